@@ -1061,6 +1061,216 @@ static int analyze_critical_chain(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+struct simulated_unit {
+        char *name;
+        char **after;   /* The units this one is ordered after that were started during boot */
+        usec_t time;
+
+        unsigned epoch;
+        usec_t finish;
+        struct simulated_unit *critical;
+};
+
+static struct simulated_unit *simulated_unit_free(struct simulated_unit *u) {
+        if (!u)
+                return NULL;
+
+        free(u->name);
+        strv_free(u->after);
+        return mfree(u);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(simulated_unit_hash_ops, char, string_hash_func, string_compare_func,
+                                              struct simulated_unit, simulated_unit_free);
+
+static int simulate_load(sd_bus *bus, const char *name, const struct boot_times *boot, Hashmap *units) {
+        _cleanup_strv_free_ char **deps = NULL;
+        struct simulated_unit *u;
+        struct unit_times *times;
+        char **c;
+        int r;
+
+        if (hashmap_contains(units, name))
+                return 0;
+
+        u = new0(struct simulated_unit, 1);
+        if (!u)
+                return log_oom();
+
+        u->name = strdup(name);
+        if (!u->name) {
+                simulated_unit_free(u);
+                return log_oom();
+        }
+
+        times = hashmap_get(unit_times_hashmap, name);
+        if (times)
+                u->time = times->time;
+
+        /* Add it before recursing, so that ordering cycles terminate */
+        r = hashmap_put(units, u->name, u);
+        if (r < 0) {
+                simulated_unit_free(u);
+                return log_oom();
+        }
+
+        r = list_dependencies_get_dependencies(bus, name, &deps);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get dependencies of %s: %m", name);
+
+        STRV_FOREACH(c, deps) {
+                if (!times_in_range(hashmap_get(unit_times_hashmap, *c), boot))
+                        continue;
+
+                if (strv_extend(&u->after, *c) < 0)
+                        return log_oom();
+
+                r = simulate_load(bus, *c, boot, units);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static usec_t simulate_finish(Hashmap *units, struct simulated_unit *u, unsigned epoch, const struct simulated_unit *skip) {
+        usec_t start = 0;
+        char **c;
+
+        /* Calculates when the unit would be done if everything ran in parallel as far as the ordering
+         * dependencies allow, with the start-up times measured in this boot. A unit that is already being
+         * looked at in this epoch is part of an ordering cycle and treated as done right away. */
+
+        if (u->epoch == epoch)
+                return u->finish;
+
+        u->epoch = epoch;
+        u->finish = 0;
+        u->critical = NULL;
+
+        STRV_FOREACH(c, u->after) {
+                struct simulated_unit *d;
+                usec_t f;
+
+                d = hashmap_get(units, *c);
+                if (!d)
+                        continue;
+
+                f = simulate_finish(units, d, epoch, skip);
+                if (f > start) {
+                        start = f;
+                        u->critical = d;
+                }
+        }
+
+        u->finish = start + (u == skip ? 0 : u->time);
+        return u->finish;
+}
+
+static int analyze_simulate(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(unit_times_freep) struct unit_times *times = NULL;
+        _cleanup_hashmap_free_ Hashmap *units = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_free_ struct simulated_unit **path = NULL;
+        char ts[FORMAT_TIMESPAN_MAX], ts2[FORMAT_TIMESPAN_MAX];
+        struct simulated_unit *target, *u;
+        struct unit_times *t;
+        struct boot_times *boot;
+        const char *name;
+        size_t n_path = 0, allocated = 0, i;
+        usec_t finish;
+        int n, r;
+
+        name = argc > 1 ? argv[1] : SPECIAL_DEFAULT_TARGET;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return bus_log_connect_error(r);
+
+        n = acquire_time_data(bus, &times);
+        if (n <= 0)
+                return n;
+
+        r = acquire_boot_times(bus, &boot);
+        if (r < 0)
+                return r;
+
+        h = hashmap_new(&string_hash_ops);
+        if (!h)
+                return log_oom();
+
+        for (t = times; t->has_data; t++) {
+                r = hashmap_put(h, t->name, t);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add entry to hashmap: %m");
+        }
+        unit_times_hashmap = h;
+
+        t = hashmap_get(h, name);
+        if (!times_in_range(t, boot))
+                return log_error_errno(SYNTHETIC_ERRNO(ENODATA), "Unit %s was not started during boot.", name);
+
+        units = hashmap_new(&simulated_unit_hash_ops);
+        if (!units)
+                return log_oom();
+
+        r = simulate_load(bus, name, boot, units);
+        if (r < 0)
+                return r;
+
+        target = hashmap_get(units, name);
+        assert(target);
+
+        finish = simulate_finish(units, target, 1, NULL);
+
+        for (u = target; u; u = u->critical) {
+                if (!GREEDY_REALLOC(path, allocated, n_path + 1))
+                        return log_oom();
+
+                path[n_path++] = u;
+        }
+
+        (void) pager_open(arg_pager_flags);
+
+        puts("The simulation uses the start-up times of the current boot and assumes that units only wait\n"
+             "for the units they are ordered after. The time a unit would be done is printed after the \"@\"\n"
+             "character, the time it took to start after the \"+\" character.\n");
+
+        printf("%s would be reached after %s, it was reached after %s.\n\n",
+               name,
+               format_timespan(ts, sizeof(ts), finish, USEC_PER_MSEC),
+               format_timespan(ts2, sizeof(ts2), usec_sub_unsigned(t->activated, boot->userspace_time), USEC_PER_MSEC));
+
+        puts("Critical path:");
+        for (i = 0; i < n_path; i++)
+                printf("  %s%s @%s +%s%s\n",
+                       path[i]->time > 0 ? ansi_highlight_red() : "",
+                       path[i]->name,
+                       format_timespan(ts, sizeof(ts), path[i]->finish, USEC_PER_MSEC),
+                       format_timespan(ts2, sizeof(ts2), path[i]->time, USEC_PER_MSEC),
+                       path[i]->time > 0 ? ansi_normal() : "");
+
+        /* Now see how much each unit on the critical path holds things up, by simulating again as if it took
+         * no time at all. Another chain of units might become the critical one then. */
+        puts("\nTime saved if a unit on the critical path started instantly:");
+        for (i = 0; i < n_path; i++) {
+                usec_t f;
+
+                if (path[i]->time == 0)
+                        continue;
+
+                f = simulate_finish(units, target, i + 2, path[i]);
+
+                printf("  %s -%s\n",
+                       path[i]->name,
+                       format_timespan(ts, sizeof(ts), usec_sub_unsigned(finish, f), USEC_PER_MSEC));
+        }
+
+        unit_times_hashmap = NULL;
+        return 0;
+}
+
 static int analyze_blame(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_(unit_times_freep) struct unit_times *times = NULL;
@@ -1368,6 +1578,128 @@ static int dump(int argc, char *argv[], void *userdata) {
         return copy_bytes(fd, STDOUT_FILENO, (uint64_t) -1, 0);
 }
 
+static int analyze_trace(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        const char *unit, *event, *detail;
+        uint64_t timestamp;
+        uint32_t pid;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return bus_log_connect_error(r);
+
+        r = bus_call_method(bus, bus_systemd_mgr, "DumpTrace", &error, &reply, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue method call DumpTrace: %s", bus_error_message(&error, r));
+
+        table = table_new("time", "unit", "event", "pid", "detail");
+        if (!table)
+                return log_oom();
+
+        (void) table_set_align_percent(table, table_get_cell(table, 0, 0), 100);
+        (void) table_set_align_percent(table, table_get_cell(table, 0, 3), 100);
+        (void) table_set_ellipsize_percent(table, table_get_cell(table, 0, 4), 100);
+
+        r = sd_bus_message_enter_container(reply, 'a', "(tsssu)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(tsssu)", &timestamp, &unit, &event, &detail, &pid)) > 0) {
+                /* Only show the events of the units that were asked for */
+                if (!strv_fnmatch_or_empty(strv_skip(argv, 1), unit, 0))
+                        continue;
+
+                r = table_add_many(table,
+                                   TABLE_TIMESPAN_MSEC, (usec_t) timestamp,
+                                   TABLE_STRING, unit,
+                                   TABLE_STRING, event);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                if (pid > 0)
+                        r = table_add_cell(table, NULL, TABLE_PID, &(pid_t) { pid });
+                else
+                        r = table_add_cell(table, NULL, TABLE_EMPTY, NULL);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                r = table_add_cell(table, NULL, TABLE_STRING, detail);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        (void) pager_open(arg_pager_flags);
+
+        return table_print(table, NULL);
+}
+
+static int analyze_memory(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        uint64_t count, size;
+        const char *category;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return bus_log_connect_error(r);
+
+        r = bus_call_method(bus, bus_systemd_mgr, "DumpMemory", &error, &reply, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue method call DumpMemory: %s", bus_error_message(&error, r));
+
+        table = table_new("category", "count", "size");
+        if (!table)
+                return log_oom();
+
+        (void) table_set_align_percent(table, table_get_cell(table, 0, 1), 100);
+        (void) table_set_align_percent(table, table_get_cell(table, 0, 2), 100);
+
+        r = sd_bus_message_enter_container(reply, 'a', "(stt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stt)", &category, &count, &size)) > 0) {
+                r = table_add_cell(table, NULL, TABLE_STRING, category);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                /* Not everything is made of discrete objects that could be counted */
+                if (count != UINT64_MAX)
+                        r = table_add_cell(table, NULL, TABLE_UINT64, &count);
+                else
+                        r = table_add_cell(table, NULL, TABLE_EMPTY, NULL);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                r = table_add_cell(table, NULL, TABLE_SIZE, &size);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        (void) pager_open(arg_pager_flags);
+
+        return table_print(table, NULL);
+}
+
 static int cat_config(int argc, char *argv[], void *userdata) {
         char **arg, **list;
         int r;
@@ -2165,9 +2497,12 @@ static int help(int argc, char *argv[], void *userdata) {
                "  [time]                   Print time required to boot the machine\n"
                "  blame                    Print list of running units ordered by time to init\n"
                "  critical-chain [UNIT...] Print a tree of the time critical chain of units\n"
+               "  simulate [UNIT]          Simulate start-up with unlimited parallelism\n"
                "  plot                     Output SVG graphic showing service initialization\n"
                "  dot [UNIT...]            Output dependency graph in %s format\n"
                "  dump                     Output state serialization of service manager\n"
+               "  trace [UNIT...]          List recent start-up events recorded by service manager\n"
+               "  memory                   Show what the service manager's memory is used for\n"
                "  cat-config               Show configuration file and drop-ins\n"
                "  unit-files               List files and symlinks for units\n"
                "  unit-paths               List load directories for units\n"
@@ -2394,6 +2729,7 @@ static int run(int argc, char *argv[]) {
                 { "time",              VERB_ANY, 1,        VERB_DEFAULT, analyze_time           },
                 { "blame",             VERB_ANY, 1,        0,            analyze_blame          },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            analyze_critical_chain },
+                { "simulate",          VERB_ANY, 2,        0,            analyze_simulate       },
                 { "plot",              VERB_ANY, 1,        0,            analyze_plot           },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            dot                    },
                 /* The following seven verbs are deprecated */
@@ -2405,6 +2741,8 @@ static int run(int argc, char *argv[]) {
                 { "get-log-target",    VERB_ANY, 1,        0,            get_log_target         },
                 { "service-watchdogs", VERB_ANY, 2,        0,            service_watchdogs      },
                 { "dump",              VERB_ANY, 1,        0,            dump                   },
+                { "trace",             VERB_ANY, VERB_ANY, 0,            analyze_trace          },
+                { "memory",            VERB_ANY, 1,        0,            analyze_memory         },
                 { "cat-config",        2,        VERB_ANY, 0,            cat_config             },
                 { "unit-files",        VERB_ANY, VERB_ANY, 0,            do_unit_files          },
                 { "unit-paths",        1,        1,        0,            dump_unit_paths        },
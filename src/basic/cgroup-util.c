@@ -160,6 +160,17 @@ bool cg_freezer_supported(void) {
         return supported;
 }
 
+bool cg_kill_supported(void) {
+        static thread_local int supported = -1;
+
+        if (supported >= 0)
+                return supported;
+
+        supported = cg_all_unified() > 0 && access("/sys/fs/cgroup/init.scope/cgroup.kill", F_OK) == 0;
+
+        return supported;
+}
+
 int cg_enumerate_subgroups(const char *controller, const char *path, DIR **_d) {
         _cleanup_free_ char *fs = NULL;
         int r;
@@ -284,7 +295,15 @@ static int cg_kill_items(
                         if ((flags & CGROUP_IGNORE_SELF) && pid == my_pid)
                                 continue;
 
-                        if (set_get(s, PID_TO_PTR(pid)) == PID_TO_PTR(pid))
+                        /* Remember the process, and skip it if we already killed it */
+                        r = set_put(s, PID_TO_PTR(pid));
+                        if (r < 0) {
+                                if (ret >= 0)
+                                        return r;
+
+                                return ret;
+                        }
+                        if (r == 0)
                                 continue;
 
                         if (log_kill)
@@ -308,14 +327,6 @@ static int cg_kill_items(
                         }
 
                         done = false;
-
-                        r = set_put(s, PID_TO_PTR(pid));
-                        if (r < 0) {
-                                if (ret >= 0)
-                                        return r;
-
-                                return ret;
-                        }
                 }
 
                 if (r < 0) {
@@ -358,6 +369,33 @@ int cg_kill(
         return cg_kill_items(controller, path, sig, flags, s, log_kill, userdata, "cgroup.threads");
 }
 
+static int cg_kill_kernel_sigkill(const char *controller, const char *path) {
+        _cleanup_free_ char *killfile = NULL;
+        int r;
+
+        assert(path);
+
+        /* Kills all processes in the cgroup subtree at once by writing to its cgroup.kill file. Unlike going
+         * through the processes one by one this is atomic, forking processes can't escape it. Returns 0 if
+         * the cgroup was empty, 1 otherwise, like cg_kill_items(). */
+
+        r = cg_is_empty_recursive(controller, path);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                return 0;
+
+        r = cg_get_path(controller, path, "cgroup.kill", &killfile);
+        if (r < 0)
+                return r;
+
+        r = write_string_file(killfile, "1", WRITE_STRING_FILE_DISABLE_BUFFER);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 int cg_kill_recursive(
                 const char *controller,
                 const char *path,
@@ -375,6 +413,24 @@ int cg_kill_recursive(
         assert(path);
         assert(sig >= 0);
 
+        /* If everything shall be SIGKILLed, and the caller is neither interested in the individual processes
+         * nor wants any of them spared, let the kernel do it. CGROUP_SIGCONT is pointless with SIGKILL
+         * anyway. The cgroups can't be removed right away though, as the processes take a moment to die. */
+        if (sig == SIGKILL && !s && !log_kill &&
+            !(flags & (CGROUP_IGNORE_SELF|CGROUP_REMOVE)) &&
+            !empty_or_root(path) &&
+            cg_kill_supported() &&
+            cg_unified_controller(controller) > 0) {
+
+                r = cg_kill_kernel_sigkill(controller, path);
+                if (r == -ENOENT) /* The cgroup is gone already */
+                        return 0;
+                if (r >= 0)
+                        return r;
+
+                log_debug_errno(r, "Failed to kill cgroup %s via cgroup.kill, killing processes individually: %m", path);
+        }
+
         if (!s) {
                 s = allocated_set = set_new(NULL);
                 if (!s)
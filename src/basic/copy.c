@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/sendfile.h>
+#include <sys/statfs.h>
 #include <sys/xattr.h>
 #include <unistd.h>
 
@@ -19,6 +20,7 @@
 #include "fs-util.h"
 #include "io-util.h"
 #include "macro.h"
+#include "missing_magic.h"
 #include "missing_syscall.h"
 #include "mountpoint-util.h"
 #include "nulstr-util.h"
@@ -578,6 +580,21 @@ static int memorize_hardlink(
         return 1;
 }
 
+static bool fd_size_is_reliable(int fd) {
+        struct statfs sfs;
+
+        /* Returns true if the file system the fd is on is one where st_size always reflects the contents of
+         * regular files. Only the common ones are listed, anything unknown is considered unreliable. */
+
+        if (fstatfs(fd, &sfs) < 0)
+                return false;
+
+        return is_fs_type(&sfs, EXT4_SUPER_MAGIC) ||
+                is_fs_type(&sfs, XFS_SB_MAGIC) ||
+                is_fs_type(&sfs, BTRFS_SUPER_MAGIC) ||
+                is_fs_type(&sfs, TMPFS_MAGIC);
+}
+
 static int fd_copy_regular(
                 int df,
                 const char *from,
@@ -620,10 +637,16 @@ static int fd_copy_regular(
         if (fdt < 0)
                 return -errno;
 
-        r = copy_bytes_full(fdf, fdt, (uint64_t) -1, copy_flags, NULL, NULL, progress, userdata);
-        if (r < 0) {
-                (void) unlinkat(dt, to, 0);
-                return r;
+        /* Empty files are common in trees (lock files, stamps, __init__.py, …), and there's nothing to
+         * copy for them. Don't bother with trying reflinks, copy_file_range() and friends then, that's a
+         * handful of syscalls per file saved. Files on procfs, sysfs and friends report a size of zero
+         * while having contents, hence only do that where the size can be trusted. */
+        if (st->st_size > 0 || !fd_size_is_reliable(fdf)) {
+                r = copy_bytes_full(fdf, fdt, (uint64_t) -1, copy_flags, NULL, NULL, progress, userdata);
+                if (r < 0) {
+                        (void) unlinkat(dt, to, 0);
+                        return r;
+                }
         }
 
         if (fchown(fdt,
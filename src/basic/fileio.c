@@ -309,14 +309,91 @@ int write_string_filef(
         return write_string_file(fn, p, flags);
 }
 
+/* A bitmask of the EOL markers we know */
+typedef enum EndOfLineMarker {
+        EOL_NONE     = 0,
+        EOL_ZERO     = 1 << 0,  /* \0 (aka NUL) */
+        EOL_TEN      = 1 << 1,  /* \n (aka NL, aka LF)  */
+        EOL_THIRTEEN = 1 << 2,  /* \r (aka CR)  */
+} EndOfLineMarker;
+
+static EndOfLineMarker categorize_eol(char c, ReadLineFlags flags) {
+
+        if (!IN_SET(flags, READ_LINE_ONLY_NUL)) {
+                if (c == '\n')
+                        return EOL_TEN;
+                if (c == '\r')
+                        return EOL_THIRTEEN;
+        }
+
+        if (c == '\0')
+                return EOL_ZERO;
+
+        return EOL_NONE;
+}
+
 int read_one_line_file(const char *fn, char **line) {
+        EndOfLineMarker previous_eol = EOL_NONE;
         _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_close_ int fd = -1;
+        char buf[LINE_MAX];
+        struct stat st;
+        size_t k, i;
+        ssize_t n;
         int r;
 
         assert(fn);
         assert(line);
 
-        r = fopen_unlocked(fn, "re", &f);
+        fd = open(fn, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* This is called a lot on small files in /proc and /sys. Read regular files with a single read()
+         * into a buffer on the stack, and only if that doesn't cover the whole file, go the slow way
+         * through stdio. A short read is EOF for regular files and the virtual files in /proc and /sys
+         * (see read_full_virtual_file() for why a second read() might even be wrong for the latter). */
+        if (S_ISREG(st.st_mode)) {
+                for (;;) {
+                        n = read(fd, buf, sizeof(buf));
+                        if (n >= 0)
+                                break;
+                        if (errno != EINTR)
+                                return -errno;
+                }
+
+                if ((size_t) n < sizeof(buf)) {
+                        for (k = 0; k < (size_t) n && categorize_eol(buf[k], 0) == EOL_NONE; k++)
+                                ;
+
+                        /* Count the EOL markers like read_line() does */
+                        for (i = k; i < (size_t) n; i++) {
+                                EndOfLineMarker eol;
+
+                                eol = categorize_eol(buf[i], 0);
+                                if (FLAGS_SET(previous_eol, EOL_ZERO) ||
+                                    eol == EOL_NONE ||
+                                    (previous_eol & eol) != 0)
+                                        break;
+
+                                previous_eol |= eol;
+                        }
+
+                        *line = strndup(buf, k);
+                        if (!*line)
+                                return -ENOMEM;
+
+                        return (int) i;
+                }
+
+                if (lseek(fd, 0, SEEK_SET) < 0)
+                        return -errno;
+        }
+
+        r = take_fdopen_unlocked(&fd, "r", &f);
         if (r < 0)
                 return r;
 
@@ -1040,29 +1117,6 @@ int fputs_with_space(FILE *f, const char *s, const char *separator, bool *space)
         return fputs(s, f);
 }
 
-/* A bitmask of the EOL markers we know */
-typedef enum EndOfLineMarker {
-        EOL_NONE     = 0,
-        EOL_ZERO     = 1 << 0,  /* \0 (aka NUL) */
-        EOL_TEN      = 1 << 1,  /* \n (aka NL, aka LF)  */
-        EOL_THIRTEEN = 1 << 2,  /* \r (aka CR)  */
-} EndOfLineMarker;
-
-static EndOfLineMarker categorize_eol(char c, ReadLineFlags flags) {
-
-        if (!IN_SET(flags, READ_LINE_ONLY_NUL)) {
-                if (c == '\n')
-                        return EOL_TEN;
-                if (c == '\r')
-                        return EOL_THIRTEEN;
-        }
-
-        if (c == '\0')
-                return EOL_ZERO;
-
-        return EOL_NONE;
-}
-
 DEFINE_TRIVIAL_CLEANUP_FUNC(FILE*, funlockfile);
 
 int read_line_full(FILE *f, size_t limit, ReadLineFlags flags, char **ret) {
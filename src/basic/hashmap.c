@@ -332,17 +332,56 @@ static uint8_t* hash_key(HashmapBase *h) {
                                : shared_hash_key;
 }
 
+/* The hash and compare functions of the most common hash_ops are open-coded here, so that lookups in maps
+ * using them don't have to go through the function pointers. Since this keys on the functions and not on
+ * the hash_ops structures, it also covers the variants with destructors, as well as any hash_ops defined
+ * elsewhere with DEFINE_HASH_OPS() on top of these functions. */
+static void base_hash_key(HashmapBase *h, const void *p, struct siphash *state) {
+        hash_func_t f = h->hash_ops->hash;
+
+        if (f == trivial_hash_func)
+                siphash24_compress(&p, sizeof(p), state);
+        else if (f == (hash_func_t) string_hash_func)
+                siphash24_compress(p, strlen(p) + 1, state);
+        else if (f == (hash_func_t) uint64_hash_func)
+                siphash24_compress(p, sizeof(uint64_t), state);
+        else
+                f(p, state);
+}
+
+static bool base_keys_equal(HashmapBase *h, const void *a, const void *b) {
+        compare_func_t f = h->hash_ops->compare;
+
+        if (f == trivial_compare_func)
+                return a == b;
+        if (f == (compare_func_t) string_compare_func)
+                return streq(a, b);
+        if (f == (compare_func_t) uint64_compare_func)
+                return *(const uint64_t*) a == *(const uint64_t*) b;
+
+        return f(a, b) == 0;
+}
+
 static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
-
-        h->hash_ops->hash(p, &state);
-
-        hash = siphash24_finalize(&state);
+        /* Keys that fit in a single word are hashed in one go */
+        if (h->hash_ops->hash == trivial_hash_func && sizeof(p) == sizeof(uint64_t))
+                hash = siphash24_uint64((uint64_t) (uintptr_t) p, hash_key(h));
+        else if (h->hash_ops->hash == (hash_func_t) uint64_hash_func)
+                hash = siphash24_uint64(*(const uint64_t*) p, hash_key(h));
+        else {
+                siphash24_init(&state, hash_key(h));
+                base_hash_key(h, p, &state);
+                hash = siphash24_finalize(&state);
+        }
 
-        return (unsigned) (hash % n_buckets(h));
+        /* Map the upper 32 bits of the hash to [0, n_buckets) by multiplication instead of taking the
+         * modulus, which avoids a 64bit division on every lookup. See Lemire, D. 2016. A fast alternative
+         * to the modulo reduction.
+         * https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/ */
+        return (unsigned) (((hash >> 32) * n_buckets(h)) >> 32);
 }
 #define bucket_hash(h, p) base_bucket_hash(HASHMAP_BASE(h), p)
 
@@ -865,11 +904,10 @@ static void hashmap_free_no_clear(HashmapBase *h) {
         assert_se(pthread_mutex_unlock(&hashmap_debug_list_mutex) == 0);
 #endif
 
-        if (h->from_pool) {
-                /* Ensure that the object didn't get migrated between threads. */
-                assert_se(is_main_thread());
+        if (h->from_pool)
+                /* This may be another thread than the one that allocated the tile, see mempool_free_tile() */
                 mempool_free_tile(hashmap_type_info[h->type].mempool, h);
-        } else
+        else
                 free(h);
 }
 
@@ -1206,7 +1244,7 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
                         return IDX_NIL;
                 if (dib == distance) {
                         e = bucket_at(h, idx);
-                        if (h->hash_ops->compare(e->key, key) == 0)
+                        if (base_keys_equal(h, e->key, key))
                                 return idx;
                 }
 
@@ -1582,6 +1620,18 @@ unsigned _hashmap_buckets(HashmapBase *h) {
         return n_buckets(h);
 }
 
+size_t _hashmap_memory_usage(HashmapBase *h) {
+        const struct hashmap_type_info *hi;
+
+        if (!h)
+                return 0;
+
+        hi = &hashmap_type_info[h->type];
+
+        return hi->head_size +
+                (h->has_indirect ? h->indirect.n_buckets * (hi->entry_size + sizeof(dib_raw_t)) : 0);
+}
+
 int _hashmap_merge(Hashmap *h, Hashmap *other) {
         Iterator i;
         unsigned idx;
@@ -273,6 +273,15 @@ static inline unsigned ordered_hashmap_buckets(OrderedHashmap *h) {
         return _hashmap_buckets(HASHMAP_BASE(h));
 }
 
+/* The memory used by the hashmap itself, i.e. not including the keys and values */
+size_t _hashmap_memory_usage(HashmapBase *h) _pure_;
+static inline size_t hashmap_memory_usage(Hashmap *h) {
+        return _hashmap_memory_usage(HASHMAP_BASE(h));
+}
+static inline size_t ordered_hashmap_memory_usage(OrderedHashmap *h) {
+        return _hashmap_memory_usage(HASHMAP_BASE(h));
+}
+
 bool _hashmap_iterate(HashmapBase *h, Iterator *i, void **value, const void **key);
 static inline bool hashmap_iterate(Hashmap *h, Iterator *i, void **value, const void **key) {
         return _hashmap_iterate(HASHMAP_BASE(h), i, value, key);
@@ -184,15 +184,20 @@ int fd_wait_for_event(int fd, int event, usec_t t) {
 static size_t nul_length(const uint8_t *p, size_t sz) {
         size_t n = 0;
 
-        while (sz > 0) {
-                if (*p != 0)
+        /* Skip over whole words of NUL bytes first, and only look at individual bytes at the end */
+        while (sz - n >= sizeof(uint64_t)) {
+                uint64_t w;
+
+                memcpy(&w, p + n, sizeof(w));
+                if (w != 0)
                         break;
 
-                n++;
-                p++;
-                sz--;
+                n += sizeof(w);
         }
 
+        while (n < sz && p[n] == 0)
+                n++;
+
         return n;
 }
 
@@ -228,8 +233,13 @@ ssize_t sparse_write(int fd, const void *p, size_t sz, size_t run_length) {
                         w = q;
                 } else if (n > 0)
                         q += n;
-                else
-                        q++;
+                else {
+                        const uint8_t *z;
+
+                        /* Jump right to the next NUL byte, memchr() is much faster at finding it than we are */
+                        z = memchr(q, 0, e - q);
+                        q = z ?: e;
+                }
         }
 
         if (q > w) {
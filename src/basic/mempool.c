@@ -7,30 +7,110 @@
 #include "macro.h"
 #include "memory-util.h"
 #include "mempool.h"
-#include "process-util.h"
 #include "util.h"
 
+/* Each thread keeps up to this many free tiles per pool for itself, anything beyond that is handed back
+ * to the pool. */
+#define MEMPOOL_CACHE_MAX 64U
+
 struct pool {
         struct pool *next;
         size_t n_tiles;
         size_t n_used;
 };
 
-void* mempool_alloc_tile(struct mempool *mp) {
-        size_t i;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static void* pop_tile(void **freelist) {
+        void *r = *freelist;
 
         /* When a tile is released we add it to the list and simply
          * place the next pointer at its offset 0. */
 
-        assert(mp->tile_size >= sizeof(void*));
-        assert(mp->at_least > 0);
+        *freelist = * (void**) r;
+        return r;
+}
 
-        if (mp->freelist) {
-                void *r;
+static void push_tile(void **freelist, void *p) {
+        * (void**) p = *freelist;
+        *freelist = p;
+}
 
-                r = mp->freelist;
-                mp->freelist = * (void**) mp->freelist;
-                return r;
+static void cache_flush(struct mempool_cache *c, unsigned n_keep) {
+        struct mempool *mp = c->mempool;
+
+        /* Hands the free tiles of this thread beyond n_keep back to the pool, so that other threads can
+         * use them. Memory in the pools is never returned to the system, hence tiles allocated by one
+         * thread may be freed and reused by any other thread. */
+
+        assert_se(pthread_mutex_lock(&mp->lock) == 0);
+
+        while (c->n_free > n_keep) {
+                push_tile(&mp->freelist, pop_tile(&c->freelist));
+                c->n_free--;
+                mp->n_free++;
+        }
+
+        assert_se(pthread_mutex_unlock(&mp->lock) == 0);
+}
+
+static void cache_key_destroy(void *p) {
+        struct mempool_cache *c = p;
+
+        /* The thread is exiting, give everything it cached back */
+
+        for (; c; c = c->next) {
+                cache_flush(c, 0);
+
+                /* In case the cache is used again by destructors that run after us */
+                c->registered = false;
+
+                assert_se(pthread_mutex_lock(&c->mempool->lock) == 0);
+                c->mempool->n_hits += c->n_hits;
+                c->mempool->n_misses += c->n_misses;
+                assert_se(pthread_mutex_unlock(&c->mempool->lock) == 0);
+        }
+}
+
+static void cache_key_create(void) {
+        assert_se(pthread_key_create(&cache_key, cache_key_destroy) == 0);
+}
+
+static void cache_register(struct mempool *mp, struct mempool_cache *c) {
+        assert_se(pthread_once(&cache_key_once, cache_key_create) == 0);
+
+        c->mempool = mp;
+        c->next = pthread_getspecific(cache_key);
+        if (pthread_setspecific(cache_key, c) != 0)
+                return; /* Try again next time */
+
+        c->registered = true;
+}
+
+static void* mempool_alloc_tile_slow(struct mempool *mp, struct mempool_cache *c) {
+        size_t i;
+        void *r;
+
+        if (!c->registered)
+                cache_register(mp, c);
+
+        assert_se(pthread_mutex_lock(&mp->lock) == 0);
+
+        /* Refill the cache from the tiles other threads handed back, to reduce the number of times we
+         * need to take the lock */
+        while (mp->freelist && c->n_free < MEMPOOL_CACHE_MAX / 2) {
+                push_tile(&c->freelist, pop_tile(&mp->freelist));
+                mp->n_free--;
+                c->n_free++;
+        }
+
+        if (c->freelist) {
+                assert_se(pthread_mutex_unlock(&mp->lock) == 0);
+
+                c->n_free--;
+                c->n_hits++;
+                return pop_tile(&c->freelist);
         }
 
         if (_unlikely_(!mp->first_pool) ||
@@ -44,8 +124,10 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 n = (size - ALIGN(sizeof(struct pool))) / mp->tile_size;
 
                 p = malloc(size);
-                if (!p)
+                if (!p) {
+                        assert_se(pthread_mutex_unlock(&mp->lock) == 0);
                         return NULL;
+                }
 
                 p->next = mp->first_pool;
                 p->n_tiles = n;
@@ -55,8 +137,30 @@ void* mempool_alloc_tile(struct mempool *mp) {
         }
 
         i = mp->first_pool->n_used++;
+        r = ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
+
+        assert_se(pthread_mutex_unlock(&mp->lock) == 0);
+
+        c->n_misses++;
+        return r;
+}
+
+void* mempool_alloc_tile(struct mempool *mp) {
+        struct mempool_cache *c;
+
+        assert(mp->tile_size >= sizeof(void*));
+        assert(mp->at_least > 0);
 
-        return ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
+        /* The fast path only touches memory of the calling thread */
+
+        c = mp->cache();
+        if (c->freelist) {
+                c->n_free--;
+                c->n_hits++;
+                return pop_tile(&c->freelist);
+        }
+
+        return mempool_alloc_tile_slow(mp, c);
 }
 
 void* mempool_alloc0_tile(struct mempool *mp) {
@@ -69,24 +173,58 @@ void* mempool_alloc0_tile(struct mempool *mp) {
 }
 
 void mempool_free_tile(struct mempool *mp, void *p) {
-        * (void**) p = mp->freelist;
-        mp->freelist = p;
+        struct mempool_cache *c;
+
+        c = mp->cache();
+        if (_unlikely_(!c->registered))
+                cache_register(mp, c);
+
+        push_tile(&c->freelist, p);
+        c->n_free++;
+
+        if (_unlikely_(c->n_free > MEMPOOL_CACHE_MAX))
+                cache_flush(c, MEMPOOL_CACHE_MAX / 2);
 }
 
 bool mempool_enabled(void) {
         static int b = -1;
+        int r;
 
-        if (!is_main_thread())
-                return false;
+        /* Pools may be used from any thread. Our own binaries use them unless $SYSTEMD_MEMPOOL=0 is set,
+         * libraries only when $SYSTEMD_MEMPOOL=1 is set explicitly, as every thread keeps a few free
+         * tiles cached, i.e. never returns them to the system, which is not something to impose on
+         * library users by default. */
 
-        if (!mempool_use_allowed)
-                b = false;
-        if (b < 0)
-                b = getenv_bool("SYSTEMD_MEMPOOL") != 0;
+        if (b < 0) {
+                r = getenv_bool("SYSTEMD_MEMPOOL");
+                b = mempool_use_allowed ? r != 0 : r > 0;
+        }
 
         return b;
 }
 
+void mempool_get_stats(struct mempool *mp, uint64_t *ret_hits, uint64_t *ret_misses) {
+        struct mempool_cache *c;
+        uint64_t hits, misses;
+
+        assert(mp);
+
+        /* Returns the counters of the threads that exited and of the calling thread. The caches of other
+         * threads that are still running are not accessible. */
+
+        c = mp->cache();
+
+        assert_se(pthread_mutex_lock(&mp->lock) == 0);
+        hits = mp->n_hits + c->n_hits;
+        misses = mp->n_misses + c->n_misses;
+        assert_se(pthread_mutex_unlock(&mp->lock) == 0);
+
+        if (ret_hits)
+                *ret_hits = hits;
+        if (ret_misses)
+                *ret_misses = misses;
+}
+
 #if VALGRIND
 void mempool_drop(struct mempool *mp) {
         struct pool *p = mp->first_pool;
@@ -1,16 +1,39 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
 
 struct pool;
+struct mempool;
+
+/* Per-thread cache of free tiles */
+struct mempool_cache {
+        void *freelist;
+        unsigned n_free;
+
+        uint64_t n_hits;              /* tiles handed out that were used before */
+        uint64_t n_misses;            /* tiles handed out that were never used before */
+
+        struct mempool *mempool;
+        struct mempool_cache *next;   /* other caches of the same thread */
+        bool registered:1;
+};
 
 struct mempool {
+        pthread_mutex_t lock;         /* protects the fields below, up to tile_size */
         struct pool *first_pool;
         void *freelist;
+        unsigned n_free;
+        uint64_t n_hits, n_misses;    /* of the threads that exited already */
+
         size_t tile_size;
         unsigned at_least;
+        struct mempool_cache* (*cache)(void);
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
@@ -18,14 +41,22 @@ void* mempool_alloc0_tile(struct mempool *mp);
 void mempool_free_tile(struct mempool *mp, void *p);
 
 #define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
+static thread_local struct mempool_cache pool_name##_cache; \
+static struct mempool_cache* pool_name##_get_cache(void) { \
+        return &pool_name##_cache; \
+} \
 static struct mempool pool_name = { \
+        .lock = PTHREAD_MUTEX_INITIALIZER, \
         .tile_size = sizeof(tile_type), \
         .at_least = alloc_at_least, \
+        .cache = pool_name##_get_cache, \
 }
 
 extern const bool mempool_use_allowed;
 bool mempool_enabled(void);
 
+void mempool_get_stats(struct mempool *mp, uint64_t *ret_hits, uint64_t *ret_misses);
+
 #if VALGRIND
 void mempool_drop(struct mempool *mp);
 #endif
@@ -704,3 +704,65 @@ static inline int missing_rt_sigqueueinfo(pid_t tgid, int sig, siginfo_t *info)
 
 #  define rt_sigqueueinfo missing_rt_sigqueueinfo
 #endif
+
+/* ======================================================================= */
+
+/* should be always defined, see kernel 39036cd2727395c3369b1051005da74059a85317 */
+#if defined(__alpha__)
+#  define systemd_NR_io_uring_setup 535
+#  define systemd_NR_io_uring_enter 536
+#else
+#  define systemd_NR_io_uring_setup 425
+#  define systemd_NR_io_uring_enter 426
+#endif
+
+/* may be (invalid) negative number due to libseccomp, see PR 13319 */
+#if defined __NR_io_uring_setup && __NR_io_uring_setup >= 0
+#  if defined systemd_NR_io_uring_setup
+assert_cc(__NR_io_uring_setup == systemd_NR_io_uring_setup);
+#  endif
+#else
+#  if defined __NR_io_uring_setup
+#    undef __NR_io_uring_setup
+#  endif
+#  define __NR_io_uring_setup systemd_NR_io_uring_setup
+#endif
+
+#if defined __NR_io_uring_enter && __NR_io_uring_enter >= 0
+#  if defined systemd_NR_io_uring_enter
+assert_cc(__NR_io_uring_enter == systemd_NR_io_uring_enter);
+#  endif
+#else
+#  if defined __NR_io_uring_enter
+#    undef __NR_io_uring_enter
+#  endif
+#  define __NR_io_uring_enter systemd_NR_io_uring_enter
+#endif
+
+struct io_uring_params;
+
+#if !HAVE_IO_URING_SETUP
+static inline int missing_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+#  ifdef __NR_io_uring_setup
+        return syscall(__NR_io_uring_setup, entries, p);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+
+#  define io_uring_setup missing_io_uring_setup
+#endif
+
+#if !HAVE_IO_URING_ENTER
+static inline int missing_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+#  ifdef __NR_io_uring_enter
+        return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+
+#  define io_uring_enter missing_io_uring_enter
+#endif
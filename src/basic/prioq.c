@@ -7,7 +7,7 @@
  * priority. Insertion and removal are Θ(log n). Optionally, the caller can
  * provide a pointer to an index which will be kept up-to-date by the prioq.
  *
- * The underlying algorithm used in this implementation is a Heap.
+ * The underlying algorithm used in this implementation is a 4-ary Heap.
  */
 
 #include <errno.h>
@@ -17,6 +17,12 @@
 #include "hashmap.h"
 #include "prioq.h"
 
+/* The number of children of each node. Compared to a binary heap, a 4-ary one is half as deep. That
+ * halves the number of comparisons when moving items up, and reduces it by a quarter when moving items
+ * down, which is what matters here, as the comparison functions are called indirectly and usually have
+ * to look at the objects. */
+#define PRIOQ_ARITY 4U
+
 struct prioq_item {
         void *data;
         unsigned *idx;
@@ -64,101 +70,110 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
-static void swap(Prioq *q, unsigned j, unsigned k) {
+static void place_item(Prioq *q, unsigned k, struct prioq_item item) {
         assert(q);
-        assert(j < q->n_items);
         assert(k < q->n_items);
 
-        assert(!q->items[j].idx || *(q->items[j].idx) == j);
-        assert(!q->items[k].idx || *(q->items[k].idx) == k);
-
-        SWAP_TWO(q->items[j].data, q->items[k].data);
-        SWAP_TWO(q->items[j].idx, q->items[k].idx);
-
-        if (q->items[j].idx)
-                *q->items[j].idx = j;
-
-        if (q->items[k].idx)
-                *q->items[k].idx = k;
+        q->items[k] = item;
+        if (item.idx)
+                *item.idx = k;
 }
 
+/* Both shuffle functions move a hole through the heap instead of swapping items, and put the item that
+ * is being moved into its final place only once. */
+
 static unsigned shuffle_up(Prioq *q, unsigned idx) {
+        struct prioq_item item;
+
         assert(q);
         assert(idx < q->n_items);
 
+        item = q->items[idx];
+
         while (idx > 0) {
                 unsigned k;
 
-                k = (idx-1)/2;
+                k = (idx-1)/PRIOQ_ARITY;
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) <= 0)
+                if (q->compare_func(q->items[k].data, item.data) <= 0)
                         break;
 
-                swap(q, idx, k);
+                place_item(q, idx, q->items[k]);
                 idx = k;
         }
 
+        place_item(q, idx, item);
         return idx;
 }
 
 static unsigned shuffle_down(Prioq *q, unsigned idx) {
+        struct prioq_item item;
+
         assert(q);
+        assert(idx < q->n_items);
 
-        for (;;) {
-                unsigned j, k, s;
+        item = q->items[idx];
 
-                k = (idx+1)*2; /* right child */
-                j = k-1;       /* left child */
+        for (;;) {
+                unsigned j, k, s, end;
 
-                if (j >= q->n_items)
+                /* Do we have any children? */
+                if (q->n_items < 2 || idx > (q->n_items - 2) / PRIOQ_ARITY)
                         break;
 
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
+                k = idx*PRIOQ_ARITY + 1; /* first child */
+                end = MIN(k + PRIOQ_ARITY, q->n_items);
 
-                        /* So our left child is smaller than we are, let's
-                         * remember this fact */
-                        s = j;
-                else
-                        s = idx;
+                /* Find the smallest of the children… */
+                s = k;
+                for (j = k + 1; j < end; j++)
+                        if (q->compare_func(q->items[j].data, q->items[s].data) < 0)
+                                s = j;
 
-                if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
-
-                        /* So our right child is smaller than we are, let's
-                         * remember this fact */
-                        s = k;
-
-                /* s now points to the smallest of the three items */
-
-                if (s == idx)
-                        /* No swap necessary, we're done */
+                /* … and stop if it's not smaller than we are */
+                if (q->compare_func(q->items[s].data, item.data) >= 0)
                         break;
 
-                swap(q, idx, s);
+                place_item(q, idx, q->items[s]);
                 idx = s;
         }
 
+        place_item(q, idx, item);
         return idx;
 }
 
+static int prioq_make_room(Prioq *q, unsigned n_add) {
+        struct prioq_item *j;
+        unsigned n;
+
+        assert(q);
+
+        if (q->n_items + n_add < q->n_items)
+                return -ENOMEM;
+
+        if (q->n_items + n_add <= q->n_allocated)
+                return 0;
+
+        n = MAX((q->n_items + n_add) * 2, 16u);
+        j = reallocarray(q->items, n, sizeof(struct prioq_item));
+        if (!j)
+                return -ENOMEM;
+
+        q->items = j;
+        q->n_allocated = n;
+        return 0;
+}
+
 int prioq_put(Prioq *q, void *data, unsigned *idx) {
         struct prioq_item *i;
         unsigned k;
+        int r;
 
         assert(q);
 
-        if (q->n_items >= q->n_allocated) {
-                unsigned n;
-                struct prioq_item *j;
-
-                n = MAX((q->n_items+1) * 2, 16u);
-                j = reallocarray(q->items, n, sizeof(struct prioq_item));
-                if (!j)
-                        return -ENOMEM;
-
-                q->items = j;
-                q->n_allocated = n;
-        }
+        r = prioq_make_room(q, 1);
+        if (r < 0)
+                return r;
 
         k = q->n_items++;
         i = q->items + k;
@@ -173,6 +188,48 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
         return 0;
 }
 
+int prioq_put_many(Prioq *q, void **data, unsigned **idx, unsigned n) {
+        unsigned n_old, k;
+        int r;
+
+        assert(q);
+        assert(data || n == 0);
+
+        /* Adds n items at once. The idx array is optional, as are its elements. If more items are added
+         * than the queue already has, the heap is rebuilt bottom up, which is O(n) instead of
+         * O(n log n) for putting the items one by one. */
+
+        r = prioq_make_room(q, n);
+        if (r < 0)
+                return r;
+
+        n_old = q->n_items;
+
+        for (k = 0; k < n; k++) {
+                q->items[n_old + k] = (struct prioq_item) {
+                        .data = data[k],
+                        .idx = idx ? idx[k] : NULL,
+                };
+
+                if (q->items[n_old + k].idx)
+                        *q->items[n_old + k].idx = n_old + k;
+        }
+
+        q->n_items += n;
+
+        if (n > n_old) {
+                if (q->n_items < 2)
+                        return 0;
+
+                for (k = (q->n_items - 2) / PRIOQ_ARITY + 1; k > 0; k--)
+                        shuffle_down(q, k - 1);
+        } else
+                for (k = n_old; k < q->n_items; k++)
+                        shuffle_up(q, k);
+
+        return 0;
+}
+
 static void remove_item(Prioq *q, struct prioq_item *i) {
         struct prioq_item *l;
 
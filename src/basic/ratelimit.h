@@ -17,4 +17,14 @@ static inline void ratelimit_reset(RateLimit *rl) {
         rl->num = rl->begin = 0;
 }
 
+static inline bool ratelimit_configured(const RateLimit *rl) {
+        return rl->interval > 0 && rl->burst > 0;
+}
+
+static inline usec_t ratelimit_end(const RateLimit *rl) {
+        /* The end of the current interval, i.e. the point in time from which on ratelimit_below() will let
+         * us through again */
+        return usec_add(rl->begin, rl->interval);
+}
+
 bool ratelimit_below(RateLimit *r);
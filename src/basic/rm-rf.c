@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
@@ -13,6 +14,7 @@
 #include "fd-util.h"
 #include "log.h"
 #include "macro.h"
+#include "missing_stat.h"
 #include "mountpoint-util.h"
 #include "path-util.h"
 #include "rm-rf.h"
@@ -104,40 +106,39 @@ int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
         }
 
         FOREACH_DIRENT_ALL(de, d, return -errno) {
+                STRUCT_STATX_DEFINE(sx);
                 bool is_dir;
-                struct stat st;
 
                 if (dot_or_dot_dot(de->d_name))
                         continue;
 
-                if (de->d_type == DT_UNKNOWN ||
-                    (de->d_type == DT_DIR && (root_dev || (flags & REMOVE_SUBVOLUME)))) {
-                        if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                                if (ret == 0 && errno != ENOENT)
-                                        ret = -errno;
+                if (IN_SET(de->d_type, DT_UNKNOWN, DT_DIR)) {
+                        /* A single statx() tells us the inode type, device, inode number and — on new
+                         * enough kernels — whether the entry is a mount point, i.e. everything we need
+                         * to know about a directory before descending into it. */
+                        r = statx_fallback(fd, de->d_name, AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT, STATX_TYPE|STATX_INO, &sx);
+                        if (r < 0) {
+                                if (ret == 0 && r != -ENOENT)
+                                        ret = r;
                                 continue;
                         }
 
-                        is_dir = S_ISDIR(st.st_mode);
+                        is_dir = S_ISDIR(sx.stx_mode);
                 } else
-                        is_dir = de->d_type == DT_DIR;
+                        is_dir = false;
 
                 if (is_dir) {
                         _cleanup_close_ int subdir_fd = -1;
 
                         /* if root_dev is set, remove subdirectories only if device is same */
-                        if (root_dev && st.st_dev != root_dev->st_dev)
+                        if (root_dev && makedev(sx.stx_dev_major, sx.stx_dev_minor) != root_dev->st_dev)
                                 continue;
 
-                        subdir_fd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
-                        if (subdir_fd < 0) {
-                                if (ret == 0 && errno != ENOENT)
-                                        ret = -errno;
-                                continue;
-                        }
-
                         /* Stop at mount points */
-                        r = fd_is_mount_point(fd, de->d_name, 0);
+                        if (FLAGS_SET(sx.stx_attributes_mask, STATX_ATTR_MOUNT_ROOT))
+                                r = FLAGS_SET(sx.stx_attributes, STATX_ATTR_MOUNT_ROOT);
+                        else
+                                r = fd_is_mount_point(fd, de->d_name, 0);
                         if (r < 0) {
                                 if (ret == 0 && r != -ENOENT)
                                         ret = r;
@@ -147,7 +148,14 @@ int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
                         if (r > 0)
                                 continue;
 
-                        if ((flags & REMOVE_SUBVOLUME) && st.st_ino == 256) {
+                        subdir_fd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
+                        if (subdir_fd < 0) {
+                                if (ret == 0 && errno != ENOENT)
+                                        ret = -errno;
+                                continue;
+                        }
+
+                        if ((flags & REMOVE_SUBVOLUME) && sx.stx_ino == 256) {
 
                                 /* This could be a subvolume, try to remove it */
 
@@ -77,6 +77,10 @@ static inline unsigned set_buckets(const Set *s) {
         return _hashmap_buckets(HASHMAP_BASE((Set *) s));
 }
 
+static inline size_t set_memory_usage(const Set *s) {
+        return _hashmap_memory_usage(HASHMAP_BASE((Set *) s));
+}
+
 static inline bool set_iterate(const Set *s, Iterator *i, void **value) {
         return _hashmap_iterate(HASHMAP_BASE((Set*) s), i, value, NULL);
 }
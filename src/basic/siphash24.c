@@ -17,6 +17,7 @@
     coding style)
 */
 
+#include <endian.h>
 #include <stdio.h>
 
 #include "macro.h"
@@ -187,6 +188,27 @@ uint64_t siphash24_finalize(struct siphash *state) {
         return state->v0 ^ state->v1 ^ state->v2  ^ state->v3;
 }
 
+uint64_t siphash24_uint64(uint64_t in, const uint8_t k[static 16]) {
+        struct siphash state;
+        uint64_t m;
+
+        assert(k);
+
+        /* Equivalent to siphash24(&in, sizeof(in), k), but without going through the buffering in
+         * siphash24_compress(), as a single word never needs any. */
+
+        siphash24_init(&state, k);
+
+        m = le64toh(in);
+        state.v3 ^= m;
+        sipround(&state);
+        sipround(&state);
+        state.v0 ^= m;
+        state.inlen = sizeof(in);
+
+        return siphash24_finalize(&state);
+}
+
 uint64_t siphash24(const void *in, size_t inlen, const uint8_t k[static 16]) {
         struct siphash state;
 
@@ -5,7 +5,6 @@
 #include <string.h>
 
 #include "alloc-util.h"
-#include "sort-util.h"
 #include "strbuf.h"
 
 /*
@@ -36,6 +35,7 @@ struct strbuf *strbuf_new(void) {
                 .buf = new0(char, 1),
                 .root = new0(struct strbuf_node, 1),
                 .len = 1,
+                .allocated = 1,
                 .nodes_count = 1,
         };
         if (!str->buf || !str->root) {
@@ -104,12 +104,31 @@ static void bubbleinsert(struct strbuf_node *node,
         node->children_count++;
 }
 
+static struct strbuf_node *strbuf_node_lookup(const struct strbuf_node *node, uint8_t c) {
+        size_t left = 0, right = node->children_count;
+
+        /* This is the hot path when looking for suffixes, hence bisect here directly rather than going
+         * through bsearch() and a comparison callback for each step */
+
+        while (right > left) {
+                size_t middle = (left + right) / 2;
+
+                if (node->children[middle].c == c)
+                        return node->children[middle].child;
+                if (node->children[middle].c < c)
+                        left = middle + 1;
+                else
+                        right = middle;
+        }
+
+        return NULL;
+}
+
 /* add string, return the index/offset into the buffer */
 ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
         uint8_t c;
         struct strbuf_node *node;
         size_t depth;
-        char *buf_new;
         struct strbuf_child_entry *child;
         struct strbuf_node *node_child;
         ssize_t off;
@@ -128,8 +147,6 @@ ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
 
         node = str->root;
         for (depth = 0; depth <= len; depth++) {
-                struct strbuf_child_entry search;
-
                 /* match against current node */
                 off = node->value_off + node->value_len - len;
                 if (depth == len || (node->value_len >= len && memcmp(str->buf + off, s, len) == 0)) {
@@ -141,18 +158,15 @@ ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
                 c = s[len - 1 - depth];
 
                 /* lookup child node */
-                search.c = c;
-                child = typesafe_bsearch(&search, node->children, node->children_count, strbuf_children_cmp);
-                if (!child)
+                node_child = strbuf_node_lookup(node, c);
+                if (!node_child)
                         break;
-                node = child->child;
+                node = node_child;
         }
 
         /* add new string */
-        buf_new = realloc(str->buf, str->len + len+1);
-        if (!buf_new)
+        if (!GREEDY_REALLOC(str->buf, str->allocated, str->len + len + 1))
                 return -ENOMEM;
-        str->buf = buf_new;
         off = str->len;
         memcpy(str->buf + off, s, len);
         str->len += len;
@@ -167,16 +181,21 @@ ssize_t strbuf_add_string(struct strbuf *str, const char *s, size_t len) {
                 .value_len = len,
         };
 
-        /* extend array, add new entry, sort for bisection */
-        child = reallocarray(node->children, node->children_count + 1, sizeof(struct strbuf_child_entry));
-        if (!child) {
-                free(node_child);
-                return -ENOMEM;
+        /* extend array, add new entry, sort for bisection. The array is grown in powers of two, so that we
+         * don't need to reallocate it for every child added. */
+        if ((node->children_count & (node->children_count - 1)) == 0) {
+                child = reallocarray(node->children, node->children_count == 0 ? 1 : node->children_count * 2,
+                                     sizeof(struct strbuf_child_entry));
+                if (!child) {
+                        free(node_child);
+                        return -ENOMEM;
+                }
+
+                node->children = child;
         }
 
         str->nodes_count++;
 
-        node->children = child;
         bubbleinsert(node, c, node_child);
 
         return off;
@@ -710,6 +710,10 @@ char *strip_tab_ansi(char **ibuf, size_t *_isz, size_t highlight[2]) {
 
         isz = _isz ? *_isz : strlen(*ibuf);
 
+        /* Most strings need none of this, don't bother setting up a stream for them */
+        if (!memchr(*ibuf, '\t', isz) && !memchr(*ibuf, '\x1B', isz) && !memchr(*ibuf, '\r', isz))
+                return *ibuf;
+
         /* Note we turn off internal locking on f for performance reasons. It's safe to do so since we
          * created f here and it doesn't leave our scope. */
         f = open_memstream_unlocked(&obuf, &osz);
@@ -77,6 +77,14 @@ static inline bool gid_is_dynamic(gid_t gid) {
         return uid_is_dynamic((uid_t) gid);
 }
 
+/* The UID range systemd-homed allocates from */
+#define HOME_UID_MIN 60001
+#define HOME_UID_MAX 60513
+
+static inline bool uid_is_home(uid_t uid) {
+        return HOME_UID_MIN <= uid && uid <= HOME_UID_MAX;
+}
+
 static inline bool uid_is_container(uid_t uid) {
         return CONTAINER_UID_BASE_MIN <= uid && uid <= CONTAINER_UID_BASE_MAX;
 }
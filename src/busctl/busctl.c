@@ -1330,7 +1330,6 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
 
                 if (m) {
                         dump(m, stdout);
-                        fflush(stdout);
 
                         if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0) {
                                 log_info("Connection terminated, exiting.");
@@ -1343,6 +1342,12 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 if (r > 0)
                         continue;
 
+                /* Only write out what we have buffered once there's nothing left to process, so that we
+                 * don't issue a write() for each message when the bus is busy. */
+                r = fflush_and_check(stdout);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write output: %m");
+
                 r = sd_bus_wait(bus, (uint64_t) -1);
                 if (r < 0)
                         return log_error_errno(r, "Failed to wait for bus: %m");
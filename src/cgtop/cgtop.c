@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
 #include <stdint.h>
@@ -24,6 +25,7 @@
 #include "pretty-print.h"
 #include "process-util.h"
 #include "procfs-util.h"
+#include "rlimit-util.h"
 #include "sort-util.h"
 #include "stdio-util.h"
 #include "strv.h"
@@ -52,6 +54,9 @@ typedef struct Group {
         uint64_t io_input, io_output;
         nsec_t io_timestamp;
         uint64_t io_input_bps, io_output_bps;
+
+        /* The attribute files are kept open between iterations, so that each refresh only costs a pread() */
+        int pids_fd, memory_fd, io_fd, cpu_fd;
 } Group;
 
 static unsigned arg_depth = 3;
@@ -87,6 +92,11 @@ static Group *group_free(Group *g) {
         if (!g)
                 return NULL;
 
+        safe_close(g->pids_fd);
+        safe_close(g->memory_fd);
+        safe_close(g->io_fd);
+        safe_close(g->cpu_fd);
+
         free(g->path);
         return mfree(g);
 }
@@ -125,6 +135,180 @@ static bool is_root_cgroup(const char *path) {
         return empty_or_root(path);
 }
 
+static ssize_t group_pread_attribute(
+                int *fd,
+                const char *controller,
+                const char *path,
+                const char *attribute,
+                char *buf,
+                size_t size,
+                off_t offset) {
+
+        unsigned attempt;
+        int r;
+
+        assert(fd);
+        assert(buf);
+        assert(size > 0);
+
+        for (attempt = 0;; attempt++) {
+                ssize_t n;
+
+                if (*fd < 0) {
+                        _cleanup_free_ char *p = NULL;
+
+                        r = cg_get_path(controller, path, attribute, &p);
+                        if (r < 0)
+                                return r;
+
+                        *fd = open(p, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                        if (*fd < 0)
+                                return -errno;
+                }
+
+                /* Leave room for the trailing NUL byte */
+                n = pread(*fd, buf, size - 1, offset);
+                if (n >= 0) {
+                        buf[n] = 0;
+                        return n;
+                }
+
+                /* The group was removed, and possibly created again under the same name since the last
+                 * iteration. Try again with a freshly opened file, but only once. */
+                if (errno != ENODEV || offset > 0 || attempt > 0)
+                        return -errno;
+
+                *fd = safe_close(*fd);
+        }
+}
+
+static int group_read_attribute(
+                int *fd,
+                const char *controller,
+                const char *path,
+                const char *attribute,
+                char *buf,
+                size_t size) {
+
+        ssize_t n;
+
+        n = group_pread_attribute(fd, controller, path, attribute, buf, size, 0);
+        if (n < 0)
+                return (int) n;
+        if ((size_t) n >= size - 1)
+                return -ENOBUFS;
+
+        delete_trailing_chars(buf, NEWLINE);
+        return 0;
+}
+
+static int group_read_attribute_u64(
+                int *fd,
+                const char *controller,
+                const char *path,
+                const char *attribute,
+                uint64_t *ret) {
+
+        char buf[DECIMAL_STR_MAX(uint64_t) + 2];
+        int r;
+
+        r = group_read_attribute(fd, controller, path, attribute, buf, sizeof(buf));
+        if (r < 0)
+                return r;
+
+        return safe_atou64(buf, ret);
+}
+
+static void parse_io_stat_line(char *l, bool unified, uint64_t *rd, uint64_t *wr) {
+        uint64_t k, *q;
+
+        /* Trim and skip the device */
+        l = strstrip(l);
+        l += strcspn(l, WHITESPACE);
+        l += strspn(l, WHITESPACE);
+
+        if (unified) {
+                while (!isempty(l)) {
+                        if (sscanf(l, "rbytes=%" SCNu64, &k))
+                                *rd += k;
+                        else if (sscanf(l, "wbytes=%" SCNu64, &k))
+                                *wr += k;
+
+                        l += strcspn(l, WHITESPACE);
+                        l += strspn(l, WHITESPACE);
+                }
+        } else {
+                if (first_word(l, "Read")) {
+                        l += 4;
+                        q = rd;
+                } else if (first_word(l, "Write")) {
+                        l += 5;
+                        q = wr;
+                } else
+                        return;
+
+                l += strspn(l, WHITESPACE);
+                if (safe_atou64(l, &k) < 0)
+                        return;
+
+                *q += k;
+        }
+}
+
+static int group_read_io_stat(
+                Group *g,
+                const char *controller,
+                bool unified,
+                uint64_t *ret_rd,
+                uint64_t *ret_wr) {
+
+        char buf[4096];
+        uint64_t rd = 0, wr = 0;
+        size_t n = 0;
+        off_t offset = 0;
+
+        assert(g);
+
+        /* The file may have a line per block device, hence read it in chunks and parse the complete lines
+         * directly in the buffer, carrying over a partial line at the end to the next chunk. */
+
+        for (;;) {
+                char *l, *e;
+                ssize_t k;
+
+                k = group_pread_attribute(&g->io_fd, controller, g->path,
+                                          unified ? "io.stat" : "blkio.io_service_bytes",
+                                          buf + n, sizeof(buf) - n, offset);
+                if (k < 0)
+                        return (int) k;
+
+                offset += k;
+                n += k;
+
+                for (l = buf; (e = memchr(l, '\n', buf + n - l)); l = e + 1) {
+                        *e = 0;
+                        parse_io_stat_line(l, unified, &rd, &wr);
+                }
+
+                if (k == 0) {
+                        /* The last line might lack the newline */
+                        if (l < buf + n)
+                                parse_io_stat_line(l, unified, &rd, &wr);
+                        break;
+                }
+
+                n = buf + n - l;
+                if (n >= sizeof(buf) - 1)
+                        return -ENOBUFS;
+
+                memmove(buf, l, n);
+        }
+
+        *ret_rd = rd;
+        *ret_wr = wr;
+        return 0;
+}
+
 static int process(
                 const char *controller,
                 const char *path,
@@ -152,6 +336,8 @@ static int process(
                         if (!g)
                                 return -ENOMEM;
 
+                        g->pids_fd = g->memory_fd = g->io_fd = g->cpu_fd = -1;
+
                         g->path = strdup(path);
                         if (!g->path) {
                                 group_free(g);
@@ -202,21 +388,11 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        r = cg_get_path(controller, path, "pids.current", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(&g->pids_fd, controller, path, "pids.current", &g->n_tasks);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &g->n_tasks);
-                        if (r < 0)
-                                return r;
                 }
 
                 if (g->n_tasks > 0)
@@ -229,24 +405,13 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        if (all_unified)
-                                r = cg_get_path(controller, path, "memory.current", &p);
-                        else
-                                r = cg_get_path(controller, path, "memory.usage_in_bytes", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(&g->memory_fd, controller, path,
+                                                     all_unified ? "memory.current" : "memory.usage_in_bytes",
+                                                     &g->memory);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &g->memory);
-                        if (r < 0)
-                                return r;
                 }
 
                 if (g->memory > 0)
@@ -254,67 +419,15 @@ static int process(
 
         } else if ((streq(controller, "io") && all_unified) ||
                    (streq(controller, "blkio") && !all_unified)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                _cleanup_free_ char *p = NULL;
-                uint64_t wr = 0, rd = 0;
+                uint64_t wr, rd;
                 nsec_t timestamp;
 
-                r = cg_get_path(controller, path, all_unified ? "io.stat" : "blkio.io_service_bytes", &p);
+                r = group_read_io_stat(g, controller, all_unified, &rd, &wr);
+                if (r == -ENOENT)
+                        return 0;
                 if (r < 0)
                         return r;
 
-                f = fopen(p, "re");
-                if (!f) {
-                        if (errno == ENOENT)
-                                return 0;
-                        return -errno;
-                }
-
-                for (;;) {
-                        _cleanup_free_ char *line = NULL;
-                        uint64_t k, *q;
-                        char *l;
-
-                        r = read_line(f, LONG_LINE_MAX, &line);
-                        if (r < 0)
-                                return r;
-                        if (r == 0)
-                                break;
-
-                        /* Trim and skip the device */
-                        l = strstrip(line);
-                        l += strcspn(l, WHITESPACE);
-                        l += strspn(l, WHITESPACE);
-
-                        if (all_unified) {
-                                while (!isempty(l)) {
-                                        if (sscanf(l, "rbytes=%" SCNu64, &k))
-                                                rd += k;
-                                        else if (sscanf(l, "wbytes=%" SCNu64, &k))
-                                                wr += k;
-
-                                        l += strcspn(l, WHITESPACE);
-                                        l += strspn(l, WHITESPACE);
-                                }
-                        } else {
-                                if (first_word(l, "Read")) {
-                                        l += 4;
-                                        q = &rd;
-                                } else if (first_word(l, "Write")) {
-                                        l += 5;
-                                        q = &wr;
-                                } else
-                                        continue;
-
-                                l += strspn(l, WHITESPACE);
-                                r = safe_atou64(l, &k);
-                                if (r < 0)
-                                        continue;
-
-                                *q += k;
-                        }
-                }
-
                 timestamp = now_nsec(CLOCK_MONOTONIC);
 
                 if (g->io_iteration == iteration - 1) {
@@ -346,7 +459,6 @@ static int process(
                 g->io_timestamp = timestamp;
                 g->io_iteration = iteration;
         } else if (STR_IN_SET(controller, "cpu", "cpuacct") || cpu_accounting_is_cheap()) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
                 uint64_t new_usage;
                 nsec_t timestamp;
 
@@ -355,18 +467,30 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else if (all_unified) {
-                        _cleanup_free_ char *val = NULL;
+                        char buf[4096], *l, *v = NULL;
 
                         if (!streq(controller, "cpu"))
                                 return 0;
 
-                        r = cg_get_keyed_attribute("cpu", path, "cpu.stat", STRV_MAKE("usage_usec"), &val);
-                        if (IN_SET(r, -ENOENT, -ENXIO))
+                        r = group_read_attribute(&g->cpu_fd, "cpu", path, "cpu.stat", buf, sizeof(buf));
+                        if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(val, &new_usage);
+                        for (l = buf; l; l = strchr(l, '\n')) {
+                                l += *l == '\n';
+
+                                v = startswith(l, "usage_usec ");
+                                if (v) {
+                                        v[strcspn(v, NEWLINE)] = 0;
+                                        break;
+                                }
+                        }
+                        if (!v)
+                                return 0;
+
+                        r = safe_atou64(v, &new_usage);
                         if (r < 0)
                                 return r;
 
@@ -375,19 +499,11 @@ static int process(
                         if (!streq(controller, "cpuacct"))
                                 return 0;
 
-                        r = cg_get_path(controller, path, "cpuacct.usage", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(&g->cpu_fd, controller, path, "cpuacct.usage", &new_usage);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &new_usage);
-                        if (r < 0)
-                                return r;
                 }
 
                 timestamp = now_nsec(CLOCK_MONOTONIC);
@@ -928,6 +1044,9 @@ static int run(int argc, char *argv[]) {
                 return log_error_errno(r, "Failed to get root control group path: %m");
         log_debug("CGroup path: %s", root);
 
+        /* We keep a couple of attribute files open for each group */
+        (void) rlimit_nofile_bump(HIGH_RLIMIT_NOFILE);
+
         a = hashmap_new(&group_hash_ops);
         b = hashmap_new(&group_hash_ops);
         if (!a || !b)
@@ -18,10 +18,13 @@
 #include "bpf-firewall.h"
 #include "bpf-program.h"
 #include "fd-util.h"
+#include "hashmap.h"
+#include "in-addr-util.h"
 #include "ip-address-access.h"
 #include "memory-util.h"
 #include "missing_syscall.h"
 #include "unit.h"
+#include "string-util.h"
 #include "strv.h"
 #include "virt.h"
 
@@ -35,6 +38,32 @@ enum {
         ACCESS_DENIED  = 2,
 };
 
+/* An LPM trie map with the addresses of one family from the allow or deny lists of a unit and its slices. Units
+ * only ever read from these maps, hence units which end up with identical lists (which is common, since most of
+ * them inherit their lists from their slices) share one map, keyed by its contents. */
+struct BPFAccessMap {
+        unsigned n_ref;
+        Manager *manager;
+        char *key;
+        int fd;
+};
+
+static BPFAccessMap* bpf_access_map_free(BPFAccessMap *m) {
+        if (!m)
+                return NULL;
+
+        if (m->manager && m->key)
+                hashmap_remove_value(m->manager->bpf_access_maps, m->key, m);
+
+        free(m->key);
+        safe_close(m->fd);
+
+        return mfree(m);
+}
+
+DEFINE_PRIVATE_TRIVIAL_REF_FUNC(BPFAccessMap, bpf_access_map);
+DEFINE_TRIVIAL_UNREF_FUNC(BPFAccessMap, bpf_access_map, bpf_access_map_free);
+
 /* Compile instructions for one list of addresses, one direction and one specific verdict on matches. */
 
 static int add_lookup_instructions(
@@ -204,10 +233,10 @@ static int bpf_firewall_compile_bpf(
                 u->ip_accounting_egress_map_fd;
 
         access_enabled =
-                u->ipv4_allow_map_fd >= 0 ||
-                u->ipv6_allow_map_fd >= 0 ||
-                u->ipv4_deny_map_fd >= 0 ||
-                u->ipv6_deny_map_fd >= 0 ||
+                u->ipv4_allow_map ||
+                u->ipv6_allow_map ||
+                u->ipv4_deny_map ||
+                u->ipv6_deny_map ||
                 ip_allow_any ||
                 ip_deny_any;
 
@@ -233,26 +262,26 @@ static int bpf_firewall_compile_bpf(
                  * - Otherwise, access will be granted
                  */
 
-                if (u->ipv4_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
+                if (u->ipv4_deny_map) {
+                        r = add_lookup_instructions(p, u->ipv4_deny_map->fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
+                if (u->ipv6_deny_map) {
+                        r = add_lookup_instructions(p, u->ipv6_deny_map->fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv4_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
+                if (u->ipv4_allow_map) {
+                        r = add_lookup_instructions(p, u->ipv4_allow_map->fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
+                if (u->ipv6_allow_map) {
+                        r = add_lookup_instructions(p, u->ipv6_allow_map->fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
@@ -378,6 +407,9 @@ static int bpf_firewall_add_access_items(
                 switch (a->family) {
 
                 case AF_INET:
+                        if (ipv4_map_fd < 0)
+                                break;
+
                         key_ipv4->prefixlen = a->prefixlen;
                         memcpy(key_ipv4->data, &a->address, sizeof(uint32_t));
 
@@ -388,6 +420,9 @@ static int bpf_firewall_add_access_items(
                         break;
 
                 case AF_INET6:
+                        if (ipv6_map_fd < 0)
+                                break;
+
                         key_ipv6->prefixlen = a->prefixlen;
                         memcpy(key_ipv6->data, &a->address, 4 * sizeof(uint32_t));
 
@@ -405,21 +440,138 @@ static int bpf_firewall_add_access_items(
         return 0;
 }
 
+static int bpf_firewall_access_map_key(Unit *u, int verdict, int family, char **ret) {
+        _cleanup_free_ char *key = NULL;
+        Unit *p;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        key = strdup(verdict == ACCESS_ALLOWED ? "allow" : "deny");
+        if (!key)
+                return -ENOMEM;
+
+        if (!strextend(&key, family == AF_INET ? " ipv4" : " ipv6", NULL))
+                return -ENOMEM;
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                IPAddressAccessItem *a;
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                LIST_FOREACH(items, a, verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny) {
+                        _cleanup_free_ char *t = NULL;
+
+                        if (a->family != family)
+                                continue;
+
+                        r = in_addr_prefix_to_string(a->family, &a->address, a->prefixlen, &t);
+                        if (r < 0)
+                                return r;
+
+                        if (!strextend(&key, " ", t, NULL))
+                                return -ENOMEM;
+                }
+        }
+
+        *ret = TAKE_PTR(key);
+        return 0;
+}
+
+static int bpf_firewall_acquire_access_map(
+                Unit *u,
+                int verdict,
+                int family,
+                size_t n_entries,
+                BPFAccessMap **ret) {
+
+        _cleanup_(bpf_access_map_unrefp) BPFAccessMap *m = NULL;
+        _cleanup_free_ char *key = NULL;
+        Unit *p;
+        int r;
+
+        assert(u);
+        assert(IN_SET(family, AF_INET, AF_INET6));
+        assert(n_entries > 0);
+        assert(ret);
+
+        r = bpf_firewall_access_map_key(u, verdict, family, &key);
+        if (r < 0)
+                return r;
+
+        m = hashmap_get(u->manager->bpf_access_maps, key);
+        if (m) {
+                *ret = bpf_access_map_ref(TAKE_PTR(m));
+                return 0;
+        }
+
+        m = new(BPFAccessMap, 1);
+        if (!m)
+                return -ENOMEM;
+
+        *m = (BPFAccessMap) {
+                .n_ref = 1,
+                .fd = -1,
+        };
+
+        m->fd = bpf_map_new(
+                        BPF_MAP_TYPE_LPM_TRIE,
+                        offsetof(struct bpf_lpm_trie_key, data) + (family == AF_INET ? sizeof(uint32_t) : sizeof(uint32_t)*4),
+                        sizeof(uint64_t),
+                        n_entries,
+                        BPF_F_NO_PREALLOC);
+        if (m->fd < 0)
+                return m->fd;
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                r = bpf_firewall_add_access_items(verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny,
+                                                  family == AF_INET ? m->fd : -1,
+                                                  family == AF_INET6 ? m->fd : -1,
+                                                  verdict);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_ensure_allocated(&u->manager->bpf_access_maps, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(u->manager->bpf_access_maps, key, m);
+        if (r < 0)
+                return r;
+
+        m->manager = u->manager;
+        m->key = TAKE_PTR(key);
+
+        *ret = TAKE_PTR(m);
+        return 1;
+}
+
 static int bpf_firewall_prepare_access_maps(
                 Unit *u,
                 int verdict,
-                int *ret_ipv4_map_fd,
-                int *ret_ipv6_map_fd,
+                BPFAccessMap **ret_ipv4_map,
+                BPFAccessMap **ret_ipv6_map,
                 bool *ret_has_any) {
 
-        _cleanup_close_ int ipv4_map_fd = -1, ipv6_map_fd = -1;
+        _cleanup_(bpf_access_map_unrefp) BPFAccessMap *ipv4_map = NULL, *ipv6_map = NULL;
         size_t n_ipv4 = 0, n_ipv6 = 0;
         IPAddressAccessItem *list;
         Unit *p;
         int r;
 
-        assert(ret_ipv4_map_fd);
-        assert(ret_ipv6_map_fd);
+        assert(ret_ipv4_map);
+        assert(ret_ipv6_map);
         assert(ret_has_any);
 
         for (p = u; p; p = UNIT_DEREF(p->slice)) {
@@ -442,42 +594,19 @@ static int bpf_firewall_prepare_access_maps(
         }
 
         if (n_ipv4 > 0) {
-                ipv4_map_fd = bpf_map_new(
-                                BPF_MAP_TYPE_LPM_TRIE,
-                                offsetof(struct bpf_lpm_trie_key, data) + sizeof(uint32_t),
-                                sizeof(uint64_t),
-                                n_ipv4,
-                                BPF_F_NO_PREALLOC);
-                if (ipv4_map_fd < 0)
-                        return ipv4_map_fd;
+                r = bpf_firewall_acquire_access_map(u, verdict, AF_INET, n_ipv4, &ipv4_map);
+                if (r < 0)
+                        return r;
         }
 
         if (n_ipv6 > 0) {
-                ipv6_map_fd = bpf_map_new(
-                                BPF_MAP_TYPE_LPM_TRIE,
-                                offsetof(struct bpf_lpm_trie_key, data) + sizeof(uint32_t)*4,
-                                sizeof(uint64_t),
-                                n_ipv6,
-                                BPF_F_NO_PREALLOC);
-                if (ipv6_map_fd < 0)
-                        return ipv6_map_fd;
-        }
-
-        for (p = u; p; p = UNIT_DEREF(p->slice)) {
-                CGroupContext *cc;
-
-                cc = unit_get_cgroup_context(p);
-                if (!cc)
-                        continue;
-
-                r = bpf_firewall_add_access_items(verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny,
-                                                  ipv4_map_fd, ipv6_map_fd, verdict);
+                r = bpf_firewall_acquire_access_map(u, verdict, AF_INET6, n_ipv6, &ipv6_map);
                 if (r < 0)
                         return r;
         }
 
-        *ret_ipv4_map_fd = TAKE_FD(ipv4_map_fd);
-        *ret_ipv6_map_fd = TAKE_FD(ipv6_map_fd);
+        *ret_ipv4_map = TAKE_PTR(ipv4_map);
+        *ret_ipv6_map = TAKE_PTR(ipv6_map);
         *ret_has_any = false;
         return 0;
 }
@@ -518,6 +647,9 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
 }
 
 int bpf_firewall_compile(Unit *u) {
+        _cleanup_(bpf_access_map_unrefp) BPFAccessMap
+                *old_ipv4_allow_map = NULL, *old_ipv6_allow_map = NULL,
+                *old_ipv4_deny_map = NULL, *old_ipv6_deny_map = NULL;
         CGroupContext *cc;
         int r, supported;
         bool ip_allow_any = false, ip_deny_any = false;
@@ -545,16 +677,18 @@ int bpf_firewall_compile(Unit *u) {
 
         /* Note that when we compile a new firewall we first flush out the access maps and the BPF programs themselves,
          * but we reuse the accounting maps. That way the firewall in effect always maps to the actual
-         * configuration, but we don't flush out the accounting unnecessarily */
+         * configuration, but we don't flush out the accounting unnecessarily. The old access maps are only
+         * released once the new ones are set up, so that a map is picked up again rather than recreated if
+         * the lists didn't change. */
 
         u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
         u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
 
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
+        old_ipv4_allow_map = TAKE_PTR(u->ipv4_allow_map);
+        old_ipv4_deny_map = TAKE_PTR(u->ipv4_deny_map);
 
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
+        old_ipv6_allow_map = TAKE_PTR(u->ipv6_allow_map);
+        old_ipv6_deny_map = TAKE_PTR(u->ipv6_deny_map);
 
         if (u->type != UNIT_SLICE) {
                 /* In inner nodes we only do accounting, we do not actually bother with access control. However, leaf
@@ -563,11 +697,11 @@ int bpf_firewall_compile(Unit *u) {
                  * means that all configure IP access rules *will* take effect on processes, even though we never
                  * compile them for inner nodes. */
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map_fd, &u->ipv6_allow_map_fd, &ip_allow_any);
+                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map, &u->ipv6_allow_map, &ip_allow_any);
                 if (r < 0)
                         return log_unit_error_errno(u, r, "Preparation of eBPF allow maps failed: %m");
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map_fd, &u->ipv6_deny_map_fd, &ip_deny_any);
+                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map, &u->ipv6_deny_map, &ip_deny_any);
                 if (r < 0)
                         return log_unit_error_errno(u, r, "Preparation of eBPF deny maps failed: %m");
         }
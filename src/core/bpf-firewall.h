@@ -13,6 +13,9 @@ enum {
 
 int bpf_firewall_supported(void);
 
+BPFAccessMap *bpf_access_map_unref(BPFAccessMap *m);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFAccessMap*, bpf_access_map_unref);
+
 int bpf_firewall_compile(Unit *u);
 int bpf_firewall_install(Unit *u);
 int bpf_firewall_load_custom(Unit *u);
@@ -73,13 +73,57 @@ bool unit_has_host_root_cgroup(Unit *u) {
         return unit_has_name(u, SPECIAL_ROOT_SLICE);
 }
 
+static char* cgroup_attribute_cache_key(const char *attribute, const char *value) {
+        const char *e;
+        size_t n;
+
+        /* Attributes such as io.max or blkio.weight_device are keyed by a "major:minor" device prefix,
+         * each device's line is an independent setting. Everything else takes a single value. */
+
+        n = strspn(value, DIGITS);
+        if (n == 0 || value[n] != ':')
+                return strdup(attribute);
+
+        e = value + n + 1;
+        e += strspn(e, DIGITS);
+        if (*e != ' ')
+                return strdup(attribute);
+
+        return strjoin(attribute, " ", strndupa(value, e - value));
+}
+
+static void cgroup_attribute_forget(Unit *u, const char *key) {
+        char *k = NULL;
+
+        free(hashmap_remove2(u->cgroup_attributes, key, (void**) &k));
+        free(k);
+}
+
 static int set_attribute_and_warn(Unit *u, const char *controller, const char *attribute, const char *value) {
+        _cleanup_free_ char *key = NULL;
+        const char *cached;
         int r;
 
+        key = cgroup_attribute_cache_key(attribute, value);
+        if (!key)
+                return log_oom();
+
+        /* Writing to cgroupfs is not free, and might block for a while under memory pressure, hence skip
+         * writes that would not change anything. */
+        cached = hashmap_get(u->cgroup_attributes, key);
+        if (streq_ptr(cached, value))
+                return 0;
+
         r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
-        if (r < 0)
+        if (r < 0) {
+                cgroup_attribute_forget(u, key);
                 log_unit_full_errno(u, LOG_LEVEL_CGROUP_WRITE(r), r, "Failed to set '%s' attribute on '%s' to '%.*s': %m",
                                     strna(attribute), isempty(u->cgroup_path) ? "/" : u->cgroup_path, (int) strcspn(value, NEWLINE), value);
+                return r;
+        }
+
+        cgroup_attribute_forget(u, key);
+        (void) hashmap_put_strdup(&u->cgroup_attributes, key, value);
 
         return r;
 }
@@ -1514,10 +1558,9 @@ CGroupMask unit_get_members_mask(Unit *u) {
         u->cgroup_members_mask = 0;
 
         if (u->type == UNIT_SLICE) {
-                void *v;
                 Unit *member;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE])
+                UNIT_FOREACH_DEPENDENCY(member, u, UNIT_BEFORE)
                         if (UNIT_DEREF(member->slice) == u)
                                 u->cgroup_members_mask |= unit_get_subtree_mask(member); /* note that this calls ourselves again, for the children */
         }
@@ -1848,6 +1891,11 @@ static int unit_update_cgroup(
                 return log_unit_error_errno(u, r, "Failed to create cgroup %s: %m", u->cgroup_path);
         created = r;
 
+        /* Whatever we wrote before doesn't apply to a cgroup that was just created, or to controller
+         * hierarchies it was just added to */
+        if (created || u->cgroup_realized_mask != target_mask)
+                u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+
         /* Start watching it */
         (void) unit_watch_cgroup(u);
         (void) unit_watch_cgroup_memory(u);
@@ -2157,14 +2205,13 @@ static int unit_realize_cgroup_now_enable(Unit *u, ManagerState state) {
  * hierarchy upwards to the unit in question. */
 static int unit_realize_cgroup_now_disable(Unit *u, ManagerState state) {
         Unit *m;
-        void *v;
 
         assert(u);
 
         if (u->type != UNIT_SLICE)
                 return 0;
 
-        HASHMAP_FOREACH_KEY(v, m, u->dependencies[UNIT_BEFORE]) {
+        UNIT_FOREACH_DEPENDENCY(m, u, UNIT_BEFORE) {
                 CGroupMask target_mask, enable_mask, new_target_mask, new_enable_mask;
                 int r;
 
@@ -2276,6 +2323,8 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
         if (r < 0)
                 return r;
 
+        manager_trace(u->manager, MANAGER_TRACE_CGROUP_REALIZED, u->id, u->cgroup_path, 0);
+
         /* Now, reset the invalidation mask */
         u->cgroup_invalidated_mask = 0;
         return 0;
@@ -2329,12 +2378,11 @@ void unit_add_family_to_cgroup_realize_queue(Unit *u) {
 
         do {
                 Unit *m;
-                void *v;
 
                 /* Children of u likely changed when we're called */
                 u->cgroup_members_mask_valid = false;
 
-                HASHMAP_FOREACH_KEY(v, m, u->dependencies[UNIT_BEFORE]) {
+                UNIT_FOREACH_DEPENDENCY(m, u, UNIT_BEFORE) {
                         /* Skip units that have a dependency on the slice but aren't actually in it. */
                         if (UNIT_DEREF(m->slice) != u)
                                 continue;
@@ -2396,6 +2444,8 @@ void unit_release_cgroup(Unit *u) {
                 u->cgroup_path = mfree(u->cgroup_path);
         }
 
+        u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+
         if (u->cgroup_control_inotify_wd >= 0) {
                 if (inotify_rm_watch(u->manager->cgroup_inotify_fd, u->cgroup_control_inotify_wd) < 0)
                         log_unit_debug_errno(u, errno, "Failed to remove cgroup control inotify watch %i for %s, ignoring: %m", u->cgroup_control_inotify_wd, u->id);
@@ -2437,6 +2487,9 @@ void unit_prune_cgroup(Unit *u) {
                  * on error, continue cleanup. */
                 log_unit_full_errno(u, r == -EBUSY ? LOG_DEBUG : LOG_WARNING, r, "Failed to destroy cgroup %s, ignoring: %m", u->cgroup_path);
 
+        /* Whatever we wrote went away with the cgroup (or with its children, for the root slice) */
+        u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+
         if (is_root_slice)
                 return;
 
@@ -2501,6 +2554,10 @@ static int unit_watch_pids_in_path(Unit *u, const char *path) {
                 pid_t pid;
 
                 while ((r = cg_read_pid(f, &pid)) > 0) {
+                        /* This is redone on every rewatch, hence keep it cheap for the PIDs we know already */
+                        if (set_contains(u->pids, PID_TO_PTR(pid)))
+                                continue;
+
                         r = unit_watch_pid(u, pid, false);
                         if (r < 0 && ret >= 0)
                                 ret = r;
@@ -3302,6 +3359,36 @@ int unit_get_ip_accounting(
         return r;
 }
 
+static bool unit_accounting_snapshot_is_current(Unit *u, usec_t timestamp) {
+        usec_t n;
+
+        assert(u);
+
+        /* Accounting data read earlier during the same event loop iteration is reused. Clients like to
+         * query all counters of a unit in one go (e.g. with GetAll), and there's no point in going to the
+         * kernel again for each of them, while a value from a previous iteration might be arbitrarily old. */
+
+        if (timestamp == USEC_INFINITY)
+                return false;
+
+        /* Returns > 0 if the event loop did not run yet, in which case there's no iteration timestamp */
+        if (sd_event_now(u->manager->event, CLOCK_MONOTONIC, &n) != 0)
+                return false;
+
+        return n == timestamp;
+}
+
+static usec_t unit_accounting_snapshot_timestamp(Unit *u) {
+        usec_t n;
+
+        assert(u);
+
+        if (sd_event_now(u->manager->event, CLOCK_MONOTONIC, &n) != 0)
+                return USEC_INFINITY;
+
+        return n;
+}
+
 static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]) {
         static const char *const field_names[_CGROUP_IO_ACCOUNTING_METRIC_MAX] = {
                 [CGROUP_IO_READ_BYTES]       = "rbytes=",
@@ -3399,7 +3486,8 @@ int unit_get_io_accounting(
         if (!UNIT_CGROUP_BOOL(u, io_accounting))
                 return -ENODATA;
 
-        if (allow_cache && u->io_accounting_last[metric] != UINT64_MAX)
+        if (u->io_accounting_last[metric] != UINT64_MAX &&
+            (allow_cache || unit_accounting_snapshot_is_current(u, u->io_accounting_timestamp)))
                 goto done;
 
         r = unit_get_io_accounting_raw(u, raw);
@@ -3416,6 +3504,8 @@ int unit_get_io_accounting(
                         u->io_accounting_last[i] = 0;
         }
 
+        u->io_accounting_timestamp = unit_accounting_snapshot_timestamp(u);
+
 done:
         if (ret)
                 *ret = u->io_accounting_last[metric];
@@ -3462,6 +3552,7 @@ int unit_reset_io_accounting(Unit *u) {
 
         for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
                 u->io_accounting_last[i] = UINT64_MAX;
+        u->io_accounting_timestamp = USEC_INFINITY;
 
         r = unit_get_io_accounting_raw(u, u->io_accounting_base);
         if (r < 0) {
@@ -3523,9 +3614,8 @@ void unit_invalidate_cgroup_bpf(Unit *u) {
          * list of our children includes our own. */
         if (u->type == UNIT_SLICE) {
                 Unit *member;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE])
+                UNIT_FOREACH_DEPENDENCY(member, u, UNIT_BEFORE)
                         if (UNIT_DEREF(member->slice) == u)
                                 unit_invalidate_cgroup_bpf(member);
         }
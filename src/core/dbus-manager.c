@@ -1289,6 +1289,90 @@ static int method_dump_by_fd(sd_bus_message *message, void *userdata, sd_bus_err
         return dump_impl(message, userdata, error, reply_dump_by_fd);
 }
 
+static int method_dump_trace(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        const ManagerTraceEntry *e;
+        Manager *m = userdata;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(tsssu)");
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; (e = manager_trace_entry(m, i)); i++) {
+                r = sd_bus_message_append(
+                                reply, "(tsssu)",
+                                e->timestamp,
+                                e->unit,
+                                manager_trace_event_to_string(e->event),
+                                manager_trace_entry_detail(e),
+                                (uint32_t) e->pid);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_dump_memory(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        ManagerMemoryUsage usage[_MANAGER_MEMORY_CATEGORY_MAX];
+        Manager *m = userdata;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        manager_get_memory_usage(m, usage);
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stt)");
+        if (r < 0)
+                return r;
+
+        for (ManagerMemoryCategory c = 0; c < _MANAGER_MEMORY_CATEGORY_MAX; c++) {
+                r = sd_bus_message_append(
+                                reply, "(stt)",
+                                manager_memory_category_to_string(c),
+                                usage[c].count,
+                                usage[c].size);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_refuse_snapshot(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         return sd_bus_error_setf(error, SD_BUS_ERROR_NOT_SUPPORTED, "Support for snapshots has been removed.");
 }
@@ -1327,8 +1411,7 @@ int verify_run_space_and_log(const char *message) {
         return 0;
 }
 
-static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        Manager *m = userdata;
+static int reload_with_objective(sd_bus_message *message, Manager *m, ManagerObjective objective, sd_bus_error *error) {
         int r;
 
         assert(message);
@@ -1358,11 +1441,19 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         if (r < 0)
                 return r;
 
-        m->objective = MANAGER_RELOAD;
+        m->objective = objective;
 
         return 1;
 }
 
+static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return reload_with_objective(message, userdata, MANAGER_RELOAD, error);
+}
+
+static int method_soft_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return reload_with_objective(message, userdata, MANAGER_SOFT_RELOAD, error);
+}
+
 static int method_reexecute(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -2539,6 +2630,13 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_PROPERTY("NJobs", "u", property_get_hashmap_size, offsetof(Manager, jobs), 0),
         SD_BUS_PROPERTY("NInstalledJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_installed_jobs), 0),
         SD_BUS_PROPERTY("NFailedJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_failed_jobs), 0),
+        SD_BUS_PROPERTY("NTransactions", "u", bus_property_get_unsigned, offsetof(Manager, n_transactions), 0),
+        SD_BUS_PROPERTY("TransactionUSec", "t", bus_property_get_usec, offsetof(Manager, transaction_usec), 0),
+        SD_BUS_PROPERTY("MaxTransactionUSec", "t", bus_property_get_usec, offsetof(Manager, transaction_max_usec), 0),
+        SD_BUS_PROPERTY("NGarbageCollectedUnits", "u", bus_property_get_unsigned, offsetof(Manager, n_gc_units), 0),
+        SD_BUS_PROPERTY("GarbageCollectionUSec", "t", bus_property_get_usec, offsetof(Manager, gc_usec), 0),
+        SD_BUS_PROPERTY("NMountEvents", "u", bus_property_get_unsigned, offsetof(Manager, n_mount_events), 0),
+        SD_BUS_PROPERTY("MountProcessingUSec", "t", bus_property_get_usec, offsetof(Manager, mount_usec), 0),
         SD_BUS_PROPERTY("Progress", "d", property_get_progress, 0, 0),
         SD_BUS_PROPERTY("Environment", "as", property_get_environment, 0, 0),
         SD_BUS_PROPERTY("ConfirmSpawn", "b", bus_property_get_bool, offsetof(Manager, confirm_spawn), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -2902,6 +3000,18 @@ const sd_bus_vtable bus_manager_vtable[] = {
                                  SD_BUS_PARAM(fd),
                                  method_dump_by_fd,
                                  SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_NAMES("DumpTrace",
+                                 NULL,,
+                                 "a(tsssu)",
+                                 SD_BUS_PARAM(events),
+                                 method_dump_trace,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_NAMES("DumpMemory",
+                                 NULL,,
+                                 "a(stt)",
+                                 SD_BUS_PARAM(usage),
+                                 method_dump_memory,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD_WITH_NAMES("CreateSnapshot",
                                  "sb",
                                  SD_BUS_PARAM(name)
@@ -2921,6 +3031,11 @@ const sd_bus_vtable bus_manager_vtable[] = {
                       NULL,
                       method_reload,
                       SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("SoftReload",
+                      NULL,
+                      NULL,
+                      method_soft_reload,
+                      SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reexecute",
                       NULL,
                       NULL,
@@ -3199,6 +3314,10 @@ const sd_bus_vtable bus_manager_vtable[] = {
                                  SD_BUS_PARAM(total),
                                  0),
         SD_BUS_SIGNAL("UnitFilesChanged", NULL, 0),
+        SD_BUS_SIGNAL_WITH_NAMES("UnitsChanged",
+                                 "a(soss)",
+                                 SD_BUS_PARAM(units),
+                                 0),
         SD_BUS_SIGNAL_WITH_NAMES("Reloading",
                                  "b",
                                  SD_BUS_PARAM(active),
@@ -3297,6 +3416,101 @@ void bus_manager_send_reloading(Manager *m, bool active) {
                 log_debug_errno(r, "Failed to send reloading signal: %m");
 }
 
+int bus_manager_add_unit_change(Manager *m, Unit *u) {
+        _cleanup_free_ char *id = NULL;
+
+        assert(m);
+        assert(u);
+
+        /* Remembers the current state of the unit for the next UnitsChanged signal. If the unit changes
+         * more than once before that, it is included more than once, so that all state transitions are
+         * seen. */
+
+        id = strdup(u->id);
+        if (!id)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(m->unit_changes, m->n_unit_changes_allocated, m->n_unit_changes + 1))
+                return -ENOMEM;
+
+        m->unit_changes[m->n_unit_changes++] = (UnitChange) {
+                .id = TAKE_PTR(id),
+                .active_state = unit_active_state_to_string(unit_active_state(u)),
+                .sub_state = unit_sub_state_to_string(u),
+        };
+
+        return 0;
+}
+
+void bus_manager_clear_unit_changes(Manager *m) {
+        size_t i;
+
+        assert(m);
+
+        for (i = 0; i < m->n_unit_changes; i++)
+                free(m->unit_changes[i].id);
+
+        m->unit_changes = mfree(m->unit_changes);
+        m->n_unit_changes = m->n_unit_changes_allocated = 0;
+}
+
+static int send_units_changed(sd_bus *bus, void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *message = NULL;
+        Manager *m = userdata;
+        size_t i;
+        int r;
+
+        assert(bus);
+        assert(m);
+
+        r = sd_bus_message_new_signal(bus, &message, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager", "UnitsChanged");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(message, 'a', "(soss)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_unit_changes; i++) {
+                _cleanup_free_ char *p = NULL;
+
+                p = unit_dbus_path_from_name(m->unit_changes[i].id);
+                if (!p)
+                        return -ENOMEM;
+
+                r = sd_bus_message_append(message, "(soss)",
+                                          m->unit_changes[i].id, p,
+                                          m->unit_changes[i].active_state,
+                                          m->unit_changes[i].sub_state);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(message);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(bus, message, NULL);
+}
+
+void bus_manager_send_units_changed(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* Sends a single signal for all units PropertiesChanged signals were sent for since the last call,
+         * for clients that prefer that over following the signals of each unit */
+
+        if (m->n_unit_changes == 0)
+                return;
+
+        r = bus_foreach_bus(m, NULL, send_units_changed, m);
+        if (r < 0)
+                log_debug_errno(r, "Failed to send units changed signal: %m");
+
+        bus_manager_clear_unit_changes(m);
+}
+
 static int send_changed_signal(sd_bus *bus, void *userdata) {
         assert(bus);
 
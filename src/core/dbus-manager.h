@@ -12,6 +12,16 @@ void bus_manager_send_finished(Manager *m, usec_t firmware_usec, usec_t loader_u
 void bus_manager_send_reloading(Manager *m, bool active);
 void bus_manager_send_change_signal(Manager *m);
 
+typedef struct UnitChange {
+        char *id;
+        const char *active_state;
+        const char *sub_state;
+} UnitChange;
+
+int bus_manager_add_unit_change(Manager *m, Unit *u);
+void bus_manager_send_units_changed(Manager *m);
+void bus_manager_clear_unit_changes(Manager *m);
+
 int verify_run_space_and_log(const char *message);
 
 int bus_property_get_oom_policy(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
@@ -46,6 +46,9 @@
 
 #define CONNECTIONS_MAX 4096
 
+/* How many messages to process per event loop iteration on each bus connection */
+#define BUS_PROCESS_BATCH 32U
+
 static void destroy_bus(Manager *m, sd_bus **bus);
 
 int bus_send_pending_reload_message(Manager *m) {
@@ -715,6 +718,13 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        /* Large replies, e.g. to ListUnits(), may be passed in a memfd, if the client supports that */
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enable memfd bodies for new connection bus: %m");
+                return 0;
+        }
+
         r = sd_bus_negotiate_creds(bus, 1,
                                    SD_BUS_CREDS_PID|SD_BUS_CREDS_UID|
                                    SD_BUS_CREDS_EUID|SD_BUS_CREDS_EFFECTIVE_CAPS|
@@ -742,6 +752,8 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        (void) sd_bus_set_process_batch(bus, BUS_PROCESS_BATCH);
+
         r = bus_setup_disconnected_match(m, bus);
         if (r < 0)
                 return 0;
@@ -836,6 +848,8 @@ int bus_init_api(Manager *m) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to attach API bus to event loop: %m");
 
+                (void) sd_bus_set_process_batch(bus, BUS_PROCESS_BATCH);
+
                 r = bus_setup_disconnected_match(m, bus);
                 if (r < 0)
                         return r;
@@ -893,6 +907,8 @@ int bus_init_system(Manager *m) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to attach system bus to event loop: %m");
 
+                (void) sd_bus_set_process_batch(bus, BUS_PROCESS_BATCH);
+
                 r = bus_setup_disconnected_match(m, bus);
                 if (r < 0)
                         return r;
@@ -14,6 +14,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "serialize.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "swap.h"
@@ -27,6 +28,21 @@ static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_PLUGGED] = UNIT_ACTIVE,
 };
 
+/* The udev properties device_setup_unit() and friends interpret, in addition to the device node, devlinks and aliases */
+static const char* const device_hashed_properties[] = {
+        "SYSTEMD_WANTS",
+        "SYSTEMD_USER_WANTS",
+        "SYSTEMD_ALIAS",
+        "SYSTEMD_MOUNT_DEVICE_BOUND",
+        "ID_MODEL_FROM_DATABASE",
+        "ID_MODEL",
+        "ID_FS_LABEL",
+        "ID_PART_ENTRY_NAME",
+        "ID_PART_ENTRY_NUMBER",
+};
+
+#define DEVICE_HASH_KEY SD_ID128_MAKE(6d,8f,0b,2c,55,1a,4e,93,b7,c2,3e,57,a0,d4,19,e8)
+
 static int device_dispatch_io(sd_device_monitor *monitor, sd_device *dev, void *userdata);
 static void device_update_found_one(Device *d, DeviceFound found, DeviceFound mask);
 
@@ -51,6 +67,7 @@ static void device_unset_sysfs(Device *d) {
                 hashmap_remove(devices, d->sysfs);
 
         d->sysfs = mfree(d->sysfs);
+        d->properties_hash = 0;
 }
 
 static int device_set_sysfs(Device *d, const char *sysfs) {
@@ -465,12 +482,11 @@ static bool device_is_bound_by_mounts(Device *d, sd_device *dev) {
 
 static void device_upgrade_mount_deps(Unit *u) {
         Unit *other;
-        void *v;
         int r;
 
         /* Let's upgrade Requires= to BindsTo= on us. (Used when SYSTEMD_MOUNT_DEVICE_BOUND is set) */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRED_BY]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRED_BY) {
                 if (other->type != UNIT_MOUNT)
                         continue;
 
@@ -569,7 +585,90 @@ fail:
         return r;
 }
 
-static int device_process_new(Manager *m, sd_device *dev) {
+static bool device_devlink_matches(const char *p, dev_t devnum) {
+        struct stat st;
+
+        /* Verify that the symlink in the FS actually belongs to this device. This is useful to deal with
+         * conflicting devices, e.g. when two disks want the same /dev/disk/by-label/xxx link because they
+         * have the same label. We want to make sure that the same device that won the symlink wins in
+         * systemd, so we check the device node major/minor */
+        if (stat(p, &st) >= 0 &&
+            ((!S_ISBLK(st.st_mode) && !S_ISCHR(st.st_mode)) ||
+             st.st_rdev != devnum))
+                return false;
+
+        return true;
+}
+
+static uint64_t device_properties_hash(sd_device *dev) {
+        struct siphash state;
+        const char *sysfs, *dn, *v;
+        dev_t devnum;
+        uint64_t h;
+
+        assert(dev);
+
+        /* Hashes everything device_process_new() derives the device units from, so that a uevent that
+         * changes none of it can be skipped cheaply. Returns 0 if the device can't be hashed. */
+
+        if (sd_device_get_syspath(dev, &sysfs) < 0)
+                return 0;
+
+        siphash24_init(&state, DEVICE_HASH_KEY.bytes);
+        siphash24_compress_string(sysfs, &state);
+
+        if (sd_device_get_devname(dev, &dn) >= 0) {
+                siphash24_compress_boolean(true, &state);
+                siphash24_compress_string(dn, &state);
+        } else
+                siphash24_compress_boolean(false, &state);
+
+        if (sd_device_get_devnum(dev, &devnum) >= 0) {
+                const char *p;
+
+                siphash24_compress(&devnum, sizeof(devnum), &state);
+
+                /* The ownership of a devlink may move between devices without this one changing */
+                FOREACH_DEVICE_DEVLINK(dev, p) {
+                        siphash24_compress_string(p, &state);
+                        siphash24_compress_boolean(device_devlink_matches(p, devnum), &state);
+                }
+        }
+
+        for (size_t i = 0; i < ELEMENTSOF(device_hashed_properties); i++)
+                if (sd_device_get_property_value(dev, device_hashed_properties[i], &v) >= 0) {
+                        siphash24_compress_string(device_hashed_properties[i], &state);
+                        siphash24_compress_string(v, &state);
+                }
+
+        h = siphash24_finalize(&state);
+        return h == 0 ? 1 : h; /* 0 means unset */
+}
+
+static bool device_is_unchanged(Manager *m, const char *sysfs, uint64_t hash) {
+        Device *l, *d;
+
+        assert(m);
+        assert(sysfs);
+
+        /* All units of the device have to be plugged, i.e. certainly set up from the last uevent and not
+         * garbage collected since, and have to have been set up from the same properties */
+
+        if (hash == 0)
+                return false;
+
+        l = hashmap_get(m->devices_by_sysfs, sysfs);
+        if (!l)
+                return false;
+
+        LIST_FOREACH(same_sysfs, d, l)
+                if (d->state != DEVICE_PLUGGED || d->properties_hash != hash)
+                        return false;
+
+        return true;
+}
+
+static int device_setup_units(Manager *m, sd_device *dev) {
         const char *sysfs, *dn, *alias;
         dev_t devnum;
         int r;
@@ -593,21 +692,10 @@ static int device_process_new(Manager *m, sd_device *dev) {
                 const char *p;
 
                 FOREACH_DEVICE_DEVLINK(dev, p) {
-                        struct stat st;
-
                         if (PATH_STARTSWITH_SET(p, "/dev/block/", "/dev/char/"))
                                 continue;
 
-                        /* Verify that the symlink in the FS actually belongs
-                         * to this device. This is useful to deal with
-                         * conflicting devices, e.g. when two disks want the
-                         * same /dev/disk/by-label/xxx link because they have
-                         * the same label. We want to make sure that the same
-                         * device that won the symlink wins in systemd, so we
-                         * check the device node major/minor */
-                        if (stat(p, &st) >= 0 &&
-                            ((!S_ISBLK(st.st_mode) && !S_ISCHR(st.st_mode)) ||
-                             st.st_rdev != devnum))
+                        if (!device_devlink_matches(p, devnum))
                                 continue;
 
                         (void) device_setup_unit(m, dev, p, false);
@@ -640,6 +728,36 @@ static int device_process_new(Manager *m, sd_device *dev) {
         return 0;
 }
 
+static int device_process_new(Manager *m, sd_device *dev) {
+        const char *sysfs;
+        uint64_t hash;
+        Device *l, *d;
+        int r;
+
+        assert(m);
+
+        if (sd_device_get_syspath(dev, &sysfs) < 0)
+                return 0;
+
+        /* Devices get "change" uevents for all kinds of reasons, and most of them don't touch anything we
+         * derive the device units from. Don't redo the setup of all the units for those. */
+        hash = device_properties_hash(dev);
+        if (device_is_unchanged(m, sysfs, hash)) {
+                log_device_debug(dev, "Relevant device properties unchanged, not updating device units.");
+                return 0;
+        }
+
+        r = device_setup_units(m, dev);
+        if (r < 0)
+                return r;
+
+        l = hashmap_get(m->devices_by_sysfs, sysfs);
+        LIST_FOREACH(same_sysfs, d, l)
+                d->properties_hash = hash;
+
+        return 0;
+}
+
 static void device_found_changed(Device *d, DeviceFound previous, DeviceFound now) {
         assert(d);
 
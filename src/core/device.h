@@ -33,6 +33,9 @@ struct Device {
 
         /* The SYSTEMD_WANTS udev property for this device the last time we saw it */
         char **wants_property;
+
+        /* A hash of everything device_process_new() looked at the last time it set up this device, 0 if unset */
+        uint64_t properties_hash;
 };
 
 extern const UnitVTable device_vtable;
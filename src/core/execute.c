@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <spawn.h>
 #include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -4524,6 +4525,236 @@ static int exec_child(
         return log_unit_error_errno(unit, r, "Failed to execute command: %m");
 }
 
+static bool exec_context_may_use_spawn_helper(
+                Unit *unit,
+                const ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                const ExecRuntime *runtime) {
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(params);
+
+        /* The spawn helper only covers what exec_child() does for the most basic services: no user switching,
+         * no sandboxing, no file descriptor passing, output to /dev/null or the journal. Everything else is
+         * still forked off PID 1 directly. */
+
+        if (getenv_bool("SYSTEMD_EXEC_SPAWN_HELPER") <= 0)
+                return false;
+
+        if (params->n_socket_fds + params->n_storage_fds > 0 ||
+            params->stdin_fd >= 0 || params->stdout_fd >= 0 || params->stderr_fd >= 0 ||
+            params->exec_fd >= 0 ||
+            params->idle_pipe ||
+            ((params->flags & EXEC_SET_WATCHDOG) && params->watchdog_usec > 0) ||
+            exec_context_has_credentials(context))
+                return false;
+
+        if (context->std_input != EXEC_INPUT_NULL ||
+            !IN_SET(context->std_output, EXEC_OUTPUT_NULL, EXEC_OUTPUT_JOURNAL) ||
+            !IN_SET(context->std_error, EXEC_OUTPUT_NULL, EXEC_OUTPUT_JOURNAL, EXEC_OUTPUT_INHERIT) ||
+            context->log_namespace ||
+            context->tty_path || context->tty_reset || context->tty_vhangup || context->tty_vt_disallocate ||
+            context->utmp_id ||
+            context->same_pgrp)
+                return false;
+
+        if (context->user || context->group || context->dynamic_user ||
+            !strv_isempty(context->supplementary_groups) ||
+            context->pam_name ||
+            context->working_directory_home ||
+            context->root_directory ||
+            !strv_isempty(context->unset_environment))
+                return false;
+
+        if (context->oom_score_adjust_set || context->coredump_filter_set || context->nice_set ||
+            context->ioprio_set || context->cpu_sched_set ||
+            context->cpu_affinity_from_numa || context->cpu_set.set ||
+            mpol_is_valid(numa_policy_get_type(&context->numa_policy)) ||
+            context->timer_slack_nsec != NSEC_INFINITY ||
+            context->personality != PERSONALITY_INVALID)
+                return false;
+
+        for (ExecDirectoryType dt = 0; dt < _EXEC_DIRECTORY_TYPE_MAX; dt++)
+                if (!strv_isempty(context->directories[dt].paths))
+                        return false;
+
+        if (exec_needs_mount_namespace(context, params, runtime) ||
+            context->private_network || context->network_namespace_path ||
+            context->private_users || context->protect_hostname)
+                return false;
+
+        if (!cap_test_all(context->capability_bounding_set) ||
+            context->capability_ambient_set != 0 ||
+            context->secure_bits != 0 ||
+            context_has_no_new_privileges(context) ||
+            context->selinux_context || context->apparmor_profile || context->smack_process_label ||
+            mac_smack_use())
+                return false;
+
+        if (context_has_syscall_filters(context) ||
+            !set_isempty(context->syscall_archs) ||
+            context_has_address_families(context) ||
+            context->memory_deny_write_execute ||
+            context->restrict_realtime ||
+            context->restrict_suid_sgid ||
+            exec_context_restrict_namespaces_set(context) ||
+            context->protect_clock ||
+            context->protect_kernel_tunables ||
+            context->protect_kernel_modules ||
+            context->protect_kernel_logs ||
+            context->private_devices ||
+            context->lock_personality)
+                return false;
+
+        return !unit_shall_confirm_spawn(unit);
+}
+
+static int exec_spawn_helper(
+                Unit *unit,
+                const ExecCommand *command,
+                const ExecContext *context,
+                const ExecParameters *params,
+                char **files_env,
+                const char *cgroup_path,
+                pid_t *ret) {
+
+        _cleanup_strv_free_ char **our_env = NULL, **pass_env = NULL, **accum_env = NULL, **replaced_argv = NULL, **args = NULL;
+        _cleanup_free_ char *nulstr = NULL;
+        _cleanup_close_ int env_fd = -1;
+        posix_spawn_file_actions_t fa;
+        char **final_argv;
+        size_t n;
+        pid_t pid;
+        int r;
+
+        assert(unit);
+        assert(command);
+        assert(context);
+        assert(params);
+        assert(ret);
+
+        /* Start the command through systemd-spawn-helper with posix_spawn(), which uses CLONE_VM|CLONE_VFORK
+         * and hence doesn't copy our page tables. The environment and the command line are computed here, the
+         * helper only applies the few process attributes exec_context_may_use_spawn_helper() lets through.
+         * If the helper fails, it logs and exits the same way a forked exec_child() would. */
+
+        r = build_environment(unit, context, params, 0, NULL, NULL, NULL, 0, 0, &our_env);
+        if (r < 0)
+                return r;
+
+        r = build_pass_environment(context, &pass_env);
+        if (r < 0)
+                return r;
+
+        accum_env = strv_env_merge(5,
+                                   params->environment,
+                                   our_env,
+                                   pass_env,
+                                   context->environment,
+                                   files_env);
+        if (!accum_env)
+                return -ENOMEM;
+        accum_env = strv_env_clean(accum_env);
+
+        if (!FLAGS_SET(command->flags, EXEC_COMMAND_NO_ENV_EXPAND)) {
+                replaced_argv = replace_env_argv(command->argv, accum_env);
+                if (!replaced_argv)
+                        return -ENOMEM;
+                final_argv = replaced_argv;
+        } else
+                final_argv = command->argv;
+
+        args = strv_new(SYSTEMD_SPAWN_HELPER_PATH);
+        if (!args)
+                return -ENOMEM;
+
+        if (strv_extendf(&args, "--unit=%s", unit->id) < 0 ||
+            strv_extendf(&args, "--umask=%04o", context->umask) < 0 ||
+            strv_extendf(&args, "--keyring=%s", exec_keyring_mode_to_string(context->keyring_mode)) < 0 ||
+            strv_extendf(&args, "--stdout=%s", exec_output_to_string(context->std_output)) < 0 ||
+            strv_extendf(&args, "--stderr=%s", exec_output_to_string(context->std_error)) < 0 ||
+            strv_extendf(&args, "--syslog-priority=%i", context->syslog_priority) < 0 ||
+            strv_extendf(&args, "--syslog-level-prefix=%s", yes_no(context->syslog_level_prefix)) < 0 ||
+            strv_extendf(&args, "--ignore-sigpipe=%s", yes_no(context->ignore_sigpipe)) < 0 ||
+            strv_extendf(&args, "--log-level=%i", log_get_max_level()) < 0)
+                return -ENOMEM;
+
+        if (MANAGER_IS_USER(unit->manager) && strv_extend(&args, "--user") < 0)
+                return -ENOMEM;
+
+        if (!sd_id128_is_null(unit->invocation_id) &&
+            strv_extendf(&args, "--invocation-id=" SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(unit->invocation_id)) < 0)
+                return -ENOMEM;
+
+        if (cgroup_path &&
+            (strv_extendf(&args, "--cgroup=%s", cgroup_path) < 0 ||
+             strv_extendf(&args, "--cgroup-supported=%" PRIu64, (uint64_t) params->cgroup_supported) < 0))
+                return -ENOMEM;
+
+        if (context->working_directory &&
+            strv_extendf(&args, "--working-directory=%s%s",
+                         context->working_directory_missing_ok ? "-" : "", context->working_directory) < 0)
+                return -ENOMEM;
+
+        if (context->syslog_identifier &&
+            strv_extendf(&args, "--syslog-identifier=%s", context->syslog_identifier) < 0)
+                return -ENOMEM;
+
+        if ((params->flags & EXEC_PASS_LOG_UNIT) && strv_extend(&args, "--log-unit") < 0)
+                return -ENOMEM;
+
+        if ((command->flags & EXEC_COMMAND_IGNORE_FAILURE) && strv_extend(&args, "--ignore-missing") < 0)
+                return -ENOMEM;
+
+        /* Like exec_child(), only apply resource limits when sandboxing applies to this command */
+        if ((params->flags & EXEC_APPLY_SANDBOXING) && !(command->flags & EXEC_COMMAND_FULLY_PRIVILEGED))
+                for (int i = 0; i < _RLIMIT_MAX; i++) {
+                        _cleanup_free_ char *limit = NULL;
+
+                        if (!context->rlimit[i])
+                                continue;
+
+                        r = rlimit_format(context->rlimit[i], &limit);
+                        if (r < 0)
+                                return r;
+
+                        if (strv_extendf(&args, "--rlimit=%s=%s", rlimit_to_string(i), limit) < 0)
+                                return -ENOMEM;
+                }
+
+        if (strv_extend(&args, command->path) < 0 ||
+            strv_extend_strv(&args, final_argv, false) < 0)
+                return -ENOMEM;
+
+        r = strv_make_nulstr(accum_env, &nulstr, &n);
+        if (r < 0)
+                return r;
+
+        env_fd = acquire_data_fd(nulstr, n, 0);
+        if (env_fd < 0)
+                return env_fd;
+
+        r = posix_spawn_file_actions_init(&fa);
+        if (r != 0)
+                return -r;
+
+        r = posix_spawn_file_actions_adddup2(&fa, env_fd, STDIN_FILENO);
+        if (r == 0)
+                r = posix_spawn(&pid, SYSTEMD_SPAWN_HELPER_PATH, &fa, NULL, args, STRV_MAKE_EMPTY);
+
+        (void) posix_spawn_file_actions_destroy(&fa);
+        if (r != 0)
+                return -r;
+
+        log_unit_debug(unit, "Spawned %s through %s as "PID_FMT, command->path, SYSTEMD_SPAWN_HELPER_PATH, pid);
+
+        *ret = pid;
+        return 0;
+}
+
 static int exec_context_load_environment(const Unit *unit, const ExecContext *c, char ***l);
 static int exec_context_named_iofds(const ExecContext *c, const ExecParameters *p, int named_iofds[static 3]);
 
@@ -4604,6 +4835,15 @@ int exec_spawn(Unit *unit,
                 }
         }
 
+        if (exec_context_may_use_spawn_helper(unit, command, context, params, runtime)) {
+                r = exec_spawn_helper(unit, command, context, params, files_env, subcgroup_path, &pid);
+                if (r >= 0)
+                        goto spawned;
+
+                log_unit_debug_errno(unit, r, "Failed to spawn %s through %s, forking instead: %m",
+                                     command->path, SYSTEMD_SPAWN_HELPER_PATH);
+        }
+
         pid = fork();
         if (pid < 0)
                 return log_unit_error_errno(unit, errno, "Failed to fork: %m");
@@ -4645,6 +4885,9 @@ int exec_spawn(Unit *unit,
 
         log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
 
+spawned:
+        manager_trace(unit->manager, MANAGER_TRACE_FORKED, unit->id, command->path, pid);
+
         /* We add the new process to the cgroup both in the child (so that we can be sure that no user code is ever
          * executed outside of the cgroup) and in the parent (so that we can be sure that when we kill the cgroup the
          * process will be killed too). */
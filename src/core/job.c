@@ -153,7 +153,7 @@ void job_uninstall(Job *j) {
 
         unit_add_to_gc_queue(j->unit);
 
-        unit_add_to_dbus_queue(j->unit); /* The Job property of the unit has changed now */
+        unit_add_to_dbus_queue_full(j->unit, UNIT_DBUS_CHANGE_JOB); /* The Job property of the unit has changed now */
 
         hashmap_remove_value(j->manager->jobs, UINT32_TO_PTR(j->id), j);
         j->installed = false;
@@ -238,11 +238,12 @@ Job* job_install(Job *j) {
         log_unit_debug(j->unit,
                        "Installed new job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
+        manager_trace(j->manager, MANAGER_TRACE_JOB_INSTALLED, j->unit->id, job_type_to_string(j->type), 0);
 
         job_add_to_gc_queue(j);
 
         job_add_to_dbus_queue(j); /* announce this job to clients */
-        unit_add_to_dbus_queue(j->unit); /* The Job property of the unit has changed now */
+        unit_add_to_dbus_queue_full(j->unit, UNIT_DBUS_CHANGE_JOB); /* The Job property of the unit has changed now */
 
         return j;
 }
@@ -459,7 +460,6 @@ int job_type_merge_and_collapse(JobType *a, JobType b, Unit *u) {
 
 static bool job_is_runnable(Job *j) {
         Unit *other;
-        void *v;
 
         assert(j);
         assert(j->installed);
@@ -481,7 +481,7 @@ static bool job_is_runnable(Job *j) {
         if (j->type == JOB_NOP)
                 return true;
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER])
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER)
                 if (other->job && job_compare(j, other->job, UNIT_AFTER) > 0) {
                         log_unit_debug(j->unit,
                                        "starting held back, waiting for: %s",
@@ -489,7 +489,7 @@ static bool job_is_runnable(Job *j) {
                         return false;
                 }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE])
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE)
                 if (other->job && job_compare(j, other->job, UNIT_BEFORE) > 0) {
                         log_unit_debug(j->unit,
                                        "stopping held back, waiting for: %s",
@@ -668,6 +668,9 @@ int job_run_and_invalidate(Job *j) {
         if (!job_is_runnable(j))
                 return -EAGAIN;
 
+        /* The time between installation and this point is spent waiting for dependencies */
+        manager_trace(j->manager, MANAGER_TRACE_JOB_STARTED, j->unit->id, job_type_to_string(j->type), 0);
+
         job_start_timer(j, true);
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
@@ -956,11 +959,10 @@ static void job_emit_done_status_message(Unit *u, uint32_t job_id, JobType t, Jo
 
 static void job_fail_dependencies(Unit *u, UnitDependency d) {
         Unit *other;
-        void *v;
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, d) {
                 Job *j = other->job;
 
                 if (!j)
@@ -976,7 +978,6 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
         Unit *u;
         Unit *other;
         JobType t;
-        void *v;
 
         assert(j);
         assert(j->installed);
@@ -989,6 +990,7 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
         log_unit_debug(u, "Job %" PRIu32 " %s/%s finished, result=%s",
                        j->id, u->id, job_type_to_string(t), job_result_to_string(result));
+        manager_trace(u->manager, MANAGER_TRACE_JOB_FINISHED, u->id, job_result_to_string(result), 0);
 
         /* If this job did nothing to the respective unit we don't log the status message */
         if (!already)
@@ -1069,12 +1071,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
 finish:
         /* Try to start the next jobs that can be started */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_AFTER)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
                 }
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BEFORE)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
@@ -1235,7 +1237,7 @@ int job_deserialize(Job *j, FILE *f) {
                 char *l, *v;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -1424,7 +1426,6 @@ int job_get_timeout(Job *j, usec_t *timeout) {
 
 bool job_may_gc(Job *j) {
         Unit *other;
-        void *v;
 
         assert(j);
 
@@ -1453,11 +1454,11 @@ bool job_may_gc(Job *j) {
                 return false;
 
         /* The logic is inverse to job_is_runnable, we cannot GC as long as we block any job. */
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE])
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE)
                 if (other->job && job_compare(j, other->job, UNIT_BEFORE) < 0)
                         return false;
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER])
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER)
                 if (other->job && job_compare(j, other->job, UNIT_AFTER) < 0)
                         return false;
 
@@ -1504,7 +1505,6 @@ int job_get_before(Job *j, Job*** ret) {
         _cleanup_free_ Job** list = NULL;
         size_t n = 0, n_allocated = 0;
         Unit *other = NULL;
-        void *v;
 
         /* Returns a list of all pending jobs that need to finish before this job may be started. */
 
@@ -1516,7 +1516,7 @@ int job_get_before(Job *j, Job*** ret) {
                 return 0;
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER]) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER) {
                 if (!other->job)
                         continue;
                 if (job_compare(j, other->job, UNIT_AFTER) <= 0)
@@ -1527,7 +1527,7 @@ int job_get_before(Job *j, Job*** ret) {
                 list[n++] = other->job;
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE]) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE) {
                 if (!other->job)
                         continue;
                 if (job_compare(j, other->job, UNIT_BEFORE) <= 0)
@@ -1549,14 +1549,13 @@ int job_get_after(Job *j, Job*** ret) {
         _cleanup_free_ Job** list = NULL;
         size_t n = 0, n_allocated = 0;
         Unit *other = NULL;
-        void *v;
 
         assert(j);
         assert(ret);
 
         /* Returns a list of all pending jobs that are waiting for this job to finish. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE]) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE) {
                 if (!other->job)
                         continue;
 
@@ -1571,7 +1570,7 @@ int job_get_after(Job *j, Job*** ret) {
                 list[n++] = other->job;
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER]) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER) {
                 if (!other->job)
                         continue;
 
@@ -9,6 +9,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "unit-name.h"
+#include "unit-prefetch.h"
 #include "unit.h"
 
 static int process_deps(Unit *u, UnitDependency dependency, const char *dir_suffix) {
@@ -112,14 +113,27 @@ int unit_load_dropin(Unit *u) {
                         return log_oom();
         }
 
-        STRV_FOREACH(f, u->dropin_paths)
-                (void) config_parse(
-                                u->id, *f, NULL,
-                                UNIT_VTABLE(u)->sections,
-                                config_item_perf_lookup, load_fragment_gperf_lookup,
-                                0,
-                                u,
-                                &u->dropin_mtime);
+        STRV_FOREACH(f, u->dropin_paths) {
+                _cleanup_(prefetched_file_freep) PrefetchedFile *p = NULL;
+
+                p = unit_prefetch_take(u->manager, *f);
+                if (p)
+                        (void) config_parse_buffer(
+                                        u->id, *f, p->data, p->size, &p->st,
+                                        UNIT_VTABLE(u)->sections,
+                                        config_item_perf_lookup, load_fragment_gperf_lookup,
+                                        0,
+                                        u,
+                                        &u->dropin_mtime);
+                else
+                        (void) config_parse(
+                                        u->id, *f, NULL,
+                                        UNIT_VTABLE(u)->sections,
+                                        config_item_perf_lookup, load_fragment_gperf_lookup,
+                                        0,
+                                        u,
+                                        &u->dropin_mtime);
+        }
 
         return 0;
 }
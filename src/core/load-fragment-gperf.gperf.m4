@@ -489,6 +489,8 @@ Path.MakeDirectory,              config_parse_bool,                  0,
 Path.DirectoryMode,              config_parse_mode,                  0,                             offsetof(Path, directory_mode)
 m4_dnl
 CGROUP_CONTEXT_CONFIG_ITEMS(Slice)m4_dnl
+Slice.LogRateLimitIntervalSec,   config_parse_sec,                   0,                             offsetof(Slice, log_ratelimit_interval_usec)
+Slice.LogRateLimitBurst,         config_parse_unsigned,              0,                             offsetof(Slice, log_ratelimit_burst)
 m4_dnl
 CGROUP_CONTEXT_CONFIG_ITEMS(Scope)m4_dnl
 KILL_CONTEXT_CONFIG_ITEMS(Scope)m4_dnl
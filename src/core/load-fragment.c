@@ -58,6 +58,7 @@
 #include "syslog-util.h"
 #include "time-util.h"
 #include "unit-name.h"
+#include "unit-prefetch.h"
 #include "unit-printf.h"
 #include "user-util.h"
 #include "utf8.h"
@@ -1968,7 +1969,7 @@ int config_parse_trigger_unit(
         assert(rvalue);
         assert(data);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_TRIGGERS])) {
+        if (!unit_dependencies_isempty(&u->dependencies, UNIT_TRIGGERS)) {
                 log_syntax(unit, LOG_WARNING, filename, line, 0, "Multiple units to trigger specified, ignoring: %s", rvalue);
                 return 0;
         }
@@ -2049,7 +2050,6 @@ int config_parse_path_spec(const char *unit,
         s->unit = UNIT(p);
         s->path = TAKE_PTR(k);
         s->type = b;
-        s->inotify_fd = -1;
 
         LIST_PREPEND(spec, p->specs, s);
 
@@ -5306,18 +5306,25 @@ int unit_load_fragment(Unit *u) {
 
         if (fragment) {
                 /* Open the file, check if this is a mask, otherwise read. */
+                _cleanup_(prefetched_file_freep) PrefetchedFile *p = NULL;
                 _cleanup_fclose_ FILE *f = NULL;
                 struct stat st;
 
-                /* Try to open the file name. A symlink is OK, for example for linked files or masks. We
-                 * expect that all symlinks within the lookup paths have been already resolved, but we don't
-                 * verify this here. */
-                f = fopen(fragment, "re");
-                if (!f)
-                        return log_unit_notice_errno(u, errno, "Failed to open %s: %m", fragment);
-
-                if (fstat(fileno(f), &st) < 0)
-                        return -errno;
+                /* Maybe the file was read already while the load queue was dispatched */
+                p = unit_prefetch_take(u->manager, fragment);
+                if (p)
+                        st = p->st;
+                else {
+                        /* Try to open the file name. A symlink is OK, for example for linked files or
+                         * masks. We expect that all symlinks within the lookup paths have been already
+                         * resolved, but we don't verify this here. */
+                        f = fopen(fragment, "re");
+                        if (!f)
+                                return log_unit_notice_errno(u, errno, "Failed to open %s: %m", fragment);
+
+                        if (fstat(fileno(f), &st) < 0)
+                                return -errno;
+                }
 
                 r = free_and_strdup(&u->fragment_path, fragment);
                 if (r < 0)
@@ -5333,12 +5340,20 @@ int unit_load_fragment(Unit *u) {
                         u->fragment_mtime = timespec_load(&st.st_mtim);
 
                         /* Now, parse the file contents */
-                        r = config_parse(u->id, fragment, f,
-                                         UNIT_VTABLE(u)->sections,
-                                         config_item_perf_lookup, load_fragment_gperf_lookup,
-                                         0,
-                                         u,
-                                         NULL);
+                        if (p)
+                                r = config_parse_buffer(u->id, fragment, p->data, p->size, &p->st,
+                                                        UNIT_VTABLE(u)->sections,
+                                                        config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                        0,
+                                                        u,
+                                                        NULL);
+                        else
+                                r = config_parse(u->id, fragment, f,
+                                                 UNIT_VTABLE(u)->sections,
+                                                 config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                 0,
+                                                 u,
+                                                 NULL);
                         if (r == -ENOEXEC)
                                 log_unit_notice_errno(u, r, "Unit configuration has fatal error, unit will not be started.");
                         if (r < 0)
@@ -1869,7 +1869,8 @@ static int invoke_main_loop(
 
                 switch ((ManagerObjective) r) {
 
-                case MANAGER_RELOAD: {
+                case MANAGER_RELOAD:
+                case MANAGER_SOFT_RELOAD: {
                         LogTarget saved_log_target;
                         int saved_log_level;
 
@@ -1894,7 +1895,7 @@ static int invoke_main_loop(
                         if (saved_log_target >= 0)
                                 manager_override_log_target(m, saved_log_target);
 
-                        r = manager_reload(m);
+                        r = m->objective == MANAGER_SOFT_RELOAD ? manager_soft_reload(m) : manager_reload(m);
                         if (r < 0)
                                 /* Reloading failed before the point of no return. Let's continue running as if nothing happened. */
                                 m->objective = MANAGER_OK;
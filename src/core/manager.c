@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/kd.h>
+#include <malloc.h>
 #include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/ioctl.h>
@@ -80,6 +81,7 @@
 #include "transaction.h"
 #include "umask-util.h"
 #include "unit-name.h"
+#include "unit-prefetch.h"
 #include "user-util.h"
 #include "virt.h"
 #include "watchdog.h"
@@ -100,6 +102,14 @@
 /* How many units and jobs to process of the bus queue before returning to the event loop. */
 #define MANAGER_BUS_MESSAGE_BUDGET 100U
 
+/* How long to spend collecting units at most, before processing events again. This is checked every
+ * MANAGER_GC_CHECK_INTERVAL units. */
+#define MANAGER_GC_BUDGET_USEC (10 * USEC_PER_MSEC)
+#define MANAGER_GC_CHECK_INTERVAL 16U
+
+/* How many notification messages to process per wakeup, before returning to the event loop */
+#define MANAGER_NOTIFY_BATCH_MAX 16U
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -835,6 +845,9 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
         /* Reboot immediately if the user hits C-A-D more often than 7x per 2s */
         m->ctrl_alt_del_ratelimit = (RateLimit) { .interval = 2 * USEC_PER_SEC, .burst = 7 };
 
+        /* We answer ListUnitFiles() and friends over and over again, don't reparse unchanged unit files */
+        unit_file_cache_enable();
+
         r = manager_default_environment(m);
         if (r < 0)
                 return r;
@@ -1123,9 +1136,15 @@ static int manager_setup_user_lookup_fd(Manager *m) {
 static unsigned manager_dispatch_cleanup_queue(Manager *m) {
         Unit *u;
         unsigned n = 0;
+        usec_t begin;
 
         assert(m);
 
+        if (!m->cleanup_queue)
+                return 0;
+
+        begin = now(CLOCK_MONOTONIC);
+
         while ((u = m->cleanup_queue)) {
                 assert(u->in_cleanup_queue);
 
@@ -1133,6 +1152,9 @@ static unsigned manager_dispatch_cleanup_queue(Manager *m) {
                 n++;
         }
 
+        m->n_gc_units += n;
+        m->gc_usec = usec_add(m->gc_usec, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin));
+
         return n;
 }
 
@@ -1146,12 +1168,11 @@ enum {
 
 static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
         Unit *other;
-        void *v;
 
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
         /* Recursively mark referenced units as GOOD as well */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCES])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCES)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -1159,7 +1180,6 @@ static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
 static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
         Unit *other;
         bool is_bad;
-        void *v;
 
         assert(u);
 
@@ -1177,7 +1197,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCED_BY]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCED_BY) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -1223,11 +1243,23 @@ good:
 
 static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         unsigned n = 0, gc_marker;
+        usec_t begin;
         Unit *u;
 
         assert(m);
 
-        /* log_debug("Running GC..."); */
+        /* We ran out of time before, let's process some events first, and continue afterwards */
+        if (m->gc_unit_queue_yield || !m->gc_unit_queue)
+                return 0;
+
+        /* Each call is a GC pass of its own, which processes the queue as long as the time budget
+         * permits. Whatever is left is investigated from scratch in the next pass, as things might change
+         * while events are processed. Units found to be unneeded are freed by the cleanup queue before any
+         * events are processed, hence their state cannot change anymore. Note that units nothing refers to
+         * are decided on right away, without looking at any other unit, which is the common case for
+         * transient units that went away. */
+
+        begin = now(CLOCK_MONOTONIC);
 
         m->gc_marker += _GC_OFFSET_MAX;
         if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
@@ -1252,8 +1284,17 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
                         u->gc_marker = gc_marker + GC_OFFSET_BAD;
                         unit_add_to_cleanup_queue(u);
                 }
+
+                if (n % MANAGER_GC_CHECK_INTERVAL == 0 && m->gc_unit_queue &&
+                    usec_sub_unsigned(now(CLOCK_MONOTONIC), begin) >= MANAGER_GC_BUDGET_USEC) {
+                        log_debug("Garbage collection of units ran out of time, processing events before continuing.");
+                        m->gc_unit_queue_yield = true;
+                        break;
+                }
         }
 
+        m->gc_usec = usec_add(m->gc_usec, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin));
+
         return n;
 }
 
@@ -1346,6 +1387,12 @@ static void manager_clear_jobs_and_units(Manager *m) {
         m->n_running_jobs = 0;
         m->n_installed_jobs = 0;
         m->n_failed_jobs = 0;
+        m->n_transactions = 0;
+        m->transaction_usec = m->transaction_max_usec = 0;
+        m->n_gc_units = 0;
+        m->gc_usec = 0;
+        m->n_mount_events = 0;
+        m->mount_usec = 0;
 }
 
 Manager* manager_free(Manager *m) {
@@ -1364,6 +1411,7 @@ Manager* manager_free(Manager *m) {
         lookup_paths_flush_generator(&m->lookup_paths);
 
         bus_done(m);
+        bus_manager_clear_unit_changes(m);
         manager_varlink_done(m);
 
         exec_runtime_vacuum(m);
@@ -1412,7 +1460,10 @@ Manager* manager_free(Manager *m) {
         strv_free(m->client_environment);
 
         hashmap_free(m->cgroup_unit);
+        assert(hashmap_isempty(m->bpf_access_maps));
+        hashmap_free(m->bpf_access_maps);
         manager_free_unit_name_maps(m);
+        unit_prefetch_flush(m);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1429,6 +1480,12 @@ Manager* manager_free(Manager *m) {
                 m->prefix[dt] = mfree(m->prefix[dt]);
         free(m->received_credentials);
 
+        unit_file_cache_flush();
+
+        for (size_t i = 0; i < m->n_trace; i++)
+                free(m->trace[i].unit);
+        free(m->trace);
+
         return mfree(m);
 }
 
@@ -1723,6 +1780,18 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
         return 0;
 }
 
+static void manager_account_transaction(Manager *m, usec_t begin) {
+        usec_t t;
+
+        assert(m);
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+
+        m->n_transactions++;
+        m->transaction_usec = usec_add(m->transaction_usec, t);
+        m->transaction_max_usec = MAX(m->transaction_max_usec, t);
+}
+
 int manager_add_job(
                 Manager *m,
                 JobType type,
@@ -1733,6 +1802,7 @@ int manager_add_job(
                 Job **ret) {
 
         Transaction *tr;
+        usec_t begin;
         int r;
 
         assert(m);
@@ -1753,6 +1823,8 @@ int manager_add_job(
 
         type = job_type_collapse(type, unit);
 
+        begin = now(CLOCK_MONOTONIC);
+
         tr = transaction_new(mode == JOB_REPLACE_IRREVERSIBLY);
         if (!tr)
                 return -ENOMEM;
@@ -1787,11 +1859,13 @@ int manager_add_job(
                 *ret = tr->anchor_job;
 
         transaction_free(tr);
+        manager_account_transaction(m, begin);
         return 0;
 
 tr_abort:
         transaction_abort(tr);
         transaction_free(tr);
+        manager_account_transaction(m, begin);
         return r;
 }
 
@@ -1831,12 +1905,15 @@ int manager_add_job_by_name_and_warn(Manager *m, JobType type, const char *name,
 int manager_propagate_reload(Manager *m, Unit *unit, JobMode mode, sd_bus_error *e) {
         int r;
         Transaction *tr;
+        usec_t begin;
 
         assert(m);
         assert(unit);
         assert(mode < _JOB_MODE_MAX);
         assert(mode != JOB_ISOLATE); /* Isolate is only valid for start */
 
+        begin = now(CLOCK_MONOTONIC);
+
         tr = transaction_new(mode == JOB_REPLACE_IRREVERSIBLY);
         if (!tr)
                 return -ENOMEM;
@@ -1854,11 +1931,13 @@ int manager_propagate_reload(Manager *m, Unit *unit, JobMode mode, sd_bus_error
                 goto tr_abort;
 
         transaction_free(tr);
+        manager_account_transaction(m, begin);
         return 0;
 
 tr_abort:
         transaction_abort(tr);
         transaction_free(tr);
+        manager_account_transaction(m, begin);
         return r;
 }
 
@@ -1896,9 +1975,8 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
 
                 for (size_t k = 0; k < ELEMENTSOF(deps); k++) {
                         Unit *target;
-                        void *v;
 
-                        HASHMAP_FOREACH_KEY(v, target, u->dependencies[deps[k]]) {
+                        UNIT_FOREACH_DEPENDENCY(target, u, deps[k]) {
                                 r = unit_add_default_target_dependency(u, target);
                                 if (r < 0)
                                         return r;
@@ -1927,10 +2005,17 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                /* Read the unit files of everything queued right now in one go */
+                if (!u->load_prefetched)
+                        (void) unit_prefetch_load_queue(m);
+
                 unit_load(u);
                 n++;
         }
 
+        /* Don't keep anything around that wasn't needed in the end, it would be outdated next time */
+        unit_prefetch_flush(m);
+
         m->dispatching_load_queue = false;
 
         /* Dispatch the units waiting for their target dependencies to be added now, as all targets that we know about
@@ -2214,7 +2299,7 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
                 budget = (unsigned) -1; /* infinite budget in this case */
         else {
                 /* Anything to do at all? */
-                if (!m->dbus_unit_queue && !m->dbus_job_queue)
+                if (!m->dbus_unit_queue && !m->dbus_job_queue && m->n_unit_changes == 0)
                         return 0;
 
                 /* Do we have overly many messages queued at the moment? If so, let's not enqueue more on top, let's
@@ -2247,6 +2332,13 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
                         budget--;
         }
 
+        /* Announce all units from above in one go, before any of the job signals below. This is not
+         * accounted against the budget, as it is only one message. */
+        if (m->n_unit_changes > 0) {
+                bus_manager_send_units_changed(m);
+                n++;
+        }
+
         while (budget != 0 && (j = m->dbus_job_queue)) {
                 assert(j->in_dbus_queue);
 
@@ -2349,10 +2441,17 @@ static void manager_invoke_notify_message(
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+typedef struct NotifyBatch {
+        /* The sender of the previous message processed in the same batch, the unit owning its cgroup, and
+         * whether the message was just a plain WATCHDOG=1 */
+        pid_t pid;
+        Unit *cgroup_unit;
+        bool watchdog_only;
+} NotifyBatch;
+
+static int manager_receive_notify_message(Manager *m, NotifyBatch *batch) {
 
         _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
         char buf[NOTIFY_BUFFER_MAX+1];
         struct iovec iovec = {
                 .iov_base = buf,
@@ -2370,24 +2469,22 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         struct cmsghdr *cmsg;
         struct ucred *ucred = NULL;
         _cleanup_free_ Unit **array_copy = NULL;
-        _cleanup_strv_free_ char **tags = NULL;
+        _cleanup_strv_free_ char **tags_allocated = NULL;
+        char *single_tag[2] = {}, **tags;
         Unit *u1, *u2, **array;
         int r, *fd_array = NULL;
         size_t n_fds = 0;
-        bool found = false;
+        bool found = false, watchdog_only;
         ssize_t n;
 
         assert(m);
-        assert(m->notify_fd == fd);
+        assert(batch);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
+        /* Returns 0 if there was no message to process, > 0 if one was processed (or ignored) */
 
         n = recvmsg_safe(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
         if (IN_SET(n, -EAGAIN, -EINTR))
-                return 0; /* Spurious wakeup, try again */
+                return 0; /* Spurious wakeup, or nothing left, try again */
         if (n < 0)
                 /* If this is any other, real error, then let's stop processing this socket. This of course
                  * means we won't take notification messages anymore, but that's still better than busy
@@ -2418,44 +2515,72 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return 1;
                 }
         }
 
         if (!ucred || !pid_is_valid(ucred->pid)) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return 1;
         }
 
         if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* Make sure it's NUL-terminated, then parse it to obtain the tags list */
         buf[n] = 0;
-        tags = strv_split_newlines(buf);
-        if (!tags) {
-                log_oom();
-                return 0;
+        if (n > 0 && buf[n-1] == '\n')
+                buf[n-1] = 0;
+
+        if (!strpbrk(buf, NEWLINE)) {
+                /* The common case is a message with a single line, such as WATCHDOG=1 or STATUS=…, which
+                 * needs no splitting, and hence no allocations. */
+                single_tag[0] = isempty(buf) ? NULL : buf;
+                tags = single_tag;
+        } else {
+                tags = tags_allocated = strv_split_newlines(buf);
+                if (!tags) {
+                        log_oom();
+                        return 1;
+                }
         }
 
+        /* A service that pings the watchdog more often than we get to read its messages tells us nothing new
+         * with the second ping in a row */
+        watchdog_only = n_fds == 0 && strv_equal(tags, STRV_MAKE("WATCHDOG=1"));
+        if (watchdog_only && batch->watchdog_only && batch->pid == ucred->pid)
+                return 1;
+
         /* possibly a barrier fd, let's see */
         if (manager_process_barrier_fd(tags, fds))
-                return 0;
+                return 1;
 
         /* Increase the generation counter used for filtering out duplicate unit invocations. */
         m->notifygen++;
 
-        /* Notify every unit that might be interested, which might be multiple. */
-        u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
+        /* Notify every unit that might be interested, which might be multiple. Looking up the cgroup of
+         * the sender means reading from /proc, hence reuse the result for consecutive messages of the same
+         * sender. */
+        if (batch->pid == ucred->pid)
+                u1 = batch->cgroup_unit;
+        else
+                u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
+
+        *batch = (NotifyBatch) {
+                .pid = ucred->pid,
+                .cgroup_unit = u1,
+                .watchdog_only = watchdog_only,
+        };
+
         u2 = hashmap_get(m->watch_pids, PID_TO_PTR(ucred->pid));
         array = hashmap_get(m->watch_pids, PID_TO_PTR(-ucred->pid));
         if (array) {
@@ -2490,6 +2615,30 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
 
+        return 1;
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        NotifyBatch batch = {};
+        int r;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Busy services send lots of small messages, read a couple of them per wakeup */
+        for (unsigned i = 0; i < MANAGER_NOTIFY_BATCH_MAX; i++) {
+                r = manager_receive_notify_message(m, &batch);
+                if (r <= 0)
+                        /* If this is any real error, then let's stop processing this socket */
+                        return r;
+        }
+
         return 0;
 }
 
@@ -2963,8 +3112,11 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_dbus_queue(m) > 0)
                         continue;
 
-                /* Sleep for watchdog runtime wait time */
-                if (timestamp_is_set(watchdog_usec))
+                /* Sleep for watchdog runtime wait time, but don't sleep at all if garbage collection needs to
+                 * continue */
+                if (m->gc_unit_queue_yield)
+                        wait_usec = 0;
+                else if (timestamp_is_set(watchdog_usec))
                         wait_usec = watchdog_runtime_wait();
                 else
                         wait_usec = USEC_INFINITY;
@@ -2972,6 +3124,8 @@ int manager_loop(Manager *m) {
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
+
+                m->gc_unit_queue_yield = false;
         }
 
         return m->objective;
@@ -3226,6 +3380,13 @@ int manager_serialize(
         (void) serialize_item_format(f, "current-job-id", "%" PRIu32, m->current_job_id);
         (void) serialize_item_format(f, "n-installed-jobs", "%u", m->n_installed_jobs);
         (void) serialize_item_format(f, "n-failed-jobs", "%u", m->n_failed_jobs);
+        (void) serialize_item_format(f, "n-transactions", "%u", m->n_transactions);
+        (void) serialize_usec(f, "transaction-usec", m->transaction_usec);
+        (void) serialize_usec(f, "transaction-max-usec", m->transaction_max_usec);
+        (void) serialize_item_format(f, "n-gc-units", "%u", m->n_gc_units);
+        (void) serialize_usec(f, "gc-usec", m->gc_usec);
+        (void) serialize_item_format(f, "n-mount-events", "%u", m->n_mount_events);
+        (void) serialize_usec(f, "mount-usec", m->mount_usec);
         (void) serialize_bool(f, "taint-usr", m->taint_usr);
         (void) serialize_bool(f, "ready-sent", m->ready_sent);
         (void) serialize_bool(f, "taint-logged", m->taint_logged);
@@ -3351,14 +3512,51 @@ static int manager_deserialize_one_unit(Manager *m, const char *name, FILE *f, F
         return 0;
 }
 
+static int manager_load_deserialized_units(Manager *m, FILE *f) {
+        off_t offset;
+        int r;
+
+        /* Queue all units listed in the serialization for loading first, so that their unit files are read
+         * ahead in one go rather than one by one. Then go back to deserialize them as usual. */
+
+        offset = ftello(f);
+        if (offset < 0)
+                return 0;
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                Unit *u;
+
+                r = deserialize_read_line(f, &line);
+                if (r <= 0)
+                        break;
+
+                (void) manager_load_unit_prepare(m, strstrip(line), NULL, NULL, &u);
+
+                if (unit_deserialize_skip(f) <= 0)
+                        break;
+        }
+
+        (void) manager_dispatch_load_queue(m);
+
+        if (fseeko(f, offset, SEEK_SET) < 0)
+                return log_error_errno(errno, "Failed to seek back in serialization: %m");
+
+        return 0;
+}
+
 static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
         const char *unit_name;
         int r;
 
+        r = manager_load_deserialized_units(m, f);
+        if (r < 0)
+                return r;
+
         for (;;) {
                 _cleanup_free_ char *line = NULL;
                 /* Start marker */
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3504,7 +3702,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 _cleanup_free_ char *line = NULL;
                 const char *val, *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3538,6 +3736,54 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                         else
                                 m->n_failed_jobs += n;
 
+                } else if ((val = startswith(l, "n-transactions="))) {
+                        uint32_t n;
+
+                        if (safe_atou32(val, &n) < 0)
+                                log_notice("Failed to parse transactions counter '%s', ignoring.", val);
+                        else
+                                m->n_transactions += n;
+
+                } else if ((val = startswith(l, "transaction-usec="))) {
+                        usec_t t;
+
+                        if (deserialize_usec(val, &t) >= 0)
+                                m->transaction_usec = usec_add(m->transaction_usec, t);
+
+                } else if ((val = startswith(l, "transaction-max-usec="))) {
+                        usec_t t;
+
+                        if (deserialize_usec(val, &t) >= 0)
+                                m->transaction_max_usec = MAX(m->transaction_max_usec, t);
+
+                } else if ((val = startswith(l, "n-gc-units="))) {
+                        uint32_t n;
+
+                        if (safe_atou32(val, &n) < 0)
+                                log_notice("Failed to parse garbage collected units counter '%s', ignoring.", val);
+                        else
+                                m->n_gc_units += n;
+
+                } else if ((val = startswith(l, "gc-usec="))) {
+                        usec_t t;
+
+                        if (deserialize_usec(val, &t) >= 0)
+                                m->gc_usec = usec_add(m->gc_usec, t);
+
+                } else if ((val = startswith(l, "n-mount-events="))) {
+                        uint32_t n;
+
+                        if (safe_atou32(val, &n) < 0)
+                                log_notice("Failed to parse mount events counter '%s', ignoring.", val);
+                        else
+                                m->n_mount_events += n;
+
+                } else if ((val = startswith(l, "mount-usec="))) {
+                        usec_t t;
+
+                        if (deserialize_usec(val, &t) >= 0)
+                                m->mount_usec = usec_add(m->mount_usec, t);
+
                 } else if ((val = startswith(l, "taint-usr="))) {
                         int b;
 
@@ -3807,6 +4053,276 @@ int manager_reload(Manager *m) {
         return 0;
 }
 
+typedef struct SoftReloadEdge {
+        Unit *unit;
+        UnitDependency type;
+        UnitDependencyMask mask;
+} SoftReloadEdge;
+
+typedef struct SoftReloadRef {
+        UnitRef *ref;
+        Unit *source;
+} SoftReloadRef;
+
+static bool manager_unit_changed_on_disk(Manager *m, Unit *u) {
+        _cleanup_set_free_free_ Set *names = NULL;
+        const char *fragment = NULL;
+        int r;
+
+        assert(m);
+        assert(u);
+
+        if (unit_need_daemon_reload(u))
+                return true;
+
+        /* A unit file might have been added somewhere higher up in the search path, or the one we loaded
+         * might have been removed in favour of another one. */
+        r = unit_file_find_fragment(m->unit_id_map, m->unit_name_map, u->id, &fragment, &names);
+        if (r < 0 && r != -ENOENT)
+                return true;
+
+        return !path_equal_ptr(fragment, u->fragment_path);
+}
+
+static int manager_find_changed_units(Manager *m, char ***ret_changed, char ***ret_retry) {
+        _cleanup_strv_free_ char **changed = NULL, **retry = NULL;
+        Unit *u;
+        char *k;
+        int r;
+
+        assert(m);
+        assert(ret_changed);
+        assert(ret_retry);
+
+        /* Generators are not rerun, hence the only thing that can have changed is what is in the unit
+         * directories, and the name map is rebuilt only if any of their modification times changed. */
+        r = unit_file_build_name_map(&m->lookup_paths,
+                                     &m->unit_cache_timestamp_hash,
+                                     &m->unit_id_map,
+                                     &m->unit_name_map,
+                                     &m->unit_path_cache);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to rebuild name map: %m");
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+
+                /* ignore aliases */
+                if (u->id != k)
+                        continue;
+
+                if (u->transient)
+                        continue;
+
+                if (u->load_state == UNIT_NOT_FOUND) {
+                        /* There's no state to carry over, such units are simply loaded again in place */
+                        if (manager_unit_cache_should_retry_load(u)) {
+                                r = strv_extend(&retry, u->id);
+                                if (r < 0)
+                                        return log_oom();
+                        }
+
+                        continue;
+                }
+
+                if (!IN_SET(u->load_state, UNIT_LOADED, UNIT_MASKED, UNIT_BAD_SETTING, UNIT_ERROR))
+                        continue;
+
+                if (!manager_unit_changed_on_disk(m, u))
+                        continue;
+
+                /* Units with pending jobs can't be recreated, and units which are set up from kernel state
+                 * only get that state back when enumerating everything. */
+                if (u->job || u->nop_job || u->perpetual ||
+                    UNIT_VTABLE(u)->enumerate || UNIT_VTABLE(u)->enumerate_perpetual)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBUSY),
+                                               "Unit %s changed on disk, but cannot be reloaded on its own.", u->id);
+
+                r = strv_extend(&changed, u->id);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        *ret_changed = TAKE_PTR(changed);
+        *ret_retry = TAKE_PTR(retry);
+        return 0;
+}
+
+static int manager_soft_reload_unit(Manager *m, Unit *u) {
+        _cleanup_free_ SoftReloadEdge *edges = NULL;
+        _cleanup_free_ SoftReloadRef *refs = NULL;
+        size_t n_edges = 0, n_edges_allocated = 0, n_refs = 0, n_refs_allocated = 0, i;
+        _cleanup_fdset_free_ FDSet *fds = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *id = NULL;
+        ExecRuntime *rt = NULL;
+        UnitDependency d;
+        Unit *other, *n;
+        UnitRef *ref;
+        char *k;
+        int r;
+
+        assert(m);
+        assert(u);
+        assert(!u->job && !u->nop_job);
+
+        id = strdup(u->id);
+        if (!id)
+                return log_oom();
+
+        r = manager_open_serialization(m, &f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create serialization file: %m");
+
+        fds = fdset_new();
+        if (!fds)
+                return log_oom();
+
+        r = unit_serialize(u, f, fds, false);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Failed to serialize unit: %m");
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to flush serialization: %m");
+
+        if (fseeko(f, 0, SEEK_SET) < 0)
+                return log_error_errno(errno, "Failed to seek to beginning of serialization: %m");
+
+        /* Loading the unit again only recreates the dependencies it configures itself, hence remember the
+         * ones other units configured on it. */
+        HASHMAP_FOREACH_KEY(other, k, m->units) {
+                if (other->id != k || other == u)
+                        continue;
+
+                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
+                        UnitDependencyInfo info;
+
+                        if (unit_dependencies_isempty(&other->dependencies, d))
+                                continue;
+
+                        if (!unit_dependencies_get(&other->dependencies, d, u, &info) || info.origin_mask == 0)
+                                continue;
+
+                        if (!GREEDY_REALLOC(edges, n_edges_allocated, n_edges + 1))
+                                return log_oom();
+
+                        edges[n_edges++] = (SoftReloadEdge) {
+                                .unit = other,
+                                .type = d,
+                                .mask = info.origin_mask,
+                        };
+                }
+        }
+
+        LIST_FOREACH(refs_by_target, ref, u->refs_by_target) {
+                if (ref->source == u)
+                        continue;
+
+                if (!GREEDY_REALLOC(refs, n_refs_allocated, n_refs + 1))
+                        return log_oom();
+
+                refs[n_refs++] = (SoftReloadRef) {
+                        .ref = ref,
+                        .source = ref->source,
+                };
+        }
+
+        /* Runtime objects are released as soon as their last unit goes away, keep them around until the new
+         * unit picked them up again. Dynamic users stay in their table anyway. */
+        if (UNIT_VTABLE(u)->exec_runtime_offset > 0) {
+                rt = *(ExecRuntime**) ((uint8_t*) u + UNIT_VTABLE(u)->exec_runtime_offset);
+                if (rt)
+                        rt->n_ref++;
+        }
+
+        unit_free(u);
+
+        r = manager_load_unit(m, id, NULL, NULL, &n);
+        exec_runtime_unref(rt, false);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to load unit %s again, dropping it: %m", id);
+
+        for (i = 0; i < n_edges; i++) {
+                r = unit_add_dependency(edges[i].unit, edges[i].type, n, false, edges[i].mask);
+                if (r < 0)
+                        log_unit_warning_errno(edges[i].unit, r, "Failed to restore dependency on %s, ignoring: %m", n->id);
+        }
+
+        for (i = 0; i < n_refs; i++)
+                unit_ref_set(refs[i].ref, refs[i].source, n);
+
+        r = unit_deserialize(n, f, fds);
+        if (r < 0)
+                log_unit_warning_errno(n, r, "Failed to deserialize unit, proceeding anyway: %m");
+
+        return 0;
+}
+
+int manager_soft_reload(Manager *m) {
+        _cleanup_(manager_reloading_stopp) Manager *reloading = NULL;
+        _cleanup_strv_free_ char **changed = NULL, **retry = NULL;
+        char **id;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        /* Contrary to manager_reload() this keeps all units in memory whose unit files didn't change
+         * since they were loaded, and only recreates the others, carrying their state over. Whenever this
+         * isn't possible, this falls back to a full reload. */
+
+        r = manager_find_changed_units(m, &changed, &retry);
+        if (r < 0) {
+                log_info("Cannot reload changed units only, doing a full reload.");
+                return manager_reload(m);
+        }
+
+        log_info("Reloading %zu changed units.", strv_length(changed));
+
+        reloading = manager_reloading_start(m);
+
+        bus_manager_send_reloading(m, true);
+
+        STRV_FOREACH(id, retry) {
+                u = manager_get_unit(m, *id);
+                if (!u || u->load_state != UNIT_NOT_FOUND)
+                        continue;
+
+                u->load_state = UNIT_STUB;
+                unit_add_to_load_queue(u);
+        }
+
+        STRV_FOREACH(id, changed) {
+                u = manager_get_unit(m, *id);
+                if (!u)
+                        continue;
+
+                (void) manager_soft_reload_unit(m, u);
+        }
+
+        manager_dispatch_load_queue(m);
+
+        /* Only the units loaded anew haven't been coldplugged yet */
+        manager_coldplug(m);
+
+        manager_vacuum(m);
+
+        reloading = NULL;
+        assert(m->n_reloading > 0);
+        m->n_reloading--;
+
+        /* Consider the reload process complete now, and catch up with what happened meanwhile */
+        STRV_FOREACH(id, changed) {
+                u = manager_get_unit(m, *id);
+                if (u)
+                        unit_catchup(u);
+        }
+
+        m->objective = MANAGER_OK;
+        m->send_reloading_done = true;
+        return 0;
+}
+
 void manager_reset_failed(Manager *m) {
         Unit *u;
 
@@ -4882,6 +5398,129 @@ ManagerTimestamp manager_timestamp_initrd_mangle(ManagerTimestamp s) {
         return s;
 }
 
+void manager_trace(Manager *m, ManagerTraceEvent event, const char *unit, const char *detail, pid_t pid) {
+        ManagerTraceEntry *e;
+        size_t a, b;
+        char *p;
+
+        assert(m);
+        assert(event >= 0 && event < _MANAGER_TRACE_EVENT_MAX);
+        assert(unit);
+
+        /* This is called on hot paths, hence keep it cheap: one allocation for both strings, and failures
+         * are silently ignored, the trace is purely informational. */
+
+        if (!m->trace) {
+                m->trace = new0(ManagerTraceEntry, MANAGER_TRACE_MAX);
+                if (!m->trace)
+                        return;
+        }
+
+        detail = strempty(detail);
+        a = strlen(unit) + 1;
+        b = strlen(detail) + 1;
+
+        p = malloc(a + b);
+        if (!p)
+                return;
+        memcpy(mempcpy(p, unit, a), detail, b);
+
+        e = m->trace + m->trace_next;
+        free(e->unit);
+        *e = (ManagerTraceEntry) {
+                .timestamp = now(CLOCK_MONOTONIC),
+                .event = event,
+                .pid = pid,
+                .unit = p,
+        };
+
+        m->trace_next = (m->trace_next + 1) % MANAGER_TRACE_MAX;
+        if (m->n_trace < MANAGER_TRACE_MAX)
+                m->n_trace++;
+}
+
+const ManagerTraceEntry *manager_trace_entry(Manager *m, size_t i) {
+        assert(m);
+
+        /* Returns the i-th oldest entry still in the ring buffer */
+
+        if (i >= m->n_trace)
+                return NULL;
+
+        return m->trace + (m->trace_next + MANAGER_TRACE_MAX - m->n_trace + i) % MANAGER_TRACE_MAX;
+}
+
+const char *manager_trace_entry_detail(const ManagerTraceEntry *e) {
+        assert(e);
+
+        return e->unit + strlen(e->unit) + 1;
+}
+
+void manager_get_memory_usage(Manager *m, ManagerMemoryUsage ret[static _MANAGER_MEMORY_CATEGORY_MAX]) {
+        struct mallinfo mi;
+        const char *k;
+        Unit *u;
+
+        assert(m);
+        assert(ret);
+
+        for (ManagerMemoryCategory c = 0; c < _MANAGER_MEMORY_CATEGORY_MAX; c++)
+                ret[c] = (ManagerMemoryUsage) {};
+
+        ret[MANAGER_MEMORY_UNIT_NAMES].count = hashmap_size(m->units);
+        ret[MANAGER_MEMORY_UNIT_NAMES].size = hashmap_memory_usage(m->units);
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                const char *alias;
+
+                if (u->id != k)
+                        continue;
+
+                ret[MANAGER_MEMORY_UNITS].count++;
+                ret[MANAGER_MEMORY_UNITS].size += UNIT_VTABLE(u)->object_size;
+
+                ret[MANAGER_MEMORY_UNIT_NAMES].size += strlen(u->id) + 1 + set_memory_usage(u->aliases);
+                SET_FOREACH(alias, u->aliases)
+                        ret[MANAGER_MEMORY_UNIT_NAMES].size += strlen(alias) + 1;
+
+                ret[MANAGER_MEMORY_DEPENDENCIES].count += unit_dependencies_count(&u->dependencies);
+                ret[MANAGER_MEMORY_DEPENDENCIES].size += unit_dependencies_memory_usage(&u->dependencies);
+
+                if (u->cgroup_path)
+                        ret[MANAGER_MEMORY_CGROUPS].size += strlen(u->cgroup_path) + 1;
+
+                ret[MANAGER_MEMORY_BUS_TRACKING].count += sd_bus_track_count(u->bus_track);
+        }
+
+        ret[MANAGER_MEMORY_JOBS].count = hashmap_size(m->jobs);
+        ret[MANAGER_MEMORY_JOBS].size = hashmap_size(m->jobs) * sizeof(Job) + hashmap_memory_usage(m->jobs);
+
+        ret[MANAGER_MEMORY_CGROUPS].count = hashmap_size(m->cgroup_unit);
+        ret[MANAGER_MEMORY_CGROUPS].size += hashmap_memory_usage(m->cgroup_unit);
+
+        ret[MANAGER_MEMORY_WATCH_PIDS].count = hashmap_size(m->watch_pids);
+        ret[MANAGER_MEMORY_WATCH_PIDS].size = hashmap_memory_usage(m->watch_pids);
+
+        ret[MANAGER_MEMORY_BUS_TRACKING].count += sd_bus_track_count(m->subscribed);
+        ret[MANAGER_MEMORY_BUS_TRACKING].size = hashmap_memory_usage(m->watch_bus);
+
+        ret[MANAGER_MEMORY_TRACE].count = m->n_trace;
+        if (m->trace) {
+                ret[MANAGER_MEMORY_TRACE].size = MANAGER_TRACE_MAX * sizeof(ManagerTraceEntry);
+
+                for (size_t i = 0; i < m->n_trace; i++) {
+                        const ManagerTraceEntry *e = manager_trace_entry(m, i);
+
+                        ret[MANAGER_MEMORY_TRACE].size += strlen(e->unit) + 1 + strlen(manager_trace_entry_detail(e)) + 1;
+                }
+        }
+
+        /* mallinfo() counts in int, which is good enough for the 2G the manager hopefully never gets near */
+        mi = mallinfo();
+        ret[MANAGER_MEMORY_MALLOC].count = UINT64_MAX;
+        ret[MANAGER_MEMORY_MALLOC].size = (unsigned) mi.uordblks + (unsigned) mi.hblkhd;
+}
+
 static const char *const manager_state_table[_MANAGER_STATE_MAX] = {
         [MANAGER_INITIALIZING] = "initializing",
         [MANAGER_STARTING] = "starting",
@@ -4916,6 +5555,31 @@ static const char *const manager_timestamp_table[_MANAGER_TIMESTAMP_MAX] = {
 
 DEFINE_STRING_TABLE_LOOKUP(manager_timestamp, ManagerTimestamp);
 
+static const char *const manager_trace_event_table[_MANAGER_TRACE_EVENT_MAX] = {
+        [MANAGER_TRACE_JOB_INSTALLED] = "job-installed",
+        [MANAGER_TRACE_JOB_STARTED] = "job-started",
+        [MANAGER_TRACE_JOB_FINISHED] = "job-finished",
+        [MANAGER_TRACE_STATE_CHANGED] = "state-changed",
+        [MANAGER_TRACE_FORKED] = "forked",
+        [MANAGER_TRACE_CGROUP_REALIZED] = "cgroup-realized",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(manager_trace_event, ManagerTraceEvent);
+
+static const char *const manager_memory_category_table[_MANAGER_MEMORY_CATEGORY_MAX] = {
+        [MANAGER_MEMORY_UNITS] = "units",
+        [MANAGER_MEMORY_UNIT_NAMES] = "unit-names",
+        [MANAGER_MEMORY_DEPENDENCIES] = "dependencies",
+        [MANAGER_MEMORY_JOBS] = "jobs",
+        [MANAGER_MEMORY_CGROUPS] = "cgroups",
+        [MANAGER_MEMORY_WATCH_PIDS] = "watch-pids",
+        [MANAGER_MEMORY_BUS_TRACKING] = "bus-tracking",
+        [MANAGER_MEMORY_TRACE] = "trace",
+        [MANAGER_MEMORY_MALLOC] = "malloc",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(manager_memory_category, ManagerMemoryCategory);
+
 static const char* const oom_policy_table[_OOM_POLICY_MAX] = {
         [OOM_CONTINUE] = "continue",
         [OOM_STOP] = "stop",
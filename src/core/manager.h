@@ -43,6 +43,7 @@ typedef enum ManagerObjective {
         MANAGER_OK,
         MANAGER_EXIT,
         MANAGER_RELOAD,
+        MANAGER_SOFT_RELOAD,
         MANAGER_REEXECUTE,
         MANAGER_REBOOT,
         MANAGER_POWEROFF,
@@ -121,6 +122,49 @@ typedef enum WatchdogType {
         _WATCHDOG_TYPE_MAX,
 } WatchdogType;
 
+/* Fine-grained events recorded into the trace ring buffer, see manager_trace(). Tools such as
+ * systemd-analyze fetch them with the DumpTrace() bus call to show where boot time goes. */
+typedef enum ManagerTraceEvent {
+        MANAGER_TRACE_JOB_INSTALLED,   /* detail: job type */
+        MANAGER_TRACE_JOB_STARTED,     /* detail: job type */
+        MANAGER_TRACE_JOB_FINISHED,    /* detail: job result */
+        MANAGER_TRACE_STATE_CHANGED,   /* detail: unit sub state, e.g. "start-pre" */
+        MANAGER_TRACE_FORKED,          /* detail: executable path, pid set */
+        MANAGER_TRACE_CGROUP_REALIZED, /* detail: cgroup path */
+        _MANAGER_TRACE_EVENT_MAX,
+        _MANAGER_TRACE_EVENT_INVALID = -1,
+} ManagerTraceEvent;
+
+#define MANAGER_TRACE_MAX 4096U
+
+typedef struct ManagerTraceEntry {
+        usec_t timestamp; /* CLOCK_MONOTONIC */
+        ManagerTraceEvent event;
+        pid_t pid;
+        char *unit;       /* Followed by the NUL-terminated detail string in the same allocation */
+} ManagerTraceEntry;
+
+/* What the manager's memory goes to, see manager_get_memory_usage(). This is determined by walking the data
+ * structures when asked for, through the DumpMemory() bus call, and hence costs nothing otherwise. */
+typedef enum ManagerMemoryCategory {
+        MANAGER_MEMORY_UNITS,        /* unit objects, including their embedded exec, cgroup and kill contexts */
+        MANAGER_MEMORY_UNIT_NAMES,   /* unit names and aliases, and the table mapping them to units */
+        MANAGER_MEMORY_DEPENDENCIES,
+        MANAGER_MEMORY_JOBS,
+        MANAGER_MEMORY_CGROUPS,      /* cgroup paths, and the table mapping them to units */
+        MANAGER_MEMORY_WATCH_PIDS,
+        MANAGER_MEMORY_BUS_TRACKING, /* count: tracked bus clients, size: the table of watched bus names */
+        MANAGER_MEMORY_TRACE,
+        MANAGER_MEMORY_MALLOC,       /* size: all memory in use according to the allocator */
+        _MANAGER_MEMORY_CATEGORY_MAX,
+        _MANAGER_MEMORY_CATEGORY_INVALID = -1,
+} ManagerMemoryCategory;
+
+typedef struct ManagerMemoryUsage {
+        uint64_t count; /* number of objects, UINT64_MAX if not applicable */
+        uint64_t size;  /* bytes, not including the allocator's overhead */
+} ManagerMemoryUsage;
+
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
@@ -165,6 +209,11 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* Units that PropertiesChanged signals were sent for, and that are announced in the next UnitsChanged
+         * signal, together with their state at that time */
+        struct UnitChange *unit_changes;
+        size_t n_unit_changes, n_unit_changes_allocated;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -235,6 +284,9 @@ struct Manager {
         Set *unit_path_cache;
         uint64_t unit_cache_timestamp_hash;
 
+        /* Contents of unit files read ahead while dispatching the load queue, see unit-prefetch.c */
+        Hashmap *unit_prefetch;
+
         char **transient_environment;  /* The environment, as determined from config files, kernel cmdline and environment generators */
         char **client_environment;     /* Environment variables created by clients through the bus API */
 
@@ -250,6 +302,20 @@ struct Manager {
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
+        Hashmap *mountinfo_snapshot; /* mount ID → MountInfoEntry, as of the last parse of /proc/self/mountinfo */
+        sd_event_source *mount_rescan_event_source;
+        usec_t mount_rescan_last_usec;     /* When the last rescan of /proc/self/mountinfo finished */
+        usec_t mount_rescan_duration_usec; /* … and how long it took */
+        bool mount_rescan_pending;
+
+        /* How many mount table change events have been received, and how long processing them took in total */
+        unsigned n_mount_events;
+        usec_t mount_usec;
+
+        /* Ring buffer of the last MANAGER_TRACE_MAX trace events, allocated on first use. trace_next is
+         * where the next event goes, i.e. the oldest one once the buffer is full. */
+        ManagerTraceEntry *trace;
+        size_t n_trace, trace_next;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -286,6 +352,9 @@ struct Manager {
         /* Data specific to the cgroup subsystem */
         Hashmap *cgroup_unit;
         CGroupMask cgroup_supported;
+
+        /* BPF firewall access maps, keyed by their contents, so that they can be shared between units */
+        Hashmap *bpf_access_maps;
         char *cgroup_root;
 
         /* Notifications from cgroups, when the unified hierarchy is used is done via inotify. */
@@ -307,6 +376,13 @@ struct Manager {
 
         unsigned gc_marker;
 
+        /* Set when the GC of units ran out of its time budget, until the next event loop iteration */
+        bool gc_unit_queue_yield;
+
+        /* How many units have been garbage collected, and how long the GC and cleanup queues took in total */
+        unsigned n_gc_units;
+        usec_t gc_usec;
+
         /* The stat() data the last time we saw /etc/localtime */
         usec_t etc_localtime_mtime;
         bool etc_localtime_accessible:1;
@@ -375,6 +451,11 @@ struct Manager {
         unsigned n_installed_jobs;
         unsigned n_failed_jobs;
 
+        /* How many transactions have been built, and how long that took in total and at most */
+        unsigned n_transactions;
+        usec_t transaction_usec;
+        usec_t transaction_max_usec;
+
         /* Jobs in progress watching */
         unsigned n_running_jobs;
         unsigned n_on_console;
@@ -501,6 +582,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+int manager_soft_reload(Manager *m);
 
 void manager_reset_failed(Manager *m);
 
@@ -557,6 +639,18 @@ const char *manager_timestamp_to_string(ManagerTimestamp m) _const_;
 ManagerTimestamp manager_timestamp_from_string(const char *s) _pure_;
 ManagerTimestamp manager_timestamp_initrd_mangle(ManagerTimestamp s);
 
+void manager_trace(Manager *m, ManagerTraceEvent event, const char *unit, const char *detail, pid_t pid);
+const ManagerTraceEntry *manager_trace_entry(Manager *m, size_t i);
+const char *manager_trace_entry_detail(const ManagerTraceEntry *e);
+
+const char *manager_trace_event_to_string(ManagerTraceEvent e) _const_;
+ManagerTraceEvent manager_trace_event_from_string(const char *s) _pure_;
+
+void manager_get_memory_usage(Manager *m, ManagerMemoryUsage ret[static _MANAGER_MEMORY_CATEGORY_MAX]);
+
+const char *manager_memory_category_to_string(ManagerMemoryCategory c) _const_;
+ManagerMemoryCategory manager_memory_category_from_string(const char *s) _pure_;
+
 usec_t manager_get_watchdog(Manager *m, WatchdogType t);
 void manager_set_watchdog(Manager *m, WatchdogType t, usec_t timeout);
 int manager_override_watchdog(Manager *m, WatchdogType t, usec_t timeout);
@@ -32,6 +32,12 @@
 #include "unit-name.h"
 #include "unit.h"
 
+/* Rescanning /proc/self/mountinfo is not free, hence when change events keep coming in, we wait a bit
+ * before rescanning again, so that many events are merged into one rescan. The delay grows with the cost
+ * of the previous rescan, but is bounded so that changes are still picked up quickly. */
+#define MOUNT_RESCAN_DELAY_FACTOR 4U
+#define MOUNT_RESCAN_DELAY_MAX_USEC (500 * USEC_PER_MSEC)
+
 #define RETRY_UMOUNT_MAX 32
 
 static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
@@ -1651,7 +1657,8 @@ static int mount_setup_unit(
                 const char *where,
                 const char *options,
                 const char *fstype,
-                bool set_flags) {
+                bool set_flags,
+                Unit **ret) {
 
         _cleanup_free_ char *e = NULL;
         MountProcFlags flags;
@@ -1663,6 +1670,9 @@ static int mount_setup_unit(
         assert(where);
         assert(options);
         assert(fstype);
+        assert(ret);
+
+        *ret = NULL;
 
         /* Ignore API mount points. They should never be referenced in
          * dependencies ever. */
@@ -1718,12 +1728,171 @@ static int mount_setup_unit(
         if (set_flags)
                 MOUNT(u)->proc_flags = flags;
 
+        *ret = u;
+        return 0;
+}
+
+typedef struct MountInfoEntry {
+        char *what;
+        char *where;
+        char *options;
+        char *fstype;
+        char *unit;  /* NULL if the mount point is ignored */
+        bool seen;
+} MountInfoEntry;
+
+static MountInfoEntry* mountinfo_entry_free(MountInfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->what);
+        free(e->where);
+        free(e->options);
+        free(e->fstype);
+        free(e->unit);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountInfoEntry*, mountinfo_entry_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(mountinfo_entry_hash_ops, void, trivial_hash_func, trivial_compare_func,
+                                              MountInfoEntry, mountinfo_entry_free);
+
+static int mountinfo_entry_new(
+                const char *what,
+                const char *where,
+                const char *options,
+                const char *fstype,
+                Unit *u,
+                MountInfoEntry **ret) {
+
+        _cleanup_(mountinfo_entry_freep) MountInfoEntry *e = NULL;
+
+        assert(ret);
+
+        e = new(MountInfoEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        *e = (MountInfoEntry) {
+                .what = strdup(what),
+                .where = strdup(where),
+                .options = strdup(options),
+                .fstype = strdup(fstype),
+                .unit = u ? strdup(u->id) : NULL,
+        };
+        if (!e->what || !e->where || !e->options || !e->fstype || (u && !e->unit))
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(e);
+        return 0;
+}
+
+static bool mountinfo_entry_matches(
+                const MountInfoEntry *e,
+                const char *what,
+                const char *where,
+                const char *options,
+                const char *fstype) {
+
+        return e &&
+                streq(e->what, what) &&
+                streq(e->where, where) &&
+                streq_ptr(e->options, options) &&
+                streq_ptr(e->fstype, fstype);
+}
+
+static bool mount_setup_unit_unchanged(Manager *m, const MountInfoEntry *e) {
+        Unit *u;
+
+        assert(m);
+        assert(e);
+
+        /* Handles a mountinfo entry that is exactly as it was during the last parse, and whose mount point
+         * saw no other changes either. All there is to do is to mark the unit as still mounted. Returns false
+         * if the unit needs the full treatment of mount_setup_unit() nonetheless. */
+
+        if (!e->unit)
+                return true; /* Ignored mount point */
+
+        u = manager_get_unit(m, e->unit);
+        if (!u)
+                return false;
+
+        /* Cover the cases where mount_setup_existing_unit() would flag the unit as just mounted or changed */
+        if (!MOUNT(u)->from_proc_self_mountinfo ||
+            MOUNT(u)->state == MOUNT_MOUNTING ||
+            IN_SET(u->load_state, UNIT_NOT_FOUND, UNIT_BAD_SETTING, UNIT_ERROR))
+                return false;
+
+        MOUNT(u)->proc_flags |= MOUNT_PROC_IS_MOUNTED;
+        return true;
+}
+
+static int mount_find_changed_mount_points(Manager *m, struct libmnt_table *table, struct libmnt_iter *iter, Set **ret) {
+        _cleanup_set_free_ Set *changed = NULL;
+        MountInfoEntry *e;
+        int r;
+
+        assert(m);
+        assert(table);
+        assert(iter);
+        assert(ret);
+
+        /* Collects the mount points that gained, lost or changed an entry since the last parse. Entries of
+         * the same mount point stack, and the topmost one defines the unit's parameters, hence all of them
+         * need to be processed again in that case. */
+
+        for (;;) {
+                struct libmnt_fs *fs;
+                const char *device, *path;
+
+                r = mnt_table_next_fs(table, iter, &fs);
+                if (r == 1)
+                        break;
+                if (r < 0)
+                        return r;
+
+                device = mnt_fs_get_source(fs);
+                path = mnt_fs_get_target(fs);
+                if (!device || !path)
+                        continue;
+
+                e = hashmap_get(m->mountinfo_snapshot, INT_TO_PTR(mnt_fs_get_id(fs)));
+                if (mountinfo_entry_matches(e, device, path, mnt_fs_get_options(fs), mnt_fs_get_fstype(fs))) {
+                        e->seen = true;
+                        continue;
+                }
+
+                r = set_ensure_put(&changed, &path_hash_ops, path);
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH(e, m->mountinfo_snapshot) {
+                if (e->seen) {
+                        e->seen = false;
+                        continue;
+                }
+
+                r = set_ensure_put(&changed, &path_hash_ops, e->where);
+                if (r < 0)
+                        return r;
+        }
+
+        mnt_reset_iter(iter, MNT_ITER_FORWARD);
+
+        *ret = TAKE_PTR(changed);
         return 0;
 }
 
 static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         _cleanup_(mnt_free_tablep) struct libmnt_table *table = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *iter = NULL;
+        _cleanup_hashmap_free_ Hashmap *snapshot = NULL;
+        _cleanup_set_free_ Set *changed = NULL;
+        bool incremental;
         int r;
 
         assert(m);
@@ -1732,15 +1901,35 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
+        /* With many mounts around, most of the entries are the same each time we get here. Hence we keep the
+         * entries from the last parse around, keyed by mount ID, and for the unchanged ones skip the device
+         * lookups and the unit setup. This is only done when processing change notifications, i.e. not when
+         * enumerating, where all units and device units have just been (re)created. */
+        incremental = set_flags && m->mountinfo_snapshot;
+        if (incremental) {
+                r = mount_find_changed_mount_points(m, table, iter, &changed);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to compare /proc/self/mountinfo with its previous contents, processing all entries: %m");
+                        changed = set_free(changed);
+                        incremental = false;
+                }
+        }
+
         for (;;) {
-                struct libmnt_fs *fs;
+                _cleanup_(mountinfo_entry_freep) MountInfoEntry *entry = NULL;
                 const char *device, *path, *options, *fstype;
+                struct libmnt_fs *fs;
+                MountInfoEntry *e;
+                Unit *u;
+                int id;
 
                 r = mnt_table_next_fs(table, iter, &fs);
                 if (r == 1)
                         break;
-                if (r < 0)
+                if (r < 0) {
+                        m->mountinfo_snapshot = hashmap_free(m->mountinfo_snapshot);
                         return log_error_errno(r, "Failed to get next entry from /proc/self/mountinfo: %m");
+                }
 
                 device = mnt_fs_get_source(fs);
                 path = mnt_fs_get_target(fs);
@@ -1750,11 +1939,38 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (!device || !path)
                         continue;
 
-                device_found_node(m, device, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+                id = mnt_fs_get_id(fs);
+
+                e = incremental ? hashmap_get(m->mountinfo_snapshot, INT_TO_PTR(id)) : NULL;
+                if (mountinfo_entry_matches(e, device, path, options, fstype)) {
+                        if (!set_contains(changed, path) && mount_setup_unit_unchanged(m, e)) {
+                                /* Carry the entry over into the new snapshot */
+                                if (hashmap_ensure_allocated(&snapshot, &mountinfo_entry_hash_ops) >= 0 &&
+                                    hashmap_put(snapshot, INT_TO_PTR(id), e) >= 0)
+                                        (void) hashmap_remove(m->mountinfo_snapshot, INT_TO_PTR(id));
+                                continue;
+                        }
+                } else
+                        device_found_node(m, device, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
+
+                r = mount_setup_unit(m, device, path, options, fstype, set_flags, &u);
+                if (r < 0)
+                        continue; /* Not recorded, so that we try again next time */
+
+                /* If we can't record the entry we'll simply process it in full again next time */
+                if (mountinfo_entry_new(device, path, options, fstype, u, &entry) < 0)
+                        continue;
+
+                if (hashmap_ensure_allocated(&snapshot, &mountinfo_entry_hash_ops) < 0 ||
+                    hashmap_put(snapshot, INT_TO_PTR(id), entry) < 0)
+                        continue;
 
-                (void) mount_setup_unit(m, device, path, options, fstype, set_flags);
+                TAKE_PTR(entry);
         }
 
+        hashmap_free(m->mountinfo_snapshot);
+        m->mountinfo_snapshot = TAKE_PTR(snapshot);
+
         return 0;
 }
 
@@ -1762,6 +1978,9 @@ static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_rescan_event_source = sd_event_source_disable_unref(m->mount_rescan_event_source);
+        m->mount_rescan_pending = false;
+        m->mountinfo_snapshot = hashmap_free(m->mountinfo_snapshot);
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
@@ -1892,14 +2111,16 @@ static int drain_libmount(Manager *m) {
                 r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
                 if (r < 0)
                         return log_error_errno(r, "Failed to drain libmount events: %m");
-                if (r == 0)
+                if (r == 0) {
+                        m->n_mount_events++;
                         rescan = true;
+                }
         } while (r == 0);
 
         return rescan;
 }
 
-static int mount_process_proc_self_mountinfo(Manager *m) {
+static void mount_rescan_proc_self_mountinfo(Manager *m) {
         _cleanup_set_free_free_ Set *around = NULL, *gone = NULL;
         const char *what;
         Unit *u;
@@ -1907,17 +2128,13 @@ static int mount_process_proc_self_mountinfo(Manager *m) {
 
         assert(m);
 
-        r = drain_libmount(m);
-        if (r <= 0)
-                return r;
-
         r = mount_load_proc_self_mountinfo(m, true);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
                         MOUNT(u)->proc_flags = 0;
 
-                return 0;
+                return;
         }
 
         manager_dispatch_load_queue(m);
@@ -2006,17 +2223,88 @@ static int mount_process_proc_self_mountinfo(Manager *m) {
                 /* Let the device units know that the device is no longer mounted */
                 device_found_node(m, what, 0, DEVICE_FOUND_MOUNT);
         }
+}
+
+static int mount_process_proc_self_mountinfo(Manager *m) {
+        usec_t begin, end;
+        int r;
+
+        assert(m);
+
+        /* Processes all pending changes right away, including those we deferred earlier */
+
+        r = drain_libmount(m);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                m->mount_rescan_pending = true;
+
+        if (!m->mount_rescan_pending)
+                return 0;
+
+        m->mount_rescan_pending = false;
+        (void) sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_OFF);
+
+        begin = now(CLOCK_MONOTONIC);
+        mount_rescan_proc_self_mountinfo(m);
+        end = now(CLOCK_MONOTONIC);
+
+        m->mount_rescan_last_usec = end;
+        m->mount_rescan_duration_usec = usec_sub_unsigned(end, begin);
+        m->mount_usec = usec_add(m->mount_usec, m->mount_rescan_duration_usec);
 
         return 0;
 }
 
+static int mount_dispatch_rescan(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        return mount_process_proc_self_mountinfo(m);
+}
+
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
+        usec_t next;
+        int r;
 
         assert(m);
         assert(revents & EPOLLIN);
 
-        return mount_process_proc_self_mountinfo(m);
+        r = drain_libmount(m);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                m->mount_rescan_pending = true;
+
+        if (!m->mount_rescan_pending)
+                return 0;
+
+        /* If we rescanned only very recently, wait a bit, so that what follows is merged into one rescan */
+        next = usec_add(m->mount_rescan_last_usec,
+                        MIN(m->mount_rescan_duration_usec * MOUNT_RESCAN_DELAY_FACTOR, MOUNT_RESCAN_DELAY_MAX_USEC));
+        if (m->mount_rescan_last_usec == 0 || now(CLOCK_MONOTONIC) >= next)
+                return mount_process_proc_self_mountinfo(m);
+
+        if (m->mount_rescan_event_source) {
+                r = sd_event_source_set_time(m->mount_rescan_event_source, next);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->mount_rescan_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(m->event, &m->mount_rescan_event_source, CLOCK_MONOTONIC, next, USEC_PER_MSEC,
+                                      mount_dispatch_rescan, m);
+                if (r >= 0) {
+                        (void) sd_event_source_set_priority(m->mount_rescan_event_source, SD_EVENT_PRIORITY_NORMAL-10);
+                        (void) sd_event_source_set_description(m->mount_rescan_event_source, "mount-rescan");
+                }
+        }
+        if (r < 0) {
+                log_debug_errno(r, "Failed to defer rescan of /proc/self/mountinfo, rescanning right away: %m");
+                return mount_process_proc_self_mountinfo(m);
+        }
+
+        return 0;
 }
 
 static void mount_reset_failed(Unit *u) {
@@ -1,7 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
-#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <unistd.h>
 
@@ -32,10 +31,21 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED,
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int path_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata);
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
-        static const int flags_table[_PATH_TYPE_MAX] = {
+static int path_spec_add_watch(PathSpec *s, uint32_t flags, sd_event_inotify_handler_t handler, sd_event_source **ret) {
+        int r;
+
+        r = sd_event_add_inotify(s->unit->manager->event, ret, s->path, flags, handler, s);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(*ret, "path");
+        return 0;
+}
+
+int path_spec_watch(PathSpec *s, sd_event_inotify_handler_t handler) {
+        static const uint32_t flags_table[_PATH_TYPE_MAX] = {
                 [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
                 [PATH_EXISTS_GLOB] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
                 [PATH_CHANGED] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO,
@@ -53,24 +63,13 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         path_spec_unwatch(s);
 
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = -errno;
-                goto fail;
-        }
-
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
-        if (r < 0)
-                goto fail;
-
-        (void) sd_event_source_set_description(s->event_source, "path");
-
         /* This function assumes the path was passed through path_simplify()! */
         assert(!strstr(s->path, "//"));
 
         for (slash = strchr(s->path, '/'); ; slash = strchr(slash+1, '/')) {
+                _cleanup_(sd_event_source_unrefp) sd_event_source *source = NULL;
                 char *cut = NULL;
-                int flags;
+                uint32_t flags;
                 char tmp;
 
                 if (slash) {
@@ -82,35 +81,39 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 } else
                         flags = flags_table[s->type];
 
-                r = inotify_add_watch(s->inotify_fd, s->path, flags);
+                r = path_spec_add_watch(s, flags, handler, &source);
                 if (r < 0) {
-                        if (IN_SET(errno, EACCES, ENOENT)) {
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
                                 if (cut)
                                         *cut = tmp;
                                 break;
                         }
 
-                        /* This second call to inotify_add_watch() should fail like the previous
-                         * one and is done for logging the error in a comprehensive way. */
-                        r = inotify_add_watch_and_warn(s->inotify_fd, s->path, flags);
-                        if (r < 0) {
-                                if (cut)
-                                        *cut = tmp;
-                                goto fail;
-                        }
+                        if (r == -ENOSPC)
+                                log_error_errno(r, "Failed to add a watch for %s: inotify watch limit reached", s->path);
+                        else
+                                log_error_errno(r, "Failed to add a watch for %s: %m", s->path);
 
-                        /* Hmm, we succeeded in adding the watch this time... let's continue. */
+                        if (cut)
+                                *cut = tmp;
+                        goto fail;
                 }
                 exists = true;
 
                 /* Path exists, we don't need to watch parent too closely. */
                 if (oldslash) {
+                        _cleanup_(sd_event_source_unrefp) sd_event_source *parent = NULL;
                         char *cut2 = oldslash + (oldslash == s->path);
                         char tmp2 = *cut2;
                         *cut2 = '\0';
 
-                        (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
+                        assert(s->n_event_sources > 0);
+
                         /* Error is ignored, the worst can happen is we get spurious events. */
+                        if (path_spec_add_watch(s, IN_MOVE_SELF, handler, &parent) >= 0) {
+                                sd_event_source_unref(s->event_sources[s->n_event_sources - 1]);
+                                s->event_sources[s->n_event_sources - 1] = TAKE_PTR(parent);
+                        }
 
                         *cut2 = tmp2;
                 }
@@ -118,17 +121,25 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 if (cut)
                         *cut = tmp;
 
-                if (slash)
-                        oldslash = slash;
-                else {
+                if (!GREEDY_REALLOC(s->event_sources, s->n_event_sources_allocated, s->n_event_sources + 1)) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                if (!slash)
                         /* whole path has been iterated over */
-                        s->primary_wd = r;
+                        s->primary_source = source;
+
+                s->event_sources[s->n_event_sources++] = TAKE_PTR(source);
+
+                if (!slash)
                         break;
-                }
+
+                oldslash = slash;
         }
 
         if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+                r = log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
                 /* either EACCESS or ENOENT */
                 goto fail;
         }
@@ -143,35 +154,25 @@ fail:
 void path_spec_unwatch(PathSpec *s) {
         assert(s);
 
-        s->event_source = sd_event_source_unref(s->event_source);
-        s->inotify_fd = safe_close(s->inotify_fd);
-}
-
-int path_spec_fd_event(PathSpec *s, uint32_t revents) {
-        union inotify_event_buffer buffer;
-        struct inotify_event *e;
-        ssize_t l;
-        int r = 0;
+        /* Keep the array around, we'll likely watch again soon */
+        while (s->n_event_sources > 0)
+                sd_event_source_unref(s->event_sources[--s->n_event_sources]);
 
-        if (revents != EPOLLIN)
-                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
-                                       "Got invalid poll event on inotify.");
+        s->primary_source = NULL;
+}
 
-        l = read(s->inotify_fd, &buffer, sizeof(buffer));
-        if (l < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
+bool path_spec_event(PathSpec *s, sd_event_source *source, const struct inotify_event *event) {
+        assert(s);
+        assert(event);
 
-                return log_error_errno(errno, "Failed to read inotify event: %m");
-        }
+        /* Returns true if the event is about the watched path itself, and we care about changes of it */
 
-        FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                if (IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
-                    s->primary_wd == e->wd)
-                        r = 1;
-        }
+        if (event->mask & IN_Q_OVERFLOW)
+                return false;
 
-        return r;
+        return IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
+                s->primary_source &&
+                s->primary_source == source;
 }
 
 static bool path_spec_check_good(PathSpec *s, bool initial, bool from_trigger_notify) {
@@ -229,8 +230,9 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 
 void path_spec_done(PathSpec *s) {
         assert(s);
-        assert(s->inotify_fd == -1);
+        assert(s->n_event_sources == 0);
 
+        free(s->event_sources);
         free(s->path);
 }
 
@@ -318,7 +320,7 @@ static int path_add_trigger_dependencies(Path *p) {
 
         assert(p);
 
-        if (!hashmap_isempty(UNIT(p)->dependencies[UNIT_TRIGGERS]))
+        if (!unit_dependencies_isempty(&UNIT(p)->dependencies, UNIT_TRIGGERS))
                 return 0;
 
         r = unit_load_related_unit(UNIT(p), ".service", &x);
@@ -405,7 +407,7 @@ static int path_watch(Path *p) {
         assert(p);
 
         LIST_FOREACH(spec, s, p->specs) {
-                r = path_spec_watch(s, path_dispatch_io);
+                r = path_spec_watch(s, path_dispatch_inotify);
                 if (r < 0)
                         return r;
         }
@@ -701,14 +703,13 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static int path_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata) {
         PathSpec *s = userdata;
         Path *p;
-        int changed;
 
         assert(s);
         assert(s->unit);
-        assert(fd >= 0);
+        assert(event);
 
         p = PATH(s->unit);
 
@@ -717,29 +718,14 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
 
         /* log_debug("inotify wakeup on %s.", UNIT(p)->id); */
 
-        LIST_FOREACH(spec, s, p->specs)
-                if (path_spec_owns_inotify_fd(s, fd))
-                        break;
-
-        if (!s) {
-                log_error("Got event on unknown fd.");
-                goto fail;
-        }
+        assert(path_spec_owns_event_source(s, source));
 
-        changed = path_spec_fd_event(s, revents);
-        if (changed < 0)
-                goto fail;
-
-        if (changed)
+        if (path_spec_event(s, source, event))
                 path_enter_running(p);
         else
                 path_enter_waiting(p, false, false);
 
         return 0;
-
-fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
-        return 0;
 }
 
 static void path_trigger_notify(Unit *u, Unit *other) {
@@ -21,24 +21,30 @@ typedef struct PathSpec {
 
         char *path;
 
-        sd_event_source *event_source;
+        /* One inotify event source for each watched path component. They all share the event loop's
+         * inotify fd, and watches on the same inode are shared with other path specs. */
+        sd_event_source **event_sources;
+        size_t n_event_sources, n_event_sources_allocated;
+        sd_event_source *primary_source; /* the one for the path itself, if it exists */
 
         LIST_FIELDS(struct PathSpec, spec);
 
         PathType type;
-        int inotify_fd;
-        int primary_wd;
 
         bool previous_exists;
 } PathSpec;
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler);
+int path_spec_watch(PathSpec *s, sd_event_inotify_handler_t handler);
 void path_spec_unwatch(PathSpec *s);
-int path_spec_fd_event(PathSpec *s, uint32_t events);
+bool path_spec_event(PathSpec *s, sd_event_source *source, const struct inotify_event *event);
 void path_spec_done(PathSpec *s);
 
-static inline bool path_spec_owns_inotify_fd(PathSpec *s, int fd) {
-        return s->inotify_fd == fd;
+static inline bool path_spec_owns_event_source(PathSpec *s, sd_event_source *source) {
+        for (size_t i = 0; i < s->n_event_sources; i++)
+                if (s->event_sources[i] == source)
+                        return true;
+
+        return false;
 }
 
 typedef enum PathResult {
@@ -214,6 +214,17 @@ static void slice_dump(Unit *u, FILE *f, const char *prefix) {
                 "%sSlice State: %s\n",
                 prefix, slice_state_to_string(t->state));
 
+        if (t->log_ratelimit_interval_usec > 0) {
+                char buf_timespan[FORMAT_TIMESPAN_MAX];
+
+                fprintf(f,
+                        "%sLogRateLimitIntervalSec: %s\n",
+                        prefix, format_timespan(buf_timespan, sizeof(buf_timespan), t->log_ratelimit_interval_usec, USEC_PER_SEC));
+        }
+
+        if (t->log_ratelimit_burst > 0)
+                fprintf(f, "%sLogRateLimitBurst: %u\n", prefix, t->log_ratelimit_burst);
+
         cgroup_context_dump(UNIT(t), f, prefix);
 }
 
@@ -350,11 +361,10 @@ static void slice_enumerate_perpetual(Manager *m) {
 
 static bool slice_freezer_action_supported_by_children(Unit *s) {
         Unit *member;
-        void *v;
 
         assert(s);
 
-        HASHMAP_FOREACH_KEY(v, member, s->dependencies[UNIT_BEFORE]) {
+        UNIT_FOREACH_DEPENDENCY(member, s, UNIT_BEFORE) {
                 int r;
 
                 if (UNIT_DEREF(member->slice) != s)
@@ -375,7 +385,6 @@ static bool slice_freezer_action_supported_by_children(Unit *s) {
 
 static int slice_freezer_action(Unit *s, FreezerAction action) {
         Unit *member;
-        void *v;
         int r;
 
         assert(s);
@@ -386,7 +395,7 @@ static int slice_freezer_action(Unit *s, FreezerAction action) {
                 return 0;
         }
 
-        HASHMAP_FOREACH_KEY(v, member, s->dependencies[UNIT_BEFORE]) {
+        UNIT_FOREACH_DEPENDENCY(member, s, UNIT_BEFORE) {
                 if (UNIT_DEREF(member->slice) != s)
                         continue;
 
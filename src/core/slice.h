@@ -11,6 +11,10 @@ struct Slice {
         SliceState state, deserialized_state;
 
         CGroupContext cgroup_context;
+
+        /* Log rate limit shared by all units in the slice */
+        usec_t log_ratelimit_interval_usec;
+        unsigned log_ratelimit_burst;
 };
 
 extern const UnitVTable slice_vtable;
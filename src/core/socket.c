@@ -54,6 +54,9 @@ struct SocketPeer {
         socklen_t peer_salen;
 };
 
+/* How many connections to accept per wakeup of an Accept=yes socket at most */
+#define SOCKET_ACCEPT_BATCH_MAX 16U
+
 static const UnitActiveState state_translation_table[_SOCKET_STATE_MAX] = {
         [SOCKET_DEAD] = UNIT_INACTIVE,
         [SOCKET_START_PRE] = UNIT_ACTIVATING,
@@ -2328,11 +2331,10 @@ static void socket_enter_running(Socket *s, int cfd_in) {
         if (cfd < 0) {
                 bool pending = false;
                 Unit *other;
-                void *v;
 
                 /* If there's already a start pending don't bother to
                  * do anything */
-                HASHMAP_FOREACH_KEY(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS])
+                UNIT_FOREACH_DEPENDENCY(other, UNIT(s), UNIT_TRIGGERS)
                         if (unit_active_or_pending(other)) {
                                 pending = true;
                                 break;
@@ -2891,17 +2893,49 @@ static int socket_accept_do(Socket *s, int fd) {
         return cfd;
 }
 
-static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
+static int socket_accept_many(Socket *s, int fd, int *ret_cfds, size_t n_max) {
+        size_t n = 0;
+        int cfd;
+
+        assert(s);
+        assert(fd >= 0);
+        assert(ret_cfds);
+        assert(n_max > 0);
+
+        /* Accepts up to n_max connections that are already queued. Returns the number of connections accepted,
+         * -EAGAIN if there were none, or an error if the first accept() failed. Errors on later accept() calls are
+         * left for the next wakeup to report. */
+
+        while (n < n_max) {
+                cfd = socket_accept_do(s, fd);
+                if (cfd < 0) {
+                        if (n > 0)
+                                break;
+
+                        return cfd;
+                }
+
+                ret_cfds[n++] = cfd;
+        }
+
+        return (int) n;
+}
+
+static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd, int *ret_cfds, size_t n_max) {
         _cleanup_close_pair_ int pair[2] = { -1, -1 };
-        int cfd, r;
+        int cfd, n = 0, r;
         pid_t pid;
 
         assert(s);
         assert(p);
         assert(fd >= 0);
+        assert(ret_cfds);
+        assert(n_max > 0);
 
         /* Similar to socket_address_listen_in_cgroup(), but for accept() rather than socket(): make sure that any
-         * connection socket is also properly associated with the cgroup. */
+         * connection socket is also properly associated with the cgroup. Since this involves forking off a
+         * helper, we accept all connections that are queued (up to n_max) in one go. Returns the number of
+         * connections accepted. */
 
         if (!IN_SET(p->address.sockaddr.sa.sa_family, AF_INET, AF_INET6))
                 goto shortcut;
@@ -2923,55 +2957,70 @@ static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
 
                 pair[0] = safe_close(pair[0]);
 
-                cfd = socket_accept_do(s, fd);
-                if (cfd == -EAGAIN) /* spurious accept() */
+                n = socket_accept_many(s, fd, ret_cfds, n_max);
+                if (n == -EAGAIN) /* spurious accept() */
                         _exit(EXIT_SUCCESS);
-                if (cfd < 0) {
-                        log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+                if (n < 0) {
+                        log_unit_error_errno(UNIT(s), n, "Failed to accept connection socket: %m");
                         _exit(EXIT_FAILURE);
                 }
 
-                r = send_one_fd(pair[1], cfd, 0);
-                if (r < 0) {
-                        log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
-                        _exit(EXIT_FAILURE);
+                for (int i = 0; i < n; i++) {
+                        r = send_one_fd(pair[1], ret_cfds[i], 0);
+                        if (r < 0) {
+                                log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
+                                _exit(EXIT_FAILURE);
+                        }
                 }
 
                 _exit(EXIT_SUCCESS);
         }
 
         pair[1] = safe_close(pair[1]);
-        cfd = receive_one_fd(pair[0], 0);
+
+        /* Collect the connection sockets until the helper closes its end of the channel */
+        for (;;) {
+                cfd = receive_one_fd(pair[0], 0);
+                if (cfd < 0)
+                        break;
+
+                ret_cfds[n++] = cfd;
+                if ((size_t) n >= n_max)
+                        break;
+        }
 
         /* We synchronously wait for the helper, as it shouldn't be slow */
         r = wait_for_terminate_and_check("(sd-accept)", pid, WAIT_LOG_ABNORMAL);
         if (r < 0) {
-                safe_close(cfd);
+                close_many(ret_cfds, n);
                 return r;
         }
 
+        if (n > 0)
+                return n;
+
         /* If we received no fd, we got EIO here. If this happens with a process exit code of EXIT_SUCCESS
          * this is a spurious accept(), let's convert that back to EAGAIN here. */
         if (cfd == -EIO)
                 return -EAGAIN;
-        if (cfd < 0)
-                return log_unit_error_errno(UNIT(s), cfd, "Failed to receive connection socket: %m");
 
-        return cfd;
+        return log_unit_error_errno(UNIT(s), cfd, "Failed to receive connection socket: %m");
 
 shortcut:
-        cfd = socket_accept_do(s, fd);
-        if (cfd == -EAGAIN) /* spurious accept(), skip it silently */
+        n = socket_accept_many(s, fd, ret_cfds, n_max);
+        if (n == -EAGAIN) /* spurious accept(), skip it silently */
                 return -EAGAIN;
-        if (cfd < 0)
-                return log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+        if (n < 0)
+                return log_unit_error_errno(UNIT(s), n, "Failed to accept connection socket: %m");
 
-        return cfd;
+        return n;
 }
 
 static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         SocketPort *p = userdata;
-        int cfd = -1;
+        int cfds[SOCKET_ACCEPT_BATCH_MAX];
+        size_t n_max;
+        int n;
 
         assert(p);
         assert(fd >= 0);
@@ -2993,16 +3042,33 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
             p->type == SOCKET_SOCKET &&
             socket_address_can_accept(&p->address)) {
 
-                cfd = socket_accept_in_cgroup(p->socket, p, fd);
-                if (cfd == -EAGAIN) /* Spurious accept() */
+                /* Take all queued connections we have room for in one go, but at least one, so that excess
+                 * connections are still refused as before. */
+                n_max = p->socket->max_connections > p->socket->n_connections ?
+                        MIN(p->socket->max_connections - p->socket->n_connections, ELEMENTSOF(cfds)) : 1;
+
+                n = socket_accept_in_cgroup(p->socket, p, fd, cfds, n_max);
+                if (n == -EAGAIN) /* Spurious accept() */
                         return 0;
-                if (cfd < 0)
+                if (n < 0)
                         goto fail;
 
-                socket_apply_socket_options(p->socket, p, cfd);
+                for (int i = 0; i < n; i++) {
+                        /* Activating the instance for one connection might have made us leave the listening
+                         * state, in which case the remaining connections are dropped. */
+                        if (p->socket->state != SOCKET_LISTENING) {
+                                close_many(cfds + i, n - i);
+                                break;
+                        }
+
+                        socket_apply_socket_options(p->socket, p, cfds[i]);
+                        socket_enter_running(p->socket, cfds[i]);
+                }
+
+                return 0;
         }
 
-        socket_enter_running(p->socket, cfd);
+        socket_enter_running(p->socket, -1);
         return 0;
 
 fail:
@@ -0,0 +1,575 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/* A small helper the service manager may spawn with posix_spawn() instead of fork()ing itself. It is only used
+ * for units whose ExecContext needs none of the sandboxing, credential or namespacing logic of exec_child(),
+ * see exec_context_may_use_spawn_helper() in execute.c. It joins the unit's cgroup, sets up standard I/O, the
+ * kernel keyring, resource limits, the umask and the working directory and then executes the command. The
+ * environment block of the command is passed NUL separated on stdin, so that it does not apply to the helper
+ * itself. */
+
+#include <getopt.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sd-id128.h"
+#include "sd-messages.h"
+
+#include "alloc-util.h"
+#include "cgroup-setup.h"
+#include "def.h"
+#include "env-util.h"
+#include "exit-status.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "log.h"
+#include "missing_resource.h"
+#include "missing_syscall.h"
+#include "parse-util.h"
+#include "rlimit-util.h"
+#include "signal-util.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "syslog-util.h"
+
+typedef enum SpawnKeyring {
+        SPAWN_KEYRING_INHERIT,
+        SPAWN_KEYRING_PRIVATE,
+        SPAWN_KEYRING_SHARED,
+} SpawnKeyring;
+
+typedef enum SpawnOutput {
+        SPAWN_OUTPUT_NULL,
+        SPAWN_OUTPUT_JOURNAL,
+        SPAWN_OUTPUT_INHERIT, /* stderr only: same as stdout */
+} SpawnOutput;
+
+#define SNDBUF_SIZE (8*1024*1024)
+
+static const char *arg_unit = NULL;
+static bool arg_user = false;
+static sd_id128_t arg_invocation_id = {};
+static const char *arg_cgroup = NULL;
+static CGroupMask arg_cgroup_supported = 0;
+static mode_t arg_umask = 0022;
+static const char *arg_working_directory = "/";
+static bool arg_working_directory_missing_ok = false;
+static struct rlimit *arg_rlimit[_RLIMIT_MAX] = {};
+static SpawnKeyring arg_keyring = SPAWN_KEYRING_INHERIT;
+static SpawnOutput arg_stdout = SPAWN_OUTPUT_NULL;
+static SpawnOutput arg_stderr = SPAWN_OUTPUT_INHERIT;
+static const char *arg_syslog_identifier = NULL;
+static int arg_syslog_priority = LOG_DAEMON|LOG_INFO;
+static bool arg_syslog_level_prefix = true;
+static bool arg_log_unit = false;
+static bool arg_ignore_sigpipe = true;
+static bool arg_ignore_missing = false;
+static const char *arg_path = NULL;
+
+enum {
+        ARG_UNIT = 0x100,
+        ARG_USER,
+        ARG_INVOCATION_ID,
+        ARG_CGROUP,
+        ARG_CGROUP_SUPPORTED,
+        ARG_UMASK,
+        ARG_WORKING_DIRECTORY,
+        ARG_RLIMIT,
+        ARG_KEYRING,
+        ARG_STDOUT,
+        ARG_STDERR,
+        ARG_SYSLOG_IDENTIFIER,
+        ARG_SYSLOG_PRIORITY,
+        ARG_SYSLOG_LEVEL_PREFIX,
+        ARG_LOG_UNIT,
+        ARG_LOG_LEVEL,
+        ARG_IGNORE_SIGPIPE,
+        ARG_IGNORE_MISSING,
+};
+
+static int parse_output(const char *s, SpawnOutput *ret) {
+        if (streq(s, "null"))
+                *ret = SPAWN_OUTPUT_NULL;
+        else if (streq(s, "journal"))
+                *ret = SPAWN_OUTPUT_JOURNAL;
+        else if (streq(s, "inherit"))
+                *ret = SPAWN_OUTPUT_INHERIT;
+        else
+                return -EINVAL;
+
+        return 0;
+}
+
+static int parse_argv(int argc, char *argv[]) {
+
+        static const struct option options[] = {
+                { "unit",                required_argument, NULL, ARG_UNIT                },
+                { "user",                no_argument,       NULL, ARG_USER                },
+                { "invocation-id",       required_argument, NULL, ARG_INVOCATION_ID       },
+                { "cgroup",              required_argument, NULL, ARG_CGROUP              },
+                { "cgroup-supported",    required_argument, NULL, ARG_CGROUP_SUPPORTED    },
+                { "umask",               required_argument, NULL, ARG_UMASK               },
+                { "working-directory",   required_argument, NULL, ARG_WORKING_DIRECTORY   },
+                { "rlimit",              required_argument, NULL, ARG_RLIMIT              },
+                { "keyring",             required_argument, NULL, ARG_KEYRING             },
+                { "stdout",              required_argument, NULL, ARG_STDOUT              },
+                { "stderr",              required_argument, NULL, ARG_STDERR              },
+                { "syslog-identifier",   required_argument, NULL, ARG_SYSLOG_IDENTIFIER   },
+                { "syslog-priority",     required_argument, NULL, ARG_SYSLOG_PRIORITY     },
+                { "syslog-level-prefix", required_argument, NULL, ARG_SYSLOG_LEVEL_PREFIX },
+                { "log-unit",            no_argument,       NULL, ARG_LOG_UNIT            },
+                { "log-level",           required_argument, NULL, ARG_LOG_LEVEL           },
+                { "ignore-sigpipe",      required_argument, NULL, ARG_IGNORE_SIGPIPE      },
+                { "ignore-missing",      no_argument,       NULL, ARG_IGNORE_MISSING      },
+                {}
+        };
+
+        int c, r;
+
+        assert(argc >= 0);
+        assert(argv);
+
+        /* Stop at the first positional argument, everything from there on belongs to the command */
+        while ((c = getopt_long(argc, argv, "+", options, NULL)) >= 0)
+                switch (c) {
+
+                case ARG_UNIT:
+                        arg_unit = optarg;
+                        break;
+
+                case ARG_USER:
+                        arg_user = true;
+                        break;
+
+                case ARG_INVOCATION_ID:
+                        r = sd_id128_from_string(optarg, &arg_invocation_id);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse invocation ID: %s", optarg);
+                        break;
+
+                case ARG_CGROUP:
+                        arg_cgroup = optarg;
+                        break;
+
+                case ARG_CGROUP_SUPPORTED: {
+                        uint64_t m;
+
+                        r = safe_atou64(optarg, &m);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse cgroup controller mask: %s", optarg);
+
+                        arg_cgroup_supported = (CGroupMask) m;
+                        break;
+                }
+
+                case ARG_UMASK:
+                        r = parse_mode(optarg, &arg_umask);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse umask: %s", optarg);
+                        break;
+
+                case ARG_WORKING_DIRECTORY:
+                        arg_working_directory_missing_ok = optarg[0] == '-';
+                        arg_working_directory = optarg + arg_working_directory_missing_ok;
+                        break;
+
+                case ARG_RLIMIT: {
+                        _cleanup_free_ char *name = NULL;
+                        struct rlimit rl, *copy;
+                        const char *eq;
+                        int resource;
+
+                        eq = strchr(optarg, '=');
+                        if (!eq)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Resource limit lacks '=': %s", optarg);
+
+                        name = strndup(optarg, eq - optarg);
+                        if (!name)
+                                return log_oom();
+
+                        resource = rlimit_from_string(name);
+                        if (resource < 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Unknown resource limit: %s", name);
+
+                        r = rlimit_parse(resource, eq + 1, &rl);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse resource limit: %s", optarg);
+
+                        copy = newdup(struct rlimit, &rl, 1);
+                        if (!copy)
+                                return log_oom();
+
+                        free_and_replace(arg_rlimit[resource], copy);
+                        break;
+                }
+
+                case ARG_KEYRING:
+                        if (streq(optarg, "inherit"))
+                                arg_keyring = SPAWN_KEYRING_INHERIT;
+                        else if (streq(optarg, "private"))
+                                arg_keyring = SPAWN_KEYRING_PRIVATE;
+                        else if (streq(optarg, "shared"))
+                                arg_keyring = SPAWN_KEYRING_SHARED;
+                        else
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Unknown keyring mode: %s", optarg);
+                        break;
+
+                case ARG_STDOUT:
+                        r = parse_output(optarg, &arg_stdout);
+                        if (r < 0 || arg_stdout == SPAWN_OUTPUT_INHERIT)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Unknown standard output mode: %s", optarg);
+                        break;
+
+                case ARG_STDERR:
+                        r = parse_output(optarg, &arg_stderr);
+                        if (r < 0)
+                                return log_error_errno(r, "Unknown standard error mode: %s", optarg);
+                        break;
+
+                case ARG_SYSLOG_IDENTIFIER:
+                        arg_syslog_identifier = optarg;
+                        break;
+
+                case ARG_SYSLOG_PRIORITY:
+                        r = safe_atoi(optarg, &arg_syslog_priority);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse syslog priority: %s", optarg);
+                        break;
+
+                case ARG_SYSLOG_LEVEL_PREFIX:
+                        r = parse_boolean(optarg);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse syslog level prefix setting: %s", optarg);
+
+                        arg_syslog_level_prefix = r;
+                        break;
+
+                case ARG_LOG_UNIT:
+                        arg_log_unit = true;
+                        break;
+
+                case ARG_LOG_LEVEL:
+                        r = log_level_from_string(optarg);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse log level: %s", optarg);
+
+                        log_set_max_level(r);
+                        break;
+
+                case ARG_IGNORE_SIGPIPE:
+                        r = parse_boolean(optarg);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse SIGPIPE setting: %s", optarg);
+
+                        arg_ignore_sigpipe = r;
+                        break;
+
+                case ARG_IGNORE_MISSING:
+                        arg_ignore_missing = true;
+                        break;
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached("Unhandled option");
+                }
+
+        if (argc - optind < 2)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Expected a command path and at least argv[0].");
+
+        if (!arg_unit)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "No unit specified.");
+
+        arg_path = argv[optind];
+        if (!arg_syslog_identifier)
+                arg_syslog_identifier = basename(arg_path);
+
+        return optind + 1;
+}
+
+static int read_environment(char ***ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        size_t size;
+        char **l;
+        int fd, r;
+
+        assert(ret);
+
+        /* Our caller passes the environment block on stdin. Take it out of the stdio range, so that we can put
+         * /dev/null or the journal stream in its place later on. */
+        fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        f = fdopen(fd, "r");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        r = read_full_stream(f, &buf, &size);
+        if (r < 0)
+                return r;
+
+        l = strv_parse_nulstr(buf, size);
+        if (!l)
+                return -ENOMEM;
+
+        *ret = l;
+        return 0;
+}
+
+static int connect_journal(int *ret, dev_t *journal_stream_dev, ino_t *journal_stream_ino) {
+        static const union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+                .un.sun_path = "/run/systemd/journal/stdout",
+        };
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+
+        assert(ret);
+
+        /* This mirrors connect_logger_as() in execute.c. We must connect only after joining the unit's cgroup, so
+         * that journald attributes the stream to the unit. */
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        if (connect(fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) < 0)
+                return -errno;
+
+        if (shutdown(fd, SHUT_RD) < 0)
+                return -errno;
+
+        (void) fd_inc_sndbuf(fd, SNDBUF_SIZE);
+
+        if (dprintf(fd,
+                    "%s\n"
+                    "%s\n"
+                    "%i\n"
+                    "%i\n"
+                    "%i\n"
+                    "%i\n"
+                    "%i\n",
+                    arg_syslog_identifier,
+                    arg_log_unit ? arg_unit : "",
+                    arg_syslog_priority,
+                    arg_syslog_level_prefix,
+                    false,
+                    false,
+                    false) < 0)
+                return -errno;
+
+        if (fstat(fd, &st) >= 0) {
+                *journal_stream_dev = st.st_dev;
+                *journal_stream_ino = st.st_ino;
+        }
+
+        *ret = TAKE_FD(fd);
+        return 0;
+}
+
+static int setup_stdio(char ***env) {
+        _cleanup_close_ int out = -1, err = -1;
+        dev_t journal_stream_dev = 0;
+        ino_t journal_stream_ino = 0;
+        int r;
+
+        assert(env);
+
+        if (arg_stdout == SPAWN_OUTPUT_JOURNAL) {
+                r = connect_journal(&out, &journal_stream_dev, &journal_stream_ino);
+                if (r < 0)
+                        log_warning_errno(r, "%s: Failed to connect stdout to the journal socket, ignoring: %m", arg_unit);
+        }
+
+        /* Like exec_child(), prefer the stderr stream for $JOURNAL_STREAM if both are connected separately */
+        if (arg_stderr == SPAWN_OUTPUT_JOURNAL && arg_stdout != SPAWN_OUTPUT_JOURNAL) {
+                r = connect_journal(&err, &journal_stream_dev, &journal_stream_ino);
+                if (r < 0)
+                        log_warning_errno(r, "%s: Failed to connect stderr to the journal socket, ignoring: %m", arg_unit);
+        } else if (arg_stderr != SPAWN_OUTPUT_NULL && out >= 0) {
+                err = fcntl(out, F_DUPFD_CLOEXEC, 3);
+                if (err < 0)
+                        return -errno;
+        }
+
+        r = rearrange_stdio(-1, TAKE_FD(out), TAKE_FD(err));
+        if (r < 0)
+                return r;
+
+        if (journal_stream_dev != 0) {
+                _cleanup_free_ char *x = NULL;
+
+                if (asprintf(&x, "JOURNAL_STREAM=" DEV_FMT ":" INO_FMT, journal_stream_dev, journal_stream_ino) < 0)
+                        return -ENOMEM;
+
+                if (strv_env_replace(env, x) < 0)
+                        return -ENOMEM;
+                TAKE_PTR(x);
+        }
+
+        return 0;
+}
+
+static int setup_keyring(void) {
+        key_serial_t key;
+
+        /* Like setup_keyring() in execute.c, but we never change UIDs, hence this is much simpler */
+
+        if (arg_keyring == SPAWN_KEYRING_INHERIT)
+                return 0;
+
+        if (keyctl(KEYCTL_JOIN_SESSION_KEYRING, 0, 0, 0, 0) == -1) {
+                if (errno == ENOSYS)
+                        log_debug_errno(errno, "Kernel keyring not supported, ignoring.");
+                else if (IN_SET(errno, EACCES, EPERM))
+                        log_debug_errno(errno, "Kernel keyring access prohibited, ignoring.");
+                else if (errno == EDQUOT)
+                        log_debug_errno(errno, "Out of kernel keyrings to allocate, ignoring.");
+                else
+                        return log_error_errno(errno, "%s: Setting up kernel keyring failed: %m", arg_unit);
+
+                return 0;
+        }
+
+        if (arg_keyring == SPAWN_KEYRING_SHARED &&
+            keyctl(KEYCTL_LINK, KEY_SPEC_USER_KEYRING, KEY_SPEC_SESSION_KEYRING, 0, 0) < 0)
+                return log_error_errno(errno, "%s: Failed to link user keyring into session keyring: %m", arg_unit);
+
+        if (sd_id128_is_null(arg_invocation_id))
+                return 0;
+
+        key = add_key("user", "invocation_id", &arg_invocation_id, sizeof(arg_invocation_id), KEY_SPEC_SESSION_KEYRING);
+        if (key == -1)
+                log_debug_errno(errno, "Failed to add invocation ID to keyring, ignoring: %m");
+        else if (keyctl(KEYCTL_SETPERM, key,
+                        KEY_POS_VIEW|KEY_POS_READ|KEY_POS_SEARCH|
+                        KEY_USR_VIEW|KEY_USR_READ|KEY_USR_SEARCH, 0, 0) < 0)
+                return log_error_errno(errno, "%s: Failed to restrict invocation ID permission: %m", arg_unit);
+
+        return 0;
+}
+
+static int run(int argc, char *argv[], int *exit_status) {
+        _cleanup_strv_free_ char **env = NULL;
+        int r, which_failed;
+
+        assert(exit_status);
+
+        /* Same as exec_child(): reset what PID 1 set up for itself */
+        (void) default_signals(SIGNALS_CRASH_HANDLER, SIGNALS_IGNORE, -1);
+
+        r = reset_signal_mask();
+        if (r < 0) {
+                *exit_status = EXIT_SIGNAL_MASK;
+                return log_error_errno(r, "Failed to set process signal mask: %m");
+        }
+
+        log_set_target(LOG_TARGET_JOURNAL_OR_KMSG);
+        log_set_open_when_needed(true);
+
+        r = parse_argv(argc, argv);
+        if (r < 0) {
+                *exit_status = EXIT_FAILURE;
+                return r;
+        }
+        argv += r;
+
+        r = read_environment(&env);
+        if (r < 0) {
+                *exit_status = EXIT_MEMORY;
+                return log_error_errno(r, "Failed to read environment block: %m");
+        }
+
+        r = close_all_fds(NULL, 0);
+        if (r < 0) {
+                *exit_status = EXIT_FDS;
+                return log_error_errno(r, "Failed to close unwanted file descriptors: %m");
+        }
+
+        if (setsid() < 0) {
+                *exit_status = EXIT_SETSID;
+                return log_error_errno(errno, "Failed to create new process session: %m");
+        }
+
+        /* Join the cgroup first, so that journald attributes the stdout stream to the unit, and no user code
+         * ever runs outside of it. */
+        if (arg_cgroup) {
+                r = cg_attach_everywhere(arg_cgroup_supported, arg_cgroup, 0, NULL, NULL);
+                if (r < 0) {
+                        *exit_status = EXIT_CGROUP;
+                        return log_error_errno(r, "Failed to attach to cgroup %s: %m", arg_cgroup);
+                }
+        }
+
+        r = setup_stdio(&env);
+        if (r < 0) {
+                *exit_status = EXIT_STDOUT;
+                return log_error_errno(r, "Failed to set up standard output: %m");
+        }
+
+        (void) umask(arg_umask);
+
+        r = setup_keyring();
+        if (r < 0) {
+                *exit_status = EXIT_KEYRING;
+                return r;
+        }
+
+        r = setrlimit_closest_all((const struct rlimit* const *) arg_rlimit, &which_failed);
+        if (r < 0) {
+                *exit_status = EXIT_LIMITS;
+                return log_error_errno(r, "Failed to adjust resource limit RLIMIT_%s: %m", rlimit_to_string(which_failed));
+        }
+
+        if (chdir(arg_working_directory) < 0 && !arg_working_directory_missing_ok) {
+                *exit_status = EXIT_CHDIR;
+                return log_error_errno(errno, "Changing to the requested working directory failed: %m");
+        }
+
+        if (arg_ignore_sigpipe)
+                (void) ignore_signals(SIGPIPE, -1);
+
+        execve(arg_path, argv, env);
+        r = -errno;
+
+        if (r == -ENOENT && arg_ignore_missing) {
+                log_struct_errno(LOG_INFO, r,
+                                 "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                 "%s=%s", arg_user ? "USER_UNIT" : "UNIT", arg_unit,
+                                 "%s=" SD_ID128_FORMAT_STR, arg_user ? "USER_INVOCATION_ID" : "INVOCATION_ID", SD_ID128_FORMAT_VAL(arg_invocation_id),
+                                 LOG_MESSAGE("%s: Executable %s missing, skipping: %m", arg_unit, arg_path),
+                                 "EXECUTABLE=%s", arg_path);
+                *exit_status = EXIT_SUCCESS;
+                return 0;
+        }
+
+        *exit_status = EXIT_EXEC;
+        return log_error_errno(r, "Failed to execute command: %m");
+}
+
+int main(int argc, char *argv[]) {
+        int exit_status = EXIT_SUCCESS, r;
+
+        r = run(argc, argv, &exit_status);
+        if (r < 0 && arg_path) {
+                const char *status =
+                        exit_status_to_string(exit_status,
+                                              EXIT_STATUS_LIBC | EXIT_STATUS_SYSTEMD);
+
+                log_struct_errno(LOG_ERR, r,
+                                 "MESSAGE_ID=" SD_MESSAGE_SPAWN_FAILED_STR,
+                                 "%s=%s", arg_user ? "USER_UNIT" : "UNIT", arg_unit,
+                                 "%s=" SD_ID128_FORMAT_STR, arg_user ? "USER_INVOCATION_ID" : "INVOCATION_ID", SD_ID128_FORMAT_VAL(arg_invocation_id),
+                                 LOG_MESSAGE("%s: Failed at step %s spawning %s: %m", arg_unit, status, arg_path),
+                                 "EXECUTABLE=%s", arg_path);
+        }
+
+        return exit_status;
+}
@@ -279,39 +279,39 @@ static int transaction_merge_jobs(Transaction *tr, sd_bus_error *e) {
 }
 
 static void transaction_drop_redundant(Transaction *tr) {
-        bool again;
+        Job *j;
 
         /* Goes through the transaction and removes all jobs of the units whose jobs are all noops. If not
-         * all of a unit's jobs are redundant, they are kept. */
+         * all of a unit's jobs are redundant, they are kept.
+         *
+         * Whether a job is redundant only depends on its own unit, and deleting a job without its
+         * dependencies never deletes the jobs of other units, hence a single pass is sufficient. Dropping
+         * the current entry is safe while iterating. */
 
         assert(tr);
 
-        do {
-                Job *j;
-
-                again = false;
-
-                HASHMAP_FOREACH(j, tr->jobs) {
-                        bool keep = false;
-                        Job *k;
-
-                        LIST_FOREACH(transaction, k, j)
-                                if (tr->anchor_job == k ||
-                                    !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
-                                    (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type))) {
-                                        keep = true;
-                                        break;
-                                }
+        HASHMAP_FOREACH(j, tr->jobs) {
+                bool keep = false;
+                Unit *u = j->unit;
+                Job *k;
 
-                        if (!keep) {
-                                log_trace("Found redundant job %s/%s, dropping from transaction.",
-                                          j->unit->id, job_type_to_string(j->type));
-                                transaction_delete_job(tr, j, false);
-                                again = true;
+                LIST_FOREACH(transaction, k, j)
+                        if (tr->anchor_job == k ||
+                            !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
+                            (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type))) {
+                                keep = true;
                                 break;
                         }
+
+                if (keep)
+                        continue;
+
+                while ((k = hashmap_get(tr->jobs, u))) {
+                        log_trace("Found redundant job %s/%s, dropping from transaction.",
+                                  k->unit->id, job_type_to_string(k->type));
+                        transaction_delete_job(tr, k, false);
                 }
-        } while (again);
+        }
 }
 
 _pure_ static bool unit_matters_to_anchor(Unit *u, Job *j) {
@@ -346,142 +346,202 @@ static char* merge_unit_ids(const char* unit_log_field, char **pairs) {
         return ans;
 }
 
-static int transaction_verify_order_one(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
-        Unit *u;
-        void *v;
-        int r;
-        static const UnitDependency directions[] = {
-                UNIT_BEFORE,
-                UNIT_AFTER,
-        };
-        size_t d;
+static int transaction_break_cycle(Transaction *tr, Job *j, Job *from, unsigned generation, sd_bus_error *e) {
+        Job *k, *delete = NULL;
+        _cleanup_free_ char **array = NULL, *unit_ids = NULL;
+        char **unit_id, **job_type;
 
-        assert(tr);
-        assert(j);
-        assert(!j->transaction_prev);
+        /* We reached j, which is on our path already, coming from 'from'. We have a cycle. Let's try to
+         * break it. We go backwards in our path and try to find a suitable job to remove. We use the
+         * marker to find our way back, since smart how we are we stored our way back in there. */
 
-        /* Does a recursive sweep through the ordering graph, looking
-         * for a cycle. If we find a cycle we try to break it. */
+        for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
 
-        /* Have we seen this before? */
-        if (j->generation == generation) {
-                Job *k, *delete = NULL;
-                _cleanup_free_ char **array = NULL, *unit_ids = NULL;
-                char **unit_id, **job_type;
+                /* For logging below */
+                if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
+                        log_oom();
 
-                /* If the marker is NULL we have been here already and
-                 * decided the job was loop-free from here. Hence
-                 * shortcut things and return right-away. */
-                if (!j->marker)
-                        return 0;
+                if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
+                        /* Ok, we can drop this one, so let's do so. */
+                        delete = k;
 
-                /* So, the marker is not NULL and we already have been here. We have
-                 * a cycle. Let's try to break it. We go backwards in our path and
-                 * try to find a suitable job to remove. We use the marker to find
-                 * our way back, since smart how we are we stored our way back in
-                 * there. */
+                /* Check if this in fact was the beginning of the cycle */
+                if (k == j)
+                        break;
+        }
 
-                for (k = from; k; k = ((k->generation == generation && k->marker != k) ? k->marker : NULL)) {
+        unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
 
-                        /* For logging below */
-                        if (strv_push_pair(&array, k->unit->id, (char*) job_type_to_string(k->type)) < 0)
-                                log_oom();
+        STRV_FOREACH_PAIR(unit_id, job_type, array)
+                /* logging for j not k here to provide a consistent narrative */
+                log_struct(LOG_WARNING,
+                           "MESSAGE=%s: Found %s on %s/%s",
+                           j->unit->id,
+                           unit_id == array ? "ordering cycle" : "dependency",
+                           *unit_id, *job_type,
+                           unit_ids);
 
-                        if (!delete && hashmap_get(tr->jobs, k->unit) && !unit_matters_to_anchor(k->unit, k))
-                                /* Ok, we can drop this one, so let's do so. */
-                                delete = k;
+        if (delete) {
+                const char *status;
+                /* logging for j not k here to provide a consistent narrative */
+                log_struct(LOG_ERR,
+                           "MESSAGE=%s: Job %s/%s deleted to break ordering cycle starting with %s/%s",
+                           j->unit->id, delete->unit->id, job_type_to_string(delete->type),
+                           j->unit->id, job_type_to_string(j->type),
+                           unit_ids);
 
-                        /* Check if this in fact was the beginning of the cycle */
-                        if (k == j)
-                                break;
+                if (log_get_show_color())
+                        status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
+                else
+                        status = " SKIP ";
+
+                unit_status_printf(delete->unit,
+                                   STATUS_TYPE_NOTICE,
+                                   status,
+                                   "Ordering cycle found, skipping %s");
+                transaction_delete_unit(tr, delete->unit);
+                return -EAGAIN;
+        }
+
+        log_struct(LOG_ERR,
+                   "MESSAGE=%s: Unable to break cycle starting with %s/%s",
+                   j->unit->id, j->unit->id, job_type_to_string(j->type),
+                   unit_ids);
+
+        return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
+                                 "Transaction order is cyclic. See system logs for details.");
+}
+
+typedef struct OrderFrame {
+        Job *job;
+        size_t direction;
+        UnitDependencyIterator iterator;
+} OrderFrame;
+
+static const UnitDependency order_directions[] = {
+        UNIT_BEFORE,
+        UNIT_AFTER,
+};
+
+static Job* order_frame_next(Transaction *tr, OrderFrame *f) {
+        Unit *u;
+
+        assert(tr);
+        assert(f);
+
+        /* Returns the next job that is ordered after the frame's job, and that we hence need to visit. Actual
+         * ordering of jobs depends on the unit ordering dependency and job types. We need to traverse the
+         * graph over 'before' edges in the actual job execution order. We traverse over both unit ordering
+         * dependencies and we test with job_compare() whether it is the 'before' edge in the job execution
+         * ordering. */
+
+        while (f->direction < ELEMENTSOF(order_directions)) {
+                Job *o;
+
+                if (!unit_dependencies_next(&f->job->unit->dependencies, order_directions[f->direction], &f->iterator, &u, NULL)) {
+                        f->direction++;
+                        f->iterator = UNIT_DEPENDENCY_ITERATOR_FIRST;
+                        continue;
                 }
 
-                unit_ids = merge_unit_ids(j->manager->unit_log_field, array); /* ignore error */
-
-                STRV_FOREACH_PAIR(unit_id, job_type, array)
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_WARNING,
-                                   "MESSAGE=%s: Found %s on %s/%s",
-                                   j->unit->id,
-                                   unit_id == array ? "ordering cycle" : "dependency",
-                                   *unit_id, *job_type,
-                                   unit_ids);
-
-                if (delete) {
-                        const char *status;
-                        /* logging for j not k here to provide a consistent narrative */
-                        log_struct(LOG_ERR,
-                                   "MESSAGE=%s: Job %s/%s deleted to break ordering cycle starting with %s/%s",
-                                   j->unit->id, delete->unit->id, job_type_to_string(delete->type),
-                                   j->unit->id, job_type_to_string(j->type),
-                                   unit_ids);
-
-                        if (log_get_show_color())
-                                status = ANSI_HIGHLIGHT_RED " SKIP " ANSI_NORMAL;
-                        else
-                                status = " SKIP ";
-
-                        unit_status_printf(delete->unit,
-                                           STATUS_TYPE_NOTICE,
-                                           status,
-                                           "Ordering cycle found, skipping %s");
-                        transaction_delete_unit(tr, delete->unit);
-                        return -EAGAIN;
+                /* Is there a job for this unit? */
+                o = hashmap_get(tr->jobs, u);
+                if (!o) {
+                        /* Ok, there is no job for this in the
+                         * transaction, but maybe there is already one
+                         * running? */
+                        o = u->job;
+                        if (!o)
+                                continue;
                 }
 
-                log_struct(LOG_ERR,
-                           "MESSAGE=%s: Unable to break cycle starting with %s/%s",
-                           j->unit->id, j->unit->id, job_type_to_string(j->type),
-                           unit_ids);
+                /* Cut traversing if the frame's job is not really *before* o. */
+                if (job_compare(f->job, o, order_directions[f->direction]) >= 0)
+                        continue;
 
-                return sd_bus_error_setf(e, BUS_ERROR_TRANSACTION_ORDER_IS_CYCLIC,
-                                         "Transaction order is cyclic. See system logs for details.");
+                return o;
         }
 
-        /* Make the marker point to where we come from, so that we can
-         * find our way backwards if we want to break a cycle. We use
-         * a special marker for the beginning: we point to
-         * ourselves. */
-        j->marker = from ? from : j;
+        return NULL;
+}
+
+static int transaction_verify_order_one(
+                Transaction *tr,
+                Job *j,
+                unsigned generation,
+                OrderFrame **stack,
+                size_t *n_allocated,
+                sd_bus_error *e) {
+
+        size_t n = 0;
+
+        assert(tr);
+        assert(j);
+        assert(stack);
+        assert(n_allocated);
+
+        /* Does a depth-first sweep through the ordering graph, looking for a cycle. If we find a cycle we try
+         * to break it. This is done iteratively, with an explicit stack that is reused for all jobs, so that
+         * long chains of ordering dependencies neither cost stack space nor allocations. */
+
+        /* Have we seen this before? Then we decided the job was loop-free from here already. */
+        if (j->generation == generation)
+                return 0;
+
+        assert(!j->transaction_prev);
+
+        if (!GREEDY_REALLOC(*stack, *n_allocated, 1))
+                return -ENOMEM;
+
+        /* Make the marker point to where we come from, so that we can find our way backwards if we want to
+         * break a cycle. We use a special marker for the beginning: we point to ourselves. */
+        j->marker = j;
         j->generation = generation;
+        (*stack)[n++] = (OrderFrame) {
+                .job = j,
+                .iterator = UNIT_DEPENDENCY_ITERATOR_FIRST,
+        };
 
-        /* Actual ordering of jobs depends on the unit ordering dependency and job types. We need to traverse
-         * the graph over 'before' edges in the actual job execution order. We traverse over both unit
-         * ordering dependencies and we test with job_compare() whether it is the 'before' edge in the job
-         * execution ordering. */
-        for (d = 0; d < ELEMENTSOF(directions); d++) {
-                HASHMAP_FOREACH_KEY(v, u, j->unit->dependencies[directions[d]]) {
-                        Job *o;
-
-                        /* Is there a job for this unit? */
-                        o = hashmap_get(tr->jobs, u);
-                        if (!o) {
-                                /* Ok, there is no job for this in the
-                                 * transaction, but maybe there is already one
-                                 * running? */
-                                o = u->job;
-                                if (!o)
-                                        continue;
-                        }
+        while (n > 0) {
+                OrderFrame *f = *stack + n - 1;
+                Job *o;
 
-                        /* Cut traversing if the job j is not really *before* o. */
-                        if (job_compare(j, o, directions[d]) >= 0)
+                o = order_frame_next(tr, f);
+                if (!o) {
+                        /* Ok, let's backtrack, and remember that this entry is not on our path anymore. */
+                        f->job->marker = NULL;
+                        n--;
+                        continue;
+                }
+
+                if (o->generation == generation) {
+                        /* If the marker is NULL we have been here already and decided the job was
+                         * loop-free from here. Hence shortcut things. */
+                        if (!o->marker)
                                 continue;
 
-                        r = transaction_verify_order_one(tr, o, j, generation, e);
-                        if (r < 0)
-                                return r;
+                        return transaction_break_cycle(tr, o, f->job, generation, e);
                 }
-        }
 
-        /* Ok, let's backtrack, and remember that this entry is not on
-         * our path anymore. */
-        j->marker = NULL;
+                assert(!o->transaction_prev);
+
+                if (!GREEDY_REALLOC(*stack, *n_allocated, n + 1))
+                        return -ENOMEM;
+
+                o->marker = f->job;
+                o->generation = generation;
+                (*stack)[n++] = (OrderFrame) {
+                        .job = o,
+                        .iterator = UNIT_DEPENDENCY_ITERATOR_FIRST,
+                };
+        }
 
         return 0;
 }
 
 static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bus_error *e) {
+        _cleanup_free_ OrderFrame *stack = NULL;
+        size_t n_allocated = 0;
         Job *j;
         int r;
         unsigned g;
@@ -495,7 +555,7 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
         g = (*generation)++;
 
         HASHMAP_FOREACH(j, tr->jobs) {
-                r = transaction_verify_order_one(tr, j, NULL, g, e);
+                r = transaction_verify_order_one(tr, j, g, &stack, &n_allocated, e);
                 if (r < 0)
                         return r;
         }
@@ -883,13 +943,12 @@ static void transaction_unlink_job(Transaction *tr, Job *j, bool delete_dependen
 void transaction_add_propagate_reload_jobs(Transaction *tr, Unit *unit, Job *by, bool ignore_order, sd_bus_error *e) {
         JobType nt;
         Unit *dep;
-        void *v;
         int r;
 
         assert(tr);
         assert(unit);
 
-        HASHMAP_FOREACH_KEY(v, dep, unit->dependencies[UNIT_PROPAGATES_RELOAD_TO]) {
+        UNIT_FOREACH_DEPENDENCY(dep, unit, UNIT_PROPAGATES_RELOAD_TO) {
                 nt = job_type_collapse(JOB_TRY_RELOAD, dep);
                 if (nt == JOB_NOP)
                         continue;
@@ -918,7 +977,6 @@ int transaction_add_job_and_dependencies(
         bool is_new;
         Unit *dep;
         Job *ret;
-        void *v;
         int r;
 
         assert(tr);
@@ -1010,7 +1068,7 @@ int transaction_add_job_and_dependencies(
 
                 /* Finally, recursively add in all dependencies. */
                 if (IN_SET(type, JOB_START, JOB_RESTART)) {
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUIRES]) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_REQUIRES) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1020,7 +1078,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_BINDS_TO]) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_BINDS_TO) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1030,7 +1088,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_WANTS]) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_WANTS) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_START, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         /* unit masked, job type not applicable and unit not found are not considered as errors. */
@@ -1042,7 +1100,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_REQUISITE]) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_REQUISITE) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_VERIFY_ACTIVE, dep, ret, true, false, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1052,7 +1110,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTS]) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_CONFLICTS) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, true, true, false, ignore_order, e);
                                 if (r < 0) {
                                         if (r != -EBADR) /* job type not applicable */
@@ -1062,7 +1120,7 @@ int transaction_add_job_and_dependencies(
                                 }
                         }
 
-                        HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[UNIT_CONFLICTED_BY]) {
+                        UNIT_FOREACH_DEPENDENCY(dep, ret->unit, UNIT_CONFLICTED_BY) {
                                 r = transaction_add_job_and_dependencies(tr, JOB_STOP, dep, ret, false, false, false, ignore_order, e);
                                 if (r < 0) {
                                         log_unit_warning(dep,
@@ -1091,7 +1149,7 @@ int transaction_add_job_and_dependencies(
                         ptype = type == JOB_RESTART ? JOB_TRY_RESTART : type;
 
                         for (j = 0; j < ELEMENTSOF(propagate_deps); j++)
-                                HASHMAP_FOREACH_KEY(v, dep, ret->unit->dependencies[propagate_deps[j]]) {
+                                UNIT_FOREACH_DEPENDENCY(dep, ret->unit, propagate_deps[j]) {
                                         JobType nt;
 
                                         nt = job_type_collapse(ptype, dep);
@@ -1154,14 +1212,13 @@ int transaction_add_isolate_jobs(Transaction *tr, Manager *m) {
 }
 
 int transaction_add_triggering_jobs(Transaction *tr, Unit *u) {
-        void *v;
         Unit *trigger;
         int r;
 
         assert(tr);
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, trigger, u->dependencies[UNIT_TRIGGERED_BY]) {
+        UNIT_FOREACH_DEPENDENCY(trigger, u, UNIT_TRIGGERED_BY) {
                 /* No need to stop inactive jobs */
                 if (UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(trigger)) && !trigger->job)
                         continue;
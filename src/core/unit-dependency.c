@@ -0,0 +1,475 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "unit-dependency.h"
+
+#define TYPE_BIT(type) (UINT32_C(1) << (type))
+
+static int entry_compare(UnitDependency type, const Unit *other, const UnitDependencyEntry *e) {
+        int r;
+
+        r = CMP(type, (UnitDependency) e->type);
+        if (r != 0)
+                return r;
+
+        return CMP((uintptr_t) other, (uintptr_t) e->other);
+}
+
+static size_t compact_lower_bound(const UnitDependencies *d, UnitDependency type, const Unit *other) {
+        size_t lo = 0, hi = d->n_entries;
+
+        /* Returns the index of the first entry that is not ordered before (type, other). If other is NULL,
+         * that's the first entry of the type, if there is one. */
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                if (entry_compare(type, other, d->entries + mid) > 0)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        return lo;
+}
+
+static UnitDependencyEntry* compact_find(const UnitDependencies *d, UnitDependency type, const Unit *other) {
+        size_t i;
+
+        i = compact_lower_bound(d, type, other);
+        if (i >= d->n_entries || d->entries[i].type != type || d->entries[i].other != other)
+                return NULL;
+
+        return d->entries + i;
+}
+
+static void compact_remove(UnitDependencies *d, UnitDependencyEntry *e) {
+        UnitDependency type = e->type;
+        size_t i = e - d->entries;
+
+        memmove(d->entries + i, d->entries + i + 1, (d->n_entries - i - 1) * sizeof(UnitDependencyEntry));
+        d->n_entries--;
+
+        /* Was this the last one of its type? Our neighbours would be of the same type otherwise. */
+        if ((i >= d->n_entries || d->entries[i].type != type) &&
+            (i == 0 || d->entries[i - 1].type != type))
+                d->types &= ~TYPE_BIT(type);
+}
+
+static UnitDependencyInfo entry_info(const UnitDependencyEntry *e) {
+        return (UnitDependencyInfo) {
+                .origin_mask = e->origin_mask,
+                .destination_mask = e->destination_mask,
+        };
+}
+
+static void hashmaps_free(Hashmap **hashmaps) {
+        if (!hashmaps)
+                return;
+
+        for (UnitDependency t = 0; t < _UNIT_DEPENDENCY_MAX; t++)
+                hashmap_free(hashmaps[t]);
+
+        free(hashmaps);
+}
+
+static int dependencies_expand(UnitDependencies *d) {
+        Hashmap **hashmaps;
+        int r;
+
+        assert(d);
+        assert(!d->hashmaps);
+
+        /* Moves the dependencies from the array into one hashmap per type */
+
+        hashmaps = new0(Hashmap*, _UNIT_DEPENDENCY_MAX);
+        if (!hashmaps)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < d->n_entries; i++) {
+                UnitDependencyEntry *e = d->entries + i;
+
+                r = hashmap_ensure_allocated(hashmaps + e->type, NULL);
+                if (r < 0)
+                        goto fail;
+
+                r = hashmap_put(hashmaps[e->type], e->other, entry_info(e).data);
+                if (r < 0)
+                        goto fail;
+        }
+
+        d->entries = mfree(d->entries);
+        d->n_entries = d->n_allocated = 0;
+        d->hashmaps = hashmaps;
+
+        return 0;
+
+fail:
+        hashmaps_free(hashmaps);
+        return r;
+}
+
+void unit_dependencies_done(UnitDependencies *d) {
+        assert(d);
+
+        free(d->entries);
+        hashmaps_free(d->hashmaps);
+
+        *d = (UnitDependencies) {};
+}
+
+bool unit_dependencies_get(const UnitDependencies *d, UnitDependency type, const Unit *other, UnitDependencyInfo *ret) {
+        UnitDependencyEntry *e;
+        void *data;
+
+        assert(d);
+        assert(other);
+
+        if (unit_dependencies_isempty(d, type))
+                return false;
+
+        if (d->hashmaps) {
+                data = hashmap_get(d->hashmaps[type], other);
+                if (!data)
+                        return false;
+
+                if (ret)
+                        ret->data = data;
+                return true;
+        }
+
+        e = compact_find(d, type, other);
+        if (!e)
+                return false;
+
+        if (ret)
+                *ret = entry_info(e);
+        return true;
+}
+
+size_t unit_dependencies_size(const UnitDependencies *d, UnitDependency type) {
+        assert(d);
+
+        if (unit_dependencies_isempty(d, type))
+                return 0;
+
+        if (d->hashmaps)
+                return hashmap_size(d->hashmaps[type]);
+
+        /* All entries have a type below _UNIT_DEPENDENCY_MAX, hence this works for the last type too */
+        return compact_lower_bound(d, type + 1, NULL) - compact_lower_bound(d, type, NULL);
+}
+
+size_t unit_dependencies_count(const UnitDependencies *d) {
+        size_t n = 0;
+
+        assert(d);
+
+        if (!d->hashmaps)
+                return d->n_entries;
+
+        for (UnitDependency type = 0; type < _UNIT_DEPENDENCY_MAX; type++)
+                n += hashmap_size(d->hashmaps[type]);
+
+        return n;
+}
+
+size_t unit_dependencies_memory_usage(const UnitDependencies *d) {
+        size_t n;
+
+        assert(d);
+
+        n = d->n_allocated * sizeof(UnitDependencyEntry);
+        if (!d->hashmaps)
+                return n;
+
+        n += _UNIT_DEPENDENCY_MAX * sizeof(Hashmap*);
+        for (UnitDependency type = 0; type < _UNIT_DEPENDENCY_MAX; type++)
+                n += hashmap_memory_usage(d->hashmaps[type]);
+
+        return n;
+}
+
+Unit* unit_dependencies_first(const UnitDependencies *d, UnitDependency type) {
+        assert(d);
+
+        if (unit_dependencies_isempty(d, type))
+                return NULL;
+
+        if (d->hashmaps)
+                return hashmap_first_key(d->hashmaps[type]);
+
+        return d->entries[compact_lower_bound(d, type, NULL)].other;
+}
+
+int unit_dependencies_add(
+                UnitDependencies *d,
+                UnitDependency type,
+                Unit *other,
+                UnitDependencyMask origin_mask,
+                UnitDependencyMask destination_mask) {
+
+        UnitDependencyInfo info;
+        int r;
+
+        assert(d);
+        assert(type >= 0 && type < _UNIT_DEPENDENCY_MAX);
+        assert(other);
+        assert(origin_mask < _UNIT_DEPENDENCY_MASK_FULL);
+        assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
+        assert(origin_mask > 0 || destination_mask > 0);
+
+        /* Returns 0 if the dependency existed already with all the bits in the masks set, > 0 otherwise */
+
+        if (!d->hashmaps) {
+                size_t i;
+
+                i = compact_lower_bound(d, type, other);
+                if (i < d->n_entries && d->entries[i].type == type && d->entries[i].other == other) {
+                        UnitDependencyEntry *e = d->entries + i;
+
+                        if (FLAGS_SET(e->origin_mask, origin_mask) &&
+                            FLAGS_SET(e->destination_mask, destination_mask))
+                                return 0; /* NOP */
+
+                        e->origin_mask |= origin_mask;
+                        e->destination_mask |= destination_mask;
+                        return 1;
+                }
+
+                if (d->n_entries < UNIT_DEPENDENCIES_COMPACT_MAX) {
+                        if (!GREEDY_REALLOC(d->entries, d->n_allocated, d->n_entries + 1))
+                                return -ENOMEM;
+
+                        memmove(d->entries + i + 1, d->entries + i, (d->n_entries - i) * sizeof(UnitDependencyEntry));
+                        d->entries[i] = (UnitDependencyEntry) {
+                                .other = other,
+                                .origin_mask = origin_mask,
+                                .destination_mask = destination_mask,
+                                .type = type,
+                        };
+                        d->n_entries++;
+                        d->types |= TYPE_BIT(type);
+
+                        return 1;
+                }
+
+                r = dependencies_expand(d);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_ensure_allocated(d->hashmaps + type, NULL);
+        if (r < 0)
+                return r;
+
+        assert_cc(sizeof(void*) == sizeof(info));
+
+        info.data = hashmap_get(d->hashmaps[type], other);
+        if (info.data) {
+                /* Entry already exists. Add in our mask. */
+
+                if (FLAGS_SET(info.origin_mask, origin_mask) &&
+                    FLAGS_SET(info.destination_mask, destination_mask))
+                        return 0; /* NOP */
+
+                info.origin_mask |= origin_mask;
+                info.destination_mask |= destination_mask;
+
+                r = hashmap_update(d->hashmaps[type], other, info.data);
+        } else {
+                info = (UnitDependencyInfo) {
+                        .origin_mask = origin_mask,
+                        .destination_mask = destination_mask,
+                };
+
+                r = hashmap_put(d->hashmaps[type], other, info.data);
+        }
+        if (r < 0)
+                return r;
+
+        d->types |= TYPE_BIT(type);
+        return 1;
+}
+
+int unit_dependencies_reserve(UnitDependencies *d, const UnitDependencies *from) {
+        size_t n = 0;
+        int r;
+
+        assert(d);
+        assert(from);
+
+        /* Makes sure all dependencies in 'from' can be added to 'd' without failing */
+
+        for (UnitDependency t = 0; t < _UNIT_DEPENDENCY_MAX; t++)
+                n += unit_dependencies_size(from, t);
+
+        if (!d->hashmaps) {
+                if (d->n_entries + n <= UNIT_DEPENDENCIES_COMPACT_MAX)
+                        return GREEDY_REALLOC(d->entries, d->n_allocated, d->n_entries + n) ? 0 : -ENOMEM;
+
+                r = dependencies_expand(d);
+                if (r < 0)
+                        return r;
+        }
+
+        for (UnitDependency t = 0; t < _UNIT_DEPENDENCY_MAX; t++) {
+                n = unit_dependencies_size(from, t);
+                if (n == 0)
+                        continue;
+
+                r = hashmap_ensure_allocated(d->hashmaps + t, NULL);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_reserve(d->hashmaps[t], n);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+bool unit_dependencies_update(UnitDependencies *d, UnitDependency type, Unit *other, UnitDependencyInfo info) {
+        UnitDependencyEntry *e;
+
+        assert(d);
+        assert(other);
+
+        /* Replaces the masks of an existing dependency, and drops it if none are left */
+
+        if (info.origin_mask == 0 && info.destination_mask == 0)
+                return unit_dependencies_remove(d, type, other);
+
+        if (unit_dependencies_isempty(d, type))
+                return false;
+
+        if (d->hashmaps)
+                return hashmap_update(d->hashmaps[type], other, info.data) >= 0;
+
+        e = compact_find(d, type, other);
+        if (!e)
+                return false;
+
+        e->origin_mask = info.origin_mask;
+        e->destination_mask = info.destination_mask;
+        return true;
+}
+
+void unit_dependencies_replace(UnitDependencies *d, UnitDependency type, Unit *old_other, Unit *new_other) {
+        UnitDependencyInfo info_old, info_new = {};
+
+        assert(d);
+        assert(old_other);
+        assert(new_other);
+        assert(old_other != new_other);
+
+        /* Makes a dependency on old_other one on new_other, merging it with the one on new_other if it exists
+         * already. This cannot fail, as no additional memory is needed. */
+
+        if (!unit_dependencies_get(d, type, old_other, &info_old))
+                return;
+
+        (void) unit_dependencies_get(d, type, new_other, &info_new);
+
+        UnitDependencyInfo info_merged = {
+                .origin_mask = info_old.origin_mask | info_new.origin_mask,
+                .destination_mask = info_old.destination_mask | info_new.destination_mask,
+        };
+
+        if (d->hashmaps) {
+                assert_se(hashmap_remove_and_replace(d->hashmaps[type], old_other, new_other, info_merged.data) >= 0);
+                return;
+        }
+
+        /* After removing the old entry there's room for the new one in the array, hence this won't fail */
+        compact_remove(d, compact_find(d, type, old_other));
+        assert_se(unit_dependencies_add(d, type, new_other, info_merged.origin_mask, info_merged.destination_mask) >= 0);
+}
+
+bool unit_dependencies_remove(UnitDependencies *d, UnitDependency type, const Unit *other) {
+        UnitDependencyEntry *e;
+
+        assert(d);
+        assert(other);
+
+        if (unit_dependencies_isempty(d, type))
+                return false;
+
+        if (d->hashmaps) {
+                if (!hashmap_remove(d->hashmaps[type], other))
+                        return false;
+
+                if (hashmap_isempty(d->hashmaps[type]))
+                        d->types &= ~TYPE_BIT(type);
+
+                return true;
+        }
+
+        e = compact_find(d, type, other);
+        if (!e)
+                return false;
+
+        compact_remove(d, e);
+        return true;
+}
+
+bool unit_dependencies_next(
+                const UnitDependencies *d,
+                UnitDependency type,
+                UnitDependencyIterator *i,
+                Unit **ret_other,
+                UnitDependencyInfo *ret_info) {
+
+        const UnitDependencyEntry *e;
+        size_t k;
+
+        assert(d);
+        assert(type >= 0 && type < _UNIT_DEPENDENCY_MAX);
+        assert(i);
+        assert(ret_other);
+
+        if (d->hashmaps) {
+                UnitDependencyInfo info;
+
+                if (!hashmap_iterate(d->hashmaps[type], &i->iterator, &info.data, (const void**) ret_other))
+                        return false;
+
+                if (ret_info)
+                        *ret_info = info;
+                return true;
+        }
+
+        if (!i->started)
+                k = compact_lower_bound(d, type, NULL);
+        else if (i->index < d->n_entries &&
+                 d->entries[i->index].type == type &&
+                 d->entries[i->index].other == i->current)
+                /* The common case: the array didn't change since we returned the previous entry */
+                k = i->index + 1;
+        else {
+                /* The previous entry was removed, or others were, look for its successor */
+                k = compact_lower_bound(d, type, i->current);
+                if (k < d->n_entries && d->entries[k].type == type && d->entries[k].other == i->current)
+                        k++;
+        }
+
+        if (k >= d->n_entries || d->entries[k].type != type) {
+                *ret_other = NULL;
+                return false;
+        }
+
+        e = d->entries + k;
+
+        i->index = k;
+        i->current = e->other;
+        i->started = true;
+
+        *ret_other = e->other;
+        if (ret_info)
+                *ret_info = entry_info(e);
+        return true;
+}
@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+#include "macro.h"
+#include "unit-def.h"
+
+typedef struct Unit Unit;
+
+/* Stores the 'reason' a dependency was created as a bit mask, i.e. due to which configuration source it came to be. We
+ * use this so that we can selectively flush out parts of dependencies again. Note that the same dependency might be
+ * created as a result of multiple "reasons", hence the bitmask. */
+typedef enum UnitDependencyMask {
+        /* Configured directly by the unit file, .wants/.requires symlink or drop-in, or as an immediate result of a
+         * non-dependency option configured that way.  */
+        UNIT_DEPENDENCY_FILE               = 1 << 0,
+
+        /* As unconditional implicit dependency (not affected by unit configuration — except by the unit name and
+         * type) */
+        UNIT_DEPENDENCY_IMPLICIT           = 1 << 1,
+
+        /* A dependency effected by DefaultDependencies=yes. Note that dependencies marked this way are conceptually
+         * just a subset of UNIT_DEPENDENCY_FILE, as DefaultDependencies= is itself a unit file setting that can only
+         * be set in unit files. We make this two separate bits only to help debugging how dependencies came to be. */
+        UNIT_DEPENDENCY_DEFAULT            = 1 << 2,
+
+        /* A dependency created from udev rules */
+        UNIT_DEPENDENCY_UDEV               = 1 << 3,
+
+        /* A dependency created because of some unit's RequiresMountsFor= setting */
+        UNIT_DEPENDENCY_PATH               = 1 << 4,
+
+        /* A dependency created because of data read from /proc/self/mountinfo and no other configuration source */
+        UNIT_DEPENDENCY_MOUNTINFO_IMPLICIT = 1 << 5,
+
+        /* A dependency created because of data read from /proc/self/mountinfo, but conditionalized by
+         * DefaultDependencies= and thus also involving configuration from UNIT_DEPENDENCY_FILE sources */
+        UNIT_DEPENDENCY_MOUNTINFO_DEFAULT  = 1 << 6,
+
+        /* A dependency created because of data read from /proc/swaps and no other configuration source */
+        UNIT_DEPENDENCY_PROC_SWAP          = 1 << 7,
+
+        _UNIT_DEPENDENCY_MASK_FULL         = (1 << 8) - 1,
+} UnitDependencyMask;
+
+/* Hashmaps of dependencies use this structure as value. It has the same size as a void pointer, and thus can be
+ * stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin and
+ * the destination of a dependency might have created it. */
+typedef union UnitDependencyInfo {
+        void *data;
+        struct {
+                UnitDependencyMask origin_mask:16;
+                UnitDependencyMask destination_mask:16;
+        } _packed_;
+} UnitDependencyInfo;
+
+/* The dependencies of a unit on other units, of all types. Most units only have a handful of them, hence they are
+ * kept in a single array, sorted by type and then by the address of the other unit, which is searched by bisection.
+ * Only once there are more than UNIT_DEPENDENCIES_COMPACT_MAX of them (for example for slices or targets most units
+ * are ordered against), they are moved into one hashmap per type, so that adding and removing them stays cheap. */
+
+#define UNIT_DEPENDENCIES_COMPACT_MAX 128U
+
+typedef struct UnitDependencyEntry {
+        Unit *other;
+        UnitDependencyMask origin_mask:16;
+        UnitDependencyMask destination_mask:16;
+        UnitDependency type:8;
+} UnitDependencyEntry;
+
+typedef struct UnitDependencies {
+        /* Used as long as hashmaps is NULL */
+        UnitDependencyEntry *entries;
+        size_t n_entries, n_allocated;
+
+        /* One hashmap per type, whose values are UnitDependencyInfo */
+        Hashmap **hashmaps;
+
+        /* One bit for each type there are dependencies of */
+        uint32_t types;
+} UnitDependencies;
+
+assert_cc(_UNIT_DEPENDENCY_MAX <= 32);
+
+typedef struct UnitDependencyIterator {
+        /* The position of the entry returned last in the array, and its unit */
+        size_t index;
+        const Unit *current;
+        bool started;
+
+        Iterator iterator;
+} UnitDependencyIterator;
+
+#define UNIT_DEPENDENCY_ITERATOR_FIRST ((UnitDependencyIterator) { .iterator = ITERATOR_FIRST })
+
+void unit_dependencies_done(UnitDependencies *d);
+
+bool unit_dependencies_get(const UnitDependencies *d, UnitDependency type, const Unit *other, UnitDependencyInfo *ret);
+size_t unit_dependencies_size(const UnitDependencies *d, UnitDependency type);
+size_t unit_dependencies_count(const UnitDependencies *d);
+size_t unit_dependencies_memory_usage(const UnitDependencies *d);
+Unit* unit_dependencies_first(const UnitDependencies *d, UnitDependency type);
+
+int unit_dependencies_add(UnitDependencies *d, UnitDependency type, Unit *other, UnitDependencyMask origin_mask, UnitDependencyMask destination_mask);
+int unit_dependencies_reserve(UnitDependencies *d, const UnitDependencies *from);
+bool unit_dependencies_update(UnitDependencies *d, UnitDependency type, Unit *other, UnitDependencyInfo info);
+void unit_dependencies_replace(UnitDependencies *d, UnitDependency type, Unit *old_other, Unit *new_other);
+bool unit_dependencies_remove(UnitDependencies *d, UnitDependency type, const Unit *other);
+
+bool unit_dependencies_next(
+                const UnitDependencies *d,
+                UnitDependency type,
+                UnitDependencyIterator *i,
+                Unit **ret_other,
+                UnitDependencyInfo *ret_info);
+
+static inline bool unit_dependencies_contains(const UnitDependencies *d, UnitDependency type, const Unit *other) {
+        return unit_dependencies_get(d, type, other, NULL);
+}
+
+static inline bool unit_dependencies_isempty(const UnitDependencies *d, UnitDependency type) {
+        assert(type >= 0 && type < _UNIT_DEPENDENCY_MAX);
+
+        return !(d->types & (UINT32_C(1) << type));
+}
+
+/* Iterates through the dependencies of the specified type of a unit. It is safe to remove the current entry (or any
+ * other), but dependencies must not be added while iterating. */
+#define _UNIT_FOREACH_DEPENDENCY(other, info, u, type, i)               \
+        for (UnitDependencyIterator i = UNIT_DEPENDENCY_ITERATOR_FIRST; \
+             unit_dependencies_next(&(u)->dependencies, (type), &i, &(other), (info)); )
+#define UNIT_FOREACH_DEPENDENCY(other, u, type)                         \
+        _UNIT_FOREACH_DEPENDENCY(other, NULL, u, type, UNIQ_T(i, UNIQ))
+#define UNIT_FOREACH_DEPENDENCY_INFO(other, info, u, type)              \
+        _UNIT_FOREACH_DEPENDENCY(other, &(info), u, type, UNIQ_T(i, UNIQ))
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "load-dropin.h"
+#include "log.h"
+#include "signal-util.h"
+#include "strv.h"
+#include "unit-file.h"
+#include "unit-prefetch.h"
+
+typedef struct PrefetchWork {
+        PrefetchedFile **files;
+        size_t n_files;
+        size_t next;
+} PrefetchWork;
+
+PrefetchedFile* prefetched_file_free(PrefetchedFile *p) {
+        if (!p)
+                return NULL;
+
+        free(p->path);
+        free(p->data);
+        return mfree(p);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(prefetched_file_hash_ops, char, string_hash_func, string_compare_func, PrefetchedFile, prefetched_file_free);
+
+static int prefetch_read(PrefetchedFile *p) {
+        _cleanup_fclose_ FILE *f = NULL;
+
+        assert(p);
+
+        /* Runs on worker threads, hence must not touch anything but the file object, and must not log */
+
+        f = fopen(p->path, "re");
+        if (!f)
+                return -errno;
+
+        if (fstat(fileno(f), &p->st) < 0)
+                return -errno;
+
+        return read_full_stream(f, &p->data, &p->size);
+}
+
+static void* prefetch_thread(void *userdata) {
+        PrefetchWork *w = userdata;
+        size_t i;
+
+        for (;;) {
+                i = __sync_fetch_and_add(&w->next, 1);
+                if (i >= w->n_files)
+                        break;
+
+                w->files[i]->error = prefetch_read(w->files[i]);
+        }
+
+        return NULL;
+}
+
+static int prefetch_add(
+                Manager *m,
+                Hashmap *h,
+                PrefetchedFile ***files,
+                size_t *n_files,
+                size_t *n_allocated,
+                const char *path) {
+
+        _cleanup_(prefetched_file_freep) PrefetchedFile *p = NULL;
+        int r;
+
+        assert(m);
+        assert(h);
+        assert(files);
+        assert(n_files);
+        assert(n_allocated);
+
+        if (!path || hashmap_contains(h, path) || hashmap_contains(m->unit_prefetch, path))
+                return 0;
+
+        p = new(PrefetchedFile, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (PrefetchedFile) {
+                .error = -EAGAIN, /* not read yet */
+        };
+
+        p->path = strdup(path);
+        if (!p->path)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(*files, *n_allocated, *n_files + 1))
+                return -ENOMEM;
+
+        r = hashmap_put(h, p->path, p);
+        if (r < 0)
+                return r;
+
+        (*files)[(*n_files)++] = TAKE_PTR(p);
+        return 1;
+}
+
+static int prefetch_collect(Manager *m, Hashmap *h, PrefetchedFile ***files, size_t *n_files, size_t *n_allocated) {
+        Unit *u;
+        int r, q;
+
+        assert(m);
+
+        /* Build the fragment map, so that it's current for all the units loaded below */
+        q = unit_file_build_name_map(&m->lookup_paths,
+                                     &m->unit_cache_timestamp_hash,
+                                     &m->unit_id_map,
+                                     &m->unit_name_map,
+                                     &m->unit_path_cache);
+
+        LIST_FOREACH(load_queue, u, m->load_queue) {
+                _cleanup_set_free_free_ Set *names = NULL;
+                _cleanup_strv_free_ char **dropins = NULL;
+                const char *fragment = NULL;
+                char **i;
+
+                if (u->load_prefetched)
+                        continue;
+
+                /* Whatever happens, each unit is considered once only */
+                u->load_prefetched = true;
+
+                if (q < 0 || u->transient || u->load_state != UNIT_STUB)
+                        continue;
+
+                r = unit_file_find_fragment(m->unit_id_map, m->unit_name_map, u->id, &fragment, &names);
+                if (r < 0 && r != -ENOENT)
+                        continue;
+
+                r = prefetch_add(m, h, files, n_files, n_allocated, fragment);
+                if (r < 0)
+                        return r;
+
+                /* The unit may gain further names while being loaded, drop-ins for those are read when
+                 * they're needed, as before */
+                if (unit_find_dropin_paths(u, &dropins) <= 0)
+                        continue;
+
+                STRV_FOREACH(i, dropins) {
+                        r = prefetch_add(m, h, files, n_files, n_allocated, *i);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return q;
+}
+
+int unit_prefetch_load_queue(Manager *m) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_free_ PrefetchedFile **files = NULL;
+        size_t n_files = 0, n_allocated = 0, n_threads, i;
+        pthread_t threads[UNIT_PREFETCH_THREADS_MAX - 1];
+        sigset_t ss, saved_ss;
+        PrefetchWork work;
+        int r;
+
+        assert(m);
+
+        /* Reads the unit files and drop-ins of all units currently in the load queue on a couple of worker
+         * threads, so that once the units are loaded one by one, only the parsing is left to do on the
+         * main thread. The files are parsed exactly as before, in load queue order, this merely saves the
+         * serialized blocking on the file system. Anything we fail to read here is simply read again the
+         * usual way later on, so that errors are reported as before. */
+
+        h = hashmap_new(&prefetched_file_hash_ops);
+        if (!h)
+                return log_oom();
+
+        r = prefetch_collect(m, h, &files, &n_files, &n_allocated);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to determine unit files to read ahead, ignoring: %m");
+
+        if (n_files < UNIT_PREFETCH_FILES_MIN)
+                return 0;
+
+        work = (PrefetchWork) {
+                .files = files,
+                .n_files = n_files,
+        };
+
+        n_threads = MIN3((size_t) MAX(sysconf(_SC_NPROCESSORS_ONLN), 1L),
+                         (size_t) UNIT_PREFETCH_THREADS_MAX,
+                         n_files / UNIT_PREFETCH_FILES_MIN);
+
+        /* Like asynchronous_job(), start the threads with all signals blocked */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return log_debug_errno(r, "Failed to block signals, not reading unit files ahead: %m");
+
+        /* The main thread does its share of the work too, and if a thread can't be started, the others
+         * simply pick up more files */
+        for (i = 0; i + 1 < n_threads; i++) {
+                r = pthread_create(threads + i, NULL, prefetch_thread, &work);
+                if (r > 0) {
+                        log_debug_errno(r, "Failed to start thread for reading unit files, ignoring: %m");
+                        break;
+                }
+        }
+        n_threads = i;
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        (void) prefetch_thread(&work);
+
+        for (i = 0; i < n_threads; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        log_debug("Read %zu unit files ahead on %zu threads.", n_files, n_threads + 1);
+
+        /* Merge into what's already there */
+        if (!m->unit_prefetch)
+                m->unit_prefetch = TAKE_PTR(h);
+        else {
+                r = hashmap_move(m->unit_prefetch, h);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        return 0;
+}
+
+PrefetchedFile* unit_prefetch_take(Manager *m, const char *path) {
+        PrefetchedFile *p;
+
+        assert(m);
+        assert(path);
+
+        /* Returns the contents of the file if they were read ahead successfully, ownership goes to the
+         * caller. Files are only read once, to keep the time between reading and parsing short. */
+
+        p = hashmap_remove(m->unit_prefetch, path);
+        if (p && p->error < 0)
+                return prefetched_file_free(p);
+
+        return p;
+}
+
+void unit_prefetch_flush(Manager *m) {
+        assert(m);
+
+        m->unit_prefetch = hashmap_free(m->unit_prefetch);
+}
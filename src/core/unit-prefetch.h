@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <sys/stat.h>
+
+typedef struct PrefetchedFile PrefetchedFile;
+
+#include "manager.h"
+
+/* The contents of a unit file or drop-in, read ahead of time by a worker thread */
+struct PrefetchedFile {
+        char *path;
+        char *data;
+        size_t size;
+        struct stat st;
+        int error;
+};
+
+/* Don't bother with threads for fewer files than this */
+#define UNIT_PREFETCH_FILES_MIN 16U
+#define UNIT_PREFETCH_THREADS_MAX 8U
+
+PrefetchedFile* prefetched_file_free(PrefetchedFile *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(PrefetchedFile*, prefetched_file_free);
+
+int unit_prefetch_load_queue(Manager *m);
+PrefetchedFile* unit_prefetch_take(Manager *m, const char *path);
+void unit_prefetch_flush(Manager *m);
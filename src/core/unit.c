@@ -67,6 +67,9 @@
 #define NOTICEWORTHY_IO_BYTES (10 * 1024 * 1024ULL)  /* 10 MB */
 #define NOTICEWORTHY_IP_BYTES (128 * 1024 * 1024ULL) /* 128 MB */
 
+/* Minimum time between two rescans of a unit's cgroup for PIDs to watch, on the legacy hierarchies */
+#define UNIT_REWATCH_PIDS_INTERVAL_USEC (50 * USEC_PER_MSEC)
+
 const UnitVTable * const unit_vtable[_UNIT_TYPE_MAX] = {
         [UNIT_SERVICE] = &service_vtable,
         [UNIT_SOCKET] = &socket_vtable,
@@ -111,10 +114,6 @@ Unit *unit_new(Manager *m, size_t size) {
 
         u->ip_accounting_ingress_map_fd = -1;
         u->ip_accounting_egress_map_fd = -1;
-        u->ipv4_allow_map_fd = -1;
-        u->ipv6_allow_map_fd = -1;
-        u->ipv4_deny_map_fd = -1;
-        u->ipv6_deny_map_fd = -1;
 
         u->last_section_private = -1;
 
@@ -123,6 +122,7 @@ Unit *unit_new(Manager *m, size_t size) {
 
         for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
                 u->io_accounting_last[i] = UINT64_MAX;
+        u->io_accounting_timestamp = USEC_INFINITY;
 
         return u;
 }
@@ -469,12 +469,17 @@ void unit_add_to_gc_queue(Unit *u) {
         u->in_gc_queue = true;
 }
 
-void unit_add_to_dbus_queue(Unit *u) {
+void unit_add_to_dbus_queue_full(Unit *u, UnitDBusChange changes) {
         assert(u);
         assert(u->type != _UNIT_TYPE_INVALID);
 
-        if (u->load_state == UNIT_STUB || u->in_dbus_queue)
+        if (u->load_state == UNIT_STUB)
+                return;
+
+        if (u->in_dbus_queue) {
+                u->dbus_changes |= changes;
                 return;
+        }
 
         /* Shortcut things if nobody cares */
         if (sd_bus_track_count(u->manager->subscribed) <= 0 &&
@@ -486,6 +491,7 @@ void unit_add_to_dbus_queue(Unit *u) {
 
         LIST_PREPEND(dbus_queue, u->manager->dbus_unit_queue, u);
         u->in_dbus_queue = true;
+        u->dbus_changes = changes;
 }
 
 void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
@@ -504,22 +510,22 @@ void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
         u->in_stop_when_unneeded_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Hashmap *h) {
+static void bidi_dependencies_free(Unit *u) {
         Unit *other;
-        void *v;
 
         assert(u);
 
-        /* Frees the hashmap and makes sure we are dropped from the inverse pointers */
+        /* Frees the dependencies and makes sure we are dropped from the inverse pointers */
 
-        HASHMAP_FOREACH_KEY(v, other, h) {
-                for (UnitDependency d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        hashmap_remove(other->dependencies[d], u);
+        for (UnitDependency d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
+                UNIT_FOREACH_DEPENDENCY(other, u, d) {
+                        for (UnitDependency k = 0; k < _UNIT_DEPENDENCY_MAX; k++)
+                                unit_dependencies_remove(&other->dependencies, k, u);
 
-                unit_add_to_gc_queue(other);
-        }
+                        unit_add_to_gc_queue(other);
+                }
 
-        hashmap_free(h);
+        unit_dependencies_done(&u->dependencies);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -652,8 +658,7 @@ void unit_free(Unit *u) {
                 job_free(j);
         }
 
-        for (UnitDependency d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                bidi_set_free(u, u->dependencies[d]);
+        bidi_dependencies_free(u);
 
         /* A unit is being dropped from the tree, make sure our family is realized properly. Do this after we
          * detach the unit from slice tree in order to eliminate its effect on controller masks. */
@@ -709,10 +714,10 @@ void unit_free(Unit *u) {
         safe_close(u->ip_accounting_ingress_map_fd);
         safe_close(u->ip_accounting_egress_map_fd);
 
-        safe_close(u->ipv4_allow_map_fd);
-        safe_close(u->ipv6_allow_map_fd);
-        safe_close(u->ipv4_deny_map_fd);
-        safe_close(u->ipv6_deny_map_fd);
+        bpf_access_map_unref(u->ipv4_allow_map);
+        bpf_access_map_unref(u->ipv6_allow_map);
+        bpf_access_map_unref(u->ipv4_deny_map);
+        bpf_access_map_unref(u->ipv6_deny_map);
 
         bpf_program_unref(u->ip_bpf_ingress);
         bpf_program_unref(u->ip_bpf_ingress_installed);
@@ -837,31 +842,9 @@ static int merge_names(Unit *u, Unit *other) {
         return 0;
 }
 
-static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
-        unsigned n_reserve;
-
-        assert(u);
-        assert(other);
-        assert(d < _UNIT_DEPENDENCY_MAX);
-
-        /*
-         * If u does not have this dependency set allocated, there is no need
-         * to reserve anything. In that case other's set will be transferred
-         * as a whole to u by complete_move().
-         */
-        if (!u->dependencies[d])
-                return 0;
-
-        /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = hashmap_size(other->dependencies[d]) - !!hashmap_get(other->dependencies[d], u);
-
-        return hashmap_reserve(u->dependencies[d], n_reserve);
-}
-
 static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
+        UnitDependencyInfo di;
         Unit *back;
-        void *v;
-        int r;
 
         /* Merges all dependencies of type 'd' of the unit 'other' into the deps of the unit 'u' */
 
@@ -870,50 +853,31 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers. Let's iterate through all dependent units of the other unit. */
-        HASHMAP_FOREACH_KEY(v, back, other->dependencies[d])
+        UNIT_FOREACH_DEPENDENCY(back, other, d)
 
                 /* Let's now iterate through the dependencies of that dependencies of the other units,
                  * looking for pointers back, and let's fix them up, to instead point to 'u'. */
                 for (UnitDependency k = 0; k < _UNIT_DEPENDENCY_MAX; k++)
                         if (back == u) {
                                 /* Do not add dependencies between u and itself. */
-                                if (hashmap_remove(back->dependencies[k], other))
+                                if (unit_dependencies_remove(&back->dependencies, k, other))
                                         maybe_warn_about_dependency(u, other_id, k);
-                        } else {
-                                UnitDependencyInfo di_u, di_other;
-
-                                /* Let's drop this dependency between "back" and "other", and let's create it between
-                                 * "back" and "u" instead. Let's merge the bit masks of the dependency we are moving,
-                                 * and any such dependency which might already exist */
-
-                                di_other.data = hashmap_get(back->dependencies[k], other);
-                                if (!di_other.data)
-                                        continue; /* dependency isn't set, let's try the next one */
-
-                                di_u.data = hashmap_get(back->dependencies[k], u);
-
-                                UnitDependencyInfo di_merged = {
-                                        .origin_mask = di_u.origin_mask | di_other.origin_mask,
-                                        .destination_mask = di_u.destination_mask | di_other.destination_mask,
-                                };
-
-                                r = hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
-                                if (r < 0)
-                                        log_warning_errno(r, "Failed to remove/replace: back=%s other=%s u=%s: %m", back->id, other_id, u->id);
-                                assert(r >= 0);
-
-                                /* assert_se(hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
-                        }
-
-        /* Also do not move dependencies on u to itself */
-        back = hashmap_remove(other->dependencies[d], u);
-        if (back)
-                maybe_warn_about_dependency(u, other_id, d);
-
-        /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(hashmap_complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+                        } else
+                                /* Let's drop this dependency between "back" and "other", and let's create it
+                                 * between "back" and "u" instead, merging the bit masks of the dependency we are
+                                 * moving, and any such dependency which might already exist */
+                                unit_dependencies_replace(&back->dependencies, k, other, u);
+
+        UNIT_FOREACH_DEPENDENCY_INFO(back, di, other, d) {
+                /* Also do not move dependencies on u to itself */
+                if (back == u) {
+                        maybe_warn_about_dependency(u, other_id, d);
+                        continue;
+                }
 
-        other->dependencies[d] = hashmap_free(other->dependencies[d]);
+                /* The move cannot fail. The caller must have performed a reservation. */
+                assert_se(unit_dependencies_add(&u->dependencies, d, back, di.origin_mask, di.destination_mask) >= 0);
+        }
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -954,16 +918,11 @@ int unit_merge(Unit *u, Unit *other) {
         if (other->id)
                 other_id = strdupa(other->id);
 
-        /* Make reservations to ensure merge_dependencies() won't fail */
-        for (UnitDependency d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                r = reserve_dependencies(u, other, d);
-                /*
-                 * We don't rollback reservations if we fail. We don't have
-                 * a way to undo reservations. A reservation is not a leak.
-                 */
-                if (r < 0)
-                        return r;
-        }
+        /* Make reservations to ensure merge_dependencies() won't fail. We don't rollback reservations if we
+         * fail. We don't have a way to undo reservations. A reservation is not a leak. */
+        r = unit_dependencies_reserve(&u->dependencies, &other->dependencies);
+        if (r < 0)
+                return r;
 
         /* Merge names */
         r = merge_names(u, other);
@@ -978,6 +937,8 @@ int unit_merge(Unit *u, Unit *other) {
         for (UnitDependency d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 merge_dependencies(u, other, other_id, d);
 
+        unit_dependencies_done(&other->dependencies);
+
         other->load_state = UNIT_MERGED;
         other->merged_into = u;
 
@@ -1364,7 +1325,7 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                 UnitDependencyInfo di;
                 Unit *other;
 
-                HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d]) {
+                UNIT_FOREACH_DEPENDENCY_INFO(other, di, u, d) {
                         bool space = false;
 
                         fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), other->id);
@@ -1498,7 +1459,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (hashmap_get(target->dependencies[UNIT_BEFORE], u))
+        if (unit_dependencies_contains(&target->dependencies, UNIT_BEFORE, u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true, UNIT_DEPENDENCY_DEFAULT);
@@ -1596,6 +1557,7 @@ int unit_load(Unit *u) {
         if (u->in_load_queue) {
                 LIST_REMOVE(load_queue, u->manager->load_queue, u);
                 u->in_load_queue = false;
+                u->load_prefetched = false;
         }
 
         if (u->type == _UNIT_TYPE_INVALID)
@@ -1637,7 +1599,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && hashmap_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && unit_dependencies_size(&u->dependencies, UNIT_ON_FAILURE) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -ENOEXEC;
                         goto fail;
@@ -1718,7 +1680,7 @@ static bool unit_test_condition(Unit *u) {
                                 log_unit_internal,
                                 u);
 
-        unit_add_to_dbus_queue(u);
+        unit_add_to_dbus_queue_full(u, UNIT_DBUS_CHANGE_CONDITIONS);
         return u->condition_result;
 }
 
@@ -1742,7 +1704,7 @@ static bool unit_test_assert(Unit *u) {
                                 log_unit_internal,
                                 u);
 
-        unit_add_to_dbus_queue(u);
+        unit_add_to_dbus_queue_full(u, UNIT_DBUS_CHANGE_ASSERTS);
         return u->assert_result;
 }
 
@@ -1794,7 +1756,6 @@ bool unit_shall_confirm_spawn(Unit *u) {
 
 static bool unit_verify_deps(Unit *u) {
         Unit *other;
-        void *v;
 
         assert(u);
 
@@ -1803,9 +1764,9 @@ static bool unit_verify_deps(Unit *u) {
          * processing, but do not have any effect afterwards. We don't check BindsTo= dependencies that are not used in
          * conjunction with After= as for them any such check would make things entirely racy. */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO) {
 
-                if (!hashmap_contains(u->dependencies[UNIT_AFTER], other))
+                if (!unit_dependencies_contains(&u->dependencies, UNIT_AFTER, other))
                         continue;
 
                 if (!UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other))) {
@@ -2017,7 +1978,7 @@ bool unit_can_reload(Unit *u) {
         if (UNIT_VTABLE(u)->can_reload)
                 return UNIT_VTABLE(u)->can_reload(u);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
+        if (!unit_dependencies_isempty(&u->dependencies, UNIT_PROPAGATES_RELOAD_TO))
                 return true;
 
         return UNIT_VTABLE(u)->reload;
@@ -2044,12 +2005,11 @@ bool unit_is_unneeded(Unit *u) {
 
         for (size_t j = 0; j < ELEMENTSOF(deps); j++) {
                 Unit *other;
-                void *v;
 
                 /* If a dependent unit has a job queued, is active or transitioning, or is marked for
                  * restart, then don't clean this one up. */
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[j]]) {
+                UNIT_FOREACH_DEPENDENCY(other, u, deps[j]) {
                         if (other->job)
                                 return false;
 
@@ -2079,9 +2039,8 @@ static void check_unneeded_dependencies(Unit *u) {
 
         for (size_t j = 0; j < ELEMENTSOF(deps); j++) {
                 Unit *other;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[j]])
+                UNIT_FOREACH_DEPENDENCY(other, u, deps[j])
                         unit_submit_to_stop_when_unneeded_queue(other);
         }
 }
@@ -2090,7 +2049,6 @@ static void unit_check_binds_to(Unit *u) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         bool stop = false;
         Unit *other;
-        void *v;
         int r;
 
         assert(u);
@@ -2101,7 +2059,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO) {
                 if (other->job)
                         continue;
 
@@ -2138,61 +2096,58 @@ static void unit_check_binds_to(Unit *u) {
 
 static void retroactively_start_dependencies(Unit *u) {
         Unit *other;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES])
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRES)
+                if (!unit_dependencies_contains(&u->dependencies, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO])
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO)
+                if (!unit_dependencies_contains(&u->dependencies, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS])
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_WANTS)
+                if (!unit_dependencies_contains(&u->dependencies, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTS])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTS)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTED_BY])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTED_BY)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL, NULL);
 }
 
 static void retroactively_stop_dependencies(Unit *u) {
         Unit *other;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BOUND_BY])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BOUND_BY)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL, NULL);
 }
 
 void unit_start_on_failure(Unit *u) {
         Unit *other;
-        void *v;
         int r;
 
         assert(u);
 
-        if (hashmap_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (unit_dependencies_size(&u->dependencies, UNIT_ON_FAILURE) <= 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_ON_FAILURE]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_ON_FAILURE) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, NULL, &error, NULL);
@@ -2203,11 +2158,10 @@ void unit_start_on_failure(Unit *u) {
 
 void unit_trigger_notify(Unit *u) {
         Unit *other;
-        void *v;
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_TRIGGERED_BY])
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_TRIGGERED_BY)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2595,6 +2549,7 @@ void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, UnitNotifyFlag
         /* Update timestamps for state changes */
         if (!MANAGER_IS_RELOADING(m)) {
                 dual_timestamp_get(&u->state_change_timestamp);
+                manager_trace(m, MANAGER_TRACE_STATE_CHANGED, u->id, unit_sub_state_to_string(u), 0);
 
                 if (UNIT_IS_INACTIVE_OR_FAILED(os) && !UNIT_IS_INACTIVE_OR_FAILED(ns))
                         u->inactive_exit_timestamp = u->state_change_timestamp;
@@ -2822,7 +2777,7 @@ static void unit_tidy_watch_pids(Unit *u) {
         }
 }
 
-static int on_rewatch_pids_event(sd_event_source *s, void *userdata) {
+static int on_rewatch_pids_event(sd_event_source *s, uint64_t usec, void *userdata) {
         Unit *u = userdata;
 
         assert(s);
@@ -2831,6 +2786,8 @@ static int on_rewatch_pids_event(sd_event_source *s, void *userdata) {
         unit_tidy_watch_pids(u);
         unit_watch_all_pids(u);
 
+        u->rewatch_pids_timestamp = now(CLOCK_MONOTONIC);
+
         /* If the PID set is empty now, then let's finish this off. */
         unit_synthesize_cgroup_empty_event(u);
 
@@ -2838,6 +2795,7 @@ static int on_rewatch_pids_event(sd_event_source *s, void *userdata) {
 }
 
 int unit_enqueue_rewatch_pids(Unit *u) {
+        usec_t when;
         int r;
 
         assert(u);
@@ -2853,12 +2811,16 @@ int unit_enqueue_rewatch_pids(Unit *u) {
 
         /* Enqueues a low-priority job that will clean up dead PIDs from our list of PIDs to watch and subscribe to new
          * PIDs that might have appeared. We do this in a delayed job because the work might be quite slow, as it
-         * involves issuing kill(pid, 0) on all processes we watch. */
+         * involves issuing kill(pid, 0) on all processes we watch. With many processes in the cgroup, and
+         * SIGCHLD storms asking for this over and over again, even that is too much, hence the job is run at
+         * most once every UNIT_REWATCH_PIDS_INTERVAL_USEC, and all requests in the meantime are coalesced. */
+
+        when = usec_add(u->rewatch_pids_timestamp, UNIT_REWATCH_PIDS_INTERVAL_USEC);
 
         if (!u->rewatch_pids_event_source) {
                 _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
 
-                r = sd_event_add_defer(u->manager->event, &s, on_rewatch_pids_event, u);
+                r = sd_event_add_time(u->manager->event, &s, CLOCK_MONOTONIC, when, 1, on_rewatch_pids_event, u);
                 if (r < 0)
                         return log_error_errno(r, "Failed to allocate event source for tidying watched PIDs: %m");
 
@@ -2869,6 +2831,18 @@ int unit_enqueue_rewatch_pids(Unit *u) {
                 (void) sd_event_source_set_description(s, "tidy-watch-pids");
 
                 u->rewatch_pids_event_source = TAKE_PTR(s);
+        } else {
+                int enabled;
+
+                r = sd_event_source_get_enabled(u->rewatch_pids_event_source, &enabled);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to query event source for tidying watched PIDs: %m");
+                if (enabled != SD_EVENT_OFF) /* Already pending */
+                        return 0;
+
+                r = sd_event_source_set_time(u->rewatch_pids_event_source, when);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to adjust time of event source for tidying watched PIDs: %m");
         }
 
         r = sd_event_source_set_enabled(u->rewatch_pids_event_source, SD_EVENT_ONESHOT);
@@ -2940,53 +2914,6 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-static int unit_add_dependency_hashmap(
-                Hashmap **h,
-                Unit *other,
-                UnitDependencyMask origin_mask,
-                UnitDependencyMask destination_mask) {
-
-        UnitDependencyInfo info;
-        int r;
-
-        assert(h);
-        assert(other);
-        assert(origin_mask < _UNIT_DEPENDENCY_MASK_FULL);
-        assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
-        assert(origin_mask > 0 || destination_mask > 0);
-
-        r = hashmap_ensure_allocated(h, NULL);
-        if (r < 0)
-                return r;
-
-        assert_cc(sizeof(void*) == sizeof(info));
-
-        info.data = hashmap_get(*h, other);
-        if (info.data) {
-                /* Entry already exists. Add in our mask. */
-
-                if (FLAGS_SET(origin_mask, info.origin_mask) &&
-                    FLAGS_SET(destination_mask, info.destination_mask))
-                        return 0; /* NOP */
-
-                info.origin_mask |= origin_mask;
-                info.destination_mask |= destination_mask;
-
-                r = hashmap_update(*h, other, info.data);
-        } else {
-                info = (UnitDependencyInfo) {
-                        .origin_mask = origin_mask,
-                        .destination_mask = destination_mask,
-                };
-
-                r = hashmap_put(*h, other, info.data);
-        }
-        if (r < 0)
-                return r;
-
-        return 1;
-}
-
 int unit_add_dependency(
                 Unit *u,
                 UnitDependency d,
@@ -3054,22 +2981,22 @@ int unit_add_dependency(
                 return log_unit_error_errno(u, SYNTHETIC_ERRNO(EINVAL),
                                             "Requested dependency TriggeredBy=%s refused (%s units cannot trigger other units).", other->id, unit_type_to_string(other->type));
 
-        r = unit_add_dependency_hashmap(u->dependencies + d, other, mask, 0);
+        r = unit_dependencies_add(&u->dependencies, d, other, mask, 0);
         if (r < 0)
                 return r;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
+                r = unit_dependencies_add(&other->dependencies, inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
         }
 
         if (add_reference) {
-                r = unit_add_dependency_hashmap(u->dependencies + UNIT_REFERENCES, other, mask, 0);
+                r = unit_dependencies_add(&u->dependencies, UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
                         return r;
 
-                r = unit_add_dependency_hashmap(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
+                r = unit_dependencies_add(&other->dependencies, UNIT_REFERENCED_BY, u, 0, mask);
                 if (r < 0)
                         return r;
         }
@@ -3637,7 +3564,7 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 ssize_t m;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0) /* eof */
@@ -3974,7 +3901,7 @@ int unit_deserialize_skip(FILE *f) {
                 _cleanup_free_ char *line = NULL;
                 char *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -4300,10 +4227,13 @@ int unit_kill_common(
                 _cleanup_set_free_ Set *pid_set = NULL;
                 int q;
 
-                /* Exclude the main/control pids from being killed via the cgroup */
-                pid_set = unit_pid_set(main_pid, control_pid);
-                if (!pid_set)
-                        return -ENOMEM;
+                /* Exclude the main/control pids from being killed via the cgroup. Sending SIGKILL twice doesn't
+                 * hurt however, and without exclusions the kernel can kill the whole cgroup at once for us. */
+                if (signo != SIGKILL) {
+                        pid_set = unit_pid_set(main_pid, control_pid);
+                        if (!pid_set)
+                                return -ENOMEM;
+                }
 
                 q = cg_kill_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, signo, 0, pid_set, NULL, NULL);
                 if (q < 0 && !IN_SET(q, -EAGAIN, -ESRCH, -ENOENT))
@@ -5083,7 +5013,6 @@ int unit_setup_exec_runtime(Unit *u) {
         ExecRuntime **rt;
         size_t offset;
         Unit *other;
-        void *v;
         int r;
 
         offset = UNIT_VTABLE(u)->exec_runtime_offset;
@@ -5095,7 +5024,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF]) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_JOINS_NAMESPACE_OF) {
                 r = exec_runtime_acquire(u->manager, NULL, other->id, false, rt);
                 if (r == 1)
                         return 1;
@@ -5475,13 +5404,11 @@ static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other,
         assert(d < _UNIT_DEPENDENCY_MAX);
         assert(other);
 
-        if (di.origin_mask == 0 && di.destination_mask == 0) {
-                /* No bit set anymore, let's drop the whole entry */
-                assert_se(hashmap_remove(u->dependencies[d], other));
+        /* If no bit set anymore, this drops the whole entry, otherwise the mask was reduced and is updated */
+        assert_se(unit_dependencies_update(&u->dependencies, d, other, di));
+
+        if (di.origin_mask == 0 && di.destination_mask == 0)
                 log_unit_debug(u, "lost dependency %s=%s", unit_dependency_to_string(d), other->id);
-        } else
-                /* Mask was reduced, let's update the entry */
-                assert_se(hashmap_update(u->dependencies[d], other, di.data) == 0);
 }
 
 void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
@@ -5501,7 +5428,7 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
 
                         done = true;
 
-                        HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d]) {
+                        UNIT_FOREACH_DEPENDENCY_INFO(other, di, u, d) {
                                 if ((di.origin_mask & ~mask) == di.origin_mask)
                                         continue;
                                 di.origin_mask &= ~mask;
@@ -5515,7 +5442,8 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                                 for (UnitDependency q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
                                         UnitDependencyInfo dj;
 
-                                        dj.data = hashmap_get(other->dependencies[q], u);
+                                        if (!unit_dependencies_get(&other->dependencies, q, u, &dj))
+                                                continue;
                                         if ((dj.destination_mask & ~mask) == dj.destination_mask)
                                                 continue;
                                         dj.destination_mask &= ~mask;
@@ -5662,23 +5590,22 @@ fail:
         return r;
 }
 
-static int unit_export_log_ratelimit_interval(Unit *u, const ExecContext *c) {
+static int unit_export_log_ratelimit_interval(Unit *u, usec_t interval) {
         _cleanup_free_ char *buf = NULL;
         const char *p;
         int r;
 
         assert(u);
-        assert(c);
 
         if (u->exported_log_ratelimit_interval)
                 return 0;
 
-        if (c->log_ratelimit_interval_usec == 0)
+        if (interval == 0)
                 return 0;
 
         p = strjoina("/run/systemd/units/log-rate-limit-interval:", u->id);
 
-        if (asprintf(&buf, "%" PRIu64, c->log_ratelimit_interval_usec) < 0)
+        if (asprintf(&buf, "%" PRIu64, interval) < 0)
                 return log_oom();
 
         r = symlink_atomic(buf, p);
@@ -5689,23 +5616,22 @@ static int unit_export_log_ratelimit_interval(Unit *u, const ExecContext *c) {
         return 0;
 }
 
-static int unit_export_log_ratelimit_burst(Unit *u, const ExecContext *c) {
+static int unit_export_log_ratelimit_burst(Unit *u, unsigned burst) {
         _cleanup_free_ char *buf = NULL;
         const char *p;
         int r;
 
         assert(u);
-        assert(c);
 
         if (u->exported_log_ratelimit_burst)
                 return 0;
 
-        if (c->log_ratelimit_burst == 0)
+        if (burst == 0)
                 return 0;
 
         p = strjoina("/run/systemd/units/log-rate-limit-burst:", u->id);
 
-        if (asprintf(&buf, "%u", c->log_ratelimit_burst) < 0)
+        if (asprintf(&buf, "%u", burst) < 0)
                 return log_oom();
 
         r = symlink_atomic(buf, p);
@@ -5749,8 +5675,14 @@ void unit_export_state_files(Unit *u) {
         if (c) {
                 (void) unit_export_log_level_max(u, c);
                 (void) unit_export_log_extra_fields(u, c);
-                (void) unit_export_log_ratelimit_interval(u, c);
-                (void) unit_export_log_ratelimit_burst(u, c);
+                (void) unit_export_log_ratelimit_interval(u, c->log_ratelimit_interval_usec);
+                (void) unit_export_log_ratelimit_burst(u, c->log_ratelimit_burst);
+        }
+
+        /* Slices have no processes of their own, their limits apply to everything below them together */
+        if (u->type == UNIT_SLICE) {
+                (void) unit_export_log_ratelimit_interval(u, SLICE(u)->log_ratelimit_interval_usec);
+                (void) unit_export_log_ratelimit_burst(u, SLICE(u)->log_ratelimit_burst);
         }
 }
 
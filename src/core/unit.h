@@ -11,9 +11,11 @@
 #include "list.h"
 #include "show-status.h"
 #include "set.h"
+#include "unit-dependency.h"
 #include "unit-file.h"
 #include "cgroup.h"
 
+typedef struct BPFAccessMap BPFAccessMap;
 typedef struct UnitRef UnitRef;
 
 typedef enum KillOperation {
@@ -33,6 +35,17 @@ typedef enum CollectMode {
         _COLLECT_MODE_INVALID = -1,
 } CollectMode;
 
+/* Which properties of a unit changed since the last PropertiesChanged signal was sent for it. Unless only the
+ * properties covered by the specific bits changed, all properties of both the generic and the type specific
+ * interface are sent. */
+typedef enum UnitDBusChange {
+        UNIT_DBUS_CHANGE_JOB        = 1 << 0, /* Job */
+        UNIT_DBUS_CHANGE_CONDITIONS = 1 << 1, /* ConditionResult, ConditionTimestamp, Conditions */
+        UNIT_DBUS_CHANGE_ASSERTS    = 1 << 2, /* AssertResult, AssertTimestamp, Asserts */
+        UNIT_DBUS_CHANGE_OTHER      = 1 << 3, /* Anything else */
+        _UNIT_DBUS_CHANGE_ALL       = (1 << 4) - 1,
+} UnitDBusChange;
+
 static inline bool UNIT_IS_ACTIVE_OR_RELOADING(UnitActiveState t) {
         return IN_SET(t, UNIT_ACTIVE, UNIT_RELOADING);
 }
@@ -53,53 +66,6 @@ static inline bool UNIT_IS_LOAD_COMPLETE(UnitLoadState t) {
         return t >= 0 && t < _UNIT_LOAD_STATE_MAX && t != UNIT_STUB && t != UNIT_MERGED;
 }
 
-/* Stores the 'reason' a dependency was created as a bit mask, i.e. due to which configuration source it came to be. We
- * use this so that we can selectively flush out parts of dependencies again. Note that the same dependency might be
- * created as a result of multiple "reasons", hence the bitmask. */
-typedef enum UnitDependencyMask {
-        /* Configured directly by the unit file, .wants/.requires symlink or drop-in, or as an immediate result of a
-         * non-dependency option configured that way.  */
-        UNIT_DEPENDENCY_FILE               = 1 << 0,
-
-        /* As unconditional implicit dependency (not affected by unit configuration — except by the unit name and
-         * type) */
-        UNIT_DEPENDENCY_IMPLICIT           = 1 << 1,
-
-        /* A dependency effected by DefaultDependencies=yes. Note that dependencies marked this way are conceptually
-         * just a subset of UNIT_DEPENDENCY_FILE, as DefaultDependencies= is itself a unit file setting that can only
-         * be set in unit files. We make this two separate bits only to help debugging how dependencies came to be. */
-        UNIT_DEPENDENCY_DEFAULT            = 1 << 2,
-
-        /* A dependency created from udev rules */
-        UNIT_DEPENDENCY_UDEV               = 1 << 3,
-
-        /* A dependency created because of some unit's RequiresMountsFor= setting */
-        UNIT_DEPENDENCY_PATH               = 1 << 4,
-
-        /* A dependency created because of data read from /proc/self/mountinfo and no other configuration source */
-        UNIT_DEPENDENCY_MOUNTINFO_IMPLICIT = 1 << 5,
-
-        /* A dependency created because of data read from /proc/self/mountinfo, but conditionalized by
-         * DefaultDependencies= and thus also involving configuration from UNIT_DEPENDENCY_FILE sources */
-        UNIT_DEPENDENCY_MOUNTINFO_DEFAULT  = 1 << 6,
-
-        /* A dependency created because of data read from /proc/swaps and no other configuration source */
-        UNIT_DEPENDENCY_PROC_SWAP          = 1 << 7,
-
-        _UNIT_DEPENDENCY_MASK_FULL         = (1 << 8) - 1,
-} UnitDependencyMask;
-
-/* The Unit's dependencies[] hashmaps use this structure as value. It has the same size as a void pointer, and thus can
- * be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
- * and the destination of a dependency might have created it. */
-typedef union UnitDependencyInfo {
-        void *data;
-        struct {
-                UnitDependencyMask origin_mask:16;
-                UnitDependencyMask destination_mask:16;
-        } _packed_;
-} UnitDependencyInfo;
-
 #include "job.h"
 
 struct UnitRef {
@@ -126,9 +92,8 @@ typedef struct Unit {
 
         Set *aliases; /* All the other names. */
 
-        /* For each dependency type we maintain a Hashmap whose key is the Unit* object, and the value encodes why the
-         * dependency exists, using the UnitDependencyInfo type */
-        Hashmap *dependencies[_UNIT_DEPENDENCY_MAX];
+        /* The dependencies of all types on other units, together with why each of them exists */
+        UnitDependencies dependencies;
 
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
@@ -266,6 +231,7 @@ typedef struct Unit {
         /* Where the io.stat data was at the time the unit was started */
         uint64_t io_accounting_base[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
         uint64_t io_accounting_last[_CGROUP_IO_ACCOUNTING_METRIC_MAX]; /* the most recently read value */
+        usec_t io_accounting_timestamp; /* the event loop iteration io_accounting_last[] was read in */
 
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
@@ -274,6 +240,9 @@ typedef struct Unit {
         CGroupMask cgroup_invalidated_mask;        /* A mask specifying controllers which shall be considered invalidated, and require re-realization */
         CGroupMask cgroup_members_mask;            /* A cache for the controllers required by all children of this cgroup (only relevant for slice units) */
 
+        /* The attribute values we last wrote successfully to the cgroup, so that unchanged ones are not rewritten */
+        Hashmap *cgroup_attributes;
+
         /* Inotify watch descriptors for watching cgroup.events and memory.events on cgroupv2 */
         int cgroup_control_inotify_wd;
         int cgroup_memory_inotify_wd;
@@ -285,10 +254,11 @@ typedef struct Unit {
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
 
-        int ipv4_allow_map_fd;
-        int ipv6_allow_map_fd;
-        int ipv4_deny_map_fd;
-        int ipv6_deny_map_fd;
+        /* Shared with all other units that end up with the same access lists */
+        BPFAccessMap *ipv4_allow_map;
+        BPFAccessMap *ipv6_allow_map;
+        BPFAccessMap *ipv4_deny_map;
+        BPFAccessMap *ipv6_deny_map;
 
         BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
         BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
@@ -302,6 +272,7 @@ typedef struct Unit {
         /* Low-priority event source which is used to remove watched PIDs that have gone away, and subscribe to any new
          * ones which might have appeared. */
         sd_event_source *rewatch_pids_event_source;
+        usec_t rewatch_pids_timestamp; /* When this was last done, CLOCK_MONOTONIC */
 
         /* How to start OnFailure units */
         JobMode on_failure_job_mode;
@@ -343,6 +314,7 @@ typedef struct Unit {
 
         /* Booleans indicating membership of this unit in the various queues */
         bool in_load_queue:1;
+        bool load_prefetched:1;      /* Unit files were read ahead while in the load queue */
         bool in_dbus_queue:1;
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
@@ -354,6 +326,9 @@ typedef struct Unit {
 
         bool sent_dbus_new_signal:1;
 
+        /* What changed since the unit was added to the D-Bus queue */
+        UnitDBusChange dbus_changes;
+
         bool in_audit:1;
         bool on_console:1;
 
@@ -655,7 +630,7 @@ static inline const UnitVTable* UNIT_VTABLE(Unit *u) {
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
 static inline Unit* UNIT_TRIGGER(Unit *u) {
-        return hashmap_first_key(u->dependencies[UNIT_TRIGGERS]);
+        return unit_dependencies_first(&u->dependencies, UNIT_TRIGGERS);
 }
 
 Unit *unit_new(Manager *m, size_t size);
@@ -679,7 +654,10 @@ int unit_set_description(Unit *u, const char *description);
 bool unit_may_gc(Unit *u);
 
 void unit_add_to_load_queue(Unit *u);
-void unit_add_to_dbus_queue(Unit *u);
+void unit_add_to_dbus_queue_full(Unit *u, UnitDBusChange changes);
+static inline void unit_add_to_dbus_queue(Unit *u) {
+        unit_add_to_dbus_queue_full(u, _UNIT_DBUS_CHANGE_ALL);
+}
 void unit_add_to_cleanup_queue(Unit *u);
 void unit_add_to_gc_queue(Unit *u);
 void unit_add_to_target_deps_queue(Unit *u);
@@ -22,7 +22,6 @@
 #include "cgroup-util.h"
 #include "compress.h"
 #include "conf-parser.h"
-#include "copy.h"
 #include "coredump-vacuum.h"
 #include "dirent-util.h"
 #include "escape.h"
@@ -322,6 +321,51 @@ static int make_filename(const Context *context, char **ret) {
         return 0;
 }
 
+static int copy_core_sparse(int input_fd, int fd, uint64_t max_size) {
+        bool truncated = false;
+        uint64_t n = 0;
+
+        assert(input_fd >= 0);
+        assert(fd >= 0);
+
+        /* Cores usually consist of a lot of zero pages, i.e. memory that was allocated but never written
+         * to. Leave holes in the file for them instead of writing them out, that saves both disk space and
+         * IO, which matters for huge cores. This reads the input in the same chunks the kernel writes them
+         * into the pipe, and reports the core as truncated if max_size is hit, just like copy_bytes() does. */
+
+        for (;;) {
+                uint8_t buf[64 * 1024];
+                ssize_t l, k;
+
+                if (n >= max_size) {
+                        truncated = true;
+                        break;
+                }
+
+                l = read(input_fd, buf, MIN(sizeof(buf), max_size - n));
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+                if (l == 0)
+                        break;
+
+                k = sparse_write(fd, buf, l, page_size());
+                if (k < 0)
+                        return (int) k;
+
+                n += l;
+        }
+
+        /* sparse_write() seeks over trailing zeros, make sure they are part of the file */
+        if (ftruncate(fd, n) < 0)
+                return -errno;
+
+        return truncated;
+}
+
 static int save_external_coredump(
                 const Context *context,
                 int input_fd,
@@ -380,7 +424,7 @@ static int save_external_coredump(
         if (fd < 0)
                 return log_error_errno(fd, "Failed to create temporary file for coredump %s: %m", fn);
 
-        r = copy_bytes(input_fd, fd, max_size, 0);
+        r = copy_core_sparse(input_fd, fd, max_size);
         if (r < 0) {
                 log_error_errno(r, "Cannot store coredump of %s (%s): %m",
                                 context->meta[META_ARGV_PID], context->meta[META_COMM]);
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fuzz.h"
+#include "json.h"
+#include "log.h"
+#include "parse-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* This is a benchmark driver for the systemd fuzzers. It is built from the very same entry points as the
+ * fuzzers, reads the files named on the command line (for example the corpora in test/fuzz/) and runs each of
+ * them through the parser that it is compiled into in a timing loop. For each input one JSON object is written
+ * to stdout, so that the numbers can be collected and compared between builds.
+ *
+ * $SYSTEMD_BENCH_ITERATIONS= sets a fixed number of iterations per input, by default each input is run for
+ * about BENCH_DEFAULT_USEC. $SYSTEMD_BENCH_REPEAT= concatenates each input with itself the specified number
+ * of times first, in order to synthesize large inputs for the line or record based formats. */
+
+#define BENCH_DEFAULT_USEC (500 * USEC_PER_MSEC)
+
+/* Count allocations to report them per operation. We don't bother with the memalign() family, nothing in
+ * the parsers uses it. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static uint64_t n_allocations = 0;
+
+void *malloc(size_t size) {
+        n_allocations++;
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+        n_allocations++;
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *p, size_t size) {
+        n_allocations++;
+        return __libc_realloc(p, size);
+}
+
+static int parse_env_unsigned(const char *name, unsigned *ret) {
+        const char *e;
+        int r;
+
+        assert(name);
+        assert(ret);
+
+        e = getenv(name);
+        if (!e)
+                return 0;
+
+        r = safe_atou(e, ret);
+        if (r < 0)
+                return log_error_errno(r, "Failed to parse $%s: %s", name, e);
+        if (*ret == 0)
+                return log_error_errno(SYNTHETIC_ERRNO(ERANGE), "$%s must be positive.", name);
+
+        return 1;
+}
+
+static int read_input(const char *name, unsigned repeat, char **ret, size_t *ret_size) {
+        _cleanup_free_ char *buf = NULL, *large = NULL;
+        size_t size;
+        int r;
+
+        assert(name);
+        assert(repeat > 0);
+        assert(ret);
+        assert(ret_size);
+
+        r = read_full_file(name, &buf, &size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open '%s': %m", name);
+
+        if (repeat == 1 || size == 0) {
+                *ret = TAKE_PTR(buf);
+                *ret_size = size;
+                return 0;
+        }
+
+        if (size > SIZE_MAX / repeat)
+                return log_oom();
+
+        large = malloc(size * repeat);
+        if (!large)
+                return log_oom();
+
+        for (unsigned i = 0; i < repeat; i++)
+                memcpy(large + i * size, buf, size);
+
+        *ret = TAKE_PTR(large);
+        *ret_size = size * repeat;
+        return 0;
+}
+
+int main(int argc, char **argv) {
+        unsigned iterations = 0, repeat = 1;
+        int r;
+
+        /* Logging from the parsers would only measure the console */
+        test_setup_logging(LOG_CRIT);
+
+        r = parse_env_unsigned("SYSTEMD_BENCH_ITERATIONS", &iterations);
+        if (r < 0)
+                return EXIT_FAILURE;
+
+        r = parse_env_unsigned("SYSTEMD_BENCH_REPEAT", &repeat);
+        if (r < 0)
+                return EXIT_FAILURE;
+
+        for (int i = 1; i < argc; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+                _cleanup_free_ char *buf = NULL;
+                uint64_t n = 0, n_allocations_start;
+                usec_t start, elapsed;
+                uint64_t ns_per_op;
+                size_t size;
+
+                r = read_input(argv[i], repeat, &buf, &size);
+                if (r < 0)
+                        return EXIT_FAILURE;
+
+                /* Warm up, and catch inputs the fuzzer refuses to deal with in this build */
+                if (LLVMFuzzerTestOneInput((uint8_t*) buf, size) == EXIT_TEST_SKIP)
+                        return EXIT_TEST_SKIP;
+
+                n_allocations_start = n_allocations;
+                start = now(CLOCK_MONOTONIC);
+                do {
+                        (void) LLVMFuzzerTestOneInput((uint8_t*) buf, size);
+                        n++;
+                        elapsed = now(CLOCK_MONOTONIC) - start;
+                } while (iterations > 0 ? n < iterations : elapsed < BENCH_DEFAULT_USEC);
+
+                ns_per_op = elapsed * NSEC_PER_USEC / n;
+
+                r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("input", JSON_BUILD_STRING(argv[i])),
+                                       JSON_BUILD_PAIR("size", JSON_BUILD_UNSIGNED(size)),
+                                       JSON_BUILD_PAIR("iterations", JSON_BUILD_UNSIGNED(n)),
+                                       JSON_BUILD_PAIR("ns_per_op", JSON_BUILD_UNSIGNED(ns_per_op)),
+                                       JSON_BUILD_PAIR("bytes_per_sec", JSON_BUILD_UNSIGNED(ns_per_op > 0 ? (uint64_t) (size * 1e9 / ns_per_op) : 0)),
+                                       JSON_BUILD_PAIR("allocations_per_op", JSON_BUILD_REAL((double) (n_allocations - n_allocations_start) / n))));
+                if (r < 0) {
+                        log_error_errno(r, "Failed to build JSON object: %m");
+                        return EXIT_FAILURE;
+                }
+
+                json_variant_dump(v, JSON_FORMAT_NEWLINE, stdout, NULL);
+                fflush(stdout);
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -47,7 +47,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         lease->expiration = UINT64_MAX;
         memcpy(lease->chaddr, chaddr, 16);
         pool_offset = get_pool_offset(server, lease->address);
-        server->bound_leases[pool_offset] = lease;
+        server_bind_lease(server, pool_offset, lease);
         assert_se(hashmap_put(server->leases_by_client_id, &lease->client_id, lease) >= 0);
 
         (void) dhcp_server_handle_message(server, (DHCPMessage*)data, size);
@@ -55,9 +55,6 @@
         "/usr/local/lib/systemd/home/\0"        \
         "/usr/lib/systemd/home/\0"
 
-static bool uid_is_home(uid_t uid) {
-        return uid >= HOME_UID_MIN && uid <= HOME_UID_MAX;
-}
 /* Takes a value generated randomly or by hashing and turns it into a UID in the right range */
 
 #define UID_CLAMP_INTO_HOME_RANGE(rnd) (((uid_t) (rnd) % (HOME_UID_MAX - HOME_UID_MIN + 1)) + HOME_UID_MIN)
@@ -13,6 +13,7 @@
 #include "chattr-util.h"
 #include "dm-util.h"
 #include "errno-util.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -1142,10 +1143,14 @@ int home_prepare_luks(
                         goto fail;
                 }
         } else {
+                char t_loop[FORMAT_TIMESPAN_MAX], t_luks[FORMAT_TIMESPAN_MAX], t_fsck[FORMAT_TIMESPAN_MAX], t_mount[FORMAT_TIMESPAN_MAX];
                 _cleanup_free_ char *fstype = NULL, *subdir = NULL;
+                usec_t ts_start, ts_loop, ts_luks, ts_fsck, ts_mount;
                 const char *ip;
                 struct stat st;
 
+                ts_start = now(CLOCK_MONOTONIC);
+
                 ip = force_image_path ?: user_record_image_path(h);
 
                 subdir = path_join("/run/systemd/user-home-mount/", user_record_user_name_and_realm(h));
@@ -1186,6 +1191,7 @@ int home_prepare_luks(
                         return log_error_errno(r, "Failed to allocate loopback context: %m");
 
                 log_info("Setting up loopback device %s completed.", loop->node ?: ip);
+                ts_loop = now(CLOCK_MONOTONIC);
 
                 r = luks_setup(loop->node ?: ip,
                                setup->dm_name,
@@ -1209,6 +1215,8 @@ int home_prepare_luks(
                 if (r < 0)
                         goto fail;
 
+                ts_luks = now(CLOCK_MONOTONIC);
+
                 r = fs_validate(setup->dm_node, h->file_system_uuid, &fstype, &found_fs_uuid);
                 if (r < 0)
                         goto fail;
@@ -1217,6 +1225,8 @@ int home_prepare_luks(
                 if (r < 0)
                         goto fail;
 
+                ts_fsck = now(CLOCK_MONOTONIC);
+
                 r = home_unshare_and_mount(setup->dm_node, fstype, user_record_luks_discard(h), user_record_mount_flags(h));
                 if (r < 0)
                         goto fail;
@@ -1232,6 +1242,15 @@ int home_prepare_luks(
                 if (user_record_luks_discard(h))
                         (void) run_fitrim(root_fd);
 
+                ts_mount = now(CLOCK_MONOTONIC);
+
+                /* Activation is on the login path, hence tell where the time went */
+                log_info("Activation phases took: loopback setup %s, LUKS unlocking %s, file system check %s, mounting %s.",
+                         format_timespan(t_loop, sizeof(t_loop), ts_loop - ts_start, USEC_PER_MSEC),
+                         format_timespan(t_luks, sizeof(t_luks), ts_luks - ts_loop, USEC_PER_MSEC),
+                         format_timespan(t_fsck, sizeof(t_fsck), ts_fsck - ts_luks, USEC_PER_MSEC),
+                         format_timespan(t_mount, sizeof(t_mount), ts_mount - ts_fsck, USEC_PER_MSEC));
+
                 setup->image_fd = TAKE_FD(image_fd);
                 setup->do_offline_fallocate = !(setup->do_offline_fitrim = user_record_luks_offline_discard(h));
                 setup->do_mark_clean = marked_dirty;
@@ -1461,6 +1480,67 @@ static struct crypt_pbkdf_type* build_minimal_pbkdf(struct crypt_pbkdf_type *buf
         return buffer;
 }
 
+static int benchmark_good_pbkdf(struct crypt_device *cd, struct crypt_pbkdf_type *pbkdf, size_t volume_key_size) {
+        _cleanup_free_ char *fn = NULL, *line = NULL, *iterations = NULL, *memory = NULL, *data = NULL;
+        const char *p;
+        int r;
+
+        assert(cd);
+        assert(pbkdf);
+
+        /* Every keyslot added with the same PBKDF parameters is benchmarked again by libcryptsetup, which
+         * takes about as long as the time cost itself. Since all homes on a host are set up with the same
+         * parameters, benchmark them only once per boot, remember the result in /run, and then add keyslots
+         * without benchmarking. */
+
+        if (asprintf(&fn, "/run/systemd/home/pbkdf-%s-%s-%" PRIu32 "-%" PRIu32 "-%" PRIu32 "-%zu",
+                     strna(pbkdf->type), strna(pbkdf->hash),
+                     pbkdf->time_ms, pbkdf->max_memory_kb, pbkdf->parallel_threads,
+                     volume_key_size) < 0)
+                return log_oom();
+
+        r = read_one_line_file(fn, &line);
+        if (r >= 0) {
+                p = line;
+                r = extract_many_words(&p, NULL, 0, &iterations, &memory, NULL);
+                if (r == 2 &&
+                    safe_atou32(iterations, &pbkdf->iterations) >= 0 &&
+                    safe_atou32(memory, &pbkdf->max_memory_kb) >= 0 &&
+                    pbkdf->iterations > 0) {
+                        log_debug("Using cached PBKDF benchmark from %s: %" PRIu32 " iterations, %" PRIu32 "K memory.",
+                                  fn, pbkdf->iterations, pbkdf->max_memory_kb);
+                        pbkdf->flags |= CRYPT_PBKDF_NO_BENCHMARK;
+                        return 0;
+                }
+
+                log_debug("Cached PBKDF benchmark %s is invalid, ignoring.", fn);
+        } else if (r != -ENOENT)
+                log_debug_errno(r, "Failed to read cached PBKDF benchmark %s, ignoring: %m", fn);
+
+        /* Same dummy password and salt libcryptsetup benchmarks with */
+        r = crypt_benchmark_pbkdf(cd, pbkdf,
+                                  "foobarfo", 8,
+                                  "0123456789abcdef0123456789abcdef", 32,
+                                  volume_key_size,
+                                  NULL, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to benchmark PBKDF: %m");
+
+        log_info("PBKDF benchmark completed: %" PRIu32 " iterations, %" PRIu32 "K memory.",
+                 pbkdf->iterations, pbkdf->max_memory_kb);
+
+        pbkdf->flags |= CRYPT_PBKDF_NO_BENCHMARK;
+
+        if (asprintf(&data, "%" PRIu32 " %" PRIu32, pbkdf->iterations, pbkdf->max_memory_kb) < 0)
+                return log_oom();
+
+        r = write_string_file(fn, data, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_MKDIR_0755);
+        if (r < 0)
+                log_debug_errno(r, "Failed to cache PBKDF benchmark in %s, ignoring: %m", fn);
+
+        return 0;
+}
+
 static int luks_format(
                 const char *node,
                 const char *dm_name,
@@ -1478,6 +1558,7 @@ static int luks_format(
         struct crypt_pbkdf_type good_pbkdf, minimal_pbkdf;
         char suuid[ID128_UUID_STRING_MAX], **pp;
         _cleanup_free_ char *text = NULL;
+        bool benchmarked = false;
         size_t volume_key_size;
         int slot = 0, r;
 
@@ -1541,6 +1622,15 @@ static int luks_format(
                         r = crypt_set_pbkdf_type(cd, &minimal_pbkdf);
                 } else {
                         log_debug("Using good PBKDF for slot %i", slot);
+
+                        if (!benchmarked) {
+                                r = benchmark_good_pbkdf(cd, &good_pbkdf, volume_key_size);
+                                if (r < 0)
+                                        return r;
+
+                                benchmarked = true;
+                        }
+
                         r = crypt_set_pbkdf_type(cd, &good_pbkdf);
                 }
                 if (r < 0)
@@ -2882,6 +2972,7 @@ int home_passwd_luks(
         size_t volume_key_size, i, max_key_slots, n_effective;
         _cleanup_(erase_and_freep) void *volume_key = NULL;
         struct crypt_pbkdf_type good_pbkdf, minimal_pbkdf;
+        bool benchmarked = false;
         const char *type;
         char **list;
         int r;
@@ -2941,6 +3032,15 @@ int home_passwd_luks(
                         r = crypt_set_pbkdf_type(setup->crypt_device, &minimal_pbkdf);
                 } else {
                         log_debug("Using good PBKDF for slot %zu", i);
+
+                        if (!benchmarked) {
+                                r = benchmark_good_pbkdf(setup->crypt_device, &good_pbkdf, volume_key_size);
+                                if (r < 0)
+                                        return r;
+
+                                benchmarked = true;
+                        }
+
                         r = crypt_set_pbkdf_type(setup->crypt_device, &good_pbkdf);
                 }
                 if (r < 0)
@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/resource.h>
+
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
 #include "btrfs-util.h"
 #include "export-tar.h"
 #include "fd-util.h"
+#include "format-util.h"
 #include "import-common.h"
 #include "process-util.h"
 #include "ratelimit.h"
@@ -38,6 +41,8 @@ struct TarExport {
         uint64_t written_compressed;
         uint64_t written_uncompressed;
 
+        usec_t start_usec;
+
         pid_t tar_pid;
 
         struct stat st;
@@ -140,6 +145,36 @@ static void tar_export_report_progress(TarExport *e) {
         e->last_percent = percent;
 }
 
+static usec_t cpu_usage(int who) {
+        struct rusage ru;
+
+        if (getrusage(who, &ru) < 0)
+                return 0;
+
+        return timeval_load(&ru.ru_utime) + timeval_load(&ru.ru_stime);
+}
+
+static void tar_export_report_statistics(TarExport *e) {
+        char a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX], c[FORMAT_BYTES_MAX], t[FORMAT_TIMESPAN_MAX], u[FORMAT_TIMESPAN_MAX];
+        usec_t elapsed, cpu;
+
+        assert(e);
+
+        /* Report throughput and the CPU time spent by us (i.e. compression) and tar, which is what matters
+         * when picking a compression algorithm for large exports */
+        elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), e->start_usec);
+        cpu = cpu_usage(RUSAGE_SELF) + cpu_usage(RUSAGE_CHILDREN);
+
+        log_info("Exported %s (%s compressed) in %s, %s/s, %s CPU time per GiB.",
+                 format_bytes(a, sizeof(a), e->written_uncompressed),
+                 format_bytes(b, sizeof(b), e->written_compressed),
+                 format_timespan(t, sizeof(t), elapsed, USEC_PER_MSEC),
+                 format_bytes(c, sizeof(c), elapsed > 0 ? e->written_uncompressed * USEC_PER_SEC / elapsed : 0),
+                 format_timespan(u, sizeof(u),
+                                 e->written_uncompressed > 0 ? (usec_t) ((double) cpu * (1024.0*1024.0*1024.0) / e->written_uncompressed) : 0,
+                                 USEC_PER_MSEC));
+}
+
 static int tar_export_finish(TarExport *e) {
         int r;
 
@@ -157,6 +192,8 @@ static int tar_export_finish(TarExport *e) {
 
         e->tar_fd = safe_close(e->tar_fd);
 
+        tar_export_report_statistics(e);
+
         return 0;
 }
 
@@ -326,5 +363,6 @@ int tar_export_start(TarExport *e, const char *path, int fd, ImportCompressType
         }
 
         e->output_fd = fd;
+        e->start_usec = now(CLOCK_MONOTONIC);
         return r;
 }
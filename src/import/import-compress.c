@@ -4,6 +4,12 @@
 #include "string-table.h"
 #include "util.h"
 
+/* Decompress into reasonably large chunks, so that the consumers (which usually write to disk) get to
+ * see few large writes rather than many small ones */
+#define UNCOMPRESS_BUFFER_SIZE (128U*1024U)
+
+#define XZ_ENCODER_THREADS_MAX 4U
+
 void import_compress_free(ImportCompress *c) {
         assert(c);
 
@@ -23,6 +29,7 @@ void import_compress_free(ImportCompress *c) {
 #endif
         }
 
+        c->buffer = mfree(c->buffer);
         c->type = IMPORT_COMPRESS_UNKNOWN;
 }
 
@@ -80,6 +87,15 @@ int import_uncompress_detect(ImportCompress *c, const void *data, size_t size) {
 
         c->encoding = false;
 
+        /* The buffer to decompress into is allocated once here, rather than on the stack for every chunk */
+        if (c->type != IMPORT_COMPRESS_UNCOMPRESSED && !c->buffer) {
+                c->buffer = malloc(UNCOMPRESS_BUFFER_SIZE);
+                if (!c->buffer) {
+                        import_compress_free(c);
+                        return -ENOMEM;
+                }
+        }
+
         return 1;
 }
 
@@ -115,17 +131,16 @@ int import_uncompress(ImportCompress *c, const void *data, size_t size, ImportCo
                 c->xz.avail_in = size;
 
                 while (c->xz.avail_in > 0) {
-                        uint8_t buffer[16 * 1024];
                         lzma_ret lzr;
 
-                        c->xz.next_out = buffer;
-                        c->xz.avail_out = sizeof(buffer);
+                        c->xz.next_out = c->buffer;
+                        c->xz.avail_out = UNCOMPRESS_BUFFER_SIZE;
 
                         lzr = lzma_code(&c->xz, LZMA_RUN);
                         if (!IN_SET(lzr, LZMA_OK, LZMA_STREAM_END))
                                 return -EIO;
 
-                        r = callback(buffer, sizeof(buffer) - c->xz.avail_out, userdata);
+                        r = callback(c->buffer, UNCOMPRESS_BUFFER_SIZE - c->xz.avail_out, userdata);
                         if (r < 0)
                                 return r;
                 }
@@ -137,16 +152,14 @@ int import_uncompress(ImportCompress *c, const void *data, size_t size, ImportCo
                 c->gzip.avail_in = size;
 
                 while (c->gzip.avail_in > 0) {
-                        uint8_t buffer[16 * 1024];
-
-                        c->gzip.next_out = buffer;
-                        c->gzip.avail_out = sizeof(buffer);
+                        c->gzip.next_out = c->buffer;
+                        c->gzip.avail_out = UNCOMPRESS_BUFFER_SIZE;
 
                         r = inflate(&c->gzip, Z_NO_FLUSH);
                         if (!IN_SET(r, Z_OK, Z_STREAM_END))
                                 return -EIO;
 
-                        r = callback(buffer, sizeof(buffer) - c->gzip.avail_out, userdata);
+                        r = callback(c->buffer, UNCOMPRESS_BUFFER_SIZE - c->gzip.avail_out, userdata);
                         if (r < 0)
                                 return r;
                 }
@@ -159,16 +172,14 @@ int import_uncompress(ImportCompress *c, const void *data, size_t size, ImportCo
                 c->bzip2.avail_in = size;
 
                 while (c->bzip2.avail_in > 0) {
-                        uint8_t buffer[16 * 1024];
-
-                        c->bzip2.next_out = (char*) buffer;
-                        c->bzip2.avail_out = sizeof(buffer);
+                        c->bzip2.next_out = (char*) c->buffer;
+                        c->bzip2.avail_out = UNCOMPRESS_BUFFER_SIZE;
 
                         r = BZ2_bzDecompress(&c->bzip2);
                         if (!IN_SET(r, BZ_OK, BZ_STREAM_END))
                                 return -EIO;
 
-                        r = callback(buffer, sizeof(buffer) - c->bzip2.avail_out, userdata);
+                        r = callback(c->buffer, UNCOMPRESS_BUFFER_SIZE - c->bzip2.avail_out, userdata);
                         if (r < 0)
                                 return r;
                 }
@@ -193,7 +204,19 @@ int import_compress_init(ImportCompress *c, ImportCompressType t) {
         case IMPORT_COMPRESS_XZ: {
                 lzma_ret xzr;
 
-                xzr = lzma_easy_encoder(&c->xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+#if LZMA_VERSION >= UINT32_C(50020000)
+                /* Compress on multiple threads, if we can. The output is a regular .xz stream, just split into
+                 * multiple blocks. Cap the number of threads, since each thread needs quite a bit of memory. */
+                lzma_mt mt = {
+                        .threads = CLAMP(lzma_cputhreads(), 1U, XZ_ENCODER_THREADS_MAX),
+                        .preset = LZMA_PRESET_DEFAULT,
+                        .check = LZMA_CHECK_CRC64,
+                };
+
+                xzr = lzma_stream_encoder_mt(&c->xz, &mt);
+                if (xzr != LZMA_OK)
+#endif
+                        xzr = lzma_easy_encoder(&c->xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
                 if (xzr != LZMA_OK)
                         return -EIO;
 
@@ -30,6 +30,7 @@ typedef struct ImportCompress {
                 bz_stream bzip2;
 #endif
         };
+        uint8_t *buffer; /* output buffer for decompression, shared by all types */
 } ImportCompress;
 
 typedef int (*ImportCompressCallback)(const void *data, size_t size, void *userdata);
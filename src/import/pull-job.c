@@ -19,6 +19,8 @@
 #include "strv.h"
 #include "xattr-util.h"
 
+#define PULL_JOB_BUFFER_SIZE (512L*1024L)
+
 PullJob* pull_job_unref(PullJob *j) {
         if (!j)
                 return NULL;
@@ -629,6 +631,11 @@ int pull_job_begin(PullJob *j) {
         if (curl_easy_setopt(j->curl, CURLOPT_NOPROGRESS, 0) != CURLE_OK)
                 return -EIO;
 
+        /* Ask for larger chunks than the 16K default, each of which is handed to the decompressor and
+         * written to disk in one go. Older libcurl versions might refuse this, which is fine. */
+        if (curl_easy_setopt(j->curl, CURLOPT_BUFFERSIZE, PULL_JOB_BUFFER_SIZE) != CURLE_OK)
+                log_debug("Failed to increase libcurl receive buffer size, ignoring.");
+
         r = curl_glue_add(j->glue, j->curl);
         if (r < 0)
                 return r;
@@ -9,6 +9,14 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "sd-bus.h"
 #include "sd-daemon.h"
 #include "sd-journal.h"
@@ -16,6 +24,7 @@
 #include "alloc-util.h"
 #include "bus-util.h"
 #include "errno-util.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
@@ -32,6 +41,9 @@
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
 
+/* Entries are rendered in batches of about this size, which are then compressed and sent as one */
+#define ENTRIES_CHUNK_SIZE (128U*1024U)
+
 static char *arg_key_pem = NULL;
 static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
@@ -41,10 +53,18 @@ STATIC_DESTRUCTOR_REGISTER(arg_key_pem, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_cert_pem, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_trust_pem, freep);
 
+typedef enum RequestEncoding {
+        REQUEST_ENCODING_IDENTITY,
+        REQUEST_ENCODING_GZIP,
+        REQUEST_ENCODING_ZSTD,
+        _REQUEST_ENCODING_MAX,
+} RequestEncoding;
+
 typedef struct RequestMeta {
         sd_journal *journal;
 
         OutputMode mode;
+        RequestEncoding encoding;
 
         char *cursor;
         int64_t n_skip;
@@ -54,6 +74,23 @@ typedef struct RequestMeta {
         FILE *tmp;
         uint64_t delta, size;
 
+        /* Entries are rendered into a memory stream that is reused for each chunk, and compressed into the
+         * chunk buffer from there if requested. data points to whatever is being sent. */
+        FILE *render;
+        char *render_buf;
+        size_t render_size;
+        char *chunk;
+        size_t chunk_size, chunk_allocated;
+        const char *data;
+        bool eof;
+
+#if HAVE_ZLIB
+        z_stream *gzip;
+#endif
+#if HAVE_ZSTD
+        ZSTD_CCtx *zstd;
+#endif
+
         int argument_parse_error;
 
         bool follow;
@@ -71,6 +108,11 @@ static const char* const mime_types[_OUTPUT_MODE_MAX] = {
         [OUTPUT_EXPORT] = "application/vnd.fdo.journal",
 };
 
+static const char* const encodings[_REQUEST_ENCODING_MAX] = {
+        [REQUEST_ENCODING_GZIP] = "gzip",
+        [REQUEST_ENCODING_ZSTD] = "zstd",
+};
+
 static RequestMeta *request_meta(void **connection_cls) {
         RequestMeta *m;
 
@@ -99,8 +141,25 @@ static void request_meta_free(
 
         sd_journal_close(m->journal);
 
+        /* Connections are served from their own threads, which end with the connection */
+        show_journal_entry_release_cache();
+
         safe_fclose(m->tmp);
 
+        safe_fclose(m->render);
+        free(m->render_buf);
+        free(m->chunk);
+
+#if HAVE_ZLIB
+        if (m->gzip) {
+                deflateEnd(m->gzip);
+                free(m->gzip);
+        }
+#endif
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(m->zstd);
+#endif
+
         free(m->cursor);
         free(m);
 }
@@ -137,32 +196,31 @@ static int request_meta_ensure_tmp(RequestMeta *m) {
         return 0;
 }
 
-static ssize_t request_reader_entries(
-                void *cls,
-                uint64_t pos,
-                char *buf,
-                size_t max) {
-
-        RequestMeta *m = cls;
+static int request_render_chunk(RequestMeta *m, size_t *ret_size) {
+        uint64_t n = 0;
+        off_t sz;
         int r;
-        size_t n, k;
 
         assert(m);
-        assert(buf);
-        assert(max > 0);
-        assert(pos >= m->delta);
-
-        pos -= m->delta;
+        assert(ret_size);
 
-        while (pos >= m->size) {
-                off_t sz;
+        /* Renders as many entries as are available into the memory stream, up to ENTRIES_CHUNK_SIZE. Returns
+         * 0 if there was none, and sets m->eof if there won't be any more. */
 
-                /* End of this entry, so let's serialize the next
-                 * one */
+        if (m->render)
+                rewind(m->render);
+        else {
+                m->render = open_memstream_unlocked(&m->render_buf, &m->render_size);
+                if (!m->render)
+                        return log_oom();
+        }
 
+        for (;;) {
                 if (m->n_entries_set &&
-                    m->n_entries <= 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                    m->n_entries <= 0) {
+                        m->eof = true;
+                        break;
+                }
 
                 if (m->n_skip < 0)
                         r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
@@ -170,92 +228,227 @@ static ssize_t request_reader_entries(
                         r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
                 else
                         r = sd_journal_next(m->journal);
-
-                if (r < 0) {
-                        log_error_errno(r, "Failed to advance journal pointer: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                } else if (r == 0) {
-
-                        if (m->follow) {
-                                r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
-                                if (r < 0) {
-                                        log_error_errno(r, "Couldn't wait for journal event: %m");
-                                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                                }
-                                if (r == SD_JOURNAL_NOP)
-                                        break;
-
-                                continue;
-                        }
-
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                if (r < 0)
+                        return log_error_errno(r, "Failed to advance journal pointer: %m");
+                if (r == 0) {
+                        /* When following, send what we have right away, and wait for more later */
+                        if (!m->follow)
+                                m->eof = true;
+                        break;
                 }
 
                 if (m->discrete) {
                         assert(m->cursor);
 
                         r = sd_journal_test_cursor(m->journal, m->cursor);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to test cursor: %m");
-                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to test cursor: %m");
+                        if (r == 0) {
+                                m->eof = true;
+                                break;
                         }
-
-                        if (r == 0)
-                                return MHD_CONTENT_READER_END_OF_STREAM;
                 }
 
-                pos -= m->size;
-                m->delta += m->size;
-
                 if (m->n_entries_set)
                         m->n_entries -= 1;
 
                 m->n_skip = 0;
 
-                r = request_meta_ensure_tmp(m);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+                r = show_journal_entry(m->render, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
+                                       NULL, NULL, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to serialize item: %m");
 
-                r = show_journal_entry(m->tmp, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
-                                   NULL, NULL, NULL);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to serialize item: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+                n++;
 
-                sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                sz = ftello(m->render);
+                if (sz == (off_t) -1)
+                        return log_error_errno(errno, "Failed to retrieve stream position: %m");
+                if ((uint64_t) sz >= ENTRIES_CHUNK_SIZE)
+                        break;
+        }
+
+        sz = ftello(m->render);
+        if (sz == (off_t) -1)
+                return log_error_errno(errno, "Failed to retrieve stream position: %m");
+
+        r = fflush_and_check(m->render);
+        if (r < 0)
+                return log_error_errno(r, "Failed to serialize items: %m");
+
+        *ret_size = (size_t) sz;
+        return n > 0;
+}
+
+#if HAVE_ZLIB
+static int request_encode_chunk_gzip(RequestMeta *m, const void *p, size_t size, bool end) {
+        int k;
+
+        if (!m->gzip) {
+                m->gzip = new0(z_stream, 1);
+                if (!m->gzip)
+                        return -ENOMEM;
+
+                /* Adding 16 to the window bits makes zlib write a gzip header and trailer */
+                if (deflateInit2(m->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                        m->gzip = mfree(m->gzip);
+                        return -ENOMEM;
                 }
+        }
 
-                m->size = (uint64_t) sz;
+        m->gzip->next_in = (Bytef*) p;
+        m->gzip->avail_in = size;
+
+        for (;;) {
+                if (!GREEDY_REALLOC(m->chunk, m->chunk_allocated, m->chunk_size + MAX(size / 2, 16U*1024U)))
+                        return -ENOMEM;
+
+                m->gzip->next_out = (Bytef*) m->chunk + m->chunk_size;
+                m->gzip->avail_out = m->chunk_allocated - m->chunk_size;
+
+                /* Flush at the end of each chunk, so that the client can decompress what it got so far */
+                k = deflate(m->gzip, end ? Z_FINISH : Z_SYNC_FLUSH);
+                if (!IN_SET(k, Z_OK, Z_STREAM_END, Z_BUF_ERROR))
+                        return -EIO;
+
+                m->chunk_size = m->chunk_allocated - m->gzip->avail_out;
+
+                if (end ? k == Z_STREAM_END : m->gzip->avail_out > 0)
+                        return 0;
         }
+}
+#endif
 
-        if (m->tmp == NULL && m->follow)
-                return 0;
+#if HAVE_ZSTD
+static int request_encode_chunk_zstd(RequestMeta *m, const void *p, size_t size, bool end) {
+        ZSTD_inBuffer input = {
+                .src = p,
+                .size = size,
+        };
 
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
+        if (!m->zstd) {
+                m->zstd = ZSTD_createCCtx();
+                if (!m->zstd)
+                        return -ENOMEM;
+
+                (void) ZSTD_CCtx_setParameter(m->zstd, ZSTD_c_checksumFlag, 1);
         }
 
-        n = m->size - pos;
-        if (n < 1)
-                return 0;
-        if (n > max)
-                n = max;
+        for (;;) {
+                ZSTD_outBuffer output;
+                size_t remaining;
 
-        errno = 0;
-        k = fread(buf, 1, n, m->tmp);
-        if (k != n) {
-                log_error("Failed to read from file: %s", errno != 0 ? strerror_safe(errno) : "Premature EOF");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
+                if (!GREEDY_REALLOC(m->chunk, m->chunk_allocated, m->chunk_size + ZSTD_CStreamOutSize()))
+                        return -ENOMEM;
+
+                output = (ZSTD_outBuffer) {
+                        .dst = m->chunk,
+                        .size = m->chunk_allocated,
+                        .pos = m->chunk_size,
+                };
+
+                remaining = ZSTD_compressStream2(m->zstd, &output, &input, end ? ZSTD_e_end : ZSTD_e_flush);
+                if (ZSTD_isError(remaining))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EIO), "ZSTD encoder failed: %s", ZSTD_getErrorName(remaining));
+
+                m->chunk_size = output.pos;
+
+                if (remaining == 0)
+                        return 0;
         }
+}
+#endif
 
-        return (ssize_t) k;
+static int request_encode_chunk(RequestMeta *m, const void *p, size_t size, bool end) {
+        assert(m);
+        assert(p || size == 0);
+
+        m->chunk_size = 0;
+
+        switch (m->encoding) {
+
+#if HAVE_ZLIB
+        case REQUEST_ENCODING_GZIP:
+                return request_encode_chunk_gzip(m, p, size, end);
+#endif
+
+#if HAVE_ZSTD
+        case REQUEST_ENCODING_ZSTD:
+                return request_encode_chunk_zstd(m, p, size, end);
+#endif
+
+        default:
+                assert_not_reached("Unexpected encoding");
+        }
+}
+
+static ssize_t request_reader_entries(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        RequestMeta *m = cls;
+        int r;
+        size_t n;
+
+        assert(m);
+        assert(buf);
+        assert(max > 0);
+        assert(pos >= m->delta);
+
+        pos -= m->delta;
+
+        while (pos >= m->size) {
+                size_t sz;
+
+                /* End of this chunk, so let's serialize the next
+                 * batch of entries */
+
+                if (m->eof)
+                        return MHD_CONTENT_READER_END_OF_STREAM;
+
+                pos -= m->size;
+                m->delta += m->size;
+                m->size = 0;
+
+                r = request_render_chunk(m, &sz);
+                if (r < 0)
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                if (r == 0 && !m->eof) {
+                        r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
+                        if (r < 0) {
+                                log_error_errno(r, "Couldn't wait for journal event: %m");
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        }
+                        if (r == SD_JOURNAL_NOP)
+                                return 0;
+
+                        continue;
+                }
+
+                if (m->encoding == REQUEST_ENCODING_IDENTITY) {
+                        m->data = m->render_buf;
+                        m->size = sz;
+                        continue;
+                }
+
+                /* The compressed stream needs to be terminated properly, hence this is even done when
+                 * there's nothing left to send */
+                r = request_encode_chunk(m, m->render_buf, sz, m->eof);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to compress entries: %m");
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                }
+
+                m->data = m->chunk;
+                m->size = m->chunk_size;
+        }
+
+        n = MIN(m->size - pos, max);
+        memcpy(buf, m->data + pos, n);
+
+        return (ssize_t) n;
 }
 
 static int request_parse_accept(
@@ -285,6 +478,54 @@ static int request_parse_accept(
         return 0;
 }
 
+static int request_parse_accept_encoding(
+                RequestMeta *m,
+                struct MHD_Connection *connection) {
+
+        const char *header;
+        int r;
+
+        assert(m);
+        assert(connection);
+
+        m->encoding = REQUEST_ENCODING_IDENTITY;
+
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+        if (!header)
+                return 0;
+
+        for (;;) {
+                _cleanup_free_ char *word = NULL;
+                char *q;
+
+                r = extract_first_word(&header, &word, ",", 0);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                /* We don't rank by quality, but honour "q=0", which means the encoding is not acceptable */
+                q = strchr(word, ';');
+                if (q) {
+                        *(q++) = 0;
+                        q = strstrip(q);
+
+                        if (startswith(q, "q=") && q[2] != 0 && q[2 + strspn(q + 2, "0.")] == 0)
+                                continue;
+                }
+
+                strstrip(word);
+
+                if (HAVE_ZSTD && streq(word, encodings[REQUEST_ENCODING_ZSTD]))
+                        m->encoding = REQUEST_ENCODING_ZSTD;
+                else if (HAVE_ZLIB && streq(word, encodings[REQUEST_ENCODING_GZIP]) &&
+                         m->encoding == REQUEST_ENCODING_IDENTITY)
+                        m->encoding = REQUEST_ENCODING_GZIP;
+        }
+
+        return 0;
+}
+
 static int request_parse_range(
                 RequestMeta *m,
                 struct MHD_Connection *connection) {
@@ -476,6 +717,9 @@ static int request_handler_entries(
         if (request_parse_accept(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept header.");
 
+        if (request_parse_accept_encoding(m, connection) < 0)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept-Encoding header.");
+
         if (request_parse_range(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Range header.");
 
@@ -499,11 +743,14 @@ static int request_handler_entries(
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 64*1024, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
         MHD_add_response_header(response, "Content-Type", mime_types[m->mode]);
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+        if (m->encoding != REQUEST_ENCODING_IDENTITY)
+                MHD_add_response_header(response, "Content-Encoding", encodings[m->encoding]);
         return MHD_queue_response(connection, MHD_HTTP_OK, response);
 }
 
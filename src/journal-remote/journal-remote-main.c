@@ -40,6 +40,7 @@ static char** arg_gnutls_log = NULL;
 
 static JournalWriteSplitMode arg_split_mode = _JOURNAL_WRITE_SPLIT_INVALID;
 static const char* arg_output = NULL;
+static unsigned arg_writer_threads = 0;
 
 static char *arg_key = NULL;
 static char *arg_cert = NULL;
@@ -147,25 +148,19 @@ static int dispatch_http_event(sd_event_source *event,
                                uint32_t revents,
                                void *userdata);
 
-static int request_meta(void **connection_cls, int fd, char *hostname) {
+static int request_meta(void **connection_cls, int fd, char *hostname, bool binary) {
         RemoteSource *source;
-        Writer *writer;
         int r;
 
         assert(connection_cls);
         if (*connection_cls)
                 return 0;
 
-        r = journal_remote_get_writer(journal_remote_server_global, hostname, &writer);
+        r = journal_remote_new_source(journal_remote_server_global, fd, true, hostname, &source);
         if (r < 0)
-                return log_warning_errno(r, "Failed to get writer for source %s: %m",
-                                         hostname);
+                return r;
 
-        source = source_new(fd, true, hostname, writer);
-        if (!source) {
-                writer_unref(writer);
-                return log_oom();
-        }
+        source->importer.binary = binary;
 
         log_debug("Added RemoteSource as connection metadata %p", source);
 
@@ -250,6 +245,18 @@ static int process_http_upload(
                                     remaining);
         }
 
+        /* Only acknowledge the upload once the writer thread has the entries on disk, so that the
+         * uploader doesn't move its cursor past entries we might still lose */
+        if (source->shard) {
+                r = remote_shard_wait(source->shard, source);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to write entries of connection %p: %m", connection);
+                        return mhd_respondf(connection,
+                                            r, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                            "Failed to write entries: %m");
+                }
+        }
+
         return mhd_respond(connection, MHD_HTTP_ACCEPTED, "OK.");
 };
 
@@ -266,7 +273,7 @@ static mhd_result request_handler(
         const char *header;
         int r, code, fd;
         _cleanup_free_ char *hostname = NULL;
-        bool chunked = false;
+        bool chunked = false, binary;
 
         assert(connection);
         assert(connection_cls);
@@ -286,8 +293,11 @@ static mhd_result request_handler(
         if (!streq(url, "/upload"))
                 return mhd_respond(connection, MHD_HTTP_NOT_FOUND, "Not found.");
 
+        /* Uploaders that want to use the binary framing fall back to the export format when they get a 415
+         * back, hence refuse it when we could not decompress the frames */
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Type");
-        if (!header || !streq(header, "application/vnd.fdo.journal"))
+        binary = HAVE_ZSTD && streq_ptr(header, JOURNAL_BINARY_CONTENT_TYPE);
+        if (!binary && !streq_ptr(header, "application/vnd.fdo.journal"))
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
                                    "Content-Type: application/vnd.fdo.journal is required.");
 
@@ -349,7 +359,7 @@ static mhd_result request_handler(
 
         assert(hostname);
 
-        r = request_meta(connection_cls, fd, hostname);
+        r = request_meta(connection_cls, fd, hostname, binary);
         if (r == -ENOMEM)
                 return respond_oom(connection);
         else if (r < 0)
@@ -559,6 +569,61 @@ static int dispatch_http_event(sd_event_source *event,
  **********************************************************************
  **********************************************************************/
 
+#define SHARD_STATS_INTERVAL_USEC (30 * USEC_PER_SEC)
+
+static int dispatch_shard_stats(sd_event_source *event,
+                                uint64_t usec,
+                                void *userdata) {
+        RemoteServer *s = userdata;
+        size_t depth_total = 0;
+        uint64_t stalls_total = 0;
+        unsigned i;
+        int r;
+
+        assert(s);
+
+        for (i = 0; i < s->n_shards; i++) {
+                size_t depth, depth_max;
+                uint64_t entries, stalls;
+
+                remote_shard_get_stats(s->shards[i], &depth, &depth_max, &entries, &stalls);
+
+                log_debug("Writer thread %u: queue depth %zu (max %zu), %" PRIu64 " entries written, %" PRIu64 " stalls.",
+                          i, depth, depth_max, entries, stalls);
+
+                depth_total += depth;
+                stalls_total += stalls;
+        }
+
+        (void) sd_notifyf(false,
+                          "STATUS=Written %" PRIu64 " entries, %zu batches queued in %u writer threads, %" PRIu64 " stalls.",
+                          journal_remote_server_event_count(s), depth_total, s->n_shards, stalls_total);
+
+        r = sd_event_source_set_time_relative(event, SHARD_STATS_INTERVAL_USEC);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to rearm writer thread statistics timer: %m");
+
+        return sd_event_source_set_enabled(event, SD_EVENT_ONESHOT);
+}
+
+static int setup_shards(RemoteServer *s, unsigned n) {
+        int r;
+
+        assert(s);
+
+        r = journal_remote_start_shards(s, n);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_time_relative(s->events, &s->shard_stats_event, CLOCK_MONOTONIC,
+                                       SHARD_STATS_INTERVAL_USEC, USEC_PER_SEC,
+                                       dispatch_shard_stats, s);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add writer thread statistics timer: %m");
+
+        return 0;
+}
+
 static int setup_signals(RemoteServer *s) {
         int r;
 
@@ -600,6 +665,13 @@ static int create_remoteserver(
         if (r < 0)
                 return r;
 
+        /* Before any source is added, as sources are assigned to a writer thread right away */
+        if (arg_writer_threads > 0) {
+                r = setup_shards(s, arg_writer_threads);
+                if (r < 0)
+                        return r;
+        }
+
         r = setup_signals(s);
         if (r < 0)
                 return log_error_errno(r, "Failed to set up signals: %m");
@@ -756,6 +828,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "WriterThreads",          config_parse_unsigned,         0, &arg_writer_threads },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -801,6 +874,8 @@ static int help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --writer-threads=N     Write the output files from N threads\n"
+               "                            (only with --split-mode=host)\n"
                "\nNote: file descriptors from sd_listen_fds() will be consumed, too.\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
@@ -825,6 +900,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CERT,
                 ARG_TRUST,
                 ARG_GNUTLS_LOG,
+                ARG_WRITER_THREADS,
         };
 
         static const struct option options[] = {
@@ -843,6 +919,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
                 { "gnutls-log",   required_argument, NULL, ARG_GNUTLS_LOG   },
+                { "writer-threads", required_argument, NULL, ARG_WRITER_THREADS },
                 {}
         };
 
@@ -967,6 +1044,12 @@ static int parse_argv(int argc, char *argv[]) {
                                                        "Invalid split mode: %s", optarg);
                         break;
 
+                case ARG_WRITER_THREADS:
+                        r = safe_atou(optarg, &arg_writer_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --writer-threads= parameter: %s", optarg);
+                        break;
+
                 case ARG_COMPRESS:
                         if (optarg) {
                                 r = parse_boolean(optarg);
@@ -1065,8 +1148,21 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "For SplitMode=host, output must be a directory.");
 
-        log_debug("Full config: SplitMode=%s Key=%s Cert=%s Trust=%s",
+        if (arg_writer_threads > REMOTE_SHARDS_MAX) {
+                log_warning("WriterThreads=%u is above the maximum of %u, limiting.",
+                            arg_writer_threads, REMOTE_SHARDS_MAX);
+                arg_writer_threads = REMOTE_SHARDS_MAX;
+        }
+
+        /* All entries of a single output file need to be written in order, by the same thread */
+        if (arg_writer_threads > 0 && arg_split_mode != JOURNAL_WRITE_SPLIT_HOST) {
+                log_warning("WriterThreads= is only supported with SplitMode=host, writing from the main thread.");
+                arg_writer_threads = 0;
+        }
+
+        log_debug("Full config: SplitMode=%s WriterThreads=%u Key=%s Cert=%s Trust=%s",
                   journal_write_split_mode_to_string(arg_split_mode),
+                  arg_writer_threads,
                   strna(arg_key),
                   strna(arg_cert),
                   strna(arg_trust));
@@ -1167,9 +1263,10 @@ static int run(int argc, char **argv) {
         notify_message = NULL;
         (void) sd_notifyf(false,
                           "STOPPING=1\n"
-                          "STATUS=Shutting down after writing %" PRIu64 " entries...", s.event_count);
+                          "STATUS=Shutting down after writing %" PRIu64 " entries...",
+                          journal_remote_server_event_count(&s));
 
-        log_info("Finishing after writing %" PRIu64 " entries", s.event_count);
+        log_info("Finishing after writing %" PRIu64 " entries", journal_remote_server_event_count(&s));
 
         return 0;
 }
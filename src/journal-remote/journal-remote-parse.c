@@ -11,10 +11,16 @@ void source_free(RemoteSource *source) {
         if (!source)
                 return;
 
+        if (source->shard)
+                remote_shard_detach(source->shard, source);
+        free(source->writer_key);
+
         journal_importer_cleanup(&source->importer);
 
-        log_debug("Writer ref count %i", source->writer->n_ref);
-        writer_unref(source->writer);
+        if (source->writer) {
+                log_debug("Writer ref count %i", source->writer->n_ref);
+                writer_unref(source->writer);
+        }
 
         sd_event_source_unref(source->event);
         sd_event_source_unref(source->buffer_event);
@@ -25,6 +31,8 @@ void source_free(RemoteSource *source) {
 /**
  * Initialize zero-filled source with given values. On success, takes
  * ownership of fd, name, and writer, otherwise does not touch them.
+ * The writer may be NULL if the source is going to be attached to a
+ * shard later.
  */
 RemoteSource* source_new(int fd, bool passive_fd, char *name, Writer *writer) {
         RemoteSource *source;
@@ -51,16 +59,56 @@ int process_source(RemoteSource *source, bool compress, bool seal) {
         int r;
 
         assert(source);
-        assert(source->writer);
+        assert(source->writer || source->shard);
 
         r = journal_importer_process_data(&source->importer);
+        if (source->shard && (r == -EAGAIN || journal_importer_eof(&source->importer))) {
+                int k;
+
+                /* Nothing more to parse for now, get the batch going */
+                k = remote_shard_flush(source->shard, source);
+                if (k < 0)
+                        return log_error_errno(k, "Failed to write entries of %s: %m", source->importer.name);
+        }
         if (r <= 0)
                 return r;
 
-        /* We have a full event */
+        /* We have a full event, or a whole frame of them */
         log_trace("Received full event from source@%p fd:%d (%s)",
                   source, source->importer.fd, source->importer.name);
 
+        if (source->shard) {
+                if (source->importer.binary)
+                        r = remote_shard_submit(source->shard, source,
+                                                source->importer.entries,
+                                                source->importer.n_entries);
+                else
+                        r = remote_shard_submit(source->shard, source,
+                                                &(JournalFileEntry) {
+                                                        .ts = &source->importer.ts,
+                                                        .boot_id = &source->importer.boot_id,
+                                                        .iovec = source->importer.iovw.iovec,
+                                                        .n_iovec = source->importer.iovw.count,
+                                                }, 1);
+                if (r < 0)
+                        log_error_errno(r, "Failed to hand over entries of %s: %m", source->importer.name);
+                else
+                        r = 1;
+
+                goto freeing;
+        }
+
+        if (source->importer.binary) {
+                r = writer_write_entries(source->writer,
+                                         source->importer.entries,
+                                         source->importer.n_entries,
+                                         compress, seal);
+                if (r >= 0)
+                        r = 1;
+
+                goto freeing;
+        }
+
         if (source->importer.iovw.count == 0) {
                 log_warning("Entry with no payload, skipping");
                 goto freeing;
@@ -4,6 +4,7 @@
 #include "sd-event.h"
 
 #include "journal-importer.h"
+#include "journal-remote-shard.h"
 #include "journal-remote-write.h"
 
 typedef struct RemoteSource {
@@ -11,6 +12,15 @@ typedef struct RemoteSource {
 
         Writer *writer;
 
+        /* With writer threads, entries are handed over to the shard owning the writer instead */
+        RemoteShard *shard;
+        char *writer_key;
+        RemoteShardBatch *shard_batch;
+        RemoteShardBatch *shard_unref;
+        bool shard_attached;       /* only accessed by the shard thread */
+        size_t n_shard_pending;    /* protected by the shard mutex */
+        int shard_error;           /* ditto */
+
         sd_event_source *event;
         sd_event_source *buffer_event;
 } RemoteSource;
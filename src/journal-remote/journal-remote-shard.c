@@ -0,0 +1,468 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "journal-remote-shard.h"
+#include "journal-remote.h"
+#include "memory-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+
+/* With --writer-threads=, each host's Writer is owned by one of a fixed number of threads, picked by
+ * hashing the host name. The main thread still accepts connections and parses what the sources send, but
+ * hands the entries over to the thread owning the writer, in batches, which appends them. Since a writer
+ * is only ever touched by its own thread, nothing needs to be locked on the append path itself, only the
+ * queues are.
+ *
+ * Each source keeps track of how many of its batches are still in flight, and of the first error that
+ * happened while writing them, so that HTTP uploads are only acknowledged once their entries made it to
+ * disk. */
+
+/* Hand over a batch to the shard once it holds this many entries, or bytes of payload */
+#define BATCH_ENTRIES_MAX 512U
+#define BATCH_DATA_MAX (1024U*1024U)
+
+static RemoteShardBatch* batch_free(RemoteShardBatch *b) {
+        if (!b)
+                return NULL;
+
+        free(b->entries);
+        free(b->meta);
+        free(b->iovec);
+        free(b->data);
+
+        return mfree(b);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(RemoteShardBatch*, batch_free);
+
+static RemoteShardBatch* batch_new(RemoteShardBatchType type, RemoteSource *source) {
+        RemoteShardBatch *b;
+
+        b = new(RemoteShardBatch, 1);
+        if (!b)
+                return NULL;
+
+        *b = (RemoteShardBatch) {
+                .type = type,
+                .source = source,
+        };
+
+        return b;
+}
+
+static int batch_add_entry(RemoteShardBatch *b, const JournalFileEntry *e) {
+        RemoteShardEntryMeta *m;
+        size_t i, size = 0;
+
+        assert(b);
+        assert(e);
+
+        for (i = 0; i < e->n_iovec; i++)
+                size += e->iovec[i].iov_len;
+
+        if (!GREEDY_REALLOC(b->entries, b->entries_allocated, b->n_entries + 1) ||
+            !GREEDY_REALLOC(b->meta, b->meta_allocated, b->n_entries + 1) ||
+            !GREEDY_REALLOC(b->iovec, b->iovec_allocated, b->n_iovec + e->n_iovec) ||
+            !GREEDY_REALLOC(b->data, b->data_allocated, b->data_size + size))
+                return -ENOMEM;
+
+        for (i = 0; i < e->n_iovec; i++) {
+                memcpy_safe(b->data + b->data_size, e->iovec[i].iov_base, e->iovec[i].iov_len);
+                b->iovec[b->n_iovec + i] = IOVEC_MAKE(UINT_TO_PTR(b->data_size), e->iovec[i].iov_len);
+                b->data_size += e->iovec[i].iov_len;
+        }
+
+        m = b->meta + b->n_entries;
+        *m = (RemoteShardEntryMeta) {
+                .ts = e->ts ? *e->ts : DUAL_TIMESTAMP_NULL,
+                .has_boot_id = !!e->boot_id,
+        };
+        if (e->boot_id)
+                m->boot_id = *e->boot_id;
+
+        b->entries[b->n_entries++] = (JournalFileEntry) {
+                .n_iovec = e->n_iovec,
+        };
+        b->n_iovec += e->n_iovec;
+
+        return 0;
+}
+
+static void batch_seal(RemoteShardBatch *b) {
+        size_t i, k = 0;
+
+        assert(b);
+
+        /* Nothing is reallocated anymore, resolve the offsets */
+
+        for (i = 0; i < b->n_iovec; i++)
+                b->iovec[i].iov_base = b->data + PTR_TO_UINT(b->iovec[i].iov_base);
+
+        for (i = 0; i < b->n_entries; i++) {
+                RemoteShardEntryMeta *m = b->meta + i;
+
+                b->entries[i].ts = &m->ts;
+                b->entries[i].boot_id = m->has_boot_id ? &m->boot_id : NULL;
+                b->entries[i].iovec = b->iovec + k;
+                k += b->entries[i].n_iovec;
+        }
+}
+
+static int shard_process_batch(RemoteShard *shard, RemoteShardBatch *b, size_t *ret_n_written) {
+        RemoteSource *source = b->source;
+        Writer *w;
+        int r;
+
+        assert(shard);
+        assert(b);
+        assert(ret_n_written);
+
+        *ret_n_written = 0;
+
+        switch (b->type) {
+
+        case REMOTE_SHARD_BATCH_REF:
+                w = hashmap_get(shard->writers, source->writer_key);
+                if (w)
+                        writer_ref(w);
+                else {
+                        r = journal_remote_open_writer(shard->server, source->writer_key, &w);
+                        if (r < 0)
+                                return r;
+
+                        r = hashmap_ensure_allocated(&shard->writers, &string_hash_ops);
+                        if (r >= 0)
+                                r = hashmap_put(shard->writers, w->hashmap_key, w);
+                        if (r < 0) {
+                                writer_unref(w);
+                                return r;
+                        }
+                }
+
+                source->shard_attached = true;
+                return 0;
+
+        case REMOTE_SHARD_BATCH_UNREF:
+                if (!source->shard_attached)
+                        return 0;
+
+                w = hashmap_get(shard->writers, source->writer_key);
+                assert(w);
+
+                if (w->n_ref == 1)
+                        (void) hashmap_remove(shard->writers, w->hashmap_key);
+                writer_unref(w);
+
+                source->shard_attached = false;
+                return 0;
+
+        case REMOTE_SHARD_BATCH_ENTRIES:
+                if (!source->shard_attached)
+                        return -ENOENT;
+
+                w = hashmap_get(shard->writers, source->writer_key);
+                assert(w);
+
+                r = writer_write_entries(w, b->entries, b->n_entries, shard->server->compress, shard->server->seal);
+                if (r < 0)
+                        return r;
+
+                *ret_n_written = r;
+                return 0;
+
+        default:
+                assert_not_reached("Unknown batch type");
+        }
+}
+
+static void* shard_thread(void *userdata) {
+        RemoteShard *shard = userdata;
+        char name[16];
+
+        xsprintf(name, "remote-shard%u", shard->index);
+        (void) pthread_setname_np(pthread_self(), name);
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        for (;;) {
+                _cleanup_(batch_freep) RemoteShardBatch *b = NULL;
+                size_t n_written;
+                int r;
+
+                while (!shard->quit && !shard->queue)
+                        assert_se(pthread_cond_wait(&shard->work_cond, &shard->mutex) == 0);
+
+                /* Finish what was queued before we are told to quit */
+                b = shard->queue;
+                if (!b)
+                        break;
+
+                LIST_REMOVE(batches, shard->queue, b);
+                if (shard->queue_tail == b)
+                        shard->queue_tail = NULL;
+                shard->queue_depth--;
+
+                assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+                r = shard_process_batch(shard, b, &n_written);
+                if (r < 0 && r != -ENOENT)
+                        log_warning_errno(r, "Failed to process entries from %s: %m", b->source->importer.name);
+
+                assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+                shard->n_batches++;
+                shard->n_entries += n_written;
+
+                /* The source may go away as soon as the counter drops to zero */
+                if (r < 0 && b->source->shard_error == 0)
+                        b->source->shard_error = r;
+                assert(b->source->n_shard_pending > 0);
+                b->source->n_shard_pending--;
+
+                assert_se(pthread_cond_broadcast(&shard->done_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        return NULL;
+}
+
+int remote_shard_new(RemoteServer *s, unsigned index, RemoteShard **ret) {
+        _cleanup_(remote_shard_freep) RemoteShard *shard = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(s->split_mode == JOURNAL_WRITE_SPLIT_HOST);
+        assert(ret);
+
+        shard = new0(RemoteShard, 1);
+        if (!shard)
+                return -ENOMEM;
+
+        shard->server = s;
+        shard->index = index;
+
+        assert_se(pthread_mutex_init(&shard->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&shard->work_cond, NULL) == 0);
+        assert_se(pthread_cond_init(&shard->done_cond, NULL) == 0);
+
+        /* Leave all signals to the main thread */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&shard->thread, NULL, shard_thread, shard);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        shard->thread_started = true;
+        *ret = TAKE_PTR(shard);
+
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+RemoteShard* remote_shard_free(RemoteShard *shard) {
+        if (!shard)
+                return NULL;
+
+        if (shard->thread_started) {
+                assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+                shard->quit = true;
+                assert_se(pthread_cond_broadcast(&shard->work_cond) == 0);
+                assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+                assert_se(pthread_join(shard->thread, NULL) == 0);
+
+                log_debug("Writer thread %u wrote %" PRIu64 " entries in %" PRIu64 " batches, "
+                          "queue depth max %zu, %" PRIu64 " stalls.",
+                          shard->index, shard->n_entries, shard->n_batches,
+                          shard->queue_depth_max, shard->n_stalls);
+        }
+
+        /* All sources are gone by now, and took their references with them */
+        assert(hashmap_isempty(shard->writers));
+        hashmap_free(shard->writers);
+
+        assert_se(pthread_cond_destroy(&shard->done_cond) == 0);
+        assert_se(pthread_cond_destroy(&shard->work_cond) == 0);
+        assert_se(pthread_mutex_destroy(&shard->mutex) == 0);
+
+        return mfree(shard);
+}
+
+static int shard_enqueue(RemoteShard *shard, RemoteShardBatch *b) {
+        RemoteSource *source;
+        int r;
+
+        assert(shard);
+        assert(b);
+
+        source = b->source;
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        /* Don't let a fast source pile up more than the shard can write */
+        if (shard->queue_depth >= REMOTE_SHARD_QUEUE_MAX) {
+                shard->n_stalls++;
+
+                do
+                        assert_se(pthread_cond_wait(&shard->done_cond, &shard->mutex) == 0);
+                while (shard->queue_depth >= REMOTE_SHARD_QUEUE_MAX);
+        }
+
+        /* Stop feeding entries of a source whose writes fail, and let the caller know. Reference changes
+         * are always let through, so that the writer set stays consistent. */
+        r = source->shard_error;
+        if (r < 0 && b->type == REMOTE_SHARD_BATCH_ENTRIES) {
+                assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+                batch_free(b);
+                return r;
+        }
+
+        LIST_INSERT_AFTER(batches, shard->queue, shard->queue_tail, b);
+        shard->queue_tail = b;
+        shard->queue_depth++;
+        shard->queue_depth_max = MAX(shard->queue_depth_max, shard->queue_depth);
+        source->n_shard_pending++;
+
+        assert_se(pthread_cond_signal(&shard->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        return 0;
+}
+
+int remote_shard_attach(RemoteShard *shard, RemoteSource *source) {
+        _cleanup_(batch_freep) RemoteShardBatch *ref = NULL, *unref = NULL;
+
+        assert(shard);
+        assert(source);
+        assert(source->writer_key);
+        assert(!source->shard);
+
+        /* Allocate the batch for dropping the reference right away, so that detaching cannot fail */
+        ref = batch_new(REMOTE_SHARD_BATCH_REF, source);
+        unref = batch_new(REMOTE_SHARD_BATCH_UNREF, source);
+        if (!ref || !unref)
+                return -ENOMEM;
+
+        source->shard = shard;
+        source->shard_unref = TAKE_PTR(unref);
+
+        return shard_enqueue(shard, TAKE_PTR(ref));
+}
+
+int remote_shard_submit(RemoteShard *shard, RemoteSource *source, const JournalFileEntry entries[], size_t n_entries) {
+        size_t i;
+        int r;
+
+        assert(shard);
+        assert(source);
+        assert(entries || n_entries == 0);
+
+        /* Only called from the main thread, which owns the batch that is being filled */
+
+        for (i = 0; i < n_entries; i++) {
+                if (!source->shard_batch) {
+                        source->shard_batch = batch_new(REMOTE_SHARD_BATCH_ENTRIES, source);
+                        if (!source->shard_batch)
+                                return -ENOMEM;
+                }
+
+                r = batch_add_entry(source->shard_batch, entries + i);
+                if (r < 0)
+                        return r;
+
+                if (source->shard_batch->n_entries >= BATCH_ENTRIES_MAX ||
+                    source->shard_batch->data_size >= BATCH_DATA_MAX) {
+                        r = remote_shard_flush(shard, source);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+int remote_shard_flush(RemoteShard *shard, RemoteSource *source) {
+        RemoteShardBatch *b;
+
+        assert(shard);
+        assert(source);
+
+        b = TAKE_PTR(source->shard_batch);
+        if (!b)
+                return 0;
+
+        batch_seal(b);
+
+        return shard_enqueue(shard, b);
+}
+
+int remote_shard_wait(RemoteShard *shard, RemoteSource *source) {
+        int r;
+
+        assert(shard);
+        assert(source);
+
+        r = remote_shard_flush(shard, source);
+        if (r < 0)
+                return r;
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        while (source->n_shard_pending > 0)
+                assert_se(pthread_cond_wait(&shard->done_cond, &shard->mutex) == 0);
+
+        r = source->shard_error;
+
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        return r;
+}
+
+void remote_shard_detach(RemoteShard *shard, RemoteSource *source) {
+        int r;
+
+        assert(shard);
+        assert(source);
+
+        /* Writes out whatever the source sent, and drops its reference to the writer. Returns only once the
+         * shard is done with the source, so that it may be freed. */
+
+        r = remote_shard_flush(shard, source);
+        if (r < 0 && r != source->shard_error)
+                log_warning_errno(r, "Failed to hand over the last entries of %s, ignoring: %m", source->importer.name);
+
+        (void) shard_enqueue(shard, TAKE_PTR(source->shard_unref));
+        (void) remote_shard_wait(shard, source);
+
+        source->shard = NULL;
+}
+
+void remote_shard_get_stats(RemoteShard *shard, size_t *ret_depth, size_t *ret_depth_max, uint64_t *ret_entries, uint64_t *ret_stalls) {
+        assert(shard);
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        if (ret_depth)
+                *ret_depth = shard->queue_depth;
+        if (ret_depth_max)
+                *ret_depth_max = shard->queue_depth_max;
+        if (ret_entries)
+                *ret_entries = shard->n_entries;
+        if (ret_stalls)
+                *ret_stalls = shard->n_stalls;
+
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <pthread.h>
+
+typedef struct RemoteShard RemoteShard;
+typedef struct RemoteShardBatch RemoteShardBatch;
+
+#include "hashmap.h"
+#include "journal-remote-write.h"
+#include "list.h"
+
+struct RemoteSource;
+
+#define REMOTE_SHARDS_MAX 64U
+
+/* Producers wait for the shard to catch up when this many batches are queued */
+#define REMOTE_SHARD_QUEUE_MAX 64U
+
+typedef enum RemoteShardBatchType {
+        REMOTE_SHARD_BATCH_ENTRIES,
+        REMOTE_SHARD_BATCH_REF,     /* a source for the writer was added */
+        REMOTE_SHARD_BATCH_UNREF,   /* ... and removed again */
+} RemoteShardBatchType;
+
+typedef struct RemoteShardEntryMeta {
+        dual_timestamp ts;
+        sd_id128_t boot_id;
+        bool has_boot_id;
+} RemoteShardEntryMeta;
+
+struct RemoteShardBatch {
+        RemoteShardBatchType type;
+        struct RemoteSource *source;
+        LIST_FIELDS(RemoteShardBatch, batches);
+
+        /* Copies of the entries, so that the source may go on parsing */
+        JournalFileEntry *entries;
+        size_t n_entries, entries_allocated;
+        RemoteShardEntryMeta *meta;
+        size_t meta_allocated;
+
+        /* While the batch is being filled, the iovecs hold offsets into the data */
+        struct iovec *iovec;
+        size_t n_iovec, iovec_allocated;
+        uint8_t *data;
+        size_t data_size, data_allocated;
+};
+
+struct RemoteShard {
+        RemoteServer *server;
+        unsigned index;
+
+        pthread_t thread;
+        bool thread_started;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;   /* there's something in the queue, or we shall quit */
+        pthread_cond_t done_cond;   /* a batch was processed */
+
+        /* Protected by the mutex */
+        LIST_HEAD(RemoteShardBatch, queue);
+        RemoteShardBatch *queue_tail;
+        size_t queue_depth;
+        bool quit;
+
+        size_t queue_depth_max;
+        uint64_t n_batches;
+        uint64_t n_entries;
+        uint64_t n_stalls;          /* how often a producer had to wait for room in the queue */
+
+        /* Only accessed by the shard thread. Maps host names to Writer objects. */
+        Hashmap *writers;
+};
+
+int remote_shard_new(RemoteServer *s, unsigned index, RemoteShard **ret);
+RemoteShard* remote_shard_free(RemoteShard *shard);
+DEFINE_TRIVIAL_CLEANUP_FUNC(RemoteShard*, remote_shard_free);
+
+int remote_shard_attach(RemoteShard *shard, struct RemoteSource *source);
+void remote_shard_detach(RemoteShard *shard, struct RemoteSource *source);
+
+int remote_shard_submit(RemoteShard *shard, struct RemoteSource *source, const JournalFileEntry entries[], size_t n_entries);
+int remote_shard_flush(RemoteShard *shard, struct RemoteSource *source);
+int remote_shard_wait(RemoteShard *shard, struct RemoteSource *source);
+
+void remote_shard_get_stats(RemoteShard *shard, size_t *ret_depth, size_t *ret_depth_max, uint64_t *ret_entries, uint64_t *ret_stalls);
@@ -62,6 +62,12 @@ int writer_write(Writer *w,
                  sd_id128_t *boot_id,
                  bool compress,
                  bool seal) {
+        JournalFileEntry entry = {
+                .ts = ts,
+                .boot_id = boot_id,
+                .iovec = iovw->iovec,
+                .n_iovec = iovw->count,
+        };
         int r;
 
         assert(w);
@@ -76,9 +82,7 @@ int writer_write(Writer *w,
                         return r;
         }
 
-        r = journal_file_append_entry(w->journal, ts, boot_id,
-                                      iovw->iovec, iovw->count,
-                                      &w->seqnum, NULL, NULL);
+        r = journal_file_append_entries(w->journal, &entry, 1, &w->seqnum, NULL);
         if (r >= 0) {
                 if (w->server)
                         w->server->event_count += 1;
@@ -94,9 +98,7 @@ int writer_write(Writer *w,
                 log_debug("%s: Successfully rotated journal", w->journal->path);
 
         log_debug("Retrying write.");
-        r = journal_file_append_entry(w->journal, ts, boot_id,
-                                      iovw->iovec, iovw->count,
-                                      &w->seqnum, NULL, NULL);
+        r = journal_file_append_entries(w->journal, &entry, 1, &w->seqnum, NULL);
         if (r < 0)
                 return r;
 
@@ -104,3 +106,62 @@ int writer_write(Writer *w,
                 w->server->event_count += 1;
         return 0;
 }
+
+int writer_write_entries(Writer *w,
+                         const JournalFileEntry entries[],
+                         size_t n_entries,
+                         bool compress,
+                         bool seal) {
+        bool rotated = false;
+        size_t n_written, n_total = 0;
+        int r;
+
+        assert(w);
+        assert(entries || n_entries == 0);
+
+        /* Like writer_write() but for a whole batch, as received in one frame of the binary framing. Invalid
+         * entries are skipped, other errors are retried once after rotating. Returns the number of entries
+         * written. */
+
+        if (n_entries > 0 && journal_file_rotate_suggested(w->journal, 0)) {
+                log_info("%s: Journal header limits reached or header out-of-date, rotating",
+                         w->journal->path);
+                r = do_rotate(&w->journal, compress, seal);
+                if (r < 0)
+                        return r;
+        }
+
+        while (n_entries > 0) {
+                r = journal_file_append_entries(w->journal, entries, n_entries, &w->seqnum, &n_written);
+
+                if (w->server)
+                        w->server->event_count += n_written;
+
+                n_total += n_written;
+                entries += n_written;
+                n_entries -= n_written;
+
+                if (r >= 0)
+                        break;
+
+                if (r == -EBADMSG) {
+                        log_error_errno(r, "Entry is invalid, ignoring.");
+                        entries++;
+                        n_entries--;
+                        continue;
+                }
+
+                if (rotated)
+                        return log_error_errno(r, "Failed to write %zu entries: %m", n_entries);
+
+                log_debug_errno(r, "%s: Write failed, rotating: %m", w->journal->path);
+                r = do_rotate(&w->journal, compress, seal);
+                if (r < 0)
+                        return r;
+
+                log_debug("%s: Successfully rotated journal, retrying write.", w->journal->path);
+                rotated = true;
+        }
+
+        return (int) MIN(n_total, (size_t) INT_MAX);
+}
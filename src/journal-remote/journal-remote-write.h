@@ -31,6 +31,11 @@ int writer_write(Writer *s,
                  sd_id128_t *boot_id,
                  bool compress,
                  bool seal);
+int writer_write_entries(Writer *w,
+                         const JournalFileEntry entries[],
+                         size_t n_entries,
+                         bool compress,
+                         bool seal);
 
 typedef enum JournalWriteSplitMode {
         JOURNAL_WRITE_SPLIT_NONE,
@@ -20,6 +20,7 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -93,6 +94,33 @@ static int init_writer_hashmap(RemoteServer *s) {
         return 0;
 }
 
+int journal_remote_open_writer(RemoteServer *s, const char *host, Writer **ret) {
+        _cleanup_(writer_unrefp) Writer *w = NULL;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        /* Opens the output for the host, without registering the writer in s->writers */
+
+        w = writer_new(NULL);
+        if (!w)
+                return log_oom();
+
+        if (s->split_mode == JOURNAL_WRITE_SPLIT_HOST) {
+                w->hashmap_key = strdup(host);
+                if (!w->hashmap_key)
+                        return log_oom();
+        }
+
+        r = open_output(s, w, host);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
 int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer) {
         _cleanup_(writer_unrefp) Writer *w = NULL;
         const void *key;
@@ -116,20 +144,12 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
         if (w)
                 writer_ref(w);
         else {
-                w = writer_new(s);
-                if (!w)
-                        return log_oom();
-
-                if (s->split_mode == JOURNAL_WRITE_SPLIT_HOST) {
-                        w->hashmap_key = strdup(key);
-                        if (!w->hashmap_key)
-                                return log_oom();
-                }
-
-                r = open_output(s, w, host);
+                r = journal_remote_open_writer(s, host, &w);
                 if (r < 0)
                         return r;
 
+                w->server = s;
+
                 r = hashmap_put(s->writers, w->hashmap_key ?: key, w);
                 if (r < 0)
                         return r;
@@ -160,30 +180,81 @@ static int dispatch_raw_connection_event(sd_event_source *event,
                                          uint32_t revents,
                                          void *userdata);
 
-static int get_source_for_fd(RemoteServer *s,
-                             int fd, char *name, RemoteSource **source) {
+static RemoteShard* pick_shard(RemoteServer *s, const char *host) {
+        static const uint8_t hash_key[16] = {};
+
+        /* Sources of the same host always end up on the same shard, as one writer per host is used */
+        return s->shards[siphash24_string(host, hash_key) % s->n_shards];
+}
+
+int journal_remote_new_source(RemoteServer *s, int fd, bool passive_fd, char *name, RemoteSource **ret) {
+        _cleanup_free_ char *key = NULL;
+        RemoteSource *source;
         Writer *writer;
         int r;
 
         /* This takes ownership of name, but only on success. */
 
+        assert(s);
         assert(fd >= 0);
-        assert(source);
+        assert(name);
+        assert(ret);
 
-        if (!GREEDY_REALLOC0(s->sources, s->sources_size, fd + 1))
-                return log_oom();
+        if (s->n_shards > 0) {
+                key = strdup(name);
+                if (!key)
+                        return log_oom();
+
+                source = source_new(fd, passive_fd, name, NULL);
+                if (!source)
+                        return log_oom();
+
+                source->writer_key = TAKE_PTR(key);
+
+                r = remote_shard_attach(pick_shard(s, name), source);
+                if (r < 0) {
+                        /* Don't close the fd nor free the name, the caller still owns them */
+                        source->importer.fd = -1;
+                        source->importer.name = NULL;
+                        source_free(source);
+                        return log_warning_errno(r, "Failed to attach source %s to writer thread: %m", name);
+                }
+
+                *ret = source;
+                return 0;
+        }
 
         r = journal_remote_get_writer(s, name, &writer);
         if (r < 0)
                 return log_warning_errno(r, "Failed to get writer for source %s: %m",
                                          name);
 
+        source = source_new(fd, passive_fd, name, writer);
+        if (!source) {
+                writer_unref(writer);
+                return log_oom();
+        }
+
+        *ret = source;
+        return 0;
+}
+
+static int get_source_for_fd(RemoteServer *s,
+                             int fd, char *name, RemoteSource **source) {
+        int r;
+
+        /* This takes ownership of name, but only on success. */
+
+        assert(fd >= 0);
+        assert(source);
+
+        if (!GREEDY_REALLOC0(s->sources, s->sources_size, fd + 1))
+                return log_oom();
+
         if (!s->sources[fd]) {
-                s->sources[fd] = source_new(fd, false, name, writer);
-                if (!s->sources[fd]) {
-                        writer_unref(writer);
-                        return log_oom();
-                }
+                r = journal_remote_new_source(s, fd, false, name, &s->sources[fd]);
+                if (r < 0)
+                        return r;
 
                 s->active++;
         }
@@ -335,6 +406,45 @@ int journal_remote_server_init(
         return 0;
 }
 
+int journal_remote_start_shards(RemoteServer *s, unsigned n) {
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(s->split_mode == JOURNAL_WRITE_SPLIT_HOST);
+        assert(n > 0 && n <= REMOTE_SHARDS_MAX);
+        assert(s->n_shards == 0);
+
+        s->shards = new0(RemoteShard*, n);
+        if (!s->shards)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                r = remote_shard_new(s, i, s->shards + s->n_shards);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to start writer thread: %m");
+
+                s->n_shards++;
+        }
+
+        log_debug("Started %u writer threads.", n);
+        return 0;
+}
+
+uint64_t journal_remote_server_event_count(RemoteServer *s) {
+        uint64_t n = s->event_count;
+        unsigned i;
+
+        for (i = 0; i < s->n_shards; i++) {
+                uint64_t k;
+
+                remote_shard_get_stats(s->shards[i], NULL, NULL, &k, NULL);
+                n += k;
+        }
+
+        return n;
+}
+
 #if HAVE_MICROHTTPD
 static void MHDDaemonWrapper_free(MHDDaemonWrapper *d) {
         MHD_stop_daemon(d->daemon);
@@ -356,11 +466,17 @@ void journal_remote_server_destroy(RemoteServer *s) {
                 remove_source(s, i);
         free(s->sources);
 
+        /* Only once all sources are gone, so that the writer threads wrote out what they got */
+        for (i = 0; i < s->n_shards; i++)
+                remote_shard_free(s->shards[i]);
+        free(s->shards);
+
         writer_unref(s->_single_writer);
         hashmap_free(s->writers);
 
         sd_event_source_unref(s->sigterm_event);
         sd_event_source_unref(s->sigint_event);
+        sd_event_source_unref(s->shard_stats_event);
         sd_event_source_unref(s->listen_event);
         sd_event_unref(s->events);
 
@@ -33,6 +33,11 @@ struct RemoteServer {
         Writer *_single_writer;
         uint64_t event_count;
 
+        /* With writer threads, the writers are owned by the shards instead */
+        RemoteShard **shards;
+        unsigned n_shards;
+        sd_event_source *shard_stats_event;
+
 #if HAVE_MICROHTTPD
         Hashmap *daemons;
 #endif
@@ -52,7 +57,12 @@ int journal_remote_server_init(
                 bool compress,
                 bool seal);
 
+int journal_remote_start_shards(RemoteServer *s, unsigned n);
+uint64_t journal_remote_server_event_count(RemoteServer *s);
+
+int journal_remote_open_writer(RemoteServer *s, const char *host, Writer **ret);
 int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer);
+int journal_remote_new_source(RemoteServer *s, int fd, bool passive_fd, char *name, RemoteSource **ret);
 
 int journal_remote_add_source(RemoteServer *s, int fd, char* name, bool own_name);
 int journal_remote_add_raw_socket(RemoteServer *s, int fd);
@@ -251,6 +251,144 @@ static void check_update_watchdog(Uploader *u) {
         }
 }
 
+/* Frames are closed once they have grown to this size, so that compression has something to work with,
+ * while the server gets to write out entries early enough */
+#define UPLOAD_FRAME_SIZE (256U*1024U)
+
+static int encode_entry(Uploader *u) {
+        dual_timestamp ts;
+        sd_id128_t boot_id;
+        const void *data;
+        size_t length;
+        int r;
+
+        r = sd_journal_get_realtime_usec(u->journal, &ts.realtime);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get realtime timestamp: %m");
+
+        r = sd_journal_get_monotonic_usec(u->journal, &ts.monotonic, &boot_id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
+
+        r = journal_binary_encoder_begin_entry(&u->encoder, &ts, boot_id);
+        if (r < 0)
+                return r;
+
+        sd_journal_restart_data(u->journal);
+
+        for (;;) {
+                r = sd_journal_enumerate_data(u->journal, &data, &length);
+                if (r < 0) {
+                        journal_binary_encoder_drop_entry(&u->encoder);
+                        return log_error_errno(r, "Failed to move to next field in entry: %m");
+                }
+                if (r == 0)
+                        break;
+
+                r = journal_binary_encoder_add_field(&u->encoder, data, length);
+                if (r < 0) {
+                        journal_binary_encoder_drop_entry(&u->encoder);
+                        return r;
+                }
+        }
+
+        journal_binary_encoder_end_entry(&u->encoder);
+
+        u->current_cursor = mfree(u->current_cursor);
+
+        r = sd_journal_get_cursor(u->journal, &u->current_cursor);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cursor: %m");
+
+        u->entries_sent++;
+        return 0;
+}
+
+static int next_frame(Uploader *u) {
+        size_t n_entries;
+        int r;
+
+        /* Packs entries into a frame until it is big enough, or we run out of entries. Returns > 0 if
+         * there is a frame to send, 0 if there are no more entries. */
+
+        for (;;) {
+                if (u->entry_state == ENTRY_DONE) {
+                        if (journal_binary_encoder_pending(&u->encoder) >= UPLOAD_FRAME_SIZE)
+                                break;
+
+                        r = sd_journal_next(u->journal);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to move to next entry in journal: %m");
+                        if (r == 0)
+                                break;
+
+                        u->entry_state = ENTRY_CURSOR;
+                }
+
+                r = encode_entry(u);
+                if (r == -E2BIG) {
+                        /* Send what we have, and start the next frame with this entry */
+                        if (journal_binary_encoder_pending(&u->encoder) > 0)
+                                break;
+
+                        log_warning("Entry does not fit into a frame, skipping.");
+                } else if (r < 0)
+                        return r;
+
+                u->entry_state = ENTRY_DONE;
+        }
+
+        n_entries = u->encoder.n_entries;
+
+        r = journal_binary_encoder_finish_frame(&u->encoder, HAVE_ZSTD, (const void**) &u->frame, &u->frame_size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to finish frame: %m");
+
+        u->frame_pos = 0;
+
+        if (r > 0)
+                log_debug("Frame of %zu entries, %zu bytes, has been queued, up to %s.",
+                          n_entries, u->frame_size, u->current_cursor);
+
+        return r;
+}
+
+static size_t journal_input_callback_binary(void *buf, size_t size, size_t nmemb, void *userp) {
+        Uploader *u = userp;
+        size_t filled = 0, n;
+        int r;
+
+        while (filled < size * nmemb) {
+                if (u->frame_pos >= u->frame_size) {
+                        if (!u->journal)
+                                break;
+
+                        r = next_frame(u);
+                        if (r < 0)
+                                return CURL_READFUNC_ABORT;
+                        if (r == 0) {
+                                if (u->input_event)
+                                        log_debug("No more entries, waiting for journal.");
+                                else {
+                                        log_info("No more entries, closing journal.");
+                                        close_journal_input(u);
+                                }
+
+                                u->uploading = false;
+
+                                break;
+                        }
+                }
+
+                n = MIN(u->frame_size - u->frame_pos, size * nmemb - filled);
+                memcpy((uint8_t*) buf + filled, u->frame + u->frame_pos, n);
+                u->frame_pos += n;
+                filled += n;
+        }
+
+        return filled;
+}
+
 static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
         Uploader *u = userp;
         int r;
@@ -263,6 +401,9 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
 
         check_update_watchdog(u);
 
+        if (u->binary)
+                return journal_input_callback_binary(buf, size, nmemb, u);
+
         j = u->journal;
 
         while (j && filled < size * nmemb) {
@@ -335,6 +476,33 @@ static int process_journal_input(Uploader *u, int skip) {
         return start_upload(u, journal_input_callback, u);
 }
 
+int restart_journal_input(Uploader *u, const char *cursor, bool after_cursor) {
+        int r;
+
+        assert(u);
+        assert(u->journal);
+
+        /* Throw away whatever was queued for the last upload, and start over from the given position */
+
+        u->frame = NULL;
+        u->frame_pos = u->frame_size = 0;
+        u->uploading = false;
+
+        if (cursor) {
+                r = sd_journal_seek_cursor(u->journal, cursor);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to seek to cursor %s: %m", cursor);
+        } else {
+                r = sd_journal_seek_head(u->journal);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to seek to head of journal: %m");
+
+                after_cursor = true;
+        }
+
+        return process_journal_input(u, !!after_cursor);
+}
+
 int check_journal_input(Uploader *u) {
         if (u->input_event) {
                 int r;
@@ -29,6 +29,7 @@
 #include "rlimit-util.h"
 #include "sigbus.h"
 #include "signal-util.h"
+#include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tmpfile-util.h"
@@ -53,6 +54,26 @@ static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
 
+typedef enum UploadFormat {
+        UPLOAD_FORMAT_AUTO,
+        UPLOAD_FORMAT_EXPORT,
+        UPLOAD_FORMAT_BINARY,
+        _UPLOAD_FORMAT_MAX,
+        _UPLOAD_FORMAT_INVALID = -1,
+} UploadFormat;
+
+static UploadFormat arg_format = UPLOAD_FORMAT_AUTO;
+
+static const char* const upload_format_table[_UPLOAD_FORMAT_MAX] = {
+        [UPLOAD_FORMAT_AUTO] = "auto",
+        [UPLOAD_FORMAT_EXPORT] = "export",
+        [UPLOAD_FORMAT_BINARY] = "binary",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(upload_format, UploadFormat);
+static DEFINE_CONFIG_PARSE_ENUM(config_parse_upload_format, upload_format, UploadFormat,
+                                "Failed to parse upload format setting");
+
 static void close_fd_input(Uploader *u);
 
 #define SERVER_ANSWER_KEEP 2048
@@ -181,7 +202,8 @@ int start_upload(Uploader *u,
         if (!u->header) {
                 struct curl_slist *h;
 
-                h = curl_slist_append(NULL, "Content-Type: application/vnd.fdo.journal");
+                h = curl_slist_append(NULL, u->binary ? "Content-Type: " JOURNAL_BINARY_CONTENT_TYPE
+                                                      : "Content-Type: application/vnd.fdo.journal");
                 if (!h)
                         return log_oom();
 
@@ -229,10 +251,6 @@ int start_upload(Uploader *u,
                 easy_setopt(curl, CURLOPT_READDATA, data,
                             LOG_ERR, return -EXFULL);
 
-                /* use our special own mime type and chunked transfer */
-                easy_setopt(curl, CURLOPT_HTTPHEADER, u->header,
-                            LOG_ERR, return -EXFULL);
-
                 if (DEBUG_LOGGING)
                         /* enable verbose for easier tracing */
                         easy_setopt(curl, CURLOPT_VERBOSE, 1L, LOG_WARNING, );
@@ -268,6 +286,14 @@ int start_upload(Uploader *u,
                 u->answer = 0;
         }
 
+        /* use our special own mime type and chunked transfer, the header list is recreated when falling
+         * back to the export format */
+        code = curl_easy_setopt(u->easy, CURLOPT_HTTPHEADER, u->header);
+        if (code)
+                return log_error_errno(SYNTHETIC_ERRNO(EXFULL),
+                                       "curl_easy_setopt CURLOPT_HTTPHEADER failed: %s",
+                                       curl_easy_strerror(code));
+
         /* upload to this place */
         code = curl_easy_setopt(u->easy, CURLOPT_URL, u->url);
         if (code)
@@ -463,6 +489,8 @@ static void destroy_uploader(Uploader *u) {
         free(u->last_cursor);
         free(u->current_cursor);
 
+        journal_binary_encoder_done(&u->encoder);
+
         free(u->url);
 
         u->input_event = sd_event_source_unref(u->input_event);
@@ -475,6 +503,43 @@ static void destroy_uploader(Uploader *u) {
         sd_event_unref(u->events);
 }
 
+static int perform_upload(Uploader *u);
+
+static int fallback_to_export(Uploader *u) {
+        const char *cursor;
+        bool after_cursor;
+        int r;
+
+        assert(u);
+        assert(u->binary);
+
+        if (!u->journal)
+                return log_error_errno(SYNTHETIC_ERRNO(EPROTONOSUPPORT),
+                                       "%s does not accept the binary format, and the journal was closed already. "
+                                       "Use --format=export.", u->url);
+
+        log_notice("%s does not accept the binary format, falling back to the export format.", u->url);
+
+        u->binary = false;
+        curl_slist_free_all(u->header);
+        u->header = NULL;
+
+        /* Start over with whatever the server did not acknowledge */
+        if (u->uploaded || !arg_cursor) {
+                cursor = u->last_cursor;
+                after_cursor = true;
+        } else {
+                cursor = arg_cursor;
+                after_cursor = arg_after_cursor;
+        }
+
+        r = restart_journal_input(u, cursor, after_cursor);
+        if (r < 0)
+                return r;
+
+        return u->uploading ? perform_upload(u) : 0;
+}
+
 static int perform_upload(Uploader *u) {
         CURLcode code;
         long status;
@@ -499,7 +564,9 @@ static int perform_upload(Uploader *u) {
                                        "Failed to retrieve response code: %s",
                                        curl_easy_strerror(code));
 
-        if (status >= 300)
+        if (status == 415 && u->binary && arg_format == UPLOAD_FORMAT_AUTO)
+                return fallback_to_export(u);
+        else if (status >= 300)
                 return log_error_errno(SYNTHETIC_ERRNO(EIO),
                                        "Upload to %s failed with code %ld: %s",
                                        u->url, status, strna(u->answer));
@@ -512,6 +579,7 @@ static int perform_upload(Uploader *u) {
                           status, strna(u->answer));
 
         free_and_replace(u->last_cursor, u->current_cursor);
+        u->uploaded = true;
 
         return update_cursor_state(u);
 }
@@ -562,6 +630,7 @@ static int parse_config(void) {
                 { "Upload",  "ServerKeyFile",          config_parse_path_or_ignore, 0, &arg_key    },
                 { "Upload",  "ServerCertificateFile",  config_parse_path_or_ignore, 0, &arg_cert   },
                 { "Upload",  "TrustedCertificateFile", config_parse_path_or_ignore, 0, &arg_trust  },
+                { "Upload",  "Format",                 config_parse_upload_format,  0, &arg_format },
                 {}
         };
 
@@ -606,6 +675,8 @@ static int help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --format=FORMAT        Upload journal entries in the export or binary format,\n"
+               "                            or pick automatically (default: auto)\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
                , link
@@ -627,6 +698,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_FORMAT,
         };
 
         static const struct option options[] = {
@@ -646,6 +718,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "format",       required_argument, NULL, ARG_FORMAT         },
                 {}
         };
 
@@ -764,6 +837,13 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_FORMAT:
+                        arg_format = upload_format_from_string(optarg);
+                        if (arg_format < 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                       "Failed to parse --format= parameter: %s", optarg);
+                        break;
+
                 case '?':
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                "Unknown option %s.",
@@ -855,6 +935,10 @@ static int run(int argc, char **argv) {
                 r = open_journal(&j);
                 if (r < 0)
                         return r;
+
+                /* Input files are passed through as they are, only our own entries may be reframed */
+                u.binary = arg_format != UPLOAD_FORMAT_EXPORT;
+
                 r = open_journal_for_upload(&u, j,
                                             arg_cursor ?: u.last_cursor,
                                             arg_cursor ? arg_after_cursor : true,
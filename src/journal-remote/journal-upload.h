@@ -5,6 +5,7 @@
 #include "sd-event.h"
 #include "sd-journal.h"
 
+#include "journal-importer.h"
 #include "time-util.h"
 
 typedef enum {
@@ -45,11 +46,18 @@ typedef struct Uploader {
         const void *field_data;
         size_t field_pos, field_length;
 
+        /* Set when entries are sent in the binary framing instead of the export format */
+        bool binary;
+        JournalBinaryEncoder encoder;
+        const uint8_t *frame;
+        size_t frame_pos, frame_size;
+
         /* general metrics */
         const char *state_file;
 
         size_t entries_sent;
         char *last_cursor, *current_cursor;
+        bool uploaded;
         usec_t watchdog_timestamp;
         usec_t watchdog_usec;
 } Uploader;
@@ -68,5 +76,6 @@ int open_journal_for_upload(Uploader *u,
                             const char *cursor,
                             bool after_cursor,
                             bool follow);
+int restart_journal_input(Uploader *u, const char *cursor, bool after_cursor);
 void close_journal_input(Uploader *u);
 int check_journal_input(Uploader *u);
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -23,6 +24,7 @@
 #include "path-util.h"
 #include "siphash24.h"
 #include "sort-util.h"
+#include "time-util.h"
 #include "sparse-endian.h"
 #include "strbuf.h"
 #include "string-util.h"
@@ -550,45 +552,60 @@ static int open_mmap(const char *database, int *_fd, struct stat *_st, void **_p
         return 0;
 }
 
+#define LANGUAGE_MAX sizeof_field(CatalogItem, language)
+
+static const char *catalog_item_text(const void *p, const CatalogItem *i) {
+        const CatalogHeader *h = p;
+
+        return (const char*) p +
+                le64toh(h->header_size) +
+                le64toh(h->n_items) * le64toh(h->catalog_item_size) +
+                le64toh(i->offset);
+}
+
+static void catalog_languages(const char *loc, char full[static LANGUAGE_MAX], char short_[static LANGUAGE_MAX]) {
+        size_t len;
+        char *e;
+
+        /* Determines the languages to look for, in order of preference, for the specified LC_MESSAGES
+         * value: the full one, then the one without the territory. The catalog entry without any language
+         * is used if neither is found. Empty strings mean there's no such language. */
+
+        full[0] = short_[0] = 0;
+
+        if (isempty(loc) || STR_IN_SET(loc, "C", "POSIX"))
+                return;
+
+        len = strcspn(loc, ".@");
+        if (len > LANGUAGE_MAX - 1) {
+                log_debug("LC_MESSAGES value too long, ignoring: \"%.*s\"", (int) len, loc);
+                return;
+        }
+
+        strncpy(full, loc, len);
+        full[len] = '\0';
+
+        e = strchr(full, '_');
+        if (e) {
+                memcpy(short_, full, e - full);
+                short_[e - full] = 0;
+        }
+}
+
 static const char *find_id(void *p, sd_id128_t id) {
         CatalogItem *f = NULL, key = { .id = id };
         const CatalogHeader *h = p;
-        const char *loc;
+        char full[LANGUAGE_MAX], short_[LANGUAGE_MAX];
+        const char *languages[] = { full, short_, "" };
+        size_t i;
 
-        loc = setlocale(LC_MESSAGES, NULL);
-        if (!isempty(loc) && !STR_IN_SET(loc, "C", "POSIX")) {
-                size_t len;
-
-                len = strcspn(loc, ".@");
-                if (len > sizeof(key.language) - 1)
-                        log_debug("LC_MESSAGES value too long, ignoring: \"%.*s\"", (int) len, loc);
-                else {
-                        strncpy(key.language, loc, len);
-                        key.language[len] = '\0';
-
-                        f = bsearch(&key,
-                                    (const uint8_t*) p + le64toh(h->header_size),
-                                    le64toh(h->n_items),
-                                    le64toh(h->catalog_item_size),
-                                    (comparison_fn_t) catalog_compare_func);
-                        if (!f) {
-                                char *e;
-
-                                e = strchr(key.language, '_');
-                                if (e) {
-                                        *e = 0;
-                                        f = bsearch(&key,
-                                                    (const uint8_t*) p + le64toh(h->header_size),
-                                                    le64toh(h->n_items),
-                                                    le64toh(h->catalog_item_size),
-                                                    (comparison_fn_t) catalog_compare_func);
-                                }
-                        }
-                }
-        }
+        catalog_languages(setlocale(LC_MESSAGES, NULL), full, short_);
 
-        if (!f) {
-                zero(key.language);
+        for (i = 0; i < ELEMENTSOF(languages) && !f; i++) {
+                if (i + 1 < ELEMENTSOF(languages) && isempty(languages[i]))
+                        continue;
+
+                strcpy(key.language, languages[i]);
                 f = bsearch(&key,
                             (const uint8_t*) p + le64toh(h->header_size),
                             le64toh(h->n_items),
@@ -599,46 +616,266 @@ static const char *find_id(void *p, sd_id128_t id) {
         if (!f)
                 return NULL;
 
-        return (const char*) p +
-                le64toh(h->header_size) +
-                le64toh(h->n_items) * le64toh(h->catalog_item_size) +
-                le64toh(f->offset);
+        return catalog_item_text(p, f);
 }
 
-int catalog_get(const char* database, sd_id128_t id, char **_text) {
-        _cleanup_close_ int fd = -1;
-        void *p = NULL;
-        struct stat st = {};
-        char *text = NULL;
+/* journalctl -x looks up the catalog entry of every message with a MESSAGE_ID, hence keep the database
+ * mapped between calls, as long as it isn't replaced. For the locale in use an index is built that maps
+ * each id to the text in the best matching language, so that lookups are a single binary search, and a
+ * few recent lookups, including misses, are remembered on top of that. As sd-journal objects may be used
+ * from different threads, each thread has its own cache. */
+
+#define CATALOG_HOT_SLOTS 64U
+
+typedef struct CatalogText {
+        sd_id128_t id;
+        const char *text;
+} CatalogText;
+
+typedef struct CatalogHotSlot {
+        sd_id128_t id;
+        const char *text;        /* NULL if there's no entry for the id */
+        bool set;
+} CatalogHotSlot;
+
+typedef struct CatalogCache {
+        char *database;
+        struct stat st;
+        void *p;
+
+        char *locale;            /* LC_MESSAGES the index was built for */
+        CatalogText *index;
+        size_t n_index;
+
+        CatalogHotSlot hot[CATALOG_HOT_SLOTS];
+
+        bool registered;         /* whether it gets released when the thread exits */
+} CatalogCache;
+
+static thread_local CatalogCache catalog_cache = {};
+static pthread_key_t catalog_cache_key;
+static pthread_once_t catalog_cache_key_once = PTHREAD_ONCE_INIT;
+
+static int catalog_text_compare(const CatalogText *a, const CatalogText *b) {
+        return memcmp(&a->id, &b->id, sizeof(a->id));
+}
+
+static void catalog_cache_clear_index(CatalogCache *c) {
+        assert(c);
+
+        c->locale = mfree(c->locale);
+        c->index = mfree(c->index);
+        c->n_index = 0;
+        zero(c->hot);
+}
+
+static void catalog_cache_clear(CatalogCache *c) {
+        assert(c);
+
+        catalog_cache_clear_index(c);
+
+        if (c->p)
+                munmap(c->p, c->st.st_size);
+        c->p = NULL;
+        c->database = mfree(c->database);
+        zero(c->st);
+}
+
+void catalog_release_cache(void) {
+        catalog_cache_clear(&catalog_cache);
+}
+
+static void catalog_cache_key_destroy(void *p) {
+        CatalogCache *c = p;
+
+        /* The thread is exiting, unmap the database and drop the index it had cached */
+
+        catalog_cache_clear(c);
+
+        /* In case the cache is used again by destructors that run after us */
+        c->registered = false;
+}
+
+static void catalog_cache_key_create(void) {
+        assert_se(pthread_key_create(&catalog_cache_key, catalog_cache_key_destroy) == 0);
+}
+
+static void catalog_cache_register(CatalogCache *c) {
+        assert(c);
+
+        assert_se(pthread_once(&catalog_cache_key_once, catalog_cache_key_create) == 0);
+
+        if (pthread_setspecific(catalog_cache_key, c) != 0)
+                return; /* Try again next time */
+
+        c->registered = true;
+}
+
+static int catalog_cache_build_index(CatalogCache *c, const char *loc) {
+        char full[LANGUAGE_MAX], short_[LANGUAGE_MAX];
+        const CatalogHeader *h;
+        const uint8_t *items;
+        uint64_t n_items, item_size, k, start;
+        _cleanup_free_ CatalogText *index = NULL;
+        _cleanup_free_ char *l = NULL;
+        size_t n_index = 0;
+
+        assert(c);
+        assert(c->p);
+
+        l = strdup(strempty(loc));
+        if (!l)
+                return -ENOMEM;
+
+        catalog_languages(loc, full, short_);
+
+        h = c->p;
+        items = (const uint8_t*) c->p + le64toh(h->header_size);
+        n_items = le64toh(h->n_items);
+        item_size = le64toh(h->catalog_item_size);
+
+        index = new(CatalogText, n_items);
+        if (!index)
+                return -ENOMEM;
+
+        /* The items are sorted by id, and then by language. Pick one from each run of the same id. */
+        for (start = 0; start < n_items; start = k) {
+                const CatalogItem *first = (const CatalogItem*) (items + start * item_size), *best = NULL;
+                unsigned best_rank = 0;
+
+                for (k = start; k < n_items; k++) {
+                        const CatalogItem *i = (const CatalogItem*) (items + k * item_size);
+                        unsigned rank;
+
+                        if (!sd_id128_equal(i->id, first->id))
+                                break;
+
+                        if (!isempty(full) && strneq(i->language, full, sizeof(i->language)))
+                                rank = 3;
+                        else if (!isempty(short_) && strneq(i->language, short_, sizeof(i->language)))
+                                rank = 2;
+                        else if (i->language[0] == 0)
+                                rank = 1;
+                        else
+                                rank = 0;
+
+                        if (rank > best_rank) {
+                                best = i;
+                                best_rank = rank;
+                        }
+                }
+
+                if (best)
+                        index[n_index++] = (CatalogText) {
+                                .id = best->id,
+                                .text = catalog_item_text(c->p, best),
+                        };
+        }
+
+        free_and_replace(c->locale, l);
+        free_and_replace(c->index, index);
+        c->n_index = n_index;
+        zero(c->hot);
+
+        return 0;
+}
+
+static int catalog_cache_get(const char *database, CatalogCache **ret) {
+        CatalogCache *c = &catalog_cache;
+        const char *loc;
+        struct stat st;
+        bool valid;
         int r;
+
+        assert(database);
+        assert(ret);
+
+        /* Returns the cache for the database, mapped and indexed for the current locale */
+
+        valid = c->p &&
+                streq(c->database, database) &&
+                stat(database, &st) >= 0 &&
+                st.st_dev == c->st.st_dev &&
+                st.st_ino == c->st.st_ino &&
+                st.st_size == c->st.st_size &&
+                timespec_load_nsec(&st.st_mtim) == timespec_load_nsec(&c->st.st_mtim);
+        if (!valid) {
+                _cleanup_close_ int fd = -1;
+                void *p;
+
+                catalog_cache_clear(c);
+
+                r = open_mmap(database, &fd, &st, &p);
+                if (r < 0)
+                        return r;
+
+                c->database = strdup(database);
+                if (!c->database) {
+                        munmap(p, st.st_size);
+                        return -ENOMEM;
+                }
+
+                c->p = p;
+                c->st = st;
+
+                if (!c->registered)
+                        catalog_cache_register(c);
+        }
+
+        loc = setlocale(LC_MESSAGES, NULL);
+        if (!c->index || !streq_ptr(c->locale, strempty(loc))) {
+                r = catalog_cache_build_index(c, loc);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = c;
+        return 0;
+}
+
+static const char *catalog_cache_lookup(CatalogCache *c, sd_id128_t id) {
+        CatalogText key = { .id = id }, *t;
+        CatalogHotSlot *slot;
+
+        assert(c);
+
+        slot = c->hot + (id.qwords[0] ^ id.qwords[1]) % CATALOG_HOT_SLOTS;
+        if (slot->set && sd_id128_equal(slot->id, id))
+                return slot->text;
+
+        t = typesafe_bsearch(&key, c->index, c->n_index, catalog_text_compare);
+
+        *slot = (CatalogHotSlot) {
+                .id = id,
+                .text = t ? t->text : NULL,
+                .set = true,
+        };
+
+        return slot->text;
+}
+
+int catalog_get(const char* database, sd_id128_t id, char **_text) {
+        CatalogCache *c;
+        char *text;
         const char *s;
+        int r;
 
         assert(_text);
 
-        r = open_mmap(database, &fd, &st, &p);
+        r = catalog_cache_get(database, &c);
         if (r < 0)
                 return r;
 
-        s = find_id(p, id);
-        if (!s) {
-                r = -ENOENT;
-                goto finish;
-        }
+        s = catalog_cache_lookup(c, id);
+        if (!s)
+                return -ENOENT;
 
         text = strdup(s);
-        if (!text) {
-                r = -ENOMEM;
-                goto finish;
-        }
+        if (!text)
+                return -ENOMEM;
 
         *_text = text;
-        r = 0;
-
-finish:
-        if (p)
-                munmap(p, st.st_size);
-
-        return r;
+        return 0;
 }
 
 static char *find_header(const char *s, const char *header) {
@@ -15,5 +15,6 @@ int catalog_get(const char* database, sd_id128_t id, char **data);
 int catalog_list(FILE *f, const char* database, bool oneline);
 int catalog_list_items(FILE *f, const char* database, bool oneline, char **items);
 int catalog_file_lang(const char *filename, char **lang);
+void catalog_release_cache(void);
 extern const char * const catalog_file_dirs[];
 extern const struct hash_ops catalog_hash_ops;
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -17,6 +18,7 @@
 #endif
 
 #if HAVE_ZSTD
+#include <zdict.h>
 #include <zstd.h>
 #include <zstd_errors.h>
 #endif
@@ -42,6 +44,17 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_decompressionContext_t, LZ4F_freeDecompressionC
 DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_CCtx *, ZSTD_freeCCtx);
 DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_DCtx *, ZSTD_freeDCtx);
 
+struct ZstdDictionary {
+        void *buffer;
+        size_t size;
+        unsigned id;
+
+        ZSTD_CDict *cdict;
+        ZSTD_CCtx *cctx;
+        ZSTD_DDict *ddict;
+        ZSTD_DCtx *dctx;
+};
+
 static int zstd_ret_to_errno(size_t ret) {
         switch (ZSTD_getErrorCode(ret)) {
         case ZSTD_error_dstSize_tooSmall:
@@ -52,6 +65,73 @@ static int zstd_ret_to_errno(size_t ret) {
                 return -EBADMSG;
         }
 }
+
+static int zstd_dctx_acquire(ZstdDictionary *d, ZSTD_DCtx **ret_owned, ZSTD_DCtx **ret) {
+        ZSTD_DCtx *dctx;
+
+        assert(ret_owned);
+        assert(ret);
+
+        /* Setting up a decompression context is expensive compared to decompressing the small objects that
+         * are compressed against a dictionary, hence keep one around next to the dictionary and reuse it.
+         * Without a dictionary one is set up for the occasion, which the caller has to free. */
+
+        if (!d) {
+                dctx = ZSTD_createDCtx();
+                if (!dctx)
+                        return -ENOMEM;
+
+                *ret_owned = *ret = dctx;
+                return 0;
+        }
+
+        if (d->dctx) {
+                size_t k;
+
+                /* Drops the dictionary referenced last time, too */
+                k = ZSTD_DCtx_reset(d->dctx, ZSTD_reset_session_and_parameters);
+                if (ZSTD_isError(k))
+                        return zstd_ret_to_errno(k);
+        } else {
+                d->dctx = ZSTD_createDCtx();
+                if (!d->dctx)
+                        return -ENOMEM;
+        }
+
+        *ret_owned = NULL;
+        *ret = d->dctx;
+        return 0;
+}
+
+static int zstd_dctx_ref_dictionary(ZSTD_DCtx *dctx, ZstdDictionary *d, const void *src, size_t src_size) {
+        unsigned id;
+        size_t k;
+
+        assert(dctx);
+
+        /* Frames compressed against a dictionary carry its ID, which is the only way to tell whether
+         * we need one at all. */
+        id = ZSTD_getDictID_fromFrame(src, src_size);
+        if (id == 0)
+                return 0;
+
+        if (!d || d->id != id) {
+                log_debug("ZSTD frame requires dictionary %u, which is not available.", id);
+                return -EBADMSG;
+        }
+
+        if (!d->ddict) {
+                d->ddict = ZSTD_createDDict(d->buffer, d->size);
+                if (!d->ddict)
+                        return -ENOMEM;
+        }
+
+        k = ZSTD_DCtx_refDDict(dctx, d->ddict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        return 0;
+}
 #endif
 
 #define ALIGN_8(l) ALIGN_TO(l, sizeof(size_t))
@@ -66,6 +146,90 @@ static const char* const object_compressed_table[_OBJECT_COMPRESSED_MAX] = {
 
 DEFINE_STRING_TABLE_LOOKUP(object_compressed, int);
 
+int zstd_dictionary_train(
+                const void *samples, const size_t *sample_sizes, size_t n_samples,
+                size_t capacity,
+                void **ret, size_t *ret_size) {
+#if HAVE_ZSTD
+        _cleanup_free_ void *buffer = NULL;
+        size_t k;
+
+        assert(samples);
+        assert(sample_sizes);
+        assert(capacity > 0);
+        assert(ret);
+        assert(ret_size);
+
+        if (n_samples > UINT_MAX)
+                return -E2BIG;
+
+        buffer = malloc(capacity);
+        if (!buffer)
+                return -ENOMEM;
+
+        k = ZDICT_trainFromBuffer(buffer, capacity, samples, sample_sizes, (unsigned) n_samples);
+        if (ZDICT_isError(k)) {
+                /* Most likely the samples were too few or too uniform to learn anything from */
+                log_debug("ZSTD dictionary training failed: %s", ZDICT_getErrorName(k));
+                return -ENODATA;
+        }
+
+        *ret = TAKE_PTR(buffer);
+        *ret_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int zstd_dictionary_new(const void *buffer, size_t size, ZstdDictionary **ret) {
+#if HAVE_ZSTD
+        _cleanup_(zstd_dictionary_freep) ZstdDictionary *d = NULL;
+        unsigned id;
+
+        assert(buffer);
+        assert(ret);
+
+        /* Raw content dictionaries have no ID, and frames compressed against them can't be told apart
+         * from frames that need no dictionary at all, hence only accept proper, trained ones. */
+        id = ZSTD_getDictID_fromDict(buffer, size);
+        if (id == 0)
+                return -EBADMSG;
+
+        d = new(ZstdDictionary, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (ZstdDictionary) {
+                .buffer = memdup(buffer, size),
+                .size = size,
+                .id = id,
+        };
+        if (!d->buffer)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+ZstdDictionary *zstd_dictionary_free(ZstdDictionary *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(d->cctx);
+        ZSTD_freeCDict(d->cdict);
+        ZSTD_freeDDict(d->ddict);
+        ZSTD_freeDCtx(d->dctx);
+        free(d->buffer);
+#endif
+
+        return mfree(d);
+}
+
 int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size) {
 #if HAVE_XZ
@@ -157,6 +321,43 @@ int compress_blob_zstd(
 #endif
 }
 
+int compress_blob_zstd_dict(
+                ZstdDictionary *d,
+                const void *src, uint64_t src_size,
+                void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(d);
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        if (!d->cdict) {
+                d->cdict = ZSTD_createCDict(d->buffer, d->size, 0);
+                if (!d->cdict)
+                        return -ENOMEM;
+        }
+
+        if (!d->cctx) {
+                d->cctx = ZSTD_createCCtx();
+                if (!d->cctx)
+                        return -ENOMEM;
+        }
+
+        k = ZSTD_compress_usingCDict(d->cctx, dst, dst_alloc_size, src, src_size, d->cdict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
 
@@ -261,8 +462,17 @@ int decompress_blob_zstd(
                 const void *src, uint64_t src_size,
                 void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max) {
 
+        return decompress_blob_zstd_dict(NULL, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
+
+int decompress_blob_zstd_dict(
+                ZstdDictionary *d,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max) {
+
 #if HAVE_ZSTD
         uint64_t size;
+        int r;
 
         assert(src);
         assert(src_size > 0);
@@ -283,9 +493,16 @@ int decompress_blob_zstd(
         if (!(greedy_realloc(dst, dst_alloc_size, MAX(ZSTD_DStreamOutSize(), size), 1)))
                 return -ENOMEM;
 
-        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = ZSTD_createDCtx();
-        if (!dctx)
-                return -ENOMEM;
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *owned = NULL;
+        ZSTD_DCtx *dctx;
+
+        r = zstd_dctx_acquire(d, &owned, &dctx);
+        if (r < 0)
+                return r;
+
+        r = zstd_dctx_ref_dictionary(dctx, d, src, src_size);
+        if (r < 0)
+                return r;
 
         ZSTD_inBuffer input = {
                 .src = src,
@@ -310,8 +527,9 @@ int decompress_blob_zstd(
 #endif
 }
 
-int decompress_blob(
+int decompress_blob_dict(
                 int compression,
+                ZstdDictionary *d,
                 const void *src, uint64_t src_size,
                 void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
 
@@ -324,7 +542,8 @@ int decompress_blob(
                                 src, src_size,
                                 dst, dst_alloc_size, dst_size, dst_max);
         else if (compression == OBJECT_COMPRESSED_ZSTD)
-                return decompress_blob_zstd(
+                return decompress_blob_zstd_dict(
+                                d,
                                 src, src_size,
                                 dst, dst_alloc_size, dst_size, dst_max);
         else
@@ -457,7 +676,19 @@ int decompress_startswith_zstd(
                 void **buffer, size_t *buffer_size,
                 const void *prefix, size_t prefix_len,
                 uint8_t extra) {
+
+        return decompress_startswith_zstd_dict(NULL, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
+
+int decompress_startswith_zstd_dict(
+                ZstdDictionary *d,
+                const void *src, uint64_t src_size,
+                void **buffer, size_t *buffer_size,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra) {
 #if HAVE_ZSTD
+        int r;
+
         assert(src);
         assert(src_size > 0);
         assert(buffer);
@@ -472,9 +703,16 @@ int decompress_startswith_zstd(
         if (size < prefix_len + 1)
                 return 0; /* Decompressed text too short to match the prefix and extra */
 
-        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = ZSTD_createDCtx();
-        if (!dctx)
-                return -ENOMEM;
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *owned = NULL;
+        ZSTD_DCtx *dctx;
+
+        r = zstd_dctx_acquire(d, &owned, &dctx);
+        if (r < 0)
+                return r;
+
+        r = zstd_dctx_ref_dictionary(dctx, d, src, src_size);
+        if (r < 0)
+                return r;
 
         if (!(greedy_realloc(buffer, buffer_size, MAX(ZSTD_DStreamOutSize(), prefix_len + 1), 1)))
                 return -ENOMEM;
@@ -503,8 +741,9 @@ int decompress_startswith_zstd(
 #endif
 }
 
-int decompress_startswith(
+int decompress_startswith_dict(
                 int compression,
+                ZstdDictionary *d,
                 const void *src, uint64_t src_size,
                 void **buffer, size_t *buffer_size,
                 const void *prefix, size_t prefix_len,
@@ -524,7 +763,8 @@ int decompress_startswith(
                                 prefix, prefix_len,
                                 extra);
         else if (compression == OBJECT_COMPRESSED_ZSTD)
-                return decompress_startswith_zstd(
+                return decompress_startswith_zstd_dict(
+                                d,
                                 src, src_size,
                                 buffer, buffer_size,
                                 prefix, prefix_len,
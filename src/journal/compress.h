@@ -5,6 +5,16 @@
 
 #include "journal-def.h"
 
+/* A zstd dictionary, trained from sample payloads, that small DATA objects are compressed against. The
+ * zstd contexts are only set up on first use, as readers never need the compression side. */
+typedef struct ZstdDictionary ZstdDictionary;
+
+int zstd_dictionary_train(const void *samples, const size_t *sample_sizes, size_t n_samples,
+                          size_t capacity, void **ret, size_t *ret_size);
+int zstd_dictionary_new(const void *buffer, size_t size, ZstdDictionary **ret);
+ZstdDictionary *zstd_dictionary_free(ZstdDictionary *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZstdDictionary*, zstd_dictionary_free);
+
 const char* object_compressed_to_string(int compression);
 int object_compressed_from_string(const char *compression);
 
@@ -14,6 +24,9 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
                       void *dst, size_t dst_alloc_size, size_t *dst_size);
 int compress_blob_zstd(const void *src, uint64_t src_size,
                        void *dst, size_t dst_alloc_size, size_t *dst_size);
+int compress_blob_zstd_dict(ZstdDictionary *d,
+                            const void *src, uint64_t src_size,
+                            void *dst, size_t dst_alloc_size, size_t *dst_size);
 
 static inline int compress_blob(const void *src, uint64_t src_size,
                                 void *dst, size_t dst_alloc_size, size_t *dst_size) {
@@ -42,9 +55,17 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob_zstd(const void *src, uint64_t src_size,
                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
-int decompress_blob(int compression,
-                    const void *src, uint64_t src_size,
-                    void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd_dict(ZstdDictionary *d,
+                              const void *src, uint64_t src_size,
+                              void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob_dict(int compression, ZstdDictionary *d,
+                         const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+static inline int decompress_blob(int compression,
+                                  const void *src, uint64_t src_size,
+                                  void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+        return decompress_blob_dict(compression, NULL, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
 
 int decompress_startswith_xz(const void *src, uint64_t src_size,
                              void **buffer, size_t *buffer_size,
@@ -58,11 +79,23 @@ int decompress_startswith_zstd(const void *src, uint64_t src_size,
                                void **buffer, size_t *buffer_size,
                                const void *prefix, size_t prefix_len,
                                uint8_t extra);
-int decompress_startswith(int compression,
-                          const void *src, uint64_t src_size,
-                          void **buffer, size_t *buffer_size,
-                          const void *prefix, size_t prefix_len,
-                          uint8_t extra);
+int decompress_startswith_zstd_dict(ZstdDictionary *d,
+                                    const void *src, uint64_t src_size,
+                                    void **buffer, size_t *buffer_size,
+                                    const void *prefix, size_t prefix_len,
+                                    uint8_t extra);
+int decompress_startswith_dict(int compression, ZstdDictionary *d,
+                               const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra);
+static inline int decompress_startswith(int compression,
+                                        const void *src, uint64_t src_size,
+                                        void **buffer, size_t *buffer_size,
+                                        const void *prefix, size_t prefix_len,
+                                        uint8_t extra) {
+        return decompress_startswith_dict(compression, NULL, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
 
 int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes);
 int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes);
@@ -13,6 +13,10 @@
 #include "memory-util.h"
 #include "time-util.h"
 
+/* Seeking the FSPRG state to an arbitrary epoch costs about as much as evolving it a few hundred times, hence
+ * when going forward by less than this, evolve step by step instead. */
+#define FSPRG_EVOLVE_MAX 256U
+
 static uint64_t journal_file_tag_seqnum(JournalFile *f) {
         uint64_t r;
 
@@ -152,7 +156,6 @@ int journal_file_fsprg_evolve(JournalFile *f, uint64_t realtime) {
 }
 
 int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
-        void *msk;
         uint64_t epoch;
 
         assert(f);
@@ -169,8 +172,9 @@ int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
                 if (goal == epoch)
                         return 0;
 
-                if (goal == epoch+1) {
-                        FSPRG_Evolve(f->fsprg_state);
+                if (goal > epoch && goal - epoch <= FSPRG_EVOLVE_MAX) {
+                        for (; epoch < goal; epoch++)
+                                FSPRG_Evolve(f->fsprg_state);
                         return 0;
                 }
         } else {
@@ -183,9 +187,17 @@ int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
 
         log_debug("Seeking FSPRG key to %"PRIu64".", goal);
 
-        msk = alloca(FSPRG_mskinbytes(FSPRG_RECOMMENDED_SECPAR));
-        FSPRG_GenMK(msk, NULL, f->fsprg_seed, f->fsprg_seed_size, FSPRG_RECOMMENDED_SECPAR);
-        FSPRG_Seek(f->fsprg_state, goal, msk, f->fsprg_seed, f->fsprg_seed_size);
+        /* Generating the master key involves searching for two large primes, which is by far the most
+         * expensive part of seeking. It only depends on the seed, hence do it only once. */
+        if (!f->fsprg_msk) {
+                f->fsprg_msk = malloc(FSPRG_mskinbytes(FSPRG_RECOMMENDED_SECPAR));
+                if (!f->fsprg_msk)
+                        return -ENOMEM;
+
+                FSPRG_GenMK(f->fsprg_msk, NULL, f->fsprg_seed, f->fsprg_seed_size, FSPRG_RECOMMENDED_SECPAR);
+        }
+
+        FSPRG_Seek(f->fsprg_state, goal, f->fsprg_msk, f->fsprg_seed, f->fsprg_seed_size);
         return 0;
 }
 
@@ -236,37 +248,47 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                         return -EBADMSG;
         }
 
-        gcry_md_write(f->hmac, o, offsetof(ObjectHeader, payload));
+        /* The object header is always covered. Where the immutable fields directly follow it, hash them
+         * together with the header in a single call, this is the hot path of appending to sealed files. The
+         * HMAC only depends on the byte stream, not on how it is split up, hence this produces the same tags
+         * as hashing every part on its own. */
+        assert_cc(offsetof(DataObject, hash) == offsetof(ObjectHeader, payload));
+        assert_cc(offsetof(FieldObject, hash) == offsetof(ObjectHeader, payload));
+        assert_cc(offsetof(EntryObject, seqnum) == offsetof(ObjectHeader, payload));
+        assert_cc(offsetof(ZstdDictionaryObject, payload) == offsetof(ObjectHeader, payload));
+        assert_cc(offsetof(TagObject, seqnum) == offsetof(ObjectHeader, payload));
+        assert_cc(offsetof(TagObject, epoch) == offsetof(TagObject, seqnum) + sizeof(le64_t));
 
         switch (o->object.type) {
 
         case OBJECT_DATA:
                 /* All but hash and payload are mutable */
-                gcry_md_write(f->hmac, &o->data.hash, sizeof(o->data.hash));
+                gcry_md_write(f->hmac, o, offsetof(DataObject, hash) + sizeof(o->data.hash));
                 gcry_md_write(f->hmac, o->data.payload, le64toh(o->object.size) - offsetof(DataObject, payload));
                 break;
 
         case OBJECT_FIELD:
                 /* Same here */
-                gcry_md_write(f->hmac, &o->field.hash, sizeof(o->field.hash));
+                gcry_md_write(f->hmac, o, offsetof(FieldObject, hash) + sizeof(o->field.hash));
                 gcry_md_write(f->hmac, o->field.payload, le64toh(o->object.size) - offsetof(FieldObject, payload));
                 break;
 
         case OBJECT_ENTRY:
+        case OBJECT_ZSTD_DICTIONARY:
                 /* All */
-                gcry_md_write(f->hmac, &o->entry.seqnum, le64toh(o->object.size) - offsetof(EntryObject, seqnum));
+                gcry_md_write(f->hmac, o, le64toh(o->object.size));
                 break;
 
         case OBJECT_FIELD_HASH_TABLE:
         case OBJECT_DATA_HASH_TABLE:
         case OBJECT_ENTRY_ARRAY:
                 /* Nothing: everything is mutable */
+                gcry_md_write(f->hmac, o, offsetof(ObjectHeader, payload));
                 break;
 
         case OBJECT_TAG:
                 /* All but the tag itself */
-                gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
-                gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
+                gcry_md_write(f->hmac, o, offsetof(TagObject, tag));
                 break;
         default:
                 return -EINVAL;
@@ -308,6 +330,7 @@ int journal_file_fss_load(JournalFile *f) {
         struct stat st;
         FSSHeader *m = NULL;
         sd_id128_t machine;
+        const char *e;
 
         assert(f);
 
@@ -318,8 +341,14 @@ int journal_file_fss_load(JournalFile *f) {
         if (r < 0)
                 return r;
 
-        if (asprintf(&p, "/var/log/journal/" SD_ID128_FORMAT_STR "/fss",
-                     SD_ID128_FORMAT_VAL(machine)) < 0)
+        /* Only useful for testing and benchmarking, the key file still has to match our machine ID */
+        e = getenv("SYSTEMD_JOURNAL_FSS");
+        if (e) {
+                p = strdup(e);
+                if (!p)
+                        return -ENOMEM;
+        } else if (asprintf(&p, "/var/log/journal/" SD_ID128_FORMAT_STR "/fss",
+                            SD_ID128_FORMAT_VAL(machine)) < 0)
                 return -ENOMEM;
 
         fd = open(p, O_RDWR|O_CLOEXEC|O_NOCTTY, 0600);
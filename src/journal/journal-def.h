@@ -23,6 +23,9 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct BloomFilterObject BloomFilterObject;
+typedef struct ZstdDictionaryObject ZstdDictionaryObject;
+typedef struct FieldStatsObject FieldStatsObject;
 
 typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
@@ -39,6 +42,9 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_BLOOM_FILTER,
+        OBJECT_ZSTD_DICTIONARY,
+        OBJECT_FIELD_STATS,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -49,6 +55,7 @@ enum {
         OBJECT_COMPRESSED_ZSTD = 1 << 2,
         OBJECT_COMPRESSION_MASK = (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4 | OBJECT_COMPRESSED_ZSTD),
         _OBJECT_COMPRESSED_MAX = OBJECT_COMPRESSION_MASK,
+        OBJECT_UNINDEXED       = 1 << 3, /* DATA objects only: not in the hash table, no entry array */
 };
 
 struct ObjectHeader {
@@ -130,6 +137,38 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+struct BloomFilterObject {
+        ObjectHeader object;
+        le64_t n_hashes;
+        le64_t n_items;
+        uint8_t bits[];
+} _packed_;
+
+struct ZstdDictionaryObject {
+        ObjectHeader object;
+        uint8_t payload[];
+} _packed_;
+
+/* The payload consists of five columns of n_values le64_t each (hash, n_entries, first_realtime,
+ * last_realtime and the end of each value relative to the end of the field name), followed by the field name
+ * and the values in "FIELD=value" form, i.e. exactly like the payload of the DATA objects they summarize. */
+enum {
+        FIELD_STATS_HASH,
+        FIELD_STATS_N_ENTRIES,
+        FIELD_STATS_FIRST_REALTIME,
+        FIELD_STATS_LAST_REALTIME,
+        FIELD_STATS_VALUE_END,
+        _FIELD_STATS_COLUMN_MAX,
+};
+
+struct FieldStatsObject {
+        ObjectHeader object;
+        le64_t next_field_stats_offset;
+        le64_t n_values;
+        le64_t field_size;
+        le64_t payload[];
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -138,6 +177,9 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        BloomFilterObject bloom_filter;
+        ZstdDictionaryObject zstd_dictionary;
+        FieldStatsObject field_stats;
 };
 
 enum {
@@ -153,41 +195,44 @@ enum {
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4  = 1 << 1,
         HEADER_INCOMPATIBLE_KEYED_HASH      = 1 << 2,
         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 3,
+        HEADER_INCOMPATIBLE_ZSTD_DICTIONARY = 1 << 4,
 };
 
-#define HEADER_INCOMPATIBLE_ANY               \
-        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |  \
-         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 | \
-         HEADER_INCOMPATIBLE_KEYED_HASH |     \
-         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD)
+#define HEADER_INCOMPATIBLE_ANY                \
+        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |   \
+         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |  \
+         HEADER_INCOMPATIBLE_KEYED_HASH |      \
+         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD | \
+         HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
 
 #if HAVE_XZ && HAVE_LZ4 && HAVE_ZSTD
 #  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_ANY
 #elif HAVE_XZ && HAVE_LZ4
 #  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4|HEADER_INCOMPATIBLE_KEYED_HASH)
 #elif HAVE_XZ && HAVE_ZSTD
-#  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_KEYED_HASH)
+#  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_ZSTD_DICTIONARY|HEADER_INCOMPATIBLE_KEYED_HASH)
 #elif HAVE_LZ4 && HAVE_ZSTD
-#  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_LZ4|HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_KEYED_HASH)
+#  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_LZ4|HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_ZSTD_DICTIONARY|HEADER_INCOMPATIBLE_KEYED_HASH)
 #elif HAVE_XZ
 #  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_KEYED_HASH)
 #elif HAVE_LZ4
 #  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_LZ4|HEADER_INCOMPATIBLE_KEYED_HASH)
 #elif HAVE_ZSTD
-#  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_KEYED_HASH)
+#  define HEADER_INCOMPATIBLE_SUPPORTED (HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_ZSTD_DICTIONARY|HEADER_INCOMPATIBLE_KEYED_HASH)
 #else
 #  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_KEYED_HASH
 #endif
 
 enum {
-        HEADER_COMPATIBLE_SEALED = 1 << 0,
+        HEADER_COMPATIBLE_SEALED    = 1 << 0,
+        HEADER_COMPATIBLE_UNINDEXED = 1 << 1,
 };
 
-#define HEADER_COMPATIBLE_ANY HEADER_COMPATIBLE_SEALED
+#define HEADER_COMPATIBLE_ANY (HEADER_COMPATIBLE_SEALED|HEADER_COMPATIBLE_UNINDEXED)
 #if HAVE_GCRYPT
-#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_SEALED
+#  define HEADER_COMPATIBLE_SUPPORTED (HEADER_COMPATIBLE_SEALED|HEADER_COMPATIBLE_UNINDEXED)
 #else
-#  define HEADER_COMPATIBLE_SUPPORTED 0
+#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_UNINDEXED
 #endif
 
 #define HEADER_SIGNATURE                                                \
@@ -227,12 +272,16 @@ enum {
         /* Added in 246 */                              \
         le64_t data_hash_chain_depth;                   \
         le64_t field_hash_chain_depth;                  \
+        /* Added in 247 */                              \
+        le64_t bloom_filter_offset;                     \
+        le64_t zstd_dictionary_offset;                  \
+        le64_t field_stats_offset;                      \
         }
 
 struct Header struct_Header__contents;
 struct Header__packed struct_Header__contents _packed_;
 assert_cc(sizeof(struct Header) == sizeof(struct Header__packed));
-assert_cc(sizeof(struct Header) == 256);
+assert_cc(sizeof(struct Header) == 280);
 
 #define FSS_HEADER_SIGNATURE                                            \
         ((const char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
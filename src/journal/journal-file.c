@@ -26,6 +26,7 @@
 #include "lookup3.h"
 #include "memory-util.h"
 #include "path-util.h"
+#include "prioq.h"
 #include "random-util.h"
 #include "set.h"
 #include "sort-util.h"
@@ -35,6 +36,7 @@
 #include "xattr-util.h"
 
 #define DEFAULT_DATA_HASH_TABLE_SIZE (2047ULL*sizeof(HashItem))
+#define DATA_HASH_TABLE_SIZE_MAX (64ULL*1024ULL*1024ULL)
 #define DEFAULT_FIELD_HASH_TABLE_SIZE (333ULL*sizeof(HashItem))
 
 #define DEFAULT_COMPRESS_THRESHOLD (512ULL)
@@ -85,6 +87,34 @@
 /* Longest hash chain to rotate after */
 #define HASH_CHAIN_DEPTH_MAX 100
 
+/* Bloom filter parameters: ~10 bits per DATA object and 7 hash functions give a false positive rate of
+ * about 1%. Files with more DATA objects than fit into the maximum size simply get a fuller filter. */
+#define BLOOM_FILTER_BITS_PER_ITEM 10
+#define BLOOM_FILTER_N_HASHES 7
+#define BLOOM_FILTER_SIZE_MIN 64
+#define BLOOM_FILTER_SIZE_MAX (4 * 1024 * 1024ULL)       /* 4 MiB */
+
+/* Files are most commonly archived because they are full, hence keep some room for the bloom filter and the
+ * field summaries appended then: this share of the maximum file size, but no more than the maximum. */
+#define ARCHIVE_RESERVE_SHARE 16
+#define ARCHIVE_RESERVE_MAX (8 * 1024 * 1024ULL)         /* 8 MiB */
+
+/* zstd dictionary parameters: the dictionary is trained from the payloads of the first new DATA objects of a
+ * file, and then used to compress payloads way below the regular compression threshold, as short log lines
+ * are mostly made of the same words. Payloads larger than the sample limit compress fine on their own. Every
+ * writer keeps the samples around until the dictionary is trained, hence don't collect too many. */
+#define ZSTD_DICTIONARY_SAMPLES 2048U
+#define ZSTD_DICTIONARY_SAMPLE_SIZE_MAX (1U * 1024U)     /* 1 KiB */
+#define ZSTD_DICTIONARY_SAMPLES_SIZE_MAX (256U * 1024U) /* 256 KiB */
+#define ZSTD_DICTIONARY_SIZE (8U * 1024U)               /* 8 KiB */
+#define ZSTD_DICTIONARY_SIZE_MAX (1024U * 1024U)        /* 1 MiB */
+#define ZSTD_DICTIONARY_COMPRESS_THRESHOLD 32U
+
+/* Fields with more values than this, or whose values take up more space than this, are not worth
+ * summarizing, readers are better off walking their data objects */
+#define FIELD_STATS_N_VALUES_MAX 65536U
+#define FIELD_STATS_SIZE_MAX (16U * 1024U * 1024U)                /* 16 MiB */
+
 #ifdef __clang__
 #  pragma GCC diagnostic ignored "-Waddress-of-packed-member"
 #endif
@@ -345,10 +375,25 @@ bool journal_file_is_offlining(JournalFile *f) {
         return true;
 }
 
+static JournalFile* journal_file_discard_prepared(JournalFile *p) {
+        if (!p)
+                return NULL;
+
+        /* Never linked into place, hence nobody will miss it */
+        if (p->prepared_tmp_path) {
+                (void) unlink(p->prepared_tmp_path);
+                p->prepared_tmp_path = mfree(p->prepared_tmp_path);
+        }
+
+        return journal_file_close(p);
+}
+
 JournalFile* journal_file_close(JournalFile *f) {
         if (!f)
                 return NULL;
 
+        f->prepared = journal_file_discard_prepared(f->prepared);
+
 #if HAVE_GCRYPT
         /* Write the final tag */
         if (f->seal && f->writable) {
@@ -367,6 +412,10 @@ JournalFile* journal_file_close(JournalFile *f) {
                 sd_event_source_disable_unref(f->post_change_timer);
         }
 
+#if HAVE_ZSTD
+        sd_event_source_disable_unref(f->zstd_train_event_source);
+#endif
+
         journal_file_set_offline(f, true);
 
         if (f->mmap && f->cache_fd)
@@ -396,13 +445,21 @@ JournalFile* journal_file_close(JournalFile *f) {
         free(f->compress_buffer);
 #endif
 
+#if HAVE_ZSTD
+        zstd_dictionary_free(f->zstd_dictionary);
+        free(f->zstd_samples);
+        free(f->zstd_sample_sizes);
+#endif
+
 #if HAVE_GCRYPT
+        /* All of these are secret key material */
         if (f->fss_file)
                 munmap(f->fss_file, PAGE_ALIGN(f->fss_file_size));
         else
-                free(f->fsprg_state);
+                erase_and_free(f->fsprg_state);
 
-        free(f->fsprg_seed);
+        erase_and_free(f->fsprg_seed);
+        erase_and_free(f->fsprg_msk);
 
         if (f->hmac)
                 gcry_md_close(f->hmac);
@@ -492,13 +549,15 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[5];
+                        const char* strv[6];
                         unsigned n = 0;
                         _cleanup_free_ char *t = NULL;
 
                         if (compatible) {
                                 if (flags & HEADER_COMPATIBLE_SEALED)
                                         strv[n++] = "sealed";
+                                if (flags & HEADER_COMPATIBLE_UNINDEXED)
+                                        strv[n++] = "unindexed";
                         } else {
                                 if (flags & HEADER_INCOMPATIBLE_COMPRESSED_XZ)
                                         strv[n++] = "xz-compressed";
@@ -506,6 +565,8 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                         strv[n++] = "lz4-compressed";
                                 if (flags & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD)
                                         strv[n++] = "zstd-compressed";
+                                if (flags & HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
+                                        strv[n++] = "zstd-dictionary";
                                 if (flags & HEADER_INCOMPATIBLE_KEYED_HASH)
                                         strv[n++] = "keyed-hash";
                         }
@@ -637,8 +698,24 @@ int journal_file_fstat(JournalFile *f) {
         return 0;
 }
 
+static uint64_t journal_file_size_limit(JournalFile *f) {
+        assert(f);
+        assert(f->header);
+
+        /* Returns the size up to which we may allocate objects right now, or 0 if there is no limit */
+
+        if (f->metrics.max_size == 0 || f->archiving)
+                return f->metrics.max_size;
+
+        /* Nothing is appended to sealed files when archiving them, see journal_file_append_bloom_filter() */
+        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) || JOURNAL_HEADER_SEALED(f->header))
+                return f->metrics.max_size;
+
+        return f->metrics.max_size - PAGE_ALIGN_DOWN(MIN(f->metrics.max_size / ARCHIVE_RESERVE_SHARE, ARCHIVE_RESERVE_MAX));
+}
+
 static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size) {
-        uint64_t old_size, new_size, old_header_size, old_arena_size;
+        uint64_t old_size, new_size, old_header_size, old_arena_size, limit;
         int r;
 
         assert(f);
@@ -662,6 +739,11 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
 
         new_size = MAX(PAGE_ALIGN(offset + size), old_header_size);
 
+        /* Check this even if the space is allocated already, it might be reserved for archiving */
+        limit = journal_file_size_limit(f);
+        if (limit > 0 && new_size > limit)
+                return -E2BIG;
+
         if (new_size <= old_size) {
 
                 /* We already pre-allocated enough space, but before
@@ -678,9 +760,6 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
 
         /* Allocate more space. */
 
-        if (f->metrics.max_size > 0 && new_size > f->metrics.max_size)
-                return -E2BIG;
-
         if (new_size > f->metrics.min_size && f->metrics.keep_free > 0) {
                 struct statvfs svfs;
 
@@ -696,8 +775,8 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
 
         /* Increase by larger blocks at once */
         new_size = DIV_ROUND_UP(new_size, FILE_SIZE_INCREASE) * FILE_SIZE_INCREASE;
-        if (f->metrics.max_size > 0 && new_size > f->metrics.max_size)
-                new_size = f->metrics.max_size;
+        if (limit > 0 && new_size > limit)
+                new_size = limit;
 
         /* Note that the glibc fallocate() fallback is very
            inefficient, hence we try to minimize the allocation area
@@ -751,7 +830,7 @@ static int journal_file_move_to(
                         return -EADDRNOTAVAIL;
         }
 
-        return mmap_cache_get(f->mmap, f->cache_fd, f->prot, type_to_context(type), keep_always, offset, size, &f->last_stat, ret, ret_size);
+        return mmap_cache_get(f->mmap, f->cache_fd, f->prot, f->mmap_contexts + type_to_context(type), keep_always, offset, size, &f->last_stat, ret, ret_size);
 }
 
 static uint64_t minimum_header_size(Object *o) {
@@ -764,6 +843,9 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject),
                 [OBJECT_TAG] = sizeof(TagObject),
+                [OBJECT_BLOOM_FILTER] = sizeof(BloomFilterObject),
+                [OBJECT_ZSTD_DICTIONARY] = sizeof(ZstdDictionaryObject),
+                [OBJECT_FIELD_STATS] = sizeof(FieldStatsObject),
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -787,6 +869,11 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                                                le64toh(o->data.n_entries),
                                                offset);
 
+                if ((o->object.flags & OBJECT_UNINDEXED) && le64toh(o->data.n_entries) != 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Unindexed data object with entries: %" PRIu64,
+                                               offset);
+
                 if (le64toh(o->object.size) <= offsetof(DataObject, payload))
                         return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
                                                "Bad object size (<= %zu): %" PRIu64 ": %" PRIu64,
@@ -915,6 +1002,68 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                                                le64toh(o->tag.epoch), offset);
 
                 break;
+
+        case OBJECT_BLOOM_FILTER: {
+                uint64_t sz;
+
+                sz = le64toh(READ_NOW(o->object.size));
+                if (sz < offsetof(BloomFilterObject, bits) + BLOOM_FILTER_SIZE_MIN ||
+                    ((sz - offsetof(BloomFilterObject, bits)) & (sz - offsetof(BloomFilterObject, bits) - 1)) != 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid bloom filter size: %" PRIu64 ": %" PRIu64,
+                                               sz,
+                                               offset);
+
+                if (le64toh(o->bloom_filter.n_hashes) <= 0 ||
+                    le64toh(o->bloom_filter.n_hashes) > 64)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid number of bloom filter hashes: %" PRIu64 ": %" PRIu64,
+                                               le64toh(o->bloom_filter.n_hashes),
+                                               offset);
+
+                break;
+        }
+
+        case OBJECT_ZSTD_DICTIONARY: {
+                uint64_t sz;
+
+                sz = le64toh(READ_NOW(o->object.size));
+                if (sz <= offsetof(ZstdDictionaryObject, payload) ||
+                    sz > offsetof(ZstdDictionaryObject, payload) + ZSTD_DICTIONARY_SIZE_MAX)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid zstd dictionary size: %" PRIu64 ": %" PRIu64,
+                                               sz,
+                                               offset);
+
+                break;
+        }
+
+        case OBJECT_FIELD_STATS: {
+                uint64_t sz, n, field_size, next;
+
+                sz = le64toh(READ_NOW(o->object.size)) - offsetof(FieldStatsObject, payload);
+                n = le64toh(o->field_stats.n_values);
+                field_size = le64toh(o->field_stats.field_size);
+
+                if (n <= 0 ||
+                    n > sz / (_FIELD_STATS_COLUMN_MAX * sizeof(le64_t)) ||
+                    field_size <= 0 ||
+                    field_size > sz - n * _FIELD_STATS_COLUMN_MAX * sizeof(le64_t))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid field statistics size: %" PRIu64 ": %" PRIu64,
+                                               sz,
+                                               offset);
+
+                /* Every object links to the one appended before it */
+                next = le64toh(o->field_stats.next_field_stats_offset);
+                if (!VALID64(next) || next >= offset)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid next field statistics offset: %" PRIu64 ": %" PRIu64,
+                                               next,
+                                               offset);
+
+                break;
+        }
         }
 
         return 0;
@@ -1016,6 +1165,39 @@ static uint64_t journal_file_entry_seqnum(JournalFile *f, uint64_t *seqnum) {
         return r;
 }
 
+static int journal_file_tail_end(JournalFile *f, uint64_t *ret) {
+        Object *tail;
+        uint64_t p, sz;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+
+        /* Returns the offset the next object will be appended at */
+
+        p = le64toh(f->header->tail_object_offset);
+        if (p == 0) {
+                *ret = le64toh(f->header->header_size);
+                return 0;
+        }
+
+        r = journal_file_move_to_object(f, OBJECT_UNUSED, p, &tail);
+        if (r < 0)
+                return r;
+
+        sz = le64toh(READ_NOW(tail->object.size));
+        if (sz > UINT64_MAX - sizeof(uint64_t) + 1)
+                return -EBADMSG;
+
+        sz = ALIGN64(sz);
+        if (p > UINT64_MAX - sz)
+                return -EBADMSG;
+
+        *ret = p + sz;
+        return 0;
+}
+
 int journal_file_append_object(
                 JournalFile *f,
                 ObjectType type,
@@ -1025,7 +1207,7 @@ int journal_file_append_object(
 
         int r;
         uint64_t p;
-        Object *tail, *o;
+        Object *o;
         void *t;
 
         assert(f);
@@ -1037,26 +1219,9 @@ int journal_file_append_object(
         if (r < 0)
                 return r;
 
-        p = le64toh(f->header->tail_object_offset);
-        if (p == 0)
-                p = le64toh(f->header->header_size);
-        else {
-                uint64_t sz;
-
-                r = journal_file_move_to_object(f, OBJECT_UNUSED, p, &tail);
-                if (r < 0)
-                        return r;
-
-                sz = le64toh(READ_NOW(tail->object.size));
-                if (sz > UINT64_MAX - sizeof(uint64_t) + 1)
-                        return -EBADMSG;
-
-                sz = ALIGN64(sz);
-                if (p > UINT64_MAX - sz)
-                        return -EBADMSG;
-
-                p += sz;
-        }
+        r = journal_file_tail_end(f, &p);
+        if (r < 0)
+                return r;
 
         r = journal_file_allocate(f, p, size);
         if (r < 0)
@@ -1084,7 +1249,7 @@ int journal_file_append_object(
         return 0;
 }
 
-static int journal_file_setup_data_hash_table(JournalFile *f) {
+static int journal_file_setup_data_hash_table(JournalFile *f, JournalFile *template) {
         uint64_t s, p;
         Object *o;
         int r;
@@ -1101,6 +1266,32 @@ static int journal_file_setup_data_hash_table(JournalFile *f) {
         if (s < DEFAULT_DATA_HASH_TABLE_SIZE)
                 s = DEFAULT_DATA_HASH_TABLE_SIZE;
 
+        /* The estimate above is off for files with many small, distinct data objects, which then fill up
+         * the hash table long before the file is full, and get rotated early because of that (see
+         * journal_file_rotate_suggested()). The table cannot be resized in place without confusing readers
+         * that have it mapped, hence size the next file instead: make room for twice as many data objects
+         * as the file we replace had, at the usual fill level, if that's more than our estimate. This way
+         * the table grows across rotations until it matches what the clients actually log. */
+        if (template && template->header && JOURNAL_HEADER_CONTAINS(template->header, n_data)) {
+                uint64_t n, t;
+
+                n = le64toh(template->header->n_data);
+                if (n < (DATA_HASH_TABLE_SIZE_MAX / sizeof(HashItem)) * 3 / 8)
+                        t = (n * 8 / 3) * sizeof(HashItem);
+                else
+                        t = DATA_HASH_TABLE_SIZE_MAX;
+
+                /* Never let the hash table take more than an eighth of the file */
+                if (f->metrics.max_size > 0)
+                        t = MIN(t, f->metrics.max_size / 8);
+
+                if (t > s) {
+                        log_debug("Previous file %s had %"PRIu64" data objects, growing data hash table.",
+                                  template->path, n);
+                        s = t;
+                }
+        }
+
         log_debug("Reserving %"PRIu64" entries in data hash table.", s / sizeof(HashItem));
 
         r = journal_file_append_object(f,
@@ -1414,6 +1605,103 @@ int journal_file_find_field_object(
                         ret, ret_offset);
 }
 
+int journal_file_get_zstd_dictionary(JournalFile *f, ZstdDictionary **ret) {
+#if HAVE_ZSTD
+        _cleanup_(zstd_dictionary_freep) ZstdDictionary *d = NULL;
+        uint64_t p, l;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+
+        /* Returns the dictionary the DATA objects of this file are compressed against, loading it on first
+         * use, or NULL if there is none. The dictionary never changes once it is there, hence we can keep it
+         * around for the lifetime of the file object. */
+
+        if (f->zstd_dictionary) {
+                *ret = f->zstd_dictionary;
+                return 1;
+        }
+
+        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset))
+                return -EBADMSG;
+
+        p = le64toh(READ_NOW(f->header->zstd_dictionary_offset));
+        if (p == 0)
+                return -EBADMSG;
+
+        r = journal_file_move_to_object(f, OBJECT_ZSTD_DICTIONARY, p, &o);
+        if (r < 0)
+                return r;
+
+        l = le64toh(READ_NOW(o->object.size)) - offsetof(Object, zstd_dictionary.payload);
+
+        r = zstd_dictionary_new(o->zstd_dictionary.payload, l, &d);
+        if (r < 0)
+                return r;
+
+        *ret = f->zstd_dictionary = TAKE_PTR(d);
+        return 1;
+#else
+        assert(ret);
+
+        *ret = NULL;
+        return 0;
+#endif
+}
+
+int journal_file_decompress_blob(
+                JournalFile *f,
+                int compression,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max) {
+
+        ZstdDictionary *d = NULL;
+        int r;
+
+        assert(f);
+
+        /* Like decompress_blob(), but makes use of the zstd dictionary of the file, if it has one. Note that
+         * loading the dictionary maps it in its own context, hence 'src' stays valid. */
+
+        if (compression == OBJECT_COMPRESSED_ZSTD) {
+                r = journal_file_get_zstd_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        return decompress_blob_dict(compression, d, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
+
+int journal_file_decompress_startswith(
+                JournalFile *f,
+                int compression,
+                const void *src, uint64_t src_size,
+                void **buffer, size_t *buffer_size,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra) {
+
+        ZstdDictionary *d = NULL;
+        int r;
+
+        assert(f);
+
+        if (compression == OBJECT_COMPRESSED_ZSTD) {
+                r = journal_file_get_zstd_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        return decompress_startswith_dict(compression, d, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
+
 int journal_file_find_data_object_with_hash(
                 JournalFile *f,
                 const void *data, uint64_t size, uint64_t hash,
@@ -1465,8 +1753,8 @@ int journal_file_find_data_object_with_hash(
 
                         l -= offsetof(Object, data.payload);
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
-                                            o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
+                        r = journal_file_decompress_blob(f, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                         o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
 
@@ -1587,103 +1875,377 @@ static int journal_file_append_field(
         return 0;
 }
 
-static int journal_file_append_data(
-                JournalFile *f,
-                const void *data, uint64_t size,
-                Object **ret, uint64_t *ret_offset) {
+#if HAVE_ZSTD
+static void journal_file_free_zstd_samples(JournalFile *f) {
+        assert(f);
 
-        uint64_t hash, p;
-        uint64_t osize;
-        Object *o;
-        int r, compression = 0;
-        const void *eq;
+        f->zstd_samples = mfree(f->zstd_samples);
+        f->zstd_sample_sizes = mfree(f->zstd_sample_sizes);
+        f->zstd_samples_size = f->n_zstd_samples = 0;
+        f->zstd_samples_done = true;
+}
 
+static void journal_file_add_zstd_sample(JournalFile *f, const void *data, uint64_t size) {
         assert(f);
-        assert(data || size == 0);
 
-        hash = journal_file_hash_data(f, data, size);
-
-        r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
-        if (r < 0)
-                return r;
-        if (r > 0) {
+        if (!f->compress_zstd || f->zstd_samples_done)
+                return;
 
-                if (ret)
-                        *ret = o;
+        /* In sealed files the first tag already covers the header flags, hence a dictionary can only be
+         * inherited when the file is created, see journal_file_inherit_zstd_dictionary(), but not be added
+         * later on. */
+        if (!JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) || JOURNAL_HEADER_SEALED(f->header)) {
+                f->zstd_samples_done = true;
+                return;
+        }
 
-                if (ret_offset)
-                        *ret_offset = p;
+        if (size <= 0 || size > ZSTD_DICTIONARY_SAMPLE_SIZE_MAX)
+                return;
 
-                return 0;
+        if (!f->zstd_samples) {
+                f->zstd_samples = malloc(ZSTD_DICTIONARY_SAMPLES_SIZE_MAX);
+                f->zstd_sample_sizes = new(size_t, ZSTD_DICTIONARY_SAMPLES);
+                if (!f->zstd_samples || !f->zstd_sample_sizes) {
+                        /* The dictionary is an optimization, don't fail the write over it */
+                        journal_file_free_zstd_samples(f);
+                        return;
+                }
         }
 
-        osize = offsetof(Object, data.payload) + size;
-        r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
-        if (r < 0)
-                return r;
+        if (f->n_zstd_samples >= ZSTD_DICTIONARY_SAMPLES ||
+            f->zstd_samples_size + size > ZSTD_DICTIONARY_SAMPLES_SIZE_MAX)
+                return;
 
-        o->data.hash = htole64(hash);
+        memcpy(f->zstd_samples + f->zstd_samples_size, data, size);
+        f->zstd_samples_size += size;
+        f->zstd_sample_sizes[f->n_zstd_samples++] = size;
+}
 
-#if HAVE_COMPRESSION
-        if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
-                size_t rsize = 0;
+static int journal_file_append_zstd_dictionary(JournalFile *f, const void *buffer, size_t size) {
+        _cleanup_(zstd_dictionary_freep) ZstdDictionary *d = NULL;
+        uint64_t p;
+        Object *o;
+        int r;
 
-                compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+        assert(f);
+        assert(f->header);
+        assert(buffer);
 
-                if (compression >= 0) {
-                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
-                        o->object.flags |= compression;
+        if (!JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset))
+                return -EOPNOTSUPP;
 
-                        log_debug("Compressed data object %"PRIu64" -> %zu using %s",
-                                  size, rsize, object_compressed_to_string(compression));
-                } else
-                        /* Compression didn't work, we don't really care why, let's continue without compression */
-                        compression = 0;
-        }
-#endif
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header))
+                return -EEXIST;
 
-        if (compression == 0)
-                memcpy_safe(o->data.payload, data, size);
+        r = zstd_dictionary_new(buffer, size, &d);
+        if (r < 0)
+                return r;
 
-        r = journal_file_link_data(f, o, p, hash);
+        r = journal_file_append_object(f, OBJECT_ZSTD_DICTIONARY, offsetof(Object, zstd_dictionary.payload) + size, &o, &p);
         if (r < 0)
                 return r;
 
+        memcpy(o->zstd_dictionary.payload, buffer, size);
+
 #if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
+        r = journal_file_hmac_put_object(f, OBJECT_ZSTD_DICTIONARY, o, p);
         if (r < 0)
                 return r;
 #endif
 
-        /* The linking might have altered the window, so let's
-         * refresh our pointer */
-        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
-        if (r < 0)
-                return r;
+        /* Readers look at the flag first, hence set the offset before it */
+        f->header->zstd_dictionary_offset = htole64(p);
+        f->header->incompatible_flags |= htole32(HEADER_INCOMPATIBLE_ZSTD_DICTIONARY);
 
-        if (!data)
-                eq = NULL;
-        else
-                eq = memchr(data, '=', size);
-        if (eq && eq > data) {
-                Object *fo = NULL;
-                uint64_t fp;
+        f->zstd_dictionary = TAKE_PTR(d);
 
-                /* Create field object ... */
-                r = journal_file_append_field(f, data, (uint8_t*) eq - (uint8_t*) data, &fo, &fp);
-                if (r < 0)
-                        return r;
+        return 0;
+}
 
-                /* ... and link it in. */
-                o->data.next_field_offset = fo->field.head_data_offset;
-                fo->field.head_data_offset = le64toh(p);
-        }
+static void journal_file_train_zstd_dictionary(JournalFile *f) {
+        _cleanup_free_ void *buffer = NULL;
+        size_t size;
+        int r;
 
-        if (ret)
-                *ret = o;
+        assert(f);
 
-        if (ret_offset)
-                *ret_offset = p;
+        if (f->zstd_samples_done)
+                return;
+
+        r = zstd_dictionary_train(f->zstd_samples, f->zstd_sample_sizes, f->n_zstd_samples, ZSTD_DICTIONARY_SIZE,
+                                  &buffer, &size);
+        if (r >= 0)
+                r = journal_file_append_zstd_dictionary(f, buffer, size);
+        if (r < 0)
+                log_debug_errno(r, "Failed to set up zstd dictionary for %s, continuing without: %m", f->path);
+        else
+                log_debug("Trained zstd dictionary of %zu bytes from %zu data objects for %s.",
+                          size, f->n_zstd_samples, f->path);
+
+        /* Either way, we won't try again for this file */
+        journal_file_free_zstd_samples(f);
+}
+
+static int on_zstd_train(sd_event_source *s, void *userdata) {
+        JournalFile *f = userdata;
+
+        assert(f);
+
+        /* No objects are referenced while the event loop runs, hence we may append the dictionary here. Readers
+         * pick it up along with the next entry, which is the first one that may make use of it. */
+        journal_file_train_zstd_dictionary(f);
+
+        f->zstd_train_event_source = sd_event_source_disable_unref(f->zstd_train_event_source);
+        return 0;
+}
+
+static void journal_file_maybe_train_zstd_dictionary(JournalFile *f) {
+        int r;
+
+        assert(f);
+
+        if (f->zstd_samples_done || f->zstd_train_event_source)
+                return;
+
+        /* Train once there's no room left for another sample of the maximum size */
+        if (f->n_zstd_samples < ZSTD_DICTIONARY_SAMPLES &&
+            f->zstd_samples_size + ZSTD_DICTIONARY_SAMPLE_SIZE_MAX <= ZSTD_DICTIONARY_SAMPLES_SIZE_MAX)
+                return;
+
+        /* Training takes a while, even with the samples bounded as they are. If we have an event loop, do
+         * it once there's nothing else to do, rather than holding up the write that filled up the samples.
+         * Until then, no more samples are collected, and data is compressed without a dictionary. */
+        if (f->post_change_timer) {
+                r = sd_event_add_defer(sd_event_source_get_event(f->post_change_timer),
+                                       &f->zstd_train_event_source, on_zstd_train, f);
+                if (r >= 0) {
+                        r = sd_event_source_set_priority(f->zstd_train_event_source, SD_EVENT_PRIORITY_IDLE);
+                        if (r >= 0) {
+                                (void) sd_event_source_set_description(f->zstd_train_event_source, "journal-file-zstd-train");
+                                return;
+                        }
+
+                        f->zstd_train_event_source = sd_event_source_disable_unref(f->zstd_train_event_source);
+                }
+
+                log_debug_errno(r, "Failed to defer zstd dictionary training for %s, training right away: %m", f->path);
+        }
+
+        journal_file_train_zstd_dictionary(f);
+}
+
+static int journal_file_inherit_zstd_dictionary(JournalFile *f, JournalFile *template) {
+        _cleanup_free_ void *buffer = NULL;
+        ZstdDictionary *d;
+        uint64_t p, l;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        /* A file replacing another one most likely gets the same kind of log lines, hence start out with the
+         * dictionary of the old file rather than collecting samples again. */
+
+        if (!template || !template->header || !f->compress_zstd)
+                return 0;
+
+        r = journal_file_get_zstd_dictionary(template, &d);
+        if (r <= 0)
+                return r;
+
+        p = le64toh(template->header->zstd_dictionary_offset);
+        r = journal_file_move_to_object(template, OBJECT_ZSTD_DICTIONARY, p, &o);
+        if (r < 0)
+                return r;
+
+        /* Both files share the mmap cache contexts, hence copy the payload before appending to the new file */
+        l = le64toh(o->object.size) - offsetof(Object, zstd_dictionary.payload);
+        buffer = memdup(o->zstd_dictionary.payload, l);
+        if (!buffer)
+                return -ENOMEM;
+
+        return journal_file_append_zstd_dictionary(f, buffer, l);
+}
+#endif
+
+static bool journal_file_data_unindexed(JournalFile *f, const void *data, uint64_t size) {
+        const char *eq;
+        char **field;
+
+        assert(f);
+
+        if (strv_isempty(f->unindexed_fields) || !data)
+                return false;
+
+        /* The first tag already covers the header flags, hence we cannot mark a sealed file as containing
+         * unindexed objects when the first one is written. */
+        if (JOURNAL_HEADER_SEALED(f->header) && !JOURNAL_HEADER_UNINDEXED(f->header))
+                return false;
+
+        eq = memchr(data, '=', size);
+        if (!eq)
+                return false;
+
+        STRV_FOREACH(field, f->unindexed_fields)
+                if (memcmp_nn(data, eq - (const char*) data, *field, strlen(*field)) == 0)
+                        return true;
+
+        return false;
+}
+
+static int journal_file_append_data(
+                JournalFile *f,
+                const void *data, uint64_t size,
+                Object **ret, uint64_t *ret_offset) {
+
+        uint64_t hash, p;
+        uint64_t osize;
+        Object *o;
+        int r, compression = 0;
+        const void *eq;
+        bool unindexed;
+#if HAVE_COMPRESSION
+        uint64_t compress_threshold = f->compress_threshold_bytes;
+#endif
+#if HAVE_ZSTD
+        ZstdDictionary *dictionary = NULL;
+#endif
+
+        assert(f);
+        assert(data || size == 0);
+
+        hash = journal_file_hash_data(f, data, size);
+
+#if HAVE_ZSTD
+        if (f->compress_zstd) {
+                /* Do this before we get hold of any object, as it might append one */
+                journal_file_maybe_train_zstd_dictionary(f);
+
+                r = journal_file_get_zstd_dictionary(f, &dictionary);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        compress_threshold = MIN(compress_threshold, (uint64_t) ZSTD_DICTIONARY_COMPRESS_THRESHOLD);
+        }
+#endif
+
+        /* Unindexed data objects are never looked up again, hence there's no point in trying to dedup them:
+         * they are high-cardinality by definition. */
+        unindexed = journal_file_data_unindexed(f, data, size);
+        if (unindexed)
+                r = 0;
+        else
+                r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+
+                if (ret)
+                        *ret = o;
+
+                if (ret_offset)
+                        *ret_offset = p;
+
+                return 0;
+        }
+
+        osize = offsetof(Object, data.payload) + size;
+        r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->data.hash = htole64(hash);
+
+#if HAVE_COMPRESSION
+        if (JOURNAL_FILE_COMPRESS(f) && size >= compress_threshold) {
+                size_t rsize = 0;
+
+#if HAVE_ZSTD
+                if (dictionary) {
+                        r = compress_blob_zstd_dict(dictionary, data, size, o->data.payload, size - 1, &rsize);
+                        compression = r < 0 ? r : OBJECT_COMPRESSED_ZSTD;
+                } else
+#endif
+                        compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+
+                if (compression >= 0) {
+                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
+                        o->object.flags |= compression;
+
+                        log_debug("Compressed data object %"PRIu64" -> %zu using %s",
+                                  size, rsize, object_compressed_to_string(compression));
+                } else
+                        /* Compression didn't work, we don't really care why, let's continue without compression */
+                        compression = 0;
+        }
+#endif
+
+        if (compression == 0)
+                memcpy_safe(o->data.payload, data, size);
+
+#if HAVE_ZSTD
+        if (!dictionary)
+                journal_file_add_zstd_sample(f, data, size);
+#endif
+
+        if (unindexed) {
+                o->object.flags |= OBJECT_UNINDEXED;
+                f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_UNINDEXED);
+
+#if HAVE_GCRYPT
+                r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
+                if (r < 0)
+                        return r;
+#endif
+
+                if (ret)
+                        *ret = o;
+
+                if (ret_offset)
+                        *ret_offset = p;
+
+                return 0;
+        }
+
+        r = journal_file_link_data(f, o, p, hash);
+        if (r < 0)
+                return r;
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        /* The linking might have altered the window, so let's
+         * refresh our pointer */
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        if (!data)
+                eq = NULL;
+        else
+                eq = memchr(data, '=', size);
+        if (eq && eq > data) {
+                Object *fo = NULL;
+                uint64_t fp;
+
+                /* Create field object ... */
+                r = journal_file_append_field(f, data, (uint8_t*) eq - (uint8_t*) data, &fo, &fp);
+                if (r < 0)
+                        return r;
+
+                /* ... and link it in. */
+                o->data.next_field_offset = fo->field.head_data_offset;
+                fo->field.head_data_offset = le64toh(p);
+        }
+
+        if (ret)
+                *ret = o;
+
+        if (ret_offset)
+                *ret_offset = p;
 
         return 0;
 }
@@ -1732,19 +2294,22 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         return (sz - offsetof(Object, hash_table.items)) / sizeof(HashItem);
 }
 
-static int link_entry_into_array(JournalFile *f,
-                                 le64_t *first,
-                                 le64_t *idx,
-                                 uint64_t p) {
+static int link_entries_into_array(JournalFile *f,
+                                   le64_t *first,
+                                   le64_t *idx,
+                                   const uint64_t p[],
+                                   size_t n_p) {
         int r;
         uint64_t n = 0, ap = 0, q, i, a, hidx;
+        size_t k = 0;
         Object *o;
 
         assert(f);
         assert(f->header);
         assert(first);
         assert(idx);
-        assert(p > 0);
+        assert(p);
+        assert(n_p > 0);
 
         a = le64toh(*first);
         i = hidx = le64toh(READ_NOW(*idx));
@@ -1756,9 +2321,13 @@ static int link_entry_into_array(JournalFile *f,
 
                 n = journal_file_entry_array_n_items(o);
                 if (i < n) {
-                        o->entry_array.items[i] = htole64(p);
-                        *idx = htole64(hidx + 1);
-                        return 0;
+                        /* Fill up whatever is left in this array */
+                        for (; i < n && k < n_p; i++, k++)
+                                o->entry_array.items[i] = htole64(p[k]);
+
+                        *idx = htole64(hidx + k);
+                        if (k >= n_p)
+                                return 0;
                 }
 
                 i -= n;
@@ -1766,6 +2335,8 @@ static int link_entry_into_array(JournalFile *f,
                 a = le64toh(o->entry_array.next_entry_array_offset);
         }
 
+        hidx += k;
+
         if (hidx > n)
                 n = (hidx+1) * 2;
         else
@@ -1774,6 +2345,10 @@ static int link_entry_into_array(JournalFile *f,
         if (n < 4)
                 n = 4;
 
+        /* Make sure the rest of the batch fits into the new array in one go */
+        if (n < i + (n_p - k))
+                n = i + (n_p - k);
+
         r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY,
                                        offsetof(Object, entry_array.items) + n * sizeof(uint64_t),
                                        &o, &q);
@@ -1786,7 +2361,8 @@ static int link_entry_into_array(JournalFile *f,
                 return r;
 #endif
 
-        o->entry_array.items[i] = htole64(p);
+        for (; k < n_p; i++, k++, hidx++)
+                o->entry_array.items[i] = htole64(p[k]);
 
         if (ap == 0)
                 *first = htole64(q);
@@ -1801,44 +2377,71 @@ static int link_entry_into_array(JournalFile *f,
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 f->header->n_entry_arrays = htole64(le64toh(f->header->n_entry_arrays) + 1);
 
-        *idx = htole64(hidx + 1);
+        *idx = htole64(hidx);
 
         return 0;
 }
 
-static int link_entry_into_array_plus_one(JournalFile *f,
-                                          le64_t *extra,
-                                          le64_t *first,
-                                          le64_t *idx,
-                                          uint64_t p) {
+static int link_entry_into_array(JournalFile *f,
+                                 le64_t *first,
+                                 le64_t *idx,
+                                 uint64_t p) {
+
+        assert(p > 0);
+
+        return link_entries_into_array(f, first, idx, &p, 1);
+}
+
+static int link_entries_into_array_plus_one(JournalFile *f,
+                                            le64_t *extra,
+                                            le64_t *first,
+                                            le64_t *idx,
+                                            const uint64_t p[],
+                                            size_t n_p) {
 
         uint64_t hidx;
+        size_t skip = 0;
         int r;
 
         assert(f);
         assert(extra);
         assert(first);
         assert(idx);
-        assert(p > 0);
+        assert(p);
+        assert(n_p > 0);
 
         hidx = le64toh(READ_NOW(*idx));
-        if (hidx == UINT64_MAX)
+        if (hidx > UINT64_MAX - n_p)
                 return -EBADMSG;
-        if (hidx == 0)
-                *extra = htole64(p);
-        else {
+        if (hidx == 0) {
+                *extra = htole64(p[0]);
+                skip = 1;
+        }
+
+        if (n_p > skip) {
                 le64_t i;
 
-                i = htole64(hidx - 1);
-                r = link_entry_into_array(f, first, &i, p);
+                i = htole64(hidx + skip - 1);
+                r = link_entries_into_array(f, first, &i, p + skip, n_p - skip);
                 if (r < 0)
                         return r;
         }
 
-        *idx = htole64(hidx + 1);
+        *idx = htole64(hidx + n_p);
         return 0;
 }
 
+static int link_entry_into_array_plus_one(JournalFile *f,
+                                          le64_t *extra,
+                                          le64_t *first,
+                                          le64_t *idx,
+                                          uint64_t p) {
+
+        assert(p > 0);
+
+        return link_entries_into_array_plus_one(f, extra, first, idx, &p, 1);
+}
+
 static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offset, uint64_t i) {
         uint64_t p;
         int r;
@@ -1852,6 +2455,10 @@ static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offs
         if (r < 0)
                 return r;
 
+        /* Nobody will ever look for the entries referencing this one */
+        if (o->object.flags & OBJECT_UNINDEXED)
+                return 0;
+
         return link_entry_into_array_plus_one(f,
                                               &o->data.entry_offset,
                                               &o->data.entry_array_offset,
@@ -1900,7 +2507,7 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         return 0;
 }
 
-static int journal_file_append_entry_internal(
+static int journal_file_append_entry_object(
                 JournalFile *f,
                 const dual_timestamp *ts,
                 const sd_id128_t *boot_id,
@@ -1917,6 +2524,8 @@ static int journal_file_append_entry_internal(
         assert(f->header);
         assert(items || n_items == 0);
         assert(ts);
+        assert(ret);
+        assert(ret_offset);
 
         osize = offsetof(Object, entry.items) + (n_items * sizeof(EntryItem));
 
@@ -1939,6 +2548,28 @@ static int journal_file_append_entry_internal(
                 return r;
 #endif
 
+        *ret = o;
+        *ret_offset = np;
+
+        return 0;
+}
+
+static int journal_file_append_entry_internal(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                uint64_t xor_hash,
+                const EntryItem items[], unsigned n_items,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *ret_offset) {
+        uint64_t np;
+        Object *o;
+        int r;
+
+        r = journal_file_append_entry_object(f, ts, boot_id, xor_hash, items, n_items, seqnum, &o, &np);
+        if (r < 0)
+                return r;
+
         r = journal_file_link_entry(f, o, np);
         if (r < 0)
                 return r;
@@ -1967,6 +2598,8 @@ void journal_file_post_change(JournalFile *f) {
 
         if (ftruncate(f->fd, f->last_stat.st_size) < 0)
                 log_debug_errno(errno, "Failed to truncate file to its own size: %m");
+
+        f->post_change_last = now(CLOCK_MONOTONIC);
 }
 
 static int post_change_thunk(sd_event_source *timer, uint64_t usec, void *userdata) {
@@ -1978,6 +2611,7 @@ static int post_change_thunk(sd_event_source *timer, uint64_t usec, void *userda
 }
 
 static void schedule_post_change(JournalFile *f) {
+        usec_t n;
         int r;
 
         assert(f);
@@ -1991,7 +2625,16 @@ static void schedule_post_change(JournalFile *f) {
         if (r > 0)
                 return;
 
-        r = sd_event_source_set_time_relative(f->post_change_timer, f->post_change_timer_period);
+        /* The timer is there to limit how often followers are woken up, not to delay them. Hence, if we
+         * didn't post a change for a full period, post this one right away, and only coalesce the changes
+         * that follow within the period. */
+        n = now(CLOCK_MONOTONIC);
+        if (n >= usec_add(f->post_change_last, f->post_change_timer_period)) {
+                journal_file_post_change(f);
+                return;
+        }
+
+        r = sd_event_source_set_time(f->post_change_timer, usec_add(f->post_change_last, f->post_change_timer_period));
         if (r < 0) {
                 log_debug_errno(r, "Failed to set time for scheduling ftruncate: %m");
                 goto fail;
@@ -2127,6 +2770,323 @@ int journal_file_append_entry(
         return r;
 }
 
+typedef struct BatchData {
+        /* The payload, pointing into the caller's buffers. Doubles as the hashmap key. */
+        struct iovec iovec;
+
+        uint64_t offset;
+        le64_t hash;
+        uint64_t xor_hash;
+        bool unindexed;
+
+        /* Entries of this batch referencing this data object, in the order they were appended */
+        uint64_t *entries;
+        size_t n_entries, n_entries_allocated;
+
+        /* The number of entries the object was linked to before, in case we need to undo the linking */
+        le64_t n_entries_before;
+} BatchData;
+
+static BatchData* batch_data_free(BatchData *d) {
+        if (!d)
+                return NULL;
+
+        free(d->entries);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BatchData*, batch_data_free);
+
+static void iovec_payload_hash_func(const struct iovec *iov, struct siphash *state) {
+        siphash24_compress(&iov->iov_len, sizeof(iov->iov_len), state);
+        siphash24_compress(iov->iov_base, iov->iov_len, state);
+}
+
+static int iovec_payload_compare_func(const struct iovec *a, const struct iovec *b) {
+        return memcmp_nn(a->iov_base, a->iov_len, b->iov_base, b->iov_len);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(batch_data_hash_ops,
+                                              struct iovec, iovec_payload_hash_func, iovec_payload_compare_func,
+                                              BatchData, batch_data_free);
+
+static int batch_data_add(JournalFile *f, Hashmap *h, const struct iovec *iov, BatchData **ret) {
+        _cleanup_(batch_data_freep) BatchData *d = NULL;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(h);
+        assert(iov);
+        assert(ret);
+
+        r = journal_file_append_data(f, iov->iov_base, iov->iov_len, &o, &p);
+        if (r < 0)
+                return r;
+
+        d = new(BatchData, 1);
+        if (!d)
+                return -ENOMEM;
+
+        /* See journal_file_append_entry() for the reasoning behind the XOR hash */
+        *d = (BatchData) {
+                .iovec = *iov,
+                .offset = p,
+                .hash = o->data.hash,
+                .xor_hash = JOURNAL_HEADER_KEYED_HASH(f->header) ?
+                        jenkins_hash64(iov->iov_base, iov->iov_len) :
+                        le64toh(o->data.hash),
+                .unindexed = o->object.flags & OBJECT_UNINDEXED,
+        };
+
+        r = hashmap_put(h, &d->iovec, d);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_written) {
+
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_free_ uint64_t *offsets = NULL;
+        _cleanup_free_ EntryItem *items = NULL;
+        _cleanup_free_ BatchData **ds = NULL;
+        size_t n_items_allocated = 0, n_ds_allocated = 0, n_written = 0, i;
+        const dual_timestamp *first_ts = NULL, *last_ts = NULL;
+        dual_timestamp _ts = DUAL_TIMESTAMP_NULL;
+        BatchData *d;
+        int r = 0, k;
+
+        assert(f);
+        assert(f->header);
+        assert(entries || n_entries == 0);
+
+        /* Appends a series of entries in one go. Identical payloads in the batch are looked up in (and
+         * appended to) the data hash table only once, the entry arrays are extended once per batch rather
+         * than once per entry, and the change is posted once at the end. If something goes wrong half-way,
+         * whatever was appended before is still linked up properly, and *ret_n_written tells the caller how
+         * many entries made it, so that it can retry the rest, for example after rotating. Entries are only
+         * considered written once they are linked up completely: if that fails, the links of the whole
+         * batch are undone, so that retrying doesn't leave duplicates behind. */
+
+        if (n_entries == 0) {
+                if (ret_n_written)
+                        *ret_n_written = 0;
+                return 0;
+        }
+
+        if (f->seal) {
+                /* Tags must be interleaved with the entries they cover, hence stick to the one-by-one path
+                 * for sealed files. */
+                for (i = 0; i < n_entries; i++) {
+                        r = journal_file_append_entry(f, entries[i].ts, entries[i].boot_id,
+                                                      entries[i].iovec, entries[i].n_iovec,
+                                                      seqnum, NULL, NULL);
+                        if (r < 0)
+                                break;
+                }
+
+                if (ret_n_written)
+                        *ret_n_written = i;
+                return r < 0 ? r : 0;
+        }
+
+        offsets = new(uint64_t, n_entries);
+        if (!offsets)
+                return -ENOMEM;
+
+        h = hashmap_new(&batch_data_hash_ops);
+        if (!h)
+                return -ENOMEM;
+
+        for (i = 0; i < n_entries; i++) {
+                const JournalFileEntry *e = entries + i;
+                const dual_timestamp *ts = e->ts;
+                uint64_t xor_hash = 0, np;
+                Object *o;
+                size_t j;
+
+                assert(e->iovec || e->n_iovec == 0);
+
+                if (ts) {
+                        if (!VALID_REALTIME(ts->realtime)) {
+                                r = log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                    "Invalid realtime timestamp %" PRIu64 ", refusing entry.",
+                                                    ts->realtime);
+                                break;
+                        }
+                        if (!VALID_MONOTONIC(ts->monotonic)) {
+                                r = log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                    "Invalid monotomic timestamp %" PRIu64 ", refusing entry.",
+                                                    ts->monotonic);
+                                break;
+                        }
+                } else {
+                        if (!dual_timestamp_is_set(&_ts))
+                                dual_timestamp_get(&_ts);
+                        ts = &_ts;
+                }
+
+                if (!GREEDY_REALLOC(items, n_items_allocated, MAX((size_t) 1, e->n_iovec)) ||
+                    !GREEDY_REALLOC(ds, n_ds_allocated, MAX((size_t) 1, e->n_iovec))) {
+                        r = -ENOMEM;
+                        break;
+                }
+
+                for (j = 0; j < e->n_iovec; j++) {
+                        d = hashmap_get(h, &e->iovec[j]);
+                        if (!d) {
+                                r = batch_data_add(f, h, &e->iovec[j], &d);
+                                if (r < 0)
+                                        break;
+                        }
+
+                        xor_hash ^= d->xor_hash;
+
+                        items[j] = (EntryItem) {
+                                .object_offset = htole64(d->offset),
+                                .hash = d->hash,
+                        };
+                        ds[j] = d;
+                }
+                if (r < 0)
+                        break;
+
+                /* Order by the position on disk, in order to improve seek times for rotating media. */
+                typesafe_qsort(items, e->n_iovec, entry_item_cmp);
+
+                r = journal_file_append_entry_object(f, ts, e->boot_id, xor_hash, items, e->n_iovec, seqnum, &o, &np);
+                if (r < 0)
+                        break;
+
+                for (j = 0; j < e->n_iovec; j++) {
+                        d = ds[j];
+
+                        if (d->unindexed)
+                                continue;
+
+                        if (!GREEDY_REALLOC(d->entries, d->n_entries_allocated, d->n_entries + 1)) {
+                                r = -ENOMEM;
+                                break;
+                        }
+
+                        d->entries[d->n_entries++] = np;
+                }
+                if (r < 0)
+                        break;
+
+                offsets[n_written++] = np;
+
+                if (!first_ts)
+                        first_ts = ts;
+                last_ts = ts;
+        }
+
+        if (n_written > 0) {
+                le64_t n_entries_before = f->header->n_entries;
+                BatchData *failed = NULL;
+                bool failed_linking = false;
+
+                __sync_synchronize();
+
+                /* Link up the entries themselves. If extending the entry array fails, some of them might
+                 * have been filled into the last one already, but they are only counted on success. */
+                k = link_entries_into_array(f,
+                                            &f->header->entry_array_offset,
+                                            &f->header->n_entries,
+                                            offsets, n_written);
+                if (k < 0) {
+                        f->header->n_entries = n_entries_before;
+                        r = k;
+                        n_written = 0;
+                } else {
+                        /* And then the items, one data object at a time */
+                        HASHMAP_FOREACH(d, h) {
+                                Object *o;
+
+                                if (d->n_entries == 0)
+                                        continue;
+
+                                k = journal_file_move_to_object(f, OBJECT_DATA, d->offset, &o);
+                                if (k < 0) {
+                                        failed = d;
+                                        r = k;
+                                        break;
+                                }
+
+                                d->n_entries_before = o->data.n_entries;
+                                k = link_entries_into_array_plus_one(f,
+                                                                     &o->data.entry_offset,
+                                                                     &o->data.entry_array_offset,
+                                                                     &o->data.n_entries,
+                                                                     d->entries, d->n_entries);
+                                if (k < 0) {
+                                        failed = d;
+                                        failed_linking = true;
+                                        r = k;
+                                        break;
+                                }
+                        }
+
+                        if (failed) {
+                                /* Undo the links of all data objects up to and including the one that
+                                 * failed, in the same order, and then the entries themselves */
+                                HASHMAP_FOREACH(d, h) {
+                                        Object *o;
+
+                                        if (d->n_entries == 0)
+                                                continue;
+
+                                        if (d == failed && !failed_linking)
+                                                break;
+
+                                        /* Arrays only exist for objects with two entries or more */
+                                        if (journal_file_move_to_object(f, OBJECT_DATA, d->offset, &o) >= 0) {
+                                                o->data.n_entries = d->n_entries_before;
+                                                if (le64toh(d->n_entries_before) < 1)
+                                                        o->data.entry_offset = 0;
+                                                if (le64toh(d->n_entries_before) < 2)
+                                                        o->data.entry_array_offset = 0;
+                                        }
+
+                                        if (d == failed)
+                                                break;
+                                }
+
+                                f->header->n_entries = n_entries_before;
+                                n_written = 0;
+                        } else {
+                                if (f->header->head_entry_realtime == 0)
+                                        f->header->head_entry_realtime = htole64(first_ts->realtime);
+
+                                f->header->tail_entry_realtime = htole64(last_ts->realtime);
+                                f->header->tail_entry_monotonic = htole64(last_ts->monotonic);
+                        }
+                }
+        }
+
+        /* See journal_file_append_entry() */
+        if (mmap_cache_got_sigbus(f->mmap, f->cache_fd))
+                r = -EIO;
+
+        if (f->post_change_timer)
+                schedule_post_change(f);
+        else
+                journal_file_post_change(f);
+
+        if (ret_n_written)
+                *ret_n_written = n_written;
+
+        return r;
+}
+
 typedef struct ChainCacheItem {
         uint64_t first; /* the array at the beginning of the chain */
         uint64_t array; /* the cached array */
@@ -2605,7 +3565,7 @@ int journal_file_move_to_entry_by_seqnum(
         return generic_array_bisect(
                         f,
                         le64toh(f->header->entry_array_offset),
-                        le64toh(f->header->n_entries),
+                        journal_file_n_entries(f),
                         seqnum,
                         test_object_seqnum,
                         direction,
@@ -2645,7 +3605,7 @@ int journal_file_move_to_entry_by_realtime(
         return generic_array_bisect(
                         f,
                         le64toh(f->header->entry_array_offset),
-                        le64toh(f->header->n_entries),
+                        journal_file_n_entries(f),
                         realtime,
                         test_object_realtime,
                         direction,
@@ -2826,7 +3786,7 @@ int journal_file_next_entry(
         assert(f);
         assert(f->header);
 
-        n = le64toh(READ_NOW(f->header->n_entries));
+        n = journal_file_n_entries(f);
         if (n <= 0)
                 return 0;
 
@@ -2835,7 +3795,7 @@ int journal_file_next_entry(
         else {
                 r = generic_array_bisect(f,
                                          le64toh(f->header->entry_array_offset),
-                                         le64toh(f->header->n_entries),
+                                         n,
                                          p,
                                          test_object_offset,
                                          DIRECTION_DOWN,
@@ -2881,6 +3841,36 @@ int journal_file_next_entry(
         return 1;
 }
 
+int journal_file_freeze(JournalFile *f) {
+        uint64_t n, offset = 0;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(!f->writable);
+
+        /* Makes the file appear as it is now to readers: entries appended from here on are left out, and
+         * the header doesn't need to be looked at again for them. As the part of the file we are going to
+         * look at doesn't change anymore, let the kernel map it in right away. */
+
+        n = le64toh(READ_NOW(f->header->n_entries));
+        if (n > 0) {
+                r = journal_file_next_entry(f, 0, DIRECTION_UP, NULL, &offset);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        n = 0;
+        }
+
+        f->frozen_n_entries = n;
+        f->frozen_tail_entry_offset = offset;
+        f->frozen = true;
+
+        mmap_cache_fd_set_populate(f->cache_fd, true);
+
+        return 0;
+}
+
 int journal_file_next_entry_for_data(
                 JournalFile *f,
                 Object *o, uint64_t p,
@@ -3176,6 +4166,22 @@ void journal_file_dump(JournalFile *f) {
                                le64toh(o->tag.epoch));
                         break;
 
+                case OBJECT_BLOOM_FILTER:
+                        printf("Type: OBJECT_BLOOM_FILTER n_items=%"PRIu64" n_hashes=%"PRIu64"\n",
+                               le64toh(o->bloom_filter.n_items),
+                               le64toh(o->bloom_filter.n_hashes));
+                        break;
+
+                case OBJECT_ZSTD_DICTIONARY:
+                        printf("Type: OBJECT_ZSTD_DICTIONARY size=%"PRIu64"\n",
+                               le64toh(o->object.size) - offsetof(ZstdDictionaryObject, payload));
+                        break;
+
+                case OBJECT_FIELD_STATS:
+                        printf("Type: OBJECT_FIELD_STATS n_values=%"PRIu64"\n",
+                               le64toh(o->field_stats.n_values));
+                        break;
+
                 default:
                         printf("Type: unknown (%i)\n", o->object.type);
                         break;
@@ -3185,6 +4191,9 @@ void journal_file_dump(JournalFile *f) {
                         printf("Flags: %s\n",
                                object_compressed_to_string(o->object.flags & OBJECT_COMPRESSION_MASK));
 
+                if (o->object.flags & OBJECT_UNINDEXED)
+                        printf("Flags: unindexed\n");
+
                 if (p == le64toh(f->header->tail_object_offset))
                         p = 0;
                 else
@@ -3220,8 +4229,8 @@ void journal_file_print_header(JournalFile *f) {
                "Boot ID: %s\n"
                "Sequential number ID: %s\n"
                "State: %s\n"
-               "Compatible flags:%s%s\n"
-               "Incompatible flags:%s%s%s%s%s\n"
+               "Compatible flags:%s%s%s\n"
+               "Incompatible flags:%s%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data hash table size: %"PRIu64"\n"
@@ -3243,10 +4252,12 @@ void journal_file_print_header(JournalFile *f) {
                f->header->state == STATE_ONLINE ? "ONLINE" :
                f->header->state == STATE_ARCHIVED ? "ARCHIVED" : "UNKNOWN",
                JOURNAL_HEADER_SEALED(f->header) ? " SEALED" : "",
+               JOURNAL_HEADER_UNINDEXED(f->header) ? " UNINDEXED" : "",
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
                JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
+               JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ? " ZSTD-DICTIONARY" : "",
                JOURNAL_HEADER_KEYED_HASH(f->header) ? " KEYED-HASH" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
@@ -3280,6 +4291,12 @@ void journal_file_print_header(JournalFile *f) {
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 printf("Entry array objects: %"PRIu64"\n",
                        le64toh(f->header->n_entry_arrays));
+        if (JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset))
+                printf("Bloom filter: %s\n",
+                       yes_no(f->header->bloom_filter_offset != 0));
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_stats_offset))
+                printf("Field statistics: %s\n",
+                       yes_no(f->header->field_stats_offset != 0));
 
         if (JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth))
                 printf("Deepest field hash chain: %" PRIu64"\n",
@@ -3381,6 +4398,7 @@ int journal_file_open(
 #if HAVE_GCRYPT
                 .seal = seal,
 #endif
+                .files_heap_idx = PRIOQ_IDX_NULL,
         };
 
         /* We turn on keyed hashes by default, but provide an environment variable to turn them off, if
@@ -3495,117 +4513,603 @@ int journal_file_open(
                 }
 #endif
 
-                r = journal_file_init_header(f, template);
+                r = journal_file_init_header(f, template);
+                if (r < 0)
+                        goto fail;
+
+                r = journal_file_fstat(f);
+                if (r < 0)
+                        goto fail;
+
+                newly_created = true;
+        }
+
+        if (f->last_stat.st_size < (off_t) HEADER_SIZE_MIN) {
+                r = -ENODATA;
+                goto fail;
+        }
+
+        r = mmap_cache_get(f->mmap, f->cache_fd, f->prot, f->mmap_contexts + CONTEXT_HEADER, true, 0, PAGE_ALIGN(sizeof(Header)), &f->last_stat, &h, NULL);
+        if (r == -EINVAL) {
+                /* Some file systems (jffs2 or p9fs) don't support mmap() properly (or only read-only
+                 * mmap()), and return EINVAL in that case. Let's propagate that as a more recognizable error
+                 * code. */
+                r = -EAFNOSUPPORT;
+                goto fail;
+        }
+        if (r < 0)
+                goto fail;
+
+        f->header = h;
+
+        if (!newly_created) {
+                set_clear_with_destructor(deferred_closes, journal_file_close);
+
+                r = journal_file_verify_header(f);
+                if (r < 0)
+                        goto fail;
+        }
+
+#if HAVE_GCRYPT
+        if (!newly_created && f->writable) {
+                r = journal_file_fss_load(f);
+                if (r < 0)
+                        goto fail;
+        }
+#endif
+
+        if (f->writable) {
+                if (metrics) {
+                        journal_default_metrics(metrics, f->fd);
+                        f->metrics = *metrics;
+                } else if (template)
+                        f->metrics = template->metrics;
+
+                if (template) {
+                        f->unindexed_fields = template->unindexed_fields;
+                        f->stats_fields = template->stats_fields;
+                }
+
+                r = journal_file_refresh_header(f);
+                if (r < 0)
+                        goto fail;
+        }
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_setup(f);
+        if (r < 0)
+                goto fail;
+#endif
+
+        if (newly_created) {
+                r = journal_file_setup_field_hash_table(f);
+                if (r < 0)
+                        goto fail;
+
+                r = journal_file_setup_data_hash_table(f, template);
+                if (r < 0)
+                        goto fail;
+
+#if HAVE_ZSTD
+                r = journal_file_inherit_zstd_dictionary(f, template);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to copy zstd dictionary from %s, ignoring: %m", template->path);
+#endif
+
+#if HAVE_GCRYPT
+                r = journal_file_append_first_tag(f);
+                if (r < 0)
+                        goto fail;
+#endif
+        }
+
+        if (mmap_cache_got_sigbus(f->mmap, f->cache_fd)) {
+                r = -EIO;
+                goto fail;
+        }
+
+        if (template && template->post_change_timer) {
+                r = journal_file_enable_post_change_timer(
+                                f,
+                                sd_event_source_get_event(template->post_change_timer),
+                                template->post_change_timer_period);
+
+                if (r < 0)
+                        goto fail;
+        }
+
+        /* The file is opened now successfully, thus we take possession of any passed in fd. */
+        f->close_fd = true;
+
+        *ret = f;
+        return 0;
+
+fail:
+        if (f->cache_fd && mmap_cache_got_sigbus(f->mmap, f->cache_fd))
+                r = -EIO;
+
+        (void) journal_file_close(f);
+
+        return r;
+}
+
+int journal_file_open_shared(JournalFile *template, unsigned mmap_contexts, JournalFile **ret) {
+        _cleanup_(journal_file_closep) JournalFile *f = NULL;
+
+        assert(template);
+        assert(template->header);
+        assert(!template->writable);
+        assert(ret);
+
+        /* Opens another read-only JournalFile object for the file of the template, which shares the
+         * template's memory maps (and hence also the header, which was verified already when the template
+         * was opened), but may be used independently of it, from another thread even, as long as the mmap
+         * cache was made thread-safe. Besides the memory maps each object has its own state, in particular
+         * the decompression buffers, which are not safe to share. */
+
+        f = new(JournalFile, 1);
+        if (!f)
+                return -ENOMEM;
+
+        *f = (JournalFile) {
+                .fd = -1,
+                .mode = template->mode,
+                .flags = template->flags,
+                .prot = template->prot,
+                .keyed_hash = template->keyed_hash,
+                .frozen = template->frozen,
+                .frozen_n_entries = template->frozen_n_entries,
+                .frozen_tail_entry_offset = template->frozen_tail_entry_offset,
+                .last_stat = template->last_stat,
+                .last_stat_usec = template->last_stat_usec,
+                .header = template->header,
+                .mmap_contexts = mmap_contexts,
+                .compress_threshold_bytes = template->compress_threshold_bytes,
+                .files_heap_idx = PRIOQ_IDX_NULL,
+        };
+
+        f->path = strdup(template->path);
+        if (!f->path)
+                return -ENOMEM;
+
+        f->chain_cache = ordered_hashmap_new(&uint64_hash_ops);
+        if (!f->chain_cache)
+                return -ENOMEM;
+
+        /* Our own fd, for fstat() and friends, so that we don't depend on the template staying around */
+        f->fd = fcntl(template->fd, F_DUPFD_CLOEXEC, 3);
+        if (f->fd < 0)
+                return -errno;
+        f->close_fd = true;
+
+        f->mmap = mmap_cache_ref(template->mmap);
+
+        f->cache_fd = mmap_cache_fd_ref(f->mmap, template->cache_fd);
+        if (!f->cache_fd)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(f);
+        return 0;
+}
+
+static uint64_t bloom_filter_bit(uint64_t hash, uint64_t i, uint64_t n_bits) {
+        /* Derive all bit indexes from the two halves of the 64bit hash (Kirsch-Mitzenmacher double hashing),
+         * n_bits must be a power of two. */
+        return ((hash & UINT32_MAX) + i * ((hash >> 32) | 1)) & (n_bits - 1);
+}
+
+static int journal_file_append_bloom_filter(JournalFile *f) {
+        _cleanup_free_ uint8_t *bits = NULL;
+        uint64_t n_data, n_items = 0, n_buckets, size, i, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Summarizes the hashes of all DATA objects in a bloom filter, so that readers may quickly tell
+         * whether a match could possibly be satisfied by this file, without walking its data hash table. This
+         * is done once when the file is archived, as its set of DATA objects never changes afterwards. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset))
+                return 0;
+        if (f->header->bloom_filter_offset != 0)
+                return 0;
+
+        /* Don't append anything after the last tag, as that would make the file look tampered with */
+        if (JOURNAL_HEADER_SEALED(f->header))
+                return 0;
+
+        n_data = le64toh(f->header->n_data);
+        if (n_data <= 0)
+                return 0;
+
+        size = BLOOM_FILTER_SIZE_MIN;
+        while (size < BLOOM_FILTER_SIZE_MAX && size * 8 < n_data * BLOOM_FILTER_BITS_PER_ITEM)
+                size <<= 1;
+
+        /* If the file is size limited, take no more than half of what is left, the rest is for the field
+         * summaries. A fuller filter still helps. */
+        if (f->metrics.max_size > 0) {
+                uint64_t end, left;
+
+                r = journal_file_tail_end(f, &end);
+                if (r < 0)
+                        return r;
+
+                left = LESS_BY(f->metrics.max_size, end);
+                while (size > BLOOM_FILTER_SIZE_MIN && offsetof(BloomFilterObject, bits) + size > left / 2)
+                        size >>= 1;
+        }
+
+        bits = new0(uint8_t, size);
+        if (!bits)
+                return -ENOMEM;
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
+
+        n_buckets = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+        for (i = 0; i < n_buckets; i++) {
+                p = le64toh(f->data_hash_table[i].head_hash_offset);
+
+                while (p > 0) {
+                        uint64_t h, k;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        h = le64toh(o->data.hash);
+                        for (k = 0; k < BLOOM_FILTER_N_HASHES; k++) {
+                                uint64_t b = bloom_filter_bit(h, k, size * 8);
+
+                                bits[b / 8] |= 1U << (b % 8);
+                        }
+
+                        n_items++;
+                        p = le64toh(o->data.next_hash_offset);
+                }
+        }
+
+        r = journal_file_append_object(f, OBJECT_BLOOM_FILTER, offsetof(BloomFilterObject, bits) + size, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->bloom_filter.n_hashes = htole64(BLOOM_FILTER_N_HASHES);
+        o->bloom_filter.n_items = htole64(n_items);
+        memcpy(o->bloom_filter.bits, bits, size);
+
+        f->header->bloom_filter_offset = htole64(p);
+
+        return 0;
+}
+
+int journal_file_bloom_filter_test(JournalFile *f, uint64_t hash) {
+        uint64_t p, n_bits, n_hashes, k;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns 0 if the file definitely contains no DATA object with the specified hash, and > 0 if it
+         * might, which includes the case of a file that carries no bloom filter at all. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset))
+                return 1;
+
+        p = le64toh(READ_NOW(f->header->bloom_filter_offset));
+        if (p == 0)
+                return 1;
+
+        r = journal_file_move_to_object(f, OBJECT_BLOOM_FILTER, p, &o);
+        if (r < 0)
+                return r;
+
+        n_bits = (le64toh(o->object.size) - offsetof(BloomFilterObject, bits)) * 8;
+        n_hashes = le64toh(o->bloom_filter.n_hashes);
+
+        for (k = 0; k < n_hashes; k++) {
+                uint64_t b = bloom_filter_bit(hash, k, n_bits);
+
+                if (!(o->bloom_filter.bits[b / 8] & (1U << (b % 8))))
+                        return 0;
+        }
+
+        return 1;
+}
+
+typedef struct FieldStatsItem {
+        void *data;
+        size_t size;
+        uint64_t hash;
+        uint64_t n_entries;
+        uint64_t first_realtime;
+        uint64_t last_realtime;
+} FieldStatsItem;
+
+static int field_stats_item_compare(const FieldStatsItem *a, const FieldStatsItem *b) {
+        return memcmp_nn(a->data, a->size, b->data, b->size);
+}
+
+static void field_stats_items_free(FieldStatsItem *items, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(items[i].data);
+        free(items);
+}
+
+static int journal_file_entry_realtime_for_data(JournalFile *f, uint64_t p, direction_t direction, uint64_t *ret) {
+        Object *o;
+        int r;
+
+        r = journal_file_next_entry_for_data(f, NULL, 0, p, direction, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        *ret = le64toh(o->entry.realtime);
+        return 1;
+}
+
+static int journal_file_append_field_stats_object(JournalFile *f, const char *field, uint64_t *head) {
+        FieldStatsItem *items = NULL;
+        size_t n_items = 0, n_allocated = 0, field_size, values_size = 0, i;
+        uint64_t p, end = 0;
+        uint8_t *strings;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(field);
+        assert(head);
+
+        field_size = strlen(field);
+
+        r = journal_file_find_field_object(f, field, field_size, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        for (p = le64toh(o->field.head_data_offset); p > 0;) {
+                FieldStatsItem item = {};
+                uint64_t l, next;
+
+                if (n_items >= FIELD_STATS_N_VALUES_MAX) {
+                        r = -E2BIG;
+                        goto finish;
+                }
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        goto finish;
+
+                next = le64toh(o->data.next_field_offset);
+                item.hash = le64toh(o->data.hash);
+                item.n_entries = le64toh(o->data.n_entries);
+
+                /* Data objects whose entry failed to be appended are not linked to any entry */
+                if (item.n_entries <= 0) {
+                        p = next;
+                        continue;
+                }
+
+                l = le64toh(o->object.size) - offsetof(Object, data.payload);
+                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+#if HAVE_COMPRESSION
+                        size_t rsize = 0;
+
+                        r = journal_file_decompress_blob(f, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                         o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
+                        if (r < 0)
+                                goto finish;
+
+                        item.data = memdup(f->compress_buffer, rsize);
+                        item.size = rsize;
+#else
+                        r = -EPROTONOSUPPORT;
+                        goto finish;
+#endif
+                } else {
+                        item.data = memdup(o->data.payload, l);
+                        item.size = l;
+                }
+                if (!item.data) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                if (!GREEDY_REALLOC(items, n_allocated, n_items + 1)) {
+                        free(item.data);
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                items[n_items++] = item;
+
+                values_size += item.size;
+                if (values_size > FIELD_STATS_SIZE_MAX) {
+                        r = -E2BIG;
+                        goto finish;
+                }
+
+                r = journal_file_entry_realtime_for_data(f, p, DIRECTION_DOWN, &items[n_items - 1].first_realtime);
                 if (r < 0)
-                        goto fail;
+                        goto finish;
 
-                r = journal_file_fstat(f);
+                r = journal_file_entry_realtime_for_data(f, p, DIRECTION_UP, &items[n_items - 1].last_realtime);
                 if (r < 0)
-                        goto fail;
+                        goto finish;
 
-                newly_created = true;
+                p = next;
         }
 
-        if (f->last_stat.st_size < (off_t) HEADER_SIZE_MIN) {
-                r = -ENODATA;
-                goto fail;
+        if (n_items <= 0) {
+                r = 0;
+                goto finish;
         }
 
-        r = mmap_cache_get(f->mmap, f->cache_fd, f->prot, CONTEXT_HEADER, true, 0, PAGE_ALIGN(sizeof(Header)), &f->last_stat, &h, NULL);
-        if (r == -EINVAL) {
-                /* Some file systems (jffs2 or p9fs) don't support mmap() properly (or only read-only
-                 * mmap()), and return EINVAL in that case. Let's propagate that as a more recognizable error
-                 * code. */
-                r = -EAFNOSUPPORT;
-                goto fail;
-        }
+        typesafe_qsort(items, n_items, field_stats_item_compare);
+
+        r = journal_file_append_object(f, OBJECT_FIELD_STATS,
+                                       offsetof(Object, field_stats.payload) +
+                                       n_items * _FIELD_STATS_COLUMN_MAX * sizeof(le64_t) +
+                                       field_size + values_size,
+                                       &o, &p);
         if (r < 0)
-                goto fail;
+                goto finish;
 
-        f->header = h;
+        o->field_stats.next_field_stats_offset = htole64(*head);
+        o->field_stats.n_values = htole64(n_items);
+        o->field_stats.field_size = htole64(field_size);
 
-        if (!newly_created) {
-                set_clear_with_destructor(deferred_closes, journal_file_close);
+        strings = (uint8_t*) o + offsetof(Object, field_stats.payload) + n_items * _FIELD_STATS_COLUMN_MAX * sizeof(le64_t);
+        strings = mempcpy(strings, field, field_size);
 
-                r = journal_file_verify_header(f);
-                if (r < 0)
-                        goto fail;
-        }
+        for (i = 0; i < n_items; i++) {
+                o->field_stats.payload[FIELD_STATS_HASH * n_items + i] = htole64(items[i].hash);
+                o->field_stats.payload[FIELD_STATS_N_ENTRIES * n_items + i] = htole64(items[i].n_entries);
+                o->field_stats.payload[FIELD_STATS_FIRST_REALTIME * n_items + i] = htole64(items[i].first_realtime);
+                o->field_stats.payload[FIELD_STATS_LAST_REALTIME * n_items + i] = htole64(items[i].last_realtime);
 
-#if HAVE_GCRYPT
-        if (!newly_created && f->writable) {
-                r = journal_file_fss_load(f);
-                if (r < 0)
-                        goto fail;
+                memcpy(strings + end, items[i].data, items[i].size);
+                end += items[i].size;
+                o->field_stats.payload[FIELD_STATS_VALUE_END * n_items + i] = htole64(end);
         }
-#endif
 
-        if (f->writable) {
-                if (metrics) {
-                        journal_default_metrics(metrics, f->fd);
-                        f->metrics = *metrics;
-                } else if (template)
-                        f->metrics = template->metrics;
+        *head = p;
+        r = 1;
 
-                r = journal_file_refresh_header(f);
-                if (r < 0)
-                        goto fail;
-        }
+finish:
+        field_stats_items_free(items, n_items);
+        return r;
+}
 
-#if HAVE_GCRYPT
-        r = journal_file_hmac_setup(f);
-        if (r < 0)
-                goto fail;
-#endif
+static int journal_file_append_field_stats(JournalFile *f) {
+        uint64_t head = 0;
+        char **field;
+        int r = 0;
 
-        if (newly_created) {
-                r = journal_file_setup_field_hash_table(f);
-                if (r < 0)
-                        goto fail;
+        assert(f);
+        assert(f->header);
 
-                r = journal_file_setup_data_hash_table(f);
-                if (r < 0)
-                        goto fail;
+        /* Summarizes the values of the configured fields together with the number of entries they occur in
+         * and the time range they cover. Like the bloom filter this is done once, when the file is archived,
+         * so that listing the values of these fields does not need to walk and decompress their data
+         * objects file by file anymore. */
 
-#if HAVE_GCRYPT
-                r = journal_file_append_first_tag(f);
+        if (!JOURNAL_HEADER_CONTAINS(f->header, field_stats_offset))
+                return 0;
+        if (f->header->field_stats_offset != 0)
+                return 0;
+
+        /* Don't append anything after the last tag, as that would make the file look tampered with */
+        if (JOURNAL_HEADER_SEALED(f->header))
+                return 0;
+
+        STRV_FOREACH(field, f->stats_fields) {
+                r = journal_file_append_field_stats_object(f, *field, &head);
+                if (r == -E2BIG) {
+                        /* Either the field has too many values, or there's no room left in the file for
+                         * them. A later field might still be small enough. */
+                        log_debug("Field %s of %s has too many values to fit, not summarizing it.", *field, f->path);
+                        r = 0;
+                        continue;
+                }
                 if (r < 0)
-                        goto fail;
-#endif
+                        break;
         }
 
-        if (mmap_cache_got_sigbus(f->mmap, f->cache_fd)) {
-                r = -EIO;
-                goto fail;
-        }
+        /* Whatever was appended completely is usable */
+        f->header->field_stats_offset = htole64(head);
 
-        if (template && template->post_change_timer) {
-                r = journal_file_enable_post_change_timer(
-                                f,
-                                sd_event_source_get_event(template->post_change_timer),
-                                template->post_change_timer_period);
+        return r < 0 ? r : 0;
+}
+
+int journal_file_find_field_stats(
+                JournalFile *f,
+                const void *field, uint64_t size,
+                Object **ret, uint64_t *ret_offset) {
+
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(field);
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, field_stats_offset))
+                return 0;
+
+        p = le64toh(READ_NOW(f->header->field_stats_offset));
+        while (p > 0) {
+                uint64_t n;
 
+                r = journal_file_move_to_object(f, OBJECT_FIELD_STATS, p, &o);
                 if (r < 0)
-                        goto fail;
-        }
+                        return r;
 
-        /* The file is opened now successfully, thus we take possession of any passed in fd. */
-        f->close_fd = true;
+                n = le64toh(o->field_stats.n_values);
+                if (le64toh(o->field_stats.field_size) == size &&
+                    memcmp((const uint8_t*) o + offsetof(Object, field_stats.payload) + n * _FIELD_STATS_COLUMN_MAX * sizeof(le64_t),
+                           field, size) == 0) {
+                        if (ret)
+                                *ret = o;
+                        if (ret_offset)
+                                *ret_offset = p;
+                        return 1;
+                }
+
+                /* The offsets decrease along the chain, as checked by journal_file_check_object() */
+                p = le64toh(o->field_stats.next_field_stats_offset);
+        }
 
-        *ret = f;
         return 0;
+}
 
-fail:
-        if (f->cache_fd && mmap_cache_got_sigbus(f->mmap, f->cache_fd))
-                r = -EIO;
+int journal_file_field_stats_value(Object *o, uint64_t i, FieldStatsValue *ret) {
+        const uint8_t *values;
+        uint64_t n, field_size, sz, start, end;
 
-        (void) journal_file_close(f);
+        assert(o);
+        assert(o->object.type == OBJECT_FIELD_STATS);
+        assert(ret);
 
-        return r;
+        /* Returns the i-th value of the field statistics object, or 0 if there are fewer values */
+
+        n = le64toh(o->field_stats.n_values);
+        if (i >= n)
+                return 0;
+
+        field_size = le64toh(o->field_stats.field_size);
+        values = (const uint8_t*) o + offsetof(Object, field_stats.payload) + n * _FIELD_STATS_COLUMN_MAX * sizeof(le64_t) + field_size;
+
+        /* What is left for the values, journal_file_check_object() made sure this doesn't underflow */
+        sz = le64toh(o->object.size) - offsetof(FieldStatsObject, payload) -
+                n * _FIELD_STATS_COLUMN_MAX * sizeof(le64_t) - field_size;
+
+        start = i > 0 ? le64toh(o->field_stats.payload[FIELD_STATS_VALUE_END * n + i - 1]) : 0;
+        end = le64toh(o->field_stats.payload[FIELD_STATS_VALUE_END * n + i]);
+        if (end < start || end > sz || end - start <= field_size)
+                return -EBADMSG;
+
+        *ret = (FieldStatsValue) {
+                .data = values + start,
+                .size = end - start,
+                .hash = le64toh(o->field_stats.payload[FIELD_STATS_HASH * n + i]),
+                .n_entries = le64toh(o->field_stats.payload[FIELD_STATS_N_ENTRIES * n + i]),
+                .first_realtime = le64toh(o->field_stats.payload[FIELD_STATS_FIRST_REALTIME * n + i]),
+                .last_realtime = le64toh(o->field_stats.payload[FIELD_STATS_LAST_REALTIME * n + i]),
+        };
+
+        return 1;
 }
 
 int journal_file_archive(JournalFile *f) {
         _cleanup_free_ char *p = NULL;
+        int r;
 
         assert(f);
 
@@ -3627,6 +5131,21 @@ int journal_file_archive(JournalFile *f) {
                      le64toh(f->header->head_entry_realtime)) < 0)
                 return -ENOMEM;
 
+        /* The set of DATA objects is final from now on, hence summarize it for readers. This is purely an
+         * optimization, hence don't fail if it doesn't work. Both may use the space that was reserved for
+         * them. */
+        f->archiving = true;
+
+        r = journal_file_append_bloom_filter(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to append bloom filter to %s, ignoring: %m", f->path);
+
+        r = journal_file_append_field_stats(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to append field statistics to %s, ignoring: %m", f->path);
+
+        f->archiving = false;
+
         /* Try to rename the file to the archived version. If the file already was deleted, we'll get ENOENT, let's
          * ignore that case. */
         if (rename(f->path, p) < 0 && errno != ENOENT)
@@ -3671,6 +5190,111 @@ JournalFile* journal_initiate_close(
         return journal_file_close(f);
 }
 
+int journal_file_prepare_rotation(
+                JournalFile *f,
+                bool compress,
+                uint64_t compress_threshold_bytes,
+                bool seal) {
+
+        _cleanup_free_ char *tmp = NULL;
+        _cleanup_close_ int fd = -1;
+        JournalFile *p = NULL;
+        const char *fn;
+        int r;
+
+        assert(f);
+
+        /* Creates the file that replaces this one when it is rotated, with the header initialized and the
+         * hash tables allocated, so that journal_file_rotate() only needs to link it into place. */
+
+        if (!f->writable)
+                return -EINVAL;
+
+        if (path_startswith(f->path, "/proc/self/fd") || !endswith(f->path, ".journal"))
+                return -EINVAL;
+
+        if (f->prepared)
+                return 0;
+
+        /* We can't use O_TMPFILE, as we refuse to deal with files that have no links. Hence use a fixed
+         * hidden name, which readers ignore, and which we just reuse if we crashed before rotating. */
+        fn = basename(f->path);
+        if (asprintf(&tmp, "%.*s.#%s~prepared", (int) (fn - f->path), f->path, fn) < 0)
+                return -ENOMEM;
+
+        fd = open(tmp, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, f->mode);
+        if (fd < 0)
+                return -errno;
+
+        r = journal_file_open(
+                        fd,
+                        f->path,
+                        f->flags,
+                        f->mode,
+                        compress,
+                        compress_threshold_bytes,
+                        seal,
+                        NULL,            /* metrics */
+                        f->mmap,
+                        NULL,            /* deferred_closes */
+                        f,               /* template */
+                        &p);
+        if (r < 0)
+                goto fail;
+
+        TAKE_FD(fd);
+        p->prepared_tmp_path = TAKE_PTR(tmp);
+        f->prepared = p;
+
+        log_debug("Prepared replacement for journal file %s.", f->path);
+        return 0;
+
+fail:
+        if (tmp)
+                (void) unlink(tmp);
+
+        return r;
+}
+
+static int journal_file_take_prepared(JournalFile *f, bool compress, bool seal, JournalFile **ret) {
+        JournalFile *p;
+        int r;
+
+        assert(f);
+        assert(f->prepared);
+        assert(ret);
+
+        p = TAKE_PTR(f->prepared);
+
+        /* The settings might have been changed since the file was prepared */
+        if (JOURNAL_FILE_COMPRESS(p) != compress || (p->seal && !seal)) {
+                journal_file_discard_prepared(p);
+                return -ESTALE;
+        }
+
+        /* The archived file has been renamed away already, hence this won't replace anything */
+        r = rename_noreplace(AT_FDCWD, p->prepared_tmp_path, AT_FDCWD, p->path);
+        if (r < 0) {
+                journal_file_discard_prepared(p);
+                return r;
+        }
+
+        p->prepared_tmp_path = mfree(p->prepared_tmp_path);
+
+        /* Continue where the archived file left off, which might have been written to since we copied this
+         * from it */
+        p->header->tail_entry_seqnum = f->header->tail_entry_seqnum;
+        p->unindexed_fields = f->unindexed_fields;
+        p->stats_fields = f->stats_fields;
+
+        /* The creation time is supposed to be the time the file showed up */
+        (void) fd_setcrtime(p->fd, 0);
+        (void) fsync_directory_of_file(p->fd);
+
+        *ret = p;
+        return 0;
+}
+
 int journal_file_rotate(
                 JournalFile **f,
                 bool compress,
@@ -3688,6 +5312,17 @@ int journal_file_rotate(
         if (r < 0)
                 return r;
 
+        if ((*f)->prepared) {
+                r = journal_file_take_prepared(*f, compress, seal, &new_file);
+                if (r >= 0) {
+                        journal_initiate_close(*f, deferred_closes);
+                        *f = new_file;
+                        return 0;
+                }
+
+                log_debug_errno(r, "Failed to use prepared replacement for %s, creating a new file: %m", (*f)->path);
+        }
+
         r = journal_file_open(
                         -1,
                         (*f)->path,
@@ -3792,13 +5427,90 @@ int journal_file_open_reliably(
                                  deferred_closes, template, ret);
 }
 
-int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p) {
+/* Bound the memory we use for this, the DATA objects that repeat the most show up early anyway */
+#define COPY_CACHE_ITEMS_MAX (256U*1024U)
+
+typedef struct JournalCopyCacheItem {
+        uint64_t from_offset;
+        le64_t from_hash;
+        le64_t to_offset;
+        le64_t to_hash;
+        uint64_t xor_hash;
+} JournalCopyCacheItem;
+
+void journal_copy_cache_done(JournalCopyCache *c) {
+        Hashmap *m;
+
+        assert(c);
+
+        while ((m = hashmap_steal_first(c->by_file)))
+                hashmap_free_free(m);
+
+        c->by_file = hashmap_free(c->by_file);
+        c->n_items = 0;
+}
+
+static Hashmap* journal_copy_cache_get(JournalCopyCache *c, JournalFile *from, JournalFile *to) {
+        Hashmap *m;
+
+        assert(c);
+        assert(from);
+        assert(to);
+
+        /* The offsets are only good for the file they were found in */
+        if (!sd_id128_equal(c->to_file_id, to->header->file_id)) {
+                journal_copy_cache_done(c);
+                c->to_file_id = to->header->file_id;
+        }
+
+        m = hashmap_get(c->by_file, from);
+        if (m)
+                return m;
+
+        if (hashmap_ensure_allocated(&c->by_file, NULL) < 0)
+                return NULL;
+
+        m = hashmap_new(&uint64_hash_ops);
+        if (!m)
+                return NULL;
+
+        if (hashmap_put(c->by_file, from, m) < 0)
+                return hashmap_free(m);
+
+        return m;
+}
+
+static void journal_copy_cache_add(JournalCopyCache *c, Hashmap *m, const JournalCopyCacheItem *item) {
+        JournalCopyCacheItem *copy;
+
+        assert(c);
+        assert(item);
+
+        /* Purely an optimization, hence it's OK if this doesn't work */
+
+        if (!m || c->n_items >= COPY_CACHE_ITEMS_MAX)
+                return;
+
+        copy = newdup(JournalCopyCacheItem, item, 1);
+        if (!copy)
+                return;
+
+        if (hashmap_put(m, &copy->from_offset, copy) < 0) {
+                free(copy);
+                return;
+        }
+
+        c->n_items++;
+}
+
+int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, JournalCopyCache *cache) {
         uint64_t i, n;
         uint64_t q, xor_hash = 0;
         int r;
         EntryItem *items;
         dual_timestamp ts;
         const sd_id128_t *boot_id;
+        Hashmap *m = NULL;
 
         assert(from);
         assert(to);
@@ -3808,6 +5520,9 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         if (!to->writable)
                 return -EPERM;
 
+        if (cache)
+                m = journal_copy_cache_get(cache, from, to);
+
         ts.monotonic = le64toh(o->entry.monotonic);
         ts.realtime = le64toh(o->entry.realtime);
         boot_id = &o->entry.boot_id;
@@ -3817,7 +5532,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         items = newa(EntryItem, MAX(1u, n));
 
         for (i = 0; i < n; i++) {
-                uint64_t l, h;
+                uint64_t l, h, x;
                 le64_t le_hash;
                 size_t t;
                 void *data;
@@ -3826,6 +5541,22 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 q = le64toh(o->entry.items[i].object_offset);
                 le_hash = o->entry.items[i].hash;
 
+                if (m) {
+                        const JournalCopyCacheItem *hit;
+
+                        hit = hashmap_get(m, &q);
+                        if (hit && hit->from_hash == le_hash) {
+                                items[i].object_offset = hit->to_offset;
+                                items[i].hash = hit->to_hash;
+                                xor_hash ^= hit->xor_hash;
+
+                                cache->n_hits++;
+                                continue;
+                        }
+
+                        cache->n_misses++;
+                }
+
                 r = journal_file_move_to_object(from, OBJECT_DATA, q, &o);
                 if (r < 0)
                         return r;
@@ -3848,8 +5579,8 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
 #if HAVE_COMPRESSION
                         size_t rsize = 0;
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
-                                            o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
+                        r = journal_file_decompress_blob(from, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                         o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
 
@@ -3866,13 +5597,24 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return r;
 
                 if (JOURNAL_HEADER_KEYED_HASH(to->header))
-                        xor_hash ^= jenkins_hash64(data, l);
+                        x = jenkins_hash64(data, l);
                 else
-                        xor_hash ^= le64toh(u->data.hash);
+                        x = le64toh(u->data.hash);
+
+                xor_hash ^= x;
 
                 items[i].object_offset = htole64(h);
                 items[i].hash = u->data.hash;
 
+                if (m)
+                        journal_copy_cache_add(cache, m, &(const JournalCopyCacheItem) {
+                                        .from_offset = q,
+                                        .from_hash = le_hash,
+                                        .to_offset = items[i].object_offset,
+                                        .to_hash = items[i].hash,
+                                        .xor_hash = x,
+                                });
+
                 r = journal_file_move_to_object(from, OBJECT_ENTRY, p, &o);
                 if (r < 0)
                         return r;
@@ -4045,6 +5787,39 @@ int journal_file_get_cutoff_monotonic_usec(JournalFile *f, sd_id128_t boot_id, u
         return 1;
 }
 
+bool journal_file_rotate_soon(JournalFile *f, usec_t max_file_usec) {
+        assert(f);
+        assert(f->header);
+
+        /* Returns true if the file is getting close to one of the limits that will make
+         * journal_file_rotate_suggested() return true, or to its maximum size, so that its replacement should
+         * be prepared. Not too early though, as the size of the replacement's data hash table is derived from
+         * the number of data objects in this one. */
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
+            le64toh(f->header->n_data) * 2ULL > le64toh(f->header->data_hash_table_size) / sizeof(HashItem))
+                return true;
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_fields) &&
+            le64toh(f->header->n_fields) * 2ULL > le64toh(f->header->field_hash_table_size) / sizeof(HashItem))
+                return true;
+
+        /* The arena is allocated in large steps, hence look at where the objects actually end */
+        if (f->metrics.max_size > 0 &&
+            le64toh(f->header->tail_object_offset) > f->metrics.max_size / 4 * 3)
+                return true;
+
+        if (max_file_usec > 0) {
+                usec_t h;
+
+                h = le64toh(f->header->head_entry_realtime);
+                if (h > 0 && now(CLOCK_REALTIME) > h + max_file_usec / 4 * 3)
+                        return true;
+        }
+
+        return false;
+}
+
 bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
         assert(f);
         assert(f->header);
@@ -11,6 +11,7 @@
 #include "sd-event.h"
 #include "sd-id128.h"
 
+#include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "mmap-cache.h"
@@ -73,11 +74,17 @@ typedef struct JournalFile {
         bool close_fd:1;
         bool archive:1;
         bool keyed_hash:1;
+        bool frozen:1;
+        bool archiving:1;
 
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
 
+        /* Set by journal_file_freeze(): entries appended later are not iterated over */
+        uint64_t frozen_n_entries;
+        uint64_t frozen_tail_entry_offset;
+
         char *path;
         struct stat last_stat;
         usec_t last_stat_usec;
@@ -94,24 +101,55 @@ typedef struct JournalFile {
         uint64_t current_xor_hash;
 
         JournalMetrics metrics;
+
+        /* Fields (names without the "=") whose data objects are stored without indexing them, i.e. they
+         * can be read back from entries but not matched on. Not owned by us. */
+        char **unindexed_fields;
+        /* Fields whose values are summarized with their entry counts when the file is archived. Not owned
+         * by us either. */
+        char **stats_fields;
         MMapCache *mmap;
+        /* Offset of the set of mmap cache contexts we use, non-zero for files opened with
+         * journal_file_open_shared() */
+        unsigned mmap_contexts;
 
         sd_event_source *post_change_timer;
         usec_t post_change_timer_period;
+        usec_t post_change_last;  /* CLOCK_MONOTONIC timestamp of the last journal_file_post_change() */
 
         OrderedHashmap *chain_cache;
 
         pthread_t offline_thread;
         volatile OfflineState offline_state;
 
+        /* Set up ahead of time to replace this file when it is rotated, see journal_file_prepare_rotation().
+         * Until then the prepared file lives under the hidden name in its prepared_tmp_path. */
+        struct JournalFile *prepared;
+        char *prepared_tmp_path;
+
         unsigned last_seen_generation;
 
+        /* Index in sd_journal's heap of files with a candidate entry */
+        unsigned files_heap_idx;
+
         uint64_t compress_threshold_bytes;
 #if HAVE_COMPRESSION
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
 
+#if HAVE_ZSTD
+        /* The dictionary of the file, loaded on first use, or trained by the writer from the payloads
+         * collected in zstd_samples while the file has none yet. */
+        ZstdDictionary *zstd_dictionary;
+        uint8_t *zstd_samples;
+        size_t zstd_samples_size;
+        size_t *zstd_sample_sizes;
+        size_t n_zstd_samples;
+        bool zstd_samples_done;
+        sd_event_source *zstd_train_event_source; /* trains the dictionary once the loop is idle */
+#endif
+
 #if HAVE_GCRYPT
         gcry_md_hd_t hmac;
         bool hmac_running;
@@ -127,6 +165,8 @@ typedef struct JournalFile {
 
         void *fsprg_seed;
         size_t fsprg_seed_size;
+
+        void *fsprg_msk; /* derived from the seed on first use, expensive to generate */
 #endif
 } JournalFile;
 
@@ -144,6 +184,8 @@ int journal_file_open(
                 JournalFile *template,
                 JournalFile **ret);
 
+int journal_file_open_shared(JournalFile *template, unsigned mmap_contexts, JournalFile **ret);
+
 int journal_file_set_offline(JournalFile *f, bool wait);
 bool journal_file_is_offlining(JournalFile *f);
 JournalFile* journal_file_close(JournalFile *j);
@@ -191,6 +233,9 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_SEALED(h) \
         FLAGS_SET(le32toh((h)->compatible_flags), HEADER_COMPATIBLE_SEALED)
 
+#define JOURNAL_HEADER_UNINDEXED(h) \
+        FLAGS_SET(le32toh((h)->compatible_flags), HEADER_COMPATIBLE_UNINDEXED)
+
 #define JOURNAL_HEADER_COMPRESSED_XZ(h) \
         FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_COMPRESSED_XZ)
 
@@ -200,6 +245,9 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPRESSED_ZSTD(h) \
         FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_COMPRESSED_ZSTD)
 
+#define JOURNAL_HEADER_ZSTD_DICTIONARY(h) \
+        FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
+
 #define JOURNAL_HEADER_KEYED_HASH(h) \
         FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_KEYED_HASH)
 
@@ -219,9 +267,32 @@ int journal_file_append_entry(
                 Object **ret,
                 uint64_t *offset);
 
+typedef struct JournalFileEntry {
+        const dual_timestamp *ts;       /* NULL for "now" */
+        const sd_id128_t *boot_id;      /* NULL for the boot ID already in the header */
+        const struct iovec *iovec;
+        size_t n_iovec;
+} JournalFileEntry;
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqno,
+                size_t *ret_n_written);
+
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
 
+int journal_file_get_zstd_dictionary(JournalFile *f, ZstdDictionary **ret);
+int journal_file_decompress_blob(JournalFile *f, int compression,
+                                 const void *src, uint64_t src_size,
+                                 void **dst, size_t *dst_alloc_size, size_t *dst_size, size_t dst_max);
+int journal_file_decompress_startswith(JournalFile *f, int compression,
+                                       const void *src, uint64_t src_size,
+                                       void **buffer, size_t *buffer_size,
+                                       const void *prefix, size_t prefix_len,
+                                       uint8_t extra);
+
 int journal_file_find_field_object(JournalFile *f, const void *field, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_field_object_with_hash(JournalFile *f, const void *field, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
 
@@ -229,6 +300,14 @@ void journal_file_reset_location(JournalFile *f);
 void journal_file_save_location(JournalFile *f, Object *o, uint64_t offset);
 int journal_file_compare_locations(JournalFile *af, JournalFile *bf);
 int journal_file_next_entry(JournalFile *f, uint64_t p, direction_t direction, Object **ret, uint64_t *offset);
+int journal_file_freeze(JournalFile *f);
+
+static inline uint64_t journal_file_n_entries(JournalFile *f) {
+        if (f->frozen)
+                return f->frozen_n_entries;
+
+        return le64toh(READ_NOW(f->header->n_entries));
+}
 
 int journal_file_next_entry_for_data(JournalFile *f, Object *o, uint64_t p, uint64_t data_offset, direction_t direction, Object **ret, uint64_t *offset);
 
@@ -241,14 +320,41 @@ int journal_file_move_to_entry_by_seqnum_for_data(JournalFile *f, uint64_t data_
 int journal_file_move_to_entry_by_realtime_for_data(JournalFile *f, uint64_t data_offset, uint64_t realtime, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_monotonic_for_data(JournalFile *f, uint64_t data_offset, sd_id128_t boot_id, uint64_t monotonic, direction_t direction, Object **ret, uint64_t *offset);
 
-int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p);
+/* Remembers where the DATA objects of the source files ended up in the destination of
+ * journal_file_copy_entry(), so that each of them is decompressed, hashed and looked up only once when
+ * copying many entries. Flushed automatically when the destination file changes. */
+typedef struct JournalCopyCache {
+        sd_id128_t to_file_id;
+        Hashmap *by_file;      /* source JournalFile → Hashmap of source offset → JournalCopyCacheItem */
+        size_t n_items;
+        uint64_t n_hits;
+        uint64_t n_misses;
+} JournalCopyCache;
+
+void journal_copy_cache_done(JournalCopyCache *c);
+
+int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, JournalCopyCache *cache);
 
 void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
 
 int journal_file_archive(JournalFile *f);
+int journal_file_bloom_filter_test(JournalFile *f, uint64_t hash);
+
+typedef struct FieldStatsValue {
+        const void *data; /* "FIELD=value" */
+        size_t size;
+        uint64_t hash;
+        uint64_t n_entries;
+        uint64_t first_realtime;
+        uint64_t last_realtime;
+} FieldStatsValue;
+
+int journal_file_find_field_stats(JournalFile *f, const void *field, uint64_t size, Object **ret, uint64_t *ret_offset);
+int journal_file_field_stats_value(Object *o, uint64_t i, FieldStatsValue *ret);
 JournalFile* journal_initiate_close(JournalFile *f, Set *deferred_closes);
 int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_threshold_bytes, bool seal, Set *deferred_closes);
+int journal_file_prepare_rotation(JournalFile *f, bool compress, uint64_t compress_threshold_bytes, bool seal);
 
 int journal_file_dispose(int dir_fd, const char *fname);
 
@@ -262,6 +368,7 @@ int journal_file_get_cutoff_realtime_usec(JournalFile *f, usec_t *from, usec_t *
 int journal_file_get_cutoff_monotonic_usec(JournalFile *f, sd_id128_t boot, usec_t *from, usec_t *to);
 
 bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec);
+bool journal_file_rotate_soon(JournalFile *f, usec_t max_file_usec);
 
 int journal_file_map_data_hash_table(JournalFile *f);
 int journal_file_map_field_hash_table(JournalFile *f);
@@ -12,6 +12,7 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
@@ -74,6 +75,15 @@ struct sd_journal {
         OrderedHashmap *files;
         IteratedCache *files_cache;
         MMapCache *mmap;
+        unsigned mmap_contexts; /* non-zero if the mmap cache is shared, see sd_journal_open_shared() */
+
+        /* Files with a candidate entry beyond the current location, ordered by that entry in
+         * files_heap_direction, so that each step only has to re-position the file that was consumed. Files
+         * that are not in the heap but need to be looked at again on the next step (the file we just took an
+         * entry from, or exhausted files that might still grow) are kept in files_probe. */
+        Prioq *files_heap;
+        Set *files_probe;
+        direction_t files_heap_direction;
 
         Location current_location;
 
@@ -93,6 +103,7 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        uint64_t unique_index; /* of the value, if unique_offset refers to a field statistics object */
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -111,11 +122,25 @@ struct sd_journal {
                                     files, so sd_j_enumerate_unique
                                     will return a value equal to 0. */
         bool fields_file_lost:1;
+        bool unique_stats:1;
         bool has_runtime_files:1;
         bool has_persistent_files:1;
+        bool files_heap_valid:1;
+        bool batch_pending:1; /* sd_journal_read_batch() found no room for the current entry */
 
         size_t data_threshold;
 
+        /* Decompressed DATA objects, keyed by file and offset, least recently used first */
+        OrderedHashmap *data_cache;
+        size_t data_cache_size, data_cache_max;
+        uint64_t data_cache_hits, data_cache_misses;
+
+        /* The fields of the entry sd_journal_read_batch() is copying */
+        struct iovec *batch_fields;
+        size_t batch_fields_allocated;
+
+        usec_t realtime_window_since, realtime_window_until;
+
         Hashmap *directories_by_path;
         Hashmap *directories_by_wd;
 
@@ -123,8 +148,22 @@ struct sd_journal {
 };
 
 char *journal_make_match_string(sd_journal *j);
+void journal_set_realtime_window(sd_journal *j, usec_t since, usec_t until);
+int journal_copy_matches(sd_journal *to, sd_journal *from);
+int journal_compare_locations(const Location *a, const Location *b);
 void journal_print_header(sd_journal *j);
 
+typedef struct JournalFieldValue {
+        char *value; /* without the "FIELD=" prefix, NUL terminated for convenience */
+        size_t size;
+        uint64_t n_entries;
+        usec_t first_realtime;
+        usec_t last_realtime;
+} JournalFieldValue;
+
+int journal_count_field_values(sd_journal *j, const char *field, JournalFieldValue **ret, size_t *ret_n);
+JournalFieldValue* journal_field_values_free(JournalFieldValue *values, size_t n);
+
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
 
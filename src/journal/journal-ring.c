@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journal-ring.h"
+#include "memory-util.h"
+
+int journal_ring_push(JournalRingHeader *h, uint8_t *data, uint32_t data_size, const struct iovec *w, size_t n) {
+        uint64_t reserve, tail, pos, pad, need, size;
+        JournalRingRecord *record;
+        uint8_t *p;
+        size_t i;
+
+        assert(h);
+        assert(data);
+        assert(w || n == 0);
+
+        /* Returns 0 if the message was queued, > 0 if it was queued and the consumer needs to be woken up,
+         * -E2BIG if the message is too large for the ring, and -ENOBUFS if the ring is full */
+
+        size = IOVEC_TOTAL_SIZE(w, n);
+        need = JOURNAL_RING_RECORD_ALIGN(sizeof(JournalRingRecord) + size);
+        if (need > JOURNAL_RING_RECORD_MAX(data_size))
+                return -E2BIG;
+
+        reserve = __atomic_load_n(&h->reserve, __ATOMIC_RELAXED);
+        do {
+                tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+                pos = reserve & (data_size - 1);
+                pad = pos + need > data_size ? data_size - pos : 0;
+
+                if (reserve + pad + need - tail > data_size)
+                        return -ENOBUFS;
+        } while (!__atomic_compare_exchange_n(&h->reserve, &reserve, reserve + pad + need,
+                                              false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+        /* The consumer zeroes everything it consumed, hence the space we reserved is not committed yet */
+        if (pad > 0) {
+                record = (JournalRingRecord*) (data + pos);
+                record->size = pad - sizeof(JournalRingRecord);
+                __atomic_store_n(&record->committed, JOURNAL_RING_RECORD_PADDING, __ATOMIC_RELEASE);
+                pos = 0;
+        }
+
+        record = (JournalRingRecord*) (data + pos);
+        record->size = size;
+        for (p = record->payload, i = 0; i < n; i++)
+                p = mempcpy(p, w[i].iov_base, w[i].iov_len);
+        __atomic_store_n(&record->committed, JOURNAL_RING_RECORD_DATA, __ATOMIC_RELEASE);
+
+        /* Pairs with the barrier in journal_ring_wait() */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        return __atomic_load_n(&h->waiting, __ATOMIC_RELAXED) &&
+                __atomic_exchange_n(&h->waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+bool journal_ring_pending(const uint8_t *data, uint32_t data_size, uint64_t tail) {
+        const JournalRingRecord *record;
+        uint64_t pos;
+
+        assert(data);
+
+        pos = tail & (data_size - 1);
+        if (pos + sizeof(JournalRingRecord) > data_size)
+                return true; /* Let journal_ring_pop() deal with it */
+
+        record = (const JournalRingRecord*) (data + pos);
+        return __atomic_load_n(&record->committed, __ATOMIC_ACQUIRE) != 0;
+}
+
+int journal_ring_pop(
+                JournalRingHeader *h,
+                uint8_t *data,
+                uint32_t data_size,
+                uint64_t *tail,
+                void **buffer,
+                size_t *buffer_allocated,
+                size_t *ret_size) {
+
+        JournalRingRecord *record;
+        uint32_t committed, size;
+        uint64_t pos, need;
+
+        assert(h);
+        assert(data);
+        assert(tail);
+        assert(buffer);
+        assert(buffer_allocated);
+        assert(ret_size);
+
+        /* Returns > 0 if a record was consumed, 0 if there is none (yet), and negative if the ring is
+         * corrupted. The message is copied into the buffer, and its size returned, which is zero for
+         * padding. Note that the producer may modify the ring under our feet at any time, hence all we read
+         * from it needs to be validated, and read only once. The data size and the tail are passed in
+         * rather than taken from the header for the same reason. */
+
+        pos = *tail & (data_size - 1);
+        if (pos + sizeof(JournalRingRecord) > data_size)
+                return -EBADMSG;
+
+        record = (JournalRingRecord*) (data + pos);
+
+        committed = __atomic_load_n(&record->committed, __ATOMIC_ACQUIRE);
+        if (committed == 0)
+                return 0;
+
+        size = __atomic_load_n(&record->size, __ATOMIC_RELAXED);
+        if (size > data_size - pos - sizeof(JournalRingRecord))
+                return -EBADMSG;
+
+        need = JOURNAL_RING_RECORD_ALIGN(sizeof(JournalRingRecord) + size);
+
+        switch (committed) {
+
+        case JOURNAL_RING_RECORD_DATA:
+                if (!greedy_realloc(buffer, buffer_allocated, (size_t) size + 1, 1))
+                        return -ENOMEM;
+
+                /* Copy the message out, so that the producer cannot change it while it is parsed */
+                memcpy(*buffer, record->payload, size);
+                *ret_size = size;
+                break;
+
+        case JOURNAL_RING_RECORD_PADDING:
+                /* Padding always extends up to the end of the data area */
+                if (pos + need != data_size)
+                        return -EBADMSG;
+
+                *ret_size = 0;
+                break;
+
+        default:
+                return -EBADMSG;
+        }
+
+        /* Producers rely on unused space being zeroed, so that they can reserve it without first clearing
+         * the commit marker */
+        memzero(record, need);
+
+        *tail += need;
+        __atomic_store_n(&h->tail, *tail, __ATOMIC_RELEASE);
+
+        return 1;
+}
+
+bool journal_ring_wait(JournalRingHeader *h, const uint8_t *data, uint32_t data_size, uint64_t tail) {
+        assert(h);
+
+        /* Asks the next producer to wake us up. Returns false if something was committed before it could
+         * see that, in which case the caller should look again rather than sleep. Pairs with the barrier
+         * in journal_ring_push(). */
+
+        __atomic_store_n(&h->waiting, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (!journal_ring_pending(data, data_size, tail))
+                return true;
+
+        __atomic_store_n(&h->waiting, 0, __ATOMIC_SEQ_CST);
+        return false;
+}
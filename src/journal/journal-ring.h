@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#include "macro.h"
+
+/* A shared memory ring clients may set up with journald to log without a system call per message.
+ *
+ * The client creates a memfd of JOURNAL_RING_HEADER_SIZE + data_size bytes, sealed against shrinking and
+ * growing, plus an eventfd and a pipe. It then sends a ".ring\n" datagram to the native socket, with the
+ * memfd, the eventfd and the read end of the pipe attached (in that order). journald binds the
+ * credentials of that datagram to the ring, and sets the state to JOURNAL_RING_ACCEPTED once it is ready
+ * to drain it. Until then, after journald revoked the ring, and whenever a message does not fit into the
+ * ring, the client uses the socket.
+ *
+ * Messages are stored as records in the usual native protocol format, each starting at a 64bit aligned
+ * offset of the data area. Producers reserve space by atomically advancing "reserve", fill in the record
+ * and then set "committed" to a nonzero value. A record that would not fit before the end of the data area
+ * is preceded by a padding record filling the remainder. journald consumes the records in order, zeroes
+ * them out and advances "tail". When it runs out of records it sets "waiting" and sleeps until the eventfd
+ * is signalled by the next producer that finds "waiting" set. When the last copy of the write end of the
+ * pipe is closed, journald drains the ring one last time and forgets about it.
+ *
+ * All fields are in host byte order, since both sides live on the same machine. */
+
+#define JOURNAL_RING_SIGNATURE ((const char[]) { 'S', 'D', 'J', 'R', 'I', 'N', 'G', 0 })
+
+#define JOURNAL_RING_SIZE_MIN (64U*1024U)
+#define JOURNAL_RING_SIZE_MAX (64U*1024U*1024U)
+#define JOURNAL_RING_SIZE_DEFAULT (1024U*1024U)
+
+enum {
+        JOURNAL_RING_OFFERED = 0,
+        JOURNAL_RING_ACCEPTED = 1,
+        JOURNAL_RING_REVOKED = 2,   /* journald stopped draining the ring */
+};
+
+enum {
+        JOURNAL_RING_RECORD_DATA = 1,
+        JOURNAL_RING_RECORD_PADDING = 2,
+};
+
+typedef struct JournalRingRecord {
+        uint32_t size;       /* bytes of payload following the record header */
+        uint32_t committed;  /* JOURNAL_RING_RECORD_DATA or _PADDING once complete, zero before */
+        uint8_t payload[];
+} JournalRingRecord;
+
+typedef struct JournalRingHeader {
+        uint8_t signature[8];
+        uint32_t header_size;
+        uint32_t data_size;  /* power of two */
+
+        /* Written by journald */
+        uint32_t state;
+        uint32_t waiting;
+        uint8_t reserved0[40];
+
+        /* Written by the producers, on a cache line of its own */
+        uint64_t reserve;
+        uint8_t reserved1[56];
+
+        /* Written by journald, on a cache line of its own */
+        uint64_t tail;
+        uint8_t reserved2[56];
+} JournalRingHeader;
+
+#define JOURNAL_RING_HEADER_SIZE sizeof(JournalRingHeader)
+
+assert_cc(JOURNAL_RING_HEADER_SIZE == 192);
+assert_cc(sizeof(JournalRingRecord) == 8);
+
+/* Records are 64bit aligned */
+#define JOURNAL_RING_RECORD_ALIGN(l) (((l) + 7U) & ~(uint64_t) 7U)
+
+/* Larger messages always go through the socket, so that a single message cannot hog the ring */
+#define JOURNAL_RING_RECORD_MAX(data_size) ((data_size) / 4)
+
+int journal_ring_push(JournalRingHeader *h, uint8_t *data, uint32_t data_size, const struct iovec *w, size_t n);
+
+bool journal_ring_pending(const uint8_t *data, uint32_t data_size, uint64_t tail);
+int journal_ring_pop(
+                JournalRingHeader *h,
+                uint8_t *data,
+                uint32_t data_size,
+                uint64_t *tail,
+                void **buffer,
+                size_t *buffer_allocated,
+                size_t *ret_size);
+bool journal_ring_wait(JournalRingHeader *h, const uint8_t *data, uint32_t data_size, uint64_t tail);
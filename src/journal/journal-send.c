@@ -4,6 +4,8 @@
 #include <fcntl.h>
 #include <printf.h>
 #include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -16,7 +18,11 @@
 #include "fd-util.h"
 #include "io-util.h"
 #include "fileio.h"
+#include "journal-ring.h"
 #include "memfd-util.h"
+#include "missing_fcntl.h"
+#include "parse-util.h"
+#include "process-util.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -62,6 +68,174 @@ retry:
         return fd;
 }
 
+typedef struct JournalRingClient {
+        pid_t pid;
+        JournalRingHeader *header;
+        uint8_t *data;
+        uint32_t data_size;
+        int doorbell_fd;
+        int lifetime_fd;
+} JournalRingClient;
+
+/* The ring is set up at most once per process, and then used by all its threads. Children inherit the
+ * mapping, but the ring is bound to the credentials of the process that set it up, hence they go back to
+ * the socket. */
+static JournalRingClient *journal_ring_client = NULL;
+static int journal_ring_attempted = 0;
+
+static int journal_ring_size(uint64_t *ret) {
+        const char *e;
+        uint64_t sz;
+        int r;
+
+        /* $SYSTEMD_JOURNAL_RING= takes a boolean or the size of the data area of the ring */
+        e = getenv("SYSTEMD_JOURNAL_RING");
+        if (!e)
+                return 0;
+
+        r = parse_boolean(e);
+        if (r >= 0) {
+                *ret = JOURNAL_RING_SIZE_DEFAULT;
+                return r;
+        }
+
+        r = parse_size(e, 1024, &sz);
+        if (r < 0)
+                return r;
+
+        if (sz < JOURNAL_RING_SIZE_MIN || sz > JOURNAL_RING_SIZE_MAX || (sz & (sz - 1)) != 0)
+                return -ERANGE;
+
+        *ret = sz;
+        return 1;
+}
+
+static int journal_ring_setup(int fd, const struct msghdr *dest) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        _cleanup_close_ int memfd = -1, doorbell_fd = -1;
+        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * 3)) control;
+        struct iovec iovec = IOVEC_MAKE_STRING(".ring\n");
+        struct msghdr mh = {
+                .msg_name = dest->msg_name,
+                .msg_namelen = dest->msg_namelen,
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        JournalRingClient *c;
+        JournalRingHeader *h;
+        struct cmsghdr *cmsg;
+        uint64_t data_size;
+        void *p;
+        int r;
+
+        r = journal_ring_size(&data_size);
+        if (r <= 0)
+                return r;
+
+        memfd = memfd_new("journal-ring");
+        if (memfd < 0)
+                return memfd;
+
+        r = memfd_set_size(memfd, JOURNAL_RING_HEADER_SIZE + data_size);
+        if (r < 0)
+                return r;
+
+        /* journald maps the ring too, make sure it cannot be made to SIGBUS by truncating it. It's still
+         * writable though, since that's the whole point. */
+        if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+                return -errno;
+
+        p = mmap(NULL, JOURNAL_RING_HEADER_SIZE + data_size, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        h = p;
+        memcpy(h->signature, JOURNAL_RING_SIGNATURE, sizeof(h->signature));
+        h->header_size = JOURNAL_RING_HEADER_SIZE;
+        h->data_size = data_size;
+
+        doorbell_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (doorbell_fd < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        c = new(JournalRingClient, 1);
+        if (!c) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+        memcpy(CMSG_DATA(cmsg), (const int[]) { memfd, doorbell_fd, pipe_fds[0] }, sizeof(int) * 3);
+
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0) {
+                r = -errno;
+                free(c);
+                goto fail;
+        }
+
+        *c = (JournalRingClient) {
+                .pid = getpid_cached(),
+                .header = h,
+                .data = (uint8_t*) h + JOURNAL_RING_HEADER_SIZE,
+                .data_size = data_size,
+                .doorbell_fd = TAKE_FD(doorbell_fd),
+                .lifetime_fd = TAKE_FD(pipe_fds[1]),
+        };
+
+        __atomic_store_n(&journal_ring_client, c, __ATOMIC_RELEASE);
+        return 1;
+
+fail:
+        (void) munmap(p, JOURNAL_RING_HEADER_SIZE + data_size);
+        return r;
+}
+
+static int journal_ring_write(int fd, const struct msghdr *dest, const struct iovec *w, size_t n) {
+        JournalRingClient *c;
+        int r;
+
+        /* Returns 0 if the message was queued into the ring, negative if it has to go through the socket */
+
+        c = __atomic_load_n(&journal_ring_client, __ATOMIC_ACQUIRE);
+        if (!c) {
+                /* Only one thread gets to set up the ring, the others use the socket in the meantime */
+                if (journal_ring_attempted ||
+                    !__sync_bool_compare_and_swap(&journal_ring_attempted, 0, 1))
+                        return -EAGAIN;
+
+                (void) journal_ring_setup(fd, dest);
+
+                /* journald has to accept the ring first, hence do not use it right away */
+                return -EAGAIN;
+        }
+
+        if (c->pid != getpid_cached())
+                return -ECHILD;
+
+        if (__atomic_load_n(&c->header->state, __ATOMIC_ACQUIRE) != JOURNAL_RING_ACCEPTED)
+                return -EAGAIN;
+
+        r = journal_ring_push(c->header, c->data, c->data_size, w, n);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                (void) eventfd_write(c->doorbell_fd, 1);
+
+        return 0;
+}
+
 _public_ int sd_journal_print(int priority, const char *format, ...) {
         int r;
         va_list ap;
@@ -285,6 +459,9 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
         if (_unlikely_(fd < 0))
                 return fd;
 
+        if (journal_ring_write(fd, &mh, w, j) >= 0)
+                return 0;
+
         mh.msg_iov = w;
         mh.msg_iovlen = j;
 
@@ -1,7 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 
 #include "sd-id128.h"
@@ -9,12 +11,14 @@
 #include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
-#include "sort-util.h"
+#include "prioq.h"
+#include "set.h"
 #include "string-util.h"
 #include "time-util.h"
 #include "xattr-util.h"
@@ -28,8 +32,41 @@ struct vacuum_info {
         sd_id128_t seqnum_id;
         uint64_t seqnum;
         bool have_seqnum;
+
+        /* Active files are never vacuumed, but count against the number of files */
+        bool active;
+        bool empty;
+        unsigned prioq_idx;
+};
+
+struct JournalVacuumIndex {
+        char *path;
+        int dir_fd;
+        int inotify_fd;
+
+        /* All journal files in the directory, by name */
+        Hashmap *files;
+
+        /* The archived files that are not empty, oldest first, i.e. in the order they are vacuumed in */
+        Prioq *archived;
+        uint64_t archived_usage;
+
+        Set *empty;
+        Set *active;
+
+        bool rescan;
 };
 
+static struct vacuum_info* vacuum_info_free(struct vacuum_info *i) {
+        if (!i)
+                return NULL;
+
+        free(i->filename);
+        return mfree(i);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct vacuum_info*, vacuum_info_free);
+
 static int vacuum_compare(const struct vacuum_info *a, const struct vacuum_info *b) {
         int r;
 
@@ -51,7 +88,7 @@ static void patch_realtime(
                 int fd,
                 const char *fn,
                 const struct stat *st,
-                unsigned long long *realtime) {
+                uint64_t *realtime) {
 
         usec_t x, crtime = 0;
 
@@ -118,204 +155,500 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
-                const char *directory,
-                uint64_t max_use,
-                uint64_t n_max_files,
-                usec_t max_retention_usec,
-                usec_t *oldest_usec,
-                bool verbose) {
+static int vacuum_prioq_compare(const void *a, const void *b) {
+        return vacuum_compare(a, b);
+}
+
+static int vacuum_parse_filename(
+                const char *name,
+                sd_id128_t *ret_seqnum_id,
+                uint64_t *ret_seqnum,
+                uint64_t *ret_realtime,
+                bool *ret_have_seqnum) {
+
+        unsigned long long seqnum = 0, realtime;
+        sd_id128_t seqnum_id = SD_ID128_NULL;
+        bool have_seqnum;
+        size_t q;
+
+        assert(name);
+
+        /* Returns > 0 for files that may be vacuumed, 0 for other journal files, which are left around, and
+         * -EINVAL for everything else. */
+
+        q = strlen(name);
+
+        if (endswith(name, ".journal")) {
+                char id[SD_ID128_STRING_MAX];
+
+                /* Vacuum archived files. Active files are
+                 * left around */
+
+                if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8)
+                        return 0;
+
+                if (name[q-8-16-1] != '-' ||
+                    name[q-8-16-1-16-1] != '-' ||
+                    name[q-8-16-1-16-1-32-1] != '@')
+                        return 0;
+
+                memcpy(id, name + q-8-16-1-16-1-32, 32);
+                id[32] = 0;
+                if (sd_id128_from_string(id, &seqnum_id) < 0)
+                        return 0;
+
+                if (sscanf(name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                        return 0;
+
+                have_seqnum = true;
+
+        } else if (endswith(name, ".journal~")) {
+                unsigned long long tmp;
+
+                /* Vacuum corrupted files */
+
+                if (q < 1 + 16 + 1 + 16 + 8 + 1)
+                        return 0;
+
+                if (name[q-1-8-16-1] != '-' ||
+                    name[q-1-8-16-1-16-1] != '@')
+                        return 0;
+
+                if (sscanf(name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2)
+                        return 0;
+
+                have_seqnum = false;
+        } else
+                /* We do not vacuum unknown files! */
+                return -EINVAL;
+
+        *ret_seqnum_id = seqnum_id;
+        *ret_seqnum = seqnum;
+        *ret_realtime = realtime;
+        *ret_have_seqnum = have_seqnum;
+
+        return 1;
+}
+
+static void vacuum_index_remove(JournalVacuumIndex *x, struct vacuum_info *i) {
+        assert(x);
+        assert(i);
+
+        assert_se(hashmap_remove(x->files, i->filename) == i);
+
+        if (i->active)
+                assert_se(set_remove(x->active, i) == i);
+        else if (i->empty)
+                assert_se(set_remove(x->empty, i) == i);
+        else {
+                if (i->prioq_idx != PRIOQ_IDX_NULL)
+                        assert_se(prioq_remove(x->archived, i, &i->prioq_idx) > 0);
+
+                x->archived_usage = LESS_BY(x->archived_usage, i->usage);
+        }
+
+        vacuum_info_free(i);
+}
+
+static int vacuum_index_link(JournalVacuumIndex *x, struct vacuum_info *i) {
+        int r;
+
+        assert(x);
+        assert(i);
+
+        if (i->active)
+                return set_ensure_put(&x->active, NULL, i);
+        if (i->empty)
+                return set_ensure_put(&x->empty, NULL, i);
+
+        r = prioq_put(x->archived, i, &i->prioq_idx);
+        if (r < 0)
+                return r;
 
-        uint64_t sum = 0, freed = 0, n_active_files = 0;
-        size_t n_list = 0, n_allocated = 0, i;
+        x->archived_usage += i->usage;
+        return 0;
+}
+
+static int vacuum_index_update(JournalVacuumIndex *x, const char *name) {
+        _cleanup_(vacuum_info_freep) struct vacuum_info *n = NULL;
+        struct vacuum_info *i;
+        struct stat st;
+        int k, r;
+
+        assert(x);
+        assert(name);
+
+        /* Looks at the file of the given name again, whatever happened to it */
+
+        i = hashmap_get(x->files, name);
+        if (i)
+                vacuum_index_remove(x, i);
+
+        n = new(struct vacuum_info, 1);
+        if (!n)
+                return -ENOMEM;
+
+        *n = (struct vacuum_info) {
+                .prioq_idx = PRIOQ_IDX_NULL,
+        };
+
+        k = vacuum_parse_filename(name, &n->seqnum_id, &n->seqnum, &n->realtime, &n->have_seqnum);
+        if (k < 0)
+                return 0;
+
+        if (fstatat(x->dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                if (errno != ENOENT)
+                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", name);
+                return 0;
+        }
+
+        if (!S_ISREG(st.st_mode))
+                return 0;
+
+        n->usage = 512UL * (uint64_t) st.st_blocks;
+        n->active = k == 0;
+
+        if (!n->active) {
+                r = journal_file_empty(x->dir_fd, name);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", name);
+                        return 0;
+                }
+
+                n->empty = r > 0;
+                if (!n->empty)
+                        patch_realtime(x->dir_fd, name, &st, &n->realtime);
+        }
+
+        n->filename = strdup(name);
+        if (!n->filename)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&x->files, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(x->files, n->filename, n);
+        if (r < 0)
+                return r;
+
+        r = vacuum_index_link(x, n);
+        if (r < 0) {
+                hashmap_remove(x->files, n->filename);
+                return r;
+        }
+
+        TAKE_PTR(n);
+        return 0;
+}
+
+static int vacuum_index_scan(JournalVacuumIndex *x) {
         _cleanup_closedir_ DIR *d = NULL;
-        struct vacuum_info *list = NULL;
-        usec_t retention_limit = 0;
-        char sbytes[FORMAT_BYTES_MAX];
+        struct vacuum_info *i;
         struct dirent *de;
         int r;
 
+        assert(x);
+
+        while ((i = hashmap_first(x->files)))
+                vacuum_index_remove(x, i);
+
+        d = xopendirat(x->dir_fd, ".", 0);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+                r = vacuum_index_update(x, de->d_name);
+                if (r < 0)
+                        return r;
+        }
+
+        x->rescan = false;
+        return 0;
+}
+
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *x) {
+        if (!x)
+                return NULL;
+
+        hashmap_free_with_destructor(x->files, vacuum_info_free);
+        set_free(x->active);
+        set_free(x->empty);
+        prioq_free(x->archived);
+
+        safe_close(x->inotify_fd);
+        safe_close(x->dir_fd);
+        free(x->path);
+
+        return mfree(x);
+}
+
+int journal_vacuum_index_new(const char *directory, bool watch, JournalVacuumIndex **ret) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *x = NULL;
+        int r;
+
         assert(directory);
+        assert(ret);
 
-        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
-                return 0;
+        x = new(JournalVacuumIndex, 1);
+        if (!x)
+                return -ENOMEM;
 
-        if (max_retention_usec > 0)
-                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+        *x = (JournalVacuumIndex) {
+                .dir_fd = -1,
+                .inotify_fd = -1,
+        };
 
-        d = opendir(directory);
-        if (!d)
+        x->path = strdup(directory);
+        if (!x->path)
+                return -ENOMEM;
+
+        x->archived = prioq_new(vacuum_prioq_compare);
+        if (!x->archived)
+                return -ENOMEM;
+
+        x->dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (x->dir_fd < 0)
                 return -errno;
 
-        FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
+        if (watch) {
+                x->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+                if (x->inotify_fd < 0)
+                        return -errno;
 
-                unsigned long long seqnum = 0, realtime;
-                _cleanup_free_ char *p = NULL;
-                sd_id128_t seqnum_id;
-                bool have_seqnum;
-                uint64_t size;
-                struct stat st;
-                size_t q;
+                /* Watch before looking, so that nothing is missed in between */
+                r = inotify_add_watch_fd(x->inotify_fd, x->dir_fd,
+                                         IN_CREATE|IN_MOVED_TO|IN_MOVED_FROM|IN_DELETE|IN_CLOSE_WRITE|
+                                         IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR);
+                if (r < 0)
+                        return r;
+        }
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
-                        continue;
-                }
+        r = vacuum_index_scan(x);
+        if (r < 0)
+                return r;
 
-                if (!S_ISREG(st.st_mode))
-                        continue;
+        *ret = TAKE_PTR(x);
+        return 0;
+}
 
-                q = strlen(de->d_name);
+int journal_vacuum_index_get_fd(JournalVacuumIndex *x) {
+        assert(x);
 
-                if (endswith(de->d_name, ".journal")) {
+        return x->inotify_fd;
+}
 
-                        /* Vacuum archived files. Active files are
-                         * left around */
+int journal_vacuum_index_process(JournalVacuumIndex *x) {
+        struct stat st;
+        int r;
 
-                        if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8) {
-                                n_active_files++;
-                                continue;
-                        }
+        assert(x);
 
-                        if (de->d_name[q-8-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1-32-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
+        /* Applies what the kernel told us about the directory since the last call. Returns -ESTALE if the
+         * directory itself went away, in which case the index is of no use anymore. Note that as long as we
+         * keep it open the kernel won't tell us about that with IN_DELETE_SELF, hence check the link count
+         * too. */
 
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
+        if (x->inotify_fd < 0)
+                return 0;
 
-                        de->d_name[q-8-16-1-16-1] = 0;
-                        if (sd_id128_from_string(de->d_name + q-8-16-1-16-1-32, &seqnum_id) < 0) {
-                                n_active_files++;
-                                continue;
-                        }
+        if (fstat(x->dir_fd, &st) < 0)
+                return -errno;
+        if (st.st_nlink <= 0)
+                return -ESTALE;
 
-                        if (sscanf(de->d_name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t l;
 
-                        have_seqnum = true;
+                l = read(x->inotify_fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (IN_SET(errno, EAGAIN, EINTR))
+                                break;
 
-                } else if (endswith(de->d_name, ".journal~")) {
-                        unsigned long long tmp;
+                        return -errno;
+                }
 
-                        /* Vacuum corrupted files */
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        if (e->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED))
+                                return -ESTALE;
 
-                        if (q < 1 + 16 + 1 + 16 + 8 + 1) {
-                                n_active_files++;
-                                continue;
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                log_debug("Inotify queue of %s overflowed, rescanning.", x->path);
+                                x->rescan = true;
                         }
 
-                        if (de->d_name[q-1-8-16-1] != '-' ||
-                            de->d_name[q-1-8-16-1-16-1] != '@') {
-                                n_active_files++;
+                        if (x->rescan || e->len == 0)
                                 continue;
-                        }
 
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
+                        r = vacuum_index_update(x, e->name);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to update vacuum index of %s, rescanning: %m", x->path);
+                                x->rescan = true;
                         }
+                }
+        }
 
-                        if (sscanf(de->d_name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
+        if (x->rescan)
+                return vacuum_index_scan(x);
 
-                        have_seqnum = false;
-                } else {
-                        /* We do not vacuum unknown files! */
-                        log_debug("Not vacuuming unknown file %s.", de->d_name);
-                        continue;
-                }
+        return 0;
+}
+
+int journal_vacuum_index_get_usage(JournalVacuumIndex *x, uint64_t *ret_used, uint64_t *ret_free) {
+        struct vacuum_info *i;
+        struct statvfs ss;
+        uint64_t used;
+        int r;
 
-                size = 512UL * (uint64_t) st.st_blocks;
+        assert(x);
+        assert(ret_used);
+        assert(ret_free);
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
-                }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+        r = journal_vacuum_index_process(x);
+        if (r < 0)
+                return r;
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+        if (fstatvfs(x->dir_fd, &ss) < 0)
+                return -errno;
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, format_bytes(sbytes, sizeof(sbytes), size));
+        used = x->archived_usage;
 
-                                freed += size;
-                        } else if (r != -ENOENT)
-                                log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", directory, p);
+        SET_FOREACH(i, x->empty)
+                used += i->usage;
 
-                        continue;
-                }
+        /* Active files grow without us being told, hence look at them every time */
+        SET_FOREACH(i, x->active) {
+                struct stat st;
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+                if (fstatat(x->dir_fd, i->filename, &st, AT_SYMLINK_NOFOLLOW) >= 0)
+                        i->usage = 512UL * (uint64_t) st.st_blocks;
 
-                if (!GREEDY_REALLOC(list, n_allocated, n_list + 1)) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+                used += i->usage;
+        }
+
+        *ret_used = used;
+        *ret_free = ss.f_bsize * ss.f_bavail;
+
+        return 0;
+}
+
+int journal_vacuum_index_vacuum(
+                JournalVacuumIndex *x,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
 
-                list[n_list++] = (struct vacuum_info) {
-                        .filename = TAKE_PTR(p),
-                        .usage = size,
-                        .seqnum = seqnum,
-                        .realtime = realtime,
-                        .seqnum_id = seqnum_id,
-                        .have_seqnum = have_seqnum,
-                };
+        _cleanup_free_ struct vacuum_info **failed = NULL;
+        size_t n_failed = 0, n_allocated = 0, j;
+        struct vacuum_info *i;
+        usec_t retention_limit = 0;
+        char sbytes[FORMAT_BYTES_MAX];
+        uint64_t freed = 0;
+        int r;
+
+        assert(x);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
 
-                sum += size;
+        r = journal_vacuum_index_process(x);
+        if (r < 0)
+                return r;
+
+        if (max_retention_usec > 0)
+                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+
+        SET_FOREACH(i, x->empty) {
+                /* Always vacuum empty non-online files. */
+
+                r = unlinkat_deallocate(x->dir_fd, i->filename, 0);
+                if (r >= 0) {
+
+                        log_full(verbose ? LOG_INFO : LOG_DEBUG,
+                                 "Deleted empty archived journal %s/%s (%s).", x->path, i->filename, format_bytes(sbytes, sizeof(sbytes), i->usage));
+
+                        freed += i->usage;
+                } else if (r != -ENOENT) {
+                        log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", x->path, i->filename);
+                        continue;
+                }
+
+                vacuum_index_remove(x, i);
         }
 
-        typesafe_qsort(list, n_list, vacuum_compare);
+        r = 0;
 
-        for (i = 0; i < n_list; i++) {
+        while ((i = prioq_peek(x->archived))) {
                 uint64_t left;
 
-                left = n_active_files + n_list - i;
+                left = set_size(x->active) + prioq_size(x->archived);
 
-                if ((max_retention_usec <= 0 || list[i].realtime >= retention_limit) &&
-                    (max_use <= 0 || sum <= max_use) &&
+                if ((max_retention_usec <= 0 || i->realtime >= retention_limit) &&
+                    (max_use <= 0 || x->archived_usage <= max_use) &&
                     (n_max_files <= 0 || left <= n_max_files))
                         break;
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
+                r = unlinkat_deallocate(x->dir_fd, i->filename, 0);
                 if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", directory, list[i].filename, format_bytes(sbytes, sizeof(sbytes), list[i].usage));
-                        freed += list[i].usage;
+                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", x->path, i->filename, format_bytes(sbytes, sizeof(sbytes), i->usage));
+                        freed += i->usage;
+                } else if (r != -ENOENT) {
+                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", x->path, i->filename);
 
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
+                        /* Move on to the next file, and try again next time */
+                        if (!GREEDY_REALLOC(failed, n_allocated, n_failed + 1)) {
+                                r = -ENOMEM;
+                                break;
+                        }
 
-                } else if (r != -ENOENT)
-                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", directory, list[i].filename);
+                        assert_se(prioq_remove(x->archived, i, &i->prioq_idx) > 0);
+                        failed[n_failed++] = i;
+                        continue;
+                }
+
+                vacuum_index_remove(x, i);
         }
 
-        if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
-                *oldest_usec = list[i].realtime;
+        if (oldest_usec && i && (*oldest_usec == 0 || i->realtime < *oldest_usec))
+                *oldest_usec = i->realtime;
 
-        r = 0;
+        for (j = 0; j < n_failed; j++)
+                if (prioq_put(x->archived, failed[j], &failed[j]->prioq_idx) < 0) {
+                        /* Forget about it until we rescan */
+                        x->rescan = true;
+                }
 
-finish:
-        for (i = 0; i < n_list; i++)
-                free(list[i].filename);
-        free(list);
+        if (r >= 0)
+                r = 0;
 
-        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), directory);
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), x->path);
 
         return r;
 }
+
+int journal_directory_vacuum(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
+
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *x = NULL;
+        int r;
+
+        assert(directory);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
+
+        r = journal_vacuum_index_new(directory, false, &x);
+        if (r < 0)
+                return r;
+
+        return journal_vacuum_index_vacuum(x, max_use, n_max_files, max_retention_usec, oldest_usec, verbose);
+}
@@ -4,6 +4,22 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
+/* Keeps track of the journal files in a directory and what vacuuming would delete, so that the directory
+ * doesn't have to be looked at again every time. If watched, it follows changes to the directory via
+ * inotify, otherwise it is a snapshot. */
+typedef struct JournalVacuumIndex JournalVacuumIndex;
+
+int journal_vacuum_index_new(const char *directory, bool watch, JournalVacuumIndex **ret);
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *x);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumIndex*, journal_vacuum_index_free);
+
+int journal_vacuum_index_get_fd(JournalVacuumIndex *x);
+int journal_vacuum_index_process(JournalVacuumIndex *x);
+
+int journal_vacuum_index_get_usage(JournalVacuumIndex *x, uint64_t *ret_used, uint64_t *ret_free);
+int journal_vacuum_index_vacuum(JournalVacuumIndex *x, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+
 int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
@@ -1,26 +1,45 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
 #include "compress.h"
+#include "copy.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "format-util.h"
 #include "fs-util.h"
+#include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-verify.h"
+#include "list.h"
 #include "lookup3.h"
 #include "macro.h"
+#include "memory-util.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "siphash24.h"
 #include "terminal-util.h"
 #include "tmpfile-util.h"
 #include "util.h"
 
-static void draw_progress(uint64_t p, usec_t *last_usec) {
+typedef struct VerifyProgress {
+        usec_t start_usec;
+        usec_t last_usec;
+
+        /* How much the first pass got through since it started, to show the throughput */
+        uint64_t n_bytes;
+} VerifyProgress;
+
+static void draw_progress(uint64_t p, VerifyProgress *progress) {
+        char buf[FORMAT_BYTES_MAX];
         unsigned n, i, j, k;
         usec_t z, x;
 
@@ -28,12 +47,12 @@ static void draw_progress(uint64_t p, usec_t *last_usec) {
                 return;
 
         z = now(CLOCK_MONOTONIC);
-        x = *last_usec;
+        x = progress->last_usec;
 
         if (x != 0 && x + 40 * USEC_PER_MSEC > z)
                 return;
 
-        *last_usec = z;
+        progress->last_usec = z;
 
         n = (3 * columns()) / 4;
         j = (n * (unsigned) p) / 65535ULL;
@@ -53,6 +72,9 @@ static void draw_progress(uint64_t p, usec_t *last_usec) {
 
         printf(" %3"PRIu64"%%", 100U * p / 65535U);
 
+        if (progress->n_bytes > 0 && z > progress->start_usec)
+                printf(" %7s/s", format_bytes(buf, sizeof(buf), progress->n_bytes * USEC_PER_SEC / (z - progress->start_usec)));
+
         fputs("\r", stdout);
         if (colors_enabled())
                 fputs("\x1B[?25h", stdout);
@@ -81,7 +103,7 @@ static void flush_progress(void) {
 
         putchar('\r');
 
-        for (i = 0; i < n + 5; i++)
+        for (i = 0; i < n + 15; i++)
                 putchar(' ');
 
         putchar('\r');
@@ -125,13 +147,33 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 return -EBADMSG;
         }
 
+        if ((o->object.flags & OBJECT_UNINDEXED) &&
+            o->object.type != OBJECT_DATA) {
+                error(offset, "Found unindexed object that isn't of type DATA, which is not allowed.");
+                return -EBADMSG;
+        }
+
         switch (o->object.type) {
 
         case OBJECT_DATA: {
                 uint64_t h1, h2;
                 int compression, r;
 
-                if (le64toh(o->data.entry_offset) == 0)
+                if (o->object.flags & OBJECT_UNINDEXED) {
+                        if (!JOURNAL_HEADER_UNINDEXED(f->header)) {
+                                error(offset, "Unindexed data object in file without unindexed data");
+                                return -EBADMSG;
+                        }
+
+                        if (o->data.entry_offset != 0 ||
+                            o->data.entry_array_offset != 0 ||
+                            o->data.n_entries != 0 ||
+                            o->data.next_hash_offset != 0 ||
+                            o->data.next_field_offset != 0) {
+                                error(offset, "Unindexed data object is linked");
+                                return -EBADMSG;
+                        }
+                } else if (le64toh(o->data.entry_offset) == 0)
                         warning(offset, "Unused data (entry_offset==0)");
 
                 if ((le64toh(o->data.entry_offset) == 0) ^ (le64toh(o->data.n_entries) == 0)) {
@@ -153,10 +195,10 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         _cleanup_free_ void *b = NULL;
                         size_t alloc = 0, b_size;
 
-                        r = decompress_blob(compression,
-                                            o->data.payload,
-                                            le64toh(o->object.size) - offsetof(Object, data.payload),
-                                            &b, &alloc, &b_size, 0);
+                        r = journal_file_decompress_blob(f, compression,
+                                                         o->data.payload,
+                                                         le64toh(o->object.size) - offsetof(Object, data.payload),
+                                                         &b, &alloc, &b_size, 0);
                         if (r < 0) {
                                 error_errno(offset, r, "%s decompression failed: %m",
                                             object_compressed_to_string(compression));
@@ -344,24 +386,685 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
+                break;
+
+        case OBJECT_BLOOM_FILTER:
+                if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
+                    le64toh(o->bloom_filter.n_items) > le64toh(f->header->n_data)) {
+                        error(offset,
+                              "Bloom filter covers more items than there are data objects: %"PRIu64,
+                              le64toh(o->bloom_filter.n_items));
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_ZSTD_DICTIONARY: {
+                _cleanup_(zstd_dictionary_freep) ZstdDictionary *d = NULL;
+                int r;
+
+                r = zstd_dictionary_new(o->zstd_dictionary.payload,
+                                        le64toh(o->object.size) - offsetof(ZstdDictionaryObject, payload),
+                                        &d);
+                if (r < 0) {
+                        error_errno(offset, r, "Invalid zstd dictionary: %m");
+                        return r;
+                }
+
+                break;
+        }
+
+        case OBJECT_FIELD_STATS: {
+                FieldStatsValue v;
+                uint64_t i;
+                int r;
+
+                if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
+                    le64toh(o->field_stats.n_values) > le64toh(f->header->n_data)) {
+                        error(offset,
+                              "Field statistics cover more values than there are data objects: %"PRIu64,
+                              le64toh(o->field_stats.n_values));
+                        return -EBADMSG;
+                }
+
+                for (i = 0;; i++) {
+                        r = journal_file_field_stats_value(o, i, &v);
+                        if (r < 0) {
+                                error(offset, "Invalid field statistics value %"PRIu64, i);
+                                return r;
+                        }
+                        if (r == 0)
+                                break;
+
+                        if (v.n_entries <= 0 || v.first_realtime > v.last_realtime) {
+                                error(offset, "Invalid field statistics for value %"PRIu64, i);
+                                return -EBADMSG;
+                        }
+                }
+
                 break;
         }
+        }
 
         return 0;
 }
 
-static int write_uint64(int fd, uint64_t p) {
-        ssize_t k;
+/* The offsets of all objects of one type, in the order the first pass found them in, hence sorted. They are
+ * collected in a temporary file, which the second pass bisects through the mmap cache. */
+typedef struct VerifyIndex {
+        int fd;
+        MMapFileDescriptor *cache_fd;
+        uint64_t n;
+
+        uint64_t buffer[512];
+        size_t n_buffered;
+} VerifyIndex;
+
+#define VERIFY_INDEX_NULL (VerifyIndex) { .fd = -1 }
+
+static int verify_index_open(VerifyIndex *x, MMapCache *m, const char *tmp_dir) {
+        assert(x);
+        assert(m);
+
+        x->fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
+        if (x->fd < 0)
+                return x->fd;
+
+        x->cache_fd = mmap_cache_add_fd(m, x->fd);
+        if (!x->cache_fd)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static void verify_index_done(VerifyIndex *x, MMapCache *m) {
+        assert(x);
+        assert(m);
 
-        k = write(fd, &p, sizeof(p));
-        if (k < 0)
+        if (x->cache_fd)
+                mmap_cache_free_fd(m, x->cache_fd);
+
+        safe_close(x->fd);
+}
+
+static int verify_index_flush(VerifyIndex *x) {
+        int r;
+
+        assert(x);
+
+        if (x->n_buffered == 0)
+                return 0;
+
+        r = loop_write(x->fd, x->buffer, x->n_buffered * sizeof(uint64_t), false);
+        if (r < 0)
+                return r;
+
+        x->n_buffered = 0;
+        return 0;
+}
+
+static int verify_index_append(VerifyIndex *x, uint64_t p) {
+        int r;
+
+        assert(x);
+
+        if (x->n_buffered >= ELEMENTSOF(x->buffer)) {
+                r = verify_index_flush(x);
+                if (r < 0)
+                        return r;
+        }
+
+        x->buffer[x->n_buffered++] = p;
+        x->n++;
+
+        return 0;
+}
+
+static int verify_index_reset(VerifyIndex *x) {
+        assert(x);
+
+        x->n = x->n_buffered = 0;
+
+        if (ftruncate(x->fd, 0) < 0)
                 return -errno;
-        if (k != sizeof(p))
+
+        if (lseek(x->fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static int verify_index_load(VerifyIndex *x, int fd, uint64_t n) {
+        int r;
+
+        assert(x);
+        assert(x->n == 0);
+        assert(fd >= 0);
+
+        r = copy_bytes(fd, x->fd, n * sizeof(uint64_t), 0);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EIO; /* Truncated */
+
+        x->n = n;
+        return 0;
+}
+
+static int verify_index_save(VerifyIndex *x, uint64_t n, int fd) {
+        int r;
+
+        assert(x);
+        assert(n <= x->n);
+        assert(fd >= 0);
+
+        r = verify_index_flush(x);
+        if (r < 0)
+                return r;
+
+        if (lseek(x->fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        r = copy_bytes(x->fd, fd, n * sizeof(uint64_t), 0);
+        if (r < 0)
+                return r;
+        if (r == 0)
                 return -EIO;
 
+        if (lseek(x->fd, 0, SEEK_END) < 0)
+                return -errno;
+
         return 0;
 }
 
+/* What the first pass keeps track of while it goes through the objects one by one */
+typedef struct VerifyState {
+        uint64_t n_weird, n_objects, n_entries, n_data, n_fields, n_data_hash_tables, n_field_hash_tables,
+                n_entry_arrays, n_tags, n_unindexed;
+
+        uint64_t entry_seqnum, entry_monotonic, entry_realtime;
+        sd_id128_t entry_boot_id;
+
+        uint64_t last_epoch, last_tag, last_tag_realtime, last_sealed_realtime;
+
+        bool entry_seqnum_set, entry_monotonic_set, entry_realtime_set;
+        bool found_main_entry_array, found_bloom_filter, found_zstd_dictionary;
+
+        /* The last field statistics object found, which the next one has to link to */
+        uint64_t field_stats_tail;
+} VerifyState;
+
+/* A checkpoint records the state of the first pass after some object. Journal files are only ever appended
+ * to, hence the next run may skip everything up to that object and only check what was added since. For
+ * sealed files checkpoints are only taken after verified tags, i.e. at the end of an FSS epoch, as the HMAC
+ * of the next tag covers everything since the previous one. The checkpoint is followed by the offsets of
+ * state.n_data data objects, state.n_entries entry objects and state.n_entry_arrays entry array objects, i.e.
+ * what the first pass put into the indexes until then, as the second pass needs all of them still.
+ *
+ * Checkpoints are meant to be used on the machine that wrote them only, and are thrown away whenever
+ * anything does not match. */
+typedef struct VerifyCheckpoint {
+        uint8_t signature[8];
+        sd_id128_t file_id;
+        sd_id128_t seqnum_id;
+
+        /* Hash of the verification key, or 0 if none was used */
+        uint64_t key_hash;
+
+        /* The last object covered, which has to be still the same */
+        uint64_t object_offset;
+        uint64_t object_size;
+        uint64_t object_type;
+
+        VerifyState state;
+} VerifyCheckpoint;
+
+#define VERIFY_CHECKPOINT_SIGNATURE ((const uint8_t[]) { 'J', 'V', 'F', 'Y', 'C', 'K', 'P', '2' })
+
+static uint64_t verify_key_hash(JournalFile *f, const char *key) {
+        assert(f);
+
+        if (!key)
+                return 0;
+
+        return siphash24(key, strlen(key), f->header->file_id.bytes) ?: 1;
+}
+
+static void verify_checkpoint_update(VerifyCheckpoint *c, const VerifyState *s, uint64_t p, Object *o) {
+        assert(c);
+        assert(s);
+        assert(o);
+
+        c->object_offset = p;
+        c->object_size = le64toh(o->object.size);
+        c->object_type = o->object.type;
+        c->state = *s;
+}
+
+static int verify_checkpoint_load(
+                JournalFile *f,
+                const char *path,
+                uint64_t key_hash,
+                VerifyIndex *data, VerifyIndex *entries, VerifyIndex *entry_arrays,
+                VerifyCheckpoint *ret) {
+
+        _cleanup_close_ int fd = -1;
+        VerifyCheckpoint c;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(path);
+        assert(data);
+        assert(entries);
+        assert(entry_arrays);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        r = loop_read_exact(fd, &c, sizeof(c), false);
+        if (r < 0)
+                return r;
+
+        if (memcmp(c.signature, VERIFY_CHECKPOINT_SIGNATURE, sizeof(c.signature)) != 0 ||
+            !sd_id128_equal(c.file_id, f->header->file_id) ||
+            !sd_id128_equal(c.seqnum_id, f->header->seqnum_id) ||
+            c.key_hash != key_hash)
+                return 0;
+
+        if (c.object_offset < le64toh(f->header->header_size) ||
+            c.object_offset > le64toh(f->header->tail_object_offset))
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_UNUSED, c.object_offset, &o);
+        if (r < 0)
+                return 0;
+
+        if (o->object.type != c.object_type || le64toh(o->object.size) != c.object_size)
+                return 0;
+
+        r = verify_index_load(data, fd, c.state.n_data);
+        if (r < 0)
+                return r;
+
+        r = verify_index_load(entries, fd, c.state.n_entries);
+        if (r < 0)
+                return r;
+
+        r = verify_index_load(entry_arrays, fd, c.state.n_entry_arrays);
+        if (r < 0)
+                return r;
+
+        *ret = c;
+        return 1;
+}
+
+static int verify_checkpoint_save(
+                const char *path,
+                const VerifyCheckpoint *c,
+                VerifyIndex *data, VerifyIndex *entries, VerifyIndex *entry_arrays) {
+
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(path);
+        assert(c);
+
+        r = mkdir_parents(path, 0700);
+        if (r < 0)
+                return r;
+
+        r = tempfn_random(path, NULL, &t);
+        if (r < 0)
+                return r;
+
+        fd = open(t, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_NOCTTY, 0600);
+        if (fd < 0) {
+                t = mfree(t);
+                return -errno;
+        }
+
+        r = loop_write(fd, c, sizeof(*c), false);
+        if (r < 0)
+                return r;
+
+        r = verify_index_save(data, c->state.n_data, fd);
+        if (r < 0)
+                return r;
+
+        r = verify_index_save(entries, c->state.n_entries, fd);
+        if (r < 0)
+                return r;
+
+        r = verify_index_save(entry_arrays, c->state.n_entry_arrays, fd);
+        if (r < 0)
+                return r;
+
+        if (rename(t, path) < 0)
+                return -errno;
+
+        t = mfree(t);
+        return 0;
+}
+
+/* The first pass has to go through the objects in order, since it checks how each relates to the ones
+ * before it. Checking the contents of an object, which for data objects means decompressing and hashing
+ * the payload, does not depend on any other object however. With more than one thread, the first pass
+ * hence leaves this to worker threads, which read the objects region by region directly from the file,
+ * bypassing the mmap cache, which is not thread-safe. */
+
+#define VERIFY_REGION_SIZE (1024U * 1024U)
+
+typedef struct VerifyRegion VerifyRegion;
+
+struct VerifyRegion {
+        uint64_t start, end;
+        LIST_FIELDS(VerifyRegion, regions);
+};
+
+typedef struct VerifyWorkers {
+        JournalFile *file;
+
+        pthread_t *threads;
+        size_t n_threads;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;   /* a region was queued, or we shall quit */
+        pthread_cond_t done_cond;   /* a region was checked */
+
+        /* Protected by the mutex */
+        LIST_HEAD(VerifyRegion, queue);
+        VerifyRegion *queue_tail;
+        size_t n_queued, n_busy;
+        bool quit;
+        int error;
+        uint64_t error_offset;      /* the first object found to be broken, if error < 0 */
+
+        /* The region that is being collected, only accessed by the thread walking the file */
+        uint64_t region_start, region_end;
+} VerifyWorkers;
+
+static int verify_region(
+                JournalFile *f,
+                uint64_t start, uint64_t end,
+                void **buffer, size_t *allocated,
+                uint64_t *ret_offset) {
+
+        uint64_t p, n;
+        ssize_t k;
+        int r;
+
+        assert(f);
+        assert(start < end);
+        assert(buffer);
+        assert(allocated);
+        assert(ret_offset);
+
+        *ret_offset = start;
+
+        if (!GREEDY_REALLOC(*buffer, *allocated, end - start))
+                return log_oom();
+
+        for (n = 0; n < end - start; n += k) {
+                k = pread(f->fd, (uint8_t*) *buffer + n, end - start - n, start + n);
+                if (k < 0) {
+                        error_errno(start + n, errno, "Failed to read objects: %m");
+                        return -errno;
+                }
+                if (k == 0) {
+                        /* The padding after the last object might be missing */
+                        memzero((uint8_t*) *buffer + n, end - start - n);
+                        break;
+                }
+        }
+
+        for (p = start; p < end; p += ALIGN64(n)) {
+                Object *o = (Object*) ((uint8_t*) *buffer + (p - start));
+
+                n = le64toh(o->object.size);
+                if (n < sizeof(ObjectHeader) || n > end - p) {
+                        error(p, "Object changed while being verified");
+                        return -EBADMSG;
+                }
+
+                r = journal_file_object_verify(f, p, o);
+                if (r < 0) {
+                        error_errno(p, r, "Invalid object contents: %m");
+                        *ret_offset = p;
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+static void* verify_worker_thread(void *userdata) {
+        VerifyWorkers *w = userdata;
+        _cleanup_free_ void *buffer = NULL;
+        size_t allocated = 0;
+
+        (void) pthread_setname_np(pthread_self(), "journal-verify");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                _cleanup_free_ VerifyRegion *region = NULL;
+                uint64_t offset;
+                bool skip;
+                int r = 0;
+
+                while (!w->quit && !w->queue)
+                        assert_se(pthread_cond_wait(&w->work_cond, &w->mutex) == 0);
+
+                region = w->queue;
+                if (!region)
+                        break;
+
+                LIST_REMOVE(regions, w->queue, region);
+                if (w->queue_tail == region)
+                        w->queue_tail = NULL;
+                w->n_queued--;
+                w->n_busy++;
+
+                /* Once something is broken there's no point in looking any further */
+                skip = w->error < 0;
+
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                if (!skip)
+                        r = verify_region(w->file, region->start, region->end, &buffer, &allocated, &offset);
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+                if (r < 0 && (w->error >= 0 || offset < w->error_offset)) {
+                        w->error = r;
+                        w->error_offset = offset;
+                }
+
+                w->n_busy--;
+                assert_se(pthread_cond_broadcast(&w->done_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+static VerifyWorkers* verify_workers_free(VerifyWorkers *w) {
+        VerifyRegion *region;
+        size_t i;
+
+        if (!w)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        while ((region = w->queue)) {
+                LIST_REMOVE(regions, w->queue, region);
+                free(region);
+        }
+        w->queue_tail = NULL;
+        w->n_queued = 0;
+
+        w->quit = true;
+        assert_se(pthread_cond_broadcast(&w->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        for (i = 0; i < w->n_threads; i++)
+                assert_se(pthread_join(w->threads[i], NULL) == 0);
+
+        free(w->threads);
+
+        assert_se(pthread_cond_destroy(&w->done_cond) == 0);
+        assert_se(pthread_cond_destroy(&w->work_cond) == 0);
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
+        return mfree(w);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(VerifyWorkers*, verify_workers_free);
+
+static int verify_workers_new(JournalFile *f, unsigned n_threads, VerifyWorkers **ret) {
+        _cleanup_(verify_workers_freep) VerifyWorkers *w = NULL;
+        sigset_t ss, saved_ss;
+        int r = 0, k;
+
+        assert(f);
+        assert(n_threads > 1);
+        assert(ret);
+
+        w = new(VerifyWorkers, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (VerifyWorkers) {
+                .file = f,
+        };
+
+        assert_se(pthread_mutex_init(&w->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&w->work_cond, NULL) == 0);
+        assert_se(pthread_cond_init(&w->done_cond, NULL) == 0);
+
+        w->threads = new(pthread_t, n_threads);
+        if (!w->threads)
+                return -ENOMEM;
+
+        /* Leave all signals to the main thread */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        k = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (k > 0)
+                return -k;
+
+        while (w->n_threads < n_threads) {
+                r = pthread_create(w->threads + w->n_threads, NULL, verify_worker_thread, w);
+                if (r > 0)
+                        break;
+
+                w->n_threads++;
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+static int verify_workers_queue_region(VerifyWorkers *w) {
+        VerifyRegion *region;
+        int r;
+
+        assert(w);
+
+        if (w->region_start == w->region_end)
+                return 0;
+
+        region = new(VerifyRegion, 1);
+        if (!region)
+                return -ENOMEM;
+
+        *region = (VerifyRegion) {
+                .start = w->region_start,
+                .end = w->region_end,
+        };
+
+        w->region_start = w->region_end = 0;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        /* Don't let the walk get too far ahead of the workers, so that we don't read the whole file into
+         * memory */
+        while (w->error >= 0 && w->n_queued >= 2 * w->n_threads)
+                assert_se(pthread_cond_wait(&w->done_cond, &w->mutex) == 0);
+
+        r = w->error;
+        if (r >= 0) {
+                LIST_INSERT_AFTER(regions, w->queue, w->queue_tail, region);
+                w->queue_tail = TAKE_PTR(region);
+                w->n_queued++;
+
+                assert_se(pthread_cond_signal(&w->work_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        free(region);
+        return r;
+}
+
+static int verify_workers_add(VerifyWorkers *w, uint64_t p, uint64_t size) {
+        int r;
+
+        assert(w);
+
+        if (w->region_start != w->region_end &&
+            (w->region_end != p || w->region_end - w->region_start >= VERIFY_REGION_SIZE)) {
+                r = verify_workers_queue_region(w);
+                if (r < 0)
+                        return r;
+        }
+
+        if (w->region_start == w->region_end)
+                w->region_start = p;
+
+        w->region_end = p + ALIGN64(size);
+        return 0;
+}
+
+static int verify_workers_finish(VerifyWorkers *w, uint64_t *ret_offset) {
+        int r;
+
+        assert(w);
+        assert(ret_offset);
+
+        /* Waits until everything that was queued is checked. Returns the first error any of the workers ran
+         * into, together with the offset of the object in question. */
+
+        r = verify_workers_queue_region(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        while (w->n_queued > 0 || w->n_busy > 0)
+                assert_se(pthread_cond_wait(&w->done_cond, &w->mutex) == 0);
+
+        if (w->error < 0) {
+                r = w->error;
+                *ret_offset = w->error_offset;
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return r;
+}
+
 static int contains_uint64(MMapCache *m, MMapFileDescriptor *f, uint64_t n, uint64_t p) {
         uint64_t a, b;
         int r;
@@ -571,7 +1274,7 @@ static int verify_hash_table(
                 MMapFileDescriptor *cache_data_fd, uint64_t n_data,
                 MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
                 MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays,
-                usec_t *last_usec,
+                VerifyProgress *progress,
                 bool show_progress) {
 
         uint64_t i, n;
@@ -581,7 +1284,7 @@ static int verify_hash_table(
         assert(cache_data_fd);
         assert(cache_entry_fd);
         assert(cache_entry_array_fd);
-        assert(last_usec);
+        assert(progress);
 
         n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
         if (n <= 0)
@@ -595,7 +1298,7 @@ static int verify_hash_table(
                 uint64_t last = 0, p;
 
                 if (show_progress)
-                        draw_progress(0xC000 + scale_progress(0x3FFF, i, n), last_usec);
+                        draw_progress(0xC000 + scale_progress(0x3FFF, i, n), progress);
 
                 p = le64toh(f->data_hash_table[i].head_hash_offset);
                 while (p != 0) {
@@ -705,6 +1408,9 @@ static int verify_entry(
                         return -EBADMSG;
                 }
 
+                if (u->object.flags & OBJECT_UNINDEXED)
+                        continue;
+
                 r = data_object_in_hash_table(f, h, q);
                 if (r < 0)
                         return r;
@@ -722,7 +1428,7 @@ static int verify_entry_array(
                 MMapFileDescriptor *cache_data_fd, uint64_t n_data,
                 MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
                 MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays,
-                usec_t *last_usec,
+                VerifyProgress *progress,
                 bool show_progress) {
 
         uint64_t i = 0, a, n, last = 0;
@@ -732,7 +1438,7 @@ static int verify_entry_array(
         assert(cache_data_fd);
         assert(cache_entry_fd);
         assert(cache_entry_array_fd);
-        assert(last_usec);
+        assert(progress);
 
         n = le64toh(f->header->n_entries);
         a = le64toh(f->header->entry_array_offset);
@@ -741,7 +1447,7 @@ static int verify_entry_array(
                 Object *o;
 
                 if (show_progress)
-                        draw_progress(0x8000 + scale_progress(0x3FFF, i, n), last_usec);
+                        draw_progress(0x8000 + scale_progress(0x3FFF, i, n), progress);
 
                 if (a == 0) {
                         error(a, "Array chain too short at %"PRIu64" of %"PRIu64, i, n);
@@ -799,30 +1505,29 @@ static int verify_entry_array(
         return 0;
 }
 
-int journal_file_verify(
+int journal_file_verify_full(
                 JournalFile *f,
                 const char *key,
-                usec_t *first_contained, usec_t *last_validated, usec_t *last_contained,
-                bool show_progress) {
+                const JournalVerifyOptions *options,
+                usec_t *first_contained, usec_t *last_validated, usec_t *last_contained) {
         int r;
         Object *o;
-        uint64_t p = 0, last_epoch = 0, last_tag_realtime = 0, last_sealed_realtime = 0;
-
-        uint64_t entry_seqnum = 0, entry_monotonic = 0, entry_realtime = 0;
-        sd_id128_t entry_boot_id;
-        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
-        uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_tags = 0;
-        usec_t last_usec = 0;
-        int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
-        MMapFileDescriptor *cache_data_fd = NULL, *cache_entry_fd = NULL, *cache_entry_array_fd = NULL;
+        uint64_t p = 0, q, start;
+        VerifyState s = {};
+        VerifyIndex data = VERIFY_INDEX_NULL, entries = VERIFY_INDEX_NULL, entry_arrays = VERIFY_INDEX_NULL;
+        _cleanup_(verify_workers_freep) VerifyWorkers *workers = NULL;
+        _cleanup_free_ char *checkpoint_path = NULL;
+        VerifyCheckpoint checkpoint = {};
+        VerifyProgress progress = {};
+        bool show_progress, have_checkpoint = false, resumed = false;
         unsigned i;
         bool found_last = false;
         const char *tmp_dir = NULL;
 
-#if HAVE_GCRYPT
-        uint64_t last_tag = 0;
-#endif
         assert(f);
+        assert(options);
+
+        show_progress = options->show_progress;
 
         if (key) {
 #if HAVE_GCRYPT
@@ -843,40 +1548,21 @@ int journal_file_verify(
                 goto fail;
         }
 
-        data_fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
-        if (data_fd < 0) {
-                r = log_error_errno(data_fd, "Failed to create data file: %m");
-                goto fail;
-        }
-
-        entry_fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
-        if (entry_fd < 0) {
-                r = log_error_errno(entry_fd, "Failed to create entry file: %m");
-                goto fail;
-        }
-
-        entry_array_fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
-        if (entry_array_fd < 0) {
-                r = log_error_errno(entry_array_fd,
-                                    "Failed to create entry array file: %m");
-                goto fail;
-        }
-
-        cache_data_fd = mmap_cache_add_fd(f->mmap, data_fd);
-        if (!cache_data_fd) {
-                r = log_oom();
+        r = verify_index_open(&data, f->mmap, tmp_dir);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create data file: %m");
                 goto fail;
         }
 
-        cache_entry_fd = mmap_cache_add_fd(f->mmap, entry_fd);
-        if (!cache_entry_fd) {
-                r = log_oom();
+        r = verify_index_open(&entries, f->mmap, tmp_dir);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create entry file: %m");
                 goto fail;
         }
 
-        cache_entry_array_fd = mmap_cache_add_fd(f->mmap, entry_array_fd);
-        if (!cache_entry_array_fd) {
-                r = log_oom();
+        r = verify_index_open(&entry_arrays, f->mmap, tmp_dir);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create entry array file: %m");
                 goto fail;
         }
 
@@ -893,17 +1579,79 @@ int journal_file_verify(
                         goto fail;
                 }
 
+        if (options->n_threads > 1) {
+                ZstdDictionary *d;
+
+                /* The workers can't load the dictionary on their own, as that goes through the mmap
+                 * cache. If it is broken, we find out single-threaded. */
+                if (journal_file_get_zstd_dictionary(f, &d) >= 0) {
+                        r = verify_workers_new(f, options->n_threads, &workers);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to start verification threads: %m");
+                                goto fail;
+                        }
+                }
+        }
+
+        p = le64toh(f->header->header_size);
+
+        if (options->checkpoint_dir) {
+                char id[SD_ID128_STRING_MAX];
+
+                checkpoint_path = path_join(options->checkpoint_dir, strjoina(sd_id128_to_string(f->header->file_id, id), ".verify"));
+                if (!checkpoint_path) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                r = verify_checkpoint_load(f, checkpoint_path, verify_key_hash(f, key),
+                                           &data, &entries, &entry_arrays, &checkpoint);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to load verification checkpoint %s, ignoring: %m", checkpoint_path);
+                if (r > 0) {
+                        log_debug("Resuming verification of %s after "OFSfmt" (epoch %"PRIu64").",
+                                  f->path, checkpoint.object_offset, checkpoint.state.last_epoch);
+
+                        s = checkpoint.state;
+                        have_checkpoint = resumed = true;
+
+                        if (checkpoint.object_offset == le64toh(f->header->tail_object_offset))
+                                found_last = true;
+                        else
+                                p = checkpoint.object_offset + ALIGN64(checkpoint.object_size);
+                } else {
+                        /* Start over with empty indexes, whatever was loaded into them */
+                        if (verify_index_reset(&data) < 0 ||
+                            verify_index_reset(&entries) < 0 ||
+                            verify_index_reset(&entry_arrays) < 0) {
+                                r = log_error_errno(errno, "Failed to reset temporary files: %m");
+                                goto fail;
+                        }
+
+                        checkpoint = (VerifyCheckpoint) {
+                                .file_id = f->header->file_id,
+                                .seqnum_id = f->header->seqnum_id,
+                                .key_hash = verify_key_hash(f, key),
+                        };
+                        memcpy(checkpoint.signature, VERIFY_CHECKPOINT_SIGNATURE, sizeof(checkpoint.signature));
+                }
+        }
+
         /* First iteration: we go through all objects, verify the
          * superficial structure, headers, hashes. */
 
-        p = le64toh(f->header->header_size);
-        for (;;) {
+        start = p;
+        progress.start_usec = now(CLOCK_MONOTONIC);
+
+        while (!found_last) {
                 /* Early exit if there are no objects in the file, at all */
                 if (le64toh(f->header->tail_object_offset) == 0)
                         break;
 
-                if (show_progress)
-                        draw_progress(scale_progress(0x7FFF, p, le64toh(f->header->tail_object_offset)), &last_usec);
+                if (show_progress) {
+                        progress.n_bytes = p - start;
+                        draw_progress(scale_progress(0x7FFF, p, le64toh(f->header->tail_object_offset)), &progress);
+                }
 
                 r = journal_file_move_to_object(f, OBJECT_UNUSED, p, &o);
                 if (r < 0) {
@@ -917,12 +1665,22 @@ int journal_file_verify(
                         goto fail;
                 }
 
-                n_objects++;
+                s.n_objects++;
 
-                r = journal_file_object_verify(f, p, o);
-                if (r < 0) {
-                        error_errno(p, r, "Invalid object contents: %m");
-                        goto fail;
+                if (workers) {
+                        r = verify_workers_add(workers, p, le64toh(o->object.size));
+                        if (r == -ENOMEM) {
+                                log_oom();
+                                goto fail;
+                        }
+                        if (r < 0)
+                                goto fail;
+                } else {
+                        r = journal_file_object_verify(f, p, o);
+                        if (r < 0) {
+                                error_errno(p, r, "Invalid object contents: %m");
+                                goto fail;
+                        }
                 }
 
                 if (!!(o->object.flags & OBJECT_COMPRESSED_XZ) +
@@ -954,78 +1712,80 @@ int journal_file_verify(
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
-                        r = write_uint64(data_fd, p);
+                        r = verify_index_append(&data, p);
                         if (r < 0)
                                 goto fail;
 
-                        n_data++;
+                        s.n_data++;
+                        if (o->object.flags & OBJECT_UNINDEXED)
+                                s.n_unindexed++;
                         break;
 
                 case OBJECT_FIELD:
-                        n_fields++;
+                        s.n_fields++;
                         break;
 
                 case OBJECT_ENTRY:
-                        if (JOURNAL_HEADER_SEALED(f->header) && n_tags <= 0) {
+                        if (JOURNAL_HEADER_SEALED(f->header) && s.n_tags <= 0) {
                                 error(p, "First entry before first tag");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        r = write_uint64(entry_fd, p);
+                        r = verify_index_append(&entries, p);
                         if (r < 0)
                                 goto fail;
 
-                        if (le64toh(o->entry.realtime) < last_tag_realtime) {
+                        if (le64toh(o->entry.realtime) < s.last_tag_realtime) {
                                 error(p, "Older entry after newer tag");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        if (!entry_seqnum_set &&
+                        if (!s.entry_seqnum_set &&
                             le64toh(o->entry.seqnum) != le64toh(f->header->head_entry_seqnum)) {
                                 error(p, "Head entry sequence number incorrect");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        if (entry_seqnum_set &&
-                            entry_seqnum >= le64toh(o->entry.seqnum)) {
+                        if (s.entry_seqnum_set &&
+                            s.entry_seqnum >= le64toh(o->entry.seqnum)) {
                                 error(p, "Entry sequence number out of synchronization");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        entry_seqnum = le64toh(o->entry.seqnum);
-                        entry_seqnum_set = true;
+                        s.entry_seqnum = le64toh(o->entry.seqnum);
+                        s.entry_seqnum_set = true;
 
-                        if (entry_monotonic_set &&
-                            sd_id128_equal(entry_boot_id, o->entry.boot_id) &&
-                            entry_monotonic > le64toh(o->entry.monotonic)) {
+                        if (s.entry_monotonic_set &&
+                            sd_id128_equal(s.entry_boot_id, o->entry.boot_id) &&
+                            s.entry_monotonic > le64toh(o->entry.monotonic)) {
                                 error(p, "Entry timestamp out of synchronization");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        entry_monotonic = le64toh(o->entry.monotonic);
-                        entry_boot_id = o->entry.boot_id;
-                        entry_monotonic_set = true;
+                        s.entry_monotonic = le64toh(o->entry.monotonic);
+                        s.entry_boot_id = o->entry.boot_id;
+                        s.entry_monotonic_set = true;
 
-                        if (!entry_realtime_set &&
+                        if (!s.entry_realtime_set &&
                             le64toh(o->entry.realtime) != le64toh(f->header->head_entry_realtime)) {
                                 error(p, "Head entry realtime timestamp incorrect");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        entry_realtime = le64toh(o->entry.realtime);
-                        entry_realtime_set = true;
+                        s.entry_realtime = le64toh(o->entry.realtime);
+                        s.entry_realtime_set = true;
 
-                        n_entries++;
+                        s.n_entries++;
                         break;
 
                 case OBJECT_DATA_HASH_TABLE:
-                        if (n_data_hash_tables > 1) {
+                        if (s.n_data_hash_tables > 1) {
                                 error(p, "More than one data hash table");
                                 r = -EBADMSG;
                                 goto fail;
@@ -1038,11 +1798,11 @@ int journal_file_verify(
                                 goto fail;
                         }
 
-                        n_data_hash_tables++;
+                        s.n_data_hash_tables++;
                         break;
 
                 case OBJECT_FIELD_HASH_TABLE:
-                        if (n_field_hash_tables > 1) {
+                        if (s.n_field_hash_tables > 1) {
                                 error(p, "More than one field hash table");
                                 r = -EBADMSG;
                                 goto fail;
@@ -1055,25 +1815,25 @@ int journal_file_verify(
                                 goto fail;
                         }
 
-                        n_field_hash_tables++;
+                        s.n_field_hash_tables++;
                         break;
 
                 case OBJECT_ENTRY_ARRAY:
-                        r = write_uint64(entry_array_fd, p);
+                        r = verify_index_append(&entry_arrays, p);
                         if (r < 0)
                                 goto fail;
 
                         if (p == le64toh(f->header->entry_array_offset)) {
-                                if (found_main_entry_array) {
+                                if (s.found_main_entry_array) {
                                         error(p, "More than one main entry array");
                                         r = -EBADMSG;
                                         goto fail;
                                 }
 
-                                found_main_entry_array = true;
+                                s.found_main_entry_array = true;
                         }
 
-                        n_entry_arrays++;
+                        s.n_entry_arrays++;
                         break;
 
                 case OBJECT_TAG:
@@ -1083,13 +1843,13 @@ int journal_file_verify(
                                 goto fail;
                         }
 
-                        if (le64toh(o->tag.seqnum) != n_tags + 1) {
+                        if (le64toh(o->tag.seqnum) != s.n_tags + 1) {
                                 error(p, "Tag sequence number out of synchronization");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
-                        if (le64toh(o->tag.epoch) < last_epoch) {
+                        if (le64toh(o->tag.epoch) < s.last_epoch) {
                                 error(p, "Epoch sequence out of synchronization");
                                 r = -EBADMSG;
                                 goto fail;
@@ -1097,12 +1857,12 @@ int journal_file_verify(
 
 #if HAVE_GCRYPT
                         if (f->seal) {
-                                uint64_t q, rt;
+                                uint64_t rt;
 
                                 debug(p, "Checking tag %"PRIu64"...", le64toh(o->tag.seqnum));
 
                                 rt = f->fss_start_usec + le64toh(o->tag.epoch) * f->fss_interval_usec;
-                                if (entry_realtime_set && entry_realtime >= rt + f->fss_interval_usec) {
+                                if (s.entry_realtime_set && s.entry_realtime >= rt + f->fss_interval_usec) {
                                         error(p, "tag/entry realtime timestamp out of synchronization");
                                         r = -EBADMSG;
                                         goto fail;
@@ -1119,14 +1879,14 @@ int journal_file_verify(
                                 if (r < 0)
                                         goto fail;
 
-                                if (last_tag == 0) {
+                                if (s.last_tag == 0) {
                                         r = journal_file_hmac_put_header(f);
                                         if (r < 0)
                                                 goto fail;
 
                                         q = le64toh(f->header->header_size);
                                 } else
-                                        q = last_tag;
+                                        q = s.last_tag;
 
                                 while (q <= p) {
                                         r = journal_file_move_to_object(f, OBJECT_UNUSED, q, &o);
@@ -1152,20 +1912,61 @@ int journal_file_verify(
                                 }
 
                                 f->hmac_running = false;
-                                last_tag_realtime = rt;
-                                last_sealed_realtime = entry_realtime;
+                                s.last_tag_realtime = rt;
+                                s.last_sealed_realtime = s.entry_realtime;
                         }
 
-                        last_tag = p + ALIGN64(le64toh(o->object.size));
+                        s.last_tag = p + ALIGN64(le64toh(o->object.size));
 #endif
 
-                        last_epoch = le64toh(o->tag.epoch);
+                        s.last_epoch = le64toh(o->tag.epoch);
 
-                        n_tags++;
+                        s.n_tags++;
+                        break;
+
+                case OBJECT_BLOOM_FILTER:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) ||
+                            p != le64toh(f->header->bloom_filter_offset)) {
+                                error(p, "Bloom filter object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        s.found_bloom_filter = true;
+                        break;
+
+                case OBJECT_ZSTD_DICTIONARY:
+                        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ||
+                            !JOURNAL_HEADER_CONTAINS(f->header, zstd_dictionary_offset) ||
+                            p != le64toh(f->header->zstd_dictionary_offset)) {
+                                error(p, "Zstd dictionary object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        s.found_zstd_dictionary = true;
+                        break;
+
+                case OBJECT_FIELD_STATS:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, field_stats_offset) ||
+                            le64toh(o->field_stats.next_field_stats_offset) != s.field_stats_tail) {
+                                error(p, "Field statistics object not linked to the previous one");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        s.field_stats_tail = p;
                         break;
 
                 default:
-                        n_weird++;
+                        s.n_weird++;
+                }
+
+                /* With sealing, only what a tag covers counts as verified */
+                if (checkpoint_path &&
+                    (f->seal ? o->object.type == OBJECT_TAG : p == le64toh(f->header->tail_object_offset))) {
+                        verify_checkpoint_update(&checkpoint, &s, p, o);
+                        have_checkpoint = true;
                 }
 
                 if (p == le64toh(f->header->tail_object_offset)) {
@@ -1176,79 +1977,118 @@ int journal_file_verify(
                 p = p + ALIGN64(le64toh(o->object.size));
         };
 
+        progress.n_bytes = p - start;
+
+        if (workers) {
+                r = verify_workers_finish(workers, &p);
+                if (r < 0)
+                        goto fail;
+        }
+
         if (!found_last && le64toh(f->header->tail_object_offset) != 0) {
                 error(le64toh(f->header->tail_object_offset), "Tail object pointer dead");
                 r = -EBADMSG;
                 goto fail;
         }
 
-        if (n_objects != le64toh(f->header->n_objects)) {
+        if (s.n_objects != le64toh(f->header->n_objects)) {
                 error(offsetof(Header, n_objects), "Object number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
-        if (n_entries != le64toh(f->header->n_entries)) {
+        if (s.n_entries != le64toh(f->header->n_entries)) {
                 error(offsetof(Header, n_entries), "Entry number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
-            n_data != le64toh(f->header->n_data)) {
+            s.n_data - s.n_unindexed != le64toh(f->header->n_data)) {
                 error(offsetof(Header, n_data), "Data number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_fields) &&
-            n_fields != le64toh(f->header->n_fields)) {
+            s.n_fields != le64toh(f->header->n_fields)) {
                 error(offsetof(Header, n_fields), "Field number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_tags) &&
-            n_tags != le64toh(f->header->n_tags)) {
+            s.n_tags != le64toh(f->header->n_tags)) {
                 error(offsetof(Header, n_tags), "Tag number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays) &&
-            n_entry_arrays != le64toh(f->header->n_entry_arrays)) {
+            s.n_entry_arrays != le64toh(f->header->n_entry_arrays)) {
                 error(offsetof(Header, n_entry_arrays), "Entry array number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
-        if (!found_main_entry_array && le64toh(f->header->entry_array_offset) != 0) {
+        if (!s.found_main_entry_array && le64toh(f->header->entry_array_offset) != 0) {
                 error(0, "Missing entry array");
                 r = -EBADMSG;
                 goto fail;
         }
 
-        if (entry_seqnum_set &&
-            entry_seqnum != le64toh(f->header->tail_entry_seqnum)) {
+        if (!s.found_bloom_filter &&
+            JOURNAL_HEADER_CONTAINS(f->header, bloom_filter_offset) &&
+            le64toh(f->header->bloom_filter_offset) != 0) {
+                error(offsetof(Header, bloom_filter_offset), "Missing bloom filter");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_stats_offset) &&
+            le64toh(f->header->field_stats_offset) != s.field_stats_tail) {
+                error(offsetof(Header, field_stats_offset), "Field statistics object not referenced by header");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (!s.found_zstd_dictionary && JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                error(offsetof(Header, zstd_dictionary_offset), "Missing zstd dictionary");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (s.entry_seqnum_set &&
+            s.entry_seqnum != le64toh(f->header->tail_entry_seqnum)) {
                 error(offsetof(Header, tail_entry_seqnum), "Invalid tail seqnum");
                 r = -EBADMSG;
                 goto fail;
         }
 
-        if (entry_monotonic_set &&
-            (sd_id128_equal(entry_boot_id, f->header->boot_id) &&
-             entry_monotonic != le64toh(f->header->tail_entry_monotonic))) {
+        if (s.entry_monotonic_set &&
+            (sd_id128_equal(s.entry_boot_id, f->header->boot_id) &&
+             s.entry_monotonic != le64toh(f->header->tail_entry_monotonic))) {
                 error(0, "Invalid tail monotonic timestamp");
                 r = -EBADMSG;
                 goto fail;
         }
 
-        if (entry_realtime_set && entry_realtime != le64toh(f->header->tail_entry_realtime)) {
+        if (s.entry_realtime_set && s.entry_realtime != le64toh(f->header->tail_entry_realtime)) {
                 error(0, "Invalid tail realtime timestamp");
                 r = -EBADMSG;
                 goto fail;
         }
 
+        r = verify_index_flush(&data);
+        if (r >= 0)
+                r = verify_index_flush(&entries);
+        if (r >= 0)
+                r = verify_index_flush(&entry_arrays);
+        if (r < 0) {
+                log_error_errno(r, "Failed to write temporary files: %m");
+                goto fail;
+        }
+
         /* Second iteration: we follow all objects referenced from the
          * two entry points: the object hash table and the entry
          * array. We also check that everything referenced (directly
@@ -1258,38 +2098,52 @@ int journal_file_verify(
          * referenced is consistent. */
 
         r = verify_entry_array(f,
-                               cache_data_fd, n_data,
-                               cache_entry_fd, n_entries,
-                               cache_entry_array_fd, n_entry_arrays,
-                               &last_usec,
+                               data.cache_fd, data.n,
+                               entries.cache_fd, entries.n,
+                               entry_arrays.cache_fd, entry_arrays.n,
+                               &progress,
                                show_progress);
         if (r < 0)
                 goto fail;
 
         r = verify_hash_table(f,
-                              cache_data_fd, n_data,
-                              cache_entry_fd, n_entries,
-                              cache_entry_array_fd, n_entry_arrays,
-                              &last_usec,
+                              data.cache_fd, data.n,
+                              entries.cache_fd, entries.n,
+                              entry_arrays.cache_fd, entry_arrays.n,
+                              &progress,
                               show_progress);
         if (r < 0)
                 goto fail;
 
-        if (show_progress)
+        if (show_progress) {
+                char a[FORMAT_BYTES_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_BYTES_MAX];
+                usec_t d;
+
                 flush_progress();
 
-        mmap_cache_free_fd(f->mmap, cache_data_fd);
-        mmap_cache_free_fd(f->mmap, cache_entry_fd);
-        mmap_cache_free_fd(f->mmap, cache_entry_array_fd);
+                d = MAX(now(CLOCK_MONOTONIC) - progress.start_usec, (usec_t) 1);
+                log_info("%s: checked %s%s in %s (%s/s).",
+                         f->path,
+                         format_bytes(a, sizeof(a), progress.n_bytes),
+                         resumed ? " since the last checkpoint" : "",
+                         format_timespan(b, sizeof(b), d, USEC_PER_MSEC),
+                         format_bytes(c, sizeof(c), progress.n_bytes * USEC_PER_SEC / d));
+        }
+
+        if (have_checkpoint) {
+                r = verify_checkpoint_save(checkpoint_path, &checkpoint, &data, &entries, &entry_arrays);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to save verification checkpoint %s, ignoring: %m", checkpoint_path);
+        }
 
-        safe_close(data_fd);
-        safe_close(entry_fd);
-        safe_close(entry_array_fd);
+        verify_index_done(&data, f->mmap);
+        verify_index_done(&entries, f->mmap);
+        verify_index_done(&entry_arrays, f->mmap);
 
         if (first_contained)
                 *first_contained = le64toh(f->header->head_entry_realtime);
         if (last_validated)
-                *last_validated = last_sealed_realtime;
+                *last_validated = s.last_sealed_realtime;
         if (last_contained)
                 *last_contained = le64toh(f->header->tail_entry_realtime);
 
@@ -1299,29 +2153,20 @@ fail:
         if (show_progress)
                 flush_progress();
 
+        /* One of the workers might have found something earlier in the file */
+        q = p;
+        if (workers && verify_workers_finish(workers, &q) < 0 && q < p)
+                p = q;
+
         log_error("File corruption detected at %s:"OFSfmt" (of %llu bytes, %"PRIu64"%%).",
                   f->path,
                   p,
                   (unsigned long long) f->last_stat.st_size,
                   100 * p / f->last_stat.st_size);
 
-        if (data_fd >= 0)
-                safe_close(data_fd);
-
-        if (entry_fd >= 0)
-                safe_close(entry_fd);
-
-        if (entry_array_fd >= 0)
-                safe_close(entry_array_fd);
-
-        if (cache_data_fd)
-                mmap_cache_free_fd(f->mmap, cache_data_fd);
-
-        if (cache_entry_fd)
-                mmap_cache_free_fd(f->mmap, cache_entry_fd);
-
-        if (cache_entry_array_fd)
-                mmap_cache_free_fd(f->mmap, cache_entry_array_fd);
+        verify_index_done(&data, f->mmap);
+        verify_index_done(&entries, f->mmap);
+        verify_index_done(&entry_arrays, f->mmap);
 
         return r;
 }
@@ -3,4 +3,25 @@
 
 #include "journal-file.h"
 
-int journal_file_verify(JournalFile *f, const char *key, usec_t *first_contained, usec_t *last_validated, usec_t *last_contained, bool show_progress);
+typedef struct JournalVerifyOptions {
+        /* If larger than 1, the contents of the objects are checked by this many threads */
+        unsigned n_threads;
+
+        /* If set, where to keep a checkpoint for each verified file, so that the next run only checks what
+         * was appended since */
+        const char *checkpoint_dir;
+
+        bool show_progress;
+} JournalVerifyOptions;
+
+int journal_file_verify_full(
+                JournalFile *f,
+                const char *key,
+                const JournalVerifyOptions *options,
+                usec_t *first_contained, usec_t *last_validated, usec_t *last_contained);
+
+static inline int journal_file_verify(JournalFile *f, const char *key, usec_t *first_contained, usec_t *last_validated, usec_t *last_contained, bool show_progress) {
+        return journal_file_verify_full(f, key,
+                                        &(const JournalVerifyOptions) { .n_threads = 1, .show_progress = show_progress },
+                                        first_contained, last_validated, last_contained);
+}
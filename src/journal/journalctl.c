@@ -6,6 +6,7 @@
 #include <getopt.h>
 #include <linux/fs.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -47,6 +48,7 @@
 #include "journal-util.h"
 #include "journal-vacuum.h"
 #include "journal-verify.h"
+#include "list.h"
 #include "locale-util.h"
 #include "log.h"
 #include "logs-show.h"
@@ -63,6 +65,7 @@
 #include "random-util.h"
 #include "rlimit-util.h"
 #include "set.h"
+#include "sort-util.h"
 #include "sigbus.h"
 #include "stdio-util.h"
 #include "string-table.h"
@@ -77,6 +80,9 @@
 #define DEFAULT_FSS_INTERVAL_USEC (15*USEC_PER_MINUTE)
 #define PROCESS_INOTIFY_INTERVAL 1024   /* Every 1,024 messages processed */
 
+#define SCAN_BATCH_ENTRIES 256U        /* Entries formatted by a --threads= worker in one go */
+#define SCAN_QUEUE_BATCHES 4U          /* Batches a --threads= worker may have queued up */
+
 enum {
         /* Special values for arg_lines */
         ARG_LINES_DEFAULT = -2,
@@ -104,10 +110,12 @@ static const char *arg_after_cursor = NULL;
 static bool arg_show_cursor = false;
 static const char *arg_directory = NULL;
 static char **arg_file = NULL;
+static unsigned arg_threads = 1;
 static bool arg_file_stdin = false;
 static int arg_priorities = 0xFF;
 static Set *arg_facilities = NULL;
 static char *arg_verify_key = NULL;
+static char *arg_verify_checkpoint_dir = NULL;
 #if HAVE_GCRYPT
 static usec_t arg_interval = DEFAULT_FSS_INTERVAL_USEC;
 static bool arg_force = false;
@@ -155,13 +163,13 @@ static enum {
         ACTION_ROTATE_AND_VACUUM,
         ACTION_LIST_FIELDS,
         ACTION_LIST_FIELD_NAMES,
+        ACTION_COUNT_FIELD_VALUES,
 } arg_action = ACTION_SHOW;
 
 typedef struct BootId {
         sd_id128_t id;
         uint64_t first;
         uint64_t last;
-        LIST_FIELDS(struct BootId, boot_list);
 } BootId;
 
 #if HAVE_PCRE2
@@ -377,17 +385,21 @@ static int help(void) {
                "  -m --merge                 Show entries from all available journals\n"
                "  -D --directory=PATH        Show journal files from directory\n"
                "     --file=PATH             Show journal file\n"
+               "     --threads=N             Scan journal files with N parallel threads\n"
                "     --root=ROOT             Operate on files below a root directory\n"
                "     --image=IMAGE           Operate on files in filesystem image\n"
                "     --namespace=NAMESPACE   Show journal data from specified namespace\n"
                "     --interval=TIME         Time interval for changing the FSS sealing key\n"
                "     --verify-key=KEY        Specify FSS verification key\n"
+               "     --verify-checkpoint-dir=PATH\n"
+               "                             Only verify what was added since the last run\n"
                "     --force                 Override of the FSS key pair with --setup-keys\n"
                "\n%3$sCommands:%4$s\n"
                "  -h --help                  Show this help text\n"
                "     --version               Show package version\n"
                "  -N --fields                List all field names currently used\n"
                "  -F --field=FIELD           List all values that a specified field takes\n"
+               "     --count-by=FIELD        Count the entries for each value of the field\n"
                "     --disk-usage            Show total disk usage of all journal files\n"
                "     --vacuum-size=BYTES     Reduce disk usage below specified size\n"
                "     --vacuum-files=INT      Leave only the specified number of journal files\n"
@@ -431,9 +443,11 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_FACILITY,
                 ARG_SETUP_KEYS,
                 ARG_FILE,
+                ARG_THREADS,
                 ARG_INTERVAL,
                 ARG_VERIFY,
                 ARG_VERIFY_KEY,
+                ARG_VERIFY_CHECKPOINT_DIR,
                 ARG_DISK_USAGE,
                 ARG_AFTER_CURSOR,
                 ARG_CURSOR_FILE,
@@ -456,6 +470,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_NO_HOSTNAME,
                 ARG_OUTPUT_FIELDS,
                 ARG_NAMESPACE,
+                ARG_COUNT_BY,
         };
 
         static const struct option options[] = {
@@ -482,6 +497,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "user",                 no_argument,       NULL, ARG_USER                 },
                 { "directory",            required_argument, NULL, 'D'                      },
                 { "file",                 required_argument, NULL, ARG_FILE                 },
+                { "threads",              required_argument, NULL, ARG_THREADS              },
                 { "root",                 required_argument, NULL, ARG_ROOT                 },
                 { "image",                required_argument, NULL, ARG_IMAGE                },
                 { "header",               no_argument,       NULL, ARG_HEADER               },
@@ -494,6 +510,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "interval",             required_argument, NULL, ARG_INTERVAL             },
                 { "verify",               no_argument,       NULL, ARG_VERIFY               },
                 { "verify-key",           required_argument, NULL, ARG_VERIFY_KEY           },
+                { "verify-checkpoint-dir", required_argument, NULL, ARG_VERIFY_CHECKPOINT_DIR },
                 { "disk-usage",           no_argument,       NULL, ARG_DISK_USAGE           },
                 { "cursor",               required_argument, NULL, 'c'                      },
                 { "cursor-file",          required_argument, NULL, ARG_CURSOR_FILE          },
@@ -505,6 +522,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "user-unit",            required_argument, NULL, ARG_USER_UNIT            },
                 { "field",                required_argument, NULL, 'F'                      },
                 { "fields",               no_argument,       NULL, 'N'                      },
+                { "count-by",             required_argument, NULL, ARG_COUNT_BY             },
                 { "catalog",              no_argument,       NULL, 'x'                      },
                 { "list-catalog",         no_argument,       NULL, ARG_LIST_CATALOG         },
                 { "dump-catalog",         no_argument,       NULL, ARG_DUMP_CATALOG         },
@@ -718,6 +736,13 @@ static int parse_argv(int argc, char *argv[]) {
                         }
                         break;
 
+                case ARG_THREADS:
+                        r = safe_atou(optarg, &arg_threads);
+                        if (r < 0 || arg_threads == 0)
+                                return log_error_errno(r < 0 ? r : SYNTHETIC_ERRNO(EINVAL),
+                                                       "Failed to parse number of threads: %s", optarg);
+                        break;
+
                 case ARG_ROOT:
                         r = parse_path_argument_and_warn(optarg, /* suppress_root= */ true, &arg_root);
                         if (r < 0)
@@ -754,6 +779,12 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_action = ACTION_VERIFY;
                         break;
 
+                case ARG_VERIFY_CHECKPOINT_DIR:
+                        r = parse_path_argument_and_warn(optarg, /* suppress_root= */ false, &arg_verify_checkpoint_dir);
+                        if (r < 0)
+                                return r;
+                        break;
+
                 case ARG_DISK_USAGE:
                         arg_action = ACTION_DISK_USAGE;
                         break;
@@ -959,6 +990,11 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_action = ACTION_LIST_FIELD_NAMES;
                         break;
 
+                case ARG_COUNT_BY:
+                        arg_action = ACTION_COUNT_FIELD_VALUES;
+                        arg_field = optarg;
+                        break;
+
                 case ARG_NO_HOSTNAME:
                         arg_no_hostname = true;
                         break;
@@ -1080,6 +1116,25 @@ static int parse_argv(int argc, char *argv[]) {
                 return -EINVAL;
         }
 
+        if (arg_threads > 1 && arg_action != ACTION_VERIFY &&
+            (arg_action != ACTION_SHOW || arg_follow || arg_reverse || arg_lines >= 0 ||
+             arg_cursor || arg_after_cursor || arg_cursor_file || arg_show_cursor)) {
+                log_error("--threads= may only be used with --verify, or to show all entries in forward order, without cursors.");
+                return -EINVAL;
+        }
+
+        if (arg_threads > 1 && (arg_file_stdin || arg_machine)) {
+                log_error("Using --threads= with --machine= or when reading from standard input is not supported.");
+                return -EINVAL;
+        }
+
+#if HAVE_PCRE2
+        if (arg_threads > 1 && arg_pattern) {
+                log_error("Using --threads= with --grep= is not supported.");
+                return -EINVAL;
+        }
+#endif
+
         if ((arg_boot || arg_action == ACTION_LIST_BOOTS) && arg_merge) {
                 log_error("Using --boot or --list-boots with --merge is not supported.");
                 return -EINVAL;
@@ -1220,15 +1275,6 @@ static int add_matches(sd_journal *j, char **args) {
         return 0;
 }
 
-static void boot_id_free_all(BootId *l) {
-
-        while (l) {
-                BootId *i = l;
-                LIST_REMOVE(boot_list, l, i);
-                free(i);
-        }
-}
-
 static int discover_next_boot(sd_journal *j,
                 sd_id128_t previous_boot_id,
                 bool advance_older,
@@ -1321,29 +1367,28 @@ static int discover_next_boot(sd_journal *j,
 
 static int get_boots(
                 sd_journal *j,
-                BootId **boots,
                 sd_id128_t *boot_id,
                 int offset) {
 
         bool skip_once;
         int r, count = 0;
-        BootId *head = NULL, *tail = NULL, *id;
-        const bool advance_older = boot_id && offset <= 0;
+        const bool advance_older = offset <= 0;
         sd_id128_t previous_boot_id;
 
         assert(j);
+        assert(boot_id);
 
         /* Adjust for the asymmetry that offset 0 is
          * the last (and current) boot, while 1 is considered the
          * (chronological) first boot in the journal. */
-        skip_once = boot_id && sd_id128_is_null(*boot_id) && offset <= 0;
+        skip_once = sd_id128_is_null(*boot_id) && offset <= 0;
 
         /* Advance to the earliest/latest occurrence of our reference
          * boot ID (taking our lookup direction into account), so that
          * discover_next_boot() can do its job.
          * If no reference is given, the journal head/tail will do,
          * they're "virtual" boots after all. */
-        if (boot_id && !sd_id128_is_null(*boot_id)) {
+        if (!sd_id128_is_null(*boot_id)) {
                 char match[9+32+1] = "_BOOT_ID=";
 
                 sd_journal_flush_matches(j);
@@ -1397,79 +1442,150 @@ static int get_boots(
                 _cleanup_free_ BootId *current = NULL;
 
                 r = discover_next_boot(j, previous_boot_id, advance_older, &current);
-                if (r < 0) {
-                        boot_id_free_all(head);
+                if (r < 0)
                         return r;
-                }
 
                 if (!current)
                         break;
 
                 previous_boot_id = current->id;
 
-                if (boot_id) {
-                        if (!skip_once)
-                                offset += advance_older ? 1 : -1;
-                        skip_once = false;
+                if (!skip_once)
+                        offset += advance_older ? 1 : -1;
+                skip_once = false;
 
-                        if (offset == 0) {
-                                count = 1;
-                                *boot_id = current->id;
-                                break;
-                        }
-                } else {
-                        LIST_FOREACH(boot_list, id, head) {
-                                if (sd_id128_equal(id->id, current->id)) {
-                                        /* boot id already stored, something wrong with the journal files */
-                                        /* exiting as otherwise this problem would cause forever loop */
-                                        goto finish;
-                                }
-                        }
-                        LIST_INSERT_AFTER(boot_list, head, tail, current);
-                        tail = TAKE_PTR(current);
-                        count++;
+                if (offset == 0) {
+                        count = 1;
+                        *boot_id = current->id;
+                        break;
                 }
         }
 
 finish:
-        if (boots)
-                *boots = head;
-
         sd_journal_flush_matches(j);
 
         return count;
 }
 
+static int boot_id_compare(const BootId *a, const BootId *b) {
+        return CMP(a->first, b->first) ?: CMP(a->last, b->last);
+}
+
+static int get_boot_list(sd_journal *j, BootId **ret, size_t *ret_n) {
+        _cleanup_free_ BootId *boots = NULL;
+        JournalFieldValue *values;
+        size_t n_values, n = 0;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Rather than hopping from boot to boot by seeking to the last entry of each one, which bisects
+         * all files for every single boot, collect the boot IDs the same way --count-by= does: from the
+         * summaries of archived files, and from the data objects of the _BOOT_ID= field of all others. Each
+         * of them knows its first and last entry, hence no entries need to be looked at beyond these. */
+
+        r = journal_count_field_values(j, "_BOOT_ID", &values, &n_values);
+        if (r < 0)
+                return r;
+
+        boots = new(BootId, MAX(n_values, 1U));
+        if (!boots) {
+                journal_field_values_free(values, n_values);
+                return -ENOMEM;
+        }
+
+        for (size_t i = 0; i < n_values; i++) {
+                if (sd_id128_from_string(values[i].value, &boots[n].id) < 0) {
+                        log_debug("Ignoring invalid boot ID '%s'.", values[i].value);
+                        continue;
+                }
+
+                boots[n].first = values[i].first_realtime;
+                boots[n].last = values[i].last_realtime;
+                n++;
+        }
+
+        journal_field_values_free(values, n_values);
+
+        typesafe_qsort(boots, n, boot_id_compare);
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n;
+        return 0;
+}
+
 static int list_boots(sd_journal *j) {
-        int w, i, count;
-        BootId *id, *all_ids;
+        _cleanup_free_ BootId *boots = NULL;
+        size_t n;
+        int w, r;
 
         assert(j);
 
-        count = get_boots(j, &all_ids, NULL, 0);
-        if (count < 0)
-                return log_error_errno(count, "Failed to determine boots: %m");
-        if (count == 0)
-                return count;
+        r = get_boot_list(j, &boots, &n);
+        if (r < 0)
+                return log_error_errno(r, "Failed to determine boots: %m");
+        if (n == 0)
+                return 0;
 
         (void) pager_open(arg_pager_flags);
 
         /* numbers are one less, but we need an extra char for the sign */
-        w = DECIMAL_STR_WIDTH(count - 1) + 1;
+        w = DECIMAL_STR_WIDTH(n - 1) + 1;
 
-        i = 0;
-        LIST_FOREACH(boot_list, id, all_ids) {
+        for (size_t i = 0; i < n; i++) {
                 char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
 
                 printf("% *i " SD_ID128_FORMAT_STR " %s—%s\n",
-                       w, i - count + 1,
-                       SD_ID128_FORMAT_VAL(id->id),
-                       format_timestamp_maybe_utc(a, sizeof(a), id->first),
-                       format_timestamp_maybe_utc(b, sizeof(b), id->last));
-                i++;
+                       w, (int) i - (int) n + 1,
+                       SD_ID128_FORMAT_VAL(boots[i].id),
+                       format_timestamp_maybe_utc(a, sizeof(a), boots[i].first),
+                       format_timestamp_maybe_utc(b, sizeof(b), boots[i].last));
         }
 
-        boot_id_free_all(all_ids);
+        return 0;
+}
+
+static int count_field_values(sd_journal *j) {
+        JournalFieldValue *values = NULL;
+        size_t n, i;
+        int w, r;
+
+        assert(j);
+        assert(arg_field);
+
+        r = sd_journal_set_data_threshold(j, 0);
+        if (r < 0)
+                return log_error_errno(r, "Failed to unset data size threshold: %m");
+
+        r = journal_count_field_values(j, arg_field, &values, &n);
+        if (r < 0)
+                return log_error_errno(r, "Failed to count values of field %s: %m", arg_field);
+        if (n == 0) {
+                free(values);
+                return 0;
+        }
+
+        (void) pager_open(arg_pager_flags);
+
+        /* Most frequent first, hence the first one has the widest count */
+        w = DECIMAL_STR_WIDTH(values[0].n_entries);
+
+        for (i = 0; i < n; i++) {
+                char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
+
+                if (arg_lines >= 0 && i >= (size_t) arg_lines)
+                        break;
+
+                printf("%*" PRIu64 " %s—%s %.*s\n",
+                       w, values[i].n_entries,
+                       format_timestamp_maybe_utc(a, sizeof(a), values[i].first_realtime),
+                       format_timestamp_maybe_utc(b, sizeof(b), values[i].last_realtime),
+                       (int) values[i].size, values[i].value);
+        }
+
+        journal_field_values_free(values, n);
 
         return 0;
 }
@@ -1492,7 +1608,7 @@ static int add_boot(sd_journal *j) {
                 return add_match_this_boot(j, arg_machine);
 
         boot_id = arg_boot_id;
-        r = get_boots(j, NULL, &boot_id, arg_boot_offset);
+        r = get_boots(j, &boot_id, arg_boot_offset);
         assert(r <= 1);
         if (r <= 0) {
                 const char *reason = (r == 0) ? "No such boot ID in journal" : strerror_safe(r);
@@ -1972,7 +2088,13 @@ static int verify(sd_journal *j) {
                         log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
 #endif
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, true);
+                k = journal_file_verify_full(f, arg_verify_key,
+                                             &(const JournalVerifyOptions) {
+                                                     .n_threads = arg_threads,
+                                                     .checkpoint_dir = arg_verify_checkpoint_dir,
+                                                     .show_progress = true,
+                                             },
+                                             &first, &validated, &last);
                 if (k == -EINVAL) {
                         /* If the key was invalid give up right-away. */
                         return k;
@@ -2088,6 +2210,458 @@ static int wait_for_change(sd_journal *j, int poll_fd) {
         return 0;
 }
 
+static OutputFlags output_flags(void) {
+        return
+                arg_all * OUTPUT_SHOW_ALL |
+                arg_full * OUTPUT_FULL_WIDTH |
+                colors_enabled() * OUTPUT_COLOR |
+                arg_catalog * OUTPUT_CATALOG |
+                arg_utc * OUTPUT_UTC |
+                arg_no_hostname * OUTPUT_NO_HOSTNAME;
+}
+
+/* With --threads= the journal files are split up between worker threads, each of which iterates through,
+ * matches and formats the entries of its files using its own sd_journal object. The formatted entries are
+ * handed over in batches to the main thread, which interleaves them in the order sd_journal_next() would
+ * have returned them in. */
+
+typedef struct ScanEntry {
+        Location location;
+        size_t begin, end;      /* The formatted entry within the buffer of the batch */
+        bool stop;              /* Neither show this entry nor any later ones */
+} ScanEntry;
+
+typedef struct ScanBatch ScanBatch;
+
+struct ScanBatch {
+        char *buf;
+        size_t size;
+
+        ScanEntry *entries;
+        size_t n_entries, n_allocated;
+
+        LIST_FIELDS(ScanBatch, batches);
+};
+
+typedef struct ScanWorker {
+        sd_journal *source;     /* Only used for copying the matches from */
+        char **paths;
+        uint64_t size;
+        OutputFlags flags;
+
+        pthread_t thread;
+        bool thread_started;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Protected by the mutex */
+        LIST_HEAD(ScanBatch, queue);
+        unsigned n_queued;
+        bool finished, cancelled;
+        int error;
+
+        /* Only accessed by the main thread */
+        ScanBatch *current;
+        size_t current_idx;
+} ScanWorker;
+
+static ScanBatch* scan_batch_free(ScanBatch *b) {
+        if (!b)
+                return NULL;
+
+        free(b->buf);
+        free(b->entries);
+        return mfree(b);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ScanBatch*, scan_batch_free);
+
+static int scan_worker_push(ScanWorker *w, ScanBatch *b) {
+        bool cancelled;
+
+        assert(w);
+        assert(b);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        while (w->n_queued >= SCAN_QUEUE_BATCHES && !w->cancelled)
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+        cancelled = w->cancelled;
+        if (!cancelled) {
+                LIST_APPEND(batches, w->queue, b);
+                w->n_queued++;
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        if (cancelled) {
+                scan_batch_free(b);
+                return -ECANCELED;
+        }
+
+        return 0;
+}
+
+static int scan_worker_run(ScanWorker *w) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_(scan_batch_freep) ScanBatch *b = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        bool ellipsized = false;
+        int r;
+
+        assert(w);
+
+        r = sd_journal_open_files(&j, (const char**) w->paths, 0);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open journal files: %m");
+
+        r = journal_copy_matches(j, w->source);
+        if (r < 0)
+                return log_oom();
+
+        if (arg_since_set || arg_until_set)
+                journal_set_realtime_window(j,
+                                            arg_since_set ? arg_since : 0,
+                                            arg_until_set ? arg_until : USEC_INFINITY);
+
+        if (arg_since_set)
+                r = sd_journal_seek_realtime_usec(j, arg_since);
+        else
+                r = sd_journal_seek_head(j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to seek journal: %m");
+
+        for (;;) {
+                ScanEntry *e;
+
+                r = sd_journal_next(j);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to iterate through journal: %m");
+                        break;
+                }
+                if (r == 0)
+                        break;
+
+                if (!b) {
+                        b = new0(ScanBatch, 1);
+                        if (!b)
+                                return log_oom();
+
+                        f = open_memstream_unlocked(&b->buf, &b->size);
+                        if (!f)
+                                return log_oom();
+                }
+
+                if (!GREEDY_REALLOC(b->entries, b->n_allocated, b->n_entries + 1))
+                        return log_oom();
+
+                e = b->entries + b->n_entries++;
+                *e = (ScanEntry) {
+                        .location = j->current_location,
+                        .begin = b->size,
+                };
+
+                /* Entries past --until= end the output, just like an entry that cannot be shown. The main
+                 * thread decides whether any entries of other workers still go before it. */
+                if (arg_until_set && e->location.realtime > arg_until)
+                        e->stop = true;
+                else {
+                        r = show_journal_entry(f, j, arg_output, 0, w->flags,
+                                               arg_output_fields, NULL, &ellipsized);
+                        if (r == -EADDRNOTAVAIL)
+                                e->stop = true;
+                        else if (r < 0) {
+                                b->n_entries--;
+                                break;
+                        }
+                }
+
+                r = fflush_and_check(f);
+                if (r < 0)
+                        return log_oom();
+
+                e->end = b->size;
+
+                if (e->stop)
+                        break;
+
+                if (b->n_entries >= SCAN_BATCH_ENTRIES) {
+                        f = safe_fclose(f);
+
+                        r = scan_worker_push(w, TAKE_PTR(b));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        if (b && b->n_entries > 0) {
+                int k;
+
+                f = safe_fclose(f);
+
+                k = scan_worker_push(w, TAKE_PTR(b));
+                if (k < 0)
+                        return k;
+        }
+
+        return r < 0 ? r : 0;
+}
+
+static void* scan_worker_thread(void *userdata) {
+        ScanWorker *w = userdata;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "journal-scan");
+
+        r = scan_worker_run(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->finished = true;
+        w->error = r;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+static int scan_worker_start(ScanWorker *w) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(w);
+
+        /* Leave all signals to the main thread, except for SIGBUS which is raised synchronously when a
+         * memory mapped journal file is truncated under us. */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&w->thread, NULL, scan_worker_thread, w);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        w->thread_started = true;
+
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+/* Returns the next entry of the worker, waiting for it to be formatted if necessary. Returns 0 once the
+ * worker has no further entries, or the error it failed with. */
+static int scan_worker_peek(ScanWorker *w, const ScanEntry **ret) {
+        ScanBatch *b;
+        int r;
+
+        assert(w);
+        assert(ret);
+
+        if (w->current && w->current_idx < w->current->n_entries) {
+                *ret = w->current->entries + w->current_idx;
+                return 1;
+        }
+
+        w->current = scan_batch_free(w->current);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        while (!w->queue && !w->finished)
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+        b = w->queue;
+        if (b) {
+                LIST_REMOVE(batches, w->queue, b);
+                w->n_queued--;
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        }
+
+        r = w->error;
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        if (!b) {
+                *ret = NULL;
+                return r < 0 ? r : 0;
+        }
+
+        w->current = b;
+        w->current_idx = 0;
+
+        *ret = b->entries;
+        return 1;
+}
+
+static void scan_workers_free(ScanWorker *workers, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+                ScanWorker *w = workers + i;
+                ScanBatch *b;
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+                w->cancelled = true;
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                if (w->thread_started)
+                        assert_se(pthread_join(w->thread, NULL) == 0);
+
+                while ((b = w->queue)) {
+                        LIST_REMOVE(batches, w->queue, b);
+                        scan_batch_free(b);
+                }
+
+                scan_batch_free(w->current);
+                strv_free(w->paths);
+
+                assert_se(pthread_cond_destroy(&w->cond) == 0);
+                assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+        }
+
+        free(workers);
+}
+
+static int journal_file_compare_size(JournalFile * const *a, JournalFile * const *b) {
+        /* Largest first */
+        return CMP((*b)->last_stat.st_size, (*a)->last_stat.st_size);
+}
+
+static int show_parallel(sd_journal *j, int *n_shown) {
+        _cleanup_free_ JournalFile **files = NULL;
+        ScanWorker *workers = NULL;
+        size_t n_files = 0, n_workers;
+        bool previous_boot_id_valid = false, last_valid = false;
+        sd_id128_t previous_boot_id;
+        Location last = {};
+        OutputFlags flags;
+        JournalFile *f;
+        int r;
+
+        assert(j);
+        assert(n_shown);
+
+        files = new(JournalFile*, ordered_hashmap_size(j->files));
+        if (!files)
+                return log_oom();
+
+        ORDERED_HASHMAP_FOREACH(f, j->files)
+                files[n_files++] = f;
+
+        n_workers = MIN((size_t) arg_threads, n_files);
+        if (n_workers == 0)
+                return 0;
+
+        workers = new(ScanWorker, n_workers);
+        if (!workers)
+                return log_oom();
+
+        flags = output_flags();
+
+        for (size_t i = 0; i < n_workers; i++) {
+                workers[i] = (ScanWorker) {
+                        .source = j,
+                        .flags = flags,
+                };
+
+                assert_se(pthread_mutex_init(&workers[i].mutex, NULL) == 0);
+                assert_se(pthread_cond_init(&workers[i].cond, NULL) == 0);
+        }
+
+        /* Hand out the largest files first, each to the worker which got the least data so far. */
+        typesafe_qsort(files, n_files, journal_file_compare_size);
+
+        for (size_t i = 0; i < n_files; i++) {
+                ScanWorker *w = workers;
+
+                for (size_t k = 1; k < n_workers; k++)
+                        if (workers[k].size < w->size)
+                                w = workers + k;
+
+                r = strv_extend(&w->paths, files[i]->path);
+                if (r < 0) {
+                        log_oom();
+                        goto finish;
+                }
+
+                w->size += files[i]->last_stat.st_size;
+        }
+
+        /* These properties are determined lazily and cached, make sure that happens before the workers
+         * start formatting entries. */
+        (void) columns();
+        (void) urlify_enabled();
+        (void) is_locale_utf8();
+
+        for (size_t i = 0; i < n_workers; i++) {
+                r = scan_worker_start(workers + i);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to start worker thread: %m");
+                        goto finish;
+                }
+        }
+
+        log_debug("Scanning %zu journal files with %zu threads.", n_files, n_workers);
+
+        for (;;) {
+                const ScanEntry *e = NULL;
+                ScanWorker *w = NULL;
+
+                for (size_t i = 0; i < n_workers; i++) {
+                        const ScanEntry *c;
+
+                        r = scan_worker_peek(workers + i, &c);
+                        if (r < 0)
+                                goto finish;
+                        if (r == 0)
+                                continue;
+
+                        if (!e || journal_compare_locations(&c->location, &e->location) < 0) {
+                                e = c;
+                                w = workers + i;
+                        }
+                }
+
+                if (!e || e->stop)
+                        break;
+
+                w->current_idx++;
+
+                /* The same entry might be contained in more than one file */
+                if (last_valid && journal_compare_locations(&e->location, &last) == 0)
+                        continue;
+
+                if (!arg_merge && !arg_quiet) {
+                        if (previous_boot_id_valid &&
+                            !sd_id128_equal(e->location.boot_id, previous_boot_id))
+                                printf("%s-- Reboot --%s\n",
+                                       ansi_highlight(), ansi_normal());
+
+                        previous_boot_id = e->location.boot_id;
+                        previous_boot_id_valid = true;
+                }
+
+                fwrite(w->current->buf + e->begin, 1, e->end - e->begin, stdout);
+
+                last = e->location;
+                last_valid = true;
+
+                (*n_shown)++;
+        }
+
+        r = 0;
+
+finish:
+        scan_workers_free(workers, n_workers);
+        return r;
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(loop_device_unrefp) LoopDevice *loop_device = NULL;
         _cleanup_(decrypted_image_unrefp) DecryptedImage *decrypted_image = NULL;
@@ -2196,6 +2770,7 @@ int main(int argc, char *argv[]) {
         case ACTION_ROTATE_AND_VACUUM:
         case ACTION_LIST_FIELDS:
         case ACTION_LIST_FIELD_NAMES:
+        case ACTION_COUNT_FIELD_VALUES:
                 /* These ones require access to the journal files, continue below. */
                 break;
 
@@ -2349,6 +2924,10 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
+        case ACTION_COUNT_FIELD_VALUES:
+                r = count_field_values(j);
+                goto finish;
+
         case ACTION_SHOW:
         case ACTION_LIST_FIELDS:
                 break;
@@ -2488,7 +3067,17 @@ int main(int argc, char *argv[]) {
                 }
         }
 
-        if (use_cursor) {
+        /* Entries outside of the requested time window are filtered out below anyway, so let sd-journal skip
+         * files that contain only such entries altogether. */
+        if (arg_since_set || arg_until_set)
+                journal_set_realtime_window(j,
+                                            arg_since_set ? arg_since : 0,
+                                            arg_until_set ? arg_until : USEC_INFINITY);
+
+        if (arg_threads > 1)
+                /* Every worker seeks its own journal object, see show_parallel(). */
+                r = 1;
+        else if (use_cursor) {
                 if (!arg_reverse)
                         r = sd_journal_next_skip(j, 1 + after_cursor);
                 else
@@ -2577,9 +3166,16 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        if (arg_threads > 1) {
+                r = show_parallel(j, &n_shown);
+                if (r >= 0 && n_shown == 0 && !arg_quiet)
+                        printf("-- No entries --\n");
+
+                goto finish;
+        }
+
         for (;;) {
                 while (arg_lines < 0 || n_shown < arg_lines || (arg_follow && !first_line)) {
-                        int flags;
                         size_t highlight[2] = {};
 
                         if (need_seek) {
@@ -2686,15 +3282,7 @@ int main(int argc, char *argv[]) {
                         }
 #endif
 
-                        flags =
-                                arg_all * OUTPUT_SHOW_ALL |
-                                arg_full * OUTPUT_FULL_WIDTH |
-                                colors_enabled() * OUTPUT_COLOR |
-                                arg_catalog * OUTPUT_CATALOG |
-                                arg_utc * OUTPUT_UTC |
-                                arg_no_hostname * OUTPUT_NO_HOSTNAME;
-
-                        r = show_journal_entry(stdout, j, arg_output, 0, flags,
+                        r = show_journal_entry(stdout, j, arg_output, 0, output_flags(),
                                                arg_output_fields, highlight, &ellipsized);
                         need_seek = true;
                         if (r == -EADDRNOTAVAIL)
@@ -2769,6 +3357,7 @@ finish:
 
         free(arg_root);
         free(arg_verify_key);
+        free(arg_verify_checkpoint_dir);
 
 #if HAVE_PCRE2
         if (arg_compiled_pattern) {
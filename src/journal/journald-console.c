@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <time.h>
 
@@ -16,6 +17,12 @@
 #include "stdio-util.h"
 #include "terminal-util.h"
 
+/* How much we queue for a console that doesn't keep up, before we start dropping lines */
+#define CONSOLE_BUFFER_MAX (64U * 1024U)
+
+/* Warn once every 30s if we dropped console messages */
+#define WARN_FORWARD_CONSOLE_DROPPED_USEC (30 * USEC_PER_SEC)
+
 static bool prefix_timestamp(void) {
 
         static int cached_printk_time = -1;
@@ -31,6 +38,132 @@ static bool prefix_timestamp(void) {
         return cached_printk_time;
 }
 
+static void console_close(Server *s) {
+        assert(s);
+
+        s->console_event_source = sd_event_source_disable_unref(s->console_event_source);
+        s->console_fd = safe_close(s->console_fd);
+}
+
+static void console_discard(Server *s) {
+        assert(s);
+
+        if (s->console_buffer_size > 0)
+                s->n_forward_console_dropped++;
+
+        s->console_buffer_size = 0;
+        console_close(s);
+}
+
+static int dispatch_console(sd_event_source *es, int fd, uint32_t revents, void *userdata);
+
+static void console_flush(Server *s) {
+        const char *tty;
+        ssize_t k;
+        int r;
+
+        assert(s);
+
+        if (s->console_buffer_size <= 0)
+                return;
+
+        tty = s->tty_path ?: "/dev/console";
+
+        /* Before you ask: yes, on purpose we open/close the console for each log line we write individually. This is a
+         * good strategy to avoid journald getting killed by the kernel's SAK concept (it doesn't fix this entirely,
+         * but minimizes the time window the kernel might end up killing journald due to SAK). It also makes things
+         * easier for us so that we don't have to recover from hangups and suchlike triggered on the console. We only
+         * keep the console open while it has a backlog, and never block on it: a slow serial console must not stall
+         * the ingestion of log messages. */
+
+        if (s->console_fd < 0) {
+                s->console_fd = open_terminal(tty, O_WRONLY|O_NOCTTY|O_CLOEXEC|O_NONBLOCK);
+                if (s->console_fd < 0) {
+                        log_debug_errno(s->console_fd, "Failed to open %s for logging: %m", tty);
+                        console_discard(s);
+                        return;
+                }
+        }
+
+        k = write(s->console_fd, s->console_buffer, s->console_buffer_size);
+        if (k < 0) {
+                if (errno != EAGAIN) {
+                        log_debug_errno(errno, "Failed to write to %s for logging: %m", tty);
+                        console_discard(s);
+                        return;
+                }
+
+                k = 0;
+        }
+
+        if ((size_t) k >= s->console_buffer_size) {
+                s->console_buffer_size = 0;
+                console_close(s);
+                return;
+        }
+
+        memmove(s->console_buffer, s->console_buffer + k, s->console_buffer_size - k);
+        s->console_buffer_size -= k;
+
+        if (s->console_event_source)
+                return;
+
+        r = sd_event_add_io(s->event, &s->console_event_source, s->console_fd, EPOLLOUT, dispatch_console, s);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to watch %s for writability: %m", tty);
+                console_discard(s);
+                return;
+        }
+
+        (void) sd_event_source_set_description(s->console_event_source, "console");
+}
+
+static int dispatch_console(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+        assert(fd == s->console_fd);
+
+        if (revents & (EPOLLERR|EPOLLHUP)) {
+                log_debug("Console hung up, dropping queued log messages.");
+                console_discard(s);
+                return 0;
+        }
+
+        console_flush(s);
+        return 0;
+}
+
+static void console_queue(Server *s, const struct iovec *iovec, size_t n) {
+        size_t l;
+
+        assert(s);
+        assert(iovec || n == 0);
+
+        l = IOVEC_TOTAL_SIZE(iovec, n);
+        if (l > CONSOLE_BUFFER_MAX - s->console_buffer_size) {
+                s->n_forward_console_dropped++;
+                return;
+        }
+
+        if (!s->console_buffer) {
+                s->console_buffer = malloc(CONSOLE_BUFFER_MAX);
+                if (!s->console_buffer) {
+                        s->n_forward_console_dropped++;
+                        return;
+                }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+                memcpy(s->console_buffer + s->console_buffer_size, iovec[i].iov_base, iovec[i].iov_len);
+                s->console_buffer_size += iovec[i].iov_len;
+        }
+
+        /* If the console still has a backlog we'll write this out together with it once it becomes writable */
+        if (!s->console_event_source)
+                console_flush(s);
+}
+
 void server_forward_console(
                 Server *s,
                 int priority,
@@ -43,8 +176,6 @@ void server_forward_console(
         char tbuf[STRLEN("[] ") + DECIMAL_STR_MAX(ts.tv_sec) + DECIMAL_STR_MAX(ts.tv_nsec)-3 + 1];
         char header_pid[STRLEN("[]: ") + DECIMAL_STR_MAX(pid_t)];
         _cleanup_free_ char *ident_buf = NULL;
-        _cleanup_close_ int fd = -1;
-        const char *tty;
         int n = 0;
 
         assert(s);
@@ -85,19 +216,37 @@ void server_forward_console(
         iovec[n++] = IOVEC_MAKE_STRING(message);
         iovec[n++] = IOVEC_MAKE_STRING("\n");
 
-        tty = s->tty_path ?: "/dev/console";
+        console_queue(s, iovec, n);
+}
 
-        /* Before you ask: yes, on purpose we open/close the console for each log line we write individually. This is a
-         * good strategy to avoid journald getting killed by the kernel's SAK concept (it doesn't fix this entirely,
-         * but minimizes the time window the kernel might end up killing journald due to SAK). It also makes things
-         * easier for us so that we don't have to recover from hangups and suchlike triggered on the console. */
+void server_maybe_warn_forward_console_dropped(Server *s) {
+        usec_t n;
+
+        assert(s);
 
-        fd = open_terminal(tty, O_WRONLY|O_NOCTTY|O_CLOEXEC);
-        if (fd < 0) {
-                log_debug_errno(fd, "Failed to open %s for logging: %m", tty);
+        if (s->n_forward_console_dropped <= 0)
                 return;
-        }
 
-        if (writev(fd, iovec, n) < 0)
-                log_debug_errno(errno, "Failed to write to %s for logging: %m", tty);
+        n = now(CLOCK_MONOTONIC);
+        if (s->last_warn_forward_console_dropped + WARN_FORWARD_CONSOLE_DROPPED_USEC > n)
+                return;
+
+        server_driver_message(s, 0, NULL,
+                              LOG_MESSAGE("Forwarding to console dropped %u messages, console too slow.",
+                                          s->n_forward_console_dropped),
+                              NULL);
+
+        s->n_forward_console_dropped = 0;
+        s->last_warn_forward_console_dropped = n;
+}
+
+void server_console_done(Server *s) {
+        assert(s);
+
+        /* One last attempt, without waiting for it */
+        console_flush(s);
+        console_close(s);
+
+        s->console_buffer = mfree(s->console_buffer);
+        s->console_buffer_size = 0;
 }
@@ -14,6 +14,8 @@
 #include "io-util.h"
 #include "journal-util.h"
 #include "journald-context.h"
+#include "missing_syscall.h"
+#include "mkdir.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -34,6 +36,14 @@
  * refreshed in an incremental way (meaning: data is reread from /proc, but any old data we can't refresh is not
  * flushed out). Data newer than 1s is used immediately without refresh.
  *
+ * If the kernel supports it we hold a pidfd for each cached process while it is running. As long as we do its PID
+ * cannot be reused, hence the 5s limit does not apply, and a refresh only rereads what a running process can
+ * actually change: the executable (and with it the command line, capabilities and label), the cgroup, and the unit
+ * metadata PID 1 maintains in /run/systemd/units/, of which the latter is only reread when the cgroup changed or
+ * PID 1 touched that directory. Once the pidfd tells us the process exited we stop refreshing the entry: there's
+ * nothing left to read, but its data is still useful for the messages it sent that we haven't processed yet, until
+ * the usual 5s limit hits.
+ *
  * Log stream clients (i.e. all clients using the AF_UNIX/SOCK_STREAM stdout/stderr transport) will pin a cache entry
  * as long as their socket is connected. Note that cache entries are shared between different transports. That means a
  * cache entry pinned for the stream connection logic may be reused for the syslog or native protocols.
@@ -134,6 +144,7 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
                 .log_level_max = -1,
                 .log_ratelimit_interval = s->ratelimit_interval,
                 .log_ratelimit_burst = s->ratelimit_burst,
+                .units_generation = s->units_generation,
         };
 
         r = hashmap_put(s->client_contexts, PID_TO_PTR(pid), c);
@@ -185,6 +196,50 @@ static void client_context_reset(Server *s, ClientContext *c) {
 
         c->log_ratelimit_interval = s->ratelimit_interval;
         c->log_ratelimit_burst = s->ratelimit_burst;
+
+        c->exited = false;
+}
+
+static int client_context_dispatch_pidfd(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        ClientContext *c = userdata;
+
+        assert(c);
+
+        /* The process is gone, and its PID may be reused from now on. Keep the data for whatever it logged
+         * before exiting, but don't bother refreshing it anymore. */
+
+        c->pidfd_event_source = sd_event_source_disable_unref(c->pidfd_event_source);
+        c->exited = true;
+
+        return 0;
+}
+
+static int client_context_watch(Server *s, ClientContext *c) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+        assert(c);
+
+        if (c->pidfd_event_source || c->exited || !s->event)
+                return 0;
+
+        fd = pidfd_open(c->pid, 0);
+        if (fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(s->event, &c->pidfd_event_source, fd, EPOLLIN, client_context_dispatch_pidfd, c);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_io_fd_own(c->pidfd_event_source, true);
+        if (r < 0) {
+                c->pidfd_event_source = sd_event_source_disable_unref(c->pidfd_event_source);
+                return r;
+        }
+
+        TAKE_FD(fd);
+        return 0;
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -199,6 +254,7 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
                 assert_se(prioq_remove(s->client_contexts_lru, c, &c->lru_index) >= 0);
 
         client_context_reset(s, c);
+        sd_event_source_disable_unref(c->pidfd_event_source);
 
         return mfree(c);
 }
@@ -219,28 +275,44 @@ static void client_context_read_uid_gid(ClientContext *c, const struct ucred *uc
                 (void) get_process_gid(c->pid, &c->gid);
 }
 
-static void client_context_read_basic(ClientContext *c) {
+static bool client_context_read_basic(ClientContext *c, bool full) {
+        bool changed = full;
         char *t;
 
         assert(c);
         assert(pid_is_valid(c->pid));
 
-        if (get_process_comm(c->pid, &t) >= 0)
+        /* Returns true if the process looks like it executed something else since we last looked, in which
+         * case the label needs to be reread too. */
+
+        if (get_process_comm(c->pid, &t) >= 0) {
+                changed = changed || !streq_ptr(c->comm, t);
                 free_and_replace(c->comm, t);
+        }
 
-        if (get_process_exe(c->pid, &t) >= 0)
+        if (get_process_exe(c->pid, &t) >= 0) {
+                changed = changed || !streq_ptr(c->exe, t);
                 free_and_replace(c->exe, t);
+        }
+
+        /* The command line and the capabilities are usually set up once when a binary is executed, hence
+         * reading them again for the same process image isn't worth the effort. */
+        if (!changed)
+                return false;
 
         if (get_process_cmdline(c->pid, SIZE_MAX, 0, &t) >= 0)
                 free_and_replace(c->cmdline, t);
 
         if (get_process_capeff(c->pid, &t) >= 0)
                 free_and_replace(c->capeff, t);
+
+        return true;
 }
 
 static int client_context_read_label(
                 ClientContext *c,
-                const char *label, size_t label_size) {
+                const char *label, size_t label_size,
+                bool query) {
 
         assert(c);
         assert(pid_is_valid(c->pid));
@@ -259,7 +331,7 @@ static int client_context_read_label(
                 c->label_size = label_size;
         }
 #if HAVE_SELINUX
-        else {
+        else if (query) {
                 char *con;
 
                 /* If we got no SELinux label passed in, let's try to acquire one */
@@ -280,6 +352,8 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
 
         assert(c);
 
+        /* Returns > 0 if the cgroup changed, and with it the unit metadata needs to be reread */
+
         /* Try to acquire the current cgroup path */
         r = cg_pid_get_path_shifted(c->pid, s->cgroup_root, &t);
         if (r < 0 || empty_or_root(t)) {
@@ -289,7 +363,7 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
                 if (unit_id && !c->unit) {
                         c->unit = strdup(unit_id);
                         if (c->unit)
-                                return 0;
+                                return 1;
                 }
 
                 return r;
@@ -319,7 +393,7 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
         (void) cg_path_get_user_slice(c->cgroup, &t);
         free_and_replace(c->user_slice, t);
 
-        return 0;
+        return 1;
 }
 
 static int client_context_read_invocation_id(
@@ -514,6 +588,9 @@ static void client_context_really_refresh(
                 const char *unit_id,
                 usec_t timestamp) {
 
+        bool full, execed;
+        int r;
+
         assert(s);
         assert(c);
         assert(pid_is_valid(c->pid));
@@ -521,19 +598,36 @@ static void client_context_really_refresh(
         if (timestamp == USEC_INFINITY)
                 timestamp = now(CLOCK_MONOTONIC);
 
-        client_context_read_uid_gid(c, ucred);
-        client_context_read_basic(c);
-        (void) client_context_read_label(c, label, label_size);
+        /* Get hold of the process first, so that everything we read below is about the same process */
+        if (c->timestamp == USEC_INFINITY)
+                (void) client_context_watch(s, c);
 
-        (void) audit_session_from_pid(c->pid, &c->auditid);
-        (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
+        /* Without a pidfd of the running process it might be a different one by now, let's read everything
+         * then */
+        full = c->timestamp == USEC_INFINITY || !c->pidfd_event_source;
 
-        (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
-        (void) client_context_read_log_ratelimit_interval(c);
-        (void) client_context_read_log_ratelimit_burst(c);
+        client_context_read_uid_gid(c, ucred);
+        execed = client_context_read_basic(c, full);
+        (void) client_context_read_label(c, label, label_size, execed);
+
+        /* The audit session and login UID can only be set once */
+        if (full || !audit_session_is_valid(c->auditid))
+                (void) audit_session_from_pid(c->pid, &c->auditid);
+        if (full || !uid_is_valid(c->loginuid))
+                (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
+
+        r = client_context_read_cgroup(s, c, unit_id);
+
+        /* We only watch PID 1's directory, the metadata of user units is reread each time */
+        if (full || r > 0 || c->user_unit || !s->units_event_source || c->units_generation != s->units_generation) {
+                (void) client_context_read_invocation_id(s, c);
+                (void) client_context_read_log_level_max(s, c);
+                (void) client_context_read_extra_fields(s, c);
+                (void) client_context_read_log_ratelimit_interval(c);
+                (void) client_context_read_log_ratelimit_burst(c);
+
+                c->units_generation = s->units_generation;
+        }
 
         c->timestamp = timestamp;
 
@@ -562,28 +656,38 @@ void client_context_maybe_refresh(
                 goto refresh;
 
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
-         * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
-        if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
+         * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. If
+         * we hold a pidfd of the process, PID reuse is not possible at all. */
+        if (c->n_ref == 0 && !c->pidfd_event_source && c->timestamp + MAX_USEC < timestamp) {
                 client_context_reset(s, c);
                 goto refresh;
         }
 
-        /* If the data is older than the lower limit, we refresh, but keep the old data for all we can't update */
-        if (c->timestamp + REFRESH_USEC < timestamp)
-                goto refresh;
-
         /* If the data passed along doesn't match the cached data we also do a refresh */
         if (ucred && uid_is_valid(ucred->uid) && c->uid != ucred->uid)
-                goto refresh;
+                goto mismatch;
 
         if (ucred && gid_is_valid(ucred->gid) && c->gid != ucred->gid)
-                goto refresh;
+                goto mismatch;
 
         if (label_size > 0 && (label_size != c->label_size || memcmp(label, c->label, label_size) != 0))
+                goto mismatch;
+
+        /* The process is gone, there's nothing we could refresh the data from */
+        if (c->exited)
+                return;
+
+        /* If the data is older than the lower limit, we refresh, but keep the old data for all we can't update */
+        if (c->timestamp + REFRESH_USEC < timestamp)
                 goto refresh;
 
         return;
 
+mismatch:
+        /* If the process we cached the data of exited, this is a different one which got the same PID */
+        if (c->exited)
+                client_context_reset(s, c);
+
 refresh:
         client_context_really_refresh(s, c, ucred, label, label_size, unit_id, timestamp);
 }
@@ -608,7 +712,8 @@ static void client_context_try_shrink_to(Server *s, size_t limit) {
 
                         assert(c->n_ref == 0);
 
-                        if (!pid_is_unwaited(c->pid))
+                        /* A running process we hold a pidfd for has not moved on, no need to ask */
+                        if (c->exited || (!c->pidfd_event_source && !pid_is_unwaited(c->pid)))
                                 client_context_free(s, c);
                         else
                                 idx ++;
@@ -661,6 +766,7 @@ static int client_context_get_internal(
                 bool add_ref,
                 ClientContext **ret) {
 
+        usec_t timestamp;
         ClientContext *c;
         int r;
 
@@ -670,6 +776,8 @@ static int client_context_get_internal(
         if (!pid_is_valid(pid))
                 return -EINVAL;
 
+        timestamp = s->client_contexts_batch_timestamp > 0 ? s->client_contexts_batch_timestamp : USEC_INFINITY;
+
         c = hashmap_get(s->client_contexts, PID_TO_PTR(pid));
         if (c) {
 
@@ -684,7 +792,7 @@ static int client_context_get_internal(
                         c->n_ref++;
                 }
 
-                client_context_maybe_refresh(s, c, ucred, label, label_len, unit_id, USEC_INFINITY);
+                client_context_maybe_refresh(s, c, ucred, label, label_len, unit_id, timestamp);
 
                 *ret = c;
                 return 0;
@@ -708,7 +816,7 @@ static int client_context_get_internal(
                 c->in_lru = true;
         }
 
-        client_context_really_refresh(s, c, ucred, label, label_len, unit_id, USEC_INFINITY);
+        client_context_really_refresh(s, c, ucred, label, label_len, unit_id, timestamp);
 
         *ret = c;
         return 0;
@@ -760,6 +868,99 @@ ClientContext *client_context_release(Server *s, ClientContext *c) {
         return NULL;
 }
 
+void client_context_begin_batch(Server *s) {
+        assert(s);
+
+        /* All lookups until client_context_end_batch() share one timestamp, so that no entry is refreshed
+         * twice for the same batch of messages */
+        s->client_contexts_batch_timestamp = now(CLOCK_MONOTONIC);
+}
+
+void client_context_prefetch(Server *s, const struct ucred *ucred) {
+
+        ClientContext *c;
+
+        assert(s);
+
+        /* Looks up the sender of a message of the current batch before the batch is processed. Writing out
+         * the messages takes a while, and short-lived clients are more likely to still be around, with their
+         * /proc data, when we look them all up first. */
+
+        if (!ucred || !pid_is_valid(ucred->pid))
+                return;
+
+        (void) client_context_get(s, ucred->pid, ucred, NULL, 0, NULL, &c);
+}
+
+void client_context_end_batch(Server *s) {
+        assert(s);
+
+        s->client_contexts_batch_timestamp = 0;
+}
+
+static int client_context_dispatch_units(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        union inotify_event_buffer buffer;
+        Server *s = userdata;
+        ssize_t l;
+
+        assert(s);
+
+        /* We don't care what changed, just that something did. Entries compare their units_generation with
+         * ours on the next refresh, and reread the unit metadata if they are behind. */
+
+        for (;;) {
+                l = read(fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (IN_SET(errno, EAGAIN, EINTR))
+                                break;
+
+                        log_warning_errno(errno, "Failed to read inotify event for /run/systemd/units/, rereading unit metadata on each refresh: %m");
+                        s->units_event_source = sd_event_source_disable_unref(s->units_event_source);
+                        break;
+                }
+        }
+
+        s->units_generation++;
+        return 0;
+}
+
+int client_context_watch_units(Server *s) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+
+        /* PID 1 creates the directory only once it starts the first unit, but it doesn't mind us doing so */
+        (void) mkdir_p("/run/systemd/units", 0755);
+
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return log_warning_errno(errno, "Failed to create inotify object: %m");
+
+        if (inotify_add_watch(fd, "/run/systemd/units", IN_CREATE|IN_DELETE|IN_MOVED_TO|IN_MOVED_FROM|IN_CLOSE_WRITE|IN_ONLYDIR) < 0)
+                return log_warning_errno(errno, "Failed to watch /run/systemd/units/, rereading unit metadata on each refresh: %m");
+
+        r = sd_event_add_io(s->event, &s->units_event_source, fd, EPOLLIN, client_context_dispatch_units, s);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add inotify event source for /run/systemd/units/: %m");
+
+        /* Let's process this before any log messages, so that these see the new metadata */
+        r = sd_event_source_set_priority(s->units_event_source, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0)
+                goto fail;
+
+        r = sd_event_source_set_io_fd_own(s->units_event_source, true);
+        if (r < 0)
+                goto fail;
+
+        TAKE_FD(fd);
+        return 0;
+
+fail:
+        s->units_event_source = sd_event_source_disable_unref(s->units_event_source);
+        return log_warning_errno(r, "Failed to set up inotify event source for /run/systemd/units/: %m");
+}
+
 void client_context_acquire_default(Server *s) {
         int r;
 
@@ -20,6 +20,11 @@ struct ClientContext {
         bool in_lru;
 
         pid_t pid;
+
+        /* Watches a pidfd of the process, as long as it is running. While we have one the PID cannot be
+         * reused, and the cached data is refreshed selectively. */
+        sd_event_source *pidfd_event_source;
+        bool exited;
         uid_t uid;
         gid_t gid;
 
@@ -55,6 +60,9 @@ struct ClientContext {
 
         usec_t log_ratelimit_interval;
         unsigned log_ratelimit_burst;
+
+        /* The Server's units_generation at the time we last read the per-unit metadata */
+        uint64_t units_generation;
 };
 
 int client_context_get(
@@ -83,6 +91,12 @@ void client_context_maybe_refresh(
                 const char *unit_id,
                 usec_t tstamp);
 
+void client_context_begin_batch(Server *s);
+void client_context_prefetch(Server *s, const struct ucred *ucred);
+void client_context_end_batch(Server *s);
+
+int client_context_watch_units(Server *s);
+
 void client_context_acquire_default(Server *s);
 void client_context_flush_all(Server *s);
 
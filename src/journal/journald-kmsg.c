@@ -20,8 +20,10 @@
 #include "journald-syslog.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "stat-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
 
 void server_forward_kmsg(
                 Server *s,
@@ -94,6 +96,118 @@ static bool is_us(const char *identifier, const char *pid) {
                streq(identifier, program_invocation_short_name);
 }
 
+/* How many devices to remember the udev fields for */
+#define KERNEL_DEVICES_MAX 64U
+
+/* How many records to read from /dev/kmsg per wakeup of the event loop, at most */
+#define DEV_KMSG_RECORDS_PER_WAKEUP_MAX 64U
+
+typedef struct KernelDevice {
+        char *id;
+        struct stat db_st; /* of the udev database entry the fields were collected from, zeroed if there was none */
+        char **fields;
+} KernelDevice;
+
+static KernelDevice* kernel_device_free(KernelDevice *k) {
+        if (!k)
+                return NULL;
+
+        free(k->id);
+        strv_free(k->fields);
+
+        return mfree(k);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(KernelDevice*, kernel_device_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(kernel_device_hash_ops, char, string_hash_func, string_compare_func,
+                                              KernelDevice, kernel_device_free);
+
+static int server_get_kernel_device_fields(Server *s, const char *id, char ***ret) {
+        _cleanup_(kernel_device_freep) KernelDevice *k = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        _cleanup_strv_free_ char **fields = NULL;
+        struct stat st = {};
+        const char *path, *g;
+        size_t j = 0;
+        int r;
+
+        assert(s);
+        assert(id);
+        assert(ret);
+
+        /* Looking up the device means reading several files from sysfs and the udev database, which adds up
+         * quickly when a driver floods the kernel log with messages about the same device. Hence remember the
+         * fields per device. udevd replaces the database entry of a device whenever it processes an event for
+         * it, so a cached entry is only used as long as the database entry didn't change. */
+
+        path = strjoina("/run/udev/data/", id);
+        if (stat(path, &st) < 0)
+                zero(st);
+
+        k = ordered_hashmap_remove(s->kernel_devices, id);
+        if (k && ((st.st_mode == 0 && k->db_st.st_mode == 0) || stat_inode_unmodified(&k->db_st, &st))) {
+                /* Re-add it at the end, so that the least recently used entry is always the first */
+                r = ordered_hashmap_put(s->kernel_devices, k->id, k);
+                if (r < 0)
+                        return r;
+
+                *ret = TAKE_PTR(k)->fields;
+                return 0;
+        }
+
+        k = kernel_device_free(k);
+
+        r = sd_device_new_from_device_id(&d, id);
+        if (r < 0)
+                return r;
+
+        if (sd_device_get_devname(d, &g) >= 0) {
+                r = strv_consume(&fields, strjoin("_UDEV_DEVNODE=", g));
+                if (r < 0)
+                        return r;
+        }
+
+        if (sd_device_get_sysname(d, &g) >= 0) {
+                r = strv_consume(&fields, strjoin("_UDEV_SYSNAME=", g));
+                if (r < 0)
+                        return r;
+        }
+
+        FOREACH_DEVICE_DEVLINK(d, g) {
+                if (j >= N_IOVEC_UDEV_FIELDS)
+                        break;
+
+                r = strv_consume(&fields, strjoin("_UDEV_DEVLINK=", g));
+                if (r < 0)
+                        return r;
+
+                j++;
+        }
+
+        while (ordered_hashmap_size(s->kernel_devices) >= KERNEL_DEVICES_MAX)
+                kernel_device_free(ordered_hashmap_steal_first(s->kernel_devices));
+
+        k = new(KernelDevice, 1);
+        if (!k)
+                return -ENOMEM;
+
+        *k = (KernelDevice) {
+                .id = strdup(id),
+                .db_st = st,
+                .fields = TAKE_PTR(fields),
+        };
+        if (!k->id)
+                return -ENOMEM;
+
+        r = ordered_hashmap_ensure_put(&s->kernel_devices, &kernel_device_hash_ops, k->id, k);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(k)->fields;
+        return 0;
+}
+
 void dev_kmsg_record(Server *s, char *p, size_t l) {
 
         _cleanup_free_ char *message = NULL, *syslog_priority = NULL, *syslog_pid = NULL, *syslog_facility = NULL, *syslog_identifier = NULL, *source_time = NULL, *identifier = NULL, *pid = NULL;
@@ -210,43 +324,12 @@ void dev_kmsg_record(Server *s, char *p, size_t l) {
         }
 
         if (kernel_device) {
-                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
-
-                if (sd_device_new_from_device_id(&d, kernel_device) >= 0) {
-                        const char *g;
-                        char *b;
-
-                        if (sd_device_get_devname(d, &g) >= 0) {
-                                b = strjoin("_UDEV_DEVNODE=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        if (sd_device_get_sysname(d, &g) >= 0) {
-                                b = strjoin("_UDEV_SYSNAME=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        j = 0;
-                        FOREACH_DEVICE_DEVLINK(d, g) {
-
-                                if (j >= N_IOVEC_UDEV_FIELDS)
-                                        break;
-
-                                b = strjoin("_UDEV_DEVLINK=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-
-                                j++;
-                        }
-                }
+                char **fields, **u;
+
+                /* The fields are owned by the cache, hence not counted in z */
+                if (server_get_kernel_device_fields(s, kernel_device, &fields) >= 0)
+                        STRV_FOREACH(u, fields)
+                                iovec[n++] = IOVEC_MAKE_STRING(*u);
         }
 
         if (asprintf(&source_time, "_SOURCE_MONOTONIC_TIMESTAMP=%llu", usec) >= 0)
@@ -349,6 +432,7 @@ int server_flush_dev_kmsg(Server *s) {
 
 static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        int r;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
@@ -360,7 +444,15 @@ static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void
         if (!(revents & EPOLLIN))
                 log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
 
-        return server_read_dev_kmsg(s);
+        /* Every read() returns a single record, but when the kernel logs a lot there are usually more
+         * queued, hence pick up a bunch of them before returning to the event loop. */
+        for (unsigned i = 0; i < DEV_KMSG_RECORDS_PER_WAKEUP_MAX; i++) {
+                r = server_read_dev_kmsg(s);
+                if (r <= 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
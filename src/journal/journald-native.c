@@ -94,7 +94,7 @@ static void server_process_entry_meta(
 
 static int server_process_entry(
                 Server *s,
-                const void *buffer, size_t *remaining,
+                void *buffer, size_t *remaining,
                 ClientContext *context,
                 const struct ucred *ucred,
                 const struct timeval *tv,
@@ -103,20 +103,21 @@ static int server_process_entry(
         /* Process a single entry from a native message. Returns 0 if nothing special happened and the message
          * processing should continue, and a negative or positive value otherwise.
          *
-         * Note that *remaining is altered on both success and failure. */
+         * Note that *remaining is altered on both success and failure, and that binary fields are rewritten
+         * in place, so that the iovecs can point into the buffer without copying their payload. */
 
-        size_t n = 0, j, tn = (size_t) -1, m = 0, entry_size = 0;
+        size_t n = 0, m = 0, entry_size = 0;
         char *identifier = NULL, *message = NULL;
         struct iovec *iovec = NULL;
         int priority = LOG_INFO;
         pid_t object_pid = 0;
-        const char *p;
+        char *p;
         int r = 1;
 
         p = buffer;
 
         while (*remaining > 0) {
-                const char *e, *q;
+                char *e, *q;
 
                 e = memchr(p, '\n', *remaining);
 
@@ -173,7 +174,7 @@ static int server_process_entry(
 
                                 /* If the field name starts with an underscore, skip the variable, since that indicates
                                  * a trusted field */
-                                iovec[n++] = IOVEC_MAKE((char*) p, l);
+                                iovec[n++] = IOVEC_MAKE(p, l);
                                 entry_size += l;
 
                                 server_process_entry_meta(p, l, ucred,
@@ -214,17 +215,13 @@ static int server_process_entry(
                                 break;
                         }
 
-                        k = malloc(total);
-                        if (!k) {
-                                log_oom();
-                                break;
-                        }
-
-                        memcpy(k, p, e - p);
-                        k[e - p] = '=';
-                        memcpy(k + (e - p) + 1, e + 1 + sizeof(uint64_t), l);
-
                         if (journal_field_valid(p, e - p, false)) {
+                                /* Turn "NAME\n<le64 size><data>" into "NAME=<data>" by moving the field name
+                                 * right in front of the data, instead of copying the data, which might be
+                                 * large. */
+                                k = memmove(p + sizeof(uint64_t), p, e - p);
+                                k[e - p] = '=';
+
                                 iovec[n] = IOVEC_MAKE(k, (e - p) + 1 + l);
                                 entry_size += iovec[n].iov_len;
                                 n++;
@@ -234,8 +231,7 @@ static int server_process_entry(
                                                           &identifier,
                                                           &message,
                                                           &object_pid);
-                        } else
-                                free(k);
+                        }
 
                         *remaining -= (e - p) + 1 + sizeof(uint64_t) + l + 1;
                         p = e + 1 + sizeof(uint64_t) + l + 1;
@@ -245,8 +241,7 @@ static int server_process_entry(
         if (n <= 0)
                 goto finish;
 
-        tn = n++;
-        iovec[tn] = IOVEC_MAKE_STRING("_TRANSPORT=journal");
+        iovec[n++] = IOVEC_MAKE_STRING("_TRANSPORT=journal");
         entry_size += STRLEN("_TRANSPORT=journal");
 
         if (entry_size + n + 1 > ENTRY_SIZE_MAX) { /* data + separators + trailer */
@@ -276,15 +271,6 @@ static int server_process_entry(
         server_dispatch_message(s, iovec, n, m, context, tv, priority, object_pid);
 
 finish:
-        for (j = 0; j < n; j++)  {
-                if (j == tn)
-                        continue;
-
-                if (iovec[j].iov_base < buffer ||
-                    (const char*) iovec[j].iov_base >= p + *remaining)
-                        free(iovec[j].iov_base);
-        }
-
         free(iovec);
         free(identifier);
         free(message);
@@ -294,7 +280,7 @@ finish:
 
 void server_process_native_message(
                 Server *s,
-                const char *buffer, size_t buffer_size,
+                char *buffer, size_t buffer_size,
                 const struct ucred *ucred,
                 const struct timeval *tv,
                 const char *label, size_t label_len) {
@@ -314,7 +300,7 @@ void server_process_native_message(
 
         do {
                 r = server_process_entry(s,
-                                         (const uint8_t*) buffer + (buffer_size - remaining), &remaining,
+                                         buffer + (buffer_size - remaining), &remaining,
                                          context, ucred, tv, label, label_len);
         } while (r == 0);
 }
@@ -388,10 +374,12 @@ void server_process_native_file(
                 void *p;
                 size_t ps;
 
-                /* The file is sealed, we can just map it and use it. */
+                /* The file is sealed, we can just map it and use it. The entries are written straight from
+                 * the mapping. It is writable, but private, since binary fields are rewritten in place, which
+                 * only copies the pages in front of their payload. */
 
                 ps = PAGE_ALIGN(st.st_size);
-                p = mmap(NULL, ps, PROT_READ, MAP_PRIVATE, fd, 0);
+                p = mmap(NULL, ps, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
                 if (p == MAP_FAILED) {
                         log_error_errno(errno, "Failed to map memfd, ignoring: %m");
                         return;
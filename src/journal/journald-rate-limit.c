@@ -5,6 +5,7 @@
 #include "alloc-util.h"
 #include "hashmap.h"
 #include "journald-rate-limit.h"
+#include "json.h"
 #include "list.h"
 #include "random-util.h"
 #include "string-util.h"
@@ -28,10 +29,15 @@ static const int priority_map[] = {
 typedef struct JournalRateLimitPool JournalRateLimitPool;
 typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
+/* Each pool is a token bucket holding up to "burst" tokens, which refills at a rate of "burst" tokens per
+ * interval, and each message takes one token. Instead of counting tokens we track the time at which the
+ * bucket will be full again ("tat"), which makes each check a few comparisons: every message moves it
+ * "interval / burst" further into the future, and a message is dropped if that would require more than the
+ * bucket's capacity, i.e. if it ends up more than "interval" ahead of now. */
 struct JournalRateLimitPool {
-        usec_t begin;
-        unsigned num;
+        usec_t tat;
         unsigned suppressed;
+        usec_t reported;
 };
 
 struct JournalRateLimitGroup {
@@ -39,12 +45,16 @@ struct JournalRateLimitGroup {
 
         char *id;
 
-        /* Interval is stored to keep track of when the group expires */
+        /* The limits last used for this group */
         usec_t interval;
+        unsigned burst;
 
         JournalRateLimitPool pools[POOLS_MAX];
         uint64_t hash;
 
+        uint64_t n_permitted;
+        uint64_t n_suppressed;
+
         LIST_FIELDS(JournalRateLimitGroup, bucket);
         LIST_FIELDS(JournalRateLimitGroup, lru);
 };
@@ -56,6 +66,8 @@ struct JournalRateLimit {
 
         unsigned n_groups;
 
+        uint64_t n_suppressed;
+
         uint8_t hash_key[16];
 };
 
@@ -104,8 +116,11 @@ static bool journal_ratelimit_group_expired(JournalRateLimitGroup *g, usec_t ts)
 
         assert(g);
 
+        /* All buckets are full again, and there's nothing left to report? Then there's nothing to remember
+         * about the group anymore */
+
         for (i = 0; i < POOLS_MAX; i++)
-                if (g->pools[i].begin + g->interval >= ts)
+                if (g->pools[i].tat > ts || g->pools[i].suppressed > 0)
                         return false;
 
         return true;
@@ -122,7 +137,7 @@ static void journal_ratelimit_vacuum(JournalRateLimit *r, usec_t ts) {
                 journal_ratelimit_group_free(r->lru_tail);
 }
 
-static JournalRateLimitGroup* journal_ratelimit_group_new(JournalRateLimit *r, const char *id, usec_t interval, usec_t ts) {
+static JournalRateLimitGroup* journal_ratelimit_group_new(JournalRateLimit *r, const char *id, usec_t ts) {
         JournalRateLimitGroup *g;
 
         assert(r);
@@ -138,8 +153,6 @@ static JournalRateLimitGroup* journal_ratelimit_group_new(JournalRateLimit *r, c
 
         g->hash = siphash24_string(g->id, r->hash_key);
 
-        g->interval = interval;
-
         journal_ratelimit_vacuum(r, ts);
 
         LIST_PREPEND(bucket, r->buckets[g->hash % BUCKETS_MAX], g);
@@ -188,8 +201,8 @@ int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interv
         uint64_t h;
         JournalRateLimitGroup *g;
         JournalRateLimitPool *p;
-        unsigned burst;
-        usec_t ts;
+        usec_t ts, emission;
+        unsigned burst, s;
 
         assert(id);
 
@@ -213,42 +226,86 @@ int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interv
                         break;
 
         if (!g) {
-                g = journal_ratelimit_group_new(r, id, rl_interval, ts);
+                g = journal_ratelimit_group_new(r, id, ts);
                 if (!g)
                         return -ENOMEM;
-        } else
-                g->interval = rl_interval;
+        }
 
-        if (rl_interval == 0 || rl_burst == 0)
+        if (rl_interval == 0 || rl_burst == 0) {
+                g->n_permitted++;
                 return 1;
+        }
 
         burst = burst_modulate(rl_burst, available);
 
+        g->interval = rl_interval;
+        g->burst = burst;
+
         p = &g->pools[priority_map[priority]];
 
-        if (p->begin <= 0) {
-                p->suppressed = 0;
-                p->num = 1;
-                p->begin = ts;
-                return 1;
+        /* What a single message costs, rounded up so that we never permit more than the burst */
+        emission = DIV_ROUND_UP(rl_interval, burst);
+
+        if (p->tat < ts)
+                p->tat = ts;
+
+        if (p->tat + emission > ts + rl_interval) {
+                p->suppressed++;
+                g->n_suppressed++;
+                r->n_suppressed++;
+                return 0;
         }
 
-        if (p->begin + rl_interval < ts) {
-                unsigned s;
+        p->tat += emission;
+        g->n_permitted++;
+
+        /* Under a constant flood messages get through every now and then, don't report the dropped ones
+         * more often than once per interval */
+        if (p->suppressed == 0 || p->reported + rl_interval > ts)
+                return 1;
+
+        s = p->suppressed;
+        p->suppressed = 0;
+        p->reported = ts;
+
+        return 1 + s;
+}
+
+int journal_ratelimit_build_json(JournalRateLimit *r, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *groups = NULL;
+        JournalRateLimitGroup *g;
+        int k;
 
-                s = p->suppressed;
-                p->suppressed = 0;
-                p->num = 1;
-                p->begin = ts;
+        assert(ret);
 
-                return 1 + s;
+        if (!r)
+                return json_build(ret, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("rateLimiting", JSON_BUILD_BOOLEAN(false))));
+
+        LIST_FOREACH(lru, g, r->lru) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                k = json_build(&v, JSON_BUILD_OBJECT(
+                                               JSON_BUILD_PAIR("id", JSON_BUILD_STRING(g->id)),
+                                               JSON_BUILD_PAIR("intervalUSec", JSON_BUILD_UNSIGNED(g->interval)),
+                                               JSON_BUILD_PAIR("burst", JSON_BUILD_UNSIGNED(g->burst)),
+                                               JSON_BUILD_PAIR("permitted", JSON_BUILD_UNSIGNED(g->n_permitted)),
+                                               JSON_BUILD_PAIR("suppressed", JSON_BUILD_UNSIGNED(g->n_suppressed))));
+                if (k < 0)
+                        return k;
+
+                k = json_variant_append_array(&groups, v);
+                if (k < 0)
+                        return k;
         }
 
-        if (p->num < burst) {
-                p->num++;
-                return 1;
+        if (!groups) {
+                k = json_variant_new_array(&groups, NULL, 0);
+                if (k < 0)
+                        return k;
         }
 
-        p->suppressed++;
-        return 0;
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR("rateLimiting", JSON_BUILD_BOOLEAN(true)),
+                                          JSON_BUILD_PAIR("suppressed", JSON_BUILD_UNSIGNED(r->n_suppressed)),
+                                          JSON_BUILD_PAIR("groups", JSON_BUILD_VARIANT(groups))));
 }
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journald-native.h"
+#include "journald-ring.h"
+#include "journald-server.h"
+#include "missing_fcntl.h"
+#include "process-util.h"
+#include "string-util.h"
+
+#define RINGS_MAX 256U
+
+/* Don't let a single ring starve the other event sources */
+#define RING_DRAIN_MAX 1024U
+
+JournalRing* journal_ring_free(JournalRing *r) {
+        if (!r)
+                return NULL;
+
+        if (r->server) {
+                assert(r->server->n_rings > 0);
+                r->server->n_rings--;
+                LIST_REMOVE(rings, r->server->rings, r);
+
+                (void) server_start_or_stop_idle_timer(r->server); /* Maybe we are idle now? */
+        }
+
+        sd_event_source_disable_unref(r->doorbell_event_source);
+        sd_event_source_disable_unref(r->lifetime_event_source);
+
+        if (r->header) {
+                /* Tell the client to go back to the socket, in case it is still around */
+                __atomic_store_n(&r->header->state, JOURNAL_RING_REVOKED, __ATOMIC_RELEASE);
+                (void) munmap(r->header, r->mapped_size);
+        }
+
+        safe_close(r->doorbell_fd);
+        safe_close(r->lifetime_fd);
+        free(r->label);
+
+        return mfree(r);
+}
+
+static int journal_ring_consume(JournalRing *r) {
+        Server *s = r->server;
+        size_t size;
+        int k;
+
+        /* Returns > 0 if a record was consumed, 0 if there is none (yet), and negative if the ring is
+         * corrupted */
+
+        k = journal_ring_pop(r->header, r->data, r->data_size, &r->tail, (void**) &s->buffer, &s->buffer_size, &size);
+        if (k <= 0)
+                return k;
+
+        if (size > 0)
+                server_process_native_message(s, s->buffer, size, &r->ucred, NULL, r->label, r->label_len);
+
+        return 1;
+}
+
+static int journal_ring_drain(JournalRing *r) {
+        unsigned i;
+        int k = 0;
+
+        assert(r);
+
+        server_begin_write_batch(r->server);
+
+        for (i = 0; i < RING_DRAIN_MAX; i++) {
+                k = journal_ring_consume(r);
+                if (k <= 0)
+                        break;
+        }
+
+        server_end_write_batch(r->server);
+
+        if (k < 0)
+                return k;
+
+        /* Ask the next producer to ring the doorbell, unless something showed up in the meantime */
+        if (i < RING_DRAIN_MAX && journal_ring_wait(r->header, r->data, r->data_size, r->tail))
+                return 0;
+
+        /* There's more, come back after the other event sources had their turn */
+        if (eventfd_write(r->doorbell_fd, 1) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static int dispatch_doorbell(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        JournalRing *r = userdata;
+        eventfd_t v;
+        int k;
+
+        assert(r);
+
+        (void) eventfd_read(r->doorbell_fd, &v);
+
+        k = journal_ring_drain(r);
+        if (k < 0) {
+                log_warning_errno(k, "Failed to process journal ring of PID " PID_FMT ", dropping it: %m", r->ucred.pid);
+                journal_ring_free(r);
+        }
+
+        return 0;
+}
+
+static int dispatch_lifetime(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        JournalRing *r = userdata;
+        int k;
+
+        assert(r);
+
+        /* The client closed its end of the pipe, i.e. it is gone. Pick up whatever it logged last. */
+        k = journal_ring_drain(r);
+        if (k < 0)
+                log_warning_errno(k, "Failed to process journal ring of PID " PID_FMT ", dropping it: %m", r->ucred.pid);
+
+        log_debug("Journal ring of PID " PID_FMT " was closed.", r->ucred.pid);
+        journal_ring_free(r);
+
+        return 0;
+}
+
+int server_setup_ring(
+                Server *s,
+                int fds[],
+                size_t n_fds,
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len) {
+
+        _cleanup_(journal_ring_freep) JournalRing *r = NULL;
+        _cleanup_free_ char *doorbell = NULL;
+        JournalRingHeader *h;
+        struct stat st, pst;
+        int seals, k;
+        void *p;
+
+        assert(s);
+        assert(fds || n_fds == 0);
+
+        /* Takes possession of the passed fds on success, and sets them to -1 then */
+
+        if (n_fds != 3)
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Got journal ring request with %zu fds, ignoring.", n_fds);
+
+        if (!ucred || !pid_is_valid(ucred->pid))
+                return log_warning_errno(SYNTHETIC_ERRNO(EPERM), "Got journal ring request without credentials, ignoring.");
+
+        if (s->n_rings >= RINGS_MAX)
+                return log_warning_errno(SYNTHETIC_ERRNO(ENOBUFS), "Too many journal rings, refusing ring of PID " PID_FMT ".", ucred->pid);
+
+        /* We map the ring shared, hence make sure it cannot shrink under our feet */
+        seals = fcntl(fds[0], F_GET_SEALS);
+        if (seals < 0)
+                return log_warning_errno(errno, "Journal ring of PID " PID_FMT " is not a memfd, refusing: %m", ucred->pid);
+        if ((seals & (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL)) != (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL))
+                return log_warning_errno(SYNTHETIC_ERRNO(EPERM), "Journal ring of PID " PID_FMT " is not sealed, refusing.", ucred->pid);
+
+        if (fstat(fds[0], &st) < 0)
+                return log_warning_errno(errno, "Failed to stat journal ring of PID " PID_FMT ": %m", ucred->pid);
+        if (!S_ISREG(st.st_mode) ||
+            st.st_size < (off_t) (JOURNAL_RING_HEADER_SIZE + JOURNAL_RING_SIZE_MIN) ||
+            st.st_size > (off_t) (JOURNAL_RING_HEADER_SIZE + JOURNAL_RING_SIZE_MAX))
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal ring of PID " PID_FMT " has invalid size, refusing.", ucred->pid);
+
+        if (fd_get_path(fds[1], &doorbell) < 0 || !streq(doorbell, "anon_inode:[eventfd]"))
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADF), "Journal ring doorbell of PID " PID_FMT " is not an eventfd, refusing.", ucred->pid);
+
+        if (fstat(fds[2], &pst) < 0 || !S_ISFIFO(pst.st_mode))
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADF), "Journal ring lifetime fd of PID " PID_FMT " is not a pipe, refusing.", ucred->pid);
+
+        r = new(JournalRing, 1);
+        if (!r)
+                return log_oom();
+
+        *r = (JournalRing) {
+                .ucred = *ucred,
+                .doorbell_fd = -1,
+                .lifetime_fd = -1,
+        };
+
+        if (label) {
+                r->label = memdup_suffix0(label, label_len);
+                if (!r->label)
+                        return log_oom();
+
+                r->label_len = label_len;
+        }
+
+        p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (p == MAP_FAILED)
+                return log_warning_errno(errno, "Failed to map journal ring of PID " PID_FMT ": %m", ucred->pid);
+
+        r->header = h = p;
+        r->mapped_size = st.st_size;
+        r->data = (uint8_t*) p + JOURNAL_RING_HEADER_SIZE;
+        r->data_size = h->data_size;
+
+        if (memcmp(h->signature, JOURNAL_RING_SIGNATURE, sizeof(h->signature)) != 0 ||
+            h->header_size != JOURNAL_RING_HEADER_SIZE ||
+            r->data_size < JOURNAL_RING_SIZE_MIN ||
+            r->data_size > JOURNAL_RING_SIZE_MAX ||
+            (r->data_size & (r->data_size - 1)) != 0 ||
+            (uint64_t) st.st_size != JOURNAL_RING_HEADER_SIZE + r->data_size)
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal ring of PID " PID_FMT " has invalid header, refusing.", ucred->pid);
+
+        /* The client may have used the ring before passing it to us, hence pick up where it left off. But
+         * the tail is under the client's control, and everything else relies on records being aligned. */
+        r->tail = __atomic_load_n(&h->tail, __ATOMIC_RELAXED);
+        if (r->tail != JOURNAL_RING_RECORD_ALIGN(r->tail))
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal ring of PID " PID_FMT " has unaligned tail, refusing.", ucred->pid);
+
+        /* The client might have set the fd to blocking mode, which it shares with us */
+        k = fd_nonblock(fds[1], true);
+        if (k < 0)
+                return log_warning_errno(k, "Failed to make journal ring doorbell non-blocking: %m");
+
+        k = sd_event_add_io(s->event, &r->doorbell_event_source, fds[1], EPOLLIN, dispatch_doorbell, r);
+        if (k < 0)
+                return log_error_errno(k, "Failed to add journal ring doorbell to event loop: %m");
+
+        k = sd_event_source_set_priority(r->doorbell_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (k < 0)
+                return log_error_errno(k, "Failed to adjust journal ring event source priority: %m");
+
+        k = sd_event_add_io(s->event, &r->lifetime_event_source, fds[2], EPOLLIN, dispatch_lifetime, r);
+        if (k < 0)
+                return log_error_errno(k, "Failed to add journal ring lifetime fd to event loop: %m");
+
+        k = sd_event_source_set_priority(r->lifetime_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (k < 0)
+                return log_error_errno(k, "Failed to adjust journal ring event source priority: %m");
+
+        fds[0] = safe_close(fds[0]);
+        r->doorbell_fd = TAKE_FD(fds[1]);
+        r->lifetime_fd = TAKE_FD(fds[2]);
+
+        r->server = s;
+        LIST_PREPEND(rings, s->rings, r);
+        s->n_rings++;
+
+        (void) server_start_or_stop_idle_timer(s); /* Maybe no longer idle? */
+
+        /* Everything is in place, the client may start using the ring now. It might have done so already
+         * anyway, hence look right away. */
+        __atomic_store_n(&h->state, JOURNAL_RING_ACCEPTED, __ATOMIC_RELEASE);
+        (void) eventfd_write(r->doorbell_fd, 1);
+
+        log_debug("Set up journal ring of %" PRIu32 " bytes for PID " PID_FMT ".", r->data_size, r->ucred.pid);
+
+        TAKE_PTR(r);
+        return 0;
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+typedef struct JournalRing JournalRing;
+
+#include "journal-ring.h"
+#include "journald-server.h"
+#include "list.h"
+
+struct JournalRing {
+        Server *server;
+        LIST_FIELDS(JournalRing, rings);
+
+        /* The credentials of the client that set up the ring, all messages are attributed to it */
+        struct ucred ucred;
+        char *label;
+        size_t label_len;
+
+        JournalRingHeader *header;
+        uint8_t *data;
+        size_t mapped_size;
+        uint32_t data_size;
+        uint64_t tail;
+
+        int doorbell_fd;
+        int lifetime_fd;
+        sd_event_source *doorbell_event_source;
+        sd_event_source *lifetime_event_source;
+};
+
+JournalRing* journal_ring_free(JournalRing *r);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalRing*, journal_ring_free);
+
+int server_setup_ring(
+                Server *s,
+                int fds[],
+                size_t n_fds,
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len);
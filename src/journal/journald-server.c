@@ -31,15 +31,20 @@
 #include "journal-authenticate.h"
 #include "journal-file.h"
 #include "journal-internal.h"
+#include "journal-util.h"
 #include "journal-vacuum.h"
 #include "journald-audit.h"
+#include "journald-console.h"
 #include "journald-context.h"
 #include "journald-kmsg.h"
 #include "journald-native.h"
 #include "journald-rate-limit.h"
+#include "journald-ring.h"
 #include "journald-server.h"
 #include "journald-stream.h"
+#include "journald-sync.h"
 #include "journald-syslog.h"
+#include "journald-writer.h"
 #include "log.h"
 #include "missing_audit.h"
 #include "mkdir.h"
@@ -55,7 +60,9 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "syslog-util.h"
+#include "unit-name.h"
 #include "user-util.h"
+#include "varlink-event.h"
 
 #define USER_JOURNALS_MAX 1024
 
@@ -79,6 +86,31 @@
 
 #define IDLE_TIMEOUT_USEC (30*USEC_PER_SEC)
 
+/* How many datagrams to read from a socket per wakeup at most */
+#define DEFAULT_DATAGRAM_BATCH_SIZE 16U
+#define DATAGRAM_BATCH_SIZE_MAX 1024U
+
+/* sd_journal_send() never sends datagrams larger than this (see SNDBUF_SIZE in journal-send.c), hence this is
+ * what we reserve for each additional slot of a batch. The memory is only populated as far as it is used. */
+#define DATAGRAM_SLOT_SIZE (8U*1024U*1024U)
+
+/* Whatever a large datagram populated beyond this is returned to the kernel again after processing it */
+#define DATAGRAM_SLOT_RESIDENT_MAX (64U*1024U)
+
+/* We use NAME_MAX space for the SELinux label here. The kernel currently enforces no limit, but according to
+ * suggestions from the SELinux people this will change and it will probably be identical to NAME_MAX. For now we
+ * use that, but this should be updated one day when the final limit is known. */
+typedef CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred)) +
+                         CMSG_SPACE(sizeof(struct timeval)) +
+                         CMSG_SPACE(sizeof(int)) + /* fd */
+                         CMSG_SPACE(NAME_MAX) /* selinux label */) DatagramControl;
+
+struct DatagramSlot {
+        struct iovec iovec;
+        union sockaddr_union sa;
+        DatagramControl control;
+};
+
 static int determine_path_usage(
                 Server *s,
                 const char *path,
@@ -125,6 +157,60 @@ static int determine_path_usage(
         return 0;
 }
 
+static void storage_close_vacuum_index(JournalStorage *storage) {
+        assert(storage);
+
+        storage->vacuum_index_event_source = sd_event_source_disable_unref(storage->vacuum_index_event_source);
+        storage->vacuum_index = journal_vacuum_index_free(storage->vacuum_index);
+}
+
+static int dispatch_vacuum_index(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        JournalStorage *storage = userdata;
+        int r;
+
+        assert(storage);
+
+        r = journal_vacuum_index_process(storage->vacuum_index);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to process changes to %s, dropping vacuum index: %m", storage->path);
+                storage_close_vacuum_index(storage);
+        }
+
+        return 0;
+}
+
+static void storage_open_vacuum_index(Server *s, JournalStorage *storage) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *x = NULL;
+        int r;
+
+        assert(s);
+        assert(storage);
+
+        /* Without the index we fall back to looking at the whole directory each time, hence failing here is
+         * not fatal */
+
+        if (storage->vacuum_index)
+                return;
+
+        r = journal_vacuum_index_new(storage->path, true, &x);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to set up vacuum index for %s, ignoring: %m", storage->path);
+                return;
+        }
+
+        r = sd_event_add_io(s->event, &storage->vacuum_index_event_source,
+                            journal_vacuum_index_get_fd(x), EPOLLIN, dispatch_vacuum_index, storage);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to watch vacuum index for %s, ignoring: %m", storage->path);
+                return;
+        }
+
+        (void) sd_event_source_set_priority(storage->vacuum_index_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        (void) sd_event_source_set_description(storage->vacuum_index_event_source, "vacuum-index");
+
+        storage->vacuum_index = TAKE_PTR(x);
+}
+
 static void cache_space_invalidate(JournalStorageSpace *space) {
         zero(*space);
 }
@@ -146,9 +232,19 @@ static int cache_space_refresh(Server *s, JournalStorage *storage) {
         if (space->timestamp != 0 && space->timestamp + RECHECK_SPACE_USEC > ts)
                 return 0;
 
-        r = determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
-        if (r < 0)
-                return r;
+        if (storage->vacuum_index) {
+                r = journal_vacuum_index_get_usage(storage->vacuum_index, &vfs_used, &vfs_avail);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to determine usage of %s from vacuum index, rescanning: %m", storage->path);
+                        storage_close_vacuum_index(storage);
+                }
+        }
+
+        if (!storage->vacuum_index) {
+                r = determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
+                if (r < 0)
+                        return r;
+        }
 
         space->vfs_used = vfs_used;
         space->vfs_available = vfs_avail;
@@ -246,6 +342,14 @@ static bool uid_for_system_journal(uid_t uid) {
         return uid_is_system(uid) || uid_is_dynamic(uid) || uid == UID_NOBODY;
 }
 
+static void server_wait_for_writer(Server *s) {
+        assert(s);
+
+        /* Everything that accesses the journal files from the main thread needs to call this first */
+        if (s->writer)
+                journal_writer_wait(s->writer);
+}
+
 static void server_add_acls(JournalFile *f, uid_t uid) {
         assert(f);
 
@@ -287,9 +391,17 @@ static int open_journal(
         if (r < 0)
                 return r;
 
-        r = journal_file_enable_post_change_timer(f, s->event, POST_CHANGE_TIMER_INTERVAL_USEC);
-        if (r < 0)
-                return r;
+        /* The timer would fire in the main thread while the writer thread appends. Without it every write
+         * triggers the inotify events right away, which with threaded writes happens once per batch. */
+        if (!s->threaded_writes) {
+                r = journal_file_enable_post_change_timer(f, s->event, POST_CHANGE_TIMER_INTERVAL_USEC);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Rotated files inherit these from their predecessor */
+        f->unindexed_fields = s->unindexed_fields;
+        f->stats_fields = s->stats_fields;
 
         *ret = TAKE_PTR(f);
         return r;
@@ -331,6 +443,7 @@ static int system_journal_open(Server *s, bool flush_requested, bool relinquish_
                 r = open_journal(s, true, fn, O_RDWR|O_CREAT, s->seal, &s->system_storage.metrics, &s->system_journal);
                 if (r >= 0) {
                         server_add_acls(s->system_journal, 0);
+                        storage_open_vacuum_index(s, &s->system_storage);
                         (void) cache_space_refresh(s, &s->system_storage);
                         patch_min_use(&s->system_storage);
                 } else {
@@ -383,6 +496,7 @@ static int system_journal_open(Server *s, bool flush_requested, bool relinquish_
 
                 if (s->runtime_journal) {
                         server_add_acls(s->runtime_journal, 0);
+                        storage_open_vacuum_index(s, &s->runtime_storage);
                         (void) cache_space_refresh(s, &s->runtime_storage);
                         patch_min_use(&s->runtime_storage);
                 }
@@ -391,6 +505,25 @@ static int system_journal_open(Server *s, bool flush_requested, bool relinquish_
         return r;
 }
 
+JournalFile* server_find_open_journal(Server *s, uid_t uid) {
+        assert(s);
+
+        /* Returns the journal file to write entries of the specified UID to, if it is open already. Never
+         * opens, closes or rotates anything, and hence may be called from the writer thread. */
+
+        /* We split up user logs only on /var, not on /run. If the runtime file is open, we write to it
+         * exclusively, in order to guarantee proper order as soon as we flush /run to /var and close the
+         * runtime file. */
+
+        if (s->runtime_journal)
+                return s->runtime_journal;
+
+        if (uid_for_system_journal(uid))
+                return s->system_journal;
+
+        return ordered_hashmap_get(s->user_journals, UID_TO_PTR(uid));
+}
+
 static JournalFile* find_journal(Server *s, uid_t uid) {
         _cleanup_free_ char *p = NULL;
         JournalFile *f;
@@ -407,18 +540,8 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
          * Fixes https://github.com/systemd/systemd/issues/3968 */
         (void) system_journal_open(s, false, false);
 
-        /* We split up user logs only on /var, not on /run. If the runtime file is open, we write to it
-         * exclusively, in order to guarantee proper order as soon as we flush /run to /var and close the
-         * runtime file. */
-
-        if (s->runtime_journal)
-                return s->runtime_journal;
-
-        if (uid_for_system_journal(uid))
-                return s->system_journal;
-
-        f = ordered_hashmap_get(s->user_journals, UID_TO_PTR(uid));
-        if (f)
+        f = server_find_open_journal(s, uid);
+        if (f || uid_for_system_journal(uid))
                 return f;
 
         if (asprintf(&p, "%s/user-" UID_FMT ".journal", s->system_storage.path, uid) < 0) {
@@ -611,6 +734,8 @@ void server_rotate(Server *s) {
         void *k;
         int r;
 
+        server_wait_for_writer(s);
+
         log_debug("Rotating...");
 
         /* First, rotate the system journal (either in its runtime flavour or in its runtime flavour) */
@@ -639,6 +764,8 @@ void server_sync(Server *s) {
         JournalFile *f;
         int r;
 
+        server_wait_for_writer(s);
+
         if (s->system_journal) {
                 r = journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -672,9 +799,14 @@ static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
+        if (storage->vacuum_index)
+                r = journal_vacuum_index_vacuum(storage->vacuum_index, storage->space.limit,
+                                                storage->metrics.n_max_files, s->max_retention_usec,
+                                                &s->oldest_file_usec, verbose);
+        else
+                r = journal_directory_vacuum(storage->path, storage->space.limit,
+                                             storage->metrics.n_max_files, s->max_retention_usec,
+                                             &s->oldest_file_usec, verbose);
         if (r < 0 && r != -ENOENT)
                 log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
 
@@ -684,6 +816,8 @@ static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
 int server_vacuum(Server *s, bool verbose) {
         assert(s);
 
+        server_wait_for_writer(s);
+
         log_debug("Vacuuming...");
 
         s->oldest_file_usec = 0;
@@ -788,21 +922,44 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+static void log_write_failure(int r, const JournalFileEntry *entries, size_t n, const char *suffix) {
+        size_t i, n_items = 0, n_bytes = 0;
+
+        for (i = 0; i < n; i++) {
+                n_items += entries[i].n_iovec;
+                n_bytes += IOVEC_TOTAL_SIZE(entries[i].iovec, entries[i].n_iovec);
+        }
+
+        if (n == 1)
+                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes)%s, ignoring: %m", n_items, n_bytes, suffix);
+        else
+                log_error_errno(r, "Failed to write %zu entries (%zu items, %zu bytes)%s, ignoring: %m", n, n_items, n_bytes, suffix);
+}
+
+void server_write_entries(Server *s, uid_t uid, JournalFileEntry *entries, size_t n, int priority) {
         bool vacuumed = false, rotate = false;
         struct dual_timestamp ts;
+        size_t i, n_written;
         JournalFile *f;
         int r;
 
         assert(s);
-        assert(iovec);
+        assert(entries);
         assert(n > 0);
 
         /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
          * the source time, and not even the time the event was originally seen, but instead simply the time we started
          * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+        if (s->writer)
+                /* The writer thread does not have the event loop's time, use the same clock it uses */
+                dual_timestamp_get(&ts);
+        else {
+                assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
+                assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+        }
+
+        for (i = 0; i < n; i++)
+                entries[i].ts = &ts;
 
         if (ts.realtime < s->last_realtime_clock) {
                 /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
@@ -836,14 +993,19 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
 
         s->last_realtime_clock = ts.realtime;
 
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        r = journal_file_append_entries(f, entries, n, &s->seqnum, &n_written);
         if (r >= 0) {
+                server_submit_sync(s, f, priority);
                 server_schedule_sync(s, priority);
                 return;
         }
 
+        /* Whatever made it into the file before the failure stays there, only retry the rest */
+        entries += n_written;
+        n -= n_written;
+
         if (vacuumed || !shall_try_append_again(f, r)) {
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+                log_write_failure(r, entries, n, "");
                 return;
         }
 
@@ -855,11 +1017,210 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                 return;
 
         log_debug("Retrying write.");
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        r = journal_file_append_entries(f, entries, n, &s->seqnum, &n_written);
         if (r < 0)
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
-        else
+                log_write_failure(r, entries + n_written, n - n_written, " despite vacuuming");
+        else {
+                server_submit_sync(s, f, priority);
                 server_schedule_sync(s, priority);
+        }
+}
+
+/* Don't let a single chatty client delay its own messages for too long */
+#define WRITE_BATCH_MAX 128U
+
+static void server_flush_write_batch(Server *s) {
+        size_t i;
+        int r;
+
+        assert(s);
+
+        if (s->n_write_batch == 0)
+                return;
+
+        if (s->writer) {
+                r = journal_writer_submit(s->writer, s->write_batch_uid, s->write_batch, s->n_write_batch, s->write_batch_priority);
+                if (r < 0)
+                        log_oom();
+                if (r > 0) {
+                        /* The writer thread owns the copied iovecs now */
+                        s->n_write_batch = 0;
+                        (void) server_schedule_sync(s, s->write_batch_priority);
+                        return;
+                }
+
+                /* Out of memory? Then write the batch ourselves, but not while the writer thread might
+                 * still be appending earlier batches. */
+                server_wait_for_writer(s);
+        }
+
+        server_write_entries(s, s->write_batch_uid, s->write_batch, s->n_write_batch, s->write_batch_priority);
+
+        for (i = 0; i < s->n_write_batch; i++)
+                free((struct iovec*) s->write_batch[i].iovec);
+
+        s->n_write_batch = 0;
+}
+
+static int server_queue_write(Server *s, uid_t uid, const struct iovec *iovec, size_t n, int priority) {
+        struct iovec *copy;
+        size_t i, sz;
+        uint8_t *p;
+
+        assert(s);
+        assert(iovec);
+
+        /* The iovecs we get passed point to stack memory of the caller, hence copy them into a single
+         * allocation owned by the batch */
+        sz = n * sizeof(struct iovec) + IOVEC_TOTAL_SIZE(iovec, n);
+
+        if (!GREEDY_REALLOC(s->write_batch, s->n_write_batch_allocated, s->n_write_batch + 1))
+                return -ENOMEM;
+
+        copy = malloc(sz);
+        if (!copy)
+                return -ENOMEM;
+
+        p = (uint8_t*) (copy + n);
+        for (i = 0; i < n; i++) {
+                copy[i] = IOVEC_MAKE(p, iovec[i].iov_len);
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+        }
+
+        if (s->n_write_batch == 0) {
+                s->write_batch_uid = uid;
+                s->write_batch_priority = LOG_PRI(priority);
+        } else
+                s->write_batch_priority = MIN(s->write_batch_priority, LOG_PRI(priority));
+
+        s->write_batch[s->n_write_batch++] = (JournalFileEntry) {
+                .iovec = copy,
+                .n_iovec = n,
+        };
+
+        return 0;
+}
+
+/* Wait a bit before trying again when a replacement file couldn't be created, e.g. because the disk is full */
+#define PREPARE_ROTATION_RETRY_USEC (1*USEC_PER_MINUTE)
+
+static int server_maybe_prepare_rotation(Server *s, JournalFile *f, bool seal) {
+        int r;
+
+        assert(s);
+
+        if (!f || f->prepared || !journal_file_rotate_soon(f, s->max_file_usec))
+                return 0;
+
+        r = journal_file_prepare_rotation(f, s->compress.enabled, s->compress.threshold_bytes, seal);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to prepare replacement for %s, will create it when rotating: %m", f->path);
+
+        return 1;
+}
+
+static int server_dispatch_prepare_rotation(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+        JournalFile *f;
+        int r;
+
+        assert(s);
+
+        /* Runs when there's nothing else to do, and creates the files that will replace the ones that are
+         * about to be rotated, so that rotating doesn't hold up the messages coming in then. */
+
+        if (s->prepare_rotation_retry_usec > 0 && now(CLOCK_MONOTONIC) < s->prepare_rotation_retry_usec)
+                return 0;
+
+        /* Don't wait for the writer thread, it will be idle soon enough, and we'll be called again */
+        if (s->writer && !journal_writer_is_idle(s->writer))
+                return 0;
+
+        r = server_maybe_prepare_rotation(s, s->runtime_journal, false);
+        if (r >= 0)
+                r = server_maybe_prepare_rotation(s, s->system_journal, s->seal);
+
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals) {
+                if (r < 0)
+                        break;
+
+                r = server_maybe_prepare_rotation(s, f, s->seal);
+        }
+
+        s->prepare_rotation_retry_usec = r < 0 ? usec_add(now(CLOCK_MONOTONIC), PREPARE_ROTATION_RETRY_USEC) : 0;
+        return 0;
+}
+
+static void server_schedule_prepare_rotation(Server *s) {
+        int r;
+
+        assert(s);
+
+        if (!s->prepare_rotation_event_source) {
+                r = sd_event_add_defer(s->event, &s->prepare_rotation_event_source, server_dispatch_prepare_rotation, s);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to add rotation preparation event source, ignoring: %m");
+                        return;
+                }
+
+                r = sd_event_source_set_priority(s->prepare_rotation_event_source, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to adjust rotation preparation event source priority, ignoring: %m");
+        }
+
+        r = sd_event_source_set_enabled(s->prepare_rotation_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                log_debug_errno(r, "Failed to enable rotation preparation event source, ignoring: %m");
+}
+
+static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+        JournalFileEntry entry = {
+                .iovec = iovec,
+                .n_iovec = n,
+        };
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        server_schedule_prepare_rotation(s);
+
+        /* The writer thread needs its own copy of the entry, hence also queue single messages then */
+        if (s->write_batch_open || s->writer) {
+                /* Entries for different journal files cannot be batched together */
+                if (s->n_write_batch > 0 &&
+                    (s->write_batch_uid != uid || s->n_write_batch >= WRITE_BATCH_MAX))
+                        server_flush_write_batch(s);
+
+                if (server_queue_write(s, uid, iovec, n, priority) >= 0) {
+                        if (!s->write_batch_open)
+                                server_flush_write_batch(s);
+                        return;
+                }
+
+                /* Couldn't queue it? Then write out what we have, and this one directly. */
+                log_oom();
+                server_flush_write_batch(s);
+                server_wait_for_writer(s);
+        }
+
+        server_write_entries(s, uid, &entry, 1, priority);
+}
+
+void server_begin_write_batch(Server *s) {
+        assert(s);
+
+        /* Messages dispatched until server_end_write_batch() is called are written out together, in order
+         * to amortize the cost of updating the journal file over all of them. */
+
+        s->write_batch_open = true;
+}
+
+void server_end_write_batch(Server *s) {
+        assert(s);
+
+        server_flush_write_batch(s);
+        s->write_batch_open = false;
 }
 
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
@@ -1067,6 +1428,143 @@ void server_driver_message(Server *s, pid_t object_pid, const char *message_id,
         }
 }
 
+/* Slices are few, unless somebody creates cgroups named like them in a delegated subtree */
+#define SLICE_RATELIMITS_MAX 1024U
+
+typedef struct SliceRateLimit {
+        char *id;
+        char *parent; /* NULL for the root slice */
+
+        usec_t interval;
+        unsigned burst;
+
+        uint64_t units_generation;
+        usec_t timestamp;
+} SliceRateLimit;
+
+static SliceRateLimit* slice_ratelimit_free(SliceRateLimit *l) {
+        if (!l)
+                return NULL;
+
+        free(l->id);
+        free(l->parent);
+        return mfree(l);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(SliceRateLimit*, slice_ratelimit_free);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(slice_ratelimit_hash_ops, char, string_hash_func, string_compare_func,
+                                              SliceRateLimit, slice_ratelimit_free);
+
+static void slice_ratelimit_read(Server *s, SliceRateLimit *l, usec_t ts) {
+        _cleanup_free_ char *value = NULL;
+        const char *p;
+
+        assert(s);
+        assert(l);
+
+        /* PID 1 exports these if LogRateLimitIntervalSec= and LogRateLimitBurst= are set for the slice.
+         * Without them the slice has no budget of its own. */
+
+        l->interval = 0;
+        l->burst = 0;
+
+        p = strjoina("/run/systemd/units/log-rate-limit-interval:", l->id);
+        if (readlink_malloc(p, &value) >= 0)
+                (void) safe_atou64(value, &l->interval);
+
+        value = mfree(value);
+
+        p = strjoina("/run/systemd/units/log-rate-limit-burst:", l->id);
+        if (readlink_malloc(p, &value) >= 0)
+                (void) safe_atou(value, &l->burst);
+
+        l->units_generation = s->units_generation;
+        l->timestamp = ts;
+}
+
+static SliceRateLimit* server_get_slice_ratelimit(Server *s, const char *slice, usec_t ts) {
+        _cleanup_(slice_ratelimit_freep) SliceRateLimit *l = NULL;
+        SliceRateLimit *found;
+
+        assert(s);
+        assert(slice);
+
+        found = hashmap_get(s->slice_ratelimits, slice);
+        if (found) {
+                /* Reread the limits if PID 1 changed something, or every now and then if we can't tell */
+                if (found->units_generation != s->units_generation ||
+                    (!s->units_event_source && found->timestamp + USEC_PER_SEC < ts))
+                        slice_ratelimit_read(s, found, ts);
+
+                return found;
+        }
+
+        if (hashmap_ensure_allocated(&s->slice_ratelimits, &slice_ratelimit_hash_ops) < 0)
+                return NULL;
+
+        l = new0(SliceRateLimit, 1);
+        if (!l)
+                return NULL;
+
+        l->id = strdup(slice);
+        if (!l->id)
+                return NULL;
+
+        if (slice_build_parent_slice(slice, &l->parent) < 0)
+                l->parent = NULL;
+
+        slice_ratelimit_read(s, l, ts);
+
+        if (hashmap_put(s->slice_ratelimits, l->id, l) < 0)
+                return NULL;
+
+        return TAKE_PTR(l);
+}
+
+static bool server_test_slice_ratelimits(Server *s, ClientContext *c, int priority, uint64_t available) {
+        const char *id;
+        usec_t ts;
+        int rl;
+
+        assert(s);
+        assert(c);
+        assert(c->slice);
+
+        /* Every slice with limits configured has a budget shared by everything below it, hence walk up
+         * the tree, and charge each. The root slice's budget covers everything. A unit that exceeds its own
+         * limit is cut off above, before it can use up the budget of the slices it is in. */
+
+        if (hashmap_size(s->slice_ratelimits) >= SLICE_RATELIMITS_MAX)
+                hashmap_clear(s->slice_ratelimits);
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (id = c->slice; id; ) {
+                SliceRateLimit *l;
+
+                l = server_get_slice_ratelimit(s, id, ts);
+                if (!l)
+                        break;
+
+                if (l->interval > 0 && l->burst > 0) {
+                        rl = journal_ratelimit_test(s->ratelimit, l->id, l->interval, l->burst, priority & LOG_PRIMASK, available);
+                        if (rl == 0)
+                                return false;
+
+                        if (rl > 1)
+                                server_driver_message(s, 0,
+                                                      "MESSAGE_ID=" SD_MESSAGE_JOURNAL_DROPPED_STR,
+                                                      LOG_MESSAGE("Suppressed %i messages from units in %s", rl - 1, l->id),
+                                                      "N_DROPPED=%i", rl - 1,
+                                                      NULL);
+                }
+
+                id = l->parent;
+        }
+
+        return true;
+}
+
 void server_dispatch_message(
                 Server *s,
                 struct iovec *iovec, size_t n, size_t m,
@@ -1092,9 +1590,10 @@ void server_dispatch_message(
         if (s->storage == STORAGE_NONE)
                 return;
 
-        if (c && c->unit) {
+        if (c && (c->unit || c->slice))
                 (void) determine_space(s, &available, NULL);
 
+        if (c && c->unit) {
                 rl = journal_ratelimit_test(s->ratelimit, c->unit, c->log_ratelimit_interval, c->log_ratelimit_burst, priority & LOG_PRIMASK, available);
                 if (rl == 0)
                         return;
@@ -1108,15 +1607,78 @@ void server_dispatch_message(
                                               NULL);
         }
 
+        if (c && c->slice && !server_test_slice_ratelimits(s, c, priority, available))
+                return;
+
         dispatch_message_real(s, iovec, n, m, c, tv, priority, object_pid);
 }
 
+/* Remember how far we got every so often, so that an interrupted flush doesn't copy everything again */
+#define FLUSH_CURSOR_INTERVAL 4096U
+
+#define FLUSH_PROGRESS_INTERVAL_USEC (5*USEC_PER_SEC)
+
+static int server_save_flush_cursor(Server *s, sd_journal *j) {
+        _cleanup_free_ char *cursor = NULL;
+        const char *fn;
+        int r;
+
+        assert(s);
+        assert(j);
+
+        r = sd_journal_get_cursor(j, &cursor);
+        if (r < 0)
+                return r;
+
+        fn = strjoina(s->runtime_directory, "/flush-cursor");
+        return write_string_file(fn, cursor, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+}
+
+static int server_seek_flush_cursor(Server *s, sd_journal *j, char **ret_cursor) {
+        _cleanup_free_ char *cursor = NULL;
+        const char *fn;
+        int r;
+
+        assert(s);
+        assert(j);
+        assert(ret_cursor);
+
+        /* Continues after the last entry an earlier flush managed to copy, if there was one */
+
+        fn = strjoina(s->runtime_directory, "/flush-cursor");
+        r = read_one_line_file(fn, &cursor);
+        if (r == -ENOENT)
+                goto head;
+        if (r < 0) {
+                log_warning_errno(r, "Failed to read %s, flushing all entries: %m", fn);
+                goto head;
+        }
+
+        r = sd_journal_seek_cursor(j, cursor);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to seek to flush cursor, flushing all entries: %m");
+                goto head;
+        }
+
+        log_debug("Resuming interrupted flush.");
+        *ret_cursor = TAKE_PTR(cursor);
+        return 1;
+
+head:
+        *ret_cursor = NULL;
+        return sd_journal_seek_head(j);
+}
+
 int server_flush_to_var(Server *s, bool require_flag_file) {
+        _cleanup_(journal_copy_cache_done) JournalCopyCache cache = {};
+        _cleanup_free_ char *resume_cursor = NULL;
         char ts[FORMAT_TIMESPAN_MAX];
         sd_journal *j = NULL;
+        uint64_t n_total = 0;
+        usec_t start, progress;
+        JournalFile *f;
         const char *fn;
         unsigned n = 0;
-        usec_t start;
         int r, k;
 
         assert(s);
@@ -1127,6 +1689,8 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
         if (s->namespace) /* Flushing concept does not exist for namespace instances */
                 return 0;
 
+        server_wait_for_writer(s);
+
         if (!s->runtime_journal) /* Nothing to flush? */
                 return 0;
 
@@ -1140,7 +1704,7 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
 
         log_debug("Flushing to %s...", s->system_storage.path);
 
-        start = now(CLOCK_MONOTONIC);
+        start = progress = now(CLOCK_MONOTONIC);
 
         r = sd_journal_open(&j, SD_JOURNAL_RUNTIME_ONLY);
         if (r < 0)
@@ -1148,13 +1712,30 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
 
         sd_journal_set_data_threshold(j, 0);
 
-        SD_JOURNAL_FOREACH(j) {
+        ORDERED_HASHMAP_FOREACH(f, j->files)
+                n_total += le64toh(f->header->n_entries);
+
+        r = server_seek_flush_cursor(s, j, &resume_cursor);
+        if (r < 0) {
+                log_error_errno(r, "Failed to seek runtime journal: %m");
+                goto finish;
+        }
+
+        while (sd_journal_next(j) > 0) {
                 Object *o = NULL;
-                JournalFile *f;
+                usec_t t;
 
                 f = j->current_file;
                 assert(f && f->current_offset > 0);
 
+                if (resume_cursor) {
+                        /* If the entry we stopped at is still around, we copied it already */
+                        k = sd_journal_test_cursor(j, resume_cursor);
+                        resume_cursor = mfree(resume_cursor);
+                        if (k > 0)
+                                continue;
+                }
+
                 n++;
 
                 r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
@@ -1163,29 +1744,40 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                         goto finish;
                 }
 
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset);
-                if (r >= 0)
-                        continue;
+                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset, &cache);
+                if (r < 0) {
+                        if (!shall_try_append_again(s->system_journal, r)) {
+                                log_error_errno(r, "Can't write entry: %m");
+                                goto finish;
+                        }
 
-                if (!shall_try_append_again(s->system_journal, r)) {
-                        log_error_errno(r, "Can't write entry: %m");
-                        goto finish;
-                }
+                        server_rotate(s);
+                        server_vacuum(s, false);
 
-                server_rotate(s);
-                server_vacuum(s, false);
+                        if (!s->system_journal) {
+                                log_notice("Didn't flush runtime journal since rotation of system journal wasn't successful.");
+                                r = -EIO;
+                                goto finish;
+                        }
 
-                if (!s->system_journal) {
-                        log_notice("Didn't flush runtime journal since rotation of system journal wasn't successful.");
-                        r = -EIO;
-                        goto finish;
+                        log_debug("Retrying write.");
+                        r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset, &cache);
+                        if (r < 0) {
+                                log_error_errno(r, "Can't write entry: %m");
+                                goto finish;
+                        }
                 }
 
-                log_debug("Retrying write.");
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset);
-                if (r < 0) {
-                        log_error_errno(r, "Can't write entry: %m");
-                        goto finish;
+                if (n % FLUSH_CURSOR_INTERVAL == 0) {
+                        k = server_save_flush_cursor(s, j);
+                        if (k < 0)
+                                log_debug_errno(k, "Failed to save flush cursor, ignoring: %m");
+
+                        t = now(CLOCK_MONOTONIC);
+                        if (t >= usec_add(progress, FLUSH_PROGRESS_INTERVAL_USEC)) {
+                                log_info("Flushed %u of %" PRIu64 " entries to %s...", n, n_total, s->system_storage.path);
+                                progress = t;
+                        }
                 }
         }
 
@@ -1195,13 +1787,28 @@ finish:
         if (s->system_journal)
                 journal_file_post_change(s->system_journal);
 
+        /* Remember the last entry we copied, so that the next attempt continues after it */
+        if (r < 0 && n > 1 && sd_journal_previous(j) > 0) {
+                k = server_save_flush_cursor(s, j);
+                if (k < 0)
+                        log_warning_errno(k, "Failed to save flush cursor, next flush will start over: %m");
+        }
+
         s->runtime_journal = journal_file_close(s->runtime_journal);
 
-        if (r >= 0)
+        if (r >= 0) {
                 (void) rm_rf(s->runtime_storage.path, REMOVE_ROOT);
 
+                fn = strjoina(s->runtime_directory, "/flush-cursor");
+                if (unlink(fn) < 0 && errno != ENOENT)
+                        log_warning_errno(errno, "Failed to remove %s, ignoring: %m", fn);
+        }
+
         sd_journal_close(j);
 
+        log_debug("Reused %" PRIu64 " of %" PRIu64 " data objects while flushing.",
+                  cache.n_hits, cache.n_hits + cache.n_misses);
+
         server_driver_message(s, 0, NULL,
                               LOG_MESSAGE("Time spent on flushing to %s is %s for %u entries.",
                                           s->system_storage.path,
@@ -1228,6 +1835,8 @@ static int server_relinquish_var(Server *s) {
         if (s->namespace) /* Concept does not exist for namespaced instances */
                 return -EOPNOTSUPP;
 
+        server_wait_for_writer(s);
+
         if (s->runtime_journal && !s->system_journal)
                 return 0;
 
@@ -1247,76 +1856,20 @@ static int server_relinquish_var(Server *s) {
         return 0;
 }
 
-int server_process_datagram(
-                sd_event_source *es,
-                int fd,
-                uint32_t revents,
-                void *userdata) {
-
-        Server *s = userdata;
+static void server_dispatch_datagram(Server *s, int fd, struct msghdr *msghdr, char *buffer, size_t n) {
         struct ucred *ucred = NULL;
         struct timeval *tv = NULL;
         struct cmsghdr *cmsg;
         char *label = NULL;
-        size_t label_len = 0, m;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
+        size_t label_len = 0;
+        int *fds = NULL;
         size_t n_fds = 0;
 
-        /* We use NAME_MAX space for the SELinux label here. The kernel currently enforces no limit, but
-         * according to suggestions from the SELinux people this will change and it will probably be
-         * identical to NAME_MAX. For now we use that, but this should be updated one day when the final
-         * limit is known. */
-        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred)) +
-                         CMSG_SPACE(sizeof(struct timeval)) +
-                         CMSG_SPACE(sizeof(int)) + /* fd */
-                         CMSG_SPACE(NAME_MAX) /* selinux label */) control;
-
-        union sockaddr_union sa = {};
-
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
-
         assert(s);
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
-
-        if (revents != EPOLLIN)
-                return log_error_errno(SYNTHETIC_ERRNO(EIO),
-                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
-                                       revents);
-
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
-
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
-
-        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
-                return log_oom();
-
-        iovec = IOVEC_MAKE(s->buffer, s->buffer_size - 1); /* Leave room for trailing NUL we add later */
-
-        n = recvmsg_safe(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (IN_SET(n, -EINTR, -EAGAIN))
-                return 0;
-        if (n == -EXFULL) {
-                log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
-                return 0;
-        }
-        if (n < 0)
-                return log_error_errno(n, "recvmsg() failed: %m");
+        assert(msghdr);
+        assert(buffer);
 
-        CMSG_FOREACH(cmsg, &msghdr)
+        CMSG_FOREACH(cmsg, msghdr)
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
                     cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
@@ -1333,26 +1886,28 @@ int server_process_datagram(
                         assert(!tv);
                         tv = (struct timeval*) CMSG_DATA(cmsg);
                 } else if (cmsg->cmsg_level == SOL_SOCKET &&
-                         cmsg->cmsg_type == SCM_RIGHTS) {
+                           cmsg->cmsg_type == SCM_RIGHTS) {
                         assert(!fds);
                         fds = (int*) CMSG_DATA(cmsg);
                         n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
                 }
 
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_syslog_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (n_fds > 0 && memcmp_nn(buffer, n, ".ring\n", STRLEN(".ring\n")) == 0)
+                        (void) server_setup_ring(s, fds, n_fds, ucred, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got too many file descriptors via native socket. Ignoring.");
 
@@ -1360,12 +1915,156 @@ int server_process_datagram(
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via audit socket. Ignoring.");
         }
 
         close_many(fds, n_fds);
+}
+
+static size_t server_datagram_slots(Server *s) {
+        size_t i, n;
+        void *p;
+
+        assert(s);
+
+        if (s->datagram_slots)
+                return s->n_datagram_slots;
+
+        n = CLAMP(s->datagram_batch_size, 1U, DATAGRAM_BATCH_SIZE_MAX);
+
+        s->datagram_slots = new0(DatagramSlot, n);
+        s->datagram_msgs = new0(struct mmsghdr, n);
+        if (!s->datagram_slots || !s->datagram_msgs) {
+                s->datagram_slots = mfree(s->datagram_slots);
+                s->datagram_msgs = mfree(s->datagram_msgs);
+                return 0;
+        }
+
+        /* The first slot uses s->buffer, which is sized for the next pending datagram on each wakeup. All
+         * others get a slot in a lazily populated mapping, so that they can take any datagram a client could
+         * have sent without us actually allocating that much memory. */
+        if (n > 1) {
+                p = mmap(NULL, (n - 1) * DATAGRAM_SLOT_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+                if (p == MAP_FAILED) {
+                        log_warning_errno(errno, "Failed to map datagram receive buffers, reading one datagram at a time: %m");
+                        n = 1;
+                } else {
+                        s->datagram_area = p;
+
+                        for (i = 1; i < n; i++)
+                                /* Leave room for trailing NUL we add later */
+                                s->datagram_slots[i].iovec = IOVEC_MAKE((uint8_t*) p + (i - 1) * DATAGRAM_SLOT_SIZE, DATAGRAM_SLOT_SIZE - 1);
+                }
+        }
+
+        s->n_datagram_slots = n;
+        return n;
+}
+
+static void server_release_datagram_slot(Server *s, size_t i, size_t n) {
+        uint8_t *p;
+
+        assert(s);
+        assert(i > 0);
+
+        /* Give back whatever a large datagram made us populate beyond what we normally keep around */
+        if (n <= DATAGRAM_SLOT_RESIDENT_MAX)
+                return;
+
+        p = (uint8_t*) s->datagram_area + (i - 1) * DATAGRAM_SLOT_SIZE;
+        (void) madvise(p + DATAGRAM_SLOT_RESIDENT_MAX, PAGE_ALIGN(n + 1) - DATAGRAM_SLOT_RESIDENT_MAX, MADV_DONTNEED);
+}
+
+int server_process_datagram(
+                sd_event_source *es,
+                int fd,
+                uint32_t revents,
+                void *userdata) {
+
+        Server *s = userdata;
+        size_t i, m, n_slots;
+        int k, v = 0;
+
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
+                                       revents);
+
+        n_slots = server_datagram_slots(s);
+        if (n_slots == 0)
+                return log_oom();
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
+                return log_oom();
+
+        s->datagram_slots[0].iovec = IOVEC_MAKE(s->buffer, s->buffer_size - 1); /* Leave room for trailing NUL we add later */
+
+        for (i = 0; i < n_slots; i++)
+                s->datagram_msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = &s->datagram_slots[i].iovec,
+                                .msg_iovlen = 1,
+                                .msg_control = &s->datagram_slots[i].control,
+                                .msg_controllen = sizeof(s->datagram_slots[i].control),
+                                .msg_name = &s->datagram_slots[i].sa,
+                                .msg_namelen = sizeof(s->datagram_slots[i].sa),
+                        },
+                };
+
+        k = recvmmsg(fd, s->datagram_msgs, n_slots, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (k < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmmsg() failed: %m");
+        }
+
+        s->n_datagram_batches++;
+        s->n_datagrams += k;
+        if ((size_t) k == n_slots)
+                s->n_datagram_batches_full++;
+
+        client_context_begin_batch(s);
+
+        /* Look up all senders first, while they are most likely still around */
+        if (k > 1)
+                for (i = 0; i < (size_t) k; i++)
+                        if (!FLAGS_SET(s->datagram_msgs[i].msg_hdr.msg_flags, MSG_CTRUNC))
+                                client_context_prefetch(s, CMSG_FIND_DATA(&s->datagram_msgs[i].msg_hdr, SOL_SOCKET, SCM_CREDENTIALS, struct ucred));
+
+        for (i = 0; i < (size_t) k; i++) {
+                struct msghdr *mh = &s->datagram_msgs[i].msg_hdr;
+                size_t n = s->datagram_msgs[i].msg_len;
+
+                if (FLAGS_SET(mh->msg_flags, MSG_CTRUNC)) {
+                        cmsg_close_all(mh);
+                        log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
+                } else if (FLAGS_SET(mh->msg_flags, MSG_TRUNC)) {
+                        s->n_datagrams_truncated++;
+                        cmsg_close_all(mh);
+                        log_warning("Got datagram larger than %zu bytes, ignoring.", mh->msg_iov->iov_len);
+                } else
+                        server_dispatch_datagram(s, fd, mh, mh->msg_iov->iov_base, n);
+
+                if (i > 0)
+                        server_release_datagram_slot(s, i, MIN(n, mh->msg_iov->iov_len));
+        }
+
+        client_context_end_batch(s);
 
         server_refresh_idle_timer(s);
         return 0;
@@ -1658,13 +2357,31 @@ static int server_dispatch_sync(sd_event_source *es, usec_t t, void *userdata) {
         return 0;
 }
 
+void server_submit_sync(Server *s, JournalFile *f, int priority) {
+        int r;
+
+        assert(s);
+        assert(f);
+
+        /* Called from the main thread as well as from the writer thread, right after messages of the
+         * specified priority have been appended to the file */
+
+        if (!s->syncer || LOG_PRI(priority) > LOG_CRIT)
+                return;
+
+        r = journal_syncer_submit(s->syncer, f);
+        if (r < 0)
+                log_warning_errno(r, "%s: Failed to queue sync, ignoring: %m", f->path);
+}
+
 int server_schedule_sync(Server *s, int priority) {
         int r;
 
         assert(s);
 
-        if (priority <= LOG_CRIT) {
-                /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG */
+        if (priority <= LOG_CRIT && !s->syncer) {
+                /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG. If the sync thread
+                 * is running it takes care of that already, see server_submit_sync(). */
                 server_sync(s);
                 return 0;
         }
@@ -2005,6 +2722,84 @@ static int vl_method_relinquish_var(Varlink *link, JsonVariant *parameters, Varl
         return varlink_reply(link, NULL);
 }
 
+static int vl_method_get_write_queue(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        Server *s = userdata;
+        int r;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        if (!s->writer)
+                return varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("threadedWrites", JSON_BUILD_BOOLEAN(false))));
+
+        r = journal_writer_build_json(s->writer, &v);
+        if (r < 0)
+                return r;
+
+        return varlink_reply(link, v);
+}
+
+static int vl_method_get_datagram_batches(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        Server *s = userdata;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR("batchSize", JSON_BUILD_UNSIGNED(s->n_datagram_slots > 0 ? s->n_datagram_slots : CLAMP(s->datagram_batch_size, 1U, DATAGRAM_BATCH_SIZE_MAX))),
+                                              JSON_BUILD_PAIR("batches", JSON_BUILD_UNSIGNED(s->n_datagram_batches)),
+                                              JSON_BUILD_PAIR("fullBatches", JSON_BUILD_UNSIGNED(s->n_datagram_batches_full)),
+                                              JSON_BUILD_PAIR("datagrams", JSON_BUILD_UNSIGNED(s->n_datagrams)),
+                                              JSON_BUILD_PAIR("truncatedDatagrams", JSON_BUILD_UNSIGNED(s->n_datagrams_truncated))));
+}
+
+static int vl_method_get_rate_limits(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        Server *s = userdata;
+        int r;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        r = journal_ratelimit_build_json(s->ratelimit, &v);
+        if (r < 0)
+                return r;
+
+        return varlink_reply(link, v);
+}
+
+static int vl_method_get_sync_latency(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        Server *s = userdata;
+        int r;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        if (!s->syncer)
+                return varlink_error(link, "io.systemd.Journal.NoSyncThread", NULL);
+
+        r = journal_syncer_build_json(s->syncer, &v);
+        if (r < 0)
+                return r;
+
+        return varlink_reply(link, v);
+}
+
 static int vl_connect(VarlinkServer *server, Varlink *link, void *userdata) {
         Server *s = userdata;
 
@@ -2040,10 +2835,18 @@ static int server_open_varlink(Server *s, const char *socket, int fd) {
 
         r = varlink_server_bind_method_many(
                         s->varlink_server,
-                        "io.systemd.Journal.Synchronize",   vl_method_synchronize,
-                        "io.systemd.Journal.Rotate",        vl_method_rotate,
-                        "io.systemd.Journal.FlushToVar",    vl_method_flush_to_var,
-                        "io.systemd.Journal.RelinquishVar", vl_method_relinquish_var);
+                        "io.systemd.Journal.Synchronize",        vl_method_synchronize,
+                        "io.systemd.Journal.Rotate",             vl_method_rotate,
+                        "io.systemd.Journal.FlushToVar",         vl_method_flush_to_var,
+                        "io.systemd.Journal.RelinquishVar",      vl_method_relinquish_var,
+                        "io.systemd.Journal.GetWriteQueue",      vl_method_get_write_queue,
+                        "io.systemd.Journal.GetDatagramBatches", vl_method_get_datagram_batches,
+                        "io.systemd.Journal.GetRateLimits",      vl_method_get_rate_limits,
+                        "io.systemd.Journal.GetSyncLatency",     vl_method_get_sync_latency);
+        if (r < 0)
+                return r;
+
+        r = varlink_server_bind_event_loop(s->varlink_server);
         if (r < 0)
                 return r;
 
@@ -2089,6 +2892,10 @@ static bool server_is_idle(Server *s) {
         if (s->n_stdout_streams > 0)
                 return false;
 
+        /* Same for clients logging through a ring */
+        if (s->n_rings > 0)
+                return false;
+
         return true;
 }
 
@@ -2182,6 +2989,7 @@ int server_init(Server *s, const char *namespace) {
                 .audit_fd = -1,
                 .hostname_fd = -1,
                 .notify_fd = -1,
+                .console_fd = -1,
 
                 .compress.enabled = true,
                 .compress.threshold_bytes = (uint64_t) -1,
@@ -2209,6 +3017,8 @@ int server_init(Server *s, const char *namespace) {
 
                 .line_max = DEFAULT_LINE_MAX,
 
+                .datagram_batch_size = DEFAULT_DATAGRAM_BATCH_SIZE,
+
                 .runtime_storage.name = "Runtime Journal",
                 .system_storage.name = "System Journal",
         };
@@ -2224,8 +3034,16 @@ int server_init(Server *s, const char *namespace) {
         journal_reset_metrics(&s->system_storage.metrics);
         journal_reset_metrics(&s->runtime_storage.metrics);
 
+        /* The fields journalctl -F and --count-by= are most commonly used with, and the one --list-boots needs */
+        s->stats_fields = strv_new("_SYSTEMD_UNIT", "_SYSTEMD_USER_UNIT", "SYSLOG_IDENTIFIER", "PRIORITY", "_COMM", "_BOOT_ID");
+        if (!s->stats_fields)
+                return log_oom();
+
         server_parse_config_file(s);
 
+        if (s->seal && !strv_isempty(s->unindexed_fields))
+                log_notice("NoIndexFields= is set, but has no effect on sealed journal files.");
+
         if (!s->namespace) {
                 /* Parse kernel command line, but only if we are not a namespace instance */
                 r = proc_cmdline_parse(parse_proc_cmdline_item, s, PROC_CMDLINE_STRIP_RD_PREFIX);
@@ -2267,6 +3085,12 @@ int server_init(Server *s, const char *namespace) {
         if (r < 0)
                 return log_error_errno(r, "Failed to create event loop: %m");
 
+        /* Under load there may be thousands of stdout streams ready, don't let them delay the watchdog and
+         * the control interfaces */
+        r = sd_event_set_priority_lanes(s->event, true);
+        if (r < 0)
+                log_debug_errno(r, "Failed to enable priority lanes for event loop, ignoring: %m");
+
         n = sd_listen_fds(true);
         if (n < 0)
                 return log_error_errno(n, "Failed to read listening file descriptors from environment: %m");
@@ -2417,12 +3241,24 @@ int server_init(Server *s, const char *namespace) {
 
         (void) server_connect_notify(s);
 
+        (void) client_context_watch_units(s);
+
         (void) client_context_acquire_default(s);
 
         r = system_journal_open(s, false, false);
         if (r < 0)
                 return r;
 
+        r = journal_syncer_new(&s->syncer);
+        if (r < 0)
+                log_warning_errno(r, "Failed to start sync thread, syncing from the main loop: %m");
+
+        if (s->threaded_writes) {
+                r = journal_writer_new(s, &s->writer);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to start writer thread: %m");
+        }
+
         server_start_or_stop_idle_timer(s);
         return 0;
 }
@@ -2432,6 +3268,11 @@ void server_maybe_append_tags(Server *s) {
         JournalFile *f;
         usec_t n;
 
+        /* This is called on every event loop iteration, don't wait for the writer thread if it's busy. It
+         * appends tags as it writes entries anyway. */
+        if (s->writer && !journal_writer_is_idle(s->writer))
+                return;
+
         n = now(CLOCK_REALTIME);
 
         if (s->system_journal)
@@ -2453,6 +3294,18 @@ void server_done(Server *s) {
         while (s->stdout_streams)
                 stdout_stream_free(s->stdout_streams);
 
+        while (s->rings)
+                journal_ring_free(s->rings);
+
+        server_end_write_batch(s);
+        free(s->write_batch);
+
+        /* Let the writer thread finish before the journal files go away */
+        s->writer = journal_writer_free(s->writer);
+
+        /* Pending syncs hold their own fds, and are completed before this returns */
+        s->syncer = journal_syncer_free(s->syncer);
+
         client_context_flush_all(s);
 
         (void) journal_file_close(s->system_journal);
@@ -2468,6 +3321,7 @@ void server_done(Server *s) {
         sd_event_source_unref(s->dev_kmsg_event_source);
         sd_event_source_unref(s->audit_event_source);
         sd_event_source_unref(s->sync_event_source);
+        sd_event_source_unref(s->prepare_rotation_event_source);
         sd_event_source_unref(s->sigusr1_event_source);
         sd_event_source_unref(s->sigusr2_event_source);
         sd_event_source_unref(s->sigterm_event_source);
@@ -2477,6 +3331,10 @@ void server_done(Server *s) {
         sd_event_source_unref(s->notify_event_source);
         sd_event_source_unref(s->watchdog_event_source);
         sd_event_source_unref(s->idle_event_source);
+        sd_event_source_disable_unref(s->units_event_source);
+        server_console_done(s);
+        storage_close_vacuum_index(&s->runtime_storage);
+        storage_close_vacuum_index(&s->system_storage);
         sd_event_unref(s->event);
 
         safe_close(s->syslog_fd);
@@ -2489,12 +3347,20 @@ void server_done(Server *s) {
 
         if (s->ratelimit)
                 journal_ratelimit_free(s->ratelimit);
+        hashmap_free(s->slice_ratelimits);
 
         if (s->kernel_seqnum)
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
+        ordered_hashmap_free(s->kernel_devices);
 
         free(s->buffer);
+        free(s->datagram_slots);
+        free(s->datagram_msgs);
+        if (s->datagram_area)
+                (void) munmap(s->datagram_area, (s->n_datagram_slots - 1) * DATAGRAM_SLOT_SIZE);
         free(s->tty_path);
+        strv_free(s->unindexed_fields);
+        strv_free(s->stats_fields);
         free(s->cgroup_root);
         free(s->hostname_field);
         free(s->runtime_storage.path);
@@ -2575,6 +3441,65 @@ int config_parse_line_max(
         return 0;
 }
 
+int config_parse_journal_fields(
+                const char* unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        char ***sv = data;
+        const char *p;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(data);
+
+        if (isempty(rvalue)) {
+                *sv = strv_free(*sv);
+                return 0;
+        }
+
+        for (p = rvalue;;) {
+                _cleanup_free_ char *word = NULL;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0) {
+                        log_syntax(unit, LOG_WARNING, filename, line, r, "Failed to parse %s= value, ignoring: %s", lvalue, rvalue);
+                        return 0;
+                }
+                if (r == 0)
+                        return 0;
+
+                if (!journal_field_valid(word, (size_t) -1, true)) {
+                        log_syntax(unit, LOG_WARNING, filename, line, 0, "Invalid field name, ignoring: %s", word);
+                        continue;
+                }
+
+                /* journalctl -b and --list-boots need to match on this one */
+                if (ltype && streq(word, "_BOOT_ID")) {
+                        log_syntax(unit, LOG_WARNING, filename, line, 0, "Field %s cannot be unindexed, ignoring.", word);
+                        continue;
+                }
+
+                if (strv_contains(*sv, word))
+                        continue;
+
+                r = strv_consume(sv, TAKE_PTR(word));
+                if (r < 0)
+                        return log_oom();
+        }
+}
+
 int config_parse_compress(
                 const char* unit,
                 const char *filename,
@@ -7,10 +7,15 @@
 #include "sd-event.h"
 
 typedef struct Server Server;
+typedef struct JournalWriter JournalWriter;
+typedef struct JournalSyncer JournalSyncer;
+typedef struct DatagramSlot DatagramSlot;
+typedef struct JournalRing JournalRing;
 
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
 #include "journald-rate-limit.h"
 #include "journald-stream.h"
@@ -57,6 +62,10 @@ typedef struct JournalStorage {
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        /* Follows the journal files in the directory, so that it needn't be rescanned for each refresh */
+        JournalVacuumIndex *vacuum_index;
+        sd_event_source *vacuum_index_event_source;
 } JournalStorage;
 
 struct Server {
@@ -78,6 +87,7 @@ struct Server {
         sd_event_source *dev_kmsg_event_source;
         sd_event_source *audit_event_source;
         sd_event_source *sync_event_source;
+        sd_event_source *prepare_rotation_event_source;
         sd_event_source *sigusr1_event_source;
         sd_event_source *sigusr2_event_source;
         sd_event_source *sigterm_event_source;
@@ -97,7 +107,16 @@ struct Server {
         char *buffer;
         size_t buffer_size;
 
+        /* Receive slots for reading a batch of datagrams at once, the first one uses the buffer above */
+        unsigned datagram_batch_size;
+        DatagramSlot *datagram_slots;
+        struct mmsghdr *datagram_msgs;
+        size_t n_datagram_slots;
+        void *datagram_area;
+        uint64_t n_datagram_batches, n_datagram_batches_full, n_datagrams, n_datagrams_truncated;
+
         JournalRateLimit *ratelimit;
+        Hashmap *slice_ratelimits;
         usec_t sync_interval_usec;
         usec_t ratelimit_interval;
         unsigned ratelimit_burst;
@@ -107,6 +126,7 @@ struct Server {
 
         JournalCompressOptions compress;
         bool seal;
+        bool threaded_writes;
         bool read_kmsg;
         int set_audit;
 
@@ -118,6 +138,14 @@ struct Server {
         unsigned n_forward_syslog_missed;
         usec_t last_warn_forward_syslog_missed;
 
+        /* Lines queued for the console while it doesn't keep up, written out whenever it becomes writable */
+        char *console_buffer;
+        size_t console_buffer_size;
+        int console_fd;
+        sd_event_source *console_event_source;
+        unsigned n_forward_console_dropped;
+        usec_t last_warn_forward_console_dropped;
+
         usec_t max_retention_usec;
         usec_t max_file_usec;
         usec_t oldest_file_usec;
@@ -126,6 +154,9 @@ struct Server {
         LIST_HEAD(StdoutStream, stdout_streams_notify_queue);
         unsigned n_stdout_streams;
 
+        LIST_HEAD(JournalRing, rings);
+        unsigned n_rings;
+
         char *tty_path;
 
         int max_level_store;
@@ -144,6 +175,9 @@ struct Server {
         uint64_t *kernel_seqnum;
         bool dev_kmsg_readable:1;
 
+        /* Kernel device id → udev fields to attach to kernel messages about that device */
+        OrderedHashmap *kernel_devices;
+
         bool send_watchdog:1;
         bool sent_notify_ready:1;
         bool sync_scheduled:1;
@@ -163,15 +197,41 @@ struct Server {
 
         size_t line_max;
 
+        char **unindexed_fields;
+        char **stats_fields;
+
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
 
         usec_t last_cache_pid_flush;
 
+        /* Set while a batch of datagrams is processed, so that all its messages share one timestamp */
+        usec_t client_contexts_batch_timestamp;
+
+        /* Bumped whenever PID 1 changes per-unit metadata in /run/systemd/units/ */
+        sd_event_source *units_event_source;
+        uint64_t units_generation;
+
         ClientContext *my_context; /* the context of journald itself */
         ClientContext *pid1_context; /* the context of PID 1 */
 
+        /* Entries queued up while processing a burst of messages, to be written to the journal in one go */
+        bool write_batch_open;
+        JournalFileEntry *write_batch;
+        size_t n_write_batch, n_write_batch_allocated;
+        uid_t write_batch_uid;
+        int write_batch_priority;
+
+        /* Appends the batches to the journal files if ThreadedWrites= is on */
+        JournalWriter *writer;
+
+        /* Syncs the files messages of priority CRIT and above were written to, off the event loop */
+        JournalSyncer *syncer;
+
+        /* Don't retry preparing replacements for the journal files before this, after it failed */
+        usec_t prepare_rotation_retry_usec;
+
         VarlinkServer *varlink_server;
 };
 
@@ -200,6 +260,7 @@ const struct ConfigPerfItem* journald_gperf_lookup(const char *key, GPERF_LEN_TY
 
 CONFIG_PARSER_PROTOTYPE(config_parse_storage);
 CONFIG_PARSER_PROTOTYPE(config_parse_line_max);
+CONFIG_PARSER_PROTOTYPE(config_parse_journal_fields);
 CONFIG_PARSER_PROTOTYPE(config_parse_compress);
 
 const char *storage_to_string(Storage s) _const_;
@@ -216,7 +277,12 @@ void server_sync(Server *s);
 int server_vacuum(Server *s, bool verbose);
 void server_rotate(Server *s);
 int server_schedule_sync(Server *s, int priority);
+void server_submit_sync(Server *s, JournalFile *f, int priority);
 int server_flush_to_var(Server *s, bool require_flag_file);
+void server_begin_write_batch(Server *s);
+void server_write_entries(Server *s, uid_t uid, JournalFileEntry *entries, size_t n, int priority);
+JournalFile* server_find_open_journal(Server *s, uid_t uid);
+void server_end_write_batch(Server *s);
 void server_maybe_append_tags(Server *s);
 int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata);
 void server_space_usage_message(Server *s, JournalStorage *storage);
@@ -72,6 +72,7 @@ struct StdoutStream {
         struct ucred ucred;
         char *label;
         char *identifier;
+        char *syslog_identifier_field;
         char *unit_id;
         int priority;
         bool level_prefix:1;
@@ -125,6 +126,7 @@ void stdout_stream_free(StdoutStream *s) {
         safe_close(s->fd);
         free(s->label);
         free(s->identifier);
+        free(s->syslog_identifier_field);
         free(s->unit_id);
         free(s->state_file);
         free(s->buffer);
@@ -250,8 +252,8 @@ static int stdout_stream_log(
         int priority;
         char syslog_priority[] = "PRIORITY=\0";
         char syslog_facility[STRLEN("SYSLOG_FACILITY=") + DECIMAL_STR_MAX(int) + 1];
-        _cleanup_free_ char *message = NULL, *syslog_identifier = NULL;
-        size_t n = 0, m;
+        _cleanup_free_ char *message = NULL;
+        size_t n = 0, m, l;
         int r;
 
         assert(s);
@@ -306,9 +308,10 @@ static int stdout_stream_log(
         }
 
         if (s->identifier) {
-                syslog_identifier = strjoin("SYSLOG_IDENTIFIER=", s->identifier);
-                if (syslog_identifier)
-                        iovec[n++] = IOVEC_MAKE_STRING(syslog_identifier);
+                if (!s->syslog_identifier_field)
+                        s->syslog_identifier_field = strjoin("SYSLOG_IDENTIFIER=", s->identifier);
+                if (s->syslog_identifier_field)
+                        iovec[n++] = IOVEC_MAKE_STRING(s->syslog_identifier_field);
         }
 
         static const char * const line_break_field_table[_LINE_BREAK_MAX] = {
@@ -326,9 +329,19 @@ static int stdout_stream_log(
         if (c)
                 iovec[n++] = IOVEC_MAKE_STRING(c);
 
-        message = strjoin("MESSAGE=", p);
-        if (message)
-                iovec[n++] = IOVEC_MAKE_STRING(message);
+        /* Everything in the buffer before the line was processed already, hence if there's enough of it, put
+         * the field name right in front of the line instead of copying it. */
+        l = strlen(p);
+        if (p >= s->buffer + STRLEN("MESSAGE=")) {
+                char *k = (char*) p - STRLEN("MESSAGE=");
+
+                memcpy(k, "MESSAGE=", STRLEN("MESSAGE="));
+                iovec[n++] = IOVEC_MAKE(k, STRLEN("MESSAGE=") + l);
+        } else {
+                message = strjoin("MESSAGE=", p);
+                if (message)
+                        iovec[n++] = IOVEC_MAKE_STRING(message);
+        }
 
         server_dispatch_message(s->server, iovec, n, m, s->context, NULL, priority, 0);
         return 0;
@@ -458,7 +471,7 @@ static int stdout_stream_found(
         return r;
 }
 
-static int stdout_stream_scan(
+static int stdout_stream_scan_terminated(
                 StdoutStream *s,
                 char *p,
                 size_t remaining,
@@ -470,25 +483,20 @@ static int stdout_stream_scan(
 
         assert(s);
         assert(p);
+        assert(p[remaining] == 0);
 
         for (;;) {
                 LineBreak line_break;
                 size_t skip, found;
-                char *end1, *end2;
+                char *end;
 
-                end1 = memchr(p, '\n', remaining);
-                end2 = memchr(p, 0, end1 ? (size_t) (end1 - p) : remaining);
+                end = strchrnul(p, '\n');
+                found = end - p;
 
-                if (end2) {
-                        /* We found a NUL terminator */
-                        found = end2 - p;
-                        skip = found + 1;
-                        line_break = LINE_BREAK_NUL;
-                } else if (end1) {
-                        /* We found a \n terminator */
-                        found = end1 - p;
+                if (found < remaining) {
+                        /* We found a \n or NUL terminator */
                         skip = found + 1;
-                        line_break = LINE_BREAK_NEWLINE;
+                        line_break = *end == '\n' ? LINE_BREAK_NEWLINE : LINE_BREAK_NUL;
                 } else if (remaining >= s->server->line_max) {
                         /* Force a line break after the maximum line length */
                         found = skip = s->server->line_max;
@@ -519,6 +527,30 @@ static int stdout_stream_scan(
         return 0;
 }
 
+static int stdout_stream_scan(
+                StdoutStream *s,
+                char *p,
+                size_t remaining,
+                LineBreak force_flush,
+                size_t *ret_consumed) {
+
+        char saved;
+        int r;
+
+        assert(s);
+        assert(p);
+
+        /* Terminate the data, so that a single strchrnul() finds the next line break of either kind. There's
+         * always room for that, see stdout_stream_process(). The byte is restored afterwards, as on a PID
+         * change it is the first one of the data read from the new process, which is scanned next. */
+        saved = p[remaining];
+        p[remaining] = 0;
+        r = stdout_stream_scan_terminated(s, p, remaining, force_flush, ret_consumed);
+        p[remaining] = saved;
+
+        return r;
+}
+
 static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred))) control;
         StdoutStream *s = userdata;
@@ -567,6 +599,9 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         }
         cmsg_close_all(&msghdr);
 
+        /* A single read might carry many lines, write them to the journal together */
+        server_begin_write_batch(s->server);
+
         if (l == 0) {
                 (void) stdout_stream_scan(s, s->buffer, s->length, /* force_flush = */ LINE_BREAK_EOF, NULL);
                 goto terminate;
@@ -604,9 +639,11 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         s->length = l - consumed;
         memmove(s->buffer, p + consumed, s->length);
 
+        server_end_write_batch(s->server);
         return 1;
 
 terminate:
+        server_end_write_batch(s->server);
         stdout_stream_destroy(s);
         return 0;
 }
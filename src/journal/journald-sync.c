@@ -0,0 +1,302 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journald-sync.h"
+#include "string-util.h"
+
+/* Messages of priority CRIT and above are supposed to hit the disk right away. Instead of taking all journal
+ * files offline from the event loop for each of them, which makes the next write wait for the sync to
+ * finish, the files they were written to are handed over to a thread that fdatasync()s them, while new
+ * messages keep being appended. Requests for a file that is already waiting to be synced are coalesced
+ * into the pending sync, and the thread syncs all pending files in order before it goes back to sleep.
+ * Taking the files offline regularly is still left to the SyncIntervalSec= timer.
+ *
+ * Each request owns a duplicate of the fd, so that the journal file may be closed or rotated while its
+ * sync is in flight. */
+
+static JournalSyncTarget* journal_sync_target_free(JournalSyncTarget *t) {
+        if (!t)
+                return NULL;
+
+        safe_close(t->fd);
+        free(t->path);
+        return mfree(t);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalSyncTarget*, journal_sync_target_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(journal_sync_target_hash_ops, char, string_hash_func, string_compare_func,
+                                              JournalSyncTarget, journal_sync_target_free);
+
+static void journal_sync_target_account(JournalSyncTarget *t, usec_t d, int r) {
+        unsigned i;
+
+        assert(t);
+
+        if (r < 0) {
+                t->n_failed++;
+                return;
+        }
+
+        t->n_synced++;
+        t->total_usec += d;
+        t->max_usec = MAX(t->max_usec, d);
+
+        for (i = 0; i < SYNC_HISTOGRAM_BUCKETS - 1; i++)
+                if (d < (usec_t) SYNC_HISTOGRAM_BASE_USEC << i)
+                        break;
+
+        t->histogram[i]++;
+}
+
+static void* syncer_thread(void *userdata) {
+        JournalSyncer *y = userdata;
+
+        (void) pthread_setname_np(pthread_self(), "journal-sync");
+
+        assert_se(pthread_mutex_lock(&y->mutex) == 0);
+
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                JournalSyncTarget *t;
+                usec_t start, d;
+                int r = 0;
+
+                while (!y->quit && !y->pending)
+                        assert_se(pthread_cond_wait(&y->cond, &y->mutex) == 0);
+
+                /* Finish what was requested before we are told to quit */
+                t = y->pending;
+                if (!t)
+                        break;
+
+                LIST_REMOVE(pending, y->pending, t);
+                if (y->pending_tail == t)
+                        y->pending_tail = NULL;
+
+                /* From here on a new request for the file queues another sync, as we may miss what is
+                 * written while we sync */
+                fd = TAKE_FD(t->fd);
+
+                assert_se(pthread_mutex_unlock(&y->mutex) == 0);
+
+                start = now(CLOCK_MONOTONIC);
+                if (fdatasync(fd) < 0)
+                        r = log_warning_errno(errno, "Failed to sync journal file %s, ignoring: %m", t->path);
+                d = now(CLOCK_MONOTONIC) - start;
+
+                fd = safe_close(fd);
+
+                assert_se(pthread_mutex_lock(&y->mutex) == 0);
+
+                journal_sync_target_account(t, d, r);
+        }
+
+        assert_se(pthread_mutex_unlock(&y->mutex) == 0);
+
+        return NULL;
+}
+
+int journal_syncer_new(JournalSyncer **ret) {
+        _cleanup_(journal_syncer_freep) JournalSyncer *y = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(ret);
+
+        y = new0(JournalSyncer, 1);
+        if (!y)
+                return -ENOMEM;
+
+        assert_se(pthread_mutex_init(&y->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&y->cond, NULL) == 0);
+
+        /* Leave all signals to the main thread */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&y->thread, NULL, syncer_thread, y);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        y->thread_started = true;
+        *ret = TAKE_PTR(y);
+
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+JournalSyncer* journal_syncer_free(JournalSyncer *y) {
+        if (!y)
+                return NULL;
+
+        if (y->thread_started) {
+                assert_se(pthread_mutex_lock(&y->mutex) == 0);
+                y->quit = true;
+                assert_se(pthread_cond_broadcast(&y->cond) == 0);
+                assert_se(pthread_mutex_unlock(&y->mutex) == 0);
+
+                assert_se(pthread_join(y->thread, NULL) == 0);
+        }
+
+        hashmap_free(y->targets);
+
+        assert_se(pthread_cond_destroy(&y->cond) == 0);
+        assert_se(pthread_mutex_destroy(&y->mutex) == 0);
+
+        return mfree(y);
+}
+
+int journal_syncer_submit(JournalSyncer *y, JournalFile *f) {
+        JournalSyncTarget *t;
+        int r = 0;
+
+        assert(y);
+        assert(f);
+        assert(f->fd >= 0);
+
+        /* May be called from the main thread as well as from the writer thread, once the entries in
+         * question have been appended */
+
+        assert_se(pthread_mutex_lock(&y->mutex) == 0);
+
+        t = hashmap_get(y->targets, f->path);
+        if (!t) {
+                _cleanup_(journal_sync_target_freep) JournalSyncTarget *n = NULL;
+
+                r = hashmap_ensure_allocated(&y->targets, &journal_sync_target_hash_ops);
+                if (r < 0)
+                        goto finish;
+
+                n = new0(JournalSyncTarget, 1);
+                if (!n) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                n->fd = -1;
+                n->path = strdup(f->path);
+                if (!n->path) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                r = hashmap_put(y->targets, n->path, n);
+                if (r < 0)
+                        goto finish;
+
+                t = TAKE_PTR(n);
+        }
+
+        t->n_requested++;
+
+        if (t->fd >= 0) {
+                /* Not synced yet, everything written so far will be covered */
+                t->n_coalesced++;
+                r = 0;
+                goto finish;
+        }
+
+        t->fd = fcntl(f->fd, F_DUPFD_CLOEXEC, 3);
+        if (t->fd < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        LIST_INSERT_AFTER(pending, y->pending, y->pending_tail, t);
+        y->pending_tail = t;
+
+        assert_se(pthread_cond_broadcast(&y->cond) == 0);
+        r = 0;
+
+finish:
+        assert_se(pthread_mutex_unlock(&y->mutex) == 0);
+        return r;
+}
+
+static int journal_sync_target_build_json(JournalSyncTarget *t, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *histogram = NULL;
+        unsigned i;
+        int r;
+
+        assert(t);
+        assert(ret);
+
+        for (i = 0; i < SYNC_HISTOGRAM_BUCKETS; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *b = NULL;
+
+                if (i < SYNC_HISTOGRAM_BUCKETS - 1)
+                        r = json_build(&b, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR("belowUSec", JSON_BUILD_UNSIGNED((usec_t) SYNC_HISTOGRAM_BASE_USEC << i)),
+                                                       JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(t->histogram[i]))));
+                else
+                        r = json_build(&b, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(t->histogram[i]))));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&histogram, b);
+                if (r < 0)
+                        return r;
+        }
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR("path", JSON_BUILD_STRING(t->path)),
+                                          JSON_BUILD_PAIR("pending", JSON_BUILD_BOOLEAN(t->fd >= 0)),
+                                          JSON_BUILD_PAIR("requested", JSON_BUILD_UNSIGNED(t->n_requested)),
+                                          JSON_BUILD_PAIR("coalesced", JSON_BUILD_UNSIGNED(t->n_coalesced)),
+                                          JSON_BUILD_PAIR("synced", JSON_BUILD_UNSIGNED(t->n_synced)),
+                                          JSON_BUILD_PAIR("failed", JSON_BUILD_UNSIGNED(t->n_failed)),
+                                          JSON_BUILD_PAIR("totalUSec", JSON_BUILD_UNSIGNED(t->total_usec)),
+                                          JSON_BUILD_PAIR("maxUSec", JSON_BUILD_UNSIGNED(t->max_usec)),
+                                          JSON_BUILD_PAIR("histogram", JSON_BUILD_VARIANT(histogram))));
+}
+
+int journal_syncer_build_json(JournalSyncer *y, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *files = NULL;
+        JournalSyncTarget *t;
+        int r = 0;
+
+        assert(y);
+        assert(ret);
+
+        assert_se(pthread_mutex_lock(&y->mutex) == 0);
+
+        HASHMAP_FOREACH(t, y->targets) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                r = journal_sync_target_build_json(t, &v);
+                if (r < 0)
+                        break;
+
+                r = json_variant_append_array(&files, v);
+                if (r < 0)
+                        break;
+        }
+
+        assert_se(pthread_mutex_unlock(&y->mutex) == 0);
+
+        if (r < 0)
+                return r;
+
+        if (!files) {
+                r = json_variant_new_array(&files, NULL, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        return json_build(ret, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("files", JSON_BUILD_VARIANT(files))));
+}
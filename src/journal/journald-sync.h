@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <pthread.h>
+
+typedef struct JournalSyncer JournalSyncer;
+typedef struct JournalSyncTarget JournalSyncTarget;
+
+#include "hashmap.h"
+#include "journal-file.h"
+#include "json.h"
+#include "list.h"
+#include "time-util.h"
+
+/* Bucket i counts syncs that took less than SYNC_HISTOGRAM_BASE_USEC << i, the last one everything else */
+#define SYNC_HISTOGRAM_BUCKETS 16
+#define SYNC_HISTOGRAM_BASE_USEC 64U
+
+struct JournalSyncTarget {
+        char *path;
+
+        /* A duplicate of the journal file's fd while a sync is pending, -1 otherwise */
+        int fd;
+        LIST_FIELDS(JournalSyncTarget, pending);
+
+        uint64_t n_requested;
+        uint64_t n_coalesced;
+        uint64_t n_synced;
+        uint64_t n_failed;
+        usec_t total_usec;
+        usec_t max_usec;
+        uint64_t histogram[SYNC_HISTOGRAM_BUCKETS];
+};
+
+struct JournalSyncer {
+        pthread_t thread;
+        bool thread_started;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Protected by the mutex */
+        Hashmap *targets;
+        LIST_HEAD(JournalSyncTarget, pending);
+        JournalSyncTarget *pending_tail;
+        bool quit;
+};
+
+int journal_syncer_new(JournalSyncer **ret);
+JournalSyncer* journal_syncer_free(JournalSyncer *y);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalSyncer*, journal_syncer_free);
+
+int journal_syncer_submit(JournalSyncer *y, JournalFile *f);
+
+int journal_syncer_build_json(JournalSyncer *y, JsonVariant **ret);
@@ -0,0 +1,446 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journald-writer.h"
+#include "time-util.h"
+
+/* With ThreadedWrites=yes the event loop only receives messages, collects the client metadata, applies rate
+ * limits and forwards messages, and then hands the batched entries (see server_queue_write()) over to a
+ * writer thread, which appends them to the journal files. That way a slow disk only delays ingestion once
+ * the queue in between is full.
+ *
+ * The writer thread only ever appends to journal files that are already open. Anything else — the clock
+ * jumping backwards, a journal file that needs to be opened, rotated or vacuumed, a failed write — is
+ * handed back to the main thread, which deals with it exactly as if writes were not threaded at all. All
+ * main thread code that accesses the journal files first calls journal_writer_wait(), which lets the
+ * writer thread drain its queue and then pauses it until the next event loop iteration. */
+
+/* The queued entries are copies of the received messages, let's not allow them to pile up without bounds */
+#define WRITE_QUEUE_BYTES_MAX (16U*1024U*1024U)
+
+static JournalWriteBatch* journal_write_batch_free(JournalWriteBatch *b) {
+        size_t i;
+
+        if (!b)
+                return NULL;
+
+        for (i = 0; i < b->n_entries; i++)
+                free((struct iovec*) b->entries[i].iovec);
+
+        return mfree(b);
+}
+
+static int writer_append(JournalWriter *w, JournalWriteBatch *b) {
+        Server *s = w->server;
+        dual_timestamp ts;
+        size_t i, n_written;
+        JournalFile *f;
+        int r;
+
+        /* Take the timestamp right when writing, like the main thread does, so that entries are strictly
+         * ordered by time within each file. */
+        dual_timestamp_get(&ts);
+
+        if (ts.realtime < s->last_realtime_clock)
+                return -EAGAIN;
+
+        f = server_find_open_journal(s, b->uid);
+        if (!f || journal_file_rotate_suggested(f, s->max_file_usec))
+                return -EAGAIN;
+
+        s->last_realtime_clock = ts.realtime;
+
+        for (i = b->n_written; i < b->n_entries; i++)
+                b->entries[i].ts = &ts;
+
+        r = journal_file_append_entries(f, b->entries + b->n_written, b->n_entries - b->n_written, &s->seqnum, &n_written);
+        b->n_written += n_written;
+        if (r < 0) {
+                log_debug_errno(r, "%s: Failed to write entries from writer thread, leaving it to the main thread: %m", f->path);
+                return -EAGAIN;
+        }
+
+        server_submit_sync(s, f, b->priority);
+        return 0;
+}
+
+static void* writer_thread(void *userdata) {
+        JournalWriter *w = userdata;
+
+        (void) pthread_setname_np(pthread_self(), "journal-writer");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                JournalWriteBatch *b;
+                int r;
+
+                while (!w->quit && (w->paused || w->deferred || w->handling_deferred || !w->queue))
+                        assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+                if (w->quit)
+                        break;
+
+                b = w->queue;
+                LIST_REMOVE(batches, w->queue, b);
+                if (w->queue_tail == b)
+                        w->queue_tail = NULL;
+                w->n_queued--;
+                w->queued_bytes -= b->size;
+                w->busy = true;
+
+                /* There's room in the queue now */
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                r = writer_append(w, b);
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+                w->busy = false;
+
+                if (r < 0) {
+                        w->deferred = b;
+                        w->n_batches_deferred++;
+
+                        if (eventfd_write(w->notify_fd, 1) < 0)
+                                log_warning_errno(errno, "Failed to notify main thread about deferred write: %m");
+                } else {
+                        w->n_batches_written++;
+                        journal_write_batch_free(b);
+                }
+
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+/* Must be called with the mutex held, and returns with it held again */
+static void writer_process_deferred(JournalWriter *w) {
+        JournalWriteBatch *b;
+
+        assert(w);
+        assert(!w->exclusive);
+
+        b = TAKE_PTR(w->deferred);
+        if (!b)
+                return;
+
+        /* The writer thread does not touch any journal file until we are done with this batch */
+        w->handling_deferred = true;
+        w->exclusive = true;
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        server_write_entries(w->server, b->uid, b->entries + b->n_written, b->n_entries - b->n_written, b->priority);
+        journal_write_batch_free(b);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        w->exclusive = false;
+        w->handling_deferred = false;
+
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+}
+
+static int dispatch_notify_event(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        JournalWriter *w = userdata;
+
+        assert(w);
+
+        (void) flush_fd(fd);
+
+        /* The deferred batch has already been taken care of if we paused the writer thread in the meantime */
+        if (w->exclusive)
+                return 0;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        writer_process_deferred(w);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return 0;
+}
+
+static int dispatch_resume_event(sd_event_source *es, void *userdata) {
+        JournalWriter *w = userdata;
+
+        assert(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->paused = false;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        w->exclusive = false;
+
+        return 0;
+}
+
+int journal_writer_new(Server *s, JournalWriter **ret) {
+        _cleanup_(journal_writer_freep) JournalWriter *w = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(ret);
+
+        w = new(JournalWriter, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (JournalWriter) {
+                .server = s,
+                .notify_fd = -1,
+        };
+
+        assert_se(pthread_mutex_init(&w->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&w->cond, NULL) == 0);
+
+        w->notify_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (w->notify_fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(s->event, &w->notify_event_source, w->notify_fd, EPOLLIN, dispatch_notify_event, w);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(w->notify_event_source, "journal-writer-notify");
+
+        r = sd_event_add_defer(s->event, &w->resume_event_source, dispatch_resume_event, w);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(w->resume_event_source, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        /* Resume the writer thread as soon as the main thread is done with the current event */
+        r = sd_event_source_set_priority(w->resume_event_source, SD_EVENT_PRIORITY_IMPORTANT);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(w->resume_event_source, "journal-writer-resume");
+
+        /* Leave all signals to the main thread, except for SIGBUS, which is raised synchronously when a
+         * memory mapped journal file is truncated under us. */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&w->thread, NULL, writer_thread, w);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        w->thread_started = true;
+        *ret = TAKE_PTR(w);
+
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+JournalWriter* journal_writer_free(JournalWriter *w) {
+        JournalWriteBatch *b;
+
+        if (!w)
+                return NULL;
+
+        if (w->thread_started) {
+                /* Write out whatever is still queued, then stop the thread */
+                journal_writer_wait(w);
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+                w->quit = true;
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                assert_se(pthread_join(w->thread, NULL) == 0);
+        }
+
+        while ((b = w->queue)) {
+                LIST_REMOVE(batches, w->queue, b);
+                journal_write_batch_free(b);
+        }
+
+        journal_write_batch_free(w->deferred);
+
+        sd_event_source_disable_unref(w->notify_event_source);
+        sd_event_source_disable_unref(w->resume_event_source);
+        safe_close(w->notify_fd);
+
+        assert_se(pthread_cond_destroy(&w->cond) == 0);
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
+        return mfree(w);
+}
+
+int journal_writer_submit(JournalWriter *w, uid_t uid, const JournalFileEntry *entries, size_t n, int priority) {
+        JournalWriteBatch *b;
+        usec_t stalled = 0;
+        size_t i;
+
+        assert(w);
+        assert(entries);
+        assert(n > 0);
+
+        /* Hands the entries over to the writer thread, which takes ownership of the iovec arrays. Returns 0
+         * if the caller shall write them itself instead, because the main thread currently has exclusive
+         * access to the journal files. */
+
+        if (w->exclusive)
+                return 0;
+
+        b = malloc(offsetof(JournalWriteBatch, entries) + n * sizeof(JournalFileEntry));
+        if (!b)
+                return -ENOMEM;
+
+        *b = (JournalWriteBatch) {
+                .uid = uid,
+                .priority = priority,
+                .n_entries = n,
+        };
+
+        for (i = 0; i < n; i++) {
+                b->entries[i] = (JournalFileEntry) {
+                        .iovec = entries[i].iovec,
+                        .n_iovec = entries[i].n_iovec,
+                };
+
+                b->size += IOVEC_TOTAL_SIZE(entries[i].iovec, entries[i].n_iovec);
+        }
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        /* If the writer thread can't keep up, stop receiving until it has caught up a bit. Only the queue
+         * fill level is limited, i.e. a single oversized batch is still accepted. */
+        while (w->queued_bytes > 0 && w->queued_bytes + b->size > WRITE_QUEUE_BYTES_MAX) {
+                if (stalled == 0)
+                        stalled = now(CLOCK_MONOTONIC);
+
+                if (w->deferred) {
+                        writer_process_deferred(w);
+                        continue;
+                }
+
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+        }
+
+        if (w->queue_tail)
+                LIST_INSERT_AFTER(batches, w->queue, w->queue_tail, b);
+        else
+                LIST_PREPEND(batches, w->queue, b);
+        w->queue_tail = b;
+
+        w->n_queued++;
+        w->queued_bytes += b->size;
+        w->max_queued_bytes = MAX(w->max_queued_bytes, w->queued_bytes);
+
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        if (stalled > 0) {
+                usec_t d = usec_sub_unsigned(now(CLOCK_MONOTONIC), stalled);
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                w->n_stalls++;
+                w->stall_usec = usec_add(w->stall_usec, d);
+
+                log_debug("Write queue was full, stopped receiving messages for %s.",
+                          format_timespan(buf, sizeof(buf), d, 0));
+        }
+
+        return 1;
+}
+
+void journal_writer_wait(JournalWriter *w) {
+        int r;
+
+        assert(w);
+
+        /* Waits until the writer thread wrote out everything queued and pauses it, so that the main thread
+         * may access the journal files until it returns to the event loop. */
+
+        if (w->exclusive)
+                return;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                if (w->deferred) {
+                        writer_process_deferred(w);
+                        continue;
+                }
+
+                if (!w->queue && !w->busy && !w->handling_deferred)
+                        break;
+
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+        }
+
+        w->paused = true;
+        w->exclusive = true;
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        r = sd_event_source_set_enabled(w->resume_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                log_error_errno(r, "Failed to enable writer thread resume event source: %m");
+}
+
+bool journal_writer_is_idle(JournalWriter *w) {
+        bool idle;
+
+        assert(w);
+
+        /* If the writer thread has nothing to do, the main thread may access the journal files until it
+         * submits the next batch. */
+
+        if (w->exclusive)
+                return true;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        idle = !w->queue && !w->busy && !w->deferred && !w->handling_deferred;
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return idle;
+}
+
+int journal_writer_build_json(JournalWriter *w, JsonVariant **ret) {
+        uint64_t written, deferred;
+        size_t queued, queued_bytes;
+
+        assert(w);
+        assert(ret);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        queued = w->n_queued;
+        queued_bytes = w->queued_bytes;
+        written = w->n_batches_written;
+        deferred = w->n_batches_deferred;
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR("threadedWrites", JSON_BUILD_BOOLEAN(true)),
+                                          JSON_BUILD_PAIR("queuedBatches", JSON_BUILD_UNSIGNED(queued)),
+                                          JSON_BUILD_PAIR("queuedBytes", JSON_BUILD_UNSIGNED(queued_bytes)),
+                                          JSON_BUILD_PAIR("maxQueuedBytes", JSON_BUILD_UNSIGNED(w->max_queued_bytes)),
+                                          JSON_BUILD_PAIR("queueLimitBytes", JSON_BUILD_UNSIGNED(WRITE_QUEUE_BYTES_MAX)),
+                                          JSON_BUILD_PAIR("writtenBatches", JSON_BUILD_UNSIGNED(written)),
+                                          JSON_BUILD_PAIR("deferredBatches", JSON_BUILD_UNSIGNED(deferred)),
+                                          JSON_BUILD_PAIR("stalls", JSON_BUILD_UNSIGNED(w->n_stalls)),
+                                          JSON_BUILD_PAIR("stallUSec", JSON_BUILD_UNSIGNED(w->stall_usec))));
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <pthread.h>
+
+typedef struct JournalWriter JournalWriter;
+typedef struct JournalWriteBatch JournalWriteBatch;
+
+#include "json.h"
+#include "journald-server.h"
+#include "list.h"
+
+struct JournalWriteBatch {
+        uid_t uid;
+        int priority;
+        size_t size;
+
+        LIST_FIELDS(JournalWriteBatch, batches);
+
+        size_t n_written;
+        size_t n_entries;
+        JournalFileEntry entries[];
+};
+
+struct JournalWriter {
+        Server *server;
+
+        pthread_t thread;
+        bool thread_started;
+        int notify_fd;
+        sd_event_source *notify_event_source;
+        sd_event_source *resume_event_source;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Protected by the mutex */
+        LIST_HEAD(JournalWriteBatch, queue);
+        JournalWriteBatch *queue_tail;
+        size_t n_queued, queued_bytes;
+        JournalWriteBatch *deferred;   /* Handed back to the main thread, nothing is written until it is done */
+        bool busy:1;
+        bool paused:1;
+        bool handling_deferred:1;
+        bool quit:1;
+        uint64_t n_batches_written, n_batches_deferred;
+
+        /* Only accessed by the main thread */
+        bool exclusive;                /* The writer thread keeps its hands off the journal files */
+        size_t max_queued_bytes;
+        uint64_t n_stalls;
+        usec_t stall_usec;
+};
+
+int journal_writer_new(Server *s, JournalWriter **ret);
+JournalWriter* journal_writer_free(JournalWriter *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalWriter*, journal_writer_free);
+
+int journal_writer_submit(JournalWriter *w, uid_t uid, const JournalFileEntry *entries, size_t n, int priority);
+void journal_writer_wait(JournalWriter *w);
+bool journal_writer_is_idle(JournalWriter *w);
+
+int journal_writer_build_json(JournalWriter *w, JsonVariant **ret);
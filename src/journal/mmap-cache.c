@@ -1,12 +1,15 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 
 #include "alloc-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "format-util.h"
 #include "hashmap.h"
 #include "list.h"
 #include "log.h"
@@ -43,13 +46,25 @@ struct Context {
         unsigned id;
         Window *window;
 
+        /* Geometry of the last window this context was attached to, used to recognize sequential scans */
+        MMapFileDescriptor *last_fd;
+        uint64_t last_offset, last_end;
+
+        unsigned n_sequential;
+        uint64_t window_size;
+
+        unsigned n_hit, n_missed, n_readahead;
+
         LIST_FIELDS(Context, by_window);
 };
 
 struct MMapFileDescriptor {
         MMapCache *cache;
+        unsigned n_ref;
         int fd;
         bool sigbus;
+        bool populate;
+        bool owns_fd; /* set once the fd is shared, see mmap_cache_fd_ref() */
         LIST_HEAD(Window, windows);
 };
 
@@ -59,8 +74,16 @@ struct MMapCache {
 
         unsigned n_hit, n_missed;
 
+        /* Once set, all calls take the lock, so that the cache may be shared between threads */
+        bool thread_safe;
+        pthread_mutex_t lock;
+
         Hashmap *fds;
-        Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
+
+        /* Sets of MMAP_CACHE_MAX_CONTEXTS contexts each, set 0 is always in use */
+        Context **contexts;
+        bool *context_sets_used;
+        unsigned n_context_sets;
 
         LIST_HEAD(Window, unused);
         Window *last_unused;
@@ -71,10 +94,17 @@ struct MMapCache {
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
 # define WINDOW_SIZE (page_size())
+# define WINDOW_SIZE_MIN WINDOW_SIZE
+# define WINDOW_SIZE_MAX WINDOW_SIZE
 #else
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+# define WINDOW_SIZE_MIN (1ULL*1024ULL*1024ULL)
+# define WINDOW_SIZE_MAX (32ULL*1024ULL*1024ULL)
 #endif
 
+/* Number of consecutive sequential misses after which we ask the kernel to read ahead */
+#define SEQUENTIAL_READAHEAD_MIN 2U
+
 MMapCache* mmap_cache_new(void) {
         MMapCache *m;
 
@@ -82,10 +112,49 @@ MMapCache* mmap_cache_new(void) {
         if (!m)
                 return NULL;
 
+        m->contexts = new0(Context*, MMAP_CACHE_MAX_CONTEXTS);
+        m->context_sets_used = new0(bool, 1);
+        if (!m->contexts || !m->context_sets_used) {
+                free(m->contexts);
+                free(m->context_sets_used);
+                return mfree(m);
+        }
+
+        m->context_sets_used[0] = true;
+        m->n_context_sets = 1;
+
         m->n_ref = 1;
         return m;
 }
 
+static void mmap_cache_lock(MMapCache *m) {
+        assert(m);
+
+        if (m->thread_safe)
+                assert_se(pthread_mutex_lock(&m->lock) == 0);
+}
+
+static void mmap_cache_unlock(MMapCache *m) {
+        assert(m);
+
+        if (m->thread_safe)
+                assert_se(pthread_mutex_unlock(&m->lock) == 0);
+}
+
+void mmap_cache_set_thread_safe(MMapCache *m) {
+        assert(m);
+
+        /* This must be called before the cache is shared with another thread, i.e. while the caller is still
+         * the only user. Turning it off again is not supported, as we couldn't know when the other threads
+         * are done with the cache. */
+
+        if (m->thread_safe)
+                return;
+
+        assert_se(pthread_mutex_init(&m->lock, NULL) == 0);
+        m->thread_safe = true;
+}
+
 static void window_unlink(Window *w) {
         Context *c;
 
@@ -235,12 +304,17 @@ static void context_attach_window(Context *c, Window *w) {
 
         c->window = w;
         LIST_PREPEND(by_window, w->contexts, c);
+
+        c->last_fd = w->fd;
+        c->last_offset = w->offset;
+        c->last_end = w->offset + w->size;
 }
 
 static Context *context_add(MMapCache *m, unsigned id) {
         Context *c;
 
         assert(m);
+        assert(id < m->n_context_sets * MMAP_CACHE_MAX_CONTEXTS);
 
         c = m->contexts[id];
         if (c)
@@ -252,6 +326,7 @@ static Context *context_add(MMapCache *m, unsigned id) {
 
         c->cache = m;
         c->id = id;
+        c->window_size = WINDOW_SIZE;
 
         assert(!m->contexts[id]);
         m->contexts[id] = c;
@@ -273,11 +348,11 @@ static void context_free(Context *c) {
 }
 
 static MMapCache *mmap_cache_free(MMapCache *m) {
-        int i;
+        unsigned i;
 
         assert(m);
 
-        for (i = 0; i < MMAP_CACHE_MAX_CONTEXTS; i++)
+        for (i = 0; i < m->n_context_sets * MMAP_CACHE_MAX_CONTEXTS; i++)
                 if (m->contexts[i])
                         context_free(m->contexts[i]);
 
@@ -286,10 +361,111 @@ static MMapCache *mmap_cache_free(MMapCache *m) {
         while (m->unused)
                 window_free(m->unused);
 
+        if (m->thread_safe)
+                assert_se(pthread_mutex_destroy(&m->lock) == 0);
+
+        free(m->contexts);
+        free(m->context_sets_used);
         return mfree(m);
 }
 
-DEFINE_TRIVIAL_REF_UNREF_FUNC(MMapCache, mmap_cache, mmap_cache_free);
+MMapCache* mmap_cache_ref(MMapCache *m) {
+        if (!m)
+                return NULL;
+
+        mmap_cache_lock(m);
+        assert(m->n_ref > 0);
+        m->n_ref++;
+        mmap_cache_unlock(m);
+
+        return m;
+}
+
+MMapCache* mmap_cache_unref(MMapCache *m) {
+        unsigned n;
+
+        if (!m)
+                return NULL;
+
+        mmap_cache_lock(m);
+        assert(m->n_ref > 0);
+        n = --m->n_ref;
+        mmap_cache_unlock(m);
+
+        /* Whoever dropped the last reference is the only one left who knows about the cache */
+        if (n == 0)
+                mmap_cache_free(m);
+
+        return NULL;
+}
+
+int mmap_cache_add_contexts(MMapCache *m, unsigned *ret) {
+        unsigned i;
+        int r = 0;
+
+        assert(m);
+        assert(ret);
+
+        /* Allocates a new set of contexts, for a user that shall not compete with the others for the
+         * windows attached to contexts. Returns the number of the first context of the set, to add to the
+         * usual context ids. */
+
+        mmap_cache_lock(m);
+
+        for (i = 1; i < m->n_context_sets; i++)
+                if (!m->context_sets_used[i])
+                        break;
+
+        if (i >= m->n_context_sets) {
+                Context **contexts;
+                bool *used;
+
+                contexts = reallocarray(m->contexts, (i + 1) * MMAP_CACHE_MAX_CONTEXTS, sizeof(Context*));
+                if (!contexts) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+                m->contexts = contexts;
+
+                used = reallocarray(m->context_sets_used, i + 1, sizeof(bool));
+                if (!used) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+                m->context_sets_used = used;
+
+                memzero(m->contexts + i * MMAP_CACHE_MAX_CONTEXTS, MMAP_CACHE_MAX_CONTEXTS * sizeof(Context*));
+                m->n_context_sets = i + 1;
+        }
+
+        m->context_sets_used[i] = true;
+        *ret = i * MMAP_CACHE_MAX_CONTEXTS;
+
+finish:
+        mmap_cache_unlock(m);
+        return r;
+}
+
+void mmap_cache_free_contexts(MMapCache *m, unsigned first) {
+        unsigned i;
+
+        assert(m);
+        assert(first % MMAP_CACHE_MAX_CONTEXTS == 0);
+
+        mmap_cache_lock(m);
+
+        assert(first > 0);
+        assert(first < m->n_context_sets * MMAP_CACHE_MAX_CONTEXTS);
+        assert(m->context_sets_used[first / MMAP_CACHE_MAX_CONTEXTS]);
+
+        for (i = first; i < first + MMAP_CACHE_MAX_CONTEXTS; i++)
+                if (m->contexts[i])
+                        context_free(m->contexts[i]);
+
+        m->context_sets_used[first / MMAP_CACHE_MAX_CONTEXTS] = false;
+
+        mmap_cache_unlock(m);
+}
 
 static int make_room(MMapCache *m) {
         assert(m);
@@ -418,6 +594,40 @@ static int mmap_try_harder(MMapCache *m, void *addr, MMapFileDescriptor *f, int
         return 0;
 }
 
+static int context_classify_miss(Context *c, MMapFileDescriptor *f, uint64_t offset, size_t size) {
+        assert(c);
+        assert(f);
+
+        /* Figure out whether a miss continues the scan of the last window of this context, and adjust the
+         * window size accordingly: sequential scans (in either direction) get larger windows, so that we
+         * need fewer mmap() calls, while contexts jumping around (for example when bisecting entry arrays)
+         * get smaller ones, so that we don't pin lots of address space for a few objects. Returns > 0 for
+         * forward scans, < 0 for backward scans, and 0 otherwise. */
+
+        if (c->last_fd == f &&
+            offset >= c->last_offset &&
+            offset + size > c->last_end &&
+            offset < c->last_end + c->window_size) {
+
+                c->n_sequential++;
+                c->window_size = MIN(c->window_size * 2, WINDOW_SIZE_MAX);
+                return 1;
+        }
+
+        if (c->last_fd == f &&
+            offset < c->last_offset &&
+            offset + c->window_size >= c->last_offset) {
+
+                c->n_sequential++;
+                c->window_size = MIN(c->window_size * 2, WINDOW_SIZE_MAX);
+                return -1;
+        }
+
+        c->n_sequential = 0;
+        c->window_size = MAX(c->window_size / 2, WINDOW_SIZE_MIN);
+        return 0;
+}
+
 static int add_mmap(
                 MMapCache *m,
                 MMapFileDescriptor *f,
@@ -430,7 +640,8 @@ static int add_mmap(
                 void **ret,
                 size_t *ret_size) {
 
-        uint64_t woffset, wsize;
+        uint64_t woffset, wsize, target;
+        int direction = 0;
         Context *c;
         Window *w;
         void *d;
@@ -442,21 +653,43 @@ static int add_mmap(
         assert(size > 0);
         assert(ret);
 
+        c = context_add(m, context);
+        if (!c)
+                return -ENOMEM;
+
+        c->n_missed++;
+
+        /* Windows that are kept around forever (header, hash tables) are not part of any scan, hence keep
+         * them at the default size and don't let them disturb the access pattern of their context. */
+        if (keep_always)
+                target = WINDOW_SIZE;
+        else {
+                direction = context_classify_miss(c, f, offset, size);
+                target = c->window_size;
+        }
+
         woffset = offset & ~((uint64_t) page_size() - 1ULL);
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        if (wsize < target) {
                 uint64_t delta;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+                if (direction > 0)
+                        /* Scanning forward: place the window so that it starts with the requested object */
+                        delta = 0;
+                else if (direction < 0)
+                        /* Scanning backward: place the window so that it ends with the requested object */
+                        delta = target - wsize;
+                else
+                        delta = PAGE_ALIGN((target - wsize) / 2);
 
-                if (delta > offset)
+                if (delta > woffset)
                         woffset = 0;
                 else
                         woffset -= delta;
 
-                wsize = WINDOW_SIZE;
+                wsize = target;
         }
 
         if (st) {
@@ -471,13 +704,17 @@ static int add_mmap(
                         wsize = PAGE_ALIGN(st->st_size - woffset);
         }
 
-        r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED, woffset, wsize, &d);
+        r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED | (f->populate ? MAP_POPULATE : 0), woffset, wsize, &d);
         if (r < 0)
                 return r;
 
-        c = context_add(m, context);
-        if (!c)
-                goto outofmem;
+        if (direction != 0 && c->n_sequential >= SEQUENTIAL_READAHEAD_MIN && !(prot & PROT_WRITE)) {
+                /* This context is clearly scanning the file, hence tell the kernel so and let it start
+                 * reading in the rest of the window while we process the first objects. */
+                (void) madvise(d, wsize, MADV_SEQUENTIAL);
+                (void) posix_madvise(d, wsize, POSIX_MADV_WILLNEED);
+                c->n_readahead++;
+        }
 
         w = window_add(m, f, prot, keep_always, woffset, wsize, d);
         if (!w)
@@ -496,7 +733,7 @@ outofmem:
         return -ENOMEM;
 }
 
-int mmap_cache_get(
+static int mmap_cache_get_unlocked(
                 MMapCache *m,
                 MMapFileDescriptor *f,
                 int prot,
@@ -515,12 +752,14 @@ int mmap_cache_get(
         assert(f);
         assert(size > 0);
         assert(ret);
-        assert(context < MMAP_CACHE_MAX_CONTEXTS);
+        assert(context < m->n_context_sets * MMAP_CACHE_MAX_CONTEXTS);
 
         /* Check whether the current context is the right one already */
         r = try_context(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
                 m->n_hit++;
+                if (r > 0)
+                        m->contexts[context]->n_hit++;
                 return r;
         }
 
@@ -528,6 +767,8 @@ int mmap_cache_get(
         r = find_mmap(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
                 m->n_hit++;
+                if (r > 0)
+                        m->contexts[context]->n_hit++;
                 return r;
         }
 
@@ -537,16 +778,81 @@ int mmap_cache_get(
         return add_mmap(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
 }
 
+int mmap_cache_get(
+                MMapCache *m,
+                MMapFileDescriptor *f,
+                int prot,
+                unsigned context,
+                bool keep_always,
+                uint64_t offset,
+                size_t size,
+                struct stat *st,
+                void **ret,
+                size_t *ret_size) {
+
+        int r;
+
+        assert(m);
+
+        /* The returned memory stays valid after we dropped the lock, as windows attached to a context are
+         * not unmapped until the context moves on, and each context is only used by one thread. */
+
+        mmap_cache_lock(m);
+        r = mmap_cache_get_unlocked(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
+        mmap_cache_unlock(m);
+
+        return r;
+}
+
 unsigned mmap_cache_get_hit(MMapCache *m) {
+        unsigned n;
+
         assert(m);
 
-        return m->n_hit;
+        mmap_cache_lock(m);
+        n = m->n_hit;
+        mmap_cache_unlock(m);
+
+        return n;
 }
 
 unsigned mmap_cache_get_missed(MMapCache *m) {
+        unsigned n;
+
+        assert(m);
+
+        mmap_cache_lock(m);
+        n = m->n_missed;
+        mmap_cache_unlock(m);
+
+        return n;
+}
+
+void mmap_cache_stats_log_debug(MMapCache *m) {
+        unsigned i;
+
         assert(m);
 
-        return m->n_missed;
+        if (!DEBUG_LOGGING)
+                return;
+
+        mmap_cache_lock(m);
+
+        log_debug("mmap cache statistics: %u hit, %u miss, %u windows", m->n_hit, m->n_missed, m->n_windows);
+
+        for (i = 0; i < m->n_context_sets * MMAP_CACHE_MAX_CONTEXTS; i++) {
+                char buf[FORMAT_BYTES_MAX];
+                Context *c = m->contexts[i];
+
+                if (!c)
+                        continue;
+
+                log_debug("mmap cache context %u: %u hit, %u miss, %u readahead, window size %s",
+                          c->id, c->n_hit, c->n_missed, c->n_readahead,
+                          format_bytes(buf, sizeof(buf), c->window_size));
+        }
+
+        mmap_cache_unlock(m);
 }
 
 static void mmap_cache_process_sigbus(MMapCache *m) {
@@ -612,15 +918,20 @@ static void mmap_cache_process_sigbus(MMapCache *m) {
 }
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f) {
+        bool b;
+
         assert(m);
         assert(f);
 
+        mmap_cache_lock(m);
         mmap_cache_process_sigbus(m);
+        b = f->sigbus;
+        mmap_cache_unlock(m);
 
-        return f->sigbus;
+        return b;
 }
 
-MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
+static MMapFileDescriptor* mmap_cache_add_fd_unlocked(MMapCache *m, int fd) {
         MMapFileDescriptor *f;
         int r;
 
@@ -628,8 +939,10 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         assert(fd >= 0);
 
         f = hashmap_get(m->fds, FD_TO_PTR(fd));
-        if (f)
+        if (f) {
+                f->n_ref++;
                 return f;
+        }
 
         r = hashmap_ensure_allocated(&m->fds, NULL);
         if (r < 0)
@@ -640,6 +953,7 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
                 return NULL;
 
         f->cache = m;
+        f->n_ref = 1;
         f->fd = fd;
 
         r = hashmap_put(m->fds, FD_TO_PTR(fd), f);
@@ -649,10 +963,75 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         return f;
 }
 
+MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
+        MMapFileDescriptor *f;
+
+        assert(m);
+
+        mmap_cache_lock(m);
+        f = mmap_cache_add_fd_unlocked(m, fd);
+        mmap_cache_unlock(m);
+
+        return f;
+}
+
+MMapFileDescriptor* mmap_cache_fd_ref(MMapCache *m, MMapFileDescriptor *f) {
+        MMapFileDescriptor *ret = NULL;
+        int fd;
+
+        assert(m);
+        assert(f);
+
+        /* Takes another reference to the file, for a user that may not keep the fd it was added with open,
+         * i.e. that wants to share the windows with the original user, but not its lifetime. Hence, the
+         * first time this is done, we duplicate the fd and move the file over to the copy, which we own. */
+
+        mmap_cache_lock(m);
+
+        if (!f->owns_fd) {
+                fd = fcntl(f->fd, F_DUPFD_CLOEXEC, 3);
+                if (fd < 0)
+                        goto finish;
+
+                if (hashmap_put(m->fds, FD_TO_PTR(fd), f) < 0) {
+                        safe_close(fd);
+                        goto finish;
+                }
+
+                assert_se(hashmap_remove(m->fds, FD_TO_PTR(f->fd)) == f);
+                f->fd = fd;
+                f->owns_fd = true;
+        }
+
+        f->n_ref++;
+        ret = f;
+
+finish:
+        mmap_cache_unlock(m);
+        return ret;
+}
+
+void mmap_cache_fd_set_populate(MMapFileDescriptor *f, bool b) {
+        assert(f);
+
+        /* Prefault new windows, for files whose contents are going to be read in large parts */
+        mmap_cache_lock(f->cache);
+        f->populate = b;
+        mmap_cache_unlock(f->cache);
+}
+
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f) {
+        unsigned i;
+
         assert(m);
         assert(f);
 
+        mmap_cache_lock(m);
+
+        assert(f->n_ref > 0);
+        if (--f->n_ref > 0)
+                goto finish;
+
         /* Make sure that any queued SIGBUS are first dispatched, so
          * that we don't end up with a SIGBUS entry we cannot relate
          * to any existing memory map */
@@ -662,8 +1041,20 @@ void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f) {
         while (f->windows)
                 window_free(f->windows);
 
+        /* Forget about the access pattern on this file, so that a new file reusing the same address is
+         * not mistaken for a continuation of the scan */
+        for (i = 0; i < m->n_context_sets * MMAP_CACHE_MAX_CONTEXTS; i++)
+                if (m->contexts[i] && m->contexts[i]->last_fd == f)
+                        m->contexts[i]->last_fd = NULL;
+
         if (f->cache)
                 assert_se(hashmap_remove(f->cache->fds, FD_TO_PTR(f->fd)));
 
+        if (f->owns_fd)
+                safe_close(f->fd);
+
         free(f);
+
+finish:
+        mmap_cache_unlock(m);
 }
@@ -4,8 +4,9 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 
-/* One context per object type, plus one of the header, plus one "additional" one */
-#define MMAP_CACHE_MAX_CONTEXTS 9
+/* One context per object type, plus one of the header, plus one "additional" one. Users that need their own
+ * contexts allocate further sets of this many with mmap_cache_add_contexts(). */
+#define MMAP_CACHE_MAX_CONTEXTS 12
 
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
@@ -13,6 +14,10 @@ typedef struct MMapFileDescriptor MMapFileDescriptor;
 MMapCache* mmap_cache_new(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
+void mmap_cache_set_thread_safe(MMapCache *m);
+
+int mmap_cache_add_contexts(MMapCache *m, unsigned *ret);
+void mmap_cache_free_contexts(MMapCache *m, unsigned first);
 
 int mmap_cache_get(
         MMapCache *m,
@@ -26,9 +31,12 @@ int mmap_cache_get(
         void **ret,
         size_t *ret_size);
 MMapFileDescriptor * mmap_cache_add_fd(MMapCache *m, int fd);
+MMapFileDescriptor * mmap_cache_fd_ref(MMapCache *m, MMapFileDescriptor *f);
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f);
+void mmap_cache_fd_set_populate(MMapFileDescriptor *f, bool b);
 
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
+void mmap_cache_stats_log_debug(MMapCache *m);
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f);
@@ -31,10 +31,12 @@
 #include "journal-internal.h"
 #include "list.h"
 #include "lookup3.h"
+#include "memory-util.h"
 #include "nulstr-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "replace-var.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -51,6 +53,22 @@
 
 #define DEFAULT_DATA_THRESHOLD (64*1024)
 
+/* Budget for decompressed DATA objects we keep around, as the same few compressed objects (think _CMDLINE=)
+ * are usually referenced by a large share of the entries */
+#define DEFAULT_DATA_CACHE_MAX (4*1024*1024)
+
+typedef struct DataCacheKey {
+        JournalFile *file;
+        uint64_t offset;
+} DataCacheKey;
+
+typedef struct DataCacheEntry {
+        DataCacheKey key;
+        size_t size;
+        bool complete; /* false if decompression stopped at the data threshold */
+        uint8_t data[];
+} DataCacheEntry;
+
 static void remove_file_real(sd_journal *j, JournalFile *f);
 
 static bool journal_pid_changed(sd_journal *j) {
@@ -62,6 +80,160 @@ static bool journal_pid_changed(sd_journal *j) {
         return j->original_pid != getpid_cached();
 }
 
+static void data_cache_key_hash_func(const DataCacheKey *k, struct siphash *state) {
+        siphash24_compress(&k->file, sizeof(k->file), state);
+        siphash24_compress(&k->offset, sizeof(k->offset), state);
+}
+
+static int data_cache_key_compare_func(const DataCacheKey *a, const DataCacheKey *b) {
+        int r;
+
+        r = CMP(a->file, b->file);
+        if (r != 0)
+                return r;
+
+        return CMP(a->offset, b->offset);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(data_cache_hash_ops, DataCacheKey, data_cache_key_hash_func, data_cache_key_compare_func,
+                                              DataCacheEntry, free);
+
+static void data_cache_remove(sd_journal *j, DataCacheEntry *e) {
+        assert(j);
+        assert(e);
+
+        assert_se(ordered_hashmap_remove(j->data_cache, &e->key) == e);
+        assert(j->data_cache_size >= e->size);
+        j->data_cache_size -= e->size;
+        free(e);
+}
+
+static void data_cache_trim(sd_journal *j, size_t max) {
+        DataCacheEntry *e;
+
+        assert(j);
+
+        /* The least recently used entries are at the front */
+        while (j->data_cache_size > max && (e = ordered_hashmap_first(j->data_cache)))
+                data_cache_remove(j, e);
+}
+
+static void data_cache_flush_file(sd_journal *j, JournalFile *f) {
+        DataCacheEntry *e;
+
+        assert(j);
+        assert(f);
+
+        ORDERED_HASHMAP_FOREACH(e, j->data_cache)
+                if (e->key.file == f)
+                        data_cache_remove(j, e);
+}
+
+static DataCacheEntry* data_cache_get(sd_journal *j, JournalFile *f, uint64_t offset) {
+        DataCacheKey k = {
+                .file = f,
+                .offset = offset,
+        };
+        DataCacheEntry *e;
+
+        assert(j);
+
+        e = ordered_hashmap_get(j->data_cache, &k);
+        if (!e)
+                return NULL;
+
+        /* An entry that was cut short only helps if we are still fine with that */
+        if (!e->complete && (j->data_threshold <= 0 || j->data_threshold > e->size)) {
+                data_cache_remove(j, e);
+                return NULL;
+        }
+
+        /* Move it to the back, as the most recently used one. This can't fail, as we just made room. */
+        assert_se(ordered_hashmap_remove(j->data_cache, &e->key) == e);
+        assert_se(ordered_hashmap_put(j->data_cache, &e->key, e) >= 0);
+
+        j->data_cache_hits++;
+        return e;
+}
+
+static DataCacheEntry* data_cache_add(sd_journal *j, JournalFile *f, uint64_t offset, const void *data, size_t size) {
+        DataCacheEntry *e;
+
+        assert(j);
+        assert(f);
+        assert(data || size == 0);
+
+        j->data_cache_misses++;
+
+        /* Don't let a single object flush everything else */
+        if (j->data_cache_max <= 0 || size > j->data_cache_max / 4)
+                return NULL;
+
+        if (ordered_hashmap_ensure_allocated(&j->data_cache, &data_cache_hash_ops) < 0)
+                return NULL;
+
+        data_cache_trim(j, j->data_cache_max - size);
+
+        e = malloc(offsetof(DataCacheEntry, data) + size);
+        if (!e)
+                return NULL;
+
+        *e = (DataCacheEntry) {
+                .key.file = f,
+                .key.offset = offset,
+                .size = size,
+                .complete = j->data_threshold <= 0 || size < j->data_threshold,
+        };
+        memcpy_safe(e->data, data, size);
+
+        if (ordered_hashmap_put(j->data_cache, &e->key, e) < 0)
+                return mfree(e);
+
+        j->data_cache_size += size;
+        return e;
+}
+
+static int decompress_data(
+                sd_journal *j,
+                JournalFile *f,
+                Object *o,
+                uint64_t offset,
+                uint64_t l,
+                const void **ret_data,
+                size_t *ret_size) {
+
+        DataCacheEntry *e;
+        size_t rsize;
+        int r;
+
+        assert(j);
+        assert(f);
+        assert(o);
+        assert(ret_data);
+        assert(ret_size);
+
+        e = data_cache_get(j, f, offset);
+        if (!e) {
+                r = journal_file_decompress_blob(f, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                 o->data.payload, l, &f->compress_buffer,
+                                                 &f->compress_buffer_size, &rsize, j->data_threshold);
+                if (r < 0)
+                        return r;
+
+                /* If we can't cache this, just return the decompression buffer */
+                e = data_cache_add(j, f, offset, f->compress_buffer, rsize);
+                if (!e) {
+                        *ret_data = f->compress_buffer;
+                        *ret_size = rsize;
+                        return 0;
+                }
+        }
+
+        *ret_data = e->data;
+        *ret_size = e->size;
+        return 0;
+}
+
 static int journal_put_error(sd_journal *j, int r, const char *path) {
         char *copy;
         int k;
@@ -111,6 +283,8 @@ static void detach_location(sd_journal *j) {
 
         j->current_file = NULL;
         j->current_field = 0;
+        j->files_heap_valid = false;
+        j->batch_pending = false;
 
         ORDERED_HASHMAP_FOREACH(f, j->files)
                 journal_file_reset_location(f);
@@ -422,6 +596,77 @@ char *journal_make_match_string(sd_journal *j) {
         return match_make_string(j->level0);
 }
 
+void journal_set_realtime_window(sd_journal *j, usec_t since, usec_t until) {
+        assert(j);
+
+        /* Files whose entries all lie outside of [since, until] are ignored from now on. This is merely an
+         * optimization for callers that filter out entries outside of the window anyway. */
+
+        j->realtime_window_since = since;
+        j->realtime_window_until = until;
+
+        detach_location(j);
+}
+
+static Match *match_copy(Match *p, const Match *m, const sd_journal *from, sd_journal *to) {
+        Match *c, *i;
+
+        assert(m);
+        assert(from);
+        assert(to);
+
+        c = match_new(p, m->type);
+        if (!c)
+                return NULL;
+
+        if (m->type == MATCH_DISCRETE) {
+                c->data = memdup(m->data, m->size);
+                if (!c->data) {
+                        match_free(c);
+                        return NULL;
+                }
+
+                c->size = m->size;
+                c->hash = m->hash;
+        }
+
+        /* match_new() prepends, hence walk the children back to front to retain their order */
+        LIST_FIND_TAIL(matches, m->matches, i);
+        for (; i; i = i->matches_prev)
+                if (!match_copy(c, i, from, to)) {
+                        match_free(c);
+                        return NULL;
+                }
+
+        if (m == from->level1)
+                to->level1 = c;
+        else if (m == from->level2)
+                to->level2 = c;
+
+        return c;
+}
+
+int journal_copy_matches(sd_journal *to, sd_journal *from) {
+        assert(to);
+        assert(from);
+
+        /* Replaces the matches of 'to' by a deep copy of the ones of 'from'. 'from' is only read, hence this
+         * may be called for multiple target objects in parallel. */
+
+        sd_journal_flush_matches(to);
+
+        if (!from->level0)
+                return 0;
+
+        to->level0 = match_copy(NULL, from->level0, from, to);
+        if (!to->level0) {
+                to->level1 = to->level2 = NULL;
+                return -ENOMEM;
+        }
+
+        return 0;
+}
+
 _public_ void sd_journal_flush_matches(sd_journal *j) {
         if (!j)
                 return;
@@ -484,6 +729,42 @@ _pure_ static int compare_with_location(const JournalFile *f, const Location *l,
         return 0;
 }
 
+int journal_compare_locations(const Location *a, const Location *b) {
+        int r;
+
+        assert(a);
+        assert(b);
+        assert(a->type == LOCATION_DISCRETE);
+        assert(b->type == LOCATION_DISCRETE);
+
+        /* Orders two entry locations the same way journal_file_compare_locations() orders the current
+         * entries of two files, i.e. the way sd_journal_next() interleaves files. */
+
+        if (sd_id128_equal(a->boot_id, b->boot_id) &&
+            a->monotonic == b->monotonic &&
+            a->realtime == b->realtime &&
+            a->xor_hash == b->xor_hash)
+                return 0;
+
+        if (sd_id128_equal(a->seqnum_id, b->seqnum_id)) {
+                r = CMP(a->seqnum, b->seqnum);
+                if (r != 0)
+                        return r;
+        }
+
+        if (sd_id128_equal(a->boot_id, b->boot_id)) {
+                r = CMP(a->monotonic, b->monotonic);
+                if (r != 0)
+                        return r;
+        }
+
+        r = CMP(a->realtime, b->realtime);
+        if (r != 0)
+                return r;
+
+        return CMP(a->xor_hash, b->xor_hash);
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -605,6 +886,11 @@ static int find_location_for_match(
                 else
                         hash = m->hash;
 
+                /* Archived files carry a summary of their data objects, which allows us to reject them
+                 * without walking the data hash table */
+                if (journal_file_bloom_filter_test(f, hash) == 0)
+                        return 0;
+
                 r = journal_file_find_data_object_with_hash(f, m->data, m->size, hash, NULL, &dp);
                 if (r <= 0)
                         return r;
@@ -687,6 +973,45 @@ static int find_location_for_match(
         }
 }
 
+static bool file_may_match_location(sd_journal *j, JournalFile *f, direction_t direction) {
+        const Location *l;
+        uint64_t head, tail;
+
+        assert(j);
+        assert(f);
+
+        /* Checks the entry ranges recorded in the file header against the location we are looking for and
+         * the realtime window we are restricted to, so that files which cannot possibly contain a candidate
+         * entry are skipped without bisecting their entry arrays (or even faulting them in). Note that this
+         * only relies on the header, hence files that are still being written to are checked again once they
+         * grew. */
+
+        if (le64toh(f->header->n_entries) <= 0)
+                return false;
+
+        head = le64toh(f->header->head_entry_realtime);
+        tail = le64toh(f->header->tail_entry_realtime);
+
+        if (tail < j->realtime_window_since || head > j->realtime_window_until)
+                return false;
+
+        l = &j->current_location;
+        if (!IN_SET(l->type, LOCATION_DISCRETE, LOCATION_SEEK))
+                return true;
+
+        if (l->seqnum_set && sd_id128_equal(l->seqnum_id, f->header->seqnum_id))
+                return direction == DIRECTION_DOWN ?
+                        le64toh(f->header->tail_entry_seqnum) >= l->seqnum :
+                        le64toh(f->header->head_entry_seqnum) <= l->seqnum;
+
+        /* If a monotonic timestamp is set it takes precedence over the realtime one, and we cannot say
+         * anything about that from the header alone. */
+        if (l->monotonic_set || !l->realtime_set)
+                return true;
+
+        return direction == DIRECTION_DOWN ? tail >= l->realtime : head <= l->realtime;
+}
+
 static int find_location_with_matches(
                 sd_journal *j,
                 JournalFile *f,
@@ -701,6 +1026,9 @@ static int find_location_with_matches(
         assert(ret);
         assert(offset);
 
+        if (!file_may_match_location(j, f, direction))
+                return 0;
+
         if (!j->level0) {
                 /* No matches is simple */
 
@@ -748,6 +1076,39 @@ static int next_with_matches(
                               direction, ret, offset);
 }
 
+static int clip_to_snapshot(
+                sd_journal *j,
+                JournalFile *f,
+                direction_t direction,
+                int r,
+                Object **c,
+                uint64_t *cp) {
+
+        assert(j);
+        assert(f);
+
+        /* Entries are appended in order of their offsets, hence anything beyond the last entry of a frozen
+         * file was added after the snapshot was taken. Going down, there is nothing more to be found then,
+         * going up we continue from the last entry of the snapshot. */
+
+        if (r <= 0 || !f->frozen || *cp <= f->frozen_tail_entry_offset)
+                return r;
+
+        if (direction == DIRECTION_DOWN || f->frozen_tail_entry_offset == 0)
+                return 0;
+
+        if (!j->level0) {
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, f->frozen_tail_entry_offset, c);
+                if (r < 0)
+                        return r;
+
+                *cp = f->frozen_tail_entry_offset;
+                return 1;
+        }
+
+        return next_for_match(j, j->level0, f, f->frozen_tail_entry_offset, DIRECTION_UP, c, cp);
+}
+
 static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direction) {
         Object *c;
         uint64_t cp, n_entries;
@@ -756,7 +1117,7 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         assert(j);
         assert(f);
 
-        n_entries = le64toh(f->header->n_entries);
+        n_entries = journal_file_n_entries(f);
 
         /* If we hit EOF before, we don't need to look into this file again
          * unless direction changed or new entries appeared. */
@@ -772,6 +1133,7 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
                  * candidate entry. */
                 if (f->location_type != LOCATION_SEEK) {
                         r = next_with_matches(j, f, direction, &c, &cp);
+                        r = clip_to_snapshot(j, f, direction, r, &c, &cp);
                         if (r <= 0)
                                 return r;
 
@@ -781,6 +1143,7 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
                 f->last_direction = direction;
 
                 r = find_location_with_matches(j, f, direction, &c, &cp);
+                r = clip_to_snapshot(j, f, direction, r, &c, &cp);
                 if (r <= 0)
                         return r;
 
@@ -809,6 +1172,7 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
                         return 1;
 
                 r = next_with_matches(j, f, direction, &c, &cp);
+                r = clip_to_snapshot(j, f, direction, r, &c, &cp);
                 if (r <= 0)
                         return r;
 
@@ -816,75 +1180,178 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
-        unsigned i, n_files;
-        const void **files;
-        Object *o;
-        int r;
+static int files_heap_compare_down(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) a, (JournalFile*) b);
+}
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+static int files_heap_compare_up(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) b, (JournalFile*) a);
+}
 
-        r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
-        if (r < 0)
-                return r;
+static void files_heap_remove(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
 
-        for (i = 0; i < n_files; i++) {
-                JournalFile *f = (JournalFile *)files[i];
-                bool found;
+        (void) prioq_remove(j->files_heap, f, &f->files_heap_idx);
+        f->files_heap_idx = PRIOQ_IDX_NULL;
+}
 
-                r = next_beyond_location(j, f, direction);
-                if (r < 0) {
-                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
-                        remove_file_real(j, f);
-                        continue;
-                } else if (r == 0) {
-                        f->location_type = LOCATION_TAIL;
-                        continue;
-                }
+static int files_heap_update(sd_journal *j, JournalFile *f, direction_t direction) {
+        int r;
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+        assert(j);
+        assert(f);
 
-                        k = journal_file_compare_locations(f, new_file);
+        /* Moves f to its next candidate entry beyond the current location, and (re-)positions it in the heap
+         * accordingly. If there is no such entry the file is dropped from the heap, but remembered for
+         * probing again if more entries might still be appended to it. */
+
+        r = next_beyond_location(j, f, direction);
+        if (r < 0) {
+                log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                remove_file_real(j, f);
+                return 0;
+        }
+        if (r == 0) {
+                f->location_type = LOCATION_TAIL;
+                files_heap_remove(j, f);
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
+                if (f->header->state == STATE_ARCHIVED) {
+                        set_remove(j->files_probe, f);
+                        return 0;
                 }
 
-                if (found)
-                        new_file = f;
-        }
+                r = set_put(j->files_probe, f);
+                if (r < 0)
+                        return r;
 
-        if (!new_file)
                 return 0;
+        }
 
-        r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
+        if (prioq_reshuffle(j->files_heap, f, &f->files_heap_idx) == 0) {
+                r = prioq_put(j->files_heap, f, &f->files_heap_idx);
+                if (r < 0)
+                        return r;
+        }
+
+        set_remove(j->files_probe, f);
+        return 1;
+}
+
+static int files_heap_rebuild(sd_journal *j, direction_t direction) {
+        unsigned i, n_files;
+        const void **files;
+        int r;
+
+        assert(j);
+
+        /* Looks at every file from scratch, and builds a new heap from those that have a candidate entry in
+         * the specified direction. */
+
+        j->files_heap_valid = false;
+        j->files_heap = prioq_free(j->files_heap);
+        set_clear(j->files_probe);
+
+        j->files_heap = prioq_new(direction == DIRECTION_DOWN ? files_heap_compare_down : files_heap_compare_up);
+        if (!j->files_heap)
+                return -ENOMEM;
+
+        r = set_ensure_allocated(&j->files_probe, NULL);
         if (r < 0)
                 return r;
 
-        set_location(j, new_file, o);
+        r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
+        if (r < 0)
+                return r;
 
-        return 1;
-}
+        for (i = 0; i < n_files; i++) {
+                JournalFile *f = (JournalFile *)files[i];
 
-_public_ int sd_journal_next(sd_journal *j) {
-        return real_journal_next(j, DIRECTION_DOWN);
-}
+                f->files_heap_idx = PRIOQ_IDX_NULL;
 
-_public_ int sd_journal_previous(sd_journal *j) {
-        return real_journal_next(j, DIRECTION_UP);
+                r = files_heap_update(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        j->files_heap_direction = direction;
+        j->files_heap_valid = true;
+
+        return 0;
 }
 
-static int real_journal_next_skip(sd_journal *j, direction_t direction, uint64_t skip) {
-        int c = 0, r;
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *new_file, *f;
+        Object *o;
+        int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
-        if (skip == 0) {
+        j->batch_pending = false;
+
+        if (!j->files_heap_valid || j->files_heap_direction != direction) {
+                r = files_heap_rebuild(j, direction);
+                if (r < 0)
+                        return r;
+        } else
+                SET_FOREACH(f, j->files_probe) {
+                        r = files_heap_update(j, f, direction);
+                        if (r < 0)
+                                goto fail;
+                }
+
+        for (;;) {
+                new_file = prioq_peek(j->files_heap);
+                if (!new_file)
+                        return 0;
+
+                /* The heap is ordered by the candidate entries the files had when they were last looked at,
+                 * but the current location moved on since. Re-check the topmost file, as its candidate might be
+                 * the very entry we just returned from another file, and needs to be skipped then. */
+                r = files_heap_update(j, new_file, direction);
+                if (r < 0)
+                        goto fail;
+
+                if (prioq_peek(j->files_heap) == new_file)
+                        break;
+        }
+
+        r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        /* The candidate of this file is consumed now, hence take it out of the heap until it is advanced
+         * on the next step. */
+        r = set_put(j->files_probe, new_file);
+        if (r < 0)
+                goto fail;
+
+        files_heap_remove(j, new_file);
+        set_location(j, new_file, o);
+
+        return 1;
+
+fail:
+        j->files_heap_valid = false;
+        return r;
+}
+
+_public_ int sd_journal_next(sd_journal *j) {
+        return real_journal_next(j, DIRECTION_DOWN);
+}
+
+_public_ int sd_journal_previous(sd_journal *j) {
+        return real_journal_next(j, DIRECTION_UP);
+}
+
+static int real_journal_next_skip(sd_journal *j, direction_t direction, uint64_t skip) {
+        int c = 0, r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        if (skip == 0) {
                 /* If this is not a discrete skip, then at least
                  * resolve the current location */
                 if (j->current_location.type != LOCATION_DISCRETE) {
@@ -919,14 +1386,13 @@ _public_ int sd_journal_previous_skip(sd_journal *j, uint64_t skip) {
         return real_journal_next_skip(j, DIRECTION_UP, skip);
 }
 
-_public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
+_public_ int sd_journal_get_cursor_binary(sd_journal *j, sd_journal_cursor *ret) {
         Object *o;
         int r;
-        char bid[SD_ID128_STRING_MAX], sid[SD_ID128_STRING_MAX];
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
-        assert_return(cursor, -EINVAL);
+        assert_return(ret, -EINVAL);
 
         if (!j->current_file || j->current_file->current_offset <= 0)
                 return -EADDRNOTAVAIL;
@@ -935,20 +1401,53 @@ _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
         if (r < 0)
                 return r;
 
-        sd_id128_to_string(j->current_file->header->seqnum_id, sid);
-        sd_id128_to_string(o->entry.boot_id, bid);
+        *ret = (sd_journal_cursor) {
+                .seqnum_id = j->current_file->header->seqnum_id,
+                .seqnum = le64toh(o->entry.seqnum),
+                .boot_id = o->entry.boot_id,
+                .monotonic = le64toh(o->entry.monotonic),
+                .realtime = le64toh(o->entry.realtime),
+                .xor_hash = le64toh(o->entry.xor_hash),
+        };
+
+        return 0;
+}
+
+_public_ int sd_journal_cursor_to_string(const sd_journal_cursor *c, char **ret) {
+        char bid[SD_ID128_STRING_MAX], sid[SD_ID128_STRING_MAX];
+
+        assert_return(c, -EINVAL);
+        assert_return(ret, -EINVAL);
 
-        if (asprintf(cursor,
+        sd_id128_to_string(c->seqnum_id, sid);
+        sd_id128_to_string(c->boot_id, bid);
+
+        if (asprintf(ret,
                      "s=%s;i=%"PRIx64";b=%s;m=%"PRIx64";t=%"PRIx64";x=%"PRIx64,
-                     sid, le64toh(o->entry.seqnum),
-                     bid, le64toh(o->entry.monotonic),
-                     le64toh(o->entry.realtime),
-                     le64toh(o->entry.xor_hash)) < 0)
+                     sid, c->seqnum,
+                     bid, c->monotonic,
+                     c->realtime,
+                     c->xor_hash) < 0)
                 return -ENOMEM;
 
         return 0;
 }
 
+_public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
+        sd_journal_cursor c;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(cursor, -EINVAL);
+
+        r = sd_journal_get_cursor_binary(j, &c);
+        if (r < 0)
+                return r;
+
+        return sd_journal_cursor_to_string(&c, cursor);
+}
+
 _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
         unsigned long long seqnum, monotonic, realtime, xor_hash;
         bool seqnum_id_set = false,
@@ -1347,6 +1846,16 @@ static int add_any_file(
 
         /* journal_file_dump(f); */
 
+        if (j->flags & SD_JOURNAL_SNAPSHOT) {
+                r = journal_file_freeze(f);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to freeze journal file %s: %m", path);
+                        f->close_fd = false; /* see below */
+                        (void) journal_file_close(f);
+                        goto finish;
+                }
+        }
+
         r = ordered_hashmap_put(j->files, f->path, f);
         if (r < 0) {
                 f->close_fd = false; /* make sure journal_file_close() doesn't close the caller's fd (or our own). We'll let the caller do that, or ourselves */
@@ -1361,6 +1870,9 @@ static int add_any_file(
         track_file_disposition(j, f);
         check_network(j, f->fd);
 
+        /* The new file needs to be positioned relative to the current location first, let's hence start
+         * from scratch with the heap on the next step. */
+        j->files_heap_valid = false;
         j->current_invalidate_counter++;
 
         log_debug("File %s added.", f->path);
@@ -1429,6 +1941,10 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
 
         log_debug("File %s removed.", f->path);
 
+        files_heap_remove(j, f);
+        set_remove(j->files_probe, f);
+        data_cache_flush_file(j, f);
+
         if (j->current_file == f) {
                 j->current_file = NULL;
                 j->current_field = 0;
@@ -1901,6 +2417,8 @@ static sd_journal *journal_new(int flags, const char *path, const char *namespac
         j->inotify_fd = -1;
         j->flags = flags;
         j->data_threshold = DEFAULT_DATA_THRESHOLD;
+        j->data_cache_max = DEFAULT_DATA_CACHE_MAX;
+        j->realtime_window_until = USEC_INFINITY;
 
         if (path) {
                 char *t;
@@ -1934,13 +2452,24 @@ static sd_journal *journal_new(int flags, const char *path, const char *namespac
         return TAKE_PTR(j);
 }
 
+static void journal_finish_open(sd_journal *j) {
+        assert(j);
+
+        /* A snapshot consists of the files found when opening, as they were then */
+        if (j->flags & SD_JOURNAL_SNAPSHOT) {
+                j->no_new_files = true;
+                j->no_inotify = true;
+        }
+}
+
 #define OPEN_ALLOWED_FLAGS                              \
         (SD_JOURNAL_LOCAL_ONLY |                        \
          SD_JOURNAL_RUNTIME_ONLY |                      \
          SD_JOURNAL_SYSTEM |                            \
          SD_JOURNAL_CURRENT_USER |                      \
          SD_JOURNAL_ALL_NAMESPACES |                    \
-         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE)
+         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE |         \
+         SD_JOURNAL_SNAPSHOT)
 
 _public_ int sd_journal_open_namespace(sd_journal **ret, const char *namespace, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -1957,6 +2486,8 @@ _public_ int sd_journal_open_namespace(sd_journal **ret, const char *namespace,
         if (r < 0)
                 return r;
 
+        journal_finish_open(j);
+
         *ret = TAKE_PTR(j);
         return 0;
 }
@@ -2010,7 +2541,8 @@ _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, in
 
 #define OPEN_DIRECTORY_ALLOWED_FLAGS                    \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SNAPSHOT)
 
 _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2031,6 +2563,8 @@ _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int f
         if (r < 0)
                 return r;
 
+        journal_finish_open(j);
+
         *ret = TAKE_PTR(j);
         return 0;
 }
@@ -2041,7 +2575,7 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
         int r;
 
         assert_return(ret, -EINVAL);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~SD_JOURNAL_SNAPSHOT) == 0, -EINVAL);
 
         j = journal_new(flags, NULL, NULL);
         if (!j)
@@ -2054,6 +2588,7 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
         }
 
         j->no_new_files = true;
+        journal_finish_open(j);
 
         *ret = TAKE_PTR(j);
         return 0;
@@ -2061,7 +2596,8 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
 
 #define OPEN_DIRECTORY_FD_ALLOWED_FLAGS         \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_SNAPSHOT)
 
 _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2091,6 +2627,8 @@ _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         if (r < 0)
                 return r;
 
+        journal_finish_open(j);
+
         *ret = TAKE_PTR(j);
         return 0;
 }
@@ -2103,7 +2641,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
 
         assert_return(ret, -EINVAL);
         assert_return(n_fds > 0, -EBADF);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~SD_JOURNAL_SNAPSHOT) == 0, -EINVAL);
 
         j = journal_new(flags, NULL, NULL);
         if (!j)
@@ -2133,6 +2671,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
 
         j->no_new_files = true;
         j->no_inotify = true;
+        journal_finish_open(j);
 
         *ret = TAKE_PTR(j);
         return 0;
@@ -2146,6 +2685,65 @@ fail:
         return r;
 }
 
+_public_ int sd_journal_open_shared(sd_journal **ret, sd_journal *j, int flags) {
+        _cleanup_(sd_journal_closep) sd_journal *n = NULL;
+        JournalFile *f;
+        int r;
+
+        assert_return(ret, -EINVAL);
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(flags == 0, -EINVAL);
+
+        /* Opens the files j has open right now once more, sharing their memory maps, i.e. the pages of the
+         * header, hash tables and objects that were mapped already are not mapped again. The new object
+         * is otherwise independent of j: it has its own location, matches and caches, and it may be used
+         * from another thread than j, and may be closed before or after j. */
+
+        n = journal_new(j->flags, NULL, NULL);
+        if (!n)
+                return -ENOMEM;
+
+        /* From now on the mmap cache is used by more than one thread */
+        mmap_cache_set_thread_safe(j->mmap);
+
+        mmap_cache_unref(n->mmap);
+        n->mmap = mmap_cache_ref(j->mmap);
+
+        r = mmap_cache_add_contexts(n->mmap, &n->mmap_contexts);
+        if (r < 0)
+                return r;
+
+        ORDERED_HASHMAP_FOREACH(f, j->files) {
+                _cleanup_(journal_file_closep) JournalFile *g = NULL;
+
+                r = journal_file_open_shared(f, n->mmap_contexts, &g);
+                if (r < 0)
+                        return r;
+
+                r = ordered_hashmap_put(n->files, g->path, g);
+                if (r < 0)
+                        return r;
+
+                g->last_seen_generation = n->generation;
+                TAKE_PTR(g);
+        }
+
+        n->on_network = j->on_network;
+        n->has_runtime_files = j->has_runtime_files;
+        n->has_persistent_files = j->has_persistent_files;
+        n->data_threshold = j->data_threshold;
+        n->data_cache_max = j->data_cache_max;
+
+        /* The set of files is the one of j at the time of the call */
+        n->no_new_files = true;
+        n->no_inotify = true;
+        journal_finish_open(n);
+
+        *ret = TAKE_PTR(n);
+        return 0;
+}
+
 _public_ void sd_journal_close(sd_journal *j) {
         Directory *d;
 
@@ -2154,6 +2752,15 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        if (j->data_cache_hits + j->data_cache_misses > 0)
+                log_debug("Data cache: %"PRIu64" hits, %"PRIu64" misses, %u objects (%zu bytes) cached.",
+                          j->data_cache_hits, j->data_cache_misses,
+                          ordered_hashmap_size(j->data_cache), j->data_cache_size);
+        ordered_hashmap_free(j->data_cache);
+
+        prioq_free(j->files_heap);
+        set_free(j->files_probe);
+
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
         iterated_cache_free(j->files_cache);
 
@@ -2169,7 +2776,10 @@ _public_ void sd_journal_close(sd_journal *j) {
         safe_close(j->inotify_fd);
 
         if (j->mmap) {
-                log_debug("mmap cache statistics: %u hit, %u miss", mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap));
+                if (j->mmap_contexts > 0)
+                        mmap_cache_free_contexts(j->mmap, j->mmap_contexts);
+
+                mmap_cache_stats_log_debug(j->mmap);
                 mmap_cache_unref(j->mmap);
         }
 
@@ -2180,6 +2790,7 @@ _public_ void sd_journal_close(sd_journal *j) {
         free(j->namespace);
         free(j->unique_field);
         free(j->fields_buffer);
+        free(j->batch_fields);
         free(j);
 }
 
@@ -2321,29 +2932,32 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
 #if HAVE_COMPRESSION
-                        r = decompress_startswith(compression,
-                                                  o->data.payload, l,
-                                                  &f->compress_buffer, &f->compress_buffer_size,
-                                                  field, field_length, '=');
-                        if (r < 0)
-                                log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
-                                                object_compressed_to_string(compression), l, p);
-                        else if (r > 0) {
+                        DataCacheEntry *e;
 
-                                size_t rsize;
+                        /* If we decompressed this one before anyway, checking the field name is cheap */
+                        e = data_cache_get(j, f, p);
+                        if (e) {
+                                if (e->size >= field_length+1 &&
+                                    memcmp(e->data, field, field_length) == 0 &&
+                                    e->data[field_length] == '=') {
 
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
-                                if (r < 0)
-                                        return r;
+                                        *data = e->data;
+                                        *size = e->size;
 
-                                *data = f->compress_buffer;
-                                *size = (size_t) rsize;
+                                        return 0;
+                                }
 
-                                return 0;
-                        }
+                                r = 0;
+                        } else
+                                r = journal_file_decompress_startswith(f, compression,
+                                                                       o->data.payload, l,
+                                                                       &f->compress_buffer, &f->compress_buffer_size,
+                                                                       field, field_length, '=');
+                        if (r < 0)
+                                log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
+                                                object_compressed_to_string(compression), l, p);
+                        else if (r > 0)
+                                return decompress_data(j, f, o, p, l, data, size);
 #else
                         return -EPROTONOSUPPORT;
 #endif
@@ -2370,7 +2984,7 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         return -ENOENT;
 }
 
-static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
+static int return_data(sd_journal *j, JournalFile *f, Object *o, uint64_t offset, const void **data, size_t *size) {
         size_t t;
         uint64_t l;
         int compression;
@@ -2388,17 +3002,11 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
         compression = o->object.flags & OBJECT_COMPRESSION_MASK;
         if (compression) {
 #if HAVE_COMPRESSION
-                size_t rsize;
                 int r;
 
-                r = decompress_blob(compression,
-                                    o->data.payload, l, &f->compress_buffer,
-                                    &f->compress_buffer_size, &rsize, j->data_threshold);
+                r = decompress_data(j, f, o, offset, l, data, size);
                 if (r < 0)
                         return r;
-
-                *data = f->compress_buffer;
-                *size = (size_t) rsize;
 #else
                 return -EPROTONOSUPPORT;
 #endif
@@ -2446,7 +3054,7 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (le_hash != o->data.hash)
                 return -EBADMSG;
 
-        r = return_data(j, f, o, data, size);
+        r = return_data(j, f, o, p, data, size);
         if (r < 0)
                 return r;
 
@@ -2468,6 +3076,122 @@ _public_ int sd_journal_enumerate_available_data(sd_journal *j, const void **dat
         }
 }
 
+static void* batch_alloc_tail(uint8_t **tail, uint8_t *head, size_t size, size_t alignment) {
+        uint8_t *p;
+
+        assert(tail);
+        assert(head);
+
+        /* Takes size bytes from the end of the free part of the arena, which lies between head and tail */
+
+        if ((size_t) (*tail - head) < size)
+                return NULL;
+
+        p = (uint8_t*) ((uintptr_t) (*tail - size) & ~((uintptr_t) alignment - 1));
+        if (p < head)
+                return NULL;
+
+        return *tail = p;
+}
+
+_public_ int sd_journal_read_batch(
+                sd_journal *j,
+                void *buffer,
+                size_t size,
+                size_t max_entries,
+                sd_journal_batch_entry **ret_entries) {
+
+        sd_journal_batch_entry *entries;
+        uint8_t *head, *tail, *end;
+        size_t n = 0;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(buffer || size == 0, -EINVAL);
+        assert_return(max_entries > 0, -EINVAL);
+        assert_return(ret_entries, -EINVAL);
+
+        /* Moves forward by up to max_entries entries, and copies them into the buffer: an array of
+         * sd_journal_batch_entry from the start, and the fields they point to from the end. Everything
+         * returned stays valid until the buffer is reused, regardless of what happens to the journal in the
+         * meantime. An entry that doesn't fit anymore is the first one returned by the next call. */
+
+        end = (uint8_t*) buffer + size;
+        entries = ALIGN_PTR(buffer);
+        if ((uint8_t*) entries > end)
+                entries = (sd_journal_batch_entry*) end;
+
+        head = (uint8_t*) entries;
+        tail = end;
+
+        while (n < max_entries) {
+                uint8_t *saved_tail = tail;
+                sd_journal_batch_entry *e;
+                struct iovec *fields;
+                size_t n_fields = 0;
+                const void *data;
+                size_t l;
+
+                if (j->batch_pending)
+                        j->batch_pending = false;
+                else {
+                        r = sd_journal_next(j);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                break;
+                }
+
+                /* Everything of this entry has to fit between the array of entries and what we copied
+                 * before */
+                e = (sd_journal_batch_entry*) head;
+                head += sizeof(sd_journal_batch_entry);
+                if (head > tail)
+                        goto full;
+
+                r = sd_journal_get_cursor_binary(j, &e->cursor);
+                if (r < 0)
+                        return r;
+
+                SD_JOURNAL_FOREACH_DATA(j, data, l) {
+                        void *p;
+
+                        if (!GREEDY_REALLOC(j->batch_fields, j->batch_fields_allocated, n_fields + 1))
+                                return -ENOMEM;
+
+                        p = batch_alloc_tail(&tail, head, l, 1);
+                        if (!p)
+                                goto full;
+
+                        j->batch_fields[n_fields++] = IOVEC_MAKE(memcpy(p, data, l), l);
+                }
+
+                fields = batch_alloc_tail(&tail, head, n_fields * sizeof(struct iovec), __alignof__(struct iovec));
+                if (!fields)
+                        goto full;
+
+                memcpy_safe(fields, j->batch_fields, n_fields * sizeof(struct iovec));
+                e->fields = fields;
+                e->n_fields = n_fields;
+
+                n++;
+                continue;
+
+        full:
+                /* Return the entry again next time */
+                j->batch_pending = true;
+                tail = saved_tail;
+
+                if (n == 0)
+                        return -ENOBUFS;
+                break;
+        }
+
+        *ret_entries = entries;
+        return (int) MIN(n, (size_t) INT_MAX);
+}
+
 _public_ void sd_journal_restart_data(sd_journal *j) {
         if (!j)
                 return;
@@ -2746,6 +3470,43 @@ _public_ int sd_journal_wait(sd_journal *j, uint64_t timeout_usec) {
         return sd_journal_process(j);
 }
 
+_public_ int sd_journal_wait_coalesced(sd_journal *j, uint64_t timeout_usec, uint64_t coalesce_usec) {
+        usec_t deadline;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        /* Like sd_journal_wait(), but once something happened keeps collecting inotify events for up to
+         * coalesce_usec, so that a writer appending entry by entry doesn't wake us up for each of them. */
+
+        r = sd_journal_wait(j, timeout_usec);
+        if (r <= SD_JOURNAL_NOP || coalesce_usec == 0)
+                return r;
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), coalesce_usec);
+
+        for (;;) {
+                usec_t n;
+                int q;
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= deadline)
+                        break;
+
+                q = sd_journal_wait(j, deadline - n);
+                if (q < 0)
+                        return q;
+                if (q == SD_JOURNAL_NOP)
+                        break;
+
+                if (q == SD_JOURNAL_INVALIDATE)
+                        r = SD_JOURNAL_INVALIDATE;
+        }
+
+        return r;
+}
+
 _public_ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from, uint64_t *to) {
         JournalFile *f;
         bool first = true;
@@ -2882,6 +3643,120 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         return 0;
 }
 
+static int unique_advance(sd_journal *j, size_t k) {
+        JournalFile *f = j->unique_file;
+        Object *o;
+        int r;
+
+        /* Moves on to the next value of the unique field in the current file. Returns 0 if there is none. */
+
+        if (j->unique_offset == 0) {
+                /* Archived files may summarize the field, which is much cheaper to go through than its data
+                 * objects */
+                r = journal_file_find_field_stats(f, j->unique_field, k, NULL, &j->unique_offset);
+                if (r < 0)
+                        return r;
+                j->unique_stats = r > 0;
+                j->unique_index = 0;
+                if (j->unique_stats)
+                        return 1;
+
+                r = journal_file_find_field_object(f, j->unique_field, k, &o, NULL);
+                if (r < 0)
+                        return r;
+
+                j->unique_offset = r > 0 ? le64toh(o->field.head_data_offset) : 0;
+        } else if (j->unique_stats) {
+                r = journal_file_move_to_object(f, OBJECT_FIELD_STATS, j->unique_offset, &o);
+                if (r < 0)
+                        return r;
+
+                if (j->unique_index + 1 >= le64toh(o->field_stats.n_values)) {
+                        j->unique_offset = 0;
+                        return 0;
+                }
+
+                j->unique_index++;
+        } else {
+                r = journal_file_move_to_object(f, OBJECT_DATA, j->unique_offset, &o);
+                if (r < 0)
+                        return r;
+
+                j->unique_offset = le64toh(o->data.next_field_offset);
+        }
+
+        return j->unique_offset > 0;
+}
+
+static int unique_get(sd_journal *j, size_t k, const void **ret_data, size_t *ret_size, uint64_t *ret_hash) {
+        JournalFile *f = j->unique_file;
+        const void *odata;
+        uint64_t hash;
+        size_t ol;
+        Object *o;
+        int r;
+
+        if (j->unique_stats) {
+                FieldStatsValue v;
+
+                r = journal_file_move_to_object(f, OBJECT_FIELD_STATS, j->unique_offset, &o);
+                if (r < 0)
+                        return r;
+
+                r = journal_file_field_stats_value(o, j->unique_index, &v);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                odata = v.data;
+                ol = v.size;
+                hash = v.hash;
+        } else {
+                /* We do not use OBJECT_DATA context here, but OBJECT_UNUSED
+                 * instead, so that we can look at this data object at the same
+                 * time as one on another file */
+                r = journal_file_move_to_object(f, OBJECT_UNUSED, j->unique_offset, &o);
+                if (r < 0)
+                        return r;
+
+                /* Let's do the type check by hand, since we used 0 context above. */
+                if (o->object.type != OBJECT_DATA)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "%s:offset " OFSfmt ": object has type %d, expected %d",
+                                               f->path,
+                                               j->unique_offset,
+                                               o->object.type, OBJECT_DATA);
+
+                hash = le64toh(o->data.hash);
+
+                r = return_data(j, f, o, j->unique_offset, &odata, &ol);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Check if we have at least the field name and "=". */
+        if (ol <= k)
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "%s:offset " OFSfmt ": object has size %zu, expected at least %zu",
+                                       f->path,
+                                       j->unique_offset, ol, k + 1);
+
+        if (memcmp(odata, j->unique_field, k) || ((const char*) odata)[k] != '=')
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "%s:offset " OFSfmt ": object does not start with \"%s=\"",
+                                       f->path,
+                                       j->unique_offset,
+                                       j->unique_field);
+
+        *ret_data = odata;
+        *ret_size = ol;
+        if (ret_hash)
+                *ret_hash = hash;
+
+        return 0;
+}
+
 _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l) {
         size_t k;
 
@@ -2906,29 +3781,19 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
 
         for (;;) {
                 JournalFile *of;
-                Object *o;
                 const void *odata;
+                uint64_t hash;
                 size_t ol;
                 bool found;
                 int r;
 
-                /* Proceed to next data object in the field's linked list */
-                if (j->unique_offset == 0) {
-                        r = journal_file_find_field_object(j->unique_file, j->unique_field, k, &o, NULL);
-                        if (r < 0)
-                                return r;
-
-                        j->unique_offset = r > 0 ? le64toh(o->field.head_data_offset) : 0;
-                } else {
-                        r = journal_file_move_to_object(j->unique_file, OBJECT_DATA, j->unique_offset, &o);
-                        if (r < 0)
-                                return r;
-
-                        j->unique_offset = le64toh(o->data.next_field_offset);
-                }
+                /* Proceed to next value of the field in this file */
+                r = unique_advance(j, k);
+                if (r < 0)
+                        return r;
 
                 /* We reached the end of the list? Then start again, with the next file */
-                if (j->unique_offset == 0) {
+                if (r == 0) {
                         j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
                         if (!j->unique_file)
                                 return 0;
@@ -2936,44 +3801,17 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         continue;
                 }
 
-                /* We do not use OBJECT_DATA context here, but OBJECT_UNUSED
-                 * instead, so that we can look at this data object at the same
-                 * time as one on another file */
-                r = journal_file_move_to_object(j->unique_file, OBJECT_UNUSED, j->unique_offset, &o);
+                r = unique_get(j, k, &odata, &ol, &hash);
                 if (r < 0)
                         return r;
 
-                /* Let's do the type check by hand, since we used 0 context above. */
-                if (o->object.type != OBJECT_DATA)
-                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
-                                               "%s:offset " OFSfmt ": object has type %d, expected %d",
-                                               j->unique_file->path,
-                                               j->unique_offset,
-                                               o->object.type, OBJECT_DATA);
-
-                r = return_data(j, j->unique_file, o, &odata, &ol);
-                if (r < 0)
-                        return r;
-
-                /* Check if we have at least the field name and "=". */
-                if (ol <= k)
-                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
-                                               "%s:offset " OFSfmt ": object has size %zu, expected at least %zu",
-                                               j->unique_file->path,
-                                               j->unique_offset, ol, k + 1);
-
-                if (memcmp(odata, j->unique_field, k) || ((const char*) odata)[k] != '=')
-                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
-                                               "%s:offset " OFSfmt ": object does not start with \"%s=\"",
-                                               j->unique_file->path,
-                                               j->unique_offset,
-                                               j->unique_field);
-
                 /* OK, now let's see if we already returned this data
                  * object by checking if it exists in the earlier
                  * traversed files. */
                 found = false;
                 ORDERED_HASHMAP_FOREACH(of, j->files) {
+                        uint64_t h;
+
                         if (of == j->unique_file)
                                 break;
 
@@ -2981,7 +3819,13 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
                                 continue;
 
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
+                        /* Files with keyed hashes each use their own key */
+                        h = of->keyed_hash || j->unique_file->keyed_hash ? journal_file_hash_data(of, odata, ol) : hash;
+
+                        if (journal_file_bloom_filter_test(of, h) == 0)
+                                continue;
+
+                        r = journal_file_find_data_object_with_hash(of, odata, ol, h, NULL, NULL);
                         if (r < 0)
                                 return r;
                         if (r > 0) {
@@ -2993,7 +3837,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 if (found)
                         continue;
 
-                r = return_data(j, j->unique_file, o, data, l);
+                r = unique_get(j, k, data, l, NULL);
                 if (r < 0)
                         return r;
 
@@ -3024,6 +3868,211 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         j->unique_file_lost = false;
 }
 
+static void field_value_hash_func(const JournalFieldValue *v, struct siphash *state) {
+        siphash24_compress(v->value, v->size, state);
+}
+
+static int field_value_compare_func(const JournalFieldValue *a, const JournalFieldValue *b) {
+        return memcmp_nn(a->value, a->size, b->value, b->size);
+}
+
+static JournalFieldValue* field_value_free(JournalFieldValue *v) {
+        if (!v)
+                return NULL;
+
+        free(v->value);
+        return mfree(v);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(field_value_hash_ops, JournalFieldValue, field_value_hash_func, field_value_compare_func,
+                                            field_value_free);
+
+static int field_value_count_compare(const JournalFieldValue *a, const JournalFieldValue *b) {
+        return CMP(b->n_entries, a->n_entries) ?: field_value_compare_func(a, b);
+}
+
+static int field_values_add(
+                Hashmap *h,
+                const void *value, size_t size,
+                uint64_t n_entries,
+                usec_t first_realtime, usec_t last_realtime) {
+
+        JournalFieldValue key = {
+                .value = (char*) value,
+                .size = size,
+        }, *v;
+        int r;
+
+        v = hashmap_get(h, &key);
+        if (v) {
+                v->n_entries += n_entries;
+                v->first_realtime = MIN(v->first_realtime, first_realtime);
+                v->last_realtime = MAX(v->last_realtime, last_realtime);
+                return 0;
+        }
+
+        v = new(JournalFieldValue, 1);
+        if (!v)
+                return -ENOMEM;
+
+        *v = (JournalFieldValue) {
+                .value = memdup_suffix0(value, size),
+                .size = size,
+                .n_entries = n_entries,
+                .first_realtime = first_realtime,
+                .last_realtime = last_realtime,
+        };
+        if (!v->value) {
+                free(v);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(h, v, v);
+        if (r < 0) {
+                free(v->value);
+                free(v);
+                return r;
+        }
+
+        return 1;
+}
+
+static int count_field_values_in_file(sd_journal *j, JournalFile *f, const char *field, size_t k, Hashmap *h) {
+        FieldStatsValue v;
+        uint64_t i, p;
+        Object *o;
+        int r;
+
+        r = journal_file_find_field_stats(f, field, k, &o, NULL);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                /* Nothing below moves the mmap windows around, hence the object stays valid */
+                for (i = 0; (r = journal_file_field_stats_value(o, i, &v)) > 0; i++) {
+                        if (v.size <= k)
+                                return -EBADMSG;
+
+                        r = field_values_add(h, (const uint8_t*) v.data + k + 1, v.size - k - 1,
+                                             v.n_entries, v.first_realtime, v.last_realtime);
+                        if (r < 0)
+                                return r;
+                }
+
+                return r;
+        }
+
+        /* No summary, hence look at each data object of the field, which knows the number of entries it is
+         * referenced by, and at the first and last of these entries */
+        r = journal_file_find_field_object(f, field, k, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        for (p = le64toh(o->field.head_data_offset); p > 0;) {
+                uint64_t n, next;
+                usec_t first = 0, last = 0;
+                const void *data;
+                size_t size;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                next = le64toh(o->data.next_field_offset);
+                n = le64toh(o->data.n_entries);
+                if (n <= 0) {
+                        p = next;
+                        continue;
+                }
+
+                r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        first = le64toh(o->entry.realtime);
+
+                r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        last = le64toh(o->entry.realtime);
+
+                /* Looking at the entries moved the data object's window, hence look it up again */
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                r = return_data(j, f, o, p, &data, &size);
+                if (r < 0)
+                        return r;
+                if (size <= k)
+                        return -EBADMSG;
+
+                r = field_values_add(h, (const uint8_t*) data + k + 1, size - k - 1, n, first, last);
+                if (r < 0)
+                        return r;
+
+                p = next;
+        }
+
+        return 0;
+}
+
+int journal_count_field_values(sd_journal *j, const char *field, JournalFieldValue **ret, size_t *ret_n) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        JournalFieldValue *values, *v;
+        JournalFile *f;
+        size_t k, n = 0;
+        int r;
+
+        assert(j);
+        assert(field);
+        assert(ret);
+        assert(ret_n);
+
+        /* Determines the values the field takes in all files, together with the number of entries each value
+         * occurs in and the time range they cover. Like sd_journal_enumerate_unique() this does not take
+         * matches into account, which allows using the summaries stored in archived files. */
+
+        if (!field_is_valid(field))
+                return -EINVAL;
+
+        k = strlen(field);
+
+        h = hashmap_new(&field_value_hash_ops);
+        if (!h)
+                return -ENOMEM;
+
+        ORDERED_HASHMAP_FOREACH(f, j->files) {
+                r = count_field_values_in_file(j, f, field, k, h);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to count values of field %s in %s, ignoring: %m", field, f->path);
+        }
+
+        values = new(JournalFieldValue, MAX(hashmap_size(h), 1U));
+        if (!values)
+                return -ENOMEM;
+
+        while ((v = hashmap_steal_first(h))) {
+                values[n++] = *v;
+                free(v);
+        }
+
+        typesafe_qsort(values, n, field_value_count_compare);
+
+        *ret = values;
+        *ret_n = n;
+        return 0;
+}
+
+JournalFieldValue* journal_field_values_free(JournalFieldValue *values, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(values[i].value);
+
+        return mfree(values);
+}
+
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
         int r;
 
@@ -3257,6 +4306,24 @@ _public_ int sd_journal_get_data_threshold(sd_journal *j, size_t *sz) {
         return 0;
 }
 
+_public_ int sd_journal_set_data_cache_size(sd_journal *j, size_t sz) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        j->data_cache_max = sz;
+        data_cache_trim(j, sz);
+        return 0;
+}
+
+_public_ int sd_journal_get_data_cache_size(sd_journal *j, size_t *sz) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(sz, -EINVAL);
+
+        *sz = j->data_cache_max;
+        return 0;
+}
+
 _public_ int sd_journal_has_runtime_files(sd_journal *j) {
         assert_return(j, -EINVAL);
 
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <locale.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include "sd-messages.h"
@@ -10,10 +11,12 @@
 #include "alloc-util.h"
 #include "catalog.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "log.h"
 #include "macro.h"
 #include "path-util.h"
+#include "rm-rf.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tests.h"
@@ -194,6 +197,111 @@ static void test_catalog_file_lang(void) {
         assert_se(streq(lang4, "ru_RU"));
 }
 
+static void test_catalog_get_cached(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_free_ char *text = NULL, *database = NULL;
+        const char *dirs[2] = {}, *p;
+        sd_id128_t id, other;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_id128_from_string("0027229ca0644181a76c4e92458afaff", &id) >= 0);
+        assert_se(sd_id128_from_string("0027229ca0644181a76c4e92458afab0", &other) >= 0);
+
+        assert_se(mkdtemp_malloc("/tmp/test-catalog-cache.XXXXXX", &dir) >= 0);
+        assert_se(database = path_join(dir, "catalog.db"));
+        dirs[0] = dir;
+
+        p = strjoina(dir, "/test.catalog");
+        assert_se(write_string_file(p,
+                                    "-- 0027229ca0644181a76c4e92458afaff\n"
+                                    "Subject: first\n"
+                                    "\n"
+                                    "one\n", WRITE_STRING_FILE_CREATE) >= 0);
+        p = strjoina(dir, "/test.de.catalog");
+        assert_se(write_string_file(p,
+                                    "-- 0027229ca0644181a76c4e92458afaff\n"
+                                    "Subject: erste\n"
+                                    "\n"
+                                    "eins\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(catalog_update(database, NULL, dirs) >= 0);
+
+        assert_se(setlocale(LC_MESSAGES, "C"));
+        assert_se(catalog_get(database, id, &text) >= 0);
+        assert_se(streq(text, "Subject: first\n\none\n"));
+        text = mfree(text);
+
+        /* Served from the cache this time, misses included */
+        assert_se(catalog_get(database, id, &text) >= 0);
+        assert_se(streq(text, "Subject: first\n\none\n"));
+        text = mfree(text);
+        assert_se(catalog_get(database, other, &text) == -ENOENT);
+        assert_se(catalog_get(database, other, &text) == -ENOENT);
+
+        /* The index follows the locale */
+        if (setlocale(LC_MESSAGES, "de_DE.UTF-8")) {
+                assert_se(catalog_get(database, id, &text) >= 0);
+                assert_se(streq(text, "Subject: erste\n\neins\n"));
+                text = mfree(text);
+                assert_se(setlocale(LC_MESSAGES, "C"));
+        } else
+                log_info("de_DE.UTF-8 locale not available, skipping.");
+
+        /* And the cache notices when the database is replaced */
+        p = strjoina(dir, "/test.catalog");
+        assert_se(write_string_file(p,
+                                    "-- 0027229ca0644181a76c4e92458afaff\n"
+                                    "Subject: first, updated\n"
+                                    "\n"
+                                    "one\n"
+                                    "\n"
+                                    "-- 0027229ca0644181a76c4e92458afab0\n"
+                                    "Subject: second\n"
+                                    "\n"
+                                    "two\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(catalog_update(database, NULL, dirs) >= 0);
+
+        assert_se(catalog_get(database, id, &text) >= 0);
+        assert_se(streq(text, "Subject: first, updated\n\none\n"));
+        text = mfree(text);
+        assert_se(catalog_get(database, other, &text) >= 0);
+        assert_se(streq(text, "Subject: second\n\ntwo\n"));
+
+        catalog_release_cache();
+}
+
+static void *catalog_get_thread(void *p) {
+        _cleanup_free_ char *text = NULL;
+
+        assert_se(catalog_get(p, SD_MESSAGE_COREDUMP, &text) >= 0);
+
+        return NULL;
+}
+
+static bool database_is_mapped(const char *database) {
+        _cleanup_free_ char *maps = NULL;
+
+        assert_se(read_full_file("/proc/self/maps", &maps, NULL) >= 0);
+
+        return strstr(maps, database);
+}
+
+static void test_catalog_get_thread(const char *database) {
+        pthread_t t;
+
+        log_info("/* %s */", __func__);
+
+        /* The per-thread cache must go away with the thread */
+
+        catalog_release_cache();
+        assert_se(!database_is_mapped(database));
+
+        assert_se(pthread_create(&t, NULL, catalog_get_thread, (void*) database) == 0);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        assert_se(!database_is_mapped(database));
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(unlink_tempfilep) char database[] = "/tmp/test-catalog.XXXXXX";
         _cleanup_free_ char *text = NULL;
@@ -231,5 +339,10 @@ int main(int argc, char *argv[]) {
         assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &text) >= 0);
         printf(">>>%s<<<\n", text);
 
+        test_catalog_get_cached();
+        test_catalog_get_thread(database);
+
+        catalog_release_cache();
+
         return 0;
 }
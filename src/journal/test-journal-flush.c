@@ -7,13 +7,18 @@
 
 #include "alloc-util.h"
 #include "chattr-util.h"
+#include "io-util.h"
 #include "journal-file.h"
 #include "journal-internal.h"
+#include "journal-verify.h"
 #include "macro.h"
 #include "path-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
 #include "string-util.h"
+#include "tmpfile-util.h"
 
-int main(int argc, char *argv[]) {
+static void test_flush_system(void) {
         _cleanup_free_ char *fn = NULL;
         char dn[] = "/var/tmp/test-journal-flush.XXXXXX";
         JournalFile *new_journal = NULL;
@@ -46,7 +51,7 @@ int main(int argc, char *argv[]) {
                         log_error_errno(r, "journal_file_move_to_object failed: %m");
                 assert_se(r >= 0);
 
-                r = journal_file_copy_entry(f, new_journal, o, f->current_offset);
+                r = journal_file_copy_entry(f, new_journal, o, f->current_offset, NULL);
                 if (r < 0)
                         log_error_errno(r, "journal_file_copy_entry failed: %m");
                 assert_se(r >= 0);
@@ -61,6 +66,72 @@ int main(int argc, char *argv[]) {
 
         unlink(fn);
         assert_se(rmdir(dn) == 0);
+}
+
+static void test_copy_cache(void) {
+        _cleanup_(journal_copy_cache_done) JournalCopyCache cache = {};
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        JournalFile *from = NULL, *to = NULL, *uncached = NULL;
+        uint64_t p, seqnum = 0;
+        unsigned i;
+        Object *o;
+        int r;
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-flush.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        assert_se(journal_file_open(-1, strjoina(dn, "/from.journal"), O_CREAT|O_RDWR, 0644, true, 0, false, NULL, NULL, NULL, NULL, &from) >= 0);
+        assert_se(journal_file_open(-1, strjoina(dn, "/to.journal"), O_CREAT|O_RDWR, 0644, true, 0, false, NULL, NULL, NULL, NULL, &to) >= 0);
+        assert_se(journal_file_open(-1, strjoina(dn, "/uncached.journal"), O_CREAT|O_RDWR, 0644, true, 0, false, NULL, NULL, NULL, NULL, &uncached) >= 0);
+
+        for (i = 0; i < 1000; i++) {
+                char message[STRLEN("MESSAGE=") + DECIMAL_STR_MAX(unsigned)], unit[STRLEN("_SYSTEMD_UNIT=foo.service") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[3];
+                dual_timestamp ts;
+
+                xsprintf(message, "MESSAGE=%u", i);
+                xsprintf(unit, "_SYSTEMD_UNIT=foo%u.service", i % 7);
+
+                iovec[0] = IOVEC_MAKE_STRING(message);
+                iovec[1] = IOVEC_MAKE_STRING(unit);
+                iovec[2] = IOVEC_MAKE_STRING("_HOSTNAME=waldo");
+
+                dual_timestamp_get(&ts);
+                assert_se(journal_file_append_entry(from, &ts, NULL, iovec, ELEMENTSOF(iovec), &seqnum, NULL, NULL) >= 0);
+        }
+
+        for (p = 0, i = 0;; i++) {
+                r = journal_file_next_entry(from, p, DIRECTION_DOWN, &o, &p);
+                assert_se(r >= 0);
+                if (r == 0)
+                        break;
+
+                assert_se(journal_file_copy_entry(from, to, o, p, &cache) >= 0);
+
+                assert_se(journal_file_move_to_object(from, OBJECT_ENTRY, p, &o) >= 0);
+                assert_se(journal_file_copy_entry(from, uncached, o, p, NULL) >= 0);
+        }
+
+        assert_se(i == 1000);
+
+        /* Everything but the messages themselves and the first occurrence of the other fields is reused */
+        assert_se(cache.n_hits == 1000 * 2 - 8);
+        assert_se(cache.n_misses == 1000 + 8);
+
+        assert_se(le64toh(to->header->n_entries) == 1000);
+        assert_se(to->header->n_data == uncached->header->n_data);
+        assert_se(to->header->n_fields == uncached->header->n_fields);
+        assert_se(le64toh(to->header->arena_size) == le64toh(uncached->header->arena_size));
+        assert_se(journal_file_verify(to, NULL, NULL, NULL, NULL, true) >= 0);
+
+        (void) journal_file_close(from);
+        (void) journal_file_close(to);
+        (void) journal_file_close(uncached);
+}
+
+int main(int argc, char *argv[]) {
+        test_flush_system();
+        test_copy_cache();
 
         return 0;
 }
@@ -9,10 +9,12 @@
 #include "chattr-util.h"
 #include "io-util.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "tests.h"
 #include "util.h"
 
@@ -196,6 +198,147 @@ static void test_skip(void (*setup)(void)) {
         puts("------------------------------------------------------------");
 }
 
+static void test_seek_realtime(void) {
+        char t[] = "/var/tmp/journal-realtime-XXXXXX";
+        uint64_t realtime[4];
+        sd_journal *j;
+        int i, r;
+
+        mkdtemp_chdir_chattr(t);
+
+        setup_sequential();
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        for (i = 0; i < 4; i++) {
+                assert_ret(r = sd_journal_next(j));
+                assert_se(r == 1);
+                assert_ret(sd_journal_get_realtime_usec(j, &realtime[i]));
+        }
+
+        /* Seeking into the second file skips the first one entirely, seeking before the first entry or past
+         * the last one must still find the closest entry in the right direction. */
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime[2]));
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 3);
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 4);
+
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime[1]));
+        assert_ret(r = sd_journal_previous(j));
+        assert_se(r == 1);
+        test_check_number(j, 2);
+
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime[0] - 1));
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 1);
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime[0] - 1));
+        assert_ret(r = sd_journal_previous(j));
+        assert_se(r == 0);
+
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime[3] + 1));
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 0);
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime[3] + 1));
+        assert_ret(r = sd_journal_previous(j));
+        assert_se(r == 1);
+        test_check_number(j, 4);
+
+        /* Restricting to a window only hides files that lie outside of it entirely. */
+        journal_set_realtime_window(j, realtime[2], USEC_INFINITY);
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 3);
+
+        journal_set_realtime_window(j, 0, realtime[0]);
+        assert_ret(sd_journal_seek_tail(j));
+        assert_ret(r = sd_journal_previous(j));
+        assert_se(r == 1);
+        test_check_number(j, 2);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_many_files(void) {
+        char t[] = "/var/tmp/journal-many-XXXXXX";
+        JournalFile *files[8];
+        sd_journal *j;
+        unsigned i;
+        int r;
+
+        mkdtemp_chdir_chattr(t);
+
+        /* Interleave entries round-robin over more files, so that the heap ordering of the files is reshuffled
+         * on every single step. */
+        for (i = 0; i < ELEMENTSOF(files); i++) {
+                char name[STRLEN("many-.journal") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "many-%u.journal", i);
+                files[i] = test_open(name);
+        }
+
+        for (i = 1; i <= 64; i++)
+                append_number(files[(i * 5) % ELEMENTSOF(files)], i, NULL);
+
+        for (i = 0; i < ELEMENTSOF(files); i++)
+                test_close(files[i]);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(sd_journal_next(j));
+        test_check_numbers_down(j, 64);
+
+        assert_ret(sd_journal_seek_tail(j));
+        assert_ret(sd_journal_previous(j));
+        test_check_numbers_up(j, 64);
+
+        /* Change direction in the middle, a couple of times. */
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(r = sd_journal_next_skip(j, 20));
+        assert_se(r == 20);
+        test_check_number(j, 20);
+        assert_ret(r = sd_journal_previous_skip(j, 7));
+        assert_se(r == 7);
+        test_check_number(j, 13);
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 14);
+        assert_ret(r = sd_journal_next_skip(j, 100));
+        assert_se(r == 50);
+        test_check_number(j, 64);
+        assert_ret(r = sd_journal_previous_skip(j, 100));
+        assert_se(r == 63);
+        test_check_number(j, 1);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_sequence_numbers(void) {
 
         char t[] = "/var/tmp/journal-seq-XXXXXX";
@@ -290,6 +433,9 @@ int main(int argc, char *argv[]) {
         test_skip(setup_sequential);
         test_skip(setup_interleaved);
 
+        test_seek_realtime();
+        test_many_files();
+
         test_sequence_numbers();
 
         return 0;
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "json.h"
+#include "logs-show.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+/* Checks that the direct JSON output is equivalent to what JsonVariant generates, which -o json-pretty still
+ * uses, and compares how fast the two are. */
+
+static unsigned arg_entries;
+
+static void append_entries(const char *path, unsigned n) {
+        static char binary[] = "BINARY=\001\002\377";
+        JournalFile *f;
+        dual_timestamp ts;
+        unsigned i;
+
+        assert_se(journal_file_open(-1, path, O_RDWR|O_CREAT, 0644, true, UINT64_MAX, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        dual_timestamp_get(&ts);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *message = NULL, *number = NULL, *big = NULL;
+                struct iovec iovec[10];
+                size_t k = 0;
+
+                assert_se(asprintf(&message, "MESSAGE=Entry %u, with a \"quote\", a back\\slash,\na newline, a\ttab and some UTF-8: \xc3\xa4\xc3\xb6\xc3\xbc", i) >= 0);
+                assert_se(asprintf(&number, "NUMBER=%u", i) >= 0);
+
+                iovec[k++] = IOVEC_MAKE_STRING(message);
+                iovec[k++] = IOVEC_MAKE_STRING(number);
+                iovec[k++] = IOVEC_MAKE_STRING("PRIORITY=6");
+                iovec[k++] = IOVEC_MAKE_STRING("_SYSTEMD_UNIT=test-journal-json.service");
+                iovec[k++] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=test-journal-json");
+                iovec[k++] = IOVEC_MAKE_STRING("EMPTY=");
+
+                if (i % 3 == 0) {
+                        /* Duplicate fields end up in an array */
+                        iovec[k++] = IOVEC_MAKE_STRING("DUPLICATE=one");
+                        iovec[k++] = IOVEC_MAKE_STRING("DUPLICATE=two");
+                }
+
+                if (i % 5 == 0)
+                        iovec[k++] = IOVEC_MAKE(binary, sizeof(binary) - 1);
+
+                if (i % 50 == 0) {
+                        /* Too big to be shown, unless with --all */
+                        big = strrep("X", 5000);
+                        assert_se(big);
+                        assert_se(memcpy(big, "BIG=", 4));
+                        iovec[k++] = IOVEC_MAKE_STRING(big);
+                }
+
+                ts.realtime++;
+                ts.monotonic++;
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, k, NULL, NULL, NULL) == 0);
+        }
+
+        (void) journal_file_close(f);
+}
+
+static char* render(sd_journal *j, OutputMode mode, OutputFlags flags, size_t *ret_size) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char *buf = NULL;
+        size_t size = 0;
+
+        f = open_memstream_unlocked(&buf, &size);
+        assert_se(f);
+
+        assert_se(sd_journal_seek_head(j) >= 0);
+        while (sd_journal_next(j) > 0)
+                assert_se(show_journal_entry(f, j, mode, 0, flags, NULL, NULL, NULL) >= 0);
+
+        assert_se(fflush_and_check(f) >= 0);
+        f = safe_fclose(f);
+
+        if (ret_size)
+                *ret_size = size;
+        return buf;
+}
+
+static void test_equivalent(sd_journal *j, OutputFlags flags) {
+        _cleanup_free_ char *plain = NULL, *pretty = NULL;
+        const char *p, *q;
+        unsigned n = 0;
+
+        log_info("/* %s(%s) */", __func__, flags & OUTPUT_SHOW_ALL ? "all" : "default");
+
+        plain = render(j, OUTPUT_JSON, flags, NULL);
+        pretty = render(j, OUTPUT_JSON_PRETTY, flags, NULL);
+
+        /* One object per line, each equal to the corresponding pretty printed one */
+        for (p = plain, q = pretty; *p; n++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *a = NULL, *b = NULL;
+                _cleanup_free_ char *line = NULL;
+                unsigned x;
+
+                line = strndup(p, strcspn(p, "\n"));
+                assert_se(line);
+                p += strlen(line);
+                assert_se(*p == '\n');
+                p++;
+
+                assert_se(json_parse(line, 0, &a, NULL, NULL) >= 0);
+                assert_se(json_parse_continue(&q, 0, &b, NULL, NULL) >= 0);
+                assert_se(json_variant_equal(a, b));
+
+                assert_se(safe_atou(json_variant_string(json_variant_by_key(a, "NUMBER")), &x) >= 0);
+                assert_se(x == n);
+                assert_se(json_variant_is_array(json_variant_by_key(a, "DUPLICATE")) == (n % 3 == 0));
+                assert_se(json_variant_is_array(json_variant_by_key(a, "BINARY")) == (n % 5 == 0));
+                if (n % 50 == 0)
+                        assert_se(json_variant_is_null(json_variant_by_key(a, "BIG")) == !(flags & OUTPUT_SHOW_ALL));
+        }
+
+        assert_se(n == arg_entries);
+}
+
+static void test_framing(sd_journal *j) {
+        _cleanup_free_ char *seq = NULL, *sse = NULL;
+
+        log_info("/* %s */", __func__);
+
+        seq = render(j, OUTPUT_JSON_SEQ, 0, NULL);
+        assert_se(seq[0] == '\x1e');
+        assert_se(strstr(seq, "}\n\x1e{"));
+
+        sse = render(j, OUTPUT_JSON_SSE, 0, NULL);
+        assert_se(startswith(sse, "data: {"));
+        assert_se(strstr(sse, "}\n\ndata: {"));
+        assert_se(endswith(sse, "}\n\n"));
+}
+
+static void test_benchmark(sd_journal *j) {
+        OutputMode modes[] = { OUTPUT_JSON, OUTPUT_JSON_PRETTY };
+        size_t i;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < ELEMENTSOF(modes); i++) {
+                _cleanup_free_ char *buf = NULL;
+                usec_t start, d;
+                size_t size;
+
+                start = now(CLOCK_MONOTONIC);
+                buf = render(j, modes[i], 0, &size);
+                d = MAX(now(CLOCK_MONOTONIC) - start, (usec_t) 1);
+
+                log_info("%s: formatted %u entries, %zu bytes in %.3fs (%.0f entries/s, %.2f MiB/s)",
+                         output_mode_to_string(modes[i]), arg_entries, size, d / 1e6,
+                         arg_entries * 1e6 / d, size * 1e6 / d / 1024 / 1024);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *path = NULL;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_entries) >= 0);
+        else
+                arg_entries = slow_tests_enabled() ? 100000 : 1000;
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-json-XXXXXX", &dir) >= 0);
+        assert_se(path = path_join(dir, "test.journal"));
+        append_entries(path, arg_entries);
+
+        assert_se(sd_journal_open_directory(&j, dir, 0) >= 0);
+
+        test_equivalent(j, 0);
+        test_equivalent(j, OUTPUT_SHOW_ALL);
+        test_framing(j);
+        test_benchmark(j);
+
+        show_journal_entry_release_cache();
+
+        return 0;
+}
@@ -0,0 +1,311 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journal-ring.h"
+#include "macro.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+#define DATA_SIZE JOURNAL_RING_SIZE_MIN
+
+typedef struct Ring {
+        JournalRingHeader *header;
+        uint8_t *data;
+        uint64_t tail;
+
+        void *buffer;
+        size_t buffer_allocated;
+} Ring;
+
+static void ring_setup(Ring *r) {
+        void *p;
+
+        assert_se((p = mmap(NULL, JOURNAL_RING_HEADER_SIZE + DATA_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0)) != MAP_FAILED);
+
+        *r = (Ring) {
+                .header = p,
+                .data = (uint8_t*) p + JOURNAL_RING_HEADER_SIZE,
+        };
+
+        r->header->header_size = JOURNAL_RING_HEADER_SIZE;
+        r->header->data_size = DATA_SIZE;
+}
+
+static void ring_done(Ring *r) {
+        assert_se(munmap(r->header, JOURNAL_RING_HEADER_SIZE + DATA_SIZE) >= 0);
+        free(r->buffer);
+}
+
+static int ring_push(Ring *r, const char *message) {
+        return journal_ring_push(r->header, r->data, DATA_SIZE, &IOVEC_MAKE_STRING(message), 1);
+}
+
+static int ring_pop(Ring *r, char **ret) {
+        size_t size;
+        int k;
+
+        /* Skips over padding, and returns the next message as string */
+
+        do {
+                k = journal_ring_pop(r->header, r->data, DATA_SIZE, &r->tail, &r->buffer, &r->buffer_allocated, &size);
+                if (k <= 0)
+                        return k;
+        } while (size == 0);
+
+        ((char*) r->buffer)[size] = 0;
+        *ret = r->buffer;
+        return 1;
+}
+
+static void make_message(char *buf, size_t n, unsigned producer, unsigned seq) {
+        size_t l;
+
+        /* Messages of varying length, with contents we can verify */
+        assert_se(snprintf(buf, n, "MESSAGE=%u/%u ", producer, seq) > 0);
+
+        l = strlen(buf);
+        memset(buf + l, 'a' + seq % 26, (seq * 37) % 500);
+        buf[l + (seq * 37) % 500] = 0;
+}
+
+static void test_ring_wraparound(void) {
+        char expected[600], *m;
+        unsigned pushed = 0, popped = 0, round;
+        Ring r;
+
+        log_info("/* %s */", __func__);
+
+        ring_setup(&r);
+
+        /* Fill the ring until it is full, drain half of it, and so on, so that the records end up at all
+         * kinds of offsets and the ring wraps around many times */
+        for (round = 0; round < 200; round++) {
+                int k;
+
+                for (;;) {
+                        make_message(expected, sizeof(expected), 0, pushed);
+
+                        k = ring_push(&r, expected);
+                        if (k == -ENOBUFS)
+                                break;
+                        assert_se(k >= 0);
+                        pushed++;
+                }
+
+                while (popped < pushed - (pushed - popped) / 2) {
+                        assert_se(ring_pop(&r, &m) > 0);
+                        make_message(expected, sizeof(expected), 0, popped);
+                        assert_se(streq(m, expected));
+                        popped++;
+                }
+        }
+
+        while (popped < pushed) {
+                assert_se(ring_pop(&r, &m) > 0);
+                make_message(expected, sizeof(expected), 0, popped);
+                assert_se(streq(m, expected));
+                popped++;
+        }
+
+        assert_se(ring_pop(&r, &m) == 0);
+        assert_se(!journal_ring_pending(r.data, DATA_SIZE, r.tail));
+
+        log_info("Passed %u messages, %" PRIu64 " bytes, through a ring of %u bytes.",
+                 popped, r.tail, DATA_SIZE);
+        assert_se(r.tail > 100 * DATA_SIZE);
+        assert_se(r.tail == r.header->reserve);
+
+        ring_done(&r);
+}
+
+#define PRODUCERS 4U
+#define MESSAGES 20000U
+
+typedef struct Producer {
+        Ring *ring;
+        unsigned id;
+} Producer;
+
+static void *producer_thread(void *userdata) {
+        Producer *p = userdata;
+        char buf[600];
+        unsigned seq;
+
+        for (seq = 0; seq < MESSAGES; seq++) {
+                int k;
+
+                make_message(buf, sizeof(buf), p->id, seq);
+
+                while ((k = ring_push(p->ring, buf)) == -ENOBUFS)
+                        sched_yield();
+                assert_se(k >= 0);
+        }
+
+        return NULL;
+}
+
+static void test_ring_threads(void) {
+        Producer producers[PRODUCERS];
+        pthread_t threads[PRODUCERS];
+        unsigned next[PRODUCERS] = {}, n = 0, i;
+        char expected[600];
+        Ring r;
+
+        log_info("/* %s */", __func__);
+
+        ring_setup(&r);
+
+        for (i = 0; i < PRODUCERS; i++) {
+                producers[i] = (Producer) { .ring = &r, .id = i };
+                assert_se(pthread_create(threads + i, NULL, producer_thread, producers + i) == 0);
+        }
+
+        /* Messages of different producers interleave, but those of each one must arrive in order, and
+         * intact */
+        while (n < PRODUCERS * MESSAGES) {
+                unsigned id, seq;
+                char *m;
+                int k;
+
+                k = ring_pop(&r, &m);
+                assert_se(k >= 0);
+                if (k == 0) {
+                        sched_yield();
+                        continue;
+                }
+
+                assert_se(sscanf(m, "MESSAGE=%u/%u ", &id, &seq) == 2);
+                assert_se(id < PRODUCERS);
+                assert_se(seq == next[id]);
+
+                make_message(expected, sizeof(expected), id, seq);
+                assert_se(streq(m, expected));
+
+                next[id]++;
+                n++;
+        }
+
+        for (i = 0; i < PRODUCERS; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        assert_se(journal_ring_pending(r.data, DATA_SIZE, r.tail) == false);
+
+        ring_done(&r);
+}
+
+static void test_ring_partial(void) {
+        JournalRingRecord *record;
+        char *m;
+        Ring r;
+
+        log_info("/* %s */", __func__);
+
+        ring_setup(&r);
+
+        assert_se(ring_push(&r, "MESSAGE=first") >= 0);
+
+        /* A producer that reserved space but did not get around to commit it, possibly because it died,
+         * holds up everything after it */
+        r.header->reserve += JOURNAL_RING_RECORD_ALIGN(sizeof(JournalRingRecord) + STRLEN("MESSAGE=second"));
+        assert_se(ring_push(&r, "MESSAGE=third") >= 0);
+
+        assert_se(ring_pop(&r, &m) > 0);
+        assert_se(streq(m, "MESSAGE=first"));
+        assert_se(ring_pop(&r, &m) == 0);
+        assert_se(!journal_ring_pending(r.data, DATA_SIZE, r.tail));
+
+        /* Once it is committed, things continue in order */
+        record = (JournalRingRecord*) (r.data + (r.tail & (DATA_SIZE - 1)));
+        record->size = STRLEN("MESSAGE=second");
+        memcpy(record->payload, "MESSAGE=second", record->size);
+        record->committed = JOURNAL_RING_RECORD_DATA;
+
+        assert_se(ring_pop(&r, &m) > 0);
+        assert_se(streq(m, "MESSAGE=second"));
+        assert_se(ring_pop(&r, &m) > 0);
+        assert_se(streq(m, "MESSAGE=third"));
+        assert_se(ring_pop(&r, &m) == 0);
+
+        ring_done(&r);
+}
+
+static void test_ring_corrupt(void) {
+        JournalRingRecord *record;
+        char *m;
+        Ring r;
+
+        log_info("/* %s */", __func__);
+
+        ring_setup(&r);
+
+        /* A record claiming to extend beyond the end of the ring */
+        record = (JournalRingRecord*) r.data;
+        record->size = DATA_SIZE;
+        record->committed = JOURNAL_RING_RECORD_DATA;
+        assert_se(ring_pop(&r, &m) == -EBADMSG);
+
+        /* Padding that doesn't extend up to the end */
+        record->size = 16;
+        record->committed = JOURNAL_RING_RECORD_PADDING;
+        assert_se(ring_pop(&r, &m) == -EBADMSG);
+
+        /* Unknown record type */
+        record->committed = 77;
+        assert_se(ring_pop(&r, &m) == -EBADMSG);
+
+        /* A tail that doesn't leave room for a record header */
+        r.tail = DATA_SIZE - 4;
+        assert_se(ring_pop(&r, &m) == -EBADMSG);
+
+        ring_done(&r);
+}
+
+static void test_ring_wait(void) {
+        _cleanup_free_ char *huge = NULL;
+        char *m;
+        Ring r;
+
+        log_info("/* %s */", __func__);
+
+        ring_setup(&r);
+
+        /* Nothing there, hence the consumer may sleep, and the next producer wakes it up, but only that one */
+        assert_se(journal_ring_wait(r.header, r.data, DATA_SIZE, r.tail));
+        assert_se(ring_push(&r, "MESSAGE=one") > 0);
+        assert_se(ring_push(&r, "MESSAGE=two") == 0);
+
+        /* Something there, hence the consumer has to look again */
+        assert_se(!journal_ring_wait(r.header, r.data, DATA_SIZE, r.tail));
+        assert_se(r.header->waiting == 0);
+        assert_se(ring_pop(&r, &m) > 0);
+        assert_se(streq(m, "MESSAGE=one"));
+        assert_se(ring_pop(&r, &m) > 0);
+        assert_se(streq(m, "MESSAGE=two"));
+
+        /* Messages that could hog the ring go through the socket */
+        assert_se(huge = malloc(JOURNAL_RING_RECORD_MAX(DATA_SIZE) + 1));
+        memset(huge, 'x', JOURNAL_RING_RECORD_MAX(DATA_SIZE));
+        huge[JOURNAL_RING_RECORD_MAX(DATA_SIZE)] = 0;
+        assert_se(ring_push(&r, huge) == -E2BIG);
+
+        ring_done(&r);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_ring_wraparound();
+        test_ring_threads();
+        test_ring_partial();
+        test_ring_corrupt();
+        test_ring_wait();
+
+        return 0;
+}
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sd-id128.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fsprg.h"
+#include "hexdecoct.h"
+#include "io-util.h"
+#include "journal-def.h"
+#include "journal-file.h"
+#include "journal-verify.h"
+#include "log.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "random-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#if HAVE_GCRYPT
+
+#define INTERVAL_USEC (15 * USEC_PER_MINUTE)
+
+static usec_t arg_duration;
+
+/* Like "journalctl --setup-keys", but writes the sealing key to the specified directory and returns the
+ * verification key */
+static char* setup_keys(const char *dir) {
+        size_t mpk_size, seed_size, state_size;
+        _cleanup_free_ char *p = NULL, *hex = NULL;
+        _cleanup_close_ int fd = -1;
+        uint8_t *mpk, *seed, *state;
+        sd_id128_t machine, boot;
+        char *key;
+        uint64_t n;
+
+        assert_se(sd_id128_get_machine(&machine) >= 0);
+        assert_se(sd_id128_get_boot(&boot) >= 0);
+
+        mpk_size = FSPRG_mskinbytes(FSPRG_RECOMMENDED_SECPAR);
+        mpk = alloca(mpk_size);
+
+        seed_size = FSPRG_RECOMMENDED_SEEDLEN;
+        seed = alloca(seed_size);
+
+        state_size = FSPRG_stateinbytes(FSPRG_RECOMMENDED_SECPAR);
+        state = alloca(state_size);
+
+        random_bytes(seed, seed_size);
+        FSPRG_GenMK(NULL, mpk, seed, seed_size, FSPRG_RECOMMENDED_SECPAR);
+        FSPRG_GenState0(state, mpk, seed, seed_size);
+
+        n = now(CLOCK_REALTIME) / INTERVAL_USEC;
+
+        struct FSSHeader h = {
+                .signature = { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' },
+                .machine_id = machine,
+                .boot_id = boot,
+                .header_size = htole64(sizeof(h)),
+                .start_usec = htole64(n * INTERVAL_USEC),
+                .interval_usec = htole64(INTERVAL_USEC),
+                .fsprg_secpar = htole16(FSPRG_RECOMMENDED_SECPAR),
+                .fsprg_state_size = htole64(state_size),
+        };
+
+        assert_se(p = path_join(dir, "fss"));
+        assert_se((fd = open(p, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0600)) >= 0);
+        assert_se(loop_write(fd, &h, sizeof(h), false) >= 0);
+        assert_se(loop_write(fd, state, state_size, false) >= 0);
+
+        assert_se(setenv("SYSTEMD_JOURNAL_FSS", p, true) >= 0);
+
+        assert_se(hex = hexmem(seed, seed_size));
+        assert_se(asprintf(&key, "%s/%" PRIx64 "-%" PRIx64, hex, n, (uint64_t) INTERVAL_USEC) >= 0);
+
+        return key;
+}
+
+static void test_append(const char *dir, bool seal, const char *verification_key) {
+        _cleanup_free_ char *fn = NULL;
+        JournalFile *f;
+        uint64_t n = 0;
+        usec_t start, end;
+
+        assert_se(fn = path_join(dir, seal ? "sealed.journal" : "unsealed.journal"));
+
+        assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, false, (uint64_t) -1, seal,
+                                    NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(f->seal == seal);
+
+        start = now(CLOCK_MONOTONIC);
+        do {
+                char message[STRLEN("MESSAGE=Benchmark message ") + DECIMAL_STR_MAX(uint64_t)],
+                        pid[STRLEN("_PID=") + DECIMAL_STR_MAX(uint64_t)];
+                struct iovec iovec[4];
+                dual_timestamp ts;
+
+                /* A new MESSAGE= data object for every entry, the rest is mostly shared between entries,
+                 * roughly like real logs */
+                xsprintf(message, "MESSAGE=Benchmark message %" PRIu64, n);
+                xsprintf(pid, "_PID=%" PRIu64, n % 97);
+
+                iovec[0] = IOVEC_MAKE_STRING(message);
+                iovec[1] = IOVEC_MAKE_STRING(pid);
+                iovec[2] = IOVEC_MAKE_STRING("PRIORITY=6");
+                iovec[3] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=test-journal-seal-benchmark");
+
+                dual_timestamp_get(&ts);
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+                n++;
+
+                end = now(CLOCK_MONOTONIC);
+        } while (end - start < arg_duration);
+
+        log_info("%s: appended %" PRIu64 " entries in %.2fs (%.0f entries/s)",
+                 seal ? "sealed" : "unsealed", n, (end - start) / 1e6, n / ((end - start) / 1e6));
+
+        (void) journal_file_close(f);
+
+        if (!verification_key)
+                return;
+
+        assert_se(journal_file_open(-1, fn, O_RDONLY, 0644, false, (uint64_t) -1, true,
+                                    NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_verify(f, verification_key, NULL, NULL, NULL, false) >= 0);
+        (void) journal_file_close(f);
+}
+#endif
+
+int main(int argc, char *argv[]) {
+#if HAVE_GCRYPT
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_free_ char *key = NULL;
+
+        /* journal_file_open() requires a valid machine id, and so does the sealing key */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return log_tests_skipped("/etc/machine-id not found");
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2) {
+                unsigned x;
+
+                assert_se(safe_atou(argv[1], &x) >= 0);
+                arg_duration = x * USEC_PER_SEC;
+        } else
+                arg_duration = slow_tests_enabled() ?
+                        2 * USEC_PER_SEC : USEC_PER_SEC / 50;
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-seal-XXXXXX", &dir) >= 0);
+
+        key = setup_keys(dir);
+
+        test_append(dir, false, NULL);
+        test_append(dir, true, key);
+
+        return 0;
+#else
+        return log_tests_skipped("gcrypt support is not enabled");
+#endif
+}
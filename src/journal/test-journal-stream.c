@@ -1,22 +1,29 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include "sd-journal.h"
 
 #include "alloc-util.h"
 #include "chattr-util.h"
+#include "io-util.h"
 #include "journal-file.h"
 #include "journal-internal.h"
 #include "log.h"
 #include "macro.h"
+#include "memory-util.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "util.h"
 
 #define N_ENTRIES 200
+#define N_LINES 20000
+#define LINES_PER_BATCH 128
 
 static void verify_contents(sd_journal *j, unsigned skip) {
         unsigned i;
@@ -173,6 +180,303 @@ static void run_test(void) {
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 }
 
+static void test_append_throughput(void) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        _cleanup_strv_free_ char **lines = NULL;
+        JournalFile *single, *batched;
+        char t[] = "/var/tmp/journal-stream-XXXXXX";
+        usec_t start, single_usec, batched_usec;
+        size_t i, size = 0;
+
+        /* Compares writing the lines of a chatty stdout stream one by one and in batches, as journald does
+         * with everything it gets from a single read */
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+        (void) chattr_path(t, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        assert_se(journal_file_open(-1, "single.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &single) == 0);
+        assert_se(journal_file_open(-1, "batched.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &batched) == 0);
+
+        assert_se(lines = new0(char*, N_LINES + 1));
+        for (i = 0; i < N_LINES; i++) {
+                assert_se(asprintf(&lines[i], "MESSAGE=Processed request %zu of client %zu in %zu ms", i, i % 97, i % 13) >= 0);
+                size += strlen(lines[i]);
+        }
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_LINES; i++) {
+                struct iovec iovec[] = {
+                        IOVEC_MAKE_STRING("_TRANSPORT=stdout"),
+                        IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=test-journal-stream"),
+                        IOVEC_MAKE_STRING(lines[i]),
+                };
+
+                assert_se(journal_file_append_entry(single, NULL, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+        single_usec = now(CLOCK_MONOTONIC) - start;
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_LINES; i += LINES_PER_BATCH) {
+                struct iovec iovec[LINES_PER_BATCH][3];
+                JournalFileEntry entries[LINES_PER_BATCH];
+                size_t k, n = MIN((size_t) LINES_PER_BATCH, N_LINES - i), n_written;
+
+                for (k = 0; k < n; k++) {
+                        iovec[k][0] = IOVEC_MAKE_STRING("_TRANSPORT=stdout");
+                        iovec[k][1] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=test-journal-stream");
+                        iovec[k][2] = IOVEC_MAKE_STRING(lines[i + k]);
+                        entries[k] = (JournalFileEntry) {
+                                .iovec = iovec[k],
+                                .n_iovec = 3,
+                        };
+                }
+
+                assert_se(journal_file_append_entries(batched, entries, n, NULL, &n_written) == 0);
+                assert_se(n_written == n);
+        }
+        batched_usec = now(CLOCK_MONOTONIC) - start;
+
+        assert_se(le64toh(single->header->n_entries) == N_LINES);
+        assert_se(le64toh(batched->header->n_entries) == N_LINES);
+
+        log_info("%u lines, %zu bytes: one by one %s (%.0f lines/s), in batches of %u %s (%.0f lines/s)",
+                 N_LINES, size,
+                 format_timespan(a, sizeof(a), single_usec, 0), (double) N_LINES * USEC_PER_SEC / MAX(single_usec, 1U),
+                 LINES_PER_BATCH,
+                 format_timespan(b, sizeof(b), batched_usec, 0), (double) N_LINES * USEC_PER_SEC / MAX(batched_usec, 1U));
+
+        (void) journal_file_close(single);
+        (void) journal_file_close(batched);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
+static void append_numbered(const char *path, unsigned from, unsigned to) {
+        JournalFile *f;
+        unsigned i;
+
+        assert_se(journal_file_open(-1, path, O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = from; i < to; i++) {
+                _cleanup_free_ char *p = NULL, *q = NULL;
+                struct iovec iovec[2];
+                dual_timestamp ts;
+
+                dual_timestamp_get(&ts);
+
+                assert_se(asprintf(&p, "NUMBER=%u", i) >= 0);
+                /* Vary the size, so that batches end at different places */
+                assert_se(asprintf(&q, "PADDING=%0*u", (int) (i % 7) * 50, 0) >= 0);
+
+                iovec[0] = IOVEC_MAKE_STRING(p);
+                iovec[1] = IOVEC_MAKE_STRING(q);
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+        }
+
+        (void) journal_file_close(f);
+}
+
+static unsigned read_batch_entries(sd_journal *j, void *buffer, size_t size, unsigned expected) {
+        sd_journal_batch_entry *entries;
+        unsigned n = 0;
+        int r;
+
+        /* Reads all entries there are in batches, and checks them against expectations */
+
+        while ((r = sd_journal_read_batch(j, buffer, size, 16, &entries)) > 0) {
+                int k;
+
+                for (k = 0; k < r; k++) {
+                        _cleanup_free_ char *number = NULL, *c = NULL;
+                        bool found = false;
+                        size_t i;
+
+                        assert_se(asprintf(&number, "NUMBER=%u", expected + n) >= 0);
+
+                        for (i = 0; i < entries[k].n_fields; i++)
+                                if (memcmp_nn(entries[k].fields[i].iov_base, entries[k].fields[i].iov_len,
+                                              number, strlen(number)) == 0)
+                                        found = true;
+                        assert_se(found);
+
+                        /* Binary cursors turn into the usual ones */
+                        assert_se(sd_journal_cursor_to_string(&entries[k].cursor, &c) >= 0);
+                        assert_se(startswith(c, "s="));
+                        assert_se(entries[k].cursor.seqnum == expected + n + 1);
+
+                        n++;
+                }
+        }
+        assert_se(r == 0);
+
+        return n;
+}
+
+static void test_read_batch(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        sd_journal_batch_entry *entries;
+        _cleanup_free_ char *c = NULL, *d = NULL;
+        _cleanup_free_ void *buffer = NULL;
+        sd_journal_cursor cursor;
+        const char *path;
+        char tiny[64];
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-stream-XXXXXX", &t) >= 0);
+        path = strjoina(t, "/test.journal");
+        append_numbered(path, 0, 500);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        /* The binary cursor is what the textual one is made of */
+        assert_se(sd_journal_next(j) > 0);
+        assert_se(sd_journal_get_cursor(j, &c) >= 0);
+        assert_se(sd_journal_get_cursor_binary(j, &cursor) >= 0);
+        assert_se(sd_journal_cursor_to_string(&cursor, &d) >= 0);
+        assert_se(streq(c, d));
+
+        /* An entry that doesn't fit is returned by the next call */
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_read_batch(j, tiny, sizeof(tiny), 16, &entries) == -ENOBUFS);
+
+        assert_se(buffer = malloc(4096));
+        assert_se(read_batch_entries(j, buffer, 4096, 0) == 500);
+
+        /* New entries are picked up after waiting, coalesced into a single wakeup */
+        assert_se(sd_journal_wait_coalesced(j, 0, 0) >= 0);
+        append_numbered(path, 500, 600);
+
+        r = sd_journal_wait_coalesced(j, 5 * USEC_PER_SEC, 50 * USEC_PER_MSEC);
+        assert_se(IN_SET(r, SD_JOURNAL_APPEND, SD_JOURNAL_INVALIDATE));
+        assert_se(sd_journal_wait_coalesced(j, 0, 0) == SD_JOURNAL_NOP);
+
+        assert_se(read_batch_entries(j, buffer, 4096, 500) == 100);
+}
+
+static unsigned count_entries(sd_journal *j, bool backwards, unsigned *ret_first) {
+        unsigned n = 0;
+        int r;
+
+        assert_se((backwards ? sd_journal_seek_tail(j) : sd_journal_seek_head(j)) >= 0);
+
+        while ((r = backwards ? sd_journal_previous(j) : sd_journal_next(j)) > 0) {
+                const void *d;
+                size_t l;
+
+                if (n == 0 && ret_first) {
+                        _cleanup_free_ char *k = NULL;
+
+                        assert_se(sd_journal_get_data(j, "NUMBER", &d, &l) >= 0);
+                        assert_se(k = strndup((const char*) d + STRLEN("NUMBER="), l - STRLEN("NUMBER=")));
+                        assert_se(safe_atou(k, ret_first) >= 0);
+                }
+
+                n++;
+        }
+        assert_se(r == 0);
+
+        return n;
+}
+
+static void test_snapshot(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL, *live = NULL;
+        const char *path;
+        unsigned first;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-stream-XXXXXX", &t) >= 0);
+        path = strjoina(t, "/one.journal");
+        append_numbered(path, 0, 100);
+
+        assert_se(sd_journal_open_directory(&j, t, SD_JOURNAL_SNAPSHOT) >= 0);
+        assert_se(sd_journal_open_directory(&live, t, 0) >= 0);
+        assert_se(sd_journal_get_fd(j) == -EMEDIUMTYPE);
+
+        /* Neither more entries nor more files show up in the snapshot */
+        append_numbered(path, 100, 150);
+        append_numbered(strjoina(t, "/two.journal"), 150, 160);
+
+        assert_se(count_entries(j, false, &first) == 100);
+        assert_se(first == 0);
+        assert_se(count_entries(j, true, &first) == 100);
+        assert_se(first == 99);
+
+        assert_se(count_entries(live, false, NULL) == 150);
+
+        /* Also when looking for entries through matches */
+        assert_se(sd_journal_add_match(j, "NUMBER=120", 0) >= 0);
+        assert_se(count_entries(j, false, NULL) == 0);
+        assert_se(count_entries(j, true, NULL) == 0);
+
+        assert_se(sd_journal_add_disjunction(j) >= 0);
+        assert_se(sd_journal_add_match(j, "NUMBER=50", 0) >= 0);
+        assert_se(count_entries(j, false, &first) == 1);
+        assert_se(first == 50);
+        assert_se(count_entries(j, true, &first) == 1);
+        assert_se(first == 50);
+
+        /* Entries 105, 112, … match as well, but came too late */
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_add_match(j, "PADDING=0", 0) >= 0);
+        assert_se(count_entries(j, true, &first) == 15);
+        assert_se(first == 98);
+}
+
+static void *shared_thread(void *p) {
+        sd_journal *j = p;
+        unsigned first;
+
+        assert_se(count_entries(j, false, &first) == 150);
+        assert_se(first == 0);
+        assert_se(count_entries(j, true, &first) == 150);
+        assert_se(first == 149);
+
+        assert_se(sd_journal_add_match(j, "NUMBER=120", 0) >= 0);
+        assert_se(count_entries(j, false, &first) == 1);
+        assert_se(first == 120);
+
+        sd_journal_close(j);
+        return NULL;
+}
+
+static void test_shared(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        pthread_t threads[4];
+        size_t i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-stream-XXXXXX", &t) >= 0);
+        append_numbered(strjoina(t, "/one.journal"), 0, 100);
+        append_numbered(strjoina(t, "/two.journal"), 100, 150);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(count_entries(j, false, NULL) == 150);
+        assert_se(sd_journal_open_shared(NULL, j, 0) == -EINVAL);
+
+        for (i = 0; i < ELEMENTSOF(threads); i++) {
+                sd_journal *s;
+
+                assert_se(sd_journal_open_shared(&s, j, 0) >= 0);
+                assert_se(sd_journal_get_fd(s) == -EMEDIUMTYPE);
+                assert_se(pthread_create(threads + i, NULL, shared_thread, s) == 0);
+        }
+
+        /* The original may be used at the same time, and go away before the others are done */
+        assert_se(count_entries(j, true, NULL) == 150);
+        sd_journal_close(TAKE_PTR(j));
+
+        for (i = 0; i < ELEMENTSOF(threads); i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
 
         /* journal_file_open requires a valid machine id */
@@ -188,5 +492,11 @@ int main(int argc, char *argv[]) {
         assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "0", 1) >= 0);
         run_test();
 
+        test_append_throughput();
+
+        test_read_batch();
+        test_snapshot();
+        test_shared();
+
         return 0;
 }
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-def.h"
+#include "journal-vacuum.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define FILE_SIZE (64U * 1024U)
+#define SEQNUM_ID "0123456789abcdef0123456789abcdef"
+
+static uint64_t add_file(int dir_fd, const char *name, uint64_t n_entries) {
+        _cleanup_free_ void *buf = NULL;
+        _cleanup_close_ int fd = -1;
+        Header *h;
+        struct stat st;
+
+        /* Writes the file under a temporary name first, like journald does when archiving */
+
+        assert_se(buf = malloc0(FILE_SIZE));
+        h = buf;
+        memcpy(h->signature, HEADER_SIGNATURE, sizeof(h->signature));
+        h->n_entries = htole64(n_entries);
+
+        fd = openat(dir_fd, "new.tmp", O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+        assert_se(fd >= 0);
+        assert_se(loop_write(fd, buf, FILE_SIZE, false) >= 0);
+        assert_se(fsync(fd) >= 0);
+        assert_se(fstat(fd, &st) >= 0);
+        fd = safe_close(fd);
+
+        assert_se(renameat(dir_fd, "new.tmp", dir_fd, name) >= 0);
+
+        return 512UL * (uint64_t) st.st_blocks;
+}
+
+static char* archived_name(unsigned i) {
+        char *p;
+
+        assert_se(asprintf(&p, "system@" SEQNUM_ID "-%016x-%016x.journal", i * 100 + 1, i + 1) >= 0);
+        return p;
+}
+
+static bool file_exists(int dir_fd, const char *name) {
+        return faccessat(dir_fd, name, F_OK, AT_SYMLINK_NOFOLLOW) >= 0;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *x = NULL;
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_close_ int dir_fd = -1;
+        uint64_t usage[5], active, empty, used, avail;
+        unsigned i;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-vacuum-XXXXXX", &dir) >= 0);
+        assert_se((dir_fd = open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) >= 0);
+
+        /* Files that exist before the index is created are found by the scan... */
+        active = add_file(dir_fd, "system.journal", 1);
+        for (i = 0; i < 2; i++) {
+                _cleanup_free_ char *n = archived_name(i);
+
+                usage[i] = add_file(dir_fd, n, 1);
+        }
+
+        assert_se(journal_vacuum_index_new(dir, true, &x) >= 0);
+        assert_se(journal_vacuum_index_get_fd(x) >= 0);
+
+        assert_se(journal_vacuum_index_get_usage(x, &used, &avail) >= 0);
+        assert_se(used == active + usage[0] + usage[1]);
+
+        /* ... and later ones through inotify, an empty one as well as files we don't care about */
+        for (i = 2; i < 5; i++) {
+                _cleanup_free_ char *n = archived_name(i);
+
+                usage[i] = add_file(dir_fd, n, 1);
+        }
+        empty = add_file(dir_fd, "system@" SEQNUM_ID "-00000000000003e8-00000000000003e8.journal", 0);
+        (void) add_file(dir_fd, "unrelated.file", 1);
+
+        assert_se(journal_vacuum_index_process(x) >= 0);
+        assert_se(journal_vacuum_index_get_usage(x, &used, &avail) >= 0);
+        assert_se(used == active + empty + usage[0] + usage[1] + usage[2] + usage[3] + usage[4]);
+
+        /* Nothing to do */
+        assert_se(journal_vacuum_index_vacuum(x, 0, 0, 0, NULL, true) >= 0);
+        assert_se(file_exists(dir_fd, "system@" SEQNUM_ID "-00000000000003e8-00000000000003e8.journal"));
+
+        /* Keep four files, i.e. the active one and the three newest archived ones. The empty one goes
+         * away in any case. */
+        assert_se(journal_vacuum_index_vacuum(x, 0, 4, 0, NULL, true) >= 0);
+        assert_se(!file_exists(dir_fd, "system@" SEQNUM_ID "-00000000000003e8-00000000000003e8.journal"));
+        assert_se(file_exists(dir_fd, "system.journal"));
+        assert_se(file_exists(dir_fd, "unrelated.file"));
+
+        for (i = 0; i < 5; i++) {
+                _cleanup_free_ char *n = archived_name(i);
+
+                assert_se(file_exists(dir_fd, n) == (i >= 2));
+        }
+
+        assert_se(journal_vacuum_index_get_usage(x, &used, &avail) >= 0);
+        assert_se(used == active + usage[2] + usage[3] + usage[4]);
+
+        /* Files removed behind our back are forgotten */
+        {
+                _cleanup_free_ char *n = archived_name(2);
+
+                assert_se(unlinkat(dir_fd, n, 0) >= 0);
+        }
+
+        assert_se(journal_vacuum_index_get_usage(x, &used, &avail) >= 0);
+        assert_se(used == active + usage[3] + usage[4]);
+
+        /* Limit by size, the oldest remaining file has to go */
+        assert_se(journal_vacuum_index_vacuum(x, usage[4], 0, 0, NULL, true) >= 0);
+
+        for (i = 3; i < 5; i++) {
+                _cleanup_free_ char *n = archived_name(i);
+
+                assert_se(file_exists(dir_fd, n) == (i == 4));
+        }
+
+        assert_se(journal_vacuum_index_get_usage(x, &used, &avail) >= 0);
+        assert_se(used == active + usage[4]);
+
+        /* Once the directory is gone the index is of no use anymore */
+        dir_fd = safe_close(dir_fd);
+        assert_se(rm_rf(dir, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        dir = mfree(dir);
+        assert_se(journal_vacuum_index_process(x) == -ESTALE);
+
+        return 0;
+}
@@ -2,6 +2,7 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "chattr-util.h"
@@ -37,7 +38,7 @@ static void bit_toggle(const char *fn, uint64_t p) {
         safe_close(fd);
 }
 
-static int raw_verify(const char *fn, const char *verification_key) {
+static int raw_verify_full(const char *fn, const char *verification_key, const JournalVerifyOptions *options) {
         JournalFile *f;
         int r;
 
@@ -45,12 +46,94 @@ static int raw_verify(const char *fn, const char *verification_key) {
         if (r < 0)
                 return r;
 
-        r = journal_file_verify(f, verification_key, NULL, NULL, NULL, false);
+        r = journal_file_verify_full(f, verification_key, options, NULL, NULL, NULL);
         (void) journal_file_close(f);
 
         return r;
 }
 
+static int raw_verify(const char *fn, const char *verification_key) {
+        return raw_verify_full(fn, verification_key, &(JournalVerifyOptions) { .n_threads = 1 });
+}
+
+static void append_marker(const char *fn, const char *marker) {
+        struct iovec iovec = IOVEC_MAKE_STRING(marker);
+        struct dual_timestamp ts;
+        JournalFile *f;
+
+        assert_se(journal_file_open(-1, fn, O_RDWR, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        dual_timestamp_get(&ts);
+        assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+        (void) journal_file_close(f);
+}
+
+static uint64_t find_marker(const char *fn, const char *marker) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        uint64_t p;
+        char *buf, *m;
+
+        fd = open(fn, O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(fstat(fd, &st) >= 0);
+
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        assert_se(buf != MAP_FAILED);
+
+        m = memmem(buf, st.st_size, marker, strlen(marker));
+        assert_se(m);
+
+        /* The bit to toggle for the data object to become broken */
+        p = (uint64_t) (m - buf + strlen(marker) - 1) * 8;
+
+        assert_se(munmap(buf, st.st_size) >= 0);
+        return p;
+}
+
+static void test_threads_and_checkpoint(const char *fn) {
+        JournalVerifyOptions threads = {
+                .n_threads = 4,
+        }, checkpoint = {
+                .n_threads = 1,
+                .checkpoint_dir = "checkpoints",
+        };
+        uint64_t p;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(raw_verify_full(fn, NULL, &threads) >= 0);
+
+        /* Corruption is found by the worker threads */
+        p = find_marker(fn, "MARKER=old");
+        bit_toggle(fn, p);
+        assert_se(raw_verify(fn, NULL) < 0);
+        assert_se(raw_verify_full(fn, NULL, &threads) < 0);
+        bit_toggle(fn, p);
+
+        /* Take a checkpoint, after which what came before isn't looked at anymore */
+        assert_se(raw_verify_full(fn, NULL, &checkpoint) >= 0);
+        assert_se(access("checkpoints", F_OK) >= 0);
+
+        bit_toggle(fn, p);
+        assert_se(raw_verify(fn, NULL) < 0);
+        assert_se(raw_verify_full(fn, NULL, &checkpoint) >= 0);
+        bit_toggle(fn, p);
+
+        /* ... but what is appended is */
+        append_marker(fn, "MARKER=new");
+
+        p = find_marker(fn, "MARKER=new");
+        bit_toggle(fn, p);
+        assert_se(raw_verify_full(fn, NULL, &checkpoint) < 0);
+        bit_toggle(fn, p);
+
+        assert_se(raw_verify_full(fn, NULL, &checkpoint) >= 0);
+        checkpoint.n_threads = 4;
+        assert_se(raw_verify_full(fn, NULL, &checkpoint) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         char t[] = "/var/tmp/journal-XXXXXX";
         unsigned n;
@@ -84,7 +167,10 @@ int main(int argc, char *argv[]) {
 
                 dual_timestamp_get(&ts);
 
-                assert_se(asprintf(&test, "RANDOM=%lu", random() % RANDOM_RANGE));
+                if (n == 0)
+                        assert_se(test = strdup("MARKER=old"));
+                else
+                        assert_se(asprintf(&test, "RANDOM=%lu", random() % RANDOM_RANGE));
 
                 iovec = IOVEC_MAKE_STRING(test);
 
@@ -111,6 +197,9 @@ int main(int argc, char *argv[]) {
 
         (void) journal_file_close(f);
 
+        if (!verification_key)
+                test_threads_and_checkpoint("test.journal");
+
         if (verification_key) {
                 log_info("Toggling bits...");
 
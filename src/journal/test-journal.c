@@ -3,13 +3,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "sd-event.h"
+#include "sd-journal.h"
+
 #include "chattr-util.h"
 #include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
 #include "log.h"
+#include "memory-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
+#include "strv.h"
 #include "tests.h"
 
 static bool arg_keep = false;
@@ -157,7 +165,898 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
+static void test_bloom_filter(void) {
+        char t[] = "/var/tmp/journal-bloom-XXXXXX";
+        char buf[STRLEN("NUMBER=") + DECIMAL_STR_MAX(unsigned)];
+        unsigned i, n_false_positives = 0;
+        dual_timestamp ts;
+        JournalFile *f;
+        sd_journal *j;
+        struct iovec iovec[2];
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 200; i++) {
+                assert_se(dual_timestamp_get(&ts));
+
+                xsprintf(buf, "NUMBER=%u", i);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING("_SYSTEMD_UNIT=foo.service");
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(f->header->bloom_filter_offset == 0);
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->bloom_filter_offset != 0);
+
+        /* No false negatives, and only a few false positives */
+        for (i = 0; i < 200; i++) {
+                xsprintf(buf, "NUMBER=%u", i);
+                assert_se(journal_file_bloom_filter_test(f, journal_file_hash_data(f, buf, strlen(buf))) > 0);
+        }
+        for (i = 200; i < 2200; i++) {
+                xsprintf(buf, "NUMBER=%u", i);
+                if (journal_file_bloom_filter_test(f, journal_file_hash_data(f, buf, strlen(buf))) > 0)
+                        n_false_positives++;
+        }
+        log_info("Bloom filter false positives: %u/2000", n_false_positives);
+        assert_se(n_false_positives < 200);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        assert_se(sd_journal_add_match(j, "_SYSTEMD_UNIT=bar.service", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_add_match(j, "_SYSTEMD_UNIT=foo.service", 0) >= 0);
+        assert_se(sd_journal_add_match(j, "NUMBER=123", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_bloom_filter_full(void) {
+        char t[] = "/var/tmp/journal-bloom-full-XXXXXX";
+        char buf[STRLEN("NUMBER=") + DECIMAL_STR_MAX(unsigned)];
+        JournalMetrics metrics;
+        dual_timestamp ts;
+        JournalFile *f;
+        struct stat st;
+        unsigned i, n;
+        int r;
+
+        mkdtemp_chdir_chattr(t);
+
+        /* Most files are archived because they are full, the filter needs to fit in then too */
+        journal_reset_metrics(&metrics);
+        metrics.max_size = 1024 * 1024;
+        metrics.keep_free = 0;
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+
+        for (n = 0;; n++) {
+                struct iovec iovec = IOVEC_MAKE(buf, 0);
+
+                assert_se(dual_timestamp_get(&ts));
+
+                xsprintf(buf, "NUMBER=%u", n);
+                iovec.iov_len = strlen(buf);
+                r = journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL);
+                if (r == -E2BIG)
+                        break;
+                assert_se(r == 0);
+        }
+        log_info("File full after %u entries", n);
+        assert_se(n > 0);
+
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->bloom_filter_offset != 0);
+
+        for (i = 0; i < n; i++) {
+                xsprintf(buf, "NUMBER=%u", i);
+                assert_se(journal_file_bloom_filter_test(f, journal_file_hash_data(f, buf, strlen(buf))) > 0);
+        }
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        assert_se(fstat(f->fd, &st) >= 0);
+        assert_se((uint64_t) st.st_size <= metrics.max_size);
+
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void append_units(JournalFile *f, unsigned n, unsigned base, unsigned n_units, bool big, usec_t first[], usec_t last[]) {
+        char buf[STRLEN("UNIT=unit-") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *b = NULL;
+        struct iovec iovec[2];
+        dual_timestamp ts;
+        unsigned i, u;
+
+        /* One value that is large enough to be compressed */
+        assert_se(b = strrep("x", 1000));
+        assert_se(memcpy(b, "UNIT=", 5));
+
+        for (i = 0; i < n; i++) {
+                assert_se(dual_timestamp_get(&ts));
+
+                u = base + i % n_units;
+                xsprintf(buf, "UNIT=unit-%u", u);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING(b);
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, big && i == 0 ? 2 : 1, NULL, NULL, NULL) == 0);
+
+                if (first[u] == 0)
+                        first[u] = ts.realtime;
+                last[u] = ts.realtime;
+        }
+}
+
+static void test_field_stats(void) {
+        char t[] = "/var/tmp/journal-field-stats-XXXXXX";
+        usec_t first[4] = {}, last[4] = {};
+        JournalFieldValue *values;
+        _cleanup_set_free_free_ Set *seen = NULL;
+        FieldStatsValue v;
+        const void *data;
+        size_t size, n;
+        JournalFile *f;
+        sd_journal *j;
+        unsigned i;
+        Object *o;
+
+        mkdtemp_chdir_chattr(t);
+
+        /* Units 0 to 2 go to a file that is archived, 3 only to the active one */
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        f->stats_fields = STRV_MAKE("UNIT", "MISSING");
+        append_units(f, 90, 0, 3, true, first, last);
+
+        assert_se(f->header->field_stats_offset == 0);
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->field_stats_offset != 0);
+
+        assert_se(journal_file_find_field_stats(f, "MISSING", STRLEN("MISSING"), NULL, NULL) == 0);
+        assert_se(journal_file_find_field_stats(f, "UNI", STRLEN("UNI"), NULL, NULL) == 0);
+        assert_se(journal_file_find_field_stats(f, "UNIT", STRLEN("UNIT"), &o, NULL) == 1);
+        assert_se(le64toh(o->field_stats.n_values) == 4);
+
+        /* Sorted by value, hence the long one comes last */
+        for (i = 0; i < 4; i++) {
+                assert_se(journal_file_field_stats_value(o, i, &v) == 1);
+                assert_se(journal_file_hash_data(f, v.data, v.size) == v.hash);
+
+                if (i == 3) {
+                        assert_se(v.size == 1000);
+                        assert_se(memcmp(v.data, "UNIT=xxx", 8) == 0);
+                        assert_se(v.n_entries == 1);
+                        assert_se(v.first_realtime == v.last_realtime);
+                        assert_se(v.first_realtime == first[0]);
+                } else {
+                        char buf[STRLEN("UNIT=unit-") + DECIMAL_STR_MAX(unsigned)];
+
+                        xsprintf(buf, "UNIT=unit-%u", i);
+                        assert_se(memcmp_nn(v.data, v.size, buf, strlen(buf)) == 0);
+                        assert_se(v.n_entries == 30);
+                        assert_se(v.first_realtime == first[i]);
+                        assert_se(v.last_realtime == last[i]);
+                }
+        }
+        assert_se(journal_file_field_stats_value(o, 4, &v) == 0);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+        (void) journal_file_close(f);
+
+        /* The active file has no summary, and shares some values with the archived one */
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        append_units(f, 10, 2, 2, false, first, last);
+        assert_se(f->header->field_stats_offset == 0);
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+
+        /* Every value exactly once */
+        assert_se(sd_journal_query_unique(j, "UNIT") >= 0);
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, size) {
+                char *d;
+
+                assert_se(d = strndup(data, size));
+                assert_se(set_ensure_consume(&seen, &string_hash_ops, d) > 0);
+        }
+        assert_se(set_size(seen) == 5);
+        assert_se(set_contains(seen, "UNIT=unit-3"));
+
+        assert_se(journal_count_field_values(j, "UNIT", &values, &n) >= 0);
+        assert_se(n == 5);
+
+        /* Most frequent first */
+        assert_se(streq(values[0].value, "unit-2"));
+        assert_se(values[0].n_entries == 30 + 5);
+        assert_se(values[0].first_realtime == first[2]);
+        assert_se(values[0].last_realtime == last[2]);
+        assert_se(streq(values[1].value, "unit-0"));
+        assert_se(values[1].n_entries == 30);
+        assert_se(values[1].first_realtime == first[0]);
+        assert_se(streq(values[3].value, "unit-3"));
+        assert_se(values[3].n_entries == 5);
+        assert_se(values[4].size == 1000 - STRLEN("UNIT="));
+        assert_se(values[4].n_entries == 1);
+        journal_field_values_free(values, n);
+
+        assert_se(journal_count_field_values(j, "MISSING", &values, &n) >= 0);
+        assert_se(n == 0);
+        journal_field_values_free(values, n);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_field_stats_full(void) {
+        char t[] = "/var/tmp/journal-field-stats-full-XXXXXX";
+        char buf[STRLEN("NUMBER=") + DECIMAL_STR_MAX(unsigned)], unit[STRLEN("UNIT=unit-") + DECIMAL_STR_MAX(unsigned)];
+        uint64_t n_entries = 0;
+        JournalMetrics metrics;
+        struct iovec iovec[2];
+        FieldStatsValue v;
+        dual_timestamp ts;
+        JournalFile *f;
+        unsigned i, n;
+        Object *o;
+        int r;
+
+        mkdtemp_chdir_chattr(t);
+
+        /* Files are usually archived because they are full, the summaries need to fit in then too */
+        journal_reset_metrics(&metrics);
+        metrics.max_size = 1024 * 1024;
+        metrics.keep_free = 0;
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+        f->stats_fields = STRV_MAKE("UNIT");
+
+        for (n = 0;; n++) {
+                assert_se(dual_timestamp_get(&ts));
+
+                xsprintf(buf, "NUMBER=%u", n);
+                xsprintf(unit, "UNIT=unit-%u", n % 10);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING(unit);
+                r = journal_file_append_entry(f, &ts, NULL, iovec, 2, NULL, NULL, NULL);
+                if (r == -E2BIG)
+                        break;
+                assert_se(r == 0);
+        }
+        log_info("File full after %u entries", n);
+        assert_se(n >= 10);
+
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(f->header->field_stats_offset != 0);
+
+        assert_se(journal_file_find_field_stats(f, "UNIT", STRLEN("UNIT"), &o, NULL) == 1);
+        assert_se(le64toh(o->field_stats.n_values) == 10);
+        for (i = 0; i < 10; i++) {
+                assert_se(journal_file_field_stats_value(o, i, &v) == 1);
+                n_entries += v.n_entries;
+        }
+        assert_se(n_entries == n);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+        (void) journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_append_entries(void) {
+        char t[] = "/var/tmp/journal-batch-XXXXXX";
+        char messages[50][STRLEN("MESSAGE=") + DECIMAL_STR_MAX(unsigned)];
+        char batch[STRLEN("BATCH=") + DECIMAL_STR_MAX(unsigned)];
+        struct iovec iovec[50][3];
+        JournalFileEntry entries[50];
+        dual_timestamp ts[50];
+        unsigned i, k, n;
+        uint64_t p, q, seqnum = 0;
+        size_t n_written;
+        JournalFile *f;
+        sd_journal *j;
+        Object *o;
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Ten batches of 50 entries, each entry with one unique field, one shared within the batch and one
+         * shared by all of them, so that both the global and the per-data entry arrays need to be chained */
+        for (k = 0; k < 10; k++) {
+                xsprintf(batch, "BATCH=%u", k);
+
+                for (i = 0; i < 50; i++) {
+                        assert_se(dual_timestamp_get(&ts[i]));
+
+                        xsprintf(messages[i], "MESSAGE=%u", k * 50 + i);
+                        iovec[i][0] = IOVEC_MAKE_STRING(messages[i]);
+                        iovec[i][1] = IOVEC_MAKE_STRING(batch);
+                        iovec[i][2] = IOVEC_MAKE_STRING("COMMON=1");
+
+                        entries[i] = (JournalFileEntry) {
+                                .ts = &ts[i],
+                                .iovec = iovec[i],
+                                .n_iovec = 3,
+                        };
+                }
+
+                assert_se(journal_file_append_entries(f, entries, 50, &seqnum, &n_written) == 0);
+                assert_se(n_written == 50);
+        }
+
+        assert_se(seqnum == 500);
+        assert_se(le64toh(f->header->n_entries) == 500);
+
+        /* An invalid entry in the middle of a batch stops it there, but what came before is kept */
+        for (i = 0; i < 50; i++)
+                assert_se(dual_timestamp_get(&ts[i]));
+        ts[10].realtime = 0;
+        iovec[10][0] = IOVEC_MAKE_STRING("MESSAGE=invalid");
+        assert_se(journal_file_append_entries(f, entries, 50, &seqnum, &n_written) == -EBADMSG);
+        assert_se(n_written == 10);
+        assert_se(le64toh(f->header->n_entries) == 510);
+
+        /* The global entry array is in order */
+        for (n = 0, p = 0; journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p) > 0; n++)
+                assert_se(le64toh(o->entry.seqnum) == n + 1);
+        assert_se(n == 510);
+
+        assert_se(journal_file_find_data_object(f, "COMMON=1", STRLEN("COMMON=1"), &o, &q) == 1);
+        assert_se(le64toh(o->data.n_entries) == 510);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, q, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 510);
+
+        assert_se(journal_file_find_data_object(f, "BATCH=7", STRLEN("BATCH=7"), &o, NULL) == 1);
+        assert_se(le64toh(o->data.n_entries) == 50);
+
+        /* This also checks that the per-data entry arrays are in order */
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        assert_se(sd_journal_add_match(j, "COMMON=1", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        for (n = 0; sd_journal_next(j) > 0; n++) {
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                xsprintf(messages[0], "MESSAGE=%u", n < 500 ? n : 450 + n - 500);
+                assert_se(memcmp_nn(d, l, messages[0], strlen(messages[0])) == 0);
+        }
+        assert_se(n == 510);
+
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_add_match(j, "BATCH=3", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        for (n = 0; sd_journal_next(j) > 0; n++)
+                ;
+        assert_se(n == 50);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_append_entries_full(uint64_t max_size) {
+        char t[] = "/var/tmp/journal-batch-full-XXXXXX";
+        char messages[50][STRLEN("MESSAGE=") + DECIMAL_STR_MAX(unsigned)];
+        struct iovec iovec[50][2];
+        JournalFileEntry entries[50];
+        JournalMetrics metrics;
+        dual_timestamp ts[50];
+        size_t n_written, total = 0;
+        JournalFile *f, *g;
+        sd_journal *j;
+        unsigned i, k, n;
+        Object *o;
+        int r;
+
+        mkdtemp_chdir_chattr(t);
+
+        /* A batch that doesn't fit anymore is continued in the next file, without duplicating or losing any
+         * entries. Depending on the size limit the batch fails while appending the objects, or while linking
+         * them up. */
+        journal_reset_metrics(&metrics);
+        metrics.max_size = max_size;
+        metrics.keep_free = 0;
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+
+        for (k = 0;; k++) {
+                for (i = 0; i < 50; i++) {
+                        assert_se(dual_timestamp_get(&ts[i]));
+
+                        xsprintf(messages[i], "MESSAGE=%u", k * 50 + i);
+                        iovec[i][0] = IOVEC_MAKE_STRING(messages[i]);
+                        iovec[i][1] = IOVEC_MAKE_STRING("COMMON=1");
+
+                        entries[i] = (JournalFileEntry) {
+                                .ts = &ts[i],
+                                .iovec = iovec[i],
+                                .n_iovec = 2,
+                        };
+                }
+
+                r = journal_file_append_entries(f, entries, 50, NULL, &n_written);
+                total += n_written;
+                if (r == -E2BIG)
+                        break;
+                assert_se(r == 0);
+                assert_se(n_written == 50);
+        }
+        log_info("File of %" PRIu64 " bytes full after %zu entries", max_size, total);
+        assert_se(le64toh(f->header->n_entries) == total);
+
+        /* The entries that didn't make it are not referenced from anywhere. journal_file_verify() would
+         * still complain about them though, like after a failed journal_file_append_entry(). */
+        assert_se(journal_file_find_data_object(f, "COMMON=1", STRLEN("COMMON=1"), &o, NULL) == 1);
+        assert_se(le64toh(o->data.n_entries) == total);
+
+        assert_se(journal_file_open(-1, "next.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, f, &g) == 0);
+        assert_se(journal_file_append_entries(g, entries + n_written, 50 - n_written, NULL, &n_written) == 0);
+        assert_se(journal_file_verify(g, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+        (void) journal_file_close(g);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        for (n = 0; sd_journal_next(j) > 0; n++) {
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                xsprintf(messages[0], "MESSAGE=%u", n);
+                assert_se(memcmp_nn(d, l, messages[0], strlen(messages[0])) == 0);
+        }
+        assert_se(n == (k + 1) * 50);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_data_hash_table_growth(void) {
+        char t[] = "/var/tmp/journal-hash-XXXXXX";
+        char buf[STRLEN("NUMBER=") + DECIMAL_STR_MAX(unsigned)];
+        JournalFile *f, *g;
+        struct iovec iovec;
+        dual_timestamp ts;
+        uint64_t size;
+        unsigned i;
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        size = le64toh(f->header->data_hash_table_size);
+
+        /* Fill the hash table beyond the rotation threshold with distinct, small data objects */
+        for (i = 0; !journal_file_rotate_suggested(f, 0); i++) {
+                assert_se(dual_timestamp_get(&ts));
+                xsprintf(buf, "NUMBER=%u", i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+        log_info("Rotation suggested after %u entries", i);
+
+        /* The successor gets a larger table, and can take the same amount without asking for rotation */
+        assert_se(journal_file_open(-1, "two.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, f, &g) == 0);
+        assert_se(le64toh(g->header->data_hash_table_size) > size);
+
+        for (i = 0; i < le64toh(f->header->n_data); i++) {
+                assert_se(dual_timestamp_get(&ts));
+                xsprintf(buf, "NUMBER=%u", i);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(g, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+        assert_se(!journal_file_rotate_suggested(g, 0));
+
+        (void) journal_file_close(f);
+        (void) journal_file_close(g);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_unindexed_fields(void) {
+        char t[] = "/var/tmp/journal-unindexed-XXXXXX";
+        char buf[STRLEN("MESSAGE=") + DECIMAL_STR_MAX(unsigned)];
+        struct iovec iovec[2];
+        JournalFileEntry entry = {
+                .iovec = iovec,
+                .n_iovec = 2,
+        };
+        dual_timestamp ts;
+        JournalFile *f;
+        sd_journal *j;
+        unsigned i, n;
+        Object *o;
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        f->unindexed_fields = STRV_MAKE("MESSAGE");
+
+        for (i = 0; i < 100; i++) {
+                assert_se(dual_timestamp_get(&ts));
+
+                /* The same message twice, to make sure it's not deduplicated */
+                xsprintf(buf, "MESSAGE=%u", i / 2);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING("_SYSTEMD_UNIT=foo.service");
+
+                if (i % 2 == 0)
+                        assert_se(journal_file_append_entry(f, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+                else {
+                        entry.ts = &ts;
+                        assert_se(journal_file_append_entries(f, &entry, 1, NULL, NULL) == 0);
+                }
+        }
+
+        assert_se(JOURNAL_HEADER_UNINDEXED(f->header));
+        assert_se(le64toh(f->header->n_data) == 1);
+        assert_se(journal_file_find_data_object(f, "MESSAGE=7", STRLEN("MESSAGE=7"), NULL, NULL) == 0);
+        assert_se(journal_file_find_data_object(f, "_SYSTEMD_UNIT=foo.service", STRLEN("_SYSTEMD_UNIT=foo.service"), &o, NULL) == 1);
+        assert_se(le64toh(o->data.n_entries) == 100);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        /* Matches on unindexed fields find nothing... */
+        assert_se(sd_journal_add_match(j, "MESSAGE=7", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 0);
+
+        /* ... but the data can still be read from the entries */
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_add_match(j, "_SYSTEMD_UNIT=foo.service", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        for (n = 0; sd_journal_next(j) > 0; n++) {
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                xsprintf(buf, "MESSAGE=%u", n / 2);
+                assert_se(memcmp_nn(d, l, buf, strlen(buf)) == 0);
+        }
+        assert_se(n == 100);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+#if HAVE_ZSTD
+static void append_service_log_line(JournalFile *f, unsigned i) {
+        char buf[STRLEN("MESSAGE=Accepted connection from 10.0.255.255 port 65535, session ") + DECIMAL_STR_MAX(unsigned)];
+        struct iovec iovec[2];
+        dual_timestamp ts;
+
+        assert_se(dual_timestamp_get(&ts));
+        xsprintf(buf, "MESSAGE=Accepted connection from 10.0.%u.%u port %u, session %u", (i / 256) % 256, i % 256, 1024 + i % 60000, i);
+        iovec[0] = IOVEC_MAKE_STRING(buf);
+        iovec[1] = IOVEC_MAKE_STRING("_SYSTEMD_UNIT=sshd.service");
+        assert_se(journal_file_append_entry(f, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+}
+
+static unsigned count_compressed_data(JournalFile *f) {
+        unsigned n = 0;
+        uint64_t p;
+        Object *o;
+
+        p = le64toh(f->header->header_size);
+        for (;;) {
+                assert_se(journal_file_move_to_object(f, OBJECT_UNUSED, p, &o) == 0);
+                if (o->object.type == OBJECT_DATA && (o->object.flags & OBJECT_COMPRESSED_ZSTD))
+                        n++;
+
+                if (p == le64toh(f->header->tail_object_offset))
+                        return n;
+                p = p + ALIGN64(le64toh(o->object.size));
+        }
+}
+
+static void test_zstd_dictionary(void) {
+        char t[] = "/var/tmp/journal-zstd-dict-XXXXXX";
+        JournalFile *f, *g;
+        unsigned i = 0, n;
+        sd_journal *j;
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* The payloads are way below the compression threshold, hence nothing is compressed until there's a
+         * dictionary */
+        for (; !JOURNAL_HEADER_ZSTD_DICTIONARY(f->header); i++) {
+                assert_se(i <= 10000);
+                append_service_log_line(f, i);
+        }
+        log_info("Dictionary trained after %u entries", i);
+        assert_se(f->header->zstd_dictionary_offset != 0);
+        assert_se(count_compressed_data(f) == 0);
+
+        for (n = i + 1000; i < n; i++)
+                append_service_log_line(f, i);
+        assert_se(count_compressed_data(f) >= 1000);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        /* A successor starts out with the same dictionary */
+        assert_se(journal_file_open(-1, "two.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, f, &g) == 0);
+        assert_se(JOURNAL_HEADER_ZSTD_DICTIONARY(g->header));
+
+        for (n = i + 100; i < n; i++)
+                append_service_log_line(g, i);
+        assert_se(count_compressed_data(g) == 100);
+        assert_se(journal_file_verify(g, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+        (void) journal_file_close(g);
+
+        /* Everything reads back, whether compressed against the dictionary or not */
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        i = 0;
+        SD_JOURNAL_FOREACH(j) {
+                char buf[STRLEN("MESSAGE=Accepted connection from 10.0.255.255 port 65535, session ") + DECIMAL_STR_MAX(unsigned)];
+                const void *data;
+                size_t l;
+
+                xsprintf(buf, "MESSAGE=Accepted connection from 10.0.%u.%u port %u, session %u", (i / 256) % 256, i % 256, 1024 + i % 60000, i);
+                assert_se(sd_journal_get_data(j, "MESSAGE", &data, &l) >= 0);
+                assert_se(memcmp_nn(data, l, buf, strlen(buf)) == 0);
+                i++;
+        }
+        assert_se(i == n);
+
+        assert_se(sd_journal_add_match(j, "MESSAGE=Accepted connection from 10.0.0.42 port 1066, session 42", 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_zstd_dictionary_deferred(void) {
+        char t[] = "/var/tmp/journal-zstd-dict-deferred-XXXXXX";
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        JournalFile *f;
+        unsigned i = 0, n;
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_enable_post_change_timer(f, e, USEC_PER_MSEC) >= 0);
+
+        /* With an event loop, the write that fills up the samples doesn't wait for the training... */
+        for (; !f->zstd_train_event_source; i++) {
+                assert_se(i <= 10000);
+                append_service_log_line(f, i);
+        }
+        log_info("Dictionary training scheduled after %u entries", i);
+
+        for (n = i + 100; i < n; i++)
+                append_service_log_line(f, i);
+        assert_se(!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header));
+        assert_se(count_compressed_data(f) == 0);
+
+        /* ... which happens once the loop has nothing else to do */
+        while (f->zstd_train_event_source)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(JOURNAL_HEADER_ZSTD_DICTIONARY(f->header));
+
+        for (n = i + 100; i < n; i++)
+                append_service_log_line(f, i);
+        assert_se(count_compressed_data(f) == 100);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
 #if HAVE_COMPRESSION
+static void test_data_cache(void) {
+        char t[] = "/var/tmp/journal-data-cache-XXXXXX";
+        char cmdline[STRLEN("_CMDLINE=") + 2048 + 1], buf[STRLEN("NUMBER=") + DECIMAL_STR_MAX(unsigned)];
+        struct iovec iovec[2];
+        dual_timestamp ts;
+        const void *data;
+        JournalFile *f;
+        sd_journal *j;
+        unsigned i;
+        size_t l;
+
+        mkdtemp_chdir_chattr(t);
+
+        /* One large, well compressible field shared by all entries */
+        memset(cmdline, 'x', sizeof(cmdline) - 1);
+        memcpy(cmdline, "_CMDLINE=", STRLEN("_CMDLINE="));
+        cmdline[sizeof(cmdline) - 1] = 0;
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        for (i = 0; i < 100; i++) {
+                assert_se(dual_timestamp_get(&ts));
+                xsprintf(buf, "NUMBER=%u", i);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING(cmdline);
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+        }
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+
+        /* The object is decompressed once, and taken from the cache afterwards */
+        SD_JOURNAL_FOREACH(j) {
+                assert_se(sd_journal_get_data(j, "_CMDLINE", &data, &l) >= 0);
+                assert_se(memcmp_nn(data, l, cmdline, strlen(cmdline)) == 0);
+        }
+        assert_se(j->data_cache_misses == 1);
+        assert_se(j->data_cache_hits == 99);
+
+        /* Entries that were cut short at the threshold are not used once it is raised */
+        assert_se(sd_journal_set_data_threshold(j, 64) >= 0);
+        assert_se(sd_journal_set_data_cache_size(j, 0) >= 0);
+        assert_se(j->data_cache_size == 0);
+        assert_se(sd_journal_set_data_cache_size(j, 1024 * 1024) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_get_data(j, "_CMDLINE", &data, &l) >= 0);
+        assert_se(l >= 64 && l < strlen(cmdline));
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+        assert_se(sd_journal_get_data(j, "_CMDLINE", &data, &l) >= 0);
+        assert_se(memcmp_nn(data, l, cmdline, strlen(cmdline)) == 0);
+
+        /* Without a cache, everything still reads back fine */
+        assert_se(sd_journal_set_data_cache_size(j, 0) >= 0);
+        SD_JOURNAL_FOREACH(j) {
+                SD_JOURNAL_FOREACH_DATA(j, data, l)
+                        if (l > STRLEN("_CMDLINE=") && memcmp(data, "_CMDLINE=", STRLEN("_CMDLINE=")) == 0)
+                                assert_se(memcmp_nn(data, l, cmdline, strlen(cmdline)) == 0);
+        }
+        assert_se(j->data_cache_size == 0);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         dual_timestamp ts;
         JournalFile *f;
@@ -251,7 +1150,21 @@ int main(int argc, char *argv[]) {
 
         test_non_empty();
         test_empty();
+        test_bloom_filter();
+        test_bloom_filter_full();
+        test_field_stats();
+        test_field_stats_full();
+        test_append_entries();
+        for (uint64_t sz = 512 * 1024; sz <= 1024 * 1024; sz += 64 * 1024)
+                test_append_entries_full(sz);
+        test_data_hash_table_growth();
+        test_unindexed_fields();
+#if HAVE_ZSTD
+        test_zstd_dictionary();
+        test_zstd_dictionary_deferred();
+#endif
 #if HAVE_COMPRESSION
+        test_data_cache();
         test_min_compress_size();
 #endif
 
@@ -11,6 +11,65 @@
 #include "tmpfile-util.h"
 #include "util.h"
 
+static void test_adaptive_window(void) {
+#if !ENABLE_DEBUG_MMAP_CACHE
+        static const uint64_t jumps[] = { 200, 20, 150, 60, 230, 100, 10, 180 };
+        char path[] = "/tmp/testmmapSXXXXXX";
+        _cleanup_close_ int fd = -1, fd2 = -1;
+        MMapFileDescriptor *f;
+        uint64_t offset = 0;
+        size_t ret_size = 0, previous = 0;
+        struct stat st;
+        MMapCache *m;
+        unsigned i;
+        void *p;
+
+        assert_se(m = mmap_cache_new());
+
+        fd = mkostemp_safe(path);
+        assert_se(fd >= 0);
+        unlink(path);
+
+        /* A sparse file, so that we don't actually need the disk space */
+        assert_se(ftruncate(fd, 256ULL*1024ULL*1024ULL) >= 0);
+        assert_se(fstat(fd, &st) >= 0);
+
+        assert_se(f = mmap_cache_add_fd(m, fd));
+
+        /* Scanning forward, each miss should get a window at least as large as the previous one, starting
+         * right at the requested offset */
+        for (i = 0; i < 8; i++) {
+                assert_se(mmap_cache_get(m, f, PROT_READ, 0, false, offset, 64, &st, &p, &ret_size) > 0);
+                if (i > 0)
+                        assert_se(ret_size >= previous);
+
+                previous = ret_size;
+                offset += ret_size;
+        }
+
+        assert_se(ret_size > 8ULL*1024ULL*1024ULL);
+
+        /* Jumping around should shrink the windows again. Use a second fd for this, so that we don't hit
+         * the windows created above. */
+        mmap_cache_free_fd(m, f);
+        fd2 = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        assert_se(fd2 >= 0);
+        assert_se(f = mmap_cache_add_fd(m, fd2));
+
+        for (i = 0; i < ELEMENTSOF(jumps); i++) {
+                offset = jumps[i] * 1024ULL*1024ULL;
+                assert_se(mmap_cache_get(m, f, PROT_READ, 0, false, offset, 64, &st, &p, &ret_size) > 0);
+        }
+
+        assert_se(ret_size <= 1024ULL*1024ULL);
+
+        mmap_cache_stats_log_debug(m);
+
+        mmap_cache_free_fd(m, f);
+        mmap_cache_unref(m);
+#endif
+}
+
 int main(int argc, char *argv[]) {
         MMapFileDescriptor *fx;
         int x, y, z, r;
@@ -62,5 +121,7 @@ int main(int argc, char *argv[]) {
         safe_close(y);
         safe_close(z);
 
+        test_adaptive_window();
+
         return 0;
 }
@@ -65,6 +65,8 @@ struct sd_dhcp_server {
 
         Hashmap *leases_by_client_id;
         DHCPLease **bound_leases;
+        uint64_t *bound_map; /* one bit per pool address, set if bound_leases[] has an entry for it */
+        uint32_t n_bound;
         DHCPLease invalid_lease;
 
         uint32_t max_lease_time, default_lease_time;
@@ -263,6 +263,57 @@ bool net_match_config(Set *match_mac,
         return true;
 }
 
+int net_match_name_prefixes(char * const *match_names, char ***ret) {
+        _cleanup_strv_free_ char **prefixes = NULL;
+        char * const *p;
+        int r;
+
+        assert(ret);
+
+        /* Collects the literal leading part of every positive Name= pattern. A device can only match if its
+         * name or one of its alternative names starts with one of them, which is much cheaper to check than
+         * the whole set of conditions. If there is no positive pattern, or one starts with a wildcard, nothing
+         * can be ruled out this way and NULL is returned. */
+
+        STRV_FOREACH(p, match_names) {
+                size_t n;
+
+                if (**p == '!')
+                        continue;
+
+                n = strcspn(*p, "*?[\\");
+                if (n == 0) {
+                        *ret = NULL;
+                        return 0;
+                }
+
+                r = strv_consume(&prefixes, strndup(*p, n));
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = strv_uniq(TAKE_PTR(prefixes));
+        return 0;
+}
+
+bool net_match_name_prefixes_test(char * const *prefixes, const char *dev_name, char * const *alternative_names) {
+        char * const *p, * const *a;
+
+        if (!prefixes)
+                return true;
+
+        STRV_FOREACH(p, prefixes) {
+                if (dev_name && startswith(dev_name, *p))
+                        return true;
+
+                STRV_FOREACH(a, alternative_names)
+                        if (startswith(*a, *p))
+                                return true;
+        }
+
+        return false;
+}
+
 int config_parse_net_condition(const char *unit,
                                const char *filename,
                                unsigned line,
@@ -36,6 +36,9 @@ bool net_match_config(Set *match_mac,
                       const char *dev_ssid,
                       const struct ether_addr *dev_bssid);
 
+int net_match_name_prefixes(char * const *match_names, char ***ret);
+bool net_match_name_prefixes_test(char * const *prefixes, const char *dev_name, char * const *alternative_names);
+
 CONFIG_PARSER_PROTOTYPE(config_parse_net_condition);
 CONFIG_PARSER_PROTOTYPE(config_parse_hwaddr);
 CONFIG_PARSER_PROTOTYPE(config_parse_hwaddrs);
@@ -21,6 +21,7 @@
 
 #define DHCP_DEFAULT_LEASE_TIME_USEC USEC_PER_HOUR
 #define DHCP_MAX_LEASE_TIME_USEC (USEC_PER_HOUR*12)
+#define DHCP_SERVER_RECEIVE_BATCH_MAX 64U
 
 static DHCPLease *dhcp_lease_free(DHCPLease *lease) {
         if (!lease)
@@ -30,6 +31,94 @@ static DHCPLease *dhcp_lease_free(DHCPLease *lease) {
         return mfree(lease);
 }
 
+static void server_bind_lease(sd_dhcp_server *server, uint32_t offset, DHCPLease *lease) {
+        assert(server);
+        assert(offset < server->pool_size);
+        assert(lease);
+        assert(!server->bound_leases[offset]);
+
+        server->bound_leases[offset] = lease;
+        server->bound_map[offset / 64] |= UINT64_C(1) << (offset % 64);
+        server->n_bound++;
+}
+
+static void server_unbind_lease(sd_dhcp_server *server, uint32_t offset) {
+        DHCPLease *lease;
+
+        assert(server);
+        assert(offset < server->pool_size);
+
+        lease = TAKE_PTR(server->bound_leases[offset]);
+        assert(lease);
+        assert(lease != &server->invalid_lease);
+
+        server->bound_map[offset / 64] &= ~(UINT64_C(1) << (offset % 64));
+        server->n_bound--;
+
+        hashmap_remove(server->leases_by_client_id, &lease->client_id);
+        dhcp_lease_free(lease);
+}
+
+static int server_lease_expired(sd_dhcp_server *server, DHCPLease *lease) {
+        usec_t time_now;
+        int r;
+
+        assert(server);
+
+        if (!lease || lease == &server->invalid_lease)
+                return false;
+
+        r = sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now);
+        if (r < 0)
+                return r;
+
+        return lease->expiration < time_now;
+}
+
+/* Returns the offset of a free address in the pool, preferably the one at or after the given offset. The
+ * bitmap is looked at 64 addresses at a time, so this stays cheap even on big and mostly used pools. */
+static int server_find_free_offset(sd_dhcp_server *server, uint32_t start) {
+        size_t n_words, i;
+        int r;
+
+        assert(server);
+        assert(start < server->pool_size);
+
+        if (server->n_bound < server->pool_size) {
+                n_words = DIV_ROUND_UP(server->pool_size, 64);
+
+                for (i = 0; i <= n_words; i++) {
+                        size_t w = (start / 64 + i) % n_words;
+                        uint64_t free_bits = ~server->bound_map[w];
+
+                        /* In the first word, skip the addresses before the preferred one, they are
+                         * looked at again once we wrap around. */
+                        if (i == 0)
+                                free_bits &= UINT64_MAX << (start % 64);
+
+                        /* Mask out the bits beyond the end of the pool */
+                        if (w == n_words - 1 && server->pool_size % 64 != 0)
+                                free_bits &= (UINT64_C(1) << (server->pool_size % 64)) - 1;
+
+                        if (free_bits != 0)
+                                return w * 64 + __builtin_ctzll(free_bits);
+                }
+        }
+
+        /* The pool is exhausted, grab the first expired lease instead */
+        for (i = 0; i < server->pool_size; i++) {
+                r = server_lease_expired(server, server->bound_leases[i]);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        server_unbind_lease(server, i);
+                        return i;
+                }
+        }
+
+        return -ENOSPC;
+}
+
 /* configures the server's address and subnet, and optionally the pool's size and offset into the subnet
  * the whole pool must fit into the subnet, and may not contain the first (any) nor last (broadcast) address
  * moreover, the server's own address may be in the pool, and is in that case reserved in order not to
@@ -81,11 +170,21 @@ int sd_dhcp_server_configure_pool(
 
         if (server->address != address->s_addr || server->netmask != netmask || server->pool_size != size || server->pool_offset != offset) {
 
-                free(server->bound_leases);
-                server->bound_leases = new0(DHCPLease*, size);
-                if (!server->bound_leases)
+                _cleanup_free_ DHCPLease **bound_leases = NULL;
+                _cleanup_free_ uint64_t *bound_map = NULL;
+
+                bound_leases = new0(DHCPLease*, size);
+                if (!bound_leases)
+                        return -ENOMEM;
+
+                bound_map = new0(uint64_t, DIV_ROUND_UP(size, 64));
+                if (!bound_map)
                         return -ENOMEM;
 
+                free_and_replace(server->bound_leases, bound_leases);
+                free_and_replace(server->bound_map, bound_map);
+                server->n_bound = 0;
+
                 server->pool_offset = offset;
                 server->pool_size = size;
 
@@ -94,7 +193,7 @@ int sd_dhcp_server_configure_pool(
                 server->subnet = address->s_addr & netmask;
 
                 if (server_off >= offset && server_off - offset < size)
-                        server->bound_leases[server_off - offset] = &server->invalid_lease;
+                        server_bind_lease(server, server_off - offset, &server->invalid_lease);
 
                 /* Drop any leases associated with the old address range */
                 hashmap_clear(server->leases_by_client_id);
@@ -157,6 +256,7 @@ static sd_dhcp_server *dhcp_server_free(sd_dhcp_server *server) {
         ordered_hashmap_free(server->vendor_options);
 
         free(server->bound_leases);
+        free(server->bound_map);
         return mfree(server);
 }
 
@@ -741,7 +841,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
         case DHCP_DISCOVER: {
                 be32_t address = INADDR_ANY;
-                unsigned i;
 
                 log_dhcp_server(server, "DISCOVER (0x%x)",
                                 be32toh(req->message->xid));
@@ -756,7 +855,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 else {
                         struct siphash state;
                         uint64_t hash;
-                        uint32_t next_offer;
+                        int next_offer;
 
                         /* even with no persistence of leases, we try to offer the same client
                            the same IP address. we do this by using the hash of the client id
@@ -765,21 +864,18 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         siphash24_init(&state, HASH_KEY.bytes);
                         client_id_hash_func(&req->client_id, &state);
                         hash = htole64(siphash24_finalize(&state));
-                        next_offer = hash % server->pool_size;
-
-                        for (i = 0; i < server->pool_size; i++) {
-                                if (!server->bound_leases[next_offer]) {
-                                        address = server->subnet | htobe32(server->pool_offset + next_offer);
-                                        break;
-                                }
 
-                                next_offer = (next_offer + 1) % server->pool_size;
+                        next_offer = server_find_free_offset(server, hash % server->pool_size);
+                        if (next_offer == -ENOSPC) {
+                                log_dhcp_server(server, "No free address left in pool, all %" PRIu32 " addresses are bound.",
+                                                server->n_bound);
+                                return 0;
                         }
-                }
+                        if (next_offer < 0)
+                                return next_offer;
 
-                if (address == INADDR_ANY)
-                        /* no free addresses left */
-                        return 0;
+                        address = server->subnet | htobe32(server->pool_offset + next_offer);
+                }
 
                 r = server_send_offer(server, req, address);
                 if (r < 0)
@@ -848,6 +944,16 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
                 pool_offset = get_pool_offset(server, address);
 
+                /* an expired lease of another client does not keep the address from being handed out */
+                if (pool_offset >= 0 &&
+                    server->bound_leases[pool_offset] != existing_lease) {
+                        r = server_lease_expired(server, server->bound_leases[pool_offset]);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                server_unbind_lease(server, pool_offset);
+                }
+
                 /* verify that the requested address is from the pool, and either
                    owned by the current client or free */
                 if (pool_offset >= 0 &&
@@ -897,9 +1003,11 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                 log_dhcp_server(server, "ACK (0x%x)",
                                                 be32toh(req->message->xid));
 
-                                server->bound_leases[pool_offset] = lease;
-                                hashmap_put(server->leases_by_client_id,
-                                            &lease->client_id, lease);
+                                if (!existing_lease) {
+                                        server_bind_lease(server, pool_offset, lease);
+                                        hashmap_put(server->leases_by_client_id,
+                                                    &lease->client_id, lease);
+                                }
 
                                 if (server->callback)
                                         server->callback(server, SD_DHCP_SERVER_EVENT_LEASE_CHANGED, server->callback_userdata);
@@ -937,9 +1045,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         return 0;
 
                 if (server->bound_leases[pool_offset] == existing_lease) {
-                        server->bound_leases[pool_offset] = NULL;
-                        hashmap_remove(server->leases_by_client_id, existing_lease);
-                        dhcp_lease_free(existing_lease);
+                        server_unbind_lease(server, pool_offset);
 
                         if (server->callback)
                                 server->callback(server, SD_DHCP_SERVER_EVENT_LEASE_CHANGED, server->callback_userdata);
@@ -951,11 +1057,9 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
         return 0;
 }
 
-static int server_receive_message(sd_event_source *s, int fd,
-                                  uint32_t revents, void *userdata) {
+static int server_receive_one(sd_dhcp_server *server, int fd) {
         _cleanup_free_ DHCPMessage *message = NULL;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct in_pktinfo))) control;
-        sd_dhcp_server *server = userdata;
         struct iovec iov = {};
         struct msghdr msg = {
                 .msg_iov = &iov,
@@ -970,6 +1074,8 @@ static int server_receive_message(sd_event_source *s, int fd,
         assert(server);
 
         buflen = next_datagram_size_fd(fd);
+        if (IN_SET(buflen, -EAGAIN, -EINTR))
+                return 0;
         if (buflen < 0)
                 return buflen;
 
@@ -979,13 +1085,13 @@ static int server_receive_message(sd_event_source *s, int fd,
 
         iov = IOVEC_MAKE(message, buflen);
 
-        len = recvmsg_safe(fd, &msg, 0);
+        len = recvmsg_safe(fd, &msg, MSG_DONTWAIT);
         if (IN_SET(len, -EAGAIN, -EINTR))
                 return 0;
         if (len < 0)
                 return len;
         if ((size_t) len < sizeof(DHCPMessage))
-                return 0;
+                return 1;
 
         CMSG_FOREACH(cmsg, &msg) {
                 if (cmsg->cmsg_level == IPPROTO_IP &&
@@ -996,7 +1102,7 @@ static int server_receive_message(sd_event_source *s, int fd,
                         /* TODO figure out if this can be done as a filter on
                          * the socket, like for IPv6 */
                         if (server->ifindex != info->ipi_ifindex)
-                                return 0;
+                                return 1;
 
                         break;
                 }
@@ -1006,6 +1112,24 @@ static int server_receive_message(sd_event_source *s, int fd,
         if (r < 0)
                 log_dhcp_server_errno(server, r, "Couldn't process incoming message: %m");
 
+        return 1;
+}
+
+static int server_receive_message(sd_event_source *s, int fd,
+                                  uint32_t revents, void *userdata) {
+        sd_dhcp_server *server = userdata;
+        int r;
+
+        assert(server);
+
+        /* When many clients boot at once, handle a bunch of queued requests per wakeup instead of going
+         * through the event loop for each of them. Stop after a while, to not starve other event sources. */
+        for (unsigned i = 0; i < DHCP_SERVER_RECEIVE_BATCH_MAX; i++) {
+                r = server_receive_one(server, fd);
+                if (r <= 0)
+                        return r;
+        }
+
         return 0;
 }
 
@@ -11,6 +11,7 @@
 
 #include "dhcp-server-internal.h"
 #include "tests.h"
+#include "unaligned.h"
 
 static void test_pool(struct in_addr *address, unsigned size, int ret) {
         _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
@@ -181,6 +182,96 @@ static void test_message_handler(void) {
         assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
 }
 
+static void test_pool_exhaustion(void) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
+        struct {
+                DHCPMessage message;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        uint8_t type;
+                } _packed_ option_type;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_requested_ip;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_server_id;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        uint8_t id[7];
+                } _packed_ option_client_id;
+                uint8_t end;
+        } _packed_ test = {
+                .message.op = BOOTREQUEST,
+                .message.htype = ARPHRD_ETHER,
+                .message.hlen = ETHER_ADDR_LEN,
+                .message.xid = htobe32(0x12345678),
+                .message.chaddr = { 'A', 'B', 'C', 'D', 'E', 'F' },
+                .option_type.code = SD_DHCP_OPTION_MESSAGE_TYPE,
+                .option_type.length = 1,
+                .option_requested_ip.code = SD_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+                .option_requested_ip.length = 4,
+                .option_server_id.code = SD_DHCP_OPTION_SERVER_IDENTIFIER,
+                .option_server_id.length = 4,
+                .option_server_id.address = htobe32(INADDR_LOOPBACK),
+                .option_client_id.code = SD_DHCP_OPTION_CLIENT_IDENTIFIER,
+                .option_client_id.length = 7,
+                .option_client_id.id = { 0x01, 'A', 'B', 'C', 'D', 0, 0 },
+                .end = SD_DHCP_OPTION_END,
+        };
+        struct in_addr address_lo = {
+                .s_addr = htonl(INADDR_LOOPBACK),
+        };
+
+        /* 130 addresses, the first one is our own, so the bitmap spans three words */
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 8, 0, 130) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+        assert_se(server->n_bound == 1);
+
+        for (unsigned i = 1; i < 130; i++) {
+                unaligned_write_be16(test.option_client_id.id + 5, i);
+
+                test.option_type.type = DHCP_DISCOVER;
+                assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_OFFER);
+
+                test.option_type.type = DHCP_REQUEST;
+                test.option_requested_ip.address = htobe32(INADDR_LOOPBACK + i);
+                assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+        }
+
+        assert_se(server->n_bound == 130);
+
+        /* No address left for a new client */
+        unaligned_write_be16(test.option_client_id.id + 5, 1000);
+        test.option_type.type = DHCP_DISCOVER;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
+
+        /* … until one is released */
+        unaligned_write_be16(test.option_client_id.id + 5, 100);
+        test.option_type.type = DHCP_RELEASE;
+        test.message.ciaddr = htobe32(INADDR_LOOPBACK + 100);
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
+        test.message.ciaddr = 0;
+        assert_se(server->n_bound == 129);
+        assert_se(!server->bound_leases[100]);
+
+        unaligned_write_be16(test.option_client_id.id + 5, 1000);
+        test.option_type.type = DHCP_DISCOVER;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_OFFER);
+        test.option_type.type = DHCP_REQUEST;
+        test.option_requested_ip.address = htobe32(INADDR_LOOPBACK + 100);
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == DHCP_ACK);
+        assert_se(server->n_bound == 130);
+}
+
 static uint64_t client_id_hash_helper(DHCPClientId *id, uint8_t key[HASH_KEY_SIZE]) {
         struct siphash state;
 
@@ -239,6 +330,7 @@ int main(int argc, char *argv[]) {
                 return log_tests_skipped("cannot start dhcp server");
 
         test_message_handler();
+        test_pool_exhaustion();
         test_client_id_hash();
 
         return 0;
@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "bus-concurrent.h"
+#include "bus-message.h"
+#include "hashmap.h"
+#include "list.h"
+#include "string-util.h"
+
+typedef struct BusConcurrentCall BusConcurrentCall;
+typedef struct BusConcurrentQueue BusConcurrentQueue;
+
+struct BusConcurrentCall {
+        sd_bus *bus;
+        BusConcurrentQueue *queue;
+
+        sd_bus_message *call;
+        sd_bus_slot *slot;
+        sd_bus_message_handler_t handler;
+        void *userdata;
+
+        sd_event_source *work_source;
+
+        /* Only touched by the worker thread while the handler runs, and by the event loop thread after that */
+        sd_bus_error error;
+        sd_bus_message **messages;
+        size_t n_messages, n_messages_allocated;
+
+        LIST_FIELDS(BusConcurrentCall, calls);
+};
+
+/* The calls received from one sender, the first one is the one that is executed right now */
+struct BusConcurrentQueue {
+        sd_bus *bus;
+        char *sender;
+
+        LIST_HEAD(BusConcurrentCall, calls);
+};
+
+/* The call the handler running on this thread is executed for */
+static thread_local BusConcurrentCall *current_call = NULL;
+
+static BusConcurrentCall* concurrent_call_free(BusConcurrentCall *c) {
+        size_t i;
+
+        if (!c)
+                return NULL;
+
+        if (c->queue)
+                LIST_REMOVE(calls, c->queue->calls, c);
+
+        /* If the handler is running right now, this waits for it to return */
+        sd_event_source_disable_unref(c->work_source);
+
+        for (i = 0; i < c->n_messages; i++)
+                sd_bus_message_unref(c->messages[i]);
+        free(c->messages);
+
+        sd_bus_error_free(&c->error);
+        sd_bus_slot_unref(c->slot);
+        sd_bus_message_unref(c->call);
+
+        return mfree(c);
+}
+
+static BusConcurrentQueue* concurrent_queue_free(BusConcurrentQueue *q) {
+        if (!q)
+                return NULL;
+
+        while (q->calls)
+                concurrent_call_free(q->calls);
+
+        hashmap_remove(q->bus->concurrent_queues, q->sender);
+        free(q->sender);
+
+        return mfree(q);
+}
+
+static int concurrent_call_work(void *userdata) {
+        BusConcurrentCall *c = userdata;
+        int r;
+
+        /* Runs on a worker thread */
+
+        current_call = c;
+        r = c->handler(c->call, c->userdata, &c->error);
+        current_call = NULL;
+
+        return r;
+}
+
+static void concurrent_queue_next(BusConcurrentQueue *q);
+
+static int concurrent_call_complete(sd_event_source *s, int result, void *userdata) {
+        BusConcurrentCall *c = userdata;
+        bool replied = false;
+        size_t i;
+        int r;
+
+        assert(c);
+        assert(c->queue);
+
+        /* Let the next call of the same sender run already, its messages are sent only once it returned,
+         * i.e. after ours */
+        LIST_REMOVE(calls, c->queue->calls, c);
+        concurrent_queue_next(TAKE_PTR(c->queue));
+
+        for (i = 0; i < c->n_messages; i++) {
+                if (c->messages[i]->reply_cookie == BUS_MESSAGE_COOKIE(c->call))
+                        replied = true;
+
+                r = sd_bus_send(c->bus, c->messages[i], NULL);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to send message queued by concurrent method call handler, ignoring: %m");
+        }
+
+        if (!replied)
+                (void) bus_maybe_reply_error(c->call, result, &c->error);
+
+        c->work_source = sd_event_source_unref(c->work_source);
+        concurrent_call_free(c);
+
+        return 0;
+}
+
+static int concurrent_call_start(BusConcurrentCall *c) {
+        int r;
+
+        assert(c);
+        assert(c->bus->event);
+
+        r = sd_event_add_work(c->bus->event, &c->work_source, concurrent_call_work, concurrent_call_complete, c);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_priority(c->work_source, c->bus->event_priority);
+        (void) sd_event_source_set_description(c->work_source, "bus-concurrent-call");
+
+        return 0;
+}
+
+static void concurrent_queue_next(BusConcurrentQueue *q) {
+        BusConcurrentCall *c;
+        int r;
+
+        assert(q);
+
+        while ((c = q->calls)) {
+                r = concurrent_call_start(c);
+                if (r >= 0)
+                        return;
+
+                (void) bus_maybe_reply_error(c->call, r, NULL);
+                concurrent_call_free(c);
+        }
+
+        concurrent_queue_free(q);
+}
+
+int bus_concurrent_call_enqueue(
+                sd_bus *bus,
+                sd_bus_message *m,
+                sd_bus_slot *slot,
+                sd_bus_message_handler_t handler,
+                void *userdata) {
+
+        BusConcurrentQueue *q;
+        BusConcurrentCall *c;
+        int r;
+
+        assert(bus);
+        assert(bus->event);
+        assert(m);
+        assert(slot);
+        assert(handler);
+
+        q = hashmap_get(bus->concurrent_queues, strempty(m->sender));
+        if (!q) {
+                _cleanup_free_ BusConcurrentQueue *n = NULL;
+                _cleanup_free_ char *sender = NULL;
+
+                sender = strdup(strempty(m->sender));
+                if (!sender)
+                        return -ENOMEM;
+
+                n = new(BusConcurrentQueue, 1);
+                if (!n)
+                        return -ENOMEM;
+
+                *n = (BusConcurrentQueue) {
+                        .bus = bus,
+                        .sender = sender,
+                };
+
+                r = hashmap_ensure_allocated(&bus->concurrent_queues, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(bus->concurrent_queues, sender, n);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(sender);
+                q = TAKE_PTR(n);
+        }
+
+        c = new(BusConcurrentCall, 1);
+        if (!c) {
+                if (!q->calls)
+                        concurrent_queue_free(q);
+                return -ENOMEM;
+        }
+
+        *c = (BusConcurrentCall) {
+                .bus = bus,
+                .queue = q,
+                .call = sd_bus_message_ref(m),
+                .slot = sd_bus_slot_ref(slot),
+                .handler = handler,
+                .userdata = userdata,
+                .error = SD_BUS_ERROR_NULL,
+        };
+
+        LIST_APPEND(calls, q->calls, c);
+
+        if (q->calls == c) {
+                r = concurrent_call_start(c);
+                if (r < 0) {
+                        concurrent_queue_free(q);
+                        return r;
+                }
+        }
+
+        return 1;
+}
+
+int bus_concurrent_call_capture(sd_bus *bus, sd_bus_message *m, uint64_t *cookie) {
+        BusConcurrentCall *c = current_call;
+
+        assert(bus);
+        assert(m);
+
+        /* Called from sd_bus_send(), returns > 0 if the message was queued instead of being sent right away,
+         * since it was sent from a concurrent method call handler */
+
+        if (!c || c->bus != bus)
+                return 0;
+
+        /* The cookie is only assigned once the message is sent for real */
+        if (cookie)
+                return -EBUSY;
+
+        if (!GREEDY_REALLOC(c->messages, c->n_messages_allocated, c->n_messages + 1))
+                return -ENOMEM;
+
+        c->messages[c->n_messages++] = sd_bus_message_ref(m);
+        return 1;
+}
+
+bool bus_concurrent_call_running(sd_bus *bus) {
+        assert(bus);
+
+        return current_call && current_call->bus == bus;
+}
+
+void bus_concurrent_call_flush(sd_bus *bus) {
+        BusConcurrentQueue *q;
+
+        assert(bus);
+
+        /* Drops all calls that didn't complete yet, waiting for the handlers that are running right now.
+         * If the connection is still open, they are answered with an error. */
+
+        while ((q = hashmap_first(bus->concurrent_queues))) {
+                BusConcurrentCall *c;
+
+                LIST_FOREACH(calls, c, q->calls) {
+                        c->work_source = sd_event_source_disable_unref(c->work_source);
+
+                        if (BUS_IS_OPEN(bus->state))
+                                (void) bus_maybe_reply_error(c->call, -ECANCELED, NULL);
+                }
+
+                concurrent_queue_free(q);
+        }
+}
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "sd-bus.h"
+
+#include "bus-internal.h"
+
+/* Method calls to vtable entries marked SD_BUS_VTABLE_METHOD_CONCURRENT are executed on the sd-event worker
+ * pool, if the connection is attached to an event loop. Calls from the same sender are executed one after
+ * the other in the order they were received. Messages the handler sends on the connection (i.e. its reply)
+ * are collected, and are sent from the event loop thread once the handler returned. */
+
+int bus_concurrent_call_enqueue(
+                sd_bus *bus,
+                sd_bus_message *m,
+                sd_bus_slot *slot,
+                sd_bus_message_handler_t handler,
+                void *userdata);
+
+int bus_concurrent_call_capture(sd_bus *bus, sd_bus_message *m, uint64_t *cookie);
+bool bus_concurrent_call_running(sd_bus *bus);
+
+void bus_concurrent_call_flush(sd_bus *bus);
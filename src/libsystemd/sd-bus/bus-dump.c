@@ -9,6 +9,7 @@
 #include "bus-type.h"
 #include "cap-list.h"
 #include "capability-util.h"
+#include "errno-util.h"
 #include "fileio.h"
 #include "format-util.h"
 #include "locale-util.h"
@@ -588,5 +589,10 @@ int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f) {
                 snaplen -= w;
         }
 
-        return fflush_and_check(f);
+        /* Don't flush here, when capturing a busy bus that would mean a write() for every single
+         * message. The caller should flush whenever it runs out of messages to process. */
+        if (ferror(f))
+                return errno_or_else(EIO);
+
+        return 0;
 }
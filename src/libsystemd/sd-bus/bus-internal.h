@@ -102,6 +102,11 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* The properties to include in GetAll() replies and other generic dumps, collected when the vtable
+         * is registered, so that we don't have to walk and filter the whole vtable each time. */
+        const sd_bus_vtable **get_all;
+        size_t n_get_all;
+
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
@@ -211,14 +216,21 @@ struct sd_bus {
         bool watch_bind:1;
         bool is_monitor:1;
         bool accept_fd:1;
+        bool accept_memfd:1;
+        bool can_memfd:1;
         bool attach_timestamp:1;
         bool connected_signal:1;
         bool close_on_exit:1;
 
+        /* How many times sd_bus_process() is called per wakeup of the event loop, see
+         * sd_bus_set_process_batch() */
+        unsigned process_batch_max;
+
         signed int use_memfd:2;
 
         void *rbuffer;
         size_t rbuffer_size;
+        size_t rbuffer_allocated;
 
         sd_bus_message **rqueue;
         size_t rqueue_size;
@@ -229,6 +241,14 @@ struct sd_bus {
         size_t windex;
         size_t wqueue_allocated;
 
+        /* Scratch array that the iovecs of the queued messages are collected in for writing, see
+         * bus_socket_write_messages() */
+        struct iovec *wiovec;
+        size_t wiovec_allocated;
+
+        uint64_t n_write_calls;
+        uint64_t n_written_messages;
+
         uint64_t cookie;
         uint64_t read_counter; /* A counter for each incoming msg */
 
@@ -244,6 +264,9 @@ struct sd_bus {
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
 
+        /* Per sender queues of concurrent method calls, see bus-concurrent.h */
+        Hashmap *concurrent_queues;
+
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
 
@@ -259,7 +282,7 @@ struct sd_bus {
 
         enum bus_auth auth;
         unsigned auth_index;
-        struct iovec auth_iovec[3];
+        struct iovec auth_iovec[4];
         size_t auth_rbegin;
         char *auth_buffer;
         usec_t auth_timeout;
@@ -53,9 +53,58 @@ static bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
-                (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
-                (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
+        /* Everything but the sender, which needs to take well-known names into account. For the pattern matches
+         * we look up all prefixes of the tested value that could match, see bus_match_run_prefixes(). */
+        return t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_ARG_HAS_LAST;
+}
+
+static bool BUS_MATCH_IS_PATTERN(enum bus_match_node_type t) {
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_PATH && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
+}
+
+/* Up to this many patterns are checked one by one, which is cheaper than looking up all prefixes of the value */
+#define BUS_MATCH_PATTERN_SCAN_MAX 16U
+
+/* The arguments of the message, parsed on first use, so that they are not parsed again for every compare node
+ * that looks at them while running the matches for one message */
+typedef struct BusMatchKeys {
+        uint64_t args_read, strvs_read;
+        const char *args[BUS_MATCH_ARG_LAST - BUS_MATCH_ARG + 1];
+        char **strvs[BUS_MATCH_ARG_HAS_LAST - BUS_MATCH_ARG_HAS + 1];
+} BusMatchKeys;
+
+static void bus_match_keys_done(BusMatchKeys *keys) {
+        unsigned i;
+
+        assert(keys);
+
+        for (i = 0; i < ELEMENTSOF(keys->strvs); i++)
+                strv_free(keys->strvs[i]);
+}
+
+static const char* bus_match_keys_get_arg(BusMatchKeys *keys, sd_bus_message *m, unsigned i) {
+        assert(keys);
+        assert(i < ELEMENTSOF(keys->args));
+
+        if (!FLAGS_SET(keys->args_read, UINT64_C(1) << i)) {
+                (void) bus_message_get_arg(m, i, &keys->args[i]);
+                keys->args_read |= UINT64_C(1) << i;
+        }
+
+        return keys->args[i];
+}
+
+static char** bus_match_keys_get_arg_strv(BusMatchKeys *keys, sd_bus_message *m, unsigned i) {
+        assert(keys);
+        assert(i < ELEMENTSOF(keys->strvs));
+
+        if (!FLAGS_SET(keys->strvs_read, UINT64_C(1) << i)) {
+                (void) bus_message_get_arg_strv(m, i, &keys->strvs[i]);
+                keys->strvs_read |= UINT64_C(1) << i;
+        }
+
+        return keys->strvs[i];
 }
 
 static void bus_match_node_free(struct bus_match_node *node) {
@@ -239,17 +288,110 @@ static bool value_node_same(
         }
 }
 
-int bus_match_run(
+static int bus_match_run_node(
                 sd_bus *bus,
                 struct bus_match_node *node,
-                sd_bus_message *m) {
+                sd_bus_message *m,
+                BusMatchKeys *keys);
+
+static int bus_match_run_scan(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m,
+                BusMatchKeys *keys,
+                const char *value) {
+
+        struct bus_match_node *c;
+        int r;
+
+        assert(node);
+
+        HASHMAP_FOREACH(c, node->compare.children) {
+                if (!value_node_test(c, node->type, 0, value, NULL, m))
+                        continue;
+
+                r = bus_match_run_node(bus, c, m, keys);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return 0;
+}
 
-        _cleanup_strv_free_ char **test_strv = NULL;
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m,
+                BusMatchKeys *keys,
+                const char *value,
+                char separator,
+                bool simple) {
+
+        _cleanup_free_ char *buf = NULL;
+        size_t i, l;
+        int r;
+
+        assert(node);
+        assert(value);
+
+        /* Runs the value nodes of a pattern match whose values might match the specified value, i.e. the
+         * prefixes of the value that end at a label boundary. With simple set this follows the rules of
+         * simple_pattern_check(), otherwise those of complex_pattern_check(), except for patterns that have
+         * the value as prefix, which our caller needs to take care of.
+         *
+         * This means a handful of hash table lookups per message, instead of a pattern check against each
+         * registered match. */
+
+        l = strlen(value);
+        buf = memdup(value, l + 1);
+        if (!buf)
+                return -ENOMEM;
+
+        for (i = 0; i <= l; i++) {
+                struct bus_match_node *found;
+                char c;
+
+                if (i < l) {
+                        if (simple ? value[i] != separator && (i == 0 || value[i-1] != separator) :
+                                     i == 0 || value[i-1] != separator)
+                                continue;
+                }
+
+                c = buf[i];
+                buf[i] = 0;
+                found = hashmap_get(node->compare.children, buf);
+                buf[i] = c;
+
+                if (!found)
+                        continue;
+
+                r = bus_match_run_node(bus, found, m, keys);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return 0;
+}
+
+static int bus_match_run_node(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m,
+                BusMatchKeys *keys) {
+
+        char **test_strv = NULL;
         const char *test_str = NULL;
         uint8_t test_u8 = 0;
         int r;
 
         assert(m);
+        assert(keys);
 
         if (!node)
                 return 0;
@@ -258,8 +400,8 @@ int bus_match_run(
                 return 0;
 
         /* Not these special semantics: when traversing the tree we
-         * usually let bus_match_run() when called for a node
-         * recursively invoke bus_match_run(). There's are two
+         * usually let bus_match_run_node() when called for a node
+         * recursively invoke bus_match_run_node(). There's are two
          * exceptions here though, which are BUS_NODE_ROOT (which
          * cannot have a sibling), and BUS_NODE_VALUE (whose siblings
          * are invoked anyway by its parent. */
@@ -272,7 +414,7 @@ int bus_match_run(
                  * we won't call any. The children of the root node
                  * are compares or leaves, they will automatically
                  * call their siblings. */
-                return bus_match_run(bus, node->child, m);
+                return bus_match_run_node(bus, node->child, m, keys);
 
         case BUS_MATCH_VALUE:
 
@@ -282,7 +424,7 @@ int bus_match_run(
                  * automatically call their siblings */
 
                 assert(node->child);
-                return bus_match_run(bus, node->child, m);
+                return bus_match_run_node(bus, node->child, m, keys);
 
         case BUS_MATCH_LEAF:
 
@@ -296,7 +438,7 @@ int bus_match_run(
                         if (node->leaf.callback->install_slot ||
                             m->read_counter <= node->leaf.callback->after ||
                             node->leaf.callback->last_iteration == bus->iteration_counter)
-                                return bus_match_run(bus, node->next, m);
+                                return bus_match_run_node(bus, node->next, m, keys);
 
                         node->leaf.callback->last_iteration = bus->iteration_counter;
                 }
@@ -331,7 +473,7 @@ int bus_match_run(
                                 return 0;
                 }
 
-                return bus_match_run(bus, node->next, m);
+                return bus_match_run_node(bus, node->next, m, keys);
 
         case BUS_MATCH_MESSAGE_TYPE:
                 test_u8 = m->header->type;
@@ -360,19 +502,19 @@ int bus_match_run(
                 break;
 
         case BUS_MATCH_ARG ... BUS_MATCH_ARG_LAST:
-                (void) bus_message_get_arg(m, node->type - BUS_MATCH_ARG, &test_str);
+                test_str = bus_match_keys_get_arg(keys, m, node->type - BUS_MATCH_ARG);
                 break;
 
         case BUS_MATCH_ARG_PATH ... BUS_MATCH_ARG_PATH_LAST:
-                (void) bus_message_get_arg(m, node->type - BUS_MATCH_ARG_PATH, &test_str);
+                test_str = bus_match_keys_get_arg(keys, m, node->type - BUS_MATCH_ARG_PATH);
                 break;
 
         case BUS_MATCH_ARG_NAMESPACE ... BUS_MATCH_ARG_NAMESPACE_LAST:
-                (void) bus_message_get_arg(m, node->type - BUS_MATCH_ARG_NAMESPACE, &test_str);
+                test_str = bus_match_keys_get_arg(keys, m, node->type - BUS_MATCH_ARG_NAMESPACE);
                 break;
 
         case BUS_MATCH_ARG_HAS ... BUS_MATCH_ARG_HAS_LAST:
-                (void) bus_message_get_arg_strv(m, node->type - BUS_MATCH_ARG_HAS, &test_strv);
+                test_strv = bus_match_keys_get_arg_strv(keys, m, node->type - BUS_MATCH_ARG_HAS);
                 break;
 
         default:
@@ -384,7 +526,24 @@ int bus_match_run(
 
                 /* Lookup via hash table, nice! So let's jump directly. */
 
-                if (test_str)
+                if (test_str && BUS_MATCH_IS_PATTERN(node->type)) {
+                        bool arg_path = node->type >= BUS_MATCH_ARG_PATH && node->type <= BUS_MATCH_ARG_PATH_LAST;
+
+                        /* With only a few patterns, or if patterns that have the value as prefix match too,
+                         * simply check them all */
+                        if (hashmap_size(node->compare.children) <= BUS_MATCH_PATTERN_SCAN_MAX ||
+                            (arg_path && endswith(test_str, "/")))
+                                r = bus_match_run_scan(bus, node, m, keys, test_str);
+                        else
+                                r = bus_match_run_prefixes(bus, node, m, keys, test_str,
+                                                           node->type == BUS_MATCH_PATH_NAMESPACE || arg_path ? '/' : '.',
+                                                           !arg_path);
+                        if (r != 0)
+                                return r;
+
+                        found = NULL;
+
+                } else if (test_str)
                         found = hashmap_get(node->compare.children, test_str);
                 else if (test_strv) {
                         char **i;
@@ -392,7 +551,7 @@ int bus_match_run(
                         STRV_FOREACH(i, test_strv) {
                                 found = hashmap_get(node->compare.children, *i);
                                 if (found) {
-                                        r = bus_match_run(bus, found, m);
+                                        r = bus_match_run_node(bus, found, m, keys);
                                         if (r != 0)
                                                 return r;
                                 }
@@ -405,7 +564,7 @@ int bus_match_run(
                         found = NULL;
 
                 if (found) {
-                        r = bus_match_run(bus, found, m);
+                        r = bus_match_run_node(bus, found, m, keys);
                         if (r != 0)
                                 return r;
                 }
@@ -418,7 +577,7 @@ int bus_match_run(
                         if (!value_node_test(c, node->type, test_u8, test_str, test_strv, m))
                                 continue;
 
-                        r = bus_match_run(bus, c, m);
+                        r = bus_match_run_node(bus, c, m, keys);
                         if (r != 0)
                                 return r;
 
@@ -431,7 +590,17 @@ int bus_match_run(
                 return 0;
 
         /* And now, let's invoke our siblings */
-        return bus_match_run(bus, node->next, m);
+        return bus_match_run_node(bus, node->next, m, keys);
+}
+
+int bus_match_run(
+                sd_bus *bus,
+                struct bus_match_node *root,
+                sd_bus_message *m) {
+
+        _cleanup_(bus_match_keys_done) BusMatchKeys keys = {};
+
+        return bus_match_run_node(bus, root, m, &keys);
 }
 
 static int bus_match_add_compare_value(
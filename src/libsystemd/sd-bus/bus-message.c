@@ -22,8 +22,26 @@
 #include "time-util.h"
 #include "utf8.h"
 
+/* Every message object is allocated together with some extra space, for a few containers, and for the header
+ * fields and the first body part of messages we construct, or the data of messages we received. Small messages
+ * hence need no further allocations, and everything is released in one go with the message object. Whatever
+ * outgrows this space is moved to the heap. */
+#define MESSAGE_INLINE_CONTAINERS 4U
+#define MESSAGE_INLINE_CONTAINERS_SIZE ALIGN8(MESSAGE_INLINE_CONTAINERS * sizeof(struct bus_container))
+#define MESSAGE_INLINE_FIELDS_SIZE 256U /* including the fixed part of the header */
+#define MESSAGE_INLINE_BODY_SIZE 256U
+
 static int message_append_basic(sd_bus_message *m, char type, const void *p, const void **stored);
 
+static struct bus_container* message_inline_containers(sd_bus_message *m) {
+        return (struct bus_container*) ((uint8_t*) m + ALIGN(sizeof(sd_bus_message)));
+}
+
+static void* message_inline_data(sd_bus_message *m) {
+        /* Either the header fields followed by the first body part, or the received data */
+        return (uint8_t*) m + ALIGN(sizeof(sd_bus_message)) + MESSAGE_INLINE_CONTAINERS_SIZE;
+}
+
 static void *adjust_pointer(const void *p, void *old_base, size_t sz, void *new_base) {
 
         if (!p)
@@ -97,12 +115,79 @@ static struct bus_container *message_get_last_container(sd_bus_message *m) {
         return m->containers + m->n_containers - 1;
 }
 
+static int message_grow_containers(sd_bus_message *m) {
+        struct bus_container *n;
+
+        assert(m);
+
+        /* Make sure we have space for one more container, using the inline space first */
+
+        if (m->n_containers < m->containers_allocated)
+                return 0;
+
+        if (!m->containers) {
+                m->containers = message_inline_containers(m);
+                m->containers_allocated = MESSAGE_INLINE_CONTAINERS;
+                return 0;
+        }
+
+        if (m->containers != message_inline_containers(m))
+                return GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1) ? 0 : -ENOMEM;
+
+        n = new(struct bus_container, m->containers_allocated * 2);
+        if (!n)
+                return -ENOMEM;
+
+        memcpy(n, m->containers, m->n_containers * sizeof(struct bus_container));
+        m->containers = n;
+        m->containers_allocated *= 2;
+        return 0;
+}
+
+static void container_free_signature(struct bus_container *c) {
+        assert(c);
+
+        /* Interned signatures are borrowed from their descriptor */
+        if (!c->descriptor)
+                free(c->signature);
+}
+
+static const BusSignature* container_lookup_signature(struct bus_container *c, const char *contents) {
+        const BusSignature *sig;
+        size_t n;
+
+        assert(c);
+        assert(contents);
+
+        /* Finds the descriptor for the contents of a container to open or enter at the current position
+         * of c. Looking at the descriptor of c first avoids hashing the contents. */
+
+        n = strlen(contents);
+
+        if (c->descriptor) {
+                sig = bus_signature_child(c->descriptor, c->index);
+                if (sig && sig->length == n && memcmp(sig->signature, contents, n) == 0)
+                        return sig;
+        }
+
+        return bus_signature_get(contents, n);
+}
+
+static int container_element_length(struct bus_container *c, size_t i, size_t *l) {
+        assert(c);
+
+        if (c->descriptor)
+                return bus_signature_element_length(c->descriptor, i, l);
+
+        return signature_element_length(c->signature + i, l);
+}
+
 static void message_free_last_container(sd_bus_message *m) {
         struct bus_container *c;
 
         c = message_get_last_container(m);
 
-        free(c->signature);
+        container_free_signature(c);
         free(c->peeked_signature);
         free(c->offsets);
 
@@ -117,7 +202,9 @@ static void message_reset_containers(sd_bus_message *m) {
         while (m->n_containers > 0)
                 message_free_last_container(m);
 
-        m->containers = mfree(m->containers);
+        if (m->containers != message_inline_containers(m))
+                free(m->containers);
+        m->containers = NULL;
         m->containers_allocated = 0;
         m->root_container.index = 0;
 }
@@ -138,6 +225,8 @@ static sd_bus_message* message_free(sd_bus_message *m) {
                 free(m->fds);
         }
 
+        safe_close(m->body_memfd);
+
         if (m->iovec != m->iovec_fixed)
                 free(m->iovec);
 
@@ -173,16 +262,19 @@ static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz, b
                 np = realloc(m->header, ALIGN8(new_size));
                 if (!np)
                         goto poison;
-        } else {
+        } else if (m->inline_buffers && ALIGN8(new_size) <= MESSAGE_INLINE_FIELDS_SIZE)
+                /* Still fits into the space allocated along with the message */
+                np = m->header;
+        else {
                 /* Initially, the header is allocated as part of
-                 * the sd_bus_message itself, let's replace it by
-                 * dynamic data */
+                 * the sd_bus_message itself, once it outgrows that
+                 * space, let's replace it by dynamic data */
 
                 np = malloc(ALIGN8(new_size));
                 if (!np)
                         goto poison;
 
-                memcpy(np, m->header, sizeof(struct bus_header));
+                memcpy(np, m->header, old_size);
         }
 
         /* Zero out padding */
@@ -201,7 +293,8 @@ static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz, b
         m->sender = adjust_pointer(m->sender, op, old_size, m->header);
         m->error.name = adjust_pointer(m->error.name, op, old_size, m->header);
 
-        m->free_header = true;
+        if (np != op)
+                m->free_header = true;
 
         if (add_offset) {
                 if (m->n_header_offsets >= ELEMENTSOF(m->header_offsets))
@@ -459,7 +552,7 @@ int bus_message_from_header(
 
         /* Note that we are happy with unknown flags in the flags header! */
 
-        a = ALIGN(sizeof(sd_bus_message)) + ALIGN(extra);
+        a = ALIGN(sizeof(sd_bus_message)) + MESSAGE_INLINE_CONTAINERS_SIZE + ALIGN(extra);
 
         if (label) {
                 label_sz = strlen(label);
@@ -515,9 +608,10 @@ int bus_message_from_header(
 
         m->fds = fds;
         m->n_fds = n_fds;
+        m->body_memfd = -1;
 
         if (label) {
-                m->creds.label = (char*) m + ALIGN(sizeof(sd_bus_message)) + ALIGN(extra);
+                m->creds.label = (char*) message_inline_data(m) + ALIGN(extra);
                 memcpy(m->creds.label, label, label_sz + 1);
 
                 m->creds.mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
@@ -531,6 +625,28 @@ int bus_message_from_header(
         return 0;
 }
 
+static int message_setup_received(sd_bus_message *m, void *buffer, size_t length) {
+        size_t sz;
+
+        assert(m);
+        assert(buffer);
+
+        sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
+        if (sz > 0) {
+                m->n_body_parts = 1;
+                m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
+                m->body.size = sz;
+                m->body.sealed = true;
+                m->body.memfd = -1;
+        }
+
+        m->n_iovec = 1;
+        m->iovec = m->iovec_fixed;
+        m->iovec[0] = IOVEC_MAKE(buffer, length);
+
+        return bus_message_parse_fields(m);
+}
+
 int bus_message_from_malloc(
                 sd_bus *bus,
                 void *buffer,
@@ -541,7 +657,6 @@ int bus_message_from_malloc(
                 sd_bus_message **ret) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
-        size_t sz;
         int r;
 
         r = bus_message_from_header(
@@ -555,25 +670,139 @@ int bus_message_from_malloc(
         if (r < 0)
                 return r;
 
-        sz = length - sizeof(struct bus_header) - ALIGN8(m->fields_size);
-        if (sz > 0) {
-                m->n_body_parts = 1;
-                m->body.data = (uint8_t*) buffer + sizeof(struct bus_header) + ALIGN8(m->fields_size);
-                m->body.size = sz;
-                m->body.sealed = true;
-                m->body.memfd = -1;
-        }
+        r = message_setup_received(m, buffer, length);
+        if (r < 0)
+                return r;
 
-        m->n_iovec = 1;
+        /* We take possession of the memory and fds now */
+        m->free_header = true;
+        m->free_fds = true;
+
+        *ret = TAKE_PTR(m);
+        return 0;
+}
+
+int bus_message_from_buffer(
+                sd_bus *bus,
+                const void *buffer,
+                size_t length,
+                int *fds,
+                size_t n_fds,
+                const char *label,
+                sd_bus_message **ret) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        void *p;
+        int r;
+
+        /* Like bus_message_from_malloc(), but copies the data into the space allocated along with the
+         * message object, instead of taking possession of the memory */
+
+        r = bus_message_from_header(
+                        bus,
+                        (void*) buffer, length,
+                        (void*) buffer, length,
+                        length,
+                        fds, n_fds,
+                        label,
+                        length, &m);
+        if (r < 0)
+                return r;
+
+        p = memcpy(message_inline_data(m), buffer, length);
+        m->header = p;
+        m->footer = p;
+
+        r = message_setup_received(m, p, length);
+        if (r < 0)
+                return r;
+
+        m->free_fds = true;
+
+        *ret = TAKE_PTR(m);
+        return 0;
+}
+
+int bus_message_from_memfd_body(
+                sd_bus *bus,
+                const void *buffer,
+                size_t length,
+                int body_memfd,
+                size_t body_size,
+                int *fds,
+                size_t n_fds,
+                const char *label,
+                sd_bus_message **ret) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        struct bus_body_part part;
+        uint64_t sz;
+        void *p;
+        int r;
+
+        assert(body_memfd >= 0);
+
+        /* Like bus_message_from_buffer(), but for messages whose body was passed in a memfd, see
+         * BUS_MESSAGE_MEMFD_BODY. The buffer contains the header and fields only, the body is mapped
+         * read-only from the memfd, without copying it. Takes possession of the memfd on success. */
+
+        if (body_size == 0)
+                return -EBADMSG;
+
+        /* Make sure the sender can neither change nor truncate the body under our feet */
+        r = memfd_get_sealed(body_memfd);
+        if (r < 0)
+                return r == -EINVAL ? -EBADMSG : r;
+        if (r == 0)
+                return -EBADMSG;
+
+        r = memfd_get_size(body_memfd, &sz);
+        if (r < 0)
+                return r;
+        if (sz < body_size)
+                return -EBADMSG;
+
+        r = bus_message_from_header(
+                        bus,
+                        (void*) buffer, length,
+                        (void*) buffer, length,
+                        length + body_size,
+                        fds, n_fds,
+                        label,
+                        length, &m);
+        if (r < 0)
+                return r;
+
+        part = (struct bus_body_part) {
+                .memfd = body_memfd,
+                .size = body_size,
+                .sealed = true,
+        };
+
+        r = bus_body_part_map(&part);
+        if (r < 0)
+                return r;
+
+        p = memcpy(message_inline_data(m), buffer, length);
+        m->header = p;
+        m->footer = p;
+        m->header->flags &= ~BUS_MESSAGE_MEMFD_BODY;
+
+        m->n_body_parts = 1;
+        m->body = part;
+
+        m->n_iovec = 2;
         m->iovec = m->iovec_fixed;
-        m->iovec[0] = IOVEC_MAKE(buffer, length);
+        m->iovec[0] = IOVEC_MAKE(p, length);
+        m->iovec[1] = IOVEC_MAKE(part.data, body_size);
 
         r = bus_message_parse_fields(m);
-        if (r < 0)
+        if (r < 0) {
+                /* Leave the memfd to the caller, but unmap it along with the message */
+                m->body.memfd = -1;
                 return r;
+        }
 
-        /* We take possession of the memory and fds now */
-        m->free_header = true;
         m->free_fds = true;
 
         *ret = TAKE_PTR(m);
@@ -592,13 +821,16 @@ _public_ int sd_bus_message_new(
         /* Creation of messages with _SD_BUS_MESSAGE_TYPE_INVALID is allowed. */
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
-        sd_bus_message *t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        sd_bus_message *t = malloc0(ALIGN(sizeof(sd_bus_message)) + MESSAGE_INLINE_CONTAINERS_SIZE +
+                                    MESSAGE_INLINE_FIELDS_SIZE + MESSAGE_INLINE_BODY_SIZE);
         if (!t)
                 return -ENOMEM;
 
         t->n_ref = 1;
         t->bus = sd_bus_ref(bus);
-        t->header = (struct bus_header*) ((uint8_t*) t + ALIGN(sizeof(struct sd_bus_message)));
+        t->body_memfd = -1;
+        t->inline_buffers = true;
+        t->header = message_inline_data(t);
         t->header->endian = BUS_NATIVE_ENDIAN;
         t->header->type = type;
         t->header->version = bus->message_version;
@@ -918,7 +1150,8 @@ _public_ sd_bus_message* sd_bus_message_ref(sd_bus_message *m) {
          * least one bus connection object. */
         assert(m->n_ref > 0 || m->n_queued > 0);
 
-        m->n_ref++;
+        /* Atomic, since concurrent method call handlers may take references from worker threads */
+        __atomic_add_fetch(&m->n_ref, 1, __ATOMIC_RELAXED);
 
         /* Each user reference to a bus message shall also be considered a ref on the bus */
         sd_bus_ref(m->bus);
@@ -936,9 +1169,7 @@ _public_ sd_bus_message* sd_bus_message_unref(sd_bus_message *m) {
                                * otherwise, if this message is currently queued sd_bus_unref() might call
                                * bus_message_unref_queued() for this which might then destroy the message
                                * while we are still processing it. */
-        m->n_ref--;
-
-        if (m->n_ref > 0 || m->n_queued > 0)
+        if (__atomic_sub_fetch(&m->n_ref, 1, __ATOMIC_ACQ_REL) > 0 || m->n_queued > 0)
                 return NULL;
 
         /* Unset the bus field if neither the user has a reference nor this message is queued. We are careful
@@ -1255,11 +1486,24 @@ static int part_make_space(
         if (m->poisoned)
                 return -ENOMEM;
 
-        if (part->allocated == 0 || sz > part->allocated) {
+        if (part->allocated == 0 && part == &m->body && m->inline_buffers && sz <= MESSAGE_INLINE_BODY_SIZE) {
+                /* The first body part starts out in the space allocated along with the message */
+                part->data = (uint8_t*) message_inline_data(m) + MESSAGE_INLINE_FIELDS_SIZE;
+                part->allocated = MESSAGE_INLINE_BODY_SIZE;
+
+        } else if (part->allocated == 0 || sz > part->allocated) {
                 size_t new_allocated;
 
                 new_allocated = sz > 0 ? 2 * sz : 64;
-                n = realloc(part->data, new_allocated);
+
+                if (part->free_this || !part->data)
+                        n = realloc(part->data, new_allocated);
+                else {
+                        /* Outgrew the inline space, move to the heap */
+                        n = malloc(new_allocated);
+                        if (n)
+                                memcpy(n, part->data, part->size);
+                }
                 if (!n) {
                         m->poisoned = true;
                         return -ENOMEM;
@@ -1732,6 +1976,7 @@ static int bus_message_open_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
                 uint32_t **array_size,
                 size_t *begin,
                 bool *need_offsets) {
@@ -1746,7 +1991,7 @@ static int bus_message_open_array(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_single(contents, true))
+        if (!(sig ? sig->single : signature_is_single(contents, true)))
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1830,13 +2075,15 @@ static int bus_message_open_array(
 static int bus_message_open_variant(
                 sd_bus_message *m,
                 struct bus_container *c,
-                const char *contents) {
+                const char *contents,
+                const BusSignature *sig,
+                bool trusted) {
 
         assert(m);
         assert(c);
         assert(contents);
 
-        if (!signature_is_single(contents, false))
+        if (!trusted && !(sig ? sig->single_strict : signature_is_single(contents, false)))
                 return -EINVAL;
 
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
@@ -1889,6 +2136,7 @@ static int bus_message_open_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
                 size_t *begin,
                 bool *need_offsets) {
 
@@ -1901,7 +2149,7 @@ static int bus_message_open_struct(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_valid(contents, false))
+        if (!(sig ? sig->valid_strict : signature_is_valid(contents, false)))
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1962,6 +2210,8 @@ static int bus_message_open_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
+                bool trusted,
                 size_t *begin,
                 bool *need_offsets) {
 
@@ -1973,7 +2223,7 @@ static int bus_message_open_dict_entry(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_pair(contents))
+        if (!trusted && !(sig ? sig->pair : signature_is_pair(contents)))
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -2016,35 +2266,39 @@ static int bus_message_open_dict_entry(
         return 0;
 }
 
-_public_ int sd_bus_message_open_container(
+static int message_open_container(
                 sd_bus_message *m,
                 char type,
-                const char *contents) {
+                const char *contents,
+                bool trusted) {
 
         struct bus_container *c;
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
+        const BusSignature *sig;
         size_t before, begin = 0;
         bool need_offsets = false;
         int r;
 
-        assert_return(m, -EINVAL);
-        assert_return(!m->sealed, -EPERM);
-        assert_return(contents, -EINVAL);
-        assert_return(!m->poisoned, -ESTALE);
+        assert(m);
+        assert(contents);
 
         /* Make sure we have space for one more container */
-        if (!GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1)) {
+        r = message_grow_containers(m);
+        if (r < 0) {
                 m->poisoned = true;
-                return -ENOMEM;
+                return r;
         }
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
-        if (!signature) {
-                m->poisoned = true;
-                return -ENOMEM;
+        sig = container_lookup_signature(c, contents);
+        if (!sig) {
+                signature = strdup(contents);
+                if (!signature) {
+                        m->poisoned = true;
+                        return -ENOMEM;
+                }
         }
 
         /* Save old index in the parent container, in case we have to
@@ -2053,13 +2307,13 @@ _public_ int sd_bus_message_open_container(
         before = m->body_size;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_open_array(m, c, contents, &array_size, &begin, &need_offsets);
+                r = bus_message_open_array(m, c, contents, sig, &array_size, &begin, &need_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
-                r = bus_message_open_variant(m, c, contents);
+                r = bus_message_open_variant(m, c, contents, sig, trusted);
         else if (type == SD_BUS_TYPE_STRUCT)
-                r = bus_message_open_struct(m, c, contents, &begin, &need_offsets);
+                r = bus_message_open_struct(m, c, contents, sig, &begin, &need_offsets);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
-                r = bus_message_open_dict_entry(m, c, contents, &begin, &need_offsets);
+                r = bus_message_open_dict_entry(m, c, contents, sig, trusted, &begin, &need_offsets);
         else
                 r = -EINVAL;
         if (r < 0)
@@ -2068,7 +2322,8 @@ _public_ int sd_bus_message_open_container(
         /* OK, let's fill it in */
         m->containers[m->n_containers++] = (struct bus_container) {
                 .enclosing = type,
-                .signature = TAKE_PTR(signature),
+                .signature = sig ? (char*) sig->signature : TAKE_PTR(signature),
+                .descriptor = sig,
                 .array_size = array_size,
                 .before = before,
                 .begin = begin,
@@ -2078,6 +2333,33 @@ _public_ int sd_bus_message_open_container(
         return 0;
 }
 
+_public_ int sd_bus_message_open_container(
+                sd_bus_message *m,
+                char type,
+                const char *contents) {
+
+        assert_return(m, -EINVAL);
+        assert_return(!m->sealed, -EPERM);
+        assert_return(contents, -EINVAL);
+        assert_return(!m->poisoned, -ESTALE);
+
+        return message_open_container(m, type, contents, false);
+}
+
+int bus_message_open_container_trusted(sd_bus_message *m, char type, const char *contents) {
+        assert(m);
+        assert(!m->sealed);
+        assert(contents);
+
+        /* Like sd_bus_message_open_container(), but skips validating the contents signature of variants
+         * and dict entries, for callers that validated it already, e.g. when the vtable was registered. */
+
+        if (m->poisoned)
+                return -ESTALE;
+
+        return message_open_container(m, type, contents, true);
+}
+
 static int bus_message_close_array(sd_bus_message *m, struct bus_container *c) {
 
         assert(m);
@@ -2281,7 +2563,7 @@ _public_ int sd_bus_message_close_container(sd_bus_message *m) {
         else
                 assert_not_reached("Unknown container type");
 
-        free(c->signature);
+        container_free_signature(c);
         free(c->offsets);
 
         return r;
@@ -3594,6 +3876,7 @@ static int bus_message_enter_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
                 uint32_t **array_size,
                 size_t *item_size,
                 size_t **offsets,
@@ -3611,7 +3894,7 @@ static int bus_message_enter_array(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_single(contents, true))
+        if (!(sig ? sig->single : signature_is_single(contents, true)))
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
@@ -3723,6 +4006,7 @@ static int bus_message_enter_variant(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
                 size_t *item_size) {
 
         size_t rindex;
@@ -3735,7 +4019,7 @@ static int bus_message_enter_variant(
         assert(contents);
         assert(item_size);
 
-        if (!signature_is_single(contents, false))
+        if (!(sig ? sig->single_strict : signature_is_single(contents, false)))
                 return -EINVAL;
 
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
@@ -3981,6 +4265,7 @@ static int bus_message_enter_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -3995,13 +4280,13 @@ static int bus_message_enter_struct(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_valid(contents, false))
+        if (!(sig ? sig->valid_strict : signature_is_valid(contents, false)))
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
-        l = strlen(contents);
+        l = sig ? sig->length : strlen(contents);
 
         if (c->signature[c->index] != SD_BUS_TYPE_STRUCT_BEGIN ||
             !startswith(c->signature + c->index + 1, contents) ||
@@ -4022,6 +4307,7 @@ static int bus_message_enter_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const BusSignature *sig,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -4033,7 +4319,7 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
-        if (!signature_is_pair(contents))
+        if (!(sig ? sig->pair : signature_is_pair(contents)))
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -4042,7 +4328,7 @@ static int bus_message_enter_dict_entry(
         if (!c->signature || c->signature[c->index] == 0)
                 return 0;
 
-        l = strlen(contents);
+        l = sig ? sig->length : strlen(contents);
 
         if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
             !startswith(c->signature + c->index + 1, contents) ||
@@ -4065,6 +4351,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         struct bus_container *c;
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
+        const BusSignature *sig;
         size_t before, end;
         _cleanup_free_ size_t *offsets = NULL;
         size_t n_offsets = 0, item_size = 0;
@@ -4112,8 +4399,9 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         if (m->n_containers >= BUS_CONTAINER_DEPTH)
                 return -EBADMSG;
 
-        if (!GREEDY_REALLOC(m->containers, m->containers_allocated, m->n_containers + 1))
-                return -ENOMEM;
+        r = message_grow_containers(m);
+        if (r < 0)
+                return r;
 
         if (message_end_of_signature(m))
                 return -ENXIO;
@@ -4123,21 +4411,24 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
-        if (!signature)
-                return -ENOMEM;
+        sig = container_lookup_signature(c, contents);
+        if (!sig) {
+                signature = strdup(contents);
+                if (!signature)
+                        return -ENOMEM;
+        }
 
         c->saved_index = c->index;
         before = m->rindex;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_enter_array(m, c, contents, &array_size, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_array(m, c, contents, sig, &array_size, &item_size, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
-                r = bus_message_enter_variant(m, c, contents, &item_size);
+                r = bus_message_enter_variant(m, c, contents, sig, &item_size);
         else if (type == SD_BUS_TYPE_STRUCT)
-                r = bus_message_enter_struct(m, c, contents, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_struct(m, c, contents, sig, &item_size, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
-                r = bus_message_enter_dict_entry(m, c, contents, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_dict_entry(m, c, contents, sig, &item_size, &offsets, &n_offsets);
         else
                 r = -EINVAL;
         if (r <= 0)
@@ -4146,14 +4437,15 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         /* OK, let's fill it in */
         if (BUS_MESSAGE_IS_GVARIANT(m) &&
             type == SD_BUS_TYPE_STRUCT &&
-            isempty(signature))
+            isempty(contents))
                 end = m->rindex + 0;
         else
                 end = m->rindex + c->item_size;
 
         m->containers[m->n_containers++] = (struct bus_container) {
                  .enclosing = type,
-                 .signature = TAKE_PTR(signature),
+                 .signature = sig ? (char*) sig->signature : TAKE_PTR(signature),
+                 .descriptor = sig,
 
                  .before = before,
                  .begin = m->rindex,
@@ -4255,21 +4547,27 @@ _public_ int sd_bus_message_peek_type(sd_bus_message *m, char *type, const char
         if (c->signature[c->index] == SD_BUS_TYPE_ARRAY) {
 
                 if (contents) {
+                        const BusSignature *child;
                         size_t l;
 
-                        r = signature_element_length(c->signature+c->index+1, &l);
-                        if (r < 0)
-                                return r;
+                        child = c->descriptor ? bus_signature_child(c->descriptor, c->index) : NULL;
+                        if (child)
+                                *contents = child->signature;
+                        else {
+                                r = signature_element_length(c->signature+c->index+1, &l);
+                                if (r < 0)
+                                        return r;
 
-                        /* signature_element_length does verification internally */
+                                /* signature_element_length does verification internally */
 
-                        /* The array element must not be empty */
-                        assert(l >= 1);
-                        if (free_and_strndup(&c->peeked_signature,
-                                             c->signature + c->index + 1, l) < 0)
-                                return -ENOMEM;
+                                /* The array element must not be empty */
+                                assert(l >= 1);
+                                if (free_and_strndup(&c->peeked_signature,
+                                                     c->signature + c->index + 1, l) < 0)
+                                        return -ENOMEM;
 
-                        *contents = c->peeked_signature;
+                                *contents = c->peeked_signature;
+                        }
                 }
 
                 if (type)
@@ -4281,18 +4579,24 @@ _public_ int sd_bus_message_peek_type(sd_bus_message *m, char *type, const char
         if (IN_SET(c->signature[c->index], SD_BUS_TYPE_STRUCT_BEGIN, SD_BUS_TYPE_DICT_ENTRY_BEGIN)) {
 
                 if (contents) {
+                        const BusSignature *child;
                         size_t l;
 
-                        r = signature_element_length(c->signature+c->index, &l);
-                        if (r < 0)
-                                return r;
+                        child = c->descriptor ? bus_signature_child(c->descriptor, c->index) : NULL;
+                        if (child)
+                                *contents = child->signature;
+                        else {
+                                r = signature_element_length(c->signature+c->index, &l);
+                                if (r < 0)
+                                        return r;
 
-                        assert(l >= 3);
-                        if (free_and_strndup(&c->peeked_signature,
-                                             c->signature + c->index + 1, l - 2) < 0)
-                                return -ENOMEM;
+                                assert(l >= 3);
+                                if (free_and_strndup(&c->peeked_signature,
+                                                     c->signature + c->index + 1, l - 2) < 0)
+                                        return -ENOMEM;
 
-                        *contents = c->peeked_signature;
+                                *contents = c->peeked_signature;
+                        }
                 }
 
                 if (type)
@@ -4634,7 +4938,7 @@ _public_ int sd_bus_message_skip(sd_bus_message *m, const char *types) {
 
                 c = message_get_last_container(m);
 
-                r = signature_element_length(c->signature + c->index, &l);
+                r = container_element_length(c, c->index, &l);
                 if (r < 0)
                         return r;
 
@@ -9,6 +9,7 @@
 
 #include "bus-creds.h"
 #include "bus-protocol.h"
+#include "bus-signature.h"
 #include "macro.h"
 #include "time-util.h"
 
@@ -20,6 +21,9 @@ struct bus_container {
         unsigned index, saved_index;
         char *signature;
 
+        /* If set, signature is the interned string of this descriptor, and not owned by us */
+        const BusSignature *descriptor;
+
         size_t before, begin, end;
 
         /* dbus1: pointer to the array size value, if this is a value */
@@ -85,6 +89,7 @@ struct sd_bus_message {
         bool free_fds:1;
         bool poisoned:1;
         bool sensitive:1;
+        bool inline_buffers:1; /* header fields and first body part may use the space allocated with us */
 
         /* The first and last bytes of the message */
         struct bus_header *header;
@@ -109,6 +114,9 @@ struct sd_bus_message {
         uint32_t n_fds;
         int *fds;
 
+        /* A sealed copy of the body that is sent in place of it, see BUS_MESSAGE_MEMFD_BODY */
+        int body_memfd;
+
         struct bus_container root_container, *containers;
         size_t n_containers;
         size_t containers_allocated;
@@ -200,12 +208,33 @@ int bus_message_from_malloc(
                 size_t n_fds,
                 const char *label,
                 sd_bus_message **ret);
+int bus_message_from_buffer(
+                sd_bus *bus,
+                const void *buffer,
+                size_t length,
+                int *fds,
+                size_t n_fds,
+                const char *label,
+                sd_bus_message **ret);
+
+int bus_message_from_memfd_body(
+                sd_bus *bus,
+                const void *buffer,
+                size_t length,
+                int body_memfd,
+                size_t body_size,
+                int *fds,
+                size_t n_fds,
+                const char *label,
+                sd_bus_message **ret);
 
 int bus_message_get_arg(sd_bus_message *m, unsigned i, const char **str);
 int bus_message_get_arg_strv(sd_bus_message *m, unsigned i, char ***strv);
 
 int bus_message_parse_fields(sd_bus_message *m);
 
+int bus_message_open_container_trusted(sd_bus_message *m, char type, const char *contents);
+
 struct bus_body_part *message_append_part(sd_bus_message *m);
 
 #define MESSAGE_FOREACH_PART(part, i, m) \
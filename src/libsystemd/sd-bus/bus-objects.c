@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "alloc-util.h"
+#include "bus-concurrent.h"
 #include "bus-internal.h"
 #include "bus-introspect.h"
 #include "bus-message.h"
@@ -409,6 +410,13 @@ static int method_callbacks_run(
 
                 slot = container_of(c->parent, sd_bus_slot, node_vtable);
 
+                /* Without an event loop there's nothing to return to once the handler finished, hence
+                 * concurrent methods are executed synchronously then, like any other */
+                if (FLAGS_SET(c->vtable->flags, SD_BUS_VTABLE_METHOD_CONCURRENT) && bus->event) {
+                        r = bus_concurrent_call_enqueue(bus, m, slot, c->vtable->x.method.handler, u);
+                        return bus_maybe_reply_error(m, r, NULL);
+                }
+
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_handler = c->vtable->x.method.handler;
                 bus->current_userdata = u;
@@ -722,15 +730,16 @@ static int vtable_append_one_property(
                         return r;
         }
 
-        r = sd_bus_message_open_container(reply, 'e', "sv");
+        /* The property signature has been validated when the vtable was registered already */
+        r = bus_message_open_container_trusted(reply, 'e', "sv");
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_append(reply, "s", v->x.property.member);
+        r = sd_bus_message_append_basic(reply, 's', v->x.property.member);
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+        r = bus_message_open_container_trusted(reply, 'v', v->x.property.signature);
         if (r < 0)
                 return r;
 
@@ -761,7 +770,6 @@ static int vtable_append_all_properties(
                 void *userdata,
                 sd_bus_error *error) {
 
-        const sd_bus_vtable *v;
         int r;
 
         assert(bus);
@@ -769,21 +777,9 @@ static int vtable_append_all_properties(
         assert(path);
         assert(c);
 
-        if (c->vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
-                return 1;
-
-        v = c->vtable;
-        for (v = bus_vtable_next(c->vtable, v); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(c->vtable, v)) {
-                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
-                        continue;
-
-                if (v->flags & SD_BUS_VTABLE_HIDDEN)
-                        continue;
-
-                /* Let's not include properties marked as "explicit" in any message that contains a generic
-                 * dump of properties, but only in those generated as a response to an explicit request. */
-                if (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)
-                        continue;
+        /* Hidden and explicit properties have been filtered out when the vtable was registered already */
+        for (size_t i = 0; i < c->n_get_all; i++) {
+                const sd_bus_vtable *v = c->get_all[i];
 
                 /* Let's not include properties marked only for invalidation on change (i.e. in contrast to
                  * those whose new values are included in PropertiesChanges message) in any signals. This is
@@ -1793,6 +1789,7 @@ static int add_object_vtable_internal(
         sd_bus_slot *s = NULL;
         struct node_vtable *i, *existing = NULL;
         const sd_bus_vtable *v;
+        size_t n_get_all_allocated = 0;
         struct node *n;
         int r;
         const char *names = "";
@@ -1921,7 +1918,7 @@ static int add_object_vtable_internal(
                         if (!member_name_is_valid(v->x.property.member) ||
                             !signature_is_single(v->x.property.signature, false) ||
                             !(v->x.property.get || bus_type_is_basic(v->x.property.signature[0]) || streq(v->x.property.signature, "as")) ||
-                            (v->flags & SD_BUS_VTABLE_METHOD_NO_REPLY) ||
+                            (v->flags & (SD_BUS_VTABLE_METHOD_NO_REPLY|SD_BUS_VTABLE_METHOD_CONCURRENT)) ||
                             (!!(v->flags & SD_BUS_VTABLE_PROPERTY_CONST) + !!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE) + !!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)) > 1 ||
                             ((v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE) && (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)) ||
                             (v->flags & SD_BUS_VTABLE_UNPRIVILEGED && v->type == _SD_BUS_VTABLE_PROPERTY)) {
@@ -1947,6 +1944,19 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
+                        /* Let's not include properties marked as "explicit" in any message that contains a
+                         * generic dump of properties, but only in those generated as a response to an
+                         * explicit request. */
+                        if (!(vtable[0].flags & SD_BUS_VTABLE_HIDDEN) &&
+                            !(v->flags & (SD_BUS_VTABLE_HIDDEN|SD_BUS_VTABLE_PROPERTY_EXPLICIT))) {
+                                if (!GREEDY_REALLOC(s->node_vtable.get_all, n_get_all_allocated, s->node_vtable.n_get_all + 1)) {
+                                        r = -ENOMEM;
+                                        goto fail;
+                                }
+
+                                s->node_vtable.get_all[s->node_vtable.n_get_all++] = v;
+                        }
+
                         break;
                 }
 
@@ -1959,7 +1969,7 @@ static int add_object_vtable_internal(
                         if (!member_name_is_valid(v->x.signal.member) ||
                             !signature_is_valid(strempty(v->x.signal.signature), false) ||
                             !names_are_valid(strempty(v->x.signal.signature), &names, &nf) ||
-                            v->flags & SD_BUS_VTABLE_UNPRIVILEGED) {
+                            v->flags & (SD_BUS_VTABLE_UNPRIVILEGED|SD_BUS_VTABLE_METHOD_CONCURRENT)) {
                                 r = -EINVAL;
                                 goto fail;
                         }
@@ -57,6 +57,10 @@ enum {
         BUS_MESSAGE_NO_REPLY_EXPECTED               = 1 << 0,
         BUS_MESSAGE_NO_AUTO_START                   = 1 << 1,
         BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION = 1 << 2,
+
+        /* sd-bus extension, only used if negotiated: the body follows in a sealed memfd passed along with
+         * the message, instead of the socket stream, see bus-socket.c */
+        BUS_MESSAGE_MEMFD_BODY                      = 1 << 7,
 };
 
 /* Header fields */
@@ -4,8 +4,17 @@
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
 #include "bus-signature.h"
 #include "bus-type.h"
+#include "string-util.h"
+
+/* Open addressing, with a bounded number of probes, so that lookups stay cheap even if peers send us lots of
+ * different signatures. Once the slots a signature may go into are taken, it is simply not interned. */
+#define SIGNATURE_TABLE_SIZE 512U
+#define SIGNATURE_TABLE_PROBES 8U
+
+static BusSignature *signature_table[SIGNATURE_TABLE_SIZE] = {};
 
 static int signature_element_length_internal(
                 const char *s,
@@ -146,3 +155,122 @@ bool signature_is_valid(const char *s, bool allow_dict_entry) {
 
         return p - s <= SD_BUS_MAXIMUM_SIGNATURE_LENGTH;
 }
+
+static uint32_t signature_hash(const char *s, size_t n) {
+        uint32_t h = 2166136261U;
+        size_t i;
+
+        /* FNV-1a, signatures are short and the table is bounded anyway */
+
+        for (i = 0; i < n; i++) {
+                h ^= (uint8_t) s[i];
+                h *= 16777619U;
+        }
+
+        return h;
+}
+
+static BusSignature* signature_new(const char *s, size_t n, uint32_t hash) {
+        _cleanup_free_ BusSignature *sig = NULL;
+        size_t i;
+
+        assert(s);
+        assert(n <= BUS_SIGNATURE_INTERN_MAX);
+
+        sig = malloc0(offsetof(BusSignature, signature) + n + 1);
+        if (!sig)
+                return NULL;
+
+        memcpy(sig->signature, s, n);
+        sig->signature[n] = 0;
+        sig->hash = hash;
+        sig->length = n;
+
+        sig->valid = signature_is_valid(sig->signature, true);
+        if (!sig->valid)
+                return NULL;
+
+        sig->valid_strict = signature_is_valid(sig->signature, false);
+        sig->single = signature_is_single(sig->signature, true);
+        sig->single_strict = signature_is_single(sig->signature, false);
+        sig->pair = signature_is_pair(sig->signature);
+
+        for (i = 0; i < n; i++) {
+                size_t l;
+
+                if (signature_element_length(sig->signature + i, &l) >= 0)
+                        sig->element_length[i] = l;
+        }
+
+        return TAKE_PTR(sig);
+}
+
+const BusSignature* bus_signature_get(const char *s, size_t n) {
+        _cleanup_free_ BusSignature *new_sig = NULL;
+        uint32_t hash;
+        unsigned k;
+
+        assert(s);
+
+        /* Returns the descriptor of the first n characters of s, or NULL if they aren't a valid signature,
+         * or can't be interned */
+
+        if (n == 0 || n > BUS_SIGNATURE_INTERN_MAX)
+                return NULL;
+
+        hash = signature_hash(s, n);
+
+        for (k = 0; k < SIGNATURE_TABLE_PROBES; k++) {
+                BusSignature **slot = signature_table + ((hash + k) % SIGNATURE_TABLE_SIZE), *sig;
+
+                sig = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+                if (!sig) {
+                        if (!new_sig) {
+                                new_sig = signature_new(s, n, hash);
+                                if (!new_sig)
+                                        return NULL;
+                        }
+
+                        if (__atomic_compare_exchange_n(slot, &sig, new_sig, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                                return TAKE_PTR(new_sig);
+
+                        /* Somebody else was faster, sig now contains what they put there, maybe it's us */
+                }
+
+                if (sig->hash == hash && sig->length == n && memcmp(sig->signature, s, n) == 0)
+                        return sig;
+        }
+
+        return NULL;
+}
+
+const BusSignature* bus_signature_child(const BusSignature *sig, size_t i) {
+        const BusSignature *child;
+        size_t l;
+
+        assert(sig);
+
+        /* Returns the descriptor of the contents of the array, struct or dict entry starting at offset i */
+
+        if (i >= sig->length || sig->element_length[i] == 0)
+                return NULL;
+
+        child = __atomic_load_n(&sig->children[i], __ATOMIC_ACQUIRE);
+        if (child)
+                return child;
+
+        l = sig->element_length[i];
+
+        if (sig->signature[i] == SD_BUS_TYPE_ARRAY)
+                child = bus_signature_get(sig->signature + i + 1, l - 1);
+        else if (IN_SET(sig->signature[i], SD_BUS_TYPE_STRUCT_BEGIN, SD_BUS_TYPE_DICT_ENTRY_BEGIN))
+                child = bus_signature_get(sig->signature + i + 1, l - 2);
+        else
+                return NULL;
+
+        /* Descriptors are unique, hence if this races with another thread, we'll both store the same */
+        if (child)
+                __atomic_store_n((BusSignature**) &sig->children[i], (BusSignature*) child, __ATOMIC_RELEASE);
+
+        return child;
+}
@@ -1,10 +1,53 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 bool signature_is_single(const char *s, bool allow_dict_entry);
 bool signature_is_pair(const char *s);
 bool signature_is_valid(const char *s, bool allow_dict_entry);
 
 int signature_element_length(const char *s, size_t *l);
+
+/* Short signatures are interned in a process-wide table, together with what's needed to walk them: whether
+ * they are valid, and the length of the complete type starting at each offset. Descriptors are never freed,
+ * hence they and their strings may be referenced indefinitely. Lookups don't take locks. The table is
+ * bounded, hence lookups may fail, in which case callers should fall back to the functions above. */
+
+#define BUS_SIGNATURE_INTERN_MAX 64U
+
+typedef struct BusSignature BusSignature;
+
+struct BusSignature {
+        uint32_t hash;
+        uint8_t length;
+
+        bool valid:1;          /* signature_is_valid(s, true) */
+        bool valid_strict:1;   /* signature_is_valid(s, false) */
+        bool single:1;         /* signature_is_single(s, true) */
+        bool single_strict:1;  /* signature_is_single(s, false) */
+        bool pair:1;           /* signature_is_pair(s) */
+
+        /* The length of the complete type starting at each offset, or 0 if there is none */
+        uint8_t element_length[BUS_SIGNATURE_INTERN_MAX];
+
+        /* The descriptors of the contents of the container types starting at each offset, resolved on
+         * first use */
+        BusSignature *children[BUS_SIGNATURE_INTERN_MAX];
+
+        char signature[];
+};
+
+const BusSignature* bus_signature_get(const char *s, size_t n);
+const BusSignature* bus_signature_child(const BusSignature *sig, size_t i);
+
+static inline int bus_signature_element_length(const BusSignature *sig, size_t i, size_t *l) {
+        if (i >= sig->length || sig->element_length[i] == 0)
+                return -EINVAL;
+
+        *l = sig->element_length[i];
+        return 0;
+}
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <endian.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -18,6 +19,7 @@
 #include "hexdecoct.h"
 #include "io-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "memory-util.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -26,10 +28,12 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
+#define BUS_READ_CHUNK_SIZE (16U*1024U)
 
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
@@ -60,6 +64,62 @@ static int append_iovec(sd_bus_message *m, const void *p, size_t sz) {
         return 0;
 }
 
+static bool bus_message_use_memfd_body(sd_bus_message *m) {
+        assert(m);
+
+        /* Large bodies are passed in a sealed memfd if the peer agreed to that, see BUS_MESSAGE_MEMFD_BODY.
+         * The memfd is sent along with the other fds, hence we need to leave room for it. We don't want
+         * sensitive data to end up in a memfd we don't control the lifetime of. */
+
+        return m->bus &&
+                m->bus->can_memfd &&
+                !BUS_MESSAGE_IS_GVARIANT(m) &&
+                m->body_size >= MEMFD_MIN_SIZE &&
+                m->n_fds < BUS_FDS_MAX &&
+                !m->sensitive;
+}
+
+static int bus_message_setup_memfd_body(sd_bus_message *m) {
+        _cleanup_close_ int fd = -1;
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(m->n_iovec > 0);
+
+        fd = memfd_new("sd-bus-body");
+        if (fd < 0)
+                return fd;
+
+        /* The first iovec is the header, the others make up the body */
+        for (i = 1; i < m->n_iovec; i++) {
+                r = loop_write(fd, m->iovec[i].iov_base, m->iovec[i].iov_len, false);
+                if (r < 0)
+                        return r;
+        }
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        m->body_memfd = TAKE_FD(fd);
+        m->header->flags |= BUS_MESSAGE_MEMFD_BODY;
+        m->n_iovec = 1;
+
+        return 0;
+}
+
+static size_t bus_message_wire_size(sd_bus_message *m) {
+        assert(m);
+
+        /* The number of bytes of the message that go through the socket stream */
+
+        if (m->body_memfd >= 0)
+                return BUS_MESSAGE_BODY_BEGIN(m);
+
+        return BUS_MESSAGE_SIZE(m);
+}
+
 static int bus_message_setup_iovec(sd_bus_message *m) {
         struct bus_body_part *part;
         unsigned n, i;
@@ -74,7 +134,7 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
         assert(!m->iovec);
 
         n = 1 + m->n_body_parts;
-        if (n < ELEMENTSOF(m->iovec_fixed))
+        if (n <= ELEMENTSOF(m->iovec_fixed))
                 m->iovec = m->iovec_fixed;
         else {
                 m->iovec = new(struct iovec, n);
@@ -100,6 +160,13 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
 
         assert(n == m->n_iovec);
 
+        if (bus_message_use_memfd_body(m)) {
+                r = bus_message_setup_memfd_body(m);
+                if (r < 0)
+                        /* Not fatal, we can still send the body in-line */
+                        log_debug_errno(r, "Failed to put message body into memfd, sending it in-line: %m");
+        }
+
         return 0;
 
 fail:
@@ -156,17 +223,18 @@ static int bus_socket_write_auth(sd_bus *b) {
 }
 
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *d, *e, *f, *start;
+        char *d, *e, *f, *g, *start;
         sd_id128_t peer;
         int r;
 
         assert(b);
 
         /*
-         * We expect three response lines:
+         * We expect up to four response lines:
          *   "DATA\r\n"
          *   "OK <server-id>\r\n"
          *   "AGREE_UNIX_FD\r\n"        (optional)
+         *   "AGREE_MEMFD_BODY\r\n"     (optional)
          */
 
         d = memmem_safe(b->rbuffer, b->rbuffer_size, "\r\n", 2);
@@ -188,6 +256,15 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 start = e + 2;
         }
 
+        if (f && b->accept_memfd) {
+                g = memmem(f + 2, b->rbuffer_size - (f - (char*) b->rbuffer) - 2, "\r\n", 2);
+                if (!g)
+                        return 0;
+
+                start = g + 2;
+        } else
+                g = NULL;
+
         /* Nice! We got all the lines we need. First check the DATA line. */
 
         if (d - (char*) b->rbuffer == 4) {
@@ -241,6 +318,14 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         memcmp(e + 2, "AGREE_UNIX_FD",
                                STRLEN("AGREE_UNIX_FD")) == 0;
 
+        /* A server that doesn't know the memfd extension replies with an error, which is fine, too */
+        if (g)
+                b->can_memfd =
+                        b->can_fds &&
+                        (g - f == STRLEN("\r\nAGREE_MEMFD_BODY")) &&
+                        memcmp(f + 2, "AGREE_MEMFD_BODY",
+                               STRLEN("AGREE_MEMFD_BODY")) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -490,6 +575,15 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD_BODY")) {
+                        /* Our own extension, see BUS_MESSAGE_MEMFD_BODY. The memfds are passed as fds,
+                         * hence this requires NEGOTIATE_UNIX_FD to have been agreed on first. */
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds || !b->accept_memfd)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD_BODY\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -541,6 +635,7 @@ static int bus_socket_read_auth(sd_bus *b) {
                 return -ENOMEM;
 
         b->rbuffer = p;
+        b->rbuffer_allocated = n;
 
         iov = IOVEC_MAKE((uint8_t *)b->rbuffer + b->rbuffer_size, n - b->rbuffer_size);
 
@@ -656,6 +751,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         static const char sasl_negotiate_unix_fd[] = {
                 "NEGOTIATE_UNIX_FD\r\n"
         };
+        static const char sasl_negotiate_memfd_body[] = {
+                "NEGOTIATE_MEMFD_BODY\r\n"
+        };
         static const char sasl_begin[] = {
                 "BEGIN\r\n"
         };
@@ -668,9 +766,13 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         else
                 b->auth_iovec[i++] = IOVEC_MAKE((char*) sasl_auth_external, sizeof(sasl_auth_external) - 1);
 
-        if (b->accept_fd)
+        if (b->accept_fd) {
                 b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_fd);
 
+                if (b->accept_memfd)
+                        b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_memfd_body);
+        }
+
         b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_begin);
 
         return bus_socket_write_auth(b);
@@ -999,76 +1101,157 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
-        struct iovec *iov;
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **m, size_t n, size_t *idx, size_t *ret_n_done) {
+        struct msghdr mh = {};
+        size_t i, left, n_iov = 0, n_done = 0;
         ssize_t k;
-        size_t n;
-        unsigned j;
         int r;
 
         assert(bus);
         assert(m);
+        assert(n > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        /* Writes as many of the specified messages as possible with a single syscall, starting at the
+         * offset *idx into the first one. The iovec arrays of the sealed messages are used as they are, only
+         * the array pointing to them is put together here, and it is kept around for the next call.
+         *
+         * The fds of a message need to be sent along with its first byte, and the reading side relies on
+         * the kernel not merging data carrying fds with data sent before it: hence only the first message
+         * of a batch may carry fds, and the batch ends before any later message that carries some. The
+         * memfd a large body is passed in counts as such an fd, too. */
+
+        if (*idx >= bus_message_wire_size(m[0])) {
+                if (ret_n_done)
+                        *ret_n_done = 0;
                 return 0;
+        }
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        for (i = 0; i < n; i++) {
+                unsigned j = 0;
+
+                r = bus_message_setup_iovec(m[i]);
+                if (r < 0)
+                        return r;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = newa(struct iovec, n);
-        memcpy_safe(iov, m->iovec, n);
+                if (i > 0 && (m[i]->n_fds > 0 || m[i]->body_memfd >= 0))
+                        break;
+
+                /* Always write the whole first message, but stop once further ones don't fit anymore */
+                if (i > 0 && n_iov + m[i]->n_iovec > IOV_MAX)
+                        break;
+
+                if (!GREEDY_REALLOC(bus->wiovec, bus->wiovec_allocated, n_iov + m[i]->n_iovec))
+                        return -ENOMEM;
 
-        j = 0;
-        iovec_advance(iov, &j, *idx);
+                memcpy_safe(bus->wiovec + n_iov, m[i]->iovec, m[i]->n_iovec * sizeof(struct iovec));
+
+                if (i == 0) {
+                        /* Skip over what has been written already */
+                        iovec_advance(bus->wiovec, &j, *idx);
+                        memmove(bus->wiovec, bus->wiovec + j, (m[0]->n_iovec - j) * sizeof(struct iovec));
+                        n_iov = m[0]->n_iovec - j;
+                } else
+                        n_iov += m[i]->n_iovec;
+        }
+
+        mh.msg_iov = bus->wiovec;
+        mh.msg_iovlen = n_iov;
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, mh.msg_iov, mh.msg_iovlen);
         else {
-                struct msghdr mh = {
-                        .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
-                };
+                size_t n_fds = m[0]->n_fds + (m[0]->body_memfd >= 0);
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if (n_fds > 0 && *idx == 0) {
                         struct cmsghdr *control;
 
-                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * m->n_fds);
+                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
                         mh.msg_control = alloca0(mh.msg_controllen);
                         control = CMSG_FIRSTHDR(&mh);
-                        control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        memcpy_safe(CMSG_DATA(control), m[0]->fds, sizeof(int) * m[0]->n_fds);
+
+                        /* The body memfd always comes last */
+                        if (m[0]->body_memfd >= 0)
+                                ((int*) CMSG_DATA(control))[n_fds - 1] = m[0]->body_memfd;
                 }
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, mh.msg_iov, mh.msg_iovlen);
                 }
         }
 
         if (k < 0)
                 return errno == EAGAIN ? 0 : -errno;
 
-        *idx += (size_t) k;
+        /* Figure out how many of the messages went out completely */
+        left = (size_t) k;
+        for (i = 0; i < n; i++) {
+                size_t l;
+
+                l = bus_message_wire_size(m[i]) - *idx;
+                if (left < l) {
+                        *idx += left;
+                        break;
+                }
+
+                left -= l;
+                *idx = 0;
+                n_done++;
+        }
+
+        bus->n_write_calls++;
+        bus->n_written_messages += n_done;
+
+        if (ret_n_done)
+                *ret_n_done = n_done;
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        size_t n_done;
+        int r;
+
+        assert(m);
+        assert(idx);
+
+        r = bus_socket_write_messages(bus, &m, 1, idx, &n_done);
+        if (r > 0 && n_done > 0)
+                /* Keep the index at the end of the message, so that the caller can tell it is complete */
+                *idx = BUS_MESSAGE_SIZE(m);
+
+        return r;
+}
+
+static uint32_t bus_header_read_u32(bool le, const uint8_t *p) {
+        return le ? unaligned_read_le32(p) : unaligned_read_be32(p);
+}
+
+static bool bus_socket_has_memfd_body(sd_bus *bus, const void *p) {
+        assert(bus);
+        assert(p);
+
+        /* Unknown flags are to be ignored, hence only honour this one if we agreed on it */
+        return bus->can_memfd && (((const struct bus_header*) p)->flags & BUS_MESSAGE_MEMFD_BODY);
+}
+
+static int bus_socket_read_message_need(sd_bus *bus, const void *p, size_t size, size_t *need) {
         uint32_t a, b;
         uint8_t e;
         uint64_t sum;
 
         assert(bus);
+        assert(p || size == 0);
         assert(need);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        if (size < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -1090,75 +1273,230 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
-
-        e = ((const uint8_t*) bus->rbuffer)[0];
-        if (e == BUS_LITTLE_ENDIAN) {
-                a = le32toh(a);
-                b = le32toh(b);
-        } else if (e == BUS_BIG_ENDIAN) {
-                a = be32toh(a);
-                b = be32toh(b);
-        } else
+        /* Messages following each other in the read buffer are not necessarily aligned */
+        e = ((const uint8_t*) p)[0];
+        if (!IN_SET(e, BUS_LITTLE_ENDIAN, BUS_BIG_ENDIAN))
                 return -EBADMSG;
 
+        a = bus_header_read_u32(e == BUS_LITTLE_ENDIAN, (const uint8_t*) p + 4);
+        b = bus_header_read_u32(e == BUS_LITTLE_ENDIAN, (const uint8_t*) p + 12);
+
         sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
 
+        /* If the body is passed in a memfd, only the header is in the stream */
+        if (bus_socket_has_memfd_body(bus, p))
+                sum -= a;
+
         *need = (size_t) sum;
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
+static bool bus_socket_peek_unix_fds(const void *p, size_t size, unsigned *ret) {
+        const uint8_t *h = p;
+        size_t i, end;
+        uint32_t l;
+        bool le;
+
+        assert(p);
+        assert(size >= sizeof(struct bus_header));
+        assert(ret);
+
+        /* Since we read more than one message at a time, we need to know how many of the fds we got belong
+         * to which message. This looks for the UNIX_FDS header field of a complete message, without fully
+         * parsing it. Returns false if that's not possible because of unexpected header fields, in which
+         * case the message is simply handed all fds, and will fail validation if they don't match. */
+
+        le = h[0] == BUS_LITTLE_ENDIAN;
+
+        l = bus_header_read_u32(le, h + 12);
+        if (l > size - sizeof(struct bus_header))
+                return false;
+
+        i = sizeof(struct bus_header);
+        end = i + l;
+
+        while (i < end) {
+                uint8_t code;
+                char type;
+
+                /* Each field is a (yv) struct, aligned to 8 bytes */
+                i = ALIGN8(i);
+                if (i + 3 > end)
+                        return false;
+
+                code = h[i++];
+
+                /* We only know how to skip fields with single type signatures */
+                if (h[i] != 1 || h[i+2] != 0)
+                        return false;
+
+                type = h[i+1];
+                i += 3;
+
+                switch (type) {
+
+                case SD_BUS_TYPE_UINT32:
+                        i = ALIGN4(i);
+                        if (i + 4 > end)
+                                return false;
+
+                        if (code == BUS_MESSAGE_HEADER_UNIX_FDS) {
+                                *ret = bus_header_read_u32(le, h + i);
+                                return true;
+                        }
+
+                        i += 4;
+                        break;
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        i = ALIGN4(i);
+                        if (i + 4 > end)
+                                return false;
+
+                        l = bus_header_read_u32(le, h + i);
+                        if (l >= end - i - 4)
+                                return false;
+
+                        i += 4 + l + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        if (i >= end)
+                                return false;
+
+                        i += 1 + h[i] + 1;
+                        break;
+
+                default:
+                        return false;
+                }
+        }
+
+        *ret = 0;
+        return true;
+}
+
+static int bus_socket_make_message(sd_bus *bus, const void *p, size_t size) {
+        _cleanup_free_ int *fds = NULL;
+        _cleanup_close_ int body_memfd = -1;
         sd_bus_message *t = NULL;
-        void *b;
+        bool memfd_body;
+        unsigned n_fds;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         r = bus_rqueue_make_room(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
-                if (!b)
+        memfd_body = bus_socket_has_memfd_body(bus, p);
+
+        /* Pass the fds that belong to this message, and keep the remaining ones for the next. The body
+         * memfd follows the fds listed in the header. */
+        if (!bus_socket_peek_unix_fds(p, size, &n_fds) || n_fds + memfd_body >= bus->n_fds) {
+                n_fds = bus->n_fds;
+                fds = TAKE_PTR(bus->fds);
+                bus->n_fds = 0;
+        } else if (n_fds + memfd_body > 0) {
+                n_fds += memfd_body;
+
+                fds = newdup(int, bus->fds, n_fds);
+                if (!fds)
                         return -ENOMEM;
-        } else
-                b = NULL;
 
-        r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
-                                    NULL,
-                                    &t);
+                memmove(bus->fds, bus->fds + n_fds, sizeof(int) * (bus->n_fds - n_fds));
+                bus->n_fds -= n_fds;
+        }
+
+        if (memfd_body) {
+                if (n_fds == 0) {
+                        log_debug("Received message without body memfd from connection %s, dropping.", strna(bus->description));
+                        return 1;
+                }
+
+                body_memfd = fds[--n_fds];
+
+                /* The data is mapped from the memfd, only the header is copied */
+                r = bus_message_from_memfd_body(bus,
+                                                p, size,
+                                                body_memfd,
+                                                bus_header_read_u32(((const uint8_t*) p)[0] == BUS_LITTLE_ENDIAN, (const uint8_t*) p + 4),
+                                                fds, n_fds,
+                                                NULL,
+                                                &t);
+                if (r >= 0)
+                        TAKE_FD(body_memfd);
+        } else
+                /* The message gets a copy of its data, allocated along with the message object */
+                r = bus_message_from_buffer(bus,
+                                            p, size,
+                                            fds, n_fds,
+                                            NULL,
+                                            &t);
         if (r == -EBADMSG) {
                 log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
-                free(bus->rbuffer); /* We want to drop current rbuffer and proceed with whatever remains in b */
-        } else if (r < 0) {
-                free(b);
+                close_many(fds, n_fds);
+                return 1;
+        }
+        if (r < 0) {
+                close_many(fds, n_fds);
                 return r;
         }
 
-        /* rbuffer ownership was either transferred to t, or we got EBADMSG and dropped it. */
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
+        /* The fds are owned by the message now */
+        TAKE_PTR(fds);
+
+        t->read_counter = ++bus->read_counter;
+        bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
+        sd_bus_message_unref(t);
+
+        return 1;
+}
+
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0, need;
+        int r, n = 0;
+
+        assert(bus);
+
+        /* Splits off all complete messages we have buffered, and moves whatever remains to the front of the
+         * read buffer, so that it can be reused for the next read. Returns the number of messages we got. */
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        for (;;) {
+                /* Leave the rest for later if the queue is full, but fail if we can't queue a single one,
+                 * like we always did */
+                if (n > 0 && bus->rqueue_size >= BUS_RQUEUE_MAX)
+                        break;
+
+                r = bus_socket_read_message_need(bus, (uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset, &need);
+                if (r < 0)
+                        goto finish;
+
+                if (bus->rbuffer_size - offset < need)
+                        break;
+
+                r = bus_socket_make_message(bus, (uint8_t*) bus->rbuffer + offset, need);
+                if (r < 0)
+                        goto finish;
 
-        if (t) {
-                t->read_counter = ++bus->read_counter;
-                bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
-                sd_bus_message_unref(t);
+                offset += need;
+                n++;
         }
 
-        return 1;
+        r = n;
+
+finish:
+        if (offset > 0) {
+                memmove(bus->rbuffer, (uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset);
+                bus->rbuffer_size -= offset;
+        }
+
+        return r;
 }
 
 int bus_socket_read_message(sd_bus *bus) {
@@ -1167,27 +1505,34 @@ int bus_socket_read_message(sd_bus *bus) {
         ssize_t k;
         size_t need;
         int r;
-        void *b;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * BUS_FDS_MAX)) control;
         bool handle_cmsg = false;
 
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_make_messages(bus);
+        if (r != 0)
+                return r < 0 ? r : 1;
+
+        r = bus_socket_read_message_need(bus, bus->rbuffer, bus->rbuffer_size, &need);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+        /* Read as much as we can get, up to a chunk, or the whole message if it is larger, so that bursts of
+         * messages are read with few syscalls. The buffer is kept around for the next read. */
+        if (bus->rbuffer_allocated < MAX(need, BUS_READ_CHUNK_SIZE)) {
+                void *b;
 
-        b = realloc(bus->rbuffer, need);
-        if (!b)
-                return -ENOMEM;
+                b = realloc(bus->rbuffer, MAX(need, BUS_READ_CHUNK_SIZE));
+                if (!b)
+                        return -ENOMEM;
 
-        bus->rbuffer = b;
+                bus->rbuffer = b;
+                bus->rbuffer_allocated = MAX(need, BUS_READ_CHUNK_SIZE);
+        }
 
-        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, need - bus->rbuffer_size);
+        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, bus->rbuffer_allocated - bus->rbuffer_size);
 
         if (bus->prefer_readv) {
                 k = readv(bus->input_fd, &iov, 1);
@@ -1255,13 +1600,10 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_make_messages(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
-
         return 1;
 }
 
@@ -14,6 +14,7 @@
 #include "sd-bus.h"
 
 #include "alloc-util.h"
+#include "bus-concurrent.h"
 #include "bus-container.h"
 #include "bus-control.h"
 #include "bus-internal.h"
@@ -193,6 +194,7 @@ static sd_bus* bus_free(sd_bus *b) {
         free(b->label);
         free(b->groups);
         free(b->rbuffer);
+        free(b->wiovec);
         free(b->unique_name);
         free(b->auth_buffer);
         free(b->address);
@@ -220,6 +222,9 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
 
+        assert(hashmap_isempty(b->concurrent_queues));
+        hashmap_free(b->concurrent_queues);
+
         bus_flush_memfd(b);
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
@@ -249,6 +254,7 @@ _public_ int sd_bus_new(sd_bus **ret) {
                 .original_pid = getpid_cached(),
                 .n_groups = (size_t) -1,
                 .close_on_exit = true,
+                .process_batch_max = 1,
         };
 
         /* We guarantee that wqueue always has space for at least one entry */
@@ -337,6 +343,16 @@ _public_ int sd_bus_negotiate_fds(sd_bus *bus, int b) {
         return 0;
 }
 
+_public_ int sd_bus_negotiate_memfd(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(bus->state == BUS_UNSET, -EPERM);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->accept_memfd = !!b;
+        return 0;
+}
+
 _public_ int sd_bus_negotiate_timestamp(sd_bus *bus, int b) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -1603,7 +1619,26 @@ void bus_enter_closing(sd_bus *bus) {
         bus_set_state(bus, BUS_CLOSING);
 }
 
-DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_bus, sd_bus, bus_free);
+/* The reference counter is updated atomically, since messages passed to concurrent method call handlers are
+ * referenced and unreferenced from worker threads, and each message reference is a reference on the bus too. */
+_public_ sd_bus* sd_bus_ref(sd_bus *bus) {
+        if (!bus)
+                return NULL;
+
+        assert_se(__atomic_fetch_add(&bus->n_ref, 1, __ATOMIC_RELAXED) > 0);
+        return bus;
+}
+
+_public_ sd_bus* sd_bus_unref(sd_bus *bus) {
+        if (!bus)
+                return NULL;
+
+        assert(bus->n_ref > 0);
+        if (__atomic_sub_fetch(&bus->n_ref, 1, __ATOMIC_ACQ_REL) > 0)
+                return NULL;
+
+        return bus_free(bus);
+}
 
 _public_ int sd_bus_is_open(sd_bus *bus) {
         assert_return(bus, -EINVAL);
@@ -1776,6 +1811,23 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
+static void bus_log_sent_message(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         int r;
 
@@ -1787,18 +1839,7 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                 return r;
 
         if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->root_container.signature),
-                          strna(m->error.name),
-                          strna(m->error.message));
+                bus_log_sent_message(m);
 
         return r;
 }
@@ -1810,31 +1851,33 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                size_t i, n_done;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                /* Write as many of the queued messages as possible in one go */
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex, &n_done);
                 if (r < 0)
                         return r;
-                else if (r == 0)
+                if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        bus_message_unref_queued(bus->wqueue[0], bus);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
-
-                        ret = 1;
+                if (n_done == 0)
+                        continue;
+
+                /* Drop the fully written entries from the queue.
+                 *
+                 * This isn't particularly optimized, but well, this is supposed to be our worst-case
+                 * buffer only, and the socket buffer is supposed to be our primary buffer, and if it got
+                 * full, then all bets are off anyway. */
+
+                for (i = 0; i < n_done; i++) {
+                        bus_log_sent_message(bus->wqueue[i]);
+                        bus_message_unref_queued(bus->wqueue[i], bus);
                 }
+
+                bus->wqueue_size -= n_done;
+                memmove(bus->wqueue, bus->wqueue + n_done, sizeof(sd_bus_message*) * bus->wqueue_size);
+
+                ret = 1;
         }
 
         return ret;
@@ -1907,6 +1950,11 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                 assert_return(bus = m->bus, -ENOTCONN);
         assert_return(!bus_pid_changed(bus), -ECHILD);
 
+        /* Messages sent from a concurrent method call handler are sent once it returned */
+        r = bus_concurrent_call_capture(bus, m, cookie);
+        if (r != 0)
+                return r;
+
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
@@ -2057,6 +2105,7 @@ _public_ int sd_bus_call_async(
         else
                 assert_return(bus = m->bus, -ENOTCONN);
         assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(!bus_concurrent_call_running(bus), -EBUSY);
 
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
@@ -2164,6 +2213,7 @@ _public_ int sd_bus_call(
         else
                 assert_return(bus = m->bus, -ENOTCONN);
         bus_assert_return(!bus_pid_changed(bus), -ECHILD, error);
+        bus_assert_return(!bus_concurrent_call_running(bus), -EBUSY, error);
 
         if (!BUS_IS_OPEN(bus->state)) {
                 r = -ENOTCONN;
@@ -3402,35 +3452,46 @@ bool bus_pid_changed(sd_bus *bus) {
         return bus->original_pid != getpid_cached();
 }
 
-static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        sd_bus *bus = userdata;
+static void bus_process_batch(sd_bus *bus) {
+        unsigned i;
         int r;
 
         assert(bus);
 
-        /* Note that this is called both on input_fd, output_fd as well as inotify_fd events */
+        /* Process up to the configured number of messages in one go, and stop early once there's nothing to
+         * do anymore */
 
-        r = sd_bus_process(bus, NULL);
-        if (r < 0) {
-                log_debug_errno(r, "Processing of bus failed, closing down: %m");
-                bus_enter_closing(bus);
+        BUS_DONT_DESTROY(bus);
+
+        for (i = 0; i < bus->process_batch_max; i++) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0) {
+                        log_debug_errno(r, "Processing of bus failed, closing down: %m");
+                        bus_enter_closing(bus);
+                        return;
+                }
+                if (r == 0)
+                        return;
         }
+}
 
+static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        sd_bus *bus = userdata;
+
+        assert(bus);
+
+        /* Note that this is called both on input_fd, output_fd as well as inotify_fd events */
+
+        bus_process_batch(bus);
         return 1;
 }
 
 static int time_callback(sd_event_source *s, uint64_t usec, void *userdata) {
         sd_bus *bus = userdata;
-        int r;
 
         assert(bus);
 
-        r = sd_bus_process(bus, NULL);
-        if (r < 0) {
-                log_debug_errno(r, "Processing of bus failed, closing down: %m");
-                bus_enter_closing(bus);
-        }
-
+        bus_process_batch(bus);
         return 1;
 }
 
@@ -3668,6 +3729,9 @@ _public_ int sd_bus_detach_event(sd_bus *bus) {
         if (!bus->event)
                 return 0;
 
+        /* Concurrent method calls are executed through the event loop */
+        bus_concurrent_call_flush(bus);
+
         bus_detach_io_events(bus);
         bus_detach_inotify_event(bus);
 
@@ -4216,6 +4280,37 @@ _public_ int sd_bus_get_close_on_exit(sd_bus *bus) {
         return bus->close_on_exit;
 }
 
+_public_ int sd_bus_set_process_batch(sd_bus *bus, unsigned max_messages) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->process_batch_max = MAX(max_messages, 1u);
+        return 0;
+}
+
+_public_ int sd_bus_get_process_batch(sd_bus *bus, unsigned *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        *ret = bus->process_batch_max;
+        return 0;
+}
+
+_public_ int sd_bus_get_write_stats(sd_bus *bus, uint64_t *ret_n_calls, uint64_t *ret_n_messages) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (ret_n_calls)
+                *ret_n_calls = bus->n_write_calls;
+        if (ret_n_messages)
+                *ret_n_messages = bus->n_written_messages;
+        return 0;
+}
+
 _public_ int sd_bus_enqueue_for_read(sd_bus *bus, sd_bus_message *m) {
         int r;
 
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -12,6 +13,9 @@
 #include "def.h"
 #include "fd-util.h"
 #include "missing_resource.h"
+#include "sort-util.h"
+#include "string-table.h"
+#include "strv.h"
 #include "time-util.h"
 #include "util.h"
 
@@ -206,11 +210,419 @@ static void client_chart(Type type, const char *address, const char *server_name
         sd_bus_unref(b);
 }
 
+/* The benchmark suite below runs everything over direct connections between threads of this process, so
+ * that no bus broker is involved, and the numbers reflect bus-message.c and bus-socket.c only. Each
+ * measurement is printed as one line of tab separated values, see suite_print_header(). */
+
+#define SUITE_SIGNALS_PER_ROUND 100U
+
+typedef enum SuiteTest {
+        SUITE_LATENCY,
+        SUITE_FANOUT,
+        SUITE_GETALL,
+        SUITE_FDS,
+        SUITE_THREADS,
+        _SUITE_TEST_MAX,
+        _SUITE_TEST_INVALID = -1,
+} SuiteTest;
+
+typedef struct SuiteServer {
+        int fd;
+        pthread_t thread;
+        bool quit;
+
+        sd_bus_vtable *properties;
+        char **property_names;
+        uint32_t value;
+} SuiteServer;
+
+static int suite_method_echo(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        const void *p;
+        size_t sz;
+
+        assert_se(sd_bus_message_read_array(m, 'y', &p, &sz) >= 0);
+        assert_se(sd_bus_message_new_method_return(m, &reply) >= 0);
+        assert_se(sd_bus_message_append_array(reply, 'y', p, sz) >= 0);
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int suite_method_fds(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        int fd;
+
+        assert_se(sd_bus_message_enter_container(m, 'a', "h") >= 0);
+        while (sd_bus_message_read(m, "h", &fd) > 0)
+                assert_se(fd >= 0);
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int suite_method_emit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        uint32_t i, n;
+
+        assert_se(sd_bus_message_read(m, "u", &n) >= 0);
+
+        for (i = 0; i < n; i++)
+                assert_se(sd_bus_emit_signal(sd_bus_message_get_bus(m), "/", "benchmark.server", "Tick", "u", i) >= 0);
+
+        /* The reply is queued after the signals, hence the client has all of them once it got it */
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int suite_method_exit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        SuiteServer *s = userdata;
+
+        s->quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable suite_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Echo", "ay", "ay", suite_method_echo, 0),
+        SD_BUS_METHOD("Fds", "ah", NULL, suite_method_fds, 0),
+        SD_BUS_METHOD("Emit", "u", NULL, suite_method_emit, 0),
+        SD_BUS_METHOD("Exit", NULL, NULL, suite_method_exit, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void *suite_server_thread(void *p) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *b = NULL;
+        SuiteServer *s = p;
+        int r;
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, s->fd, s->fd) >= 0);
+        assert_se(sd_bus_set_server(b, true, SD_ID128_NULL) >= 0);
+        assert_se(sd_bus_negotiate_memfd(b, true) >= 0);
+        assert_se(sd_bus_add_object_vtable(b, NULL, "/", "benchmark.server", suite_vtable, s) >= 0);
+        if (s->properties)
+                assert_se(sd_bus_add_object_vtable(b, NULL, "/", "benchmark.Properties", s->properties, &s->value) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        while (!s->quit) {
+                r = sd_bus_process(b, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(b, USEC_INFINITY) >= 0);
+        }
+
+        return NULL;
+}
+
+static void suite_server_setup_properties(SuiteServer *s, size_t n) {
+        size_t i;
+
+        assert(s);
+
+        s->properties = new0(sd_bus_vtable, n + 2);
+        assert_se(s->properties);
+        s->property_names = new0(char*, n + 1);
+        assert_se(s->property_names);
+
+        s->properties[0] = (sd_bus_vtable) SD_BUS_VTABLE_START(0);
+        for (i = 0; i < n; i++) {
+                assert_se(asprintf(&s->property_names[i], "Property%zu", i) >= 0);
+                s->properties[i + 1] = (sd_bus_vtable) SD_BUS_PROPERTY(s->property_names[i], "u", NULL, 0, SD_BUS_VTABLE_PROPERTY_CONST);
+        }
+        s->properties[n + 1] = (sd_bus_vtable) SD_BUS_VTABLE_END;
+}
+
+static sd_bus* suite_start(SuiteServer *s, size_t n_properties, bool memfd) {
+        sd_bus *b;
+        int fds[2];
+
+        assert(s);
+
+        *s = (SuiteServer) {};
+
+        if (n_properties > 0)
+                suite_server_setup_properties(s, n_properties);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        s->fd = fds[0];
+        assert_se(pthread_create(&s->thread, NULL, suite_server_thread, s) == 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_negotiate_memfd(b, memfd) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        return b;
+}
+
+static void suite_stop(SuiteServer *s, sd_bus *b) {
+        assert(s);
+
+        assert_se(sd_bus_call_method(b, NULL, "/", "benchmark.server", "Exit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(s->thread, NULL) == 0);
+        sd_bus_flush_close_unref(b);
+
+        free(s->properties);
+        strv_free(s->property_names);
+}
+
+static int usec_compare(const usec_t *a, const usec_t *b) {
+        return CMP(*a, *b);
+}
+
+static void suite_print_header(void) {
+        /* One line per measurement: the test, its parameter (payload size, number of subscribers,
+         * properties, fds or threads), the number of operations done, the 50th and 99th percentile of
+         * their latency, and the number of operations per second. */
+        printf("TEST\tPARAMETER\tCOUNT\tP50_USEC\tP99_USEC\tPER_SEC\n");
+}
+
+static void suite_print_result(const char *test, uint64_t parameter, usec_t *latencies, size_t n, usec_t duration) {
+        assert(test);
+        assert(latencies || n == 0);
+
+        typesafe_qsort(latencies, n, usec_compare);
+
+        printf("%s\t%" PRIu64 "\t%zu\t" USEC_FMT "\t" USEC_FMT "\t%" PRIu64 "\n",
+               test, parameter, n,
+               n > 0 ? latencies[(n - 1) * 50 / 100] : 0,
+               n > 0 ? latencies[(n - 1) * 99 / 100] : 0,
+               duration > 0 ? (uint64_t) n * USEC_PER_SEC / duration : 0);
+        fflush(stdout);
+}
+
+typedef void (*suite_operation_t)(sd_bus *b, uint64_t parameter, void *userdata);
+
+static usec_t suite_run(sd_bus *b, suite_operation_t op, uint64_t parameter, void *userdata, usec_t **latencies, size_t *n, size_t *allocated) {
+        usec_t begin, t, u;
+
+        assert(latencies);
+        assert(n);
+        assert(allocated);
+
+        /* Runs the operation repeatedly for the configured time, and records the latency of each run */
+
+        begin = t = now(CLOCK_MONOTONIC);
+        do {
+                op(b, parameter, userdata);
+
+                u = now(CLOCK_MONOTONIC);
+                assert_se(GREEDY_REALLOC(*latencies, *allocated, *n + 1));
+                (*latencies)[(*n)++] = u - t;
+                t = u;
+        } while (t < begin + arg_loop_usec);
+
+        return t - begin;
+}
+
+static void suite_op_echo(sd_bus *b, uint64_t size, void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        const void *p;
+        void *q;
+        size_t sz;
+
+        assert_se(sd_bus_message_new_method_call(b, &m, NULL, "/", "benchmark.server", "Echo") >= 0);
+        assert_se(sd_bus_message_append_array_space(m, 'y', size, &q) >= 0);
+        memset(q, 0x80, size);
+
+        assert_se(sd_bus_call(b, m, 0, NULL, &reply) >= 0);
+        assert_se(sd_bus_message_read_array(reply, 'y', &p, &sz) >= 0);
+        assert_se(sz == size);
+}
+
+static int suite_tick(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 0;
+}
+
+static void suite_op_fanout(sd_bus *b, uint64_t n_subscribers, void *userdata) {
+        unsigned *n_ticks = userdata;
+
+        *n_ticks = 0;
+
+        assert_se(sd_bus_call_method(b, NULL, "/", "benchmark.server", "Emit", NULL, NULL, "u", SUITE_SIGNALS_PER_ROUND) >= 0);
+
+        /* The signals have been queued while we waited for the reply, dispatch them all */
+        while (*n_ticks < SUITE_SIGNALS_PER_ROUND * n_subscribers)
+                assert_se(sd_bus_process(b, NULL) > 0);
+}
+
+static void suite_op_getall(sd_bus *b, uint64_t n_properties, void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+        assert_se(sd_bus_call_method(b, NULL, "/", "org.freedesktop.DBus.Properties", "GetAll", NULL, &reply, "s", "benchmark.Properties") >= 0);
+        assert_se(sd_bus_message_skip(reply, "a{sv}") >= 0);
+}
+
+static void suite_op_fds(sd_bus *b, uint64_t n_fds, void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        uint64_t i;
+
+        assert_se(sd_bus_message_new_method_call(b, &m, NULL, "/", "benchmark.server", "Fds") >= 0);
+        assert_se(sd_bus_message_open_container(m, 'a', "h") >= 0);
+        for (i = 0; i < n_fds; i++)
+                assert_se(sd_bus_message_append(m, "h", STDERR_FILENO) >= 0);
+        assert_se(sd_bus_message_close_container(m) >= 0);
+
+        assert_se(sd_bus_call(b, m, 0, NULL, NULL) >= 0);
+}
+
+typedef struct SuiteWorker {
+        pthread_t thread;
+        usec_t *latencies;
+        size_t n, allocated;
+        usec_t duration;
+} SuiteWorker;
+
+static void *suite_worker_thread(void *p) {
+        SuiteWorker *w = p;
+        SuiteServer s;
+        sd_bus *b;
+
+        /* Each worker has its own connection and server thread, and only competes for the CPUs */
+        b = suite_start(&s, 0, false);
+        w->duration = suite_run(b, suite_op_echo, 0, NULL, &w->latencies, &w->n, &w->allocated);
+        suite_stop(&s, b);
+
+        return NULL;
+}
+
+static void suite_threads(uint64_t n_threads) {
+        _cleanup_free_ SuiteWorker *workers = NULL;
+        _cleanup_free_ usec_t *latencies = NULL;
+        usec_t duration = 0;
+        size_t i, n = 0;
+
+        workers = new0(SuiteWorker, n_threads);
+        assert_se(workers);
+
+        for (i = 0; i < n_threads; i++)
+                assert_se(pthread_create(&workers[i].thread, NULL, suite_worker_thread, workers + i) == 0);
+
+        for (i = 0; i < n_threads; i++) {
+                assert_se(pthread_join(workers[i].thread, NULL) == 0);
+
+                assert_se(latencies = reallocarray(latencies, n + workers[i].n, sizeof(usec_t)));
+                memcpy(latencies + n, workers[i].latencies, workers[i].n * sizeof(usec_t));
+                n += workers[i].n;
+
+                duration = MAX(duration, workers[i].duration);
+                free(workers[i].latencies);
+        }
+
+        suite_print_result("threads", n_threads, latencies, n, duration);
+}
+
+static void suite_test(SuiteTest test) {
+        static const uint64_t payload_sizes[] = { 0, 64, 1024, 16*1024, 256*1024, 1024*1024, 4*1024*1024 };
+        static const uint64_t n_subscribers[] = { 1, 10, 100, 1000 };
+        static const uint64_t n_properties[] = { 10, 100, 1000 };
+        static const uint64_t n_fds[] = { 1, 16, 128 };
+        static const uint64_t n_threads[] = { 1, 2, 4, 8 };
+        size_t i;
+
+        switch (test) {
+
+        case SUITE_LATENCY:
+                for (i = 0; i < ELEMENTSOF(payload_sizes); i++) {
+                        unsigned memfd;
+
+                        /* Large payloads go through memfds if negotiated, measure both ways */
+                        for (memfd = 0; memfd <= (payload_sizes[i] >= MEMFD_MIN_SIZE); memfd++) {
+                                _cleanup_free_ usec_t *latencies = NULL;
+                                size_t n = 0, allocated = 0;
+                                SuiteServer s;
+                                usec_t duration;
+                                sd_bus *b;
+
+                                b = suite_start(&s, 0, memfd);
+                                duration = suite_run(b, suite_op_echo, payload_sizes[i], NULL, &latencies, &n, &allocated);
+                                suite_stop(&s, b);
+
+                                suite_print_result(memfd ? "latency-memfd" : "latency", payload_sizes[i], latencies, n, duration);
+                        }
+                }
+                break;
+
+        case SUITE_FANOUT:
+                for (i = 0; i < ELEMENTSOF(n_subscribers); i++) {
+                        _cleanup_free_ usec_t *latencies = NULL;
+                        size_t n = 0, allocated = 0;
+                        unsigned n_ticks = 0;
+                        SuiteServer s;
+                        usec_t duration;
+                        uint64_t j;
+                        sd_bus *b;
+
+                        b = suite_start(&s, 0, false);
+                        for (j = 0; j < n_subscribers[i]; j++)
+                                assert_se(sd_bus_add_match(b, NULL, "type='signal',interface='benchmark.server',member='Tick'", suite_tick, &n_ticks) >= 0);
+
+                        duration = suite_run(b, suite_op_fanout, n_subscribers[i], &n_ticks, &latencies, &n, &allocated);
+                        suite_stop(&s, b);
+
+                        suite_print_result("fanout", n_subscribers[i], latencies, n, duration);
+                }
+                break;
+
+        case SUITE_GETALL:
+                for (i = 0; i < ELEMENTSOF(n_properties); i++) {
+                        _cleanup_free_ usec_t *latencies = NULL;
+                        size_t n = 0, allocated = 0;
+                        SuiteServer s;
+                        usec_t duration;
+                        sd_bus *b;
+
+                        b = suite_start(&s, n_properties[i], false);
+                        duration = suite_run(b, suite_op_getall, n_properties[i], NULL, &latencies, &n, &allocated);
+                        suite_stop(&s, b);
+
+                        suite_print_result("getall", n_properties[i], latencies, n, duration);
+                }
+                break;
+
+        case SUITE_FDS:
+                for (i = 0; i < ELEMENTSOF(n_fds); i++) {
+                        _cleanup_free_ usec_t *latencies = NULL;
+                        size_t n = 0, allocated = 0;
+                        SuiteServer s;
+                        usec_t duration;
+                        sd_bus *b;
+
+                        b = suite_start(&s, 0, false);
+                        duration = suite_run(b, suite_op_fds, n_fds[i], NULL, &latencies, &n, &allocated);
+                        suite_stop(&s, b);
+
+                        suite_print_result("fds", n_fds[i], latencies, n, duration);
+                }
+                break;
+
+        case SUITE_THREADS:
+                for (i = 0; i < ELEMENTSOF(n_threads); i++)
+                        suite_threads(n_threads[i]);
+                break;
+
+        default:
+                assert_not_reached("Unknown test");
+        }
+}
+
+static const char* const suite_test_table[_SUITE_TEST_MAX] = {
+        [SUITE_LATENCY] = "latency",
+        [SUITE_FANOUT] = "fanout",
+        [SUITE_GETALL] = "getall",
+        [SUITE_FDS] = "fds",
+        [SUITE_THREADS] = "threads",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(suite_test, SuiteTest);
+
 int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_SUITE,
         } mode = MODE_BISECT;
+        SuiteTest test = _SUITE_TEST_INVALID;
         Type type = TYPE_LEGACY;
         int i, pair[2] = { -1, -1 };
         _cleanup_free_ char *address = NULL, *server_name = NULL;
@@ -232,6 +644,13 @@ int main(int argc, char *argv[]) {
                 } else if (streq(argv[i], "direct")) {
                         type = TYPE_DIRECT;
                         continue;
+                } else if (streq(argv[i], "suite")) {
+                        mode = MODE_SUITE;
+                        continue;
+                } else if (suite_test_from_string(argv[i]) >= 0) {
+                        mode = MODE_SUITE;
+                        test = suite_test_from_string(argv[i]);
+                        continue;
                 }
 
                 assert_se(parse_sec(argv[i], &arg_loop_usec) >= 0);
@@ -239,6 +658,19 @@ int main(int argc, char *argv[]) {
 
         assert_se(arg_loop_usec > 0);
 
+        if (mode == MODE_SUITE) {
+                /* Runs all tests of the suite, or just the one specified */
+                suite_print_header();
+
+                if (test >= 0)
+                        suite_test(test);
+                else
+                        for (test = 0; test < _SUITE_TEST_MAX; test++)
+                                suite_test(test);
+
+                return 0;
+        }
+
         if (type == TYPE_LEGACY) {
                 const char *e;
 
@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "fd-util.h"
+#include "log.h"
+#include "macro.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define N_CONNECTIONS 2
+#define SLEEP_USEC (300 * USEC_PER_MSEC)
+
+typedef struct Server {
+        int fds[N_CONNECTIONS];
+        sd_bus *buses[N_CONNECTIONS];
+        pthread_t loop_thread;
+} Server;
+
+static int method_sleep(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        uint64_t usec;
+        uint32_t n;
+        int r;
+
+        r = sd_bus_message_read(m, "tu", &usec, &n);
+        if (r < 0)
+                return r;
+
+        (void) usleep(usec);
+
+        return sd_bus_reply_method_return(m, "u", n);
+}
+
+static int method_fail(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return -EIO;
+}
+
+static int method_nested(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        int r;
+
+        /* Only sending messages is allowed from a concurrent handler, blocking calls are refused */
+        r = sd_bus_call_method(sd_bus_message_get_bus(m), NULL, "/", "org.freedesktop.systemd.Test", "Ping", NULL, NULL, NULL);
+        assert_se(r == -EBUSY);
+
+        r = sd_bus_emit_signal(sd_bus_message_get_bus(m), "/", "org.freedesktop.systemd.Test", "Nested", NULL);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "i", r);
+}
+
+static int method_ping(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Server *s = userdata;
+
+        /* Not concurrent, hence executed on the event loop thread */
+        assert_se(pthread_equal(pthread_self(), s->loop_thread));
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_quit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        int r;
+
+        r = sd_bus_reply_method_return(m, NULL);
+        if (r < 0)
+                return r;
+
+        return sd_event_exit(sd_bus_get_event(sd_bus_message_get_bus(m)), 0);
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Sleep", "tu", "u", method_sleep, SD_BUS_VTABLE_METHOD_CONCURRENT),
+        SD_BUS_METHOD("Fail", NULL, NULL, method_fail, SD_BUS_VTABLE_METHOD_CONCURRENT),
+        SD_BUS_METHOD("Nested", NULL, "i", method_nested, SD_BUS_VTABLE_METHOD_CONCURRENT),
+        SD_BUS_METHOD("Ping", NULL, NULL, method_ping, 0),
+        SD_BUS_METHOD("Quit", NULL, NULL, method_quit, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void* server(void *p) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Server *s = p;
+        size_t i;
+
+        s->loop_thread = pthread_self();
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        for (i = 0; i < N_CONNECTIONS; i++) {
+                assert_se(sd_bus_new(&s->buses[i]) >= 0);
+                assert_se(sd_bus_set_fd(s->buses[i], s->fds[i], s->fds[i]) >= 0);
+                assert_se(sd_bus_set_server(s->buses[i], true, SD_ID128_NULL) >= 0);
+                assert_se(sd_bus_add_object_vtable(s->buses[i], NULL, "/", "org.freedesktop.systemd.Test", vtable, s) >= 0);
+                assert_se(sd_bus_attach_event(s->buses[i], e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+                assert_se(sd_bus_start(s->buses[i]) >= 0);
+        }
+
+        assert_se(sd_event_loop(e) >= 0);
+
+        for (i = 0; i < N_CONNECTIONS; i++)
+                s->buses[i] = sd_bus_flush_close_unref(s->buses[i]);
+
+        return NULL;
+}
+
+typedef struct Replies {
+        uint32_t order[4];
+        size_t n;
+} Replies;
+
+static int sleep_reply(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Replies *r = userdata;
+        uint32_t n;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+        assert_se(sd_bus_message_read(m, "u", &n) >= 0);
+
+        assert_se(r->n < ELEMENTSOF(r->order));
+        r->order[r->n++] = n;
+        return 0;
+}
+
+static void wait_for_replies(sd_bus *bus, Replies *r, size_t n) {
+        while (r->n < n) {
+                int k;
+
+                k = sd_bus_process(bus, NULL);
+                assert_se(k >= 0);
+                if (k > 0)
+                        continue;
+
+                assert_se(sd_bus_wait(bus, UINT64_MAX) >= 0);
+        }
+}
+
+static void test_concurrent(void) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        sd_bus *clients[N_CONNECTIONS] = {};
+        Replies replies[N_CONNECTIONS] = {};
+        Server s = {};
+        pthread_t t;
+        usec_t ts;
+        size_t i;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < N_CONNECTIONS; i++) {
+                int pair[2];
+
+                assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+                s.fds[i] = pair[0];
+
+                assert_se(sd_bus_new(&clients[i]) >= 0);
+                assert_se(sd_bus_set_fd(clients[i], pair[1], pair[1]) >= 0);
+                assert_se(sd_bus_start(clients[i]) >= 0);
+        }
+
+        assert_se(pthread_create(&t, NULL, server, &s) == 0);
+
+        /* Make sure both connections are fully set up, so that the calls below are sent right away */
+        for (i = 0; i < N_CONNECTIONS; i++)
+                assert_se(sd_bus_call_method(clients[i], NULL, "/", "org.freedesktop.systemd.Test", "Ping", &error, NULL, NULL) >= 0);
+
+        /* Calls of different connections are executed in parallel, the event loop stays responsive */
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_CONNECTIONS; i++)
+                assert_se(sd_bus_call_method_async(clients[i], NULL, NULL, "/", "org.freedesktop.systemd.Test", "Sleep",
+                                                   sleep_reply, &replies[i], "tu", SLEEP_USEC, (uint32_t) i) >= 0);
+
+        assert_se(sd_bus_call_method(clients[0], NULL, "/", "org.freedesktop.systemd.Test", "Ping", &error, NULL, NULL) >= 0);
+        assert_se(now(CLOCK_MONOTONIC) - ts < SLEEP_USEC);
+
+        for (i = 0; i < N_CONNECTIONS; i++) {
+                wait_for_replies(clients[i], &replies[i], 1);
+                assert_se(replies[i].order[0] == i);
+        }
+        log_info("Two calls sleeping %s each took %s.",
+                 format_timespan(a, sizeof(a), SLEEP_USEC, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
+        assert_se(now(CLOCK_MONOTONIC) - ts < N_CONNECTIONS * SLEEP_USEC);
+
+        /* Calls of the same connection are executed one after the other, and replied to in order */
+        replies[0] = (Replies) {};
+        assert_se(sd_bus_call_method_async(clients[0], NULL, NULL, "/", "org.freedesktop.systemd.Test", "Sleep",
+                                           sleep_reply, &replies[0], "tu", SLEEP_USEC / 4, (uint32_t) 0) >= 0);
+        assert_se(sd_bus_call_method_async(clients[0], NULL, NULL, "/", "org.freedesktop.systemd.Test", "Sleep",
+                                           sleep_reply, &replies[0], "tu", (uint64_t) 0, (uint32_t) 1) >= 0);
+        assert_se(sd_bus_call_method_async(clients[0], NULL, NULL, "/", "org.freedesktop.systemd.Test", "Sleep",
+                                           sleep_reply, &replies[0], "tu", SLEEP_USEC / 8, (uint32_t) 2) >= 0);
+        wait_for_replies(clients[0], &replies[0], 3);
+        for (i = 0; i < 3; i++)
+                assert_se(replies[0].order[i] == i);
+
+        /* Errors returned by the handler are turned into error replies */
+        r = sd_bus_call_method(clients[1], NULL, "/", "org.freedesktop.systemd.Test", "Fail", &error, NULL, NULL);
+        assert_se(r == -EIO);
+        assert_se(sd_bus_error_has_name(&error, SD_BUS_ERROR_IO_ERROR));
+        sd_bus_error_free(&error);
+
+        assert_se(sd_bus_call_method(clients[1], NULL, "/", "org.freedesktop.systemd.Test", "Nested", &error, &reply, NULL) >= 0);
+        assert_se(sd_bus_message_read(reply, "i", &r) >= 0);
+        assert_se(r > 0);
+
+        assert_se(sd_bus_call_method(clients[0], NULL, "/", "org.freedesktop.systemd.Test", "Quit", &error, NULL, NULL) >= 0);
+
+        assert_se(pthread_join(t, NULL) == 0);
+
+        for (i = 0; i < N_CONNECTIONS; i++)
+                sd_bus_flush_close_unref(clients[i]);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_concurrent();
+
+        return 0;
+}
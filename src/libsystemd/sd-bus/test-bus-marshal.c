@@ -105,6 +105,61 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+static void test_bus_message_inline_one(sd_bus *bus, size_t n_path, size_t n_body, unsigned depth) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *n = NULL;
+        _cleanup_free_ char *path = NULL, *body = NULL;
+        void *buffer = NULL;
+        const char *x;
+        unsigned i;
+        size_t sz;
+
+        log_info("/* %s(%zu, %zu, %u) */", __func__, n_path, n_body, depth);
+
+        assert_se(path = new(char, n_path + 2));
+        path[0] = '/';
+        memset(path + 1, 'p', n_path);
+        path[n_path + 1] = 0;
+
+        assert_se(body = new(char, n_body + 1));
+        memset(body, 'b', n_body);
+        body[n_body] = 0;
+
+        /* Small messages are constructed in the space allocated along with the message object, larger ones
+         * move to the heap, and either way they have to end up the same */
+        assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", path, "foobar.waldo", "Piep") >= 0);
+        for (i = 0; i < depth; i++)
+                assert_se(sd_bus_message_open_container(m, 'v', "v") >= 0);
+        assert_se(sd_bus_message_append(m, "v", "s", body) >= 0);
+        for (i = 0; i < depth; i++)
+                assert_se(sd_bus_message_close_container(m) >= 0);
+        assert_se(sd_bus_message_seal(m, 4711, 0) >= 0);
+
+        assert_se(m->free_header == (n_path > 128));
+        assert_se(m->body.free_this == (n_body > 128));
+
+        assert_se(bus_message_get_blob(m, &buffer, &sz) >= 0);
+        assert_se(bus_message_from_buffer(bus, buffer, sz, NULL, 0, NULL, &n) >= 0);
+        free(buffer);
+
+        assert_se(!n->free_header);
+        assert_se(streq(sd_bus_message_get_path(n), path));
+
+        for (i = 0; i < depth; i++)
+                assert_se(sd_bus_message_enter_container(n, 'v', "v") > 0);
+        assert_se(sd_bus_message_read(n, "v", "s", &x) > 0);
+        assert_se(streq(x, body));
+        for (i = 0; i < depth; i++)
+                assert_se(sd_bus_message_exit_container(n) > 0);
+}
+
+static void test_bus_message_inline(sd_bus *bus) {
+        test_bus_message_inline_one(bus, 8, 8, 0);
+        test_bus_message_inline_one(bus, 8, 8, 8);
+        test_bus_message_inline_one(bus, 300, 8, 2);
+        test_bus_message_inline_one(bus, 8, 300, 2);
+        test_bus_message_inline_one(bus, 300, 300, 8);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -413,6 +468,7 @@ int main(int argc, char *argv[]) {
         assert_se(streq(c, "ccc"));
         assert_se(streq(d, "3"));
 
+        test_bus_message_inline(bus);
         test_bus_label_escape();
         test_bus_path_encode();
         test_bus_path_encode_unique();
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "alloc-util.h"
 #include "bus-match.h"
 #include "bus-message.h"
 #include "bus-slot.h"
@@ -7,7 +8,9 @@
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "stdio-util.h"
 #include "tests.h"
+#include "time-util.h"
 
 static bool mask[32];
 
@@ -59,6 +62,80 @@ static int match_add(sd_bus_slot *slots, struct bus_match_node *root, const char
         return r;
 }
 
+static unsigned n_counted;
+
+static int count_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_counted++;
+        return 0;
+}
+
+static void test_match_benchmark(sd_bus *bus, unsigned n) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        char b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        usec_t ts, setup;
+        unsigned i, k;
+
+        /* Similar to what a client watching all units and jobs of the service manager registers: one match
+         * per object path, plus a couple of pattern matches that are hashed as well */
+
+        assert_se(slots = new0(sd_bus_slot, 3 * n));
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n; i++) {
+                struct bus_match_component *components = NULL;
+                unsigned n_components = 0, j;
+                char match[3][256];
+
+                xsprintf(match[0], "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',"
+                         "path='/org/freedesktop/systemd1/unit/unit_%u'", i);
+                xsprintf(match[1], "type='signal',path_namespace='/org/freedesktop/systemd1/job/%u'", i);
+                xsprintf(match[2], "type='signal',arg0namespace='org.example.unit_%u'", i);
+
+                for (j = 0; j < 3; j++) {
+                        sd_bus_slot *s = slots + 3 * i + j;
+
+                        s->match_callback.callback = count_filter;
+
+                        assert_se(bus_match_parse(match[j], &components, &n_components) >= 0);
+                        assert_se(bus_match_add(&root, components, n_components, &s->match_callback) >= 0);
+                        bus_match_parse_free(components, n_components);
+                }
+        }
+
+        setup = now(CLOCK_MONOTONIC) - ts;
+
+        n_counted = 0;
+        ts = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < 1000; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                char path[64], arg[64];
+
+                i = k % n;
+                xsprintf(path, "/org/freedesktop/systemd1/unit/unit_%u", i);
+                xsprintf(arg, "org.example.unit_%u.sub", i);
+
+                assert_se(sd_bus_message_new_signal(bus, &m, path, "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+                assert_se(sd_bus_message_append(m, "s", arg) >= 0);
+                assert_se(sd_bus_message_seal(m, k + 1, 0) >= 0);
+
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+        }
+
+        log_info("%u matches: added in %s, %s per message", 3 * n,
+                 format_timespan(b, sizeof b, setup, 0),
+                 format_timespan(c, sizeof c, (now(CLOCK_MONOTONIC) - ts) / k, 1));
+
+        /* The path match and the arg0namespace match must have fired for each message, nothing else */
+        assert_se(n_counted == 2 * k);
+
+        bus_match_free(&root);
+}
+
 static void test_match_scope(const char *match, enum bus_match_scope scope) {
         struct bus_match_component *components = NULL;
         unsigned n_components = 0;
@@ -76,7 +153,8 @@ int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum bus_match_node_type i;
-        sd_bus_slot slots[19];
+        sd_bus_slot slots[24];
+        unsigned n;
         int r;
 
         test_setup_logging(LOG_INFO);
@@ -105,6 +183,11 @@ int main(int argc, char *argv[]) {
         assert_se(match_add(slots, &root, "arg4has='pa'", 16) >= 0);
         assert_se(match_add(slots, &root, "arg4has='po'", 17) >= 0);
         assert_se(match_add(slots, &root, "arg4='pi'", 18) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/'", 19) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/fo'", 20) >= 0);
+        assert_se(match_add(slots, &root, "arg2path='/'", 21) >= 0);
+        assert_se(match_add(slots, &root, "arg2path='/prefix/three/more'", 22) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.fou'", 23) >= 0);
 
         bus_match_dump(&root, 0);
 
@@ -114,7 +197,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17 }, 11));
+        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17, 19, 21 }, 13));
 
         assert_se(bus_match_remove(&root, &slots[8].match_callback) >= 0);
         assert_se(bus_match_remove(&root, &slots[13].match_callback) >= 0);
@@ -123,7 +206,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19, 21 }, 11));
 
         for (i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
@@ -137,6 +220,9 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        for (n = 10; n <= (slow_tests_enabled() ? 100000U : 10000U); n *= 10)
+                test_match_benchmark(bus, n);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
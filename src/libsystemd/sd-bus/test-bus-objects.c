@@ -409,6 +409,30 @@ static int client(struct context *c) {
         assert_se(sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_INTERFACE));
         sd_bus_error_free(&error);
 
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/value/a", "org.freedesktop.DBus.Properties", "GetAll", &error, &reply, "s", "org.freedesktop.systemd.ValueTest");
+        assert_se(r >= 0);
+
+        {
+                _cleanup_strv_free_ char **names = NULL;
+                const char *name;
+
+                /* The explicit property must not be included */
+                assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+                while ((r = sd_bus_message_enter_container(reply, 'e', "sv")) > 0) {
+                        assert_se(sd_bus_message_read(reply, "s", &name) > 0);
+                        assert_se(strv_extend(&names, name) >= 0);
+                        assert_se(sd_bus_message_read(reply, "v", "s", &s) > 0);
+                        assert_se(startswith(s, "object "));
+                        assert_se(sd_bus_message_exit_container(reply) >= 0);
+                }
+                assert_se(r == 0);
+                assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+                assert_se(strv_equal(names, STRV_MAKE("Value", "Value2", "Value3", "Value4")));
+        }
+
+        reply = sd_bus_message_unref(reply);
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
         assert_se(r < 0);
         assert_se(sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD));
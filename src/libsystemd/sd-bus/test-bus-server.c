@@ -1,26 +1,55 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
 
 #include "sd-bus.h"
 
 #include "bus-internal.h"
+#include "bus-message.h"
 #include "bus-util.h"
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "socket-util.h"
+
+#define N_PINGS 200U
+#define LARGE_SIZE (2U * MEMFD_MIN_SIZE)
 
 struct context {
         int fds[2];
 
+        unsigned n_pings, n_ping_fds;
+
         bool client_negotiate_unix_fds;
         bool server_negotiate_unix_fds;
 
         bool client_anonymous_auth;
         bool server_anonymous_auth;
+
+        bool client_negotiate_memfd;
+        bool server_negotiate_memfd;
 };
 
+static bool context_expect_memfd(const struct context *c) {
+        return c->client_negotiate_unix_fds && c->server_negotiate_unix_fds &&
+                c->client_negotiate_memfd && c->server_negotiate_memfd;
+}
+
+static bool large_data_is_valid(const uint8_t *p, size_t n) {
+        size_t i;
+
+        if (n != LARGE_SIZE)
+                return false;
+
+        for (i = 0; i < n; i++)
+                if (p[i] != (uint8_t) (i % 251))
+                        return false;
+
+        return true;
+}
+
 static void *server(void *p) {
         struct context *c = p;
         sd_bus *bus = NULL;
@@ -35,6 +64,7 @@ static void *server(void *p) {
         assert_se(sd_bus_set_server(bus, 1, id) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->server_anonymous_auth) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->server_negotiate_unix_fds) >= 0);
+        assert_se(sd_bus_negotiate_memfd(bus, c->server_negotiate_memfd) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
         while (!quit) {
@@ -59,13 +89,53 @@ static void *server(void *p) {
                 if (!m)
                         continue;
 
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Ping")) {
+                        uint32_t i;
+
+                        /* The pings are pipelined, and hence read in chunks, make sure each got its own fd */
+                        if (sd_bus_message_has_signature(m, "uh")) {
+                                int fd;
+
+                                assert_se(sd_bus_message_read(m, "uh", &i, &fd) >= 0);
+                                assert_se(fcntl(fd, F_GETFD) >= 0);
+                                c->n_ping_fds++;
+                        } else
+                                assert_se(sd_bus_message_read(m, "u", &i) >= 0);
+
+                        assert_se(i == c->n_pings);
+                        c->n_pings++;
+                        continue;
+                }
+
                 log_info("Got message! member=%s", strna(sd_bus_message_get_member(m)));
 
-                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Large")) {
+                        const void *p;
+                        size_t n;
+
+                        /* Large bodies are passed in a memfd if both sides agreed to that */
+                        assert_se(bus->can_memfd == context_expect_memfd(c));
+                        assert_se((m->body.memfd >= 0) == context_expect_memfd(c));
+
+                        assert_se(sd_bus_message_read_array(m, 'y', &p, &n) >= 0);
+                        assert_se(large_data_is_valid(p, n));
+
+                        r = sd_bus_message_new_method_return(m, &reply);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to allocate return: %m");
+                                goto fail;
+                        }
+
+                        assert_se(sd_bus_message_append_array(reply, 'y', p, n) >= 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
 
                         assert_se((sd_bus_can_send(bus, 'h') >= 1) ==
                                   (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
 
+                        assert_se(c->n_pings == N_PINGS);
+                        assert_se(c->n_ping_fds == (sd_bus_can_send(bus, 'h') >= 1 ? N_PINGS / 3 + 1 : 0));
+
                         r = sd_bus_message_new_method_return(m, &reply);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to allocate return: %m");
@@ -109,14 +179,78 @@ static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        uint64_t n_calls, n_messages;
+        uint32_t i;
         int r;
 
         assert_se(sd_bus_new(&bus) >= 0);
         assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->client_negotiate_unix_fds) >= 0);
+        assert_se(sd_bus_negotiate_memfd(bus, c->client_negotiate_memfd) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
+        /* Shrink the socket buffer again that sd-bus enlarged, so that the pings below are likely to pile
+         * up in the write queue */
+        assert_se(setsockopt_int(c->fds[1], SOL_SOCKET, SO_SNDBUF, 4096) >= 0);
+
+        for (i = 0; i < N_PINGS; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *ping = NULL;
+
+                assert_se(sd_bus_message_new_method_call(bus, &ping, "org.freedesktop.systemd.test", "/",
+                                                         "org.freedesktop.systemd.test", "Ping") >= 0);
+                assert_se(sd_bus_message_set_expect_reply(ping, false) >= 0);
+
+                if (i % 3 == 0 && sd_bus_can_send(bus, 'h') > 0)
+                        assert_se(sd_bus_message_append(ping, "uh", i, STDERR_FILENO) >= 0);
+                else
+                        assert_se(sd_bus_message_append(ping, "u", i) >= 0);
+
+                /* Pipeline them, so that they are read in batches on the other side */
+                r = sd_bus_send(bus, ping, NULL);
+                if (r == -EPERM)
+                        return r; /* Authentication failed, as expected by some of the cases */
+                assert_se(r >= 0);
+        }
+
+        /* Queued messages are written in batches, but each of them is counted */
+        r = sd_bus_flush(bus);
+        if (r == -EPERM)
+                return r;
+        assert_se(r >= 0);
+        assert_se(sd_bus_get_write_stats(bus, &n_calls, &n_messages) >= 0);
+        log_info("Wrote %" PRIu64 " messages with %" PRIu64 " calls.", n_messages, n_calls);
+        assert_se(n_messages == N_PINGS);
+        assert_se(n_calls > 0);
+
+        /* Large messages go through a memfd if negotiated, in both directions, and through the stream
+         * otherwise */
+        {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *large = NULL, *large_reply = NULL;
+                _cleanup_free_ uint8_t *data = NULL;
+                const void *p;
+                size_t k, n;
+
+                assert_se(data = malloc(LARGE_SIZE));
+                for (k = 0; k < LARGE_SIZE; k++)
+                        data[k] = (uint8_t) (k % 251);
+
+                assert_se(sd_bus_message_new_method_call(bus, &large, "org.freedesktop.systemd.test", "/",
+                                                         "org.freedesktop.systemd.test", "Large") >= 0);
+                assert_se(sd_bus_message_append_array(large, 'y', data, LARGE_SIZE) >= 0);
+
+                r = sd_bus_call(bus, large, 0, &error, &large_reply);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to issue large method call: %s", bus_error_message(&error, r));
+
+                assert_se(bus->can_memfd == context_expect_memfd(c));
+                assert_se((large->body_memfd >= 0) == context_expect_memfd(c));
+                assert_se((large_reply->body.memfd >= 0) == context_expect_memfd(c));
+
+                assert_se(sd_bus_message_read_array(large_reply, 'y', &p, &n) >= 0);
+                assert_se(large_data_is_valid(p, n));
+        }
+
         r = sd_bus_message_new_method_call(
                         bus,
                         &m,
@@ -135,7 +269,8 @@ static int client(struct context *c) {
 }
 
 static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
-                    bool client_anonymous_auth, bool server_anonymous_auth) {
+                    bool client_anonymous_auth, bool server_anonymous_auth,
+                    bool client_negotiate_memfd, bool server_negotiate_memfd) {
 
         struct context c;
         pthread_t s;
@@ -150,6 +285,8 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         c.server_negotiate_unix_fds = server_negotiate_unix_fds;
         c.client_anonymous_auth = client_anonymous_auth;
         c.server_anonymous_auth = server_anonymous_auth;
+        c.client_negotiate_memfd = client_negotiate_memfd;
+        c.server_negotiate_memfd = server_negotiate_memfd;
 
         r = pthread_create(&s, NULL, server, &c);
         if (r != 0)
@@ -173,26 +310,41 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
 int main(int argc, char *argv[]) {
         int r;
 
-        r = test_one(true, true, false, false);
+        r = test_one(true, true, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, false, false, false);
+        r = test_one(true, false, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(false, true, false, false);
+        r = test_one(false, true, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(false, false, false, false);
+        r = test_one(false, false, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, true);
+        r = test_one(true, true, true, true, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, false, true);
+        r = test_one(true, true, false, true, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, false);
+        r = test_one(true, true, true, false, false, false);
         assert_se(r == -EPERM);
 
+        r = test_one(true, true, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, true, false);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, false, true);
+        assert_se(r >= 0);
+
+        r = test_one(false, true, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, true, true, true, true);
+        assert_se(r >= 0);
+
         return EXIT_SUCCESS;
 }
@@ -143,5 +143,35 @@ int main(int argc, char *argv[]) {
         }
         assert_se(r == 3);
 
+        {
+                const BusSignature *sig, *child;
+                size_t l;
+
+                sig = bus_signature_get("a{sv}ia(ss)xyz", 5);
+                assert_se(sig);
+                assert_se(streq(sig->signature, "a{sv}"));
+                assert_se(sig->valid && sig->valid_strict && sig->single && sig->single_strict && !sig->pair);
+                assert_se(bus_signature_get("a{sv}", 5) == sig);
+
+                assert_se(bus_signature_element_length(sig, 0, &l) >= 0 && l == 5);
+                assert_se(bus_signature_element_length(sig, 1, &l) >= 0 && l == 4);
+                assert_se(bus_signature_element_length(sig, 3, &l) >= 0 && l == 1);
+                assert_se(bus_signature_element_length(sig, 4, &l) == -EINVAL);
+                assert_se(bus_signature_element_length(sig, 5, &l) == -EINVAL);
+
+                child = bus_signature_child(sig, 0);
+                assert_se(child && streq(child->signature, "{sv}"));
+                assert_se(child->single && !child->single_strict);
+                assert_se(bus_signature_child(sig, 0) == child);
+
+                child = bus_signature_child(child, 0);
+                assert_se(child && streq(child->signature, "sv"));
+                assert_se(child->pair && !child->single);
+                assert_se(!bus_signature_child(child, 0));
+
+                assert_se(!bus_signature_get("a{sv", 4));
+                assert_se(!bus_signature_get("", 0));
+        }
+
         return 0;
 }
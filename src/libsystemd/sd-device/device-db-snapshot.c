@@ -0,0 +1,586 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-db-snapshot.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "macro.h"
+#include "sort-util.h"
+#include "sparse-endian.h"
+#include "string-util.h"
+#include "tmpfile-util.h"
+
+#define DB_SNAPSHOT_SIG { 'U', 'D', 'E', 'V', 'D', 'B', 'S', 'N' }
+
+struct db_snapshot_header_f {
+        uint8_t signature[8];
+
+        /* value of the generation counter the snapshot was built at */
+        le64_t generation;
+        le64_t file_size;
+
+        /* size of structures to allow them to grow */
+        le64_t header_size;
+        le64_t entry_size;
+
+        /* sorted by id */
+        le64_t entries_off;
+        le64_t entries_count;
+
+        le64_t strings_off;
+        le64_t strings_len;
+} _packed_;
+
+struct db_snapshot_entry_f {
+        /* relative to strings_off, the id is NUL terminated, the data is not */
+        le64_t id_off;
+        le64_t data_off;
+        le64_t data_size;
+} _packed_;
+
+typedef struct DbSnapshotEntry {
+        char *id;
+        char *data;
+        size_t size;
+} DbSnapshotEntry;
+
+typedef struct DbSnapshotEntries {
+        DbSnapshotEntry *entries;
+        size_t n_entries, n_allocated;
+} DbSnapshotEntries;
+
+typedef struct DbSnapshotCache {
+        char *dir;
+
+        const uint64_t *counter;
+        dev_t counter_dev;
+        ino_t counter_ino;
+
+        const uint8_t *map;
+        size_t map_size;
+
+        /* data.bin that was found to be out of date, no need to look at it again until it is replaced */
+        dev_t stale_dev;
+        ino_t stale_ino;
+        bool stale;
+} DbSnapshotCache;
+
+/* Like everything else in sd-device, this is not shared between threads */
+static thread_local DbSnapshotCache cache = {};
+
+static int counter_open(const char *dir, int flags, uint64_t **ret, struct stat *ret_st) {
+        _cleanup_close_ int fd = -1;
+        const char *path;
+        struct stat st;
+        void *p;
+
+        assert(dir);
+        assert(ret);
+
+        path = strjoina(dir, "/data.generation");
+
+        fd = open(path, flags|O_CLOEXEC|O_NOCTTY, 0644);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(uint64_t)) {
+                if (!FLAGS_SET(flags, O_CREAT))
+                        return -EBADMSG;
+
+                if (ftruncate(fd, sizeof(uint64_t)) < 0)
+                        return -errno;
+        }
+
+        p = mmap(NULL, sizeof(uint64_t), (flags & O_ACCMODE) == O_RDONLY ? PROT_READ : PROT_READ|PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        *ret = p;
+        if (ret_st)
+                *ret_st = st;
+        return 0;
+}
+
+static void cache_reset(void) {
+        if (cache.counter)
+                (void) munmap((void *) cache.counter, sizeof(uint64_t));
+        if (cache.map)
+                (void) munmap((void *) cache.map, cache.map_size);
+        free(cache.dir);
+
+        cache = (DbSnapshotCache) {};
+}
+
+static int cache_get_counter(const char *dir, uint64_t *ret) {
+        int r;
+
+        assert(dir);
+        assert(ret);
+
+        if (cache.dir && !streq(cache.dir, dir))
+                cache_reset();
+
+        if (!cache.counter) {
+                _cleanup_free_ char *d = NULL;
+                uint64_t *counter;
+                struct stat st;
+
+                d = strdup(dir);
+                if (!d)
+                        return -ENOMEM;
+
+                r = counter_open(dir, O_RDONLY, &counter, &st);
+                if (r < 0)
+                        return r;
+
+                cache.dir = TAKE_PTR(d);
+                cache.counter = counter;
+                cache.counter_dev = st.st_dev;
+                cache.counter_ino = st.st_ino;
+        }
+
+        *ret = __atomic_load_n(cache.counter, __ATOMIC_ACQUIRE);
+        return 0;
+}
+
+static bool cache_counter_replaced(void) {
+        const char *path;
+        struct stat st;
+
+        assert(cache.dir);
+
+        /* The counter is increased before it is removed, hence a mapping of a removed counter never
+         * matches data.bin anymore, and we end up here */
+        path = strjoina(cache.dir, "/data.generation");
+        return stat(path, &st) < 0 || st.st_dev != cache.counter_dev || st.st_ino != cache.counter_ino;
+}
+
+static const struct db_snapshot_header_f *snapshot_header(const uint8_t *map, size_t size) {
+        const struct db_snapshot_header_f *h = (const struct db_snapshot_header_f *) map;
+        uint64_t entries_off, entries_count, strings_off, strings_len;
+
+        if (size < sizeof(struct db_snapshot_header_f))
+                return NULL;
+
+        if (memcmp(h->signature, (const uint8_t[]) DB_SNAPSHOT_SIG, sizeof(h->signature)) != 0 ||
+            le64toh(h->file_size) != size ||
+            le64toh(h->header_size) != sizeof(struct db_snapshot_header_f) ||
+            le64toh(h->entry_size) != sizeof(struct db_snapshot_entry_f))
+                return NULL;
+
+        entries_off = le64toh(h->entries_off);
+        entries_count = le64toh(h->entries_count);
+        strings_off = le64toh(h->strings_off);
+        strings_len = le64toh(h->strings_len);
+
+        if (entries_off > size ||
+            entries_count > (size - entries_off) / sizeof(struct db_snapshot_entry_f) ||
+            strings_off > size ||
+            strings_len > size - strings_off)
+                return NULL;
+
+        return h;
+}
+
+static int cache_get_snapshot(uint64_t generation, const struct db_snapshot_header_f **ret) {
+        const struct db_snapshot_header_f *h;
+        _cleanup_close_ int fd = -1;
+        const char *path;
+        struct stat st;
+        void *p;
+
+        assert(cache.dir);
+        assert(ret);
+
+        if (cache.map) {
+                h = (const struct db_snapshot_header_f *) cache.map;
+                if (le64toh(h->generation) == generation) {
+                        *ret = h;
+                        return 0;
+                }
+
+                (void) munmap((void *) cache.map, cache.map_size);
+                cache.map = NULL;
+                cache.map_size = 0;
+        }
+
+        path = strjoina(cache.dir, "/data.bin");
+
+        if (stat(path, &st) < 0) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                st = (struct stat) {};
+        }
+
+        if (cache.stale && st.st_dev == cache.stale_dev && st.st_ino == cache.stale_ino)
+                return -ESTALE;
+
+        cache.stale = true;
+        cache.stale_dev = st.st_dev;
+        cache.stale_ino = st.st_ino;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return cache_counter_replaced() ? -EAGAIN : -ESTALE;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        cache.stale_dev = st.st_dev;
+        cache.stale_ino = st.st_ino;
+
+        if (st.st_size < (off_t) sizeof(struct db_snapshot_header_f))
+                return -ESTALE;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        h = snapshot_header(p, st.st_size);
+        if (!h || le64toh(h->generation) != generation) {
+                (void) munmap(p, st.st_size);
+                return cache_counter_replaced() ? -EAGAIN : -ESTALE;
+        }
+
+        cache.map = p;
+        cache.map_size = st.st_size;
+        cache.stale = false;
+
+        *ret = h;
+        return 0;
+}
+
+static int snapshot_get(const char *dir, uint64_t *ret_generation, const struct db_snapshot_header_f **ret) {
+        uint64_t generation;
+        int r;
+
+        for (unsigned attempt = 0;; attempt++) {
+                r = cache_get_counter(dir, &generation);
+                if (r < 0)
+                        return r;
+
+                r = cache_get_snapshot(generation, ret);
+                if (r >= 0) {
+                        *ret_generation = generation;
+                        return 0;
+                }
+                if (r != -EAGAIN || attempt > 0)
+                        return r == -EAGAIN ? -ESTALE : r;
+
+                /* udevd was restarted or the database was cleaned up, start over with the new counter */
+                cache_reset();
+        }
+}
+
+int device_db_snapshot_read(const char *dir, const char *id, char **ret, size_t *ret_size) {
+        const struct db_snapshot_header_f *h;
+        const struct db_snapshot_entry_f *entries;
+        uint64_t generation, strings_len;
+        const char *strings;
+        size_t lo, hi;
+        int r;
+
+        assert(dir);
+        assert(id);
+        assert(ret);
+
+        /* Returns 1 and the contents of the database file of the device with the given id, 0 if the
+         * device has no database file, or -ESTALE if the snapshot can't be used now. */
+
+        r = snapshot_get(dir, &generation, &h);
+        if (r < 0)
+                return r;
+
+        entries = (const struct db_snapshot_entry_f *) (cache.map + le64toh(h->entries_off));
+        strings = (const char *) cache.map + le64toh(h->strings_off);
+        strings_len = le64toh(h->strings_len);
+
+        lo = 0;
+        hi = le64toh(h->entries_count);
+        while (lo < hi) {
+                size_t i = lo + (hi - lo) / 2;
+                uint64_t id_off = le64toh(entries[i].id_off);
+                int c;
+
+                if (id_off >= strings_len || !memchr(strings + id_off, 0, strings_len - id_off))
+                        return -EBADMSG;
+
+                c = strcmp(id, strings + id_off);
+                if (c < 0)
+                        hi = i;
+                else if (c > 0)
+                        lo = i + 1;
+                else {
+                        uint64_t data_off = le64toh(entries[i].data_off), data_size = le64toh(entries[i].data_size);
+                        char *data;
+
+                        if (data_off > strings_len || data_size > strings_len - data_off)
+                                return -EBADMSG;
+
+                        data = memdup_suffix0(strings + data_off, data_size);
+                        if (!data)
+                                return -ENOMEM;
+
+                        /* The database might have been changed while we were copying */
+                        if (__atomic_load_n(cache.counter, __ATOMIC_ACQUIRE) != generation) {
+                                free(data);
+                                return -ESTALE;
+                        }
+
+                        *ret = data;
+                        if (ret_size)
+                                *ret_size = data_size;
+                        return 1;
+                }
+        }
+
+        if (__atomic_load_n(cache.counter, __ATOMIC_ACQUIRE) != generation)
+                return -ESTALE;
+
+        return 0;
+}
+
+int device_db_snapshot_bump(const char *dir) {
+        uint64_t *counter;
+        int r;
+
+        assert(dir);
+
+        r = counter_open(dir, O_RDWR, &counter, NULL);
+        if (r == -ENOENT)
+                return 0; /* no snapshot is maintained */
+        if (r < 0)
+                return r;
+
+        (void) __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+        (void) munmap(counter, sizeof(uint64_t));
+
+        return 1;
+}
+
+int device_db_snapshot_setup(const char *dir, bool enable) {
+        uint64_t *counter;
+        int r;
+
+        assert(dir);
+
+        if (!enable) {
+                const char *path;
+
+                r = counter_open(dir, O_RDWR, &counter, NULL);
+                if (r == -ENOENT)
+                        counter = NULL;
+                else if (r < 0)
+                        return r;
+
+                path = strjoina(dir, "/data.bin");
+                if (unlink(path) < 0 && errno != ENOENT)
+                        r = -errno;
+
+                path = strjoina(dir, "/data.generation");
+                if (unlink(path) < 0 && errno != ENOENT)
+                        r = -errno;
+
+                /* Only now, so that readers find both gone when they notice the change */
+                if (counter) {
+                        (void) __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+                        (void) munmap(counter, sizeof(uint64_t));
+                }
+
+                return r < 0 ? r : 0;
+        }
+
+        r = counter_open(dir, O_RDWR|O_CREAT, &counter, NULL);
+        if (r < 0)
+                return r;
+
+        /* Whatever data.bin is left over was not built by us, make sure it is not used anymore */
+        (void) __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+        (void) munmap(counter, sizeof(uint64_t));
+
+        return 0;
+}
+
+static int db_snapshot_entry_compare(const DbSnapshotEntry *a, const DbSnapshotEntry *b) {
+        return strcmp(a->id, b->id);
+}
+
+static void db_snapshot_entries_done(DbSnapshotEntries *e) {
+        assert(e);
+
+        for (size_t i = 0; i < e->n_entries; i++) {
+                free(e->entries[i].id);
+                free(e->entries[i].data);
+        }
+
+        e->entries = mfree(e->entries);
+        e->n_entries = e->n_allocated = 0;
+}
+
+static int db_snapshot_read_dir(DIR *d, DbSnapshotEntries *e) {
+        struct dirent *de;
+        int r;
+
+        assert(d);
+        assert(e);
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+                _cleanup_free_ char *id = NULL, *data = NULL;
+                size_t size;
+
+                /* skip temporary files */
+                if (de->d_name[0] == '.')
+                        continue;
+
+                if (!IN_SET(de->d_type, DT_REG, DT_UNKNOWN))
+                        continue;
+
+                r = read_full_file_full(dirfd(d), de->d_name, 0, &data, &size);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0)
+                        return r;
+
+                id = strdup(de->d_name);
+                if (!id)
+                        return -ENOMEM;
+
+                if (!GREEDY_REALLOC(e->entries, e->n_allocated, e->n_entries + 1))
+                        return -ENOMEM;
+
+                e->entries[e->n_entries++] = (DbSnapshotEntry) {
+                        .id = TAKE_PTR(id),
+                        .data = TAKE_PTR(data),
+                        .size = size,
+                };
+        }
+
+        return 0;
+}
+
+static int db_snapshot_write(const char *dir, uint64_t generation, const DbSnapshotEntry *entries, size_t n) {
+        _cleanup_free_ struct db_snapshot_entry_f *entries_f = NULL;
+        _cleanup_(unlink_and_freep) char *path_tmp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct db_snapshot_header_f h;
+        uint64_t off = 0;
+        const char *path;
+        int r;
+
+        entries_f = new(struct db_snapshot_entry_f, MAX(n, 1u));
+        if (!entries_f)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n; i++) {
+                size_t l = strlen(entries[i].id) + 1;
+
+                entries_f[i] = (struct db_snapshot_entry_f) {
+                        .id_off = htole64(off),
+                        .data_off = htole64(off + l),
+                        .data_size = htole64(entries[i].size),
+                };
+
+                off += l + entries[i].size;
+        }
+
+        h = (struct db_snapshot_header_f) {
+                .signature = DB_SNAPSHOT_SIG,
+                .generation = htole64(generation),
+                .header_size = htole64(sizeof(struct db_snapshot_header_f)),
+                .entry_size = htole64(sizeof(struct db_snapshot_entry_f)),
+                .entries_off = htole64(sizeof(struct db_snapshot_header_f)),
+                .entries_count = htole64(n),
+                .strings_off = htole64(sizeof(struct db_snapshot_header_f) + n * sizeof(struct db_snapshot_entry_f)),
+                .strings_len = htole64(off),
+        };
+        h.file_size = htole64(le64toh(h.strings_off) + off);
+
+        path = strjoina(dir, "/data.bin");
+
+        r = fopen_temporary(path, &f, &path_tmp);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(entries_f, sizeof(struct db_snapshot_entry_f), n, f);
+        for (size_t i = 0; i < n; i++) {
+                fwrite(entries[i].id, 1, strlen(entries[i].id) + 1, f);
+                fwrite(entries[i].data, 1, entries[i].size, f);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (rename(path_tmp, path) < 0)
+                return -errno;
+
+        path_tmp = mfree(path_tmp);
+        return 0;
+}
+
+int device_db_snapshot_update(const char *dir, uint64_t *generation) {
+        _cleanup_(db_snapshot_entries_done) DbSnapshotEntries e = {};
+        _cleanup_closedir_ DIR *d = NULL;
+        uint64_t current;
+        const char *path;
+        int r;
+
+        assert(dir);
+        assert(generation);
+
+        /* Writes a new snapshot if the database was changed since the one at *generation was written.
+         * Returns 1 if a snapshot was written, 0 if there was no need, -EAGAIN if the database was
+         * changed while the snapshot was built. */
+
+        r = cache_get_counter(dir, &current);
+        if (r < 0)
+                return r;
+
+        if (current == *generation)
+                return 0;
+
+        if (cache_counter_replaced()) {
+                cache_reset();
+                return -ESTALE;
+        }
+
+        path = strjoina(dir, "/data");
+
+        d = opendir(path);
+        if (d) {
+                r = db_snapshot_read_dir(d, &e);
+                if (r < 0)
+                        return r;
+        } else if (errno != ENOENT)
+                return -errno;
+
+        if (__atomic_load_n(cache.counter, __ATOMIC_ACQUIRE) != current)
+                return -EAGAIN;
+
+        typesafe_qsort(e.entries, e.n_entries, db_snapshot_entry_compare);
+
+        r = db_snapshot_write(dir, current, e.entries, e.n_entries);
+        if (r < 0)
+                return r;
+
+        log_debug("sd-device: Wrote database snapshot with %zu devices at generation %" PRIu64 ".", e.n_entries, current);
+
+        *generation = current;
+        return 1;
+}
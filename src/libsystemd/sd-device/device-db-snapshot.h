@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* A snapshot of all files in <dir>/data/ in <dir>/data.bin, which is only valid as long as the counter in
+ * <dir>/data.generation still has the value the snapshot was built at. Everyone writing to the database
+ * increases the counter first, hence the snapshot is never used once it does not reflect the text files
+ * anymore. */
+
+int device_db_snapshot_setup(const char *dir, bool enable);
+int device_db_snapshot_bump(const char *dir);
+int device_db_snapshot_update(const char *dir, uint64_t *generation);
+int device_db_snapshot_read(const char *dir, const char *id, char **ret, size_t *ret_size);
@@ -7,9 +7,11 @@
 
 #include "alloc-util.h"
 #include "device-enumerator-private.h"
+#include "device-internal.h"
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fs-util.h"
 #include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
@@ -401,6 +403,87 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
+static char *sysfs_resolve_link(const char *dir, const char *target) {
+        _cleanup_free_ char *path = NULL;
+        const char *p;
+        char *e;
+
+        assert(dir);
+        assert(target);
+
+        /* Resolves the relative symlink target lexically, the result is never longer than both joined */
+
+        if (path_is_absolute(target))
+                return NULL;
+
+        path = new(char, strlen(dir) + 1 + strlen(target) + 1);
+        if (!path)
+                return NULL;
+
+        e = stpcpy(path, dir);
+        while (e > path && e[-1] == '/')
+                e--;
+
+        for (p = target; *p; p += strspn(p, "/")) {
+                size_t l = strcspn(p, "/");
+
+                if (l == 2 && strneq(p, "..", 2)) {
+                        while (e > path && e[-1] != '/')
+                                e--;
+                        if (e <= path + 1)
+                                return NULL;
+                        e--;
+                } else if (l > 0 && !(l == 1 && p[0] == '.')) {
+                        *(e++) = '/';
+                        e = mempcpy(e, p, l);
+                }
+
+                p += l;
+        }
+
+        *e = '\0';
+        return TAKE_PTR(path);
+}
+
+static int enumerator_new_device(sd_device **ret, DIR *dir, const char *path, const struct dirent *dent) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        _cleanup_free_ char *target = NULL, *syspath = NULL;
+        const char *uevent;
+        int r;
+
+        assert(ret);
+        assert(dir);
+        assert(path);
+        assert(dent);
+
+        /* The entries of /sys/bus/SUBSYSTEM/devices/ and /sys/class/SUBSYSTEM/ are relative symlinks
+         * the kernel builds from the canonical location of the link to the canonical location of the
+         * device, hence resolving the ".." lexically yields the syspath. This avoids chase_symlinks()
+         * walking the path component by component, which dominates enumerating large machines. */
+        if (dent->d_type == DT_LNK &&
+            readlinkat_malloc(dirfd(dir), dent->d_name, &target) >= 0)
+                syspath = sysfs_resolve_link(path, target);
+
+        if (!syspath || !path_startswith(syspath, "/sys/devices/"))
+                return sd_device_new_from_syspath(ret, strjoina(path, dent->d_name));
+
+        /* all 'devices' require an 'uevent' file */
+        uevent = strjoina(syspath, "/uevent");
+        if (access(uevent, F_OK) < 0)
+                return errno == ENOENT ? -ENODEV : -errno;
+
+        r = device_new_aux(&device);
+        if (r < 0)
+                return r;
+
+        r = device_set_syspath(device, syspath, false);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(device);
+        return 0;
+}
+
 static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
@@ -424,8 +507,7 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
 
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
                 _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
-                int initialized, k;
+                int k;
 
                 if (dent->d_name[0] == '.')
                         continue;
@@ -433,9 +515,7 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                 if (!match_sysname(enumerator, dent->d_name))
                         continue;
 
-                (void) sprintf(syspath, "%s%s", path, dent->d_name);
-
-                k = sd_device_new_from_syspath(&device, syspath);
+                k = enumerator_new_device(&device, dir, path, dent);
                 if (k < 0) {
                         if (k != -ENODEV)
                                 /* this is necessarily racey, so ignore missing devices */
@@ -444,33 +524,37 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                         continue;
                 }
 
-                initialized = sd_device_get_is_initialized(device);
-                if (initialized < 0) {
-                        if (initialized != -ENOENT)
-                                /* this is necessarily racey, so ignore missing devices */
-                                r = initialized;
-
+                /* Cheap checks first, the ones below read the uevent file or the udev database */
+                if (!match_parent(enumerator, device))
                         continue;
-                }
 
-                /*
-                 * All devices with a device node or network interfaces
-                 * possibly need udev to adjust the device node permission
-                 * or context, or rename the interface before it can be
-                 * reliably used from other processes.
-                 *
-                 * For now, we can only check these types of devices, we
-                 * might not store a database, and have no way to find out
-                 * for all other types of devices.
-                 */
-                if (!enumerator->match_allow_uninitialized &&
-                    !initialized &&
-                    (sd_device_get_devnum(device, NULL) >= 0 ||
-                     sd_device_get_ifindex(device, NULL) >= 0))
-                        continue;
+                if (!enumerator->match_allow_uninitialized) {
+                        int initialized;
 
-                if (!match_parent(enumerator, device))
-                        continue;
+                        initialized = sd_device_get_is_initialized(device);
+                        if (initialized < 0) {
+                                if (initialized != -ENOENT)
+                                        /* this is necessarily racey, so ignore missing devices */
+                                        r = initialized;
+
+                                continue;
+                        }
+
+                        /*
+                         * All devices with a device node or network interfaces
+                         * possibly need udev to adjust the device node permission
+                         * or context, or rename the interface before it can be
+                         * reliably used from other processes.
+                         *
+                         * For now, we can only check these types of devices, we
+                         * might not store a database, and have no way to find out
+                         * for all other types of devices.
+                         */
+                        if (!initialized &&
+                            (sd_device_get_devnum(device, NULL) >= 0 ||
+                             sd_device_get_ifindex(device, NULL) >= 0))
+                                continue;
+                }
 
                 if (!match_tag(enumerator, device))
                         continue;
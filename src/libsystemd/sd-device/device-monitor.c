@@ -649,6 +649,9 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
                         uint32_t tag_bloom_hi = tag_bloom_bits >> 32;
                         uint32_t tag_bloom_lo = tag_bloom_bits & 0xffffffff;
 
+                        if (i + 7 >= ELEMENTSOF(ins))
+                                return -E2BIG;
+
                         /* load device bloom bits in A */
                         bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_tag_bloom_hi));
                         /* clear bits (tag bits & bloom bits) */
@@ -671,29 +674,62 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
 
         /* add all subsystem matches */
         if (!hashmap_isempty(m->subsystem_filter)) {
+                unsigned n_plain = 0, k = 0;
+
+                HASHMAP_FOREACH_KEY(devtype, subsystem, m->subsystem_filter)
+                        if (!devtype)
+                                n_plain++;
+
+                /* Matches on the subsystem alone only need to compare the hash, hence load it once and
+                 * then go through a plain chain of comparisons. A conditional jump can skip at most 255
+                 * instructions, so the chain is split into blocks, each followed by a "pass" verdict. */
+                if (n_plain > 0)
+                        /* load device subsystem value in A */
+                        bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_subsystem_hash));
+
+                HASHMAP_FOREACH_KEY(devtype, subsystem, m->subsystem_filter) {
+                        if (devtype)
+                                continue;
+
+                        if (i + 4 >= ELEMENTSOF(ins))
+                                return -E2BIG;
+
+                        if (k == 0)
+                                k = MIN(n_plain, 255U);
+
+                        /* jump to the end of the block if subsystem matches */
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, string_hash32(subsystem), k, 0);
+                        n_plain--;
+
+                        if (--k == 0) {
+                                /* nothing matched in this block, skip the verdict */
+                                bpf_stmt(ins, &i, BPF_JMP|BPF_JA, 1);
+                                /* matched, pass packet */
+                                bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
+                        }
+                }
+
                 HASHMAP_FOREACH_KEY(devtype, subsystem, m->subsystem_filter) {
                         uint32_t hash = string_hash32(subsystem);
 
+                        if (!devtype)
+                                continue;
+
+                        if (i + 6 >= ELEMENTSOF(ins))
+                                return -E2BIG;
+
                         /* load device subsystem value in A */
                         bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_subsystem_hash));
-                        if (!devtype) {
-                                /* jump if subsystem does not match */
-                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 1);
-                        } else {
-                                /* jump if subsystem does not match */
-                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 3);
-                                /* load device devtype value in A */
-                                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_devtype_hash));
-                                /* jump if value does not match */
-                                hash = string_hash32(devtype);
-                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 1);
-                        }
+                        /* jump if subsystem does not match */
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 3);
+                        /* load device devtype value in A */
+                        bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_devtype_hash));
+                        /* jump if value does not match */
+                        hash = string_hash32(devtype);
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 1);
 
                         /* matched, pass packet */
                         bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
-
-                        if (i+1 >= ELEMENTSOF(ins))
-                                return -E2BIG;
                 }
 
                 /* nothing matched, drop packet */
@@ -7,6 +7,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db-snapshot.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -881,6 +882,11 @@ int device_update_db(sd_device *device) {
 
         path = strjoina("/run/udev/data/", id);
 
+        /* invalidate the snapshot before the database is changed */
+        r = device_db_snapshot_bump("/run/udev");
+        if (r < 0)
+                return r;
+
         /* do not store anything for otherwise empty devices */
         if (!has_info && major(device->devnum) == 0 && device->ifindex == 0) {
                 r = unlink(path);
@@ -981,6 +987,10 @@ int device_delete_db(sd_device *device) {
 
         path = strjoina("/run/udev/data/", id);
 
+        r = device_db_snapshot_bump("/run/udev");
+        if (r < 0)
+                return r;
+
         r = unlink(path);
         if (r < 0 && errno != ENOENT)
                 return -errno;
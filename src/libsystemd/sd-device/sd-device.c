@@ -8,6 +8,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db-snapshot.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -1275,10 +1276,9 @@ int device_get_id_filename(sd_device *device, const char **ret) {
         return 0;
 }
 
-int device_read_db_internal_filename(sd_device *device, const char *filename) {
-        _cleanup_free_ char *db = NULL;
+static int device_parse_db(sd_device *device, char *db, size_t db_len) {
         const char *value;
-        size_t db_len, i;
+        size_t i;
         char key;
         int r;
 
@@ -1291,15 +1291,7 @@ int device_read_db_internal_filename(sd_device *device, const char *filename) {
         } state = PRE_KEY;
 
         assert(device);
-        assert(filename);
-
-        r = read_full_file(filename, &db, &db_len);
-        if (r < 0) {
-                if (r == -ENOENT)
-                        return 0;
-
-                return log_device_debug_errno(device, r, "sd-device: Failed to read db '%s': %m", filename);
-        }
+        assert(db);
 
         /* devices with a database entry are initialized */
         device->is_initialized = true;
@@ -1358,8 +1350,29 @@ int device_read_db_internal_filename(sd_device *device, const char *filename) {
         return 0;
 }
 
+int device_read_db_internal_filename(sd_device *device, const char *filename) {
+        _cleanup_free_ char *db = NULL;
+        size_t db_len;
+        int r;
+
+        assert(device);
+        assert(filename);
+
+        r = read_full_file(filename, &db, &db_len);
+        if (r < 0) {
+                if (r == -ENOENT)
+                        return 0;
+
+                return log_device_debug_errno(device, r, "sd-device: Failed to read db '%s': %m", filename);
+        }
+
+        return device_parse_db(device, db, db_len);
+}
+
 int device_read_db_internal(sd_device *device, bool force) {
+        _cleanup_free_ char *db = NULL;
         const char *id, *path;
+        size_t db_len;
         int r;
 
         assert(device);
@@ -1371,6 +1384,13 @@ int device_read_db_internal(sd_device *device, bool force) {
         if (r < 0)
                 return r;
 
+        /* If udevd maintains a snapshot of the database, look there first, see device-db-snapshot.h */
+        r = device_db_snapshot_read("/run/udev", id, &db, &db_len);
+        if (r > 0)
+                return device_parse_db(device, db, db_len);
+        if (r == 0)
+                return 0; /* no db entry */
+
         path = strjoina("/run/udev/data/", id);
 
         return device_read_db_internal_filename(device, path);
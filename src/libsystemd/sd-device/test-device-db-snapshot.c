@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-db-snapshot.h"
+#include "errno-util.h"
+#include "fileio.h"
+#include "mkdir.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void write_db(const char *dir, const char *id, const char *contents) {
+        const char *p;
+
+        p = strjoina(dir, "/data/", id);
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+}
+
+static void assert_db(const char *dir, const char *id, const char *expected) {
+        _cleanup_free_ char *data = NULL;
+        size_t size;
+        int r;
+
+        r = device_db_snapshot_read(dir, id, &data, &size);
+        log_debug("%s: %s (expected %s)", id, r > 0 ? data : r == 0 ? "(none)" : strerror_safe(r), strnull(expected));
+        if (expected) {
+                assert_se(r > 0);
+                assert_se(streq(data, expected));
+                assert_se(size == strlen(expected));
+        } else
+                assert_se(r == 0);
+}
+
+static void test_snapshot(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_free_ char *data = NULL;
+        uint64_t generation = UINT64_MAX, previous;
+        const char *p;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-device-db-snapshot.XXXXXX", &dir) >= 0);
+        p = strjoina(dir, "/data");
+        assert_se(mkdir_p(p, 0755) >= 0);
+
+        write_db(dir, "c1:2", "E:FOO=bar\n");
+        write_db(dir, "n3", "I:123\n");
+        write_db(dir, ".#c1:3tmp", "E:TEMPORARY=1\n");
+
+        /* Nothing to use without udevd maintaining a snapshot */
+        assert_se(device_db_snapshot_read(dir, "c1:2", &data, NULL) == -ENOENT);
+        assert_se(device_db_snapshot_bump(dir) == 0);
+
+        assert_se(device_db_snapshot_setup(dir, true) >= 0);
+        assert_se(device_db_snapshot_read(dir, "c1:2", &data, NULL) == -ESTALE);
+
+        assert_se(device_db_snapshot_update(dir, &generation) == 1);
+        assert_se(device_db_snapshot_update(dir, &generation) == 0);
+        assert_db(dir, "c1:2", "E:FOO=bar\n");
+        assert_db(dir, "n3", "I:123\n");
+        assert_db(dir, "c1:3", NULL);
+        assert_db(dir, ".#c1:3tmp", NULL);
+        assert_db(dir, "+pci:0000:00:00.0", NULL);
+
+        /* Any change makes the snapshot unusable until it is written again */
+        previous = generation;
+        assert_se(device_db_snapshot_bump(dir) == 1);
+        write_db(dir, "c1:2", "E:FOO=baz\n");
+        assert_se(device_db_snapshot_read(dir, "c1:2", &data, NULL) == -ESTALE);
+        assert_se(device_db_snapshot_read(dir, "c1:3", &data, NULL) == -ESTALE);
+
+        assert_se(device_db_snapshot_update(dir, &generation) == 1);
+        assert_se(generation != previous);
+        assert_db(dir, "c1:2", "E:FOO=baz\n");
+
+        /* Removing the snapshot, as "udevadm info --cleanup-db" does */
+        assert_se(device_db_snapshot_setup(dir, false) >= 0);
+        assert_se(access(strjoina(dir, "/data.bin"), F_OK) < 0 && errno == ENOENT);
+        assert_se(device_db_snapshot_read(dir, "c1:2", &data, NULL) == -ENOENT);
+        assert_se(device_db_snapshot_bump(dir) == 0);
+
+        /* The new counter of a restarted udevd is picked up */
+        assert_se(device_db_snapshot_setup(dir, true) >= 0);
+        generation = UINT64_MAX;
+        assert_se(device_db_snapshot_update(dir, &generation) == 1);
+        assert_db(dir, "c1:2", "E:FOO=baz\n");
+        assert_db(dir, "n3", "I:123\n");
+
+        /* Garbage is refused */
+        assert_se(device_db_snapshot_bump(dir) == 1);
+        p = strjoina(dir, "/data.bin");
+        assert_se(write_string_file(p, "UDEVDBSN", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+        assert_se(device_db_snapshot_read(dir, "c1:2", &data, NULL) == -ESTALE);
+        assert_se(!data);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_snapshot();
+
+        return 0;
+}
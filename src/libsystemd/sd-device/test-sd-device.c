@@ -9,6 +9,7 @@
 #include "time-util.h"
 
 static void test_sd_device_one(sd_device *d) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
         const char *syspath, *subsystem, *val;
         dev_t devnum;
         usec_t usec;
@@ -16,6 +17,11 @@ static void test_sd_device_one(sd_device *d) {
 
         assert_se(sd_device_get_syspath(d, &syspath) >= 0);
 
+        /* The enumerator resolves the sysfs symlinks itself, the result must be canonical */
+        assert_se(sd_device_new_from_syspath(&dev, syspath) >= 0);
+        assert_se(sd_device_get_syspath(dev, &val) >= 0);
+        assert_se(streq(syspath, val));
+
         r = sd_device_get_subsystem(d, &subsystem);
         assert_se(r >= 0 || r == -ENOENT);
 
@@ -7,10 +7,13 @@
 
 #include "sd-event.h"
 
+#include "event-work.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "list.h"
 #include "prioq.h"
+#include "ratelimit.h"
+#include "timer-wheel.h"
 
 typedef enum EventSourceType {
         SOURCE_IO,
@@ -26,6 +29,7 @@ typedef enum EventSourceType {
         SOURCE_EXIT,
         SOURCE_WATCHDOG,
         SOURCE_INOTIFY,
+        SOURCE_WORK,
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -1
 } EventSourceType;
@@ -38,11 +42,16 @@ typedef enum WakeupType {
         WAKEUP_CLOCK_DATA,
         WAKEUP_SIGNAL_DATA,
         WAKEUP_INOTIFY_DATA,
+        WAKEUP_URING,
+        WAKEUP_WORK_DATA,
+        WAKEUP_IO_LANE,
         _WAKEUP_TYPE_MAX,
         _WAKEUP_TYPE_INVALID = -1,
 } WakeupType;
 
 struct inode_data;
+struct io_poll;
+struct io_lane;
 
 struct sd_event_source {
         WakeupType wakeup;
@@ -60,13 +69,23 @@ struct sd_event_source {
         bool pending:1;
         bool dispatching:1;
         bool floating:1;
+        bool ratelimited:1;             /* offline because of the rate limit, see sd_event_source_set_ratelimit() */
+        signed int ratelimit_enabled:3; /* the enabled state to go back to once the rate limit expires */
 
         int64_t priority;
         unsigned pending_index;
         unsigned prepare_index;
         uint64_t pending_iteration;
+        usec_t pending_timestamp; /* only maintained while recording statistics */
         uint64_t prepare_iteration;
 
+        RateLimit rate_limit;
+        unsigned ratelimit_index;
+
+        uint64_t n_dispatched;
+        usec_t dispatch_usec;   /* total time spent in the callback */
+        usec_t profile_usec;    /* the same, since the last report with $SD_EVENT_PROFILE_DELAYS */
+
         sd_event_destroy_t destroy_callback;
 
         LIST_FIELDS(sd_event_source, sources);
@@ -79,12 +98,20 @@ struct sd_event_source {
                         uint32_t revents;
                         bool registered:1;
                         bool owned:1;
+                        bool checked:1; /* whether the fd was found pollable (io_uring only) */
+                        bool dirty:1;   /* whether the poll needs to be reconciled (io_uring only) */
+                        bool uring:1;   /* whether registered through io_uring rather than epoll */
+                        struct io_poll *poll; /* the poll we have outstanding in the ring (io_uring only) */
+                        struct io_lane *lane; /* the nested epoll we are registered in, NULL for the main one */
+                        LIST_FIELDS(sd_event_source, by_dirty);
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
                         unsigned earliest_index;
                         unsigned latest_index;
+                        bool wheel:1;   /* whether we are kept in the timer wheel rather than the prioqs */
+                        TimerWheelEntry wheel_entry;
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -102,6 +129,7 @@ struct sd_event_source {
                         bool process_owned:1; /* kill+reap process when event source is freed */
                         bool exited:1; /* true if process exited (i.e. if there's value in SIGKILLing it if we want to get rid of it) */
                         bool waited:1; /* true if process was waited for (i.e. if there's value in waitid(P_PID)'ing it if we want to get rid of it) */
+                        LIST_FIELDS(sd_event_source, waitid); /* in child_waitid_sources while enabled, unless watched via pidfd */
                 } child;
                 struct {
                         sd_event_handler_t callback;
@@ -119,9 +147,21 @@ struct sd_event_source {
                         struct inode_data *inode_data;
                         LIST_FIELDS(sd_event_source, by_inode_data);
                 } inotify;
+                struct {
+                        sd_event_work_complete_handler_t callback;
+                        WorkItem item;
+                } work;
         };
 };
 
+/* One IORING_OP_POLL_ADD in flight. This is allocated separately from the event source, since the kernel
+ * might still hand us a completion for it after the source is long gone. */
+struct io_poll {
+        sd_event_source *source; /* NULL if the source doesn't care anymore */
+        uint32_t events;
+        LIST_FIELDS(struct io_poll, polls);
+};
+
 struct clock_data {
         WakeupType wakeup;
         int fd;
@@ -137,6 +177,11 @@ struct clock_data {
         Prioq *latest;
         usec_t next;
 
+        /* Sources with coarse accuracy on clocks that never jump are kept in a timer wheel instead, with
+         * one tick every 250ms, so that they can be re-armed cheaply. Only enabled sources that are not
+         * pending are linked into it. */
+        TimerWheel *wheel;
+
         bool needs_rearm:1;
 };
 
@@ -197,9 +242,11 @@ struct inotify_data {
         Hashmap *inodes; /* The inode_data structures keyed by dev+ino */
         Hashmap *wd;     /* The inode_data structures keyed by the watch descriptor for each */
 
-        /* The buffer we read inotify events into */
-        union inotify_event_buffer buffer;
-        size_t buffer_filled; /* fill level of the buffer */
+        /* The buffer we read inotify events into. It is large enough for a batch of events, so that busy
+         * watches don't need a read() for each of them, and is consumed front to back. */
+        uint8_t buffer[INOTIFY_EVENT_MAX * 16] _alignas_(struct inotify_event);
+        size_t buffer_offset; /* where the first unprocessed event starts */
+        size_t buffer_filled; /* fill level of the buffer, counted from buffer_offset */
 
         /* How many event sources are currently marked pending for this inotify. We won't read new events off the
          * inotify fd as long as there are still pending events on the inotify (because we have no strategy of queuing
@@ -210,3 +257,23 @@ struct inotify_data {
          * to make it efficient to figure out what inotify objects to process data on next. */
         LIST_FIELDS(struct inotify_data, buffered);
 };
+
+/* With priority lanes enabled, I/O sources of idle priority are not registered in the event loop's epoll directly,
+ * but in a nested epoll per priority, which is only read if nothing more important is pending, see
+ * sd_event_set_priority_lanes(). */
+struct io_lane {
+        WakeupType wakeup;
+        int fd;
+        int64_t priority;
+
+        unsigned n_sources; /* the I/O sources registered in it */
+        bool ready;         /* whether the main epoll reported it readable in this iteration */
+
+        LIST_FIELDS(struct io_lane, lanes); /* ordered by priority */
+};
+
+/* The eventfd the worker threads signal whenever work items of this event loop are done */
+struct work_data {
+        WakeupType wakeup;
+        WorkSink sink;
+};
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "event-stats.h"
+#include "string-table.h"
+#include "util.h"
+
+static unsigned histogram_bucket(uint64_t v) {
+        unsigned l;
+
+        if (v < EVENT_HISTOGRAM_SUB_BUCKETS)
+                return (unsigned) v;
+
+        /* The highest bit selects the range, the ones right after it the sub-bucket within it */
+        l = u64log2(v);
+        return (l - EVENT_HISTOGRAM_SUB_BITS + 1) * EVENT_HISTOGRAM_SUB_BUCKETS +
+                (unsigned) ((v >> (l - EVENT_HISTOGRAM_SUB_BITS)) & (EVENT_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+void event_histogram_add(EventHistogram *h, uint64_t v) {
+        assert(h);
+
+        h->n++;
+        h->sum = h->sum + v < h->sum ? UINT64_MAX : h->sum + v;
+        h->max = MAX(h->max, v);
+        h->buckets[histogram_bucket(v)]++;
+}
+
+uint64_t event_histogram_bucket_below(unsigned i) {
+        unsigned range, sub;
+
+        assert(i < EVENT_HISTOGRAM_BUCKETS);
+
+        /* Returns the (exclusive) upper bound of the values counted in bucket i, UINT64_MAX for the last */
+
+        range = i / EVENT_HISTOGRAM_SUB_BUCKETS;
+        sub = i % EVENT_HISTOGRAM_SUB_BUCKETS;
+
+        if (range == 0)
+                return sub + 1;
+
+        if (i == EVENT_HISTOGRAM_BUCKETS - 1)
+                return UINT64_MAX;
+
+        return (uint64_t) (EVENT_HISTOGRAM_SUB_BUCKETS + sub + 1) << (range - 1);
+}
+
+uint64_t event_histogram_percentile(const EventHistogram *h, unsigned percent) {
+        uint64_t need, seen = 0;
+        unsigned i;
+
+        assert(h);
+        assert(percent <= 100);
+
+        /* Returns an upper bound for the specified percentile, precise to the bucket size */
+
+        if (h->n == 0)
+                return 0;
+
+        need = DIV_ROUND_UP(h->n * percent, 100);
+        for (i = 0; i < EVENT_HISTOGRAM_BUCKETS; i++) {
+                seen += h->buckets[i];
+                if (seen >= need && seen > 0)
+                        break;
+        }
+
+        if (i >= EVENT_HISTOGRAM_BUCKETS - 1)
+                return h->max;
+
+        return MIN(event_histogram_bucket_below(i) - 1, h->max);
+}
+
+EventPriorityClass event_priority_class_from_priority(int64_t priority) {
+        if (priority < SD_EVENT_PRIORITY_NORMAL)
+                return EVENT_PRIORITY_CLASS_IMPORTANT;
+        if (priority > SD_EVENT_PRIORITY_NORMAL)
+                return EVENT_PRIORITY_CLASS_IDLE;
+
+        return EVENT_PRIORITY_CLASS_NORMAL;
+}
+
+static const char* const event_priority_class_table[_EVENT_PRIORITY_CLASS_MAX] = {
+        [EVENT_PRIORITY_CLASS_IMPORTANT] = "important",
+        [EVENT_PRIORITY_CLASS_NORMAL] = "normal",
+        [EVENT_PRIORITY_CLASS_IDLE] = "idle",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(event_priority_class, EventPriorityClass);
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "sd-event.h"
+
+#include "macro.h"
+#include "time-util.h"
+
+/* Latency histograms with logarithmic buckets, each split into a few linear sub-buckets, so that the relative
+ * error stays bounded (25%) over the whole range of 64bit values, while the histogram stays small. Values
+ * below EVENT_HISTOGRAM_SUB_BUCKETS are counted exactly. */
+#define EVENT_HISTOGRAM_SUB_BITS 2U
+#define EVENT_HISTOGRAM_SUB_BUCKETS (1U << EVENT_HISTOGRAM_SUB_BITS)
+#define EVENT_HISTOGRAM_BUCKETS ((64U - EVENT_HISTOGRAM_SUB_BITS + 1U) * EVENT_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct EventHistogram {
+        uint64_t n, sum, max;
+        uint64_t buckets[EVENT_HISTOGRAM_BUCKETS];
+} EventHistogram;
+
+void event_histogram_add(EventHistogram *h, uint64_t v);
+uint64_t event_histogram_bucket_below(unsigned i);
+uint64_t event_histogram_percentile(const EventHistogram *h, unsigned percent);
+
+typedef enum EventPriorityClass {
+        EVENT_PRIORITY_CLASS_IMPORTANT, /* below SD_EVENT_PRIORITY_NORMAL */
+        EVENT_PRIORITY_CLASS_NORMAL,
+        EVENT_PRIORITY_CLASS_IDLE,      /* above SD_EVENT_PRIORITY_NORMAL */
+        _EVENT_PRIORITY_CLASS_MAX,
+        _EVENT_PRIORITY_CLASS_INVALID = -1,
+} EventPriorityClass;
+
+EventPriorityClass event_priority_class_from_priority(int64_t priority);
+const char* event_priority_class_to_string(EventPriorityClass c) _const_;
+EventPriorityClass event_priority_class_from_string(const char *s) _pure_;
+
+typedef struct EventStats {
+        usec_t since;      /* when recording started */
+        usec_t wait_usec;  /* time spent waiting in epoll_wait() */
+        uint64_t n_wakeups;
+
+        /* From the wake-up of the iteration until the handler is called */
+        EventHistogram wakeup_latency;
+
+        /* From the event source becoming pending until the handler is called, by priority */
+        EventHistogram dwell_time[_EVENT_PRIORITY_CLASS_MAX];
+} EventStats;
+
+/* Recording is enabled for event loops created with $SD_EVENT_STATS=1 set, or explicitly with
+ * event_set_stats(). event_get_stats() returns NULL if it is disabled. */
+int event_set_stats(sd_event *e, bool b);
+const EventStats* event_get_stats(sd_event *e);
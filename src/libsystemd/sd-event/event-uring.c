@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include "alloc-util.h"
+#include "event-uring.h"
+#include "fd-util.h"
+#include "memory-util.h"
+#include "missing_syscall.h"
+
+struct EventUring {
+        int fd;
+
+        void *sq_ring, *cq_ring;
+        size_t sq_ring_size, cq_ring_size;
+        void *sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        void *cqes;
+
+        unsigned sq_entries;
+        unsigned n_queued; /* entries in the submission ring the kernel hasn't seen yet */
+};
+
+EventUring* event_uring_free(EventUring *u) {
+        if (!u)
+                return NULL;
+
+        if (u->sqes)
+                (void) munmap(u->sqes, u->sqes_size);
+        if (u->cq_ring && u->cq_ring != u->sq_ring)
+                (void) munmap(u->cq_ring, u->cq_ring_size);
+        if (u->sq_ring)
+                (void) munmap(u->sq_ring, u->sq_ring_size);
+
+        safe_close(u->fd);
+
+        return mfree(u);
+}
+
+int event_uring_get_fd(EventUring *u) {
+        assert(u);
+
+        return u->fd;
+}
+
+#if HAVE_LINUX_IO_URING_H
+
+int event_uring_new(unsigned entries, EventUring **ret) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct io_uring_params p = {};
+
+        assert(ret);
+
+        u = new(EventUring, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (EventUring) {
+                .fd = -1,
+        };
+
+        u->fd = io_uring_setup(entries, &p);
+        if (u->fd < 0)
+                return -errno;
+
+        u->fd = fd_move_above_stdio(u->fd);
+
+        /* Without NODROP completions can get lost when the completion ring is full, and we'd lose track of
+         * the polls we have outstanding. That's Linux 5.5, older kernels get the epoll backend. */
+        if (!FLAGS_SET(p.features, IORING_FEAT_NODROP))
+                return -EOPNOTSUPP;
+
+        u->sq_entries = p.sq_entries;
+        u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+        if (FLAGS_SET(p.features, IORING_FEAT_SINGLE_MMAP))
+                u->sq_ring_size = u->cq_ring_size = MAX(u->sq_ring_size, u->cq_ring_size);
+
+        u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+        if (u->sq_ring == MAP_FAILED) {
+                u->sq_ring = NULL;
+                return -errno;
+        }
+
+        if (FLAGS_SET(p.features, IORING_FEAT_SINGLE_MMAP))
+                u->cq_ring = u->sq_ring;
+        else {
+                u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+                if (u->cq_ring == MAP_FAILED) {
+                        u->cq_ring = NULL;
+                        return -errno;
+                }
+        }
+
+        u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        u->sqes = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+        if (u->sqes == MAP_FAILED) {
+                u->sqes = NULL;
+                return -errno;
+        }
+
+        u->sq_head = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.head);
+        u->sq_tail = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.tail);
+        u->sq_mask = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.ring_mask);
+        u->sq_flags = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.flags);
+        u->sq_array = (unsigned*) ((uint8_t*) u->sq_ring + p.sq_off.array);
+
+        u->cq_head = (unsigned*) ((uint8_t*) u->cq_ring + p.cq_off.head);
+        u->cq_tail = (unsigned*) ((uint8_t*) u->cq_ring + p.cq_off.tail);
+        u->cq_mask = (unsigned*) ((uint8_t*) u->cq_ring + p.cq_off.ring_mask);
+        u->cqes = (uint8_t*) u->cq_ring + p.cq_off.cqes;
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
+int event_uring_submit(EventUring *u) {
+        int r;
+
+        assert(u);
+
+        while (u->n_queued > 0) {
+                r = io_uring_enter(u->fd, u->n_queued, 0, 0);
+                if (r < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        /* The kernel refuses new submissions while it has completions it couldn't post
+                         * yet. Leave them queued, they'll go out once the completion ring got drained. */
+                        if (IN_SET(errno, EAGAIN, EBUSY))
+                                return 0;
+
+                        return -errno;
+                }
+
+                assert((unsigned) r <= u->n_queued);
+                u->n_queued -= r;
+        }
+
+        return 0;
+}
+
+static int event_uring_get_sqe(EventUring *u, struct io_uring_sqe **ret) {
+        unsigned head, tail;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        tail = *u->sq_tail;
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+        if (tail - head >= u->sq_entries) {
+                /* Ring is full, hand what we have to the kernel first */
+                r = event_uring_submit(u);
+                if (r < 0)
+                        return r;
+
+                head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+                if (tail - head >= u->sq_entries)
+                        return -EBUSY;
+        }
+
+        *ret = (struct io_uring_sqe*) u->sqes + (tail & *u->sq_mask);
+        memzero(*ret, sizeof(struct io_uring_sqe));
+        return 0;
+}
+
+static void event_uring_queue_sqe(EventUring *u) {
+        unsigned tail;
+
+        assert(u);
+
+        tail = *u->sq_tail;
+        u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+        __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        u->n_queued++;
+}
+
+int event_uring_poll_add(EventUring *u, int fd, uint32_t events, uint64_t user_data) {
+        struct io_uring_sqe *sqe;
+        int r;
+
+        assert(u);
+        assert(fd >= 0);
+        assert(user_data != 0);
+
+        r = event_uring_get_sqe(u, &sqe);
+        if (r < 0)
+                return r;
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        /* All EPOLL* bits we accept fit into the 16bit field, which newer kernels still understand */
+        sqe->poll_events = events;
+        sqe->user_data = user_data;
+
+        event_uring_queue_sqe(u);
+        return 0;
+}
+
+int event_uring_poll_remove(EventUring *u, uint64_t user_data) {
+        struct io_uring_sqe *sqe;
+        int r;
+
+        assert(u);
+        assert(user_data != 0);
+
+        r = event_uring_get_sqe(u, &sqe);
+        if (r < 0)
+                return r;
+
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        sqe->user_data = 0; /* Its own completion is of no interest */
+
+        event_uring_queue_sqe(u);
+        return 0;
+}
+
+int event_uring_reap(EventUring *u, uint64_t *ret_user_data, int32_t *ret_res) {
+        struct io_uring_cqe *cqe;
+        unsigned head, tail;
+
+        assert(u);
+        assert(ret_user_data);
+        assert(ret_res);
+
+        head = *u->cq_head;
+        tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+                /* Completions that didn't fit into the ring are only moved over on request */
+                if (!FLAGS_SET(__atomic_load_n(u->sq_flags, __ATOMIC_ACQUIRE), IORING_SQ_CQ_OVERFLOW))
+                        return 0;
+
+                if (io_uring_enter(u->fd, 0, 0, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                        return -errno;
+
+                tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+                if (head == tail)
+                        return 0;
+        }
+
+        cqe = (struct io_uring_cqe*) u->cqes + (head & *u->cq_mask);
+        *ret_user_data = cqe->user_data;
+        *ret_res = cqe->res;
+
+        __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+        return 1;
+}
+
+#else
+
+int event_uring_new(unsigned entries, EventUring **ret) {
+        return -EOPNOTSUPP;
+}
+
+int event_uring_submit(EventUring *u) {
+        return -EOPNOTSUPP;
+}
+
+int event_uring_poll_add(EventUring *u, int fd, uint32_t events, uint64_t user_data) {
+        return -EOPNOTSUPP;
+}
+
+int event_uring_poll_remove(EventUring *u, uint64_t user_data) {
+        return -EOPNOTSUPP;
+}
+
+int event_uring_reap(EventUring *u, uint64_t *ret_user_data, int32_t *ret_res) {
+        return -EOPNOTSUPP;
+}
+
+#endif
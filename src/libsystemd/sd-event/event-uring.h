@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "macro.h"
+
+/* A minimal io_uring submission/completion ring, just enough for sd-event to watch I/O sources with
+ * IORING_OP_POLL_ADD. Submission entries are queued in the shared ring and handed to the kernel in one
+ * io_uring_enter() call, completions are read directly from the mapped completion ring. */
+
+typedef struct EventUring EventUring;
+
+int event_uring_new(unsigned entries, EventUring **ret);
+EventUring* event_uring_free(EventUring *u);
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventUring*, event_uring_free);
+
+int event_uring_get_fd(EventUring *u);
+
+int event_uring_poll_add(EventUring *u, int fd, uint32_t events, uint64_t user_data);
+int event_uring_poll_remove(EventUring *u, uint64_t user_data);
+
+int event_uring_submit(EventUring *u);
+int event_uring_reap(EventUring *u, uint64_t *ret_user_data, int32_t *ret_res);
@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "async.h"
+#include "event-work.h"
+#include "log.h"
+#include "parse-util.h"
+#include "time-util.h"
+
+#define WORK_THREADS_MIN 4U
+#define WORK_THREADS_MAX 16U
+
+/* How long an idle worker waits for new work before it exits */
+#define WORK_IDLE_USEC (30 * USEC_PER_SEC)
+
+/* All work is submitted from event loop threads, never from the workers themselves, hence there's no locality
+ * to preserve, and a single queue shared by all workers is all we need. Everything is protected by the one
+ * mutex, the work items are small and the critical sections short. */
+static struct {
+        pthread_mutex_t mutex;
+        pthread_cond_t queued;   /* signalled when an item is queued */
+        pthread_cond_t finished; /* broadcast when an item is done */
+
+        LIST_HEAD(WorkItem, queue);
+        WorkItem *queue_tail;
+        unsigned n_queued;
+
+        unsigned n_threads;
+        unsigned n_idle;
+        unsigned n_threads_max;
+
+        bool atfork_installed;
+} pool = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .queued = PTHREAD_COND_INITIALIZER,
+        .finished = PTHREAD_COND_INITIALIZER,
+};
+
+static void pool_reset_after_fork(void) {
+        /* The workers didn't make it into the child, and the work items belong to event loops the child
+         * can't use anymore, hence start from scratch. */
+        pool.mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+        pool.queued = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+        pool.finished = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+        pool.queue = pool.queue_tail = NULL;
+        pool.n_queued = pool.n_threads = pool.n_idle = 0;
+}
+
+static unsigned pool_threads_max(void) {
+        const char *e;
+        unsigned n;
+        long k;
+
+        e = getenv("SYSTEMD_WORK_THREADS");
+        if (e) {
+                if (safe_atou(e, &n) >= 0 && n > 0)
+                        return n;
+
+                log_debug("Failed to parse $SYSTEMD_WORK_THREADS, ignoring: %s", e);
+        }
+
+        /* Work items are expected to block, hence allow some more threads than there are CPUs */
+        k = sysconf(_SC_NPROCESSORS_ONLN);
+        n = k > 0 ? (unsigned) MIN(k, (long) WORK_THREADS_MAX) * 2 : WORK_THREADS_MIN;
+
+        return CLAMP(n, WORK_THREADS_MIN, WORK_THREADS_MAX);
+}
+
+static WorkItem* pool_dequeue(void) {
+        WorkItem *item = pool.queue;
+
+        if (!item)
+                return NULL;
+
+        if (pool.queue_tail == item)
+                pool.queue_tail = NULL;
+
+        LIST_REMOVE(items, pool.queue, item);
+        pool.n_queued--;
+
+        return item;
+}
+
+static void* pool_worker(void *p) {
+        (void) pthread_setname_np(pthread_self(), "sd-event-work");
+
+        assert_se(pthread_mutex_lock(&pool.mutex) == 0);
+
+        for (;;) {
+                WorkItem *item;
+                int r;
+
+                while (!pool.queue) {
+                        struct timespec ts;
+
+                        timespec_store(&ts, usec_add(now(CLOCK_REALTIME), WORK_IDLE_USEC));
+
+                        pool.n_idle++;
+                        r = pthread_cond_timedwait(&pool.queued, &pool.mutex, &ts);
+                        pool.n_idle--;
+
+                        if (r == ETIMEDOUT && !pool.queue) {
+                                pool.n_threads--;
+                                assert_se(pthread_mutex_unlock(&pool.mutex) == 0);
+                                return NULL;
+                        }
+                }
+
+                item = pool_dequeue();
+                item->state = WORK_RUNNING;
+
+                assert_se(pthread_mutex_unlock(&pool.mutex) == 0);
+                r = item->func(item->userdata);
+                assert_se(pthread_mutex_lock(&pool.mutex) == 0);
+
+                item->result = r;
+                item->state = WORK_DONE;
+                LIST_PREPEND(items, item->sink->done, item);
+
+                /* Notify while still holding the lock, work_pool_forget() relies on the sink not being
+                 * touched anymore once the item is done */
+                if (eventfd_write(item->sink->fd, 1) < 0)
+                        log_debug_errno(errno, "Failed to signal work completion, ignoring: %m");
+
+                assert_se(pthread_cond_broadcast(&pool.finished) == 0);
+        }
+}
+
+int work_pool_submit(WorkItem *item, void *userdata) {
+        int r = 0;
+
+        assert(item);
+        assert(item->func);
+        assert(item->sink);
+
+        assert_se(pthread_mutex_lock(&pool.mutex) == 0);
+
+        /* Already on its way? */
+        if (item->state != WORK_IDLE)
+                goto finish;
+
+        if (!pool.atfork_installed) {
+                r = -pthread_atfork(NULL, NULL, pool_reset_after_fork);
+                if (r < 0)
+                        goto finish;
+
+                pool.atfork_installed = true;
+        }
+
+        if (pool.n_threads_max == 0)
+                pool.n_threads_max = pool_threads_max();
+
+        /* Start another worker if nobody is around to pick this up, but don't fail if we already have
+         * some, the item will be processed eventually. */
+        if (pool.n_idle <= pool.n_queued && pool.n_threads < pool.n_threads_max) {
+                r = asynchronous_job(pool_worker, NULL);
+                if (r < 0) {
+                        if (pool.n_threads == 0)
+                                goto finish;
+
+                        log_debug_errno(r, "Failed to start additional work thread, ignoring: %m");
+                        r = 0;
+                } else
+                        pool.n_threads++;
+        }
+
+        if (pool.queue_tail)
+                LIST_INSERT_AFTER(items, pool.queue, pool.queue_tail, item);
+        else
+                LIST_PREPEND(items, pool.queue, item);
+        pool.queue_tail = item;
+        pool.n_queued++;
+
+        item->userdata = userdata;
+        item->state = WORK_QUEUED;
+        assert_se(pthread_cond_signal(&pool.queued) == 0);
+
+finish:
+        assert_se(pthread_mutex_unlock(&pool.mutex) == 0);
+        return r;
+}
+
+static void pool_unqueue(WorkItem *item) {
+        if (pool.queue_tail == item)
+                pool.queue_tail = item->items_prev;
+
+        LIST_REMOVE(items, pool.queue, item);
+        pool.n_queued--;
+}
+
+bool work_pool_cancel(WorkItem *item) {
+        bool idle;
+
+        assert(item);
+
+        /* Takes the item off the queue if it hasn't been picked up yet. Returns false if it is already
+         * running or done, in which case it has to be collected as usual. */
+
+        assert_se(pthread_mutex_lock(&pool.mutex) == 0);
+
+        if (item->state == WORK_QUEUED) {
+                pool_unqueue(item);
+                item->state = WORK_IDLE;
+        }
+
+        idle = item->state == WORK_IDLE;
+
+        assert_se(pthread_mutex_unlock(&pool.mutex) == 0);
+
+        return idle;
+}
+
+void work_pool_forget(WorkItem *item) {
+        assert(item);
+
+        /* Makes sure the pool doesn't reference the item anymore. If the item is being executed right now,
+         * this waits for it to finish, as there's no way to interrupt it. */
+
+        assert_se(pthread_mutex_lock(&pool.mutex) == 0);
+
+        while (item->state == WORK_RUNNING)
+                assert_se(pthread_cond_wait(&pool.finished, &pool.mutex) == 0);
+
+        if (item->state == WORK_QUEUED)
+                pool_unqueue(item);
+        else if (item->state == WORK_DONE)
+                LIST_REMOVE(items, item->sink->done, item);
+
+        item->state = WORK_IDLE;
+
+        assert_se(pthread_mutex_unlock(&pool.mutex) == 0);
+}
+
+WorkItem* work_pool_collect(WorkSink *sink) {
+        WorkItem *list, *item;
+        eventfd_t x;
+
+        assert(sink);
+
+        /* Returns the list of items that are done, which are idle again from now on */
+
+        if (eventfd_read(sink->fd, &x) < 0 && errno != EAGAIN)
+                log_debug_errno(errno, "Failed to read work completion counter, ignoring: %m");
+
+        assert_se(pthread_mutex_lock(&pool.mutex) == 0);
+
+        list = TAKE_PTR(sink->done);
+        LIST_FOREACH(items, item, list)
+                item->state = WORK_IDLE;
+
+        assert_se(pthread_mutex_unlock(&pool.mutex) == 0);
+
+        return list;
+}
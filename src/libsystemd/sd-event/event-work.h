@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "list.h"
+#include "macro.h"
+
+/* A process-wide pool of worker threads that sd-event work sources are executed on. The pool is bounded, and
+ * threads are started on demand and exit again after being idle for a while. Once a work item is done it is
+ * added to the list of finished items of its sink, and the sink's eventfd is signalled, so that the event
+ * loop can pick it up from its own thread. */
+
+typedef struct WorkItem WorkItem;
+typedef struct WorkSink WorkSink;
+
+typedef enum WorkItemState {
+        WORK_IDLE,
+        WORK_QUEUED,
+        WORK_RUNNING,
+        WORK_DONE,
+        _WORK_ITEM_STATE_MAX,
+        _WORK_ITEM_STATE_INVALID = -1,
+} WorkItemState;
+
+struct WorkItem {
+        int (*func)(void *userdata);
+        void *userdata;
+        int result;
+
+        WorkSink *sink;
+        WorkItemState state;
+        LIST_FIELDS(WorkItem, items);
+};
+
+struct WorkSink {
+        int fd;
+        LIST_HEAD(WorkItem, done);
+};
+
+int work_pool_submit(WorkItem *item, void *userdata);
+bool work_pool_cancel(WorkItem *item);
+void work_pool_forget(WorkItem *item);
+
+WorkItem* work_pool_collect(WorkSink *sink);
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
 
@@ -11,6 +13,8 @@
 #include "alloc-util.h"
 #include "env-util.h"
 #include "event-source.h"
+#include "event-stats.h"
+#include "event-uring.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "hashmap.h"
@@ -26,9 +30,14 @@
 #include "string-util.h"
 #include "strxcpyx.h"
 #include "time-util.h"
+#include "timer-wheel.h"
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+#define TIMER_WHEEL_TICK_USEC (250 * USEC_PER_MSEC)
+
+#define URING_ENTRIES 256U
+
 static bool EVENT_SOURCE_WATCH_PIDFD(sd_event_source *s) {
         /* Returns true if this is a PID event source and can be implemented by watching EPOLLIN */
         return s &&
@@ -51,18 +60,32 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_EXIT] = "exit",
         [SOURCE_WATCHDOG] = "watchdog",
         [SOURCE_INOTIFY] = "inotify",
+        [SOURCE_WORK] = "work",
 };
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(event_source_type, int);
 
 #define EVENT_SOURCE_IS_TIME(t) IN_SET((t), SOURCE_TIME_REALTIME, SOURCE_TIME_BOOTTIME, SOURCE_TIME_MONOTONIC, SOURCE_TIME_REALTIME_ALARM, SOURCE_TIME_BOOTTIME_ALARM)
 
+/* Time sources are excluded as they are rate limited by their very nature, and exit, post and child sources
+ * have their own notion of when they are dispatched that we don't want to interfere with. */
+#define EVENT_SOURCE_CAN_RATE_LIMIT(t) IN_SET((t), SOURCE_IO, SOURCE_SIGNAL, SOURCE_DEFER, SOURCE_INOTIFY)
+
+#define PROFILE_TOP_SOURCES 5U
+
 struct sd_event {
         unsigned n_ref;
 
         int epoll_fd;
         int watchdog_fd;
 
+        /* If set, I/O sources are watched with polls in this ring rather than through the epoll. The ring's
+         * fd is registered in the epoll instead, so that the latter remains the one fd to wait on. */
+        EventUring *uring;
+        WakeupType uring_wakeup;
+        LIST_HEAD(struct io_poll, io_polls);
+        LIST_HEAD(sd_event_source, io_dirty);
+
         Prioq *pending;
         Prioq *prepare;
 
@@ -83,12 +106,24 @@ struct sd_event {
         Hashmap *child_sources;
         unsigned n_enabled_child_sources;
 
+        /* The enabled child sources that can't be watched through their pidfd, and hence need to be checked
+         * with waitid() whenever SIGCHLD is seen */
+        LIST_HEAD(sd_event_source, child_waitid_sources);
+
         Set *post_sources;
+        bool post_sources_pending; /* whether all enabled post sources are marked pending already */
 
         Prioq *exit;
 
+        /* Sources taken offline by their rate limit, ordered by when it expires */
+        Prioq *ratelimited;
+
         Hashmap *inotify_data; /* indexed by priority */
 
+        struct work_data *work_data;
+
+        LIST_HEAD(struct io_lane, io_lanes); /* ordered by priority */
+
         /* A list of inode structures that still have an fd open, that we need to close before the next loop iteration */
         LIST_HEAD(struct inode_data, inode_data_to_close);
 
@@ -105,6 +140,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool priority_lanes:1;
 
         int exit_code;
 
@@ -118,16 +154,27 @@ struct sd_event {
         struct epoll_event *event_queue;
         size_t event_queue_allocated;
 
+        /* How many pending sources sd_event_dispatch() may dispatch in one go, and for how long */
+        unsigned dispatch_budget_max;
+        usec_t dispatch_budget_usec;
+
+        uint64_t n_events, n_dispatched, n_budget_exceeded;
+
         LIST_HEAD(sd_event_source, sources);
 
         usec_t last_run, last_log;
         unsigned delays[sizeof(usec_t) * 8];
+
+        EventStats *stats;
+        uint64_t last_log_iteration, last_log_events, last_log_dispatched, last_log_budget_exceeded;
 };
 
 static thread_local sd_event *default_event = NULL;
 
 static void source_disconnect(sd_event_source *s);
 static void event_gc_inode_data(sd_event *e, struct inode_data *d);
+static void event_free_io_lane(sd_event *e, struct io_lane *l);
+static usec_t sleep_between(sd_event *e, usec_t a, usec_t b);
 
 static sd_event *event_resolve(sd_event *e) {
         return e == SD_EVENT_DEFAULT ? default_event : e;
@@ -243,6 +290,16 @@ static int exit_prioq_compare(const void *a, const void *b) {
         return CMP(x->priority, y->priority);
 }
 
+static int ratelimit_prioq_compare(const void *a, const void *b) {
+        const sd_event_source *x = a, *y = b;
+
+        assert(x->ratelimited);
+        assert(y->ratelimited);
+
+        /* Earlier expiry first */
+        return CMP(ratelimit_end(&x->rate_limit), ratelimit_end(&y->rate_limit));
+}
+
 static void free_clock_data(struct clock_data *d) {
         assert(d);
         assert(d->wakeup == WAKEUP_CLOCK_DATA);
@@ -250,9 +307,11 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+        timer_wheel_free(d->wheel);
 }
 
 static sd_event *event_free(sd_event *e) {
+        struct io_poll *p;
         sd_event_source *s;
 
         assert(e);
@@ -271,6 +330,13 @@ static sd_event *event_free(sd_event *e) {
         safe_close(e->epoll_fd);
         safe_close(e->watchdog_fd);
 
+        /* Closing the ring cancels whatever polls are left, so we can forget about them */
+        event_uring_free(e->uring);
+        while ((p = e->io_polls)) {
+                LIST_REMOVE(polls, e->io_polls, p);
+                free(p);
+        }
+
         free_clock_data(&e->realtime);
         free_clock_data(&e->boottime);
         free_clock_data(&e->monotonic);
@@ -280,20 +346,55 @@ static sd_event *event_free(sd_event *e) {
         prioq_free(e->pending);
         prioq_free(e->prepare);
         prioq_free(e->exit);
+        prioq_free(e->ratelimited);
 
         free(e->signal_sources);
         hashmap_free(e->signal_data);
 
         hashmap_free(e->inotify_data);
 
+        if (e->work_data) {
+                safe_close(e->work_data->sink.fd);
+                free(e->work_data);
+        }
+
+        while (e->io_lanes)
+                event_free_io_lane(e, e->io_lanes);
+
         hashmap_free(e->child_sources);
         set_free(e->post_sources);
 
         free(e->event_queue);
+        free(e->stats);
 
         return mfree(e);
 }
 
+static int event_setup_uring(sd_event *e) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct epoll_event ev;
+        int r;
+
+        assert(e);
+
+        r = event_uring_new(URING_ENTRIES, &u);
+        if (r < 0)
+                return r;
+
+        e->uring_wakeup = WAKEUP_URING;
+
+        ev = (struct epoll_event) {
+                .events = EPOLLIN,
+                .data.ptr = &e->uring_wakeup,
+        };
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, event_uring_get_fd(u), &ev) < 0)
+                return -errno;
+
+        e->uring = TAKE_PTR(u);
+        return 0;
+}
+
 _public_ int sd_event_new(sd_event** ret) {
         sd_event *e;
         int r;
@@ -325,6 +426,8 @@ _public_ int sd_event_new(sd_event** ret) {
                 .boottime_alarm.next = USEC_INFINITY,
                 .perturb = USEC_INFINITY,
                 .original_pid = getpid_cached(),
+                .dispatch_budget_max = 1,
+                .dispatch_budget_usec = USEC_INFINITY,
         };
 
         r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
@@ -339,11 +442,25 @@ _public_ int sd_event_new(sd_event** ret) {
 
         e->epoll_fd = fd_move_above_stdio(e->epoll_fd);
 
+        if (getenv_bool_secure("SYSTEMD_IO_URING") > 0) {
+                r = event_setup_uring(e);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to set up io_uring for event loop, using epoll only: %m");
+                else
+                        log_debug("Event loop watches I/O sources through io_uring.");
+        }
+
         if (secure_getenv("SD_EVENT_PROFILE_DELAYS")) {
                 log_debug("Event loop profiling enabled. Logarithmic histogram of event loop iterations in the range 2^0 ... 2^63 us will be logged every 5s.");
                 e->profile_delays = true;
         }
 
+        if (getenv_bool_secure("SD_EVENT_STATS") > 0) {
+                r = event_set_stats(e, true);
+                if (r < 0)
+                        goto fail;
+        }
+
         *ret = e;
         return 0;
 
@@ -369,20 +486,212 @@ static bool event_pid_changed(sd_event *e) {
         return e->original_pid != getpid_cached();
 }
 
-static void source_io_unregister(sd_event_source *s) {
+static void source_io_mark_dirty(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        if (s->io.dirty)
+                return;
+
+        LIST_PREPEND(io.by_dirty, s->event->io_dirty, s);
+        s->io.dirty = true;
+}
+
+static void source_io_poll_detach(sd_event_source *s) {
+        struct io_poll *p;
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_IO);
 
+        p = TAKE_PTR(s->io.poll);
+        if (!p)
+                return;
+
+        /* The poll is freed once its completion shows up, which it does in any case, either because the fd
+         * became ready after all or because of the removal. */
+        p->source = NULL;
+
         if (event_pid_changed(s->event))
                 return;
 
-        if (!s->io.registered)
+        r = event_uring_poll_remove(s->event->uring, PTR_TO_UINT64(p));
+        if (r < 0)
+                log_debug_errno(r, "Failed to queue removal of poll for source %s (type %s), ignoring: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+}
+
+static bool source_io_use_uring(sd_event_source *s, uint32_t events) {
+        assert(s);
+
+        /* io_uring polls are oneshot and only ever report the current state, hence edge-triggered sources
+         * stay with epoll, which knows how to deliver edges. */
+        return s->event->uring && !(events & EPOLLET);
+}
+
+static void source_io_forget(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        /* Called when the source goes away: drop the poll right away rather than on the next iteration */
+
+        if (!s->event->uring)
+                return;
+
+        source_io_poll_detach(s);
+
+        if (s->io.dirty) {
+                LIST_REMOVE(io.by_dirty, s->event->io_dirty, s);
+                s->io.dirty = false;
+        }
+}
+
+static int source_io_check_fd(int fd) {
+        struct stat st;
+
+        /* epoll refuses regular files and directories as they are always readable and writable. POLL_ADD
+         * doesn't, but let's stay compatible, and a busy loop is never what the caller wants anyway. */
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))
+                return -EPERM;
+
+        return 0;
+}
+
+static void event_free_io_lane(sd_event *e, struct io_lane *l) {
+        assert(e);
+
+        if (!l)
+                return;
+
+        LIST_REMOVE(lanes, e->io_lanes, l);
+
+        /* Closing the fd removes it from the main epoll, too */
+        safe_close(l->fd);
+        free(l);
+}
+
+static void event_unref_io_lane(sd_event *e, struct io_lane *l) {
+        assert(e);
+
+        if (!l)
                 return;
 
-        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->io.fd, NULL) < 0)
+        assert(l->n_sources > 0);
+        if (--l->n_sources == 0)
+                event_free_io_lane(e, l);
+}
+
+static int event_make_io_lane(sd_event *e, int64_t priority, struct io_lane **ret) {
+        struct io_lane *l, *after = NULL;
+        struct epoll_event ev;
+        int r;
+
+        assert(e);
+        assert(ret);
+
+        LIST_FOREACH(lanes, l, e->io_lanes) {
+                if (l->priority == priority) {
+                        *ret = l;
+                        return 0;
+                }
+
+                if (l->priority > priority)
+                        break;
+
+                after = l;
+        }
+
+        l = new(struct io_lane, 1);
+        if (!l)
+                return -ENOMEM;
+
+        *l = (struct io_lane) {
+                .wakeup = WAKEUP_IO_LANE,
+                .priority = priority,
+        };
+
+        l->fd = epoll_create1(EPOLL_CLOEXEC);
+        if (l->fd < 0) {
+                r = -errno;
+                free(l);
+                return r;
+        }
+
+        l->fd = fd_move_above_stdio(l->fd);
+
+        ev = (struct epoll_event) {
+                .events = EPOLLIN,
+                .data.ptr = l,
+        };
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, l->fd, &ev) < 0) {
+                r = -errno;
+                safe_close(l->fd);
+                free(l);
+                return r;
+        }
+
+        LIST_INSERT_AFTER(lanes, e->io_lanes, after, l);
+
+        *ret = l;
+        return 1;
+}
+
+static bool event_io_lane_matches(sd_event *e, struct io_lane *l, int64_t priority) {
+        assert(e);
+
+        /* Returns true if an I/O source of the specified priority belongs into the specified lane */
+
+        if (!e->priority_lanes || priority <= SD_EVENT_PRIORITY_NORMAL)
+                return !l;
+
+        return l && l->priority == priority;
+}
+
+static int event_io_lane_fd(sd_event *e, struct io_lane *l) {
+        assert(e);
+
+        return l ? l->fd : e->epoll_fd;
+}
+
+static void source_io_epoll_del(sd_event_source *s, int fd) {
+        struct io_lane *l;
+
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        l = TAKE_PTR(s->io.lane);
+
+        if (epoll_ctl(event_io_lane_fd(s->event, l), EPOLL_CTL_DEL, fd, NULL) < 0)
                 log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll: %m",
                                 strna(s->description), event_source_type_to_string(s->type));
 
+        event_unref_io_lane(s->event, l);
+}
+
+static void source_io_unregister(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        if (event_pid_changed(s->event))
+                return;
+
+        if (!s->io.registered)
+                return;
+
+        if (s->io.uring) {
+                /* The poll itself is only removed when the loop is about to wait, so that switching a source
+                 * off and on again within one iteration doesn't cost anything. */
+                s->io.registered = false;
+                source_io_mark_dirty(s);
+                return;
+        }
+
+        source_io_epoll_del(s, s->io.fd);
         s->io.registered = false;
 }
 
@@ -399,20 +708,98 @@ static int source_io_register(
                 .events = events | (enabled == SD_EVENT_ONESHOT ? EPOLLONESHOT : 0),
                 .data.ptr = s,
         };
+        struct io_lane *lane = NULL;
+        bool moved;
         int r;
 
-        r = epoll_ctl(s->event->epoll_fd,
-                      s->io.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+        if (source_io_use_uring(s, events)) {
+                /* Only validate the fd here, the poll is set up on the next iteration, see
+                 * event_flush_io_polls(). */
+                if (!s->io.checked) {
+                        r = source_io_check_fd(s->io.fd);
+                        if (r < 0)
+                                return r;
+
+                        s->io.checked = true;
+                }
+
+                /* Switching over from epoll, because EPOLLET was dropped? */
+                if (s->io.registered && !s->io.uring)
+                        source_io_epoll_del(s, s->io.fd);
+
+                s->io.registered = true;
+                s->io.uring = true;
+                source_io_mark_dirty(s);
+                return 0;
+        }
+
+        /* Switching over from io_uring, because EPOLLET was set? Then drop the poll right away, so that it
+         * doesn't dispatch us a second time. */
+        if (s->io.registered && s->io.uring) {
+                source_io_poll_detach(s);
+                s->io.registered = false;
+        }
+
+        if (!event_io_lane_matches(s->event, NULL, s->priority)) {
+                r = event_make_io_lane(s->event, s->priority, &lane);
+                if (r < 0)
+                        return r;
+        }
+
+        /* If our priority changed, add us to the new lane first, and only then remove us from the old one */
+        moved = s->io.registered && lane != s->io.lane;
+
+        r = epoll_ctl(event_io_lane_fd(s->event, lane),
+                      s->io.registered && !moved ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
                       s->io.fd,
                       &ev);
-        if (r < 0)
-                return -errno;
+        if (r < 0) {
+                r = -errno;
+                if (lane && lane->n_sources == 0)
+                        event_free_io_lane(s->event, lane);
+                return r;
+        }
+
+        if (moved)
+                source_io_epoll_del(s, s->io.fd);
+
+        if (!s->io.registered || moved) {
+                s->io.lane = lane;
+                if (lane)
+                        lane->n_sources++;
+        }
 
         s->io.registered = true;
+        s->io.uring = false;
 
         return 0;
 }
 
+static void source_child_account(sd_event_source *s, bool enabled) {
+        sd_event *e;
+
+        assert(s);
+        assert(s->type == SOURCE_CHILD);
+
+        /* Call whenever a child source is enabled or disabled. Those watched through their pidfd don't need
+         * SIGCHLD, hence are not linked into the list process_child() iterates through. */
+
+        e = s->event;
+
+        if (enabled) {
+                e->n_enabled_child_sources++;
+
+                if (!EVENT_SOURCE_WATCH_PIDFD(s))
+                        LIST_PREPEND(child.waitid, e->child_waitid_sources, s);
+        } else {
+                assert(e->n_enabled_child_sources > 0);
+                e->n_enabled_child_sources--;
+
+                if (!EVENT_SOURCE_WATCH_PIDFD(s))
+                        LIST_REMOVE(child.waitid, e->child_waitid_sources, s);
+        }
+}
+
 static void source_child_pidfd_unregister(sd_event_source *s) {
         assert(s);
         assert(s->type == SOURCE_CHILD);
@@ -669,7 +1056,7 @@ static void event_gc_signal_data(sd_event *e, const int64_t *priority, int sig)
          * and possibly drop the signalfd for it. */
 
         if (sig == SIGCHLD &&
-            e->n_enabled_child_sources > 0)
+            e->child_waitid_sources)
                 return;
 
         if (e->signal_sources &&
@@ -717,8 +1104,10 @@ static void source_disconnect(sd_event_source *s) {
         switch (s->type) {
 
         case SOURCE_IO:
-                if (s->io.fd >= 0)
+                if (s->io.fd >= 0) {
                         source_io_unregister(s);
+                        source_io_forget(s);
+                }
 
                 break;
 
@@ -732,8 +1121,12 @@ static void source_disconnect(sd_event_source *s) {
                 d = event_get_clock_data(s->event, s->type);
                 assert(d);
 
-                prioq_remove(d->earliest, s, &s->time.earliest_index);
-                prioq_remove(d->latest, s, &s->time.latest_index);
+                if (s->time.wheel)
+                        timer_wheel_remove(d->wheel, &s->time.wheel_entry);
+                else {
+                        prioq_remove(d->earliest, s, &s->time.earliest_index);
+                        prioq_remove(d->latest, s, &s->time.latest_index);
+                }
                 d->needs_rearm = true;
                 break;
         }
@@ -751,10 +1144,8 @@ static void source_disconnect(sd_event_source *s) {
 
         case SOURCE_CHILD:
                 if (s->child.pid > 0) {
-                        if (s->enabled != SD_EVENT_OFF) {
-                                assert(s->event->n_enabled_child_sources > 0);
-                                s->event->n_enabled_child_sources--;
-                        }
+                        if (s->enabled != SD_EVENT_OFF)
+                                source_child_account(s, false);
 
                         (void) hashmap_remove(s->event->child_sources, PID_TO_PTR(s->child.pid));
                 }
@@ -813,6 +1204,10 @@ static void source_disconnect(sd_event_source *s) {
                 break;
         }
 
+        case SOURCE_WORK:
+                work_pool_forget(&s->work.item);
+                break;
+
         default:
                 assert_not_reached("Wut? I shouldn't exist.");
         }
@@ -823,6 +1218,9 @@ static void source_disconnect(sd_event_source *s) {
         if (s->prepare)
                 prioq_remove(s->event->prepare, s, &s->prepare_index);
 
+        if (s->ratelimited)
+                prioq_remove(s->event->ratelimited, s, &s->ratelimit_index);
+
         event = TAKE_PTR(s->event);
         LIST_REMOVE(sources, event->sources, s);
         event->n_sources--;
@@ -888,6 +1286,61 @@ static void source_free(sd_event_source *s) {
 }
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_event_source*, source_free);
 
+static uint64_t time_wheel_tick(sd_event *e, usec_t t) {
+        usec_t offset = e->perturb % TIMER_WHEEL_TICK_USEC;
+
+        /* Ticks are aligned to the perturbation value, so that they fall on the spots sleep_between()
+         * prefers. */
+        return t <= offset ? 0 : (t - offset) / TIMER_WHEEL_TICK_USEC;
+}
+
+static usec_t time_wheel_tick_usec(sd_event *e, uint64_t tick) {
+        usec_t offset = e->perturb % TIMER_WHEEL_TICK_USEC;
+
+        if (tick >= (USEC_INFINITY - offset) / TIMER_WHEEL_TICK_USEC)
+                return USEC_INFINITY;
+
+        return tick * TIMER_WHEEL_TICK_USEC + offset;
+}
+
+static void event_source_time_reshuffle(sd_event_source *s) {
+        struct clock_data *d;
+        uint64_t tick;
+        usec_t t;
+
+        assert(s);
+        assert(EVENT_SOURCE_IS_TIME(s->type));
+
+        /* Call this whenever the time, accuracy, enablement or pending state of a time source changed */
+
+        d = event_get_clock_data(s->event, s->type);
+        assert(d);
+
+        d->needs_rearm = true;
+
+        if (!s->time.wheel) {
+                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
+                prioq_reshuffle(d->latest, s, &s->time.latest_index);
+                return;
+        }
+
+        /* Unlike the prioqs the wheel has no place to keep sources around that shall not fire, hence drop
+         * them, they are put back once that changes. */
+        if (s->enabled == SD_EVENT_OFF || s->pending || s->time.next == USEC_INFINITY) {
+                timer_wheel_remove(d->wheel, &s->time.wheel_entry);
+                return;
+        }
+
+        /* Pick the spot sleep_between() would pick for this source alone, and round it down to a tick. As
+         * the window is at least one tick long, this never ends up before the source's time. */
+        t = sleep_between(s->event, s->time.next, time_event_source_latest(s));
+        tick = time_wheel_tick(s->event, t);
+        if (time_wheel_tick_usec(s->event, tick) < s->time.next)
+                tick++;
+
+        timer_wheel_put(d->wheel, &s->time.wheel_entry, tick);
+}
+
 static int source_set_pending(sd_event_source *s, bool b) {
         int r;
 
@@ -902,6 +1355,11 @@ static int source_set_pending(sd_event_source *s, bool b) {
         if (b) {
                 s->pending_iteration = s->event->iteration;
 
+                /* While processing the wake-up, use its time, which is closest to when the events happened */
+                if (s->event->stats)
+                        s->pending_timestamp = s->event->state == SD_EVENT_ARMED ?
+                                s->event->timestamp.monotonic : now(CLOCK_MONOTONIC);
+
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
                         s->pending = false;
@@ -910,16 +1368,11 @@ static int source_set_pending(sd_event_source *s, bool b) {
         } else
                 assert_se(prioq_remove(s->event->pending, s, &s->pending_index));
 
-        if (EVENT_SOURCE_IS_TIME(s->type)) {
-                struct clock_data *d;
-
-                d = event_get_clock_data(s->event, s->type);
-                assert(d);
+        if (EVENT_SOURCE_IS_TIME(s->type))
+                event_source_time_reshuffle(s);
 
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
-        }
+        if (s->type == SOURCE_POST && !b)
+                s->event->post_sources_pending = false;
 
         if (s->type == SOURCE_SIGNAL && !b) {
                 struct signal_data *d;
@@ -961,6 +1414,7 @@ static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType t
                 .type = type,
                 .pending_index = PRIOQ_IDX_NULL,
                 .prepare_index = PRIOQ_IDX_NULL,
+                .ratelimit_index = PRIOQ_IDX_NULL,
         };
 
         if (!floating)
@@ -1065,14 +1519,41 @@ static int event_setup_timer_fd(
         return 0;
 }
 
-static int time_exit_callback(sd_event_source *s, uint64_t usec, void *userdata) {
-        assert(s);
-
-        return sd_event_exit(sd_event_source_get_event(s), PTR_TO_INT(userdata));
+static bool time_source_wants_wheel(EventSourceType type, usec_t accuracy) {
+        /* The wheel only ever moves forward, hence clocks that may jump backwards stay with the prioqs, as
+         * do sources that need to be more precise than a tick. */
+        return IN_SET(type, SOURCE_TIME_BOOTTIME, SOURCE_TIME_MONOTONIC, SOURCE_TIME_BOOTTIME_ALARM) &&
+                accuracy >= TIMER_WHEEL_TICK_USEC;
 }
 
-_public_ int sd_event_add_time(
-                sd_event *e,
+static int clock_data_ensure_wheel(sd_event *e, struct clock_data *d, clockid_t clock) {
+        usec_t n;
+        int r;
+
+        assert(e);
+        assert(d);
+
+        if (d->wheel)
+                return 0;
+
+        /* The ticks are aligned to this, hence fix it before the first one is calculated */
+        initialize_perturb(e);
+
+        r = sd_event_now(e, clock, &n);
+        if (r < 0)
+                return r;
+
+        return timer_wheel_new(&d->wheel, time_wheel_tick(e, n));
+}
+
+static int time_exit_callback(sd_event_source *s, uint64_t usec, void *userdata) {
+        assert(s);
+
+        return sd_event_exit(sd_event_source_get_event(s), PTR_TO_INT(userdata));
+}
+
+_public_ int sd_event_add_time(
+                sd_event *e,
                 sd_event_source **ret,
                 clockid_t clock,
                 uint64_t usec,
@@ -1112,6 +1593,15 @@ _public_ int sd_event_add_time(
         if (r < 0)
                 return r;
 
+        if (accuracy == 0)
+                accuracy = DEFAULT_ACCURACY_USEC;
+
+        if (time_source_wants_wheel(type, accuracy)) {
+                r = clock_data_ensure_wheel(e, d, clock);
+                if (r < 0)
+                        return r;
+        }
+
         if (d->fd < 0) {
                 r = event_setup_timer_fd(e, d, clock);
                 if (r < 0)
@@ -1123,21 +1613,26 @@ _public_ int sd_event_add_time(
                 return -ENOMEM;
 
         s->time.next = usec;
-        s->time.accuracy = accuracy == 0 ? DEFAULT_ACCURACY_USEC : accuracy;
+        s->time.accuracy = accuracy;
         s->time.callback = callback;
         s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
+        s->time.wheel = time_source_wants_wheel(type, accuracy);
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
         d->needs_rearm = true;
 
-        r = prioq_put(d->earliest, s, &s->time.earliest_index);
-        if (r < 0)
-                return r;
+        if (s->time.wheel)
+                event_source_time_reshuffle(s);
+        else {
+                r = prioq_put(d->earliest, s, &s->time.earliest_index);
+                if (r < 0)
+                        return r;
 
-        r = prioq_put(d->latest, s, &s->time.latest_index);
-        if (r < 0)
-                return r;
+                r = prioq_put(d->latest, s, &s->time.latest_index);
+                if (r < 0)
+                        return r;
+        }
 
         if (ret)
                 *ret = s;
@@ -1290,7 +1785,6 @@ _public_ int sd_event_add_child(
         s->child.options = options;
         s->child.callback = callback;
         s->userdata = userdata;
-        s->enabled = SD_EVENT_ONESHOT;
 
         /* We always take a pidfd here if we can, even if we wait for anything else than WEXITED, so that we
          * pin the PID, and make regular waitid() handling race-free. */
@@ -1310,24 +1804,23 @@ _public_ int sd_event_add_child(
         if (r < 0)
                 return r;
 
-        e->n_enabled_child_sources++;
+        /* Only mark it enabled now, so that source_disconnect() doesn't undo accounting that never happened
+         * if hashmap_put() failed */
+        s->enabled = SD_EVENT_ONESHOT;
+        source_child_account(s, true);
 
         if (EVENT_SOURCE_WATCH_PIDFD(s)) {
                 /* We have a pidfd and we only want to watch for exit */
 
                 r = source_child_pidfd_register(s, s->enabled);
-                if (r < 0) {
-                        e->n_enabled_child_sources--;
+                if (r < 0)
                         return r;
-                }
         } else {
                 /* We have no pidfd or we shall wait for some other event than WEXITED */
 
                 r = event_make_signal_data(e, SIGCHLD, NULL);
-                if (r < 0) {
-                        e->n_enabled_child_sources--;
+                if (r < 0)
                         return r;
-                }
 
                 e->need_process_child = true;
         }
@@ -1391,30 +1884,26 @@ _public_ int sd_event_add_child_pidfd(
         s->child.callback = callback;
         s->child.pidfd_owned = false; /* If we got the pidfd passed in we don't own it by default (similar to the IO fd case) */
         s->userdata = userdata;
-        s->enabled = SD_EVENT_ONESHOT;
 
         r = hashmap_put(e->child_sources, PID_TO_PTR(pid), s);
         if (r < 0)
                 return r;
 
-        e->n_enabled_child_sources++;
+        s->enabled = SD_EVENT_ONESHOT;
+        source_child_account(s, true);
 
         if (EVENT_SOURCE_WATCH_PIDFD(s)) {
                 /* We only want to watch for WEXITED */
 
                 r = source_child_pidfd_register(s, s->enabled);
-                if (r < 0) {
-                        e->n_enabled_child_sources--;
+                if (r < 0)
                         return r;
-                }
         } else {
                 /* We shall wait for some other event than WEXITED */
 
                 r = event_make_signal_data(e, SIGCHLD, NULL);
-                if (r < 0) {
-                        e->n_enabled_child_sources--;
+                if (r < 0)
                         return r;
-                }
 
                 e->need_process_child = true;
         }
@@ -1488,6 +1977,8 @@ _public_ int sd_event_add_post(
                 return r;
         assert(r > 0);
 
+        e->post_sources_pending = false;
+
         if (ret)
                 *ret = s;
         TAKE_PTR(s);
@@ -1534,6 +2025,84 @@ _public_ int sd_event_add_exit(
         return 0;
 }
 
+static int event_make_work_data(sd_event *e) {
+        _cleanup_free_ struct work_data *d = NULL;
+        struct epoll_event ev;
+
+        assert(e);
+
+        if (e->work_data)
+                return 0;
+
+        d = new(struct work_data, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (struct work_data) {
+                .wakeup = WAKEUP_WORK_DATA,
+        };
+
+        d->sink.fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (d->sink.fd < 0)
+                return -errno;
+
+        ev = (struct epoll_event) {
+                .events = EPOLLIN,
+                .data.ptr = d,
+        };
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->sink.fd, &ev) < 0) {
+                safe_close(d->sink.fd);
+                return -errno;
+        }
+
+        e->work_data = TAKE_PTR(d);
+        return 1;
+}
+
+_public_ int sd_event_add_work(
+                sd_event *e,
+                sd_event_source **ret,
+                sd_event_work_handler_t work,
+                sd_event_work_complete_handler_t callback,
+                void *userdata) {
+
+        _cleanup_(source_freep) sd_event_source *s = NULL;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(work, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        r = event_make_work_data(e);
+        if (r < 0)
+                return r;
+
+        s = source_new(e, !ret, SOURCE_WORK);
+        if (!s)
+                return -ENOMEM;
+
+        s->work.callback = callback;
+        s->work.item = (WorkItem) {
+                .func = work,
+                .sink = &e->work_data->sink,
+        };
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ONESHOT;
+
+        r = work_pool_submit(&s->work.item, userdata);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = s;
+        TAKE_PTR(s);
+
+        return 0;
+}
+
 static void event_free_inotify_data(sd_event *e, struct inotify_data *d) {
         assert(e);
 
@@ -1986,26 +2555,49 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
         if (s->io.fd == fd)
                 return 0;
 
+        if (source_io_use_uring(s, s->io.events)) {
+                /* Polls are tied to the file, not the fd number, hence the old one is removed regardless
+                 * of what happens to the old fd, and there's no ordering to care about. */
+                if (s->enabled != SD_EVENT_OFF) {
+                        r = source_io_check_fd(fd);
+                        if (r < 0)
+                                return r;
+                }
+
+                source_io_poll_detach(s);
+                s->io.fd = fd;
+                s->io.checked = s->enabled != SD_EVENT_OFF;
+                if (s->io.registered)
+                        source_io_mark_dirty(s);
+
+                return 0;
+        }
+
         if (s->enabled == SD_EVENT_OFF) {
                 s->io.fd = fd;
                 s->io.registered = false;
         } else {
+                struct io_lane *saved_lane;
                 int saved_fd;
 
                 saved_fd = s->io.fd;
+                saved_lane = s->io.lane;
                 assert(s->io.registered);
 
                 s->io.fd = fd;
+                s->io.lane = NULL;
                 s->io.registered = false;
 
                 r = source_io_register(s, s->enabled, s->io.events);
                 if (r < 0) {
                         s->io.fd = saved_fd;
+                        s->io.lane = saved_lane;
                         s->io.registered = true;
                         return r;
                 }
 
-                (void) epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, saved_fd, NULL);
+                (void) epoll_ctl(event_io_lane_fd(s->event, saved_lane), EPOLL_CTL_DEL, saved_fd, NULL);
+                event_unref_io_lane(s->event, saved_lane);
         }
 
         return 0;
@@ -2173,6 +2765,19 @@ _public_ int sd_event_source_set_priority(sd_event_source *s, int64_t priority)
                 }
 
                 event_unmask_signal_data(s->event, old, s->signal.sig);
+
+        } else if (s->type == SOURCE_IO && s->io.registered && !s->io.uring &&
+                   !event_io_lane_matches(s->event, s->io.lane, priority)) {
+                int64_t old_priority = s->priority;
+
+                /* Move us to the epoll lane of the new priority */
+                s->priority = priority;
+
+                r = source_io_register(s, s->enabled, s->io.events);
+                if (r < 0) {
+                        s->priority = old_priority;
+                        return r;
+                }
         } else
                 s->priority = priority;
 
@@ -2198,25 +2803,24 @@ fail:
 }
 
 _public_ int sd_event_source_get_enabled(sd_event_source *s, int *m) {
+        int enabled;
+
         assert_return(s, -EINVAL);
         assert_return(!event_pid_changed(s->event), -ECHILD);
 
+        /* A source that is offline because of its rate limit is still enabled as far as the caller is
+         * concerned */
+        enabled = s->ratelimited ? s->ratelimit_enabled : s->enabled;
+
         if (m)
-                *m = s->enabled;
-        return s->enabled != SD_EVENT_OFF;
+                *m = enabled;
+        return enabled != SD_EVENT_OFF;
 }
 
-_public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
+static int source_set_enabled(sd_event_source *s, int m) {
         int r;
 
-        assert_return(s, -EINVAL);
-        assert_return(IN_SET(m, SD_EVENT_OFF, SD_EVENT_ON, SD_EVENT_ONESHOT), -EINVAL);
-        assert_return(!event_pid_changed(s->event), -ECHILD);
-
-        /* If we are dead anyway, we are fine with turning off
-         * sources, but everything else needs to fail. */
-        if (s->event->state == SD_EVENT_FINISHED)
-                return m == SD_EVENT_OFF ? 0 : -ESTALE;
+        assert(s);
 
         if (s->enabled == m)
                 return 0;
@@ -2241,18 +2845,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_TIME_BOOTTIME:
                 case SOURCE_TIME_MONOTONIC:
                 case SOURCE_TIME_REALTIME_ALARM:
-                case SOURCE_TIME_BOOTTIME_ALARM: {
-                        struct clock_data *d;
-
+                case SOURCE_TIME_BOOTTIME_ALARM:
                         s->enabled = m;
-                        d = event_get_clock_data(s->event, s->type);
-                        assert(d);
-
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        event_source_time_reshuffle(s);
                         break;
-                }
 
                 case SOURCE_SIGNAL:
                         s->enabled = m;
@@ -2263,8 +2859,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_CHILD:
                         s->enabled = m;
 
-                        assert(s->event->n_enabled_child_sources > 0);
-                        s->event->n_enabled_child_sources--;
+                        source_child_account(s, false);
 
                         if (EVENT_SOURCE_WATCH_PIDFD(s))
                                 source_child_pidfd_unregister(s);
@@ -2284,6 +2879,12 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         s->enabled = m;
                         break;
 
+                case SOURCE_WORK:
+                        /* If it is running already it is too late, we'll drop the result when collecting it */
+                        (void) work_pool_cancel(&s->work.item);
+                        s->enabled = m;
+                        break;
+
                 default:
                         assert_not_reached("Wut? I shouldn't exist.");
                 }
@@ -2311,18 +2912,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_TIME_BOOTTIME:
                 case SOURCE_TIME_MONOTONIC:
                 case SOURCE_TIME_REALTIME_ALARM:
-                case SOURCE_TIME_BOOTTIME_ALARM: {
-                        struct clock_data *d;
-
+                case SOURCE_TIME_BOOTTIME_ALARM:
                         s->enabled = m;
-                        d = event_get_clock_data(s->event, s->type);
-                        assert(d);
-
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        event_source_time_reshuffle(s);
                         break;
-                }
 
                 case SOURCE_SIGNAL:
 
@@ -2340,7 +2933,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_CHILD:
 
                         if (s->enabled == SD_EVENT_OFF)
-                                s->event->n_enabled_child_sources++;
+                                source_child_account(s, true);
 
                         s->enabled = m;
 
@@ -2350,7 +2943,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                                 r = source_child_pidfd_register(s, s->enabled);
                                 if (r < 0) {
                                         s->enabled = SD_EVENT_OFF;
-                                        s->event->n_enabled_child_sources--;
+                                        source_child_account(s, false);
                                         return r;
                                 }
                         } else {
@@ -2359,7 +2952,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                                 r = event_make_signal_data(s->event, SIGCHLD, NULL);
                                 if (r < 0) {
                                         s->enabled = SD_EVENT_OFF;
-                                        s->event->n_enabled_child_sources--;
+                                        source_child_account(s, false);
                                         event_gc_signal_data(s->event, &s->priority, SIGCHLD);
                                         return r;
                                 }
@@ -2372,12 +2965,25 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         prioq_reshuffle(s->event->exit, s, &s->exit.prioq_index);
                         break;
 
-                case SOURCE_DEFER:
                 case SOURCE_POST:
+                        s->enabled = m;
+                        s->event->post_sources_pending = false;
+                        break;
+
+                case SOURCE_DEFER:
                 case SOURCE_INOTIFY:
                         s->enabled = m;
                         break;
 
+                case SOURCE_WORK:
+                        /* Enabling a work source runs the work (again), unless it is still on its way */
+                        r = work_pool_submit(&s->work.item, s->userdata);
+                        if (r < 0)
+                                return r;
+
+                        s->enabled = m;
+                        break;
+
                 default:
                         assert_not_reached("Wut? I shouldn't exist.");
                 }
@@ -2392,6 +2998,25 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
         return 0;
 }
 
+_public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
+        assert_return(s, -EINVAL);
+        assert_return(IN_SET(m, SD_EVENT_OFF, SD_EVENT_ON, SD_EVENT_ONESHOT), -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        /* If we are dead anyway, we are fine with turning off
+         * sources, but everything else needs to fail. */
+        if (s->event->state == SD_EVENT_FINISHED)
+                return m == SD_EVENT_OFF ? 0 : -ESTALE;
+
+        if (s->ratelimited) {
+                /* Offline until the rate limit expires, just remember what to switch to then */
+                s->ratelimit_enabled = m;
+                return 0;
+        }
+
+        return source_set_enabled(s, m);
+}
+
 _public_ int sd_event_source_get_time(sd_event_source *s, uint64_t *usec) {
         assert_return(s, -EINVAL);
         assert_return(usec, -EINVAL);
@@ -2403,7 +3028,6 @@ _public_ int sd_event_source_get_time(sd_event_source *s, uint64_t *usec) {
 }
 
 _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
-        struct clock_data *d;
         int r;
 
         assert_return(s, -EINVAL);
@@ -2416,13 +3040,7 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
                 return r;
 
         s->time.next = usec;
-
-        d = event_get_clock_data(s->event, s->type);
-        assert(d);
-
-        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        event_source_time_reshuffle(s);
 
         return 0;
 }
@@ -2456,6 +3074,7 @@ _public_ int sd_event_source_get_time_accuracy(sd_event_source *s, uint64_t *use
 
 _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec) {
         struct clock_data *d;
+        bool wheel;
         int r;
 
         assert_return(s, -EINVAL);
@@ -2471,13 +3090,35 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         if (usec == 0)
                 usec = DEFAULT_ACCURACY_USEC;
 
-        s->time.accuracy = usec;
-
         d = event_get_clock_data(s->event, s->type);
         assert(d);
 
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        wheel = time_source_wants_wheel(s->type, usec);
+        if (wheel && !s->time.wheel) {
+                r = clock_data_ensure_wheel(s->event, d, event_source_type_to_clock(s->type));
+                if (r < 0)
+                        return r;
+
+                prioq_remove(d->earliest, s, &s->time.earliest_index);
+                prioq_remove(d->latest, s, &s->time.latest_index);
+
+        } else if (!wheel && s->time.wheel) {
+                r = prioq_put(d->earliest, s, &s->time.earliest_index);
+                if (r < 0)
+                        return r;
+
+                r = prioq_put(d->latest, s, &s->time.latest_index);
+                if (r < 0) {
+                        prioq_remove(d->earliest, s, &s->time.earliest_index);
+                        return r;
+                }
+
+                timer_wheel_remove(d->wheel, &s->time.wheel_entry);
+        }
+
+        s->time.wheel = wheel;
+        s->time.accuracy = usec;
+        event_source_time_reshuffle(s);
 
         return 0;
 }
@@ -2739,7 +3380,7 @@ static int event_arm_timer(
 
         struct itimerspec its = {};
         sd_event_source *a, *b;
-        usec_t t;
+        usec_t earliest = USEC_INFINITY, latest = USEC_INFINITY, t;
         int r;
 
         assert(e);
@@ -2751,7 +3392,40 @@ static int event_arm_timer(
                 d->needs_rearm = false;
 
         a = prioq_peek(d->earliest);
-        if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY) {
+        if (a && a->enabled != SD_EVENT_OFF && a->time.next != USEC_INFINITY) {
+                b = prioq_peek(d->latest);
+                assert_se(b && b->enabled != SD_EVENT_OFF);
+
+                earliest = a->time.next;
+                latest = time_event_source_latest(b);
+        }
+
+        if (d->wheel) {
+                uint64_t tick;
+
+                /* Expired entries are waiting to be picked up by process_timer() */
+                if (timer_wheel_peek_expired(d->wheel))
+                        earliest = latest = 0;
+                else {
+                        tick = timer_wheel_next(d->wheel);
+                        if (tick != UINT64_MAX) {
+                                t = time_wheel_tick_usec(e, tick);
+                                earliest = MIN(earliest, t);
+                                latest = MIN(latest, t);
+                        }
+                }
+        }
+
+        /* Rate limited sources come back on the monotonic clock, and want to do so without delay */
+        if (d == &e->monotonic) {
+                a = prioq_peek(e->ratelimited);
+                if (a) {
+                        earliest = MIN(earliest, ratelimit_end(&a->rate_limit));
+                        latest = MIN(latest, ratelimit_end(&a->rate_limit));
+                }
+        }
+
+        if (earliest == USEC_INFINITY) {
 
                 if (d->fd < 0)
                         return 0;
@@ -2768,10 +3442,7 @@ static int event_arm_timer(
                 return 0;
         }
 
-        b = prioq_peek(d->latest);
-        assert_se(b && b->enabled != SD_EVENT_OFF);
-
-        t = sleep_between(e, a->time.next, time_event_source_latest(b));
+        t = sleep_between(e, earliest, latest);
         if (d->next == t)
                 return 0;
 
@@ -2811,63 +3482,283 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         return source_set_pending(s, true);
 }
 
-static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
-        uint64_t x;
-        ssize_t ss;
+static int event_flush_io_polls(sd_event *e) {
+        sd_event_source *s;
+        int r;
 
         assert(e);
-        assert(fd >= 0);
 
-        assert_return(events == EPOLLIN, -EIO);
+        if (!e->uring)
+                return 0;
 
-        ss = read(fd, &x, sizeof(x));
-        if (ss < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
+        /* Bring the polls in the ring in line with what the I/O sources want now, after all changes of
+         * this iteration have been collapsed, and hand all of this to the kernel in one go. */
 
-                return -errno;
-        }
+        while ((s = e->io_dirty)) {
+                uint32_t events = s->io.events;
+                bool want = s->io.registered && s->io.uring;
 
-        if (_unlikely_(ss != sizeof(x)))
-                return -EIO;
+                if (s->io.poll && (!want || s->io.poll->events != events))
+                        source_io_poll_detach(s);
 
-        if (next)
-                *next = USEC_INFINITY;
+                /* A oneshot source that is still waiting to be dispatched doesn't need to be polled again */
+                if (want && !s->io.poll && !(s->enabled == SD_EVENT_ONESHOT && s->pending)) {
+                        _cleanup_free_ struct io_poll *p = NULL;
 
-        return 0;
-}
+                        p = new(struct io_poll, 1);
+                        if (!p)
+                                return -ENOMEM;
 
-static int process_timer(
-                sd_event *e,
-                usec_t n,
-                struct clock_data *d) {
+                        *p = (struct io_poll) {
+                                .source = s,
+                                .events = events,
+                        };
 
-        sd_event_source *s;
-        int r;
+                        r = event_uring_poll_add(e->uring, s->io.fd, events, PTR_TO_UINT64(p));
+                        if (r < 0)
+                                return r;
 
-        assert(e);
-        assert(d);
+                        LIST_PREPEND(polls, e->io_polls, p);
+                        s->io.poll = TAKE_PTR(p);
+                }
 
-        for (;;) {
-                s = prioq_peek(d->earliest);
-                if (!s ||
-                    s->time.next > n ||
-                    s->enabled == SD_EVENT_OFF ||
-                    s->pending)
-                        break;
+                LIST_REMOVE(io.by_dirty, e->io_dirty, s);
+                s->io.dirty = false;
+        }
 
-                r = source_set_pending(s, true);
-                if (r < 0)
-                        return r;
+        return event_uring_submit(e->uring);
+}
 
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
+static int process_work(sd_event *e, uint32_t events) {
+        WorkItem *list, *item;
+        int r = 0, k;
+
+        assert(e);
+        assert(e->work_data);
+
+        if ((events & (EPOLLIN|EPOLLERR|EPOLLHUP)) == 0)
+                return 0;
+
+        list = work_pool_collect(&e->work_data->sink);
+        while ((item = list)) {
+                sd_event_source *s = container_of(item, sd_event_source, work.item);
+
+                LIST_REMOVE(items, list, item);
+
+                /* Disabled while it was running? Then nobody is interested in the result anymore */
+                if (s->enabled == SD_EVENT_OFF)
+                        continue;
+
+                k = source_set_pending(s, true);
+                if (k < 0 && r >= 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static int process_uring(sd_event *e, uint32_t events) {
+        int r;
+
+        assert(e);
+        assert(e->uring);
+
+        assert_return(events == EPOLLIN, -EIO);
+
+        for (;;) {
+                struct io_poll *p;
+                sd_event_source *s;
+                uint64_t user_data;
+                int32_t res;
+
+                r = event_uring_reap(e->uring, &user_data, &res);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return 0;
+
+                /* Completions of removals carry no data */
+                if (user_data == 0)
+                        continue;
+
+                p = UINT64_TO_PTR(user_data);
+                s = p->source;
+
+                LIST_REMOVE(polls, e->io_polls, p);
+                free(p);
+
+                if (!s)
+                        continue;
+
+                s->io.poll = NULL;
+
+                if (res < 0) {
+                        /* Don't retry until the source is changed, that would just fail again */
+                        log_debug_errno(res, "Failed to poll source %s (type %s), ignoring: %m",
+                                        strna(s->description), event_source_type_to_string(s->type));
+                        continue;
+                }
+
+                /* Polls are oneshot, rearm it on the next iteration, which gives us level-triggered
+                 * behaviour like epoll by default. */
+                source_io_mark_dirty(s);
+
+                if (!s->io.registered || !s->io.uring)
+                        continue;
+
+                r = process_io(e, s, (uint32_t) res);
+                if (r < 0)
+                        return r;
+        }
+}
+
+static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
+        uint64_t x;
+        ssize_t ss;
+
+        assert(e);
+        assert(fd >= 0);
+
+        assert_return(events == EPOLLIN, -EIO);
+
+        ss = read(fd, &x, sizeof(x));
+        if (ss < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return -errno;
+        }
+
+        if (_unlikely_(ss != sizeof(x)))
+                return -EIO;
+
+        if (next)
+                *next = USEC_INFINITY;
+
+        return 0;
+}
+
+static int process_timer(
+                sd_event *e,
+                usec_t n,
+                struct clock_data *d) {
+
+        sd_event_source *s;
+        int r;
+
+        assert(e);
+        assert(d);
+
+        for (;;) {
+                s = prioq_peek(d->earliest);
+                if (!s ||
+                    s->time.next > n ||
+                    s->enabled == SD_EVENT_OFF ||
+                    s->pending)
+                        break;
+
+                r = source_set_pending(s, true);
+                if (r < 0)
+                        return r;
+        }
+
+        if (d->wheel) {
+                TimerWheelEntry *x;
+
+                if (n >= time_wheel_tick_usec(e, 0) &&
+                    timer_wheel_advance(d->wheel, time_wheel_tick(e, n)))
+                        d->needs_rearm = true;
+
+                /* Marking them pending drops them from the wheel */
+                while ((x = timer_wheel_peek_expired(d->wheel))) {
+                        s = container_of(x, sd_event_source, time.wheel_entry);
+
+                        r = source_set_pending(s, true);
+                        if (r < 0)
+                                return r;
+                }
         }
 
         return 0;
 }
 
+static int event_source_enter_ratelimited(sd_event_source *s) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        int enabled, r;
+
+        assert(s);
+        assert(!s->ratelimited);
+
+        /* Takes the source offline until the current rate limit interval is over. The monotonic timer is
+         * used to wake us up then, hence make sure it exists. */
+
+        r = event_setup_timer_fd(s->event, &s->event->monotonic, CLOCK_MONOTONIC);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated(&s->event->ratelimited, ratelimit_prioq_compare);
+        if (r < 0)
+                return r;
+
+        enabled = s->enabled;
+
+        r = source_set_enabled(s, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        s->ratelimited = true;
+        s->ratelimit_enabled = enabled;
+
+        r = prioq_put(s->event->ratelimited, s, &s->ratelimit_index);
+        if (r < 0) {
+                s->ratelimited = false;
+                (void) source_set_enabled(s, enabled);
+                return r;
+        }
+
+        s->event->monotonic.needs_rearm = true;
+
+        log_debug("Event source %s (type %s) was dispatched too often, taking it offline for %s.",
+                  strna(s->description), event_source_type_to_string(s->type),
+                  format_timespan(buf, sizeof(buf), usec_sub_unsigned(ratelimit_end(&s->rate_limit), now(CLOCK_MONOTONIC)), USEC_PER_MSEC));
+
+        return 0;
+}
+
+static int event_source_leave_ratelimit(sd_event_source *s) {
+        assert(s);
+
+        if (!s->ratelimited)
+                return 0;
+
+        prioq_remove(s->event->ratelimited, s, &s->ratelimit_index);
+        s->ratelimited = false;
+        s->event->monotonic.needs_rearm = true;
+
+        /* Start over with a fresh interval */
+        ratelimit_reset(&s->rate_limit);
+
+        return source_set_enabled(s, s->ratelimit_enabled);
+}
+
+static void process_ratelimit(sd_event *e, usec_t n) {
+        sd_event_source *s;
+        int r;
+
+        assert(e);
+
+        for (;;) {
+                s = prioq_peek(e->ratelimited);
+                if (!s || ratelimit_end(&s->rate_limit) > n)
+                        break;
+
+                r = event_source_leave_ratelimit(s);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to bring back event source %s (type %s) after rate limit, leaving it disabled: %m",
+                                        strna(s->description), event_source_type_to_string(s->type));
+        }
+}
+
 static int process_child(sd_event *e) {
         sd_event_source *s;
         int r;
@@ -2887,28 +3778,25 @@ static int process_child(sd_event *e) {
            want anything flushed out of the kernel's queue that we
            don't care about. Since this is O(n) this means that if you
            have a lot of processes you probably want to handle SIGCHLD
-           yourself.
+           yourself. Children with a usable pidfd are not affected
+           though, they are watched via epoll, and not iterated here.
 
            We do not reap the children here (by using WNOWAIT), this
            is only done after the event source is dispatched so that
            the callback still sees the process as a zombie.
         */
 
-        HASHMAP_FOREACH(s, e->child_sources) {
+        LIST_FOREACH(child.waitid, s, e->child_waitid_sources) {
                 assert(s->type == SOURCE_CHILD);
+                assert(s->enabled != SD_EVENT_OFF);
+                assert(!EVENT_SOURCE_WATCH_PIDFD(s));
 
                 if (s->pending)
                         continue;
 
-                if (s->enabled == SD_EVENT_OFF)
-                        continue;
-
                 if (s->child.exited)
                         continue;
 
-                if (EVENT_SOURCE_WATCH_PIDFD(s)) /* There's a usable pidfd known for this event source? then don't waitid() for it here */
-                        continue;
-
                 zero(s->child.siginfo);
                 r = waitid(P_PID, s->child.pid, &s->child.siginfo,
                            WNOHANG | (s->child.options & WEXITED ? WNOWAIT : 0) | s->child.options);
@@ -3045,7 +3933,7 @@ static int event_inotify_data_read(sd_event *e, struct inotify_data *d, uint32_t
         if (d->buffer_filled > 0)
                 return 0;
 
-        n = read(d->fd, &d->buffer, sizeof(d->buffer));
+        n = read(d->fd, d->buffer, sizeof(d->buffer));
         if (n < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
                         return 0;
@@ -3054,12 +3942,19 @@ static int event_inotify_data_read(sd_event *e, struct inotify_data *d, uint32_t
         }
 
         assert(n > 0);
+        d->buffer_offset = 0;
         d->buffer_filled = (size_t) n;
         LIST_PREPEND(buffered, e->inotify_data_buffered, d);
 
         return 1;
 }
 
+static struct inotify_event* event_inotify_data_current(struct inotify_data *d) {
+        assert(d);
+
+        return (struct inotify_event*) (d->buffer + d->buffer_offset);
+}
+
 static void event_inotify_data_drop(sd_event *e, struct inotify_data *d, size_t sz) {
         assert(e);
         assert(d);
@@ -3068,8 +3963,8 @@ static void event_inotify_data_drop(sd_event *e, struct inotify_data *d, size_t
         if (sz == 0)
                 return;
 
-        /* Move the rest to the buffer to the front, in order to get things properly aligned again */
-        memmove(d->buffer.raw, d->buffer.raw + sz, d->buffer_filled - sz);
+        /* The kernel pads the names so that every event is suitably aligned, hence just move on to the next */
+        d->buffer_offset += sz;
         d->buffer_filled -= sz;
 
         if (d->buffer_filled == 0)
@@ -3087,17 +3982,18 @@ static int event_inotify_data_process(sd_event *e, struct inotify_data *d) {
                 return 0;
 
         while (d->buffer_filled > 0) {
+                struct inotify_event *ev = event_inotify_data_current(d);
                 size_t sz;
 
                 /* Let's validate that the event structures are complete */
                 if (d->buffer_filled < offsetof(struct inotify_event, name))
                         return -EIO;
 
-                sz = offsetof(struct inotify_event, name) + d->buffer.ev.len;
+                sz = offsetof(struct inotify_event, name) + ev->len;
                 if (d->buffer_filled < sz)
                         return -EIO;
 
-                if (d->buffer.ev.mask & IN_Q_OVERFLOW) {
+                if (ev->mask & IN_Q_OVERFLOW) {
                         struct inode_data *inode_data;
 
                         /* The queue overran, let's pass this event to all event sources connected to this inotify
@@ -3122,9 +4018,9 @@ static int event_inotify_data_process(sd_event *e, struct inotify_data *d) {
 
                         /* Find the inode object for this watch descriptor. If IN_IGNORED is set we also remove it from
                          * our watch descriptor table. */
-                        if (d->buffer.ev.mask & IN_IGNORED) {
+                        if (ev->mask & IN_IGNORED) {
 
-                                inode_data = hashmap_remove(d->wd, INT_TO_PTR(d->buffer.ev.wd));
+                                inode_data = hashmap_remove(d->wd, INT_TO_PTR(ev->wd));
                                 if (!inode_data) {
                                         event_inotify_data_drop(e, d, sz);
                                         continue;
@@ -3133,7 +4029,7 @@ static int event_inotify_data_process(sd_event *e, struct inotify_data *d) {
                                 /* The watch descriptor was removed by the kernel, let's drop it here too */
                                 inode_data->wd = -1;
                         } else {
-                                inode_data = hashmap_get(d->wd, INT_TO_PTR(d->buffer.ev.wd));
+                                inode_data = hashmap_get(d->wd, INT_TO_PTR(ev->wd));
                                 if (!inode_data) {
                                         event_inotify_data_drop(e, d, sz);
                                         continue;
@@ -3147,8 +4043,8 @@ static int event_inotify_data_process(sd_event *e, struct inotify_data *d) {
                                 if (s->enabled == SD_EVENT_OFF)
                                         continue;
 
-                                if ((d->buffer.ev.mask & (IN_IGNORED|IN_UNMOUNT)) == 0 &&
-                                    (s->inotify.mask & d->buffer.ev.mask & IN_ALL_EVENTS) == 0)
+                                if ((ev->mask & (IN_IGNORED|IN_UNMOUNT)) == 0 &&
+                                    (s->inotify.mask & ev->mask & IN_ALL_EVENTS) == 0)
                                         continue;
 
                                 r = source_set_pending(s, true);
@@ -3184,6 +4080,7 @@ static int process_inotify(sd_event *e) {
 
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
+        usec_t begin, d;
         int r = 0;
 
         assert(s);
@@ -3199,11 +4096,22 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
-        if (s->type != SOURCE_POST) {
-                sd_event_source *z;
+        if (!ratelimit_below(&s->rate_limit)) {
+                /* Dispatched too often: don't dispatch this time, but take the source offline for a
+                 * while, so that others get their turn. Note that pending defer sources stay pending, and
+                 * are dispatched once they come back. */
+                r = event_source_enter_ratelimited(s);
+                if (r < 0)
+                        return r;
 
-                /* If we execute a non-post source, let's mark all
-                 * post sources as pending */
+                return 1;
+        }
+
+        /* If we execute a non-post source, let's mark all post sources as pending. Once they are, there's
+         * nothing to do until one of them is dispatched or enabled again, hence skip going through them on
+         * every dispatch. */
+        if (s->type != SOURCE_POST && !s->event->post_sources_pending) {
+                sd_event_source *z;
 
                 SET_FOREACH(z, s->event->post_sources) {
                         if (z->enabled == SD_EVENT_OFF)
@@ -3213,6 +4121,8 @@ static int source_dispatch(sd_event_source *s) {
                         if (r < 0)
                                 return r;
                 }
+
+                s->event->post_sources_pending = true;
         }
 
         if (s->enabled == SD_EVENT_ONESHOT) {
@@ -3222,6 +4132,16 @@ static int source_dispatch(sd_event_source *s) {
         }
 
         s->dispatching = true;
+        begin = now(CLOCK_MONOTONIC);
+
+        if (s->event->stats && s->type != SOURCE_EXIT) {
+                event_histogram_add(&s->event->stats->wakeup_latency,
+                                    usec_sub_unsigned(begin, s->event->timestamp.monotonic));
+
+                if (s->pending_timestamp > 0)
+                        event_histogram_add(&s->event->stats->dwell_time[event_priority_class_from_priority(s->priority)],
+                                            usec_sub_unsigned(begin, s->pending_timestamp));
+        }
 
         switch (s->type) {
 
@@ -3272,16 +4192,19 @@ static int source_dispatch(sd_event_source *s) {
         case SOURCE_INOTIFY: {
                 struct sd_event *e = s->event;
                 struct inotify_data *d;
+                struct inotify_event *ev;
                 size_t sz;
 
                 assert(s->inotify.inode_data);
                 assert_se(d = s->inotify.inode_data->inotify_data);
 
+                ev = event_inotify_data_current(d);
+
                 assert(d->buffer_filled >= offsetof(struct inotify_event, name));
-                sz = offsetof(struct inotify_event, name) + d->buffer.ev.len;
+                sz = offsetof(struct inotify_event, name) + ev->len;
                 assert(d->buffer_filled >= sz);
 
-                r = s->inotify.callback(s, &d->buffer.ev, s->userdata);
+                r = s->inotify.callback(s, ev, s->userdata);
 
                 /* When no event is pending anymore on this inotify object, then let's drop the event from the
                  * buffer. */
@@ -3291,23 +4214,47 @@ static int source_dispatch(sd_event_source *s) {
                 break;
         }
 
+        case SOURCE_WORK:
+                if (s->work.callback)
+                        r = s->work.callback(s, s->work.item.result, s->userdata);
+                break;
+
         case SOURCE_WATCHDOG:
         case _SOURCE_EVENT_SOURCE_TYPE_MAX:
         case _SOURCE_EVENT_SOURCE_TYPE_INVALID:
                 assert_not_reached("Wut? I shouldn't exist.");
         }
 
+        d = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+        s->n_dispatched++;
+        s->dispatch_usec += d;
+        s->profile_usec += d;
+
+        /* Defer sources stay pending, count their next turn from now on */
+        if (s->pending)
+                s->pending_timestamp = begin + d;
+
         s->dispatching = false;
 
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
 
-        if (s->n_ref == 0)
+        if (s->n_ref == 0) {
                 source_free(s);
-        else if (r < 0)
+                return 1;
+        }
+
+        if (r < 0)
                 sd_event_source_set_enabled(s, SD_EVENT_OFF);
 
+        /* A floating work source is released once done, unless the callback asked for the work to be run
+         * again */
+        if (s->type == SOURCE_WORK && s->floating && s->enabled == SD_EVENT_OFF) {
+                source_disconnect(s);
+                sd_event_source_unref(s);
+        }
+
         return 1;
 }
 
@@ -3491,6 +4438,10 @@ _public_ int sd_event_prepare(sd_event *e) {
 
         event_close_inode_data_fds(e);
 
+        r = event_flush_io_polls(e);
+        if (r < 0)
+                return r;
+
         if (event_next_pending(e) || e->need_process_child)
                 goto pending;
 
@@ -3507,8 +4458,123 @@ pending:
         return r;
 }
 
+static int process_epoll_event(sd_event *e, const struct epoll_event *ev) {
+        WakeupType *t;
+
+        assert(e);
+        assert(ev);
+
+        if (ev->data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
+                return flush_timer(e, e->watchdog_fd, ev->events, NULL);
+
+        t = ev->data.ptr;
+
+        switch (*t) {
+
+        case WAKEUP_EVENT_SOURCE: {
+                sd_event_source *s = ev->data.ptr;
+
+                assert(s);
+
+                switch (s->type) {
+
+                case SOURCE_IO:
+                        return process_io(e, s, ev->events);
+
+                case SOURCE_CHILD:
+                        return process_pidfd(e, s, ev->events);
+
+                default:
+                        assert_not_reached("Unexpected event source type");
+                }
+        }
+
+        case WAKEUP_CLOCK_DATA: {
+                struct clock_data *d = ev->data.ptr;
+
+                assert(d);
+
+                return flush_timer(e, d->fd, ev->events, &d->next);
+        }
+
+        case WAKEUP_SIGNAL_DATA:
+                return process_signal(e, ev->data.ptr, ev->events);
+
+        case WAKEUP_INOTIFY_DATA:
+                return event_inotify_data_read(e, ev->data.ptr, ev->events);
+
+        case WAKEUP_URING:
+                return process_uring(e, ev->events);
+
+        case WAKEUP_WORK_DATA:
+                return process_work(e, ev->events);
+
+        case WAKEUP_IO_LANE: {
+                struct io_lane *l = ev->data.ptr;
+
+                /* Only note it here, whether the lane is read depends on what else is pending, see
+                 * process_io_lanes() */
+                l->ready = true;
+                return 0;
+        }
+
+        default:
+                assert_not_reached("Invalid wake-up pointer");
+        }
+}
+
+static int process_io_lanes(sd_event *e) {
+        struct io_lane *l;
+        bool skip = false;
+        int r, m, i;
+
+        assert(e);
+
+        /* Read the ready lanes in order of their priority, but only as long as the sources dispatched next
+         * aren't all more important than the lane anyway. Lanes we skip remain readable, hence the next
+         * iteration will look at them again. */
+
+        LIST_FOREACH(lanes, l, e->io_lanes) {
+                sd_event_source *p;
+
+                if (!l->ready)
+                        continue;
+
+                l->ready = false;
+
+                if (!skip) {
+                        p = event_next_pending(e);
+                        skip = p && p->priority < l->priority &&
+                                prioq_size(e->pending) >= e->dispatch_budget_max;
+                }
+                if (skip)
+                        continue;
+
+                assert(l->n_sources <= e->event_queue_allocated);
+
+                m = epoll_wait(l->fd, e->event_queue, l->n_sources, 0);
+                if (m < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                e->n_events += m;
+
+                for (i = 0; i < m; i++) {
+                        r = process_epoll_event(e, e->event_queue + i);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
 _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         size_t event_queue_max;
+        usec_t before = 0;
         int r, m, i;
 
         assert_return(e, -EINVAL);
@@ -3530,6 +4596,14 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         if (e->inotify_data_buffered)
                 timeout = 0;
 
+        /* Pick up changes the caller made between sd_event_prepare() and now */
+        r = event_flush_io_polls(e);
+        if (r < 0)
+                goto finish;
+
+        if (e->stats)
+                before = now(CLOCK_MONOTONIC);
+
         m = epoll_wait(e->epoll_fd, e->event_queue, event_queue_max,
                        timeout == (uint64_t) -1 ? -1 : (int) DIV_ROUND_UP(timeout, USEC_PER_MSEC));
         if (m < 0) {
@@ -3543,59 +4617,15 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         }
 
         triple_timestamp_get(&e->timestamp);
+        e->n_events += m;
 
-        for (i = 0; i < m; i++) {
-
-                if (e->event_queue[i].data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
-                        r = flush_timer(e, e->watchdog_fd, e->event_queue[i].events, NULL);
-                else {
-                        WakeupType *t = e->event_queue[i].data.ptr;
-
-                        switch (*t) {
-
-                        case WAKEUP_EVENT_SOURCE: {
-                                sd_event_source *s = e->event_queue[i].data.ptr;
-
-                                assert(s);
-
-                                switch (s->type) {
-
-                                case SOURCE_IO:
-                                        r = process_io(e, s, e->event_queue[i].events);
-                                        break;
-
-                                case SOURCE_CHILD:
-                                        r = process_pidfd(e, s, e->event_queue[i].events);
-                                        break;
-
-                                default:
-                                        assert_not_reached("Unexpected event source type");
-                                }
-
-                                break;
-                        }
-
-                        case WAKEUP_CLOCK_DATA: {
-                                struct clock_data *d = e->event_queue[i].data.ptr;
-
-                                assert(d);
-
-                                r = flush_timer(e, d->fd, e->event_queue[i].events, &d->next);
-                                break;
-                        }
-
-                        case WAKEUP_SIGNAL_DATA:
-                                r = process_signal(e, e->event_queue[i].data.ptr, e->event_queue[i].events);
-                                break;
-
-                        case WAKEUP_INOTIFY_DATA:
-                                r = event_inotify_data_read(e, e->event_queue[i].data.ptr, e->event_queue[i].events);
-                                break;
+        if (e->stats) {
+                e->stats->wait_usec += usec_sub_unsigned(e->timestamp.monotonic, before);
+                e->stats->n_wakeups++;
+        }
 
-                        default:
-                                assert_not_reached("Invalid wake-up pointer");
-                        }
-                }
+        for (i = 0; i < m; i++) {
+                r = process_epoll_event(e, e->event_queue + i);
                 if (r < 0)
                         goto finish;
         }
@@ -3616,6 +4646,8 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         if (r < 0)
                 goto finish;
 
+        process_ratelimit(e, e->timestamp.monotonic);
+
         r = process_timer(e, e->timestamp.realtime, &e->realtime_alarm);
         if (r < 0)
                 goto finish;
@@ -3634,6 +4666,10 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
         if (r < 0)
                 goto finish;
 
+        r = process_io_lanes(e);
+        if (r < 0)
+                goto finish;
+
         if (event_next_pending(e)) {
                 e->state = SD_EVENT_PENDING;
 
@@ -3664,11 +4700,42 @@ _public_ int sd_event_dispatch(sd_event *e) {
         p = event_next_pending(e);
         if (p) {
                 _cleanup_(sd_event_unrefp) sd_event *ref = NULL;
+                usec_t begin = 0;
+                unsigned n = 0;
 
                 ref = sd_event_ref(e);
-                e->state = SD_EVENT_RUNNING;
-                r = source_dispatch(p);
-                e->state = SD_EVENT_INITIAL;
+
+                if (e->dispatch_budget_max > 1 && e->dispatch_budget_usec != USEC_INFINITY)
+                        begin = now(CLOCK_MONOTONIC);
+
+                /* Dispatch pending sources in order of priority, until the budget is used up. Sources which
+                 * become pending in the meantime are only picked up by the next iteration, hence this trades
+                 * latency for less overhead per dispatched source. */
+                for (;;) {
+                        bool defer = p->type == SOURCE_DEFER;
+
+                        e->state = SD_EVENT_RUNNING;
+                        r = source_dispatch(p);
+                        e->state = SD_EVENT_INITIAL;
+                        if (r < 0)
+                                return r;
+
+                        e->n_dispatched++;
+
+                        /* Defer sources stay pending while enabled, don't let them eat up the whole budget */
+                        if (++n >= e->dispatch_budget_max || defer || e->exit_requested)
+                                break;
+
+                        if (begin > 0 && usec_sub_unsigned(now(CLOCK_MONOTONIC), begin) >= e->dispatch_budget_usec) {
+                                e->n_budget_exceeded++;
+                                break;
+                        }
+
+                        p = event_next_pending(e);
+                        if (!p)
+                                break;
+                }
+
                 return r;
         }
 
@@ -3690,6 +4757,58 @@ static void event_log_delays(sd_event *e) {
         log_debug("Event loop iterations: %s", b);
 }
 
+static void event_log_batches(sd_event *e) {
+        uint64_t n;
+
+        n = e->iteration - e->last_log_iteration;
+        if (n == 0)
+                return;
+
+        log_debug("Event loop dispatching: %.2f events and %.2f sources per iteration, budget exceeded %" PRIu64 " times.",
+                  (double) (e->n_events - e->last_log_events) / n,
+                  (double) (e->n_dispatched - e->last_log_dispatched) / n,
+                  e->n_budget_exceeded - e->last_log_budget_exceeded);
+
+        e->last_log_iteration = e->iteration;
+        e->last_log_events = e->n_events;
+        e->last_log_dispatched = e->n_dispatched;
+        e->last_log_budget_exceeded = e->n_budget_exceeded;
+}
+
+static void event_log_slowest_sources(sd_event *e) {
+        sd_event_source *top[PROFILE_TOP_SOURCES], *s;
+        size_t n = 0, i;
+
+        /* Logs the sources whose callbacks took the most time since the last report */
+
+        LIST_FOREACH(sources, s, e->sources) {
+                if (s->profile_usec == 0)
+                        continue;
+
+                for (i = n; i > 0 && top[i-1]->profile_usec < s->profile_usec; i--)
+                        if (i < ELEMENTSOF(top))
+                                top[i] = top[i-1];
+
+                if (i < ELEMENTSOF(top)) {
+                        top[i] = s;
+                        n = MIN(n + 1, ELEMENTSOF(top));
+                }
+        }
+
+        for (i = 0; i < n; i++) {
+                char t[FORMAT_TIMESPAN_MAX], total[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Slowest event sources: #%zu %s (type %s) took %s, %s total in %" PRIu64 " dispatches.",
+                          i + 1, strna(top[i]->description), event_source_type_to_string(top[i]->type),
+                          format_timespan(t, sizeof(t), top[i]->profile_usec, 1),
+                          format_timespan(total, sizeof(total), top[i]->dispatch_usec, 1),
+                          top[i]->n_dispatched);
+        }
+
+        LIST_FOREACH(sources, s, e->sources)
+                s->profile_usec = 0;
+}
+
 _public_ int sd_event_run(sd_event *e, uint64_t timeout) {
         int r;
 
@@ -3711,6 +4830,8 @@ _public_ int sd_event_run(sd_event *e, uint64_t timeout) {
 
                 if (this_run - e->last_log >= 5*USEC_PER_SEC) {
                         event_log_delays(e);
+                        event_log_batches(e);
+                        event_log_slowest_sources(e);
                         e->last_log = this_run;
                 }
         }
@@ -3931,6 +5052,117 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         return 0;
 }
 
+_public_ int sd_event_set_dispatch_budget(sd_event *e, unsigned max_sources, uint64_t max_usec) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+        assert_return(max_usec > 0, -EINVAL);
+
+        e->dispatch_budget_max = MAX(max_sources, 1u);
+        e->dispatch_budget_usec = max_usec;
+        return 0;
+}
+
+_public_ int sd_event_get_dispatch_budget(sd_event *e, unsigned *ret_max_sources, uint64_t *ret_max_usec) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (ret_max_sources)
+                *ret_max_sources = e->dispatch_budget_max;
+        if (ret_max_usec)
+                *ret_max_usec = e->dispatch_budget_usec;
+        return 0;
+}
+
+_public_ int sd_event_get_dispatch_stats(
+                sd_event *e,
+                uint64_t *ret_n_events,
+                uint64_t *ret_n_dispatched,
+                uint64_t *ret_n_budget_exceeded) {
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (ret_n_events)
+                *ret_n_events = e->n_events;
+        if (ret_n_dispatched)
+                *ret_n_dispatched = e->n_dispatched;
+        if (ret_n_budget_exceeded)
+                *ret_n_budget_exceeded = e->n_budget_exceeded;
+        return 0;
+}
+
+_public_ int sd_event_set_priority_lanes(sd_event *e, int b) {
+        sd_event_source *s;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (e->priority_lanes == !!b)
+                return e->priority_lanes;
+
+        /* With io_uring the polls are not grouped by epoll at all */
+        if (e->uring)
+                return -EOPNOTSUPP;
+
+        e->priority_lanes = b;
+
+        /* Move the I/O sources we already have over */
+        LIST_FOREACH(sources, s, e->sources) {
+                if (s->type != SOURCE_IO || !s->io.registered)
+                        continue;
+
+                if (event_io_lane_matches(e, s->io.lane, s->priority))
+                        continue;
+
+                r = source_io_register(s, s->enabled, s->io.events);
+                if (r < 0)
+                        return r;
+        }
+
+        return e->priority_lanes;
+}
+
+_public_ int sd_event_get_priority_lanes(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        return e->priority_lanes;
+}
+
+int event_set_stats(sd_event *e, bool b) {
+        assert(e);
+        assert_se(e = event_resolve(e));
+
+        if (!b) {
+                e->stats = mfree(e->stats);
+                return 0;
+        }
+
+        if (e->stats)
+                return 0;
+
+        e->stats = new0(EventStats, 1);
+        if (!e->stats)
+                return -ENOMEM;
+
+        e->stats->since = now(CLOCK_MONOTONIC);
+        return 1;
+}
+
+const EventStats* event_get_stats(sd_event *e) {
+        assert(e);
+        assert_se(e = event_resolve(e));
+
+        return e->stats;
+}
+
 _public_ int sd_event_source_set_destroy_callback(sd_event_source *s, sd_event_destroy_t callback) {
         assert_return(s, -EINVAL);
 
@@ -3974,3 +5206,58 @@ _public_ int sd_event_source_set_floating(sd_event_source *s, int b) {
 
         return 1;
 }
+
+_public_ int sd_event_source_set_ratelimit(sd_event_source *s, uint64_t interval_usec, unsigned burst) {
+        int r;
+
+        assert_return(s, -EINVAL);
+        assert_return(EVENT_SOURCE_CAN_RATE_LIMIT(s->type), -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        /* Turning the rate limit off or changing it while it is in effect brings the source back right
+         * away, the new limit is only applied from now on. */
+        r = event_source_leave_ratelimit(s);
+        if (r < 0)
+                return r;
+
+        s->rate_limit = (RateLimit) {
+                .interval = interval_usec,
+                .burst = burst,
+        };
+
+        return 0;
+}
+
+_public_ int sd_event_source_get_ratelimit(sd_event_source *s, uint64_t *ret_interval_usec, unsigned *ret_burst) {
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (!ratelimit_configured(&s->rate_limit))
+                return -ENOEXEC;
+
+        if (ret_interval_usec)
+                *ret_interval_usec = s->rate_limit.interval;
+        if (ret_burst)
+                *ret_burst = s->rate_limit.burst;
+
+        return 0;
+}
+
+_public_ int sd_event_source_is_ratelimited(sd_event_source *s) {
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        return s->ratelimited;
+}
+
+_public_ int sd_event_source_get_dispatch_stats(sd_event_source *s, uint64_t *ret_n_dispatched, uint64_t *ret_usec) {
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (ret_n_dispatched)
+                *ret_n_dispatched = s->n_dispatched;
+        if (ret_usec)
+                *ret_usec = s->dispatch_usec;
+
+        return 0;
+}
@@ -5,6 +5,7 @@
 #include "sd-event.h"
 
 #include "alloc-util.h"
+#include "event-stats.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "log.h"
@@ -590,6 +591,763 @@ static void test_pidfd(void) {
         sd_event_unref(e);
 }
 
+#define N_BATCH_CHILDREN 16
+
+static int batch_child_handler(sd_event_source *s, const siginfo_t *si, void *userdata) {
+        unsigned *n = userdata;
+
+        assert_se(si->si_code == CLD_EXITED);
+        assert_se(si->si_status == 7);
+
+        (*n)++;
+        return 0;
+}
+
+static void test_child_batch(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *s[N_BATCH_CHILDREN + 1] = {};
+        unsigned n = 0;
+        size_t i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_dispatch_budget(e, N_BATCH_CHILDREN, UINT64_MAX) >= 0);
+
+        /* The last one watches for more than just exit, hence is checked with waitid() on SIGCHLD, the
+         * others are watched through their pidfd, if available */
+        for (i = 0; i < ELEMENTSOF(s); i++) {
+                pid_t pid;
+
+                pid = fork();
+                assert_se(pid >= 0);
+                if (pid == 0)
+                        _exit(7);
+
+                assert_se(sd_event_add_child(e, &s[i], pid, i < N_BATCH_CHILDREN ? WEXITED : WEXITED|WSTOPPED,
+                                             batch_child_handler, &n) >= 0);
+        }
+
+        /* Toggling doesn't lose any */
+        assert_se(sd_event_source_set_enabled(s[0], SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(s[N_BATCH_CHILDREN], SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(s[N_BATCH_CHILDREN], SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_set_enabled(s[0], SD_EVENT_ONESHOT) >= 0);
+
+        while (n < ELEMENTSOF(s))
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(s); i++) {
+                assert_se(sd_event_source_get_enabled(s[i], NULL) == 0);
+                sd_event_source_unref(s[i]);
+        }
+}
+
+static uint32_t last_toggle_revents = 0;
+
+static int toggle_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        last_toggle_revents = revents;
+        return 0;
+}
+
+static void test_io_toggle(bool with_uring) {
+        _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-event-io-XXXXXX";
+        _cleanup_close_pair_ int p[2] = { -1, -1 }, q[2] = { -1, -1 };
+        _cleanup_close_ int fd = -1;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        static const char ch = 'x';
+        unsigned n = 0, i;
+
+        log_info("/* %s(%s) */", __func__, with_uring ? "io_uring" : "epoll");
+
+        assert_se(setenv("SYSTEMD_IO_URING", yes_no(with_uring), 1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* Regular files are refused, whatever the backend */
+        assert_se((fd = mkostemp_safe(name)) >= 0);
+        assert_se(sd_event_add_io(e, NULL, fd, EPOLLIN, toggle_handler, &n) == -EPERM);
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(pipe2(q, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, &s, p[0], EPOLLIN, toggle_handler, &n) >= 0);
+
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 0);
+
+        /* Nobody reads the byte, hence the source keeps firing, however often it was toggled in between */
+        assert_se(write(p[1], &ch, 1) == 1);
+        for (i = 0; i < 100; i++) {
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+                assert_se(sd_event_source_set_io_events(s, EPOLLIN|EPOLLPRI) >= 0);
+                assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+
+                assert_se(sd_event_run(e, 0) == 1);
+                assert_se(n == i + 1);
+                assert_se(last_toggle_revents == EPOLLIN);
+        }
+
+        /* Disabled sources stay quiet... */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 100);
+
+        /* ... and oneshot ones fire once */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 101);
+
+        /* Moving the source to another fd while disabled and enabling it again */
+        assert_se(sd_event_source_set_io_fd(s, fd) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) == -EPERM);
+        assert_se(sd_event_source_set_io_fd(s, q[1]) >= 0);
+        assert_se(sd_event_source_set_io_events(s, EPOLLOUT) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(n == 102);
+        assert_se(last_toggle_revents == EPOLLOUT);
+
+        /* And while enabled */
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(sd_event_source_set_io_fd(s, fd) == -EPERM);
+        assert_se(sd_event_source_set_io_fd(s, p[0]) >= 0);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(n == 103);
+        assert_se(last_toggle_revents == EPOLLIN);
+
+        assert_se(unsetenv("SYSTEMD_IO_URING") >= 0);
+}
+
+static void test_io_edge(bool with_uring) {
+        _cleanup_close_pair_ int p[2] = { -1, -1 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        static const char ch = 'x';
+        unsigned n = 0;
+
+        log_info("/* %s(%s) */", __func__, with_uring ? "io_uring" : "epoll");
+
+        assert_se(setenv("SYSTEMD_IO_URING", yes_no(with_uring), 1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, &s, p[0], EPOLLIN|EPOLLET, toggle_handler, &n) >= 0);
+
+        /* Edge-triggered sources fire once per write, even if nobody reads the data */
+        assert_se(write(p[1], &ch, 1) == 1);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(n == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 1);
+
+        assert_se(write(p[1], &ch, 1) == 1);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 2);
+
+        /* Level-triggered again, the data that is still there keeps it firing */
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(n == 4);
+
+        /* And back: setting EPOLLET resets the edge, hence we get one more dispatch, but only one */
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN|EPOLLET) >= 0);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 5);
+
+        assert_se(write(p[1], &ch, 1) == 1);
+        assert_se(sd_event_run(e, 0) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 6);
+        assert_se(last_toggle_revents == EPOLLIN);
+
+        assert_se(unsetenv("SYSTEMD_IO_URING") >= 0);
+}
+
+static int ratelimit_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *c = userdata;
+
+        (*c)++;
+        return 0;
+}
+
+static int ratelimit_defer_handler(sd_event_source *s, void *userdata) {
+        unsigned *c = userdata;
+
+        (*c)++;
+        return 0;
+}
+
+static void test_ratelimit(void) {
+        _cleanup_close_pair_ int p[2] = { -1, -1 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL, *d = NULL, *t = NULL;
+        static const char ch = 'x';
+        uint64_t interval, n_dispatched, usec;
+        unsigned count = 0, defer_count = 0, burst, i;
+        usec_t start;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(write(p[1], &ch, 1) == 1);
+        assert_se(sd_event_add_io(e, &s, p[0], EPOLLIN, ratelimit_io_handler, &count) >= 0);
+        assert_se(sd_event_source_set_description(s, "test-ratelimit-io") >= 0);
+
+        assert_se(sd_event_source_get_ratelimit(s, NULL, NULL) == -ENOEXEC);
+        assert_se(sd_event_source_set_ratelimit(s, 500 * USEC_PER_MSEC, 5) >= 0);
+        assert_se(sd_event_source_get_ratelimit(s, &interval, &burst) >= 0);
+        assert_se(interval == 500 * USEC_PER_MSEC);
+        assert_se(burst == 5);
+
+        /* Time sources can't be rate limited */
+        assert_se(sd_event_add_time_relative(e, &t, CLOCK_MONOTONIC, USEC_PER_SEC, 0, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_ratelimit(t, USEC_PER_SEC, 1) == -EDOM);
+        t = sd_event_source_unref(t);
+
+        /* The fd stays readable, so the source fires continuously until it hits the limit and goes
+         * offline. Note that sd_event_run() might return early if interrupted by a signal, hence loop
+         * until the state we are waiting for is reached. */
+        start = now(CLOCK_MONOTONIC);
+        while (sd_event_source_is_ratelimited(s) == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(count == 5);
+
+        /* Still enabled as far as the caller is concerned */
+        assert_se(sd_event_source_get_enabled(s, NULL) > 0);
+
+        /* Meanwhile others get their turn */
+        assert_se(sd_event_add_defer(e, &d, ratelimit_defer_handler, &defer_count) >= 0);
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ONESHOT) >= 0);
+        while (defer_count == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(count == 5);
+
+        /* Until the interval is over and it is back */
+        while (sd_event_source_is_ratelimited(s) > 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(now(CLOCK_MONOTONIC) >= start + 500 * USEC_PER_MSEC);
+        while (count == 5)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(count == 6);
+
+        assert_se(sd_event_source_get_dispatch_stats(s, &n_dispatched, &usec) >= 0);
+        assert_se(n_dispatched == 6);
+
+        /* Disabling a source while it is offline sticks */
+        while (sd_event_source_is_ratelimited(s) == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(count == 10);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_get_enabled(s, NULL) == 0);
+        while (sd_event_source_is_ratelimited(s) > 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(count == 10);
+
+        /* Dropping the limit brings it back right away */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        while (sd_event_source_is_ratelimited(s) == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(count == 15);
+        assert_se(sd_event_source_set_ratelimit(s, 0, 0) >= 0);
+        assert_se(sd_event_source_is_ratelimited(s) == 0);
+        assert_se(sd_event_source_get_ratelimit(s, NULL, NULL) == -ENOEXEC);
+        for (i = 0; i < 100; i++)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(count > 100);
+        assert_se(sd_event_source_get_dispatch_stats(s, &n_dispatched, &usec) >= 0);
+        assert_se(n_dispatched == count);
+}
+
+#define N_WHEEL_TIMERS 200U
+
+static unsigned wheel_fired[N_WHEEL_TIMERS], wheel_total;
+
+static int wheel_time_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        unsigned i = PTR_TO_UINT(userdata);
+        uint64_t n, accuracy;
+        clockid_t clock;
+
+        assert_se(sd_event_source_get_time_clock(s, &clock) >= 0);
+        assert_se(sd_event_now(sd_event_source_get_event(s), clock, &n) >= 0);
+        assert_se(sd_event_source_get_time_accuracy(s, &accuracy) >= 0);
+
+        /* Never before the time, and dispatched within the window, modulo scheduling delays */
+        assert_se(n >= usec);
+        assert_se(n <= usec + accuracy + 5 * USEC_PER_SEC);
+
+        wheel_fired[i]++;
+        wheel_total++;
+
+        /* Re-arm the first time round */
+        if (wheel_fired[i] == 1) {
+                assert_se(sd_event_source_set_time_relative(s, (i % 7) * 50 * USEC_PER_MSEC) >= 0);
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        }
+
+        return 0;
+}
+
+static void test_time_wheel(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *s[N_WHEEL_TIMERS];
+        usec_t start;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &start) >= 0);
+
+        /* Coarse sources end up in the timer wheel, precise ones and those on the realtime clock in the
+         * prioqs. Mix them, and move some from one to the other. */
+        for (i = 0; i < N_WHEEL_TIMERS; i++) {
+                usec_t accuracy = i % 5 == 0 ? 1 : (250 + (i % 4) * 250) * USEC_PER_MSEC;
+
+                assert_se(sd_event_add_time(e, &s[i],
+                                            i % 10 == 3 ? CLOCK_REALTIME : CLOCK_MONOTONIC,
+                                            i % 10 == 3 ? now(CLOCK_REALTIME) : start + (i % 13) * 37 * USEC_PER_MSEC,
+                                            accuracy, wheel_time_handler, UINT_TO_PTR(i)) >= 0);
+        }
+
+        assert_se(sd_event_source_set_time_accuracy(s[0], USEC_PER_SEC) >= 0);
+        assert_se(sd_event_source_set_time_accuracy(s[1], 1) >= 0);
+
+        /* Disabled, moved around and far away ones don't fire */
+        assert_se(sd_event_source_set_enabled(s[2], SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_time(s[4], start + USEC_PER_WEEK) >= 0);
+        assert_se(sd_event_source_set_time(s[6], USEC_INFINITY) >= 0);
+
+        while (wheel_total < 2 * (N_WHEEL_TIMERS - 3))
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+
+        for (i = 0; i < N_WHEEL_TIMERS; i++)
+                assert_se(wheel_fired[i] == (IN_SET(i, 2, 4, 6) ? 0 : 2));
+
+        /* Turning a source back on that has been due for a while makes it fire right-away */
+        assert_se(sd_event_source_set_enabled(s[2], SD_EVENT_ONESHOT) >= 0);
+        while (wheel_fired[2] == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+
+        for (i = 0; i < N_WHEEL_TIMERS; i++)
+                sd_event_source_unref(s[i]);
+}
+
+static int work_results[4];
+static unsigned n_work_results;
+
+static int work_read(void *userdata) {
+        char c;
+
+        /* Blocks until something is written to the pipe */
+        if (read(PTR_TO_FD(userdata), &c, 1) != 1)
+                return -errno;
+
+        return c;
+}
+
+static int work_answer(void *userdata) {
+        return 42;
+}
+
+static int work_done(sd_event_source *s, int result, void *userdata) {
+        assert_se(n_work_results < ELEMENTSOF(work_results));
+        work_results[n_work_results++] = result;
+
+        return 0;
+}
+
+static void test_work(void) {
+        _cleanup_close_pair_ int p[2] = { -1, -1 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *a = NULL, *b = NULL, *c = NULL, *d = NULL;
+        int enabled;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        /* Two threads only, so that we can fill up the pool */
+        assert_se(setenv("SYSTEMD_WORK_THREADS", "2", 1) >= 0);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(pipe2(p, O_CLOEXEC) >= 0);
+
+        assert_se(sd_event_add_work(e, &a, work_read, work_done, FD_TO_PTR(p[0])) >= 0);
+        assert_se(sd_event_add_work(e, &b, work_read, work_done, FD_TO_PTR(p[0])) >= 0);
+
+        /* This one has to wait, and can hence still be cancelled */
+        assert_se(sd_event_add_work(e, &c, work_answer, work_done, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(c, SD_EVENT_OFF) >= 0);
+
+        assert_se(write(p[1], "xy", 2) == 2);
+        while (n_work_results < 2)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(work_results[0] + work_results[1] == 'x' + 'y');
+
+        for (i = 0; i < 3; i++)
+                assert_se(sd_event_run(e, 10 * USEC_PER_MSEC) >= 0);
+        assert_se(n_work_results == 2);
+        assert_se(sd_event_source_get_pending(c) == 0);
+
+        /* Enabling it again runs it after all */
+        assert_se(sd_event_source_set_enabled(c, SD_EVENT_ONESHOT) >= 0);
+        while (n_work_results < 3)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(work_results[2] == 42);
+        assert_se(sd_event_source_get_enabled(c, &enabled) >= 0);
+        assert_se(enabled == SD_EVENT_OFF);
+
+        /* Floating ones take care of themselves */
+        assert_se(sd_event_add_work(e, NULL, work_answer, work_done, NULL) >= 0);
+        while (n_work_results < 4)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(work_results[3] == 42);
+
+        /* A completion handler is optional */
+        assert_se(sd_event_add_work(e, &d, work_answer, NULL, NULL) >= 0);
+        do {
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+                assert_se(sd_event_source_get_enabled(d, &enabled) >= 0);
+        } while (enabled != SD_EVENT_OFF);
+        assert_se(n_work_results == 4);
+
+        assert_se(unsetenv("SYSTEMD_WORK_THREADS") >= 0);
+}
+
+#define N_BUDGET_SOURCES 8U
+
+static unsigned budget_order[N_BUDGET_SOURCES], budget_count;
+static bool budget_slow;
+
+static int budget_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char ch;
+
+        assert_se(read(fd, &ch, 1) == 1);
+        assert_se(budget_count < N_BUDGET_SOURCES);
+        budget_order[budget_count++] = PTR_TO_UINT(userdata);
+
+        if (budget_slow)
+                (void) usleep(10);
+
+        return 0;
+}
+
+static int budget_defer_handler(sd_event_source *s, void *userdata) {
+        unsigned *c = userdata;
+
+        (*c)++;
+        return 0;
+}
+
+static void test_dispatch_budget(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *d = NULL;
+        sd_event_source *s[N_BUDGET_SOURCES] = {};
+        int p[N_BUDGET_SOURCES][2];
+        uint64_t n_events, n_dispatched, n_exceeded, usec;
+        unsigned i, max, defer_count = 0;
+        static const char ch = 'x';
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_get_dispatch_budget(e, &max, &usec) >= 0);
+        assert_se(max == 1);
+        assert_se(usec == USEC_INFINITY);
+        assert_se(sd_event_set_dispatch_budget(e, 3, 0) == -EINVAL);
+        assert_se(sd_event_set_dispatch_budget(e, 3, USEC_INFINITY) >= 0);
+
+        for (i = 0; i < N_BUDGET_SOURCES; i++) {
+                assert_se(pipe2(p[i], O_CLOEXEC|O_NONBLOCK) >= 0);
+                assert_se(sd_event_add_io(e, &s[i], p[i][0], EPOLLIN, budget_io_handler, UINT_TO_PTR(i)) >= 0);
+                assert_se(sd_event_source_set_priority(s[i], N_BUDGET_SOURCES - i) >= 0);
+                assert_se(write(p[i][1], &ch, 1) == 1);
+        }
+
+        /* All become pending at once, and are dispatched in batches, in order of priority. Note that
+         * sd_event_run() might return early if interrupted by a signal, hence loop until something is
+         * dispatched. */
+        while (budget_count == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(budget_count == 3);
+        while (budget_count == 3)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(budget_count == 6);
+        while (budget_count == 6)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(budget_count == N_BUDGET_SOURCES);
+
+        for (i = 0; i < N_BUDGET_SOURCES; i++)
+                assert_se(budget_order[i] == N_BUDGET_SOURCES - 1 - i);
+
+        assert_se(sd_event_get_dispatch_stats(e, &n_events, &n_dispatched, &n_exceeded) >= 0);
+        assert_se(n_events >= N_BUDGET_SOURCES);
+        assert_se(n_dispatched == N_BUDGET_SOURCES);
+        assert_se(n_exceeded == 0);
+
+        /* A defer source that stays enabled is dispatched once per iteration, however large the budget */
+        assert_se(sd_event_add_defer(e, &d, budget_defer_handler, &defer_count) >= 0);
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(defer_count == 1);
+        assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(defer_count == 2);
+        d = sd_event_source_unref(d);
+
+        /* Running out of time ends the batch early */
+        budget_count = 0;
+        budget_slow = true;
+        assert_se(sd_event_set_dispatch_budget(e, N_BUDGET_SOURCES, 1) >= 0);
+        for (i = 0; i < N_BUDGET_SOURCES; i++)
+                assert_se(write(p[i][1], &ch, 1) == 1);
+        while (budget_count == 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        assert_se(budget_count == 1);
+        assert_se(sd_event_get_dispatch_stats(e, NULL, &n_dispatched, &n_exceeded) >= 0);
+        assert_se(n_dispatched == N_BUDGET_SOURCES + 2 + 1);
+        assert_se(n_exceeded == 1);
+
+        for (i = 0; i < N_BUDGET_SOURCES; i++) {
+                sd_event_source_unref(s[i]);
+                safe_close_pair(p[i]);
+        }
+}
+
+static int post_count_handler(sd_event_source *s, void *userdata) {
+        unsigned *c = userdata;
+
+        (*c)++;
+        return 0;
+}
+
+static void run_until_idle(sd_event *e) {
+        int r;
+
+        do
+                assert_se((r = sd_event_run(e, 0)) >= 0);
+        while (r > 0);
+}
+
+static void test_post(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *d = NULL, *p1 = NULL, *p2 = NULL, *p3 = NULL;
+        unsigned defer_count = 0, c1 = 0, c2 = 0, c3 = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_add_defer(e, &d, post_count_handler, &defer_count) >= 0);
+        assert_se(sd_event_add_post(e, &p1, post_count_handler, &c1) >= 0);
+        assert_se(sd_event_add_post(e, &p2, post_count_handler, &c2) >= 0);
+
+        /* Post sources run once after the defer source, not after each other */
+        run_until_idle(e);
+        assert_se(defer_count == 1);
+        assert_se(c1 == 1 && c2 == 1);
+
+        /* A disabled post source is skipped, and doesn't run either when enabled again later on without
+         * anything else being dispatched in between */
+        assert_se(sd_event_source_set_enabled(p2, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ONESHOT) >= 0);
+        run_until_idle(e);
+        assert_se(defer_count == 2);
+        assert_se(c1 == 2 && c2 == 1);
+
+        assert_se(sd_event_source_set_enabled(p2, SD_EVENT_ON) >= 0);
+        run_until_idle(e);
+        assert_se(c1 == 2 && c2 == 1);
+
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ONESHOT) >= 0);
+        run_until_idle(e);
+        assert_se(defer_count == 3);
+        assert_se(c1 == 3 && c2 == 2);
+
+        /* Sources added while the others are pending are picked up too */
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(defer_count == 4);
+        assert_se(sd_event_add_post(e, &p3, post_count_handler, &c3) >= 0);
+        assert_se(sd_event_source_set_enabled(d, SD_EVENT_ONESHOT) >= 0);
+        run_until_idle(e);
+        assert_se(defer_count == 5);
+        assert_se(c1 == 4 && c2 == 3 && c3 == 1);
+}
+
+static void test_histogram(void) {
+        static const uint64_t values[] = { 0, 1, 3, 4, 5, 7, 8, 9, 1000, 1023, 1024, 123456789, UINT64_MAX - 1, UINT64_MAX };
+        _cleanup_free_ EventHistogram *h = NULL;
+        size_t i;
+        unsigned j;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < ELEMENTSOF(values); i++) {
+                assert_se(h = new0(EventHistogram, 1));
+
+                event_histogram_add(h, values[i]);
+
+                for (j = 0; j < EVENT_HISTOGRAM_BUCKETS; j++)
+                        if (h->buckets[j] > 0)
+                                break;
+                assert_se(j < EVENT_HISTOGRAM_BUCKETS);
+
+                /* The bucket covers the value, and is not wider than a quarter of it */
+                assert_se(values[i] < event_histogram_bucket_below(j) || j == EVENT_HISTOGRAM_BUCKETS - 1);
+                assert_se(j == 0 || values[i] >= event_histogram_bucket_below(j - 1));
+                assert_se(j == 0 || event_histogram_bucket_below(j) - event_histogram_bucket_below(j - 1) <= MAX(values[i] / 4, 1u) ||
+                          j == EVENT_HISTOGRAM_BUCKETS - 1);
+
+                assert_se(event_histogram_percentile(h, 50) == values[i]);
+
+                h = mfree(h);
+        }
+
+        for (j = 1; j < EVENT_HISTOGRAM_BUCKETS; j++)
+                assert_se(event_histogram_bucket_below(j - 1) < event_histogram_bucket_below(j));
+
+        assert_se(h = new0(EventHistogram, 1));
+        for (i = 1; i <= 1000; i++)
+                event_histogram_add(h, i);
+        assert_se(h->n == 1000);
+        assert_se(h->max == 1000);
+        assert_se(event_histogram_percentile(h, 50) >= 500);
+        assert_se(event_histogram_percentile(h, 50) < 500 + 500 / 4);
+        assert_se(event_histogram_percentile(h, 100) == 1000);
+}
+
+static void test_stats(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *a = NULL, *b = NULL;
+        unsigned count = 0;
+        const EventStats *stats;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        if (!event_get_stats(e))
+                assert_se(event_set_stats(e, true) > 0);
+        assert_se(stats = event_get_stats(e));
+
+        assert_se(sd_event_add_defer(e, &a, post_count_handler, &count) >= 0);
+        assert_se(sd_event_source_set_priority(a, SD_EVENT_PRIORITY_IMPORTANT) >= 0);
+        assert_se(sd_event_add_defer(e, &b, post_count_handler, &count) >= 0);
+        assert_se(sd_event_source_set_priority(b, SD_EVENT_PRIORITY_IDLE) >= 0);
+
+        run_until_idle(e);
+        assert_se(count == 2);
+
+        assert_se(stats->n_wakeups >= 2);
+        assert_se(stats->wakeup_latency.n == 2);
+        assert_se(stats->dwell_time[EVENT_PRIORITY_CLASS_IMPORTANT].n == 1);
+        assert_se(stats->dwell_time[EVENT_PRIORITY_CLASS_NORMAL].n == 0);
+        assert_se(stats->dwell_time[EVENT_PRIORITY_CLASS_IDLE].n == 1);
+
+        /* Nothing to wait for, so idle time is spent in epoll_wait() */
+        assert_se(sd_event_run(e, 20 * USEC_PER_MSEC) >= 0);
+        assert_se(stats->wait_usec >= 10 * USEC_PER_MSEC);
+
+        assert_se(event_set_stats(e, false) >= 0);
+        assert_se(!event_get_stats(e));
+}
+
+#define N_LANE_SOURCES 3
+
+static int lane_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char **order = userdata, c;
+
+        assert_se(read(fd, &c, 1) == 1);
+        assert_se(strextend(order, (char[]) { c, 0 }, NULL));
+
+        return 0;
+}
+
+static void test_priority_lanes(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *idle[N_LANE_SOURCES] = {}, *normal = NULL;
+        int idle_pipe[N_LANE_SOURCES][2], normal_pipe[2];
+        _cleanup_free_ char *order = NULL;
+        uint64_t n_events, n, iteration, k;
+        size_t i;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        r = sd_event_set_priority_lanes(e, true);
+        if (r == -EOPNOTSUPP)
+                return (void) log_tests_skipped("event loop uses io_uring");
+        assert_se(r > 0);
+        assert_se(sd_event_get_priority_lanes(e) > 0);
+
+        assert_se(pipe2(normal_pipe, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, &normal, normal_pipe[0], EPOLLIN, lane_handler, &order) >= 0);
+
+        for (i = 0; i < N_LANE_SOURCES; i++) {
+                assert_se(pipe2(idle_pipe[i], O_CLOEXEC|O_NONBLOCK) >= 0);
+                assert_se(sd_event_add_io(e, &idle[i], idle_pipe[i][0], EPOLLIN, lane_handler, &order) >= 0);
+                assert_se(sd_event_source_set_priority(idle[i], SD_EVENT_PRIORITY_IDLE) >= 0);
+                assert_se(write(idle_pipe[i][1], "i", 1) == 1);
+        }
+
+        assert_se(write(normal_pipe[1], "nn", 2) == 2);
+
+        /* While the normal source is pending, the lane of the idle ones is not read at all, only its own
+         * wake-up is seen */
+        assert_se(sd_event_get_dispatch_stats(e, &n_events, NULL, NULL) >= 0);
+        assert_se(sd_event_get_iteration(e, &iteration) >= 0);
+        while (!order)
+                assert_se(sd_event_run(e, 0) >= 0);
+        assert_se(streq(order, "n"));
+        assert_se(sd_event_get_dispatch_stats(e, &n, NULL, NULL) >= 0);
+        assert_se(sd_event_get_iteration(e, &k) >= 0);
+        assert_se(n - n_events <= 2 * (k - iteration));
+
+        run_until_idle(e);
+        assert_se(streq(order, "nniii"));
+
+        /* Moving a source between lanes, and out of them, keeps it working */
+        assert_se(sd_event_source_set_priority(idle[0], SD_EVENT_PRIORITY_IDLE + 1) >= 0);
+        assert_se(sd_event_source_set_priority(idle[1], SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_event_source_set_io_fd(idle[2], normal_pipe[0]) >= 0);
+        assert_se(sd_event_source_set_io_fd(idle[2], idle_pipe[2][0]) >= 0);
+        assert_se(write(idle_pipe[0][1], "0", 1) == 1);
+        assert_se(write(idle_pipe[1][1], "1", 1) == 1);
+        assert_se(write(idle_pipe[2][1], "2", 1) == 1);
+        run_until_idle(e);
+        assert_se(streq(order, "nniii120"));
+
+        /* Turning it off moves everything back into the main epoll */
+        assert_se(sd_event_set_priority_lanes(e, false) == 0);
+        assert_se(write(idle_pipe[0][1], "0", 1) == 1);
+        assert_se(write(normal_pipe[1], "n", 1) == 1);
+        run_until_idle(e);
+        assert_se(streq(order, "nniii120n0"));
+
+        for (i = 0; i < N_LANE_SOURCES; i++) {
+                sd_event_source_unref(idle[i]);
+                safe_close_pair(idle_pipe[i]);
+        }
+        sd_event_source_unref(normal);
+        safe_close_pair(normal_pipe);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_INFO);
 
@@ -603,6 +1361,27 @@ int main(int argc, char *argv[]) {
         test_inotify(33000); /* should trigger a q overflow */
 
         test_pidfd();
+        test_child_batch();
+
+        test_io_toggle(false);
+        test_io_toggle(true);
+        test_io_edge(false);
+        test_io_edge(true);
+
+        test_ratelimit();
+
+        test_time_wheel();
+
+        test_work();
+
+        test_dispatch_budget();
+
+        test_post();
+
+        test_priority_lanes();
+
+        test_histogram();
+        test_stats();
 
         return 0;
 }
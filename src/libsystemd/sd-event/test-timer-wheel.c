@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "tests.h"
+#include "timer-wheel.h"
+
+#define N_ENTRIES 4096U
+
+static void test_basic(void) {
+        _cleanup_(timer_wheel_freep) TimerWheel *w = NULL;
+        TimerWheelEntry a = {}, b = {}, c = {};
+
+        log_info("/* %s */", __func__);
+
+        assert_se(timer_wheel_new(&w, 1000) >= 0);
+        assert_se(timer_wheel_next(w) == UINT64_MAX);
+        assert_se(!timer_wheel_peek_expired(w));
+
+        /* In the past, hence expired right-away */
+        timer_wheel_put(w, &a, 999);
+        assert_se(timer_wheel_entry_linked(&a));
+        assert_se(timer_wheel_peek_expired(w) == &a);
+        assert_se(timer_wheel_next(w) == UINT64_MAX);
+
+        timer_wheel_put(w, &a, 1010);
+        assert_se(!timer_wheel_peek_expired(w));
+        assert_se(timer_wheel_next(w) == 1010);
+
+        /* Far out, we only learn when it is going to be cascaded */
+        timer_wheel_put(w, &b, 1000 + 100000);
+        timer_wheel_put(w, &c, UINT64_MAX - 1);
+        assert_se(timer_wheel_size(w) == 3);
+        assert_se(timer_wheel_next(w) == 1010);
+
+        assert_se(!timer_wheel_advance(w, 1009));
+        assert_se(!timer_wheel_peek_expired(w));
+        assert_se(timer_wheel_advance(w, 1010));
+        assert_se(timer_wheel_peek_expired(w) == &a);
+
+        timer_wheel_remove(w, &a);
+        assert_se(!timer_wheel_entry_linked(&a));
+        assert_se(timer_wheel_size(w) == 2);
+        timer_wheel_remove(w, &a);
+
+        assert_se(timer_wheel_next(w) > 1010);
+        assert_se(timer_wheel_next(w) <= b.tick);
+
+        while (!timer_wheel_peek_expired(w))
+                assert_se(timer_wheel_advance(w, timer_wheel_next(w)));
+        assert_se(timer_wheel_peek_expired(w) == &b);
+        assert_se(timer_wheel_next(w) > b.tick);
+
+        timer_wheel_remove(w, &b);
+        timer_wheel_remove(w, &c);
+        assert_se(timer_wheel_size(w) == 0);
+        assert_se(timer_wheel_next(w) == UINT64_MAX);
+}
+
+static void test_random(void) {
+        _cleanup_(timer_wheel_freep) TimerWheel *w = NULL;
+        _cleanup_free_ TimerWheelEntry *entries = NULL;
+        uint64_t now = 12345, next;
+        unsigned i, round;
+
+        log_info("/* %s */", __func__);
+
+        /* Compares what the wheel does with a brute force scan over all entries */
+
+        srand(0);
+
+        assert_se(entries = new0(TimerWheelEntry, N_ENTRIES));
+        assert_se(timer_wheel_new(&w, now) >= 0);
+
+        for (round = 0; round < 2000; round++) {
+                TimerWheelEntry *x;
+                uint64_t min = UINT64_MAX;
+                size_t n_linked = 0, n_expired = 0;
+
+                /* Move some entries around, mostly into the near future, some far away */
+                for (i = 0; i < N_ENTRIES / 16; i++) {
+                        x = entries + rand() % N_ENTRIES;
+
+                        switch (rand() % 8) {
+                        case 0:
+                                timer_wheel_remove(w, x);
+                                break;
+                        case 1:
+                                timer_wheel_put(w, x, now + ((uint64_t) rand() << 16));
+                                break;
+                        default:
+                                timer_wheel_put(w, x, now - 5 + rand() % 5000);
+                        }
+                }
+
+                /* Either jump right to the next event, or do a random step */
+                next = timer_wheel_next(w);
+                if (rand() % 2 == 0 && next != UINT64_MAX)
+                        now = MAX(now, next);
+                else
+                        now += rand() % 300;
+
+                (void) timer_wheel_advance(w, now);
+
+                for (i = 0; i < N_ENTRIES; i++) {
+                        x = entries + i;
+
+                        if (!timer_wheel_entry_linked(x))
+                                continue;
+
+                        n_linked++;
+
+                        if (x->tick <= now)
+                                n_expired++;
+                        else
+                                min = MIN(min, x->tick);
+                }
+
+                assert_se(timer_wheel_size(w) == n_linked);
+
+                LIST_FOREACH(entries, x, timer_wheel_peek_expired(w)) {
+                        assert_se(x->tick <= now);
+                        assert_se(n_expired > 0);
+                        n_expired--;
+                }
+                assert_se(n_expired == 0);
+
+                next = timer_wheel_next(w);
+                assert_se(next > now);
+                assert_se(next <= min);
+                assert_se((next == UINT64_MAX) == (min == UINT64_MAX));
+        }
+
+        for (i = 0; i < N_ENTRIES; i++)
+                timer_wheel_remove(w, entries + i);
+
+        assert_se(timer_wheel_size(w) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_basic();
+        test_random();
+
+        return 0;
+}
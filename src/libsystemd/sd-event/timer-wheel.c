@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "timer-wheel.h"
+
+/* Six levels with 64 slots each: level 0 has one slot per tick, every further level slots 64 times as wide as
+ * the previous one. With sd-event's quarter second ticks that covers more than 500 years, entries further out
+ * than that are parked in the last slot of the outermost level and placed again once it is cascaded. */
+#define LEVEL_BITS 6U
+#define LEVEL_SIZE (1U << LEVEL_BITS)
+#define LEVEL_MASK ((uint64_t) LEVEL_SIZE - 1)
+#define LEVELS 6U
+
+#define LEVEL_SHIFT(level) ((level) * LEVEL_BITS)
+#define LEVEL_RANGE(level) (UINT64_C(1) << LEVEL_SHIFT((level) + 1))
+
+#define INDEX_EXPIRED (LEVELS * LEVEL_SIZE + 1)
+
+struct TimerWheel {
+        uint64_t now;             /* the next tick to process, all before it have been */
+        size_t n_entries;
+        size_t n_scheduled;       /* the entries in slots, i.e. not expired yet */
+
+        uint64_t occupied[LEVELS]; /* which slots are non-empty, one bit per slot */
+        TimerWheelEntry *slots[LEVELS][LEVEL_SIZE];
+
+        LIST_HEAD(TimerWheelEntry, expired);
+};
+
+int timer_wheel_new(TimerWheel **ret, uint64_t now) {
+        TimerWheel *w;
+
+        assert(ret);
+
+        w = new0(TimerWheel, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->now = now;
+
+        *ret = w;
+        return 0;
+}
+
+TimerWheel* timer_wheel_free(TimerWheel *w) {
+        /* Entries are owned by the caller, and are expected to have been removed already */
+        return mfree(w);
+}
+
+static void link_slot(TimerWheel *w, TimerWheelEntry *x, unsigned level, unsigned slot) {
+        LIST_PREPEND(entries, w->slots[level][slot], x);
+        w->occupied[level] |= UINT64_C(1) << slot;
+        w->n_scheduled++;
+
+        x->index = 1 + level * LEVEL_SIZE + slot;
+}
+
+static void link_expired(TimerWheel *w, TimerWheelEntry *x) {
+        LIST_PREPEND(entries, w->expired, x);
+        x->index = INDEX_EXPIRED;
+}
+
+static void unlink_entry(TimerWheel *w, TimerWheelEntry *x) {
+        unsigned level, slot;
+
+        if (x->index == INDEX_EXPIRED)
+                LIST_REMOVE(entries, w->expired, x);
+        else {
+                assert(x->index > 0 && x->index < INDEX_EXPIRED);
+
+                level = (x->index - 1) / LEVEL_SIZE;
+                slot = (x->index - 1) % LEVEL_SIZE;
+
+                LIST_REMOVE(entries, w->slots[level][slot], x);
+                if (!w->slots[level][slot])
+                        w->occupied[level] &= ~(UINT64_C(1) << slot);
+
+                assert(w->n_scheduled > 0);
+                w->n_scheduled--;
+        }
+
+        x->index = 0;
+}
+
+static void place(TimerWheel *w, TimerWheelEntry *x) {
+        uint64_t delta, tick;
+        unsigned level;
+
+        if (x->tick < w->now) {
+                link_expired(w, x);
+                return;
+        }
+
+        /* Pick the finest level that reaches far enough. The slot is selected by the tick's bits for that
+         * level, which makes sure the slot is cascaded exactly when we enter the range of ticks it covers. */
+        delta = x->tick - w->now;
+        for (level = 0; level < LEVELS - 1; level++)
+                if (delta < LEVEL_RANGE(level))
+                        break;
+
+        tick = x->tick;
+        if (delta >= LEVEL_RANGE(LEVELS - 1))
+                tick = w->now + LEVEL_RANGE(LEVELS - 1) - 1;
+
+        link_slot(w, x, level, (tick >> LEVEL_SHIFT(level)) & LEVEL_MASK);
+}
+
+void timer_wheel_put(TimerWheel *w, TimerWheelEntry *x, uint64_t tick) {
+        assert(w);
+        assert(x);
+
+        if (timer_wheel_entry_linked(x))
+                unlink_entry(w, x);
+        else
+                w->n_entries++;
+
+        x->tick = tick;
+        place(w, x);
+}
+
+void timer_wheel_remove(TimerWheel *w, TimerWheelEntry *x) {
+        assert(x);
+
+        if (!timer_wheel_entry_linked(x))
+                return;
+
+        assert(w);
+        assert(w->n_entries > 0);
+
+        unlink_entry(w, x);
+        w->n_entries--;
+}
+
+static bool cascade(TimerWheel *w, unsigned level) {
+        TimerWheelEntry *x, *list;
+        unsigned slot;
+
+        slot = (w->now >> LEVEL_SHIFT(level)) & LEVEL_MASK;
+        if (!(w->occupied[level] & (UINT64_C(1) << slot)))
+                return false;
+
+        list = TAKE_PTR(w->slots[level][slot]);
+        w->occupied[level] &= ~(UINT64_C(1) << slot);
+
+        while ((x = list)) {
+                LIST_REMOVE(entries, list, x);
+                x->index = 0;
+                w->n_scheduled--;
+
+                place(w, x);
+        }
+
+        return true;
+}
+
+bool timer_wheel_advance(TimerWheel *w, uint64_t tick) {
+        bool changed = false;
+
+        assert(w);
+        assert(tick < UINT64_MAX);
+
+        /* Processes all ticks up to and including the specified one, and moves whatever is due by then to
+         * the list of expired entries. Returns true if anything was moved around. Ticks at which nothing
+         * happens are skipped over. */
+
+        while (w->now <= tick) {
+                unsigned slot, level;
+                uint64_t next;
+
+                slot = w->now & LEVEL_MASK;
+
+                /* Whenever a level wraps around, the next slot of the level above is pulled down */
+                if (slot == 0)
+                        for (level = 1; level < LEVELS; level++) {
+                                if (cascade(w, level))
+                                        changed = true;
+
+                                if ((w->now >> LEVEL_SHIFT(level)) & LEVEL_MASK)
+                                        break;
+                        }
+
+                if (w->occupied[0] & (UINT64_C(1) << slot)) {
+                        TimerWheelEntry *x;
+
+                        while ((x = w->slots[0][slot])) {
+                                LIST_REMOVE(entries, w->slots[0][slot], x);
+                                w->n_scheduled--;
+
+                                link_expired(w, x);
+                        }
+
+                        w->occupied[0] &= ~(UINT64_C(1) << slot);
+                        changed = true;
+                }
+
+                w->now++;
+
+                next = timer_wheel_next(w);
+                if (next > tick) {
+                        w->now = tick + 1;
+                        break;
+                }
+
+                w->now = next;
+        }
+
+        return changed;
+}
+
+static uint64_t rotate_right(uint64_t x, unsigned n) {
+        n &= 63;
+        return n == 0 ? x : (x >> n) | (x << (64 - n));
+}
+
+uint64_t timer_wheel_next(TimerWheel *w) {
+        uint64_t next = UINT64_MAX, later;
+        unsigned slot, level;
+
+        assert(w);
+
+        /* Returns the first tick timer_wheel_advance() has to be called for to make progress, or UINT64_MAX
+         * if nothing is scheduled. For entries in the outer levels this is when their slot is cascaded,
+         * not when they are due. Expired entries are not considered. */
+
+        if (w->n_scheduled == 0)
+                return UINT64_MAX;
+
+        slot = w->now & LEVEL_MASK;
+        later = w->occupied[0] & (~UINT64_C(0) << slot);
+        if (later != 0)
+                next = (w->now & ~LEVEL_MASK) + __builtin_ctzll(later);
+        else if (w->occupied[0] != 0)
+                next = (w->now & ~LEVEL_MASK) + LEVEL_SIZE + __builtin_ctzll(w->occupied[0]);
+
+        for (level = 1; level < LEVELS; level++) {
+                uint64_t first;
+
+                if (w->occupied[level] == 0)
+                        continue;
+
+                /* The first slot boundary of this level at or after the current tick, and from there
+                 * the number of slots until we reach an occupied one */
+                first = (w->now + (UINT64_C(1) << LEVEL_SHIFT(level)) - 1) >> LEVEL_SHIFT(level);
+                first += __builtin_ctzll(rotate_right(w->occupied[level], first & LEVEL_MASK));
+
+                next = MIN(next, first << LEVEL_SHIFT(level));
+        }
+
+        return next;
+}
+
+TimerWheelEntry* timer_wheel_peek_expired(TimerWheel *w) {
+        assert(w);
+
+        return w->expired;
+}
+
+size_t timer_wheel_size(TimerWheel *w) {
+        return w ? w->n_entries : 0;
+}
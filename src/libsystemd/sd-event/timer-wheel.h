@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "list.h"
+#include "macro.h"
+
+/* A hierarchical timer wheel. Time is counted in ticks, and every entry is due at some tick. Adding, moving and
+ * removing an entry is O(1), which makes this a better fit than a priority queue for many timers that are
+ * re-armed all the time. Entries due soon are kept in one slot per tick, entries further in the future in
+ * coarser slots, which are cascaded into the finer ones as time goes by. Entries whose tick has been reached
+ * are moved to the list of expired entries, where they stay until they are removed or put again. */
+
+typedef struct TimerWheel TimerWheel;
+typedef struct TimerWheelEntry TimerWheelEntry;
+
+struct TimerWheelEntry {
+        uint64_t tick;
+        unsigned index; /* where we are linked in, 0 if nowhere */
+        LIST_FIELDS(TimerWheelEntry, entries);
+};
+
+int timer_wheel_new(TimerWheel **ret, uint64_t now);
+TimerWheel* timer_wheel_free(TimerWheel *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(TimerWheel*, timer_wheel_free);
+
+void timer_wheel_put(TimerWheel *w, TimerWheelEntry *x, uint64_t tick);
+void timer_wheel_remove(TimerWheel *w, TimerWheelEntry *x);
+
+static inline bool timer_wheel_entry_linked(const TimerWheelEntry *x) {
+        return x->index != 0;
+}
+
+bool timer_wheel_advance(TimerWheel *w, uint64_t tick);
+uint64_t timer_wheel_next(TimerWheel *w) _pure_;
+TimerWheelEntry* timer_wheel_peek_expired(TimerWheel *w) _pure_;
+
+size_t timer_wheel_size(TimerWheel *w) _pure_;
@@ -32,11 +32,22 @@ struct sd_hwdb {
                 const char *map;
         };
 
+        /* Points into the cache, the results of the current lookup */
         OrderedHashmap *properties;
         Iterator properties_iterator;
         bool properties_modified;
+
+        /* modalias → OrderedHashmap of the properties matching it, see properties_prepare() */
+        Hashmap *cache;
 };
 
+/* The same modaliases are looked up over and over again, e.g. by udev for each event of a device. Once
+ * the cache is full it is dropped entirely, which is good enough to keep it bounded. */
+#define HWDB_CACHE_MAX 1024U
+
+DEFINE_PRIVATE_HASH_OPS_FULL(hwdb_cache_hash_ops, char, string_hash_func, string_compare_func, free,
+                             OrderedHashmap, ordered_hashmap_free);
+
 struct linebuf {
         char bytes[LINE_MAX];
         size_t size;
@@ -181,10 +192,6 @@ static int hwdb_add_property(sd_hwdb *hwdb, const struct trie_value_entry_f *ent
                 }
         }
 
-        r = ordered_hashmap_ensure_allocated(&hwdb->properties, &string_hash_ops);
-        if (r < 0)
-                return r;
-
         r = ordered_hashmap_replace(hwdb->properties, key, (void *)entry);
         if (r < 0)
                 return r;
@@ -366,7 +373,7 @@ static sd_hwdb *hwdb_free(sd_hwdb *hwdb) {
         if (hwdb->map)
                 munmap((void *)hwdb->map, hwdb->st.st_size);
         safe_fclose(hwdb->f);
-        ordered_hashmap_free(hwdb->properties);
+        hashmap_free(hwdb->cache);
         return mfree(hwdb);
 }
 
@@ -397,13 +404,50 @@ bool hwdb_validate(sd_hwdb *hwdb) {
 }
 
 static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
+        _cleanup_(ordered_hashmap_freep) OrderedHashmap *properties = NULL;
+        _cleanup_free_ char *key = NULL;
+        int r;
+
         assert(hwdb);
         assert(modalias);
 
-        ordered_hashmap_clear(hwdb->properties);
         hwdb->properties_modified = true;
 
-        return trie_search_f(hwdb, modalias);
+        hwdb->properties = hashmap_get(hwdb->cache, modalias);
+        if (hwdb->properties)
+                return 0;
+
+        if (hashmap_size(hwdb->cache) >= HWDB_CACHE_MAX)
+                hashmap_clear(hwdb->cache);
+
+        r = hashmap_ensure_allocated(&hwdb->cache, &hwdb_cache_hash_ops);
+        if (r < 0)
+                return r;
+
+        /* Allocated even if nothing matches, so that misses are cached too */
+        properties = ordered_hashmap_new(&string_hash_ops);
+        if (!properties)
+                return -ENOMEM;
+
+        hwdb->properties = properties;
+        r = trie_search_f(hwdb, modalias);
+        hwdb->properties = NULL;
+        if (r < 0)
+                return r;
+
+        key = strdup(modalias);
+        if (!key)
+                return -ENOMEM;
+
+        r = hashmap_put(hwdb->cache, key, properties);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(key);
+        hwdb->properties = TAKE_PTR(properties);
+        hwdb->properties_modified = true;
+
+        return 0;
 }
 
 _public_ int sd_hwdb_get(sd_hwdb *hwdb, const char *modalias, const char *key, const char **_value) {
@@ -14,6 +14,11 @@
 
 #define RTNL_RQUEUE_MAX 64*1024
 
+/* Limits for the number of messages and bytes that are coalesced into a single sendmsg() while batching. The byte
+ * limit stays well below the default socket send buffer size. */
+#define RTNL_WQUEUE_MAX 256
+#define RTNL_WQUEUE_BYTES_MAX (64U*1024U)
+
 #define RTNL_CONTAINER_DEPTH 32
 
 struct reply_callback {
@@ -80,6 +85,13 @@ struct sd_netlink {
         struct nlmsghdr *rbuffer;
         size_t rbuffer_allocated;
 
+        sd_netlink_message **wqueue;
+        unsigned wqueue_size;
+        size_t wqueue_allocated;
+        size_t wqueue_bytes;
+
+        unsigned n_batch;
+
         bool processing:1;
 
         uint32_t serial;
@@ -125,12 +137,17 @@ struct sd_netlink_message {
         unsigned n_containers; /* number of containers */
         bool sealed:1;
         bool broadcast:1;
+        bool hdr_embedded:1; /* hdr is part of the allocation of the message itself */
+        bool parse_pending:1; /* the top-level attributes are only parsed on first access */
+
+        size_t header_size; /* size of the family specific header following the nlmsghdr */
 
         sd_netlink_message *next; /* next in a chain of multi-part messages */
 };
 
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type);
 int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret);
+int message_new_received(sd_netlink *rtnl, const struct nlmsghdr *hdr, sd_netlink_message **ret);
 
 int netlink_open_family(sd_netlink **ret, int family);
 
@@ -139,6 +156,7 @@ int socket_bind(sd_netlink *nl);
 int socket_broadcast_group_ref(sd_netlink *nl, unsigned group);
 int socket_broadcast_group_unref(sd_netlink *nl, unsigned group);
 int socket_write_message(sd_netlink *nl, sd_netlink_message *m);
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount);
 int socket_read_message(sd_netlink *nl);
 
 int rtnl_rqueue_make_room(sd_netlink *rtnl);
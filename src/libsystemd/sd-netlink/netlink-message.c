@@ -45,6 +45,34 @@ int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret) {
         return 0;
 }
 
+int message_new_received(sd_netlink *rtnl, const struct nlmsghdr *hdr, sd_netlink_message **ret) {
+        sd_netlink_message *m;
+
+        assert(rtnl);
+        assert(hdr);
+        assert(ret);
+
+        /* Received messages are never extended, hence store the copy of the message right after the object,
+         * saving an allocation for each message read from the socket. */
+
+        m = malloc(ALIGN(sizeof(sd_netlink_message)) + hdr->nlmsg_len);
+        if (!m)
+                return -ENOMEM;
+
+        *m = (sd_netlink_message) {
+                .n_ref = 1,
+                .protocol = rtnl->protocol,
+                .hdr = (struct nlmsghdr*) ((uint8_t*) m + ALIGN(sizeof(sd_netlink_message))),
+                .hdr_embedded = true,
+        };
+
+        memcpy(m->hdr, hdr, hdr->nlmsg_len);
+
+        *ret = m;
+
+        return 0;
+}
+
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         const NLType *nl_type;
@@ -101,7 +129,8 @@ sd_netlink_message *sd_netlink_message_unref(sd_netlink_message *m) {
         while (m && --m->n_ref == 0) {
                 unsigned i;
 
-                free(m->hdr);
+                if (!m->hdr_embedded)
+                        free(m->hdr);
 
                 for (i = 0; i <= m->n_containers; i++)
                         free(m->containers[i].attributes);
@@ -644,9 +673,12 @@ int sd_netlink_message_cancel_array(sd_netlink_message *m) {
         return 0;
 }
 
+static int netlink_message_parse_pending(sd_netlink_message *m);
+
 static int netlink_message_read_internal(sd_netlink_message *m, unsigned short type, void **data, bool *net_byteorder) {
         struct netlink_attribute *attribute;
         struct rtattr *rta;
+        int r;
 
         assert_return(m, -EINVAL);
         assert_return(m->sealed, -EPERM);
@@ -654,6 +686,12 @@ static int netlink_message_read_internal(sd_netlink_message *m, unsigned short t
 
         assert(m->n_containers < RTNL_CONTAINER_DEPTH);
 
+        if (m->n_containers == 0) {
+                r = netlink_message_parse_pending(m);
+                if (r < 0)
+                        return r;
+        }
+
         if (!m->containers[m->n_containers].attributes)
                 return -ENODATA;
 
@@ -973,19 +1011,30 @@ static int netlink_container_parse(sd_netlink_message *m,
                                    size_t rt_len) {
         _cleanup_free_ struct netlink_attribute *attributes = NULL;
         size_t n_allocated = 0;
+        struct rtattr *i;
 
         /* RTA_OK() macro compares with rta->rt_len, which is unsigned short, and
          * LGTM.com analysis does not like the type difference. Hence, here we
          * introduce an unsigned short variable as a workaround. */
         unsigned short len = rt_len;
+
+        /* Find the highest attribute type first, so that the table is allocated in one go rather than grown
+         * attribute by attribute. */
+        for (i = rta; RTA_OK(i, len); i = RTA_NEXT(i, len))
+                n_allocated = MAX(n_allocated, (size_t) RTA_TYPE(i) + 1);
+
+        if (n_allocated > 0) {
+                attributes = new0(struct netlink_attribute, n_allocated);
+                if (!attributes)
+                        return -ENOMEM;
+        }
+
+        len = rt_len;
         for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
                 unsigned short type;
 
                 type = RTA_TYPE(rta);
 
-                if (!GREEDY_REALLOC0(attributes, n_allocated, type + 1))
-                        return -ENOMEM;
-
                 if (attributes[type].offset != 0)
                         log_debug("rtnl: message parse - overwriting repeated attribute");
 
@@ -1185,6 +1234,28 @@ static int netlink_message_parse_error(sd_netlink_message *m) {
                                        NLMSG_PAYLOAD(m->hdr, hlen));
 }
 
+static int netlink_message_parse_pending(sd_netlink_message *m) {
+        int r;
+
+        assert(m);
+
+        if (!m->parse_pending)
+                return 0;
+
+        if (sd_netlink_message_is_error(m))
+                r = netlink_message_parse_error(m);
+        else
+                r = netlink_container_parse(m,
+                                            &m->containers[0],
+                                            (struct rtattr*)((uint8_t*) NLMSG_DATA(m->hdr) + NLMSG_ALIGN(m->header_size)),
+                                            NLMSG_PAYLOAD(m->hdr, m->header_size));
+        if (r < 0)
+                return r;
+
+        m->parse_pending = false;
+        return 0;
+}
+
 int sd_netlink_message_rewind(sd_netlink_message *m, sd_netlink *genl) {
         const NLType *nl_type;
         uint16_t type;
@@ -1204,8 +1275,8 @@ int sd_netlink_message_rewind(sd_netlink_message *m, sd_netlink *genl) {
 
         m->n_containers = 0;
 
-        if (m->containers[0].attributes)
-                /* top-level attributes have already been parsed */
+        if (m->containers[0].attributes || m->parse_pending)
+                /* top-level attributes have already been parsed, or will be on first access */
                 return 0;
 
         assert(m->hdr);
@@ -1224,15 +1295,10 @@ int sd_netlink_message_rewind(sd_netlink_message *m, sd_netlink *genl) {
 
                 m->containers[0].type_system = type_system;
 
-                if (sd_netlink_message_is_error(m))
-                        r = netlink_message_parse_error(m);
-                else
-                        r = netlink_container_parse(m,
-                                                    &m->containers[m->n_containers],
-                                                    (struct rtattr*)((uint8_t*) NLMSG_DATA(m->hdr) + NLMSG_ALIGN(size)),
-                                                    NLMSG_PAYLOAD(m->hdr, size));
-                if (r < 0)
-                        return r;
+                /* Many messages, e.g. acknowledgements or notifications nobody is interested in, are never
+                 * looked at, hence defer building the attribute table until it is needed. */
+                m->header_size = size;
+                m->parse_pending = true;
         }
 
         return 0;
@@ -238,6 +238,48 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         return k;
 }
 
+/* Sends several messages with a single sendmsg(). The kernel processes them in order and sends a separate reply for
+ * each of them. Returns the number of bytes sent, or a negative error code. */
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_nl nl;
+        } addr = {
+                .nl.nl_family = AF_NETLINK,
+        };
+        struct msghdr mh = {
+                .msg_name = &addr.sa,
+                .msg_namelen = sizeof(addr.nl),
+                .msg_iovlen = msgcount,
+        };
+        struct iovec *iovs;
+        ssize_t k;
+        size_t i;
+
+        assert(nl);
+        assert(m);
+        assert(msgcount > 0);
+        assert(msgcount <= RTNL_WQUEUE_MAX);
+
+        iovs = newa(struct iovec, msgcount);
+        for (i = 0; i < msgcount; i++) {
+                assert(m[i]->hdr);
+                /* The messages are simply concatenated, hence make sure the next one starts where the kernel
+                 * expects it. */
+                assert(NLMSG_ALIGN(m[i]->hdr->nlmsg_len) == m[i]->hdr->nlmsg_len);
+
+                iovs[i] = IOVEC_MAKE(m[i]->hdr, m[i]->hdr->nlmsg_len);
+        }
+
+        mh.msg_iov = iovs;
+
+        k = sendmsg(nl->fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+
+        return k;
+}
+
 static int socket_recv_message(int fd, struct iovec *iov, uint32_t *ret_mcast_group, bool peek) {
         union sockaddr_union sender;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct nl_pktinfo))) control;
@@ -383,16 +425,12 @@ int socket_read_message(sd_netlink *rtnl) {
                         continue;
                 }
 
-                r = message_new_empty(rtnl, &m);
+                r = message_new_received(rtnl, new_msg, &m);
                 if (r < 0)
                         return r;
 
                 m->broadcast = !!group;
 
-                m->hdr = memdup(new_msg, new_msg->nlmsg_len);
-                if (!m->hdr)
-                        return -ENOMEM;
-
                 /* seal and parse the top-level message */
                 r = sd_netlink_message_rewind(m, rtnl);
                 if (r < 0)
@@ -790,6 +790,15 @@ static const NLTypeSystem rtnl_nexthop_type_system = {
        .types = rtnl_nexthop_types,
 };
 
+static const NLType rtnl_stats_types[] = {
+        [IFLA_STATS_LINK_64]      = { .size = sizeof(struct rtnl_link_stats64) },
+};
+
+static const NLTypeSystem rtnl_stats_type_system = {
+       .count = ELEMENTSOF(rtnl_stats_types),
+       .types = rtnl_stats_types,
+};
+
 static const NLType rtnl_tca_option_data_cake_types[] = {
         [TCA_CAKE_BASE_RATE64] = { .type = NETLINK_TYPE_U64 },
         [TCA_CAKE_OVERHEAD]    = { .type = NETLINK_TYPE_S32 },
@@ -990,6 +999,7 @@ static const NLTypeSystem error_type_system = {
 static const NLType rtnl_types[] = {
         [NLMSG_DONE]       = { .type = NETLINK_TYPE_NESTED, .type_system = &empty_type_system, .size = 0 },
         [NLMSG_ERROR]      = { .type = NETLINK_TYPE_NESTED, .type_system = &error_type_system, .size = sizeof(struct nlmsgerr) },
+        [NLMSG_OVERRUN]    = { .type = NETLINK_TYPE_NESTED, .type_system = &empty_type_system, .size = 0 },
         [RTM_NEWLINK]      = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_link_type_system, .size = sizeof(struct ifinfomsg) },
         [RTM_DELLINK]      = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_link_type_system, .size = sizeof(struct ifinfomsg) },
         [RTM_GETLINK]      = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_link_type_system, .size = sizeof(struct ifinfomsg) },
@@ -1015,6 +1025,8 @@ static const NLType rtnl_types[] = {
         [RTM_NEWNEXTHOP]   = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_nexthop_type_system, .size = sizeof(struct nhmsg) },
         [RTM_DELNEXTHOP]   = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_nexthop_type_system, .size = sizeof(struct nhmsg) },
         [RTM_GETNEXTHOP]   = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_nexthop_type_system, .size = sizeof(struct nhmsg) },
+        [RTM_NEWSTATS]     = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_stats_type_system, .size = sizeof(struct if_stats_msg) },
+        [RTM_GETSTATS]     = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_stats_type_system, .size = sizeof(struct if_stats_msg) },
         [RTM_NEWQDISC]     = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_tca_type_system, .size = sizeof(struct tcmsg) },
         [RTM_DELQDISC]     = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_tca_type_system, .size = sizeof(struct tcmsg) },
         [RTM_GETQDISC]     = { .type = NETLINK_TYPE_NESTED, .type_system = &rtnl_tca_type_system, .size = sizeof(struct tcmsg) },
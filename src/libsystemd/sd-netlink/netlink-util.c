@@ -304,6 +304,22 @@ int rtnl_message_new_synthetic_error(sd_netlink *rtnl, int error, uint32_t seria
         return 0;
 }
 
+int rtnl_message_new_synthetic_overrun(sd_netlink *rtnl, sd_netlink_message **ret) {
+        int r;
+
+        /* The kernel reports lost broadcast messages through ENOBUFS on the next read. This turns that into
+         * a message that can be subscribed to with sd_netlink_add_match() like any other notification. */
+
+        r = message_new(rtnl, ret, NLMSG_OVERRUN);
+        if (r < 0)
+                return r;
+
+        rtnl_message_seal(*ret);
+        (*ret)->broadcast = true;
+
+        return 0;
+}
+
 int rtnl_log_parse_error(int r) {
         return log_error_errno(r, "Failed to parse netlink message: %m");
 }
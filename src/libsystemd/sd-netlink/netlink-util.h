@@ -10,9 +10,22 @@
 #include "util.h"
 
 int rtnl_message_new_synthetic_error(sd_netlink *rtnl, int error, uint32_t serial, sd_netlink_message **ret);
+int rtnl_message_new_synthetic_overrun(sd_netlink *rtnl, sd_netlink_message **ret);
 uint32_t rtnl_message_get_serial(sd_netlink_message *m);
 void rtnl_message_seal(sd_netlink_message *m);
 
+/* Use as _cleanup_(netlink_batch_endp) sd_netlink *batch = netlink_batch_begin(nl); to batch all messages sent
+ * in the current scope. Failures are reported to the reply callbacks of the messages, hence they are ignored here. */
+static inline sd_netlink *netlink_batch_begin(sd_netlink *nl) {
+        (void) sd_netlink_batch_begin(nl);
+        return nl;
+}
+
+static inline void netlink_batch_endp(sd_netlink **nl) {
+        if (*nl)
+                (void) sd_netlink_batch_end(*nl);
+}
+
 static inline bool rtnl_message_type_is_neigh(uint16_t type) {
         return IN_SET(type, RTM_NEWNEIGH, RTM_GETNEIGH, RTM_DELNEIGH);
 }
@@ -25,6 +38,10 @@ static inline bool rtnl_message_type_is_nexthop(uint16_t type) {
         return IN_SET(type, RTM_NEWNEXTHOP, RTM_GETNEXTHOP, RTM_DELNEXTHOP);
 }
 
+static inline bool rtnl_message_type_is_stats(uint16_t type) {
+        return IN_SET(type, RTM_NEWSTATS, RTM_GETSTATS);
+}
+
 static inline bool rtnl_message_type_is_link(uint16_t type) {
         return IN_SET(type,
                       RTM_NEWLINK, RTM_SETLINK, RTM_GETLINK, RTM_DELLINK,
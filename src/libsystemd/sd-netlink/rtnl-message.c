@@ -3,6 +3,7 @@
 #include <netinet/in.h>
 #include <linux/if_addrlabel.h>
 #include <linux/if_bridge.h>
+#include <linux/if_link.h>
 #include <linux/nexthop.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -350,6 +351,41 @@ int sd_rtnl_message_nexthop_get_family(const sd_netlink_message *m, uint8_t *fam
         return 0;
 }
 
+int sd_rtnl_message_new_stats(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t nlmsg_type, int ifindex, uint32_t filter_mask) {
+        struct if_stats_msg *ifsm;
+        int r;
+
+        assert_return(rtnl_message_type_is_stats(nlmsg_type), -EINVAL);
+        assert_return(ifindex >= 0, -EINVAL);
+        assert_return(filter_mask != 0, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        r = message_new(rtnl, ret, nlmsg_type);
+        if (r < 0)
+                return r;
+
+        ifsm = NLMSG_DATA((*ret)->hdr);
+        ifsm->family = AF_UNSPEC;
+        ifsm->ifindex = ifindex;
+        ifsm->filter_mask = filter_mask;
+
+        return 0;
+}
+
+int sd_rtnl_message_stats_get_ifindex(const sd_netlink_message *m, int *ifindex) {
+        struct if_stats_msg *ifsm;
+
+        assert_return(m, -EINVAL);
+        assert_return(m->hdr, -EINVAL);
+        assert_return(rtnl_message_type_is_stats(m->hdr->nlmsg_type), -EINVAL);
+        assert_return(ifindex, -EINVAL);
+
+        ifsm = NLMSG_DATA(m->hdr);
+        *ifindex = ifsm->ifindex;
+
+        return 0;
+}
+
 int sd_rtnl_message_neigh_set_flags(sd_netlink_message *m, uint8_t flags) {
         struct ndmsg *ndm;
 
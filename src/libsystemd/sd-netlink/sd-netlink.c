@@ -168,6 +168,10 @@ static sd_netlink *netlink_free(sd_netlink *rtnl) {
 
         free(rtnl->rbuffer);
 
+        for (i = 0; i < rtnl->wqueue_size; i++)
+                sd_netlink_message_unref(rtnl->wqueue[i]);
+        free(rtnl->wqueue);
+
         while ((s = rtnl->slots)) {
                 assert(s->floating);
                 netlink_slot_disconnect(s, true);
@@ -205,26 +209,161 @@ static void rtnl_seal_message(sd_netlink *rtnl, sd_netlink_message *m) {
         return;
 }
 
+static int wqueue_fail_message(sd_netlink *nl, sd_netlink_message *m, int error) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *reply = NULL;
+        int r;
+
+        assert(nl);
+        assert(m);
+        assert(error < 0);
+
+        /* The caller has been told that the message was sent already, hence report the failure the same way the
+         * kernel would, i.e. through an error reply that is dispatched to the reply callback or sd_netlink_call(). */
+
+        r = rtnl_message_new_synthetic_error(nl, error, rtnl_message_get_serial(m), &reply);
+        if (r < 0)
+                return r;
+
+        r = rtnl_rqueue_make_room(nl);
+        if (r < 0)
+                return r;
+
+        nl->rqueue[nl->rqueue_size++] = TAKE_PTR(reply);
+        return 0;
+}
+
+static int wqueue_flush(sd_netlink *nl) {
+        unsigned i;
+        int r;
+
+        assert(nl);
+
+        if (nl->wqueue_size == 0)
+                return 0;
+
+        r = socket_writev_message(nl, nl->wqueue, nl->wqueue_size);
+        if (r == -EMSGSIZE && nl->wqueue_size > 1) {
+                /* The send buffer is too small for the whole batch, fall back to sending the messages one by one */
+                r = 0;
+                for (i = 0; i < nl->wqueue_size; i++) {
+                        int k;
+
+                        k = socket_write_message(nl, nl->wqueue[i]);
+                        if (k < 0) {
+                                if (r >= 0)
+                                        r = k;
+
+                                k = wqueue_fail_message(nl, nl->wqueue[i], k);
+                                if (k < 0)
+                                        log_debug_errno(k, "sd-netlink: failed to queue error reply, ignoring: %m");
+                        }
+                }
+        } else if (r < 0)
+                for (i = 0; i < nl->wqueue_size; i++) {
+                        int k;
+
+                        k = wqueue_fail_message(nl, nl->wqueue[i], r);
+                        if (k < 0)
+                                log_debug_errno(k, "sd-netlink: failed to queue error reply, ignoring: %m");
+                }
+
+        for (i = 0; i < nl->wqueue_size; i++)
+                sd_netlink_message_unref(nl->wqueue[i]);
+        nl->wqueue_size = 0;
+        nl->wqueue_bytes = 0;
+
+        return r < 0 ? r : 0;
+}
+
+static int wqueue_push(sd_netlink *nl, sd_netlink_message *m) {
+        int r;
+
+        assert(nl);
+        assert(m);
+
+        if (nl->wqueue_size >= RTNL_WQUEUE_MAX ||
+            nl->wqueue_bytes + m->hdr->nlmsg_len > RTNL_WQUEUE_BYTES_MAX) {
+                /* Errors are reported to the reply callbacks of the affected messages */
+                r = wqueue_flush(nl);
+                if (r < 0)
+                        log_debug_errno(r, "sd-netlink: failed to send batched messages: %m");
+        }
+
+        if (!GREEDY_REALLOC(nl->wqueue, nl->wqueue_allocated, nl->wqueue_size + 1))
+                return -ENOMEM;
+
+        nl->wqueue[nl->wqueue_size++] = sd_netlink_message_ref(m);
+        nl->wqueue_bytes += m->hdr->nlmsg_len;
+
+        return 0;
+}
+
+static int netlink_send(sd_netlink *nl, sd_netlink_message *message, bool batch, uint32_t *serial) {
+        int r;
+
+        assert(nl);
+        assert(message);
+
+        rtnl_seal_message(nl, message);
+
+        /* Dump requests are not batched, as the kernel refuses to start a dump while another one is running
+         * on the same socket. */
+        if (batch && !FLAGS_SET(message->hdr->nlmsg_flags, NLM_F_DUMP)) {
+                r = wqueue_push(nl, message);
+                if (r < 0)
+                        return r;
+        } else {
+                /* Keep the ordering of messages */
+                r = wqueue_flush(nl);
+                if (r < 0)
+                        log_debug_errno(r, "sd-netlink: failed to send batched messages: %m");
+
+                r = socket_write_message(nl, message);
+                if (r < 0)
+                        return r;
+        }
+
+        if (serial)
+                *serial = rtnl_message_get_serial(message);
+
+        return 1;
+}
+
 int sd_netlink_send(sd_netlink *nl,
                     sd_netlink_message *message,
                     uint32_t *serial) {
-        int r;
 
         assert_return(nl, -EINVAL);
         assert_return(!rtnl_pid_changed(nl), -ECHILD);
         assert_return(message, -EINVAL);
         assert_return(!message->sealed, -EPERM);
 
-        rtnl_seal_message(nl, message);
+        return netlink_send(nl, message, nl->n_batch > 0, serial);
+}
 
-        r = socket_write_message(nl, message);
-        if (r < 0)
-                return r;
+int sd_netlink_batch_begin(sd_netlink *nl) {
+        assert_return(nl, -EINVAL);
+        assert_return(!rtnl_pid_changed(nl), -ECHILD);
 
-        if (serial)
-                *serial = rtnl_message_get_serial(message);
+        /* Messages sent until the matching sd_netlink_batch_end() are queued, and written to the kernel in as few
+         * sendmsg() calls as possible. Batches may be nested, the messages are flushed when the outermost one
+         * ends. */
 
-        return 1;
+        nl->n_batch++;
+        return 0;
+}
+
+int sd_netlink_batch_end(sd_netlink *nl) {
+        assert_return(nl, -EINVAL);
+        assert_return(!rtnl_pid_changed(nl), -ECHILD);
+        assert_return(nl->n_batch > 0, -ENXIO);
+
+        if (--nl->n_batch > 0)
+                return 0;
+
+        /* Errors are also reported to the reply callbacks of the affected messages, hence callers may ignore
+         * the return value. */
+        return wqueue_flush(nl);
 }
 
 int rtnl_rqueue_make_room(sd_netlink *rtnl) {
@@ -256,6 +395,32 @@ int rtnl_rqueue_partial_make_room(sd_netlink *rtnl) {
         return 0;
 }
 
+static int rqueue_push_overrun(sd_netlink *rtnl) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int r;
+
+        assert(rtnl);
+
+        log_debug("sd-netlink: receive buffer overrun, some messages were lost.");
+
+        /* Queue a single NLMSG_OVERRUN message for the matches, no matter how often we overran until it is
+         * dispatched. */
+        for (unsigned i = 0; i < rtnl->rqueue_size; i++)
+                if (rtnl->rqueue[i]->hdr->nlmsg_type == NLMSG_OVERRUN)
+                        return 0;
+
+        r = rtnl_message_new_synthetic_overrun(rtnl, &m);
+        if (r < 0)
+                return r;
+
+        r = rtnl_rqueue_make_room(rtnl);
+        if (r < 0)
+                return r;
+
+        rtnl->rqueue[rtnl->rqueue_size++] = TAKE_PTR(m);
+        return 0;
+}
+
 static int dispatch_rqueue(sd_netlink *rtnl, sd_netlink_message **message) {
         int r;
 
@@ -265,11 +430,13 @@ static int dispatch_rqueue(sd_netlink *rtnl, sd_netlink_message **message) {
         if (rtnl->rqueue_size <= 0) {
                 /* Try to read a new message */
                 r = socket_read_message(rtnl);
-                if (r == -ENOBUFS) { /* FIXME: ignore buffer overruns for now */
-                        log_debug_errno(r, "Got ENOBUFS from netlink socket, ignoring.");
-                        return 1;
-                }
-                if (r <= 0)
+                if (r == -ENOBUFS) {
+                        r = rqueue_push_overrun(rtnl);
+                        if (r < 0)
+                                log_debug_errno(r, "sd-netlink: failed to queue overrun message, ignoring: %m");
+                        if (rtnl->rqueue_size <= 0)
+                                return 1;
+                } else if (r <= 0)
                         return r;
         }
 
@@ -598,8 +765,10 @@ int sd_netlink_call(sd_netlink *rtnl,
         assert_return(rtnl, -EINVAL);
         assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
         assert_return(message, -EINVAL);
+        assert_return(!message->sealed, -EPERM);
 
-        r = sd_netlink_send(rtnl, message, &serial);
+        /* We are going to wait for the reply, hence never queue the message */
+        r = netlink_send(rtnl, message, false, &serial);
         if (r < 0)
                 return r;
 
@@ -646,6 +815,9 @@ int sd_netlink_call(sd_netlink *rtnl,
                 }
 
                 r = socket_read_message(rtnl);
+                if (r == -ENOBUFS)
+                        /* The reply might have been lost, but let the matches know in any case */
+                        (void) rqueue_push_overrun(rtnl);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -738,6 +910,11 @@ static int prepare_callback(sd_event_source *s, void *userdata) {
         assert(s);
         assert(rtnl);
 
+        /* Don't let messages linger in an unterminated batch while we go to sleep */
+        r = wqueue_flush(rtnl);
+        if (r < 0)
+                log_debug_errno(r, "sd-netlink: failed to send batched messages: %m");
+
         e = sd_netlink_get_events(rtnl);
         if (e < 0)
                 return e;
@@ -904,6 +1081,10 @@ int sd_netlink_add_match(
                                 return r;
                 break;
 
+                case NLMSG_OVERRUN:
+                        /* Synthesized locally when the receive buffer overran, see rqueue_push_overrun() */
+                        break;
+
                 default:
                         return -EOPNOTSUPP;
         }
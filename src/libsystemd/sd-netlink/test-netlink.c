@@ -3,12 +3,14 @@
 #include <net/if.h>
 #include <netinet/ether.h>
 #include <linux/genetlink.h>
+#include <linux/if_link.h>
 
 #include "sd-netlink.h"
 
 #include "alloc-util.h"
 #include "ether-addr-util.h"
 #include "macro.h"
+#include "netlink-internal.h"
 #include "netlink-util.h"
 #include "socket-util.h"
 #include "stdio-util.h"
@@ -423,6 +425,99 @@ static void test_pipe(int ifindex) {
         assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
 }
 
+static int batch_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
+        unsigned *counter = userdata;
+
+        assert_se(sd_netlink_message_get_errno(m) == -ENODEV);
+
+        (*counter)--;
+
+        return 1;
+}
+
+static void test_batch(int ifindex) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *r = NULL;
+        const char *str;
+        unsigned counter = 0, i;
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+        /* Make room for all the replies, they are only read once the batch is sent */
+        (void) sd_netlink_inc_rcvbuf(rtnl, 1024 * 1024);
+
+        assert_se(sd_netlink_batch_end(rtnl) == -ENXIO);
+
+        assert_se(sd_netlink_batch_begin(rtnl) >= 0);
+        assert_se(sd_netlink_batch_begin(rtnl) >= 0);
+
+        /* More messages than fit into a single write, each of them gets its own reply */
+        for (i = 0; i < 300; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *q = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &q, RTM_GETLINK, INT_MAX - 1) >= 0);
+
+                counter++;
+                assert_se(sd_netlink_call_async(rtnl, NULL, q, batch_handler, NULL, &counter, 0, NULL) >= 0);
+        }
+
+        /* Synchronous calls are not held back by the batch */
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, &r) == 1);
+        assert_se(sd_netlink_message_read_string(r, IFLA_IFNAME, &str) >= 0);
+        assert_se(streq(str, "lo"));
+
+        assert_se(sd_netlink_batch_end(rtnl) == 0);
+        assert_se(sd_netlink_batch_end(rtnl) == 0);
+
+        while (counter > 0) {
+                assert_se(sd_netlink_wait(rtnl, 0) >= 0);
+                assert_se(sd_netlink_process(rtnl, NULL) >= 0);
+        }
+
+        assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
+}
+
+static void test_lazy_parse(sd_netlink *rtnl, int ifindex) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *r = NULL;
+        const char *str;
+        uint32_t mtu;
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, &r) == 1);
+
+        /* The attributes of received messages are only indexed when they are first looked at */
+        assert_se(r->hdr_embedded);
+        assert_se(r->parse_pending);
+        assert_se(!r->containers[0].attributes);
+
+        assert_se(sd_netlink_message_read_string(r, IFLA_IFNAME, &str) >= 0);
+        assert_se(streq(str, "lo"));
+        assert_se(!r->parse_pending);
+        assert_se(r->containers[0].attributes);
+        assert_se(sd_netlink_message_read_u32(r, IFLA_MTU, &mtu) >= 0);
+
+        assert_se(sd_netlink_message_rewind(r, NULL) >= 0);
+        assert_se(sd_netlink_message_read_string(r, IFLA_IFNAME, &str) >= 0);
+        assert_se(streq(str, "lo"));
+}
+
+static void test_stats(sd_netlink *rtnl, int ifindex) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *r = NULL;
+        struct rtnl_link_stats64 stats;
+        uint16_t type;
+        int i;
+
+        assert_se(sd_rtnl_message_new_stats(rtnl, &m, RTM_GETSTATS, ifindex, IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64)) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, &r) == 1);
+
+        assert_se(sd_netlink_message_get_type(r, &type) >= 0);
+        assert_se(type == RTM_NEWSTATS);
+        assert_se(sd_rtnl_message_stats_get_ifindex(r, &i) >= 0);
+        assert_se(i == ifindex);
+        assert_se(sd_netlink_message_read(r, IFLA_STATS_LINK_64, sizeof stats, &stats) >= 0);
+        assert_se(sd_netlink_message_read(r, IFLA_STATS_LINK_XSTATS, sizeof stats, &stats) < 0);
+}
+
 static void test_container(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         uint16_t u16_data;
@@ -607,6 +702,9 @@ int main(void) {
         test_slot_set(if_loopback);
         test_async_destroy_callback(if_loopback);
         test_pipe(if_loopback);
+        test_batch(if_loopback);
+        test_lazy_parse(rtnl, if_loopback);
+        test_stats(rtnl, if_loopback);
         test_event_loop(if_loopback);
         test_link_configure(rtnl, if_loopback);
 
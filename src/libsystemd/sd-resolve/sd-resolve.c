@@ -22,22 +22,34 @@
 #include "list.h"
 #include "memory-util.h"
 #include "missing_syscall.h"
+#include "parse-util.h"
 #include "process-util.h"
 #include "resolve-private.h"
 #include "socket-util.h"
 
 #define WORKERS_MIN 1U
-#define WORKERS_MAX 16U
+#define WORKERS_MAX_DEFAULT 64U
 #define QUERIES_MAX 256U
 #define BUFSIZE 10240U
 
+/* There's no point in having more workers than queries, hence that's the largest limit that may be configured */
+#define WORKERS_MAX QUERIES_MAX
+
+/* How many workers to keep around when no query is outstanding anymore */
+#define WORKERS_IDLE 4U
+
+/* How many responses to process per wakeup of the event loop, at most */
+#define RESPONSES_PER_WAKEUP_MAX 64U
+
 typedef enum {
         REQUEST_ADDRINFO,
         RESPONSE_ADDRINFO,
         REQUEST_NAMEINFO,
         RESPONSE_NAMEINFO,
         REQUEST_TERMINATE,
-        RESPONSE_DIED
+        RESPONSE_DIED,
+        REQUEST_RETIRE,
+        RESPONSE_RETIRED,
 } QueryType;
 
 enum {
@@ -57,7 +69,7 @@ struct sd_resolve {
         int fds[_FD_MAX];
 
         pthread_t workers[WORKERS_MAX];
-        unsigned n_valid_workers;
+        unsigned n_valid_workers, n_retiring_workers, workers_max;
 
         unsigned current_id;
         sd_resolve_query* query_array[QUERIES_MAX];
@@ -150,12 +162,18 @@ typedef struct NameInfoResponse {
         int _h_errno;
 } NameInfoResponse;
 
+typedef struct RetiredResponse {
+        struct RHeader header;
+        pthread_t thread;
+} RetiredResponse;
+
 typedef union Packet {
         RHeader rheader;
         AddrInfoRequest addrinfo_request;
         AddrInfoResponse addrinfo_response;
         NameInfoRequest nameinfo_request;
         NameInfoResponse nameinfo_response;
+        RetiredResponse retired_response;
 } Packet;
 
 static int getaddrinfo_done(sd_resolve_query* q);
@@ -188,6 +206,21 @@ static int send_died(int out_fd) {
         return 0;
 }
 
+static int send_retired(int out_fd) {
+        RetiredResponse resp = {
+                .header.type = RESPONSE_RETIRED,
+                .header.length = sizeof(RetiredResponse),
+                .thread = pthread_self(),
+        };
+
+        assert(out_fd >= 0);
+
+        if (send(out_fd, &resp, resp.header.length, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 0;
+}
+
 static void *serialize_addrinfo(void *p, const struct addrinfo *ai, size_t *length, size_t maxlength) {
         AddrInfoSerialization s;
         size_t cnl, l;
@@ -396,6 +429,10 @@ static int handle_request(int out_fd, const Packet *packet, size_t length) {
                  /* Quit */
                  return -ECONNRESET;
 
+        case REQUEST_RETIRE:
+                 /* Quit, but this is no reason to consider the resolver dead */
+                 return 0;
+
         default:
                 assert_not_reached("Unknown request");
         }
@@ -428,6 +465,11 @@ static void* thread_worker(void *p) {
 
                 if (handle_request(resolve->fds[RESPONSE_SEND_FD], &buf.packet, (size_t) length) < 0)
                         break;
+
+                if (buf.packet.rheader.type == REQUEST_RETIRE) {
+                        (void) send_retired(resolve->fds[RESPONSE_SEND_FD]);
+                        return NULL;
+                }
         }
 
         send_died(resolve->fds[RESPONSE_SEND_FD]);
@@ -449,9 +491,12 @@ static int start_threads(sd_resolve *resolve, unsigned extra) {
                 return -r;
 
         n = resolve->n_outstanding + extra;
-        n = CLAMP(n, WORKERS_MIN, WORKERS_MAX);
+        n = CLAMP(n, WORKERS_MIN, resolve->workers_max);
 
-        while (resolve->n_valid_workers < n) {
+        /* Workers that were asked to retire still occupy their slot until they are gone, but they don't pick up
+         * any more queries */
+        while (resolve->n_valid_workers - resolve->n_retiring_workers < n &&
+               resolve->n_valid_workers < WORKERS_MAX) {
                 r = pthread_create(&resolve->workers[resolve->n_valid_workers], NULL, thread_worker, resolve);
                 if (r > 0) {
                         r = -r;
@@ -471,6 +516,48 @@ finish:
         return r;
 }
 
+static void retire_threads(sd_resolve *resolve) {
+        RHeader req = {
+                .type = REQUEST_RETIRE,
+                .length = sizeof req,
+        };
+
+        assert(resolve);
+
+        /* Once no query is outstanding anymore, ask the workers started for a burst of queries to exit. A few are
+         * kept, so that we don't start new threads all the time when queries come in one after the other. */
+
+        if (resolve->n_outstanding > 0)
+                return;
+
+        while (resolve->n_valid_workers - resolve->n_retiring_workers > WORKERS_IDLE) {
+                if (send(resolve->fds[REQUEST_SEND_FD], &req, req.length, MSG_NOSIGNAL) < 0)
+                        return;
+
+                resolve->n_retiring_workers++;
+        }
+}
+
+static void reap_thread(sd_resolve *resolve, pthread_t thread) {
+        unsigned i;
+
+        assert(resolve);
+
+        for (i = 0; i < resolve->n_valid_workers; i++)
+                if (pthread_equal(resolve->workers[i], thread))
+                        break;
+        if (i >= resolve->n_valid_workers)
+                return;
+
+        /* The thread exits right after sending the response, hence this doesn't block for long */
+        (void) pthread_join(thread, NULL);
+
+        resolve->workers[i] = resolve->workers[--resolve->n_valid_workers];
+
+        assert(resolve->n_retiring_workers > 0);
+        resolve->n_retiring_workers--;
+}
+
 static bool resolve_pid_changed(sd_resolve *r) {
         assert(r);
 
@@ -482,6 +569,8 @@ static bool resolve_pid_changed(sd_resolve *r) {
 
 _public_ int sd_resolve_new(sd_resolve **ret) {
         _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        const char *e;
+        unsigned k;
         int i;
 
         assert_return(ret, -EINVAL);
@@ -492,6 +581,11 @@ _public_ int sd_resolve_new(sd_resolve **ret) {
 
         resolve->n_ref = 1;
         resolve->original_pid = getpid_cached();
+        resolve->workers_max = WORKERS_MAX_DEFAULT;
+
+        e = secure_getenv("SYSTEMD_RESOLVE_WORKERS_MAX");
+        if (e && safe_atou(e, &k) >= 0)
+                resolve->workers_max = CLAMP(k, WORKERS_MIN, WORKERS_MAX);
 
         for (i = 0; i < _FD_MAX; i++)
                 resolve->fds[i] = -1;
@@ -613,7 +707,8 @@ _public_ int sd_resolve_get_events(sd_resolve *resolve) {
         assert_return(resolve, -EINVAL);
         assert_return(!resolve_pid_changed(resolve), -ECHILD);
 
-        return resolve->n_queries > resolve->n_done ? POLLIN : 0;
+        /* Retired workers need to be joined too, once they are gone */
+        return resolve->n_queries > resolve->n_done || resolve->n_retiring_workers > 0 ? POLLIN : 0;
 }
 
 _public_ int sd_resolve_get_timeout(sd_resolve *resolve, uint64_t *usec) {
@@ -748,9 +843,18 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
                 return 0;
         }
 
+        if (resp->type == RESPONSE_RETIRED) {
+                assert_return(length >= sizeof(RetiredResponse), -EBADMSG);
+
+                reap_thread(resolve, packet->retired_response.thread);
+                return 0;
+        }
+
         assert(resolve->n_outstanding > 0);
         resolve->n_outstanding--;
 
+        retire_threads(resolve);
+
         q = lookup_query(resolve, resp->id);
         if (!q)
                 return 0;
@@ -1241,9 +1345,17 @@ static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userd
 
         assert(resolve);
 
-        r = sd_resolve_process(resolve);
-        if (r < 0)
-                return r;
+        RESOLVE_DONT_DESTROY(resolve);
+
+        /* When many lookups are in flight, several responses are usually queued by the time we get here.
+         * Process them in one go, instead of going through the event loop once for each. */
+        for (unsigned i = 0; i < RESPONSES_PER_WAKEUP_MAX; i++) {
+                r = sd_resolve_process(resolve);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+        }
 
         return 1;
 }
@@ -3,12 +3,17 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <resolv.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "sd-resolve.h"
 
 #include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "macro.h"
 #include "socket-util.h"
 #include "string-util.h"
@@ -50,6 +55,65 @@ static int getnameinfo_handler(sd_resolve_query *q, int ret, const char *host, c
         return 0;
 }
 
+static unsigned n_threads(void) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        assert_se(d = opendir("/proc/self/task"));
+        FOREACH_DIRENT(de, d, assert_not_reached("readdir() failed"))
+                n++;
+
+        return n;
+}
+
+static int numeric_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        unsigned *n_done = userdata;
+
+        assert_se(ret == 0);
+        assert_se(ai);
+        assert_se(ai->ai_family == AF_INET);
+
+        (*n_done)++;
+        return 0;
+}
+
+static void test_workers(void) {
+        _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        static const struct addrinfo hints = {
+                .ai_family = AF_INET,
+                .ai_socktype = SOCK_STREAM,
+                .ai_flags = AI_NUMERICHOST,
+        };
+        unsigned i, n_done = 0, n_before;
+
+        log_info("/* %s */", __func__);
+
+        n_before = n_threads();
+
+        assert_se(setenv("SYSTEMD_RESOLVE_WORKERS_MAX", "8", true) >= 0);
+        assert_se(sd_resolve_new(&resolve) >= 0);
+        assert_se(unsetenv("SYSTEMD_RESOLVE_WORKERS_MAX") >= 0);
+
+        /* Numeric lookups don't need the network, so this works everywhere */
+        for (i = 0; i < 100; i++)
+                assert_se(sd_resolve_getaddrinfo(resolve, NULL, "127.0.0.1", NULL, &hints, numeric_handler, &n_done) >= 0);
+
+        assert_se(n_threads() <= n_before + 8);
+
+        while (n_done < 100)
+                assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+
+        /* Workers beyond the few that are kept around retire once nothing is outstanding anymore */
+        while (sd_resolve_get_events(resolve) != 0) {
+                assert_se(fd_wait_for_event(sd_resolve_get_fd(resolve), POLLIN, TEST_TIMEOUT_USEC) > 0);
+                assert_se(sd_resolve_process(resolve) >= 0);
+        }
+
+        log_info("%u threads left", n_threads() - n_before);
+        assert_se(n_threads() <= n_before + 4);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q1 = NULL, *q2 = NULL;
         _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
@@ -66,6 +130,8 @@ int main(int argc, char *argv[]) {
                 .sin_port = htons(80)
         };
 
+        test_workers();
+
         assert_se(sd_resolve_default(&resolve) >= 0);
 
         /* Test a floating resolver query */
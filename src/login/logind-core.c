@@ -16,13 +16,16 @@
 #include "efi-loader.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "limits-util.h"
+#include "memory-util.h"
 #include "logind.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "tmpfile-util.h"
 #include "udev-util.h"
 #include "user-util.h"
 #include "userdb.h"
@@ -841,3 +844,45 @@ int manager_read_efi_boot_loader_entries(Manager *m) {
         return 0;
 #endif
 }
+
+int logind_write_state_file(const char *path, const char *contents, size_t size) {
+        _cleanup_free_ char *old = NULL, *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t old_size;
+        int r;
+
+        assert(path);
+        assert(contents || size == 0);
+
+        /* sd-login clients watch the state directories with inotify and parse the files again on every
+         * change, hence don't replace a file if its contents would remain the same anyway. Returns 0 if
+         * the file was left as it is, 1 if it was replaced. */
+
+        if (read_full_file(path, &old, &old_size) >= 0 &&
+            old_size == size &&
+            memcmp_safe(old, contents, size) == 0)
+                return 0;
+
+        r = fopen_temporary(path, &f, &temp_path);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(contents, 1, size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 1;
+
+fail:
+        (void) unlink(temp_path);
+        return r;
+}
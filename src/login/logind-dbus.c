@@ -948,6 +948,8 @@ static int method_create_session(sd_bus_message *message, void *userdata, sd_bus
         if (r < 0)
                 goto fail;
 
+        session->create_usec = now(CLOCK_MONOTONIC);
+
         r = session_start(session, message, error);
         if (r < 0)
                 goto fail;
@@ -3806,6 +3808,7 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
         if (session) {
                 if (streq_ptr(path, session->scope_job)) {
                         session->scope_job = mfree(session->scope_job);
+                        session->scope_job_done_usec = now(CLOCK_MONOTONIC);
                         (void) session_jobs_reply(session, id, unit, result);
 
                         session_save(session);
@@ -3819,6 +3822,7 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
         if (user) {
                 if (streq_ptr(path, user->service_job)) {
                         user->service_job = mfree(user->service_job);
+                        user->service_job_done_usec = now(CLOCK_MONOTONIC);
 
                         LIST_FOREACH(sessions_by_user, session, user->sessions)
                                 (void) session_jobs_reply(session, id, unit, NULL /* don't propagate user service failures to the client */);
@@ -22,6 +22,7 @@
 #include "signal-util.h"
 #include "stat-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "user-util.h"
 #include "util.h"
 
@@ -776,6 +777,30 @@ static bool session_ready(Session *s) {
                 !s->user->service_job;
 }
 
+static void session_log_create_latency(Session *s) {
+        char total[FORMAT_TIMESPAN_MAX], scope[FORMAT_TIMESPAN_MAX], service[FORMAT_TIMESPAN_MAX];
+        usec_t n;
+
+        assert(s);
+
+        if (s->create_usec == 0)
+                return;
+
+        /* Break down where the time until we reply to CreateSession() was spent. The jobs for the session
+         * scope and the user service run in parallel, hence the phases overlap. If the user service was
+         * already running when the session was created there's no job to wait for. */
+
+        n = now(CLOCK_MONOTONIC);
+
+        log_debug("Session %s created in %s (scope unit %s, user service %s).",
+                  s->id,
+                  format_timespan(total, sizeof(total), usec_sub_unsigned(n, s->create_usec), USEC_PER_MSEC),
+                  s->scope_job_done_usec >= s->create_usec ?
+                  format_timespan(scope, sizeof(scope), s->scope_job_done_usec - s->create_usec, USEC_PER_MSEC) : "n/a",
+                  s->user->service_job_done_usec >= s->create_usec ?
+                  format_timespan(service, sizeof(service), s->user->service_job_done_usec - s->create_usec, USEC_PER_MSEC) : "already running");
+}
+
 int session_send_create_reply(Session *s, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *c = NULL;
         _cleanup_close_ int fifo_fd = -1;
@@ -803,6 +828,8 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
         /* Update the session state file before we notify the client about the result. */
         session_save(s);
 
+        session_log_create_latency(s);
+
         p = session_bus_path(s);
         if (!p)
                 return -ENOMEM;
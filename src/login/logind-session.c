@@ -34,7 +34,6 @@
 #include "string-table.h"
 #include "strv.h"
 #include "terminal-util.h"
-#include "tmpfile-util.h"
 #include "user-util.h"
 #include "util.h"
 
@@ -199,8 +198,9 @@ static void session_save_devices(Session *s, FILE *f) {
 }
 
 int session_save(Session *s) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
         int r;
 
         assert(s);
@@ -215,11 +215,11 @@ int session_save(Session *s) {
         if (r < 0)
                 goto fail;
 
-        r = fopen_temporary(s->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream_unlocked(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        (void) fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -341,19 +341,15 @@ int session_save(Session *s) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, s->state_file) < 0) {
-                r = -errno;
+        r = logind_write_state_file(s->state_file, data, size);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(s->state_file);
 
-        if (temp_path)
-                (void) unlink(temp_path);
-
         return log_error_errno(r, "Failed to save session data %s: %m", s->state_file);
 }
 
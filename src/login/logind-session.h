@@ -108,6 +108,10 @@ struct Session {
 
         sd_bus_message *create_message;
 
+        /* When CreateSession() was called and when the scope job finished, for logging login latency */
+        usec_t create_usec;
+        usec_t scope_job_done_usec;
+
         /* Set up when a client requested to release the session via the bus */
         sd_event_source *timer_event_source;
 
@@ -30,7 +30,6 @@
 #include "stdio-util.h"
 #include "string-table.h"
 #include "strv.h"
-#include "tmpfile-util.h"
 #include "unit-name.h"
 #include "user-util.h"
 #include "util.h"
@@ -139,8 +138,9 @@ User *user_free(User *u) {
 }
 
 static int user_save_internal(User *u) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
         int r;
 
         assert(u);
@@ -150,11 +150,11 @@ static int user_save_internal(User *u) {
         if (r < 0)
                 goto fail;
 
-        r = fopen_temporary(u->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream_unlocked(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        (void) fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -277,19 +277,15 @@ static int user_save_internal(User *u) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, u->state_file) < 0) {
-                r = -errno;
+        r = logind_write_state_file(u->state_file, data, size);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(u->state_file);
 
-        if (temp_path)
-                (void) unlink(temp_path);
-
         return log_error_errno(r, "Failed to save user data %s: %m", u->state_file);
 }
 
@@ -32,6 +32,7 @@ struct User {
         char *runtime_dir_service;       /* user-runtime-dir@UID.service */
 
         char *service_job;
+        usec_t service_job_done_usec;  /* When the last start job for user@UID.service finished */
 
         Session *display;
 
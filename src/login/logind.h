@@ -179,3 +179,5 @@ int manager_setup_wall_message_timer(Manager *m);
 bool logind_wall_tty_filter(const char *tty, void *userdata);
 
 int manager_read_efi_boot_loader_entries(Manager *m);
+
+int logind_write_state_file(const char *path, const char *contents, size_t size);
@@ -40,6 +40,7 @@
 #include "stdio-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "user-util.h"
 #include "userdb.h"
 
@@ -674,6 +675,7 @@ _public_ PAM_EXTERN int pam_sm_open_session(
         _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
         int session_fd = -1, existing, r;
         bool debug = false, remote;
+        usec_t call_usec = 0;
         uint32_t vtnr = 0;
         uid_t original_uid;
 
@@ -862,6 +864,9 @@ _public_ PAM_EXTERN int pam_sm_open_session(
         if (r < 0)
                 return pam_bus_log_create_error(handle, r);
 
+        if (debug)
+                call_usec = now(CLOCK_MONOTONIC);
+
         r = sd_bus_call(bus, m, LOGIN_SLOW_BUS_CALL_TIMEOUT_USEC, &error, &reply);
         if (r < 0) {
                 if (sd_bus_error_has_name(&error, BUS_ERROR_SESSION_BUSY)) {
@@ -889,10 +894,14 @@ _public_ PAM_EXTERN int pam_sm_open_session(
         if (r < 0)
                 return pam_bus_log_parse_error(handle, r);
 
-        if (debug)
-                pam_syslog(handle, LOG_DEBUG, "Reply from logind: "
+        if (debug) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                pam_syslog(handle, LOG_DEBUG, "Reply from logind after %s: "
                            "id=%s object_path=%s runtime_path=%s session_fd=%d seat=%s vtnr=%u original_uid=%u",
+                           format_timespan(ts, sizeof(ts), usec_sub_unsigned(now(CLOCK_MONOTONIC), call_usec), USEC_PER_MSEC),
                            id, object_path, runtime_path, session_fd, seat, vtnr, original_uid);
+        }
 
         r = update_environment(handle, "XDG_SESSION_ID", id);
         if (r != PAM_SUCCESS)
@@ -19,6 +19,7 @@
 #include "hashmap.h"
 #include "machine-dbus.h"
 #include "machine.h"
+#include "memory-util.h"
 #include "mkdir.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -105,9 +106,49 @@ Machine* machine_free(Machine *m) {
         return mfree(m);
 }
 
+static int machine_write_state_file(const char *path, const char *contents, size_t size) {
+        _cleanup_free_ char *old = NULL, *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t old_size;
+        int r;
+
+        assert(path);
+
+        /* The state is saved a couple of times while a machine is registered, often without any change in
+         * between. Don't replace the file then, that's just needless work when many machines come and go. */
+        if (read_full_file(path, &old, &old_size) >= 0 &&
+            old_size == size &&
+            memcmp_safe(old, contents, size) == 0)
+                return 0;
+
+        r = fopen_temporary(path, &f, &temp_path);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(contents, 1, size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, path) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 1;
+
+fail:
+        (void) unlink(temp_path);
+        return r;
+}
+
 int machine_save(Machine *m) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
         int r;
 
         assert(m);
@@ -122,11 +163,11 @@ int machine_save(Machine *m) {
         if (r < 0)
                 goto fail;
 
-        r = fopen_temporary(m->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream_unlocked(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        (void) fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -205,12 +246,11 @@ int machine_save(Machine *m) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, m->state_file) < 0) {
-                r = -errno;
+        r = machine_write_state_file(m->state_file, data, size);
+        if (r < 0)
                 goto fail;
-        }
 
-        if (m->unit) {
+        if (r > 0 && m->unit) {
                 char *sl;
 
                 /* Create a symlink from the unit name to the machine
@@ -225,9 +265,6 @@ int machine_save(Machine *m) {
 fail:
         (void) unlink(m->state_file);
 
-        if (temp_path)
-                (void) unlink(temp_path);
-
         return log_error_errno(r, "Failed to save machine data %s: %m", m->state_file);
 }
 
@@ -48,6 +48,8 @@ struct Address {
         bool autojoin:1;
         AddressFamily duplicate_address_detection;
 
+        uint64_t generation; /* the last resynchronization with the kernel the address was seen in */
+
         /* Called when address become ready */
         address_ready_callback_t callback;
 
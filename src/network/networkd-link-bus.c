@@ -34,7 +34,6 @@ static int property_get_bit_rates(
                 sd_bus_error *error) {
 
         Link *link = userdata;
-        Manager *manager;
         double interval_sec;
         uint64_t tx, rx;
 
@@ -42,15 +41,14 @@ static int property_get_bit_rates(
         assert(reply);
         assert(userdata);
 
-        manager = link->manager;
+        /* Served from the last two samples the speed meter took, this never talks to the kernel. */
 
-        if (!manager->use_speed_meter ||
-            manager->speed_meter_usec_old == 0 ||
+        if (!link->manager->use_speed_meter ||
             !link->stats_updated)
                 return sd_bus_message_append(reply, "(tt)", UINT64_MAX, UINT64_MAX);
 
-        assert(manager->speed_meter_usec_new > manager->speed_meter_usec_old);
-        interval_sec = (manager->speed_meter_usec_new - manager->speed_meter_usec_old) / USEC_PER_SEC;
+        assert(link->stats_usec_new > link->stats_usec_old);
+        interval_sec = (double) (link->stats_usec_new - link->stats_usec_old) / USEC_PER_SEC;
 
         if (link->stats_new.tx_bytes > link->stats_old.tx_bytes)
                 tx = (uint64_t) ((link->stats_new.tx_bytes - link->stats_old.tx_bytes) / interval_sec);
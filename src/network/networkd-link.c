@@ -744,6 +744,7 @@ static Link *link_free(Link *link) {
         link_free_engines(link);
         free(link->lease_file);
         free(link->lldp_file);
+        free(link->lldp_file_data);
 
         free(link->ifname);
         strv_free(link->alternative_names);
@@ -753,6 +754,7 @@ static Link *link_free(Link *link) {
 
         (void) unlink(link->state_file);
         free(link->state_file);
+        free(link->state_file_data);
 
         sd_device_unref(link->sd_device);
 
@@ -990,11 +992,14 @@ static int nexthop_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link)
 }
 
 static int link_request_set_nexthop(Link *link) {
+        _cleanup_(netlink_batch_endp) sd_netlink *batch = NULL;
         NextHop *nh;
         int r;
 
         link->static_nexthops_configured = false;
 
+        batch = netlink_batch_begin(link->manager->rtnl);
+
         LIST_FOREACH(nexthops, nh, link->network->static_nexthops) {
                 r = nexthop_configure(nh, link, nexthop_handler);
                 if (r < 0)
@@ -1049,6 +1054,7 @@ int link_request_set_routes(Link *link) {
                 PHASE_GATEWAY,     /* Second phase: Routes with a gateway */
                 _PHASE_MAX
         } phase;
+        _cleanup_(netlink_batch_endp) sd_netlink *batch = NULL;
         Route *rt;
         int r;
 
@@ -1066,6 +1072,10 @@ int link_request_set_routes(Link *link) {
                  * the addresses now, let's not configure the routes either. */
                 return 0;
 
+        /* Send all rules and routes to the kernel in as few writes as possible. Replies are dispatched to the
+         * handlers one by one as usual. */
+        batch = netlink_batch_begin(link->manager->rtnl);
+
         r = link_request_set_routing_policy_rule(link);
         if (r < 0)
                 return r;
@@ -1382,6 +1392,7 @@ static int static_address_configure(Address *address, Link *link, bool update) {
 }
 
 static int link_request_set_addresses(Link *link) {
+        _cleanup_(netlink_batch_endp) sd_netlink *batch = NULL;
         AddressLabel *label;
         Address *ad;
         Prefix *p;
@@ -1406,6 +1417,8 @@ static int link_request_set_addresses(Link *link) {
         link->static_nexthops_configured = false;
         link->routing_policy_rules_configured = false;
 
+        batch = netlink_batch_begin(link->manager->rtnl);
+
         r = link_set_bridge_fdb(link);
         if (r < 0)
                 return r;
@@ -4325,8 +4338,9 @@ static void serialize_addresses(
 
 int link_save(Link *link) {
         const char *admin_state, *oper_state, *carrier_state, *address_state;
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         Route *route;
         Address *a;
         int r;
@@ -4338,6 +4352,7 @@ int link_save(Link *link) {
 
         if (link->state == LINK_STATE_LINGER) {
                 (void) unlink(link->state_file);
+                link->state_file_data = mfree(link->state_file_data);
                 return 0;
         }
 
@@ -4355,11 +4370,11 @@ int link_save(Link *link) {
         address_state = link_address_state_to_string(link->address_state);
         assert(address_state);
 
-        r = fopen_temporary(link->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream_unlocked(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        (void) fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -4622,17 +4637,17 @@ int link_save(Link *link) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, link->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = state_file_update(link->state_file, data, &link->state_file_data);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(link->state_file);
-        if (temp_path)
-                (void) unlink(temp_path);
+        link->state_file_data = mfree(link->state_file_data);
 
         return log_link_error_errno(link, r, "Failed to save link data to %s: %m", link->state_file);
 }
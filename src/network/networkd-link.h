@@ -52,6 +52,7 @@ typedef struct Link {
         char *kind;
         unsigned short iftype;
         char *state_file;
+        char *state_file_data; /* what was last written to state_file */
         struct ether_addr mac;
         struct ether_addr permanent_mac;
         struct in6_addr ipv6ll_address;
@@ -67,6 +68,8 @@ typedef struct Link {
         unsigned flags;
         uint8_t kernel_operstate;
 
+        uint64_t generation; /* the last resynchronization with the kernel the link was seen in */
+
         Network *network;
 
         LinkState state;
@@ -160,6 +163,8 @@ typedef struct Link {
         /* This is about LLDP reception */
         sd_lldp *lldp;
         char *lldp_file;
+        void *lldp_file_data; /* what was last written to lldp_file */
+        size_t lldp_file_size;
 
         /* This is about LLDP transmission */
         unsigned lldp_tx_fast; /* The LLDP txFast counter (See 802.1ab-2009, section 9.2.5.18) */
@@ -171,7 +176,10 @@ typedef struct Link {
 
         /* For speed meter */
         struct rtnl_link_stats64 stats_old, stats_new;
+        usec_t stats_usec_old, stats_usec_new;
+        unsigned stats_backoff, stats_skip;
         bool stats_updated;
+        bool stats_pending;
 
         /* All kinds of DNS configuration the user configured via D-Bus */
         struct in_addr_full **dns;
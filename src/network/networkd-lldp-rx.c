@@ -6,6 +6,7 @@
 
 #include "fd-util.h"
 #include "fileio.h"
+#include "memory-util.h"
 #include "networkd-link.h"
 #include "networkd-lldp-rx.h"
 #include "networkd-lldp-tx.h"
@@ -52,7 +53,10 @@ static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n
 
         assert(link);
 
-        (void) link_lldp_save(link);
+        /* A refresh only restarts the TTL of a neighbor whose data did not change, hence there's nothing new
+         * to save. Chatty peers send those all the time. */
+        if (event != SD_LLDP_EVENT_REFRESHED)
+                (void) link_lldp_save(link);
 
         if (link_lldp_emit_enabled(link) && event == SD_LLDP_EVENT_ADDED) {
                 /* If we received information about a new neighbor, restart the LLDP "fast" logic */
@@ -87,6 +91,12 @@ int link_lldp_rx_configure(Link *link) {
         if (r < 0)
                 return r;
 
+        if (link->network->lldp_neighbors_max > 0) {
+                r = sd_lldp_set_neighbors_max(link->lldp, link->network->lldp_neighbors_max);
+                if (r < 0)
+                        return r;
+        }
+
         r = sd_lldp_attach_event(link->lldp, NULL, 0);
         if (r < 0)
                 return r;
@@ -128,9 +138,10 @@ int link_update_lldp(Link *link) {
 }
 
 int link_lldp_save(Link *link) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *temp_path = NULL, *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         sd_lldp_neighbor **l = NULL;
+        size_t size = 0;
         int n = 0, r, i;
 
         assert(link);
@@ -138,6 +149,8 @@ int link_lldp_save(Link *link) {
 
         if (!link->lldp) {
                 (void) unlink(link->lldp_file);
+                link->lldp_file_data = mfree(link->lldp_file_data);
+                link->lldp_file_size = 0;
                 return 0;
         }
 
@@ -146,16 +159,18 @@ int link_lldp_save(Link *link) {
                 goto finish;
         if (r == 0) {
                 (void) unlink(link->lldp_file);
+                link->lldp_file_data = mfree(link->lldp_file_data);
+                link->lldp_file_size = 0;
                 goto finish;
         }
 
         n = r;
 
-        r = fopen_temporary(link->lldp_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream_unlocked(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto finish;
-
-        fchmod(fileno(f), 0644);
+        }
 
         for (i = 0; i < n; i++) {
                 const void *p;
@@ -171,6 +186,24 @@ int link_lldp_save(Link *link) {
                 (void) fwrite(p, 1, sz, f);
         }
 
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto finish;
+
+        f = safe_fclose(f);
+
+        /* Don't wake up readers of the file if the set of neighbors did not change */
+        if (link->lldp_file_data && memcmp_nn(link->lldp_file_data, link->lldp_file_size, data, size) == 0)
+                goto finish;
+
+        r = fopen_temporary(link->lldp_file, &f, &temp_path);
+        if (r < 0)
+                goto finish;
+
+        (void) fchmod(fileno(f), 0644);
+
+        (void) fwrite(data, 1, size, f);
+
         r = fflush_and_check(f);
         if (r < 0)
                 goto finish;
@@ -180,12 +213,18 @@ int link_lldp_save(Link *link) {
                 goto finish;
         }
 
+        free_and_replace(link->lldp_file_data, data);
+        link->lldp_file_size = size;
+
 finish:
         if (r < 0) {
                 (void) unlink(link->lldp_file);
                 if (temp_path)
                         (void) unlink(temp_path);
 
+                link->lldp_file_data = mfree(link->lldp_file_data);
+                link->lldp_file_size = 0;
+
                 log_link_error_errno(link, r, "Failed to save LLDP data to %s: %m", link->lldp_file);
         }
 
@@ -45,6 +45,9 @@
 /* use 128 MB for receive socket kernel queue. */
 #define RCVBUF_SIZE    (128*1024*1024)
 
+/* How long to wait after a receive buffer overrun before resynchronizing with the kernel */
+#define RTNL_RESYNC_DELAY_USEC (1 * USEC_PER_SEC)
+
 static int log_message_warning_errno(sd_netlink_message *m, int err, const char *msg) {
         const char *err_msg = NULL;
 
@@ -524,13 +527,16 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         case RTM_NEWROUTE:
                 if (!route && link->manager->manage_foreign_routes) {
                         /* A route appeared that we did not request */
-                        r = route_add_foreign(link, tmp, &route);
+                        r = route_add_foreign_consume(link, TAKE_PTR(tmp), &route);
                         if (r < 0) {
                                 log_link_warning_errno(link, r, "Failed to remember foreign route, ignoring: %m");
                                 return 0;
                         }
                 }
 
+                if (route)
+                        route->generation = m->rtnl_generation;
+
                 break;
 
         case RTM_DELROUTE:
@@ -861,6 +867,8 @@ int manager_rtnl_process_address(sd_netlink *rtnl, sd_netlink_message *message,
                                                valid_str ? "for " : "forever", strempty(valid_str));
                 }
 
+                address->generation = m->rtnl_generation;
+
                 /* address_update() logs internally, so we don't need to here. */
                 r = address_update(address, flags, scope, &cinfo);
                 if (r < 0)
@@ -955,6 +963,8 @@ static int manager_rtnl_process_link(sd_netlink *rtnl, sd_netlink_message *messa
                         }
                 }
 
+                link->generation = m->rtnl_generation;
+
                 r = link_update(link, message);
                 if (r < 0) {
                         log_warning_errno(r, "Could not process link message, ignoring: %m");
@@ -1328,6 +1338,43 @@ int manager_rtnl_process_nexthop(sd_netlink *rtnl, sd_netlink_message *message,
         return 1;
 }
 
+static int on_rtnl_resync(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        (void) manager_rtnl_resync(m);
+        return 0;
+}
+
+static int manager_rtnl_process_overrun(sd_netlink *rtnl, sd_netlink_message *message, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        /* The receive buffer overran, hence we missed notifications and our view of links, addresses and
+         * routes may be outdated. Instead of resetting everything, dump the state from the kernel again and
+         * reconcile it with ours. Wait a bit first, as overruns tend to come in bursts. */
+
+        if (m->rtnl_resync_event_source) {
+                r = sd_event_source_get_enabled(m->rtnl_resync_event_source, NULL);
+                if (r > 0)
+                        return 0; /* already pending */
+
+                r = sd_event_source_set_time_relative(m->rtnl_resync_event_source, RTNL_RESYNC_DELAY_USEC);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->rtnl_resync_event_source, SD_EVENT_ONESHOT);
+        } else
+                r = sd_event_add_time_relative(m->event, &m->rtnl_resync_event_source, clock_boottime_or_monotonic(),
+                                               RTNL_RESYNC_DELAY_USEC, 0, on_rtnl_resync, m);
+        if (r < 0)
+                return log_warning_errno(r, "rtnl: Lost notifications, but failed to schedule resynchronization, ignoring: %m");
+
+        log_notice("rtnl: Kernel receive buffer overrun, notifications were lost. Resynchronizing state with the kernel.");
+        return 0;
+}
+
 static int systemd_netlink_fd(void) {
         int n, fd, rtnl_fd = -EINVAL;
 
@@ -1441,6 +1488,10 @@ static int manager_connect_rtnl(Manager *m) {
         if (r < 0)
                 return r;
 
+        r = sd_netlink_add_match(m->rtnl, NULL, NLMSG_OVERRUN, &manager_rtnl_process_overrun, NULL, m, "network-rtnl_process_overrun");
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
@@ -1530,9 +1581,10 @@ static int manager_save(Manager *m) {
         LinkOperationalState operstate = LINK_OPERSTATE_OFF;
         LinkCarrierState carrier_state = LINK_CARRIER_STATE_OFF;
         LinkAddressState address_state = LINK_ADDRESS_STATE_OFF;
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_strv_free_ char **p = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         Link *link;
         int r;
 
@@ -1667,11 +1719,9 @@ static int manager_save(Manager *m) {
         address_state_str = link_address_state_to_string(address_state);
         assert(address_state_str);
 
-        r = fopen_temporary(m->state_file, &f, &temp_path);
-        if (r < 0)
-                return r;
-
-        (void) fchmod(fileno(f), 0644);
+        f = open_memstream_unlocked(&data, &size);
+        if (!f)
+                return -ENOMEM;
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -1694,10 +1744,11 @@ static int manager_save(Manager *m) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, m->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = state_file_update(m->state_file, data, &m->state_file_data);
+        if (r < 0)
                 goto fail;
-        }
 
         if (m->operational_state != operstate) {
                 m->operational_state = operstate;
@@ -1729,22 +1780,65 @@ static int manager_save(Manager *m) {
 
 fail:
         (void) unlink(m->state_file);
-        (void) unlink(temp_path);
+        m->state_file_data = mfree(m->state_file_data);
 
         return log_error_errno(r, "Failed to save network state to %s: %m", m->state_file);
 }
 
-static int manager_dirty_handler(sd_event_source *s, void *userdata) {
-        Manager *m = userdata;
+void manager_save_dirty(Manager *m) {
         Link *link;
 
         assert(m);
 
+        if (m->save_state_event_source)
+                (void) sd_event_source_set_enabled(m->save_state_event_source, SD_EVENT_OFF);
+
         if (m->dirty)
                 manager_save(m);
 
         SET_FOREACH(link, m->dirty_links)
                 (void) link_save_and_clean(link);
+}
+
+static int on_save_state(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        manager_save_dirty(m);
+        return 0;
+}
+
+static int manager_dirty_handler(sd_event_source *s, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        if (!m->dirty && set_isempty(m->dirty_links))
+                return 1;
+
+        if (m->save_state_delay_usec == 0) {
+                manager_save_dirty(m);
+                return 1;
+        }
+
+        /* Coalesce the changes of the next SaveStateDelaySec= into a single write of each state file. */
+        if (m->save_state_event_source) {
+                r = sd_event_source_get_enabled(m->save_state_event_source, NULL);
+                if (r > 0)
+                        return 1; /* already pending */
+
+                r = sd_event_source_set_time_relative(m->save_state_event_source, m->save_state_delay_usec);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->save_state_event_source, SD_EVENT_ONESHOT);
+        } else
+                r = sd_event_add_time_relative(m->event, &m->save_state_event_source, clock_boottime_or_monotonic(),
+                                               m->save_state_delay_usec, 0, on_save_state, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to delay saving state, saving it immediately: %m");
+                manager_save_dirty(m);
+        }
 
         return 1;
 }
@@ -1845,6 +1939,7 @@ void manager_free(Manager *m) {
                 return;
 
         free(m->state_file);
+        free(m->state_file_data);
 
         HASHMAP_FOREACH(link, m->links)
                 (void) link_stop_clients(link, true);
@@ -1875,6 +1970,8 @@ void manager_free(Manager *m) {
         sd_resolve_unref(m->resolve);
 
         sd_event_source_unref(m->speed_meter_event_source);
+        sd_event_source_unref(m->rtnl_resync_event_source);
+        sd_event_source_unref(m->save_state_event_source);
         sd_event_unref(m->event);
 
         sd_device_monitor_unref(m->device_monitor);
@@ -2075,6 +2172,108 @@ int manager_rtnl_enumerate_routes(Manager *m) {
         return r;
 }
 
+int manager_rtnl_resync(Manager *m) {
+        unsigned n_links = 0, n_addresses = 0, n_routes = 0;
+        bool links_ok, addresses_ok, routes_ok;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t start;
+        Link *link;
+        int r;
+
+        assert(m);
+
+        /* Everything we get told about by the kernel from now on is stamped with the new generation. Whatever
+         * isn't after the dumps has been removed while we weren't listening. */
+        start = now(CLOCK_MONOTONIC);
+        m->rtnl_generation++;
+
+        r = manager_rtnl_enumerate_links(m);
+        if (r < 0)
+                log_warning_errno(r, "rtnl: Could not enumerate links, ignoring: %m");
+        links_ok = r >= 0;
+
+        r = manager_rtnl_enumerate_addresses(m);
+        if (r < 0)
+                log_warning_errno(r, "rtnl: Could not enumerate addresses, ignoring: %m");
+        addresses_ok = r >= 0;
+
+        r = manager_rtnl_enumerate_routes(m);
+        if (r < 0)
+                log_warning_errno(r, "rtnl: Could not enumerate routes, ignoring: %m");
+        routes_ok = r >= 0 && m->manage_foreign_routes;
+
+        /* These are only dumped again, they are not tracked well enough to detect removals. */
+        r = manager_rtnl_enumerate_neighbors(m);
+        if (r < 0)
+                log_warning_errno(r, "rtnl: Could not enumerate neighbors, ignoring: %m");
+
+        r = manager_rtnl_enumerate_rules(m);
+        if (r < 0)
+                log_warning_errno(r, "rtnl: Could not enumerate routing policy rules, ignoring: %m");
+
+        r = manager_rtnl_enumerate_nexthop(m);
+        if (r < 0)
+                log_warning_errno(r, "rtnl: Could not enumerate nexthops, ignoring: %m");
+
+        HASHMAP_FOREACH(link, m->links) {
+                Address *address;
+                Route *route;
+
+                if (link->state == LINK_STATE_LINGER)
+                        continue;
+
+                if (links_ok && link->generation != m->rtnl_generation) {
+                        NetDev *netdev;
+
+                        log_link_debug(link, "Link vanished while notifications were lost, dropping.");
+
+                        if (netdev_get(m, link->ifname, &netdev) >= 0 && netdev->ifindex == link->ifindex)
+                                netdev_drop(netdev);
+
+                        link_drop(link);
+                        n_links++;
+                        continue;
+                }
+
+                if (addresses_ok) {
+                        SET_FOREACH(address, link->addresses)
+                                if (address->generation != m->rtnl_generation) {
+                                        (void) address_drop(address);
+                                        n_addresses++;
+                                }
+
+                        SET_FOREACH(address, link->addresses_foreign)
+                                if (address->generation != m->rtnl_generation) {
+                                        (void) address_drop(address);
+                                        n_addresses++;
+                                }
+                }
+
+                if (routes_ok) {
+                        /* Routes without an outgoing interface are not attributed to links when they are
+                         * received, hence they never get stamped. */
+                        SET_FOREACH(route, link->routes)
+                                if (route->generation != m->rtnl_generation &&
+                                    !IN_SET(route->type, RTN_UNREACHABLE, RTN_PROHIBIT, RTN_BLACKHOLE, RTN_THROW)) {
+                                        route_free(route);
+                                        n_routes++;
+                                }
+
+                        SET_FOREACH(route, link->routes_foreign)
+                                if (route->generation != m->rtnl_generation) {
+                                        route_free(route);
+                                        n_routes++;
+                                }
+                }
+        }
+
+        log_info("rtnl: Resynchronized with the kernel in %s, forgot %u links, %u addresses and %u routes that vanished meanwhile.",
+                 format_timespan(buf, sizeof(buf), usec_sub_unsigned(now(CLOCK_MONOTONIC), start), USEC_PER_MSEC),
+                 n_links, n_addresses, n_routes);
+
+        return 0;
+}
+
 int manager_rtnl_enumerate_rules(Manager *m) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
         sd_netlink_message *rule;
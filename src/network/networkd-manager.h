@@ -34,8 +34,11 @@ struct Manager {
         bool manage_foreign_routes;
 
         Set *dirty_links;
+        sd_event_source *save_state_event_source;
+        usec_t save_state_delay_usec;
 
         char *state_file;
+        char *state_file_data; /* what was last written to state_file */
         LinkOperationalState operational_state;
         LinkCarrierState carrier_state;
         LinkAddressState address_state;
@@ -66,10 +69,12 @@ struct Manager {
         bool use_speed_meter;
         sd_event_source *speed_meter_event_source;
         usec_t speed_meter_interval_usec;
-        usec_t speed_meter_usec_new;
-        usec_t speed_meter_usec_old;
 
         bool dhcp4_prefix_root_cannot_set_table;
+
+        /* Resynchronization with the kernel after notifications were lost */
+        sd_event_source *rtnl_resync_event_source;
+        uint64_t rtnl_generation;
 };
 
 int manager_new(Manager **ret);
@@ -87,6 +92,7 @@ int manager_rtnl_enumerate_neighbors(Manager *m);
 int manager_rtnl_enumerate_routes(Manager *m);
 int manager_rtnl_enumerate_rules(Manager *m);
 int manager_rtnl_enumerate_nexthop(Manager *m);
+int manager_rtnl_resync(Manager *m);
 
 int manager_rtnl_process_address(sd_netlink *nl, sd_netlink_message *message, void *userdata);
 int manager_rtnl_process_neighbor(sd_netlink *nl, sd_netlink_message *message, void *userdata);
@@ -95,6 +101,7 @@ int manager_rtnl_process_rule(sd_netlink *nl, sd_netlink_message *message, void
 int manager_rtnl_process_nexthop(sd_netlink *nl, sd_netlink_message *message, void *userdata);
 
 void manager_dirty(Manager *m);
+void manager_save_dirty(Manager *m);
 
 int manager_address_pool_acquire(Manager *m, int family, unsigned prefixlen, union in_addr_union *found);
 
@@ -567,6 +567,10 @@ int network_load_one(Manager *manager, OrderedHashmap **networks, const char *fi
                 /* Ignore .network files that do not match the conditions. */
                 return 0;
 
+        r = net_match_name_prefixes(network->match_name, &network->match_name_prefixes);
+        if (r < 0)
+                return r;
+
         r = ordered_hashmap_ensure_allocated(networks, &string_hash_ops);
         if (r < 0)
                 return r;
@@ -666,6 +670,7 @@ static Network *network_free(Network *network) {
         strv_free(network->match_driver);
         strv_free(network->match_type);
         strv_free(network->match_name);
+        strv_free(network->match_name_prefixes);
         strv_free(network->match_property);
         strv_free(network->match_wlan_iftype);
         strv_free(network->match_ssid);
@@ -810,7 +815,15 @@ int network_get(Manager *manager, unsigned short iftype, sd_device *device,
         assert(manager);
         assert(ret);
 
-        ORDERED_HASHMAP_FOREACH(network, manager->networks)
+        ORDERED_HASHMAP_FOREACH(network, manager->networks) {
+                /* Rule out most .network files cheaply, before evaluating all the conditions, which needs
+                 * several lookups in the udev database each. */
+                if (ifname && !net_match_name_prefixes_test(network->match_name_prefixes, ifname, alternative_names))
+                        continue;
+
+                if (mac && network->match_mac && !set_contains(network->match_mac, mac))
+                        continue;
+
                 if (net_match_config(network->match_mac, network->match_permanent_mac,
                                      network->match_path, network->match_driver,
                                      network->match_type, network->match_name, network->match_property,
@@ -835,6 +848,7 @@ int network_get(Manager *manager, unsigned short iftype, sd_device *device,
                         *ret = network;
                         return 0;
                 }
+        }
 
         *ret = NULL;
 
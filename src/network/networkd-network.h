@@ -87,6 +87,7 @@ struct Network {
         char **match_driver;
         char **match_type;
         char **match_name;
+        char **match_name_prefixes; /* Index over match_name, see net_match_name_prefixes() */
         char **match_property;
         char **match_wlan_iftype;
         char **match_ssid;
@@ -284,6 +285,7 @@ struct Network {
         LLDPMode lldp_mode; /* LLDP reception */
         LLDPEmit lldp_emit; /* LLDP transmission */
         char *lldp_mud;    /* LLDP MUD URL */
+        unsigned lldp_neighbors_max; /* LLDP reception, 0 means the default of sd-lldp */
 
         LIST_HEAD(Address, static_addresses);
         LIST_HEAD(Route, static_routes);
@@ -145,17 +145,20 @@ void route_free(Route *route) {
         if (route->link) {
                 NDiscRoute *n;
 
-                set_remove(route->link->routes, route);
-                set_remove(route->link->routes_foreign, route);
-                set_remove(route->link->dhcp_routes, route);
-                set_remove(route->link->dhcp_routes_old, route);
-                set_remove(route->link->dhcp6_routes, route);
-                set_remove(route->link->dhcp6_routes_old, route);
-                set_remove(route->link->dhcp6_pd_routes, route);
-                set_remove(route->link->dhcp6_pd_routes_old, route);
-                SET_FOREACH(n, route->link->ndisc_routes)
-                        if (n->route == route)
-                                free(set_remove(route->link->ndisc_routes, n));
+                /* Foreign routes are not referenced from anywhere else, no need to hash the route over and
+                 * over again to look for it in the other sets. */
+                if (set_remove(route->link->routes_foreign, route) != route) {
+                        set_remove(route->link->routes, route);
+                        set_remove(route->link->dhcp_routes, route);
+                        set_remove(route->link->dhcp_routes_old, route);
+                        set_remove(route->link->dhcp6_routes, route);
+                        set_remove(route->link->dhcp6_routes_old, route);
+                        set_remove(route->link->dhcp6_pd_routes, route);
+                        set_remove(route->link->dhcp6_pd_routes_old, route);
+                        SET_FOREACH(n, route->link->ndisc_routes)
+                                if (n->route == route)
+                                        free(set_remove(route->link->ndisc_routes, n));
+                }
         }
 
         ordered_set_free_free(route->multipath_routes);
@@ -173,25 +176,16 @@ void route_hash_func(const Route *route, struct siphash *state) {
         switch (route->family) {
         case AF_INET:
         case AF_INET6:
+                /* Routes are hashed on every netlink notification, and the sets may hold full routing tables.
+                 * Hence only hash the fields that tell routes apart in practice, route_compare_func() still
+                 * looks at all of them. */
                 siphash24_compress(&route->dst_prefixlen, sizeof(route->dst_prefixlen), state);
                 siphash24_compress(&route->dst, FAMILY_ADDRESS_SIZE(route->family), state);
 
-                siphash24_compress(&route->src_prefixlen, sizeof(route->src_prefixlen), state);
-                siphash24_compress(&route->src, FAMILY_ADDRESS_SIZE(route->family), state);
-
                 siphash24_compress(&route->gw, FAMILY_ADDRESS_SIZE(route->family), state);
 
-                siphash24_compress(&route->prefsrc, FAMILY_ADDRESS_SIZE(route->family), state);
-
-                siphash24_compress(&route->tos, sizeof(route->tos), state);
                 siphash24_compress(&route->priority, sizeof(route->priority), state);
                 siphash24_compress(&route->table, sizeof(route->table), state);
-                siphash24_compress(&route->protocol, sizeof(route->protocol), state);
-                siphash24_compress(&route->scope, sizeof(route->scope), state);
-                siphash24_compress(&route->type, sizeof(route->type), state);
-
-                siphash24_compress(&route->initcwnd, sizeof(route->initcwnd), state);
-                siphash24_compress(&route->initrwnd, sizeof(route->initrwnd), state);
 
                 break;
         default:
@@ -360,8 +354,33 @@ static int route_add_internal(Link *link, Set **routes, Route *in, Route **ret)
         return 0;
 }
 
-int route_add_foreign(Link *link, Route *in, Route **ret) {
-        return route_add_internal(link, &link->routes_foreign, in, ret);
+int route_add_foreign_consume(Link *link, Route *in, Route **ret) {
+        _cleanup_(route_freep) Route *route = in;
+        int r;
+
+        assert(link);
+        assert(route);
+        assert(!route->link);
+        assert(!route->network);
+
+        /* Like route_add_internal(), but takes possession of the passed route rather than copying it, as the
+         * caller has no use for it anymore. Routes are dumped and announced by the kernel one by one, hence this
+         * saves an allocation per route. */
+
+        r = set_ensure_put(&link->routes_foreign, &route_hash_ops, route);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EEXIST;
+
+        route->link = link;
+
+        if (ret)
+                *ret = route;
+
+        TAKE_PTR(route);
+
+        return 0;
 }
 
 int route_add(Link *link, Route *in, Route **ret) {
@@ -59,6 +59,8 @@ struct Route {
         usec_t lifetime;
         sd_event_source *expire;
 
+        uint64_t generation; /* the last resynchronization with the kernel the route was seen in */
+
         LIST_FIELDS(Route, routes);
 };
 
@@ -73,7 +75,7 @@ int route_remove(Route *route, Link *link, link_netlink_message_handler_t callba
 
 int route_get(Link *link, Route *in, Route **ret);
 int route_add(Link *link, Route *in, Route **ret);
-int route_add_foreign(Link *link, Route *in, Route **ret);
+int route_add_foreign_consume(Link *link, Route *in, Route **ret);
 bool route_equal(Route *r1, Route *r2);
 
 int route_expire_handler(sd_event_source *s, uint64_t usec, void *userdata);
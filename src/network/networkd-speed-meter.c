@@ -1,50 +1,96 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <linux/if_link.h>
 
 #include "sd-event.h"
 #include "sd-netlink.h"
 
+#include "netlink-util.h"
 #include "networkd-link-bus.h"
 #include "networkd-link.h"
 #include "networkd-manager.h"
 #include "networkd-speed-meter.h"
 
-static int process_message(Manager *manager, sd_netlink_message *message) {
-        uint16_t type;
-        int ifindex, r;
-        Link *link;
+static int link_stats_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link) {
+        struct rtnl_link_stats64 stats;
+        usec_t usec_now;
+        bool changed;
+        int r;
 
-        r = sd_netlink_message_get_type(message, &type);
-        if (r < 0)
-                return r;
+        assert(m);
+        assert(link);
+
+        link->stats_pending = false;
+
+        if (IN_SET(link->state, LINK_STATE_FAILED, LINK_STATE_LINGER))
+                return 0;
+
+        r = sd_netlink_message_get_errno(m);
+        if (r < 0) {
+                if (r != -ENODEV)
+                        log_link_debug_errno(link, r, "Failed to get link statistics, ignoring: %m");
+                link->stats_updated = false;
+                return 0;
+        }
 
-        if (type != RTM_NEWLINK)
+        r = sd_netlink_message_read(m, IFLA_STATS_LINK_64, sizeof stats, &stats);
+        if (r < 0) {
+                log_link_debug_errno(link, r, "Failed to read link statistics, ignoring: %m");
+                link->stats_updated = false;
                 return 0;
+        }
 
-        r = sd_rtnl_message_link_get_ifindex(message, &ifindex);
+        r = sd_event_now(link->manager->event, CLOCK_MONOTONIC, &usec_now);
         if (r < 0)
                 return r;
 
-        link = hashmap_get(manager->links, INT_TO_PTR(ifindex));
-        if (!link)
-                return -ENODEV;
+        changed = stats.rx_bytes != link->stats_new.rx_bytes ||
+                  stats.tx_bytes != link->stats_new.tx_bytes;
 
         link->stats_old = link->stats_new;
+        link->stats_usec_old = link->stats_usec_new;
+        link->stats_new = stats;
+        link->stats_usec_new = usec_now;
+        link->stats_updated = link->stats_usec_old > 0 && link->stats_usec_new > link->stats_usec_old;
+
+        /* Links without traffic are asked less and less often, up to every SPEED_METER_MAXIMUM_BACKOFF
+         * intervals. The rate is computed from the actual time between the samples, so it stays correct. */
+        if (changed)
+                link->stats_backoff = 0;
+        else
+                link->stats_backoff = MIN(MAX(link->stats_backoff * 2, 1U), SPEED_METER_MAXIMUM_BACKOFF - 1);
+        link->stats_skip = link->stats_backoff;
 
-        r = sd_netlink_message_read(message, IFLA_STATS64, sizeof link->stats_new, &link->stats_new);
+        return 0;
+}
+
+static int link_request_stats(Link *link) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
+        int r;
+
+        assert(link);
+        assert(link->manager);
+
+        r = sd_rtnl_message_new_stats(link->manager->rtnl, &req, RTM_GETSTATS, link->ifindex,
+                                      IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64));
         if (r < 0)
                 return r;
 
-        link->stats_updated = true;
+        r = netlink_call_async(link->manager->rtnl, NULL, req, link_stats_handler,
+                               link_netlink_destroy_callback, link);
+        if (r < 0)
+                return r;
+
+        link_ref(link);
+        link->stats_pending = true;
 
         return 0;
 }
 
 static int speed_meter_handler(sd_event_source *s, uint64_t usec, void *userdata) {
-        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
+        _cleanup_(netlink_batch_endp) sd_netlink *batch = NULL;
         Manager *manager = userdata;
-        sd_netlink_message *i;
         usec_t usec_now;
         Link *link;
         int r;
@@ -60,33 +106,29 @@ static int speed_meter_handler(sd_event_source *s, uint64_t usec, void *userdata
         if (r < 0)
                 return r;
 
-        manager->speed_meter_usec_old = manager->speed_meter_usec_new;
-        manager->speed_meter_usec_new = usec_now;
+        /* Only ask for the 64bit counters of the links we manage, rather than dumping everything about
+         * every link. The requests are sent in one go and the replies are processed as they come in. */
+        batch = netlink_batch_begin(manager->rtnl);
 
-        HASHMAP_FOREACH(link, manager->links)
-                link->stats_updated = false;
+        HASHMAP_FOREACH(link, manager->links) {
+                if (!link->network || IN_SET(link->state, LINK_STATE_FAILED, LINK_STATE_LINGER)) {
+                        link->stats_updated = false;
+                        continue;
+                }
 
-        r = sd_rtnl_message_new_link(manager->rtnl, &req, RTM_GETLINK, 0);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to allocate RTM_GETLINK netlink message, ignoring: %m");
-                return 0;
-        }
+                if (link->stats_pending)
+                        continue;
 
-        r = sd_netlink_message_request_dump(req, true);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to set dump flag, ignoring: %m");
-                return 0;
-        }
+                if (link->stats_skip > 0) {
+                        link->stats_skip--;
+                        continue;
+                }
 
-        r = sd_netlink_call(manager->rtnl, req, 0, &reply);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to call RTM_GETLINK, ignoring: %m");
-                return 0;
+                r = link_request_stats(link);
+                if (r < 0)
+                        log_link_warning_errno(link, r, "Failed to request link statistics, ignoring: %m");
         }
 
-        for (i = reply; i; i = sd_netlink_message_next(i))
-                (void) process_message(manager, i);
-
         return 0;
 }
 
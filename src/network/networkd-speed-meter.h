@@ -7,6 +7,9 @@
 #define SPEED_METER_DEFAULT_TIME_INTERVAL (10 * USEC_PER_SEC)
 #define SPEED_METER_MINIMUM_TIME_INTERVAL (100 * USEC_PER_MSEC)
 
+/* Links without traffic are polled at most every 8 intervals. */
+#define SPEED_METER_MAXIMUM_BACKOFF 8U
+
 typedef struct Manager Manager;
 
 int manager_start_speed_meter(Manager *m);
@@ -2,6 +2,7 @@
 
 #include "condition.h"
 #include "conf-parser.h"
+#include "fileio.h"
 #include "networkd-util.h"
 #include "parse-util.h"
 #include "string-table.h"
@@ -116,6 +117,32 @@ int kernel_route_expiration_supported(void) {
         return cached;
 }
 
+int state_file_update(const char *path, const char *data, char **last) {
+        int r;
+
+        assert(path);
+        assert(data);
+        assert(last);
+
+        /* Every rewrite wakes up all sd-network consumers watching /run/systemd/netif/, hence skip it if
+         * nothing changed since the last time. Returns 1 if the file was written, 0 if it was up to date. */
+
+        if (streq_ptr(*last, data))
+                return 0;
+
+        r = write_string_file(path, data, WRITE_STRING_FILE_CREATE | WRITE_STRING_FILE_ATOMIC | WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0) {
+                *last = mfree(*last);
+                return r;
+        }
+
+        r = free_and_strdup(last, data);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 static void network_config_hash_func(const NetworkConfigSection *c, struct siphash *state) {
         siphash24_compress_string(c->filename, state);
         siphash24_compress(&c->line, sizeof(c->line), state);
@@ -124,6 +124,9 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return log_error_errno(r, "Event loop failed: %m");
 
+        /* Write out whatever changes SaveStateDelaySec= might still hold back */
+        manager_save_dirty(m);
+
         return 0;
 }
 
@@ -181,6 +181,29 @@ static void test_address_equality(void) {
         assert_se(!address_equal(a1, a2));
 }
 
+static void test_match_name_prefixes(void) {
+        _cleanup_strv_free_ char **prefixes = NULL;
+
+        assert_se(net_match_name_prefixes(STRV_MAKE("veth*", "vb-?", "!vethfoo", "eth0", "veth[0-9]"), &prefixes) >= 0);
+        assert_se(strv_equal(prefixes, STRV_MAKE("veth", "vb-", "eth0")));
+
+        assert_se(net_match_name_prefixes_test(prefixes, "veth1234", NULL));
+        assert_se(net_match_name_prefixes_test(prefixes, "eth0", NULL));
+        assert_se(net_match_name_prefixes_test(prefixes, "enp0s1", STRV_MAKE("vb-foo")));
+        assert_se(!net_match_name_prefixes_test(prefixes, "enp0s1", STRV_MAKE("wlan0")));
+        assert_se(!net_match_name_prefixes_test(prefixes, "eth", NULL));
+        prefixes = strv_free(prefixes);
+
+        /* Leading wildcards and negative patterns only can't be indexed */
+        assert_se(net_match_name_prefixes(STRV_MAKE("en*", "*0"), &prefixes) >= 0);
+        assert_se(!prefixes);
+        assert_se(net_match_name_prefixes(STRV_MAKE("!en*"), &prefixes) >= 0);
+        assert_se(!prefixes);
+        assert_se(net_match_name_prefixes(NULL, &prefixes) >= 0);
+        assert_se(!prefixes);
+        assert_se(net_match_name_prefixes_test(NULL, "anything", NULL));
+}
+
 static void test_dhcp_hostname_shorten_overlong(void) {
         int r;
 
@@ -237,6 +260,7 @@ int main(void) {
         test_deserialize_dhcp_routes();
         test_address_equality();
         test_dhcp_hostname_shorten_overlong();
+        test_match_name_prefixes();
 
         assert_se(manager_new(&manager) >= 0);
 
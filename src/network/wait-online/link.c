@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/stat.h>
+
 #include "sd-network.h"
 
 #include "alloc-util.h"
 #include "hashmap.h"
 #include "link.h"
 #include "manager.h"
+#include "stdio-util.h"
 #include "string-util.h"
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname) {
@@ -103,6 +106,39 @@ int link_update_rtnl(Link *l, sd_netlink_message *m) {
         return 0;
 }
 
+static int link_state_file_changed(Link *l) {
+        char path[STRLEN("/run/systemd/netif/links/") + DECIMAL_STR_MAX(int)];
+        struct stat st;
+
+        assert(l);
+
+        /* networkd replaces the state file of a link atomically whenever its contents change. Checking
+         * whether this happened is a lot cheaper than parsing the file over and over again for every link,
+         * whenever the state of any link changed. */
+
+        xsprintf(path, "/run/systemd/netif/links/%i", l->ifindex);
+
+        if (stat(path, &st) < 0) {
+                if (errno != ENOENT)
+                        return 1; /* Let the sd-network calls deal with it */
+
+                if (l->state_file_ino == 0)
+                        return 0;
+
+                l->state_file_ino = 0;
+                l->state_file_mtime = 0;
+                return 1;
+        }
+
+        if (st.st_ino == l->state_file_ino &&
+            timespec_load(&st.st_mtim) == l->state_file_mtime)
+                return 0;
+
+        l->state_file_ino = st.st_ino;
+        l->state_file_mtime = timespec_load(&st.st_mtim);
+        return 1;
+}
+
 int link_update_monitor(Link *l) {
         _cleanup_free_ char *operstate = NULL, *required_operstate = NULL, *state = NULL;
         int r, ret = 0;
@@ -110,6 +146,9 @@ int link_update_monitor(Link *l) {
         assert(l);
         assert(l->ifname);
 
+        if (link_state_file_changed(l) == 0)
+                return 0;
+
         r = sd_network_link_get_required_for_online(l->ifindex);
         if (r < 0)
                 ret = log_link_debug_errno(l, r, "Failed to determine whether the link is required for online or not, "
@@ -1,10 +1,13 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <sys/types.h>
+
 #include "sd-netlink.h"
 
 #include "log-link.h"
 #include "network-util.h"
+#include "time-util.h"
 
 typedef struct Link Link;
 typedef struct Manager Manager;
@@ -20,6 +23,12 @@ struct Link {
         LinkOperationalStateRange required_operstate;
         LinkOperationalState operational_state;
         char *state;
+
+        /* Identifies the version of /run/systemd/netif/links/<ifindex> the fields above were read from */
+        ino_t state_file_ino;
+        usec_t state_file_mtime;
+
+        usec_t online_usec; /* when the link was first found to be online */
 };
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname);
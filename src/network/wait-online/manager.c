@@ -32,6 +32,18 @@ static bool manager_ignore_link(Manager *m, Link *link) {
         return strv_fnmatch(m->ignore, link->ifname);
 }
 
+static LinkOperationalStateRange manager_link_required_operstate(Manager *m, Link *l, LinkOperationalStateRange s) {
+        if (s.min < 0)
+                s.min = m->required_operstate.min >= 0 ? m->required_operstate.min
+                                                       : l->required_operstate.min;
+
+        if (s.max < 0)
+                s.max = m->required_operstate.max >= 0 ? m->required_operstate.max
+                                                       : l->required_operstate.max;
+
+        return s;
+}
+
 static int manager_link_is_online(Manager *m, Link *l, LinkOperationalStateRange s) {
         /* This returns the following:
          * -EAGAIN: not processed by udev or networkd
@@ -46,13 +58,7 @@ static int manager_link_is_online(Manager *m, Link *l, LinkOperationalStateRange
                 return log_link_debug_errno(l, SYNTHETIC_ERRNO(EAGAIN),
                                             "link is being processed by networkd");
 
-        if (s.min < 0)
-                s.min = m->required_operstate.min >= 0 ? m->required_operstate.min
-                                                       : l->required_operstate.min;
-
-        if (s.max < 0)
-                s.max = m->required_operstate.max >= 0 ? m->required_operstate.max
-                                                       : l->required_operstate.max;
+        s = manager_link_required_operstate(m, l, s);
 
         if (l->operational_state < s.min || l->operational_state > s.max) {
                 log_link_debug(l, "Operational state '%s' is not in range ['%s':'%s']",
@@ -61,9 +67,58 @@ static int manager_link_is_online(Manager *m, Link *l, LinkOperationalStateRange
                 return 0;
         }
 
+        if (l->online_usec == 0)
+                l->online_usec = now(clock_boottime_or_monotonic());
+
         return 1;
 }
 
+static void manager_log_link(Manager *m, Link *l, LinkOperationalStateRange s) {
+        char buf[FORMAT_TIMESPAN_MAX];
+
+        s = manager_link_required_operstate(m, l, s);
+
+        if (l->online_usec > 0)
+                log_link_info(l, "Online after %s, operational state '%s' (required: '%s':'%s').",
+                              format_timespan(buf, sizeof(buf), usec_sub_unsigned(l->online_usec, m->start_usec), USEC_PER_MSEC),
+                              link_operstate_to_string(l->operational_state),
+                              link_operstate_to_string(s.min), link_operstate_to_string(s.max));
+        else
+                log_link_info(l, "Not online, setup state '%s', operational state '%s' (required: '%s':'%s').",
+                              strna(l->state),
+                              link_operstate_to_string(l->operational_state),
+                              link_operstate_to_string(s.min), link_operstate_to_string(s.max));
+}
+
+void manager_log_links(Manager *m) {
+        const char *ifname;
+        void *p;
+        Link *l;
+
+        assert(m);
+
+        /* Tell which links we waited for, and for how long, so that slow ones can be identified. */
+
+        if (!hashmap_isempty(m->interfaces)) {
+                HASHMAP_FOREACH_KEY(p, ifname, m->interfaces) {
+                        LinkOperationalStateRange *range = p;
+
+                        l = hashmap_get(m->links_by_name, ifname);
+                        if (l)
+                                manager_log_link(m, l, *range);
+                        else
+                                log_info("%s: Not found.", ifname);
+                }
+
+                return;
+        }
+
+        HASHMAP_FOREACH(l, m->links)
+                if (!manager_ignore_link(m, l))
+                        manager_log_link(m, l, (LinkOperationalStateRange) { _LINK_OPERSTATE_INVALID,
+                                                                             _LINK_OPERSTATE_INVALID });
+}
+
 bool manager_configured(Manager *m) {
         bool one_ready = false;
         const char *ifname;
@@ -261,6 +316,7 @@ static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *
 
         sd_network_monitor_flush(m->network_monitor);
 
+        /* This only parses the state files of the links that changed, see link_update_monitor(). */
         HASHMAP_FOREACH(l, m->links) {
                 r = link_update_monitor(l);
                 if (r < 0 && r != -ENODATA)
@@ -315,6 +371,7 @@ int manager_new(Manager **ret, Hashmap *interfaces, char **ignore,
                 .ignore = ignore,
                 .required_operstate = required_operstate,
                 .any = any,
+                .start_usec = now(clock_boottime_or_monotonic()),
         };
 
         r = sd_event_default(&m->event);
@@ -23,6 +23,8 @@ struct Manager {
         LinkOperationalStateRange required_operstate;
         bool any;
 
+        usec_t start_usec;
+
         sd_netlink *rtnl;
         sd_event_source *rtnl_event_source;
 
@@ -40,3 +42,4 @@ int manager_new(Manager **ret, Hashmap *interfaces, char **ignore,
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
 
 bool manager_configured(Manager *m);
+void manager_log_links(Manager *m);
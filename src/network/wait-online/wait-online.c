@@ -212,10 +212,13 @@ static int run(int argc, char *argv[]) {
                                       "STATUS=Failed to wait for network connectivity...");
 
         r = sd_event_loop(m->event);
-        if (r < 0)
+        if (r < 0) {
+                manager_log_links(m);
                 return log_error_errno(r, "Event loop failed: %m");
+        }
 
 success:
+        manager_log_links(m);
         notify_message = "STATUS=All interfaces configured...";
 
         return 0;
@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "acl-util.h"
@@ -23,26 +24,32 @@
 
 static int get_acl(int fd, const char *name, acl_type_t type, acl_t *ret) {
         char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int) + 1];
+        _cleanup_close_ int child_fd = -1;
+        const char *p = NULL, *xattr;
         acl_t acl;
 
         assert(fd >= 0);
         assert(ret);
 
         if (name) {
-                _cleanup_close_ int child_fd = -1;
-
                 child_fd = openat(fd, name, O_PATH|O_CLOEXEC|O_NOFOLLOW);
                 if (child_fd < 0)
                         return -errno;
 
                 xsprintf(procfs_path, "/proc/self/fd/%i", child_fd);
-                acl = acl_get_file(procfs_path, type);
-        } else if (type == ACL_TYPE_ACCESS)
-                acl = acl_get_fd(fd);
-        else {
+                p = procfs_path;
+        } else if (type != ACL_TYPE_ACCESS) {
                 xsprintf(procfs_path, "/proc/self/fd/%i", fd);
-                acl = acl_get_file(procfs_path, type);
+                p = procfs_path;
         }
+
+        /* Most inodes carry no ACL at all, in which case libacl would synthesize one from the access mode,
+         * which never contains any UIDs/GIDs to shift. Checking for the xattr first is much cheaper. */
+        xattr = type == ACL_TYPE_ACCESS ? "system.posix_acl_access" : "system.posix_acl_default";
+        if ((p ? getxattr(p, xattr, NULL, 0) : fgetxattr(fd, xattr, NULL, 0)) < 0)
+                return -errno;
+
+        acl = p ? acl_get_file(p, type) : acl_get_fd(fd);
         if (!acl)
                 return -errno;
 
@@ -173,27 +180,30 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
         r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
         if (r == -EOPNOTSUPP)
                 return 0;
-        if (r < 0)
+        if (r < 0 && r != -ENODATA)
                 return r;
-
-        r = shift_acl(acl, shift, &shifted);
-        if (r < 0)
-                return r;
-        if (r > 0) {
-                r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+        if (r >= 0) {
+                r = shift_acl(acl, shift, &shifted);
                 if (r < 0)
                         return r;
+                if (r > 0) {
+                        r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+                        if (r < 0)
+                                return r;
 
-                changed = true;
+                        changed = true;
+                }
         }
 
         if (S_ISDIR(st->st_mode)) {
-                acl_free(acl);
-                acl_free(shifted);
+                acl_freep(&acl);
+                acl_freep(&shifted);
 
                 acl = shifted = NULL;
 
                 r = get_acl(fd, name, ACL_TYPE_DEFAULT, &acl);
+                if (r == -ENODATA)
+                        return changed;
                 if (r < 0)
                         return r;
 
@@ -57,6 +57,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "user-util.h"
 #include "utf8.h"
 
@@ -2485,6 +2486,109 @@ static int deactivate_luks(struct crypt_device *cd, const char *node) {
         return 1;
 }
 
+static int zero_range(int fd, uint64_t offset, uint64_t size) {
+        struct stat st;
+
+        assert(fd >= 0);
+
+        /* Makes sure the specified range of a regular file or block device reads back as zeroes, without
+         * writing them out ourselves. Returns -EOPNOTSUPP if that's not possible. */
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (S_ISREG(st.st_mode)) {
+                if (fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, offset, size) < 0) {
+                        if (ERRNO_IS_NOT_SUPPORTED(errno))
+                                return -EOPNOTSUPP;
+
+                        return -errno;
+                }
+
+                return 0;
+        }
+
+        if (S_ISBLK(st.st_mode)) {
+                uint64_t range[2] = { offset, size };
+
+                if (offset % 512 != 0 || size % 512 != 0)
+                        return -EOPNOTSUPP;
+
+                if (ioctl(fd, BLKZEROOUT, range) < 0) {
+                        if (ERRNO_IS_NOT_SUPPORTED(errno))
+                                return -EOPNOTSUPP;
+
+                        return -errno;
+                }
+
+                return 0;
+        }
+
+        return -EOPNOTSUPP;
+}
+
+static int copy_blocks_sparse(int source_fd, int target_fd, uint64_t target_offset, uint64_t size) {
+        uint64_t offset = 0;
+        int r;
+
+        assert(source_fd >= 0);
+        assert(target_fd >= 0);
+
+        /* Copies the first 'size' bytes of source_fd to target_fd at target_offset. File system images usually
+         * are mostly empty, hence holes in the source are not copied, but zeroed out on the target, which
+         * typically is a lot quicker than writing out the zeroes, and keeps image files sparse. */
+
+        while (offset < size) {
+                uint64_t data, end;
+                off_t l;
+
+                l = lseek(source_fd, offset, SEEK_DATA);
+                if (l < 0 && errno == ENXIO) /* Only a hole left */
+                        data = size;
+                else if (l < 0 && (errno == EINVAL || ERRNO_IS_NOT_SUPPORTED(errno))) /* Treat it all as data */
+                        data = offset;
+                else if (l < 0)
+                        return -errno;
+                else
+                        data = MIN((uint64_t) l, size);
+
+                if (data > offset) {
+                        r = zero_range(target_fd, target_offset + offset, data - offset);
+                        if (r >= 0) {
+                                offset = data;
+                                continue;
+                        }
+                        if (r != -EOPNOTSUPP)
+                                return r;
+
+                        /* Can't zero out the range on the target, hence copy the hole like data */
+                        end = data;
+                } else {
+                        l = lseek(source_fd, offset, SEEK_HOLE);
+                        if (l < 0 && (errno == EINVAL || ERRNO_IS_NOT_SUPPORTED(errno)))
+                                end = size;
+                        else if (l < 0)
+                                return -errno;
+                        else
+                                end = MIN((uint64_t) l, size);
+                }
+
+                if (lseek(source_fd, offset, SEEK_SET) == (off_t) -1)
+                        return -errno;
+
+                if (lseek(target_fd, target_offset + offset, SEEK_SET) == (off_t) -1)
+                        return -errno;
+
+                r = copy_bytes_full(source_fd, target_fd, end - offset, 0, NULL, NULL, NULL, NULL);
+                if (r < 0)
+                        return r;
+
+                offset = end;
+        }
+
+        return 0;
+}
+
 static int context_copy_blocks(Context *context) {
         Partition *p;
         int whole_fd = -1, r;
@@ -2498,7 +2602,9 @@ static int context_copy_blocks(Context *context) {
                 _cleanup_(loop_device_unrefp) LoopDevice *d = NULL;
                 _cleanup_free_ char *encrypted = NULL;
                 _cleanup_close_ int encrypted_dev_fd = -1;
-                char buf[FORMAT_BYTES_MAX];
+                char buf[FORMAT_BYTES_MAX], ts[FORMAT_TIMESPAN_MAX];
+                uint64_t target_offset;
+                usec_t start, elapsed;
                 int target_fd;
 
                 if (p->copy_blocks_fd < 0)
@@ -2534,16 +2640,17 @@ static int context_copy_blocks(Context *context) {
                                 return log_error_errno(errno, "Failed to lock LUKS device: %m");
 
                         target_fd = encrypted_dev_fd;
+                        target_offset = 0;
                 }  else {
-                        if (lseek(whole_fd, p->offset, SEEK_SET) == (off_t) -1)
-                                return log_error_errno(errno, "Failed to seek to partition offset: %m");
-
                         target_fd = whole_fd;
+                        target_offset = p->offset;
                 }
 
                 log_info("Copying in '%s' (%s) on block level into future partition %" PRIu64 ".", p->copy_blocks_path, format_bytes(buf, sizeof(buf), p->copy_blocks_size), p->partno);
 
-                r = copy_bytes_full(p->copy_blocks_fd, target_fd, p->copy_blocks_size, 0, NULL, NULL, NULL, NULL);
+                start = now(CLOCK_MONOTONIC);
+
+                r = copy_blocks_sparse(p->copy_blocks_fd, target_fd, target_offset, p->copy_blocks_size);
                 if (r < 0)
                         return log_error_errno(r, "Failed to copy in data from '%s': %m", p->copy_blocks_path);
 
@@ -2565,7 +2672,11 @@ static int context_copy_blocks(Context *context) {
                                 return log_error_errno(r, "Failed to sync loopback device: %m");
                 }
 
-                log_info("Copying in of '%s' on block level completed.", p->copy_blocks_path);
+                elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+                log_info("Copying in of '%s' on block level completed in %s (%s/s).",
+                         p->copy_blocks_path,
+                         format_timespan(ts, sizeof(ts), elapsed, USEC_PER_MSEC),
+                         format_bytes(buf, sizeof(buf), elapsed > 0 ? p->copy_blocks_size * USEC_PER_SEC / elapsed : p->copy_blocks_size));
         }
 
         return 0;
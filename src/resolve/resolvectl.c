@@ -973,7 +973,7 @@ static int show_statistics(int argc, char **argv, void *userdata) {
         _cleanup_(table_unrefp) Table *table = NULL;
         sd_bus *bus = userdata;
         uint64_t n_current_transactions, n_total_transactions,
-                cache_size, n_cache_hit, n_cache_miss,
+                cache_size, n_cache_hit, n_cache_miss, n_cache_evicted,
                 n_dnssec_secure, n_dnssec_insecure, n_dnssec_bogus, n_dnssec_indeterminate;
         int r, dnssec_supported;
 
@@ -1013,6 +1013,10 @@ static int show_statistics(int argc, char **argv, void *userdata) {
 
         reply = sd_bus_message_unref(reply);
 
+        r = bus_get_property_trivial(bus, bus_resolve_mgr, "CacheEvictions", &error, 't', &n_cache_evicted);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cache evictions: %s", bus_error_message(&error, r));
+
         r = bus_get_property(bus, bus_resolve_mgr, "DNSSECStatistics", &error, &reply, "(tttt)");
         if (r < 0)
                 return log_error_errno(r, "Failed to get DNSSEC statistics: %s", bus_error_message(&error, r));
@@ -1052,6 +1056,8 @@ static int show_statistics(int argc, char **argv, void *userdata) {
                            TABLE_UINT64, n_cache_hit,
                            TABLE_STRING, "Cache Misses:",
                            TABLE_UINT64, n_cache_miss,
+                           TABLE_STRING, "Cache Evictions:",
+                           TABLE_UINT64, n_cache_evicted,
                            TABLE_EMPTY, TABLE_EMPTY,
                            TABLE_STRING, "DNSSEC Verdicts",
                            TABLE_SET_COLOR, ansi_highlight(),
@@ -1069,6 +1075,60 @@ static int show_statistics(int argc, char **argv, void *userdata) {
         if (r < 0)
                 table_log_add_error(r);
 
+        reply = sd_bus_message_unref(reply);
+
+        r = bus_get_property(bus, bus_resolve_mgr, "DNSServerLatency", &error, &reply, "a(isttt)");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get DNS server latency: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, 'a', "(isttt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (bool first = true;; first = false) {
+                char ifname[IF_NAMESIZE + 1], rtt_buf[FORMAT_TIMESPAN_MAX], rtt_var_buf[FORMAT_TIMESPAN_MAX];
+                uint64_t n_samples, rtt, rtt_var;
+                _cleanup_free_ char *label = NULL, *value = NULL;
+                const char *server;
+                int ifindex;
+
+                r = sd_bus_message_read(reply, "(isttt)", &ifindex, &server, &n_samples, &rtt, &rtt_var);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                if (first) {
+                        r = table_add_many(table,
+                                           TABLE_EMPTY, TABLE_EMPTY,
+                                           TABLE_STRING, "Server Round-Trip Times",
+                                           TABLE_SET_COLOR, ansi_highlight(),
+                                           TABLE_SET_ALIGN_PERCENT, 0,
+                                           TABLE_EMPTY);
+                        if (r < 0)
+                                table_log_add_error(r);
+                }
+
+                if (ifindex > 0 && format_ifname(ifindex, ifname))
+                        label = strjoin(server, " (", ifname, "):");
+                else
+                        label = strjoin(server, ":");
+                if (!label)
+                        return log_oom();
+
+                if (asprintf(&value, "%s ± %s",
+                             format_timespan(rtt_buf, sizeof(rtt_buf), rtt, USEC_PER_MSEC / 10),
+                             format_timespan(rtt_var_buf, sizeof(rtt_var_buf), rtt_var, USEC_PER_MSEC / 10)) < 0)
+                        return log_oom();
+
+                r = table_add_many(table,
+                                   TABLE_STRING, label,
+                                   TABLE_SET_ALIGN_PERCENT, 100,
+                                   TABLE_STRING, value);
+                if (r < 0)
+                        table_log_add_error(r);
+        }
+
         r = table_print(table, NULL);
         if (r < 0)
                 return table_log_print_error(r);
@@ -1544,9 +1544,34 @@ static int bus_property_get_cache_statistics(
                 miss += s->cache.n_miss;
         }
 
+        /* Stub queries answered from the stub's own cache never make it to the cache of any scope */
+        hit += m->dns_stub_cache.n_hit;
+
         return sd_bus_message_append(reply, "(ttt)", size, hit, miss);
 }
 
+static int bus_property_get_cache_evictions(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        uint64_t evicted = 0;
+        Manager *m = userdata;
+        DnsScope *s;
+
+        assert(reply);
+        assert(m);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes)
+                evicted += s->cache.n_evicted;
+
+        return sd_bus_message_append(reply, "t", evicted);
+}
+
 static int bus_property_get_dnssec_statistics(
                 sd_bus *bus,
                 const char *path,
@@ -1568,6 +1593,66 @@ static int bus_property_get_dnssec_statistics(
                                      (uint64_t) m->n_dnssec_verdict[DNSSEC_INDETERMINATE]);
 }
 
+static int bus_dns_server_latency_append(sd_bus_message *reply, DnsServer *first) {
+        DnsServer *s;
+        int r;
+
+        assert(reply);
+
+        LIST_FOREACH(servers, s, first) {
+                if (s->n_rtt_samples == 0)
+                        continue;
+
+                r = sd_bus_message_append(reply, "(isttt)",
+                                          dns_server_ifindex(s),
+                                          dns_server_string_full(s),
+                                          (uint64_t) s->n_rtt_samples,
+                                          (uint64_t) s->rtt_usec,
+                                          (uint64_t) s->rtt_var_usec);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int bus_property_get_dns_server_latency(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        Link *l;
+        int r;
+
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(isttt)");
+        if (r < 0)
+                return r;
+
+        r = bus_dns_server_latency_append(reply, m->dns_servers);
+        if (r < 0)
+                return r;
+
+        r = bus_dns_server_latency_append(reply, m->fallback_dns_servers);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(l, m->links) {
+                r = bus_dns_server_latency_append(reply, l->dns_servers);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int bus_property_get_ntas(
                 sd_bus *bus,
                 const char *path,
@@ -1610,7 +1695,8 @@ static int bus_method_reset_statistics(sd_bus_message *message, void *userdata,
         assert(m);
 
         LIST_FOREACH(scopes, s, m->dns_scopes)
-                s->cache.n_hit = s->cache.n_miss = 0;
+                s->cache.n_hit = s->cache.n_miss = s->cache.n_evicted = 0;
+        m->dns_stub_cache.n_hit = 0;
 
         m->n_transactions_total = 0;
         zero(m->n_dnssec_verdict);
@@ -1977,8 +2063,10 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_PROPERTY("Domains", "a(isb)", bus_property_get_domains, 0, 0),
         SD_BUS_PROPERTY("TransactionStatistics", "(tt)", bus_property_get_transaction_statistics, 0, 0),
         SD_BUS_PROPERTY("CacheStatistics", "(ttt)", bus_property_get_cache_statistics, 0, 0),
+        SD_BUS_PROPERTY("CacheEvictions", "t", bus_property_get_cache_evictions, 0, 0),
         SD_BUS_PROPERTY("DNSSEC", "s", bus_property_get_dnssec_mode, 0, 0),
         SD_BUS_PROPERTY("DNSSECStatistics", "(tttt)", bus_property_get_dnssec_statistics, 0, 0),
+        SD_BUS_PROPERTY("DNSServerLatency", "a(isttt)", bus_property_get_dns_server_latency, 0, 0),
         SD_BUS_PROPERTY("DNSSECSupported", "b", bus_property_get_dnssec_supported, 0, 0),
         SD_BUS_PROPERTY("DNSSECNegativeTrustAnchors", "as", bus_property_get_ntas, 0, 0),
         SD_BUS_PROPERTY("DNSStubListener", "s", bus_property_get_dns_stub_listener_mode, offsetof(Manager, dns_stub_listener_mode), 0),
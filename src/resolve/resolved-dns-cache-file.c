@@ -0,0 +1,397 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "resolved-dns-cache-file.h"
+#include "resolved-dns-packet.h"
+#include "string-util.h"
+#include "tmpfile-util.h"
+#include "unaligned.h"
+
+/* The file starts with the magic and the wallclock time it was written at, followed by any number of chunks, each
+ * made of a 32bit size and the data of a DNS packet. After the DNS header, a packet contains the name and
+ * fingerprint of the section, followed by pairs of a flags byte and a resource record, so that names may be
+ * compressed as usual. Packets are kept small enough for all names to be compressible. */
+#define CACHE_FILE_MAGIC "RSLVCCH1"
+#define CACHE_FILE_HEADER_SIZE (sizeof(CACHE_FILE_MAGIC) - 1 + sizeof(uint64_t))
+#define CACHE_FILE_CHUNK_SIZE_MAX 0x3000U
+
+#define CACHE_FILE_FLAG_AUTHENTICATED 0x01U
+
+typedef struct DnsCacheFileSection {
+        char *name;
+        uint64_t fingerprint;
+        DnsAnswer *answer;
+} DnsCacheFileSection;
+
+static DnsCacheFileSection* dns_cache_file_section_free(DnsCacheFileSection *s) {
+        if (!s)
+                return NULL;
+
+        dns_answer_unref(s->answer);
+        free(s->name);
+        return mfree(s);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsCacheFileSection*, dns_cache_file_section_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(dns_cache_file_section_hash_ops, char, string_hash_func, string_compare_func,
+                                              DnsCacheFileSection, dns_cache_file_section_free);
+
+void dns_cache_file_clear(DnsCacheFile *f) {
+        assert(f);
+
+        f->sections = hashmap_free(f->sections);
+        f->timestamp = 0;
+}
+
+int dns_cache_file_add(DnsCacheFile *f, const char *name, uint64_t fingerprint, DnsAnswer *answer) {
+        _cleanup_(dns_cache_file_section_freep) DnsCacheFileSection *s = NULL;
+        int r;
+
+        assert(f);
+        assert(name);
+
+        if (dns_answer_size(answer) <= 0)
+                return 0;
+
+        s = new(DnsCacheFileSection, 1);
+        if (!s)
+                return -ENOMEM;
+
+        *s = (DnsCacheFileSection) {
+                .name = strdup(name),
+                .fingerprint = fingerprint,
+                .answer = dns_answer_ref(answer),
+        };
+        if (!s->name)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&f->sections, &dns_cache_file_section_hash_ops);
+        if (r < 0)
+                return r;
+
+        dns_cache_file_section_free(hashmap_remove(f->sections, name));
+
+        r = hashmap_put(f->sections, s->name, s);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(s);
+        return 1;
+}
+
+static int dns_cache_file_section_answer(DnsCacheFile *f, DnsCacheFileSection *s, usec_t now_realtime, DnsAnswer **ret) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnsAnswerFlags flags;
+        DnsResourceRecord *rr;
+        uint32_t elapsed;
+        int ifindex, r;
+
+        assert(f);
+        assert(s);
+        assert(ret);
+
+        /* Returns the records of the section with the TTLs they have left at the specified time */
+
+        elapsed = (uint32_t) MIN(LESS_BY(now_realtime, f->timestamp) / USEC_PER_SEC, (usec_t) UINT32_MAX);
+
+        answer = dns_answer_new(dns_answer_size(s->answer));
+        if (!answer)
+                return -ENOMEM;
+
+        DNS_ANSWER_FOREACH_FULL(rr, ifindex, flags, s->answer) {
+                _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *copy = NULL;
+
+                if (rr->ttl <= elapsed)
+                        continue;
+
+                copy = dns_resource_record_ref(rr);
+                r = dns_resource_record_clamp_ttl(&copy, rr->ttl - elapsed);
+                if (r < 0)
+                        return r;
+
+                r = dns_answer_add(answer, copy, ifindex, flags);
+                if (r < 0)
+                        return r;
+        }
+
+        if (dns_answer_size(answer) <= 0) {
+                *ret = NULL;
+                return 0;
+        }
+
+        *ret = TAKE_PTR(answer);
+        return 1;
+}
+
+int dns_cache_file_take(DnsCacheFile *f, const char *name, uint64_t fingerprint, usec_t now_realtime, DnsAnswer **ret) {
+        _cleanup_(dns_cache_file_section_freep) DnsCacheFileSection *s = NULL;
+
+        assert(f);
+        assert(name);
+        assert(ret);
+
+        /* Removes the section and returns its records. Sections written while talking to other servers are
+         * dropped, as those may know other records for the same names. */
+
+        s = hashmap_remove(f->sections, name);
+        if (!s || s->fingerprint != fingerprint) {
+                if (s)
+                        log_debug("DNS servers of scope %s changed, not using saved cache entries.", name);
+
+                *ret = NULL;
+                return 0;
+        }
+
+        return dns_cache_file_section_answer(f, s, now_realtime, ret);
+}
+
+int dns_cache_file_merge(DnsCacheFile *f, DnsCacheFile *other) {
+        DnsCacheFileSection *s;
+        int r;
+
+        assert(f);
+        assert(other);
+
+        /* Copies the sections of the other file that this one has none for, with the TTLs adjusted to the
+         * timestamp of this one. This keeps the saved entries of scopes that didn't show up (yet). */
+
+        HASHMAP_FOREACH(s, other->sections) {
+                _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+
+                if (hashmap_contains(f->sections, s->name))
+                        continue;
+
+                r = dns_cache_file_section_answer(other, s, f->timestamp, &answer);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                r = dns_cache_file_add(f, s->name, s->fingerprint, answer);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int dns_cache_file_section_read(DnsCacheFile *f, DnsPacket *p) {
+        _cleanup_free_ char *name = NULL;
+        DnsCacheFileSection *s;
+        uint64_t fingerprint;
+        uint8_t buf[8];
+        int r;
+
+        assert(f);
+        assert(p);
+
+        dns_packet_rewind(p, DNS_PACKET_HEADER_SIZE);
+
+        r = dns_packet_read_string(p, &name, NULL);
+        if (r < 0)
+                return r;
+
+        r = dns_packet_read_blob(p, buf, sizeof(buf), NULL);
+        if (r < 0)
+                return r;
+        fingerprint = unaligned_read_le64(buf);
+
+        /* Large sections are split into several chunks */
+        s = hashmap_get(f->sections, name);
+        if (s) {
+                if (s->fingerprint != fingerprint)
+                        return -EBADMSG;
+        } else {
+                r = hashmap_ensure_allocated(&f->sections, &dns_cache_file_section_hash_ops);
+                if (r < 0)
+                        return r;
+
+                s = new(DnsCacheFileSection, 1);
+                if (!s)
+                        return -ENOMEM;
+
+                *s = (DnsCacheFileSection) {
+                        .name = TAKE_PTR(name),
+                        .fingerprint = fingerprint,
+                };
+
+                r = hashmap_put(f->sections, s->name, s);
+                if (r < 0) {
+                        dns_cache_file_section_free(s);
+                        return r;
+                }
+        }
+
+        while (p->rindex < p->size) {
+                _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+                uint8_t flags;
+
+                r = dns_packet_read_uint8(p, &flags, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_rr(p, &rr, NULL, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_answer_add_extend(&s->answer, rr, 0,
+                                          DNS_ANSWER_CACHEABLE |
+                                          (FLAGS_SET(flags, CACHE_FILE_FLAG_AUTHENTICATED) ? DNS_ANSWER_AUTHENTICATED : 0));
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int dns_cache_file_load(DnsCacheFile *f, const char *path) {
+        _cleanup_free_ char *data = NULL;
+        size_t size, offset;
+        int r;
+
+        assert(f);
+        assert(path);
+
+        dns_cache_file_clear(f);
+
+        r = read_full_file(path, &data, &size);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (size < CACHE_FILE_HEADER_SIZE ||
+            memcmp(data, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC) - 1) != 0)
+                return -EBADMSG;
+
+        f->timestamp = unaligned_read_le64(data + sizeof(CACHE_FILE_MAGIC) - 1);
+
+        for (offset = CACHE_FILE_HEADER_SIZE; offset < size; ) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+                uint32_t sz;
+
+                if (size - offset < sizeof(uint32_t)) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                sz = unaligned_read_le32(data + offset);
+                offset += sizeof(uint32_t);
+
+                if (sz < DNS_PACKET_HEADER_SIZE || sz > DNS_PACKET_SIZE_MAX || sz > size - offset) {
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                r = dns_packet_new(&p, DNS_PROTOCOL_DNS, sz, DNS_PACKET_SIZE_MAX);
+                if (r < 0)
+                        goto fail;
+
+                assert(p->allocated >= sz);
+                memcpy(DNS_PACKET_DATA(p), data + offset, sz);
+                p->size = sz;
+                offset += sz;
+
+                r = dns_cache_file_section_read(f, p);
+                if (r < 0)
+                        goto fail;
+        }
+
+        return !hashmap_isempty(f->sections);
+
+fail:
+        dns_cache_file_clear(f);
+        return r == -ENOMEM ? r : -EBADMSG;
+}
+
+static int dns_cache_file_chunk_write(FILE *out, DnsCacheFileSection *s, size_t *index) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        uint8_t buf[8];
+        int r;
+
+        assert(out);
+        assert(s);
+        assert(index);
+
+        r = dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX);
+        if (r < 0)
+                return r;
+
+        r = dns_packet_append_string(p, s->name, NULL);
+        if (r < 0)
+                return r;
+
+        unaligned_write_le64(buf, s->fingerprint);
+        r = dns_packet_append_blob(p, buf, sizeof(buf), NULL);
+        if (r < 0)
+                return r;
+
+        for (; *index < s->answer->n_rrs && p->size < CACHE_FILE_CHUNK_SIZE_MAX; (*index)++) {
+                DnsAnswerItem *item = s->answer->items + *index;
+                size_t saved_size = p->size;
+
+                r = dns_packet_append_uint8(
+                                p,
+                                FLAGS_SET(item->flags, DNS_ANSWER_AUTHENTICATED) ? CACHE_FILE_FLAG_AUTHENTICATED : 0,
+                                NULL);
+                if (r >= 0)
+                        r = dns_packet_append_rr(p, item->rr, 0, NULL, NULL);
+                if (r < 0) {
+                        /* Records we can't serialize are simply not saved */
+                        log_debug_errno(r, "Failed to serialize cache entry, skipping: %m");
+                        dns_packet_truncate(p, saved_size);
+                }
+        }
+
+        unaligned_write_le32(buf, (uint32_t) p->size);
+        if (fwrite(buf, sizeof(uint32_t), 1, out) != 1 ||
+            fwrite(DNS_PACKET_DATA(p), p->size, 1, out) != 1)
+                return errno_or_else(EIO);
+
+        return 0;
+}
+
+int dns_cache_file_save(DnsCacheFile *f, const char *path) {
+        _cleanup_(unlink_and_freep) char *temp_path = NULL;
+        _cleanup_fclose_ FILE *out = NULL;
+        DnsCacheFileSection *s;
+        uint8_t buf[8];
+        int r;
+
+        assert(f);
+        assert(path);
+
+        r = fopen_temporary(path, &out, &temp_path);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(out), 0600);
+
+        unaligned_write_le64(buf, f->timestamp);
+        if (fwrite(CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC) - 1, 1, out) != 1 ||
+            fwrite(buf, sizeof(buf), 1, out) != 1)
+                return errno_or_else(EIO);
+
+        HASHMAP_FOREACH(s, f->sections)
+                for (size_t i = 0; i < dns_answer_size(s->answer); ) {
+                        r = dns_cache_file_chunk_write(out, s, &i);
+                        if (r < 0)
+                                return r;
+                }
+
+        r = fflush_and_check(out);
+        if (r < 0)
+                return r;
+
+        if (rename(temp_path, path) < 0)
+                return -errno;
+
+        temp_path = mfree(temp_path);
+        return 0;
+}
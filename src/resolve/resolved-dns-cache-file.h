@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "hashmap.h"
+#include "time-util.h"
+
+/* Cache entries written to disk, so that they survive restarts of the daemon. Entries are kept in sections, one
+ * for each scope, identified by the name of the scope and a fingerprint of the DNS servers it talks to. The TTLs
+ * of the records are relative to the wallclock time the file was written at. */
+typedef struct DnsCacheFile {
+        Hashmap *sections;
+        usec_t timestamp;
+} DnsCacheFile;
+
+#include "resolved-dns-answer.h"
+
+void dns_cache_file_clear(DnsCacheFile *f);
+
+int dns_cache_file_add(DnsCacheFile *f, const char *name, uint64_t fingerprint, DnsAnswer *answer);
+int dns_cache_file_take(DnsCacheFile *f, const char *name, uint64_t fingerprint, usec_t now_realtime, DnsAnswer **ret);
+int dns_cache_file_merge(DnsCacheFile *f, DnsCacheFile *other);
+
+int dns_cache_file_load(DnsCacheFile *f, const char *path);
+int dns_cache_file_save(DnsCacheFile *f, const char *path);
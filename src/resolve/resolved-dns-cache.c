@@ -11,7 +11,7 @@
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
-/* Never cache more than 4K entries. RFC 1536, Section 5 suggests to
+/* Never cache more than 4K entries by default. RFC 1536, Section 5 suggests to
  * leave DNS caches unbounded, but that's crazy. */
 #define CACHE_MAX 4096
 
@@ -22,6 +22,12 @@
  * now) */
 #define CACHE_TTL_STRANGE_RCODE_USEC (30 * USEC_PER_SEC)
 
+/* Entries that were looked up at least this often are refreshed in the background once the last tenth of their
+ * lifetime has begun, so that the next lookup doesn't have to wait for the network. Entries that are valid for a
+ * few seconds only aren't worth it. */
+#define CACHE_PREFETCH_HITS_MIN 2U
+#define CACHE_PREFETCH_LIFETIME_MIN_USEC (30 * USEC_PER_SEC)
+
 typedef enum DnsCacheItemType DnsCacheItemType;
 typedef struct DnsCacheItem DnsCacheItem;
 
@@ -39,14 +45,20 @@ struct DnsCacheItem {
         int rcode;
 
         usec_t until;
+        usec_t lifetime;
         bool authenticated:1;
         bool shared_owner:1;
+        bool prefetching:1;
 
         int ifindex;
         int owner_family;
         union in_addr_union owner_address;
 
+        uint64_t last_used;
+        unsigned n_hit;
+
         unsigned prioq_idx;
+        unsigned use_idx;
         LIST_FIELDS(DnsCacheItem, by_key);
 };
 
@@ -99,6 +111,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
                 hashmap_remove(c->by_key, i->key);
 
         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        prioq_remove(c->by_use, i, &i->use_idx);
 
         dns_cache_item_free(i);
 }
@@ -133,6 +146,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
 
         LIST_FOREACH_SAFE(by_key, i, n, first) {
                 prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                prioq_remove(c->by_use, i, &i->use_idx);
                 dns_cache_item_free(i);
         }
 
@@ -149,39 +163,82 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(prioq_size(c->by_use) == 0);
 
         c->by_key = hashmap_free(c->by_key);
         c->by_expiry = prioq_free(c->by_expiry);
+        c->by_use = prioq_free(c->by_use);
+}
+
+static void dns_cache_touch(DnsCache *c, DnsCacheItem *first) {
+        DnsCacheItem *i;
+
+        assert(c);
+
+        /* Marks all items of a key as used just now. We always evict whole keys, hence all items of a key
+         * carry the same use stamp. */
+
+        c->n_use++;
+
+        LIST_FOREACH(by_key, i, first) {
+                i->last_used = c->n_use;
+                prioq_reshuffle(c->by_use, i, &i->use_idx);
+                i->n_hit++;
+        }
+}
+
+static unsigned dns_cache_size_max(DnsCache *c) {
+        assert(c);
+
+        return c->size_max > 0 ? c->size_max : CACHE_MAX;
 }
 
 static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        unsigned size_max;
+
         assert(c);
 
         if (add <= 0)
                 return;
 
-        /* Makes space for n new entries. Note that we actually allow
-         * the cache to grow beyond CACHE_MAX, but only when we shall
-         * add more RRs to the cache than CACHE_MAX at once. In that
+        size_max = dns_cache_size_max(c);
+        if (prioq_size(c->by_expiry) + add < size_max)
+                return;
+
+        /* Entries past their TTL are of no use to anyone, get rid of them first */
+        dns_cache_prune(c);
+
+        /* Makes space for n new entries by evicting the keys that
+         * were used least recently. Note that we actually allow
+         * the cache to grow beyond the limit, but only when we shall
+         * add more RRs to the cache than the limit at once. In that
          * case the cache will be emptied completely otherwise. */
 
         for (;;) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+                char key_str[DNS_RESOURCE_KEY_STRING_MAX];
                 DnsCacheItem *i;
+                unsigned n;
 
-                if (prioq_size(c->by_expiry) <= 0)
+                n = prioq_size(c->by_use);
+                if (n <= 0)
                         break;
 
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
+                if (n + add < size_max)
                         break;
 
-                i = prioq_peek(c->by_expiry);
+                i = prioq_peek(c->by_use);
                 assert(i);
 
+                log_debug("Evicting least recently used cache entry for %s",
+                          dns_resource_key_to_string(i->key, key_str, sizeof key_str));
+
                 /* Take an extra reference to the key so that it
                  * doesn't go away in the middle of the remove call */
                 key = dns_resource_key_ref(i->key);
                 dns_cache_remove_by_key(c, key);
+
+                c->n_evicted += n - prioq_size(c->by_use);
         }
 }
 
@@ -232,6 +289,12 @@ static int dns_cache_item_prioq_compare_func(const void *a, const void *b) {
         return CMP(x->until, y->until);
 }
 
+static int dns_cache_item_use_compare_func(const void *a, const void *b) {
+        const DnsCacheItem *x = a, *y = b;
+
+        return CMP(x->last_used, y->last_used);
+}
+
 static int dns_cache_init(DnsCache *c) {
         int r;
 
@@ -241,6 +304,10 @@ static int dns_cache_init(DnsCache *c) {
         if (r < 0)
                 return r;
 
+        r = prioq_ensure_allocated(&c->by_use, dns_cache_item_use_compare_func);
+        if (r < 0)
+                return r;
+
         r = hashmap_ensure_allocated(&c->by_key, &dns_resource_key_hash_ops);
         if (r < 0)
                 return r;
@@ -255,10 +322,19 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         assert(c);
         assert(i);
 
+        /* Newly added items count as used, so that they aren't the first to go */
+        i->last_used = ++c->n_use;
+
         r = prioq_put(c->by_expiry, i, &i->prioq_idx);
         if (r < 0)
                 return r;
 
+        r = prioq_put(c->by_use, i, &i->use_idx);
+        if (r < 0) {
+                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                return r;
+        }
+
         first = hashmap_get(c->by_key, i->key);
         if (first) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = NULL;
@@ -280,6 +356,7 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
                 r = hashmap_put(c->by_key, i->key, i);
                 if (r < 0) {
                         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                        prioq_remove(c->by_use, i, &i->use_idx);
                         return r;
                 }
         }
@@ -368,15 +445,23 @@ static void dns_cache_item_update_positive(
         i->key = dns_resource_key_ref(rr->key);
 
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
+        i->lifetime = i->until - timestamp;
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
 
+        /* This is a fresh copy now, hence counts as unused, and needs no refresh anymore */
+        i->n_hit = 0;
+        i->prefetching = false;
+
         i->ifindex = ifindex;
 
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
 
         prioq_reshuffle(c->by_expiry, i, &i->prioq_idx);
+
+        i->last_used = ++c->n_use;
+        prioq_reshuffle(c->by_use, i, &i->use_idx);
 }
 
 static int dns_cache_put_positive(
@@ -444,6 +529,7 @@ static int dns_cache_put_positive(
         i->key = dns_resource_key_ref(rr->key);
         i->rr = dns_resource_record_ref(rr);
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
+        i->lifetime = i->until - timestamp;
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
         i->ifindex = ifindex;
@@ -531,6 +617,7 @@ static int dns_cache_put_negative(
         i->until =
                 i->type == DNS_CACHE_RCODE ? timestamp + CACHE_TTL_STRANGE_RCODE_USEC :
                 calculate_until(soa, nsec_ttl, timestamp, true);
+        i->lifetime = i->until - timestamp;
         i->authenticated = authenticated;
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
@@ -871,6 +958,9 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 return 0;
         }
 
+        /* Whatever we make of the entry, it was useful enough to be kept for longer */
+        dns_cache_touch(c, first);
+
         LIST_FOREACH(by_key, j, first) {
                 if (j->rr) {
                         if (j->rr->key->type == DNS_TYPE_NSEC)
@@ -977,6 +1067,45 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         return n;
 }
 
+bool dns_cache_want_prefetch(DnsCache *c, DnsResourceKey *key, usec_t ts) {
+        DnsCacheItem *first, *i;
+
+        assert(c);
+        assert(key);
+
+        /* Checks whether the entry that answers lookups for the key is popular and about to expire, and hence
+         * should be refreshed from the network. Returns false if a refresh was started already. */
+
+        first = dns_cache_get_by_key_follow_cname_dname_nsec(c, key);
+        if (!first)
+                return false;
+
+        LIST_FOREACH(by_key, i, first) {
+                if (i->prefetching || i->type == DNS_CACHE_RCODE)
+                        return false;
+
+                if (i->n_hit >= CACHE_PREFETCH_HITS_MIN &&
+                    i->lifetime >= CACHE_PREFETCH_LIFETIME_MIN_USEC &&
+                    i->until <= ts + i->lifetime / 10)
+                        return true;
+        }
+
+        return false;
+}
+
+void dns_cache_mark_prefetch(DnsCache *c, DnsResourceKey *key) {
+        DnsCacheItem *i;
+
+        assert(c);
+        assert(key);
+
+        /* Remember that a refresh is underway, so that only one is started. The flag is reset when the
+         * answer replaces the items. */
+
+        LIST_FOREACH(by_key, i, dns_cache_get_by_key_follow_cname_dname_nsec(c, key))
+                i->prefetching = true;
+}
+
 int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_family, const union in_addr_union *owner_address) {
         DnsCacheItem *i, *first;
         bool same_owner = true;
@@ -1099,6 +1228,46 @@ void dns_cache_dump(DnsCache *cache, FILE *f) {
         }
 }
 
+int dns_cache_export(DnsCache *cache, DnsAnswer **ret) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnsCacheItem *i, *j;
+        usec_t t;
+        int r;
+
+        assert(cache);
+        assert(ret);
+
+        /* Returns all positive entries with the TTLs they have left. Negative entries and incomplete mDNS
+         * shared RRsets are not of much use later on, and hence skipped. */
+
+        answer = dns_answer_new(prioq_size(cache->by_expiry));
+        if (!answer)
+                return -ENOMEM;
+
+        t = now(clock_boottime_or_monotonic());
+
+        HASHMAP_FOREACH(i, cache->by_key)
+                LIST_FOREACH(by_key, j, i) {
+                        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+
+                        if (!j->rr || j->shared_owner || j->until <= t + USEC_PER_SEC)
+                                continue;
+
+                        rr = dns_resource_record_ref(j->rr);
+                        r = dns_resource_record_clamp_ttl(&rr, (j->until - t) / USEC_PER_SEC);
+                        if (r < 0)
+                                return r;
+
+                        r = dns_answer_add(answer, rr, j->ifindex,
+                                           DNS_ANSWER_CACHEABLE | (j->authenticated ? DNS_ANSWER_AUTHENTICATED : 0));
+                        if (r < 0)
+                                return r;
+                }
+
+        *ret = TAKE_PTR(answer);
+        return 0;
+}
+
 bool dns_cache_is_empty(DnsCache *cache) {
         if (!cache)
                 return true;
@@ -10,8 +10,12 @@
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+        Prioq *by_use;
+        uint64_t n_use;
+        unsigned size_max;
         unsigned n_hit;
         unsigned n_miss;
+        unsigned n_evicted;
 } DnsCache;
 
 #include "resolved-dns-answer.h"
@@ -25,9 +29,13 @@ void dns_cache_prune(DnsCache *c);
 int dns_cache_put(DnsCache *c, DnsCacheMode cache_mode, DnsResourceKey *key, int rcode, DnsAnswer *answer, bool authenticated, uint32_t nsec_ttl, usec_t timestamp, int owner_family, const union in_addr_union *owner_address);
 int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **answer, bool *authenticated);
 
+bool dns_cache_want_prefetch(DnsCache *c, DnsResourceKey *key, usec_t ts);
+void dns_cache_mark_prefetch(DnsCache *c, DnsResourceKey *key);
+
 int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_family, const union in_addr_union *owner_address);
 
 void dns_cache_dump(DnsCache *cache, FILE *f);
+int dns_cache_export(DnsCache *cache, DnsAnswer **ret);
 bool dns_cache_is_empty(DnsCache *cache);
 
 unsigned dns_cache_size(DnsCache *cache);
@@ -9,8 +9,10 @@
 #include "memory-util.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
+#include "siphash24.h"
 #include "sort-util.h"
 #include "string-table.h"
+#include "unaligned.h"
 
 #define VERIFY_RRS_MAX 256
 #define MAX_KEY_SIZE (32*1024)
@@ -21,6 +23,12 @@
 /* Maximum number of NSEC3 iterations we'll do. RFC5155 says 2500 shall be the maximum useful value */
 #define NSEC3_ITERATIONS_MAX 2500
 
+/* Maximum number of remembered signature verifications */
+#define VERIFY_CACHE_MAX 4096
+
+/* Size of the SHA256 digest identifying a verification */
+#define VERIFY_CACHE_DIGEST_SIZE 32
+
 /*
  * The DNSSEC Chain of trust:
  *
@@ -59,8 +67,177 @@ uint16_t dnssec_keytag(DnsResourceRecord *dnskey, bool mask_revoke) {
         return sum & UINT32_C(0xFFFF);
 }
 
+typedef struct DnssecVerifyCacheEntry {
+        uint8_t digest[VERIFY_CACHE_DIGEST_SIZE];
+        bool valid;
+        usec_t until;
+        unsigned prioq_idx;
+} DnssecVerifyCacheEntry;
+
+static void dnssec_verify_cache_remove(DnssecVerifyCache *c, DnssecVerifyCacheEntry *e) {
+        assert(c);
+        assert(e);
+
+        assert_se(hashmap_remove(c->by_digest, e->digest) == e);
+        prioq_remove(c->by_expiry, e, &e->prioq_idx);
+        free(e);
+}
+
+void dnssec_verify_cache_flush(DnssecVerifyCache *c) {
+        DnssecVerifyCacheEntry *e;
+
+        assert(c);
+
+        while ((e = hashmap_first(c->by_digest)))
+                dnssec_verify_cache_remove(c, e);
+
+        c->by_digest = hashmap_free(c->by_digest);
+        c->by_expiry = prioq_free(c->by_expiry);
+}
+
+unsigned dnssec_verify_cache_size(DnssecVerifyCache *c) {
+        assert(c);
+
+        return hashmap_size(c->by_digest);
+}
+
 #if HAVE_GCRYPT
 
+static void verify_cache_digest_hash_func(const uint8_t *digest, struct siphash *state) {
+        siphash24_compress(digest, VERIFY_CACHE_DIGEST_SIZE, state);
+}
+
+static int verify_cache_digest_compare_func(const uint8_t *a, const uint8_t *b) {
+        return memcmp(a, b, VERIFY_CACHE_DIGEST_SIZE);
+}
+
+DEFINE_PRIVATE_HASH_OPS(verify_cache_digest_hash_ops, uint8_t, verify_cache_digest_hash_func, verify_cache_digest_compare_func);
+
+static int dnssec_verify_cache_entry_prioq_compare_func(const void *a, const void *b) {
+        const DnssecVerifyCacheEntry *x = a, *y = b;
+
+        return CMP(x->until, y->until);
+}
+
+static int dnssec_verify_cache_digest(
+                const void *sig_data,
+                size_t sig_size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                uint8_t ret[static VERIFY_CACHE_DIGEST_SIZE]) {
+
+        _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
+        uint8_t buf[8];
+        void *digest;
+
+        assert(sig_data);
+        assert(rrsig);
+        assert(dnskey);
+
+        /* The signed data covers the RRSIG fields including the key tag and algorithm, and the canonical form of
+         * the RRset. Add the signature and the key itself, each prefixed by its size, since key tags aren't
+         * unique. */
+
+        gcry_md_open(&md, GCRY_MD_SHA256, 0);
+        if (!md)
+                return -EIO;
+
+        unaligned_write_le64(buf, sig_size);
+        gcry_md_write(md, buf, sizeof(buf));
+        gcry_md_write(md, sig_data, sig_size);
+
+        unaligned_write_le64(buf, rrsig->rrsig.signature_size);
+        gcry_md_write(md, buf, sizeof(buf));
+        gcry_md_write(md, rrsig->rrsig.signature, rrsig->rrsig.signature_size);
+
+        unaligned_write_le64(buf, dnskey->dnskey.key_size);
+        gcry_md_write(md, buf, sizeof(buf));
+        gcry_md_write(md, dnskey->dnskey.key, dnskey->dnskey.key_size);
+
+        digest = gcry_md_read(md, 0);
+        if (!digest)
+                return -EIO;
+
+        memcpy(ret, digest, VERIFY_CACHE_DIGEST_SIZE);
+        return 0;
+}
+
+static int dnssec_verify_cache_lookup(DnssecVerifyCache *c, const uint8_t digest[static VERIFY_CACHE_DIGEST_SIZE], usec_t realtime) {
+        DnssecVerifyCacheEntry *e;
+
+        assert(c);
+
+        /* Returns > 0 if the signature was found valid before, 0 if it was found invalid, -ENOENT if unknown */
+
+        e = hashmap_get(c->by_digest, digest);
+        if (e && e->until <= realtime) {
+                dnssec_verify_cache_remove(c, e);
+                e = NULL;
+        }
+        if (!e) {
+                c->n_miss++;
+                return -ENOENT;
+        }
+
+        c->n_hit++;
+        return e->valid;
+}
+
+static int dnssec_verify_cache_put(
+                DnssecVerifyCache *c,
+                const uint8_t digest[static VERIFY_CACHE_DIGEST_SIZE],
+                DnsResourceRecord *rrsig,
+                bool valid,
+                usec_t realtime) {
+
+        _cleanup_free_ DnssecVerifyCacheEntry *e = NULL;
+        DnssecVerifyCacheEntry *i;
+        int r;
+
+        assert(c);
+        assert(rrsig);
+
+        e = new(DnssecVerifyCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        *e = (DnssecVerifyCacheEntry) {
+                .valid = valid,
+                .until = rrsig->rrsig.expiration * USEC_PER_SEC,
+                .prioq_idx = PRIOQ_IDX_NULL,
+        };
+        memcpy(e->digest, digest, sizeof(e->digest));
+
+        if (e->until <= realtime)
+                return 0;
+
+        r = prioq_ensure_allocated(&c->by_expiry, dnssec_verify_cache_entry_prioq_compare_func);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&c->by_digest, &verify_cache_digest_hash_ops);
+        if (r < 0)
+                return r;
+
+        /* Drop everything that is expired, and then the entries expiring first until there's room for one more */
+        while ((i = prioq_peek(c->by_expiry)) &&
+               (i->until <= realtime || prioq_size(c->by_expiry) >= VERIFY_CACHE_MAX))
+                dnssec_verify_cache_remove(c, i);
+
+        r = hashmap_put(c->by_digest, e->digest, e);
+        if (r < 0)
+                return r;
+
+        r = prioq_put(c->by_expiry, e, &e->prioq_idx);
+        if (r < 0) {
+                hashmap_remove(c->by_digest, e->digest);
+                return r;
+        }
+
+        TAKE_PTR(e);
+        return 1;
+}
+
 static int rr_compare(DnsResourceRecord * const *a, DnsResourceRecord * const *b) {
         const DnsResourceRecord *x = *a, *y = *b;
         size_t m;
@@ -627,19 +804,20 @@ static void dnssec_fix_rrset_ttl(
         rrsig->expiry = rrsig->rrsig.expiration * USEC_PER_SEC;
 }
 
-int dnssec_verify_rrset(
+int dnssec_verify_rrset_full(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
                 DnsResourceRecord *rrsig,
                 DnsResourceRecord *dnskey,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result) {
 
-        uint8_t wire_format_name[DNS_WIRE_FORMAT_HOSTNAME_MAX];
+        uint8_t wire_format_name[DNS_WIRE_FORMAT_HOSTNAME_MAX], digest[VERIFY_CACHE_DIGEST_SIZE];
         DnsResourceRecord **list, *rr;
         const char *source, *name;
         _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
-        int r, md_algorithm;
+        int r, q, md_algorithm;
         size_t k, n = 0;
         size_t sig_size = 0;
         _cleanup_free_ char *sig_data = NULL;
@@ -657,7 +835,9 @@ int dnssec_verify_rrset(
 
         /* Verifies that the RRSet matches the specified "key" in "a",
          * using the signature "rrsig" and the key "dnskey". It's
-         * assumed that RRSIG and DNSKEY match. */
+         * assumed that RRSIG and DNSKEY match. If "cache" is
+         * specified, the outcome of the signature check is taken
+         * from it if known, and remembered there otherwise. */
 
         r = dnssec_rrsig_prepare(rrsig);
         if (r == -EINVAL) {
@@ -797,6 +977,19 @@ int dnssec_verify_rrset(
 
         initialize_libgcrypt(false);
 
+        if (cache) {
+                if (realtime == USEC_INFINITY)
+                        realtime = now(CLOCK_REALTIME);
+
+                r = dnssec_verify_cache_digest(sig_data, sig_size, rrsig, dnskey, digest);
+                if (r < 0)
+                        return r;
+
+                r = dnssec_verify_cache_lookup(cache, digest, realtime);
+                if (r >= 0)
+                        goto finish;
+        }
+
         switch (rrsig->rrsig.algorithm) {
 #if GCRYPT_VERSION_NUMBER >= 0x010600
         case DNSSEC_ALGORITHM_ED25519:
@@ -866,6 +1059,14 @@ int dnssec_verify_rrset(
         if (r < 0)
                 return r;
 
+        if (cache) {
+                /* A failure to remember the result is not fatal, we'll simply verify again next time */
+                q = dnssec_verify_cache_put(cache, digest, rrsig, r > 0, realtime);
+                if (q < 0)
+                        log_debug_errno(q, "Failed to cache DNSSEC verification result, ignoring: %m");
+        }
+
+finish:
         /* Now, fix the ttl, expiry, and remember the synthesizing source and the signer */
         if (r > 0)
                 dnssec_fix_rrset_ttl(list, n, rrsig, realtime);
@@ -931,6 +1132,7 @@ int dnssec_verify_rrset_search(
                 const DnsResourceKey *key,
                 DnsAnswer *validated_dnskeys,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result,
                 DnsResourceRecord **ret_rrsig) {
 
@@ -985,7 +1187,7 @@ int dnssec_verify_rrset_search(
                          * the RRSet against the RRSIG and DNSKEY
                          * combination. */
 
-                        r = dnssec_verify_rrset(a, key, rrsig, dnskey, realtime, &one_result);
+                        r = dnssec_verify_rrset_full(a, key, rrsig, dnskey, realtime, cache, &one_result);
                         if (r < 0)
                                 return r;
 
@@ -2168,12 +2370,13 @@ int dnssec_test_positive_wildcard(
 
 #else
 
-int dnssec_verify_rrset(
+int dnssec_verify_rrset_full(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
                 DnsResourceRecord *rrsig,
                 DnsResourceRecord *dnskey,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result) {
 
         return -EOPNOTSUPP;
@@ -2194,6 +2397,7 @@ int dnssec_verify_rrset_search(
                 const DnsResourceKey *key,
                 DnsAnswer *validated_dnskeys,
                 usec_t realtime,
+                DnssecVerifyCache *cache,
                 DnssecResult *result,
                 DnsResourceRecord **ret_rrsig) {
 
@@ -5,6 +5,8 @@ typedef enum DnssecResult DnssecResult;
 typedef enum DnssecVerdict DnssecVerdict;
 
 #include "dns-domain.h"
+#include "hashmap.h"
+#include "prioq.h"
 #include "resolved-dns-answer.h"
 #include "resolved-dns-rr.h"
 
@@ -45,11 +47,27 @@ enum DnssecVerdict {
 /* The longest digest we'll ever generate, of all digest algorithms we support */
 #define DNSSEC_HASH_SIZE_MAX (MAX(20, 32))
 
+/* Results of signature verifications, so that an RRset signed with the same key isn't verified again for every
+ * transaction that needs it. Entries are identified by a digest of the signed data, the signature and the key, and
+ * are kept no longer than the signature is valid. */
+typedef struct DnssecVerifyCache {
+        Hashmap *by_digest;
+        Prioq *by_expiry;
+        unsigned n_hit;
+        unsigned n_miss;
+} DnssecVerifyCache;
+
+void dnssec_verify_cache_flush(DnssecVerifyCache *c);
+unsigned dnssec_verify_cache_size(DnssecVerifyCache *c);
+
 int dnssec_rrsig_match_dnskey(DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, bool revoked_ok);
 int dnssec_key_match_rrsig(const DnsResourceKey *key, DnsResourceRecord *rrsig);
 
-int dnssec_verify_rrset(DnsAnswer *answer, const DnsResourceKey *key, DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, usec_t realtime, DnssecResult *result);
-int dnssec_verify_rrset_search(DnsAnswer *answer, const DnsResourceKey *key, DnsAnswer *validated_dnskeys, usec_t realtime, DnssecResult *result, DnsResourceRecord **rrsig);
+int dnssec_verify_rrset_full(DnsAnswer *answer, const DnsResourceKey *key, DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, usec_t realtime, DnssecVerifyCache *cache, DnssecResult *result);
+static inline int dnssec_verify_rrset(DnsAnswer *answer, const DnsResourceKey *key, DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, usec_t realtime, DnssecResult *result) {
+        return dnssec_verify_rrset_full(answer, key, rrsig, dnskey, realtime, NULL, result);
+}
+int dnssec_verify_rrset_search(DnsAnswer *answer, const DnsResourceKey *key, DnsAnswer *validated_dnskeys, usec_t realtime, DnssecVerifyCache *cache, DnssecResult *result, DnsResourceRecord **rrsig);
 
 int dnssec_verify_dnskey_by_ds(DnsResourceRecord *dnskey, DnsResourceRecord *ds, bool mask_revoke);
 int dnssec_verify_dnskey_by_ds_search(DnsResourceRecord *dnskey, DnsAnswer *validated_ds);
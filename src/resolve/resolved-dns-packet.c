@@ -168,6 +168,16 @@ DnsPacket *dns_packet_ref(DnsPacket *p) {
         return p;
 }
 
+static void dns_packet_flush_keys(DnsPacket *p) {
+        DnsResourceKey *k;
+
+        assert(p);
+
+        while ((k = hashmap_steal_first(p->keys)))
+                dns_resource_key_unref(k);
+        p->keys = hashmap_free(p->keys);
+}
+
 static void dns_packet_free(DnsPacket *p) {
         char *s;
 
@@ -181,6 +191,8 @@ static void dns_packet_free(DnsPacket *p) {
                 free(s);
         hashmap_free(p->names);
 
+        dns_packet_flush_keys(p);
+
         free(p->_data);
 
         if (!p->on_stack)
@@ -371,6 +383,9 @@ void dns_packet_truncate(DnsPacket *p, size_t sz) {
                 free(s);
         }
 
+        /* The names these were parsed from may be overwritten */
+        dns_packet_flush_keys(p);
+
         p->size = sz;
 }
 
@@ -1561,6 +1576,68 @@ static int dns_packet_read_type_windows(DnsPacket *p, Bitmap **types, size_t siz
         return 0;
 }
 
+static size_t dns_packet_name_offset(DnsPacket *p, size_t offset) {
+        const uint8_t *d = DNS_PACKET_DATA(p);
+
+        /* Returns where the labels of the name at the specified offset start, i.e. follows a pointer if the name
+         * consists of nothing else. A name decodes the same way wherever it is referenced from. */
+
+        if (offset + 2 <= p->size && (d[offset] & 0xc0) == 0xc0)
+                return (size_t) (d[offset] & ~0xc0) << 8 | (size_t) d[offset + 1];
+
+        return offset;
+}
+
+#define DNS_PACKET_KEY_ID(offset, type) UINT32_TO_PTR((uint32_t) (offset) << 16 | (uint32_t) (type))
+
+static DnsResourceKey* dns_packet_find_key(DnsPacket *p) {
+        const uint8_t *d = DNS_PACKET_DATA(p);
+        size_t offset;
+
+        assert(p);
+
+        /* Looks for a key parsed before that the key at the current read index refers to by its name. Since
+         * most RRs in a reply are for the same few names, and refer to them by pointers, this saves us from
+         * decoding and allocating the name and the key for each of them. Only keys of class IN are
+         * remembered, so that the mDNS cache flush bit never needs to be dealt with here. */
+
+        if (hashmap_isempty(p->keys))
+                return NULL;
+
+        if (p->rindex + 6 > p->size || (d[p->rindex] & 0xc0) != 0xc0)
+                return NULL;
+
+        if (unaligned_read_be16(d + p->rindex + 4) != DNS_CLASS_IN)
+                return NULL;
+
+        offset = dns_packet_name_offset(p, p->rindex);
+        if (offset < DNS_PACKET_HEADER_SIZE || offset >= p->rindex)
+                return NULL;
+
+        return hashmap_get(p->keys, DNS_PACKET_KEY_ID(offset, unaligned_read_be16(d + p->rindex + 2)));
+}
+
+static void dns_packet_remember_key(DnsPacket *p, size_t start, DnsResourceKey *key) {
+        size_t offset;
+
+        assert(p);
+        assert(key);
+
+        if (key->class != DNS_CLASS_IN)
+                return;
+
+        offset = dns_packet_name_offset(p, start);
+        if (offset >= UINT16_MAX)
+                return;
+
+        if (hashmap_ensure_allocated(&p->keys, NULL) < 0)
+                return;
+
+        /* This is just an optimization, hence don't bother if this fails */
+        if (hashmap_put(p->keys, DNS_PACKET_KEY_ID(offset, key->type), key) > 0)
+                dns_resource_key_ref(key);
+}
+
 int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flush, size_t *start) {
         _cleanup_(rewind_dns_packet) DnsPacketRewinder rewinder;
         _cleanup_free_ char *name = NULL;
@@ -1573,6 +1650,22 @@ int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flus
         assert(ret);
         INIT_REWINDER(rewinder, p);
 
+        if (!p->refuse_compression) {
+                key = dns_packet_find_key(p);
+                if (key) {
+                        p->rindex += 6;
+                        *ret = dns_resource_key_ref(key);
+
+                        if (ret_cache_flush)
+                                *ret_cache_flush = false;
+                        if (start)
+                                *start = rewinder.saved_rindex;
+                        CANCEL_REWINDER(rewinder);
+
+                        return 0;
+                }
+        }
+
         r = dns_packet_read_name(p, &name, true, NULL);
         if (r < 0)
                 return r;
@@ -1601,6 +1694,9 @@ int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flus
         name = NULL;
         *ret = key;
 
+        if (!p->refuse_compression)
+                dns_packet_remember_key(p, rewinder.saved_rindex, key);
+
         if (ret_cache_flush)
                 *ret_cache_flush = cache_flush;
         if (start)
@@ -58,6 +58,7 @@ struct DnsPacket {
         size_t size, allocated, rindex, max_size;
         void *_data; /* don't access directly, use DNS_PACKET_DATA()! */
         Hashmap *names; /* For name compression */
+        Hashmap *keys; /* Parsed keys, by offset of their name and type, for RRs referring to the same name */
         size_t opt_start, opt_size;
 
         /* Parsed data */
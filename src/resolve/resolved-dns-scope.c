@@ -14,6 +14,7 @@
 #include "resolved-dns-zone.h"
 #include "resolved-llmnr.h"
 #include "resolved-mdns.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "strv.h"
 
@@ -24,6 +25,9 @@
 #define MULTICAST_RESEND_TIMEOUT_MIN_USEC (100 * USEC_PER_MSEC)
 #define MULTICAST_RESEND_TIMEOUT_MAX_USEC (1 * USEC_PER_SEC)
 
+/* Used for the fingerprint of the DNS servers saved cache entries were retrieved from */
+#define CACHE_FILE_FINGERPRINT_KEY SD_ID128_MAKE(e7,48,4b,91,9f,9e,47,73,ab,44,f6,6c,81,d9,22,ce)
+
 int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int family) {
         DnsScope *s;
 
@@ -40,6 +44,7 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
                 .protocol = protocol,
                 .family = family,
                 .resend_timeout = MULTICAST_RESEND_TIMEOUT_MIN_USEC,
+                .cache.size_max = m->cache_size_max,
         };
 
         if (protocol == DNS_PROTOCOL_DNS) {
@@ -114,13 +119,96 @@ DnsScope* dns_scope_free(DnsScope *s) {
 
         sd_event_source_unref(s->announce_event_source);
 
-        dns_cache_flush(&s->cache);
+        dns_scope_flush_cache(s);
         dns_zone_flush(&s->zone);
 
         LIST_REMOVE(scopes, s->manager->dns_scopes, s);
         return mfree(s);
 }
 
+void dns_scope_flush_cache(DnsScope *s) {
+        assert(s);
+
+        dns_cache_flush(&s->cache);
+
+        /* The replies cached by the stub are made of what unicast DNS scopes found */
+        if (s->protocol == DNS_PROTOCOL_DNS)
+                dns_stub_cache_flush(&s->manager->dns_stub_cache);
+}
+
+static const char *dns_scope_cache_file_name(DnsScope *s) {
+        assert(s);
+
+        return s->link ? s->link->ifname : "*";
+}
+
+static uint64_t dns_scope_cache_file_fingerprint(DnsScope *s) {
+        struct siphash state;
+        DnsServer *first, *server;
+
+        assert(s);
+
+        if (s->link)
+                first = s->link->dns_servers;
+        else
+                first = s->manager->dns_servers ?: s->manager->fallback_dns_servers;
+
+        siphash24_init(&state, CACHE_FILE_FINGERPRINT_KEY.bytes);
+        LIST_FOREACH(servers, server, first)
+                siphash24_compress_string(strempty(dns_server_string_full(server)), &state);
+
+        return siphash24_finalize(&state);
+}
+
+int dns_scope_save_cache(DnsScope *s, DnsCacheFile *f) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        int r;
+
+        assert(s);
+        assert(f);
+
+        if (s->protocol != DNS_PROTOCOL_DNS)
+                return 0;
+
+        r = dns_cache_export(&s->cache, &answer);
+        if (r < 0)
+                return r;
+
+        return dns_cache_file_add(f, dns_scope_cache_file_name(s), dns_scope_cache_file_fingerprint(s), answer);
+}
+
+void dns_scope_restore_cache(DnsScope *s) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        int r;
+
+        assert(s);
+
+        /* Fills the cache of a fresh scope from the entries saved by a previous instance of the daemon, as long
+         * as the scope still talks to the same DNS servers. */
+
+        if (s->protocol != DNS_PROTOCOL_DNS ||
+            s->manager->enable_cache == DNS_CACHE_MODE_NO)
+                return;
+
+        r = dns_cache_file_take(&s->manager->cache_file, dns_scope_cache_file_name(s), dns_scope_cache_file_fingerprint(s),
+                                now(CLOCK_REALTIME), &answer);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to read saved cache entries of scope %s, ignoring: %m", dns_scope_cache_file_name(s));
+                return;
+        }
+        if (r == 0)
+                return;
+
+        r = dns_cache_put(&s->cache, s->manager->enable_cache, NULL, DNS_RCODE_SUCCESS, answer, false, UINT32_MAX, 0,
+                          AF_UNSPEC, &IN_ADDR_NULL);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to restore saved cache entries of scope %s, ignoring: %m", dns_scope_cache_file_name(s));
+                return;
+        }
+
+        log_debug("Restored %zu saved cache entries of scope %s.", dns_answer_size(answer), dns_scope_cache_file_name(s));
+}
+
 DnsServer *dns_scope_get_dns_server(DnsScope *s) {
         assert(s);
 
@@ -907,6 +995,10 @@ DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key,
         if (!t)
                 return NULL;
 
+        /* Don't make anyone wait for the network while refreshing the cache, it is still valid */
+        if (t->prefetch)
+                return NULL;
+
         /* Refuse reusing transactions that completed based on cached
          * data instead of a real packet, if that's requested. */
         if (!cache_ok &&
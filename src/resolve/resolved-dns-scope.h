@@ -7,6 +7,7 @@
 typedef struct DnsQueryCandidate DnsQueryCandidate;
 typedef struct DnsScope DnsScope;
 
+#include "resolved-dns-cache-file.h"
 #include "resolved-dns-cache.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
@@ -70,6 +71,10 @@ struct DnsScope {
 int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol p, int family);
 DnsScope* dns_scope_free(DnsScope *s);
 
+void dns_scope_flush_cache(DnsScope *s);
+int dns_scope_save_cache(DnsScope *s, DnsCacheFile *f);
+void dns_scope_restore_cache(DnsScope *s);
+
 void dns_scope_packet_received(DnsScope *s, usec_t rtt);
 void dns_scope_packet_lost(DnsScope *s, usec_t usec);
 
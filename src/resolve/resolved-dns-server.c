@@ -19,6 +19,11 @@
 /* The number of times we will attempt a certain feature set before degrading */
 #define DNS_SERVER_FEATURE_RETRY_ATTEMPTS 3
 
+/* The number of round-trip time samples needed before the resend timeout is derived from them, and the lower
+ * bound of such timeouts, so that the usual jitter of upstream resolvers doesn't make us give up on them */
+#define DNS_SERVER_RTT_SAMPLES_MIN 4
+#define DNS_SERVER_RESEND_TIMEOUT_MIN_USEC (250 * USEC_PER_MSEC)
+
 int dns_server_new(
                 Manager *m,
                 DnsServer **ret,
@@ -385,6 +390,58 @@ static bool dns_server_grace_period_expired(DnsServer *s) {
         return true;
 }
 
+void dns_server_packet_rtt(DnsServer *s, usec_t rtt) {
+        usec_t delta;
+
+        assert(s);
+
+        /* Invoked for each reply to a UDP packet that wasn't resent on the same socket, so that the measured time
+         * can be attributed */
+
+        if (s->n_rtt_samples == 0) {
+                s->rtt_usec = rtt;
+                s->rtt_var_usec = rtt / 2;
+        } else {
+                delta = s->rtt_usec > rtt ? s->rtt_usec - rtt : rtt - s->rtt_usec;
+                s->rtt_var_usec = (3 * s->rtt_var_usec + delta) / 4;
+                s->rtt_usec = (7 * s->rtt_usec + rtt) / 8;
+        }
+
+        if (s->n_rtt_samples < UINT_MAX)
+                s->n_rtt_samples++;
+
+        s->rtt_backoff = 0;
+}
+
+void dns_server_packet_timeout(DnsServer *s) {
+        assert(s);
+
+        /* Invoked whenever a UDP packet didn't get a reply in time, each of these doubles the resend timeout
+         * until a reply arrives again */
+
+        if (s->rtt_backoff < 16)
+                s->rtt_backoff++;
+}
+
+usec_t dns_server_resend_timeout(DnsServer *s, usec_t default_timeout) {
+        usec_t t;
+
+        assert(s);
+
+        /* Returns how long to wait for a reply to a UDP packet before trying again with another server. That's
+         * the smoothed round-trip time plus four times its variation, i.e. a time rarely exceeded unless
+         * something went wrong, but never more than the specified default. */
+
+        if (s->n_rtt_samples < DNS_SERVER_RTT_SAMPLES_MIN)
+                return default_timeout;
+
+        t = MAX(usec_add(s->rtt_usec, 4 * s->rtt_var_usec), DNS_SERVER_RESEND_TIMEOUT_MIN_USEC);
+        if (t >= default_timeout >> s->rtt_backoff)
+                return default_timeout;
+
+        return t << s->rtt_backoff;
+}
+
 DnsServerFeatureLevel dns_server_possible_feature_level(DnsServer *s) {
         DnsServerFeatureLevel best;
 
@@ -733,7 +790,7 @@ DnsServer *manager_set_dns_server(Manager *m, DnsServer *s) {
         m->current_dns_server = dns_server_ref(s);
 
         if (m->unicast_scope)
-                dns_cache_flush(&m->unicast_scope->cache);
+                dns_scope_flush_cache(m->unicast_scope);
 
         (void) manager_send_changed(m, "CurrentDNSServer");
 
@@ -828,7 +885,7 @@ void dns_server_flush_cache(DnsServer *s) {
         if (!scope)
                 return;
 
-        dns_cache_flush(&scope->cache);
+        dns_scope_flush_cache(scope);
 }
 
 void dns_server_reset_features(DnsServer *s) {
@@ -895,6 +952,16 @@ void dns_server_dump(DnsServer *s, FILE *f) {
         fputs(yes_no(dns_server_dnssec_supported(s)), f);
         fputc('\n', f);
 
+        if (s->n_rtt_samples > 0) {
+                char rtt[FORMAT_TIMESPAN_MAX], rtt_var[FORMAT_TIMESPAN_MAX];
+
+                fprintf(f,
+                        "\tRound-trip time: %s ± %s (%u samples)\n",
+                        format_timespan(rtt, sizeof(rtt), s->rtt_usec, 0),
+                        format_timespan(rtt_var, sizeof(rtt_var), s->rtt_var_usec, 0),
+                        s->n_rtt_samples);
+        }
+
         fprintf(f,
                 "\tMaximum UDP packet size received: %zu\n"
                 "\tFailed UDP attempts: %u\n"
@@ -74,6 +74,12 @@ struct DnsServer {
 
         size_t received_udp_packet_max;
 
+        /* Smoothed round-trip time of UDP queries and its variation, calculated the way TCP does it (RFC 6298) */
+        usec_t rtt_usec;
+        usec_t rtt_var_usec;
+        unsigned n_rtt_samples;
+        unsigned rtt_backoff;
+
         unsigned n_failed_udp;
         unsigned n_failed_tcp;
         unsigned n_failed_tls;
@@ -119,6 +125,10 @@ void dns_server_packet_truncated(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_rrsig_missing(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_bad_opt(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_rcode_downgrade(DnsServer *s, DnsServerFeatureLevel level);
+void dns_server_packet_rtt(DnsServer *s, usec_t rtt);
+void dns_server_packet_timeout(DnsServer *s);
+
+usec_t dns_server_resend_timeout(DnsServer *s, usec_t default_timeout);
 
 DnsServerFeatureLevel dns_server_possible_feature_level(DnsServer *s);
 
@@ -273,6 +273,17 @@ static ssize_t dns_stream_read(DnsStream *s, void *buf, size_t count) {
         return ss;
 }
 
+static usec_t dns_stream_timeout(Manager *m, DnsStreamType type) {
+        assert(m);
+
+        /* Connections to upstream servers may be kept around for longer, so that later lookups can reuse
+         * them without paying for another TCP and TLS handshake */
+        if (type == DNS_STREAM_LOOKUP && m->connection_idle_timeout_usec > 0)
+                return m->connection_idle_timeout_usec;
+
+        return DNS_STREAM_TIMEOUT_USEC;
+}
+
 static int on_stream_timeout(sd_event_source *es, usec_t usec, void *userdata) {
         DnsStream *s = userdata;
 
@@ -437,7 +448,7 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 
         /* If we did something, let's restart the timeout event source */
         if (progressed && s->timeout_event_source) {
-                r = sd_event_source_set_time_relative(s->timeout_event_source, DNS_STREAM_TIMEOUT_USEC);
+                r = sd_event_source_set_time_relative(s->timeout_event_source, s->timeout_usec);
                 if (r < 0)
                         log_warning_errno(errno, "Couldn't restart TCP connection timeout, ignoring: %m");
         }
@@ -507,6 +518,7 @@ int dns_stream_new(
                 .fd = -1,
                 .protocol = protocol,
                 .type = type,
+                .timeout_usec = dns_stream_timeout(m, type),
         };
 
         r = ordered_set_ensure_allocated(&s->write_queue, &dns_packet_hash_ops);
@@ -519,16 +531,18 @@ int dns_stream_new(
 
         (void) sd_event_source_set_description(s->io_event_source, "dns-stream-io");
 
-        r = sd_event_add_time_relative(
-                        m->event,
-                        &s->timeout_event_source,
-                        clock_boottime_or_monotonic(),
-                        DNS_STREAM_TIMEOUT_USEC, 0,
-                        on_stream_timeout, s);
-        if (r < 0)
-                return r;
+        if (s->timeout_usec != USEC_INFINITY) {
+                r = sd_event_add_time_relative(
+                                m->event,
+                                &s->timeout_event_source,
+                                clock_boottime_or_monotonic(),
+                                s->timeout_usec, 0,
+                                on_stream_timeout, s);
+                if (r < 0)
+                        return r;
 
-        (void) sd_event_source_set_description(s->timeout_event_source, "dns-stream-timeout");
+                (void) sd_event_source_set_description(s->timeout_event_source, "dns-stream-timeout");
+        }
 
         LIST_PREPEND(streams, m->dns_streams, s);
         m->n_dns_streams[type]++;
@@ -60,6 +60,7 @@ struct DnsStream {
 
         sd_event_source *io_event_source;
         sd_event_source *timeout_event_source;
+        usec_t timeout_usec;
 
         be16_t write_size, read_size;
         DnsPacket *write_packet, *read_packet;
@@ -0,0 +1,336 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "resolved-dns-stub-cache.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "unaligned.h"
+
+/* Same limits as for the regular cache */
+#define STUB_CACHE_MAX 4096
+#define STUB_CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
+
+typedef struct DnsStubCacheItem {
+        /* The question, which is included in the reply as it was asked, hence it is compared case-sensitively */
+        DnsResourceKey *key;
+        bool edns0;
+        bool dnssec_ok;
+        bool checking_disabled;
+
+        DnsPacket *reply;
+        usec_t timestamp;
+        usec_t until;
+
+        /* Where the TTLs are located in the reply, and what they were when it was built */
+        size_t *ttl_offsets;
+        uint32_t *ttls;
+        size_t n_ttls;
+
+        unsigned prioq_idx;
+} DnsStubCacheItem;
+
+static DnsStubCacheItem* dns_stub_cache_item_free(DnsStubCacheItem *i) {
+        if (!i)
+                return NULL;
+
+        dns_resource_key_unref(i->key);
+        dns_packet_unref(i->reply);
+        free(i->ttl_offsets);
+        free(i->ttls);
+
+        return mfree(i);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStubCacheItem*, dns_stub_cache_item_free);
+
+static void dns_stub_cache_item_hash_func(const DnsStubCacheItem *i, struct siphash *state) {
+        siphash24_compress_string(dns_resource_key_name(i->key), state);
+        siphash24_compress(&i->key->class, sizeof(i->key->class), state);
+        siphash24_compress(&i->key->type, sizeof(i->key->type), state);
+        siphash24_compress_boolean(i->edns0, state);
+        siphash24_compress_boolean(i->dnssec_ok, state);
+        siphash24_compress_boolean(i->checking_disabled, state);
+}
+
+static int dns_stub_cache_item_compare_func(const DnsStubCacheItem *a, const DnsStubCacheItem *b) {
+        int r;
+
+        r = strcmp(dns_resource_key_name(a->key), dns_resource_key_name(b->key));
+        if (r != 0)
+                return r;
+
+        r = CMP(a->key->class, b->key->class);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->key->type, b->key->type);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->edns0, b->edns0);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->dnssec_ok, b->dnssec_ok);
+        if (r != 0)
+                return r;
+
+        return CMP(a->checking_disabled, b->checking_disabled);
+}
+
+DEFINE_PRIVATE_HASH_OPS(dns_stub_cache_item_hash_ops, DnsStubCacheItem, dns_stub_cache_item_hash_func, dns_stub_cache_item_compare_func);
+
+static int dns_stub_cache_item_prioq_compare_func(const void *a, const void *b) {
+        const DnsStubCacheItem *x = a, *y = b;
+
+        return CMP(x->until, y->until);
+}
+
+static void dns_stub_cache_remove(DnsStubCache *c, DnsStubCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        assert_se(hashmap_remove(c->by_key, i) == i);
+        prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        dns_stub_cache_item_free(i);
+}
+
+void dns_stub_cache_flush(DnsStubCache *c) {
+        DnsStubCacheItem *i;
+
+        assert(c);
+
+        while ((i = hashmap_first(c->by_key)))
+                dns_stub_cache_remove(c, i);
+
+        c->by_key = hashmap_free(c->by_key);
+        c->by_expiry = prioq_free(c->by_expiry);
+}
+
+static void dns_stub_cache_make_space(DnsStubCache *c, usec_t timestamp) {
+        DnsStubCacheItem *i;
+
+        assert(c);
+
+        /* Drop everything that is expired, and then the items expiring first until there's room for one more */
+        while ((i = prioq_peek(c->by_expiry)) &&
+               (i->until <= timestamp || prioq_size(c->by_expiry) >= STUB_CACHE_MAX))
+                dns_stub_cache_remove(c, i);
+}
+
+static bool dns_stub_cache_request_key(DnsPacket *request, DnsStubCacheItem *ret) {
+        assert(request);
+        assert(ret);
+
+        if (!request->extracted || dns_question_size(request->question) != 1)
+                return false;
+
+        *ret = (DnsStubCacheItem) {
+                .key = request->question->keys[0],
+                .edns0 = !!request->opt,
+                .dnssec_ok = DNS_PACKET_DO(request),
+                .checking_disabled = DNS_PACKET_CD(request),
+        };
+
+        return true;
+}
+
+static int dns_stub_cache_find_ttls(DnsStubCacheItem *i, uint32_t *ret_min_ttl) {
+        DnsPacket *p = i->reply;
+        uint32_t min_ttl = UINT32_MAX;
+        unsigned n, j;
+        int r;
+
+        /* Skips over the question and records where the TTLs of the answer section are. Only those are rewritten
+         * on lookups, hence replies that carry anything but an OPT pseudo-RR besides the answer are refused: the
+         * TTLs of their other records would go stale. Returns 0 for a reply not suitable for caching. */
+
+        if (DNS_PACKET_NSCOUNT(p) > 0 || DNS_PACKET_ARCOUNT(p) > 1)
+                return 0;
+
+        dns_packet_rewind(p, DNS_PACKET_HEADER_SIZE);
+
+        n = be16toh(DNS_PACKET_HEADER(p)->qdcount);
+        for (j = 0; j < n; j++) {
+                _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+
+                r = dns_packet_read_key(p, &key, NULL, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        n = be16toh(DNS_PACKET_HEADER(p)->ancount);
+        i->ttl_offsets = new(size_t, n);
+        i->ttls = new(uint32_t, n);
+        if (!i->ttl_offsets || !i->ttls)
+                return -ENOMEM;
+
+        for (j = 0; j < n; j++) {
+                _cleanup_free_ char *name = NULL;
+                uint16_t type, class, rdlength;
+                uint32_t ttl;
+                size_t offset;
+
+                r = dns_packet_read_name(p, &name, true, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint16(p, &type, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint16(p, &class, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint32(p, &ttl, &offset);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint16(p, &rdlength, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read(p, rdlength, NULL, NULL);
+                if (r < 0)
+                        return r;
+
+                i->ttl_offsets[j] = offset;
+                i->ttls[j] = ttl;
+                min_ttl = MIN(min_ttl, ttl);
+        }
+
+        if (DNS_PACKET_ARCOUNT(p) > 0) {
+                _cleanup_free_ char *name = NULL;
+                uint16_t type;
+
+                r = dns_packet_read_name(p, &name, true, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint16(p, &type, NULL);
+                if (r < 0)
+                        return r;
+
+                if (type != DNS_TYPE_OPT)
+                        return 0;
+        }
+
+        i->n_ttls = n;
+        *ret_min_ttl = n > 0 ? min_ttl : 0;
+        return 1;
+}
+
+int dns_stub_cache_put(DnsStubCache *c, DnsPacket *request, DnsPacket *reply, usec_t timestamp) {
+        _cleanup_(dns_stub_cache_item_freep) DnsStubCacheItem *i = NULL;
+        DnsStubCacheItem lookup, *existing;
+        uint32_t min_ttl;
+        int r;
+
+        assert(c);
+        assert(request);
+        assert(reply);
+
+        /* Returns 0 if the reply was not suitable for caching, 1 if it was stored */
+
+        if (!dns_stub_cache_request_key(request, &lookup))
+                return 0;
+
+        if (DNS_PACKET_TC(reply) || DNS_PACKET_RCODE(reply) != DNS_RCODE_SUCCESS)
+                return 0;
+
+        i = new(DnsStubCacheItem, 1);
+        if (!i)
+                return -ENOMEM;
+
+        *i = (DnsStubCacheItem) {
+                .key = dns_resource_key_ref(lookup.key),
+                .edns0 = lookup.edns0,
+                .dnssec_ok = lookup.dnssec_ok,
+                .checking_disabled = lookup.checking_disabled,
+                .reply = dns_packet_ref(reply),
+                .timestamp = timestamp,
+                .prioq_idx = PRIOQ_IDX_NULL,
+        };
+
+        r = dns_stub_cache_find_ttls(i, &min_ttl);
+        if (r <= 0)
+                return r;
+        if (min_ttl == 0)
+                return 0;
+
+        i->until = timestamp + MIN((usec_t) min_ttl * USEC_PER_SEC, STUB_CACHE_TTL_MAX_USEC);
+
+        existing = hashmap_get(c->by_key, i);
+        if (existing)
+                dns_stub_cache_remove(c, existing);
+
+        dns_stub_cache_make_space(c, timestamp);
+
+        r = hashmap_ensure_allocated(&c->by_key, &dns_stub_cache_item_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated(&c->by_expiry, dns_stub_cache_item_prioq_compare_func);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(c->by_key, i, i);
+        if (r < 0)
+                return r;
+
+        r = prioq_put(c->by_expiry, i, &i->prioq_idx);
+        if (r < 0) {
+                hashmap_remove(c->by_key, i);
+                return r;
+        }
+
+        TAKE_PTR(i);
+        return 1;
+}
+
+int dns_stub_cache_lookup(DnsStubCache *c, DnsPacket *request, usec_t timestamp, DnsPacket **ret) {
+        DnsStubCacheItem lookup, *i;
+        uint32_t elapsed;
+        size_t j;
+
+        assert(c);
+        assert(request);
+        assert(ret);
+
+        /* The returned packet is shared with the cache, and is modified in place by the next lookup. Hence it may
+         * only be used for sending it right away. */
+
+        if (!dns_stub_cache_request_key(request, &lookup))
+                return 0;
+
+        i = hashmap_get(c->by_key, &lookup);
+        if (!i)
+                return 0;
+
+        if (i->until <= timestamp) {
+                dns_stub_cache_remove(c, i);
+                return 0;
+        }
+
+        if (i->reply->size > DNS_PACKET_PAYLOAD_SIZE_MAX(request))
+                return 0;
+
+        /* All TTLs are at least as large as the time the item is valid for, hence this never underflows */
+        elapsed = (uint32_t) ((timestamp - i->timestamp) / USEC_PER_SEC);
+        for (j = 0; j < i->n_ttls; j++)
+                unaligned_write_be32(DNS_PACKET_DATA(i->reply) + i->ttl_offsets[j], i->ttls[j] - elapsed);
+
+        DNS_PACKET_HEADER(i->reply)->id = DNS_PACKET_ID(request);
+
+        c->n_hit++;
+
+        *ret = dns_packet_ref(i->reply);
+        return 1;
+}
+
+unsigned dns_stub_cache_size(DnsStubCache *c) {
+        assert(c);
+
+        return hashmap_size(c->by_key);
+}
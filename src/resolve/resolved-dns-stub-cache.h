@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "hashmap.h"
+#include "prioq.h"
+#include "time-util.h"
+
+/* Fully serialized replies of the stub resolver, so that repeated queries for the same question can be answered
+ * without going through a DnsQuery and serializing the answer again. Only positive answers from unicast DNS are
+ * kept, and never longer than the smallest TTL of the answer allows. */
+typedef struct DnsStubCache {
+        Hashmap *by_key;
+        Prioq *by_expiry;
+        unsigned n_hit;
+} DnsStubCache;
+
+#include "resolved-dns-packet.h"
+
+void dns_stub_cache_flush(DnsStubCache *c);
+
+int dns_stub_cache_put(DnsStubCache *c, DnsPacket *request, DnsPacket *reply, usec_t timestamp);
+int dns_stub_cache_lookup(DnsStubCache *c, DnsPacket *request, usec_t timestamp, DnsPacket **ret);
+
+unsigned dns_stub_cache_size(DnsStubCache *c);
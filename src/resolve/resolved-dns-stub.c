@@ -2,11 +2,14 @@
 
 #include <net/if_arp.h>
 
+#include "alloc-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "in-addr-util.h"
 #include "missing_network.h"
 #include "missing_socket.h"
 #include "resolved-dns-stub.h"
+#include "resolved-etc-hosts.h"
 #include "socket-netlink.h"
 #include "socket-util.h"
 #include "string-table.h"
@@ -15,8 +18,17 @@
  * IP and UDP header sizes */
 #define ADVERTISE_DATAGRAM_SIZE_MAX (65536U-14U-20U-8U)
 
+/* How many datagrams to read from a stub socket before giving other event sources a chance */
+#define STUB_UDP_BATCH_MAX 32U
+
 static int manager_dns_stub_fd_extra(Manager *m, DnsStubListenerExtra *l, int type);
 
+static DnsStubStatistics *dns_stub_statistics(Manager *m, DnsStubListenerExtra *l) {
+        assert(m);
+
+        return l ? &l->statistics : &m->dns_stub_statistics;
+}
+
 static void dns_stub_listener_extra_hash_func(const DnsStubListenerExtra *a, struct siphash *state) {
         assert(a);
 
@@ -221,9 +233,12 @@ static int dns_stub_send(
                                  l ? p->ifindex : LOOPBACK_IFINDEX, /* force loopback iface if this is the main listener stub */
                                  p->family, &p->sender, p->sender_port, &p->destination,
                                  reply);
-        if (r < 0)
+        if (r < 0) {
+                dns_stub_statistics(m, l)->n_send_errors++;
                 return log_debug_errno(r, "Failed to send reply packet: %m");
+        }
 
+        dns_stub_statistics(m, l)->n_replies++;
         return 0;
 }
 
@@ -297,6 +312,14 @@ static void dns_stub_query_complete(DnsQuery *q) {
                 }
 
                 (void) dns_stub_send(q->manager, q->stub_listener_extra, q->request_dns_stream, q->request_dns_packet, q->reply_dns_packet);
+
+                /* Keep replies to UDP queries around, so that they can be sent again as they are. TCP replies are
+                 * not, as the stream might still have them queued when being modified for the next lookup. */
+                if (!q->request_dns_stream && !truncated && q->answer_protocol == DNS_PROTOCOL_DNS) {
+                        r = dns_stub_cache_put(&q->manager->dns_stub_cache, q->request_dns_packet, q->reply_dns_packet, clock_boottime_or_monotonic());
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to cache reply packet, ignoring: %m");
+                }
                 break;
         }
 
@@ -409,6 +432,23 @@ static void dns_stub_process_query(Manager *m, DnsStubListenerExtra *l, DnsStrea
                 return;
         }
 
+        if (!s) {
+                _cleanup_(dns_answer_unrefp) DnsAnswer *hosts = NULL;
+                _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+
+                /* /etc/hosts takes precedence over the network, hence check it first. This also rereads the file
+                 * if it changed, which flushes the stub cache. */
+                r = manager_etc_hosts_lookup(m, p->question, &hosts);
+                if (r == 0) {
+                        r = dns_stub_cache_lookup(&m->dns_stub_cache, p, clock_boottime_or_monotonic(), &reply);
+                        if (r > 0) {
+                                log_debug("Answering query from stub cache.");
+                                (void) dns_stub_send(m, l, s, p, reply);
+                                return;
+                        }
+                }
+        }
+
         r = dns_query_new(m, &q, p->question, p->question, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH);
         if (r < 0) {
                 log_error_errno(r, "Failed to generate query object: %m");
@@ -448,19 +488,32 @@ static void dns_stub_process_query(Manager *m, DnsStubListenerExtra *l, DnsStrea
 }
 
 static int on_dns_stub_packet_internal(sd_event_source *s, int fd, uint32_t revents, Manager *m, DnsStubListenerExtra *l) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        DnsStubStatistics *stats;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+        stats = dns_stub_statistics(m, l);
+        stats->n_udp_wakeups++;
 
-        if (dns_packet_validate_query(p) > 0) {
-                log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+        /* Queries tend to arrive in bursts, hence read whatever is queued already instead of going back to
+         * the event loop for every single datagram. The batch is bounded to stay fair to other sockets. */
+        for (unsigned n = 0; n < STUB_UDP_BATCH_MAX; n++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
 
-                dns_stub_process_query(m, l, NULL, p);
-        } else
-                log_debug("Invalid DNS stub UDP packet, ignoring.");
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (n > 0 && IN_SET(r, -EAGAIN, -EINTR))
+                        break;
+                if (r <= 0)
+                        return r;
+
+                stats->n_udp_packets++;
+
+                if (dns_packet_validate_query(p) > 0) {
+                        log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+
+                        dns_stub_process_query(m, l, NULL, p);
+                } else
+                        log_debug("Invalid DNS stub UDP packet, ignoring.");
+        }
 
         return 0;
 }
@@ -513,6 +566,8 @@ static int on_dns_stub_stream_internal(sd_event_source *s, int fd, uint32_t reve
                 return r;
         }
 
+        dns_stub_statistics(m, l)->n_tcp_connections++;
+
         stream->stub_listener_extra = l;
         stream->on_packet = on_dns_stub_stream_packet;
         stream->complete = dns_stub_stream_complete;
@@ -755,6 +810,41 @@ void manager_dns_stub_stop(Manager *m) {
         m->dns_stub_tcp_event_source = sd_event_source_unref(m->dns_stub_tcp_event_source);
 }
 
+static void dns_stub_statistics_dump(const char *address, DnsStubListenerMode mode, const DnsStubStatistics *stats, FILE *f) {
+        assert(address);
+        assert(stats);
+        assert(f);
+
+        fprintf(f,
+                "[Stub listener %s mode=%s]\n"
+                "\tUDP packets: %" PRIu64 " in %" PRIu64 " wakeups\n"
+                "\tTCP connections: %" PRIu64 "\n"
+                "\tReplies: %" PRIu64 " (%" PRIu64 " failed to send)\n",
+                address, dns_stub_listener_mode_to_string(mode),
+                stats->n_udp_packets, stats->n_udp_wakeups,
+                stats->n_tcp_connections,
+                stats->n_replies, stats->n_send_errors);
+}
+
+void dns_stub_dump(Manager *m, FILE *f) {
+        DnsStubListenerExtra *l;
+
+        assert(m);
+
+        if (!f)
+                f = stdout;
+
+        if (m->dns_stub_listener_mode != DNS_STUB_LISTENER_NO)
+                dns_stub_statistics_dump("127.0.0.53:53", m->dns_stub_listener_mode, &m->dns_stub_statistics, f);
+
+        ORDERED_SET_FOREACH(l, m->dns_extra_stub_listeners) {
+                _cleanup_free_ char *a = NULL;
+
+                (void) in_addr_port_to_string(l->family, &l->address, l->port > 0 ? l->port : 53, &a);
+                dns_stub_statistics_dump(strna(a), l->mode, &l->statistics, f);
+        }
+}
+
 static const char* const dns_stub_listener_mode_table[_DNS_STUB_LISTENER_MODE_MAX] = {
         [DNS_STUB_LISTENER_NO] = "no",
         [DNS_STUB_LISTENER_UDP] = "udp",
@@ -1,10 +1,20 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <stdio.h>
+
 #include "hash-funcs.h"
 
 typedef struct DnsStubListenerExtra DnsStubListenerExtra;
 
+typedef struct DnsStubStatistics {
+        uint64_t n_udp_packets;
+        uint64_t n_udp_wakeups;
+        uint64_t n_tcp_connections;
+        uint64_t n_replies;
+        uint64_t n_send_errors;
+} DnsStubStatistics;
+
 typedef enum DnsStubListenerMode {
         DNS_STUB_LISTENER_NO,
         DNS_STUB_LISTENER_UDP = 1 << 0,
@@ -27,6 +37,8 @@ struct DnsStubListenerExtra {
 
         sd_event_source *udp_event_source;
         sd_event_source *tcp_event_source;
+
+        DnsStubStatistics statistics;
 };
 
 extern const struct hash_ops dns_stub_listener_extra_hash_ops;
@@ -37,5 +49,7 @@ DnsStubListenerExtra *dns_stub_listener_extra_free(DnsStubListenerExtra *p);
 void manager_dns_stub_stop(Manager *m);
 int manager_dns_stub_start(Manager *m);
 
+void dns_stub_dump(Manager *m, FILE *f);
+
 const char* dns_stub_listener_mode_to_string(DnsStubListenerMode p) _const_;
 DnsStubListenerMode dns_stub_listener_mode_from_string(const char *s) _pure_;
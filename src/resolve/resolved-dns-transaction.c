@@ -16,6 +16,7 @@
 #include "string-table.h"
 
 #define TRANSACTIONS_MAX 4096
+#define PREFETCH_TRANSACTIONS_MAX 16
 #define TRANSACTION_TCP_TIMEOUT_USEC (10U*USEC_PER_SEC)
 
 /* After how much time to repeat classic DNS requests */
@@ -88,6 +89,11 @@ DnsTransaction* dns_transaction_free(DnsTransaction *t) {
         dns_server_unref(t->server);
 
         if (t->scope) {
+                if (t->prefetch) {
+                        assert(t->scope->manager->n_prefetch_transactions > 0);
+                        t->scope->manager->n_prefetch_transactions--;
+                }
+
                 hashmap_remove_value(t->scope->transactions_by_key, t->key, t);
                 LIST_REMOVE(transactions_by_scope, t->scope->transactions, t);
 
@@ -136,6 +142,10 @@ bool dns_transaction_gc(DnsTransaction *t) {
         if (t->block_gc > 0)
                 return true;
 
+        /* Prefetches have nobody to notify, they live until they are done */
+        if (t->prefetch && DNS_TRANSACTION_IS_LIVE(t->state))
+                return true;
+
         if (set_isempty(t->notify_query_candidates) &&
             set_isempty(t->notify_query_candidates_done) &&
             set_isempty(t->notify_zone_items) &&
@@ -1103,6 +1113,9 @@ void dns_transaction_process_reply(DnsTransaction *t, DnsPacket *p) {
 
                 /* Report that we successfully received a packet */
                 dns_server_packet_received(t->server, p->ipproto, t->current_feature_level, p->size);
+
+                if (p->ipproto == IPPROTO_UDP && !t->udp_resent)
+                        dns_server_packet_rtt(t->server, ts - t->start_usec);
         }
 
         /* See if we know things we didn't know before that indicate we better restart the lookup immediately. */
@@ -1239,6 +1252,8 @@ static int dns_transaction_emit_udp(DnsTransaction *t) {
                 if (!dns_server_dnssec_supported(t->server) && dns_type_is_dnssec(t->key->type))
                         return -EOPNOTSUPP;
 
+                t->udp_resent = r == 0 && t->dns_udp_fd >= 0;
+
                 if (r > 0 || t->dns_udp_fd < 0) { /* Server changed, or no connection yet. */
                         int fd;
 
@@ -1285,7 +1300,14 @@ static int on_transaction_timeout(sd_event_source *s, usec_t usec, void *userdat
 
                 case DNS_PROTOCOL_DNS:
                         assert(t->server);
-                        dns_server_packet_lost(t->server, t->stream ? IPPROTO_TCP : IPPROTO_UDP, t->current_feature_level);
+
+                        if (!t->stream)
+                                dns_server_packet_timeout(t->server);
+
+                        /* If we moved on early, because the server is usually faster than this, the packet is not
+                         * necessarily lost, hence don't let that count towards downgrading the feature level */
+                        if (t->stream || usec - t->start_usec >= DNS_TIMEOUT_USEC)
+                                dns_server_packet_lost(t->server, t->stream ? IPPROTO_TCP : IPPROTO_UDP, t->current_feature_level);
                         break;
 
                 case DNS_PROTOCOL_LLMNR:
@@ -1321,7 +1343,10 @@ static usec_t transaction_get_resend_timeout(DnsTransaction *t) {
                 if (t->stream)
                         return TRANSACTION_TCP_TIMEOUT_USEC;
 
-                return DNS_TIMEOUT_USEC;
+                /* Servers that usually reply quickly get a shorter timeout, so that we move on to the next one
+                 * soon if one of them is stuck */
+                assert(t->server);
+                return dns_server_resend_timeout(t->server, DNS_TIMEOUT_USEC);
 
         case DNS_PROTOCOL_MDNS:
                 assert(t->n_attempts > 0);
@@ -1338,6 +1363,50 @@ static usec_t transaction_get_resend_timeout(DnsTransaction *t) {
         }
 }
 
+static void dns_transaction_maybe_prefetch(DnsTransaction *t, usec_t ts) {
+        DnsTransaction *p;
+        int r;
+
+        assert(t);
+
+        /* Refreshes popular cache entries shortly before they expire, so that lookups keep being answered
+         * from the cache. The number of such refreshes in flight is limited, in order not to flood the
+         * servers with queries nobody is waiting for. */
+
+        if (t->scope->protocol != DNS_PROTOCOL_DNS)
+                return;
+
+        if (t->scope->manager->n_prefetch_transactions >= PREFETCH_TRANSACTIONS_MAX)
+                return;
+
+        if (!dns_cache_want_prefetch(&t->scope->cache, t->key, ts))
+                return;
+
+        r = dns_transaction_new(&p, t->scope, t->key);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to create prefetch transaction, ignoring: %m");
+                return;
+        }
+
+        p->prefetch = true;
+        t->scope->manager->n_prefetch_transactions++;
+        dns_cache_mark_prefetch(&t->scope->cache, t->key);
+
+        log_debug("Refreshing cache entry in transaction %" PRIu16 ".", p->id);
+
+        p->block_gc++;
+        r = dns_transaction_go(p);
+        p->block_gc--;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to start prefetch transaction, ignoring: %m");
+                dns_transaction_free(p);
+                return;
+        }
+
+        /* Frees the transaction if it finished right away */
+        dns_transaction_gc(p);
+}
+
 static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         int r;
 
@@ -1442,8 +1511,9 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         }
 
         /* Check the cache, but only if this transaction is not used
-         * for probing or verifying a zone item. */
-        if (set_isempty(t->notify_zone_items)) {
+         * for probing or verifying a zone item, or for refreshing the
+         * cache itself. */
+        if (set_isempty(t->notify_zone_items) && !t->prefetch) {
 
                 /* Before trying the cache, let's make sure we figured out a
                  * server to use. Should this cause a change of server this
@@ -1457,6 +1527,8 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                 if (r < 0)
                         return r;
                 if (r > 0) {
+                        dns_transaction_maybe_prefetch(t, ts);
+
                         t->answer_source = DNS_TRANSACTION_CACHE;
                         if (t->answer_rcode == DNS_RCODE_SUCCESS)
                                 dns_transaction_complete(t, DNS_TRANSACTION_SUCCESS);
@@ -2828,7 +2900,7 @@ static int dnssec_validate_records(
                                 continue;
                 }
 
-                r = dnssec_verify_rrset_search(t->answer, rr->key, t->validated_keys, USEC_INFINITY, &result, &rrsig);
+                r = dnssec_verify_rrset_search(t->answer, rr->key, t->validated_keys, USEC_INFINITY, &t->scope->manager->dnssec_verify_cache, &result, &rrsig);
                 if (r < 0)
                         return r;
 
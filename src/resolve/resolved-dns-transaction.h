@@ -63,6 +63,13 @@ struct DnsTransaction {
 
         bool probing:1;
 
+        /* Refreshes a cache entry in the background, nobody waits for it */
+        bool prefetch:1;
+
+        /* The current packet was sent on the same UDP socket as an earlier one, hence the time until a reply
+         * arrives tells us nothing about the server */
+        bool udp_resent:1;
+
         DnsPacket *sent, *received;
 
         DnsAnswer *answer;
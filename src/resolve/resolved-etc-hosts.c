@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "errno-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
@@ -18,12 +19,11 @@
 #define ETC_HOSTS_RECHECK_USEC (2*USEC_PER_SEC)
 
 static void etc_hosts_item_free(EtcHostsItem *item) {
-        strv_free(item->names);
+        free(item->names);
         free(item);
 }
 
 static void etc_hosts_item_by_name_free(EtcHostsItemByName *item) {
-        free(item->name);
         free(item->addresses);
         free(item);
 }
@@ -31,7 +31,8 @@ static void etc_hosts_item_by_name_free(EtcHostsItemByName *item) {
 void etc_hosts_free(EtcHosts *hosts) {
         hosts->by_address = hashmap_free_with_destructor(hosts->by_address, etc_hosts_item_free);
         hosts->by_name = hashmap_free_with_destructor(hosts->by_name, etc_hosts_item_by_name_free);
-        hosts->no_address = set_free_free(hosts->no_address);
+        hosts->no_address = set_free(hosts->no_address);
+        hosts->data = mfree(hosts->data);
 }
 
 void manager_etc_hosts_flush(Manager *m) {
@@ -41,20 +42,37 @@ void manager_etc_hosts_flush(Manager *m) {
         m->etc_hosts_dev = 0;
 }
 
-static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
-        _cleanup_free_ char *address_str = NULL;
+static char* next_word(char **line) {
+        char *word;
+
+        assert(line);
+
+        /* Splits off the next whitespace separated word in place. Like glibc, we don't do any quoting or escaping
+         * in /etc/hosts. */
+
+        word = *line + strspn(*line, WHITESPACE);
+        if (*word == 0)
+                return NULL;
+
+        *line = word + strcspn(word, WHITESPACE);
+        if (**line != 0)
+                *((*line)++) = 0;
+
+        return word;
+}
+
+static int parse_line(EtcHosts *hosts, unsigned nr, char *line) {
         struct in_addr_data address = {};
         bool found = false;
         EtcHostsItem *item;
+        char *address_str;
         int r;
 
         assert(hosts);
         assert(line);
 
-        r = extract_first_word(&line, &address_str, NULL, EXTRACT_RELAX);
-        if (r < 0)
-                return log_error_errno(r, "/etc/hosts:%u: failed to extract address: %m", nr);
-        assert(r > 0); /* We already checked that the line is not empty, so it should contain *something* */
+        address_str = next_word(&line);
+        assert(address_str); /* We already checked that the line is not empty, so it should contain *something* */
 
         r = in_addr_ifindex_from_string_auto(address_str, &address.family, &address.address, NULL);
         if (r < 0) {
@@ -95,13 +113,11 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
         }
 
         for (;;) {
-                _cleanup_free_ char *name = NULL;
                 EtcHostsItemByName *bn;
+                char *name;
 
-                r = extract_first_word(&line, &name, NULL, EXTRACT_RELAX);
-                if (r < 0)
-                        return log_error_errno(r, "/etc/hosts:%u: couldn't extract hostname: %m", nr);
-                if (r == 0)
+                name = next_word(&line);
+                if (!name)
                         break;
 
                 found = true;
@@ -120,17 +136,21 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
                         /* Optimize the case where we don't need to store any addresses, by storing
                          * only the name in a dedicated Set instead of the hashmap */
 
-                        r = set_ensure_consume(&hosts->no_address, &dns_name_hash_ops, TAKE_PTR(name));
+                        r = set_ensure_put(&hosts->no_address, &dns_name_hash_ops, name);
                         if (r < 0)
-                                return r;
+                                return log_oom();
 
                         continue;
                 }
 
-                r = strv_extend(&item->names, name);
-                if (r < 0)
+                /* Blocklists tend to map huge numbers of names to the same address, hence keep track of the
+                 * allocated size here, instead of using a strv */
+                if (!GREEDY_REALLOC(item->names, item->n_allocated, item->n_names + 2))
                         return log_oom();
 
+                item->names[item->n_names++] = name;
+                item->names[item->n_names] = NULL;
+
                 bn = hashmap_get(hosts->by_name, name);
                 if (!bn) {
                         r = hashmap_ensure_allocated(&hosts->by_name, &dns_name_hash_ops);
@@ -147,7 +167,7 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
                                 return log_oom();
                         }
 
-                        bn->name = TAKE_PTR(name);
+                        bn->name = name;
                 }
 
                 if (!GREEDY_REALLOC(bn->addresses, bn->n_allocated, bn->n_addresses + 1))
@@ -162,20 +182,62 @@ static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
         return 0;
 }
 
+static int read_hosts_file(FILE *f, char **ret, size_t *ret_size) {
+        _cleanup_free_ char *buf = NULL;
+        size_t n = 0, allocated = 0;
+
+        assert(f);
+        assert(ret);
+        assert(ret_size);
+
+        /* Unlike read_full_stream() this doesn't enforce an upper limit on the size, since ad blocking lists
+         * in /etc/hosts routinely grow beyond a few MiB */
+
+        for (;;) {
+                size_t k;
+
+                if (!GREEDY_REALLOC(buf, allocated, n + LINE_MAX + 1))
+                        return -ENOMEM;
+
+                errno = 0;
+                k = fread(buf + n, 1, allocated - n - 1, f);
+                n += k;
+                if (k == 0) {
+                        if (ferror(f))
+                                return errno_or_else(EIO);
+                        break;
+                }
+        }
+
+        buf[n] = 0;
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = n;
+        return 0;
+}
+
 int etc_hosts_parse(EtcHosts *hosts, FILE *f) {
         _cleanup_(etc_hosts_free) EtcHosts t = {};
         unsigned nr = 0;
+        size_t size;
+        char *p;
         int r;
 
-        for (;;) {
-                _cleanup_free_ char *line = NULL;
-                char *l;
+        /* Read the whole file in one go, and split it up in place. The entries refer to the names in this
+         * buffer, so that there's no need to allocate each of them separately. */
+        r = read_hosts_file(f, &t.data, &size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read /etc/hosts: %m");
 
-                r = read_line(f, LONG_LINE_MAX, &line);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to read /etc/hosts: %m");
-                if (r == 0)
-                        break;
+        for (p = t.data; p < t.data + size; ) {
+                char *line = p, *l;
+
+                l = memchr(p, '\n', t.data + size - p);
+                if (l) {
+                        *l = 0;
+                        p = l + 1;
+                } else
+                        p = t.data + size;
 
                 nr++;
 
@@ -218,6 +280,7 @@ static int manager_etc_hosts_read(Manager *m) {
                                 return log_error_errno(errno, "Failed to stat /etc/hosts: %m");
 
                         manager_etc_hosts_flush(m);
+                        dns_stub_cache_flush(&m->dns_stub_cache);
                         return 0;
                 }
 
@@ -233,6 +296,7 @@ static int manager_etc_hosts_read(Manager *m) {
                         return log_error_errno(errno, "Failed to open /etc/hosts: %m");
 
                 manager_etc_hosts_flush(m);
+                dns_stub_cache_flush(&m->dns_stub_cache);
                 return 0;
         }
 
@@ -246,6 +310,9 @@ static int manager_etc_hosts_read(Manager *m) {
         if (r < 0)
                 return r;
 
+        /* Replies cached by the stub resolver might be for names that are now listed */
+        dns_stub_cache_flush(&m->dns_stub_cache);
+
         m->etc_hosts_mtime = timespec_load(&st.st_mtim);
         m->etc_hosts_ino = st.st_ino;
         m->etc_hosts_dev = st.st_dev;
@@ -306,7 +373,7 @@ int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
                 if (found_ptr) {
                         char **n;
 
-                        r = dns_answer_reserve(answer, strv_length(item->names));
+                        r = dns_answer_reserve(answer, item->n_names);
                         if (r < 0)
                                 return r;
 
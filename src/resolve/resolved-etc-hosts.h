@@ -5,10 +5,12 @@
 #include "resolved-dns-question.h"
 #include "resolved-dns-answer.h"
 
+/* All names point into EtcHosts.data, i.e. the contents of the file, which are kept around for this purpose */
 typedef struct EtcHostsItem {
         struct in_addr_data address;
 
         char **names;
+        size_t n_names, n_allocated;
 } EtcHostsItem;
 
 typedef struct EtcHostsItemByName {
@@ -124,7 +124,7 @@ void link_allocate_scopes(Link *l) {
                 /* Also, flush the global unicast scope, to deal with split horizon setups, where talking through one
                  * interface reveals different DNS zones than through others. */
                 if (l->manager->unicast_scope)
-                        dns_cache_flush(&l->manager->unicast_scope->cache);
+                        dns_scope_flush_cache(l->manager->unicast_scope);
         }
 
         /* And now, allocate all scopes that makes sense now if we didn't have them yet, and drop those which we don't
@@ -137,6 +137,8 @@ void link_allocate_scopes(Link *l) {
                         r = dns_scope_new(l->manager, &l->unicast_scope, l, DNS_PROTOCOL_DNS, AF_UNSPEC);
                         if (r < 0)
                                 log_warning_errno(r, "Failed to allocate DNS scope: %m");
+                        else
+                                dns_scope_restore_cache(l->unicast_scope);
                 }
         } else
                 l->unicast_scope = dns_scope_free(l->unicast_scope);
@@ -449,7 +451,7 @@ void link_set_dnssec_mode(Link *l, DnssecMode mode) {
                 /* When switching from non-DNSSEC mode to DNSSEC mode, flush the cache. Also when switching from the
                  * allow-downgrade mode to full DNSSEC mode, flush it too. */
                 if (l->unicast_scope)
-                        dns_cache_flush(&l->unicast_scope->cache);
+                        dns_scope_flush_cache(l->unicast_scope);
         }
 
         l->dnssec_mode = mode;
@@ -749,7 +751,7 @@ DnsServer* link_set_dns_server(Link *l, DnsServer *s) {
         l->current_dns_server = dns_server_ref(s);
 
         if (l->unicast_scope)
-                dns_cache_flush(&l->unicast_scope->cache);
+                dns_scope_flush_cache(l->unicast_scope);
 
         return s;
 }
@@ -44,6 +44,9 @@
 
 #define SEND_TIMEOUT_USEC (200 * USEC_PER_MSEC)
 
+#define CACHE_FILE_PATH "/var/cache/systemd/resolved/cache"
+#define CACHE_FILE_SAVE_INTERVAL_USEC (15 * USEC_PER_MINUTE)
+
 static int manager_process_link(sd_netlink *rtnl, sd_netlink_message *mm, void *userdata) {
         Manager *m = userdata;
         uint16_t type;
@@ -502,6 +505,78 @@ static int manager_watch_hostname(Manager *m) {
         return 0;
 }
 
+static int on_cache_file_save(sd_event_source *s, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        (void) manager_save_cache(m);
+
+        r = sd_event_source_set_time_relative(s, CACHE_FILE_SAVE_INTERVAL_USEC);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to rearm cache save timer, not saving the cache periodically anymore: %m");
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static int manager_cache_file_setup(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (!m->persistent_cache || m->enable_cache == DNS_CACHE_MODE_NO)
+                return 0;
+
+        r = dns_cache_file_load(&m->cache_file, CACHE_FILE_PATH);
+        if (r < 0)
+                log_warning_errno(r, "Failed to load saved cache entries from %s, ignoring: %m", CACHE_FILE_PATH);
+
+        r = sd_event_add_time_relative(
+                        m->event,
+                        &m->cache_file_event_source,
+                        clock_boottime_or_monotonic(),
+                        CACHE_FILE_SAVE_INTERVAL_USEC, USEC_PER_MINUTE,
+                        on_cache_file_save, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->cache_file_event_source, "cache-file-save");
+
+        return 0;
+}
+
+int manager_save_cache(Manager *m) {
+        _cleanup_(dns_cache_file_clear) DnsCacheFile f = {};
+        DnsScope *s;
+        int r;
+
+        assert(m);
+
+        if (!m->persistent_cache || m->enable_cache == DNS_CACHE_MODE_NO)
+                return 0;
+
+        f.timestamp = now(CLOCK_REALTIME);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                r = dns_scope_save_cache(s, &f);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to serialize cache: %m");
+        }
+
+        r = dns_cache_file_merge(&f, &m->cache_file);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to serialize cache: %m");
+
+        r = dns_cache_file_save(&f, CACHE_FILE_PATH);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to save cache to %s: %m", CACHE_FILE_PATH);
+
+        log_debug("Saved cache to %s.", CACHE_FILE_PATH);
+        return 0;
+}
+
 static int manager_sigusr1(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         _cleanup_free_ char *buffer = NULL;
         _cleanup_fclose_ FILE *f = NULL;
@@ -530,6 +605,8 @@ static int manager_sigusr1(sd_event_source *s, const struct signalfd_siginfo *si
                 LIST_FOREACH(servers, server, l->dns_servers)
                         dns_server_dump(server, f);
 
+        dns_stub_dump(m, f);
+
         if (fflush_and_check(f) < 0)
                 return log_oom();
 
@@ -625,6 +702,11 @@ int manager_new(Manager **ret) {
         if (r < 0)
                 log_warning_errno(r, "Failed to load DNS-SD configuration files: %m");
 
+        /* Load saved cache entries before any scope shows up */
+        r = manager_cache_file_setup(m);
+        if (r < 0)
+                return r;
+
         r = dns_scope_new(m, &m->unicast_scope, NULL, DNS_PROTOCOL_DNS, AF_UNSPEC);
         if (r < 0)
                 return r;
@@ -665,6 +747,12 @@ int manager_start(Manager *m) {
         if (r < 0)
                 return r;
 
+        /* The global servers are known only once resolv.conf was read */
+        if (!hashmap_isempty(m->cache_file.sections)) {
+                (void) manager_read_resolv_conf(m);
+                dns_scope_restore_cache(m->unicast_scope);
+        }
+
         return 0;
 }
 
@@ -708,6 +796,9 @@ Manager *manager_free(Manager *m) {
         manager_llmnr_stop(m);
         manager_mdns_stop(m);
         manager_dns_stub_stop(m);
+        dns_stub_cache_flush(&m->dns_stub_cache);
+        dns_cache_file_clear(&m->cache_file);
+        sd_event_source_unref(m->cache_file_event_source);
         manager_varlink_done(m);
 
         ordered_set_free(m->dns_extra_stub_listeners);
@@ -739,6 +830,7 @@ Manager *manager_free(Manager *m) {
         hashmap_free(m->dnssd_services);
 
         dns_trust_anchor_flush(&m->trust_anchor);
+        dnssec_verify_cache_flush(&m->dnssec_verify_cache);
         manager_etc_hosts_flush(m);
 
         return mfree(m);
@@ -1434,7 +1526,12 @@ void manager_flush_caches(Manager *m) {
         assert(m);
 
         LIST_FOREACH(scopes, scope, m->dns_scopes)
-                dns_cache_flush(&scope->cache);
+                dns_scope_flush_cache(scope);
+
+        /* Don't bring back what was just flushed on the next start */
+        dns_cache_file_clear(&m->cache_file);
+        if (m->persistent_cache && unlink(CACHE_FILE_PATH) < 0 && errno != ENOENT)
+                log_warning_errno(errno, "Failed to remove %s, ignoring: %m", CACHE_FILE_PATH);
 
         log_info("Flushed all caches.");
 }
@@ -18,6 +18,8 @@ typedef struct Manager Manager;
 #include "resolved-dns-query.h"
 #include "resolved-dns-search-domain.h"
 #include "resolved-dns-stream.h"
+#include "resolved-dns-cache-file.h"
+#include "resolved-dns-stub-cache.h"
 #include "resolved-dns-stub.h"
 #include "resolved-dns-trust-anchor.h"
 #include "resolved-link.h"
@@ -29,6 +31,7 @@ typedef struct EtcHosts {
         Hashmap *by_address;
         Hashmap *by_name;
         Set *no_address;
+        char *data;
 } EtcHosts;
 
 struct Manager {
@@ -39,6 +42,9 @@ struct Manager {
         DnssecMode dnssec_mode;
         DnsOverTlsMode dns_over_tls_mode;
         DnsCacheMode enable_cache;
+        unsigned cache_size_max;
+        usec_t connection_idle_timeout_usec;
+        bool persistent_cache;
         DnsStubListenerMode dns_stub_listener_mode;
 
 #if ENABLE_DNS_OVER_TLS
@@ -78,6 +84,7 @@ struct Manager {
         struct stat resolv_conf_stat;
 
         DnsTrustAnchor trust_anchor;
+        DnssecVerifyCache dnssec_verify_cache;
 
         LIST_HEAD(DnsScope, dns_scopes);
         DnsScope *unicast_scope;
@@ -124,6 +131,7 @@ struct Manager {
         sd_event_source *sigrtmin1_event_source;
 
         unsigned n_transactions_total;
+        unsigned n_prefetch_transactions;
         unsigned n_dnssec_verdict[_DNSSEC_VERDICT_MAX];
 
         /* Data from /etc/hosts */
@@ -138,6 +146,12 @@ struct Manager {
         /* Local DNS stub on 127.0.0.53:53 */
         sd_event_source *dns_stub_udp_event_source;
         sd_event_source *dns_stub_tcp_event_source;
+        DnsStubStatistics dns_stub_statistics;
+        DnsStubCache dns_stub_cache;
+
+        /* Cache entries saved by a previous instance, for scopes that didn't show up yet */
+        DnsCacheFile cache_file;
+        sd_event_source *cache_file_event_source;
 
         Hashmap *polkit_registry;
 
@@ -188,6 +202,7 @@ void manager_dnssec_verdict(Manager *m, DnssecVerdict verdict, const DnsResource
 bool manager_routable(Manager *m, int family);
 
 void manager_flush_caches(Manager *m);
+int manager_save_cache(Manager *m);
 void manager_reset_server_features(Manager *m);
 
 void manager_cleanup_saved_user(Manager *m);
@@ -299,6 +299,7 @@ static void test_dnssec_verify_rrset(void) {
 
         _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *a = NULL, *rrsig = NULL, *dnskey = NULL;
         _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnssecVerifyCache cache = {};
         DnssecResult result;
 
         a = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, "nAsA.gov");
@@ -349,6 +350,37 @@ static void test_dnssec_verify_rrset(void) {
         /* Validate the RR as it if was 2015-12-2 today */
         assert_se(dnssec_verify_rrset(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &result) >= 0);
         assert_se(result == DNSSEC_VALIDATED);
+
+        /* The second verification is answered from the cache */
+        assert_se(dnssec_verify_rrset_full(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &cache, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+        assert_se(dnssec_verify_cache_size(&cache) == 1);
+        assert_se(cache.n_miss == 1 && cache.n_hit == 0);
+        assert_se(dnssec_verify_rrset_full(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &cache, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+        assert_se(cache.n_miss == 1 && cache.n_hit == 1);
+
+        /* Expiry is still checked for cached signatures */
+        assert_se(dnssec_verify_rrset_full(answer, a->key, rrsig, dnskey, 1549092754*USEC_PER_SEC, &cache, &result) >= 0);
+        assert_se(result == DNSSEC_SIGNATURE_EXPIRED);
+
+        /* A different signature is verified separately, and found invalid */
+        ((uint8_t*) rrsig->rrsig.signature)[0] ^= 0x01;
+        assert_se(dnssec_verify_rrset_full(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &cache, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+        assert_se(dnssec_verify_cache_size(&cache) == 2);
+        assert_se(cache.n_miss == 2 && cache.n_hit == 1);
+        assert_se(dnssec_verify_rrset_full(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &cache, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+        assert_se(cache.n_miss == 2 && cache.n_hit == 2);
+
+        ((uint8_t*) rrsig->rrsig.signature)[0] ^= 0x01;
+        assert_se(dnssec_verify_rrset_full(answer, a->key, rrsig, dnskey, 1449092754*USEC_PER_SEC, &cache, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+        assert_se(cache.n_hit == 3);
+
+        dnssec_verify_cache_flush(&cache);
+        assert_se(dnssec_verify_cache_size(&cache) == 0);
 }
 
 static void test_dnssec_verify_rrset2(void) {
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "fileio.h"
+#include "fs-util.h"
+#include "resolved-dns-cache-file.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void add_a(DnsAnswer **answer, const char *name, uint32_t ttl, uint32_t address, DnsAnswerFlags flags) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+
+        assert_se(rr = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, name));
+        rr->ttl = ttl;
+        rr->a.in_addr.s_addr = htobe32(address);
+        assert_se(dns_answer_add_extend(answer, rr, 0, DNS_ANSWER_CACHEABLE | flags) >= 0);
+}
+
+static void assert_rr(DnsAnswer *answer, const char *name, uint32_t ttl, bool authenticated) {
+        DnsAnswerFlags flags;
+        DnsResourceRecord *rr;
+
+        DNS_ANSWER_FOREACH_FLAGS(rr, flags, answer)
+                if (streq(dns_resource_key_name(rr->key), name)) {
+                        log_debug("%s (expected TTL %" PRIu32 ")", dns_resource_record_to_string(rr), ttl);
+                        assert_se(rr->ttl == ttl);
+                        assert_se(FLAGS_SET(flags, DNS_ANSWER_AUTHENTICATED) == authenticated);
+                        return;
+                }
+
+        assert_not_reached("record not found");
+}
+
+static void test_cache_file(void) {
+        _cleanup_(unlink_tempfilep) char path[] = "/tmp/test-resolved-cache-file.XXXXXX";
+        _cleanup_(dns_answer_unrefp) DnsAnswer *link = NULL, *global = NULL, *large = NULL, *answer = NULL;
+        _cleanup_(dns_cache_file_clear) DnsCacheFile f = {}, g = {};
+        usec_t ts = 1000 * USEC_PER_SEC;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(close(mkostemp_safe(path)) >= 0);
+
+        add_a(&link, "www.example.com", 100, 0x7f000001, DNS_ANSWER_AUTHENTICATED);
+        add_a(&link, "example.com", 10, 0x7f000002, 0);
+        add_a(&global, "foo.example.org", 3600, 0x7f000003, 0);
+
+        /* Enough records to need several chunks */
+        for (unsigned i = 0; i < 2000; i++) {
+                char name[DECIMAL_STR_MAX(unsigned) + STRLEN("host.example.net") + 1];
+
+                xsprintf(name, "host%u.example.net", i);
+                add_a(&large, name, 300 + i, i, 0);
+        }
+
+        f.timestamp = ts;
+        assert_se(dns_cache_file_add(&f, "eth0", 42, link) == 1);
+        assert_se(dns_cache_file_add(&f, "*", 43, global) == 1);
+        assert_se(dns_cache_file_add(&f, "wlan0", 44, large) == 1);
+        assert_se(dns_cache_file_add(&f, "empty", 45, NULL) == 0);
+        assert_se(dns_cache_file_save(&f, path) >= 0);
+        dns_cache_file_clear(&f);
+
+        assert_se(dns_cache_file_load(&f, path) > 0);
+        assert_se(f.timestamp == ts);
+
+        /* The TTLs are counted down by the time since the file was written, expired records are dropped */
+        assert_se(dns_cache_file_take(&f, "eth0", 42, ts + 20 * USEC_PER_SEC, &answer) == 1);
+        assert_se(dns_answer_size(answer) == 1);
+        assert_rr(answer, "www.example.com", 80, true);
+        answer = dns_answer_unref(answer);
+
+        /* Sections are used only once */
+        assert_se(dns_cache_file_take(&f, "eth0", 42, ts, &answer) == 0);
+        assert_se(!answer);
+
+        /* … and not at all if the servers changed */
+        assert_se(dns_cache_file_take(&f, "*", 1, ts, &answer) == 0);
+        assert_se(!answer);
+        assert_se(dns_cache_file_take(&f, "*", 43, ts, &answer) == 0);
+
+        /* Sections not used yet are carried over when the file is written again */
+        g.timestamp = ts + 100 * USEC_PER_SEC;
+        assert_se(dns_cache_file_merge(&g, &f) >= 0);
+        assert_se(dns_cache_file_save(&g, path) >= 0);
+        dns_cache_file_clear(&g);
+        dns_cache_file_clear(&f);
+
+        assert_se(dns_cache_file_load(&f, path) > 0);
+        assert_se(dns_cache_file_take(&f, "wlan0", 44, ts + 100 * USEC_PER_SEC, &answer) == 1);
+        assert_se(dns_answer_size(answer) == 2000);
+        assert_rr(answer, "host0.example.net", 200, false);
+        assert_rr(answer, "host1999.example.net", 2199, false);
+        answer = dns_answer_unref(answer);
+
+        /* Garbage is refused */
+        assert_se(write_string_file(path, "RSLVCCH1\x01\x02\x03\x04\x05\x06\x07\x08\x09", WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+        assert_se(dns_cache_file_load(&f, path) == -EBADMSG);
+        assert_se(write_string_file(path, "RSLVCCH0", WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+        assert_se(dns_cache_file_load(&f, path) == -EBADMSG);
+        assert_se(unlink(path) >= 0);
+        assert_se(dns_cache_file_load(&f, path) == 0);
+}
+
+int main(int argc, char **argv) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_cache_file();
+
+        return 0;
+}
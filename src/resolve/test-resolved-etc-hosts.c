@@ -127,6 +127,47 @@ static void test_parse_etc_hosts(void) {
         assert_se(!set_contains(hosts.no_address, "foobar.foo.foo"));
 }
 
+static void test_parse_etc_hosts_many_names(void) {
+        _cleanup_(unlink_tempfilep) char
+                t[] = "/tmp/test-resolved-etc-hosts.XXXXXX";
+        _cleanup_(etc_hosts_free) EtcHosts hosts = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        EtcHostsItemByName *bn;
+        EtcHostsItem *item;
+        int fd;
+
+        log_info("/* %s */", __func__);
+
+        fd = mkostemp_safe(t);
+        assert_se(fd >= 0);
+
+        assert_se(f = fdopen(fd, "r+"));
+
+        /* Lots of names for the same address, and no trailing newline */
+        for (unsigned i = 0; i < 1000; i++)
+                fprintf(f, "127.0.0.1 name%u.example.com alias%u\n", i, i);
+        fputs("127.0.0.1 last.example.com", f);
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        assert_se(etc_hosts_parse(&hosts, f) == 0);
+
+        assert_se(hashmap_size(hosts.by_address) == 1);
+        assert_se(item = hashmap_first(hosts.by_address));
+        assert_se(item->n_names == 2001);
+        assert_se(strv_length(item->names) == 2001);
+        assert_se(streq(item->names[0], "name0.example.com"));
+        assert_se(streq(item->names[1], "alias0"));
+        assert_se(streq(item->names[2000], "last.example.com"));
+
+        assert_se(hashmap_size(hosts.by_name) == 2001);
+        assert_se(bn = hashmap_get(hosts.by_name, "alias999"));
+        assert_se(bn->n_addresses == 1);
+        assert_se(address_equal_4(bn->addresses[0], inet_addr("127.0.0.1")));
+        assert_se(bn = hashmap_get(hosts.by_name, "last.example.com"));
+        assert_se(bn->n_addresses == 1);
+}
+
 static void test_parse_file(const char *fname) {
         _cleanup_(etc_hosts_free) EtcHosts hosts = {};
         _cleanup_fclose_ FILE *f;
@@ -143,6 +184,7 @@ int main(int argc, char **argv) {
         if (argc == 1) {
                 test_parse_etc_hosts_system();
                 test_parse_etc_hosts();
+                test_parse_etc_hosts_many_names();
         } else
                 test_parse_file(argv[1]);
 
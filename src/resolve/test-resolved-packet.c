@@ -3,6 +3,7 @@
 #include "log.h"
 #include "resolved-dns-packet.h"
 #include "tests.h"
+#include "time-util.h"
 
 static void test_dns_packet_new(void) {
         size_t i;
@@ -23,10 +24,102 @@ static void test_dns_packet_new(void) {
         assert_se(dns_packet_new(&p2, DNS_PROTOCOL_DNS, DNS_PACKET_SIZE_MAX + 1, DNS_PACKET_SIZE_MAX) == -EFBIG);
 }
 
+static DnsPacket *make_reply(unsigned n_a) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *cname = NULL, *aaaa = NULL;
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        DnsPacket *copy;
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_A, "www.example.com"));
+        assert_se(dns_packet_append_key(p, key, 0, NULL) >= 0);
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(1);
+
+        assert_se(cname = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_CNAME, "www.example.com"));
+        cname->ttl = 100;
+        assert_se(cname->cname.name = strdup("example.com"));
+        assert_se(dns_packet_append_rr(p, cname, 0, NULL, NULL) >= 0);
+
+        for (unsigned i = 0; i < n_a; i++) {
+                _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *a = NULL;
+
+                assert_se(a = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, "example.com"));
+                a->ttl = 300;
+                a->a.in_addr.s_addr = htobe32(0x7f000001 + i);
+                assert_se(dns_packet_append_rr(p, a, 0, NULL, NULL) >= 0);
+        }
+
+        assert_se(aaaa = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_AAAA, "example.com"));
+        aaaa->ttl = 300;
+        aaaa->aaaa.in6_addr = in6addr_loopback;
+        assert_se(dns_packet_append_rr(p, aaaa, 0, NULL, NULL) >= 0);
+        DNS_PACKET_HEADER(p)->ancount = htobe16(n_a + 2);
+
+        DNS_PACKET_HEADER(p)->flags = htobe16(DNS_PACKET_MAKE_FLAGS(1, 0, 0, 0, 1, 1, 0, 0, DNS_RCODE_SUCCESS));
+
+        /* Parse a copy, so that nothing is left over from building the packet */
+        assert_se(dns_packet_new(&copy, DNS_PROTOCOL_DNS, p->size, DNS_PACKET_SIZE_MAX) >= 0);
+        memcpy(DNS_PACKET_DATA(copy), DNS_PACKET_DATA(p), p->size);
+        copy->size = p->size;
+
+        return copy;
+}
+
+static void test_dns_packet_key_reuse(void) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        DnsResourceKey *a_key = NULL;
+        DnsResourceRecord *rr;
+        unsigned n_a = 0;
+
+        log_info("/* %s */", __func__);
+
+        p = make_reply(10);
+        assert_se(dns_packet_extract(p) >= 0);
+        assert_se(dns_answer_size(p->answer) == 12);
+
+        /* All A RRs refer to the name in the CNAME RR by pointers, and hence share a key, while the others
+         * don't, as their types differ */
+        DNS_ANSWER_FOREACH(rr, p->answer) {
+                log_debug("%s", dns_resource_record_to_string(rr));
+                assert_se(streq(dns_resource_key_name(rr->key), rr->key->type == DNS_TYPE_CNAME ? "www.example.com" : "example.com"));
+                assert_se(rr->key->class == DNS_CLASS_IN);
+
+                if (rr->key->type == DNS_TYPE_A) {
+                        assert_se(!a_key || a_key == rr->key);
+                        a_key = rr->key;
+                        assert_se(be32toh(rr->a.in_addr.s_addr) == 0x7f000001 + n_a);
+                        n_a++;
+                } else
+                        assert_se(rr->key != a_key && rr->key != p->question->keys[0]);
+        }
+        assert_se(n_a == 10);
+}
+
+static void test_dns_packet_extract_benchmark(void) {
+        usec_t t;
+
+        log_info("/* %s */", __func__);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < 2000; i++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+
+                p = make_reply(64);
+                assert_se(dns_packet_extract(p) >= 0);
+                assert_se(dns_answer_size(p->answer) == 66);
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Built and parsed 2000 replies with 66 RRs each in %s.", format_timespan((char[FORMAT_TIMESPAN_MAX]) {}, FORMAT_TIMESPAN_MAX, t, USEC_PER_MSEC));
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
         test_dns_packet_new();
+        test_dns_packet_key_reuse();
+        test_dns_packet_extract_benchmark();
 
         return 0;
 }
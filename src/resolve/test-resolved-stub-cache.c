@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "log.h"
+#include "resolved-dns-stub-cache.h"
+#include "tests.h"
+#include "unaligned.h"
+
+static DnsPacket *make_request(const char *name, bool edns0_do) {
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        DnsPacket *p;
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+        DNS_PACKET_HEADER(p)->id = htobe16(0x1234);
+        DNS_PACKET_HEADER(p)->flags = htobe16(DNS_PACKET_MAKE_FLAGS(0, 0, 0, 0, 1, 0, 0, 0, 0));
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_A, name));
+        assert_se(dns_packet_append_key(p, key, 0, NULL) >= 0);
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(1);
+
+        if (edns0_do) {
+                assert_se(dns_packet_append_opt(p, 4096, true, 0, NULL) >= 0);
+                DNS_PACKET_HEADER(p)->arcount = htobe16(1);
+        }
+
+        assert_se(dns_packet_extract(p) >= 0);
+        return p;
+}
+
+static DnsPacket *make_reply(DnsPacket *request, uint32_t ttl_cname, uint32_t ttl_a, bool tc) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *cname = NULL, *a = NULL;
+        DnsPacket *p;
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+        assert_se(dns_packet_append_question(p, request->question) >= 0);
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(1);
+
+        assert_se(cname = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_CNAME, "www.example.com"));
+        cname->ttl = ttl_cname;
+        assert_se(cname->cname.name = strdup("example.com"));
+        assert_se(dns_packet_append_rr(p, cname, 0, NULL, NULL) >= 0);
+
+        assert_se(a = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, "example.com"));
+        a->ttl = ttl_a;
+        a->a.in_addr.s_addr = htobe32(0x7f000001);
+        assert_se(dns_packet_append_rr(p, a, 0, NULL, NULL) >= 0);
+        DNS_PACKET_HEADER(p)->ancount = htobe16(2);
+
+        DNS_PACKET_HEADER(p)->id = DNS_PACKET_ID(request);
+        DNS_PACKET_HEADER(p)->flags = htobe16(DNS_PACKET_MAKE_FLAGS(1, 0, 0, tc, 1, 1, 0, 0, DNS_RCODE_SUCCESS));
+
+        return p;
+}
+
+static void append_extra_rr(DnsPacket *p, uint16_t type) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+
+        assert_se(rr = dns_resource_record_new_full(DNS_CLASS_IN, type, "example.com"));
+        rr->ttl = 3600;
+        if (type == DNS_TYPE_NS)
+                assert_se(rr->ns.name = strdup("ns.example.com"));
+        else
+                rr->a.in_addr.s_addr = htobe32(0x7f000002);
+        assert_se(dns_packet_append_rr(p, rr, 0, NULL, NULL) >= 0);
+}
+
+static void assert_ttls(DnsPacket *reply, uint32_t ttl_cname, uint32_t ttl_a) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *copy = NULL;
+        DnsResourceRecord *rr;
+        unsigned n = 0;
+
+        /* Parse a copy, so that the answer section is read from the wire data */
+        assert_se(dns_packet_new(&copy, DNS_PROTOCOL_DNS, reply->size, DNS_PACKET_SIZE_MAX) >= 0);
+        memcpy(DNS_PACKET_DATA(copy), DNS_PACKET_DATA(reply), DNS_PACKET_HEADER_SIZE);
+        assert_se(dns_packet_append_blob(copy, DNS_PACKET_DATA(reply) + DNS_PACKET_HEADER_SIZE, reply->size - DNS_PACKET_HEADER_SIZE, NULL) >= 0);
+        assert_se(dns_packet_extract(copy) >= 0);
+
+        DNS_ANSWER_FOREACH(rr, copy->answer) {
+                log_debug("%s", dns_resource_record_to_string(rr));
+                assert_se(rr->ttl == (rr->key->type == DNS_TYPE_CNAME ? ttl_cname : ttl_a));
+                n++;
+        }
+        assert_se(n == 2);
+}
+
+static void test_stub_cache(void) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *request = NULL, *other_case = NULL, *dnssec_ok = NULL, *reply = NULL, *found = NULL;
+        DnsStubCache c = {};
+        usec_t ts = 10 * USEC_PER_SEC;
+
+        log_info("/* %s */", __func__);
+
+        request = make_request("www.example.com", false);
+        other_case = make_request("WWW.example.com", false);
+        dnssec_ok = make_request("www.example.com", true);
+
+        /* Nothing is cached for answers without TTL, or truncated ones */
+        reply = make_reply(request, 0, 300, false);
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 0);
+        reply = dns_packet_unref(reply);
+        reply = make_reply(request, 100, 300, true);
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 0);
+        reply = dns_packet_unref(reply);
+
+        /* Only the TTLs of the answer section are rewritten, hence nothing else but an OPT RR may be there */
+        reply = make_reply(request, 100, 300, false);
+        append_extra_rr(reply, DNS_TYPE_NS);
+        DNS_PACKET_HEADER(reply)->nscount = htobe16(1);
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 0);
+        reply = dns_packet_unref(reply);
+        reply = make_reply(request, 100, 300, false);
+        append_extra_rr(reply, DNS_TYPE_A);
+        DNS_PACKET_HEADER(reply)->arcount = htobe16(1);
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 0);
+        reply = dns_packet_unref(reply);
+        assert_se(dns_stub_cache_size(&c) == 0);
+
+        reply = make_reply(request, 100, 300, false);
+        assert_se(dns_packet_append_opt(reply, 4096, false, 0, NULL) >= 0);
+        DNS_PACKET_HEADER(reply)->arcount = htobe16(1);
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 1);
+        reply = dns_packet_unref(reply);
+        dns_stub_cache_flush(&c);
+
+        reply = make_reply(request, 100, 300, false);
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 1);
+        assert_se(dns_stub_cache_size(&c) == 1);
+
+        /* TTLs are counted down, and the ID is taken from the request */
+        DNS_PACKET_HEADER(request)->id = htobe16(0x4321);
+        assert_se(dns_stub_cache_lookup(&c, request, ts + 5 * USEC_PER_SEC + 1, &found) == 1);
+        assert_se(DNS_PACKET_ID(found) == htobe16(0x4321));
+        assert_ttls(found, 95, 295);
+        found = dns_packet_unref(found);
+
+        /* The question is repeated as it was asked, hence names are compared case-sensitively, and the EDNS0 bits
+         * are part of the key */
+        assert_se(dns_stub_cache_lookup(&c, other_case, ts, &found) == 0);
+        assert_se(dns_stub_cache_lookup(&c, dnssec_ok, ts, &found) == 0);
+
+        /* The smallest TTL determines how long the reply is used */
+        assert_se(dns_stub_cache_lookup(&c, request, ts + 99 * USEC_PER_SEC, &found) == 1);
+        assert_ttls(found, 1, 201);
+        found = dns_packet_unref(found);
+        assert_se(dns_stub_cache_lookup(&c, request, ts + 100 * USEC_PER_SEC, &found) == 0);
+        assert_se(dns_stub_cache_size(&c) == 0);
+
+        assert_se(dns_stub_cache_put(&c, request, reply, ts) == 1);
+        assert_se(dns_stub_cache_put(&c, other_case, reply, ts) == 1);
+        assert_se(dns_stub_cache_size(&c) == 2);
+        dns_stub_cache_flush(&c);
+        assert_se(dns_stub_cache_size(&c) == 0);
+        assert_se(dns_stub_cache_lookup(&c, request, ts, &found) == 0);
+}
+
+int main(int argc, char **argv) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_stub_cache();
+
+        return 0;
+}
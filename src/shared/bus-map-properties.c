@@ -118,6 +118,41 @@ static int map_basic(sd_bus *bus, const char *member, sd_bus_message *m, unsigne
         return -EOPNOTSUPP;
 }
 
+int bus_message_map_property(
+                sd_bus_message *m,
+                const struct bus_properties_map *prop,
+                unsigned flags,
+                sd_bus_error *error,
+                void *userdata) {
+
+        const char *contents;
+        void *v;
+        int r;
+
+        assert(m);
+        assert(prop);
+
+        /* Maps the value of a single property, the next thing to read from the message must be its variant */
+
+        r = sd_bus_message_peek_type(m, NULL, &contents);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_enter_container(m, SD_BUS_TYPE_VARIANT, contents);
+        if (r < 0)
+                return r;
+
+        v = (uint8_t *)userdata + prop->offset;
+        if (prop->set)
+                r = prop->set(sd_bus_message_get_bus(m), prop->member, m, error, v);
+        else
+                r = map_basic(sd_bus_message_get_bus(m), prop->member, m, flags, error, v);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_exit_container(m);
+}
+
 int bus_message_map_all_properties(
                 sd_bus_message *m,
                 const struct bus_properties_map *map,
@@ -137,8 +172,6 @@ int bus_message_map_all_properties(
         while ((r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
                 const struct bus_properties_map *prop;
                 const char *member;
-                const char *contents;
-                void *v;
                 unsigned i;
 
                 r = sd_bus_message_read_basic(m, SD_BUS_TYPE_STRING, &member);
@@ -152,23 +185,7 @@ int bus_message_map_all_properties(
                         }
 
                 if (prop) {
-                        r = sd_bus_message_peek_type(m, NULL, &contents);
-                        if (r < 0)
-                                return r;
-
-                        r = sd_bus_message_enter_container(m, SD_BUS_TYPE_VARIANT, contents);
-                        if (r < 0)
-                                return r;
-
-                        v = (uint8_t *)userdata + prop->offset;
-                        if (map[i].set)
-                                r = prop->set(sd_bus_message_get_bus(m), member, m, error, v);
-                        else
-                                r = map_basic(sd_bus_message_get_bus(m), member, m, flags, error, v);
-                        if (r < 0)
-                                return r;
-
-                        r = sd_bus_message_exit_container(m);
+                        r = bus_message_map_property(m, prop, flags, error, userdata);
                         if (r < 0)
                                 return r;
                 } else {
@@ -227,3 +244,101 @@ int bus_map_all_properties(
 
         return r;
 }
+
+typedef struct BusGetAllCall {
+        sd_bus_slot *slot;
+        sd_bus_message *reply;
+        size_t *n_pending;
+} BusGetAllCall;
+
+static int get_all_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        BusGetAllCall *c = userdata;
+
+        assert(m);
+        assert(c);
+
+        c->reply = sd_bus_message_ref(m);
+        c->slot = sd_bus_slot_unref(c->slot);
+        (*c->n_pending)--;
+
+        return 0;
+}
+
+int bus_get_all_properties_many(
+                sd_bus *bus,
+                const char *destination,
+                char **paths,
+                sd_bus_message ***ret_replies) {
+
+        _cleanup_free_ BusGetAllCall *calls = NULL;
+        sd_bus_message **replies;
+        size_t n, n_pending = 0, i;
+        int r;
+
+        assert(bus);
+        assert(destination);
+        assert(ret_replies);
+
+        /* Queues a GetAll() call for each of the objects and only then waits for the replies, so that the
+         * round trips to the service overlap instead of being serialized. On success an array with one
+         * reply per path is returned, in the same order. Objects that could not be queried are
+         * represented by the error reply, use sd_bus_message_is_method_error() to tell them apart. */
+
+        n = strv_length(paths);
+
+        calls = new0(BusGetAllCall, n);
+        if (!calls)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                calls[i].n_pending = &n_pending;
+
+                r = sd_bus_call_method_async(
+                                bus,
+                                &calls[i].slot,
+                                destination,
+                                paths[i],
+                                "org.freedesktop.DBus.Properties",
+                                "GetAll",
+                                get_all_reply,
+                                calls + i,
+                                "s", "");
+                if (r < 0)
+                        goto fail;
+
+                n_pending++;
+        }
+
+        while (n_pending > 0) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        goto fail;
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r < 0)
+                        goto fail;
+        }
+
+        replies = new(sd_bus_message*, n + 1);
+        if (!replies) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        for (i = 0; i < n; i++)
+                replies[i] = calls[i].reply;
+        replies[n] = NULL;
+
+        *ret_replies = replies;
+        return 0;
+
+fail:
+        for (i = 0; i < n; i++) {
+                sd_bus_slot_unref(calls[i].slot);
+                sd_bus_message_unref(calls[i].reply);
+        }
+
+        return r;
+}
@@ -0,0 +1,566 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "bus-property-cache.h"
+#include "hashmap.h"
+#include "path-util.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
+
+typedef struct CacheObject {
+        BusPropertyCache *cache;
+        char *path;
+
+        /* The map entries of properties that were invalidated, and need to be fetched again */
+        Set *invalidated;
+
+        void *data;
+} CacheObject;
+
+struct BusPropertyCache {
+        sd_bus *bus;
+        char *destination;
+        char *path_prefix;
+        char *interface;
+
+        const struct bus_properties_map *map;
+        size_t object_size;
+        bus_property_cache_done_t done;
+
+        sd_bus_slot *slot_properties_changed;
+        sd_bus_slot *slot_interfaces_added;
+        sd_bus_slot *slot_interfaces_removed;
+        sd_bus_slot *slot_name_owner_changed;
+
+        Hashmap *objects;
+};
+
+static CacheObject* cache_object_free(CacheObject *o) {
+        if (!o)
+                return NULL;
+
+        if (o->cache)
+                hashmap_remove(o->cache->objects, o->path);
+
+        if (o->data) {
+                if (o->cache && o->cache->done)
+                        o->cache->done(o->data);
+
+                free(o->data);
+        }
+
+        set_free(o->invalidated);
+        free(o->path);
+
+        return mfree(o);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CacheObject*, cache_object_free);
+
+static const struct bus_properties_map* cache_find_property(BusPropertyCache *c, const char *member) {
+        const struct bus_properties_map *prop;
+
+        assert(c);
+        assert(member);
+
+        for (prop = c->map; prop->member; prop++)
+                if (streq(prop->member, member))
+                        return prop;
+
+        return NULL;
+}
+
+static int cache_object_map_property(CacheObject *o, const struct bus_properties_map *prop, sd_bus_message *m, sd_bus_error *error) {
+        int r;
+
+        assert(o);
+        assert(prop);
+        assert(m);
+
+        /* The value is replaced, not appended to, since the object may have been mapped before */
+        if (!prop->set && streq_ptr(prop->signature, "as")) {
+                char ***l = (char***) ((uint8_t*) o->data + prop->offset);
+
+                *l = strv_free(*l);
+        }
+
+        r = bus_message_map_property(m, prop, BUS_MAP_STRDUP, error, o->data);
+        if (r < 0)
+                return r;
+
+        /* We got a current value, no need to fetch it again anymore */
+        set_remove(o->invalidated, prop);
+        return 0;
+}
+
+static int cache_object_map_properties(CacheObject *o, sd_bus_message *m, sd_bus_error *error) {
+        int r;
+
+        assert(o);
+        assert(m);
+
+        r = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
+                const struct bus_properties_map *prop;
+                const char *member;
+
+                r = sd_bus_message_read_basic(m, SD_BUS_TYPE_STRING, &member);
+                if (r < 0)
+                        return r;
+
+                prop = cache_find_property(o->cache, member);
+                if (prop)
+                        r = cache_object_map_property(o, prop, m, error);
+                else
+                        r = sd_bus_message_skip(m, "v");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_exit_container(m);
+                if (r < 0)
+                        return r;
+        }
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_exit_container(m);
+}
+
+static int cache_object_new(BusPropertyCache *c, const char *path, CacheObject **ret) {
+        _cleanup_(cache_object_freep) CacheObject *o = NULL;
+        int r;
+
+        assert(c);
+        assert(path);
+        assert(ret);
+
+        o = new(CacheObject, 1);
+        if (!o)
+                return -ENOMEM;
+
+        *o = (CacheObject) {};
+
+        o->path = strdup(path);
+        if (!o->path)
+                return -ENOMEM;
+
+        o->data = malloc0(c->object_size);
+        if (!o->data)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&c->objects, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(c->objects, o->path, o);
+        if (r < 0)
+                return r;
+
+        o->cache = c;
+
+        *ret = TAKE_PTR(o);
+        return 0;
+}
+
+static int cache_object_add(BusPropertyCache *c, const char *path, sd_bus_message *m) {
+        CacheObject *o;
+        int r;
+
+        assert(c);
+        assert(path);
+        assert(m);
+
+        /* Initializes or updates an object from a complete set of properties */
+
+        o = hashmap_get(c->objects, path);
+        if (!o) {
+                r = cache_object_new(c, path, &o);
+                if (r < 0)
+                        return r;
+        }
+
+        r = cache_object_map_properties(o, m, NULL);
+        if (r < 0) {
+                /* Don't keep what we might have mapped only partially */
+                cache_object_free(o);
+                return r;
+        }
+
+        return 0;
+}
+
+static bool cache_covers_path(BusPropertyCache *c, const char *path) {
+        assert(c);
+
+        return path && path_startswith(path, c->path_prefix);
+}
+
+static int match_properties_changed(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        BusPropertyCache *c = userdata;
+        const char *path, *interface, *member;
+        CacheObject *o;
+        int r;
+
+        assert(m);
+        assert(c);
+
+        path = sd_bus_message_get_path(m);
+        if (!cache_covers_path(c, path))
+                return 0;
+
+        /* We only care about the objects that are cached already, the others are fetched on demand */
+        o = hashmap_get(c->objects, path);
+        if (!o)
+                return 0;
+
+        r = sd_bus_message_read(m, "s", &interface);
+        if (r < 0)
+                goto fail;
+
+        if (!streq(interface, c->interface))
+                return 0;
+
+        r = cache_object_map_properties(o, m, NULL);
+        if (r < 0)
+                goto fail;
+
+        r = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "s");
+        if (r < 0)
+                goto fail;
+
+        while ((r = sd_bus_message_read_basic(m, SD_BUS_TYPE_STRING, &member)) > 0) {
+                const struct bus_properties_map *prop;
+
+                prop = cache_find_property(c, member);
+                if (!prop)
+                        continue;
+
+                r = set_ensure_put(&o->invalidated, NULL, prop);
+                if (r < 0)
+                        goto fail;
+        }
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        /* If we can't follow the changes, let's fetch everything again on the next lookup */
+        log_debug_errno(r, "Failed to process PropertiesChanged signal of %s, forgetting object: %m", path);
+        cache_object_free(o);
+        return 0;
+}
+
+static int match_interfaces_added(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        BusPropertyCache *c = userdata;
+        const char *path, *interface;
+        int r;
+
+        assert(m);
+        assert(c);
+
+        r = sd_bus_message_read(m, "o", &path);
+        if (r < 0)
+                goto fail;
+
+        if (!cache_covers_path(c, path))
+                return 0;
+
+        r = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sa{sv}}");
+        if (r < 0)
+                goto fail;
+
+        while ((r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sa{sv}")) > 0) {
+                r = sd_bus_message_read(m, "s", &interface);
+                if (r < 0)
+                        goto fail;
+
+                /* The signal carries all properties, hence we can cache the object right away */
+                if (streq(interface, c->interface))
+                        r = cache_object_add(c, path, m);
+                else
+                        r = sd_bus_message_skip(m, "a{sv}");
+                if (r < 0)
+                        goto fail;
+
+                r = sd_bus_message_exit_container(m);
+                if (r < 0)
+                        goto fail;
+        }
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        log_debug_errno(r, "Failed to process InterfacesAdded signal, ignoring: %m");
+        return 0;
+}
+
+static int match_interfaces_removed(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_strv_free_ char **interfaces = NULL;
+        BusPropertyCache *c = userdata;
+        const char *path;
+        int r;
+
+        assert(m);
+        assert(c);
+
+        r = sd_bus_message_read(m, "o", &path);
+        if (r < 0)
+                goto fail;
+
+        if (!cache_covers_path(c, path))
+                return 0;
+
+        r = sd_bus_message_read_strv(m, &interfaces);
+        if (r < 0)
+                goto fail;
+
+        if (strv_contains(interfaces, c->interface))
+                bus_property_cache_forget(c, path);
+
+        return 0;
+
+fail:
+        log_debug_errno(r, "Failed to process InterfacesRemoved signal, ignoring: %m");
+        return 0;
+}
+
+static int match_name_owner_changed(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        BusPropertyCache *c = userdata;
+
+        assert(m);
+        assert(c);
+
+        /* The service went away or was restarted, nothing we know about it is current anymore */
+        bus_property_cache_flush(c);
+        return 0;
+}
+
+int bus_property_cache_new(
+                sd_bus *bus,
+                const char *destination,
+                const char *path_prefix,
+                const char *interface,
+                const struct bus_properties_map *map,
+                size_t object_size,
+                bus_property_cache_done_t done,
+                BusPropertyCache **ret) {
+
+        _cleanup_(bus_property_cache_freep) BusPropertyCache *c = NULL;
+        _cleanup_free_ char *sender = NULL, *match = NULL;
+        int r;
+
+        assert(bus);
+        assert(path_prefix);
+        assert(interface);
+        assert(map);
+        assert(object_size > 0);
+        assert(ret);
+
+        c = new(BusPropertyCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        *c = (BusPropertyCache) {
+                .bus = sd_bus_ref(bus),
+                .map = map,
+                .object_size = object_size,
+                .done = done,
+        };
+
+        if (destination) {
+                c->destination = strdup(destination);
+                if (!c->destination)
+                        return -ENOMEM;
+
+                sender = strjoin("sender='", destination, "',");
+                if (!sender)
+                        return -ENOMEM;
+        }
+
+        c->path_prefix = strdup(path_prefix);
+        c->interface = strdup(interface);
+        if (!c->path_prefix || !c->interface)
+                return -ENOMEM;
+
+        /* The matches are installed synchronously, so that we can't miss changes to objects cached
+         * afterwards. Signals from objects we haven't cached yet are simply ignored. */
+
+        match = strjoin("type='signal',",
+                        strempty(sender),
+                        "path_namespace='", path_prefix, "',"
+                        "interface='org.freedesktop.DBus.Properties',"
+                        "member='PropertiesChanged',"
+                        "arg0='", interface, "'");
+        if (!match)
+                return -ENOMEM;
+
+        r = sd_bus_add_match(bus, &c->slot_properties_changed, match, match_properties_changed, c);
+        if (r < 0)
+                return r;
+
+        /* InterfacesAdded/InterfacesRemoved are sent from the object manager, which may live further up
+         * the tree, hence match on the object path they carry instead */
+        match = mfree(match);
+        match = strjoin("type='signal',",
+                        strempty(sender),
+                        "interface='org.freedesktop.DBus.ObjectManager',"
+                        "member='InterfacesAdded',"
+                        "arg0path='", path_prefix, endswith(path_prefix, "/") ? "" : "/", "'");
+        if (!match)
+                return -ENOMEM;
+
+        r = sd_bus_add_match(bus, &c->slot_interfaces_added, match, match_interfaces_added, c);
+        if (r < 0)
+                return r;
+
+        match = mfree(match);
+        match = strjoin("type='signal',",
+                        strempty(sender),
+                        "interface='org.freedesktop.DBus.ObjectManager',"
+                        "member='InterfacesRemoved',"
+                        "arg0path='", path_prefix, endswith(path_prefix, "/") ? "" : "/", "'");
+        if (!match)
+                return -ENOMEM;
+
+        r = sd_bus_add_match(bus, &c->slot_interfaces_removed, match, match_interfaces_removed, c);
+        if (r < 0)
+                return r;
+
+        if (destination) {
+                match = mfree(match);
+                match = strjoin("type='signal',"
+                                "sender='org.freedesktop.DBus',"
+                                "path='/org/freedesktop/DBus',"
+                                "interface='org.freedesktop.DBus',"
+                                "member='NameOwnerChanged',"
+                                "arg0='", destination, "'");
+                if (!match)
+                        return -ENOMEM;
+
+                r = sd_bus_add_match(bus, &c->slot_name_owner_changed, match, match_name_owner_changed, c);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+BusPropertyCache* bus_property_cache_free(BusPropertyCache *c) {
+        if (!c)
+                return NULL;
+
+        bus_property_cache_flush(c);
+        hashmap_free(c->objects);
+
+        sd_bus_slot_unref(c->slot_properties_changed);
+        sd_bus_slot_unref(c->slot_interfaces_added);
+        sd_bus_slot_unref(c->slot_interfaces_removed);
+        sd_bus_slot_unref(c->slot_name_owner_changed);
+        sd_bus_unref(c->bus);
+
+        free(c->destination);
+        free(c->path_prefix);
+        free(c->interface);
+
+        return mfree(c);
+}
+
+static int cache_object_refresh(CacheObject *o, sd_bus_error *error) {
+        const struct bus_properties_map *prop;
+        int r;
+
+        assert(o);
+
+        /* Fetches the properties that were invalidated only, one by one */
+
+        while ((prop = set_first(o->invalidated))) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+
+                r = sd_bus_call_method(
+                                o->cache->bus,
+                                o->cache->destination,
+                                o->path,
+                                "org.freedesktop.DBus.Properties",
+                                "Get",
+                                error,
+                                &reply,
+                                "ss", o->cache->interface, prop->member);
+                if (r < 0)
+                        return r;
+
+                r = cache_object_map_property(o, prop, reply, error);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int bus_property_cache_get(BusPropertyCache *c, const char *path, sd_bus_error *error, void **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        CacheObject *o;
+        int r;
+
+        assert(c);
+        assert(path);
+        assert(ret);
+
+        if (!cache_covers_path(c, path))
+                return -EINVAL;
+
+        o = hashmap_get(c->objects, path);
+        if (o) {
+                r = cache_object_refresh(o, error);
+                if (r < 0)
+                        return r;
+
+                *ret = o->data;
+                return 0;
+        }
+
+        r = sd_bus_call_method(
+                        c->bus,
+                        c->destination,
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        error,
+                        &reply,
+                        "s", c->interface);
+        if (r < 0)
+                return r;
+
+        r = cache_object_add(c, path, reply);
+        if (r < 0)
+                return r;
+
+        o = hashmap_get(c->objects, path);
+        assert(o);
+
+        *ret = o->data;
+        return 0;
+}
+
+void bus_property_cache_forget(BusPropertyCache *c, const char *path) {
+        assert(c);
+        assert(path);
+
+        cache_object_free(hashmap_get(c->objects, path));
+}
+
+void bus_property_cache_flush(BusPropertyCache *c) {
+        CacheObject *o;
+
+        assert(c);
+
+        while ((o = hashmap_first(c->objects)))
+                cache_object_free(o);
+}
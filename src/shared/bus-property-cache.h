@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "sd-bus.h"
+
+#include "bus-map-properties.h"
+#include "macro.h"
+
+/* Caches the properties of one interface of all objects below a path prefix of a service, decoded into
+ * structures as described by a bus_properties_map table (with BUS_MAP_STRDUP semantics). The cache
+ * subscribes to PropertiesChanged and InterfacesAdded/InterfacesRemoved once, and applies the changes as
+ * they come in. Properties that are only invalidated are fetched again individually, the next time the
+ * object is looked up. Looking up an object that isn't cached yet fetches all its properties. */
+
+typedef struct BusPropertyCache BusPropertyCache;
+
+/* Called before an object's structure is freed, to release what the map allocated */
+typedef void (*bus_property_cache_done_t)(void *object);
+
+int bus_property_cache_new(
+                sd_bus *bus,
+                const char *destination,
+                const char *path_prefix,
+                const char *interface,
+                const struct bus_properties_map *map,
+                size_t object_size,
+                bus_property_cache_done_t done,
+                BusPropertyCache **ret);
+BusPropertyCache* bus_property_cache_free(BusPropertyCache *c);
+
+int bus_property_cache_get(BusPropertyCache *c, const char *path, sd_bus_error *error, void **ret);
+void bus_property_cache_forget(BusPropertyCache *c, const char *path);
+void bus_property_cache_flush(BusPropertyCache *c);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusPropertyCache*, bus_property_cache_free);
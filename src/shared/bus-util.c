@@ -199,6 +199,11 @@ int bus_connect_system_systemd(sd_bus **_bus) {
         if (r < 0)
                 return r;
 
+        /* This is a direct connection, hence large replies may be passed in memfds */
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_system(_bus);
@@ -236,6 +241,10 @@ int bus_connect_user_systemd(sd_bus **_bus) {
         if (!bus->address)
                 return -ENOMEM;
 
+        r = sd_bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_user(_bus);
@@ -1196,19 +1196,38 @@ static int tm_within_bounds(struct tm *tm, bool utc) {
         return good;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
-        struct tm t;
+static int weekday_of_date(int year, int mon, int mday) {
+        static const int offset[12] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+
+        assert(mon >= 0 && mon < 12);
+
+        /* Returns the day of the week of a normalized date in the Gregorian calendar, with 0 being Monday.
+         * The year is in tm_year notation (years since 1900), the month counts from 0. The weekday of a
+         * date does not depend on the time zone, hence there's no need to go through mktime(). */
+
+        year += 1900;
+        if (mon < 2)
+                year--;
+
+        return (year + year/4 - year/100 + year/400 + offset[mon] + mday + 6) % 7;
+}
+
+static int days_to_matching_weekday(int weekdays_bits, const struct tm *tm) {
         int k;
 
+        /* Returns how many days are left until the next day that matches the weekday bits, 0 if the day
+         * of tm matches already */
+
         if (weekdays_bits < 0 || weekdays_bits >= BITS_WEEKDAYS)
-                return true;
+                return 0;
 
-        t = *tm;
-        if (mktime_or_timegm(&t, utc) < 0)
-                return false;
+        k = weekday_of_date(tm->tm_year, tm->tm_mon, tm->tm_mday);
 
-        k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
-        return (weekdays_bits & (1 << k));
+        for (int i = 0; i < 7; i++)
+                if (weekdays_bits & (1 << ((k + i) % 7)))
+                        return i;
+
+        assert_not_reached("No weekday set in weekday bits");
 }
 
 static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
@@ -1273,8 +1292,10 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                 if (r == 0)
                         continue;
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
-                        c.tm_mday++;
+                /* Skip directly to the next matching weekday, none of the days in between can match */
+                r = days_to_matching_weekday(spec->weekdays_bits, &c);
+                if (r > 0) {
+                        c.tm_mday += r;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
@@ -1358,13 +1379,30 @@ typedef struct SpecNextResult {
         int return_value;
 } SpecNextResult;
 
+static bool calendar_spec_timezone_is_local(const CalendarSpec *spec) {
+        _cleanup_free_ char *tz = NULL;
+
+        assert(spec);
+
+        /* If the time zone of the expression is the one we are running in anyway, there's no need to fork
+         * off a child to switch to it */
+
+        if (getenv("TZ"))
+                return false;
+
+        if (get_timezone(&tz) < 0)
+                return false;
+
+        return streq(tz, spec->timezone);
+}
+
 int calendar_spec_next_usec(const CalendarSpec *spec, usec_t usec, usec_t *ret_next) {
         SpecNextResult *shared, tmp;
         int r;
 
         assert(spec);
 
-        if (isempty(spec->timezone))
+        if (isempty(spec->timezone) || calendar_spec_timezone_is_local(spec))
                 return calendar_spec_next_usec_impl(spec, usec, ret_next);
 
         shared = mmap(NULL, sizeof *shared, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
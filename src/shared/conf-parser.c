@@ -251,6 +251,43 @@ static int parse_line(
 }
 
 /* Go through the file and parse each line */
+/* Returns the next line of the buffer, terminating it in place. End-of-line markers are treated the
+ * same way as read_line() does: any combination of '\n', '\r' and NUL in which no marker repeats
+ * counts as a single line break, and a NUL always terminates the sequence. */
+static int config_next_line(char **p, char *end, char **ret) {
+        char *s, *e;
+        unsigned seen = 0;
+
+        assert(p);
+        assert(*p);
+        assert(end);
+        assert(ret);
+
+        s = *p;
+        if (s >= end)
+                return 0;
+
+        for (e = s; e < end && !IN_SET(*e, '\n', '\r', '\0'); e++)
+                ;
+
+        if ((size_t) (e - s) >= LONG_LINE_MAX)
+                return -ENOBUFS;
+
+        for (*p = e; *p < end; (*p)++) {
+                unsigned m = **p == '\n' ? 1U : **p == '\r' ? 2U : **p == '\0' ? 4U : 0U;
+
+                if (m == 0 || (seen & (m | 4U)))
+                        break;
+
+                seen |= m;
+        }
+
+        /* The buffer always has a trailing NUL byte after its end, hence this is safe even for the last line */
+        *e = 0;
+        *ret = s;
+        return 1;
+}
+
 int config_parse(const char *unit,
                  const char *filename,
                  FILE *f,
@@ -261,10 +298,12 @@ int config_parse(const char *unit,
                  void *userdata,
                  usec_t *ret_mtime) {
 
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
+        _cleanup_free_ char *section = NULL, *continuation = NULL, *contents = NULL;
         _cleanup_fclose_ FILE *ours = NULL;
         unsigned line = 0, section_line = 0;
         bool section_ignored = false, bom_seen = false;
+        char *next, *end;
+        size_t size;
         int r, fd;
         usec_t mtime;
 
@@ -295,12 +334,24 @@ int config_parse(const char *unit,
                 mtime = timespec_load(&st.st_mtim);
         }
 
+        /* Read the whole file in one go and split it into lines in place, instead of doing a separate
+         * allocation for every single line. */
+        r = read_full_stream(f, &contents, &size);
+        if (r < 0) {
+                if (FLAGS_SET(flags, CONFIG_PARSE_WARN))
+                        log_error_errno(r, "%s: Error while reading configuration file: %m", filename);
+
+                return r;
+        }
+
+        next = contents;
+        end = contents + size;
+
         for (;;) {
-                _cleanup_free_ char *buf = NULL;
                 bool escaped = false;
-                char *l, *p, *e;
+                char *buf, *l, *p, *e;
 
-                r = read_line(f, LONG_LINE_MAX, &buf);
+                r = config_next_line(&next, end, &buf);
                 if (r == 0)
                         break;
                 if (r == -ENOBUFS) {
@@ -309,12 +360,6 @@ int config_parse(const char *unit,
 
                         return r;
                 }
-                if (r < 0) {
-                        if (FLAGS_SET(flags, CONFIG_PARSE_WARN))
-                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", filename, line);
-
-                        return r;
-                }
 
                 line++;
 
@@ -419,6 +464,48 @@ int config_parse(const char *unit,
         return 0;
 }
 
+/* Same as config_parse(), but for a file whose contents were read already */
+int config_parse_buffer(
+                const char *unit,
+                const char *filename,
+                const char *data,
+                size_t size,
+                const struct stat *st,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata,
+                usec_t *ret_mtime) {
+
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        assert(filename);
+        assert(data || size == 0);
+        assert(st);
+
+        (void) stat_warn_permissions(filename, st);
+
+        /* Not all implementations of fmemopen() accept empty buffers, there's nothing to parse anyway */
+        if (size > 0) {
+                f = fmemopen_unlocked((void*) data, size, "r");
+                if (!f)
+                        return log_full_errno(FLAGS_SET(flags, CONFIG_PARSE_WARN) ? LOG_ERR : LOG_DEBUG, errno,
+                                              "Failed to open memory stream for '%s': %m", filename);
+
+                /* The stream isn't backed by an fd, hence config_parse() won't look at the file again */
+                r = config_parse(unit, filename, f, sections, lookup, table, flags, userdata, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        if (ret_mtime)
+                *ret_mtime = timespec_load(&st->st_mtim);
+
+        return 0;
+}
+
 static int config_parse_many_files(
                 const char *conf_file,
                 char **files,
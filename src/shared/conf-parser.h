@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <syslog.h>
 
 #include "alloc-util.h"
@@ -91,6 +92,19 @@ int config_parse(
                 void *userdata,
                 usec_t *ret_mtime);         /* possibly NULL */
 
+int config_parse_buffer(
+                const char *unit,
+                const char *filename,
+                const char *data,
+                size_t size,
+                const struct stat *st,      /* of the file the data was read from */
+                const char *sections,       /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata,
+                usec_t *ret_mtime);         /* possibly NULL */
+
 int config_parse_many_nulstr(
                 const char *conf_file,      /* possibly NULL */
                 const char *conf_file_dirs, /* nulstr */
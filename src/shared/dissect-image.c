@@ -157,6 +157,12 @@ static int enumerator_for_parent(sd_device *d, sd_device_enumerator **ret) {
         return 0;
 }
 
+static bool device_is_partition_candidate(sd_device *d) {
+        return sd_device_get_devnum(d, NULL) >= 0 &&
+                device_is_block(d) &&
+                !device_is_mmc_special_partition(d);
+}
+
 static int wait_for_partitions_to_appear(
                 int fd,
                 sd_device *d,
@@ -180,23 +186,25 @@ static int wait_for_partitions_to_appear(
         /* Count the partitions enumerated by the kernel */
         n = 0;
         FOREACH_DEVICE(e, q) {
-                if (sd_device_get_devnum(q, NULL) < 0)
-                        continue;
-                if (!device_is_block(q))
+                if (!device_is_partition_candidate(q))
                         continue;
-                if (device_is_mmc_special_partition(q))
-                        continue;
-
-                if (!FLAGS_SET(flags, DISSECT_IMAGE_NO_UDEV)) {
-                        r = device_wait_for_initialization(q, "block", USEC_INFINITY, NULL);
-                        if (r < 0)
-                                return r;
-                }
 
                 n++;
         }
 
         if (n == num_partitions + 1) {
+                /* Only wait for udev once we know that the kernel has all partitions in place. Otherwise
+                 * we'd wait for each partition on every attempt, just to find out we have to try again. */
+                if (!FLAGS_SET(flags, DISSECT_IMAGE_NO_UDEV))
+                        FOREACH_DEVICE(e, q) {
+                                if (!device_is_partition_candidate(q))
+                                        continue;
+
+                                r = device_wait_for_initialization(q, "block", USEC_INFINITY, NULL);
+                                if (r < 0)
+                                        return r;
+                        }
+
                 *ret_enumerator = TAKE_PTR(e);
                 return 0; /* success! */
         }
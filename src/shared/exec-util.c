@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -26,6 +27,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "tmpfile-util.h"
 #include "util.h"
 
@@ -72,6 +74,13 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
         return 1;
 }
 
+static void log_execution_time(const char *path, usec_t start) {
+        char ts[FORMAT_TIMESPAN_MAX];
+
+        log_debug("%s finished after %s.",
+                  path, format_timespan(ts, sizeof(ts), usec_sub_unsigned(now(CLOCK_MONOTONIC), start), USEC_PER_MSEC));
+}
+
 static int do_execute(
                 char **directories,
                 usec_t timeout,
@@ -85,6 +94,7 @@ static int do_execute(
         _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
         _cleanup_strv_free_ char **paths = NULL;
         char **path, **e;
+        usec_t start;
         int r;
         bool parallel_execution;
 
@@ -116,6 +126,10 @@ static int do_execute(
                 if (putenv(*e) != 0)
                         return log_error_errno(errno, "Failed to set environment variable: %m");
 
+        /* In parallel mode all executables are forked off right away, hence their run times are measured
+         * from here */
+        start = now(CLOCK_MONOTONIC);
+
         STRV_FOREACH(path, paths) {
                 _cleanup_free_ char *t = NULL;
                 _cleanup_close_ int fd = -1;
@@ -131,6 +145,9 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
+                if (!parallel_execution)
+                        start = now(CLOCK_MONOTONIC);
+
                 r = do_spawn(t, argv, fd, &pid);
                 if (r <= 0)
                         continue;
@@ -142,6 +159,7 @@ static int do_execute(
                         t = NULL;
                 } else {
                         r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                        log_execution_time(t, start);
                         if (FLAGS_SET(flags, EXEC_DIR_IGNORE_ERRORS)) {
                                 if (r < 0)
                                         continue;
@@ -168,15 +186,31 @@ static int do_execute(
 
         while (!hashmap_isempty(pids)) {
                 _cleanup_free_ char *t = NULL;
+                siginfo_t si = {};
                 pid_t pid;
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
+                /* Pick up the executables in the order they finish rather than in the order of the
+                 * hashmap, so that the time each one took is known. WNOWAIT leaves the zombie around, it's
+                 * reaped by wait_for_terminate_and_check() below. */
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return log_error_errno(errno, "Failed to wait for executables: %m");
+                }
+
+                pid = si.si_pid;
                 assert(pid > 0);
 
                 t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+                if (!t) {
+                        /* Not one of ours, just reap it */
+                        (void) wait_for_terminate(pid, NULL);
+                        continue;
+                }
 
                 r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                log_execution_time(t, start);
                 if (!FLAGS_SET(flags, EXEC_DIR_IGNORE_ERRORS) && r > 0)
                         return r;
         }
@@ -76,6 +76,8 @@ typedef struct TableData {
         const char *rgap_color;     /* The ANSI color to use for the gap right of this cell. Usually used to underline entire rows in a gapless fashion */
         char *url;                  /* A URL to use for a clickable hyperlink */
         char *formatted;            /* A cached textual representation of the cell data, before ellipsation/alignment */
+        size_t formatted_width;     /* The cached width and height of the textual representation in console cells, … */
+        size_t formatted_height;    /* … or 0 if not determined yet. */
 
         union {
                 uint8_t data[0];    /* data is generic array */
@@ -724,6 +726,7 @@ int table_set_uppercase(Table *t, TableCell *cell, bool b) {
                 return 0;
 
         d->formatted = mfree(d->formatted);
+        d->formatted_height = 0;
         d->uppercase = b;
         return 1;
 }
@@ -1583,6 +1586,20 @@ static const char *table_data_format(Table *t, TableData *d, bool avoid_uppercas
         return d->formatted;
 }
 
+static bool table_data_isempty(TableData *d) {
+        assert(d);
+
+        if (d->type == TABLE_EMPTY)
+                return true;
+
+        /* Let's also consider an empty strv as truly empty. */
+        if (d->type == TABLE_STRV)
+                return strv_isempty(d->strv);
+
+        /* Note that an empty string we do not consider empty here! */
+        return false;
+}
+
 static int console_width_height(
                 const char *s,
                 size_t *ret_width,
@@ -1629,6 +1646,44 @@ static int console_width_height(
         return 0;
 }
 
+static int table_data_console_width_height(
+                TableData *d,
+                const char *formatted,
+                size_t *ret_width,
+                size_t *ret_height) {
+
+        size_t width, height;
+        int r;
+
+        assert(d);
+        assert(formatted);
+        assert(ret_width);
+        assert(ret_height);
+
+        /* Determining the width of a string is not cheap, and we need it once to size the columns and once more when
+         * printing the cell, hence cache it. The textual representation of empty cells depends on the table's empty
+         * string, hence don't cache it for those. */
+
+        if (d->formatted_height > 0) {
+                *ret_width = d->formatted_width;
+                *ret_height = d->formatted_height;
+                return 0;
+        }
+
+        r = console_width_height(formatted, &width, &height);
+        if (r < 0)
+                return r;
+
+        if (!table_data_isempty(d)) {
+                d->formatted_width = width;
+                d->formatted_height = height;
+        }
+
+        *ret_width = width;
+        *ret_height = height;
+        return 0;
+}
+
 static int table_data_requested_width_height(
                 Table *table,
                 TableData *d,
@@ -1645,20 +1700,23 @@ static int table_data_requested_width_height(
         if (!t)
                 return -ENOMEM;
 
-        if (table->cell_height_max != (size_t) -1) {
+        r = table_data_console_width_height(d, t, &width, &height);
+        if (r < 0)
+                return r;
+
+        if (table->cell_height_max != (size_t) -1 && height > table->cell_height_max) {
                 r = string_truncate_lines(t, table->cell_height_max, &truncated);
                 if (r < 0)
                         return r;
-                if (r > 0)
+                if (r > 0) {
                         truncation_applied = true;
 
-                t = truncated;
+                        r = console_width_height(truncated, &width, &height);
+                        if (r < 0)
+                                return r;
+                }
         }
 
-        r = console_width_height(t, &width, &height);
-        if (r < 0)
-                return r;
-
         if (d->maximum_width != (size_t) -1 && width > d->maximum_width)
                 width = d->maximum_width;
 
@@ -1733,20 +1791,6 @@ static char *align_string_mem(const char *str, const char *url, size_t new_lengt
         return ret;
 }
 
-static bool table_data_isempty(TableData *d) {
-        assert(d);
-
-        if (d->type == TABLE_EMPTY)
-                return true;
-
-        /* Let's also consider an empty strv as truly empty. */
-        if (d->type == TABLE_STRV)
-                return strv_isempty(d->strv);
-
-        /* Note that an empty string we do not consider empty here! */
-        return false;
-}
-
 static const char* table_data_color(TableData *d) {
         assert(d);
 
@@ -2046,10 +2090,13 @@ int table_print(Table *t, FILE *f) {
                                         else
                                                 lines_truncated = true;
                                 }
-                                if (extracted)
+                                if (extracted) {
                                         field = extracted;
-
-                                l = utf8_console_width(field);
+                                        l = utf8_console_width(field);
+                                } else if (d->formatted_height == 1)
+                                        l = d->formatted_width; /* Single line cell, we know its width already */
+                                else
+                                        l = utf8_console_width(field);
                                 if (l > width[j]) {
                                         /* Field is wider than allocated space. Let's ellipsize */
 
@@ -1204,6 +1204,187 @@ static int config_parse_default_instance(
         return free_and_replace(i->default_instance, printed);
 }
 
+/* Parsed [Install] sections of unit files, keyed by path. This is only enabled in long-running processes, i.e.
+ * the service manager, where it makes ListUnitFiles() and GetUnitFileState() only parse the files that
+ * changed since the last call. */
+typedef struct InstallCacheEntry {
+        char *path;
+        char *name;
+        struct stat st;
+
+        char **aliases;
+        char **wanted_by;
+        char **required_by;
+        char **also;
+        char *default_instance;
+} InstallCacheEntry;
+
+/* Parsed preset files, one set per scope, valid as long as the same files are found and none of them changed.
+ * This is enabled together with the cache above, and makes the service manager not re-read all presets for
+ * each PresetUnitFiles() call, or for each unit whose UnitFilePreset property is queried. */
+typedef struct PresetCacheEntry {
+        char *root_dir;
+        char **files;
+        struct stat *st;
+        UnitFilePresets presets;
+} PresetCacheEntry;
+
+static bool install_cache_enabled = false;
+static Hashmap *install_cache = NULL;
+static PresetCacheEntry *preset_cache[_UNIT_FILE_SCOPE_MAX] = {};
+
+static InstallCacheEntry* install_cache_entry_free(InstallCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->path);
+        free(e->name);
+        strv_free(e->aliases);
+        strv_free(e->wanted_by);
+        strv_free(e->required_by);
+        strv_free(e->also);
+        free(e->default_instance);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(InstallCacheEntry*, install_cache_entry_free);
+
+static PresetCacheEntry* preset_cache_entry_free(PresetCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->root_dir);
+        strv_free(e->files);
+        free(e->st);
+        unit_file_presets_freep(&e->presets);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PresetCacheEntry*, preset_cache_entry_free);
+
+void unit_file_cache_enable(void) {
+        install_cache_enabled = true;
+}
+
+void unit_file_cache_flush(void) {
+        InstallCacheEntry *e;
+
+        while ((e = hashmap_steal_first(install_cache)))
+                install_cache_entry_free(e);
+
+        install_cache = hashmap_free(install_cache);
+
+        for (UnitFileScope scope = 0; scope < _UNIT_FILE_SCOPE_MAX; scope++)
+                preset_cache[scope] = preset_cache_entry_free(preset_cache[scope]);
+}
+
+static bool install_info_is_pristine(const UnitFileInstallInfo *info) {
+        assert(info);
+
+        return strv_isempty(info->aliases) &&
+                strv_isempty(info->wanted_by) &&
+                strv_isempty(info->required_by) &&
+                strv_isempty(info->also) &&
+                !info->default_instance;
+}
+
+static int install_cache_lookup(
+                InstallContext *c,
+                UnitFileInstallInfo *info,
+                const char *path,
+                const struct stat *st) {
+
+        InstallCacheEntry *e;
+        char **i;
+        int r;
+
+        assert(c);
+        assert(info);
+        assert(path);
+        assert(st);
+
+        /* Returns > 0 and fills in info if the file didn't change since we parsed it last */
+
+        if (!install_info_is_pristine(info))
+                return 0;
+
+        e = hashmap_get(install_cache, path);
+        if (!e ||
+            !streq(e->name, info->name) || /* Specifiers depend on the unit name */
+            !stat_inode_unmodified(&e->st, st) ||
+            e->st.st_mtim.tv_nsec != st->st_mtim.tv_nsec)
+                return 0;
+
+        info->aliases = strv_copy(e->aliases);
+        info->wanted_by = strv_copy(e->wanted_by);
+        info->required_by = strv_copy(e->required_by);
+        info->also = strv_copy(e->also);
+        if (!info->aliases || !info->wanted_by || !info->required_by || !info->also)
+                return -ENOMEM;
+
+        if (e->default_instance) {
+                info->default_instance = strdup(e->default_instance);
+                if (!info->default_instance)
+                        return -ENOMEM;
+        }
+
+        /* Parsing Also= queues the listed units, do the same here */
+        STRV_FOREACH(i, info->also) {
+                r = install_info_add(c, *i, NULL, true, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
+static void install_cache_store(const UnitFileInstallInfo *info, const char *path, const struct stat *st) {
+        _cleanup_(install_cache_entry_freep) InstallCacheEntry *e = NULL;
+        int r;
+
+        assert(info);
+        assert(path);
+        assert(st);
+
+        /* Failing to cache is not an issue, we'll just parse the file again next time */
+
+        e = new(InstallCacheEntry, 1);
+        if (!e)
+                return;
+
+        *e = (InstallCacheEntry) {
+                .st = *st,
+                .path = strdup(path),
+                .name = strdup(info->name),
+                .aliases = strv_copy(info->aliases),
+                .wanted_by = strv_copy(info->wanted_by),
+                .required_by = strv_copy(info->required_by),
+                .also = strv_copy(info->also),
+        };
+        if (!e->path || !e->name || !e->aliases || !e->wanted_by || !e->required_by || !e->also)
+                return;
+
+        if (info->default_instance) {
+                e->default_instance = strdup(info->default_instance);
+                if (!e->default_instance)
+                        return;
+        }
+
+        r = hashmap_ensure_allocated(&install_cache, &path_hash_ops);
+        if (r < 0)
+                return;
+
+        install_cache_entry_free(hashmap_remove(install_cache, path));
+
+        r = hashmap_put(install_cache, e->path, e);
+        if (r < 0)
+                return;
+
+        TAKE_PTR(e);
+}
+
 static int unit_file_load(
                 InstallContext *c,
                 UnitFileInstallInfo *info,
@@ -1224,6 +1405,7 @@ static int unit_file_load(
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_close_ int fd = -1;
         struct stat st;
+        bool cache;
         int r;
 
         assert(info);
@@ -1285,13 +1467,23 @@ static int unit_file_load(
         if (r < 0)
                 return r;
 
+        /* c is only needed if we actually load the file (it's referenced from items[] btw, in case you wonder.) */
+        assert(c);
+
+        /* Drop-ins modify what the main file set up, only the main file's parse result can be cached */
+        cache = install_cache_enabled && !(flags & SEARCH_DROPIN) && install_info_is_pristine(info);
+        if (cache) {
+                r = install_cache_lookup(c, info, path, &st);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        goto finish;
+        }
+
         f = take_fdopen(&fd, "r");
         if (!f)
                 return -errno;
 
-        /* c is only needed if we actually load the file (it's referenced from items[] btw, in case you wonder.) */
-        assert(c);
-
         r = config_parse(info->name, path, f,
                          "Install\0"
                          "-Unit\0"
@@ -1312,6 +1504,10 @@ static int unit_file_load(
         if (r < 0)
                 return log_debug_errno(r, "Failed to parse %s: %m", info->name);
 
+        if (cache)
+                install_cache_store(info, path, &st);
+
+finish:
         if ((flags & SEARCH_DROPIN) == 0)
                 info->type = UNIT_FILE_TYPE_REGULAR;
 
@@ -2939,10 +3135,117 @@ static int presets_find_config(UnitFileScope scope, const char *root_dir, char *
         return conf_files_list_strv(files, ".preset", root_dir, 0, dirs);
 }
 
+static int presets_copy(const UnitFilePresets *presets, UnitFilePresets *ret) {
+        _cleanup_(unit_file_presets_freep) UnitFilePresets ps = {};
+
+        assert(presets);
+        assert(ret);
+
+        ps.rules = new0(UnitFilePresetRule, MAX(presets->n_rules, 1U));
+        if (!ps.rules)
+                return -ENOMEM;
+
+        for (; ps.n_rules < presets->n_rules; ps.n_rules++) {
+                const UnitFilePresetRule *rule = presets->rules + ps.n_rules;
+
+                ps.rules[ps.n_rules] = (UnitFilePresetRule) {
+                        .pattern = strdup(rule->pattern),
+                        .action = rule->action,
+                };
+                if (!ps.rules[ps.n_rules].pattern)
+                        return -ENOMEM;
+
+                if (rule->instances) {
+                        ps.rules[ps.n_rules].instances = strv_copy(rule->instances);
+                        if (!ps.rules[ps.n_rules].instances) {
+                                ps.n_rules++;
+                                return -ENOMEM;
+                        }
+                }
+        }
+
+        ps.initialized = true;
+        *ret = ps;
+        ps = (UnitFilePresets) {};
+
+        return 0;
+}
+
+static int preset_cache_lookup(UnitFileScope scope, const char *root_dir, char **files, UnitFilePresets *ret) {
+        PresetCacheEntry *e;
+        size_t k = 0;
+        char **p;
+
+        assert(scope >= 0);
+        assert(scope < _UNIT_FILE_SCOPE_MAX);
+        assert(ret);
+
+        /* Returns > 0 and a copy of the cached presets if the same preset files are found as last time, and
+         * none of them changed since */
+
+        e = preset_cache[scope];
+        if (!e ||
+            !streq_ptr(e->root_dir, root_dir) ||
+            !strv_equal(e->files, files))
+                return 0;
+
+        STRV_FOREACH(p, files) {
+                struct stat st;
+
+                if (stat(*p, &st) < 0 ||
+                    !stat_inode_unmodified(e->st + k, &st) ||
+                    e->st[k].st_mtim.tv_nsec != st.st_mtim.tv_nsec)
+                        return 0;
+
+                k++;
+        }
+
+        return presets_copy(&e->presets, ret) ?: 1;
+}
+
+static void preset_cache_store(
+                UnitFileScope scope,
+                const char *root_dir,
+                char ***files,
+                struct stat **st,
+                const UnitFilePresets *presets) {
+
+        _cleanup_(preset_cache_entry_freep) PresetCacheEntry *e = NULL;
+
+        assert(scope >= 0);
+        assert(scope < _UNIT_FILE_SCOPE_MAX);
+        assert(files);
+        assert(st);
+        assert(presets);
+
+        /* Failing to cache is not an issue, we'll just read the files again next time */
+
+        e = new0(PresetCacheEntry, 1);
+        if (!e)
+                return;
+
+        if (root_dir) {
+                e->root_dir = strdup(root_dir);
+                if (!e->root_dir)
+                        return;
+        }
+
+        if (presets_copy(presets, &e->presets) < 0)
+                return;
+
+        e->files = TAKE_PTR(*files);
+        e->st = TAKE_PTR(*st);
+
+        preset_cache_entry_free(preset_cache[scope]);
+        preset_cache[scope] = TAKE_PTR(e);
+}
+
 static int read_presets(UnitFileScope scope, const char *root_dir, UnitFilePresets *presets) {
         _cleanup_(unit_file_presets_freep) UnitFilePresets ps = {};
-        size_t n_allocated = 0;
+        size_t n_allocated = 0, k = 0;
         _cleanup_strv_free_ char **files = NULL;
+        _cleanup_free_ struct stat *st = NULL;
+        bool cache = install_cache_enabled;
         char **p;
         int r;
 
@@ -2954,18 +3257,36 @@ static int read_presets(UnitFileScope scope, const char *root_dir, UnitFilePrese
         if (r < 0)
                 return r;
 
+        if (cache) {
+                r = preset_cache_lookup(scope, root_dir, files, presets);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        return 0;
+
+                st = new(struct stat, MAX(strv_length(files), 1U));
+                if (!st)
+                        return -ENOMEM;
+        }
+
         STRV_FOREACH(p, files) {
                 _cleanup_fclose_ FILE *f;
                 int n = 0;
 
                 f = fopen(*p, "re");
                 if (!f) {
-                        if (errno == ENOENT)
+                        if (errno == ENOENT) {
+                                /* Don't bother caching the result of a race with a file being removed */
+                                cache = false;
                                 continue;
+                        }
 
                         return -errno;
                 }
 
+                if (cache && fstat(fileno(f), st + k++) < 0)
+                        cache = false;
+
                 for (;;) {
                         _cleanup_free_ char *line = NULL;
                         UnitFilePresetRule rule = {};
@@ -3032,6 +3353,10 @@ static int read_presets(UnitFileScope scope, const char *root_dir, UnitFilePrese
         }
 
         ps.initialized = true;
+
+        if (cache)
+                preset_cache_store(scope, root_dir, &files, &st, &ps);
+
         *presets = ps;
         ps = (UnitFilePresets){};
 
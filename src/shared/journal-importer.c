@@ -4,6 +4,7 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "compress.h"
 #include "errno-util.h"
 #include "escape.h"
 #include "fd-util.h"
@@ -11,6 +12,7 @@
 #include "journal-file.h"
 #include "journal-importer.h"
 #include "journal-util.h"
+#include "memory-util.h"
 #include "parse-util.h"
 #include "string-util.h"
 #include "unaligned.h"
@@ -20,6 +22,7 @@ enum {
         IMPORTER_STATE_DATA_START,  /* reading binary data header */
         IMPORTER_STATE_DATA,        /* reading binary data */
         IMPORTER_STATE_DATA_FINISH, /* expecting newline */
+        IMPORTER_STATE_FRAME,       /* reading binary frame payload, LINE is used for the frame header */
         IMPORTER_STATE_EOF,         /* done */
 };
 
@@ -32,6 +35,11 @@ void journal_importer_cleanup(JournalImporter *imp) {
         free(imp->name);
         free(imp->buf);
         iovw_free_contents(&imp->iovw, false);
+
+        free(imp->frame);
+        free(imp->frame_iovec);
+        free(imp->entry_meta);
+        free(imp->entries);
 }
 
 static char* realloc_buffer(JournalImporter *imp, size_t size) {
@@ -113,8 +121,9 @@ static int get_line(JournalImporter *imp, char **line, size_t *size) {
 static int fill_fixed_size(JournalImporter *imp, void **data, size_t size) {
 
         assert(imp);
-        assert(IN_SET(imp->state, IMPORTER_STATE_DATA_START, IMPORTER_STATE_DATA, IMPORTER_STATE_DATA_FINISH));
-        assert(size <= DATA_SIZE_MAX);
+        assert(IN_SET(imp->state, IMPORTER_STATE_DATA_START, IMPORTER_STATE_DATA, IMPORTER_STATE_DATA_FINISH) ||
+               (imp->binary && IN_SET(imp->state, IMPORTER_STATE_LINE, IMPORTER_STATE_FRAME)));
+        assert(size <= ENTRY_SIZE_MAX);
         assert(imp->offset <= imp->filled);
         assert(imp->filled <= imp->size);
         assert(imp->buf || imp->size == 0);
@@ -280,7 +289,181 @@ static int process_special_field(JournalImporter *imp, char *line) {
         return 0;
 }
 
-int journal_importer_process_data(JournalImporter *imp) {
+static int parse_binary_frame(JournalImporter *imp, size_t size) {
+        const uint8_t *p, *end;
+        size_t i, k = 0;
+
+        assert(imp);
+        assert(imp->frame);
+
+        /* Splits up a decoded frame into entries. The iovecs point right into the frame buffer, so that
+         * the entries can be handed to journal_file_append_entries() as they are. */
+
+        imp->n_frame_iovec = imp->n_entries = 0;
+
+        for (p = imp->frame, end = p + size; p < end; ) {
+                const JournalBinaryEntryHeader *h = (const JournalBinaryEntryHeader*) p;
+                JournalFileEntry *e;
+                uint32_t n_fields;
+
+                if ((size_t) (end - p) < sizeof(JournalBinaryEntryHeader))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Truncated entry in binary frame.");
+
+                n_fields = le32toh(h->n_fields);
+                if (n_fields > ENTRY_FIELD_COUNT_MAX)
+                        return -E2BIG;
+
+                if (!GREEDY_REALLOC(imp->entries, imp->entries_allocated, imp->n_entries + 1) ||
+                    !GREEDY_REALLOC(imp->entry_meta, imp->entry_meta_allocated, imp->n_entries + 1) ||
+                    !GREEDY_REALLOC(imp->frame_iovec, imp->frame_iovec_allocated, imp->n_frame_iovec + n_fields))
+                        return log_oom();
+
+                imp->entry_meta[imp->n_entries] = (JournalImporterEntryMeta) {
+                        .ts.realtime = le64toh(h->realtime),
+                        .ts.monotonic = le64toh(h->monotonic),
+                        .boot_id = h->boot_id,
+                };
+
+                e = imp->entries + imp->n_entries;
+                *e = (JournalFileEntry) {};
+
+                p += sizeof(JournalBinaryEntryHeader);
+
+                for (i = 0; i < n_fields; i++) {
+                        const char *field, *sep;
+                        uint32_t l;
+
+                        if ((size_t) (end - p) < sizeof(le32_t))
+                                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Truncated field in binary frame.");
+
+                        l = unaligned_read_le32(p);
+                        p += sizeof(le32_t);
+
+                        if ((size_t) (end - p) < l)
+                                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Truncated field in binary frame.");
+
+                        field = (const char*) p;
+                        p += l;
+
+                        sep = memchr(field, '=', l);
+                        if (!sep || startswith(field, "__") || !journal_field_valid(field, sep - field, true)) {
+                                log_debug("Ignoring invalid field of %" PRIu32 " bytes in binary frame.", l);
+                                continue;
+                        }
+
+                        imp->frame_iovec[imp->n_frame_iovec + e->n_iovec++] = IOVEC_MAKE((char*) field, l);
+                }
+
+                if (e->n_iovec == 0) {
+                        log_warning("Entry with no payload, skipping");
+                        continue;
+                }
+
+                imp->n_frame_iovec += e->n_iovec;
+                imp->n_entries++;
+        }
+
+        /* Only now that nothing is reallocated anymore, point the entries to their fields */
+        for (i = 0; i < imp->n_entries; i++) {
+                JournalImporterEntryMeta *m = imp->entry_meta + i;
+
+                imp->entries[i].ts = &m->ts;
+                imp->entries[i].boot_id = sd_id128_is_null(m->boot_id) ? NULL : &m->boot_id;
+                imp->entries[i].iovec = imp->frame_iovec + k;
+                k += imp->entries[i].n_iovec;
+        }
+
+        return 0;
+}
+
+static int process_binary_data(JournalImporter *imp) {
+        void *data;
+        size_t n;
+        int r;
+
+        assert(imp);
+        assert(imp->binary);
+
+        switch (imp->state) {
+
+        case IMPORTER_STATE_LINE: {
+                const JournalBinaryFrameHeader *h;
+
+                r = fill_fixed_size(imp, &data, sizeof(JournalBinaryFrameHeader));
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                h = data;
+                imp->frame_type = le32toh(h->type);
+                imp->frame_size = le32toh(h->size);
+                imp->frame_raw_size = le32toh(h->raw_size);
+
+                if (!IN_SET(imp->frame_type, JOURNAL_BINARY_FRAME_PLAIN, JOURNAL_BINARY_FRAME_ZSTD))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Unknown binary frame type %" PRIu32 ".", imp->frame_type);
+
+                if (imp->frame_raw_size > JOURNAL_BINARY_FRAME_SIZE_MAX ||
+                    imp->frame_size > imp->frame_raw_size)
+                        return log_error_errno(SYNTHETIC_ERRNO(ENOBUFS),
+                                               "Binary frame of %zu bytes is bigger than %u bytes.",
+                                               imp->frame_raw_size, JOURNAL_BINARY_FRAME_SIZE_MAX);
+
+                if (imp->frame_size == 0 ||
+                    (imp->frame_type == JOURNAL_BINARY_FRAME_PLAIN && imp->frame_size != imp->frame_raw_size))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Invalid binary frame size.");
+
+                imp->state = IMPORTER_STATE_FRAME;
+                return 0; /* continue */
+        }
+
+        case IMPORTER_STATE_FRAME:
+                r = fill_fixed_size(imp, &data, imp->frame_size);
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                /* The payload is always copied out, so that the receive buffer may be compacted or grow
+                 * while the entries are still being looked at. */
+                if (imp->frame_type == JOURNAL_BINARY_FRAME_ZSTD) {
+                        r = decompress_blob_zstd(data, imp->frame_size,
+                                                 &imp->frame, &imp->frame_allocated, &n,
+                                                 imp->frame_raw_size);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to decompress binary frame: %m");
+                        if (n != imp->frame_raw_size)
+                                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                       "Binary frame decompressed to %zu bytes, expected %zu.",
+                                                       n, imp->frame_raw_size);
+                } else {
+                        if (!greedy_realloc(&imp->frame, &imp->frame_allocated, imp->frame_raw_size, 1))
+                                return log_oom();
+
+                        memcpy(imp->frame, data, imp->frame_raw_size);
+                }
+
+                imp->state = IMPORTER_STATE_LINE;
+
+                r = parse_binary_frame(imp, imp->frame_raw_size);
+                if (r < 0)
+                        return r;
+
+                log_trace("Received binary frame with %zu entries", imp->n_entries);
+
+                return imp->n_entries > 0;
+
+        default:
+                assert_not_reached("wtf?");
+        }
+}
+
+static int process_export_data(JournalImporter *imp) {
         int r;
 
         switch(imp->state) {
@@ -326,9 +509,13 @@ int journal_importer_process_data(JournalImporter *imp) {
                         }
 
                         line[n] = '\0';
-                        r = process_special_field(imp, line);
-                        if (r != 0)
-                                return r < 0 ? r : 0;
+
+                        /* Only the fields with a leading underscore may need special treatment */
+                        if (line[0] == '_') {
+                                r = process_special_field(imp, line);
+                                if (r != 0)
+                                        return r < 0 ? r : 0;
+                        }
 
                         r = iovw_put(&imp->iovw, line, n);
                         if (r < 0)
@@ -413,6 +600,25 @@ int journal_importer_process_data(JournalImporter *imp) {
         }
 }
 
+int journal_importer_process_data(JournalImporter *imp) {
+        int r;
+
+        assert(imp);
+
+        /* Parses as much input as it takes to complete an entry (or a frame of entries). Returns 1 when
+         * that is the case, 0 on EOF, -EAGAIN if more input needs to be pushed first, and other negative
+         * errors if the input is not acceptable. Hence the callers don't need to come back for every
+         * single field, which is expensive if they do so via the event loop. */
+
+        do {
+                r = imp->binary ? process_binary_data(imp) : process_export_data(imp);
+                if (r != 0)
+                        return r;
+        } while (imp->state != IMPORTER_STATE_EOF);
+
+        return 0;
+}
+
 int journal_importer_push_data(JournalImporter *imp, const char *data, size_t size) {
         assert(imp);
         assert(imp->state != IMPORTER_STATE_EOF);
@@ -433,9 +639,11 @@ int journal_importer_push_data(JournalImporter *imp, const char *data, size_t si
 void journal_importer_drop_iovw(JournalImporter *imp) {
         size_t remain, target;
 
-        /* This function drops processed data that along with the iovw that points at it */
+        /* This function drops processed data that along with the iovw that points at it. The array of the
+         * iovw is kept around for the next entry. */
 
-        iovw_free_contents(&imp->iovw, false);
+        imp->iovw.count = 0;
+        imp->n_entries = imp->n_frame_iovec = 0;
 
         /* possibly reset buffer position */
         remain = imp->filled - imp->offset;
@@ -471,3 +679,164 @@ void journal_importer_drop_iovw(JournalImporter *imp) {
 bool journal_importer_eof(const JournalImporter *imp) {
         return imp->state == IMPORTER_STATE_EOF;
 }
+
+void journal_binary_encoder_done(JournalBinaryEncoder *e) {
+        assert(e);
+
+        e->buf = mfree(e->buf);
+        e->compressed = mfree(e->compressed);
+        e->allocated = e->compressed_allocated = e->size = 0;
+        e->entry_offset = e->n_entries = 0;
+        e->n_fields = 0;
+}
+
+static uint8_t* binary_encoder_extend(JournalBinaryEncoder *e, size_t n) {
+        uint8_t *p;
+
+        assert(e);
+
+        if (e->size == 0)
+                e->size = sizeof(JournalBinaryFrameHeader);
+
+        if (n > JOURNAL_BINARY_FRAME_SIZE_MAX - journal_binary_encoder_pending(e))
+                return NULL;
+
+        if (!GREEDY_REALLOC(e->buf, e->allocated, e->size + n))
+                return NULL;
+
+        p = e->buf + e->size;
+        e->size += n;
+
+        return p;
+}
+
+int journal_binary_encoder_begin_entry(JournalBinaryEncoder *e, const dual_timestamp *ts, sd_id128_t boot_id) {
+        JournalBinaryEntryHeader *h;
+        size_t offset;
+
+        assert(e);
+        assert(ts);
+        assert(e->entry_offset == 0);
+
+        offset = MAX(e->size, sizeof(JournalBinaryFrameHeader));
+
+        h = (JournalBinaryEntryHeader*) binary_encoder_extend(e, sizeof(JournalBinaryEntryHeader));
+        if (!h)
+                return journal_binary_encoder_pending(e) > 0 ? -E2BIG : -ENOMEM;
+
+        *h = (JournalBinaryEntryHeader) {
+                .realtime = htole64(ts->realtime),
+                .monotonic = htole64(ts->monotonic),
+                .boot_id = boot_id,
+        };
+
+        e->entry_offset = offset;
+        e->n_fields = 0;
+
+        return 0;
+}
+
+int journal_binary_encoder_add_field(JournalBinaryEncoder *e, const void *data, size_t size) {
+        uint8_t *p;
+
+        assert(e);
+        assert(data || size == 0);
+        assert(e->entry_offset > 0);
+
+        if (e->n_fields >= ENTRY_FIELD_COUNT_MAX)
+                return -E2BIG;
+
+        if (size > JOURNAL_BINARY_FRAME_SIZE_MAX - sizeof(le32_t))
+                return -E2BIG;
+
+        /* Note that the buffer may move, hence only ever refer to the entry header by its offset */
+        p = binary_encoder_extend(e, sizeof(le32_t) + size);
+        if (!p)
+                return journal_binary_encoder_pending(e) + sizeof(le32_t) + size > JOURNAL_BINARY_FRAME_SIZE_MAX ? -E2BIG : -ENOMEM;
+
+        unaligned_write_le32(p, size);
+        memcpy_safe(p + sizeof(le32_t), data, size);
+        e->n_fields++;
+
+        return 0;
+}
+
+void journal_binary_encoder_end_entry(JournalBinaryEncoder *e) {
+        JournalBinaryEntryHeader *h;
+
+        assert(e);
+        assert(e->entry_offset > 0);
+
+        h = (JournalBinaryEntryHeader*) (e->buf + e->entry_offset);
+        h->n_fields = htole32(e->n_fields);
+
+        e->entry_offset = 0;
+        e->n_entries++;
+}
+
+void journal_binary_encoder_drop_entry(JournalBinaryEncoder *e) {
+        assert(e);
+
+        if (e->entry_offset == 0)
+                return;
+
+        e->size = e->entry_offset;
+        e->entry_offset = 0;
+}
+
+int journal_binary_encoder_finish_frame(JournalBinaryEncoder *e, bool compress, const void **ret, size_t *ret_size) {
+        JournalBinaryFrameHeader *h;
+        size_t raw_size;
+
+        assert(e);
+        assert(e->entry_offset == 0);
+        assert(ret);
+        assert(ret_size);
+
+        /* Returns the frame with all entries added so far, valid until the encoder is used again */
+
+        raw_size = journal_binary_encoder_pending(e);
+        if (raw_size == 0) {
+                *ret = NULL;
+                *ret_size = 0;
+                return 0;
+        }
+
+        e->size = 0;
+        e->n_entries = 0;
+
+        if (compress) {
+                size_t k;
+                int r;
+
+                if (!GREEDY_REALLOC(e->compressed, e->compressed_allocated, sizeof(JournalBinaryFrameHeader) + raw_size))
+                        return -ENOMEM;
+
+                /* Only bother if the result is actually smaller, as zstd cannot fit it otherwise */
+                r = compress_blob_zstd(e->buf + sizeof(JournalBinaryFrameHeader), raw_size,
+                                       e->compressed + sizeof(JournalBinaryFrameHeader), raw_size - 1, &k);
+                if (r >= 0) {
+                        h = (JournalBinaryFrameHeader*) e->compressed;
+                        *h = (JournalBinaryFrameHeader) {
+                                .type = htole32(JOURNAL_BINARY_FRAME_ZSTD),
+                                .size = htole32(k),
+                                .raw_size = htole32(raw_size),
+                        };
+
+                        *ret = e->compressed;
+                        *ret_size = sizeof(JournalBinaryFrameHeader) + k;
+                        return 1;
+                }
+        }
+
+        h = (JournalBinaryFrameHeader*) e->buf;
+        *h = (JournalBinaryFrameHeader) {
+                .type = htole32(JOURNAL_BINARY_FRAME_PLAIN),
+                .size = htole32(raw_size),
+                .raw_size = htole32(raw_size),
+        };
+
+        *ret = e->buf;
+        *ret_size = sizeof(JournalBinaryFrameHeader) + raw_size;
+        return 1;
+}
@@ -9,6 +9,8 @@
 #include "sd-id128.h"
 
 #include "io-util.h"
+#include "journal-file.h"
+#include "sparse-endian.h"
 #include "time-util.h"
 
 /* Make sure not to make this smaller than the maximum coredump size.
@@ -25,6 +27,44 @@
 /* The maximum number of fields in an entry */
 #define ENTRY_FIELD_COUNT_MAX 1024
 
+/* Besides the export format, entries may be sent in a binary framing, which is cheaper to generate and to
+ * parse, and may be compressed. The stream is a series of frames, each made of a JournalBinaryFrameHeader
+ * followed by "size" bytes of payload. Once decompressed, the payload is "raw_size" bytes long and holds a
+ * series of complete entries: each is a JournalBinaryEntryHeader, followed by "n_fields" fields, each of
+ * which is a le32 length followed by that many bytes of "FIELD=value". All integers are little endian.
+ * There are no cursors in the stream, the sender keeps track of those. */
+#define JOURNAL_BINARY_CONTENT_TYPE "application/vnd.fdo.journal.binary"
+
+/* A frame holds at least one entry, hence it has to be able to hold the largest one */
+#define JOURNAL_BINARY_FRAME_SIZE_MAX ENTRY_SIZE_MAX
+
+enum {
+        JOURNAL_BINARY_FRAME_PLAIN = 1,
+        JOURNAL_BINARY_FRAME_ZSTD = 2,
+};
+
+typedef struct JournalBinaryFrameHeader {
+        le32_t type;
+        le32_t size;
+        le32_t raw_size;
+} _packed_ JournalBinaryFrameHeader;
+
+typedef struct JournalBinaryEntryHeader {
+        le64_t realtime;
+        le64_t monotonic;
+        sd_id128_t boot_id;
+        le32_t n_fields;
+        le32_t reserved;
+} _packed_ JournalBinaryEntryHeader;
+
+assert_cc(sizeof(JournalBinaryFrameHeader) == 12);
+assert_cc(sizeof(JournalBinaryEntryHeader) == 40);
+
+typedef struct JournalImporterEntryMeta {
+        dual_timestamp ts;
+        sd_id128_t boot_id;
+} JournalImporterEntryMeta;
+
 typedef struct JournalImporter {
         int fd;
         bool passive_fd;
@@ -44,6 +84,22 @@ typedef struct JournalImporter {
         int state;
         dual_timestamp ts;
         sd_id128_t boot_id;
+
+        /* Set if the stream uses the binary framing. Then all entries of a frame are returned at once,
+         * in "entries", instead of one at a time in "iovw". */
+        bool binary;
+        uint32_t frame_type;
+        size_t frame_size;
+        size_t frame_raw_size;
+
+        void *frame;
+        size_t frame_allocated;
+        struct iovec *frame_iovec;
+        size_t n_frame_iovec, frame_iovec_allocated;
+        JournalImporterEntryMeta *entry_meta;
+        size_t entry_meta_allocated;
+        JournalFileEntry *entries;
+        size_t n_entries, entries_allocated;
 } JournalImporter;
 
 #define JOURNAL_IMPORTER_INIT(_fd) { .fd = (_fd), .iovw = {} }
@@ -55,6 +111,30 @@ int journal_importer_push_data(JournalImporter *, const char *data, size_t size)
 void journal_importer_drop_iovw(JournalImporter *);
 bool journal_importer_eof(const JournalImporter *);
 
+/* Builds frames in the binary framing, one entry and field at a time */
+typedef struct JournalBinaryEncoder {
+        uint8_t *buf;          /* the frame header, followed by the raw payload */
+        size_t allocated;
+        size_t size;
+        size_t entry_offset;   /* where the header of the entry being added starts, or 0 */
+        uint32_t n_fields;
+        size_t n_entries;
+
+        uint8_t *compressed;
+        size_t compressed_allocated;
+} JournalBinaryEncoder;
+
+void journal_binary_encoder_done(JournalBinaryEncoder *e);
+int journal_binary_encoder_begin_entry(JournalBinaryEncoder *e, const dual_timestamp *ts, sd_id128_t boot_id);
+int journal_binary_encoder_add_field(JournalBinaryEncoder *e, const void *data, size_t size);
+void journal_binary_encoder_end_entry(JournalBinaryEncoder *e);
+void journal_binary_encoder_drop_entry(JournalBinaryEncoder *e);
+int journal_binary_encoder_finish_frame(JournalBinaryEncoder *e, bool compress, const void **ret, size_t *ret_size);
+
+static inline size_t journal_binary_encoder_pending(const JournalBinaryEncoder *e) {
+        return e->size > 0 ? e->size - sizeof(JournalBinaryFrameHeader) : 0;
+}
+
 static inline size_t journal_importer_bytes_remaining(const JournalImporter *imp) {
         return imp->filled;
 }
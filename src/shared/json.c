@@ -3150,7 +3150,11 @@ static int json_parse_internal(
                         if (FLAGS_SET(flags, JSON_PARSE_SENSITIVE))
                                 json_variant_sensitive(add);
 
-                        (void) json_variant_set_source(&add, source, line_token, column_token);
+                        /* Recording the position in a constant variant (i.e. true, false, null, 0, "",
+                         * [] or {}) means allocating a copy of it. Hence allow callers who will never
+                         * look at the positions to skip this. */
+                        if (source || !FLAGS_SET(flags, JSON_PARSE_NO_LINE_COLUMN))
+                                (void) json_variant_set_source(&add, source, line_token, column_token);
 
                         if (!GREEDY_REALLOC(current->elements, current->n_elements_allocated, current->n_elements + 1)) {
                                 r = -ENOMEM;
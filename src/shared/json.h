@@ -198,7 +198,8 @@ int json_variant_sort(JsonVariant **v);
 int json_variant_normalize(JsonVariant **v);
 
 typedef enum JsonParseFlags {
-        JSON_PARSE_SENSITIVE = 1 << 0, /* mark variant as "sensitive", i.e. something containing secret key material or such */
+        JSON_PARSE_SENSITIVE      = 1 << 0, /* mark variant as "sensitive", i.e. something containing secret key material or such */
+        JSON_PARSE_NO_LINE_COLUMN = 1 << 1, /* don't record line and column numbers in the parsed variants */
 } JsonParseFlags;
 
 int json_parse(const char *string, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column);
@@ -26,16 +26,19 @@
 #include "log.h"
 #include "logs-show.h"
 #include "macro.h"
+#include "memory-util.h"
 #include "namespace-util.h"
 #include "output-mode.h"
 #include "parse-util.h"
 #include "pretty-print.h"
 #include "process-util.h"
+#include "siphash24.h"
 #include "sparse-endian.h"
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
+#include "strxcpyx.h"
 #include "terminal-util.h"
 #include "time-util.h"
 #include "utf8.h"
@@ -346,10 +349,34 @@ static int output_timestamp_monotonic(FILE *f, sd_journal *j, const char *monoto
         return 1 + 5 + 1 + 6 + 1;
 }
 
+static bool strftime_cached(char *buf, size_t size, const char *format, time_t t, bool utc) {
+        static thread_local struct {
+                const char *format;
+                time_t t;
+                bool utc;
+                char buf[64];
+        } cache = {};
+        struct tm tm;
+
+        /* When showing many entries, most of them were logged in the same second as the previous one, hence
+         * remember the last formatted second instead of going through localtime_r() and strftime() again. */
+
+        if (!streq_ptr(cache.format, format) || cache.t != t || cache.utc != utc) {
+                cache.format = NULL;
+
+                if (strftime(cache.buf, sizeof(cache.buf), format, (utc ? gmtime_r : localtime_r)(&t, &tm)) <= 0)
+                        return false;
+
+                cache.format = format;
+                cache.t = t;
+                cache.utc = utc;
+        }
+
+        return strscpy(buf, size, cache.buf) > 0;
+}
+
 static int output_timestamp_realtime(FILE *f, sd_journal *j, OutputMode mode, OutputFlags flags, const char *realtime) {
         char buf[MAX(FORMAT_TIMESTAMP_MAX, 64)];
-        struct tm *(*gettime_r)(const time_t *, struct tm *);
-        struct tm tm;
         uint64_t x;
         time_t t;
         int r;
@@ -378,7 +405,6 @@ static int output_timestamp_realtime(FILE *f, sd_journal *j, OutputMode mode, Ou
         } else {
                 char usec[7];
 
-                gettime_r = (flags & OUTPUT_UTC) ? gmtime_r : localtime_r;
                 t = (time_t) (x / USEC_PER_SEC);
 
                 switch (mode) {
@@ -388,14 +414,14 @@ static int output_timestamp_realtime(FILE *f, sd_journal *j, OutputMode mode, Ou
                         break;
 
                 case OUTPUT_SHORT_ISO:
-                        if (strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", gettime_r(&t, &tm)) <= 0)
+                        if (!strftime_cached(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", t, flags & OUTPUT_UTC))
                                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                        "Failed to format ISO time");
                         break;
 
                 case OUTPUT_SHORT_ISO_PRECISE:
                         /* No usec in strftime, so we leave space and copy over */
-                        if (strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.xxxxxx%z", gettime_r(&t, &tm)) <= 0)
+                        if (!strftime_cached(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.xxxxxx%z", t, flags & OUTPUT_UTC))
                                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                        "Failed to format ISO-precise time");
                         xsprintf(usec, "%06"PRI_USEC, x % USEC_PER_SEC);
@@ -405,7 +431,7 @@ static int output_timestamp_realtime(FILE *f, sd_journal *j, OutputMode mode, Ou
                 case OUTPUT_SHORT:
                 case OUTPUT_SHORT_PRECISE:
 
-                        if (strftime(buf, sizeof(buf), "%b %d %H:%M:%S", gettime_r(&t, &tm)) <= 0)
+                        if (!strftime_cached(buf, sizeof(buf), "%b %d %H:%M:%S", t, flags & OUTPUT_UTC))
                                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                        "Failed to format syslog time");
 
@@ -982,6 +1008,391 @@ static int update_json_data_split(
         return update_json_data(h, flags, name, eq + 1, size - (eq - (const char*) data) - 1);
 }
 
+/* The compact JSON modes are what the journal is usually exported in bulk with, hence they don't go
+ * through JsonVariant objects. Instead, the fields of an entry are copied into a buffer that is reused for
+ * all entries of a thread, duplicate fields are grouped with a small open addressing table, and the object
+ * is written out directly. The result is the same as what json_variant_dump() generates, except for the
+ * order of the fields. */
+
+typedef struct JsonField {
+        size_t offset;          /* of "NAME=value" in the data buffer */
+        size_t size;
+        size_t name_size;
+        size_t next;            /* the next field with the same name, or SIZE_MAX */
+        size_t last;            /* for the first field with a name, the last one with it */
+        bool duplicate;         /* not the first field with this name */
+} JsonField;
+
+typedef struct JsonOutputCache {
+        char *data;
+        size_t data_size, data_allocated;
+
+        JsonField *fields;
+        size_t n_fields, fields_allocated;
+
+        size_t *table;
+        size_t table_allocated;
+} JsonOutputCache;
+
+static thread_local JsonOutputCache json_output_cache = {};
+
+/* Don't hold on to the memory an exceptionally large entry needed */
+#define JSON_OUTPUT_CACHE_MAX (1024U*1024U)
+
+void show_journal_entry_release_cache(void) {
+        JsonOutputCache *c = &json_output_cache;
+
+        free(c->data);
+        free(c->fields);
+        free(c->table);
+        *c = (JsonOutputCache) {};
+}
+
+static int json_output_cache_add(JsonOutputCache *c, const char *name, size_t name_size, const void *value, size_t value_size) {
+        JsonField *field;
+        size_t size;
+
+        assert(c);
+
+        /* Without a name, value is the whole "NAME=value" string already */
+        size = name ? name_size + 1 + value_size : value_size;
+
+        if (!GREEDY_REALLOC(c->data, c->data_allocated, c->data_size + size))
+                return log_oom();
+        if (!GREEDY_REALLOC(c->fields, c->fields_allocated, c->n_fields + 1))
+                return log_oom();
+
+        field = c->fields + c->n_fields++;
+        *field = (JsonField) {
+                .offset = c->data_size,
+                .size = size,
+                .name_size = name_size,
+                .next = SIZE_MAX,
+                .last = c->n_fields - 1,
+        };
+
+        if (name) {
+                memcpy(c->data + c->data_size, name, name_size);
+                c->data[c->data_size + name_size] = '=';
+                memcpy_safe(c->data + c->data_size + name_size + 1, value, value_size);
+        } else
+                memcpy(c->data + c->data_size, value, value_size);
+
+        c->data_size += size;
+        return 0;
+}
+
+static int json_output_cache_group(JsonOutputCache *c) {
+        static const uint8_t hash_key[16] = {};
+        size_t i, n_table = 16, mask;
+
+        assert(c);
+
+        /* Keep the table at most half full, so that the probe sequences stay short */
+        while (n_table < c->n_fields * 2)
+                n_table <<= 1;
+
+        if (!GREEDY_REALLOC(c->table, c->table_allocated, n_table))
+                return log_oom();
+
+        memset(c->table, 0xff, n_table * sizeof(size_t));
+        mask = n_table - 1;
+
+        for (i = 0; i < c->n_fields; i++) {
+                JsonField *field = c->fields + i;
+                const char *name = c->data + field->offset;
+                size_t h;
+
+                for (h = siphash24(name, field->name_size, hash_key) & mask;; h = (h + 1) & mask) {
+                        JsonField *first;
+
+                        if (c->table[h] == SIZE_MAX) {
+                                c->table[h] = i;
+                                break;
+                        }
+
+                        first = c->fields + c->table[h];
+                        if (first->name_size == field->name_size &&
+                            memcmp(c->data + first->offset, name, field->name_size) == 0) {
+                                c->fields[first->last].next = i;
+                                first->last = i;
+                                field->duplicate = true;
+                                break;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+#define WORD_ONES UINT64_C(0x0101010101010101)
+#define WORD_HIGHS UINT64_C(0x8080808080808080)
+
+static inline uint64_t word_has_zero_byte(uint64_t w) {
+        return (w - WORD_ONES) & ~w & WORD_HIGHS;
+}
+
+static inline uint64_t word_has_special_byte(uint64_t w, bool ascii) {
+        uint64_t m;
+
+        /* Non-zero if any of the bytes is a control character, '"' or '\\'. If ascii is true, also if any of
+         * them is DEL or not ASCII. */
+
+        m = ((w - WORD_ONES * 0x20) & ~w & WORD_HIGHS) |
+            word_has_zero_byte(w ^ (WORD_ONES * '"')) |
+            word_has_zero_byte(w ^ (WORD_ONES * '\\'));
+        if (ascii)
+                m |= (w & WORD_HIGHS) | word_has_zero_byte(w ^ (WORD_ONES * 0x7f));
+
+        return m;
+}
+
+static size_t json_plain_prefix(const char *p, size_t l, bool ascii) {
+        size_t i = 0;
+
+        /* Returns the number of leading bytes that may be copied into a JSON string as they are. Looks at a
+         * word at a time, since that's the common case for all of a field. */
+
+        for (; i + sizeof(uint64_t) <= l; i += sizeof(uint64_t)) {
+                uint64_t w;
+
+                memcpy(&w, p + i, sizeof(w));
+                if (word_has_special_byte(w, ascii))
+                        break;
+        }
+
+        for (; i < l; i++) {
+                uint8_t c = p[i];
+
+                if (c < ' ' || IN_SET(c, '"', '\\') || (ascii && c >= 0x7f))
+                        break;
+        }
+
+        return i;
+}
+
+static void json_write_string(FILE *f, const char *p, size_t l) {
+        fputc_unlocked('"', f);
+
+        for (;;) {
+                size_t n;
+
+                n = json_plain_prefix(p, l, false);
+                fwrite_unlocked(p, 1, n, f);
+                p += n;
+                l -= n;
+
+                if (l == 0)
+                        break;
+
+                /* Same escaping as json_format_string() */
+                switch (*p) {
+
+                case '"':
+                        fputs_unlocked("\\\"", f);
+                        break;
+
+                case '\\':
+                        fputs_unlocked("\\\\", f);
+                        break;
+
+                case '\b':
+                        fputs_unlocked("\\b", f);
+                        break;
+
+                case '\f':
+                        fputs_unlocked("\\f", f);
+                        break;
+
+                case '\n':
+                        fputs_unlocked("\\n", f);
+                        break;
+
+                case '\r':
+                        fputs_unlocked("\\r", f);
+                        break;
+
+                case '\t':
+                        fputs_unlocked("\\t", f);
+                        break;
+
+                default:
+                        fprintf(f, "\\u%04x", (uint8_t) *p);
+                }
+
+                p++;
+                l--;
+        }
+
+        fputc_unlocked('"', f);
+}
+
+static void json_write_value(FILE *f, OutputFlags flags, const JsonField *field, const char *data) {
+        const char *p;
+        size_t l, i;
+
+        if (!(flags & OUTPUT_SHOW_ALL) && field->size >= JSON_THRESHOLD) {
+                fputs_unlocked("null", f);
+                return;
+        }
+
+        p = data + field->offset + field->name_size + 1;
+        l = field->size - field->name_size - 1;
+
+        /* Plain ASCII needs neither validation nor escaping */
+        if (json_plain_prefix(p, l, true) == l) {
+                fputc_unlocked('"', f);
+                fwrite_unlocked(p, 1, l, f);
+                fputc_unlocked('"', f);
+                return;
+        }
+
+        if (utf8_is_printable(p, l)) {
+                json_write_string(f, p, l);
+                return;
+        }
+
+        fputc_unlocked('[', f);
+        for (i = 0; i < l; i++)
+                fprintf(f, i > 0 ? ",%u" : "%u", (uint8_t) p[i]);
+        fputc_unlocked(']', f);
+}
+
+static int output_json_plain(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                OutputFlags flags,
+                const Set *output_fields) {
+
+        char sid[SD_ID128_STRING_MAX], usecbuf[DECIMAL_STR_MAX(usec_t)];
+        JsonOutputCache *c = &json_output_cache;
+        _cleanup_free_ char *cursor = NULL;
+        uint64_t realtime, monotonic;
+        sd_id128_t boot_id;
+        bool first = true;
+        size_t i;
+        int r;
+
+        assert(f);
+        assert(j);
+
+        (void) sd_journal_set_data_threshold(j, flags & OUTPUT_SHOW_ALL ? 0 : JSON_THRESHOLD);
+
+        r = sd_journal_get_realtime_usec(j, &realtime);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get realtime timestamp: %m");
+
+        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
+
+        r = sd_journal_get_cursor(j, &cursor);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cursor: %m");
+
+        c->data_size = c->n_fields = 0;
+
+        r = json_output_cache_add(c, "__CURSOR", STRLEN("__CURSOR"), cursor, strlen(cursor));
+        if (r < 0)
+                return r;
+
+        xsprintf(usecbuf, USEC_FMT, realtime);
+        r = json_output_cache_add(c, "__REALTIME_TIMESTAMP", STRLEN("__REALTIME_TIMESTAMP"), usecbuf, strlen(usecbuf));
+        if (r < 0)
+                return r;
+
+        xsprintf(usecbuf, USEC_FMT, monotonic);
+        r = json_output_cache_add(c, "__MONOTONIC_TIMESTAMP", STRLEN("__MONOTONIC_TIMESTAMP"), usecbuf, strlen(usecbuf));
+        if (r < 0)
+                return r;
+
+        sd_id128_to_string(boot_id, sid);
+        r = json_output_cache_add(c, "_BOOT_ID", STRLEN("_BOOT_ID"), sid, strlen(sid));
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                const void *data;
+                const char *eq;
+                size_t size;
+
+                r = sd_journal_enumerate_data(j, &data, &size);
+                if (r == -EBADMSG) {
+                        log_debug_errno(r, "Skipping message we can't read: %m");
+                        return 0;
+                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read journal: %m");
+                if (r == 0)
+                        break;
+
+                if (memory_startswith(data, size, "_BOOT_ID="))
+                        continue;
+
+                eq = memchr(data, '=', MIN(size, JSON_THRESHOLD));
+                if (!eq || eq == data)
+                        continue;
+
+                if (output_fields && !set_contains(output_fields, strndupa(data, eq - (const char*) data)))
+                        continue;
+
+                r = json_output_cache_add(c, NULL, eq - (const char*) data, data, size);
+                if (r < 0)
+                        return r;
+        }
+
+        r = json_output_cache_group(c);
+        if (r < 0)
+                return r;
+
+        flockfile(f);
+
+        if (mode == OUTPUT_JSON_SSE)
+                fputs_unlocked("data: ", f);
+        if (mode == OUTPUT_JSON_SEQ)
+                fputc_unlocked('\x1e', f); /* ASCII Record Separator */
+
+        fputc_unlocked('{', f);
+
+        for (i = 0; i < c->n_fields; i++) {
+                JsonField *field = c->fields + i;
+
+                if (field->duplicate)
+                        continue;
+
+                if (!first)
+                        fputc_unlocked(',', f);
+                first = false;
+
+                json_write_string(f, c->data + field->offset, field->name_size);
+                fputc_unlocked(':', f);
+
+                if (field->next == SIZE_MAX)
+                        json_write_value(f, flags, field, c->data);
+                else {
+                        size_t k;
+
+                        fputc_unlocked('[', f);
+                        for (k = i; k != SIZE_MAX; k = c->fields[k].next) {
+                                if (k != i)
+                                        fputc_unlocked(',', f);
+                                json_write_value(f, flags, c->fields + k, c->data);
+                        }
+                        fputc_unlocked(']', f);
+                }
+        }
+
+        fputs_unlocked(mode == OUTPUT_JSON_SSE ? "}\n\n" : "}\n", f);
+
+        funlockfile(f);
+
+        if (c->data_allocated > JSON_OUTPUT_CACHE_MAX)
+                show_journal_entry_release_cache();
+
+        return 0;
+}
+
 static int output_json(
                 FILE *f,
                 sd_journal *j,
@@ -1004,6 +1415,9 @@ static int output_json(
 
         assert(j);
 
+        if (mode != OUTPUT_JSON_PRETTY && !FLAGS_SET(flags, OUTPUT_COLOR))
+                return output_json_plain(f, j, mode, flags, output_fields);
+
         (void) sd_journal_set_data_threshold(j, flags & OUTPUT_SHOW_ALL ? 0 : JSON_THRESHOLD);
 
         r = sd_journal_get_realtime_usec(j, &realtime);
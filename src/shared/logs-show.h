@@ -22,6 +22,7 @@ int show_journal_entry(
                 char **output_fields,
                 const size_t highlight[2],
                 bool *ellipsized);
+void show_journal_entry_release_cache(void);
 int show_journal(
                 FILE *f,
                 sd_journal *j,
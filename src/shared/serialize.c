@@ -4,6 +4,7 @@
 
 #include "alloc-util.h"
 #include "env-util.h"
+#include "errno-util.h"
 #include "escape.h"
 #include "fileio.h"
 #include "missing_mman.h"
@@ -131,6 +132,46 @@ int serialize_strv(FILE *f, const char *key, char **l) {
         return ret;
 }
 
+int deserialize_read_line(FILE *f, char **ret) {
+        _cleanup_free_ char *line = NULL;
+        size_t allocated = 0;
+        ssize_t n;
+
+        assert(f);
+        assert(ret);
+
+        /* Reads one line of a serialization we wrote ourselves through serialize_item() and friends. Unlike
+         * read_line() this does not look at the stream character by character, and does not check whether
+         * the file is a TTY for each line: everything we wrote is terminated by '\n' only and never contains
+         * other line separators, hence we can let getline() find the line end in the stdio buffer in one go.
+         * Returns the number of bytes consumed, or 0 on EOF, in which case *ret is set to an empty string,
+         * exactly like read_line(). */
+
+        errno = 0;
+        n = getline(&line, &allocated, f);
+        if (n < 0) {
+                if (ferror(f))
+                        return errno_or_else(EIO);
+
+                free(line);
+                line = strdup("");
+                if (!line)
+                        return -ENOMEM;
+
+                *ret = TAKE_PTR(line);
+                return 0;
+        }
+
+        if ((size_t) n > LONG_LINE_MAX)
+                return -ENOBUFS;
+
+        if (n > 0 && line[n-1] == '\n')
+                line[n-1] = 0;
+
+        *ret = TAKE_PTR(line);
+        return (int) n;
+}
+
 int deserialize_usec(const char *value, usec_t *ret) {
         int r;
 
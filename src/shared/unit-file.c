@@ -1,17 +1,27 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+
 #include "sd-id128.h"
 
 #include "dirent-util.h"
+#include "env-util.h"
+#include "errno-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "macro.h"
 #include "path-lookup.h"
+#include "path-util.h"
 #include "set.h"
+#include "siphash24.h"
+#include "sparse-endian.h"
 #include "special.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "tmpfile-util.h"
 #include "unit-file.h"
 
 bool unit_type_may_alias(UnitType type) {
@@ -235,6 +245,313 @@ bool lookup_paths_timestamp_hash_same(const LookupPaths *lp, uint64_t timestamp_
         return updated == timestamp_hash;
 }
 
+#define CACHE_HASH_KEY SD_ID128_MAKE(b6,1d,4e,02,5f,f3,4b,3c,8e,a0,71,9b,c3,52,6e,d9)
+
+/* The unit name map cache is a single file, which is mmap()ed and copied into the hashmaps in one go. After
+ * the header, it consists of NUL terminated strings only: first "id\0destination\0" pairs, then one
+ * "name\0alias\0alias\0…\0\0" list for each name, then the paths of the path cache. */
+typedef struct UnitNameMapCacheHeader {
+        uint8_t signature[8];
+        le64_t key;
+        le64_t n_ids;
+        le64_t n_names;
+        le64_t n_paths;
+        le64_t size;
+} _packed_ UnitNameMapCacheHeader;
+
+#define UNIT_NAME_MAP_CACHE_SIGNATURE ((const uint8_t[]) { 'S', 'D', 'U', 'N', 'M', 'A', 'P', '1' })
+#define UNIT_NAME_MAP_CACHE_SIZE_MAX (64U*1024U*1024U)
+
+uint64_t unit_name_map_cache_key(const LookupPaths *lp) {
+        struct siphash state;
+        char **dir;
+
+        assert(lp);
+
+        /* Contrary to lookup_paths_timestamp_hash_same() this covers all directories, including the ones
+         * under our control, since the cache is shared between all users of the same lookup paths. It also
+         * covers the paths themselves and the identity of the directories, so that a directory that is
+         * replaced by a new one is noticed. */
+
+        siphash24_init(&state, CACHE_HASH_KEY.bytes);
+
+        string_hash_func(strempty(lp->root_dir), &state);
+
+        STRV_FOREACH(dir, (char**) lp->search_path) {
+                struct stat st;
+
+                string_hash_func(*dir, &state);
+
+                if (stat(*dir, &st) < 0) {
+                        siphash24_compress_boolean(false, &state);
+                        continue;
+                }
+
+                siphash24_compress_boolean(true, &state);
+                siphash24_compress(&st.st_dev, sizeof(st.st_dev), &state);
+                siphash24_compress(&st.st_ino, sizeof(st.st_ino), &state);
+                siphash24_compress(&st.st_mtim.tv_sec, sizeof(st.st_mtim.tv_sec), &state);
+                siphash24_compress(&st.st_mtim.tv_nsec, sizeof(st.st_mtim.tv_nsec), &state);
+        }
+
+        return siphash24_finalize(&state);
+}
+
+static int unit_name_map_cache_path(const LookupPaths *lp, char **ret) {
+        _cleanup_free_ char *dir = NULL;
+        int r;
+
+        assert(lp);
+        assert(ret);
+
+        r = getenv_bool("SYSTEMD_NAME_MAP_CACHE");
+        if (r == 0)
+                return -EPERM;
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_NAME_MAP_CACHE, ignoring: %m");
+
+        /* Use the directory the transient units are placed in, i.e. /run/systemd/ or the user's runtime
+         * directory. Not when operating on a different root or with temporary lookup paths though. */
+        if (!lp->transient || lp->root_dir || lp->temporary_dir)
+                return -EOPNOTSUPP;
+
+        dir = dirname_malloc(lp->transient);
+        if (!dir)
+                return -ENOMEM;
+
+        *ret = path_join(dir, "unit-name-map.cache");
+        if (!*ret)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int cache_write_string(FILE *f, const char *s) {
+        assert(f);
+        assert(s);
+
+        if (fwrite(s, 1, strlen(s) + 1, f) != strlen(s) + 1)
+                return errno_or_else(EIO);
+
+        return 0;
+}
+
+int unit_name_map_cache_write(const char *path, uint64_t key, Hashmap *ids, Hashmap *names, Set *paths) {
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        UnitNameMapCacheHeader header;
+        const char *k, *v;
+        char **l, **i;
+        long size;
+        int r;
+
+        assert(path);
+
+        r = fopen_temporary(path, &f, &t);
+        if (r < 0)
+                return r;
+
+        /* The header is written again at the end, once the size is known */
+        header = (UnitNameMapCacheHeader) {
+                .key = htole64(key),
+                .n_ids = htole64(hashmap_size(ids)),
+                .n_names = htole64(hashmap_size(names)),
+                .n_paths = htole64(set_size(paths)),
+        };
+
+        if (fwrite(&header, sizeof(header), 1, f) != 1)
+                return errno_or_else(EIO);
+
+        HASHMAP_FOREACH_KEY(v, k, ids) {
+                r = cache_write_string(f, k);
+                if (r < 0)
+                        return r;
+
+                r = cache_write_string(f, v);
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH_KEY(l, k, names) {
+                r = cache_write_string(f, k);
+                if (r < 0)
+                        return r;
+
+                STRV_FOREACH(i, l) {
+                        r = cache_write_string(f, *i);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = cache_write_string(f, "");
+                if (r < 0)
+                        return r;
+        }
+
+        SET_FOREACH(v, paths) {
+                r = cache_write_string(f, v);
+                if (r < 0)
+                        return r;
+        }
+
+        size = ftell(f);
+        if (size < 0)
+                return -errno;
+        if ((unsigned long) size > UNIT_NAME_MAP_CACHE_SIZE_MAX)
+                return -EFBIG;
+
+        memcpy(header.signature, UNIT_NAME_MAP_CACHE_SIGNATURE, sizeof(header.signature));
+        header.size = htole64(size);
+
+        rewind(f);
+        if (fwrite(&header, sizeof(header), 1, f) != 1)
+                return errno_or_else(EIO);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (fchmod(fileno(f), 0644) < 0)
+                return -errno;
+
+        if (rename(t, path) < 0)
+                return -errno;
+
+        t = mfree(t);
+        return 0;
+}
+
+static const char* cache_next_string(const char **p, const char *end) {
+        const char *s = *p;
+
+        /* The file ends in a NUL byte, hence there's always a terminated string as long as we're not at
+         * the end yet */
+        if (s >= end)
+                return NULL;
+
+        *p = s + strlen(s) + 1;
+        return s;
+}
+
+int unit_name_map_cache_read(const char *path, uint64_t key, Hashmap **ret_ids, Hashmap **ret_names, Set **ret_paths) {
+        _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL;
+        _cleanup_set_free_free_ Set *paths = NULL;
+        _cleanup_close_ int fd = -1;
+        const UnitNameMapCacheHeader *header;
+        const char *p, *end, *k, *v;
+        struct stat st;
+        uint64_t i;
+        void *map;
+        int r;
+
+        assert(path);
+        assert(ret_ids);
+        assert(ret_names);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOFOLLOW|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* Only trust what we or root wrote ourselves */
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+        if (st.st_uid != 0 && st.st_uid != geteuid())
+                return -EPERM;
+        if (st.st_size < (off_t) sizeof(UnitNameMapCacheHeader) || st.st_size > UNIT_NAME_MAP_CACHE_SIZE_MAX)
+                return -EBADMSG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        header = map;
+        p = (const char*) map + sizeof(UnitNameMapCacheHeader);
+        end = (const char*) map + st.st_size;
+
+        if (memcmp(header->signature, UNIT_NAME_MAP_CACHE_SIGNATURE, sizeof(header->signature)) != 0 ||
+            le64toh(header->size) != (uint64_t) st.st_size ||
+            (p < end && end[-1] != 0)) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        if (le64toh(header->key) != key) {
+                r = -ESTALE;
+                goto finish;
+        }
+
+        for (i = 0; i < le64toh(header->n_ids); i++) {
+                k = cache_next_string(&p, end);
+                v = cache_next_string(&p, end);
+                if (!k || !v) {
+                        r = -EBADMSG;
+                        goto finish;
+                }
+
+                r = hashmap_put_strdup(&ids, k, v);
+                if (r < 0)
+                        goto finish;
+        }
+
+        for (i = 0; i < le64toh(header->n_names); i++) {
+                k = cache_next_string(&p, end);
+                if (!k) {
+                        r = -EBADMSG;
+                        goto finish;
+                }
+
+                for (;;) {
+                        v = cache_next_string(&p, end);
+                        if (!v) {
+                                r = -EBADMSG;
+                                goto finish;
+                        }
+                        if (isempty(v))
+                                break;
+
+                        r = string_strv_hashmap_put(&names, k, v);
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        if (ret_paths) {
+                paths = set_new(&path_hash_ops_free);
+                if (!paths) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+        }
+
+        for (i = 0; i < le64toh(header->n_paths); i++) {
+                k = cache_next_string(&p, end);
+                if (!k) {
+                        r = -EBADMSG;
+                        goto finish;
+                }
+
+                if (!paths)
+                        continue;
+
+                r = set_put_strdup(&paths, k);
+                if (r < 0)
+                        goto finish;
+        }
+
+        *ret_ids = TAKE_PTR(ids);
+        *ret_names = TAKE_PTR(names);
+        if (ret_paths)
+                *ret_paths = TAKE_PTR(paths);
+        r = 0;
+
+finish:
+        (void) munmap(map, st.st_size);
+        return r;
+}
+
 int unit_file_build_name_map(
                 const LookupPaths *lp,
                 uint64_t *cache_timestamp_hash,
@@ -254,7 +571,8 @@ int unit_file_build_name_map(
 
         _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL;
         _cleanup_set_free_free_ Set *paths = NULL;
-        uint64_t timestamp_hash;
+        _cleanup_free_ char *cache_path = NULL;
+        uint64_t timestamp_hash, cache_key = 0;
         char **dir;
         int r;
 
@@ -267,6 +585,20 @@ int unit_file_build_name_map(
         /* The timestamp hash is now set based on the mtimes from before when we start reading files.
          * If anything is modified concurrently, we'll consider the cache outdated. */
 
+        /* Then check if somebody else, i.e. the manager or an earlier systemctl invocation, already built
+         * the maps for the very same directory contents, and left them in the cache in /run for us. */
+        if (unit_name_map_cache_path(lp, &cache_path) >= 0) {
+                cache_key = unit_name_map_cache_key(lp);
+
+                r = unit_name_map_cache_read(cache_path, cache_key, &ids, &names, path_cache ? &paths : NULL);
+                if (r >= 0) {
+                        log_debug("Loaded unit name map from %s.", cache_path);
+                        goto finish;
+                }
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Failed to load unit name map from %s, rebuilding: %m", cache_path);
+        }
+
         if (path_cache) {
                 paths = set_new(&path_hash_ops_free);
                 if (!paths)
@@ -421,6 +753,13 @@ int unit_file_build_name_map(
                                                  basename(dst), src);
         }
 
+        if (cache_path) {
+                r = unit_name_map_cache_write(cache_path, cache_key, ids, names, paths);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write unit name map to %s, ignoring: %m", cache_path);
+        }
+
+finish:
         if (cache_timestamp_hash)
                 *cache_timestamp_hash = timestamp_hash;
 
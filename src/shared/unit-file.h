@@ -44,6 +44,11 @@ int unit_symlink_name_compatible(const char *symlink, const char *target, bool i
 int unit_validate_alias_symlink_and_warn(const char *filename, const char *target);
 
 bool lookup_paths_timestamp_hash_same(const LookupPaths *lp, uint64_t timestamp_hash, uint64_t *ret_new);
+
+uint64_t unit_name_map_cache_key(const LookupPaths *lp);
+int unit_name_map_cache_write(const char *path, uint64_t key, Hashmap *ids, Hashmap *names, Set *paths);
+int unit_name_map_cache_read(const char *path, uint64_t key, Hashmap **ret_ids, Hashmap **ret_names, Set **ret_paths);
+
 int unit_file_build_name_map(
                 const LookupPaths *lp,
                 uint64_t *cache_timestamp_hash,
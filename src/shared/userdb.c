@@ -384,11 +384,30 @@ static int userdb_connect(
         return r;
 }
 
+static bool userdb_service_may_own_uid(const char *service, uid_t uid) {
+        assert(service);
+
+        /* Some of our own services only ever serve records from a fixed UID/GID range. Lookups of
+         * UIDs/GIDs outside of these ranges (for example of users from LDAP, or of files owned by UIDs
+         * that have no user at all) don't need to be sent there. */
+
+        if (!uid_is_valid(uid))
+                return true;
+
+        if (streq(service, "io.systemd.DynamicUser"))
+                return uid_is_dynamic(uid);
+        if (streq(service, "io.systemd.Home"))
+                return uid_is_home(uid);
+
+        return true;
+}
+
 static int userdb_start_query(
                 UserDBIterator *iterator,
                 const char *method,
                 bool more,
                 JsonVariant *query,
+                uid_t uid,           /* UID or GID looked up, or UID_INVALID */
                 UserDBFlags flags) {
 
         _cleanup_(strv_freep) char **except = NULL, **only = NULL;
@@ -470,6 +489,9 @@ static int userdb_start_query(
                 if (only && !strv_contains(only, de->d_name))
                         continue;
 
+                if (!userdb_service_may_own_uid(de->d_name, uid))
+                        continue;
+
                 p = path_join("/run/systemd/userdb/", de->d_name);
                 if (!p)
                         return -ENOMEM;
@@ -612,7 +634,7 @@ int userdb_by_name(const char *name, UserDBFlags flags, UserRecord **ret) {
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", false, query, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", false, query, UID_INVALID, flags);
         if (r >= 0) {
                 r = userdb_process(iterator, ret, NULL, NULL, NULL);
                 if (r >= 0)
@@ -659,7 +681,7 @@ int userdb_by_uid(uid_t uid, UserDBFlags flags, UserRecord **ret) {
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", false, query, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", false, query, uid, flags);
         if (r >= 0) {
                 r = userdb_process(iterator, ret, NULL, NULL, NULL);
                 if (r >= 0)
@@ -699,7 +721,7 @@ int userdb_all(UserDBFlags flags, UserDBIterator **ret) {
 
         iterator->synthesize_root = iterator->synthesize_nobody = !FLAGS_SET(flags, USERDB_DONT_SYNTHESIZE);
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", true, NULL, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetUserRecord", true, NULL, UID_INVALID, flags);
 
         if (!FLAGS_SET(flags, USERDB_AVOID_NSS) && (r < 0 || !iterator->nss_covered)) {
                 r = userdb_iterator_block_nss_systemd(iterator);
@@ -816,7 +838,7 @@ int groupdb_by_name(const char *name, UserDBFlags flags, GroupRecord **ret) {
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", false, query, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", false, query, UID_INVALID, flags);
         if (r >= 0) {
                 r = userdb_process(iterator, NULL, ret, NULL, NULL);
                 if (r >= 0)
@@ -860,7 +882,7 @@ int groupdb_by_gid(gid_t gid, UserDBFlags flags, GroupRecord **ret) {
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", false, query, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", false, query, (uid_t) gid, flags);
         if (r >= 0) {
                 r = userdb_process(iterator, NULL, ret, NULL, NULL);
                 if (r >= 0)
@@ -899,7 +921,7 @@ int groupdb_all(UserDBFlags flags, UserDBIterator **ret) {
 
         iterator->synthesize_root = iterator->synthesize_nobody = !FLAGS_SET(flags, USERDB_DONT_SYNTHESIZE);
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", true, NULL, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetGroupRecord", true, NULL, UID_INVALID, flags);
 
         if (!FLAGS_SET(flags, USERDB_AVOID_NSS) && (r < 0 || !iterator->nss_covered)) {
                 r = userdb_iterator_block_nss_systemd(iterator);
@@ -999,7 +1021,7 @@ int membershipdb_by_user(const char *name, UserDBFlags flags, UserDBIterator **r
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, query, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, query, UID_INVALID, flags);
         if ((r >= 0 && iterator->nss_covered) || FLAGS_SET(flags, USERDB_AVOID_NSS))
                 goto finish;
 
@@ -1042,7 +1064,7 @@ int membershipdb_by_group(const char *name, UserDBFlags flags, UserDBIterator **
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, query, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, query, UID_INVALID, flags);
         if ((r >= 0 && iterator->nss_covered) || FLAGS_SET(flags, USERDB_AVOID_NSS))
                 goto finish;
 
@@ -1083,7 +1105,7 @@ int membershipdb_all(UserDBFlags flags, UserDBIterator **ret) {
         if (!iterator)
                 return -ENOMEM;
 
-        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, NULL, flags);
+        r = userdb_start_query(iterator, "io.systemd.UserDatabase.GetMemberships", true, NULL, UID_INVALID, flags);
         if ((r >= 0 && iterator->nss_covered) || FLAGS_SET(flags, USERDB_AVOID_NSS))
                 goto finish;
 
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "event-stats.h"
+#include "varlink-event.h"
+
+static int event_histogram_build_json(const EventHistogram *h, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *buckets = NULL;
+        unsigned i;
+        int r;
+
+        assert(h);
+        assert(ret);
+
+        /* Only the buckets that counted anything, everything else would be mostly zeroes */
+        for (i = 0; i < EVENT_HISTOGRAM_BUCKETS; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *b = NULL;
+
+                if (h->buckets[i] == 0)
+                        continue;
+
+                r = json_build(&b, JSON_BUILD_OBJECT(
+                                               JSON_BUILD_PAIR("belowUSec", JSON_BUILD_UNSIGNED(event_histogram_bucket_below(i))),
+                                               JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(h->buckets[i]))));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&buckets, b);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!buckets) {
+                r = json_variant_new_array(&buckets, NULL, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(h->n)),
+                                          JSON_BUILD_PAIR("totalUSec", JSON_BUILD_UNSIGNED(h->sum)),
+                                          JSON_BUILD_PAIR("maxUSec", JSON_BUILD_UNSIGNED(h->max)),
+                                          JSON_BUILD_PAIR("p50USec", JSON_BUILD_UNSIGNED(event_histogram_percentile(h, 50))),
+                                          JSON_BUILD_PAIR("p90USec", JSON_BUILD_UNSIGNED(event_histogram_percentile(h, 90))),
+                                          JSON_BUILD_PAIR("p99USec", JSON_BUILD_UNSIGNED(event_histogram_percentile(h, 99))),
+                                          JSON_BUILD_PAIR("histogram", JSON_BUILD_VARIANT(buckets))));
+}
+
+int event_stats_build_json(sd_event *e, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *wakeup = NULL, *dwell = NULL;
+        const EventStats *stats;
+        EventPriorityClass c;
+        usec_t elapsed;
+        uint64_t iteration;
+        int r;
+
+        assert(e);
+        assert(ret);
+
+        stats = event_get_stats(e);
+        if (!stats)
+                return -ENODATA;
+
+        r = sd_event_get_iteration(e, &iteration);
+        if (r < 0)
+                return r;
+
+        r = event_histogram_build_json(&stats->wakeup_latency, &wakeup);
+        if (r < 0)
+                return r;
+
+        for (c = 0; c < _EVENT_PRIORITY_CLASS_MAX; c++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                r = event_histogram_build_json(&stats->dwell_time[c], &v);
+                if (r < 0)
+                        return r;
+
+                r = json_variant_set_field(&dwell, event_priority_class_to_string(c), v);
+                if (r < 0)
+                        return r;
+        }
+
+        elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), stats->since);
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR("iterations", JSON_BUILD_UNSIGNED(iteration)),
+                                          JSON_BUILD_PAIR("wakeups", JSON_BUILD_UNSIGNED(stats->n_wakeups)),
+                                          JSON_BUILD_PAIR("recordingUSec", JSON_BUILD_UNSIGNED(elapsed)),
+                                          JSON_BUILD_PAIR("waitUSec", JSON_BUILD_UNSIGNED(stats->wait_usec)),
+                                          JSON_BUILD_PAIR("idleRatio", JSON_BUILD_REAL(elapsed > 0 ? (long double) MIN(stats->wait_usec, elapsed) / elapsed : 0)),
+                                          JSON_BUILD_PAIR("wakeupLatency", JSON_BUILD_VARIANT(wakeup)),
+                                          JSON_BUILD_PAIR("dwellTime", JSON_BUILD_VARIANT(dwell))));
+}
+
+static int vl_method_get_stats(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        sd_event *e;
+        int r;
+
+        assert(link);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        e = varlink_get_event(link);
+        if (!e)
+                return varlink_error(link, "io.systemd.EventLoop.NotAttached", NULL);
+
+        r = event_stats_build_json(e, &v);
+        if (r == -ENODATA)
+                return varlink_error(link, "io.systemd.EventLoop.NotRecording", NULL);
+        if (r < 0)
+                return r;
+
+        return varlink_reply(link, v);
+}
+
+int varlink_server_bind_event_loop(VarlinkServer *s) {
+        assert(s);
+
+        return varlink_server_bind_method(s, "io.systemd.EventLoop.GetStats", vl_method_get_stats);
+}
@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "json.h"
+#include "sd-event.h"
+#include "varlink.h"
+
+int event_stats_build_json(sd_event *e, JsonVariant **ret);
+
+/* Binds io.systemd.EventLoop.GetStats, which reports the latency statistics of the event loop the server is
+ * attached to. Recording them needs to be enabled with $SD_EVENT_STATS=1. */
+int varlink_server_bind_event_loop(VarlinkServer *s);
@@ -508,6 +508,14 @@ static int varlink_read(Varlink *v) {
                         if (!GREEDY_REALLOC(v->input_buffer, v->input_buffer_allocated, v->input_buffer_size + add))
                                 return -ENOMEM;
 
+                } else if (v->input_buffer_allocated >= v->input_buffer_size + add) {
+
+                        /* There's enough room if we move the unprocessed data (i.e. the beginning of the
+                         * next message, when the other side pipelines its messages) to the front, no need
+                         * to allocate a new buffer. */
+                        memmove(v->input_buffer, v->input_buffer + v->input_buffer_index, v->input_buffer_size);
+                        v->input_buffer_index = 0;
+
                 } else {
                         char *b;
 
@@ -584,7 +592,7 @@ static int varlink_parse_message(Varlink *v) {
                                                             * This may produce a non-printable journal entry if the message
                                                             * is invalid. We may also expose privileged information. */
 
-        r = json_parse(begin, 0, &v->current, NULL, NULL);
+        r = json_parse(begin, JSON_PARSE_NO_LINE_COLUMN, &v->current, NULL, NULL);
         if (r < 0) {
                 /* If we encounter a parse failure flush all data. We cannot possibly recover from this,
                  * hence drop all buffered data now. */
@@ -458,13 +458,21 @@ static int remount_with_timeout(MountPoint *m, int umount_log_level) {
         return r;
 }
 
-static int umount_with_timeout(MountPoint *m, int umount_log_level) {
+/* How many umount operations to run at the same time */
+#define UMOUNT_PARALLEL_MAX 16
+
+typedef struct UmountChild {
+        MountPoint *mount_point;
         pid_t pid;
-        int r;
+        usec_t until;
+} UmountChild;
 
-        BLOCK_SIGNALS(SIGCHLD);
+static int umount_fork(MountPoint *m, int umount_log_level, pid_t *ret_pid) {
+        pid_t pid;
+        int r;
 
         assert(m);
+        assert(ret_pid);
 
         /* Due to the possibility of a umount operation hanging, we
          * fork a child process and set a timeout. If the timeout
@@ -490,28 +498,116 @@ static int umount_with_timeout(MountPoint *m, int umount_log_level) {
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
-        r = wait_for_terminate_with_timeout(pid, DEFAULT_TIMEOUT_USEC);
-        if (r == -ETIMEDOUT) {
-                log_error_errno(r, "Unmounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", m->path, pid);
-                (void) kill(pid, SIGKILL);
-        } else if (r == -EPROTO)
-                log_debug_errno(r, "Unmounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", m->path, pid);
-        else if (r < 0)
-                log_error_errno(r, "Unmounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", m->path, pid);
+        *ret_pid = pid;
+        return 0;
+}
 
-        return r;
+static bool umount_children_overlap(const UmountChild *children, size_t n_children, const char *path) {
+        assert(children || n_children == 0);
+        assert(path);
+
+        /* Checks whether any of the mount points currently being unmounted is below or above the specified
+         * one. Unmounting those at the same time would only make one of them fail with EBUSY. */
+
+        for (size_t i = 0; i < n_children; i++)
+                if (path_startswith(children[i].mount_point->path, path) ||
+                    path_startswith(path, children[i].mount_point->path))
+                        return true;
+
+        return false;
+}
+
+static void umount_children_wait(UmountChild *children, size_t *n_children, bool *changed, int *n_failed) {
+        sigset_t mask;
+
+        assert(children);
+        assert(n_children);
+        assert(*n_children > 0);
+        assert(changed);
+        assert(n_failed);
+
+        /* Waits until at least one of the children exited or timed out, and removes those from the array.
+         * Expects SIGCHLD to be blocked. */
+
+        assert_se(sigemptyset(&mask) == 0);
+        assert_se(sigaddset(&mask, SIGCHLD) == 0);
+
+        for (;;) {
+                usec_t n, until = USEC_INFINITY;
+                struct timespec ts;
+                size_t n_done = 0;
+
+                n = now(CLOCK_MONOTONIC);
+
+                for (size_t i = 0; i < *n_children;) {
+                        UmountChild *c = children + i;
+                        siginfo_t status = {};
+
+                        if (waitid(P_PID, c->pid, &status, WEXITED|WNOHANG) < 0) {
+                                log_error_errno(errno, "Unmounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", c->mount_point->path, c->pid);
+                                (*n_failed)++;
+                        } else if (status.si_pid == c->pid) {
+                                if (status.si_code == CLD_EXITED && status.si_status == 0)
+                                        *changed = true;
+                                else {
+                                        log_debug("Unmounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", c->mount_point->path, c->pid);
+                                        (*n_failed)++;
+                                }
+                        } else if (n >= c->until) {
+                                log_error_errno(SYNTHETIC_ERRNO(ETIMEDOUT), "Unmounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", c->mount_point->path, c->pid);
+                                (void) kill(c->pid, SIGKILL);
+                                (*n_failed)++;
+                        } else {
+                                until = MIN(until, c->until);
+                                i++;
+                                continue;
+                        }
+
+                        /* This one is done, fill the gap with the last one */
+                        *c = children[--(*n_children)];
+                        n_done++;
+                }
+
+                if (n_done > 0)
+                        return;
+
+                if (sigtimedwait(&mask, NULL, timespec_store(&ts, until - n)) < 0 && !IN_SET(errno, EAGAIN, EINTR)) {
+                        log_error_errno(errno, "sigtimedwait() failed, giving up on pending unmounts: %m");
+
+                        for (size_t i = 0; i < *n_children; i++)
+                                (void) kill(children[i].pid, SIGKILL);
+
+                        *n_failed += *n_children;
+                        *n_children = 0;
+                        return;
+                }
+        }
 }
 
 /* This includes remounting readonly, which changes the kernel mount options.  Therefore the list passed to
  * this function is invalidated, and should not be reused. */
 static int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level) {
+        UmountChild children[UMOUNT_PARALLEL_MAX];
+        size_t n_children = 0;
         MountPoint *m;
         int n_failed = 0;
 
         assert(head);
         assert(changed);
 
+        BLOCK_SIGNALS(SIGCHLD);
+
+        /* Mount points are unmounted in parallel, but a mount point is only started on once nothing below or
+         * above it is being unmounted anymore. As the list is ordered newest first, this means mounts nested
+         * in others are generally gone before we get to the mount they are nested in. */
+
         LIST_FOREACH(mount_point, m, *head) {
+                pid_t pid;
+
+                while (n_children >= UMOUNT_PARALLEL_MAX ||
+                       umount_children_overlap(children, n_children, m->path))
+                        umount_children_wait(children, &n_children, changed, &n_failed);
+
                 if (m->try_remount_ro) {
                         /* We always try to remount directories read-only first, before we go on and umount
                          * them.
@@ -541,12 +637,21 @@ static int mount_points_list_umount(MountPoint **head, bool *changed, int umount
                         continue;
 
                 /* Trying to umount */
-                if (umount_with_timeout(m, umount_log_level) < 0)
+                if (umount_fork(m, umount_log_level, &pid) < 0) {
                         n_failed++;
-                else
-                        *changed = true;
+                        continue;
+                }
+
+                children[n_children++] = (UmountChild) {
+                        .mount_point = m,
+                        .pid = pid,
+                        .until = usec_add(now(CLOCK_MONOTONIC), DEFAULT_TIMEOUT_USEC),
+                };
         }
 
+        while (n_children > 0)
+                umount_children_wait(children, &n_children, changed, &n_failed);
+
         return n_failed;
 }
 
@@ -25,14 +25,26 @@
 #include "set.h"
 #include "socket-util.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 
 #define BUFFER_SIZE (256 * 1024)
 
+/* How many drained pipe buffers to keep around for reuse by later connections */
+#define PIPE_CACHE_MAX 64U
+
+/* How many connections to accept() per listening socket wakeup */
+#define ACCEPT_BATCH_MAX 16U
+
 static unsigned arg_connections_max = 256;
 static const char *arg_remote_host = NULL;
 static usec_t arg_exit_idle_time = USEC_INFINITY;
 
+typedef struct PipeBuffer {
+        int fds[2];
+        size_t size;
+} PipeBuffer;
+
 typedef struct Context {
         sd_event *event;
         sd_resolve *resolve;
@@ -40,6 +52,9 @@ typedef struct Context {
 
         Set *listen;
         Set *connections;
+
+        PipeBuffer pipe_cache[PIPE_CACHE_MAX];
+        size_t n_pipe_cache;
 } Context;
 
 typedef struct Connection {
@@ -52,25 +67,53 @@ typedef struct Connection {
         size_t server_to_client_buffer_full, client_to_server_buffer_full;
         size_t server_to_client_buffer_size, client_to_server_buffer_size;
 
+        uint64_t server_to_client_bytes, client_to_server_bytes;
+        usec_t start_usec;
+
         sd_event_source *server_event_source, *client_event_source;
 
         sd_resolve_query *resolve_query;
 } Connection;
 
+static void connection_recycle_pipe(Connection *c, int buffer[static 2], size_t full, size_t sz) {
+        Context *context = c->context;
+
+        /* Setting up a fresh pipe of BUFFER_SIZE for every connection is comparatively expensive, hence
+         * keep pipes that were fully drained around and hand them to the next connection. */
+        if (context && buffer[0] >= 0 && full == 0 && context->n_pipe_cache < PIPE_CACHE_MAX) {
+                PipeBuffer *p = context->pipe_cache + context->n_pipe_cache++;
+
+                p->fds[0] = TAKE_FD(buffer[0]);
+                p->fds[1] = TAKE_FD(buffer[1]);
+                p->size = sz;
+                return;
+        }
+
+        safe_close_pair(buffer);
+}
+
 static void connection_free(Connection *c) {
         assert(c);
 
         if (c->context)
                 set_remove(c->context->connections, c);
 
+        if (c->start_usec > 0) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Connection closed after %s, %" PRIu64 " bytes from peer, %" PRIu64 " bytes to peer.",
+                          format_timespan(ts, sizeof(ts), usec_sub_unsigned(now(CLOCK_MONOTONIC), c->start_usec), USEC_PER_MSEC),
+                          c->server_to_client_bytes, c->client_to_server_bytes);
+        }
+
         sd_event_source_unref(c->server_event_source);
         sd_event_source_unref(c->client_event_source);
 
         safe_close(c->server_fd);
         safe_close(c->client_fd);
 
-        safe_close_pair(c->server_to_client_buffer);
-        safe_close_pair(c->client_to_server_buffer);
+        connection_recycle_pipe(c, c->server_to_client_buffer, c->server_to_client_buffer_full, c->server_to_client_buffer_size);
+        connection_recycle_pipe(c, c->client_to_server_buffer, c->client_to_server_buffer_full, c->client_to_server_buffer_size);
 
         sd_resolve_query_unref(c->resolve_query);
 
@@ -127,6 +170,10 @@ static void context_clear(Context *context) {
         set_free_with_destructor(context->listen, sd_event_source_unref);
         set_free_with_destructor(context->connections, connection_free);
 
+        for (size_t i = 0; i < context->n_pipe_cache; i++)
+                safe_close_pair(context->pipe_cache[i].fds);
+        context->n_pipe_cache = 0;
+
         sd_event_unref(context->event);
         sd_resolve_unref(context->resolve);
         sd_event_source_unref(context->idle_time);
@@ -142,6 +189,15 @@ static int connection_create_pipes(Connection *c, int buffer[static 2], size_t *
         if (buffer[0] >= 0)
                 return 0;
 
+        if (c->context->n_pipe_cache > 0) {
+                PipeBuffer *p = c->context->pipe_cache + --c->context->n_pipe_cache;
+
+                buffer[0] = TAKE_FD(p->fds[0]);
+                buffer[1] = TAKE_FD(p->fds[1]);
+                *sz = p->size;
+                return 0;
+        }
+
         r = pipe2(buffer, O_CLOEXEC|O_NONBLOCK);
         if (r < 0)
                 return log_error_errno(errno, "Failed to allocate pipe buffer: %m");
@@ -161,7 +217,7 @@ static int connection_create_pipes(Connection *c, int buffer[static 2], size_t *
 static int connection_shovel(
                 Connection *c,
                 int *from, int buffer[2], int *to,
-                size_t *full, size_t *sz,
+                size_t *full, size_t *sz, uint64_t *bytes,
                 sd_event_source **from_source, sd_event_source **to_source) {
 
         bool shoveled;
@@ -174,6 +230,7 @@ static int connection_shovel(
         assert(to);
         assert(full);
         assert(sz);
+        assert(bytes);
         assert(from_source);
         assert(to_source);
 
@@ -198,6 +255,7 @@ static int connection_shovel(
                         z = splice(buffer[0], NULL, *to, NULL, *full, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
                         if (z > 0) {
                                 *full -= z;
+                                *bytes += z;
                                 shoveled = true;
                         } else if (z == 0 || ERRNO_IS_DISCONNECT(errno)) {
                                 *to_source = sd_event_source_unref(*to_source);
@@ -223,6 +281,7 @@ static int traffic_cb(sd_event_source *s, int fd, uint32_t revents, void *userda
         r = connection_shovel(c,
                               &c->server_fd, c->server_to_client_buffer, &c->client_fd,
                               &c->server_to_client_buffer_full, &c->server_to_client_buffer_size,
+                              &c->server_to_client_bytes,
                               &c->server_event_source, &c->client_event_source);
         if (r < 0)
                 goto quit;
@@ -230,6 +289,7 @@ static int traffic_cb(sd_event_source *s, int fd, uint32_t revents, void *userda
         r = connection_shovel(c,
                               &c->client_fd, c->client_to_server_buffer, &c->server_fd,
                               &c->client_to_server_buffer_full, &c->client_to_server_buffer_size,
+                              &c->client_to_server_bytes,
                               &c->client_event_source, &c->server_event_source);
         if (r < 0)
                 goto quit;
@@ -491,6 +551,7 @@ static int add_connection_socket(Context *context, int fd) {
                .client_fd = -1,
                .server_to_client_buffer = {-1, -1},
                .client_to_server_buffer = {-1, -1},
+               .start_usec = now(CLOCK_MONOTONIC),
         };
 
         r = set_ensure_put(&context->connections, NULL, c);
@@ -504,7 +565,6 @@ static int add_connection_socket(Context *context, int fd) {
 }
 
 static int accept_cb(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_free_ char *peer = NULL;
         Context *context = userdata;
         int nfd = -1, r;
 
@@ -513,18 +573,27 @@ static int accept_cb(sd_event_source *s, int fd, uint32_t revents, void *userdat
         assert(revents & EPOLLIN);
         assert(context);
 
-        nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
-        if (nfd < 0) {
-                if (!ERRNO_IS_ACCEPT_AGAIN(errno))
-                        log_warning_errno(errno, "Failed to accept() socket: %m");
-        } else {
-                (void) getpeername_pretty(nfd, true, &peer);
-                log_debug("New connection from %s", strna(peer));
+        /* Under load many connections are queued by the time we get here, pick up a bunch of them at once
+         * rather than going through the event loop for each. */
+        for (unsigned i = 0; i < ACCEPT_BATCH_MAX; i++) {
+                _cleanup_free_ char *peer = NULL;
+
+                nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+                if (nfd < 0) {
+                        if (!ERRNO_IS_ACCEPT_AGAIN(errno))
+                                log_warning_errno(errno, "Failed to accept() socket: %m");
+                        break;
+                }
+
+                if (DEBUG_LOGGING) {
+                        (void) getpeername_pretty(nfd, true, &peer);
+                        log_debug("New connection from %s", strna(peer));
+                }
 
                 r = add_connection_socket(context, nfd);
                 if (r < 0) {
                         log_error_errno(r, "Failed to accept connection, ignoring: %m");
-                        safe_close(fd);
+                        safe_close(nfd);
                 }
         }
 
@@ -115,6 +115,7 @@ static bool arg_no_wtmp = false;
 static bool arg_no_sync = false;
 static bool arg_no_wall = false;
 static bool arg_no_reload = false;
+static bool arg_soft = false;
 static bool arg_value = false;
 static bool arg_show_types = false;
 static bool arg_ignore_inhibitors = false;
@@ -5505,6 +5506,7 @@ static int show_one(
                 const char *path,
                 const char *unit,
                 SystemctlShowMode show_mode,
+                sd_bus_message *prefetched,
                 bool *new_line,
                 bool *ellipsized) {
 
@@ -5626,15 +5628,27 @@ static int show_one(
 
         log_debug("Showing one %s", path);
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
-                        BUS_MAP_BOOLEAN_AS_BOOL,
-                        &error,
-                        &reply,
-                        &info);
+        if (!prefetched)
+                r = bus_map_all_properties(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &reply,
+                                &info);
+        else if (sd_bus_message_is_method_error(prefetched, NULL))
+                r = sd_bus_error_copy(&error, sd_bus_message_get_error(prefetched));
+        else {
+                reply = sd_bus_message_ref(prefetched);
+                r = bus_message_map_all_properties(
+                                reply,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &info);
+        }
         if (r < 0)
                 return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
 
@@ -5707,6 +5721,66 @@ static int get_unit_dbus_path_by_pid(
         return 0;
 }
 
+/* How many GetAll() calls to have in flight at a time when showing many units */
+#define SHOW_PREFETCH_MAX 64U
+
+static int show_many(
+                sd_bus *bus,
+                char **names,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        size_t n, i, j;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Asking for the properties of one unit after the other is dominated by the round trips to PID 1
+         * when there are many units, hence query them in batches and show each batch once it is complete. */
+
+        n = strv_length(names);
+
+        for (i = 0; i < n; i += SHOW_PREFETCH_MAX) {
+                _cleanup_strv_free_ char **paths = NULL;
+                sd_bus_message **replies = NULL;
+                size_t m;
+
+                m = MIN(n - i, SHOW_PREFETCH_MAX);
+
+                paths = new0(char*, m + 1);
+                if (!paths)
+                        return log_oom();
+
+                for (j = 0; j < m; j++) {
+                        paths[j] = unit_dbus_path_from_name(names[i + j]);
+                        if (!paths[j])
+                                return log_oom();
+                }
+
+                r = bus_get_all_properties_many(bus, "org.freedesktop.systemd1", paths, &replies);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get properties: %m");
+
+                for (j = 0; j < m; j++) {
+                        r = show_one(bus, paths[j], names[i + j], show_mode, replies[j], new_line, ellipsized);
+                        if (r < 0)
+                                break;
+                        if (r > 0 && ret == 0)
+                                ret = r;
+                }
+
+                for (j = 0; j < m; j++)
+                        sd_bus_message_unref(replies[j]);
+                free(replies);
+
+                if (r < 0)
+                        return r;
+        }
+
+        return ret;
+}
+
 static int show_all(
                 sd_bus *bus,
                 bool *new_line,
@@ -5714,9 +5788,10 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
+        _cleanup_free_ char **names = NULL;
         const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        unsigned c, i = 0;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5728,21 +5803,15 @@ static int show_all(
 
         typesafe_qsort(unit_infos, c, compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
+        /* The strings are owned by the unit list reply, hence only the array itself is freed */
+        names = new0(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        for (u = unit_infos; u < unit_infos + c; u++)
+                names[i++] = (char*) u->id;
 
-                r = show_one(bus, p, u->id, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
-
-        return ret;
+        return show_many(bus, names, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5837,7 +5906,7 @@ static int show(int argc, char *argv[], void *userdata) {
 
         /* If no argument is specified inspect the manager itself */
         if (show_mode == SYSTEMCTL_SHOW_PROPERTIES && argc <= 1)
-                return show_one(bus, "/org/freedesktop/systemd1", NULL, show_mode, &new_line, &ellipsized);
+                return show_one(bus, "/org/freedesktop/systemd1", NULL, show_mode, NULL, &new_line, &ellipsized);
 
         if (show_mode == SYSTEMCTL_SHOW_STATUS && argc <= 1) {
 
@@ -5877,7 +5946,7 @@ static int show(int argc, char *argv[], void *userdata) {
                                         return log_oom();
                         }
 
-                        r = show_one(bus, path, unit, show_mode, &new_line, &ellipsized);
+                        r = show_one(bus, path, unit, show_mode, NULL, &new_line, &ellipsized);
                         if (r < 0)
                                 return r;
                         else if (r > 0 && ret == 0)
@@ -5895,19 +5964,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return r;
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(bus, path, *name, show_mode, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_many(bus, names, show_mode, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -6080,6 +6141,7 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         case ACTION_SYSTEMCTL:
                 method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
+                         arg_soft ? "SoftReload" :
                                      /* "daemon-reload" */ "Reload";
                 break;
 
@@ -7911,6 +7973,7 @@ static int systemctl_help(void) {
                "     --no-block          Do not wait until operation finished\n"
                "     --no-wall           Don't send wall message before halt/power-off/reboot\n"
                "     --no-reload         Don't reload daemon after en-/dis-abling unit files\n"
+               "     --soft              With 'daemon-reload', only reload changed unit files\n"
                "     --no-legend         Do not print a legend (column headers and hints)\n"
                "     --no-pager          Do not pipe output into a pager\n"
                "     --no-ask-password   Do not ask for system passwords\n"
@@ -8187,6 +8250,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_WHAT,
                 ARG_REBOOT_ARG,
                 ARG_TIMESTAMP_STYLE,
+                ARG_SOFT,
         };
 
         static const struct option options[] = {
@@ -8220,6 +8284,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "root",                required_argument, NULL, ARG_ROOT                },
                 { "force",               no_argument,       NULL, 'f'                     },
                 { "no-reload",           no_argument,       NULL, ARG_NO_RELOAD           },
+                { "soft",                no_argument,       NULL, ARG_SOFT                },
                 { "kill-who",            required_argument, NULL, ARG_KILL_WHO            },
                 { "signal",              required_argument, NULL, 's'                     },
                 { "no-ask-password",     no_argument,       NULL, ARG_NO_ASK_PASSWORD     },
@@ -8415,6 +8480,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_no_wall = true;
                         break;
 
+                case ARG_SOFT:
+                        arg_soft = true;
+                        break;
+
                 case ARG_ROOT:
                         r = parse_path_argument_and_warn(optarg, false, &arg_root);
                         if (r < 0)
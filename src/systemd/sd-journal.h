@@ -71,6 +71,7 @@ enum {
         SD_JOURNAL_OS_ROOT                   = 1 << 4,
         SD_JOURNAL_ALL_NAMESPACES            = 1 << 5, /* Show all namespaces, not just the default or specified one */
         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE = 1 << 6, /* Show default namespace in addition to specified one */
+        SD_JOURNAL_SNAPSHOT                  = 1 << 7, /* Ignore entries and files added after opening */
 
         SD_JOURNAL_SYSTEM_ONLY _sd_deprecated_ = SD_JOURNAL_SYSTEM /* old name */
 };
@@ -88,6 +89,7 @@ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags);
 int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags);
 int sd_journal_open_files(sd_journal **ret, const char **paths, int flags);
 int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fds, int flags);
+int sd_journal_open_shared(sd_journal **ret, sd_journal *j, int flags);
 int sd_journal_open_container(sd_journal **ret, const char *machine, int flags) _sd_deprecated_;
 void sd_journal_close(sd_journal *j);
 
@@ -102,6 +104,8 @@ int sd_journal_get_monotonic_usec(sd_journal *j, uint64_t *ret, sd_id128_t *ret_
 
 int sd_journal_set_data_threshold(sd_journal *j, size_t sz);
 int sd_journal_get_data_threshold(sd_journal *j, size_t *sz);
+int sd_journal_set_data_cache_size(sd_journal *j, size_t sz);
+int sd_journal_get_data_cache_size(sd_journal *j, size_t *sz);
 
 int sd_journal_get_data(sd_journal *j, const char *field, const void **data, size_t *l);
 int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *l);
@@ -122,6 +126,28 @@ int sd_journal_seek_cursor(sd_journal *j, const char *cursor);
 int sd_journal_get_cursor(sd_journal *j, char **cursor);
 int sd_journal_test_cursor(sd_journal *j, const char *cursor);
 
+/* The fields of a cursor, as sd_journal_get_cursor() formats them */
+typedef struct sd_journal_cursor {
+        sd_id128_t seqnum_id;
+        uint64_t seqnum;
+        sd_id128_t boot_id;
+        uint64_t monotonic;
+        uint64_t realtime;
+        uint64_t xor_hash;
+} sd_journal_cursor;
+
+int sd_journal_get_cursor_binary(sd_journal *j, sd_journal_cursor *ret);
+int sd_journal_cursor_to_string(const sd_journal_cursor *c, char **ret);
+
+/* Entries as copied by sd_journal_read_batch() */
+typedef struct sd_journal_batch_entry {
+        sd_journal_cursor cursor;
+        const struct iovec *fields;
+        size_t n_fields;
+} sd_journal_batch_entry;
+
+int sd_journal_read_batch(sd_journal *j, void *buffer, size_t size, size_t max_entries, sd_journal_batch_entry **ret_entries);
+
 int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from, uint64_t *to);
 int sd_journal_get_cutoff_monotonic_usec(sd_journal *j, const sd_id128_t boot_id, uint64_t *from, uint64_t *to);
 
@@ -140,6 +166,7 @@ int sd_journal_get_events(sd_journal *j);
 int sd_journal_get_timeout(sd_journal *j, uint64_t *timeout_usec);
 int sd_journal_process(sd_journal *j);
 int sd_journal_wait(sd_journal *j, uint64_t timeout_usec);
+int sd_journal_wait_coalesced(sd_journal *j, uint64_t timeout_usec, uint64_t coalesce_usec);
 int sd_journal_reliable_fd(sd_journal *j);
 
 int sd_journal_get_catalog(sd_journal *j, char **text);
@@ -22,6 +22,7 @@
 #include "set.h"
 #include "smack-util.h"
 #include "specifier.h"
+#include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tmpfile-util-label.h"
@@ -79,6 +80,11 @@ static Hashmap *database_by_uid = NULL, *database_by_username = NULL;
 static Hashmap *database_by_gid = NULL, *database_by_groupname = NULL;
 static Set *database_users = NULL, *database_groups = NULL;
 
+/* The passwd and group files as we loaded them, and where their NIS entries start (if there are any), so
+ * that they can be copied verbatim when we only append entries */
+static struct stat database_users_stat = {}, database_groups_stat = {};
+static off_t database_users_nis_offset = -1, database_groups_nis_offset = -1;
+
 static uid_t search_uid = UID_INVALID;
 static UidRange *uid_range = NULL;
 static unsigned n_uid_range = 0;
@@ -127,10 +133,25 @@ static int load_user_database(void) {
         if (r < 0)
                 return r;
 
-        while ((r = fgetpwent_sane(f, &pw)) > 0) {
+        if (fstat(fileno(f), &database_users_stat) < 0)
+                return -errno;
+
+        for (;;) {
+                off_t offset;
                 char *n;
                 int k, q;
 
+                offset = ftello(f);
+                if (offset < 0)
+                        return -errno;
+
+                r = fgetpwent_sane(f, &pw);
+                if (r <= 0)
+                        break;
+
+                if (database_users_nis_offset < 0 && IN_SET(pw->pw_name[0], '+', '-'))
+                        database_users_nis_offset = offset;
+
                 n = strdup(pw->pw_name);
                 if (!n)
                         return -ENOMEM;
@@ -175,10 +196,25 @@ static int load_group_database(void) {
         if (r < 0)
                 return r;
 
-        while ((r = fgetgrent_sane(f, &gr)) > 0) {
+        if (fstat(fileno(f), &database_groups_stat) < 0)
+                return -errno;
+
+        for (;;) {
+                off_t offset;
                 char *n;
                 int k, q;
 
+                offset = ftello(f);
+                if (offset < 0)
+                        return -errno;
+
+                r = fgetgrent_sane(f, &gr);
+                if (r <= 0)
+                        break;
+
+                if (database_groups_nis_offset < 0 && IN_SET(gr->gr_name[0], '+', '-'))
+                        database_groups_nis_offset = offset;
+
                 n = strdup(gr->gr_name);
                 if (!n)
                         return -ENOMEM;
@@ -349,6 +385,76 @@ static int putsgent_with_members(const struct sgrp *sg, FILE *gshadow) {
 }
 #endif
 
+static int database_copy_head(FILE *original, FILE *target, const struct stat *loaded, off_t nis_offset) {
+        struct stat st;
+        uint64_t n;
+        int r;
+
+        assert(original);
+        assert(target);
+        assert(loaded);
+
+        /* If the file is still the one we loaded, copy all entries before the NIS ones verbatim instead of
+         * parsing and formatting each of them again, which is slow for big databases. The new entries were
+         * already checked against the loaded ones, hence the safety checks done while copying entry by
+         * entry are not needed either. Returns > 0 if the copy was done, 0 if the caller needs to copy the
+         * file entry by entry. */
+
+        if (fstat(fileno(original), &st) < 0)
+                return -errno;
+
+        if (!stat_inode_unmodified(loaded, &st))
+                return 0;
+
+        n = nis_offset >= 0 ? (uint64_t) nis_offset : (uint64_t) st.st_size;
+        if (n == 0)
+                return 1;
+
+        r = copy_bytes(fileno(original), fileno(target), n, 0);
+        if (r < 0)
+                return r;
+
+        if (nis_offset < 0) {
+                char c;
+                ssize_t k;
+
+                /* New entries are appended, hence make sure the last line is terminated */
+                k = pread(fileno(original), &c, 1, n - 1);
+                if (k < 0)
+                        return -errno;
+                if (k == 1 && c != '\n' && write(fileno(target), "\n", 1) != 1)
+                        return errno > 0 ? -errno : -EIO;
+        }
+
+        /* The data was written to the fd directly, make sure the stream continues after it */
+        if (fseeko(target, 0, SEEK_END) < 0)
+                return -errno;
+
+        return 1;
+}
+
+static int database_copy_tail(FILE *original, FILE *target) {
+        int r;
+
+        assert(original);
+        assert(target);
+
+        /* Copies the rest of the original file, i.e. the NIS entries, after a database_copy_head() */
+
+        r = fflush_and_check(target);
+        if (r < 0)
+                return r;
+
+        r = copy_bytes(fileno(original), fileno(target), UINT64_MAX, 0);
+        if (r < 0)
+                return r;
+
+        if (fseeko(target, 0, SEEK_END) < 0)
+                return -errno;
+
+        return 0;
+}
+
 static const char* default_shell(uid_t uid) {
         return uid == 0 ? "/bin/sh" : NOLOGIN;
 }
@@ -357,6 +463,7 @@ static int write_temporary_passwd(const char *passwd_path, FILE **tmpfile, char
         _cleanup_fclose_ FILE *original = NULL, *passwd = NULL;
         _cleanup_(unlink_and_freep) char *passwd_tmp = NULL;
         struct passwd *pw = NULL;
+        bool verbatim = false;
         Item *i;
         int r;
 
@@ -374,7 +481,12 @@ static int write_temporary_passwd(const char *passwd_path, FILE **tmpfile, char
                 if (r < 0)
                         return r;
 
-                while ((r = fgetpwent_sane(original, &pw)) > 0) {
+                r = database_copy_head(original, passwd, &database_users_stat, database_users_nis_offset);
+                if (r < 0)
+                        return r;
+                verbatim = r > 0;
+
+                while (!verbatim && (r = fgetpwent_sane(original, &pw)) > 0) {
 
                         i = ordered_hashmap_get(users, pw->pw_name);
                         if (i && i->todo_user)
@@ -428,6 +540,12 @@ static int write_temporary_passwd(const char *passwd_path, FILE **tmpfile, char
                         return r;
         }
 
+        if (verbatim && database_users_nis_offset >= 0) {
+                r = database_copy_tail(original, passwd);
+                if (r < 0)
+                        return r;
+        }
+
         /* Append the remaining NIS entries if any */
         while (pw) {
                 r = putpwent_sane(pw, passwd);
@@ -552,7 +670,7 @@ static int write_temporary_shadow(const char *shadow_path, FILE **tmpfile, char
 static int write_temporary_group(const char *group_path, FILE **tmpfile, char **tmpfile_path) {
         _cleanup_fclose_ FILE *original = NULL, *group = NULL;
         _cleanup_(unlink_and_freep) char *group_tmp = NULL;
-        bool group_changed = false;
+        bool group_changed = false, verbatim = false;
         struct group *gr = NULL;
         Item *i;
         int r;
@@ -571,7 +689,16 @@ static int write_temporary_group(const char *group_path, FILE **tmpfile, char **
                 if (r < 0)
                         return r;
 
-                while ((r = fgetgrent_sane(original, &gr)) > 0) {
+                /* Members are added to existing groups by rewriting their entries, hence only take the
+                 * shortcut if there are none to add */
+                if (ordered_hashmap_isempty(members)) {
+                        r = database_copy_head(original, group, &database_groups_stat, database_groups_nis_offset);
+                        if (r < 0)
+                                return r;
+                        verbatim = r > 0;
+                }
+
+                while (!verbatim && (r = fgetgrent_sane(original, &gr)) > 0) {
                         /* Safety checks against name and GID collisions. Normally,
                          * this should be unnecessary, but given that we look at the
                          * entries anyway here, let's make an extra verification
@@ -622,6 +749,12 @@ static int write_temporary_group(const char *group_path, FILE **tmpfile, char **
                 group_changed = true;
         }
 
+        if (verbatim && database_groups_nis_offset >= 0) {
+                r = database_copy_tail(original, group);
+                if (r < 0)
+                        return r;
+        }
+
         /* Append the remaining NIS entries if any */
         while (gr) {
                 r = putgrent_sane(gr, group);
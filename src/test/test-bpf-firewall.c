@@ -24,6 +24,7 @@ int main(int argc, char *argv[]) {
         CGroupContext *cc = NULL;
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
         _cleanup_(manager_freep) Manager *m = NULL;
+        BPFAccessMap *allow_map;
         Unit *u;
         char log_buf[65535];
         struct rlimit rl;
@@ -142,6 +143,11 @@ int main(int argc, char *argv[]) {
         assert(u->ip_bpf_ingress);
         assert(u->ip_bpf_egress);
 
+        /* Recompiling with unchanged lists picks up the same access maps again */
+        assert_se(allow_map = u->ipv4_allow_map);
+        assert_se(bpf_firewall_compile(u) >= 0);
+        assert_se(u->ipv4_allow_map == allow_map);
+
         r = bpf_program_load_kernel(u->ip_bpf_ingress, log_buf, ELEMENTSOF(log_buf));
 
         log_notice("log:");
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-property-cache.h"
+#include "fd-util.h"
+#include "log.h"
+#include "strv.h"
+#include "tests.h"
+
+typedef struct Server {
+        sd_bus *bus;
+        char *name;
+        char **tags;
+        uint32_t counter;
+        unsigned n_get;
+        unsigned n_get_all;
+        bool quit;
+} Server;
+
+typedef struct Thing {
+        char *name;
+        char **tags;
+        uint32_t counter;
+} Thing;
+
+static int method_change(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Server *s = userdata;
+        const char *name;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &name);
+        assert_se(r >= 0);
+
+        assert_se(free_and_strdup(&s->name, name) >= 0);
+        assert_se(strv_extend(&s->tags, name) >= 0);
+        s->counter++;
+
+        assert_se(sd_bus_emit_properties_changed(sd_bus_message_get_bus(m), sd_bus_message_get_path(m),
+                                                 "org.freedesktop.systemd.Test", "Name", "Tags", "Counter", NULL) >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_remove(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        assert_se(sd_bus_emit_signal(sd_bus_message_get_bus(m), "/thing", "org.freedesktop.DBus.ObjectManager",
+                                     "InterfacesRemoved", "oas", sd_bus_message_get_path(m),
+                                     1, "org.freedesktop.systemd.Test") >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_quit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Server *s = userdata;
+
+        s->quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int count_filter(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        Server *s = userdata;
+
+        if (sd_bus_message_is_method_call(m, "org.freedesktop.DBus.Properties", "Get"))
+                s->n_get++;
+        else if (sd_bus_message_is_method_call(m, "org.freedesktop.DBus.Properties", "GetAll"))
+                s->n_get_all++;
+
+        return 0;
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Name", "s", NULL, offsetof(Server, name), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Tags", "as", NULL, offsetof(Server, tags), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Counter", "u", NULL, offsetof(Server, counter), SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
+        SD_BUS_METHOD("Change", "s", NULL, method_change, 0),
+        SD_BUS_METHOD("Remove", NULL, NULL, method_remove, 0),
+        SD_BUS_METHOD("Quit", NULL, NULL, method_quit, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void* server(void *p) {
+        Server *s = p;
+
+        assert_se(sd_bus_add_filter(s->bus, NULL, count_filter, s) >= 0);
+        assert_se(sd_bus_add_object_vtable(s->bus, NULL, "/thing/one", "org.freedesktop.systemd.Test", vtable, s) >= 0);
+        assert_se(sd_bus_add_object_vtable(s->bus, NULL, "/thing/two", "org.freedesktop.systemd.Test", vtable, s) >= 0);
+        assert_se(sd_bus_start(s->bus) >= 0);
+
+        while (!s->quit) {
+                int r;
+
+                r = sd_bus_process(s->bus, NULL);
+                assert_se(r >= 0);
+                if (r > 0)
+                        continue;
+
+                assert_se(sd_bus_wait(s->bus, UINT64_MAX) >= 0);
+        }
+
+        sd_bus_flush(s->bus);
+        return NULL;
+}
+
+static void thing_done(void *p) {
+        Thing *t = p;
+
+        free(t->name);
+        strv_free(t->tags);
+}
+
+static const struct bus_properties_map thing_map[] = {
+        { "Name",    "s",  NULL, offsetof(Thing, name)    },
+        { "Tags",    "as", NULL, offsetof(Thing, tags)    },
+        { "Counter", "u",  NULL, offsetof(Thing, counter) },
+        {}
+};
+
+static void call(sd_bus *bus, const char *path, const char *member, const char *arg) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+
+        if (arg)
+                assert_se(sd_bus_call_method(bus, NULL, path, "org.freedesktop.systemd.Test", member, &error, NULL, "s", arg) >= 0);
+        else
+                assert_se(sd_bus_call_method(bus, NULL, path, "org.freedesktop.systemd.Test", member, &error, NULL, NULL) >= 0);
+
+        /* Dispatch the signals that were queued while we waited for the reply */
+        while (sd_bus_process(bus, NULL) > 0)
+                ;
+}
+
+static void test_property_cache(void) {
+        _cleanup_(bus_property_cache_freep) BusPropertyCache *cache = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        Server s = {};
+        pthread_t t;
+        Thing *thing;
+        void *p;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&s.bus) >= 0);
+        assert_se(sd_bus_set_fd(s.bus, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(s.bus, true, SD_ID128_NULL) >= 0);
+        pair[0] = -1;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[1], pair[1]) >= 0);
+        pair[1] = -1;
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(free_and_strdup(&s.name, "initial") >= 0);
+        assert_se(pthread_create(&t, NULL, server, &s) == 0);
+
+        assert_se(bus_property_cache_new(bus, NULL, "/thing", "org.freedesktop.systemd.Test",
+                                         thing_map, sizeof(Thing), thing_done, &cache) >= 0);
+
+        assert_se(bus_property_cache_get(cache, "/elsewhere", NULL, &p) == -EINVAL);
+
+        /* The first lookup fetches everything */
+        assert_se(bus_property_cache_get(cache, "/thing/one", NULL, &p) >= 0);
+        thing = p;
+        assert_se(streq(thing->name, "initial"));
+        assert_se(strv_isempty(thing->tags));
+        assert_se(thing->counter == 0);
+
+        /* The second one doesn't talk to the service at all */
+        assert_se(bus_property_cache_get(cache, "/thing/one", NULL, &p) >= 0);
+        assert_se(p == thing);
+
+        /* The server processed the GetAll() before it replied to it, hence no call is needed to sync here */
+        assert_se(s.n_get_all == 1);
+        assert_se(s.n_get == 0);
+
+        /* Changed values are taken from the signal, the invalidated one is fetched on the next lookup */
+        call(bus, "/thing/one", "Change", "foo");
+        call(bus, "/thing/one", "Change", "bar");
+        assert_se(streq(thing->name, "bar"));
+        assert_se(strv_equal(thing->tags, STRV_MAKE("foo", "bar")));
+        assert_se(thing->counter == 0);
+
+        assert_se(bus_property_cache_get(cache, "/thing/one", NULL, &p) >= 0);
+        assert_se(p == thing);
+        assert_se(thing->counter == 2);
+
+        /* Objects are cached independently of each other */
+        assert_se(bus_property_cache_get(cache, "/thing/two", NULL, &p) >= 0);
+        assert_se(p != thing);
+        assert_se(streq(((Thing*) p)->name, "bar"));
+        assert_se(((Thing*) p)->counter == 2);
+
+        /* Removed objects are dropped, and fetched again when looked up */
+        call(bus, "/thing/two", "Remove", NULL);
+        assert_se(bus_property_cache_get(cache, "/thing/one", NULL, &p) >= 0);
+        assert_se(p == thing);
+        assert_se(bus_property_cache_get(cache, "/thing/two", NULL, &p) >= 0);
+
+        bus_property_cache_flush(cache);
+        assert_se(bus_property_cache_get(cache, "/thing/one", NULL, &p) >= 0);
+        assert_se(streq(((Thing*) p)->name, "bar"));
+        assert_se(strv_equal(((Thing*) p)->tags, STRV_MAKE("foo", "bar")));
+
+        call(bus, "/thing/one", "Quit", NULL);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        /* One GetAll() for each initial lookup, one Get() for the invalidated counter */
+        assert_se(s.n_get_all == 4);
+        assert_se(s.n_get == 1);
+
+        s.bus = sd_bus_flush_close_unref(s.bus);
+        free(s.name);
+        strv_free(s.tags);
+}
+
+int main(int argc, char **argv) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_property_cache();
+
+        return 0;
+}
@@ -2,9 +2,12 @@
 
 #include <stdio.h>
 
+#include "alloc-util.h"
+#include "cgroup-util.h"
 #include "cgroup.h"
 #include "manager.h"
 #include "rm-rf.h"
+#include "string-util.h"
 #include "tests.h"
 #include "unit.h"
 
@@ -135,12 +138,81 @@ static int test_default_memory_low(void) {
         return 0;
 }
 
+static void assert_pids_max(Unit *u, const char *expected) {
+        _cleanup_free_ char *v = NULL;
+
+        assert_se(cg_get_attribute("pids", u->cgroup_path, "pids.max", &v) >= 0);
+        log_info("pids.max of %s: %s (expected %s)", u->id, v, expected);
+        assert_se(streq(v, expected));
+}
+
+static void set_tasks_max_and_realize(Unit *u, uint64_t value) {
+        unit_get_cgroup_context(u)->tasks_max = (TasksMax) { .value = value };
+        unit_invalidate_cgroup_members_masks(u);
+        unit_invalidate_cgroup(u, CGROUP_MASK_PIDS);
+        assert_se(unit_realize_cgroup(u) >= 0);
+}
+
+static int test_attribute_cache(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *parent;
+        int r;
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        _cleanup_free_ char *unit_dir = NULL;
+        assert_se(get_testdata_dir("units", &unit_dir) >= 0);
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (IN_SET(r, -EPERM, -EACCES)) {
+                log_error_errno(r, "manager_new: %m");
+                return log_tests_skipped("cannot create manager");
+        }
+
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        if (!FLAGS_SET(m->cgroup_supported, CGROUP_MASK_PIDS))
+                return log_tests_skipped("pids controller not available");
+
+        assert_se(manager_load_startable_unit_or_warn(m, "parent.slice", NULL, &parent) >= 0);
+
+        set_tasks_max_and_realize(parent, 100);
+        assert_pids_max(parent, "100");
+
+        /* Change the attribute behind our back: realizing the unchanged setting again must not write it */
+        assert_se(cg_set_attribute("pids", parent->cgroup_path, "pids.max", "200") >= 0);
+        set_tasks_max_and_realize(parent, 100);
+        assert_pids_max(parent, "200");
+
+        /* A changed setting is written */
+        set_tasks_max_and_realize(parent, 300);
+        assert_pids_max(parent, "300");
+
+        /* Once the cgroup is removed, nothing we wrote before counts anymore */
+        unit_prune_cgroup(parent);
+        assert_se(!parent->cgroup_attributes);
+        set_tasks_max_and_realize(parent, 300);
+        assert_pids_max(parent, "300");
+
+        unit_prune_cgroup(parent);
+
+        return 0;
+}
+
 int main(int argc, char* argv[]) {
         int rc = EXIT_SUCCESS;
 
         test_setup_logging(LOG_DEBUG);
 
         TEST_REQ_RUNNING_SYSTEMD(rc = test_default_memory_low());
+        if (rc == EXIT_SUCCESS) {
+                TEST_REQ_RUNNING_SYSTEMD(rc = test_attribute_cache());
+        }
 
         return rc;
 }
@@ -308,13 +308,20 @@ static const char* const config_file[] = {
         "setting1=3\n"
         "[X-Section]\n"
         "setting1=3\n",
+
+        "[Section]\r\n"     /* Windows line breaks, mixed with others */
+        "setting1=1\r\n"
+        "\n\r"
+        "setting1=2\\\r"
+        "3\n",
 };
 
 static void test_config_parse(unsigned i, const char *s) {
         _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-conf-parser.XXXXXX";
         _cleanup_fclose_ FILE *f = NULL;
-        _cleanup_free_ char *setting1 = NULL;
-        int r;
+        _cleanup_free_ char *setting1 = NULL, *expected = NULL;
+        struct stat st;
+        int r, q;
 
         const ConfigTableItem items[] = {
                 { "Section", "setting1",  config_parse_string,   0, &setting1},
@@ -382,7 +389,26 @@ static void test_config_parse(unsigned i, const char *s) {
                 assert_se(r == 0);
                 assert_se(streq(setting1, "2"));
                 break;
+
+        case 18:
+                assert_se(r == 0);
+                assert_se(streq(setting1, "2 3"));
+                break;
         }
+
+        /* Parsing contents that were read already has the very same result */
+        expected = TAKE_PTR(setting1);
+        assert_se(fstat(fileno(f), &st) >= 0);
+
+        q = config_parse_buffer(NULL, name, s, strlen(s), &st,
+                                "Section\0"
+                                "-NoWarnSection\0",
+                                config_item_table_lookup, items,
+                                CONFIG_PARSE_WARN,
+                                NULL,
+                                NULL);
+        assert_se(q == r);
+        assert_se(streq_ptr(setting1, expected));
 }
 
 int main(int argc, char **argv) {
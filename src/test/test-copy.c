@@ -85,7 +85,7 @@ static void test_copy_tree(void) {
                                     "link2", "dir1/file");
         char **hardlinks = STRV_MAKE("hlink", "file",
                                      "hlink2", "dir1/file");
-        const char *unixsockp;
+        const char *unixsockp, *emptyp;
         char **p, **ll;
         struct stat st;
         int xattr_worked = -1; /* xattr support is optional in temporary directories, hence use it if we can,
@@ -135,6 +135,9 @@ static void test_copy_tree(void) {
         unixsockp = strjoina(original_dir, "unixsock");
         assert_se(mknod(unixsockp, S_IFSOCK|0644, 0) >= 0);
 
+        emptyp = strjoina(original_dir, "dir1/empty");
+        assert_se(mknod(emptyp, S_IFREG|0640, 0) >= 0);
+
         assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_REFLINK|COPY_MERGE|COPY_HARDLINKS) == 0);
 
         STRV_FOREACH(p, files) {
@@ -187,6 +190,12 @@ static void test_copy_tree(void) {
         assert_se(stat(unixsockp, &st) >= 0);
         assert_se(S_ISSOCK(st.st_mode));
 
+        emptyp = strjoina(copy_dir, "dir1/empty");
+        assert_se(stat(emptyp, &st) >= 0);
+        assert_se(S_ISREG(st.st_mode));
+        assert_se(st.st_size == 0);
+        assert_se((st.st_mode & 07777) == 0640);
+
         assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_REFLINK) < 0);
         assert_se(copy_tree("/tmp/inexistent/foo/bar/fsdoi", copy_dir, UID_INVALID, GID_INVALID, COPY_REFLINK) < 0);
 
@@ -286,6 +295,29 @@ static void test_copy_bytes_regular_file(const char *src, bool try_reflink, uint
         unlink(fn3);
 }
 
+static void test_copy_tree_procfs(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *p = NULL;
+        _cleanup_free_ char *a = NULL, *b = NULL;
+        struct stat st;
+        const char *q;
+
+        log_info("%s", __func__);
+
+        /* Files on procfs report a size of zero, but still need to be copied */
+        assert_se(stat("/proc/self/comm", &st) >= 0);
+        assert_se(st.st_size == 0);
+
+        assert_se(mkdtemp_malloc(NULL, &p) >= 0);
+        q = strjoina(p, "/comm");
+
+        assert_se(copy_tree("/proc/self/comm", q, UID_INVALID, GID_INVALID, 0) >= 0);
+
+        assert_se(read_full_file("/proc/self/comm", &a, NULL) >= 0);
+        assert_se(read_full_file(q, &b, NULL) >= 0);
+        assert_se(!isempty(b));
+        assert_se(streq(a, b));
+}
+
 static void test_copy_atomic(void) {
         _cleanup_(rm_rf_physical_and_freep) char *p = NULL;
         const char *q;
@@ -310,6 +342,7 @@ int main(int argc, char *argv[]) {
         test_copy_file();
         test_copy_file_fd();
         test_copy_tree();
+        test_copy_tree_procfs();
         test_copy_bytes();
         test_copy_bytes_regular_file(argv[0], false, (uint64_t) -1);
         test_copy_bytes_regular_file(argv[0], true, (uint64_t) -1);
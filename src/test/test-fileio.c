@@ -826,6 +826,50 @@ static void test_read_line4(void) {
         }
 }
 
+static void test_read_one_line_file(void) {
+        _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-fileio-read-one-line-file-XXXXXX";
+        _cleanup_free_ char *line = NULL, *long_line = NULL;
+        _cleanup_close_ int fd = -1;
+        static const struct {
+                size_t length;
+                const char *string;
+                int ret;
+        } tests[] = {
+                { 0, "",                0 },
+                { 3, "foo",             3 },
+                { 4, "foo\n",           4 },
+                { 8, "foo\nbar\n",      4 },
+                { 5, "foo\r\n",         5 },
+                { 6, "foo\r\nbar",      5 },
+                { 7, "foo\n\r\0bar",    6 },
+                { 6, "foo\0\nx",        4 },
+                { 7, "foo\n\nbar",      4 },
+        };
+
+        log_info("/* %s */", __func__);
+
+        fd = mkostemp_safe(fn);
+        assert_se(fd >= 0);
+
+        for (size_t i = 0; i < ELEMENTSOF(tests); i++) {
+                assert_se(ftruncate(fd, 0) >= 0);
+                assert_se(pwrite(fd, tests[i].string, tests[i].length, 0) == (ssize_t) tests[i].length);
+
+                assert_se(read_one_line_file(fn, &line) == tests[i].ret);
+                assert_se(streq(line, tests[i].length > 0 ? "foo" : ""));
+                line = mfree(line);
+        }
+
+        /* Lines that don't fit into a single read() */
+        assert_se(long_line = malloc(LINE_MAX * 3 + 1));
+        memset(long_line, 'x', LINE_MAX * 3);
+        long_line[LINE_MAX * 3] = 0;
+
+        assert_se(write_string_file(fn, long_line, 0) >= 0);
+        assert_se(read_one_line_file(fn, &line) == LINE_MAX * 3 + 1);
+        assert_se(streq(line, long_line));
+}
+
 static void test_read_nul_string(void) {
         static const char test[] = "string nr. 1\0"
                 "string nr. 2\n\0"
@@ -931,6 +975,7 @@ int main(int argc, char *argv[]) {
         test_read_line2();
         test_read_line3();
         test_read_line4();
+        test_read_one_line_file();
         test_read_nul_string();
         test_read_full_file_socket();
 
@@ -256,6 +256,33 @@ static void test_strv(void) {
         formatted = mfree(formatted);
 }
 
+static void test_reformat(void) {
+        _cleanup_(table_unrefp) Table *table = NULL;
+        _cleanup_free_ char *formatted = NULL;
+
+        assert_se(table = table_new("foo", "bar"));
+        assert_se(table_add_many(table,
+                                 TABLE_STRING, "x",
+                                 TABLE_EMPTY) >= 0);
+
+        table_set_width(table, 0);
+        assert_se(table_format(table, &formatted) >= 0);
+        printf("%s\n", formatted);
+        assert_se(streq(formatted,
+                        "FOO BAR\n"
+                        "x      \n"));
+        formatted = mfree(formatted);
+
+        /* Changing how cells are formatted must be reflected in the column widths */
+        assert_se(table_set_empty_string(table, "nothing") >= 0);
+        assert_se(table_set_uppercase(table, table_get_cell(table, 0, 0), false) > 0);
+        assert_se(table_format(table, &formatted) >= 0);
+        printf("%s\n", formatted);
+        assert_se(streq(formatted,
+                        "foo BAR    \n"
+                        "x   nothing\n"));
+}
+
 int main(int argc, char *argv[]) {
 
         _cleanup_(table_unrefp) Table *t = NULL;
@@ -399,6 +426,7 @@ int main(int argc, char *argv[]) {
         test_issue_9549();
         test_multiline();
         test_strv();
+        test_reformat();
 
         return 0;
 }
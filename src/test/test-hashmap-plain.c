@@ -783,6 +783,54 @@ static void test_hashmap_many(void) {
         }
 }
 
+static void test_hashmap_performance(void) {
+        bool slow = slow_tests_enabled();
+        const unsigned sizes[] = { 1 << 10, 1 << 16, 1 << 20 };
+
+        log_info("/* %s (%s) */", __func__, slow ? "slow" : "fast");
+
+        for (unsigned j = 0; j < ELEMENTSOF(sizes); j++) {
+                char b[FORMAT_TIMESPAN_MAX];
+                unsigned n_entries = sizes[j];
+                Hashmap *h;
+                usec_t ts;
+                void *v;
+                unsigned n = 0;
+
+                if (!slow && n_entries > (1 << 10))
+                        break;
+
+                assert_se(h = hashmap_new(NULL));
+
+                ts = now(CLOCK_MONOTONIC);
+                for (unsigned k = 1; k <= n_entries; k++)
+                        assert_se(hashmap_put(h, UINT_TO_PTR(k), UINT_TO_PTR(k)) == 1);
+                log_info("%u entries: insert took %s", n_entries,
+                         format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+
+                ts = now(CLOCK_MONOTONIC);
+                for (unsigned k = 1; k <= n_entries; k++)
+                        assert_se(PTR_TO_UINT(hashmap_get(h, UINT_TO_PTR(k))) == k);
+                log_info("%u entries: successful lookup took %s", n_entries,
+                         format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+
+                ts = now(CLOCK_MONOTONIC);
+                for (unsigned k = n_entries + 1; k <= 2 * n_entries; k++)
+                        assert_se(!hashmap_get(h, UINT_TO_PTR(k)));
+                log_info("%u entries: failed lookup took %s", n_entries,
+                         format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+
+                ts = now(CLOCK_MONOTONIC);
+                HASHMAP_FOREACH(v, h)
+                        n++;
+                assert_se(n == n_entries);
+                log_info("%u entries: iteration took %s", n_entries,
+                         format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+
+                hashmap_free(h);
+        }
+}
+
 extern unsigned custom_counter;
 extern const struct hash_ops boring_hash_ops, custom_hash_ops;
 
@@ -985,15 +1033,21 @@ static void test_hashmap_clear_free_with_destructor(void) {
 
 static void test_hashmap_reserve(void) {
         _cleanup_hashmap_free_ Hashmap *m = NULL;
+        size_t usage;
 
         log_info("/* %s */", __func__);
 
+        assert_se(hashmap_memory_usage(NULL) == 0);
+
         m = hashmap_new(&string_hash_ops);
 
         assert_se(hashmap_reserve(m, 1) == 0);
         assert_se(hashmap_buckets(m) < 1000);
+        usage = hashmap_memory_usage(m);
+        assert_se(usage > 0);
         assert_se(hashmap_reserve(m, 1000) == 0);
         assert_se(hashmap_buckets(m) >= 1000);
+        assert_se(hashmap_memory_usage(m) > usage + 1000 * sizeof(void*));
         assert_se(hashmap_isempty(m));
 
         assert_se(hashmap_put(m, "key 1", (void*) "val 1") == 1);
@@ -1084,6 +1138,7 @@ void test_hashmap_funcs(void) {
         test_hashmap_get2();
         test_hashmap_size();
         test_hashmap_many();
+        test_hashmap_performance();
         test_hashmap_free();
         test_hashmap_free_with_destructor();
         test_hashmap_first();
@@ -1086,6 +1086,65 @@ static void verify_one(
         assert(streq_ptr(alias2, updated_name));
 }
 
+static void test_cache(const char *root) {
+        UnitFileState state;
+        const char *p, *q;
+
+        log_info("== %s ==", __func__);
+
+        unit_file_cache_enable();
+
+        p = strjoina(root, "/usr/lib/systemd/system/cache-test.service");
+        assert_se(write_string_file(p,
+                                    "[Install]\n"
+                                    "WantedBy=multi-user.target\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "cache-test.service", &state) >= 0 && state == UNIT_FILE_DISABLED);
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "cache-test.service", &state) >= 0 && state == UNIT_FILE_DISABLED);
+
+        /* Changing the file invalidates the cached [Install] section */
+        assert_se(write_string_file(p,
+                                    "[Unit]\n"
+                                    "Description=No [Install] section\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "cache-test.service", &state) >= 0 && state == UNIT_FILE_STATIC);
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "cache-test.service", &state) >= 0 && state == UNIT_FILE_STATIC);
+
+        /* The cached Also= units are still queued */
+        p = strjoina(root, "/usr/lib/systemd/system/cache-test-also.service");
+        assert_se(write_string_file(p,
+                                    "[Install]\n"
+                                    "Also=cache-test-other.service\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        p = strjoina(root, "/usr/lib/systemd/system/cache-test-other.service");
+        assert_se(write_string_file(p,
+                                    "[Install]\n"
+                                    "WantedBy=multi-user.target\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "cache-test-also.service", &state) >= 0 && state == UNIT_FILE_INDIRECT);
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "cache-test-also.service", &state) >= 0 && state == UNIT_FILE_INDIRECT);
+
+        /* Presets are cached too, until a preset file is changed, added or removed */
+        p = strjoina(root, "/usr/lib/systemd/system-preset/cache-test.preset");
+        assert_se(write_string_file(p, "disable cache-test.service\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(unit_file_query_preset(UNIT_FILE_SYSTEM, root, "cache-test.service", NULL) == 0);
+        assert_se(unit_file_query_preset(UNIT_FILE_SYSTEM, root, "cache-test.service", NULL) == 0);
+
+        assert_se(write_string_file(p, "enable cache-test.service\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(unit_file_query_preset(UNIT_FILE_SYSTEM, root, "cache-test.service", NULL) > 0);
+
+        q = strjoina(root, "/usr/lib/systemd/system-preset/00-cache-test.preset");
+        assert_se(write_string_file(q, "disable cache-test.service\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(unit_file_query_preset(UNIT_FILE_SYSTEM, root, "cache-test.service", NULL) == 0);
+
+        assert_se(unlink(q) >= 0);
+        assert_se(unit_file_query_preset(UNIT_FILE_SYSTEM, root, "cache-test.service", NULL) > 0);
+        assert_se(unlink(p) >= 0);
+
+        unit_file_cache_flush();
+}
+
 static void test_verify_alias(void) {
         const UnitFileInstallInfo
                 plain_service    = { .name = (char*) "plain.service" },
@@ -1257,6 +1316,7 @@ int main(int argc, char *argv[]) {
         test_static_instance(root);
         test_with_dropin(root);
         test_with_dropin_template(root);
+        test_cache(root);
 
         assert_se(rm_rf(root, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
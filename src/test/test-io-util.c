@@ -45,8 +45,30 @@ static void test_sparse_write(void) {
         test_sparse_write_one(fd, test_e, sizeof(test_e));
 }
 
+static void test_sparse_write_large(void) {
+        _cleanup_free_ char *buffer = NULL;
+        _cleanup_close_ int fd = -1;
+        char fn[] = "/tmp/sparseXXXXXX";
+        size_t n = 1024 * 1024;
+
+        fd = mkostemp(fn, O_CLOEXEC);
+        assert_se(fd >= 0);
+        unlink(fn);
+
+        /* Zero runs of all kinds of lengths and alignments, mixed with data containing single NUL bytes */
+        assert_se(buffer = new0(char, n));
+        for (size_t i = 0; i < n; i++)
+                if ((i / 777) % 3 != 0)
+                        buffer[i] = i % 13 == 0 ? 0 : (char) (i % 251) + 1;
+
+        test_sparse_write_one(fd, buffer, n);
+        test_sparse_write_one(fd, buffer + 1, n - 1);
+        test_sparse_write_one(fd, buffer + 777, n - 777);
+}
+
 int main(void) {
         test_sparse_write();
+        test_sparse_write_large();
 
         return 0;
 }
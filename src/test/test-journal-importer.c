@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 #include "alloc-util.h"
 #include "log.h"
@@ -68,11 +69,118 @@ static void test_bad_input(void) {
         assert_se(journal_importer_eof(&imp));
 }
 
+static void test_binary_parsing(void) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = JOURNAL_IMPORTER_INIT(STDIN_FILENO);
+        JournalBinaryEncoder e = {};
+        _cleanup_free_ char *stream = NULL, *big = NULL;
+        size_t stream_size = 0, frame_size, i, n = 0;
+        unsigned n_frames = 0;
+        const void *frame;
+        sd_id128_t boot_id;
+        int r;
+
+        /* The connection fd is never read from by passive importers */
+        imp.passive_fd = true;
+        imp.binary = true;
+
+        assert_se(sd_id128_randomize(&boot_id) >= 0);
+
+        /* A compressible frame of three entries, one of them with a binary field */
+        big = malloc(10000);
+        assert_se(big);
+        memcpy(big, "BIG=", 4);
+        memset(big + 4, 'x', 10000 - 4);
+        big[100] = '\n';
+
+        for (i = 0; i < 3; i++) {
+                dual_timestamp ts = {
+                        .realtime = 1478389147837945 + i,
+                        .monotonic = 1000 + i,
+                };
+
+                assert_se(journal_binary_encoder_begin_entry(&e, &ts, boot_id) >= 0);
+                assert_se(journal_binary_encoder_add_field(&e, "MESSAGE=hello", STRLEN("MESSAGE=hello")) >= 0);
+                if (i == 1)
+                        assert_se(journal_binary_encoder_add_field(&e, big, 10000) >= 0);
+                /* Invalid field names are dropped by the importer */
+                assert_se(journal_binary_encoder_add_field(&e, "lower=case", STRLEN("lower=case")) >= 0);
+                journal_binary_encoder_end_entry(&e);
+        }
+
+        assert_se(journal_binary_encoder_finish_frame(&e, true, &frame, &frame_size) == 1);
+        if (HAVE_ZSTD)
+                assert_se(frame_size < 10000);
+        assert_se(GREEDY_REALLOC(stream, n, stream_size + frame_size));
+        memcpy(stream + stream_size, frame, frame_size);
+        stream_size += frame_size;
+
+        /* An uncompressed one, and one started and dropped again */
+        assert_se(journal_binary_encoder_begin_entry(&e, &(dual_timestamp) { 1478389147837950, 2000 }, SD_ID128_NULL) >= 0);
+        assert_se(journal_binary_encoder_add_field(&e, "MESSAGE=bye", STRLEN("MESSAGE=bye")) >= 0);
+        journal_binary_encoder_end_entry(&e);
+        assert_se(journal_binary_encoder_begin_entry(&e, &(dual_timestamp) { 1478389147837951, 2001 }, SD_ID128_NULL) >= 0);
+        assert_se(journal_binary_encoder_add_field(&e, "MESSAGE=dropped", STRLEN("MESSAGE=dropped")) >= 0);
+        journal_binary_encoder_drop_entry(&e);
+
+        assert_se(journal_binary_encoder_finish_frame(&e, false, &frame, &frame_size) == 1);
+        assert_se(GREEDY_REALLOC(stream, n, stream_size + frame_size));
+        memcpy(stream + stream_size, frame, frame_size);
+        stream_size += frame_size;
+
+        assert_se(journal_binary_encoder_finish_frame(&e, true, &frame, &frame_size) == 0);
+        journal_binary_encoder_done(&e);
+
+        /* Feed it in small pieces, so that frame headers and payloads are split up */
+        for (i = 0; i < stream_size; i += 7) {
+                assert_se(journal_importer_push_data(&imp, stream + i, MIN((size_t) 7, stream_size - i)) >= 0);
+
+                for (;;) {
+                        r = journal_importer_process_data(&imp);
+                        if (r == -EAGAIN)
+                                break;
+                        assert_se(r >= 0);
+                        if (r == 0)
+                                continue;
+
+                        if (imp.n_entries == 3) {
+                                assert_se(imp.entries[0].n_iovec == 1);
+                                assert_iovec_entry(&imp.entries[0].iovec[0], "MESSAGE=hello");
+                                assert_se(imp.entries[0].ts->realtime == 1478389147837945);
+                                assert_se(imp.entries[0].ts->monotonic == 1000);
+                                assert_se(sd_id128_equal(*imp.entries[0].boot_id, boot_id));
+
+                                assert_se(imp.entries[1].n_iovec == 2);
+                                assert_se(imp.entries[1].iovec[1].iov_len == 10000);
+                                assert_se(memcmp(imp.entries[1].iovec[1].iov_base, big, 10000) == 0);
+
+                                assert_se(imp.entries[2].n_iovec == 1);
+                                assert_se(imp.entries[2].ts->realtime == 1478389147837947);
+                        } else {
+                                assert_se(imp.n_entries == 1);
+                                assert_se(imp.entries[0].n_iovec == 1);
+                                assert_iovec_entry(&imp.entries[0].iovec[0], "MESSAGE=bye");
+                                assert_se(!imp.entries[0].boot_id);
+                        }
+
+                        journal_importer_drop_iovw(&imp);
+                        n_frames++;
+                }
+        }
+
+        assert_se(n_frames == 2);
+        assert_se(journal_importer_bytes_remaining(&imp) == 0);
+
+        /* Garbage is refused */
+        assert_se(journal_importer_push_data(&imp, "\377\377\377\377\0\0\0\0\0\0\0\0", 12) >= 0);
+        assert_se(journal_importer_process_data(&imp) == -EBADMSG);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
         test_basic_parsing();
         test_bad_input();
+        test_binary_parsing();
 
         return 0;
 }
@@ -391,6 +391,29 @@ static void test_source(void) {
         printf("--- pretty end ---\n");
 }
 
+static void test_no_line_column(void) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
+        unsigned line, column;
+        JsonVariant *e;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(json_parse("\n[ true, false, null, 0, \"\", [], {}, 7, \"foo\" ]", 0, &v, NULL, NULL) >= 0);
+        assert_se(json_parse("\n[ true, false, null, 0, \"\", [], {}, 7, \"foo\" ]", JSON_PARSE_NO_LINE_COLUMN, &w, NULL, NULL) >= 0);
+        assert_se(json_variant_equal(v, w));
+
+        assert_se(json_variant_get_source(json_variant_by_index(v, 0), NULL, &line, &column) >= 0);
+        assert_se(line == 2 && column == 3);
+        assert_se(json_variant_get_source(json_variant_by_index(v, 8), NULL, &line, &column) >= 0);
+        assert_se(line == 2 && column == 40);
+
+        for (size_t i = 0; i < json_variant_elements(w); i++) {
+                assert_se(e = json_variant_by_index(w, i));
+                assert_se(json_variant_get_source(e, NULL, &line, &column) >= 0);
+                assert_se(line == 0 && column == 0);
+        }
+}
+
 static void test_depth(void) {
         log_info("/* %s */", __func__);
 
@@ -569,6 +592,7 @@ int main(int argc, char *argv[]) {
 
         test_build();
         test_source();
+        test_no_line_column();
         test_depth();
 
         test_normalize();
@@ -10,6 +10,7 @@
 #include "capability-util.h"
 #include "conf-parser.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "hashmap.h"
@@ -19,12 +20,16 @@
 #include "load-fragment.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "mkdir.h"
+#include "path-util.h"
 #include "rm-rf.h"
 #include "specifier.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tests.h"
 #include "tmpfile-util.h"
+#include "unit-prefetch.h"
 #include "user-util.h"
 
 /* Nontrivial value serves as a placeholder to check that parsing function (didn't) change it */
@@ -831,6 +836,73 @@ static void test_config_parse_memory_limit(void) {
 
 }
 
+static void test_unit_prefetch(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *unit_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        char name[STRLEN("prefetch-.service") + DECIMAL_STR_MAX(unsigned)];
+        unsigned i, n = 2 * UNIT_PREFETCH_FILES_MIN;
+        Unit *u;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-prefetch.XXXXXX", &unit_dir) >= 0);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *p = NULL, *d = NULL, *contents = NULL;
+
+                xsprintf(name, "prefetch-%u.service", i);
+                assert_se(p = path_join(unit_dir, name));
+                assert_se(asprintf(&contents, "[Unit]\nDescription=Unit %u\n[Service]\nExecStart=/bin/true\n", i) >= 0);
+                assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+                /* Every other unit gets a drop-in overriding the description */
+                if (i % 2 != 0)
+                        continue;
+
+                assert_se(d = strjoin(p, ".d/override.conf"));
+                contents = mfree(contents);
+                assert_se(asprintf(&contents, "[Unit]\nDescription=Override %u\n", i) >= 0);
+                assert_se(write_string_file(d, contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_MKDIR_0755) >= 0);
+        }
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (manager_errno_skip_test(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return;
+        }
+
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        /* Queue everything first, so that all files are read ahead in one go */
+        for (i = 0; i < n; i++) {
+                xsprintf(name, "prefetch-%u.service", i);
+                assert_se(manager_load_unit_prepare(m, name, NULL, NULL, &u) >= 0);
+        }
+
+        assert_se(manager_dispatch_load_queue(m) >= n);
+        assert_se(hashmap_isempty(m->unit_prefetch));
+
+        for (i = 0; i < n; i++) {
+                char description[STRLEN("Override ") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "prefetch-%u.service", i);
+                xsprintf(description, i % 2 == 0 ? "Override %u" : "Unit %u", i);
+
+                assert_se(u = manager_get_unit(m, name));
+                assert_se(u->load_state == UNIT_LOADED);
+                assert_se(!u->load_prefetched);
+                assert_se(streq(u->description, description));
+                assert_se(strv_length(u->dropin_paths) == (i % 2 == 0));
+                assert_se(SERVICE(u)->exec_command[SERVICE_EXEC_START]);
+        }
+
+        assert_se(unsetenv("SYSTEMD_UNIT_PATH") == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
         int r;
@@ -852,6 +924,7 @@ int main(int argc, char *argv[]) {
         TEST_REQ_RUNNING_SYSTEMD(test_install_printf());
         test_unit_dump_config_items();
         test_config_parse_memory_limit();
+        test_unit_prefetch();
 
         return r;
 }
@@ -3,10 +3,13 @@
 #include <stdlib.h>
 
 #include "alloc-util.h"
+#include "log.h"
 #include "prioq.h"
 #include "set.h"
 #include "siphash24.h"
 #include "sort-util.h"
+#include "tests.h"
+#include "time-util.h"
 
 #define SET_SIZE 1024*4
 
@@ -119,10 +122,84 @@ static void test_struct(void) {
         assert_se(set_isempty(s));
 }
 
+static void test_put_many(void) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        struct test items[SET_SIZE];
+        void *data[SET_SIZE];
+        unsigned *idx[SET_SIZE], previous = 0, i;
+        struct test *t;
+
+        srand(0);
+
+        assert_se(q = prioq_new((compare_func_t) test_compare));
+
+        for (i = 0; i < SET_SIZE; i++) {
+                items[i].value = (unsigned) rand();
+                data[i] = items + i;
+                idx[i] = &items[i].idx;
+        }
+
+        /* A few items one by one, then more in bulk (which rebuilds the heap), then a few more in bulk
+         * (which are added one by one) */
+        for (i = 0; i < 10; i++)
+                assert_se(prioq_put(q, data[i], idx[i]) >= 0);
+        assert_se(prioq_put_many(q, data + 10, idx + 10, SET_SIZE - 20) >= 0);
+        assert_se(prioq_put_many(q, data + SET_SIZE - 10, idx + SET_SIZE - 10, 10) >= 0);
+        assert_se(prioq_put_many(q, NULL, NULL, 0) >= 0);
+        assert_se(prioq_size(q) == SET_SIZE);
+
+        for (i = 0; i < SET_SIZE; i++)
+                assert_se(prioq_peek_by_index(q, items[i].idx) == items + i);
+
+        for (i = 0; i < SET_SIZE; i++) {
+                assert_se(t = prioq_pop(q));
+                assert_se(previous <= t->value);
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
+static void test_performance(void) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ struct test *items = NULL;
+        char b[FORMAT_TIMESPAN_MAX];
+        unsigned i, n = SET_SIZE * 64;
+        usec_t ts;
+
+        srand(0);
+
+        assert_se(q = prioq_new((compare_func_t) test_compare));
+        assert_se(items = new(struct test, n));
+
+        for (i = 0; i < n; i++)
+                items[i].value = (unsigned) rand();
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+        log_info("%u puts took %s", n, format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                items[i].value = (unsigned) rand();
+                assert_se(prioq_reshuffle(q, items + i, &items[i].idx) == 1);
+        }
+        log_info("%u reshuffles took %s", n, format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(prioq_pop(q));
+        log_info("%u pops took %s", n, format_timespan(b, sizeof b, now(CLOCK_MONOTONIC) - ts, 1));
+}
+
 int main(int argc, char* argv[]) {
+        test_setup_logging(LOG_INFO);
 
         test_unsigned();
         test_struct();
+        test_put_many();
+        test_performance();
 
         return 0;
 }
@@ -3,8 +3,10 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "fs-util.h"
 #include "process-util.h"
 #include "rm-rf.h"
+#include "stat-util.h"
 #include "string-util.h"
 #include "tests.h"
 #include "tmpfile-util.h"
@@ -65,10 +67,41 @@ static void test_rm_rf_chmod(void) {
         test_rm_rf_chmod_inner();
 }
 
+static void test_rm_rf_tree(void) {
+        _cleanup_free_ char *d = NULL;
+        const char *p;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc(NULL, &d) >= 0);
+
+        p = d;
+        for (unsigned i = 0; i < 16; i++) {
+                const char *f;
+
+                f = strjoina(p, "/file");
+                assert_se(touch(f) >= 0);
+                f = strjoina(p, "/link");
+                assert_se(symlink("/", f) >= 0);
+
+                p = strjoina(p, "/sub");
+                assert_se(mkdir(p, 0755) >= 0);
+        }
+
+        /* Without REMOVE_ROOT the top-level directory survives, but is empty afterwards */
+        assert_se(rm_rf(d, REMOVE_PHYSICAL) >= 0);
+        assert_se(dir_is_empty(d) > 0);
+
+        assert_se(rm_rf(d, REMOVE_PHYSICAL|REMOVE_ROOT) >= 0);
+        errno = 0;
+        assert_se(access(d, F_OK) < 0 && errno == ENOENT);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
         test_rm_rf_chmod();
+        test_rm_rf_tree();
 
         return 0;
 }
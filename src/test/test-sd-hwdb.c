@@ -3,6 +3,7 @@
 #include "alloc-util.h"
 #include "errno-util.h"
 #include "errno.h"
+#include "string-util.h"
 #include "tests.h"
 
 static int test_failed_enumerate(void) {
@@ -60,6 +61,36 @@ static void test_basic_enumerate(void) {
         assert_se(len1 == len2);
 }
 
+static void test_cached(void) {
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        const char *key, *value, *v;
+        unsigned n1 = 0, n2 = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_hwdb_new(&hwdb) == 0);
+
+        SD_HWDB_FOREACH_PROPERTY(hwdb, DELL_MODALIAS, key, value)
+                n1++;
+
+        /* Looking up another modalias in between must not disturb the cached result */
+        assert_se(sd_hwdb_get(hwdb, "no-such-modalias-should-exist", "KEY", &v) == -ENOENT);
+
+        SD_HWDB_FOREACH_PROPERTY(hwdb, DELL_MODALIAS, key, value)
+                n2++;
+
+        assert_se(sd_hwdb_get(hwdb, DELL_MODALIAS, "KEYBOARD_KEY_81", &v) == 0);
+        assert_se(streq(v, "playpause"));
+
+        /* Lookups in between invalidate the enumeration */
+        assert_se(sd_hwdb_seek(hwdb, DELL_MODALIAS) == 0);
+        assert_se(sd_hwdb_get(hwdb, DELL_MODALIAS, "KEY", &v) == -ENOENT);
+        assert_se(sd_hwdb_enumerate(hwdb, &key, &value) == -EAGAIN);
+
+        assert_se(n1 == n2);
+        assert_se(n1 > 0);
+}
+
 int main(int argc, char *argv[]) {
         int r;
 
@@ -70,6 +101,7 @@ int main(int argc, char *argv[]) {
                 return log_tests_skipped_errno(r, "cannot open hwdb");
 
         test_basic_enumerate();
+        test_cached();
 
         return 0;
 }
@@ -191,6 +191,33 @@ static void test_serialize_environment(void) {
         assert_se(strv_equal(env, env2));
 }
 
+static void test_deserialize_read_line(void) {
+        _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-serialize.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *line1 = NULL, *line2 = NULL, *line3 = NULL, *line4 = NULL, *eof = NULL;
+
+        assert_se(fmkostemp_safe(fn, "r+", &f) == 0);
+        log_info("/* %s (%s) */", __func__, fn);
+
+        assert_se(serialize_item(f, "a", "bbb") == 1);
+        assert_se(serialize_item_escaped(f, "b", "x\ny") == 1);
+        assert_se(fputs("\n", f) >= 0);
+        assert_se(fputs("unterminated", f) >= 0);
+
+        rewind(f);
+
+        assert_se(deserialize_read_line(f, &line1) == 6);
+        assert_se(streq(line1, "a=bbb"));
+        assert_se(deserialize_read_line(f, &line2) == 7);
+        assert_se(streq(line2, "b=x\\ny"));
+        assert_se(deserialize_read_line(f, &line3) == 1);
+        assert_se(streq(line3, ""));
+        assert_se(deserialize_read_line(f, &line4) == 12);
+        assert_se(streq(line4, "unterminated"));
+        assert_se(deserialize_read_line(f, &eof) == 0);
+        assert_se(streq(eof, ""));
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_INFO);
 
@@ -203,6 +230,7 @@ int main(int argc, char *argv[]) {
         test_serialize_strv();
         test_deserialize_environment();
         test_serialize_environment();
+        test_deserialize_read_line();
 
         return EXIT_SUCCESS;
 }
@@ -2,6 +2,7 @@
 
 #include <pthread.h>
 
+#include "mempool.h"
 #include "process-util.h"
 #include "set.h"
 #include "tests.h"
@@ -41,9 +42,68 @@ static void test_one(const char *val) {
         assert_se(!s);
 }
 
+typedef struct Tile {
+        uint64_t a, b;
+} Tile;
+
+DEFINE_MEMPOOL(test_pool, Tile, 8);
+
+static void* pool_thread(void *p) {
+        Tile **tiles = p;
+
+        /* Free the tiles of the main thread, and allocate new ones for it */
+        for (unsigned i = 0; i < NUM; i++) {
+                mempool_free_tile(&test_pool, tiles[i]);
+                assert_se(tiles[i] = mempool_alloc0_tile(&test_pool));
+        }
+
+        return NULL;
+}
+
+static void test_mempool_threads(void) {
+        Tile *tiles[NUM];
+        uint64_t hits, misses;
+        pthread_t t;
+
+        log_info("/* %s */", __func__);
+
+        for (unsigned i = 0; i < NUM; i++)
+                assert_se(tiles[i] = mempool_alloc0_tile(&test_pool));
+
+        mempool_get_stats(&test_pool, &hits, &misses);
+        assert_se(hits == 0);
+        assert_se(misses == NUM);
+
+        assert_se(pthread_create(&t, NULL, pool_thread, tiles) == 0);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        /* The thread reused the tiles it freed, and handed its cache back to the pool when it exited */
+        mempool_get_stats(&test_pool, &hits, &misses);
+        log_info("hits=%" PRIu64 " misses=%" PRIu64, hits, misses);
+        assert_se(hits == NUM);
+        assert_se(misses == NUM);
+
+        for (unsigned i = 0; i < NUM; i++) {
+                assert_se(tiles[i]->a == 0 && tiles[i]->b == 0);
+                mempool_free_tile(&test_pool, tiles[i]);
+        }
+
+        for (unsigned i = 0; i < NUM; i++)
+                assert_se(tiles[i] = mempool_alloc_tile(&test_pool));
+
+        mempool_get_stats(&test_pool, &hits, &misses);
+        assert_se(hits == 2 * NUM);
+        assert_se(misses == NUM);
+
+        for (unsigned i = 0; i < NUM; i++)
+                mempool_free_tile(&test_pool, tiles[i]);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
+        test_mempool_threads();
+
         test_one("0");
         /* The value $SYSTEMD_MEMPOOL= is cached. So the following
          * test should also succeed. */
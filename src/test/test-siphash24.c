@@ -85,6 +85,15 @@ static void test_short_hashes(void) {
         }
 }
 
+static void test_uint64(void) {
+        const uint8_t key[16] = { 0x22, 0x24, 0x41, 0x22, 0x55, 0x77, 0x88, 0x07,
+                                  0x23, 0x09, 0x23, 0x14, 0x0c, 0x33, 0x0e, 0x0f};
+        const uint64_t values[] = { 0, 1, 0xff, 0x0102030405060708, UINT64_MAX };
+
+        for (unsigned i = 0; i < ELEMENTSOF(values); i++)
+                assert_se(siphash24_uint64(values[i], key) == siphash24(&values[i], sizeof(values[i]), key));
+}
+
 /* see https://131002.net/siphash/siphash.pdf, Appendix A */
 int main(int argc, char *argv[]) {
         const uint8_t in[15]  = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -104,4 +113,5 @@ int main(int argc, char *argv[]) {
         do_test(in_buf + 4, sizeof(in), key);
 
         test_short_hashes();
+        test_uint64();
 }
@@ -12,6 +12,13 @@ int main(int argc, char *argv[]) {
         _cleanup_free_ char *urlified = NULL, *q = NULL, *qq = NULL;
         char *p, *z;
 
+        /* Nothing to strip, the string is returned as is */
+        assert_se(p = strdup("Foobar bar waldo"));
+        z = p;
+        assert_se(strip_tab_ansi(&p, NULL, NULL) == z);
+        assert_se(streq(p, "Foobar bar waldo"));
+        free(p);
+
         assert_se(p = strdup("\tFoobar\tbar\twaldo\t"));
         assert_se(strip_tab_ansi(&p, NULL, NULL));
         fprintf(stdout, "<%s>\n", p);
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-private.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "udev-event.h"
+#include "udev-rules.h"
+
+static void load_rules(const char *text, UdevRules **ret) {
+        _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-udev-rules.XXXXXX";
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+        _cleanup_close_ int fd = -1;
+
+        fd = mkostemp_safe(name);
+        assert_se(fd >= 0);
+        assert_se(write_string_file(name, text, WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+
+        assert_se(rules = udev_rules_new(RESOLVE_NAME_NEVER));
+        assert_se(udev_rules_parse_file(rules, name) >= 0);
+
+        *ret = TAKE_PTR(rules);
+}
+
+static void apply_rules(UdevRules *rules, const char *action, const char *devpath, const char *subsystem, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_(udev_event_freep) UdevEvent *event = NULL;
+        _cleanup_strv_free_ char **props = NULL;
+
+        /* device_new_from_strv() modifies the strings in place */
+        props = strv_copy(STRV_MAKE(strjoina("ACTION=", action),
+                          strjoina("DEVPATH=", devpath),
+                          strjoina("SUBSYSTEM=", subsystem),
+                          "SEQNUM=1"));
+        assert_se(props);
+
+        assert_se(device_new_from_strv(&dev, props) >= 0);
+        assert_se(event = udev_event_new(dev, 0, NULL));
+        assert_se(udev_rules_apply_to_event(rules, event, USEC_INFINITY, SIGKILL, NULL) >= 0);
+
+        *ret = TAKE_PTR(dev);
+}
+
+static void assert_property(sd_device *dev, const char *key, const char *expected) {
+        const char *val = NULL;
+
+        (void) sd_device_get_property_value(dev, key, &val);
+        log_debug("%s=%s (expected %s)", key, strnull(val), strnull(expected));
+        assert_se(streq_ptr(val, expected));
+}
+
+static void test_prefilter(void) {
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+
+        log_info("/* %s */", __func__);
+
+        load_rules("ACTION==\"remove\", GOTO=\"end\"\n"
+                   "SUBSYSTEM==\"net\", ENV{RUN1}=\"net\"\n"
+                   "SUBSYSTEM==\"net\", ENV{RUN2}=\"net\"\n"
+                   "SUBSYSTEM==\"net\", LABEL=\"inside\"\n"
+                   "SUBSYSTEM==\"net\", ENV{RUN3}=\"net\"\n"
+                   "SUBSYSTEM==\"block\", KERNEL==\"sdzz\", ENV{BOTH}=\"1\"\n"
+                   "SUBSYSTEM==\"block\", KERNEL==\"sdyy\", ENV{OTHER}=\"1\"\n"
+                   "SUBSYSTEM!=\"block\", ENV{NOT_BLOCK}=\"1\"\n"
+                   "KERNEL==\"vd*|sd*\", ENV{DISK}=\"1\"\n"
+                   "DRIVER==\"\", ENV{NO_DRIVER}=\"1\"\n"
+                   "SUBSYSTEM==\"block\", GOTO=\"inside2\"\n"
+                   "ENV{SKIPPED}=\"1\"\n"
+                   "LABEL=\"inside2\"\n"
+                   "SUBSYSTEM==\"block\", ENV{AFTER_GOTO}=\"1\"\n"
+                   "LABEL=\"end\"\n"
+                   "ENV{LAST}=\"1\"\n", &rules);
+
+        apply_rules(rules, "add", "/devices/virtual/test/sdzz", "block", &dev);
+        assert_property(dev, "RUN1", NULL);
+        assert_property(dev, "RUN3", NULL);
+        assert_property(dev, "BOTH", "1");
+        assert_property(dev, "OTHER", NULL);
+        assert_property(dev, "NOT_BLOCK", NULL);
+        assert_property(dev, "DISK", "1");
+        assert_property(dev, "NO_DRIVER", "1");
+        assert_property(dev, "SKIPPED", NULL);
+        assert_property(dev, "AFTER_GOTO", "1");
+        assert_property(dev, "LAST", "1");
+        dev = sd_device_unref(dev);
+
+        apply_rules(rules, "change", "/devices/virtual/test/lozz", "net", &dev);
+        assert_property(dev, "RUN1", "net");
+        assert_property(dev, "RUN2", "net");
+        assert_property(dev, "RUN3", "net");
+        assert_property(dev, "BOTH", NULL);
+        assert_property(dev, "NOT_BLOCK", "1");
+        assert_property(dev, "DISK", NULL);
+        assert_property(dev, "SKIPPED", "1");
+        assert_property(dev, "AFTER_GOTO", NULL);
+        assert_property(dev, "LAST", "1");
+        dev = sd_device_unref(dev);
+
+        apply_rules(rules, "remove", "/devices/virtual/test/sdzz", "block", &dev);
+        assert_property(dev, "BOTH", NULL);
+        assert_property(dev, "LAST", "1");
+}
+
+static void test_prefilter_performance(void) {
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+        char buf[FORMAT_TIMESPAN_MAX], line[LINE_MAX];
+        _cleanup_free_ char *text = NULL;
+        unsigned n_lines, n_events;
+        bool slow = slow_tests_enabled();
+        usec_t ts;
+
+        n_lines = slow ? 2000 : 200;
+        n_events = slow ? 4000 : 100;
+
+        log_info("/* %s (%s, %u lines, %u events) */", __func__, slow ? "slow" : "fast", n_lines, n_events);
+
+        /* Lots of lines for subsystems the events don't belong to, as in typical rules files */
+        for (unsigned i = 0; i < n_lines; i++) {
+                xsprintf(line, "SUBSYSTEM==\"%s\", KERNEL==\"dev%u\", ENV{MATCHED%u}=\"1\"\n",
+                         i % 4 == 0 ? "tty" : i % 4 == 1 ? "input" : i % 4 == 2 ? "usb" : "net", i, i);
+                assert_se(strextend(&text, line, NULL));
+        }
+        assert_se(strextend(&text, "SUBSYSTEM==\"block\", ENV{BLOCK}=\"1\"\n", NULL));
+
+        load_rules(text, &rules);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_events; i++) {
+                _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+
+                apply_rules(rules, "add", "/devices/virtual/test/sdzz", "block", &dev);
+                assert_property(dev, "BLOCK", "1");
+        }
+
+        log_info("Applying %u rules to %u events took %s.", n_lines + 1, n_events,
+                 format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
+}
+
+static void test_compiled(void) {
+        _cleanup_(unlink_tempfilep) char a[] = "/tmp/test-udev-rules-compiled.XXXXXX", b[] = "/tmp/test-udev-rules-compiled.XXXXXX";
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL, *compiled = NULL, *parsed = NULL;
+        _cleanup_free_ char *data_a = NULL, *data_b = NULL;
+        size_t size_a, size_b;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(close(mkostemp_safe(a)) >= 0);
+        assert_se(close(mkostemp_safe(b)) >= 0);
+
+        /* Whatever rules are installed on the system */
+        assert_se(udev_rules_load(&rules, RESOLVE_NAME_NEVER) >= 0);
+        assert_se(udev_rules_save_compiled(rules, a) >= 0);
+
+        /* Loading and writing the result again must be lossless */
+        assert_se(udev_rules_load_compiled(&compiled, RESOLVE_NAME_NEVER, a) >= 0);
+        assert_se(udev_rules_save_compiled(compiled, b) >= 0);
+        compiled = udev_rules_free(compiled);
+
+        assert_se(read_full_file(a, &data_a, &size_a) >= 0);
+        assert_se(read_full_file(b, &data_b, &size_b) >= 0);
+        log_info("Compiled rules take %zu bytes.", size_a);
+        assert_se(size_a == size_b);
+        assert_se(memcmp(data_a, data_b, size_a) == 0);
+
+        /* Compiled rules are only valid for the parameters they were built with */
+        r = udev_rules_load_compiled(&compiled, RESOLVE_NAME_LATE, a);
+        assert_se(r == -ESTALE);
+        assert_se(!compiled);
+
+        /* Truncated or garbled files are refused */
+        assert_se(write_string_file(b, "UDEVRULZ", WRITE_STRING_FILE_AVOID_NEWLINE) >= 0);
+        assert_se(udev_rules_load_compiled(&compiled, RESOLVE_NAME_NEVER, b) == -EBADMSG);
+        assert_se(truncate(a, size_a - 1) >= 0);
+        assert_se(udev_rules_load_compiled(&compiled, RESOLVE_NAME_NEVER, a) == -EBADMSG);
+        assert_se(!compiled);
+
+        /* Rules not loaded from the rules directories can't be validated, hence aren't written */
+        load_rules("KERNEL==\"sdzz\", ENV{FOO}=\"1\"\n", &parsed);
+        assert_se(udev_rules_save_compiled(parsed, a) == -ESTALE);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_prefilter();
+        test_prefilter_performance();
+        test_compiled();
+
+        return 0;
+}
@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <malloc.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "memory-util.h"
+#include "tests.h"
+#include "unit-dependency.h"
+
+/* The dependency store never looks at the units, it only compares their addresses */
+static uint8_t fake_units[4096];
+#define FAKE_UNIT(i) ((Unit*) (fake_units + (i)))
+
+typedef struct FakeUnit {
+        UnitDependencies dependencies;
+} FakeUnit;
+
+static void test_basic(void) {
+        FakeUnit u = {};
+        UnitDependencies *d = &u.dependencies;
+        UnitDependencyInfo di;
+        Unit *other;
+        size_t n = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(unit_dependencies_isempty(d, UNIT_AFTER));
+        assert_se(unit_dependencies_size(d, UNIT_AFTER) == 0);
+        assert_se(!unit_dependencies_first(d, UNIT_AFTER));
+        assert_se(!unit_dependencies_contains(d, UNIT_AFTER, FAKE_UNIT(1)));
+
+        assert_se(unit_dependencies_add(d, UNIT_AFTER, FAKE_UNIT(3), UNIT_DEPENDENCY_FILE, 0) > 0);
+        assert_se(unit_dependencies_add(d, UNIT_AFTER, FAKE_UNIT(1), UNIT_DEPENDENCY_FILE, 0) > 0);
+        assert_se(unit_dependencies_add(d, UNIT_WANTS, FAKE_UNIT(2), 0, UNIT_DEPENDENCY_DEFAULT) > 0);
+        assert_se(unit_dependencies_add(d, UNIT_AFTER, FAKE_UNIT(1), UNIT_DEPENDENCY_FILE, 0) == 0);
+        assert_se(unit_dependencies_add(d, UNIT_AFTER, FAKE_UNIT(1), UNIT_DEPENDENCY_UDEV, 0) > 0);
+        assert_se(unit_dependencies_add(d, UNIT_REFERENCED_BY, FAKE_UNIT(1), 0, UNIT_DEPENDENCY_FILE) > 0);
+
+        assert_se(unit_dependencies_size(d, UNIT_AFTER) == 2);
+        assert_se(unit_dependencies_size(d, UNIT_WANTS) == 1);
+        assert_se(unit_dependencies_size(d, UNIT_REFERENCED_BY) == 1);
+        assert_se(unit_dependencies_size(d, UNIT_BEFORE) == 0);
+        assert_se(unit_dependencies_first(d, UNIT_AFTER) == FAKE_UNIT(1));
+        assert_se(!unit_dependencies_contains(d, UNIT_WANTS, FAKE_UNIT(1)));
+
+        assert_se(unit_dependencies_get(d, UNIT_AFTER, FAKE_UNIT(1), &di));
+        assert_se(di.origin_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_UDEV));
+        assert_se(di.destination_mask == 0);
+
+        UNIT_FOREACH_DEPENDENCY_INFO(other, di, &u, UNIT_AFTER) {
+                assert_se(other == FAKE_UNIT(n == 0 ? 1 : 3));
+                assert_se(FLAGS_SET(di.origin_mask, UNIT_DEPENDENCY_FILE));
+                n++;
+        }
+        assert_se(n == 2);
+
+        /* Dropping the last bit drops the dependency */
+        di = (UnitDependencyInfo) { .origin_mask = UNIT_DEPENDENCY_UDEV };
+        assert_se(unit_dependencies_update(d, UNIT_AFTER, FAKE_UNIT(1), di));
+        assert_se(unit_dependencies_get(d, UNIT_AFTER, FAKE_UNIT(1), &di));
+        assert_se(di.origin_mask == UNIT_DEPENDENCY_UDEV);
+        assert_se(unit_dependencies_update(d, UNIT_AFTER, FAKE_UNIT(1), (UnitDependencyInfo) {}));
+        assert_se(!unit_dependencies_contains(d, UNIT_AFTER, FAKE_UNIT(1)));
+        assert_se(!unit_dependencies_update(d, UNIT_AFTER, FAKE_UNIT(1), di));
+
+        /* Replacing merges the masks */
+        assert_se(unit_dependencies_add(d, UNIT_AFTER, FAKE_UNIT(5), UNIT_DEPENDENCY_PATH, 0) > 0);
+        unit_dependencies_replace(d, UNIT_AFTER, FAKE_UNIT(3), FAKE_UNIT(5));
+        assert_se(!unit_dependencies_contains(d, UNIT_AFTER, FAKE_UNIT(3)));
+        assert_se(unit_dependencies_get(d, UNIT_AFTER, FAKE_UNIT(5), &di));
+        assert_se(di.origin_mask == (UNIT_DEPENDENCY_FILE|UNIT_DEPENDENCY_PATH));
+        unit_dependencies_replace(d, UNIT_AFTER, FAKE_UNIT(5), FAKE_UNIT(4));
+        assert_se(unit_dependencies_first(d, UNIT_AFTER) == FAKE_UNIT(4));
+
+        assert_se(unit_dependencies_remove(d, UNIT_AFTER, FAKE_UNIT(4)));
+        assert_se(!unit_dependencies_remove(d, UNIT_AFTER, FAKE_UNIT(4)));
+        assert_se(unit_dependencies_isempty(d, UNIT_AFTER));
+        assert_se(!unit_dependencies_isempty(d, UNIT_WANTS));
+
+        unit_dependencies_done(d);
+        assert_se(unit_dependencies_isempty(d, UNIT_WANTS));
+}
+
+static void test_iterate_and_remove_one(size_t n_deps) {
+        FakeUnit u = {};
+        bool seen[n_deps];
+        Unit *other;
+        size_t n = 0;
+
+        log_info("/* %s(%zu) */", __func__, n_deps);
+
+        for (size_t i = 0; i < n_deps; i++) {
+                assert_se(unit_dependencies_add(&u.dependencies, UNIT_BEFORE, FAKE_UNIT(i), UNIT_DEPENDENCY_FILE, 0) > 0);
+                assert_se(unit_dependencies_add(&u.dependencies, UNIT_REFERENCES, FAKE_UNIT(i), UNIT_DEPENDENCY_FILE, 0) > 0);
+        }
+
+        assert_se(unit_dependencies_size(&u.dependencies, UNIT_BEFORE) == n_deps);
+        assert_se(unit_dependencies_size(&u.dependencies, UNIT_REFERENCES) == n_deps);
+        assert_se(!!u.dependencies.hashmaps == (2 * n_deps > UNIT_DEPENDENCIES_COMPACT_MAX));
+
+        /* Removing every other entry while iterating, when it is the current one */
+        zero(seen);
+        UNIT_FOREACH_DEPENDENCY(other, &u, UNIT_BEFORE) {
+                size_t i = (uint8_t*) other - fake_units;
+
+                assert_se(i < n_deps);
+                assert_se(!seen[i]);
+                seen[i] = true;
+                n++;
+
+                if (i % 2 == 0)
+                        assert_se(unit_dependencies_remove(&u.dependencies, UNIT_BEFORE, other));
+        }
+        assert_se(n == n_deps);
+        assert_se(unit_dependencies_size(&u.dependencies, UNIT_BEFORE) == n_deps / 2);
+        assert_se(unit_dependencies_size(&u.dependencies, UNIT_REFERENCES) == n_deps);
+
+        UNIT_FOREACH_DEPENDENCY(other, &u, UNIT_BEFORE)
+                assert_se(((uint8_t*) other - fake_units) % 2 == 1);
+
+        n = 0;
+        UNIT_FOREACH_DEPENDENCY(other, &u, UNIT_REFERENCES) {
+                assert_se(unit_dependencies_remove(&u.dependencies, UNIT_REFERENCES, other));
+                n++;
+        }
+        assert_se(n == n_deps);
+        assert_se(unit_dependencies_isempty(&u.dependencies, UNIT_REFERENCES));
+
+        unit_dependencies_done(&u.dependencies);
+}
+
+static void test_iterate_and_remove(void) {
+        test_iterate_and_remove_one(1);
+        test_iterate_and_remove_one(7);
+        test_iterate_and_remove_one(UNIT_DEPENDENCIES_COMPACT_MAX / 2);
+        test_iterate_and_remove_one(UNIT_DEPENDENCIES_COMPACT_MAX * 4);
+}
+
+static void test_reserve(void) {
+        UnitDependencies a = {}, b = {};
+
+        log_info("/* %s */", __func__);
+
+        for (size_t i = 0; i < UNIT_DEPENDENCIES_COMPACT_MAX / 2; i++)
+                assert_se(unit_dependencies_add(&a, UNIT_AFTER, FAKE_UNIT(i), UNIT_DEPENDENCY_FILE, 0) > 0);
+        for (size_t i = 0; i < UNIT_DEPENDENCIES_COMPACT_MAX; i++)
+                assert_se(unit_dependencies_add(&b, i % 2 ? UNIT_AFTER : UNIT_WANTS, FAKE_UNIT(i), UNIT_DEPENDENCY_FILE, 0) > 0);
+
+        /* After the reservation everything fits, and a is expanded right away as it won't fit the array */
+        assert_se(!a.hashmaps);
+        assert_se(unit_dependencies_reserve(&a, &b) >= 0);
+        assert_se(a.hashmaps);
+        assert_se(unit_dependencies_size(&a, UNIT_AFTER) == UNIT_DEPENDENCIES_COMPACT_MAX / 2);
+
+        for (size_t i = 0; i < UNIT_DEPENDENCIES_COMPACT_MAX; i++)
+                assert_se(unit_dependencies_add(&a, i % 2 ? UNIT_AFTER : UNIT_WANTS, FAKE_UNIT(i), UNIT_DEPENDENCY_FILE, 0) >= 0);
+
+        assert_se(unit_dependencies_size(&a, UNIT_AFTER) == UNIT_DEPENDENCIES_COMPACT_MAX * 3 / 4);
+        assert_se(unit_dependencies_size(&a, UNIT_WANTS) == UNIT_DEPENDENCIES_COMPACT_MAX / 2);
+
+        unit_dependencies_done(&a);
+        unit_dependencies_done(&b);
+}
+
+static size_t heap_size(void) {
+        struct mallinfo mi;
+
+        mi = mallinfo();
+        return (size_t) mi.uordblks + (size_t) mi.hblkhd;
+}
+
+#define N_UNITS 4096U
+
+static void test_memory(void) {
+        /* A rough model of what a unit has: a couple of ordering and requirement dependencies, and their
+         * references */
+        static const UnitDependency types[] = {
+                UNIT_REQUIRES, UNIT_WANTS, UNIT_CONFLICTS, UNIT_BEFORE, UNIT_AFTER,
+                UNIT_AFTER, UNIT_AFTER, UNIT_REFERENCES, UNIT_REFERENCES, UNIT_REFERENCED_BY,
+        };
+        _cleanup_free_ Hashmap **hashmaps = NULL;
+        _cleanup_free_ UnitDependencies *stores = NULL;
+        size_t before, old_size, new_size;
+
+        log_info("/* %s */", __func__);
+
+        before = heap_size();
+        hashmaps = new0(Hashmap*, N_UNITS * _UNIT_DEPENDENCY_MAX);
+        assert_se(hashmaps);
+
+        for (size_t i = 0; i < N_UNITS; i++)
+                for (size_t j = 0; j < ELEMENTSOF(types); j++) {
+                        UnitDependencyInfo di = { .origin_mask = UNIT_DEPENDENCY_FILE };
+                        Hashmap **h = hashmaps + i * _UNIT_DEPENDENCY_MAX + types[j];
+
+                        assert_se(hashmap_ensure_allocated(h, NULL) >= 0);
+                        assert_se(hashmap_put(*h, FAKE_UNIT((i + j) % ELEMENTSOF(fake_units)), di.data) >= 0);
+                }
+        old_size = heap_size() - before;
+
+        for (size_t i = 0; i < N_UNITS * _UNIT_DEPENDENCY_MAX; i++)
+                hashmap_free(hashmaps[i]);
+        hashmaps = mfree(hashmaps);
+
+        before = heap_size();
+        stores = new0(UnitDependencies, N_UNITS);
+        assert_se(stores);
+
+        for (size_t i = 0; i < N_UNITS; i++)
+                for (size_t j = 0; j < ELEMENTSOF(types); j++)
+                        assert_se(unit_dependencies_add(stores + i, types[j], FAKE_UNIT((i + j) % ELEMENTSOF(fake_units)),
+                                                        UNIT_DEPENDENCY_FILE, 0) > 0);
+        new_size = heap_size() - before;
+
+        for (size_t i = 0; i < N_UNITS; i++)
+                unit_dependencies_done(stores + i);
+
+        log_info("Heap used per unit for %zu dependencies: %zu bytes with one hashmap per type, %zu bytes compact.",
+                 ELEMENTSOF(types), old_size / N_UNITS, new_size / N_UNITS);
+
+        /* mallinfo() doesn't know about allocations made by sanitizers */
+        if (old_size > 0)
+                assert_se(new_size < old_size);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_basic();
+        test_iterate_and_remove();
+        test_reserve();
+        test_memory();
+
+        return 0;
+}
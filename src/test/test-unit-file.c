@@ -1,10 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <unistd.h>
+
 #include "path-lookup.h"
+#include "rm-rf.h"
 #include "set.h"
 #include "special.h"
 #include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "unit-file.h"
 
 static void test_unit_validate_alias_symlink_and_warn(void) {
@@ -73,6 +77,60 @@ static void test_unit_file_build_name_map(char **ids) {
         }
 }
 
+static void test_unit_name_map_cache(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *d = NULL;
+        _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL, *ids2 = NULL, *names2 = NULL;
+        _cleanup_set_free_free_ Set *paths = NULL, *paths2 = NULL;
+        const char *p, *k, *v;
+        char **l;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file-XXXXXX", &d) >= 0);
+        p = strjoina(d, "/unit-name-map.cache");
+
+        assert_se(hashmap_put_strdup(&ids, "a.service", "/etc/systemd/system/a.service") >= 0);
+        assert_se(hashmap_put_strdup(&ids, "b.service", "a.service") >= 0);
+        assert_se(hashmap_put_strdup(&ids, "c.service", "a.service") >= 0);
+        assert_se(hashmap_put_strdup(&ids, "x.target", "/dev/null") >= 0);
+        assert_se(string_strv_hashmap_put(&names, "a.service", "b.service") >= 0);
+        assert_se(string_strv_hashmap_put(&names, "a.service", "c.service") >= 0);
+        assert_se(set_put_strdup(&paths, "/etc/systemd/system/a.service") >= 0);
+        assert_se(set_put_strdup(&paths, "/etc/systemd/system/x.target.wants") >= 0);
+
+        assert_se(unit_name_map_cache_write(p, 4711, ids, names, paths) >= 0);
+
+        assert_se(unit_name_map_cache_read(p, 4712, &ids2, &names2, &paths2) == -ESTALE);
+        assert_se(!ids2 && !names2 && !paths2);
+
+        assert_se(unit_name_map_cache_read(p, 4711, &ids2, &names2, &paths2) >= 0);
+
+        assert_se(hashmap_size(ids2) == hashmap_size(ids));
+        HASHMAP_FOREACH_KEY(v, k, ids)
+                assert_se(streq_ptr(hashmap_get(ids2, k), v));
+
+        assert_se(hashmap_size(names2) == hashmap_size(names));
+        HASHMAP_FOREACH_KEY(l, k, names)
+                assert_se(strv_equal(hashmap_get(names2, k), l));
+
+        assert_se(set_size(paths2) == set_size(paths));
+        SET_FOREACH(v, paths)
+                assert_se(set_contains(paths2, v));
+
+        /* The path cache is optional */
+        ids2 = hashmap_free(ids2);
+        names2 = hashmap_free(names2);
+        assert_se(unit_name_map_cache_read(p, 4711, &ids2, &names2, NULL) >= 0);
+        assert_se(hashmap_size(ids2) == hashmap_size(ids));
+
+        /* A truncated file is refused */
+        assert_se(truncate(p, 20) >= 0);
+        assert_se(unit_name_map_cache_read(p, 4711, &ids2, &names2, NULL) == -EBADMSG);
+
+        assert_se(unlink(p) >= 0);
+        assert_se(unit_name_map_cache_read(p, 4711, &ids2, &names2, NULL) == -ENOENT);
+}
+
 static void test_runlevel_to_target(void) {
         log_info("/* %s */", __func__);
 
@@ -96,6 +154,7 @@ int main(int argc, char **argv) {
 
         test_unit_validate_alias_symlink_and_warn();
         test_unit_file_build_name_map(strv_skip(argv, 1));
+        test_unit_name_map_cache();
         test_runlevel_to_target();
 
         return 0;
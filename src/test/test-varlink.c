@@ -6,9 +6,12 @@
 
 #include "sd-event.h"
 
+#include "alloc-util.h"
 #include "fd-util.h"
+#include "io-util.h"
 #include "json.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "strv.h"
 #include "tmpfile-util.h"
 #include "user-util.h"
@@ -167,6 +170,98 @@ static void *thread(void *arg) {
         return NULL;
 }
 
+#define PIPELINED_CALLS 20000
+
+struct pipelined_calls {
+        int fd;
+        char *data;
+        size_t size;
+};
+
+static void *write_pipelined_calls(void *arg) {
+        struct pipelined_calls *p = arg;
+
+        assert_se(loop_write(p->fd, p->data, p->size, false) >= 0);
+        return NULL;
+}
+
+static void test_pipelining(void) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        _cleanup_(close_pairp) int fds[2] = { -1, -1 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ char *calls = NULL, *replies = NULL;
+        size_t calls_size = 0, calls_allocated = 0, replies_size = 0, replies_allocated = 0, i, begin = 0;
+        struct pipelined_calls p;
+        unsigned n_replies = 0;
+        pthread_t t;
+
+        log_info("/* %s */", __func__);
+
+        /* Send many calls in one go, without waiting for the replies, which are more than fit in one read.
+         * Messages hence straddle the buffer boundary, and the replies must still come back in order. */
+
+        for (i = 0; i < PIPELINED_CALLS; i++) {
+                char m[128];
+                size_t n;
+
+                xsprintf(m, "{\"method\":\"io.test.DoSomething\",\"parameters\":{\"a\":%zu,\"b\":1}}", i);
+                n = strlen(m);
+                assert_se(GREEDY_REALLOC(calls, calls_allocated, calls_size + n + 1));
+                memcpy(calls + calls_size, m, n + 1);
+                calls_size += n + 1;
+        }
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        assert_se(varlink_server_new(&s, 0) >= 0);
+        assert_se(varlink_server_bind_method(s, "io.test.DoSomething", method_something) >= 0);
+        assert_se(varlink_server_attach_event(s, e, 0) >= 0);
+        assert_se(varlink_server_add_connection(s, TAKE_FD(fds[0]), NULL) >= 0);
+
+        p = (struct pipelined_calls) {
+                .fd = fds[1],
+                .data = calls,
+                .size = calls_size,
+        };
+        assert_se(pthread_create(&t, NULL, write_pipelined_calls, &p) == 0);
+
+        while (n_replies < PIPELINED_CALLS) {
+                ssize_t n;
+
+                assert_se(sd_event_run(e, 10 * USEC_PER_MSEC) >= 0);
+
+                assert_se(GREEDY_REALLOC(replies, replies_allocated, replies_size + 64 * 1024));
+                n = recv(fds[1], replies + replies_size, replies_allocated - replies_size, MSG_DONTWAIT);
+                if (n < 0) {
+                        assert_se(errno == EAGAIN);
+                        continue;
+                }
+                assert_se(n > 0);
+                replies_size += n;
+
+                for (i = begin; i < replies_size; i++) {
+                        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                        if (replies[i] != 0)
+                                continue;
+
+                        assert_se(json_parse(replies + begin, 0, &v, NULL, NULL) >= 0);
+                        assert_se(json_variant_integer(json_variant_by_key(json_variant_by_key(v, "parameters"), "sum")) == n_replies + 1);
+
+                        n_replies++;
+                        begin = i + 1;
+                }
+        }
+
+        assert_se(pthread_join(t, NULL) == 0);
+
+        /* Connections keep a reference to the server, hence hang up and wait until ours is gone */
+        fds[1] = safe_close(fds[1]);
+        while (varlink_server_current_connections(s) > 0)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+}
+
 static int block_fd_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         char c;
 
@@ -198,6 +293,8 @@ int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
         log_open();
 
+        test_pipelining();
+
         assert_se(mkdtemp_malloc("/tmp/varlink-test-XXXXXX", &tmpdir) >= 0);
         sp = strjoina(tmpdir, "/socket");
 
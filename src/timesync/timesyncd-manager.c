@@ -10,6 +10,10 @@
 #include <sys/timex.h>
 #include <sys/types.h>
 
+/* linux/errqueue.h needs struct timespec defined first */
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
@@ -122,6 +126,7 @@ static int manager_send_request(Manager *m) {
          */
         assert_se(clock_gettime(clock_boottime_or_monotonic(), &m->trans_time_mon) >= 0);
         assert_se(clock_gettime(CLOCK_REALTIME, &m->trans_time) >= 0);
+        m->trans_time_kernel = (struct timespec) {};
         ntpmsg.trans_time.sec = htobe32(m->trans_time.tv_sec + OFFSET_1900_1970);
         ntpmsg.trans_time.frac = htobe32(m->trans_time.tv_nsec);
 
@@ -398,6 +403,46 @@ static void manager_adjust_poll(Manager *m, double offset, bool spike) {
         }
 }
 
+static int manager_receive_transmit_timestamps(Manager *m, int fd) {
+        int n = 0;
+
+        assert(m);
+        assert(fd >= 0);
+
+        /* Reads the transmit timestamps the kernel queued for our requests. Returns the number of timestamps
+         * read, or a negative errno if anything else was queued. */
+
+        for (;;) {
+                CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct timespec)) +
+                                 CMSG_SPACE(sizeof(struct scm_timestamping)) +
+                                 CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(union sockaddr_union))) control;
+                struct msghdr msghdr = {
+                        .msg_control = &control,
+                        .msg_controllen = sizeof(control),
+                };
+                struct scm_timestamping *tss;
+                ssize_t len;
+
+                len = recvmsg_safe(fd, &msghdr, MSG_ERRQUEUE|MSG_DONTWAIT);
+                if (len == -EAGAIN)
+                        return n;
+                if (len < 0)
+                        return (int) len;
+
+                tss = CMSG_FIND_DATA(&msghdr, SOL_SOCKET, SCM_TIMESTAMPING, struct scm_timestamping);
+                if (!tss)
+                        return -EIO;
+
+                n++;
+
+                /* Ignore timestamps of earlier requests we didn't get a reply for */
+                if (timespec_load(&tss->ts[0]) < timespec_load(&m->trans_time))
+                        continue;
+
+                m->trans_time_kernel = tss->ts[0];
+        }
+}
+
 static int manager_receive_response(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
         struct ntp_msg ntpmsg;
@@ -406,7 +451,8 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 .iov_base = &ntpmsg,
                 .iov_len = sizeof(ntpmsg),
         };
-        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct timeval))) control;
+        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct timespec)) +
+                         CMSG_SPACE(sizeof(struct scm_timestamping))) control;
         union sockaddr_union server_addr;
         struct msghdr msghdr = {
                 .msg_iov = &iov,
@@ -430,8 +476,15 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         assert(m);
 
         if (revents & (EPOLLHUP|EPOLLERR)) {
-                log_warning("Server connection returned error.");
-                return manager_connect(m);
+                /* The transmit timestamps are queued on the error queue, hence show up as EPOLLERR */
+                r = (revents & EPOLLHUP) ? 0 : manager_receive_transmit_timestamps(m, fd);
+                if (r <= 0) {
+                        log_warning("Server connection returned error.");
+                        return manager_connect(m);
+                }
+
+                if (!(revents & EPOLLIN))
+                        return 0;
         }
 
         len = recvmsg_safe(fd, &msghdr, MSG_DONTWAIT);
@@ -539,7 +592,12 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
          *  The round-trip delay, d, and system clock offset, t, are defined as:
          *  d = (T4 - T1) - (T3 - T2)     t = ((T2 - T1) + (T3 - T4)) / 2"
          */
-        origin = ts_to_d(&m->trans_time) + OFFSET_1900_1970;
+        if (m->trans_time_kernel.tv_sec > 0)
+                m->origin_time = m->trans_time_kernel;
+        else
+                m->origin_time = m->trans_time;
+
+        origin = ts_to_d(&m->origin_time) + OFFSET_1900_1970;
         receive = ntp_ts_to_d(&ntpmsg.recv_time);
         trans = ntp_ts_to_d(&ntpmsg.trans_time);
         dest = ts_to_d(recv_time) + OFFSET_1900_1970;
@@ -593,7 +651,6 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
 
         /* Save NTP response */
         m->ntpmsg = ntpmsg;
-        m->origin_time = m->trans_time;
         m->dest_time = *recv_time;
         m->spike = spike;
 
@@ -647,6 +704,14 @@ static int manager_listen_setup(Manager *m) {
         if (r < 0)
                 return r;
 
+        /* Ask the kernel when our requests actually leave, so that neither the time it takes us to get from
+         * taking the transmit timestamp to the network stack nor the time spent in it is counted as network
+         * delay. If this isn't supported we just stick to the timestamps we take ourselves. */
+        r = setsockopt_int(m->server_socket, SOL_SOCKET, SO_TIMESTAMPING,
+                           SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY);
+        if (r < 0)
+                log_debug_errno(r, "Failed to enable transmit timestamps, ignoring: %m");
+
         if (addr.sa.sa_family == AF_INET)
                 (void) setsockopt_int(m->server_socket, IPPROTO_IP, IP_TOS, IPTOS_LOWDELAY);
 
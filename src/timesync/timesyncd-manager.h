@@ -59,6 +59,7 @@ struct Manager {
         /* last sent packet */
         struct timespec trans_time_mon;
         struct timespec trans_time;
+        struct timespec trans_time_kernel; /* when the packet actually left, as reported by the kernel, if it does */
         usec_t retry_interval;
         bool pending;
 
@@ -49,6 +49,7 @@
 #include "path-lookup.h"
 #include "path-util.h"
 #include "pretty-print.h"
+#include "ratelimit.h"
 #include "rlimit-util.h"
 #include "rm-rf.h"
 #include "selinux-util.h"
@@ -159,6 +160,12 @@ typedef enum DirectoryType {
         _DIRECTORY_TYPE_MAX,
 } DirectoryType;
 
+typedef struct CleanStatistics {
+        uint64_t n_examined;
+        uint64_t n_removed_files;
+        uint64_t n_removed_directories;
+} CleanStatistics;
+
 static bool arg_cat_config = false;
 static bool arg_user = false;
 static OperationMask arg_operation = 0;
@@ -170,12 +177,16 @@ static char **arg_exclude_prefixes = NULL;
 static char *arg_root = NULL;
 static char *arg_image = NULL;
 static char *arg_replace = NULL;
+static unsigned arg_clean_rate = 0;
 
 #define MAX_DEPTH 256
 
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
 
+static CleanStatistics clean_stats = {};
+static RateLimit clean_ratelimit = {};
+
 STATIC_DESTRUCTOR_REGISTER(items, ordered_hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(globs, ordered_hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(unix_sockets, set_free_freep);
@@ -503,6 +514,23 @@ static inline nsec_t load_statx_timestamp_nsec(const struct statx_timestamp *ts)
         return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
 }
 
+static void clean_throttle(void) {
+        /* Limits the number of file system operations done while aging directories to --clean-rate= per
+         * second, so that cleaning huge directory trees does not saturate the disk for everybody else. */
+
+        if (!ratelimit_configured(&clean_ratelimit))
+                return;
+
+        while (!ratelimit_below(&clean_ratelimit)) {
+                usec_t n, e;
+
+                n = now(CLOCK_MONOTONIC);
+                e = ratelimit_end(&clean_ratelimit);
+                if (e >= n)
+                        (void) usleep(e - n + 1);
+        }
+}
+
 static int dir_cleanup(
                 Item *i,
                 const char *p,
@@ -540,6 +568,9 @@ static int dir_cleanup(
 
                 STRUCT_STATX_DEFINE(sx);
 
+                clean_throttle();
+                clean_stats.n_examined++;
+
                 r = statx_fallback(
                                 dirfd(d), dent->d_name,
                                 AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,
@@ -681,9 +712,12 @@ static int dir_cleanup(
                         }
 
                         log_debug("Removing directory \"%s\".", sub_path);
-                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0)
+                        clean_throttle();
+                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0) {
                                 if (!IN_SET(errno, ENOENT, ENOTEMPTY))
                                         r = log_warning_errno(errno, "Failed to remove directory \"%s\", ignoring: %m", sub_path);
+                        } else
+                                clean_stats.n_removed_directories++;
 
                 } else {
                         /* Skip files for which the sticky bit is set. These are semantics we define, and are
@@ -756,9 +790,12 @@ static int dir_cleanup(
                         }
 
                         log_debug("Removing \"%s\".", sub_path);
-                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0)
+                        clean_throttle();
+                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0) {
                                 if (errno != ENOENT)
                                         r = log_warning_errno(errno, "Failed to remove \"%s\", ignoring: %m", sub_path);
+                        } else
+                                clean_stats.n_removed_files++;
 
                         deleted = true;
                 }
@@ -2250,6 +2287,7 @@ static int remove_item(Item *i) {
 static int clean_item_instance(Item *i, const char* instance) {
         char timestamp[FORMAT_TIMESTAMP_MAX];
         _cleanup_closedir_ DIR *d = NULL;
+        CleanStatistics before;
         STRUCT_STATX_DEFINE(sx);
         int mountpoint, r;
         usec_t cutoff, n;
@@ -2298,12 +2336,22 @@ static int clean_item_instance(Item *i, const char* instance) {
                   instance,
                   format_timestamp_style(timestamp, sizeof(timestamp), cutoff, TIMESTAMP_US));
 
-        return dir_cleanup(i, instance, d,
-                           load_statx_timestamp_nsec(&sx.stx_atime),
-                           load_statx_timestamp_nsec(&sx.stx_mtime),
-                           cutoff * NSEC_PER_USEC,
-                           sx.stx_dev_major, sx.stx_dev_minor, mountpoint,
-                           MAX_DEPTH, i->keep_first_level);
+        before = clean_stats;
+
+        r = dir_cleanup(i, instance, d,
+                        load_statx_timestamp_nsec(&sx.stx_atime),
+                        load_statx_timestamp_nsec(&sx.stx_mtime),
+                        cutoff * NSEC_PER_USEC,
+                        sx.stx_dev_major, sx.stx_dev_minor, mountpoint,
+                        MAX_DEPTH, i->keep_first_level);
+
+        log_debug("Cleaned up \"%s\": examined %" PRIu64 " entries, removed %" PRIu64 " files and %" PRIu64 " directories.",
+                  instance,
+                  clean_stats.n_examined - before.n_examined,
+                  clean_stats.n_removed_files - before.n_removed_files,
+                  clean_stats.n_removed_directories - before.n_removed_directories);
+
+        return r;
 }
 
 static int clean_item(Item *i) {
@@ -3004,6 +3052,7 @@ static int help(void) {
                "     --root=PATH            Operate on an alternate filesystem root\n"
                "     --image=PATH           Operate on disk image as filesystem root\n"
                "     --replace=PATH         Treat arguments as replacement for PATH\n"
+               "     --clean-rate=N         Limit cleaning to N file system operations per second\n"
                "     --no-pager             Do not pipe output into a pager\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
@@ -3028,6 +3077,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_ROOT,
                 ARG_IMAGE,
                 ARG_REPLACE,
+                ARG_CLEAN_RATE,
                 ARG_NO_PAGER,
         };
 
@@ -3045,6 +3095,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "root",           required_argument,   NULL, ARG_ROOT           },
                 { "image",          required_argument,   NULL, ARG_IMAGE          },
                 { "replace",        required_argument,   NULL, ARG_REPLACE        },
+                { "clean-rate",     required_argument,   NULL, ARG_CLEAN_RATE     },
                 { "no-pager",       no_argument,         NULL, ARG_NO_PAGER       },
                 {}
         };
@@ -3128,6 +3179,14 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_replace = optarg;
                         break;
 
+                case ARG_CLEAN_RATE:
+                        r = safe_atou(optarg, &arg_clean_rate);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --clean-rate= argument: %s", optarg);
+
+                        clean_ratelimit = (RateLimit) { USEC_PER_SEC, arg_clean_rate };
+                        break;
+
                 case ARG_NO_PAGER:
                         arg_pager_flags |= PAGER_DISABLE;
                         break;
@@ -3342,6 +3401,7 @@ static int run(int argc, char *argv[]) {
                 PHASE_CREATE,
                 _PHASE_MAX
         } phase;
+        usec_t phase_start;
         int r, k;
 
         r = parse_argv(argc, argv);
@@ -3455,6 +3515,8 @@ static int run(int argc, char *argv[]) {
                 if (op == 0) /* Nothing requested in this phase */
                         continue;
 
+                phase_start = now(CLOCK_MONOTONIC);
+
                 /* The non-globbing ones usually create things, hence we apply them first */
                 ORDERED_HASHMAP_FOREACH(a, items) {
                         k = process_item_array(a, op);
@@ -3468,6 +3530,17 @@ static int run(int argc, char *argv[]) {
                         if (k < 0 && r >= 0)
                                 r = k;
                 }
+
+                if (FLAGS_SET(op, OPERATION_CLEAN)) {
+                        char ts[FORMAT_TIMESPAN_MAX];
+
+                        log_full(clean_stats.n_removed_files + clean_stats.n_removed_directories > 0 ? LOG_INFO : LOG_DEBUG,
+                                 "Cleanup finished in %s: examined %" PRIu64 " entries, removed %" PRIu64 " files and %" PRIu64 " directories.",
+                                 format_timespan(ts, sizeof(ts), usec_sub_unsigned(now(CLOCK_MONOTONIC), phase_start), USEC_PER_MSEC),
+                                 clean_stats.n_examined,
+                                 clean_stats.n_removed_files,
+                                 clean_stats.n_removed_directories);
+                }
         }
 
         if (ERRNO_IS_RESOURCE(r))
@@ -16,16 +16,24 @@
 
 #include "alloc-util.h"
 #include "blkid-util.h"
+#include "device-private.h"
 #include "device-util.h"
 #include "efi-loader.h"
 #include "errno-util.h"
+#include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "gpt.h"
 #include "parse-util.h"
+#include "stat-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "strxcpyx.h"
 #include "udev-builtin.h"
 
+/* Results of previous probes, see blkid_cache_key() */
+#define BLKID_CACHE_DIR "/run/udev/blkid"
+
 static void print_property(sd_device *dev, bool test, const char *name, const char *value) {
         char s[256];
 
@@ -94,7 +102,7 @@ static void print_property(sd_device *dev, bool test, const char *name, const ch
         }
 }
 
-static int find_gpt_root(sd_device *dev, blkid_probe pr, bool test) {
+static int find_gpt_root(blkid_probe pr, char **ret) {
 
 #if defined(GPT_ROOT_NATIVE) && ENABLE_EFI
 
@@ -171,10 +179,13 @@ static int find_gpt_root(sd_device *dev, blkid_probe pr, bool test) {
 
         /* We found the ESP on this disk, and also found a root
          * partition, nice! Let's export its UUID */
-        if (found_esp && root_id)
-                udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT_UUID", root_id);
+        if (found_esp && root_id) {
+                *ret = TAKE_PTR(root_id);
+                return 1;
+        }
 #endif
 
+        *ret = NULL;
         return 0;
 }
 
@@ -212,11 +223,226 @@ static int probe_superblocks(blkid_probe pr) {
         return blkid_do_safeprobe(pr);
 }
 
+static int blkid_cache_key(sd_device *dev, int fd, int64_t offset, bool noraid, char **ret) {
+        _cleanup_strv_free_ char **fields = NULL;
+        const char *v, *syspath, *size, *start = "0", *stat, *version = NULL;
+        sd_device *disk = dev;
+        char *key;
+
+        assert(dev);
+        assert(ret);
+
+        /* Change events are often synthesized after a close-after-write, or sent on partition table
+         * rescans, with nothing of the disk having been modified. Since all writes and discards are
+         * accounted in the statistics of the whole disk, the result of the last probe may be used as long
+         * as those did not change. That does not hold for disks whose contents can change otherwise:
+         * removable media, stacked devices and loop devices, where writes go to the backing devices and
+         * files, and network block devices. Returns 0 if the device can't be cached. */
+
+        if (sd_device_get_property_value(dev, "DISK_MEDIA_CHANGE", &v) >= 0)
+                goto uncached;
+
+        if (sd_device_get_devtype(dev, &v) >= 0 && streq(v, "partition")) {
+                if (sd_device_get_parent_with_subsystem_devtype(dev, "block", "disk", &disk) < 0)
+                        goto uncached;
+                if (sd_device_get_sysattr_value(dev, "start", &start) < 0)
+                        goto uncached;
+        }
+
+        if (sd_device_get_sysname(disk, &v) < 0 ||
+            startswith(v, "loop") || startswith(v, "nbd"))
+                goto uncached;
+
+        if (sd_device_get_sysattr_value(disk, "removable", &v) < 0 || !streq(v, "0"))
+                goto uncached;
+
+        if (sd_device_get_syspath(disk, &syspath) < 0 ||
+            dir_is_empty(strjoina(syspath, "/slaves")) <= 0)
+                goto uncached;
+
+        /* Get data still in the page cache to the disk, so that it shows up in the statistics */
+        if (sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|SYNC_FILE_RANGE_WAIT_AFTER) < 0)
+                goto uncached;
+
+        if (sd_device_get_sysattr_value(dev, "size", &size) < 0 ||
+            sd_device_get_sysattr_value(disk, "stat", &stat) < 0)
+                goto uncached;
+
+        /* Writes, written sectors, I/Os in flight, and, if supported, discards and discarded sectors */
+        fields = strv_split(stat, WHITESPACE);
+        if (!fields)
+                return -ENOMEM;
+        if (strv_length(fields) < 11 || !streq(fields[8], "0"))
+                goto uncached;
+
+        /* Also include the parameters of the probe, and the version of libblkid, which might have been
+         * updated since */
+        (void) blkid_get_library_version(&version, NULL);
+
+        if (asprintf(&key, "%s %s %s %s %s %s %"PRIi64" %s %s",
+                     size, start, fields[4], fields[6],
+                     strv_length(fields) >= 15 ? fields[11] : "-",
+                     strv_length(fields) >= 15 ? fields[13] : "-",
+                     offset, noraid ? "noraid" : "raid", strna(version)) < 0)
+                return -ENOMEM;
+
+        *ret = key;
+        return 1;
+
+uncached:
+        *ret = NULL;
+        return 0;
+}
+
+static int blkid_cache_load(sd_device *dev, const char *key, char ***ret_values, char **ret_root) {
+        _cleanup_free_ char *root = NULL, *line = NULL;
+        _cleanup_strv_free_ char **values = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *id, *path, *e;
+        int r;
+
+        assert(dev);
+        assert(key);
+        assert(ret_values);
+        assert(ret_root);
+
+        r = device_get_id_filename(dev, &id);
+        if (r < 0)
+                return r;
+
+        path = strjoina(BLKID_CACHE_DIR "/", id);
+        f = fopen(path, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        r = read_line(f, LONG_LINE_MAX, &line);
+        if (r < 0)
+                return r;
+        e = startswith(line, "K:");
+        if (!e || !streq(e, key))
+                return 0;
+
+        for (;;) {
+                _cleanup_free_ char *name = NULL, *value = NULL;
+
+                line = mfree(line);
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if ((e = startswith(line, "R:"))) {
+                        r = free_and_strdup(&root, e);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                e = startswith(line, "E:");
+                if (!e || !strchr(e, '='))
+                        return -EBADMSG;
+
+                name = strndup(e, strchr(e, '=') - e);
+                if (!name)
+                        return -ENOMEM;
+
+                r = cunescape(strchr(e, '=') + 1, 0, &value);
+                if (r < 0)
+                        return r;
+
+                r = strv_push_pair(&values, name, value);
+                if (r < 0)
+                        return r;
+                name = value = NULL;
+        }
+
+        *ret_values = TAKE_PTR(values);
+        *ret_root = TAKE_PTR(root);
+        return 1;
+}
+
+static int blkid_cache_save(sd_device *dev, const char *key, char **values, const char *root) {
+        _cleanup_free_ char *contents = NULL;
+        const char *id, *path;
+        char **name, **data;
+        int r;
+
+        assert(dev);
+        assert(key);
+
+        r = device_get_id_filename(dev, &id);
+        if (r < 0)
+                return r;
+
+        contents = strjoin("K:", key, "\n");
+        if (!contents)
+                return -ENOMEM;
+
+        STRV_FOREACH_PAIR(name, data, values) {
+                _cleanup_free_ char *escaped = NULL;
+
+                escaped = cescape(*data);
+                if (!escaped)
+                        return -ENOMEM;
+
+                if (!strextend(&contents, "E:", *name, "=", escaped, "\n", NULL))
+                        return -ENOMEM;
+        }
+
+        if (root && !strextend(&contents, "R:", root, "\n", NULL))
+                return -ENOMEM;
+
+        path = strjoina(BLKID_CACHE_DIR "/", id);
+        return write_string_file(path, contents,
+                                 WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|
+                                 WRITE_STRING_FILE_AVOID_NEWLINE|WRITE_STRING_FILE_MKDIR_0755);
+}
+
+static int blkid_cache_remove(sd_device *dev) {
+        const char *id;
+        int r;
+
+        assert(dev);
+
+        r = device_get_id_filename(dev, &id);
+        if (r < 0)
+                return r;
+
+        if (unlink(strjoina(BLKID_CACHE_DIR "/", id)) < 0 && errno != ENOENT)
+                return -errno;
+
+        return 0;
+}
+
+static void export_values(sd_device *dev, bool test, char **values, const char *root_id) {
+        const char *root_partition = NULL;
+        char **name, **data;
+
+        /* If the device is a partition then its parent passed the root partition UUID to the device */
+        (void) sd_device_get_property_value(dev, "ID_PART_GPT_AUTO_ROOT_UUID", &root_partition);
+
+        STRV_FOREACH_PAIR(name, data, values) {
+                print_property(dev, test, *name, *data);
+
+                /* Is this a partition that matches the root partition
+                 * property inherited from the parent? */
+                if (root_partition && streq(*name, "PART_ENTRY_UUID") && streq(*data, root_partition))
+                        udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT", "1");
+        }
+
+        if (root_id)
+                udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT_UUID", root_id);
+}
+
 static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
-        const char *devnode, *root_partition = NULL, *data, *name;
+        _cleanup_free_ char *key = NULL, *root_id = NULL;
+        _cleanup_strv_free_ char **values = NULL;
         _cleanup_(blkid_free_probep) blkid_probe pr = NULL;
+        const char *devnode, *data, *name;
         bool noraid = false, is_gpt = false;
         _cleanup_close_ int fd = -1;
+        DeviceAction action;
         int64_t offset = 0;
         int nvals, i, r;
 
@@ -247,6 +473,31 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
                 }
         }
 
+        r = sd_device_get_devname(dev, &devnode);
+        if (r < 0)
+                return log_device_debug_errno(dev, r, "Failed to get device name: %m");
+
+        fd = open(devnode, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+        if (fd < 0)
+                return log_device_debug_errno(dev, errno, "Failed to open block device %s: %m", devnode);
+
+        if (!test) {
+                r = blkid_cache_key(dev, fd, offset, noraid, &key);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to determine whether the device was modified, ignoring: %m");
+        }
+        /* A new device might have been given the number of a removed one, hence always probe on "add" */
+        if (key && device_get_action(dev, &action) >= 0 && action == DEVICE_ACTION_CHANGE) {
+                r = blkid_cache_load(dev, key, &values, &root_id);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to read result of previous probe, ignoring: %m");
+                if (r > 0) {
+                        log_device_debug(dev, "%s was not modified since the last probe, using its result.", devnode);
+                        export_values(dev, test, values, root_id);
+                        return 0;
+                }
+        }
+
         errno = 0;
         pr = blkid_new_probe();
         if (!pr)
@@ -260,14 +511,6 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
         if (noraid)
                 blkid_probe_filter_superblocks_usage(pr, BLKID_FLTR_NOTIN, BLKID_USAGE_RAID);
 
-        r = sd_device_get_devname(dev, &devnode);
-        if (r < 0)
-                return log_device_debug_errno(dev, r, "Failed to get device name: %m");
-
-        fd = open(devnode, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
-        if (fd < 0)
-                return log_device_debug_errno(dev, errno, "Failed to open block device %s: %m", devnode);
-
         errno = 0;
         r = blkid_probe_set_device(pr, fd, offset, 0);
         if (r < 0)
@@ -279,9 +522,6 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
         if (r < 0)
                 return log_device_debug_errno(dev, r, "Failed to probe superblocks: %m");
 
-        /* If the device is a partition then its parent passed the root partition UUID to the device */
-        (void) sd_device_get_property_value(dev, "ID_PART_GPT_AUTO_ROOT_UUID", &root_partition);
-
         errno = 0;
         nvals = blkid_probe_numof_values(pr);
         if (nvals < 0)
@@ -291,20 +531,26 @@ static int builtin_blkid(sd_device *dev, int argc, char *argv[], bool test) {
                 if (blkid_probe_get_value(pr, i, &name, &data, NULL) < 0)
                         continue;
 
-                print_property(dev, test, name, data);
+                r = strv_extend_strv(&values, STRV_MAKE(name, data), false);
+                if (r < 0)
+                        return log_oom();
 
                 /* Is this a disk with GPT partition table? */
                 if (streq(name, "PTTYPE") && streq(data, "gpt"))
                         is_gpt = true;
-
-                /* Is this a partition that matches the root partition
-                 * property inherited from the parent? */
-                if (root_partition && streq(name, "PART_ENTRY_UUID") && streq(data, root_partition))
-                        udev_builtin_add_property(dev, test, "ID_PART_GPT_AUTO_ROOT", "1");
         }
 
         if (is_gpt)
-                find_gpt_root(dev, pr, test);
+                (void) find_gpt_root(pr, &root_id);
+
+        export_values(dev, test, values, root_id);
+
+        if (key) {
+                r = blkid_cache_save(dev, key, values, root_id);
+                if (r < 0)
+                        log_device_debug_errno(dev, r, "Failed to save result of probe, ignoring: %m");
+        } else if (!test)
+                (void) blkid_cache_remove(dev);
 
         return 0;
 }
@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -17,6 +18,7 @@
 #include "fs-util.h"
 #include "libudev-util.h"
 #include "mkdir.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
@@ -104,17 +106,80 @@ static int node_symlink(sd_device *dev, const char *node, const char *slink) {
         return r;
 }
 
+/* Each device claiming a symlink has an entry in the stack directory of the link, named after its id. The
+ * entry is a symlink pointing to "PRIORITY:DEVNODE", so that the device with the highest priority can be
+ * determined without reading the database of every claimant. Entries written by older versions are empty
+ * regular files, for those the database is consulted. */
+static int stack_entry_read(int dirfd, const char *id, int *ret_priority, char **ret_devnode) {
+        _cleanup_(sd_device_unrefp) sd_device *dev_db = NULL;
+        _cleanup_free_ char *data = NULL;
+        const char *devnode, *colon;
+        int priority = 0, r;
+
+        r = readlinkat_malloc(dirfd, id, &data);
+        if (r >= 0) {
+                _cleanup_free_ char *p = NULL;
+
+                colon = strchr(data, ':');
+                if (!colon)
+                        return -EINVAL;
+
+                p = strndup(data, colon - data);
+                if (!p)
+                        return -ENOMEM;
+
+                r = safe_atoi(p, &priority);
+                if (r < 0)
+                        return r;
+
+                if (!path_is_absolute(colon + 1))
+                        return -EINVAL;
+
+                r = free_and_strdup(ret_devnode, colon + 1);
+                if (r < 0)
+                        return r;
+
+                *ret_priority = priority;
+                return 0;
+        }
+        if (r != -EINVAL)
+                return r;
+
+        r = sd_device_new_from_device_id(&dev_db, id);
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_devname(dev_db, &devnode);
+        if (r < 0)
+                return r;
+
+        r = device_get_devlink_priority(dev_db, &priority);
+        if (r < 0)
+                return r;
+
+        r = free_and_strdup(ret_devnode, devnode);
+        if (r < 0)
+                return r;
+
+        *ret_priority = priority;
+        return 0;
+}
+
 /* find device node of device with highest priority */
-static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir, char **ret) {
+static int link_find_prioritized(sd_device *dev, bool add, int dirfd, char **ret) {
         _cleanup_closedir_ DIR *dir = NULL;
         _cleanup_free_ char *target = NULL;
+        const char *id_filename;
         struct dirent *dent;
-        int r, priority = 0;
+        int r, fd, priority = 0;
 
-        assert(!add || dev);
-        assert(stackdir);
+        assert(dev);
         assert(ret);
 
+        r = device_get_id_filename(dev, &id_filename);
+        if (r < 0)
+                return r;
+
         if (add) {
                 const char *devnode;
 
@@ -131,19 +196,27 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
                         return -ENOMEM;
         }
 
-        dir = opendir(stackdir);
-        if (!dir) {
+        if (dirfd < 0) {
                 if (target) {
                         *ret = TAKE_PTR(target);
                         return 0;
                 }
 
+                return -ENOENT;
+        }
+
+        fd = fcntl(dirfd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        dir = fdopendir(fd);
+        if (!dir) {
+                safe_close(fd);
                 return -errno;
         }
 
         FOREACH_DIRENT_ALL(dent, dir, break) {
-                _cleanup_(sd_device_unrefp) sd_device *dev_db = NULL;
-                const char *devnode, *id_filename;
+                _cleanup_free_ char *devnode = NULL;
                 int db_prio = 0;
 
                 if (dent->d_name[0] == '\0')
@@ -151,32 +224,21 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
                 if (dent->d_name[0] == '.')
                         continue;
 
-                log_device_debug(dev, "Found '%s' claiming '%s'", dent->d_name, stackdir);
-
-                if (device_get_id_filename(dev, &id_filename) < 0)
-                        continue;
+                log_device_debug(dev, "Found '%s' claiming the link", dent->d_name);
 
                 /* did we find ourself? */
                 if (streq(dent->d_name, id_filename))
                         continue;
 
-                if (sd_device_new_from_device_id(&dev_db, dent->d_name) < 0)
-                        continue;
-
-                if (sd_device_get_devname(dev_db, &devnode) < 0)
-                        continue;
-
-                if (device_get_devlink_priority(dev_db, &db_prio) < 0)
+                if (stack_entry_read(dirfd, dent->d_name, &db_prio, &devnode) < 0)
                         continue;
 
                 if (target && db_prio <= priority)
                         continue;
 
-                log_device_debug(dev_db, "Device claims priority %i for '%s'", db_prio, stackdir);
+                log_device_debug(dev, "Device '%s' claims priority %i for the link", dent->d_name, db_prio);
 
-                r = free_and_strdup(&target, devnode);
-                if (r < 0)
-                        return r;
+                free_and_replace(target, devnode);
                 priority = db_prio;
         }
 
@@ -187,9 +249,43 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
         return 0;
 }
 
+static int stack_directory_open(const char *dirname, bool add) {
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                struct stat st;
+                int r;
+
+                if (add) {
+                        r = mkdir_p(dirname, 0755);
+                        if (r < 0)
+                                return r;
+                }
+
+                fd = open(dirname, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                if (fd < 0) {
+                        if (errno == ENOENT && add)
+                                continue;
+                        return -errno;
+                }
+
+                /* Serialize the updates of the link by all workers */
+                if (flock(fd, LOCK_EX) < 0)
+                        return -errno;
+
+                /* The last claimant removes the directory, if that happened while we waited, start over */
+                if (fstat(fd, &st) < 0)
+                        return -errno;
+                if (st.st_nlink == 0)
+                        continue;
+
+                return TAKE_FD(fd);
+        }
+}
+
 /* manage "stack of names" with possibly specified device priorities */
 static int link_update(sd_device *dev, const char *slink, bool add) {
-        _cleanup_free_ char *target = NULL, *filename = NULL, *dirname = NULL;
+        _cleanup_free_ char *target = NULL, *dirname = NULL;
+        _cleanup_close_ int dirfd = -1;
         char name_enc[PATH_MAX];
         const char *id_filename;
         int r;
@@ -205,34 +301,49 @@ static int link_update(sd_device *dev, const char *slink, bool add) {
         dirname = path_join("/run/udev/links/", name_enc);
         if (!dirname)
                 return log_oom();
-        filename = path_join(dirname, id_filename);
-        if (!filename)
-                return log_oom();
 
-        if (!add && unlink(filename) == 0)
-                (void) rmdir(dirname);
+        dirfd = stack_directory_open(dirname, add);
+        if (dirfd < 0 && (add || dirfd != -ENOENT))
+                log_device_debug_errno(dev, dirfd, "Failed to open '%s', ignoring: %m", dirname);
+
+        if (dirfd >= 0) {
+                if (add) {
+                        _cleanup_free_ char *data = NULL;
+                        const char *devnode;
+                        int priority;
+
+                        r = device_get_devlink_priority(dev, &priority);
+                        if (r < 0)
+                                return log_device_debug_errno(dev, r, "Failed to get devlink priority: %m");
+
+                        r = sd_device_get_devname(dev, &devnode);
+                        if (r < 0)
+                                return log_device_debug_errno(dev, r, "Failed to get devname: %m");
+
+                        if (asprintf(&data, "%i:%s", priority, devnode) < 0)
+                                return log_oom();
+
+                        /* Replace our entry, it can be a regular file written by an older version */
+                        (void) unlinkat(dirfd, id_filename, 0);
+                        if (symlinkat(data, dirfd, id_filename) < 0)
+                                log_device_debug_errno(dev, errno, "Failed to create '%s/%s', ignoring: %m", dirname, id_filename);
+                } else
+                        (void) unlinkat(dirfd, id_filename, 0);
+        }
 
-        r = link_find_prioritized(dev, add, dirname, &target);
+        r = link_find_prioritized(dev, add, dirfd, &target);
         if (r < 0) {
                 log_device_debug(dev, "No reference left, removing '%s'", slink);
                 if (unlink(slink) == 0)
                         (void) rmdir_parents(slink, "/");
+
+                /* Still holding the lock, those waiting for it notice and create the directory again */
+                if (dirfd >= 0)
+                        (void) rmdir(dirname);
         } else
                 (void) node_symlink(dev, target, slink);
 
-        if (add)
-                do {
-                        _cleanup_close_ int fd = -1;
-
-                        r = mkdir_parents(filename, 0755);
-                        if (!IN_SET(r, 0, -ENOENT))
-                                break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd < 0)
-                                r = -errno;
-                } while (r == -ENOENT);
-
-        return r;
+        return 0;
 }
 
 int udev_node_update_old_links(sd_device *dev, sd_device *dev_old) {
@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: GPL-2.0+ */
 
 #include <ctype.h>
+#include <sys/mman.h>
+
+#include "sd-id128.h"
 
 #include "alloc-util.h"
 #include "architecture.h"
@@ -21,10 +24,14 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
+#include "siphash24.h"
+#include "sparse-endian.h"
 #include "stat-util.h"
+#include "strbuf.h"
 #include "strv.h"
 #include "strxcpyx.h"
 #include "sysctl-util.h"
+#include "tmpfile-util.h"
 #include "udev-builtin.h"
 #include "udev-event.h"
 #include "udev-rules.h"
@@ -151,6 +158,7 @@ struct UdevRuleToken {
 
 struct UdevRuleLine {
         char *line;
+        size_t line_size;
         unsigned line_number;
         UdevRuleLineType type;
 
@@ -162,18 +170,38 @@ struct UdevRuleLine {
         UdevRuleToken *current_token;
         LIST_HEAD(UdevRuleToken, tokens);
         LIST_FIELDS(UdevRuleLine, rule_lines);
+
+        /* The first ACTION==, KERNEL==, SUBSYSTEM== or DRIVER== match of the line, and the last line of the run
+         * of consecutive lines starting here that all have the very same match. If that match fails, the whole
+         * run can be skipped. See rule_file_build_prefilter(). */
+        UdevRuleToken *prefilter_token;
+        UdevRuleLine *prefilter_run_end;
 };
 
 struct UdevRuleFile {
         char *filename;
+        bool mapped; /* lines point into the compiled rules, see udev_rules_load_compiled() */
         UdevRuleLine *current_line;
         LIST_HEAD(UdevRuleLine, rule_lines);
         LIST_FIELDS(UdevRuleFile, rule_files);
 };
 
+/* The properties of the event the prefilter matches against, they don't change while the rules are applied */
+typedef struct UdevRulePrefilter {
+        bool enabled;
+        const char *action;
+        const char *sysname;
+        const char *subsystem;
+        const char *driver;
+} UdevRulePrefilter;
+
 struct UdevRules {
         usec_t dirs_ts_usec;
         ResolveNameTiming resolve_name_timing;
+        uint64_t sources_hash;
+        bool sources_hash_set;
+        void *map;
+        size_t map_size;
         Hashmap *known_users;
         Hashmap *known_groups;
         UdevRuleFile *current_file;
@@ -276,7 +304,8 @@ static void udev_rule_line_free(UdevRuleLine *rule_line) {
                 LIST_REMOVE(rule_lines, rule_line->rule_file->rule_lines, rule_line);
         }
 
-        free(rule_line->line);
+        if (!rule_line->rule_file || !rule_line->rule_file->mapped)
+                free(rule_line->line);
         free(rule_line);
 }
 
@@ -306,6 +335,10 @@ UdevRules *udev_rules_free(UdevRules *rules) {
 
         hashmap_free_free_key(rules->known_users);
         hashmap_free_free_key(rules->known_groups);
+
+        if (rules->map)
+                (void) munmap(rules->map, rules->map_size);
+
         return mfree(rules);
 }
 
@@ -1082,6 +1115,7 @@ static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_n
         _cleanup_(udev_rule_line_freep) UdevRuleLine *rule_line = NULL;
         _cleanup_free_ char *line = NULL;
         UdevRuleFile *rule_file;
+        size_t len;
         char *p;
         int r;
 
@@ -1096,7 +1130,8 @@ static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_n
 
         /* We use memdup_suffix0() here, since we want to add a second NUL byte to the end, since possibly
          * some parsers might turn this into a "nulstr", which requires an extra NUL at the end. */
-        line = memdup_suffix0(line_str, strlen(line_str) + 1);
+        len = strlen(line_str) + 1;
+        line = memdup_suffix0(line_str, len);
         if (!line)
                 return log_oom();
 
@@ -1106,6 +1141,7 @@ static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_n
 
         *rule_line = (UdevRuleLine) {
                 .line = TAKE_PTR(line),
+                .line_size = len,
                 .line_number = line_nr,
                 .rule_file = rule_file,
         };
@@ -1177,6 +1213,68 @@ static void rule_resolve_goto(UdevRuleFile *rule_file) {
         }
 }
 
+static bool token_is_prefilter(const UdevRuleToken *token) {
+        assert(token);
+
+        /* These only depend on the event, not on what previous rules did, hence can be checked up front. Note
+         * that tokens are sorted by type, and all token types up to TK_M_DRIVER are side-effect free matches. */
+        return IN_SET(token->type, TK_M_ACTION, TK_M_KERNEL, TK_M_SUBSYSTEM, TK_M_DRIVER);
+}
+
+static size_t nulstr_size(const char *s) {
+        const char *i;
+
+        assert(s);
+
+        /* Returns the size of a nulstr including its terminating double NUL */
+        for (i = s; *i; i += strlen(i) + 1)
+                ;
+
+        return i - s + 1;
+}
+
+static bool token_equal(const UdevRuleToken *a, const UdevRuleToken *b) {
+        size_t n;
+
+        if (!a || !b)
+                return false;
+
+        if (a->type != b->type || a->op != b->op || a->match_type != b->match_type)
+                return false;
+
+        n = nulstr_size(a->value);
+        return n == nulstr_size(b->value) && memcmp(a->value, b->value, n) == 0;
+}
+
+static void rule_file_build_prefilter(UdevRuleFile *rule_file) {
+        UdevRuleLine *line, *tail = NULL;
+        UdevRuleToken *token;
+
+        assert(rule_file);
+
+        LIST_FOREACH(rule_lines, line, rule_file->rule_lines) {
+                line->prefilter_token = NULL;
+
+                LIST_FOREACH(tokens, token, line->tokens) {
+                        if (token->type > TK_M_DRIVER)
+                                break;
+
+                        if (token_is_prefilter(token)) {
+                                line->prefilter_token = token;
+                                break;
+                        }
+                }
+
+                tail = line;
+        }
+
+        /* Walk backwards, so that each line can take over the run end of its successor */
+        for (line = tail; line; line = line->rule_lines_prev)
+                line->prefilter_run_end =
+                        line->rule_lines_next && token_equal(line->prefilter_token, line->rule_lines_next->prefilter_token) ?
+                        line->rule_lines_next->prefilter_run_end : line;
+}
+
 int udev_rules_parse_file(UdevRules *rules, const char *filename) {
         _cleanup_free_ char *continuation = NULL, *name = NULL;
         _cleanup_fclose_ FILE *f = NULL;
@@ -1277,6 +1375,7 @@ int udev_rules_parse_file(UdevRules *rules, const char *filename) {
         }
 
         rule_resolve_goto(rule_file);
+        rule_file_build_prefilter(rule_file);
         return 0;
 }
 
@@ -1294,6 +1393,47 @@ UdevRules* udev_rules_new(ResolveNameTiming resolve_name_timing) {
         return rules;
 }
 
+#define SOURCES_HASH_KEY SD_ID128_MAKE(3f,a1,6c,0e,92,d4,4b,57,b8,19,e6,2a,7d,c0,55,8b)
+
+static void sources_hash_stat(const char *path, struct siphash *state) {
+        struct stat st;
+
+        siphash24_compress(path, strlen(path) + 1, state);
+
+        if (stat(path, &st) < 0) {
+                siphash24_compress(&errno, sizeof(errno), state);
+                return;
+        }
+
+        siphash24_compress(&st.st_dev, sizeof(st.st_dev), state);
+        siphash24_compress(&st.st_ino, sizeof(st.st_ino), state);
+        siphash24_compress(&st.st_size, sizeof(st.st_size), state);
+        siphash24_compress_usec_t(timespec_load_nsec(&st.st_mtim), state);
+}
+
+/* Identifies the input the rules were built from: the list of rules files with their inode, size and mtime,
+ * and everything else parsing depends on. */
+static uint64_t rules_sources_hash(char **files, ResolveNameTiming resolve_name_timing) {
+        struct siphash state;
+        uint32_t n = _TK_TYPE_MAX;
+        char **f;
+
+        siphash24_init(&state, SOURCES_HASH_KEY.bytes);
+        siphash24_compress(&n, sizeof(n), &state);
+        siphash24_compress(&resolve_name_timing, sizeof(resolve_name_timing), &state);
+
+        STRV_FOREACH(f, files)
+                sources_hash_stat(*f, &state);
+
+        /* With early name resolution, OWNER= and GROUP= are turned into numeric IDs while parsing */
+        if (resolve_name_timing == RESOLVE_NAME_EARLY) {
+                sources_hash_stat("/etc/passwd", &state);
+                sources_hash_stat("/etc/group", &state);
+        }
+
+        return siphash24_finalize(&state);
+}
+
 int udev_rules_load(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing) {
         _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
         _cleanup_strv_free_ char **files = NULL;
@@ -1310,6 +1450,11 @@ int udev_rules_load(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing
         if (r < 0)
                 return log_debug_errno(r, "Failed to enumerate rules files: %m");
 
+        /* Calculated before the files are read, so that changes made while parsing invalidate the compiled
+         * rules written from the result. */
+        rules->sources_hash = rules_sources_hash(files, resolve_name_timing);
+        rules->sources_hash_set = true;
+
         STRV_FOREACH(f, files) {
                 r = udev_rules_parse_file(rules, *f);
                 if (r < 0)
@@ -1327,6 +1472,443 @@ bool udev_rules_check_timestamp(UdevRules *rules) {
         return paths_check_timestamp(RULES_DIRS, &rules->dirs_ts_usec, true);
 }
 
+/*** Compiled rules ***/
+
+/* The parsed rules can be stored in a binary file, so that they don't need to be parsed again as long as
+ * the rules files are unchanged. Each line is stored as the buffer parse_line() left behind, i.e. with its
+ * keys and values NUL terminated in place, and the tokens refer to their strings by offset into that
+ * buffer. All buffers are collected in a string table, the file is mmap()ed and used in place when
+ * loading, only the file, line and token objects are allocated. */
+
+#define UDEV_RULES_SIG { 'U', 'D', 'E', 'V', 'R', 'U', 'L', 'S' }
+
+struct udev_rules_header_f {
+        uint8_t signature[8];
+
+        /* version of tool which created the file */
+        le64_t tool_version;
+        le64_t file_size;
+
+        /* size of structures to allow them to grow */
+        le64_t header_size;
+        le64_t file_entry_size;
+        le64_t line_entry_size;
+        le64_t token_entry_size;
+
+        /* see rules_sources_hash() */
+        le64_t sources_hash;
+
+        le64_t files_off;
+        le64_t files_count;
+        le64_t lines_off;
+        le64_t lines_count;
+        le64_t tokens_off;
+        le64_t tokens_count;
+        le64_t strings_off;
+        le64_t strings_len;
+} _packed_;
+
+struct udev_rules_file_f {
+        le64_t filename_off;
+        le64_t lines_index;
+        le64_t lines_count;
+} _packed_;
+
+/* Offsets of the label, the GOTO label and of token strings are relative to the line buffer */
+#define COMPILED_OFF_NONE UINT64_MAX
+
+struct udev_rules_line_f {
+        le64_t line_off;
+        le64_t line_size;
+        le64_t label_off;
+        le64_t goto_label_off;
+        le64_t tokens_index;
+        le64_t tokens_count;
+        le32_t line_number;
+        le32_t type;
+} _packed_;
+
+struct udev_rules_token_f {
+        uint8_t type;
+        uint8_t op;
+        uint8_t match_type;
+        uint8_t attr_subst_type;
+        uint8_t attr_match_remove_trailing_whitespace;
+        uint8_t padding[3];
+        le64_t value_off;
+        /* an offset if token_data_is_string(), the integer stored in the pointer otherwise */
+        le64_t data;
+} _packed_;
+
+static bool token_data_is_string(UdevRuleTokenType type) {
+        return IN_SET(type, TK_M_ENV, TK_M_CONST, TK_M_ATTR, TK_M_SYSCTL, TK_M_PARENTS_ATTR,
+                      TK_A_SECLABEL, TK_A_ENV, TK_A_ATTR, TK_A_SYSCTL);
+}
+
+static int compiled_string_off(const UdevRuleLine *line, const char *str, uint64_t *ret) {
+        assert(line);
+        assert(ret);
+
+        if (!str) {
+                *ret = COMPILED_OFF_NONE;
+                return 0;
+        }
+
+        if (str < line->line || str >= line->line + line->line_size)
+                return -EINVAL;
+
+        *ret = str - line->line;
+        return 0;
+}
+
+static const char *compiled_string(const char *line, size_t line_size, le64_t off, bool *invalid) {
+        uint64_t o = le64toh(off);
+
+        if (o == COMPILED_OFF_NONE)
+                return NULL;
+
+        if (o >= line_size) {
+                *invalid = true;
+                return NULL;
+        }
+
+        return line + o;
+}
+
+int udev_rules_save_compiled(UdevRules *rules, const char *path) {
+        _cleanup_free_ struct udev_rules_file_f *files_f = NULL;
+        _cleanup_free_ struct udev_rules_line_f *lines_f = NULL;
+        _cleanup_free_ struct udev_rules_token_f *tokens_f = NULL;
+        _cleanup_(strbuf_cleanupp) struct strbuf *strings = NULL;
+        _cleanup_(unlink_and_freep) char *path_tmp = NULL;
+        size_t n_files = 0, n_lines = 0, n_tokens = 0, i_file = 0, i_line = 0, i_token = 0;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct udev_rules_header_f h;
+        UdevRuleFile *file;
+        UdevRuleLine *line;
+        UdevRuleToken *token;
+        ssize_t off;
+        int r;
+
+        assert(rules);
+        assert(path);
+
+        /* Without the hash of the rules files, the result could never be validated on load */
+        if (!rules->sources_hash_set)
+                return -ESTALE;
+
+        LIST_FOREACH(rule_files, file, rules->rule_files) {
+                n_files++;
+                LIST_FOREACH(rule_lines, line, file->rule_lines) {
+                        n_lines++;
+                        LIST_FOREACH(tokens, token, line->tokens)
+                                n_tokens++;
+                }
+        }
+
+        files_f = new0(struct udev_rules_file_f, MAX(n_files, 1u));
+        lines_f = new0(struct udev_rules_line_f, MAX(n_lines, 1u));
+        tokens_f = new0(struct udev_rules_token_f, MAX(n_tokens, 1u));
+        strings = strbuf_new();
+        if (!files_f || !lines_f || !tokens_f || !strings)
+                return -ENOMEM;
+
+        LIST_FOREACH(rule_files, file, rules->rule_files) {
+                off = strbuf_add_string(strings, file->filename, strlen(file->filename));
+                if (off < 0)
+                        return off;
+
+                files_f[i_file++] = (struct udev_rules_file_f) {
+                        .filename_off = htole64(off),
+                        .lines_index = htole64(i_line),
+                };
+
+                LIST_FOREACH(rule_lines, line, file->rule_lines) {
+                        struct udev_rules_line_f *l = lines_f + i_line++;
+                        uint64_t label_off, goto_label_off;
+
+                        /* All but the final NUL, strbuf_add_string() appends that one */
+                        off = strbuf_add_string(strings, line->line, line->line_size);
+                        if (off < 0)
+                                return off;
+
+                        *l = (struct udev_rules_line_f) {
+                                .line_off = htole64(off),
+                                .line_size = htole64(line->line_size),
+                                .tokens_index = htole64(i_token),
+                                .line_number = htole32(line->line_number),
+                                .type = htole32(line->type),
+                        };
+
+                        if (compiled_string_off(line, line->label, &label_off) < 0 ||
+                            compiled_string_off(line, line->goto_label, &goto_label_off) < 0)
+                                return -EINVAL;
+
+                        l->label_off = htole64(label_off);
+                        l->goto_label_off = htole64(goto_label_off);
+
+                        LIST_FOREACH(tokens, token, line->tokens) {
+                                struct udev_rules_token_f *t = tokens_f + i_token++;
+                                uint64_t value_off, data = (uintptr_t) token->data;
+
+                                if (compiled_string_off(line, token->value, &value_off) < 0)
+                                        return -EINVAL;
+                                if (token_data_is_string(token->type) &&
+                                    compiled_string_off(line, token->data, &data) < 0)
+                                        return -EINVAL;
+
+                                *t = (struct udev_rules_token_f) {
+                                        .type = token->type,
+                                        .op = token->op,
+                                        .match_type = (uint8_t) token->match_type,
+                                        .attr_subst_type = (uint8_t) token->attr_subst_type,
+                                        .attr_match_remove_trailing_whitespace = token->attr_match_remove_trailing_whitespace,
+                                        .value_off = htole64(value_off),
+                                        .data = htole64(data),
+                                };
+                        }
+
+                        l->tokens_count = htole64(i_token - le64toh(l->tokens_index));
+                }
+
+                files_f[i_file - 1].lines_count = htole64(i_line - le64toh(files_f[i_file - 1].lines_index));
+        }
+
+        h = (struct udev_rules_header_f) {
+                .signature = UDEV_RULES_SIG,
+                .tool_version = htole64(PROJECT_VERSION),
+                .header_size = htole64(sizeof(struct udev_rules_header_f)),
+                .file_entry_size = htole64(sizeof(struct udev_rules_file_f)),
+                .line_entry_size = htole64(sizeof(struct udev_rules_line_f)),
+                .token_entry_size = htole64(sizeof(struct udev_rules_token_f)),
+                .sources_hash = htole64(rules->sources_hash),
+                .files_off = htole64(sizeof(struct udev_rules_header_f)),
+                .files_count = htole64(n_files),
+                .lines_count = htole64(n_lines),
+                .tokens_count = htole64(n_tokens),
+                .strings_len = htole64(strings->len),
+        };
+        h.lines_off = htole64(le64toh(h.files_off) + n_files * sizeof(struct udev_rules_file_f));
+        h.tokens_off = htole64(le64toh(h.lines_off) + n_lines * sizeof(struct udev_rules_line_f));
+        h.strings_off = htole64(le64toh(h.tokens_off) + n_tokens * sizeof(struct udev_rules_token_f));
+        h.file_size = htole64(le64toh(h.strings_off) + strings->len);
+
+        r = fopen_temporary(path, &f, &path_tmp);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(files_f, sizeof(struct udev_rules_file_f), n_files, f);
+        fwrite(lines_f, sizeof(struct udev_rules_line_f), n_lines, f);
+        fwrite(tokens_f, sizeof(struct udev_rules_token_f), n_tokens, f);
+        fwrite(strings->buf, 1, strings->len, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (rename(path_tmp, path) < 0)
+                return -errno;
+
+        path_tmp = mfree(path_tmp);
+
+        log_debug("Wrote compiled rules to %s: %zu files, %zu lines, %zu tokens, %zu bytes of strings (%zu bytes deduplicated).",
+                  path, n_files, n_lines, n_tokens, strings->len, strings->dedup_len);
+        return 0;
+}
+
+static bool compiled_range_valid(const struct udev_rules_header_f *h, le64_t off, le64_t count, size_t size) {
+        uint64_t o = le64toh(off), n = le64toh(count);
+
+        return o <= le64toh(h->file_size) &&
+               n <= (le64toh(h->file_size) - o) / size;
+}
+
+int udev_rules_load_compiled(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing, const char *path) {
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+        _cleanup_strv_free_ char **files = NULL;
+        const struct udev_rules_header_f *h;
+        const struct udev_rules_file_f *files_f;
+        const struct udev_rules_line_f *lines_f;
+        const struct udev_rules_token_f *tokens_f;
+        const char sig[] = UDEV_RULES_SIG;
+        _cleanup_close_ int fd = -1;
+        uint64_t strings_len;
+        const char *strings;
+        struct stat st;
+        int r;
+
+        assert(ret_rules);
+        assert(path);
+
+        rules = udev_rules_new(resolve_name_timing);
+        if (!rules)
+                return -ENOMEM;
+
+        (void) udev_rules_check_timestamp(rules);
+
+        r = conf_files_list_strv(&files, ".rules", NULL, 0, RULES_DIRS);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to enumerate rules files: %m");
+
+        rules->sources_hash = rules_sources_hash(files, resolve_name_timing);
+        rules->sources_hash_set = true;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (st.st_size < (off_t) sizeof(struct udev_rules_header_f))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Compiled rules %s are too short.", path);
+
+        rules->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (rules->map == MAP_FAILED) {
+                rules->map = NULL;
+                return log_debug_errno(errno, "Failed to map %s: %m", path);
+        }
+        rules->map_size = st.st_size;
+
+        h = rules->map;
+        if (memcmp(h->signature, sig, sizeof(h->signature)) != 0 ||
+            le64toh(h->tool_version) != PROJECT_VERSION ||
+            le64toh(h->file_size) != (uint64_t) st.st_size ||
+            le64toh(h->header_size) != sizeof(struct udev_rules_header_f) ||
+            le64toh(h->file_entry_size) != sizeof(struct udev_rules_file_f) ||
+            le64toh(h->line_entry_size) != sizeof(struct udev_rules_line_f) ||
+            le64toh(h->token_entry_size) != sizeof(struct udev_rules_token_f))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Failed to recognize the format of %s.", path);
+
+        if (le64toh(h->sources_hash) != rules->sources_hash)
+                return log_debug_errno(SYNTHETIC_ERRNO(ESTALE), "Compiled rules %s are outdated.", path);
+
+        if (!compiled_range_valid(h, h->files_off, h->files_count, sizeof(struct udev_rules_file_f)) ||
+            !compiled_range_valid(h, h->lines_off, h->lines_count, sizeof(struct udev_rules_line_f)) ||
+            !compiled_range_valid(h, h->tokens_off, h->tokens_count, sizeof(struct udev_rules_token_f)) ||
+            !compiled_range_valid(h, h->strings_off, h->strings_len, 1))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Compiled rules %s are corrupted.", path);
+
+        files_f = (const struct udev_rules_file_f*) ((const uint8_t*) rules->map + le64toh(h->files_off));
+        lines_f = (const struct udev_rules_line_f*) ((const uint8_t*) rules->map + le64toh(h->lines_off));
+        tokens_f = (const struct udev_rules_token_f*) ((const uint8_t*) rules->map + le64toh(h->tokens_off));
+        strings = (const char*) rules->map + le64toh(h->strings_off);
+        strings_len = le64toh(h->strings_len);
+
+        /* Every string is followed by a NUL, hence the table must end in one */
+        if (strings_len == 0 || strings[strings_len - 1] != '\0')
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Compiled rules %s are corrupted.", path);
+
+        for (uint64_t i = 0; i < le64toh(h->files_count); i++) {
+                const struct udev_rules_file_f *ff = files_f + i;
+                uint64_t lines_index = le64toh(ff->lines_index), lines_count = le64toh(ff->lines_count);
+                UdevRuleFile *rule_file;
+
+                if (le64toh(ff->filename_off) >= strings_len ||
+                    lines_index > le64toh(h->lines_count) ||
+                    lines_count > le64toh(h->lines_count) - lines_index)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Compiled rules %s are corrupted.", path);
+
+                rule_file = new(UdevRuleFile, 1);
+                if (!rule_file)
+                        return -ENOMEM;
+
+                *rule_file = (UdevRuleFile) {
+                        .filename = strdup(strings + le64toh(ff->filename_off)),
+                        .mapped = true,
+                };
+
+                if (rules->current_file)
+                        LIST_APPEND(rule_files, rules->current_file, rule_file);
+                else
+                        LIST_APPEND(rule_files, rules->rule_files, rule_file);
+                rules->current_file = rule_file;
+
+                if (!rule_file->filename)
+                        return -ENOMEM;
+
+                for (uint64_t j = lines_index; j < lines_index + lines_count; j++) {
+                        const struct udev_rules_line_f *lf = lines_f + j;
+                        uint64_t line_off = le64toh(lf->line_off), line_size = le64toh(lf->line_size);
+                        uint64_t tokens_index = le64toh(lf->tokens_index), tokens_count = le64toh(lf->tokens_count);
+                        UdevRuleLine *rule_line;
+                        bool invalid = false;
+                        char *buf;
+
+                        if (line_off > strings_len || line_size == 0 || line_size >= strings_len - line_off ||
+                            tokens_index > le64toh(h->tokens_count) ||
+                            tokens_count > le64toh(h->tokens_count) - tokens_index)
+                                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Compiled rules %s are corrupted.", path);
+
+                        /* The map is read-only, but the rules never modify a line once it's parsed */
+                        buf = (char*) strings + line_off;
+
+                        rule_line = new(UdevRuleLine, 1);
+                        if (!rule_line)
+                                return -ENOMEM;
+
+                        *rule_line = (UdevRuleLine) {
+                                .line = buf,
+                                .line_size = line_size,
+                                .line_number = le32toh(lf->line_number),
+                                .type = le32toh(lf->type),
+                                .rule_file = rule_file,
+                                .label = compiled_string(buf, line_size, lf->label_off, &invalid),
+                                .goto_label = compiled_string(buf, line_size, lf->goto_label_off, &invalid),
+                        };
+
+                        if (rule_file->current_line)
+                                LIST_APPEND(rule_lines, rule_file->current_line, rule_line);
+                        else
+                                LIST_APPEND(rule_lines, rule_file->rule_lines, rule_line);
+                        rule_file->current_line = rule_line;
+
+                        for (uint64_t k = tokens_index; k < tokens_index + tokens_count; k++) {
+                                const struct udev_rules_token_f *tf = tokens_f + k;
+                                UdevRuleToken *token;
+
+                                if (tf->type >= _TK_TYPE_MAX || tf->op >= _OP_TYPE_MAX ||
+                                    (int8_t) tf->match_type < _MATCH_TYPE_INVALID ||
+                                    (int8_t) tf->match_type >= _MATCH_TYPE_MAX ||
+                                    (int8_t) tf->attr_subst_type < _SUBST_TYPE_INVALID ||
+                                    (int8_t) tf->attr_subst_type >= _SUBST_TYPE_MAX)
+                                        invalid = true;
+
+                                token = new(UdevRuleToken, 1);
+                                if (!token)
+                                        return -ENOMEM;
+
+                                *token = (UdevRuleToken) {
+                                        .type = tf->type,
+                                        .op = tf->op,
+                                        .match_type = (int8_t) tf->match_type,
+                                        .attr_subst_type = (int8_t) tf->attr_subst_type,
+                                        .attr_match_remove_trailing_whitespace = tf->attr_match_remove_trailing_whitespace,
+                                        .value = compiled_string(buf, line_size, tf->value_off, &invalid),
+                                        .data = token_data_is_string(tf->type) ?
+                                                (void*) compiled_string(buf, line_size, tf->data, &invalid) :
+                                                (void*) (uintptr_t) le64toh(tf->data),
+                                };
+
+                                rule_line_append_token(rule_line, token);
+                        }
+
+                        if (invalid)
+                                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Compiled rules %s are corrupted.", path);
+                }
+
+                rule_resolve_goto(rule_file);
+                rule_file_build_prefilter(rule_file);
+        }
+
+        log_debug("Loaded compiled rules from %s.", path);
+
+        *ret_rules = TAKE_PTR(rules);
+        return 0;
+}
+
 static bool token_match_string(UdevRuleToken *token, const char *str) {
         const char *i, *value;
         bool match = false;
@@ -2207,36 +2789,73 @@ static int udev_rule_apply_parent_token_to_event(
         }
 }
 
+static UdevRuleToken *udev_rule_line_prefilter(UdevRuleLine *line, const UdevRulePrefilter *prefilter) {
+        UdevRuleToken *token;
+
+        assert(line);
+        assert(prefilter);
+
+        /* Returns the first token which is known not to match without evaluating the line, or NULL */
+
+        if (!prefilter->enabled)
+                return NULL;
+
+        LIST_FOREACH(tokens, token, line->tokens) {
+                const char *val;
+
+                if (token->type > TK_M_DRIVER)
+                        break;
+
+                switch (token->type) {
+                case TK_M_ACTION:
+                        val = prefilter->action;
+                        break;
+                case TK_M_KERNEL:
+                        val = prefilter->sysname;
+                        break;
+                case TK_M_SUBSYSTEM:
+                        val = prefilter->subsystem;
+                        break;
+                case TK_M_DRIVER:
+                        val = prefilter->driver;
+                        break;
+                default:
+                        continue;
+                }
+
+                if (!token_match_string(token, val))
+                        return token;
+        }
+
+        return NULL;
+}
+
 static int udev_rule_apply_line_to_event(
                 UdevRules *rules,
                 UdevEvent *event,
                 usec_t timeout_usec,
                 int timeout_signal,
                 Hashmap *properties_list,
+                UdevRuleLineType mask,
+                const UdevRulePrefilter *prefilter,
                 UdevRuleLine **next_line) {
 
         UdevRuleLine *line = rules->current_file->current_line;
-        UdevRuleLineType mask = LINE_HAS_GOTO | LINE_UPDATE_SOMETHING;
         UdevRuleToken *token, *next_token;
         bool parents_done = false;
-        DeviceAction action;
         int r;
 
-        r = device_get_action(event->dev, &action);
-        if (r < 0)
-                return r;
-
-        if (action != DEVICE_ACTION_REMOVE) {
-                if (sd_device_get_devnum(event->dev, NULL) >= 0)
-                        mask |= LINE_HAS_DEVLINK;
-
-                if (sd_device_get_ifindex(event->dev, NULL) >= 0)
-                        mask |= LINE_HAS_NAME;
-        }
-
         if ((line->type & mask) == 0)
                 return 0;
 
+        token = udev_rule_line_prefilter(line, prefilter);
+        if (token) {
+                /* If the first match of a run of lines with the same match fails, all of them fail */
+                if (token == line->prefilter_token)
+                        *next_line = line->prefilter_run_end->rule_lines_next;
+                return 0;
+        }
+
         event->esc = ESCAPE_UNSET;
         LIST_FOREACH_SAFE(tokens, token, next_token, line->tokens) {
                 line->current_token = token;
@@ -2271,17 +2890,41 @@ int udev_rules_apply_to_event(
                 int timeout_signal,
                 Hashmap *properties_list) {
 
+        UdevRuleLineType mask = LINE_HAS_GOTO | LINE_UPDATE_SOMETHING;
+        UdevRulePrefilter prefilter = {};
         UdevRuleFile *file;
         UdevRuleLine *next_line;
+        DeviceAction action;
         int r;
 
         assert(rules);
         assert(event);
 
+        r = device_get_action(event->dev, &action);
+        if (r < 0)
+                return r;
+
+        if (action != DEVICE_ACTION_REMOVE) {
+                if (sd_device_get_devnum(event->dev, NULL) >= 0)
+                        mask |= LINE_HAS_DEVLINK;
+
+                if (sd_device_get_ifindex(event->dev, NULL) >= 0)
+                        mask |= LINE_HAS_NAME;
+        }
+
+        /* If any of these can't be determined, let the tokens deal with it, so that errors are reported as
+         * before. */
+        prefilter.action = device_action_to_string(action);
+        prefilter.enabled =
+                sd_device_get_sysname(event->dev, &prefilter.sysname) >= 0 &&
+                IN_SET(sd_device_get_subsystem(event->dev, &prefilter.subsystem), 0, -ENOENT) &&
+                IN_SET(sd_device_get_driver(event->dev, &prefilter.driver), 0, -ENOENT);
+
         LIST_FOREACH(rule_files, file, rules->rule_files) {
                 rules->current_file = file;
                 LIST_FOREACH_SAFE(rule_lines, file->current_line, next_line, file->rule_lines) {
-                        r = udev_rule_apply_line_to_event(rules, event, timeout_usec, timeout_signal, properties_list, &next_line);
+                        r = udev_rule_apply_line_to_event(rules, event, timeout_usec, timeout_signal, properties_list,
+                                                          mask, &prefilter, &next_line);
                         if (r < 0)
                                 return r;
                 }
@@ -5,6 +5,8 @@
 #include "time-util.h"
 #include "udev-util.h"
 
+#define UDEV_RULES_COMPILED_PATH "/run/udev/rules.bin"
+
 typedef struct UdevRules UdevRules;
 typedef struct UdevEvent UdevEvent;
 
@@ -19,6 +21,8 @@ typedef enum {
 int udev_rules_parse_file(UdevRules *rules, const char *filename);
 UdevRules* udev_rules_new(ResolveNameTiming resolve_name_timing);
 int udev_rules_load(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing);
+int udev_rules_save_compiled(UdevRules *rules, const char *path);
+int udev_rules_load_compiled(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing, const char *path);
 UdevRules *udev_rules_free(UdevRules *rules);
 DEFINE_TRIVIAL_CLEANUP_FUNC(UdevRules*, udev_rules_free);
 
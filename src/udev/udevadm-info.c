@@ -12,6 +12,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-db-snapshot.h"
 #include "device-enumerator-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -247,9 +248,10 @@ static void cleanup_dir(DIR *dir, mode_t mask, int depth) {
 }
 
 static void cleanup_db(void) {
-        _cleanup_closedir_ DIR *dir1 = NULL, *dir2 = NULL, *dir3 = NULL, *dir4 = NULL, *dir5 = NULL;
+        _cleanup_closedir_ DIR *dir1 = NULL, *dir2 = NULL, *dir3 = NULL, *dir4 = NULL, *dir5 = NULL, *dir6 = NULL;
 
         (void) unlink("/run/udev/queue.bin");
+        (void) device_db_snapshot_setup("/run/udev", false);
 
         dir1 = opendir("/run/udev/data");
         if (dir1)
@@ -270,6 +272,10 @@ static void cleanup_db(void) {
         dir5 = opendir("/run/udev/watch");
         if (dir5)
                 cleanup_dir(dir5, 0, 1);
+
+        dir6 = opendir("/run/udev/blkid");
+        if (dir6)
+                cleanup_dir(dir6, 0, 1);
 }
 
 static int query_device(QueryType query, sd_device* device) {
@@ -123,7 +123,10 @@ int test_main(int argc, char *argv[], void *userdata) {
 
         udev_builtin_init();
 
-        r = udev_rules_load(&rules, arg_resolve_name_timing);
+        /* Use the rules compiled by udevd if they are up-to-date, but never write them from here */
+        r = udev_rules_load_compiled(&rules, arg_resolve_name_timing, UDEV_RULES_COMPILED_PATH);
+        if (r < 0)
+                r = udev_rules_load(&rules, arg_resolve_name_timing);
         if (r < 0) {
                 log_error_errno(r, "Failed to read udev rules: %m");
                 goto out;
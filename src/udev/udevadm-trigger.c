@@ -10,6 +10,8 @@
 #include "device-private.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "id128-util.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "set.h"
@@ -23,12 +25,58 @@
 static bool arg_verbose = false;
 static bool arg_dry_run = false;
 
-static int exec_list(sd_device_enumerator *e, const char *action, Set **settle_set) {
+typedef struct SettleContext {
+        sd_event *event;
+
+        /* the UUIDs of the events we wait for, or their syspaths if the kernel doesn't support UUIDs */
+        Set *set;
+        bool use_uuid;
+
+        unsigned max_in_flight;
+        bool triggered;
+
+        size_t n_settled;
+        usec_t start_usec;
+} SettleContext;
+
+static int write_uevent(const char *filename, const char *action, SettleContext *settle, char uuid[static ID128_UUID_STRING_MAX]) {
+        sd_id128_t id;
+        const char *s;
+        int r;
+
+        assert(filename);
+        assert(action);
+
+        if (!settle || !settle->use_uuid)
+                return write_string_file(filename, action, WRITE_STRING_FILE_DISABLE_BUFFER);
+
+        /* The kernel adds the UUID as SYNTH_UUID= to the uevent, which identifies the resulting event */
+        r = sd_id128_randomize(&id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to generate UUID: %m");
+
+        s = strjoina(action, " ", id128_to_uuid_string(id, uuid));
+        r = write_string_file(filename, s, WRITE_STRING_FILE_DISABLE_BUFFER);
+        if (r != -EINVAL)
+                return r;
+
+        /* Kernels before 4.13 refuse any arguments */
+        r = write_string_file(filename, action, WRITE_STRING_FILE_DISABLE_BUFFER);
+        if (r < 0)
+                return r;
+
+        log_debug("Kernel does not support synthetic uevent arguments, waiting for events by their syspath.");
+        settle->use_uuid = false;
+        return 0;
+}
+
+static int exec_list(sd_device_enumerator *e, const char *action, SettleContext *settle) {
         sd_device *d;
         int r, ret = 0;
 
         FOREACH_DEVICE_AND_SUBSYSTEM(e, d) {
                 _cleanup_free_ char *filename = NULL;
+                char uuid[ID128_UUID_STRING_MAX];
                 const char *syspath;
 
                 if (sd_device_get_syspath(d, &syspath) < 0)
@@ -43,7 +91,7 @@ static int exec_list(sd_device_enumerator *e, const char *action, Set **settle_s
                 if (!filename)
                         return log_oom();
 
-                r = write_string_file(filename, action, WRITE_STRING_FILE_DISABLE_BUFFER);
+                r = write_uevent(filename, action, settle, uuid);
                 if (r < 0) {
                         bool ignore = IN_SET(r, -ENOENT, -EACCES, -ENODEV, -EROFS);
 
@@ -57,10 +105,17 @@ static int exec_list(sd_device_enumerator *e, const char *action, Set **settle_s
                         continue;
                 }
 
-                if (settle_set) {
-                        r = set_put_strdup(settle_set, syspath);
+                if (settle) {
+                        r = set_put_strdup(&settle->set, settle->use_uuid ? uuid : syspath);
                         if (r < 0)
                                 return log_oom();
+
+                        /* Do not let more events than requested pile up in the queue of udevd */
+                        while (settle->max_in_flight > 0 && set_size(settle->set) >= settle->max_in_flight) {
+                                r = sd_event_run(settle->event, UINT64_MAX);
+                                if (r < 0)
+                                        return log_error_errno(r, "Failed to wait for triggered events: %m");
+                        }
                 }
         }
 
@@ -69,23 +124,33 @@ static int exec_list(sd_device_enumerator *e, const char *action, Set **settle_s
 
 static int device_monitor_handler(sd_device_monitor *m, sd_device *dev, void *userdata) {
         _cleanup_free_ char *val = NULL;
-        Set *settle_set = userdata;
-        const char *syspath;
+        SettleContext *settle = userdata;
+        const char *syspath, *uuid;
 
         assert(dev);
-        assert(settle_set);
+        assert(settle);
 
         if (sd_device_get_syspath(dev, &syspath) < 0)
                 return 0;
 
+        if (settle->use_uuid) {
+                if (sd_device_get_property_value(dev, "SYNTH_UUID", &uuid) < 0)
+                        return 0;
+
+                val = set_remove(settle->set, uuid);
+        } else
+                val = set_remove(settle->set, syspath);
+        if (!val) {
+                log_debug("Got uevent for %s not triggered by us, ignoring.", syspath);
+                return 0;
+        }
+
+        settle->n_settled++;
+
         if (arg_verbose)
                 printf("settle %s\n", syspath);
 
-        val = set_remove(settle_set, syspath);
-        if (!val)
-                log_debug("Got epoll event on syspath %s not present in syspath set", syspath);
-
-        if (set_isempty(settle_set))
+        if (settle->triggered && set_isempty(settle->set))
                 return sd_event_exit(sd_device_monitor_get_event(m), 0);
 
         return 0;
@@ -131,6 +196,8 @@ static int help(void) {
                "     --name-match=NAME              Trigger devices with this /dev name\n"
                "  -b --parent-match=NAME            Trigger devices with that parent device\n"
                "  -w --settle                       Wait for the triggered events to complete\n"
+               "     --max-in-flight=NUMBER         With --settle, wait for events to complete\n"
+               "                                    before triggering more than NUMBER at once\n"
                "     --wait-daemon[=SECONDS]        Wait for udevd daemon to be initialized\n"
                "                                    before triggering uevents\n"
                , program_invocation_short_name);
@@ -142,6 +209,7 @@ int trigger_main(int argc, char *argv[], void *userdata) {
         enum {
                 ARG_NAME = 0x100,
                 ARG_PING,
+                ARG_MAX_IN_FLIGHT,
         };
 
         static const struct option options[] = {
@@ -160,6 +228,7 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 { "parent-match",      required_argument, NULL, 'b'      },
                 { "settle",            no_argument,       NULL, 'w'      },
                 { "wait-daemon",       optional_argument, NULL, ARG_PING },
+                { "max-in-flight",     required_argument, NULL, ARG_MAX_IN_FLIGHT },
                 { "version",           no_argument,       NULL, 'V'      },
                 { "help",              no_argument,       NULL, 'h'      },
                 {}
@@ -175,6 +244,8 @@ int trigger_main(int argc, char *argv[], void *userdata) {
         _cleanup_set_free_ Set *settle_set = NULL;
         usec_t ping_timeout_usec = 5 * USEC_PER_SEC;
         bool settle = false, ping = false;
+        unsigned max_in_flight = 0;
+        SettleContext ctx = {};
         int c, r;
 
         if (running_in_chroot() > 0) {
@@ -302,6 +373,12 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                         break;
                 }
 
+                case ARG_MAX_IN_FLIGHT:
+                        r = safe_atou(optarg, &max_in_flight);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse maximum number of events in flight '%s': %m", optarg);
+                        break;
+
                 case 'V':
                         return print_version();
                 case 'h':
@@ -313,6 +390,9 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 }
         }
 
+        if (max_in_flight > 0 && !settle)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "--max-in-flight= requires --settle.");
+
         if (ping) {
                 _cleanup_(udev_ctrl_unrefp) struct udev_ctrl *uctrl = NULL;
 
@@ -358,7 +438,15 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to attach event to device monitor: %m");
 
-                r = sd_device_monitor_start(m, device_monitor_handler, settle_set);
+                ctx = (SettleContext) {
+                        .event = event,
+                        .set = settle_set,
+                        .use_uuid = true,
+                        .max_in_flight = max_in_flight,
+                        .start_usec = now(CLOCK_MONOTONIC),
+                };
+
+                r = sd_device_monitor_start(m, device_monitor_handler, &ctx);
                 if (r < 0)
                         return log_error_errno(r, "Failed to start device monitor: %m");
         }
@@ -378,15 +466,27 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 assert_not_reached("Unknown device type");
         }
 
-        r = exec_list(e, action, settle ? &settle_set : NULL);
+        r = exec_list(e, action, settle ? &ctx : NULL);
         if (r < 0)
                 return r;
 
         if (event && !set_isempty(settle_set)) {
+                ctx.triggered = true;
+
                 r = sd_event_loop(event);
                 if (r < 0)
                         return log_error_errno(r, "Event loop failed: %m");
         }
 
+        if (settle && arg_verbose) {
+                char buf[FORMAT_TIMESPAN_MAX];
+                usec_t t;
+
+                t = now(CLOCK_MONOTONIC) - ctx.start_usec;
+                printf("Settled %zu events in %s (%.1f events/s).\n", ctx.n_settled,
+                       format_timespan(buf, sizeof(buf), t, USEC_PER_MSEC),
+                       (double) ctx.n_settled * USEC_PER_SEC / MAX(t, (usec_t) 1));
+        }
+
         return 0;
 }
@@ -32,6 +32,7 @@
 #include "cgroup-util.h"
 #include "cpu-set-util.h"
 #include "dev-setup.h"
+#include "device-db-snapshot.h"
 #include "device-monitor-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -48,6 +49,7 @@
 #include "main-func.h"
 #include "mkdir.h"
 #include "netlink-util.h"
+#include "ordered-set.h"
 #include "parse-util.h"
 #include "pretty-print.h"
 #include "proc-cmdline.h"
@@ -77,11 +79,13 @@ static usec_t arg_exec_delay_usec = 0;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static int arg_timeout_signal = SIGKILL;
 static bool arg_blockdev_read_only = false;
+static bool arg_db_snapshot = false;
 
 typedef struct Manager {
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(struct event, events);
+        Hashmap *events_by_key; /* dependency key → OrderedSet of queued events, see event_build_keys() */
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -99,6 +103,7 @@ typedef struct Manager {
         sd_event_source *kill_workers_event;
 
         usec_t last_usec;
+        uint64_t db_snapshot_generation; /* of the last /run/udev/data.bin we wrote */
 
         bool stop_exec_queue:1;
         bool exit:1;
@@ -121,6 +126,9 @@ struct event {
         uint64_t seqnum;
         uint64_t delaying_seqnum;
 
+        char **index_keys; /* the keys this event is found under in events_by_key */
+        char **lookup_keys; /* the keys of the events this event depends on */
+
         sd_event_source *timeout_warning_event;
         sd_event_source *timeout_event;
 
@@ -148,6 +156,28 @@ struct worker {
 struct worker_message {
 };
 
+static void event_unindex(struct event *event) {
+        Manager *manager = event->manager;
+        char **k;
+
+        STRV_FOREACH(k, event->index_keys) {
+                OrderedSet *events;
+                char *key;
+
+                events = hashmap_get2(manager->events_by_key, *k, (void**) &key);
+                if (!events)
+                        continue;
+
+                (void) ordered_set_remove(events, event);
+                if (!ordered_set_isempty(events))
+                        continue;
+
+                assert_se(hashmap_remove(manager->events_by_key, key) == events);
+                ordered_set_free(events);
+                free(key);
+        }
+}
+
 static void event_free(struct event *event) {
         if (!event)
                 return;
@@ -155,6 +185,9 @@ static void event_free(struct event *event) {
         assert(event->manager);
 
         LIST_REMOVE(event, event->manager->events, event);
+        event_unindex(event);
+        strv_free(event->index_keys);
+        strv_free(event->lookup_keys);
         sd_device_unref(event->dev);
         sd_device_unref(event->dev_kernel);
 
@@ -283,7 +316,18 @@ static void manager_clear_for_worker(Manager *manager) {
         manager->event = sd_event_unref(manager->event);
 
         manager->workers = hashmap_free(manager->workers);
-        event_queue_cleanup(manager, EVENT_UNDEF);
+
+        if (manager->pid == getpid_cached()) {
+                event_queue_cleanup(manager, EVENT_UNDEF);
+                manager->events_by_key = hashmap_free(manager->events_by_key);
+        } else {
+                /* In a worker, forget about the queued events instead of freeing them. They still belong to
+                 * the main process, and freeing them here would only make the kernel copy every page they
+                 * live on. With a long queue, e.g. during coldplug, that takes far longer than the fork
+                 * itself. */
+                LIST_HEAD_INIT(manager->events);
+                manager->events_by_key = NULL;
+        }
 
         manager->monitor = sd_device_monitor_unref(manager->monitor);
         manager->ctrl = udev_ctrl_unref(manager->ctrl);
@@ -663,6 +707,142 @@ static void event_run(Manager *manager, struct event *event) {
         worker_spawn(manager, event);
 }
 
+/* An event has to wait for all earlier events of the same device, of its parent and child devices, of
+ * devices with the same device number or network interface index, and of the device it was renamed
+ * from. Each of these relations is expressed as a key: an event is indexed under the keys of its own
+ * device number, interface index and devpath, plus a key for each of its parent devpaths, so that an event
+ * for a parent can find it. It then looks up the keys it conflicts with, and only needs to check the
+ * first, i.e. oldest, event found under each. */
+static int event_build_keys(struct event *event) {
+        _cleanup_strv_free_ char **index_keys = NULL, **lookup_keys = NULL;
+        const char *subsystem, *devpath, *devpath_old = NULL;
+        dev_t devnum = makedev(0, 0);
+        int r, ifindex = 0;
+
+        r = sd_device_get_subsystem(event->dev, &subsystem);
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_devpath(event->dev, &devpath);
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_property_value(event->dev, "DEVPATH_OLD", &devpath_old);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        r = sd_device_get_devnum(event->dev, &devnum);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        r = sd_device_get_ifindex(event->dev, &ifindex);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        if (major(devnum) != 0) {
+                char *k;
+
+                if (asprintf(&k, "devnum:%c%u:%u", streq(subsystem, "block") ? 'b' : 'c', major(devnum), minor(devnum)) < 0)
+                        return -ENOMEM;
+                if (strv_consume(&index_keys, k) < 0)
+                        return -ENOMEM;
+        }
+
+        if (ifindex > 0) {
+                char *k;
+
+                if (asprintf(&k, "ifindex:%i", ifindex) < 0)
+                        return -ENOMEM;
+                if (strv_consume(&index_keys, k) < 0)
+                        return -ENOMEM;
+        }
+
+        if (strv_consume(&index_keys, strjoin("devpath:", devpath)) < 0)
+                return -ENOMEM;
+
+        /* Devices with the same device number, interface index or devpath depend on each other */
+        lookup_keys = strv_copy(index_keys);
+        if (!lookup_keys)
+                return -ENOMEM;
+
+        if (devpath_old &&
+            strv_consume(&lookup_keys, strjoin("devpath:", devpath_old)) < 0)
+                return -ENOMEM;
+
+        /* Children of the device */
+        if (strv_consume(&lookup_keys, strjoin("parent:", devpath)) < 0)
+                return -ENOMEM;
+
+        for (const char *p = strchr(devpath + 1, '/'); p; p = strchr(p + 1, '/')) {
+                _cleanup_free_ char *parent = NULL;
+
+                parent = strndup(devpath, p - devpath);
+                if (!parent)
+                        return -ENOMEM;
+
+                /* This is a child of the parent device, hence an event for the parent finds us here… */
+                if (strv_consume(&index_keys, strjoin("parent:", parent)) < 0)
+                        return -ENOMEM;
+
+                /* …and we find the events for the parent device here */
+                if (strv_consume(&lookup_keys, strjoin("devpath:", parent)) < 0)
+                        return -ENOMEM;
+        }
+
+        event->index_keys = TAKE_PTR(index_keys);
+        event->lookup_keys = TAKE_PTR(lookup_keys);
+        return 0;
+}
+
+static int event_index(Manager *manager, struct event *event) {
+        char **k;
+        int r;
+
+        assert(manager);
+        assert(event);
+
+        r = event_build_keys(event);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&manager->events_by_key, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(k, event->index_keys) {
+                OrderedSet *events;
+
+                events = hashmap_get(manager->events_by_key, *k);
+                if (!events) {
+                        _cleanup_free_ char *key = NULL;
+
+                        key = strdup(*k);
+                        if (!key)
+                                return -ENOMEM;
+
+                        events = ordered_set_new(NULL);
+                        if (!events)
+                                return -ENOMEM;
+
+                        r = hashmap_put(manager->events_by_key, key, events);
+                        if (r < 0) {
+                                ordered_set_free(events);
+                                return r;
+                        }
+
+                        TAKE_PTR(key);
+                }
+
+                /* Events are queued in the order of their sequence numbers, hence the first event in each
+                 * set is the oldest one */
+                r = ordered_set_put(events, event);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int event_queue_insert(Manager *manager, sd_device *dev) {
         _cleanup_(sd_device_unrefp) sd_device *clone = NULL;
         struct event *event;
@@ -715,6 +895,12 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
 
         LIST_APPEND(event, manager->events, event);
 
+        r = event_index(manager, event);
+        if (r < 0) {
+                event_free(event);
+                return r;
+        }
+
         log_device_debug(dev, "Device (SEQNUM=%"PRIu64", ACTION=%s) is queued",
                          seqnum, device_action_to_string(action));
 
@@ -736,113 +922,33 @@ static void manager_kill_workers(Manager *manager) {
 }
 
 /* lookup event for identical, parent, child device */
-static int is_device_busy(Manager *manager, struct event *event) {
-        const char *subsystem, *devpath, *devpath_old = NULL;
-        dev_t devnum = makedev(0, 0);
+static bool is_device_busy(Manager *manager, struct event *event) {
         struct event *loop_event;
-        size_t devpath_len;
-        int r, ifindex = 0;
-        bool is_block;
-
-        r = sd_device_get_subsystem(event->dev, &subsystem);
-        if (r < 0)
-                return r;
-
-        is_block = streq(subsystem, "block");
-
-        r = sd_device_get_devpath(event->dev, &devpath);
-        if (r < 0)
-                return r;
-
-        devpath_len = strlen(devpath);
-
-        r = sd_device_get_property_value(event->dev, "DEVPATH_OLD", &devpath_old);
-        if (r < 0 && r != -ENOENT)
-                return r;
-
-        r = sd_device_get_devnum(event->dev, &devnum);
-        if (r < 0 && r != -ENOENT)
-                return r;
-
-        r = sd_device_get_ifindex(event->dev, &ifindex);
-        if (r < 0 && r != -ENOENT)
-                return r;
-
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                size_t loop_devpath_len, common;
-                const char *loop_devpath;
-
-                /* we already found a later event, earlier cannot block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
-
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
-
-                /* check major/minor */
-                if (major(devnum) != 0) {
-                        const char *s;
-                        dev_t d;
-
-                        if (sd_device_get_subsystem(loop_event->dev, &s) < 0)
-                                continue;
-
-                        if (sd_device_get_devnum(loop_event->dev, &d) >= 0 &&
-                            devnum == d && is_block == streq(s, "block"))
-                                goto set_delaying_seqnum;
-                }
+        char **k;
 
-                /* check network device ifindex */
-                if (ifindex > 0) {
-                        int i;
+        STRV_FOREACH(k, event->lookup_keys) {
+                OrderedSet *events;
 
-                        if (sd_device_get_ifindex(loop_event->dev, &i) >= 0 &&
-                            ifindex == i)
-                                goto set_delaying_seqnum;
-                }
-
-                if (sd_device_get_devpath(loop_event->dev, &loop_devpath) < 0)
+                events = hashmap_get(manager->events_by_key, *k);
+                if (!events)
                         continue;
 
-                /* check our old name */
-                if (devpath_old && streq(devpath_old, loop_devpath))
-                        goto set_delaying_seqnum;
-
-                loop_devpath_len = strlen(loop_devpath);
-
-                /* compare devpath */
-                common = MIN(devpath_len, loop_devpath_len);
-
-                /* one devpath is contained in the other? */
-                if (!strneq(devpath, loop_devpath, common))
-                        continue;
-
-                /* identical device event found */
-                if (devpath_len == loop_devpath_len)
-                        goto set_delaying_seqnum;
-
-                /* parent device event found */
-                if (devpath[common] == '/')
-                        goto set_delaying_seqnum;
-
-                /* child device event found */
-                if (loop_devpath[common] == '/')
-                        goto set_delaying_seqnum;
+                loop_event = ordered_set_first(events);
+                if (loop_event && loop_event->seqnum < event->seqnum)
+                        goto delayed;
         }
 
         return false;
 
-set_delaying_seqnum:
-        log_device_debug(event->dev, "SEQNUM=%" PRIu64 " blocked by SEQNUM=%" PRIu64,
-                         event->seqnum, loop_event->seqnum);
+delayed:
+        /* Only log when the blocking event changes, this is checked every time the queue is processed */
+        if (loop_event->seqnum != event->delaying_seqnum) {
+                log_device_debug(event->dev, "SEQNUM=%" PRIu64 " blocked by SEQNUM=%" PRIu64,
+                                 event->seqnum, loop_event->seqnum);
+
+                event->delaying_seqnum = loop_event->seqnum;
+        }
 
-        event->delaying_seqnum = loop_event->seqnum;
         return true;
 }
 
@@ -897,6 +1003,29 @@ static int on_kill_workers_event(sd_event_source *s, uint64_t usec, void *userda
         return 1;
 }
 
+static int manager_load_rules(Manager *manager) {
+        int r;
+
+        assert(manager);
+
+        r = udev_rules_load_compiled(&manager->rules, arg_resolve_name_timing, UDEV_RULES_COMPILED_PATH);
+        if (r >= 0)
+                return 0;
+        if (!IN_SET(r, -ENOENT, -ESTALE))
+                log_debug_errno(r, "Failed to load compiled udev rules, parsing rules files: %m");
+
+        r = udev_rules_load(&manager->rules, arg_resolve_name_timing);
+        if (r < 0)
+                return r;
+
+        /* Written for the next start or reload, as long as the rules files stay unchanged */
+        r = udev_rules_save_compiled(manager->rules, UDEV_RULES_COMPILED_PATH);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write compiled udev rules to %s, ignoring: %m", UDEV_RULES_COMPILED_PATH);
+
+        return 0;
+}
+
 static void event_queue_start(Manager *manager) {
         struct event *event;
         usec_t usec;
@@ -926,7 +1055,7 @@ static void event_queue_start(Manager *manager) {
         udev_builtin_init();
 
         if (!manager->rules) {
-                r = udev_rules_load(&manager->rules, arg_resolve_name_timing);
+                r = manager_load_rules(manager);
                 if (r < 0) {
                         log_warning_errno(r, "Failed to read udev rules: %m");
                         return;
@@ -938,7 +1067,7 @@ static void event_queue_start(Manager *manager) {
                         continue;
 
                 /* do not start event if parent or child event is still running */
-                if (is_device_busy(manager, event) != 0)
+                if (is_device_busy(manager, event))
                         continue;
 
                 event_run(manager, event);
@@ -1402,12 +1531,20 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
 
 static int on_post(sd_event_source *s, void *userdata) {
         Manager *manager = userdata;
+        int r;
 
         assert(manager);
 
         if (!LIST_IS_EMPTY(manager->events))
                 return 1;
 
+        if (arg_db_snapshot) {
+                /* All events are done, hence nothing changes the database right now */
+                r = device_db_snapshot_update("/run/udev", &manager->db_snapshot_generation);
+                if (r < 0 && r != -EAGAIN)
+                        log_debug_errno(r, "Failed to update device database snapshot, ignoring: %m");
+        }
+
         /* There are no pending events. Let's cleanup idle process. */
 
         if (!hashmap_isempty(manager->workers)) {
@@ -1472,6 +1609,7 @@ static int listen_fds(int *ret_ctrl, int *ret_netlink) {
  *   udev.exec_delay=<number of seconds>       delay execution of every executed program
  *   udev.event_timeout=<number of seconds>    seconds to wait before terminating an event
  *   udev.blockdev_read_only<=bool>            mark all block devices read-only when they appear
+ *   udev.db_snapshot<=bool>                   publish a snapshot of the device database in /run/udev/data.bin
  */
 static int parse_proc_cmdline_item(const char *key, const char *value, void *data) {
         int r;
@@ -1534,6 +1672,20 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
 
                 return 0;
 
+        } else if (proc_cmdline_key_streq(key, "udev.db_snapshot")) {
+
+                if (!value)
+                        arg_db_snapshot = true;
+                else {
+                        r = parse_boolean(value);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to parse udev.db_snapshot argument, ignoring: %s", value);
+                        else
+                                arg_db_snapshot = r;
+                }
+
+                return 0;
+
         } else {
                 if (startswith(key, "udev."))
                         log_warning("Unknown udev kernel command line option \"%s\", ignoring.", key);
@@ -1669,6 +1821,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 .fd_inotify = -1,
                 .worker_watch = { -1, -1 },
                 .cgroup = cgroup,
+                .db_snapshot_generation = UINT64_MAX,
         };
 
         r = udev_ctrl_new_from_fd(&manager->ctrl, fd_ctrl);
@@ -1722,6 +1875,12 @@ static int main_loop(Manager *manager) {
                 return log_error_errno(r, "Failed to create inotify descriptor: %m");
         manager->fd_inotify = r;
 
+        /* Before any worker is forked, they must find the counter they increase on database changes */
+        r = device_db_snapshot_setup("/run/udev", arg_db_snapshot);
+        if (r < 0)
+                log_warning_errno(r, "Failed to %s device database snapshot, ignoring: %m",
+                                  arg_db_snapshot ? "set up" : "remove");
+
         udev_watch_restore();
 
         /* block and listen to all signals on signalfd */
@@ -1791,7 +1950,7 @@ static int main_loop(Manager *manager) {
 
         udev_builtin_init();
 
-        r = udev_rules_load(&manager->rules, arg_resolve_name_timing);
+        r = manager_load_rules(manager);
         if (!manager->rules)
                 return log_error_errno(r, "Failed to read udev rules: %m");
 
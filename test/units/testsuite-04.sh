@@ -35,6 +35,15 @@ journalctl --sync
 journalctl -b -o cat -t "$ID" >/output
 cmp /expected /output
 
+# A half-written line is flushed when another process writes to the same stream, and neither that line
+# nor the next one lose any characters
+ID=$(journalctl --new-id128 | sed -n 2p)
+printf $'first\nsecond\n' >/expected
+systemd-cat -t "$ID" --level-prefix false bash -c 'printf first; sleep 0.5; bash -c "echo second"; true'
+journalctl --sync
+journalctl -b -o cat -t "$ID" >/output
+cmp /expected /output
+
 # Don't remove leading spaces
 ID=$(journalctl --new-id128 | sed -n 2p)
 printf $' \t Leading spaces\n'>/expected
@@ -121,4 +130,23 @@ sleep 3
 # https://github.com/systemd/systemd/issues/15528
 journalctl --follow --file=/var/log/journal/*/* | head -n1 || [[ $? -eq 1 ]]
 
+# Nothing gets lost or reordered with ThreadedWrites=yes, also not across rotations
+mkdir -p /run/systemd/journald.conf.d
+printf '[Journal]\nThreadedWrites=yes\n' >/run/systemd/journald.conf.d/threaded.conf
+systemctl restart systemd-journald
+
+ID=$(journalctl --new-id128 | sed -n 2p)
+seq 1 2000 >/expected
+seq 1 2000 | systemd-cat -t "$ID" --level-prefix false &
+for i in 1 2 3; do
+    journalctl --rotate
+done
+wait %%
+journalctl --sync
+journalctl -b -o cat -t "$ID" >/output
+cmp /expected /output
+
+rm /run/systemd/journald.conf.d/threaded.conf
+systemctl restart systemd-journald
+
 touch /testok